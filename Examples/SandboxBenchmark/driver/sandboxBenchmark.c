@@ -0,0 +1,446 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+// Runs the operations of a workload file (see ../workload.txt) in a scratch directory and writes how long each took, so that a run
+// under a sandbox can be compared with an unsandboxed run of the same workload on the same machine:
+//
+//   sandboxBenchmark <workload file> <scratch directory> <results file>
+//   sandboxBenchmark --compare <baseline results file> <results file>
+//
+// Every operation first sets up what it needs (untimed), then times 'count' repetitions of the operation itself.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#define PATH_SEPARATOR "\\"
+#else
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#define PATH_SEPARATOR "/"
+extern char **environ;
+#endif
+
+#define MAX_PATH_LENGTH 4096
+#define MAX_OPERATIONS  64
+#define MAX_SPAWN_WIDTH 64
+
+static const char *g_self;
+static char g_buffer[1 << 16];
+
+static uint64_t now_ns(void)
+{
+#ifdef _WIN32
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    if (frequency.QuadPart == 0) QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)(counter.QuadPart / (double)frequency.QuadPart * 1e9);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+static void fail(const char *what, const char *path)
+{
+    fprintf(stderr, "sandboxBenchmark: %s failed for '%s'\n", what, path);
+    exit(2);
+}
+
+// File system primitives
+
+static bool make_directory(const char *path)
+{
+#ifdef _WIN32
+    return CreateDirectoryA(path, NULL) || GetLastError() == ERROR_ALREADY_EXISTS;
+#else
+    return mkdir(path, 0755) == 0 || errno == EEXIST;
+#endif
+}
+
+static void write_file(const char *path, size_t size)
+{
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) fail("create", path);
+    for (size_t written = 0; written < size; )
+    {
+        DWORD chunk = (DWORD)(size - written < sizeof(g_buffer) ? size - written : sizeof(g_buffer)), count;
+        if (!WriteFile(file, g_buffer, chunk, &count, NULL)) fail("write", path);
+        written += count;
+    }
+    CloseHandle(file);
+#else
+    int fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, 0644);
+    if (fd < 0) fail("create", path);
+    for (size_t written = 0; written < size; )
+    {
+        size_t chunk = size - written < sizeof(g_buffer) ? size - written : sizeof(g_buffer);
+        ssize_t count = write(fd, g_buffer, chunk);
+        if (count <= 0) fail("write", path);
+        written += (size_t)count;
+    }
+    close(fd);
+#endif
+}
+
+// Returns the number of bytes read, or -1 if the file can't be opened
+static long long read_file(const char *path)
+{
+    long long total = 0;
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return -1;
+    DWORD count;
+    while (ReadFile(file, g_buffer, sizeof(g_buffer), &count, NULL) && count > 0) total += count;
+    CloseHandle(file);
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+    ssize_t count;
+    while ((count = read(fd, g_buffer, sizeof(g_buffer))) > 0) total += count;
+    close(fd);
+#endif
+    return total;
+}
+
+static bool path_exists(const char *path)
+{
+#ifdef _WIN32
+    return GetFileAttributesA(path) != INVALID_FILE_ATTRIBUTES;
+#else
+    struct stat st;
+    return stat(path, &st) == 0;
+#endif
+}
+
+static int enumerate_directory(const char *path)
+{
+    int entries = 0;
+#ifdef _WIN32
+    char pattern[MAX_PATH_LENGTH];
+    snprintf(pattern, sizeof(pattern), "%s\\*", path);
+    WIN32_FIND_DATAA data;
+    HANDLE find = FindFirstFileA(pattern, &data);
+    if (find == INVALID_HANDLE_VALUE) fail("enumerate", path);
+    do { entries++; } while (FindNextFileA(find, &data));
+    FindClose(find);
+#else
+    DIR *dir = opendir(path);
+    if (dir == NULL) fail("enumerate", path);
+    while (readdir(dir) != NULL) entries++;
+    closedir(dir);
+#endif
+    return entries;
+}
+
+static bool make_symlink(const char *target, const char *link)
+{
+#ifdef _WIN32
+    // SYMBOLIC_LINK_FLAG_ALLOW_UNPRIVILEGED_CREATE: works without elevation in developer mode
+    return CreateSymbolicLinkA(link, target, 0x2) != 0;
+#else
+    unlink(link);
+    return symlink(target, link) == 0;
+#endif
+}
+
+// Runs 'width' instances of this executable (with --noop) at once and waits for all of them
+static void spawn_children(int width)
+{
+#ifdef _WIN32
+    char self[MAX_PATH_LENGTH], commandLine[MAX_PATH_LENGTH + 16];
+    GetModuleFileNameA(NULL, self, sizeof(self));
+    snprintf(commandLine, sizeof(commandLine), "\"%s\" --noop", self);
+
+    HANDLE children[MAX_SPAWN_WIDTH];
+    for (int i = 0; i < width; i++)
+    {
+        STARTUPINFOA startupInfo = { sizeof(startupInfo) };
+        PROCESS_INFORMATION processInfo;
+        if (!CreateProcessA(self, commandLine, NULL, NULL, FALSE, 0, NULL, NULL, &startupInfo, &processInfo)) fail("spawn", self);
+        CloseHandle(processInfo.hThread);
+        children[i] = processInfo.hProcess;
+    }
+
+    WaitForMultipleObjects((DWORD)width, children, TRUE, INFINITE);
+    for (int i = 0; i < width; i++) CloseHandle(children[i]);
+#else
+    pid_t children[MAX_SPAWN_WIDTH];
+    char *argv[] = { (char *)g_self, "--noop", NULL };
+    for (int i = 0; i < width; i++)
+    {
+        if (posix_spawn(&children[i], g_self, NULL, NULL, argv, environ) != 0) fail("spawn", g_self);
+    }
+
+    for (int i = 0; i < width; i++)
+    {
+        int status;
+        waitpid(children[i], &status, 0);
+    }
+#endif
+}
+
+// Operations
+
+typedef struct
+{
+    char name[32];
+    long count;
+    long arg;
+} Operation;
+
+static void file_path(char *buffer, const char *scratch, const char *directory, long index)
+{
+    snprintf(buffer, MAX_PATH_LENGTH, "%s" PATH_SEPARATOR "%s" PATH_SEPARATOR "f%ld", scratch, directory, index);
+}
+
+static void ensure_directory(char *buffer, const char *scratch, const char *directory)
+{
+    snprintf(buffer, MAX_PATH_LENGTH, "%s" PATH_SEPARATOR "%s", scratch, directory);
+    if (!make_directory(buffer)) fail("mkdir", buffer);
+}
+
+// The files read and stat-ed by the operations (created untimed unless 'create' already made them)
+static void ensure_files(const char *scratch, long count, long size)
+{
+    char path[MAX_PATH_LENGTH];
+    ensure_directory(path, scratch, "files");
+    for (long i = 0; i < count; i++)
+    {
+        file_path(path, scratch, "files", i);
+        if (!path_exists(path)) write_file(path, (size_t)size);
+    }
+}
+
+// Runs an operation; returns the elapsed time of its timed part, or 0 if the operation is not supported here
+static uint64_t run_operation(const Operation *op, const char *scratch)
+{
+    char path[MAX_PATH_LENGTH];
+    uint64_t start;
+    long files = op->count < 1000 ? op->count : 1000;
+
+    if (strcmp(op->name, "create") == 0)
+    {
+        ensure_directory(path, scratch, "created");
+        start = now_ns();
+        for (long i = 0; i < op->count; i++)
+        {
+            file_path(path, scratch, "created", i);
+            write_file(path, (size_t)op->arg);
+        }
+    }
+    else if (strcmp(op->name, "read") == 0)
+    {
+        ensure_files(scratch, files, op->arg > 0 ? op->arg : 4096);
+        start = now_ns();
+        for (long i = 0; i < op->count; i++)
+        {
+            file_path(path, scratch, "files", i % files);
+            if (read_file(path) < 0) fail("read", path);
+        }
+    }
+    else if (strcmp(op->name, "stat") == 0)
+    {
+        ensure_files(scratch, files, 4096);
+        start = now_ns();
+        for (long i = 0; i < op->count; i++)
+        {
+            file_path(path, scratch, "files", i % files);
+            if (!path_exists(path)) fail("stat", path);
+        }
+    }
+    else if (strcmp(op->name, "probe") == 0)
+    {
+        start = now_ns();
+        for (long i = 0; i < op->count; i++)
+        {
+            file_path(path, scratch, "missing", i);
+            if (path_exists(path)) fail("probe", path);
+        }
+    }
+    else if (strcmp(op->name, "enumerate") == 0)
+    {
+        char directory[64];
+        snprintf(directory, sizeof(directory), "enumerate%ld", op->arg);
+        ensure_directory(path, scratch, directory);
+        for (long i = 0; i < op->arg; i++)
+        {
+            file_path(path, scratch, directory, i);
+            if (!path_exists(path)) write_file(path, 0);
+        }
+
+        snprintf(path, sizeof(path), "%s" PATH_SEPARATOR "%s", scratch, directory);
+        start = now_ns();
+        for (long i = 0; i < op->count; i++)
+        {
+            enumerate_directory(path);
+        }
+    }
+    else if (strcmp(op->name, "symlink") == 0)
+    {
+        // links/f0 -> links/f1 -> ... -> links/f<depth> (a file)
+        char target[MAX_PATH_LENGTH];
+        ensure_directory(path, scratch, "links");
+        file_path(target, scratch, "links", op->arg);
+        write_file(target, 4096);
+        for (long i = op->arg - 1; i >= 0; i--)
+        {
+            file_path(path, scratch, "links", i);
+            if (!make_symlink(target, path)) return 0;
+            strcpy(target, path);
+        }
+
+        start = now_ns();
+        for (long i = 0; i < op->count; i++)
+        {
+            if (read_file(target) < 0) fail("symlink", target);
+        }
+    }
+    else if (strcmp(op->name, "spawn") == 0)
+    {
+        int width = op->arg < 1 ? 1 : op->arg > MAX_SPAWN_WIDTH ? MAX_SPAWN_WIDTH : (int)op->arg;
+        start = now_ns();
+        for (long i = 0; i < op->count; i += width)
+        {
+            spawn_children(width);
+        }
+    }
+    else
+    {
+        fprintf(stderr, "sandboxBenchmark: unknown operation '%s'\n", op->name);
+        exit(2);
+    }
+
+    uint64_t elapsed = now_ns() - start;
+    return elapsed > 0 ? elapsed : 1;
+}
+
+static int read_workload(const char *path, Operation *ops)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL) fail("open", path);
+
+    int count = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), file) != NULL && count < MAX_OPERATIONS)
+    {
+        char *comment = strchr(line, '#');
+        if (comment != NULL) *comment = '\0';
+
+        Operation op = { { 0 }, 0, 0 };
+        if (sscanf(line, "%31s %ld %ld", op.name, &op.count, &op.arg) >= 2 && op.count > 0)
+        {
+            ops[count++] = op;
+        }
+    }
+
+    fclose(file);
+    return count;
+}
+
+// Comparison
+
+typedef struct
+{
+    char name[32];
+    long count;
+    double nsPerOp;
+} Result;
+
+static int read_results(const char *path, Result *results)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL) fail("open", path);
+
+    int count = 0;
+    unsigned long long total;
+    while (count < MAX_OPERATIONS &&
+           fscanf(file, "%31s %ld %llu %lf", results[count].name, &results[count].count, &total, &results[count].nsPerOp) == 4)
+    {
+        count++;
+    }
+
+    fclose(file);
+    return count;
+}
+
+static int compare(const char *baselinePath, const char *resultsPath)
+{
+    Result baseline[MAX_OPERATIONS], results[MAX_OPERATIONS];
+    int baselineCount = read_results(baselinePath, baseline);
+    int resultsCount = read_results(resultsPath, results);
+
+    printf("%-12s %10s %14s %14s %10s\n", "operation", "count", "baseline ns", "sandboxed ns", "overhead");
+    for (int i = 0; i < resultsCount; i++)
+    {
+        for (int j = 0; j < baselineCount; j++)
+        {
+            if (strcmp(results[i].name, baseline[j].name) == 0 && results[i].count == baseline[j].count)
+            {
+                double overhead = baseline[j].nsPerOp > 0 ? (results[i].nsPerOp / baseline[j].nsPerOp - 1) * 100 : 0;
+                printf("%-12s %10ld %14.0f %14.0f %9.1f%%\n", results[i].name, results[i].count, baseline[j].nsPerOp, results[i].nsPerOp, overhead);
+                break;
+            }
+        }
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    g_self = argv[0];
+
+    if (argc == 2 && strcmp(argv[1], "--noop") == 0)
+    {
+        return 0;
+    }
+
+    if (argc == 4 && strcmp(argv[1], "--compare") == 0)
+    {
+        return compare(argv[2], argv[3]);
+    }
+
+    if (argc != 4)
+    {
+        fprintf(stderr, "usage: %s <workload file> <scratch directory> <results file>\n"
+                        "       %s --compare <baseline results file> <results file>\n", argv[0], argv[0]);
+        return 1;
+    }
+
+    Operation ops[MAX_OPERATIONS];
+    int count = read_workload(argv[1], ops);
+    if (!make_directory(argv[2])) fail("mkdir", argv[2]);
+
+    FILE *results = fopen(argv[3], "w");
+    if (results == NULL) fail("open", argv[3]);
+
+    for (int i = 0; i < count; i++)
+    {
+        uint64_t elapsed = run_operation(&ops[i], argv[2]);
+        if (elapsed == 0)
+        {
+            fprintf(stderr, "sandboxBenchmark: '%s' is not supported here, skipped\n", ops[i].name);
+            continue;
+        }
+
+        fprintf(results, "%s %ld %llu %.1f\n", ops[i].name, ops[i].count, (unsigned long long)elapsed, (double)elapsed / ops[i].count);
+        printf("%-12s %10ld %12.0f ns/op\n", ops[i].name, ops[i].count, (double)elapsed / ops[i].count);
+    }
+
+    fclose(results);
+    return 0;
+}
@@ -0,0 +1,36 @@
+@echo off
+setlocal
+SETLOCAL ENABLEEXTENSIONS
+SETLOCAL ENABLEDELAYEDEXPANSION
+
+REM Measures the overhead of the Windows sandbox (detours) on workload.txt; see run.sh.
+REM Must be run from a developer command prompt (cl.exe on the PATH).
+
+if "%BUILDXL_BIN%" EQU "" (
+    echo [error] BUILDXL_BIN not set.  Please set it to a BuildXL deployment folder
+    exit /b 1
+)
+
+set resultsDir=%~dp0Out\Results
+if not exist %~dp0bin mkdir %~dp0bin
+if not exist %resultsDir% mkdir %resultsDir%
+
+cl.exe /nologo /O2 /Fo%~dp0bin\ /Fe%~dp0bin\sandboxBenchmark.exe %~dp0driver\sandboxBenchmark.c
+if %ERRORLEVEL% neq 0 exit /b %ERRORLEVEL%
+
+echo == baseline
+if exist %resultsDir%\scratch rd /Q /S %resultsDir%\scratch
+%~dp0bin\sandboxBenchmark.exe %~dp0workload.txt %resultsDir%\scratch %resultsDir%\baseline.txt
+if %ERRORLEVEL% neq 0 exit /b %ERRORLEVEL%
+
+echo == winDetours
+set SANDBOX_BENCHMARK_RUN=winDetours-%RANDOM%%RANDOM%
+set buildCmd=%BUILDXL_BIN%\bxl.exe /server- /cacheGraph- /incrementalScheduling- /sandboxKind:winDetours /c:%~dp0config.dsc
+echo Executing: %buildCmd%
+%buildCmd%
+if %ERRORLEVEL% neq 0 exit /b %ERRORLEVEL%
+copy /Y %~dp0Out\Bin\results.txt %resultsDir%\winDetours.txt > nul
+
+echo.
+echo == winDetours overhead
+%~dp0bin\sandboxBenchmark.exe --compare %resultsDir%\baseline.txt %resultsDir%\winDetours.txt
@@ -0,0 +1,57 @@
+#!/bin/bash
+
+# Measures the overhead of the sandboxes of this machine on workload.txt:
+#   1. builds the driver into bin/,
+#   2. runs it outside of BuildXL (the baseline),
+#   3. runs it as a pip under every given sandbox kind (default: the sandbox of the current OS),
+#   4. prints the per-operation overhead of every sandbox against the baseline.
+#
+# Usage: run.sh [<sandbox kind>...]  (e.g., run.sh macOsKext macOsEndpointSecurity macOsDetours)
+# BUILDXL_BIN must point at a BuildXL deployment.
+
+readonly MY_DIR=$(cd `dirname ${BASH_SOURCE[0]}` && pwd)
+readonly RESULTS_DIR="$MY_DIR/Out/Results"
+
+source "${MY_DIR}/../DotNetCoreBuild/env.sh"
+
+if [[ -z "$BUILDXL_BIN" ]]; then
+    echo "[error] BUILDXL_BIN not set.  Please set it to a BuildXL deployment folder"
+    exit 1
+fi
+
+sandboxKinds=("$@")
+if [[ ${#sandboxKinds[@]} == 0 ]]; then
+    if [[ "$(uname)" == "Darwin" ]]; then
+        sandboxKinds=(macOsKext)
+    else
+        sandboxKinds=(linuxDetours)
+    fi
+fi
+
+set -e
+
+mkdir -p "$MY_DIR/bin" "$RESULTS_DIR"
+cc -O2 -o "$MY_DIR/bin/sandboxBenchmark" "$MY_DIR/driver/sandboxBenchmark.c"
+
+echo "== baseline"
+rm -rf "$RESULTS_DIR/scratch"
+"$MY_DIR/bin/sandboxBenchmark" "$MY_DIR/workload.txt" "$RESULTS_DIR/scratch" "$RESULTS_DIR/baseline.txt"
+
+for kind in "${sandboxKinds[@]}"; do
+    echo "== $kind"
+    SANDBOX_BENCHMARK_RUN="$kind-$(date +%s)"    \
+    /bin/bash "${MacOsScriptsDir}/bxl.sh"        \
+      --config "$MY_DIR/config.dsc"              \
+      --buildxl-bin "$BUILDXL_BIN"               \
+      /sandboxKind:$kind                         \
+      /disableProcessRetryOnResourceExhaustion+  \
+      /incrementalScheduling-                    \
+      /cacheGraph-
+    cp "$MY_DIR/Out/Bin/results.txt" "$RESULTS_DIR/$kind.txt"
+done
+
+for kind in "${sandboxKinds[@]}"; do
+    echo
+    echo "== $kind overhead"
+    "$MY_DIR/bin/sandboxBenchmark" --compare "$RESULTS_DIR/baseline.txt" "$RESULTS_DIR/$kind.txt"
+done
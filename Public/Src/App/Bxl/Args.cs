@@ -1068,6 +1068,9 @@ namespace BuildXL
                         OptionHandlerFactory.CreateOption(
                             "enforceFullReparsePointsUnderPath",
                             opt => sandboxConfiguration.DirectoriesToEnableFullReparsePointParsing.Add(CommandLineUtilities.ParsePathOption(opt, pathTable))),
+                        OptionHandlerFactory.CreateOption(
+                            "noReparsePointsUnderPath",
+                            opt => sandboxConfiguration.DirectoriesWithoutReparsePoints.Add(CommandLineUtilities.ParsePathOption(opt, pathTable))),
                         OptionHandlerFactory.CreateBoolOption(
                             "treatAbsentDirectoryAsExistentUnderOpaque",
                             sign => schedulingConfiguration.TreatAbsentDirectoryAsExistentUnderOpaque = sign),
@@ -703,6 +703,11 @@ namespace BuildXL
                 Strings.HelpText_DisplayHelp_EnforceFullReparsePointsUnderPath,
                 HelpLevel.Verbose);
 
+            hw.WriteOption(
+                "/noReparsePointsUnderPath:<path>",
+                Strings.HelpText_DisplayHelp_NoReparsePointsUnderPath,
+                HelpLevel.Verbose);
+
             hw.WriteOption(
                 "/analyzeDependencyViolations[+|-]",
                 Strings.HelpText_DisplayHelp_AnalyzeDependencyViolations,
@@ -10,6 +10,13 @@
 // file (where diagnostings are logged as well) with exclusive write and shared read access. If aniother process
 // tries to open the same file, it fails with sharing validation. The second process will wait for the first 
 // process to close the file and will get the lock once that happens.
+//
+// When RUN_IN_SUBST_PERSISTENT is set to 1, drives are mapped directly (DefineDosDevice) rather than by running subst.exe, and
+// mappings are left in place when the process exits, so that the next invocation asking for the same mapping finds it there.
+// Invocations that use the same mapping share it: each one holds a read (rather than exclusive write) handle to the lock file while
+// its process runs, and a mapping is only replaced once nobody holds such a handle. The decision to reuse, replace or create the
+// mapping of a drive is made under a named mutex per drive letter. The lock files are compatible with the default protocol: an
+// exclusive lock waits for the mapping to be unused, and a shared one for an exclusive one to be released.
 // 
 
 #pragma warning( disable: 4820 ) // Shut-off padding warnings.
@@ -26,6 +33,8 @@
 #define RUN_IN_SUBST_VERBOSE_BUFF_SIZE 2
 #define MAPPED_PATH_STRING L"\\??\\"
 #define SUBST_FILE_NAME L".SubstLock"
+#define RUN_IN_SUBST_PERSISTENT L"RUN_IN_SUBST_PERSISTENT"
+#define DRIVE_MUTEX_NAME_PREFIX L"Local\\BuildXL.RunInSubst.Drive."
 
 // Subst target and source node.
 typedef struct _tagSubstNode
@@ -505,6 +514,189 @@ static int MapDrive(PSUBST_NODE pSubstNode)
     return 0;
 }
 
+// Validates that the source location of a node exists and is a directory.
+static bool ValidateSourceDirectory(PSUBST_NODE pListNode)
+{
+    if (pListNode->szSourceDirectory == nullptr)
+    {
+        wprintf(L"Error: Invalid source location for a subst drive %C:.\r\n", pListNode->szDriveLetter);
+        return false;
+    }
+
+    DWORD srcAttr = GetFileAttributes(pListNode->szSourceDirectory);
+    if (srcAttr == INVALID_FILE_ATTRIBUTES)
+    {
+        wprintf(L"Error: Invalid source location for a subst drive %C:. The source location %s doesn't exist.\r\n",
+            pListNode->szDriveLetter,
+            pListNode->szSourceDirectory);
+        return false;
+    }
+
+    if ((srcAttr & FILE_ATTRIBUTE_DIRECTORY) == 0)
+    {
+        wprintf(L"Error: Invalid source location for a subst drive %C:. The source location %s is not a directory.\r\n",
+            pListNode->szDriveLetter,
+            pListNode->szSourceDirectory);
+        return false;
+    }
+
+    return true;
+}
+
+// Returns whether a drive is defined. If it is mapped to a directory, 'mapping' is set to that (lower case) directory, with a
+// trailing '\\'; otherwise (e.g., a volume or a network share), it is set to an empty string.
+static bool QueryDriveMapping(TCHAR driveLetter, std::wstring& mapping)
+{
+    TCHAR drive[3] = { driveLetter, L':', L'\0' };
+    std::vector<TCHAR> target(SUBST_SOURCE_LENGTH);
+    mapping.clear();
+    if (QueryDosDevice(drive, target.data(), (DWORD)target.size()) == 0)
+    {
+        return GetLastError() == ERROR_INSUFFICIENT_BUFFER;
+    }
+
+    // The first string is the current mapping: \??\<path> for directories.
+    mapping.assign(target.data());
+    if (mapping.find(MAPPED_PATH_STRING) != 0)
+    {
+        mapping.clear();
+        return true;
+    }
+
+    mapping.erase(0, wcslen(MAPPED_PATH_STRING));
+    for (TCHAR& c : mapping)
+    {
+        c = (TCHAR)::tolower(c);
+    }
+
+    if (mapping.empty() || mapping.back() != L'\\')
+    {
+        mapping.push_back(L'\\');
+    }
+
+    return true;
+}
+
+// Opens the lock file at 'lockFilePath' for the given access, sharing read access only. Returns INVALID_HANDLE_VALUE on failure.
+static HANDLE OpenLockFile(std::wstring const& lockFilePath, DWORD desiredAccess)
+{
+    return CreateFile(lockFilePath.c_str(), desiredAccess, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+}
+
+// Maps the drive of the node to its source directory, reusing the mapping if the drive already has it, and takes a shared lock on it.
+// Returns 0 on success and non-zero on failure.
+static int AcquirePersistentMapping(PSUBST_NODE pSubstNode)
+{
+    if (!ValidateSourceDirectory(pSubstNode))
+    {
+        return 1;
+    }
+
+    TCHAR drive[3] = { pSubstNode->szDriveLetter, L':', L'\0' };
+    std::wstring mutexName(DRIVE_MUTEX_NAME_PREFIX);
+    mutexName.push_back(pSubstNode->szDriveLetter);
+
+    HANDLE driveMutex = CreateMutex(nullptr, FALSE, mutexName.c_str());
+    if (driveMutex == NULL)
+    {
+        wprintf(L"Error: Could not create the mutex for drive %C:. Error: %d\r\n", pSubstNode->szDriveLetter, (int)GetLastError());
+        return 1;
+    }
+
+    std::wstring sourceLockFile(pSubstNode->szSourceDirectory);
+    sourceLockFile.append(SUBST_FILE_NAME);
+    std::wstring driveLockFile(drive);
+    driveLockFile.append(L"\\");
+    driveLockFile.append(SUBST_FILE_NAME);
+
+    int ret = 0;
+    WaitForSingleObject(driveMutex, INFINITE);
+    while (true)
+    {
+        std::wstring mapping;
+        bool isDefined = QueryDriveMapping(pSubstNode->szDriveLetter, mapping);
+        bool mustWait = false;
+
+        if (isDefined && mapping.empty())
+        {
+            wprintf(L"Error: Drive %C: is not a subst drive.\r\n", pSubstNode->szDriveLetter);
+            ret = 1;
+            break;
+        }
+        else if (mapping == pSubstNode->szSourceDirectory)
+        {
+            // The drive has the mapping already: share it (unless an exclusive lock is held on it).
+            pSubstNode->hLockFile = OpenLockFile(sourceLockFile, GENERIC_READ);
+            if (pSubstNode->hLockFile != INVALID_HANDLE_VALUE)
+            {
+                printVerbose(L"Reusing the mapping of drive %C: to %s.", pSubstNode->szDriveLetter, pSubstNode->szSourceDirectory);
+                break;
+            }
+
+            if (GetLastError() != ERROR_SHARING_VIOLATION)
+            {
+                wprintf(L"Error: Could not get a shared lock for local lock file in %s. Error: %d\r\n", pSubstNode->szSourceDirectory, (int)GetLastError());
+                ret = 1;
+                break;
+            }
+
+            mustWait = true;
+        }
+        else if (isDefined)
+        {
+            // The drive is mapped elsewhere: replace the mapping once nobody uses it. A drive that does not follow the protocol
+            // (e.g., its lock file can't be created) is not in use as far as the protocol is concerned.
+            HANDLE hLockFile = OpenLockFile(driveLockFile, GENERIC_WRITE);
+            if (hLockFile == INVALID_HANDLE_VALUE && GetLastError() == ERROR_SHARING_VIOLATION)
+            {
+                mustWait = true;
+            }
+            else
+            {
+                if (hLockFile != INVALID_HANDLE_VALUE)
+                {
+                    CloseHandle(hLockFile);
+                }
+
+                printVerbose(L"Removing the mapping of drive %C: to %s.", pSubstNode->szDriveLetter, mapping.c_str());
+                if (!DefineDosDevice(DDD_REMOVE_DEFINITION, drive, nullptr))
+                {
+                    wprintf(L"Error: Could not remove the mapping of drive %C:. Error: %d\r\n", pSubstNode->szDriveLetter, (int)GetLastError());
+                    ret = 1;
+                    break;
+                }
+
+                continue;
+            }
+        }
+        else
+        {
+            std::wstring source(pSubstNode->szSourceDirectory, wcslen(pSubstNode->szSourceDirectory) - 1); // Skip the trailing '\\'.
+            printVerbose(L"Mapping drive %C: to %s.", pSubstNode->szDriveLetter, pSubstNode->szSourceDirectory);
+            if (!DefineDosDevice(0, drive, source.c_str()))
+            {
+                wprintf(L"Error: Could not map drive %C: to %s. Error: %d\r\n", pSubstNode->szDriveLetter, pSubstNode->szSourceDirectory, (int)GetLastError());
+                ret = 1;
+                break;
+            }
+
+            continue;
+        }
+
+        if (mustWait)
+        {
+            wprintf(L"Warning: Drive %C: is in use by another process. Waiting for %d secs...\r\n", pSubstNode->szDriveLetter, RUN_IN_SUBST_TIMEOUT / 1000);
+            ReleaseMutex(driveMutex);
+            Sleep(RUN_IN_SUBST_TIMEOUT);
+            WaitForSingleObject(driveMutex, INFINITE);
+        }
+    }
+
+    ReleaseMutex(driveMutex);
+    CloseHandle(driveMutex);
+    return ret;
+}
+
 // Handle the CTRL-C signal. RunInSubst.exe process should continue as long as it's child is alive to keep the
 // console looking reasonable. If it were to exit, standard input control would return to the console which
 // gets confusing when RunInSubst.exe's child process is still running.
@@ -703,28 +895,8 @@ static int SubstDrivesAndExecute(int argc, _TCHAR* argv[], PSUBST_LIST_NODE pSub
 
             // Validate that the existence of the source location and try to get
             // an exclusive write lock, using the source path.
-            if (pListNode->szSourceDirectory == nullptr)
-            {
-                wprintf(L"Error: Invalid source location for a subst drive %C:.\r\n", pListNode->szDriveLetter);
-                // Process exits. All handles closed by the OS.
-                return 1;
-            }
-
-            DWORD srcAttr = GetFileAttributes(pListNode->szSourceDirectory);
-            if (srcAttr == INVALID_FILE_ATTRIBUTES)
-            {
-                wprintf(L"Error: Invalid source location for a subst drive %C:. The source location %s doesn't exist.\r\n",
-                    pListNode->szDriveLetter,
-                    pListNode->szSourceDirectory);
-                // Process exits. All handles closed by the OS.
-                return 1;
-            }
-
-            if ((srcAttr & FILE_ATTRIBUTE_DIRECTORY) == 0)
+            if (!ValidateSourceDirectory(pListNode))
             {
-                wprintf(L"Error: Invalid source location for a subst drive %C:. The source location %s is not a directory.\r\n",
-                    pListNode->szDriveLetter,
-                    pListNode->szSourceDirectory);
                 // Process exits. All handles closed by the OS.
                 return 1;
             }
@@ -890,6 +1062,45 @@ static int SubstDrivesAndExecute(int argc, _TCHAR* argv[], PSUBST_LIST_NODE pSub
     return errorCode;
 }
 
+// Maps the drives persistently (see RUN_IN_SUBST_PERSISTENT) and executes the process.
+// Returns the exit code of the process, or non-zero if the drives could not be mapped.
+static int SubstDrivesPersistentAndExecute(int argc, _TCHAR* argv[], PSUBST_NODE* pOrderedSubstList, int executableToRunIndex)
+{
+    // Drives are acquired in order, so invocations waiting for each other's drives never deadlock.
+    int ret = 0;
+    for (int i = 0; i < NUMBER_DEFINABLE_SUBST && ret == 0; i++)
+    {
+        if (pOrderedSubstList[i] != nullptr)
+        {
+            ret = AcquirePersistentMapping(pOrderedSubstList[i]);
+        }
+    }
+
+    if (ret == 0)
+    {
+        ret = ExecuteProcess(argc, argv, executableToRunIndex, pOrderedSubstList);
+    }
+
+    // The mappings stay: releasing the shared locks is what lets other invocations replace them.
+    for (int i = 0; i < NUMBER_DEFINABLE_SUBST; i++)
+    {
+        PSUBST_NODE pListNode = pOrderedSubstList[i];
+        if (pListNode != nullptr && pListNode->hLockFile != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(pListNode->hLockFile);
+        }
+    }
+
+    return ret;
+}
+
+// Returns whether the environment variable 'name' is set to 1.
+static bool IsEnvironmentFlagSet(PCWSTR name)
+{
+    TCHAR value[RUN_IN_SUBST_VERBOSE_BUFF_SIZE];
+    return GetEnvironmentVariable(name, value, RUN_IN_SUBST_VERBOSE_BUFF_SIZE) == 1 && value[0] == L'1';
+}
+
 // main - app entry point.
 int _tmain(int argc, _TCHAR* argv[])
 {
@@ -910,7 +1121,9 @@ int _tmain(int argc, _TCHAR* argv[])
 
     SetConsoleCtrlHandler(CtrlHandler, true);
 
-    int ret = SubstDrivesAndExecute(argc, argv, pSubstList, pOrderedSubstList, executableToRunIndex);
+    int ret = IsEnvironmentFlagSet(RUN_IN_SUBST_PERSISTENT)
+        ? SubstDrivesPersistentAndExecute(argc, argv, pOrderedSubstList, executableToRunIndex)
+        : SubstDrivesAndExecute(argc, argv, pSubstList, pOrderedSubstList, executableToRunIndex);
 
     if (pOrderedSubstList != nullptr)
     {
@@ -0,0 +1,166 @@
+﻿// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+using System;
+using System.Buffers.Binary;
+using System.Text;
+
+namespace BuildXL.Processes
+{
+    /// <summary>
+    /// A binary access report record as the sandboxes send it, read in place from the bytes it was received in.
+    /// </summary>
+    /// <remarks>
+    /// CODESYNC: Public/Src/Sandbox/Windows/DetoursServices/AccessReportRecord.h (see there for the format).
+    /// A record is a fixed header (<see cref="MinHeaderSize"/> bytes, little-endian), an extension of the header that sandboxes may add (skipped here,
+    /// except for the timing of timed records, which comes first), the payload and padding. Fields are only read when asked for, and the payload is handed out as a span of the received bytes.
+    /// </remarks>
+    internal readonly ref struct AccessReportRecord
+    {
+        /// <summary>Version of the records this reads</summary>
+        public const ushort Version = 1;
+
+        /// <summary>Size of the fixed part of the header</summary>
+        public const int MinHeaderSize = 56;
+
+        /// <nodoc />
+        public const ushort KindAccess = 1;
+
+        /// <nodoc />
+        public const ushort KindProcessName = 2;
+
+        /// <summary>The payload is a <see cref="SandboxStats"/></summary>
+        public const ushort KindSandboxStats = 3;
+
+        /// <summary>First kind specific to a sandbox</summary>
+        public const ushort KindSandboxSpecific = 0x100;
+
+        /// <summary>The operation is a <see cref="ReportedFileOperation"/></summary>
+        public const byte PlatformWindows = 1;
+
+        /// <summary>The operation is a <see cref="BuildXL.Interop.Unix.Sandbox.FileOperation"/></summary>
+        public const byte PlatformPosix = 2;
+
+        /// <summary>Size of the timing that starts the header extension of timed records</summary>
+        public const int TimingSize = 16;
+
+        private const byte FlagReportExplicitly = 0x1;
+        private const byte FlagUtf16Path = 0x2;
+        private const byte FlagTimed = 0x4;
+
+        private readonly ReadOnlySpan<byte> m_record;
+
+        private AccessReportRecord(ReadOnlySpan<byte> record)
+        {
+            m_record = record;
+        }
+
+        /// <summary>Total length of the record (header, payload and padding), i.e., the offset of the record that follows it</summary>
+        public int Length => (int)ReadUInt32(0);
+
+        /// <nodoc />
+        public ushort Kind => BinaryPrimitives.ReadUInt16LittleEndian(m_record.Slice(8));
+
+        /// <nodoc />
+        public byte Platform => m_record[10];
+
+        /// <nodoc />
+        public uint Operation => ReadUInt32(12);
+
+        /// <nodoc />
+        public uint ProcessId => ReadUInt32(16);
+
+        /// <nodoc />
+        public uint RootProcessId => ReadUInt32(20);
+
+        /// <nodoc />
+        public RequestedAccess RequestedAccess => (RequestedAccess)ReadUInt32(24);
+
+        /// <nodoc />
+        public uint Status => ReadUInt32(28);
+
+        /// <nodoc />
+        public uint Error => ReadUInt32(32);
+
+        /// <summary>Id of the process name defined by an earlier <see cref="KindProcessName"/> record of the same process (0 if none)</summary>
+        public uint ProcessNameId => ReadUInt32(36);
+
+        /// <summary>Semi-stable hash of the pip (0 when the transport the record came through already tells)</summary>
+        public ulong PipId => BinaryPrimitives.ReadUInt64LittleEndian(m_record.Slice(40));
+
+        /// <nodoc />
+        public bool ReportExplicitly => (m_record[11] & FlagReportExplicitly) != 0;
+
+        /// <summary>Whether the record carries <see cref="Timestamp"/> and <see cref="SequenceNumber"/></summary>
+        public bool IsTimed => (m_record[11] & FlagTimed) != 0;
+
+        /// <summary>
+        /// When the record was made, in nanoseconds on the monotonic clock <see cref="System.Diagnostics.Stopwatch"/> reads (0 if the record is not timed)
+        /// </summary>
+        public ulong Timestamp => IsTimed ? BinaryPrimitives.ReadUInt64LittleEndian(m_record.Slice(MinHeaderSize)) : 0;
+
+        /// <summary>Increases with every timed record of the process, in the order they were made (0 if the record is not timed)</summary>
+        public ulong SequenceNumber => IsTimed ? BinaryPrimitives.ReadUInt64LittleEndian(m_record.Slice(MinHeaderSize + 8)) : 0;
+
+        /// <summary>Offset of the payload from the start of the record</summary>
+        public int PayloadOffset => BinaryPrimitives.ReadUInt16LittleEndian(m_record.Slice(6));
+
+        /// <nodoc />
+        public int PayloadLength => (int)ReadUInt32(48);
+
+        /// <summary>The payload (e.g., the path of an access report) in the bytes the record was read from</summary>
+        public ReadOnlySpan<byte> Payload => m_record.Slice(PayloadOffset, PayloadLength);
+
+        /// <summary>Decodes the payload (UTF-8, or UTF-16 if the record says so)</summary>
+        public unsafe string GetPayloadString()
+        {
+            ReadOnlySpan<byte> payload = Payload;
+            if (payload.IsEmpty)
+            {
+                return string.Empty;
+            }
+
+            Encoding encoding = (m_record[11] & FlagUtf16Path) != 0 ? Encoding.Unicode : Encoding.UTF8;
+            fixed (byte* bytes = payload)
+            {
+                return encoding.GetString(bytes, payload.Length);
+            }
+        }
+
+        /// <summary>
+        /// Reads the record at the start of <paramref name="bytes"/>; fails (with an error message) if the bytes don't start with a whole,
+        /// well formed record of the supported version.
+        /// </summary>
+        public static bool TryRead(ReadOnlySpan<byte> bytes, out AccessReportRecord record, out string error)
+        {
+            record = default;
+            if (bytes.Length < MinHeaderSize)
+            {
+                error = $"Truncated access report record: {bytes.Length} bytes left, at least {MinHeaderSize} expected";
+                return false;
+            }
+
+            var candidate = new AccessReportRecord(bytes);
+            ushort version = BinaryPrimitives.ReadUInt16LittleEndian(bytes.Slice(4));
+            if (version != Version)
+            {
+                error = $"Unsupported access report record version: {version} (expected {Version})";
+                return false;
+            }
+
+            long length = candidate.ReadUInt32(0);
+            int minHeaderSize = candidate.IsTimed ? MinHeaderSize + TimingSize : MinHeaderSize;
+            if (candidate.PayloadOffset < minHeaderSize || length > bytes.Length || (long)candidate.PayloadOffset + candidate.ReadUInt32(48) > length)
+            {
+                error = $"Invalid access report record: length {length}, header size {candidate.PayloadOffset}, payload length {candidate.ReadUInt32(48)} (bytes left: {bytes.Length})";
+                return false;
+            }
+
+            record = new AccessReportRecord(bytes.Slice(0, (int)length));
+            error = null;
+            return true;
+        }
+
+        private uint ReadUInt32(int offset) => BinaryPrimitives.ReadUInt32LittleEndian(m_record.Slice(offset));
+    }
+}
@@ -0,0 +1,132 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+using System;
+using System.Collections.Generic;
+using System.Globalization;
+using System.IO;
+using System.Linq;
+
+namespace BuildXL.Processes
+{
+    /// <summary>
+    /// The summary of a complete enumeration of a directory by a process, sent instead of one report per entry found
+    /// (see <see cref="FileAccessManifest.SummarizeDirectoryEnumerations"/>).
+    /// </summary>
+    /// <remarks>
+    /// The entries themselves are not sent: <see cref="TryReconstructEntries"/> finds them by enumerating the directory again,
+    /// and tells (by the number and membership hash of the entries) whether that is what the process saw.
+    /// </remarks>
+    public readonly struct DirectoryEnumerationSummary
+    {
+        /// <nodoc />
+        public uint ProcessId { get; }
+
+        /// <summary>
+        /// The enumerated directory, as in the <see cref="RequestedAccess.Enumerate"/> report of the enumeration
+        /// </summary>
+        public string Directory { get; }
+
+        /// <summary>
+        /// The filter of the enumeration (e.g., <c>*.cs</c>); empty if there is none
+        /// </summary>
+        public string Filter { get; }
+
+        /// <summary>
+        /// The number of entries found, without <c>.</c> and <c>..</c>
+        /// </summary>
+        public ulong EntryCount { get; }
+
+        /// <summary>
+        /// The membership hash of the entries found (see <see cref="ComputeMembershipHash"/>)
+        /// </summary>
+        public ulong MembershipHash { get; }
+
+        /// <nodoc />
+        public DirectoryEnumerationSummary(uint processId, string directory, string filter, ulong entryCount, ulong membershipHash)
+        {
+            ProcessId = processId;
+            Directory = directory;
+            Filter = filter;
+            EntryCount = entryCount;
+            MembershipHash = membershipHash;
+        }
+
+        /// <summary>
+        /// The sum of the FNV-1a hashes of the names (over their UTF-16 code units), which does not depend on the order of the names.
+        /// </summary>
+        /// <remarks>
+        /// CODESYNC: Public/Src/Sandbox/Windows/DetoursServices/SendReport.h (AddToEnumerationMembershipHash)
+        /// </remarks>
+        public static ulong ComputeMembershipHash(IEnumerable<string> names)
+        {
+            ulong membershipHash = 0;
+            foreach (string name in names)
+            {
+                ulong hash = 0xcbf29ce484222325UL;
+                foreach (char c in name)
+                {
+                    hash = unchecked((hash ^ c) * 0x100000001b3UL);
+                }
+
+                membershipHash = unchecked(membershipHash + hash);
+            }
+
+            return membershipHash;
+        }
+
+        /// <summary>
+        /// Enumerates the directory with the filter of the summary, and returns the names of the entries if they are the ones the process found.
+        /// </summary>
+        /// <remarks>
+        /// Returns false if the directory changed since the process enumerated it (or the filter is matched differently), or cannot be enumerated.
+        /// </remarks>
+        public bool TryReconstructEntries(out IReadOnlyList<string> entries)
+        {
+            entries = null;
+            try
+            {
+                string[] names = System.IO.Directory
+                    .EnumerateFileSystemEntries(Directory, string.IsNullOrEmpty(Filter) ? "*" : Filter)
+                    .Select(Path.GetFileName)
+                    .ToArray();
+
+                if ((ulong)names.Length != EntryCount || ComputeMembershipHash(names) != MembershipHash)
+                {
+                    return false;
+                }
+
+                entries = names;
+                return true;
+            }
+            catch (Exception ex) when (ex is IOException || ex is UnauthorizedAccessException || ex is ArgumentException)
+            {
+                return false;
+            }
+        }
+
+        /// <summary>
+        /// Parses the data of a <see cref="ReportType.DirectoryEnumerationSummary"/> report:
+        /// <c>pid|entry count|membership hash|directory|filter</c> (numbers in hexadecimal).
+        /// </summary>
+        internal static bool TryParse(string data, out DirectoryEnumerationSummary summary, out string errorMessage)
+        {
+            summary = default;
+            errorMessage = string.Empty;
+
+            // '|' can be neither in paths nor in filters
+            string[] items = data.TrimEnd('\r', '\n').Split('|');
+            if (items.Length != 5
+                || !uint.TryParse(items[0], NumberStyles.HexNumber, CultureInfo.InvariantCulture, out uint processId)
+                || !ulong.TryParse(items[1], NumberStyles.HexNumber, CultureInfo.InvariantCulture, out ulong entryCount)
+                || !ulong.TryParse(items[2], NumberStyles.HexNumber, CultureInfo.InvariantCulture, out ulong membershipHash))
+            {
+                errorMessage = "Unexpected directory enumeration summary";
+                return false;
+            }
+
+            summary = new DirectoryEnumerationSummary(processId, items[3], items[4], entryCount, membershipHash);
+            return true;
+        }
+    }
+}
@@ -35,16 +35,29 @@ namespace BuildXL.Processes
         /// </summary>
         private FileAccessManifestFlag m_fileAccessManifestFlag;
 
+        /// <summary>
+        /// File access manifest extra flags.
+        /// </summary>
+        private FileAccessManifestExtraFlag m_fileAccessManifestExtraFlag;
+
         /// <summary>
         /// Name of semaphore for message count.
         /// </summary>
         private string m_messageCountSemaphoreName;
+        private int m_reportRingSlots;
+        private int m_sharedReparsePointCacheSlots;
+        private int m_sharedReportedAccessSlots;
 
         /// <summary>
         /// Sealed manifest tree.
         /// </summary>
         private byte[] m_sealedManifestTreeBlock;
 
+        /// <summary>
+        /// Whether some policy of the manifest carries <see cref="FileAccessPolicy.ReportUsnAfterOpen"/>.
+        /// </summary>
+        private bool m_hasReportUsnAfterOpenPolicies;
+
         /// <summary>
         /// Creates an empty instance.
         /// </summary>
@@ -88,6 +101,25 @@ namespace BuildXL.Processes
             EnforceAccessPoliciesOnDirectoryCreation = false;
             IgnoreCreateProcessReport = false;
             ProbeDirectorySymlinkAsDirectory = false;
+            BatchReports = false;
+            BufferDebugMessages = false;
+            BinaryReports = false;
+            ReportRingSlots = 0;
+            SharedReparsePointCacheSlots = 0;
+            ReportOncePerPathAndAccess = false;
+            SharedReportedAccessSlots = 0;
+            UseCompactManifestTree = false;
+            UseManifestPathFilter = false;
+            CacheDosDeviceNames = false;
+            CollectDetourStatistics = false;
+            NtCreateFileOnly = false;
+            MinimalDetours = false;
+            DeferColdDetours = false;
+            CacheProbeResults = false;
+            CacheImagePathSearches = false;
+            AllowManifestRetarget = false;
+            SummarizeDirectoryEnumerations = false;
+            UseHotpatchDetours = false;
         }
 
         private bool GetFlag(FileAccessManifestFlag flag) => (m_fileAccessManifestFlag & flag) != 0;
@@ -123,6 +155,16 @@ namespace BuildXL.Processes
         /// </remarks>
         public bool IsManifestTreeHydrated => !IsManifestTreeBlockSealed || m_rootNode.Children != null;
 
+        /// <summary>
+        /// Whether some scope or path of the manifest was added with <see cref="FileAccessPolicy.ReportUsnAfterOpen"/>.
+        /// </summary>
+        /// <remarks>
+        /// Detours only reads the USN of a file it opens when the manifest expects one. The USNs that are only reported
+        /// are left to the host, which reads them as it receives the reports (see SandboxedProcessReports), and which
+        /// only looks up the policies of the reported paths when this is set.
+        /// </remarks>
+        public bool HasReportUsnAfterOpenPolicies => m_hasReportUsnAfterOpenPolicies;
+
         /// <summary>
         /// If true, then the detoured file access functions will write diagnostic messages
         /// to stderr when access to files is prevented.
@@ -406,6 +448,331 @@ namespace BuildXL.Processes
             set => SetFlag(FileAccessManifestFlag.CheckDetoursMessageCount, value);
         }
 
+        /// <summary>
+        /// If true, Detours coalesces report lines into batches (written when full, before a child process is created, when the process exits,
+        /// and at the latest shortly after the first line of the batch was reported) instead of writing each line to the report pipe separately.
+        /// </summary>
+        /// <remarks>
+        /// The message count semaphore is still released once per line (in one call per batch), so message count checks keep working.
+        /// Lines still batched when a process is terminated are lost.
+        /// </remarks>
+        public bool BatchReports
+        {
+            get => (m_fileAccessManifestExtraFlag & FileAccessManifestExtraFlag.BatchReports) != 0;
+            set => m_fileAccessManifestExtraFlag = value
+                ? m_fileAccessManifestExtraFlag | FileAccessManifestExtraFlag.BatchReports
+                : m_fileAccessManifestExtraFlag & ~FileAccessManifestExtraFlag.BatchReports;
+        }
+
+        /// <summary>
+        /// If true, Detours buffers the debug messages of a process in memory and writes them out together (shortly after they were logged, before a child
+        /// process is created, when the process exits and before an internal error is handled) instead of writing each message to the report pipe separately.
+        /// </summary>
+        /// <remarks>
+        /// Messages logged while the buffer is full are dropped (and counted in a later message); messages still buffered when a process is terminated are lost.
+        /// </remarks>
+        public bool BufferDebugMessages
+        {
+            get => (m_fileAccessManifestExtraFlag & FileAccessManifestExtraFlag.BufferDebugMessages) != 0;
+            set => m_fileAccessManifestExtraFlag = value
+                ? m_fileAccessManifestExtraFlag | FileAccessManifestExtraFlag.BufferDebugMessages
+                : m_fileAccessManifestExtraFlag & ~FileAccessManifestExtraFlag.BufferDebugMessages;
+        }
+
+        /// <summary>
+        /// If true, Detours reports file accesses as compact binary records (<see cref="ReportType.FileAccessRecord"/>), in which paths
+        /// a process already reported are replaced with ids, instead of formatting them as text.
+        /// </summary>
+        public bool BinaryReports
+        {
+            get => (m_fileAccessManifestExtraFlag & FileAccessManifestExtraFlag.BinaryReports) != 0;
+            set => m_fileAccessManifestExtraFlag = value
+                ? m_fileAccessManifestExtraFlag | FileAccessManifestExtraFlag.BinaryReports
+                : m_fileAccessManifestExtraFlag & ~FileAccessManifestExtraFlag.BinaryReports;
+        }
+
+        /// <summary>
+        /// Number of slots of the shared-memory ring into which Detours puts its reports instead of writing them to the report pipe;
+        /// 0 means that no ring is used.
+        /// </summary>
+        /// <remarks>
+        /// The ring is created by <see cref="SandboxedProcess"/> under a name derived from <see cref="InternalDetoursErrorNotificationFile"/>
+        /// (like the message count semaphore), hence no ring is used when that file is not set.
+        /// </remarks>
+        public int ReportRingSlots
+        {
+            get => m_reportRingSlots;
+            set
+            {
+                Contract.Requires(value >= 0);
+                m_reportRingSlots = value;
+                m_fileAccessManifestExtraFlag = value > 0
+                    ? m_fileAccessManifestExtraFlag | FileAccessManifestExtraFlag.ReportRing
+                    : m_fileAccessManifestExtraFlag & ~FileAccessManifestExtraFlag.ReportRing;
+            }
+        }
+
+        /// <summary>
+        /// Number of slots of the shared-memory cache in which the processes of the pip share the reparse point targets they query;
+        /// 0 means that every process resolves reparse points on its own.
+        /// </summary>
+        /// <remarks>
+        /// The cache is created by <see cref="SandboxedProcess"/> under a name derived from <see cref="InternalDetoursErrorNotificationFile"/>
+        /// (like the message count semaphore), hence no cache is used when that file is not set.
+        /// </remarks>
+        public int SharedReparsePointCacheSlots
+        {
+            get => m_sharedReparsePointCacheSlots;
+            set
+            {
+                Contract.Requires(value >= 0);
+                m_sharedReparsePointCacheSlots = value;
+                m_fileAccessManifestExtraFlag = value > 0
+                    ? m_fileAccessManifestExtraFlag | FileAccessManifestExtraFlag.SharedReparsePointCache
+                    : m_fileAccessManifestExtraFlag & ~FileAccessManifestExtraFlag.SharedReparsePointCache;
+            }
+        }
+
+        /// <summary>
+        /// If true, Detours does not report an access to a path that the process already reported with the same or a stronger requested access
+        /// (Write implies Read, which implies Probe, which implies Lookup), like the macOS sandbox does.
+        /// </summary>
+        /// <remarks>
+        /// Accesses that fail and accesses that succeed, as well as explicit and non-explicit reports, are told apart; denied accesses are always reported.
+        /// </remarks>
+        public bool ReportOncePerPathAndAccess
+        {
+            get => (m_fileAccessManifestExtraFlag & FileAccessManifestExtraFlag.ReportOncePerPathAndAccess) != 0;
+            set => m_fileAccessManifestExtraFlag = value
+                ? m_fileAccessManifestExtraFlag | FileAccessManifestExtraFlag.ReportOncePerPathAndAccess
+                : m_fileAccessManifestExtraFlag & ~FileAccessManifestExtraFlag.ReportOncePerPathAndAccess;
+        }
+
+        /// <summary>
+        /// Number of slots of the shared-memory table in which the processes of the pip record the accesses they reported, so that a process does not
+        /// report an access that another process of the pip already reported with the same or a stronger requested access (see <see cref="ReportOncePerPathAndAccess"/>);
+        /// 0 means that every process reports its own accesses.
+        /// </summary>
+        /// <remarks>
+        /// The table is created by <see cref="SandboxedProcess"/> under a name derived from <see cref="InternalDetoursErrorNotificationFile"/>
+        /// (like the shared reparse point cache), hence no table is used when that file is not set. An access is then only reported for the process of the
+        /// pip that made it first, which doesn't matter for the observed inputs and outputs of the pip.
+        /// </remarks>
+        public int SharedReportedAccessSlots
+        {
+            get => m_sharedReportedAccessSlots;
+            set
+            {
+                Contract.Requires(value >= 0);
+                m_sharedReportedAccessSlots = value;
+                m_fileAccessManifestExtraFlag = value > 0
+                    ? m_fileAccessManifestExtraFlag | FileAccessManifestExtraFlag.SharedReportedAccesses
+                    : m_fileAccessManifestExtraFlag & ~FileAccessManifestExtraFlag.SharedReportedAccesses;
+            }
+        }
+
+        /// <summary>
+        /// If true, the children of the nodes of the manifest tree are laid out in the compact layout of Detours (see ManifestRecord in DataTypes.h),
+        /// in which the hashes of the children of a node are stored next to each other so that a lookup can compare several of them at once
+        /// without touching the records of the children.
+        /// </summary>
+        /// <remarks>
+        /// Every record tells its own layout, so whatever reads a manifest tree (including a sealed one) does not need this setting.
+        /// The compact layout is only written on Windows; the other sandboxes read the original layout only.
+        /// </remarks>
+        public bool UseCompactManifestTree { get; set; }
+
+        /// <summary>
+        /// If true, the manifest tree carries a Bloom filter of the paths of its nodes (see ManifestPathFilter in DataTypes.h), so that a search
+        /// that reaches a node can tell that the path has no more specific node without looking it up among the children of the node, and stop there.
+        /// </summary>
+        /// <remarks>
+        /// The filter is stored in the root record, which tells whether it has one, so whatever reads a manifest tree does not need this setting.
+        /// All the sandboxes (which share PolicySearch.cpp) read it.
+        /// </remarks>
+        public bool UseManifestPathFilter { get; set; }
+
+        /// <summary>
+        /// If not null, the manifest tree is written as a delta tree overlaid on this base tree, which the sandbox must then be given along with
+        /// the payload: the delta tree leaves out the parts of the manifest tree that are the same in the base tree (see <see cref="ManifestTreeBase"/>).
+        /// </summary>
+        /// <remarks>
+        /// The whole manifest tree is written when it cannot be overlaid on the base tree (e.g., when it is sealed). Only the sandboxes that read
+        /// the manifest with FileAccessManifestParser (Linux and macOS) accept a base tree.
+        /// </remarks>
+        public ManifestTreeBase TreeBase { get; set; }
+
+        /// <summary>
+        /// If true, Detours caches the NT device names and volume names of the drives of a process, so that it can get the final path of
+        /// a handle as an NT path and translate it itself, instead of having the OS query the mount manager for the DOS name of its volume.
+        /// </summary>
+        /// <remarks>
+        /// The cache is refreshed when the process defines a DOS device. Volumes with no drive letter or with several ones are still left to the OS.
+        /// </remarks>
+        public bool CacheDosDeviceNames
+        {
+            get => (m_fileAccessManifestExtraFlag & FileAccessManifestExtraFlag.CacheDosDeviceNames) != 0;
+            set => m_fileAccessManifestExtraFlag = value
+                ? m_fileAccessManifestExtraFlag | FileAccessManifestExtraFlag.CacheDosDeviceNames
+                : m_fileAccessManifestExtraFlag & ~FileAccessManifestExtraFlag.CacheDosDeviceNames;
+        }
+
+        /// <summary>
+        /// If true, Detours counts the calls to each detoured function of a process and the time spent in it (excluding the time spent in
+        /// the detoured functions it calls), and reports them with the hit counts of its path caches when the process exits.
+        /// </summary>
+        /// <remarks>
+        /// The statistics are logged as a verbose message of the pip.
+        /// </remarks>
+        public bool CollectDetourStatistics
+        {
+            get => (m_fileAccessManifestExtraFlag & FileAccessManifestExtraFlag.CollectDetourStatistics) != 0;
+            set => m_fileAccessManifestExtraFlag = value
+                ? m_fileAccessManifestExtraFlag | FileAccessManifestExtraFlag.CollectDetourStatistics
+                : m_fileAccessManifestExtraFlag & ~FileAccessManifestExtraFlag.CollectDetourStatistics;
+        }
+
+        /// <summary>
+        /// If true, the Linux sandbox reports accesses without checking them against this manifest (only honored when
+        /// <see cref="FailUnexpectedFileAccesses"/> is false, i.e., when nothing has to be denied), and the host checks the reports instead.
+        /// </summary>
+        /// <remarks>
+        /// The host needs the manifest tree to do so, hence it is kept until the pip completes (see <see cref="GetEffectivePolicy"/>).
+        /// </remarks>
+        public bool ObserveOnly
+        {
+            get => (m_fileAccessManifestExtraFlag & FileAccessManifestExtraFlag.ObserveOnly) != 0;
+            set => m_fileAccessManifestExtraFlag = value
+                ? m_fileAccessManifestExtraFlag | FileAccessManifestExtraFlag.ObserveOnly
+                : m_fileAccessManifestExtraFlag & ~FileAccessManifestExtraFlag.ObserveOnly;
+        }
+
+        /// <summary>
+        /// If true, Detours does not detour CreateFileW and CreateFileA: the accesses made through them are checked and reported once,
+        /// by the detour of the NtCreateFile they call, instead of at both levels.
+        /// </summary>
+        /// <remarks>
+        /// Only honored when <see cref="MonitorNtCreateFile"/> is true, since the accesses made through CreateFile would not be checked otherwise.
+        /// </remarks>
+        public bool NtCreateFileOnly
+        {
+            get => (m_fileAccessManifestExtraFlag & FileAccessManifestExtraFlag.NtCreateFileOnly) != 0;
+            set => m_fileAccessManifestExtraFlag = value
+                ? m_fileAccessManifestExtraFlag | FileAccessManifestExtraFlag.NtCreateFileOnly
+                : m_fileAccessManifestExtraFlag & ~FileAccessManifestExtraFlag.NtCreateFileOnly;
+        }
+
+        /// <summary>
+        /// If true, Detours only detours the Nt functions, process creation and the Win32 functions whose accesses do not all go through
+        /// a detoured Nt function (e.g., probes, enumerations and symbolic link creations): copies, moves, deletions, hard links and
+        /// CreateFile itself (see <see cref="NtCreateFileOnly"/>) are checked and reported by the detours of the Nt functions they call.
+        /// </summary>
+        /// <remarks>
+        /// Only honored when <see cref="MonitorNtCreateFile"/> is true and neither <see cref="IgnoreZwRenameFileInformation"/> nor
+        /// <see cref="IgnoreZwOtherFileInformation"/> is, since those accesses would not be checked otherwise. The reports of those accesses
+        /// carry the operation of the Nt function (e.g., NtCreateFile rather than CopyFile_Source).
+        /// </remarks>
+        public bool MinimalDetours
+        {
+            get => (m_fileAccessManifestExtraFlag & FileAccessManifestExtraFlag.MinimalDetours) != 0;
+            set => m_fileAccessManifestExtraFlag = value
+                ? m_fileAccessManifestExtraFlag | FileAccessManifestExtraFlag.MinimalDetours
+                : m_fileAccessManifestExtraFlag & ~FileAccessManifestExtraFlag.MinimalDetours;
+        }
+
+        /// <summary>
+        /// If true, Detours does not detour the file functions almost no tool calls (e.g., EncryptFile, OpenFileById or ReplaceFile) when a
+        /// process starts, but from a background thread right after, which shortens the start of every process.
+        /// </summary>
+        /// <remarks>
+        /// The calls to those functions made before they are detoured are only checked by the detours of the Nt functions they call, if any.
+        /// </remarks>
+        public bool DeferColdDetours
+        {
+            get => (m_fileAccessManifestExtraFlag & FileAccessManifestExtraFlag.DeferColdDetours) != 0;
+            set => m_fileAccessManifestExtraFlag = value
+                ? m_fileAccessManifestExtraFlag | FileAccessManifestExtraFlag.DeferColdDetours
+                : m_fileAccessManifestExtraFlag & ~FileAccessManifestExtraFlag.DeferColdDetours;
+        }
+
+        /// <summary>
+        /// If true, Detours remembers the probes (GetFileAttributes(Ex), and CreateFile opens of absent files without data access) it already
+        /// checked and reported, by path and outcome (absent, file or directory), so that probing the same path again only costs the real call.
+        /// </summary>
+        /// <remarks>
+        /// Like <see cref="ReportOncePerPathAndAccess"/>, this means a probe is only reported once per path and outcome (until the process
+        /// changes how paths resolve, e.g., by creating a symlink). Only absolute paths are cached.
+        /// </remarks>
+        public bool CacheProbeResults
+        {
+            get => (m_fileAccessManifestExtraFlag & FileAccessManifestExtraFlag.CacheProbeResults) != 0;
+            set => m_fileAccessManifestExtraFlag = value
+                ? m_fileAccessManifestExtraFlag | FileAccessManifestExtraFlag.CacheProbeResults
+                : m_fileAccessManifestExtraFlag & ~FileAccessManifestExtraFlag.CacheProbeResults;
+        }
+
+        /// <summary>
+        /// If true, Detours remembers the image paths it found by searching (the current directory and PATH) for the non-rooted application
+        /// names of the processes it creates, so that creating the same tool again does not search again.
+        /// </summary>
+        /// <remarks>
+        /// A search is keyed by the name, the current directory and PATH, and every search is dropped when the process writes a file with the
+        /// name a search looked for. Files written by other processes (e.g., a tool built by a child process) are not seen.
+        /// </remarks>
+        public bool CacheImagePathSearches
+        {
+            get => (m_fileAccessManifestExtraFlag & FileAccessManifestExtraFlag.CacheImagePathSearches) != 0;
+            set => m_fileAccessManifestExtraFlag = value
+                ? m_fileAccessManifestExtraFlag | FileAccessManifestExtraFlag.CacheImagePathSearches
+                : m_fileAccessManifestExtraFlag & ~FileAccessManifestExtraFlag.CacheImagePathSearches;
+        }
+
+        /// <summary>
+        /// If true, the process can be moved to the manifest of another pip while it runs (see <c>IProcessInjector.Retarget</c>), so that
+        /// a long-lived tool (e.g., a compiler server) can serve several pips, each of them with its own policy and report pipe.
+        /// </summary>
+        /// <remarks>
+        /// The process switches manifests once no thread is in a detoured function, which costs every detoured call a shared lock. Children
+        /// created before the switch keep their manifest, and the accesses through handles opened before the switch are not reported.
+        /// </remarks>
+        public bool AllowManifestRetarget
+        {
+            get => (m_fileAccessManifestExtraFlag & FileAccessManifestExtraFlag.AllowManifestRetarget) != 0;
+            set => m_fileAccessManifestExtraFlag = value
+                ? m_fileAccessManifestExtraFlag | FileAccessManifestExtraFlag.AllowManifestRetarget
+                : m_fileAccessManifestExtraFlag & ~FileAccessManifestExtraFlag.AllowManifestRetarget;
+        }
+
+        /// <summary>
+        /// If true, the entries found by a (reported) FindFirstFileEx/FindNextFile enumeration are not reported one by one: Detours sends one
+        /// <see cref="DirectoryEnumerationSummary"/> per directory and filter instead, from which the entries can be found again on demand.
+        /// </summary>
+        /// <remarks>
+        /// Not honored when all accesses are reported (<see cref="ReportFileAccesses"/>). Only the precise reports of the entries (i.e.,
+        /// <see cref="RequestedAccess.EnumerationProbe"/> accesses) are left out; the enumeration itself is reported as before.
+        /// </remarks>
+        public bool SummarizeDirectoryEnumerations
+        {
+            get => (m_fileAccessManifestExtraFlag & FileAccessManifestExtraFlag.SummarizeDirectoryEnumerations) != 0;
+            set => m_fileAccessManifestExtraFlag = value
+                ? m_fileAccessManifestExtraFlag | FileAccessManifestExtraFlag.SummarizeDirectoryEnumerations
+                : m_fileAccessManifestExtraFlag & ~FileAccessManifestExtraFlag.SummarizeDirectoryEnumerations;
+        }
+
+        /// <summary>
+        /// If true, Detours attaches to the functions that start like hotpatchable ones (e.g., with <c>mov edi,edi</c> on x86) through the
+        /// padding before them, which only needs their first instruction to be moved; the other functions are detoured as usual.
+        /// </summary>
+        public bool UseHotpatchDetours
+        {
+            get => (m_fileAccessManifestExtraFlag & FileAccessManifestExtraFlag.UseHotpatchDetours) != 0;
+            set => m_fileAccessManifestExtraFlag = value
+                ? m_fileAccessManifestExtraFlag | FileAccessManifestExtraFlag.UseHotpatchDetours
+                : m_fileAccessManifestExtraFlag & ~FileAccessManifestExtraFlag.UseHotpatchDetours;
+        }
+
+        private bool WritesCompactManifestTree => UseCompactManifestTree && !OperatingSystemHelper.IsUnixOS;
+
         /// <summary>
         /// True when the sandbox is integrated in QBuild. False otherwise.
         /// </summary>
@@ -497,6 +864,8 @@ namespace BuildXL.Processes
         {
             Contract.Requires(!IsManifestTreeBlockSealed);
 
+            m_hasReportUsnAfterOpenPolicies |= (values & FileAccessPolicy.ReportUsnAfterOpen) != 0;
+
             if (!path.IsValid)
             {
                 // Note that AbsolutePath.Invalid is allowable (representing the root scope).
@@ -504,6 +873,7 @@ namespace BuildXL.Processes
                 return;
             }
 
+            NormalizeFragmentsOf(path);
             m_rootNode.AddConeWithScope(this, path, new FileAccessScope(mask, values));
         }
 
@@ -515,9 +885,54 @@ namespace BuildXL.Processes
             Contract.Requires(!IsManifestTreeBlockSealed);
             Contract.Requires(path != AbsolutePath.Invalid);
 
+            m_hasReportUsnAfterOpenPolicies |= (values & FileAccessPolicy.ReportUsnAfterOpen) != 0;
+
+            NormalizeFragmentsOf(path);
             m_rootNode.AddNodeWithScope(this, path, new FileAccessScope(mask, values), expectedUsn ?? ReportedFileAccess.NoUsn);
         }
 
+        /// <summary>
+        /// Normalizes the fragments of the path that are not normalized yet with a single call into native, instead of one call per fragment
+        /// when the nodes of the path are added.
+        /// </summary>
+        private void NormalizeFragmentsOf(AbsolutePath path)
+        {
+            List<StringId> fragments = null;
+            for (AbsolutePath current = path; current.IsValid; current = current.GetParent(PathTable))
+            {
+                StringId fragment = current.GetName(PathTable).StringId;
+                if (!m_normalizedFragments.ContainsKey(fragment))
+                {
+                    fragments ??= new List<StringId>();
+                    if (!fragments.Contains(fragment))
+                    {
+                        fragments.Add(fragment);
+                    }
+                }
+            }
+
+            // A single fragment is left to the nodes
+            if (fragments == null || fragments.Count < 2)
+            {
+                return;
+            }
+
+            var strings = new string[fragments.Count];
+            for (int i = 0; i < fragments.Count; i++)
+            {
+                strings[i] = PathTable.StringTable.GetString(fragments[i]);
+            }
+
+            var normalizedBytes = new byte[fragments.Count][];
+            var hashes = new int[fragments.Count];
+            ProcessUtilities.NormalizeAndHashPaths(strings, normalizedBytes, hashes);
+
+            for (int i = 0; i < fragments.Count; i++)
+            {
+                m_normalizedFragments.Add(fragments[i], new NormalizedPathString(normalizedBytes[i], hashes[i]));
+            }
+        }
+
         /// <summary> 
         /// Looking up a policy for a path is not allowed before this property becomes true
         /// (which happens once the FAM is serialized)
@@ -557,6 +972,22 @@ namespace BuildXL.Processes
             return true;
         }
 
+        /// <summary>
+        /// The policy the sandbox applies to a given path: the node policy of its node if the manifest has one,
+        /// and otherwise the cone policy of the closest node above it (like PolicyResult::Initialize does natively).
+        /// </summary>
+        internal FileAccessPolicy GetEffectivePolicy(AbsolutePath path)
+        {
+            Contract.Requires(path.IsValid);
+
+            HydrateTreeNodeIfNeeded();
+
+            Contract.Assert(m_rootNode.IsPolicyFinalized);
+
+            var resultNode = m_rootNode.FindNodeFor(this, path);
+            return resultNode.PathId == path ? resultNode.NodePolicy : resultNode.ConePolicy;
+        }
+
         // See unmanaged decoder at DetoursHelpers.cpp :: CreateStringFromWriteChars()
         private static void WriteChars(BinaryWriter writer, string str)
         {
@@ -924,9 +1355,9 @@ namespace BuildXL.Processes
             {
                 writer.Write(m_sealedManifestTreeBlock);
             }
-            else
+            else if (TreeBase == null || !TreeBase.TrySerializeDelta(this, writer, WritesCompactManifestTree))
             {
-                m_rootNode.InternalSerialize(default(NormalizedPathString), writer);
+                m_rootNode.Serialize(writer, WritesCompactManifestTree, UseManifestPathFilter);
             }
         }
 
@@ -956,7 +1387,7 @@ namespace BuildXL.Processes
                 WriteTranslationPathStrings(writer, DirectoryTranslator);
                 WriteErrorDumpLocation(writer, InternalDetoursErrorNotificationFile);
                 WriteFlagsBlock(writer, m_fileAccessManifestFlag);
-                WriteExtraFlagsBlock(writer, FileAccessManifestExtraFlag.None);
+                WriteExtraFlagsBlock(writer, m_fileAccessManifestExtraFlag);
                 WritePipId(writer, PipId);
                 WriteReportBlock(writer, setup);
                 WriteDllBlock(writer, setup);
@@ -1008,6 +1439,7 @@ namespace BuildXL.Processes
                 WriteFlagsBlock(writer, m_fileAccessManifestFlag);
                 WritePipId(writer, PipId);
                 WriteChars(writer, m_messageCountSemaphoreName);
+                writer.Write(m_hasReportUsnAfterOpenPolicies);
 
                 // The manifest tree block has to be serialized the last.
                 WriteManifestTreeBlock(writer);
@@ -1033,6 +1465,7 @@ namespace BuildXL.Processes
                 FileAccessManifestFlag fileAccessManifestFlag = ReadFlagsBlock(reader);
                 long pipId = ReadPipId(reader);
                 string messageCountSemaphoreName = ReadChars(reader);
+                bool hasReportUsnAfterOpenPolicies = reader.ReadBoolean();
 
                 byte[] sealedManifestTreeBlock;
 
@@ -1049,7 +1482,8 @@ namespace BuildXL.Processes
                     PipId = pipId,
                     m_fileAccessManifestFlag = fileAccessManifestFlag,
                     m_sealedManifestTreeBlock = sealedManifestTreeBlock,
-                    m_messageCountSemaphoreName = messageCountSemaphoreName
+                    m_messageCountSemaphoreName = messageCountSemaphoreName,
+                    m_hasReportUsnAfterOpenPolicies = hasReportUsnAfterOpenPolicies
                 };
             }
         }
@@ -1089,7 +1523,7 @@ namespace BuildXL.Processes
             {
                 using (var writer = new BinaryWriter(stream, Encoding.Unicode, true))
                 {
-                    m_rootNode.Serialize(writer);
+                    m_rootNode.Serialize(writer, WritesCompactManifestTree, UseManifestPathFilter);
                     var bytes = stream.ToArray();
                     return bytes;
                 }
@@ -1102,7 +1536,7 @@ namespace BuildXL.Processes
         /// <returns>The line-by-line string representation of the manifest (formatted as a pre-order tree).</returns>
         public IEnumerable<string> Describe()
         {
-            return m_rootNode.Describe();
+            return m_rootNode.Describe(WritesCompactManifestTree, UseManifestPathFilter);
         }
 
         // CODESYNC: DataTypes.h
@@ -1148,6 +1582,24 @@ namespace BuildXL.Processes
         private enum FileAccessManifestExtraFlag
         {
             None = 0,
+            BatchReports = 0x1,
+            BinaryReports = 0x2,
+            ReportRing = 0x4,
+            SharedReparsePointCache = 0x8,
+            ReportOncePerPathAndAccess = 0x10,
+            CacheDosDeviceNames = 0x20,
+            CollectDetourStatistics = 0x40,
+            ObserveOnly = 0x80,
+            NtCreateFileOnly = 0x100,
+            MinimalDetours = 0x200,
+            DeferColdDetours = 0x400,
+            CacheProbeResults = 0x800,
+            CacheImagePathSearches = 0x1000,
+            AllowManifestRetarget = 0x2000,
+            SummarizeDirectoryEnumerations = 0x4000,
+            UseHotpatchDetours = 0x8000,
+            SharedReportedAccesses = 0x10000,
+            BufferDebugMessages = 0x20000,
         }
 
         private readonly struct FileAccessScope
@@ -1304,6 +1756,135 @@ namespace BuildXL.Processes
             }
         }
 
+        /// <summary>
+        /// A manifest tree shared by the manifests of the pips of a build, which only carry a delta tree overlaid on it (see <see cref="TreeBase"/>):
+        /// most of a manifest tree is the same for every pip (untracked scopes, mounts and the like), and the sandbox maps the base tree once
+        /// instead of parsing (and each process mapping) a copy of it with every manifest.
+        /// </summary>
+        /// <remarks>
+        /// The base tree is made of the nodes of the cones (<see cref="AddScope"/>) of a manifest and of their ancestors. A record of a delta tree
+        /// that has a record with the same path in the base tree, all of whose children it has too, links to it (see ManifestRecord::BaseLinkFlag
+        /// in DataTypes.h): a search that does not find a child of the record among its children looks it up among the children of the base record.
+        /// The children whose whole subtree is the same in the base tree are left out of the delta tree. Whatever else differs from the base tree
+        /// (policies, USNs, path ids) is in the delta tree, so searching a delta tree overlaid on its base tree is the same as searching the whole tree.
+        /// </remarks>
+        public sealed class ManifestTreeBase
+        {
+            private readonly PathTable m_pathTable;
+            private readonly Node m_root;
+            private readonly byte[] m_bytes;
+
+            /// <summary>
+            /// Offset of the record of every node from the root record of the serialized base tree
+            /// </summary>
+            private readonly Dictionary<Node, uint> m_recordOffsets;
+
+            private ManifestTreeBase(PathTable pathTable, Node root)
+            {
+                m_pathTable = pathTable;
+                m_root = root;
+                m_recordOffsets = new Dictionary<Node, uint>();
+
+                using (var stream = new MemoryStream(4096))
+                using (var writer = new BinaryWriter(stream, Encoding.Unicode, true))
+                {
+                    root.InternalSerialize(default(NormalizedPathString), writer, compactLayout: false, recordOffsets: m_recordOffsets);
+                    m_bytes = stream.ToArray();
+                }
+            }
+
+            /// <summary>
+            /// Creates a base tree out of the cones of the tree of <paramref name="manifest"/> (which gets finalized), null if its tree is sealed.
+            /// </summary>
+            public static ManifestTreeBase Create(FileAccessManifest manifest)
+            {
+                Contract.Requires(manifest != null);
+
+                if (manifest.IsManifestTreeBlockSealed)
+                {
+                    return null;
+                }
+
+                if (!manifest.m_rootNode.IsPolicyFinalized)
+                {
+                    manifest.m_rootNode.FinalizePolicies();
+                }
+
+                return new ManifestTreeBase(manifest.PathTable, manifest.m_rootNode.CopyCones(isRoot: true));
+            }
+
+            /// <summary>
+            /// Whether the base tree has any node besides its root.
+            /// </summary>
+            public bool IsEmpty => m_root.Children == null;
+
+            /// <summary>
+            /// Writes the serialized base tree (a manifest tree, as the last block of a manifest payload) to <paramref name="path"/>.
+            /// </summary>
+            public void Save(string path)
+            {
+                File.WriteAllBytes(path, m_bytes);
+            }
+
+            /// <summary>
+            /// Writes the tree of <paramref name="manifest"/> as a delta tree overlaid on this base tree, unless it cannot be (in which case nothing is written).
+            /// </summary>
+            /// <remarks>
+            /// A delta tree has no path filter: searches leave it for the base tree anyway.
+            /// </remarks>
+            internal bool TrySerializeDelta(FileAccessManifest manifest, BinaryWriter writer, bool compactLayout)
+            {
+                if (manifest.PathTable != m_pathTable)
+                {
+                    // The path ids of the base tree mean nothing to the manifest
+                    return false;
+                }
+
+                Node root = manifest.m_rootNode;
+                if (!root.IsPolicyFinalized)
+                {
+                    root.FinalizePolicies();
+                }
+
+                // The sandbox tells a delta tree by the link of its root, without which the base tree would be of no use anyway
+                var overlay = new TreeOverlay(m_recordOffsets);
+                root.Overlay(m_root, overlay, canLeaveOutChildren: false);
+                if (!overlay.BaseLinks.ContainsKey(root))
+                {
+                    return false;
+                }
+
+                root.InternalSerialize(default(NormalizedPathString), writer, compactLayout, overlay: overlay);
+                return true;
+            }
+        }
+
+        /// <summary>
+        /// The delta tree of a manifest tree overlaid on a <see cref="ManifestTreeBase"/>.
+        /// </summary>
+        private sealed class TreeOverlay
+        {
+            /// <summary>
+            /// Offset of the record of every node of the base tree (see <see cref="ManifestTreeBase"/>)
+            /// </summary>
+            internal readonly IReadOnlyDictionary<Node, uint> BaseRecordOffsets;
+
+            /// <summary>
+            /// Nodes that link to a node of the base tree, and the offset of its record
+            /// </summary>
+            internal readonly Dictionary<Node, uint> BaseLinks = new Dictionary<Node, uint>();
+
+            /// <summary>
+            /// Nodes left out of the delta tree, whose subtree is the same in the base tree
+            /// </summary>
+            internal readonly HashSet<Node> LeftOut = new HashSet<Node>();
+
+            internal TreeOverlay(IReadOnlyDictionary<Node, uint> baseRecordOffsets)
+            {
+                BaseRecordOffsets = baseRecordOffsets;
+            }
+        }
+
         /// <summary>
         /// A node for a partial path and associated policy.
         /// </summary>
@@ -1552,6 +2133,18 @@ namespace BuildXL.Processes
                 ChainMask = 0x03,
             }
 
+            // CODESYNC: DataTypes.h (ManifestRecord::CompactLayoutFlag and ManifestRecord::CompactLayoutProbeWidth)
+            private const uint CompactLayoutFlag = 0x80000000;
+            private const uint CompactLayoutProbeWidth = 4;
+
+            // CODESYNC: DataTypes.h (ManifestRecord::PathFilterFlag and ManifestPathFilter)
+            private const uint PathFilterFlag = 0x40000000;
+            private const uint RootPathHash = 0x9E3779B9;
+            private const int MaxPathFilterWords = 1 << 16;
+
+            // CODESYNC: DataTypes.h (ManifestRecord::BaseLinkFlag)
+            private const uint BaseLinkFlag = 0x20000000;
+
             /// <summary>
             /// Add a path to the tree.
             /// </summary>
@@ -1626,6 +2219,93 @@ namespace BuildXL.Processes
                 ExpectedUsn = expectedUsn;
             }
 
+            /// <summary>
+            /// Copies (with their finalized policies) the nodes of the subtree rooted at this node that a cone scope was applied to, and their ancestors;
+            /// null if there is none (and this is not the root).
+            /// </summary>
+            internal Node CopyCones(bool isRoot = false)
+            {
+                Contract.Requires(IsPolicyFinalized);
+
+                Dictionary<NormalizedPathString, Node> children = null;
+                if (m_children != null)
+                {
+                    foreach (var child in m_children)
+                    {
+                        Node copy = child.Value.CopyCones();
+                        if (copy != null)
+                        {
+                            children ??= new Dictionary<NormalizedPathString, Node>();
+                            children.Add(child.Key, copy);
+                        }
+                    }
+                }
+
+                bool isCone = ConeScope.Mask != FileAccessPolicy.MaskNothing || ConeScope.Values != FileAccessPolicy.Deny;
+                if (!isRoot && !isCone && children == null)
+                {
+                    return null;
+                }
+
+                return new Node(m_pathId)
+                {
+                    m_children = children,
+                    m_conePolicy = m_conePolicy,
+                    m_nodePolicy = m_nodePolicy,
+                    m_isPolicyFinalized = true,
+                    ExpectedUsn = ExpectedUsn,
+                };
+            }
+
+            /// <summary>
+            /// Records in <paramref name="overlay"/> how the subtree rooted at this node is overlaid on the subtree rooted at <paramref name="baseNode"/>,
+            /// which has the same path in the base tree, and returns whether both are the same (see <see cref="ManifestTreeBase"/>).
+            /// </summary>
+            /// <remarks>
+            /// This node links to the base node if it has all of its children, as a search in the delta tree that finds no child of this node carries on
+            /// in the base tree from the child of the base node, if any. The children whose subtree is the same are then left out of the delta tree,
+            /// unless <paramref name="canLeaveOutChildren"/> is false (for the root, whose single child of a Unix tree is the root the sandbox searches from).
+            /// </remarks>
+            internal bool Overlay(Node baseNode, TreeOverlay overlay, bool canLeaveOutChildren)
+            {
+                Contract.Requires(IsPolicyFinalized && baseNode.IsPolicyFinalized);
+
+                bool isLinked = baseNode.m_children == null || baseNode.m_children.Keys.All(key => m_children?.ContainsKey(key) == true);
+                if (isLinked)
+                {
+                    overlay.BaseLinks.Add(this, overlay.BaseRecordOffsets[baseNode]);
+                }
+
+                bool isSame = isLinked
+                    && m_conePolicy == baseNode.m_conePolicy
+                    && m_nodePolicy == baseNode.m_nodePolicy
+                    && m_pathId == baseNode.m_pathId
+                    && ExpectedUsn == baseNode.ExpectedUsn;
+
+                if (m_children != null)
+                {
+                    foreach (var child in m_children)
+                    {
+                        if (baseNode.m_children?.TryGetValue(child.Key, out Node baseChild) == true)
+                        {
+                            bool isChildSame = child.Value.Overlay(baseChild, overlay, canLeaveOutChildren: true);
+                            if (isChildSame && isLinked && canLeaveOutChildren)
+                            {
+                                overlay.LeftOut.Add(child.Value);
+                            }
+
+                            isSame &= isChildSame;
+                        }
+                        else
+                        {
+                            isSame = false;
+                        }
+                    }
+                }
+
+                return isSame;
+            }
+
             /// <nodoc/>
             public static (Node, NormalizedPathString) InternalDeserialize(BinaryReader reader)
             {
@@ -1639,6 +2319,16 @@ namespace BuildXL.Processes
                 uint pathIdValue = reader.ReadUInt32();
                 ulong expectedUsnValue = reader.ReadUInt64();
                 uint bucketCount = reader.ReadUInt32();
+                bool isCompactLayout = (bucketCount & CompactLayoutFlag) != 0;
+                bool hasPathFilter = (bucketCount & PathFilterFlag) != 0;
+                bool hasBaseLink = (bucketCount & BaseLinkFlag) != 0;
+                bucketCount &= ~(CompactLayoutFlag | PathFilterFlag | BaseLinkFlag);
+
+                if (isCompactLayout)
+                {
+                    // Home slot count
+                    reader.ReadUInt32();
+                }
 
                 int childrenCount = 0;
                 for (int i = 0; i < bucketCount; i++)
@@ -1651,10 +2341,29 @@ namespace BuildXL.Processes
                     }
                 }
 
+                if (isCompactLayout)
+                {
+                    // Child hashes
+                    reader.BaseStream.Seek(bucketCount * sizeof(uint), SeekOrigin.Current);
+                }
+
                 unchecked
                 {
                     var normalizedPathString = new NormalizedPathString(NormalizedPathString.DeserializeBytes(reader), (int)normalizedFragmentHash);
 
+                    if (hasBaseLink)
+                    {
+                        // Serialized trees are whole trees, never delta trees: the base record is of no use here
+                        reader.ReadUInt32();
+                    }
+
+                    if (hasPathFilter)
+                    {
+                        // Rebuilt when the tree is serialized again
+                        uint wordCount = reader.ReadUInt32();
+                        reader.BaseStream.Seek(wordCount * sizeof(uint), SeekOrigin.Current);
+                    }
+
                     Node node = new Node(new AbsolutePath((int)pathIdValue));
                     node.m_conePolicy = (FileAccessPolicy)conePolicy;
                     node.m_nodePolicy = (FileAccessPolicy)nodePolicy;
@@ -1676,7 +2385,11 @@ namespace BuildXL.Processes
                 }
             }
 
-            public void InternalSerialize(NormalizedPathString normalizedFragment, BinaryWriter writer)
+            /// <remarks>
+            /// The position of the record of every node is added to <paramref name="recordOffsets"/>, if not null. The tree is written as the delta tree
+            /// of <paramref name="overlay"/>, if not null (see <see cref="ManifestTreeBase"/>).
+            /// </remarks>
+            public void InternalSerialize(NormalizedPathString normalizedFragment, BinaryWriter writer, bool compactLayout, uint[] pathFilter = null, Dictionary<Node, uint> recordOffsets = null, TreeOverlay overlay = null)
             {
                 // always finalize when serializing -- note that this prevents adding additional scopes as before
                 if (!IsPolicyFinalized)
@@ -1687,6 +2400,21 @@ namespace BuildXL.Processes
                 unchecked
                 {
                     long start = writer.BaseStream.Position;
+                    recordOffsets?.Add(this, checked((uint)start));
+
+                    uint? baseRecordOffset = null;
+                    IReadOnlyCollection<KeyValuePair<NormalizedPathString, Node>> children = m_children;
+                    if (overlay != null)
+                    {
+                        baseRecordOffset = overlay.BaseLinks.TryGetValue(this, out uint baseOffset) ? baseOffset : (uint?)null;
+                        if (m_children != null && overlay.LeftOut.Count > 0)
+                        {
+                            var remaining = m_children.Where(child => !overlay.LeftOut.Contains(child.Value)).ToList();
+                            children = remaining.Count > 0 ? remaining : null;
+                        }
+                    }
+
+                    uint flags = (pathFilter != null ? PathFilterFlag : 0U) | (baseRecordOffset.HasValue ? BaseLinkFlag : 0U);
 #if DEBUG
                     writer.Write((uint)0xF00DCAFE); // "food cafe"
 #endif
@@ -1696,17 +2424,24 @@ namespace BuildXL.Processes
                     writer.Write((uint)PathId.Value.Value);
                     writer.Write((ulong)ExpectedUsn.Value);
 
-                    var childCount = (uint)(m_children == null ? 0 : m_children.Count);
+                    var childCount = (uint)(children == null ? 0 : children.Count);
 
                     // The children will be added to a hash-table.
                     // As it is known that hash-table performance starts to degrade with load factors > 0.7,
                     // we size our hash-table appropriately.
                     var bucketCount = childCount == 0 ? 0 : checked((uint)(childCount / 0.7));
                     Contract.Assert((bucketCount == 0) == (childCount == 0));
-                    writer.Write(bucketCount);
+
+                    if (compactLayout && children != null)
+                    {
+                        InternalSerializeCompactChildren(normalizedFragment, children, writer, start, homeSlotCount: bucketCount, flags, pathFilter, baseRecordOffset, recordOffsets, overlay);
+                        return;
+                    }
+
+                    writer.Write(bucketCount | flags);
 
                     long offsetsStart = 0;
-                    if (m_children != null)
+                    if (children != null)
                     {
                         offsetsStart = writer.BaseStream.Position;
                         for (var i = 0; i < bucketCount; i++)
@@ -1725,12 +2460,15 @@ namespace BuildXL.Processes
                         writer.Write(0U);
                     }
 
-                    if (m_children != null)
+                    WriteBaseLink(writer, baseRecordOffset);
+                    WritePathFilter(writer, pathFilter);
+
+                    if (children != null)
                     {
                         // We are now building a simple hash-table with linear chaining for collisions.
                         // The lowest two bits of each record may encoding information about whether a collision chain starts at that point, or continues.
                         uint[] offsets = new uint[bucketCount];
-                        foreach (var child in m_children)
+                        foreach (var child in children)
                         {
                             var hash = unchecked((uint)child.Key.HashCode);
                             var index = hash % bucketCount;
@@ -1752,7 +2490,7 @@ namespace BuildXL.Processes
                             var offset = checked((uint)(writer.BaseStream.Position - start));
                             Contract.Assume((offset & (uint)FileAccessBucketOffsetFlag.ChainMask) == 0);
                             offsets[index] = offset;
-                            child.Value.InternalSerialize(child.Key, writer);
+                            child.Value.InternalSerialize(child.Key, writer, compactLayout, recordOffsets: recordOffsets, overlay: overlay);
                         }
 
                         long endPosition = writer.BaseStream.Position;
@@ -1767,7 +2505,95 @@ namespace BuildXL.Processes
                 }
             }
 
-            public void Serialize(BinaryWriter writer)
+            /// <summary>
+            /// Serializes the children of this node (which has some) in the compact layout, after the part of the record that both layouts share.
+            /// </summary>
+            /// <remarks>
+            /// The children are placed by linear probing from their home slot, without wrapping around, in a table that is extended as needed so that
+            /// probes never go past its end: see ManifestRecord::CompactLayoutFlag in DataTypes.h.
+            /// </remarks>
+            private void InternalSerializeCompactChildren(
+                NormalizedPathString normalizedFragment,
+                IReadOnlyCollection<KeyValuePair<NormalizedPathString, Node>> serializedChildren,
+                BinaryWriter writer,
+                long start,
+                uint homeSlotCount,
+                uint flags,
+                uint[] pathFilter,
+                uint? baseRecordOffset,
+                Dictionary<Node, uint> recordOffsets,
+                TreeOverlay overlay)
+            {
+                unchecked
+                {
+                    var children = new KeyValuePair<NormalizedPathString, Node>[homeSlotCount + CompactLayoutProbeWidth];
+                    int slotCount = (int)(homeSlotCount - 1 + CompactLayoutProbeWidth);
+                    foreach (var child in serializedChildren)
+                    {
+                        var index = (int)((uint)child.Key.HashCode % homeSlotCount);
+                        while (children[index].Value != null)
+                        {
+                            index++;
+                        }
+
+                        slotCount = Math.Max(slotCount, index + 1 + (int)CompactLayoutProbeWidth);
+                        if (slotCount > children.Length)
+                        {
+                            Array.Resize(ref children, Math.Max(slotCount, children.Length * 2));
+                        }
+
+                        children[index] = child;
+                    }
+
+                    writer.Write(CompactLayoutFlag | flags | (uint)slotCount);
+                    writer.Write(homeSlotCount);
+
+                    long offsetsStart = writer.BaseStream.Position;
+                    for (var i = 0; i < slotCount; i++)
+                    {
+                        // to be patched up later
+                        writer.Write(0U);
+                    }
+
+                    for (var i = 0; i < slotCount; i++)
+                    {
+                        writer.Write(children[i].Value != null ? (uint)children[i].Key.HashCode : 0U);
+                    }
+
+                    if (normalizedFragment.IsValid)
+                    {
+                        normalizedFragment.Serialize(writer);
+                    }
+                    else
+                    {
+                        writer.Write(0U);
+                    }
+
+                    WriteBaseLink(writer, baseRecordOffset);
+                    WritePathFilter(writer, pathFilter);
+
+                    uint[] offsets = new uint[slotCount];
+                    for (var i = 0; i < slotCount; i++)
+                    {
+                        if (children[i].Value != null)
+                        {
+                            offsets[i] = checked((uint)(writer.BaseStream.Position - start));
+                            children[i].Value.InternalSerialize(children[i].Key, writer, compactLayout: true, recordOffsets: recordOffsets, overlay: overlay);
+                        }
+                    }
+
+                    long endPosition = writer.BaseStream.Position;
+                    writer.BaseStream.Seek(offsetsStart, SeekOrigin.Begin);
+                    for (var i = 0; i < offsets.Length; i++)
+                    {
+                        writer.Write(offsets[i]);
+                    }
+
+                    writer.BaseStream.Seek(endPosition, SeekOrigin.Begin);
+                }
+            }
+
+            public void Serialize(BinaryWriter writer, bool compactLayout, bool pathFilter)
             {
                 // always finalize when serializing -- note that this prevents adding additional scopes as before
                 if (!IsPolicyFinalized)
@@ -1775,7 +2601,92 @@ namespace BuildXL.Processes
                     FinalizePolicies();
                 }
 
-                InternalSerialize(default(NormalizedPathString), writer);
+                InternalSerialize(default(NormalizedPathString), writer, compactLayout, pathFilter && m_children != null ? BuildPathFilter() : null);
+            }
+
+            /// <summary>
+            /// Builds the path filter of the tree rooted at this node: see ManifestPathFilter in DataTypes.h.
+            /// </summary>
+            /// <remarks>
+            /// The filter has about 16 bits per node (up to <see cref="MaxPathFilterWords"/> words), which makes the false positive rate below 1%.
+            /// </remarks>
+            private uint[] BuildPathFilter()
+            {
+                var pathHashes = new List<uint>();
+                CollectPathHashes(RootPathHash, pathHashes);
+
+                int wordCount = 1;
+                while (wordCount < MaxPathFilterWords && wordCount * 2 < pathHashes.Count)
+                {
+                    wordCount *= 2;
+                }
+
+                var words = new uint[wordCount];
+                foreach (var pathHash in pathHashes)
+                {
+                    AddToPathFilter(words, pathHash);
+                }
+
+                return words;
+            }
+
+            private void CollectPathHashes(uint pathHash, List<uint> pathHashes)
+            {
+                if (m_children == null)
+                {
+                    return;
+                }
+
+                foreach (var child in m_children)
+                {
+                    uint childPathHash = ExtendPathHash(pathHash, unchecked((uint)child.Key.HashCode));
+                    pathHashes.Add(childPathHash);
+                    child.Value.CollectPathHashes(childPathHash, pathHashes);
+                }
+            }
+
+            // CODESYNC: DataTypes.h (ManifestPathFilter::ExtendPathHash)
+            private static uint ExtendPathHash(uint parentPathHash, uint childHash)
+            {
+                unchecked
+                {
+                    return (((parentPathHash << 5) | (parentPathHash >> 27)) ^ childHash) * 0x85EBCA6B;
+                }
+            }
+
+            // CODESYNC: DataTypes.h (ManifestPathFilter::MayContain)
+            private static void AddToPathFilter(uint[] words, uint pathHash)
+            {
+                unchecked
+                {
+                    uint x = pathHash ^ (pathHash >> 16);
+                    x *= 0xC2B2AE35;
+                    x ^= x >> 13;
+                    uint y = x * 0x9E3779B1;
+                    words[x & (uint)(words.Length - 1)] |= (1U << (int)(y >> 27)) | (1U << (int)((y >> 22) & 31)) | (1U << (int)((y >> 17) & 31));
+                }
+            }
+
+            private static void WriteBaseLink(BinaryWriter writer, uint? baseRecordOffset)
+            {
+                if (baseRecordOffset.HasValue)
+                {
+                    writer.Write(baseRecordOffset.Value);
+                }
+            }
+
+            private static void WritePathFilter(BinaryWriter writer, uint[] pathFilter)
+            {
+                if (pathFilter == null)
+                {
+                    return;
+                }
+
+                writer.Write((uint)pathFilter.Length);
+                foreach (var word in pathFilter)
+                {
+                    writer.Write(word);
+                }
             }
 
             private static string ReadUnicodeString(BinaryReader reader, List<byte> buffer)
@@ -1810,7 +2721,7 @@ namespace BuildXL.Processes
             /// as that faithfully represents the information that is actually used by the monitored process.
             /// </remarks>
             [SuppressMessage("Microsoft.Usage", "CA2202:Do not dispose objects multiple times")]
-            public IEnumerable<string> Describe()
+            public IEnumerable<string> Describe(bool compactLayout, bool pathFilter)
             {
                 // start with 4 KB of memory (one page), which will expand as necessary
                 // stream will be disposed by the BinaryWriter when it goes out of scope
@@ -1818,7 +2729,7 @@ namespace BuildXL.Processes
                 {
                     using (var writer = new BinaryWriter(stream, Encoding.Unicode, true))
                     {
-                        Serialize(writer);
+                        Serialize(writer, compactLayout, pathFilter);
                     }
 
                     using (var reader = new BinaryReader(stream, Encoding.Unicode, true))
@@ -1851,7 +2762,15 @@ namespace BuildXL.Processes
                                 var pathId = reader.ReadUInt32();
                                 Usn expectedUsn = new Usn(reader.ReadUInt64());
 
-                                int hashtableCount = reader.ReadInt32();
+                                uint bucketCount = reader.ReadUInt32();
+                                bool isCompactLayout = (bucketCount & CompactLayoutFlag) != 0;
+                                int hashtableCount = (int)(bucketCount & ~(CompactLayoutFlag | PathFilterFlag));
+                                if (isCompactLayout)
+                                {
+                                    // Home slot count
+                                    reader.ReadUInt32();
+                                }
+
                                 List<long> absoluteChildStarts = new List<long>();
                                 for (int i = 0; i < hashtableCount; i++)
                                 {
@@ -1862,6 +2781,12 @@ namespace BuildXL.Processes
                                     }
                                 }
 
+                                if (isCompactLayout)
+                                {
+                                    // Child hashes
+                                    reader.BaseStream.Seek(hashtableCount * sizeof(uint), SeekOrigin.Current);
+                                }
+
                                 string partialPath = ReadUnicodeString(reader, buffer);
                                 string fullPath = Path.Combine(item.Path, partialPath);
 
@@ -1956,6 +2881,7 @@ namespace BuildXL.Processes
                     Tuple.Create((short)FileAccessPolicy.OverrideAllowWriteForExistingFiles, "OverrideAllowWriteForExistingFiles"),
                     Tuple.Create((short)FileAccessPolicy.TreatDirectorySymlinkAsDirectory, "DirectorySymlinkAsDirectory"),
                     Tuple.Create((short)FileAccessPolicy.EnableFullReparsePointParsing, "EnableFullReparsePointParsing"),
+                    Tuple.Create((short)FileAccessPolicy.NoReparsePoints, "NoReparsePoints"),
                     Tuple.Create((short)FileAccessPolicy.ReportAccess, "ReportAccess"),
                     // Note that composite values must appear before their parts.
                     Tuple.Create((short)FileAccessPolicy.ReportAccessIfExistent, "ReportAccessIfExistent"),
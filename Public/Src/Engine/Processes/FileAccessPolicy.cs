@@ -104,6 +104,12 @@ namespace BuildXL.Processes
         /// </summary>
         EnableFullReparsePointParsing = 0x1000,
 
+        /// <summary>
+        /// If set, the paths under here (including the scope itself) are guaranteed not to be reparse points, so Detours only checks
+        /// the directories above the scope for reparse points.
+        /// </summary>
+        NoReparsePoints = 0x2000,
+
         /// <summary>
         /// If set, then we will report attempts to access files under this scope, whether they exist or not (combination of <see cref="ReportAccessIfExistent"/>
         /// and <see cref="ReportAccessIfNonexistent"/>).
@@ -0,0 +1,220 @@
+﻿// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+using System.Collections.Generic;
+using BuildXL.Native.IO;
+using BuildXL.Utilities;
+using static BuildXL.Utilities.FormattableStringEx;
+
+namespace BuildXL.Processes
+{
+    /// <summary>
+    /// Parses the binary file access reports (<see cref="ReportType.FileAccessRecord"/>) Detours sends when
+    /// <see cref="FileAccessManifest.BinaryReports"/> is set.
+    /// </summary>
+    /// <remarks>
+    /// CODESYNC: Public/Src/Sandbox/Windows/DetoursServices/SendReport.cpp (see there for the format).
+    /// Strings (operation names and paths) are sent in full only the first time a process reports them, along with an id the
+    /// process uses for them from then on; an instance keeps track of those ids, so one instance must see all the reports of a pip.
+    /// </remarks>
+    internal sealed class FileAccessReportRecordParser
+    {
+        private const uint Version = 1;
+
+        // Digits are UTF-16 code units in [MinDigit, MaxDigit); each carries DigitBits bits, and more digits follow if it is >= MoreDigits.
+        private const int MinDigit = 0x4000;
+        private const int MoreDigits = 0x8000;
+        private const int MaxDigit = 0xC000;
+        private const int DigitBits = 14;
+        private const int DigitMask = (1 << DigitBits) - 1;
+
+        private readonly Dictionary<(uint processId, uint id), string> m_strings = new Dictionary<(uint processId, uint id), string>();
+
+        /// <summary>
+        /// Parses a record (the report line without its report type); matches <see cref="SandboxedProcessReports.FileAccessReportProvider{T}"/>.
+        /// </summary>
+        public bool TryParse(
+            ref string record,
+            out uint processId,
+            out uint id,
+            out uint correlationId,
+            out ReportedFileOperation operation,
+            out RequestedAccess requestedAccess,
+            out FileAccessStatus status,
+            out bool explicitlyReported,
+            out uint error,
+            out Usn usn,
+            out DesiredAccess desiredAccess,
+            out ShareMode shareMode,
+            out CreationDisposition creationDisposition,
+            out FlagsAndAttributes flagsAndAttributes,
+            out FlagsAndAttributes openedFileOrDirectoryAttributes,
+            out AbsolutePath manifestPath,
+            out string path,
+            out string enumeratePattern,
+            out string processArgs,
+            out string errorMessage)
+        {
+            operation = ReportedFileOperation.Unknown;
+            requestedAccess = RequestedAccess.None;
+            status = FileAccessStatus.None;
+            processId = id = correlationId = error = 0;
+            usn = default;
+            explicitlyReported = false;
+            desiredAccess = 0;
+            shareMode = ShareMode.FILE_SHARE_NONE;
+            creationDisposition = 0;
+            flagsAndAttributes = 0;
+            openedFileOrDirectoryAttributes = 0;
+            manifestPath = AbsolutePath.Invalid;
+            path = enumeratePattern = processArgs = null;
+            errorMessage = string.Empty;
+
+            int index = 0;
+            if (!TryReadNumber(record, ref index, out var version) || version != Version)
+            {
+                errorMessage = I($"Unexpected file access record version (potentially due to pipe corruption). Expected {Version}.");
+                return false;
+            }
+
+            if (!(TryReadUInt(record, ref index, out processId) &&
+                  TryReadUInt(record, ref index, out id) &&
+                  TryReadUInt(record, ref index, out correlationId) &&
+                  TryReadUInt(record, ref index, out var requestedAccessValue) &&
+                  TryReadUInt(record, ref index, out var statusValue) &&
+                  TryReadUInt(record, ref index, out var explicitlyReportedValue) &&
+                  TryReadUInt(record, ref index, out error) &&
+                  TryReadNumber(record, ref index, out var usnValue) &&
+                  TryReadUInt(record, ref index, out var desiredAccessValue) &&
+                  TryReadUInt(record, ref index, out var shareModeValue) &&
+                  TryReadUInt(record, ref index, out var creationDispositionValue) &&
+                  TryReadUInt(record, ref index, out var flagsAndAttributesValue) &&
+                  TryReadUInt(record, ref index, out var openedFileOrDirectoryAttributesValue) &&
+                  TryReadUInt(record, ref index, out var manifestPathValue)))
+            {
+                errorMessage = "Malformed file access record (potentially due to pipe corruption): could not read its fields.";
+                return false;
+            }
+
+            if (!(TryReadString(record, ref index, processId, out var operationName, out errorMessage) &&
+                  TryReadString(record, ref index, processId, out path, out errorMessage) &&
+                  TryReadString(record, ref index, processId, out enumeratePattern, out errorMessage) &&
+                  TryReadString(record, ref index, processId, out processArgs, out errorMessage)))
+            {
+                return false;
+            }
+
+            if (index != record.Length)
+            {
+                errorMessage = I($"Malformed file access record (potentially due to pipe corruption): {record.Length - index} unexpected trailing characters.");
+                return false;
+            }
+
+            if (statusValue > (uint)FileAccessStatus.CannotDeterminePolicy)
+            {
+                errorMessage = I($"Unknown file access status '{statusValue}'");
+                return false;
+            }
+
+            if (requestedAccessValue > (uint)RequestedAccess.All)
+            {
+                errorMessage = I($"Unknown requested access '{requestedAccessValue}'");
+                return false;
+            }
+
+            if (!FileAccessReportLine.Operations.TryGetValue(operationName, out operation))
+            {
+                // Like FileAccessReportLine.TryParse, do not throw the report out because of an operation the parser does not know yet.
+                operation = ReportedFileOperation.Unknown;
+            }
+
+            requestedAccess = (RequestedAccess)requestedAccessValue;
+            status = (FileAccessStatus)statusValue;
+            explicitlyReported = explicitlyReportedValue != 0;
+            usn = new Usn(usnValue);
+            desiredAccess = (DesiredAccess)desiredAccessValue;
+            shareMode = (ShareMode)shareModeValue;
+            creationDisposition = (CreationDisposition)creationDispositionValue;
+            flagsAndAttributes = (FlagsAndAttributes)flagsAndAttributesValue;
+            openedFileOrDirectoryAttributes = (FlagsAndAttributes)openedFileOrDirectoryAttributesValue;
+            manifestPath = new AbsolutePath(unchecked((int)manifestPathValue));
+
+            if (requestedAccess != RequestedAccess.Enumerate)
+            {
+                // If the requested access is not enumeration, enumeratePattern does not matter.
+                enumeratePattern = null;
+            }
+
+            return true;
+        }
+
+        private static bool TryReadNumber(string record, ref int index, out ulong value)
+        {
+            value = 0;
+            for (int shift = 0; index < record.Length && shift < 64; shift += DigitBits)
+            {
+                int digit = record[index++];
+                if (digit < MinDigit || digit >= MaxDigit)
+                {
+                    return false;
+                }
+
+                value |= (ulong)(digit & DigitMask) << shift;
+                if (digit < MoreDigits)
+                {
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        private static bool TryReadUInt(string record, ref int index, out uint value)
+        {
+            bool success = TryReadNumber(record, ref index, out var number) && number <= uint.MaxValue;
+            value = unchecked((uint)number);
+            return success;
+        }
+
+        private bool TryReadString(string record, ref int index, uint processId, out string value, out string errorMessage)
+        {
+            value = null;
+            errorMessage = string.Empty;
+
+            if (!TryReadUInt(record, ref index, out var reference))
+            {
+                errorMessage = "Malformed file access record (potentially due to pipe corruption): could not read a string reference.";
+                return false;
+            }
+
+            uint stringId = reference >> 1;
+            if ((reference & 1) == 0)
+            {
+                if (!m_strings.TryGetValue((processId, stringId), out value))
+                {
+                    errorMessage = I($"File access record of process {processId} refers to unknown string {stringId}.");
+                    return false;
+                }
+
+                return true;
+            }
+
+            if (!TryReadUInt(record, ref index, out var length) || length > record.Length - index)
+            {
+                errorMessage = "Malformed file access record (potentially due to pipe corruption): string length out of range.";
+                return false;
+            }
+
+            value = record.Substring(index, (int)length);
+            index += (int)length;
+
+            if (stringId != 0)
+            {
+                // A process reusing the pid of an exited one redefines the ids it uses before using them.
+                m_strings[(processId, stringId)] = value;
+            }
+
+            return true;
+        }
+    }
+}
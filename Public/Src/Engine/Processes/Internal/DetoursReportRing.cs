@@ -0,0 +1,371 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+using System;
+using System.Diagnostics.ContractsLight;
+using System.IO;
+using System.IO.MemoryMappedFiles;
+using System.Runtime.InteropServices;
+using System.Text;
+using System.Threading;
+using System.Threading.Tasks;
+using BuildXL.Utilities;
+using BuildXL.Utilities.Tasks;
+
+namespace BuildXL.Processes.Internal
+{
+    /// <summary>
+    /// Shared-memory ring into which the Detours of a pip's processes put their report lines instead of writing them to the report pipe
+    /// (see <see cref="FileAccessManifest.ReportRingSlots"/>), along with the thread that receives them.
+    /// </summary>
+    /// <remarks>
+    /// CODESYNC: Public/Src/Sandbox/Windows/DetoursServices/ReportRing.h
+    ///
+    /// The ring is a bounded multi-producer queue of slots (see ReportRing.h); data larger than a slot is put into consecutive slots.
+    /// When the ring is empty, the receiving thread sets a flag and waits on an event, which producers only signal when they find the flag set.
+    /// The report pipe still tells when all reports have been sent: once it has reached EOF, <see cref="CompleteAsync"/> makes the thread
+    /// receive whatever is left in the ring and stop.
+    ///
+    /// A slot that was claimed but is not published stops the thread. While that lasts, the thread wakes up regularly to skip the slot
+    /// once the process that claimed it is gone (see <see cref="TrySkipAbandonedSlot"/>), as terminated processes never publish theirs.
+    /// </remarks>
+    internal sealed unsafe class DetoursReportRing : IDisposable
+    {
+        private const uint Magic = 0x474e4952;
+        private const uint Version = 2;
+        private const int HeaderSize = 256;
+        private const int SlotHeaderSize = 24;
+        private const int SlotLengthOffset = 8;
+        private const int SlotFlagsOffset = 12;
+        private const int SlotClaimerPidOffset = 16;
+        private const int EnqueuePosOffset = 64;
+        private const int DequeuePosOffset = 128;
+        private const int ReaderWaitingOffset = 192;
+        private const int SlotFlagContinued = 0x1;
+
+        /// <summary>How long a claimed slot stays unpublished before its claimer is checked (and how often the thread wakes up meanwhile)</summary>
+        private static readonly TimeSpan s_abandonedSlotTimeout = TimeSpan.FromSeconds(1);
+
+        /// <summary>How long a claimed slot whose claimer is not known yet stays unpublished before it is skipped</summary>
+        /// <remarks>The claimer records its id right after it claims the slot: only one that was terminated in between leaves it unknown</remarks>
+        private static readonly TimeSpan s_unknownClaimerTimeout = TimeSpan.FromSeconds(10);
+
+        /// <summary>Number of bytes a slot holds</summary>
+        private const int SlotSize = 4096;
+
+        private static readonly char[] s_lineTerminators = new[] { '\r', '\n' };
+
+        private readonly MemoryMappedFile m_section;
+        private readonly MemoryMappedViewAccessor m_view;
+        private readonly byte* m_base;
+        private readonly int m_slotCount;
+        private readonly int m_slotStride;
+        private long m_dequeuePos;
+
+        private readonly EventWaitHandle m_doorbell;
+        private readonly ManualResetEvent m_stopRequested = new ManualResetEvent(false);
+        private readonly StreamDataReceived m_callback;
+        private readonly TaskSourceSlim<bool> m_completion = TaskSourceSlim.Create<bool>();
+        private readonly Thread m_thread;
+        private bool m_started;
+
+        // Data of a report chunk spanning several slots
+        private byte[] m_chunk = new byte[SlotSize];
+        private int m_chunkLength;
+        private bool m_callbackFailed;
+
+        // The position the thread is stopped at since 'm_stalledSince' (-1 if it is not stopped), and the last claimer found gone
+        // (the other slots it claimed, if any, are skipped right away)
+        private long m_stalledPos = -1;
+        private readonly System.Diagnostics.Stopwatch m_stalledSince = new System.Diagnostics.Stopwatch();
+        private uint m_goneClaimerPid;
+
+        /// <summary>
+        /// Creates the ring (and its event) for the processes whose internal error notification file is <paramref name="errorNotificationFile"/>.
+        /// </summary>
+        /// <exception cref="BuildXLException">Thrown if a ring with the same name already exists.</exception>
+        internal DetoursReportRing(string errorNotificationFile, int slotCount, StreamDataReceived callback)
+        {
+            Contract.Requires(!string.IsNullOrEmpty(errorNotificationFile));
+            Contract.Requires(slotCount > 0);
+
+            int count = 1;
+            while (count < slotCount)
+            {
+                count <<= 1;
+            }
+
+            m_slotCount = count;
+            m_slotStride = SlotHeaderSize + SlotSize;
+            m_callback = callback;
+
+            // Kernel object names don't allow '\\' chars.
+            string baseName = errorNotificationFile.Replace('\\', '_');
+            long size = HeaderSize + (long)m_slotCount * m_slotStride;
+            try
+            {
+                m_section = MemoryMappedFile.CreateNew(baseName + "_ReportRing", size, MemoryMappedFileAccess.ReadWrite);
+            }
+            catch (IOException ex)
+            {
+                throw new BuildXLException($"Failed to create the report ring for '{errorNotificationFile}'", ex);
+            }
+
+            m_doorbell = new EventWaitHandle(false, EventResetMode.AutoReset, baseName + "_ReportRingEvent", out bool createdNew);
+            if (!createdNew)
+            {
+                m_doorbell.Dispose();
+                m_section.Dispose();
+                throw new BuildXLException($"The report ring event for '{errorNotificationFile}' already exists");
+            }
+
+            m_view = m_section.CreateViewAccessor(0, size, MemoryMappedFileAccess.ReadWrite);
+            byte* ptr = null;
+            m_view.SafeMemoryMappedViewHandle.AcquirePointer(ref ptr);
+            m_base = ptr + m_view.PointerOffset;
+
+            for (int i = 0; i < m_slotCount; i++)
+            {
+                *(long*)SlotAt(i) = i;
+            }
+
+            *(uint*)(m_base + 8) = (uint)m_slotCount;
+            *(uint*)(m_base + 12) = SlotSize;
+            *(long*)(m_base + EnqueuePosOffset) = 0;
+            *(long*)(m_base + DequeuePosOffset) = 0;
+            *(int*)(m_base + ReaderWaitingOffset) = 0;
+            *(uint*)(m_base + 4) = Version;
+            Volatile.Write(ref *(uint*)m_base, Magic);
+
+            m_thread = new Thread(ReceiveReports)
+            {
+                IsBackground = true,
+                Name = nameof(DetoursReportRing),
+            };
+        }
+
+        /// <summary>
+        /// Starts receiving reports.
+        /// </summary>
+        internal void Start()
+        {
+            Contract.Assume(!m_started);
+            m_started = true;
+            m_thread.Start();
+        }
+
+        /// <summary>
+        /// Receives the reports left in the ring and stops; must only be called once the report pipe has reached EOF, i.e., once no process can put reports into the ring anymore.
+        /// </summary>
+        internal Task CompleteAsync()
+        {
+            m_stopRequested.Set();
+            return m_started ? m_completion.Task : BoolTask.True;
+        }
+
+        private byte* SlotAt(long pos) => m_base + HeaderSize + (pos & (m_slotCount - 1)) * m_slotStride;
+
+        private bool IsEmpty => Volatile.Read(ref *(long*)SlotAt(m_dequeuePos)) != m_dequeuePos + 1;
+
+        /// <remarks>A full fence: pairs with the producers publishing a slot and then checking this flag.</remarks>
+        private void SetReaderWaiting(bool value) => Interlocked.Exchange(ref *(int*)(m_base + ReaderWaitingOffset), value ? 1 : 0);
+
+        private void ReceiveReports()
+        {
+            try
+            {
+                var waitHandles = new WaitHandle[] { m_doorbell, m_stopRequested };
+                while (true)
+                {
+                    // Checked before draining: once stop is requested, all reports have been published.
+                    bool stopping = m_stopRequested.WaitOne(0);
+                    bool dequeued;
+                    do
+                    {
+                        dequeued = TryDequeue(skipUnpublished: stopping);
+                    }
+                    while (dequeued);
+
+                    if (stopping)
+                    {
+                        break;
+                    }
+
+                    if (TrySkipAbandonedSlot())
+                    {
+                        continue;
+                    }
+
+                    SetReaderWaiting(true);
+                    if (IsEmpty)
+                    {
+                        // A claimed slot that is not published may never be: come back to check on its claimer.
+                        WaitHandle.WaitAny(waitHandles, m_stalledPos >= 0 ? s_abandonedSlotTimeout : Timeout.InfiniteTimeSpan);
+                    }
+
+                    SetReaderWaiting(false);
+                }
+
+                m_completion.TrySetResult(true);
+            }
+            catch (Exception ex)
+            {
+                m_completion.TrySetException(ex);
+            }
+        }
+
+        /// <summary>
+        /// Receives the data in the next slot (if published) and releases the slot.
+        /// </summary>
+        /// <remarks>
+        /// With <paramref name="skipUnpublished"/>, skips over slots that were claimed but never published (e.g., by a process that got killed),
+        /// which would otherwise block the ring forever; only valid once no producers are left.
+        /// </remarks>
+        private bool TryDequeue(bool skipUnpublished)
+        {
+            byte* slot = SlotAt(m_dequeuePos);
+            if (Volatile.Read(ref *(long*)slot) != m_dequeuePos + 1)
+            {
+                if (!skipUnpublished || m_dequeuePos >= Volatile.Read(ref *(long*)(m_base + EnqueuePosOffset)))
+                {
+                    return false;
+                }
+
+                // Whatever was being gathered is incomplete.
+                m_chunkLength = 0;
+                Release(slot);
+                return true;
+            }
+
+            int length = Math.Min(*(int*)(slot + SlotLengthOffset), SlotSize);
+            bool continued = (*(int*)(slot + SlotFlagsOffset) & SlotFlagContinued) != 0;
+            if (m_chunkLength + length > m_chunk.Length)
+            {
+                Array.Resize(ref m_chunk, Math.Max(m_chunk.Length * 2, m_chunkLength + length));
+            }
+
+            Marshal.Copy((IntPtr)(slot + SlotHeaderSize), m_chunk, m_chunkLength, length);
+            m_chunkLength += length;
+            Release(slot);
+
+            if (!continued)
+            {
+                DeliverLines(Encoding.Unicode.GetString(m_chunk, 0, m_chunkLength));
+                m_chunkLength = 0;
+            }
+
+            return true;
+        }
+
+        /// <summary>
+        /// Skips the next slot if it was claimed but is still not published, and its claimer is gone.
+        /// </summary>
+        /// <remarks>
+        /// A process that is terminated in between claiming and publishing slots would otherwise hold back the thread, and, once the ring is full,
+        /// every other process of the pip (which a parent waiting on them would then wait on too) until the ring is given up on (see ReportRing.h).
+        /// </remarks>
+        private bool TrySkipAbandonedSlot()
+        {
+            byte* slot = SlotAt(m_dequeuePos);
+            if (m_dequeuePos >= Volatile.Read(ref *(long*)(m_base + EnqueuePosOffset)) || !IsEmpty)
+            {
+                // Nothing claimed, or published
+                m_stalledPos = -1;
+                return false;
+            }
+
+            if (m_stalledPos != m_dequeuePos)
+            {
+                m_stalledPos = m_dequeuePos;
+                m_stalledSince.Restart();
+            }
+
+            uint claimerPid = Volatile.Read(ref *(uint*)(slot + SlotClaimerPidOffset));
+            bool abandoned = claimerPid != 0
+                ? claimerPid == m_goneClaimerPid || (m_stalledSince.Elapsed > s_abandonedSlotTimeout && IsProcessGone(claimerPid))
+                : m_stalledSince.Elapsed > s_unknownClaimerTimeout;
+            if (!abandoned || !IsEmpty)
+            {
+                return false;
+            }
+
+            // Whatever was being gathered is incomplete.
+            m_goneClaimerPid = claimerPid;
+            m_stalledPos = -1;
+            m_chunkLength = 0;
+            Release(slot);
+            return true;
+        }
+
+        private static bool IsProcessGone(uint pid)
+        {
+            try
+            {
+                using (var process = System.Diagnostics.Process.GetProcessById((int)pid))
+                {
+                    return process.HasExited;
+                }
+            }
+            catch (Exception ex) when (ex is ArgumentException || ex is InvalidOperationException)
+            {
+                // Not running
+                return true;
+            }
+            catch (System.ComponentModel.Win32Exception)
+            {
+                // Cannot tell
+                return false;
+            }
+        }
+
+        private void Release(byte* slot)
+        {
+            Volatile.Write(ref *(uint*)(slot + SlotClaimerPidOffset), 0u);
+            Volatile.Write(ref *(long*)slot, m_dequeuePos + m_slotCount);
+            m_dequeuePos++;
+            Volatile.Write(ref *(long*)(m_base + DequeuePosOffset), m_dequeuePos);
+        }
+
+        private void DeliverLines(string chunk)
+        {
+            // Chunks consist of whole lines, each terminated by "\r\n" (see SendReport.cpp).
+            int start = 0;
+            while (start < chunk.Length && !m_callbackFailed)
+            {
+                int end = chunk.IndexOfAny(s_lineTerminators, start);
+                if (end < 0)
+                {
+                    end = chunk.Length;
+                }
+
+                if (m_callback?.Invoke(chunk.Substring(start, end - start)) == false)
+                {
+                    // Like AsyncPipeReader, stop processing once the callback reports an error.
+                    m_callbackFailed = true;
+                }
+
+                start = end + 1;
+                if (end < chunk.Length && chunk[end] == '\r' && start < chunk.Length && chunk[start] == '\n')
+                {
+                    start++;
+                }
+            }
+        }
+
+        /// <nodoc />
+        public void Dispose()
+        {
+            if (m_started)
+            {
+                m_stopRequested.Set();
+                m_thread.Join();
+            }
+
+            m_view.SafeMemoryMappedViewHandle.ReleasePointer();
+            m_view.Dispose();
+            m_section.Dispose();
+            m_doorbell.Dispose();
+            m_stopRequested.Dispose();
+        }
+    }
+}
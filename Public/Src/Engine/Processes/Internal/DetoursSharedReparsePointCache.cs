@@ -0,0 +1,80 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+using System;
+using System.Diagnostics.ContractsLight;
+using System.IO;
+using System.IO.MemoryMappedFiles;
+using BuildXL.Utilities;
+
+namespace BuildXL.Processes.Internal
+{
+    /// <summary>
+    /// Shared-memory cache of the reparse point targets queried by the Detours of a pip's processes
+    /// (see <see cref="FileAccessManifest.SharedReparsePointCacheSlots"/>).
+    /// </summary>
+    /// <remarks>
+    /// CODESYNC: Public/Src/Sandbox/Windows/DetoursServices/SharedReparsePointCache.h
+    ///
+    /// BuildXL only creates the section and initializes its header: the cache is filled, looked up and invalidated by the processes of the pip
+    /// (see SharedReparsePointCache.h). It lives as long as the pip, so it is also found by the processes of the pip that BuildXL does not start directly.
+    /// </remarks>
+    internal sealed class DetoursSharedReparsePointCache : IDisposable
+    {
+        private const uint Magic = 0x50525253;
+        private const uint Version = 1;
+        private const int HeaderSize = 128;
+        private const int GenerationOffset = 64;
+
+        /// <summary>Size of a slot, header included</summary>
+        private const int SlotSize = 1024;
+
+        private readonly MemoryMappedFile m_section;
+
+        /// <summary>
+        /// Creates the cache for the processes whose internal error notification file is <paramref name="errorNotificationFile"/>.
+        /// </summary>
+        /// <exception cref="BuildXLException">Thrown if a cache with the same name already exists.</exception>
+        internal DetoursSharedReparsePointCache(string errorNotificationFile, int slotCount)
+        {
+            Contract.Requires(!string.IsNullOrEmpty(errorNotificationFile));
+            Contract.Requires(slotCount > 0);
+
+            int count = 1;
+            while (count < slotCount)
+            {
+                count <<= 1;
+            }
+
+            // Kernel object names don't allow '\\' chars.
+            string name = errorNotificationFile.Replace('\\', '_') + "_ReparsePointCache";
+            long size = HeaderSize + (long)count * SlotSize;
+            try
+            {
+                m_section = MemoryMappedFile.CreateNew(name, size, MemoryMappedFileAccess.ReadWrite);
+            }
+            catch (IOException ex)
+            {
+                throw new BuildXLException($"Failed to create the shared reparse point cache for '{errorNotificationFile}'", ex);
+            }
+
+            // The section is zeroed, i.e., all slots are empty.
+            using (var header = m_section.CreateViewAccessor(0, HeaderSize, MemoryMappedFileAccess.ReadWrite))
+            {
+                header.Write(4, Version);
+                header.Write(8, (uint)count);
+                header.Write(12, (uint)SlotSize);
+
+                // Generation 0 is the generation of the slots that were never written.
+                header.Write(GenerationOffset, 1L);
+                header.Write(0, Magic);
+            }
+        }
+
+        /// <nodoc />
+        public void Dispose()
+        {
+            m_section.Dispose();
+        }
+    }
+}
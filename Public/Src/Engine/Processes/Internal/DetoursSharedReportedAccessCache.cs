@@ -0,0 +1,76 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+using System;
+using System.Diagnostics.ContractsLight;
+using System.IO;
+using System.IO.MemoryMappedFiles;
+using BuildXL.Utilities;
+
+namespace BuildXL.Processes.Internal
+{
+    /// <summary>
+    /// Shared-memory table of the accesses reported by the Detours of a pip's processes
+    /// (see <see cref="FileAccessManifest.SharedReportedAccessSlots"/>).
+    /// </summary>
+    /// <remarks>
+    /// CODESYNC: Public/Src/Sandbox/Windows/DetoursServices/ReportedAccessCache.h
+    ///
+    /// BuildXL only creates the section and initializes its header: the table is filled and looked up by the processes of the pip
+    /// (see SharedReportedAccessCache in ReportedAccessCache.h).
+    /// </remarks>
+    internal sealed class DetoursSharedReportedAccessCache : IDisposable
+    {
+        private const uint Magic = 0x43415253;
+        private const uint Version = 2;
+        private const int HeaderSize = 64;
+
+        /// <summary>Size of a slot: two hashes of a path (and of the image of the process that reported it) and its accesses</summary>
+        private const int SlotSize = 24;
+
+        private readonly MemoryMappedFile m_section;
+
+        /// <summary>
+        /// Creates the table for the processes whose internal error notification file is <paramref name="errorNotificationFile"/>.
+        /// </summary>
+        /// <exception cref="BuildXLException">Thrown if a table with the same name already exists.</exception>
+        internal DetoursSharedReportedAccessCache(string errorNotificationFile, int slotCount)
+        {
+            Contract.Requires(!string.IsNullOrEmpty(errorNotificationFile));
+            Contract.Requires(slotCount > 0);
+
+            int count = 1;
+            while (count < slotCount)
+            {
+                count <<= 1;
+            }
+
+            // Kernel object names don't allow '\\' chars.
+            string name = errorNotificationFile.Replace('\\', '_') + "_ReportedAccesses";
+            long size = HeaderSize + (long)count * SlotSize;
+            try
+            {
+                m_section = MemoryMappedFile.CreateNew(name, size, MemoryMappedFileAccess.ReadWrite);
+            }
+            catch (IOException ex)
+            {
+                throw new BuildXLException($"Failed to create the shared reported access cache for '{errorNotificationFile}'", ex);
+            }
+
+            // The section is zeroed, i.e., all slots are free.
+            using (var header = m_section.CreateViewAccessor(0, HeaderSize, MemoryMappedFileAccess.ReadWrite))
+            {
+                header.Write(4, Version);
+                header.Write(8, (uint)count);
+                header.Write(12, (uint)SlotSize);
+                header.Write(0, Magic);
+            }
+        }
+
+        /// <nodoc />
+        public void Dispose()
+        {
+            m_section.Dispose();
+        }
+    }
+}
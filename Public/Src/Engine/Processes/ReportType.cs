@@ -48,9 +48,24 @@ namespace BuildXL.Processes
         /// </remarks>
         AugmentedFileAccess = 6,
 
+        /// <summary>
+        /// Report file access as a binary record (see <see cref="FileAccessManifest.BinaryReports"/>)
+        /// </summary>
+        FileAccessRecord = 7,
+
+        /// <summary>
+        /// Report the call counts and times of the detoured functions of a process (see <see cref="FileAccessManifest.CollectDetourStatistics"/>)
+        /// </summary>
+        DetourStatistics = 8,
+
+        /// <summary>
+        /// Report the summary of a complete directory enumeration, sent instead of its entries (see <see cref="DirectoryEnumerationSummary"/>)
+        /// </summary>
+        DirectoryEnumerationSummary = 9,
+
         /// <summary>
         /// This is a non-value, but places an upper-bound on the range of the enum
         /// </summary>
-        Max = 7,
+        Max = 10,
     }
 }
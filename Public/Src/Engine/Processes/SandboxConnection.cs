@@ -136,8 +136,25 @@ namespace BuildXL.Processes
             };
 
             Sandbox.ObserverFileAccessReports(ref m_sandboxConnectionInfo, m_AccessReportCallback, Marshal.SizeOf<Sandbox.AccessReport>());
+
+            if (HybridBackendCache != null)
+            {
+                Sandbox.SetHybridBackendCache(HybridBackendCache);
+            }
         }
 
+        /// <summary>
+        /// The file the Hybrid sandbox keeps the backend of every executable in (see <see cref="EngineEnvironmentSettings.MacOsHybridSandboxBackendCache"/>),
+        /// null when the backends are not selected per executable
+        /// </summary>
+        private string HybridBackendCache =>
+            Kind == SandboxKind.MacOsHybrid && !string.IsNullOrEmpty(EngineEnvironmentSettings.MacOsHybridSandboxBackendCache.Value)
+                ? EngineEnvironmentSettings.MacOsHybridSandboxBackendCache.Value
+                : null;
+
+        // CODESYNC: BackendSelector::kBackendCacheEnvVar (Public/Src/Sandbox/MacOs/Interop/Sandbox/Data/BackendSelector.hpp)
+        private const string HybridBackendCacheEnvVar = "BUILDXL_HYBRID_BACKENDS";
+
         /// <summary>
         /// Disposes the sandbox connection and release the resources in the interop layer, when running tests this can be skipped
         /// </summary>
@@ -168,6 +185,12 @@ namespace BuildXL.Processes
         /// <inheritdoc />
         public IEnumerable<(string, string)> AdditionalEnvVarsToSet(long pipId)
         {
+            // the interposing library reads the backend of the executables its process execs (as decided by earlier builds)
+            if (HybridBackendCache != null)
+            {
+                return new[] { (HybridBackendCacheEnvVar, HybridBackendCache) };
+            }
+
             return Enumerable.Empty<(string, string)>();
         }
 
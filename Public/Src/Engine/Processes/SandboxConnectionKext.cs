@@ -49,7 +49,11 @@ namespace BuildXL.Processes
         }
 
         /// <inheritdoc />
-        public ulong MinReportQueueEnqueueTime => Volatile.Read(ref m_reportQueueLastEnqueueTime);
+        /// <remarks>
+        /// The reports of a pip are all received from the same queue, in the order in which they were enqueued, so the latest enqueue time
+        /// received from any queue is at least the enqueue time of every report received so far for any pip.
+        /// </remarks>
+        public ulong MinReportQueueEnqueueTime => (ulong)Volatile.Read(ref m_reportQueueLastEnqueueTime);
 
         /// <inheritdoc />
         public bool IsInTestMode { get; }
@@ -79,15 +83,23 @@ Use the the following command to load/reload the sandbox kernel extension and fi
 
         private readonly ConcurrentDictionary<long, SandboxedProcessUnix> m_pipProcesses = new ConcurrentDictionary<long, SandboxedProcessUnix>();
 
+        /// <summary>
+        /// Copies of the reports received for each pip (see <see cref="EngineEnvironmentSettings.SandboxReportCaptureDirectory"/>); empty if reports are not captured
+        /// </summary>
+        private readonly ConcurrentDictionary<long, SandboxReportCapture> m_reportCaptures = new ConcurrentDictionary<long, SandboxReportCapture>();
+
         private Sandbox.KextConnectionInfo m_kextConnectionInfo;
         private readonly Sandbox.KextSharedMemoryInfo m_sharedMemoryInfo;
         private readonly Sandbox.ManagedFailureCallback m_failureCallback;
-        private readonly Thread m_workerThread;
+        private readonly Thread[] m_workerThreads;
 
         /// <summary>
-        /// Enqueue time of the last received report (or 0 if no reports have been received)
+        /// Latest enqueue time of the received reports (or 0 if no reports have been received)
         /// </summary>
-        private ulong m_reportQueueLastEnqueueTime;
+        /// <remarks>
+        /// A long so that it can be updated with <see cref="Interlocked.CompareExchange(ref long, long, long)"/> (mach absolute times fit in it).
+        /// </remarks>
+        private long m_reportQueueLastEnqueueTime;
 
         /// <summary>
         /// The time (in ticks) when the last report was received.
@@ -107,7 +119,12 @@ Use the the following command to load/reload the sandbox kernel extension and fi
         {
             m_reportQueueLastEnqueueTime = 0;
             m_kextConnectionInfo = new Sandbox.KextConnectionInfo() { Error = Sandbox.SandboxSuccess };
-            m_sharedMemoryInfo = new Sandbox.KextSharedMemoryInfo() { Error = Sandbox.SandboxSuccess };
+            m_sharedMemoryInfo = new Sandbox.KextSharedMemoryInfo()
+            {
+                Error = Sandbox.SandboxSuccess,
+                Addresses = new ulong[Sandbox.MaxReportQueues],
+                Ports = new uint[Sandbox.MaxReportQueues]
+            };
 
             IsInTestMode = skipDisposingForTests;
 
@@ -164,10 +181,17 @@ Use the the following command to load/reload the sandbox kernel extension and fi
                 throw new BuildXLException($"Unable to set sandbox kernel extension failure notification callback handler");
             }
 
-            m_workerThread = new Thread(() => StartReceivingAccessReports(m_sharedMemoryInfo.Address, m_sharedMemoryInfo.Port));
-            m_workerThread.IsBackground = true;
-            m_workerThread.Priority = ThreadPriority.Highest;
-            m_workerThread.Start();
+            // One worker per report queue (the kernel extension creates one per CPU)
+            m_workerThreads = new Thread[m_sharedMemoryInfo.QueueCount];
+            for (int i = 0; i < m_workerThreads.Length; i++)
+            {
+                ulong address = m_sharedMemoryInfo.Addresses[i];
+                uint port = m_sharedMemoryInfo.Ports[i];
+                m_workerThreads[i] = new Thread(() => StartReceivingAccessReports(address, port));
+                m_workerThreads[i].IsBackground = true;
+                m_workerThreads[i].Priority = ThreadPriority.Highest;
+                m_workerThreads[i].Start();
+            }
         }
 
         private unsafe bool SetFailureNotificationHandler()
@@ -198,7 +222,10 @@ Use the the following command to load/reload the sandbox kernel extension and fi
         {
             Sandbox.DeinitializeKextSharedMemory(m_sharedMemoryInfo, m_kextConnectionInfo);
 
-            m_workerThread.Join();
+            foreach (var workerThread in m_workerThreads)
+            {
+                workerThread.Join();
+            }
 
             Sandbox.DeinitializeKextConnection(m_kextConnectionInfo);
         }
@@ -208,7 +235,8 @@ Use the the following command to load/reload the sandbox kernel extension and fi
         /// </summary>
         private void StartReceivingAccessReports(ulong address, uint port)
         {
-            Sandbox.AccessReportCallback callback = (Sandbox.AccessReport report, int code) =>
+            int reportSize = Marshal.SizeOf<Sandbox.AccessReport>();
+            Sandbox.AccessReportBatchCallback callback = (IntPtr reports, int count, int code) =>
             {
                 if (code != Sandbox.ReportQueueSuccessCode)
                 {
@@ -219,26 +247,94 @@ Use the the following command to load/reload the sandbox kernel extension and fi
                 // Update last received timestamp
                 Volatile.Write(ref m_lastReportReceivedTimestampTicks, DateTime.UtcNow.Ticks);
 
-                // Remember the latest enqueue time
-                Volatile.Write(ref m_reportQueueLastEnqueueTime, report.Statistics.EnqueueTime);
-
-                // The only way it can happen that no process is found for 'report.PipId' is when that pip is
-                // explicitly terminated (e.g., because it timed out or Ctrl-c was pressed)
-                if (m_pipProcesses.TryGetValue(report.PipId, out var process))
+                for (int i = 0; i < count; i++)
                 {
-                    // if the process is found, its ProcessId must match the RootPid of the report.
-                    if (process.ProcessId != report.RootPid)
+                    IntPtr reportPtr = IntPtr.Add(reports, i * reportSize);
+                    var report = Marshal.PtrToStructure<Sandbox.AccessReport>(reportPtr);
+                    if (!m_reportCaptures.IsEmpty && m_reportCaptures.TryGetValue(report.PipId, out var capture))
                     {
-                        m_failureCallback?.Invoke(-1, $"Unexpected PID for Pip {report.PipId:X}: Expected {process.ProcessId}, Reported {report.RootPid}");
+                        var bytes = new byte[reportSize];
+                        Marshal.Copy(reportPtr, bytes, 0, reportSize);
+                        capture.Write(bytes, 0, reportSize);
                     }
-                    else
+
+                    ProcessAccessReport(report);
+                }
+            };
+
+            Sandbox.ListenForFileAccessReportBatches(callback, reportSize, address, port);
+        }
+
+        private void ProcessAccessReport(Sandbox.AccessReport report)
+        {
+            // Remember the latest enqueue time (the queues are drained concurrently)
+            UpdateLastEnqueueTime(report.Statistics.EnqueueTime);
+
+            // The only way it can happen that no process is found for 'report.PipId' is when that pip is
+            // explicitly terminated (e.g., because it timed out or Ctrl-c was pressed)
+            if (m_pipProcesses.TryGetValue(report.PipId, out var process))
+            {
+                // if the process is found, its ProcessId must match the RootPid of the report.
+                if (process.ProcessId != report.RootPid)
+                {
+                    m_failureCallback?.Invoke(-1, $"Unexpected PID for Pip {report.PipId:X}: Expected {process.ProcessId}, Reported {report.RootPid}");
+                }
+                else
+                {
+                    process.PostAccessReport(report);
+                }
+            }
+        }
+
+        /// <summary>
+        /// Processes the reports of a capture (see <see cref="SandboxReportCapture"/>) as if they had just been received for the given
+        /// (started) pip, e.g., to benchmark the processing of reports. Returns the number of reports replayed.
+        /// </summary>
+        internal int ReplayReportCapture(string path, long pipId, bool originalSpeed)
+        {
+            var kind = SandboxReportCapture.ReadKind(path);
+            if (kind != SandboxReportCaptureKind.MacOsAccessReports)
+            {
+                throw new BuildXLException($"Capture '{path}' holds {kind} messages, not macOS access reports");
+            }
+
+            return SandboxReportCapture.Replay(path, (bytes, length) =>
+            {
+                var handle = GCHandle.Alloc(bytes, GCHandleType.Pinned);
+                try
+                {
+                    var report = Marshal.PtrToStructure<Sandbox.AccessReport>(handle.AddrOfPinnedObject());
+
+                    // the reports of the capture belong to a pip (and a process) of another build
+                    report.PipId = pipId;
+                    if (m_pipProcesses.TryGetValue(pipId, out var process))
                     {
-                        process.PostAccessReport(report);
+                        report.RootPid = process.ProcessId;
                     }
+
+                    ProcessAccessReport(report);
                 }
-            };
+                finally
+                {
+                    handle.Free();
+                }
+            }, originalSpeed);
+        }
 
-            Sandbox.ListenForFileAccessReports(callback, Marshal.SizeOf<Sandbox.AccessReport>(), address, port);
+        private void UpdateLastEnqueueTime(ulong enqueueTime)
+        {
+            long time = (long)enqueueTime;
+            long current = Volatile.Read(ref m_reportQueueLastEnqueueTime);
+            while (time > current)
+            {
+                long original = Interlocked.CompareExchange(ref m_reportQueueLastEnqueueTime, time, current);
+                if (original == current)
+                {
+                    break;
+                }
+
+                current = original;
+            }
         }
 
         /// <inheritdoc />
@@ -258,6 +354,12 @@ Use the the following command to load/reload the sandbox kernel extension and fi
                 throw new BuildXLException($"Process with PidId {fam.PipId} already exists");
             }
 
+            var capture = SandboxReportCapture.TryCreateForPip(process.PipSemiStableHash, SandboxReportCaptureKind.MacOsAccessReports);
+            if (capture != null)
+            {
+                m_reportCaptures[fam.PipId] = capture;
+            }
+
             var setup = new FileAccessSetup()
             {
                 DllNameX64 = string.Empty,
@@ -311,6 +413,11 @@ Use the the following command to load/reload the sandbox kernel extension and fi
         /// <inheritdoc />
         public bool NotifyPipFinished(long pipId, SandboxedProcessUnix process)
         {
+            if (m_reportCaptures.TryRemove(pipId, out var capture))
+            {
+                capture.Dispose();
+            }
+
             if (m_pipProcesses.TryRemove(pipId, out var proc))
             {
                 Contract.Assert(process == proc);
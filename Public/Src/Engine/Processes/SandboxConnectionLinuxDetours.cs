@@ -5,7 +5,9 @@ using System;
 using System.Collections.Concurrent;
 using System.Collections.Generic;
 using System.Diagnostics.ContractsLight;
+using System.Globalization;
 using System.IO;
+using System.IO.MemoryMappedFiles;
 using System.Linq;
 using System.Reflection;
 using System.Runtime.InteropServices;
@@ -78,10 +80,55 @@ namespace BuildXL.Processes
 
             internal string DebugLogJailPath { get; }
 
+            internal string ReportsRingPath => m_ring?.Path;
+
+            /// <summary>
+            /// File the native side keeps track of the live processes of the pip in (null if the process tree is not tracked)
+            /// </summary>
+            internal string ProcessTreePath { get; }
+
+            /// <summary>
+            /// File the processes of the pip share the accesses they already reported through (null if reports are only deduplicated per process)
+            /// </summary>
+            internal string SharedReportCachePath { get; }
+
+            /// <summary>
+            /// File the processes of the pip share where the libraries they loaded were found through (null if every process searches for them)
+            /// </summary>
+            internal string LoaderSearchCachePath { get; }
+
+            /// <summary>
+            /// File of the base manifest tree the manifest of the pip is overlaid on (null if the manifest has its whole tree), shared by all pips
+            /// </summary>
+            internal string ManifestBasePath { get; }
+
             private readonly Sandbox.ManagedFailureCallback m_failureCallback;
             private readonly Dictionary<string, PathCacheRecord> m_pathCache; // TODO: use AbsolutePath instead of string
             private readonly CancellationTokenSource m_waitToCompleteCts;
             private readonly bool m_isInTestMode;
+            private readonly bool m_binaryReports;
+
+            /// <summary>
+            /// Process names interned by the native side when binary reports are used (keyed by pid and name id)
+            /// </summary>
+            /// <remarks>Only accessed from <see cref="m_accessReportProcessingBlock"/>.</remarks>
+            private readonly Dictionary<(uint pid, uint id), string> m_processNames;
+
+            /// <summary>
+            /// Payloads of fragmented packets that are not complete yet
+            /// </summary>
+            /// <remarks>Only accessed from <see cref="m_workerThread"/>.</remarks>
+            private readonly PacketFragments m_pendingFragments;
+
+            /// <summary>
+            /// Shared-memory ring the native side puts report packets into (null if reports are only sent through the FIFO)
+            /// </summary>
+            private readonly ReportsRing m_ring;
+
+            /// <summary>
+            /// Copy of the messages received (see <see cref="EngineEnvironmentSettings.SandboxReportCaptureDirectory"/>), null if they are not captured
+            /// </summary>
+            private readonly SandboxReportCapture m_reportCapture;
 
             /// <remarks>
             /// This dictionary is accessed both from the <see cref="m_workerThread"/> thread as well as the thread
@@ -96,19 +143,47 @@ namespace BuildXL.Processes
             private readonly CancellableTimedAction m_activeProcessesChecker;
             private readonly Lazy<SafeFileHandle> m_lazyWriteHandle;
             private readonly Thread m_workerThread;
-            private readonly ActionBlock<(PooledObjectWrapper<byte[]> wrapper, int length)> m_accessReportProcessingBlock;
+            private readonly TransformBlock<(PooledObjectWrapper<byte[]> wrapper, int length), ParsedMessage> m_accessReportParsingBlock;
+            private readonly ActionBlock<ParsedMessage> m_accessReportProcessingBlock;
 
             private int m_stopRequestCounter;
             private int m_completeAccessReportProcessingCounter;
 
+            /// <summary>
+            /// Set once the native side reports that the last tracked process of the tree has exited (see <see cref="ProcessTreePath"/>)
+            /// </summary>
+            private volatile bool m_processTreeCompleted;
+
             private static readonly TimeSpan ActiveProcessesCheckerInterval = TimeSpan.FromSeconds(1);
             private static readonly TimeSpan MaxWaitForReceiveAccessReports = TimeSpan.FromMinutes(1);
 
             private static ArrayPool<byte> ByteArrayPool { get; } = new ArrayPool<byte>(4096);
 
-            internal Info(Sandbox.ManagedFailureCallback failureCallback, SandboxedProcessUnix process, string reportsFifoPath, string famPath, string debugLogPath, bool isInTestMode)
+            // CODESYNC: Public/Src/Sandbox/Linux/report_format.hpp
+            private const int PacketHeaderSize = 12;
+            private const uint PacketFlagMoreFragments = 1;
+            private const ushort RecordKindInterposeStats = AccessReportRecord.KindSandboxSpecific;
+            private const ushort RecordKindContentHash = AccessReportRecord.KindSandboxSpecific + 1;
+            private const ushort RecordKindAccessSummary = AccessReportRecord.KindSandboxSpecific + 2;
+            private const ushort RecordKindOverheadBudgetExceeded = AccessReportRecord.KindSandboxSpecific + 3;
+
+            // kinds of parsed records that are never sent by the native side (see ParsedRecord)
+            private const ushort RecordKindParseError = ushort.MaxValue;
+            private const ushort RecordKindTiming = ushort.MaxValue - 1;
+
+            // size of the (SHA-256 based) VSO0 hashes sent in content hash records
+            private const int ContentHashLength = 32;
+
+            internal Info(Sandbox.ManagedFailureCallback failureCallback, SandboxedProcessUnix process, string reportsFifoPath, string famPath, string debugLogPath, bool isInTestMode, bool binaryReports, int reportParsingParallelism, ReportsRing ring, string processTreePath, string sharedReportCachePath, string loaderSearchCachePath, string manifestBasePath)
             {
                 m_isInTestMode = isInTestMode;
+                m_ring = ring;
+                m_binaryReports = binaryReports || ring != null;
+                m_reportCapture = SandboxReportCapture.TryCreateForPip(
+                    process.PipSemiStableHash,
+                    m_binaryReports ? SandboxReportCaptureKind.LinuxBinaryReports : SandboxReportCaptureKind.LinuxTextReports);
+                m_processNames = new Dictionary<(uint, uint), string>();
+                m_pendingFragments = new PacketFragments(ByteArrayPool);
                 m_stopRequestCounter = 0;
                 m_completeAccessReportProcessingCounter = 0;
                 m_failureCallback = failureCallback;
@@ -116,6 +191,10 @@ namespace BuildXL.Processes
                 ReportsFifoPath = reportsFifoPath;
                 FamPath = famPath;
                 DebugLogJailPath = debugLogPath;
+                ProcessTreePath = processTreePath;
+                SharedReportCachePath = sharedReportCachePath;
+                LoaderSearchCachePath = loaderSearchCachePath;
+                ManifestBasePath = manifestBasePath;
 
                 m_waitToCompleteCts = new CancellationTokenSource();
                 m_pathCache = new Dictionary<string, PathCacheRecord>();
@@ -135,13 +214,20 @@ namespace BuildXL.Processes
                     return IO.Open(ReportsFifoPath, IO.OpenFlags.O_WRONLY, 0);
                 });
 
-                // action block where parsing and processing of received ActionReport bytes is done
-                m_accessReportProcessingBlock = new ActionBlock<(PooledObjectWrapper<byte[]> wrapper, int length)>(ProcessBytes, new ExecutionDataflowBlockOptions
+                // received messages are parsed on several threads (see ParsedRecord), and then processed one at a time, in the order they were received in
+                m_accessReportParsingBlock = new TransformBlock<(PooledObjectWrapper<byte[]> wrapper, int length), ParsedMessage>(ParseBytes, new ExecutionDataflowBlockOptions
+                {
+                    BoundedCapacity = DataflowBlockOptions.Unbounded,
+                    MaxDegreeOfParallelism = Math.Max(1, reportParsingParallelism),
+                    EnsureOrdered = true
+                });
+                m_accessReportProcessingBlock = new ActionBlock<ParsedMessage>(ProcessParsedMessage, new ExecutionDataflowBlockOptions
                 {
                     BoundedCapacity = DataflowBlockOptions.Unbounded,
                     MaxDegreeOfParallelism = 1,
                     EnsureOrdered = true
                 });
+                m_accessReportParsingBlock.LinkTo(m_accessReportProcessingBlock, new DataflowLinkOptions { PropagateCompletion = true });
 
                 // start a background thread for reading from the FIFO
                 m_workerThread = new Thread(StartReceivingAccessReports);
@@ -181,7 +267,7 @@ namespace BuildXL.Processes
                     LogDebug($"[WARNING] Access report processing not completed after {MaxWaitForReceiveAccessReports} for pip {Process.PipId}");
                 }
 
-                m_accessReportProcessingBlock.Complete();
+                m_accessReportParsingBlock.Complete();
                 m_accessReportProcessingBlock.Completion.ContinueWith(t =>
                 {
                     LogDebug("Posting OpProcessTreeCompleted message");
@@ -209,7 +295,7 @@ namespace BuildXL.Processes
                 m_lazyWriteHandle.Value.Dispose();
                 m_activeProcessesChecker.Cancel();
 
-                // The m_workerThread might still be processing access reports from the FIFO so don't complete m_accessReportProcessingBlock yet.
+                // The m_workerThread might still be processing access reports from the FIFO so don't complete m_accessReportParsingBlock yet.
                 // However, in the event of a catastrophic filesystem failure, the worker thread might get stuck; to make sure we eventually
                 // make progress, here we complete the action block after a certain timeout.
                 //
@@ -239,6 +325,7 @@ namespace BuildXL.Processes
                 if (m_activeProcesses.Count == 0)
                 {
                     RequestStop();
+                    CompleteIfProcessTreeCompleted();
                 }
                 else if (removed && pid == Process.ProcessId)
                 {
@@ -254,6 +341,32 @@ namespace BuildXL.Processes
                 }
             }
 
+            /// <summary>
+            /// Handles the report the native side sends when the last tracked process of the tree exits.
+            /// </summary>
+            /// <remarks>
+            /// All tracked processes send their reports before they exit, so everything they reported has been received by now.
+            /// Unless some process the native side could not track is still known to be alive (e.g., one that got killed before
+            /// reporting its exit, or that was created by a process the native library was not loaded into), there is no need to
+            /// wait for all writers of the FIFO to close it: a process that broke away, or a daemon that inherited its descriptor,
+            /// could keep it open long after the pip is done.
+            /// </remarks>
+            private void OnProcessTreeCompleted(uint pid)
+            {
+                LogDebug($"Process tree completed (last process: {pid}); active processes: {m_activeProcesses.Count}");
+                m_processTreeCompleted = true;
+                CompleteIfProcessTreeCompleted();
+            }
+
+            private void CompleteIfProcessTreeCompleted()
+            {
+                if (m_processTreeCompleted && m_activeProcesses.Count == 0)
+                {
+                    RequestStop();
+                    CompleteAccessReportProcessing();
+                }
+            }
+
             internal PathCacheRecord GetOrCreateCacheRecord(string path)
             {
                 PathCacheRecord cacheRecord;
@@ -289,8 +402,30 @@ namespace BuildXL.Processes
                 m_waitToCompleteCts.Dispose();
                 m_pathCache.Clear();
                 m_activeProcesses.Clear();
+                m_reportCapture?.Dispose();
                 Analysis.IgnoreResult(FileUtilities.TryDeleteFile(ReportsFifoPath, retryOnFailure: false));
                 Analysis.IgnoreResult(FileUtilities.TryDeleteFile(FamPath, retryOnFailure: false));
+                if (ReportsRingPath != null)
+                {
+                    // the mapping itself is released by the worker thread once it is done with it
+                    Analysis.IgnoreResult(FileUtilities.TryDeleteFile(ReportsRingPath, retryOnFailure: false));
+                }
+
+                if (ProcessTreePath != null)
+                {
+                    Analysis.IgnoreResult(FileUtilities.TryDeleteFile(ProcessTreePath, retryOnFailure: false));
+                }
+
+                if (SharedReportCachePath != null)
+                {
+                    Analysis.IgnoreResult(FileUtilities.TryDeleteFile(SharedReportCachePath, retryOnFailure: false));
+                }
+
+                if (LoaderSearchCachePath != null)
+                {
+                    Analysis.IgnoreResult(FileUtilities.TryDeleteFile(LoaderSearchCachePath, retryOnFailure: false));
+                }
+
                 if (m_isInTestMode)
                 {
                     // The worker thread should complete in all but most extreme cases.  One such extreme case
@@ -303,66 +438,468 @@ namespace BuildXL.Processes
                 }
             }
 
+            /// <summary>
+            /// A record parsed out of a message by <see cref="m_accessReportParsingBlock"/>, for <see cref="m_accessReportProcessingBlock"/> to act on.
+            /// </summary>
+            /// <remarks>
+            /// Parsing (framing records, decoding their payloads, expanding access summaries) only depends on the message itself, so messages are parsed
+            /// on several threads; acting on the records (the path cache, process names, posting reports) is done on one thread, in the order the
+            /// messages were received in.
+            /// </remarks>
+            private struct ParsedRecord
+            {
+                internal ushort Kind;
+                internal uint Pid;
+                internal uint Access;
+                internal uint Status;
+                internal uint ExplicitLogging;
+                internal uint Error;
+                internal uint Operation;
+                internal uint ProcessNameId;
+
+                /// <summary>Payload of the record (e.g., the path of an access), or the error for <see cref="RecordKindParseError"/></summary>
+                internal string Str;
+
+                /// <summary>UTF-8 bytes of the path of an access (what <see cref="AccessReport.PathOrPipStats"/> holds)</summary>
+                internal byte[] PathBytes;
+
+                /// <summary>The whole report, for text reports (null for binary ones, which are described from their fields)</summary>
+                internal string Message;
+
+                /// <summary>The payload of a <see cref="AccessReportRecord.KindSandboxStats"/> record</summary>
+                internal SandboxStats Stats;
+
+                internal bool IsTimed;
+                internal ulong Timestamp;
+                internal ulong SequenceNumber;
+            }
+
+            /// <summary>The records of one message, along with the message itself (which is only released once they are processed)</summary>
+            private sealed class ParsedMessage
+            {
+                internal PooledObjectWrapper<byte[]> Bytes;
+                internal int Length;
+                internal List<ParsedRecord> Records;
+            }
+
+            /// <summary>
+            /// This method is backing <see cref="m_accessReportParsingBlock"/> (i.e., it may run on several threads at once).
+            /// </summary>
+            private ParsedMessage ParseBytes((PooledObjectWrapper<byte[]> wrapper, int length) item)
+            {
+                var records = new List<ParsedRecord>();
+                if (m_binaryReports)
+                {
+                    ParseBinaryRecords(item.wrapper.Instance, item.length, records);
+                }
+                else
+                {
+                    ParseTextReport(item.wrapper.Instance, item.length, records);
+                }
+
+                return new ParsedMessage { Bytes = item.wrapper, Length = item.length, Records = records };
+            }
+
             /// <summary>
             /// This method is backing <see cref="m_accessReportProcessingBlock"/>.
             /// </summary>
-            private void ProcessBytes((PooledObjectWrapper<byte[]> wrapper, int length) item)
+            private void ProcessParsedMessage(ParsedMessage message)
+            {
+                using (message.Bytes)
+                {
+                    m_reportCapture?.Write(message.Bytes.Instance, 0, message.Length);
+
+                    foreach (var record in message.Records)
+                    {
+                        ProcessRecord(record);
+                    }
+                }
+            }
+
+            /// <summary>
+            /// Processes the messages of a capture (see <see cref="SandboxReportCapture"/>) as if they had just been received for this pip,
+            /// e.g., to benchmark the processing of reports. Returns the number of messages replayed.
+            /// </summary>
+            internal int ReplayReportCapture(string path, bool originalSpeed)
             {
-                using (item.wrapper)
+                var expectedKind = m_binaryReports ? SandboxReportCaptureKind.LinuxBinaryReports : SandboxReportCaptureKind.LinuxTextReports;
+                var kind = SandboxReportCapture.ReadKind(path);
+                if (kind != expectedKind)
+                {
+                    throw new BuildXLException($"Capture '{path}' holds {kind} messages, this pip expects {expectedKind} ones");
+                }
+
+                return SandboxReportCapture.Replay(path, (bytes, length) =>
                 {
-                    // Format:
-                    //   "%s|%d|%d|%d|%d|%d|%d|%s\n", __progname, getpid(), access, status, explicitLogging, err, opcode, reportPath
-                    string message = Encoding.GetString(item.wrapper.Instance, index: 0, count: item.length).TrimEnd('\n');
+                    PooledObjectWrapper<byte[]> messageBytes = ByteArrayPool.GetInstance(length);
+                    Array.Copy(bytes, messageBytes.Instance, length);
+                    m_accessReportParsingBlock.Post((messageBytes, length));
+                }, originalSpeed);
+            }
+
+            private static void ParseTextReport(byte[] bytes, int length, List<ParsedRecord> records)
+            {
+                // Format:
+                //   "%s|%d|%d|%d|%d|%d|%d|%s\n", __progname, getpid(), access, status, explicitLogging, err, opcode, reportPath
+                string message = Encoding.GetString(bytes, index: 0, count: length).TrimEnd('\n');
+
+                // parse message and create AccessReport
+                string[] parts = message.Split(new[] { '|' });
+                Contract.Assert(parts.Length == 8);
 
-                    // parse message and create AccessReport
-                    string[] parts = message.Split(new[] { '|' });
-                    Contract.Assert(parts.Length == 8);
-                    RequestedAccess access = (RequestedAccess)AssertInt(parts[2]);
-                    string path = parts[7];
+                records.Add(new ParsedRecord
+                {
+                    Kind = AccessReportRecord.KindAccess,
+                    Pid = ParseInt(parts[1], records),
+                    Access = ParseInt(parts[2], records),
+                    Status = ParseInt(parts[3], records),
+                    ExplicitLogging = ParseInt(parts[4], records),
+                    Error = ParseInt(parts[5], records),
+                    Operation = ParseInt(parts[6], records),
+                    Str = parts[7],
+                    PathBytes = Encoding.GetBytes(parts[7]),
+                    Message = message,
+                });
+            }
 
-                    // ignore accesses to libDetours.so, because we injected that library
-                    if (path == DetoursLibFile)
+            /// <summary>
+            /// Parses records (see <see cref="AccessReportRecord"/>) out of a (reassembled) packet payload.
+            /// </summary>
+            /// <remarks>
+            /// CODESYNC: Public/Src/Sandbox/Linux/report_format.hpp
+            /// </remarks>
+            private static void ParseBinaryRecords(byte[] bytes, int length, List<ParsedRecord> records)
+            {
+                int offset = 0;
+                while (offset < length)
+                {
+                    if (!AccessReportRecord.TryRead(new ReadOnlySpan<byte>(bytes, offset, length - offset), out var record, out string recordError))
                     {
+                        records.Add(new ParsedRecord { Kind = RecordKindParseError, Str = recordError });
                         return;
                     }
 
-                    var report = new AccessReport
+                    var parsed = new ParsedRecord
                     {
-                        Pid = (int)AssertInt(parts[1]),
-                        PipId = Process.PipId,
-                        RequestedAccess = (uint)access,
-                        Status = AssertInt(parts[3]),
-                        ExplicitLogging = AssertInt(parts[4]),
-                        Error = AssertInt(parts[5]),
-                        Operation = (FileOperation) AssertInt(parts[6]),
-                        PathOrPipStats = Encoding.GetBytes(path),
+                        Kind = record.Kind,
+                        Pid = record.ProcessId,
+                        Access = (uint)record.RequestedAccess,
+                        Status = record.Status,
+                        ExplicitLogging = record.ReportExplicitly ? 1u : 0u,
+                        Error = record.Error,
+                        Operation = record.Operation,
+                        ProcessNameId = record.ProcessNameId,
+                        IsTimed = record.IsTimed,
+                        Timestamp = record.Timestamp,
+                        SequenceNumber = record.SequenceNumber,
                     };
 
-                    // update active processes
-                    if (report.Operation == FileOperation.OpProcessStart)
-                    {
-                        AddPid(report.Pid);
-                    }
-                    else if (report.Operation == FileOperation.OpProcessExit)
+                    int strOffset = offset + record.PayloadOffset;
+                    int strLength = record.PayloadLength;
+                    offset += record.Length;
+
+                    // the entries of a summary are binary (see ParseAccessSummary)
+                    if (parsed.Kind == RecordKindAccessSummary)
                     {
-                        RemovePid(report.Pid);
+                        // the timing of a summary is not that of any of its entries
+                        if (parsed.IsTimed)
+                        {
+                            records.Add(new ParsedRecord { Kind = RecordKindTiming, Pid = parsed.Pid, IsTimed = true, Timestamp = parsed.Timestamp, SequenceNumber = parsed.SequenceNumber });
+                        }
+
+                        ParseAccessSummary(parsed.Pid, parsed.ProcessNameId, bytes, strOffset, strLength, records);
+                        continue;
                     }
-                    else
+
+                    if (parsed.Kind == AccessReportRecord.KindSandboxStats)
                     {
-                        // check the path cache (only when the message is not about process tree)
-                        if (GetOrCreateCacheRecord(path).CheckCacheHitAndUpdate(access))
+                        if (!SandboxStats.TryRead(new ReadOnlySpan<byte>(bytes, strOffset, strLength), out parsed.Stats))
                         {
-                            LogDebug("Cache hit for access report: " + message);
+                            records.Add(new ParsedRecord { Kind = RecordKindParseError, Str = $"Invalid sandbox stats record of process {parsed.Pid}: {strLength} bytes" });
                             return;
                         }
+
+                        records.Add(parsed);
+                        continue;
+                    }
+
+                    parsed.Str = Encoding.GetString(bytes, strOffset, strLength);
+                    if (parsed.Kind == AccessReportRecord.KindAccess)
+                    {
+                        // the payload already is the UTF-8 encoding of the path
+                        parsed.PathBytes = new byte[strLength];
+                        Array.Copy(bytes, strOffset, parsed.PathBytes, 0, strLength);
+                    }
+
+                    records.Add(parsed);
+                }
+            }
+
+            private void ProcessRecord(in ParsedRecord record)
+            {
+                if (record.IsTimed)
+                {
+                    Process.AddReportTiming(record.Pid, record.Timestamp, record.SequenceNumber);
+                }
+
+                uint pid = record.Pid;
+                uint processNameId = record.ProcessNameId;
+                string str = record.Str;
+                switch (record.Kind)
+                {
+                    case RecordKindParseError:
+                        LogError(str);
+                        break;
+
+                    case RecordKindTiming:
+                        break;
+
+                    case AccessReportRecord.KindProcessName:
+                        m_processNames[(pid, processNameId)] = str;
+                        break;
+
+                    case RecordKindInterposeStats:
+                        ProcessInterposeStats(str);
+                        break;
+
+                    case AccessReportRecord.KindSandboxStats:
+                        Process.AddSandboxStats(record.Stats);
+                        break;
+
+                    case RecordKindContentHash:
+                        ProcessContentHash(str);
+                        break;
+
+                    case RecordKindOverheadBudgetExceeded:
+                        ProcessOverheadBudgetExceeded(pid, m_processNames.TryGetValue((pid, processNameId), out var processName) ? processName : "<unknown>", str);
+                        break;
+
+                    case AccessReportRecord.KindAccess:
+                        uint access = record.Access, status = record.Status, explicitLogging = record.ExplicitLogging, error = record.Error, operation = record.Operation;
+                        string message = record.Message;
+                        ProcessAccessReport(
+                            pid,
+                            (RequestedAccess)access,
+                            status,
+                            explicitLogging,
+                            error,
+                            (FileOperation)operation,
+                            str,
+                            record.PathBytes,
+                            describe: () => message ?? $"{(m_processNames.TryGetValue((pid, processNameId), out var name) ? name : "<unknown>")}|{pid}|{access}|{status}|{explicitLogging}|{error}|{operation}|{str}");
+                        break;
+
+                    default:
+                        LogError($"Unknown access report record kind: {record.Kind}");
+                        break;
+                }
+            }
+
+            /// <summary>
+            /// Parses the per-interposer stats sent by a process right before it exits (or execs), i.e.,
+            /// "name,calls,cacheHits,reports,totalNs,realNs;" entries.
+            /// </summary>
+            /// <remarks>
+            /// CODESYNC: Public/Src/Sandbox/Linux/interpose_stats.hpp
+            /// </remarks>
+            private void ProcessInterposeStats(string stats)
+            {
+                foreach (var entry in stats.Split(new[] { ';' }, StringSplitOptions.RemoveEmptyEntries))
+                {
+                    var fields = entry.Split(',');
+                    if (fields.Length != 6
+                        || !ulong.TryParse(fields[1], out var calls)
+                        || !ulong.TryParse(fields[2], out var cacheHits)
+                        || !ulong.TryParse(fields[3], out var reports)
+                        || !ulong.TryParse(fields[4], out var totalNs)
+                        || !ulong.TryParse(fields[5], out var realNs))
+                    {
+                        LogError($"Invalid interpose stats entry: '{entry}'");
+                        continue;
+                    }
+
+                    Process.AddInterposeStats(fields[0], calls, cacheHits, reports, totalNs, realNs);
+                }
+            }
+
+            /// <summary>
+            /// Parses the notice a process sends when it exceeds the overhead budget (see <see cref="EngineEnvironmentSettings.LinuxSandboxOverheadBudgetPercent"/>),
+            /// i.e., "overheadNs|wallNs|budgetPercent|mode".
+            /// </summary>
+            /// <remarks>
+            /// CODESYNC: Public/Src/Sandbox/Linux/report_format.hpp
+            /// </remarks>
+            private void ProcessOverheadBudgetExceeded(uint pid, string processName, string record)
+            {
+                var fields = record.Split('|');
+                if (fields.Length != 4
+                    || !ulong.TryParse(fields[0], out var overheadNs)
+                    || !ulong.TryParse(fields[1], out var wallNs)
+                    || !uint.TryParse(fields[2], out var budgetPercent))
+                {
+                    LogError($"Invalid overhead budget record: '{record}'");
+                    return;
+                }
+
+                Process.AddOverheadBudgetExceeded(pid, processName, overheadNs, wallNs, budgetPercent, fields[3]);
+            }
+
+            /// <summary>
+            /// Parses the content hash of a file a process wrote sequentially, i.e.,
+            /// "hash|size|mtimeSec|mtimeNsec|inode|path" (the hash being the hex VSO0 hash of the file).
+            /// </summary>
+            /// <remarks>
+            /// CODESYNC: Public/Src/Sandbox/Linux/output_hasher.hpp
+            /// </remarks>
+            private void ProcessContentHash(string record)
+            {
+                var fields = record.Split(new[] { '|' }, 6);
+                if (fields.Length != 6
+                    || fields[0].Length != 2 * ContentHashLength
+                    || !long.TryParse(fields[1], out var size)
+                    || !long.TryParse(fields[2], out var mtimeSec)
+                    || !long.TryParse(fields[3], out var mtimeNsec)
+                    || !ulong.TryParse(fields[4], out var inode))
+                {
+                    LogError($"Invalid content hash record: '{record}'");
+                    return;
+                }
+
+                var hash = new byte[ContentHashLength];
+                for (int i = 0; i < ContentHashLength; i++)
+                {
+                    if (!byte.TryParse(fields[0].Substring(2 * i, 2), NumberStyles.HexNumber, CultureInfo.InvariantCulture, out hash[i]))
+                    {
+                        LogError($"Invalid content hash record: '{record}'");
+                        return;
+                    }
+                }
+
+                Process.AddOutputContentHash(fields[5], hash, size, mtimeSec, mtimeNsec, inode);
+            }
+
+            /// <summary>
+            /// Parses the accesses a process deferred (see <see cref="EngineEnvironmentSettings.LinuxSandboxDeferReports"/>), i.e., a sequence of
+            /// "operation, requestedAccess, status, explicitLogging, error, sharedPrefixLength, suffixLength" varints, each followed by the
+            /// suffix bytes of a path whose first sharedPrefixLength bytes are those of the previous path of the record.
+            /// </summary>
+            /// <remarks>
+            /// CODESYNC: Public/Src/Sandbox/Linux/access_summary.hpp
+            /// </remarks>
+            private static void ParseAccessSummary(uint pid, uint processNameId, byte[] bytes, int offset, int length, List<ParsedRecord> records)
+            {
+                int end = offset + length;
+                var path = new byte[256];
+                int pathLength = 0;
+                while (offset < end)
+                {
+                    if (!TryReadVarint(bytes, ref offset, end, out uint operation)
+                        || !TryReadVarint(bytes, ref offset, end, out uint access)
+                        || !TryReadVarint(bytes, ref offset, end, out uint status)
+                        || !TryReadVarint(bytes, ref offset, end, out uint explicitLogging)
+                        || !TryReadVarint(bytes, ref offset, end, out uint error)
+                        || !TryReadVarint(bytes, ref offset, end, out uint sharedLength)
+                        || !TryReadVarint(bytes, ref offset, end, out uint suffixLength)
+                        || sharedLength > pathLength
+                        || suffixLength > end - offset)
+                    {
+                        records.Add(new ParsedRecord { Kind = RecordKindParseError, Str = $"Invalid access summary record from pid {pid}" });
+                        return;
+                    }
+
+                    if (sharedLength + suffixLength > path.Length)
+                    {
+                        Array.Resize(ref path, (int)Math.Max(2 * path.Length, sharedLength + suffixLength));
+                    }
+
+                    Array.Copy(bytes, offset, path, sharedLength, suffixLength);
+                    offset += (int)suffixLength;
+                    pathLength = (int)(sharedLength + suffixLength);
+
+                    var pathBytes = new byte[pathLength];
+                    Array.Copy(path, pathBytes, pathLength);
+                    records.Add(new ParsedRecord
+                    {
+                        Kind = AccessReportRecord.KindAccess,
+                        Pid = pid,
+                        Access = access,
+                        Status = status,
+                        ExplicitLogging = explicitLogging,
+                        Error = error,
+                        Operation = operation,
+                        ProcessNameId = processNameId,
+                        Str = Encoding.GetString(pathBytes),
+                        PathBytes = pathBytes,
+                    });
+                }
+            }
+
+            private static bool TryReadVarint(byte[] bytes, ref int offset, int end, out uint value)
+            {
+                value = 0;
+                for (int shift = 0; shift < 35 && offset < end; shift += 7)
+                {
+                    byte b = bytes[offset++];
+                    value |= (uint)(b & 0x7f) << shift;
+                    if (b < 0x80)
+                    {
+                        return true;
                     }
+                }
+
+                return false;
+            }
+
+            private void ProcessAccessReport(uint pid, RequestedAccess access, uint status, uint explicitLogging, uint error, FileOperation operation, string path, byte[] pathBytes, Func<string> describe)
+            {
+                // ignore accesses to libDetours.so, because we injected that library
+                if (path == DetoursLibFile)
+                {
+                    return;
+                }
+
+                var report = new AccessReport
+                {
+                    Pid = (int)pid,
+                    PipId = Process.PipId,
+                    RequestedAccess = (uint)access,
+                    Status = status,
+                    ExplicitLogging = explicitLogging,
+                    Error = error,
+                    Operation = operation,
+                    PathOrPipStats = pathBytes,
+                };
 
-                    // post the AccessReport
-                    Process.PostAccessReport(report);
+                // update active processes
+                if (report.Operation == FileOperation.OpProcessStart)
+                {
+                    AddPid(report.Pid);
+                }
+                else if (report.Operation == FileOperation.OpProcessExit)
+                {
+                    RemovePid(report.Pid);
+                }
+                else if (report.Operation == FileOperation.OpProcessTreeCompleted)
+                {
+                    // not posted: the pip gets its OpProcessTreeCompleted from CompleteAccessReportProcessing, once all reports have been processed
+                    OnProcessTreeCompleted(pid);
+                    return;
+                }
+                else
+                {
+                    // check the path cache (only when the message is not about process tree)
+                    if (GetOrCreateCacheRecord(path).CheckCacheHitAndUpdate(access))
+                    {
+                        LogDebug("Cache hit for access report: " + describe());
+                        return;
+                    }
                 }
+
+                // post the AccessReport
+                Process.PostAccessReport(report);
             }
 
-            private uint AssertInt(string str)
+            private static uint ParseInt(string str, List<ParsedRecord> records)
             {
                 if (uint.TryParse(str, out uint result))
                 {
@@ -370,7 +907,7 @@ namespace BuildXL.Processes
                 }
                 else
                 {
-                    LogError($"Could not parse int from '{str}'");
+                    records.Add(new ParsedRecord { Kind = RecordKindParseError, Str = $"Could not parse int from '{str}'" });
                     return 0;
                 }
             }
@@ -396,6 +933,19 @@ namespace BuildXL.Processes
             /// The method backing the <see cref="m_workerThread"/> thread.
             /// </summary>
             private void StartReceivingAccessReports()
+            {
+                try
+                {
+                    ReceiveAccessReports();
+                }
+                finally
+                {
+                    // only this thread ever touches the ring
+                    m_ring?.Dispose();
+                }
+            }
+
+            private void ReceiveAccessReports()
             {
                 var fifoName = ReportsFifoPath;
 
@@ -411,6 +961,20 @@ namespace BuildXL.Processes
                 // make sure that m_lazyWriteHandle has been created
                 Analysis.IgnoreResult(m_lazyWriteHandle.Value);
 
+                if (m_binaryReports)
+                {
+                    ReceiveBinaryPackets(readHandle);
+                }
+                else
+                {
+                    ReceiveTextReports(readHandle);
+                }
+
+                CompleteAccessReportProcessing();
+            }
+
+            private void ReceiveTextReports(SafeFileHandle readHandle)
+            {
                 byte[] messageLengthBytes = new byte[sizeof(int)];
                 while (true)
                 {
@@ -442,14 +1006,433 @@ namespace BuildXL.Processes
                     }
 
                     // Add message to processing queue
-                    m_accessReportProcessingBlock.Post((messageBytes, messageLength));
+                    m_accessReportParsingBlock.Post((messageBytes, messageLength));
                 }
-
-                CompleteAccessReportProcessing();
             }
-        }
 
-        /// <inheritdoc />
+            /// <remarks>
+            /// CODESYNC: Public/Src/Sandbox/Linux/report_format.hpp
+            /// </remarks>
+            private void ReceiveBinaryPackets(SafeFileHandle readHandle)
+            {
+                byte[] packetHeaderBytes = new byte[PacketHeaderSize];
+                byte[] ringPacketBytes = m_ring != null ? new byte[m_ring.SlotSize] : null;
+                while (true)
+                {
+                    if (m_ring != null)
+                    {
+                        DrainRing(ringPacketBytes, untilEnqueuePos: false);
+
+                        // a producer that died after claiming a slot must not hold back the ones after it (see ReportsRing.TrySkipAbandonedSlot):
+                        // this is checked every time the consumer wakes up, which the producers waiting on a full ring make it do regularly
+                        if (m_ring.TrySkipAbandonedSlot(out uint claimerPid))
+                        {
+                            LogDebug($"[WARNING] Skipped a slot of the reports ring {m_ring.Path} that was claimed but never published by process {claimerPid}");
+                            continue;
+                        }
+
+                        // about to block on the FIFO: ask the producers to ring the doorbell
+                        // and then make sure that nothing got published in the meantime
+                        m_ring.SetReaderWaiting(true);
+                        if (!m_ring.IsEmpty)
+                        {
+                            m_ring.SetReaderWaiting(false);
+                            continue;
+                        }
+                    }
+
+                    // read packet header
+                    var numRead = Read(readHandle, packetHeaderBytes, 0, packetHeaderBytes.Length);
+                    if (numRead == 0) // EOF
+                    {
+                        LogDebug("Exiting 'receive reports' loop.");
+                        break;
+                    }
+
+                    if (numRead < 0) // error
+                    {
+                        LogError($"Read from FIFO {ReportsFifoPath} failed with return value {numRead}");
+                        break;
+                    }
+
+                    m_ring?.SetReaderWaiting(false);
+
+                    int payloadLength = BitConverter.ToInt32(packetHeaderBytes, startIndex: 0);
+                    uint writerId = BitConverter.ToUInt32(packetHeaderBytes, startIndex: 4);
+                    bool moreFragments = (BitConverter.ToUInt32(packetHeaderBytes, startIndex: 8) & PacketFlagMoreFragments) != 0;
+
+                    // an empty packet is just a doorbell
+                    if (payloadLength == 0 && !moreFragments)
+                    {
+                        continue;
+                    }
+
+                    // read the payload
+                    PooledObjectWrapper<byte[]> payloadBytes = ByteArrayPool.GetInstance(payloadLength);
+                    numRead = Read(readHandle, payloadBytes.Instance, 0, payloadLength);
+                    if (numRead < payloadLength)
+                    {
+                        LogError($"Read from FIFO {ReportsFifoPath} failed: read only {numRead} out of {payloadLength} bytes");
+                        payloadBytes.Dispose();
+                        break;
+                    }
+
+                    ProcessPacket(writerId, moreFragments, payloadBytes, payloadLength);
+                }
+
+                // all writers are gone: pick up everything that was published to the ring
+                if (m_ring != null)
+                {
+                    DrainRing(ringPacketBytes, untilEnqueuePos: true);
+                }
+
+                m_pendingFragments.Dispose();
+            }
+
+            private void DrainRing(byte[] packetBytes, bool untilEnqueuePos)
+            {
+                int packetLength;
+                while (untilEnqueuePos ? m_ring.TryDequeueSkippingUnpublished(packetBytes, out packetLength) : m_ring.TryDequeue(packetBytes, out packetLength))
+                {
+                    if (packetLength < PacketHeaderSize)
+                    {
+                        LogError($"Invalid packet in reports ring {m_ring.Path}: {packetLength} bytes");
+                        continue;
+                    }
+
+                    int payloadLength = BitConverter.ToInt32(packetBytes, startIndex: 0);
+                    uint writerId = BitConverter.ToUInt32(packetBytes, startIndex: 4);
+                    bool moreFragments = (BitConverter.ToUInt32(packetBytes, startIndex: 8) & PacketFlagMoreFragments) != 0;
+                    if (payloadLength > packetLength - PacketHeaderSize)
+                    {
+                        LogError($"Invalid packet in reports ring {m_ring.Path}: payload length {payloadLength}, packet length {packetLength}");
+                        continue;
+                    }
+
+                    PooledObjectWrapper<byte[]> payloadBytes = ByteArrayPool.GetInstance(payloadLength);
+                    Array.Copy(packetBytes, PacketHeaderSize, payloadBytes.Instance, 0, payloadLength);
+                    ProcessPacket(writerId, moreFragments, payloadBytes, payloadLength);
+                }
+            }
+
+            private void ProcessPacket(uint writerId, bool moreFragments, PooledObjectWrapper<byte[]> payloadBytes, int payloadLength)
+            {
+                // a fragment of a record that did not fit in a single packet --> hold on to it until the last fragment arrives
+                if (!m_pendingFragments.TryComplete(writerId, moreFragments, ref payloadBytes, ref payloadLength))
+                {
+                    return;
+                }
+
+                // Add payload to processing queue
+                m_accessReportParsingBlock.Post((payloadBytes, payloadLength));
+            }
+        }
+
+        /// <summary>
+        /// Reassembles the payloads of records that did not fit in a single packet.
+        /// </summary>
+        /// <remarks>
+        /// CODESYNC: Public/Src/Sandbox/Linux/report_format.hpp
+        ///
+        /// All the fragments of a record are written by the same native thread, in order, but fragments of different threads can be
+        /// interleaved: they are kept apart by the id of the writer. Not thread-safe (packets are received on a single thread).
+        /// </remarks>
+        internal sealed class PacketFragments : IDisposable
+        {
+            private readonly ArrayPool<byte> m_pool;
+            private readonly Dictionary<uint, MemoryStream> m_pending = new Dictionary<uint, MemoryStream>();
+
+            /// <nodoc />
+            internal PacketFragments(ArrayPool<byte> pool)
+            {
+                m_pool = pool;
+            }
+
+            /// <summary>Number of writers whose last fragment did not arrive yet</summary>
+            internal int PendingCount => m_pending.Count;
+
+            /// <summary>
+            /// Adds the payload of a packet written by <paramref name="writerId"/>.
+            /// </summary>
+            /// <returns>
+            /// False if the payload is a fragment that others must follow (the payload is then held on to, and given back to its pool).
+            /// Otherwise, <paramref name="payloadBytes"/> and <paramref name="payloadLength"/> are set to the whole payload: that of the packet or,
+            /// for the last fragment, the fragments of the writer put back together.
+            /// </returns>
+            internal bool TryComplete(uint writerId, bool moreFragments, ref PooledObjectWrapper<byte[]> payloadBytes, ref int payloadLength)
+            {
+                if (!moreFragments && !m_pending.ContainsKey(writerId))
+                {
+                    return true;
+                }
+
+                if (!m_pending.TryGetValue(writerId, out var pending))
+                {
+                    pending = new MemoryStream();
+                    m_pending[writerId] = pending;
+                }
+
+                pending.Write(payloadBytes.Instance, 0, payloadLength);
+                payloadBytes.Dispose();
+
+                if (moreFragments)
+                {
+                    return false;
+                }
+
+                m_pending.Remove(writerId);
+                payloadLength = (int)pending.Length;
+                payloadBytes = m_pool.GetInstance(payloadLength);
+                Array.Copy(pending.GetBuffer(), payloadBytes.Instance, payloadLength);
+                pending.Dispose();
+                return true;
+            }
+
+            /// <summary>Drops the fragments of records that never got their last one</summary>
+            public void Dispose()
+            {
+                foreach (var pending in m_pending.Values)
+                {
+                    pending.Dispose();
+                }
+
+                m_pending.Clear();
+            }
+        }
+
+        /// <summary>
+        /// Consumer side of the shared-memory ring that native sandboxed processes put their report packets into.
+        /// </summary>
+        /// <remarks>
+        /// CODESYNC: Public/Src/Sandbox/Linux/report_ring.hpp
+        ///
+        /// There is exactly one consumer (the thread receiving access reports of a pip), so dequeuing needs no synchronization
+        /// with other consumers: a slot at position 'pos' is ready when its sequence number is 'pos + 1', and is released by
+        /// setting its sequence number to 'pos + slotCount'.
+        ///
+        /// A slot that was claimed but is not published stops the consumer; when that lasts, the consumer skips the slot if the
+        /// process that claimed it is gone (see <see cref="TrySkipAbandonedSlot"/>).
+        /// </remarks>
+        internal sealed unsafe class ReportsRing : IDisposable
+        {
+            private const uint Magic = 0x474e4952;
+            private const uint Version = 2;
+            private const int HeaderSize = 256;
+            private const int SlotHeaderSize = 16;
+            private const int SlotLengthOffset = 8;
+            private const int SlotClaimerPidOffset = 12;
+            private const int EnqueuePosOffset = 64;
+            private const int DequeuePosOffset = 128;
+            private const int ReaderWaitingOffset = 192;
+
+            /// <summary>Minimum slot size (PIPE_BUF on Linux)</summary>
+            internal const int MinSlotSize = 4096;
+
+            private readonly MemoryMappedFile m_file;
+            private readonly MemoryMappedViewAccessor m_view;
+            private readonly byte* m_base;
+            private readonly int m_slotCount;
+            private readonly int m_slotStride;
+            private long m_dequeuePos;
+
+            /// <summary>How long a claimed slot stays unpublished before the consumer checks whether its claimer is gone</summary>
+            internal static readonly TimeSpan AbandonedSlotTimeout = TimeSpan.FromSeconds(1);
+
+            /// <summary>How long a claimed slot whose claimer is not known yet stays unpublished before the consumer skips it</summary>
+            /// <remarks>The claimer records its pid right after it claims the slot: only one that died in between leaves it unknown</remarks>
+            internal static readonly TimeSpan UnknownClaimerTimeout = TimeSpan.FromSeconds(10);
+
+            // the position the consumer is stopped at since 'm_stalledSince' (-1 if it is not stopped)
+            private long m_stalledPos = -1;
+            private readonly System.Diagnostics.Stopwatch m_stalledSince = new System.Diagnostics.Stopwatch();
+
+            /// <summary>Path to the backing file</summary>
+            internal string Path { get; }
+
+            /// <summary>Maximum size of a packet</summary>
+            internal int SlotSize { get; }
+
+            /// <summary>
+            /// Creates the backing file at <paramref name="path"/> and initializes an empty ring in it.
+            /// </summary>
+            /// <param name="path">Backing file (preferably on a tmpfs)</param>
+            /// <param name="slotCount">Number of slots; rounded up to the next power of 2</param>
+            internal ReportsRing(string path, int slotCount)
+            {
+                Contract.Requires(slotCount > 0);
+
+                int count = 1;
+                while (count < slotCount)
+                {
+                    count <<= 1;
+                }
+
+                Path = path;
+                SlotSize = MinSlotSize;
+                m_slotCount = count;
+                m_slotStride = SlotHeaderSize + SlotSize;
+                m_dequeuePos = 0;
+
+                long size = HeaderSize + (long)m_slotCount * m_slotStride;
+                var stream = new FileStream(path, FileMode.CreateNew, FileAccess.ReadWrite, FileShare.ReadWrite);
+                stream.SetLength(size);
+                m_file = MemoryMappedFile.CreateFromFile(stream, mapName: null, size, MemoryMappedFileAccess.ReadWrite, HandleInheritability.None, leaveOpen: false);
+                m_view = m_file.CreateViewAccessor(0, size, MemoryMappedFileAccess.ReadWrite);
+
+                byte* ptr = null;
+                m_view.SafeMemoryMappedViewHandle.AcquirePointer(ref ptr);
+                m_base = ptr + m_view.PointerOffset;
+
+                for (int i = 0; i < m_slotCount; i++)
+                {
+                    *(long*)SlotAt(i) = i;
+                }
+
+                *(uint*)(m_base + 8) = (uint)m_slotCount;
+                *(uint*)(m_base + 12) = (uint)SlotSize;
+                *(long*)(m_base + EnqueuePosOffset) = 0;
+                *(long*)(m_base + DequeuePosOffset) = 0;
+                *(int*)(m_base + ReaderWaitingOffset) = 0;
+                *(uint*)(m_base + 4) = Version;
+                Volatile.Write(ref *(uint*)m_base, Magic);
+            }
+
+            private byte* SlotAt(long pos) => m_base + HeaderSize + (pos & (m_slotCount - 1)) * m_slotStride;
+
+            /// <summary>Whether the next slot to dequeue has not been published yet</summary>
+            internal bool IsEmpty => Volatile.Read(ref *(long*)SlotAt(m_dequeuePos)) != m_dequeuePos + 1;
+
+            /// <summary>
+            /// Tells the producers whether the consumer is (about to start) waiting on the FIFO.
+            /// </summary>
+            /// <remarks>A full fence: pairs with the producers publishing a slot and then checking this flag.</remarks>
+            internal void SetReaderWaiting(bool value) => Interlocked.Exchange(ref *(int*)(m_base + ReaderWaitingOffset), value ? 1 : 0);
+
+            /// <summary>
+            /// Copies the next packet (if published) into <paramref name="buffer"/> and releases its slot.
+            /// </summary>
+            internal bool TryDequeue(byte[] buffer, out int length)
+            {
+                byte* slot = SlotAt(m_dequeuePos);
+                if (Volatile.Read(ref *(long*)slot) != m_dequeuePos + 1)
+                {
+                    length = 0;
+                    return false;
+                }
+
+                length = Math.Min(*(int*)(slot + SlotLengthOffset), SlotSize);
+                Marshal.Copy((IntPtr)(slot + SlotHeaderSize), buffer, 0, length);
+                Release(slot);
+                return true;
+            }
+
+            /// <summary>
+            /// Like <see cref="TryDequeue"/>, but skips over slots that were claimed but never published.
+            /// </summary>
+            /// <remarks>
+            /// Must only be called once it is known that no producers are left (e.g., a producer that got
+            /// killed after claiming a slot would otherwise block the consumer forever).
+            /// </remarks>
+            internal bool TryDequeueSkippingUnpublished(byte[] buffer, out int length)
+            {
+                long enqueuePos = Volatile.Read(ref *(long*)(m_base + EnqueuePosOffset));
+                while (m_dequeuePos < enqueuePos)
+                {
+                    if (TryDequeue(buffer, out length))
+                    {
+                        return true;
+                    }
+
+                    Release(SlotAt(m_dequeuePos));
+                }
+
+                length = 0;
+                return false;
+            }
+
+            /// <summary>
+            /// Skips the next slot if it was claimed but is still not published, and its claimer is gone.
+            /// </summary>
+            /// <remarks>
+            /// The consumer is stopped at such a slot until then: a producer that dies in between claiming and publishing a slot
+            /// would otherwise hold back the consumer, and, once the ring is full, every other producer, until all of them are gone.
+            /// </remarks>
+            internal bool TrySkipAbandonedSlot(out uint claimerPid)
+            {
+                claimerPid = 0;
+                long enqueuePos = Volatile.Read(ref *(long*)(m_base + EnqueuePosOffset));
+                if (m_dequeuePos >= enqueuePos || !IsEmpty)
+                {
+                    // nothing claimed, or published
+                    m_stalledPos = -1;
+                    return false;
+                }
+
+                if (m_stalledPos != m_dequeuePos)
+                {
+                    m_stalledPos = m_dequeuePos;
+                    m_stalledSince.Restart();
+                    return false;
+                }
+
+                byte* slot = SlotAt(m_dequeuePos);
+                claimerPid = Volatile.Read(ref *(uint*)(slot + SlotClaimerPidOffset));
+                bool abandoned = claimerPid != 0
+                    ? m_stalledSince.Elapsed > AbandonedSlotTimeout && IsProcessGone(claimerPid)
+                    : m_stalledSince.Elapsed > UnknownClaimerTimeout;
+                if (!abandoned || !IsEmpty)
+                {
+                    return false;
+                }
+
+                m_stalledPos = -1;
+                Release(slot);
+                return true;
+            }
+
+            /// <summary>Whether <paramref name="pid"/> exited (a zombie, which its parent did not reap yet, is gone too)</summary>
+            private static bool IsProcessGone(uint pid)
+            {
+                if (!Dispatch.IsProcessAlive((int)pid))
+                {
+                    return true;
+                }
+
+                try
+                {
+                    // the state follows the name, which is in parentheses (and may contain any of them)
+                    string stat = File.ReadAllText($"/proc/{pid}/stat");
+                    int end = stat.LastIndexOf(')');
+                    return end >= 0 && end + 2 < stat.Length && (stat[end + 2] == 'Z' || stat[end + 2] == 'X');
+                }
+                catch (Exception ex) when (ex is FileNotFoundException || ex is DirectoryNotFoundException)
+                {
+                    return true;
+                }
+                catch (Exception ex) when (ex is IOException || ex is UnauthorizedAccessException)
+                {
+                    return false;
+                }
+            }
+
+            private void Release(byte* slot)
+            {
+                Volatile.Write(ref *(uint*)(slot + SlotClaimerPidOffset), 0u);
+                Volatile.Write(ref *(long*)slot, m_dequeuePos + m_slotCount);
+                m_dequeuePos++;
+                Volatile.Write(ref *(long*)(m_base + DequeuePosOffset), m_dequeuePos);
+            }
+
+            /// <nodoc />
+            public void Dispose()
+            {
+                m_view.SafeMemoryMappedViewHandle.ReleasePointer();
+                m_view.Dispose();
+                m_file.Dispose();
+            }
+        }
+
+        /// <inheritdoc />
         public SandboxKind Kind => SandboxKind.LinuxDetours;
 
         /// <inheritdoc />
@@ -459,6 +1442,117 @@ namespace BuildXL.Processes
         /// <inheritdoc />
         public bool IsInTestMode { get; }
 
+        /// <summary>
+        /// Whether the native sandbox is asked to send batched, binary-framed access reports (see <see cref="EngineEnvironmentSettings.LinuxSandboxBinaryReports"/>)
+        /// </summary>
+        public bool UseBinaryReports { get; }
+
+        /// <summary>
+        /// Number of slots of the shared-memory reports ring created for each pip; 0 means that no ring is used
+        /// (see <see cref="EngineEnvironmentSettings.LinuxSandboxReportsRingSlots"/>)
+        /// </summary>
+        public int ReportsRingSlots { get; }
+
+        /// <summary>
+        /// Whether statically linked executables are observed using seccomp user notifications
+        /// (see <see cref="EngineEnvironmentSettings.LinuxSandboxSeccompStaticProcesses"/>)
+        /// </summary>
+        public bool SuperviseStaticProcesses { get; }
+
+        /// <summary>
+        /// Whether the native sandbox is asked to collect per-interposer counters and timings
+        /// (see <see cref="EngineEnvironmentSettings.LinuxSandboxInterposeStats"/>)
+        /// </summary>
+        public bool CollectInterposeStats { get; }
+
+        /// <summary>
+        /// Whether the audit library redirects libc bindings of processes that libDetours.so was not preloaded into
+        /// (see <see cref="EngineEnvironmentSettings.LinuxSandboxAuditSymbind"/>)
+        /// </summary>
+        public bool UseAuditSymbind { get; }
+
+        /// <summary>
+        /// Whether the processes of a pip keep track of how many of them are alive, so that the last one reports the process tree as completed
+        /// (see <see cref="EngineEnvironmentSettings.LinuxSandboxTrackProcessTree"/>)
+        /// </summary>
+        public bool TrackProcessTree { get; }
+
+        /// <summary>
+        /// Whether the processes of a pip skip reporting accesses that another one of them already reported
+        /// (see <see cref="EngineEnvironmentSettings.LinuxSandboxSharedReportCache"/>)
+        /// </summary>
+        /// <remarks>
+        /// Only with text reports: a buffered binary report may never reach the host (e.g., when its process is killed),
+        /// which must not make the pip lose the same access made by other processes.
+        /// </remarks>
+        public bool UseSharedReportCache { get; }
+
+        /// <summary>
+        /// Whether the processes of a pip load the libraries another one of them already searched for from where it found them
+        /// (see <see cref="EngineEnvironmentSettings.LinuxSandboxLoaderSearchCache"/>)
+        /// </summary>
+        /// <remarks>
+        /// The searches are made by the audit library (LD_AUDIT), so pips that run without it search for every library.
+        /// </remarks>
+        public bool UseLoaderSearchCache { get; }
+
+        /// <summary>
+        /// Number of threads the reports of a pip are parsed on (they are always processed on one thread, in order)
+        /// (see <see cref="EngineEnvironmentSettings.LinuxSandboxReportParsingParallelism"/>)
+        /// </summary>
+        public int ReportParsingParallelism { get; }
+
+        /// <summary>
+        /// Whether paths that lie lexically inside an untracked scope are neither resolved nor reported by the native sandbox
+        /// (see <see cref="EngineEnvironmentSettings.LinuxSandboxLexicalUntrackedScopes"/>)
+        /// </summary>
+        public bool UseLexicalUntrackedScopes { get; }
+
+        /// <summary>
+        /// Whether the manifests of pips are overlaid on a base manifest tree shared by all of them
+        /// (see <see cref="EngineEnvironmentSettings.LinuxSandboxSharedManifestBase"/>)
+        /// </summary>
+        /// <remarks>
+        /// The base tree is made out of the manifest of the first pip, and is not used for pips that run in a root jail (which cannot see its file).
+        /// </remarks>
+        public bool UseSharedManifestBase { get; }
+
+        /// <summary>
+        /// Whether the native sandbox is asked not to check the accesses of pips that do not fail on unexpected file accesses
+        /// (see <see cref="EngineEnvironmentSettings.LinuxSandboxObserveOnly"/>)
+        /// </summary>
+        public bool UseObserveOnly { get; }
+
+        /// <summary>
+        /// Whether the native sandbox is asked to hash the files pips write sequentially
+        /// (see <see cref="EngineEnvironmentSettings.LinuxSandboxHashOutputs"/>)
+        /// </summary>
+        public bool HashOutputs { get; }
+
+        /// <summary>
+        /// Whether the native sandbox is asked to defer the reports of observe-only pips until their processes exit
+        /// (see <see cref="EngineEnvironmentSettings.LinuxSandboxDeferReports"/>)
+        /// </summary>
+        public bool DeferReports { get; }
+
+        /// <summary>
+        /// Whether the native sandbox is asked to time its reports
+        /// (see <see cref="EngineEnvironmentSettings.LinuxSandboxTimedReports"/>)
+        /// </summary>
+        public bool TimedReports { get; }
+
+        /// <summary>
+        /// Whether the native sandbox is asked to cache the symlinks it resolves paths through
+        /// (see <see cref="EngineEnvironmentSettings.LinuxSandboxCacheResolvedPrefixes"/>)
+        /// </summary>
+        public bool CacheResolvedPrefixes { get; }
+
+        /// <summary>
+        /// The overhead budget of the native sandbox, in percent of the wall time of a process (0: none)
+        /// (see <see cref="EngineEnvironmentSettings.LinuxSandboxOverheadBudgetPercent"/>)
+        /// </summary>
+        public int OverheadBudgetPercent { get; }
+
         private static readonly string s_buildXLBin = Path.GetDirectoryName(Assembly.GetExecutingAssembly().GetLocation());
 
         private readonly ConcurrentDictionary<long, Info> m_pipProcesses = new ConcurrentDictionary<long, Info>();
@@ -467,6 +1561,13 @@ namespace BuildXL.Processes
 
         private static readonly Encoding Encoding = Encoding.UTF8;
 
+        private const string SharedMemoryDir = "/dev/shm";
+
+        private readonly object m_manifestBaseLock = new object();
+        private bool m_manifestBaseCreated;
+        private FileAccessManifest.ManifestTreeBase m_manifestBase;
+        private string m_manifestBasePath;
+
         /// <inheritdoc />
         /// <remarks>Unimportant</remarks>
         public TimeSpan CurrentDrought => TimeSpan.FromSeconds(0);
@@ -476,6 +1577,24 @@ namespace BuildXL.Processes
         {
             m_failureCallback = failureCallback;
             IsInTestMode = isInTestMode;
+            ReportsRingSlots = Math.Max(0, EngineEnvironmentSettings.LinuxSandboxReportsRingSlots.Value ?? 0);
+            CollectInterposeStats = EngineEnvironmentSettings.LinuxSandboxInterposeStats;
+            HashOutputs = EngineEnvironmentSettings.LinuxSandboxHashOutputs;
+            UseObserveOnly = EngineEnvironmentSettings.LinuxSandboxObserveOnly;
+            DeferReports = UseObserveOnly && EngineEnvironmentSettings.LinuxSandboxDeferReports;
+            TimedReports = EngineEnvironmentSettings.LinuxSandboxTimedReports;
+            CacheResolvedPrefixes = EngineEnvironmentSettings.LinuxSandboxCacheResolvedPrefixes;
+            OverheadBudgetPercent = Math.Max(0, EngineEnvironmentSettings.LinuxSandboxOverheadBudgetPercent.Value ?? 0);
+            UseBinaryReports = EngineEnvironmentSettings.LinuxSandboxBinaryReports || ReportsRingSlots > 0 || CollectInterposeStats || HashOutputs || DeferReports || TimedReports
+                || OverheadBudgetPercent > 0;
+            SuperviseStaticProcesses = EngineEnvironmentSettings.LinuxSandboxSeccompStaticProcesses;
+            UseAuditSymbind = EngineEnvironmentSettings.LinuxSandboxAuditSymbind;
+            TrackProcessTree = EngineEnvironmentSettings.LinuxSandboxTrackProcessTree;
+            UseSharedReportCache = EngineEnvironmentSettings.LinuxSandboxSharedReportCache && !UseBinaryReports;
+            UseLoaderSearchCache = EngineEnvironmentSettings.LinuxSandboxLoaderSearchCache;
+            ReportParsingParallelism = Math.Max(1, EngineEnvironmentSettings.LinuxSandboxReportParsingParallelism.Value ?? Math.Min(4, Environment.ProcessorCount));
+            UseLexicalUntrackedScopes = EngineEnvironmentSettings.LinuxSandboxLexicalUntrackedScopes;
+            UseSharedManifestBase = EngineEnvironmentSettings.LinuxSandboxSharedManifestBase;
 
 #if DEBUG
             BuildXL.Native.Processes.ProcessUtilities.SetNativeConfiguration(true);
@@ -495,6 +1614,11 @@ namespace BuildXL.Processes
         public void Dispose()
         {
             ReleaseResources();
+
+            if (m_manifestBasePath != null)
+            {
+                Analysis.IgnoreResult(FileUtilities.TryDeleteFile(m_manifestBasePath, retryOnFailure: false));
+            }
         }
 
         /// <inheritdoc />
@@ -532,8 +1656,86 @@ namespace BuildXL.Processes
             // CODESYNC: Public/Src/Sandbox/Linux/bxl_observer.hpp
             yield return ("__BUILDXL_ROOT_PID", info.Process.ProcessId.ToString());
             yield return ("__BUILDXL_FAM_PATH", info.Process.ToPathInsideRootJail(info.FamPath));
+
+            if (info.ManifestBasePath != null)
+            {
+                yield return ("__BUILDXL_FAM_BASE_PATH", info.ManifestBasePath);
+            }
+
             yield return ("__BUILDXL_DETOURS_PATH", detoursLibPath);
 
+            if (UseBinaryReports)
+            {
+                yield return ("__BUILDXL_BINARY_REPORTS", "1");
+            }
+
+            if (info.ReportsRingPath != null)
+            {
+                yield return ("__BUILDXL_REPORTS_RING_PATH", info.Process.ToPathInsideRootJail(info.ReportsRingPath));
+            }
+
+            if (info.ProcessTreePath != null)
+            {
+                yield return ("__BUILDXL_PROCESS_TREE_PATH", info.Process.ToPathInsideRootJail(info.ProcessTreePath));
+            }
+
+            if (info.SharedReportCachePath != null)
+            {
+                yield return ("__BUILDXL_SHARED_REPORT_CACHE_PATH", info.Process.ToPathInsideRootJail(info.SharedReportCachePath));
+            }
+
+            if (info.LoaderSearchCachePath != null)
+            {
+                yield return ("__BUILDXL_LOADER_SEARCH_CACHE_PATH", info.Process.ToPathInsideRootJail(info.LoaderSearchCachePath));
+            }
+
+            if (UseLexicalUntrackedScopes)
+            {
+                yield return ("__BUILDXL_LEXICAL_UNTRACKED_SCOPES", "1");
+            }
+
+            if (SuperviseStaticProcesses)
+            {
+                yield return ("__BUILDXL_SECCOMP_STATIC_PROCESSES", "1");
+            }
+
+            if (CollectInterposeStats)
+            {
+                yield return ("__BUILDXL_INTERPOSE_STATS", "1");
+            }
+
+            if (UseAuditSymbind)
+            {
+                yield return ("__BUILDXL_AUDIT_SYMBIND", "1");
+            }
+
+            if (TimedReports)
+            {
+                yield return ("__BUILDXL_TIMED_REPORTS", "1");
+            }
+
+            if (CacheResolvedPrefixes)
+            {
+                yield return ("__BUILDXL_CACHE_RESOLVED_PREFIXES", "1");
+            }
+
+            // the native sandbox only defers the reports of observe-only pips (see FileAccessManifest.ObserveOnly)
+            if (DeferReports)
+            {
+                yield return ("__BUILDXL_DEFER_REPORTS", "1");
+            }
+
+            if (OverheadBudgetPercent > 0)
+            {
+                yield return ("__BUILDXL_OVERHEAD_BUDGET", OverheadBudgetPercent.ToString(CultureInfo.InvariantCulture));
+            }
+
+            // reported paths are only meaningful to the host outside of a root jail
+            if (HashOutputs && info.Process.RootJail == null)
+            {
+                yield return ("__BUILDXL_HASH_OUTPUTS", "1");
+            }
+
             if (info.DebugLogJailPath != null)
             {
                 yield return ("__BUILDXL_LOG_PATH", info.DebugLogJailPath);
@@ -578,6 +1780,13 @@ namespace BuildXL.Processes
                 fam.AddPath(toAbsPath(debugLogPath), mask: FileAccessPolicy.MaskAll, values: FileAccessPolicy.AllowAll);
             }
 
+            // nothing has to be denied: leave checking the accesses to the host (see SandboxedProcessUnix.CheckUncheckedAccess)
+            fam.ObserveOnly = UseObserveOnly && !fam.FailUnexpectedFileAccesses;
+
+            // overlay the manifest tree on the base tree shared by all pips
+            string manifestBasePath = UseSharedManifestBase && process.RootJail == null ? EnsureManifestBase(fam, process) : null;
+            fam.TreeBase = manifestBasePath != null ? m_manifestBase : null;
+
             // serialize FAM
             using (var wrapper = Pools.MemoryStreamPool.GetInstance())
             {
@@ -604,8 +1813,112 @@ namespace BuildXL.Processes
 
             process.LogDebug($"Created FIFO at '{fifoPath}'");
 
+            // create the shared-memory reports ring (preferably on a tmpfs, unless the pip runs in a root jail)
+            ReportsRing ring = null;
+            if (ReportsRingSlots > 0)
+            {
+                string ringDir = process.RootJail == null && Directory.Exists(SharedMemoryDir) ? SharedMemoryDir : rootDir;
+                string ringPath = Path.Combine(ringDir, Path.GetFileName(Path.ChangeExtension(fifoPath, ".ring")));
+                try
+                {
+                    ring = new ReportsRing(ringPath, ReportsRingSlots);
+                }
+                catch (Exception e) when (e is IOException || e is UnauthorizedAccessException)
+                {
+                    m_failureCallback?.Invoke(1, $"Creating reports ring {ringPath} failed: {e.Message}");
+                    return false;
+                }
+
+                process.LogDebug($"Created reports ring at '{ringPath}'");
+            }
+
+            // create the process tree file (next to the ring, for the same reasons)
+            string processTreePath = null;
+            if (TrackProcessTree)
+            {
+                string treeDir = process.RootJail == null && Directory.Exists(SharedMemoryDir) ? SharedMemoryDir : rootDir;
+                processTreePath = Path.Combine(treeDir, Path.GetFileName(Path.ChangeExtension(fifoPath, ".tree")));
+                try
+                {
+                    CreateProcessTreeFile(processTreePath, process.ProcessId);
+                }
+                catch (Exception e) when (e is IOException || e is UnauthorizedAccessException)
+                {
+                    if (ring != null)
+                    {
+                        ring.Dispose();
+                        Analysis.IgnoreResult(FileUtilities.TryDeleteFile(ring.Path, retryOnFailure: false));
+                    }
+
+                    m_failureCallback?.Invoke(1, $"Creating process tree file {processTreePath} failed: {e.Message}");
+                    return false;
+                }
+
+                process.LogDebug($"Created process tree file at '{processTreePath}'");
+            }
+
+            // create the shared report cache file (next to the ring, for the same reasons)
+            string sharedReportCachePath = null;
+            if (UseSharedReportCache)
+            {
+                string cacheDir = process.RootJail == null && Directory.Exists(SharedMemoryDir) ? SharedMemoryDir : rootDir;
+                sharedReportCachePath = Path.Combine(cacheDir, Path.GetFileName(Path.ChangeExtension(fifoPath, ".cache")));
+                try
+                {
+                    CreateSharedReportCacheFile(sharedReportCachePath);
+                }
+                catch (Exception e) when (e is IOException || e is UnauthorizedAccessException)
+                {
+                    // the ring implies binary reports, in which case there is no shared cache
+                    if (processTreePath != null)
+                    {
+                        Analysis.IgnoreResult(FileUtilities.TryDeleteFile(processTreePath, retryOnFailure: false));
+                    }
+
+                    m_failureCallback?.Invoke(1, $"Creating shared report cache file {sharedReportCachePath} failed: {e.Message}");
+                    return false;
+                }
+
+                process.LogDebug($"Created shared report cache file at '{sharedReportCachePath}'");
+            }
+
+            // create the loader search cache file (next to the ring, for the same reasons)
+            string loaderSearchCachePath = null;
+            if (UseLoaderSearchCache && process.RootJailInfo?.DisableAuditing != true)
+            {
+                string cacheDir = process.RootJail == null && Directory.Exists(SharedMemoryDir) ? SharedMemoryDir : rootDir;
+                loaderSearchCachePath = Path.Combine(cacheDir, Path.GetFileName(Path.ChangeExtension(fifoPath, ".ldcache")));
+                try
+                {
+                    CreateLoaderSearchCacheFile(loaderSearchCachePath);
+                }
+                catch (Exception e) when (e is IOException || e is UnauthorizedAccessException)
+                {
+                    if (ring != null)
+                    {
+                        ring.Dispose();
+                        Analysis.IgnoreResult(FileUtilities.TryDeleteFile(ring.Path, retryOnFailure: false));
+                    }
+
+                    if (processTreePath != null)
+                    {
+                        Analysis.IgnoreResult(FileUtilities.TryDeleteFile(processTreePath, retryOnFailure: false));
+                    }
+
+                    if (sharedReportCachePath != null)
+                    {
+                        Analysis.IgnoreResult(FileUtilities.TryDeleteFile(sharedReportCachePath, retryOnFailure: false));
+                    }
+
+                    m_failureCallback?.Invoke(1, $"Creating loader search cache file {loaderSearchCachePath} failed: {e.Message}");
+                    return false;
+                }
+
+                process.LogDebug($"Created loader search cache file at '{loaderSearchCachePath}'");
+            }
+
             // create and save info for this pip
-            var info = new Info(m_failureCallback, process, fifoPath, famPath, debugLogPath, IsInTestMode);
+            var info = new Info(m_failureCallback, process, fifoPath, famPath, debugLogPath, IsInTestMode, UseBinaryReports, ReportParsingParallelism, ring, processTreePath, sharedReportCachePath, loaderSearchCachePath, manifestBasePath);
             if (!m_pipProcesses.TryAdd(process.PipId, info))
             {
                 throw new BuildXLException($"Process with PidId {process.PipId} already exists");
@@ -617,6 +1930,125 @@ namespace BuildXL.Processes
             AbsolutePath toAbsPath(string path) => AbsolutePath.Create(process.PathTable, path);
         }
 
+        /// <summary>
+        /// Returns the file of the base manifest tree the manifests of pips are overlaid on, which the first call creates out of <paramref name="fam"/>;
+        /// null if there is none (e.g., it could not be saved), in which case manifests are written whole.
+        /// </summary>
+        /// <remarks>
+        /// CODESYNC: Public/Src/Sandbox/Linux/bxl_observer.cpp (BxlObserver::InitFam)
+        /// </remarks>
+        private string EnsureManifestBase(FileAccessManifest fam, SandboxedProcessUnix process)
+        {
+            lock (m_manifestBaseLock)
+            {
+                if (!m_manifestBaseCreated)
+                {
+                    m_manifestBaseCreated = true;
+                    var manifestBase = FileAccessManifest.ManifestTreeBase.Create(fam);
+                    if (manifestBase != null && !manifestBase.IsEmpty)
+                    {
+                        string baseDir = Directory.Exists(SharedMemoryDir) ? SharedMemoryDir : Path.GetTempPath();
+                        string basePath = Path.Combine(baseDir, $"bxl_FamBase.{Guid.NewGuid():N}.fam");
+                        try
+                        {
+                            manifestBase.Save(basePath);
+                            m_manifestBase = manifestBase;
+                            m_manifestBasePath = basePath;
+                            process.LogDebug($"Saved base manifest tree to '{basePath}'");
+                        }
+                        catch (Exception e) when (e is IOException || e is UnauthorizedAccessException)
+                        {
+                            process.LogDebug($"Saving base manifest tree to '{basePath}' failed, manifests are written whole: {e.Message}");
+                        }
+                    }
+                }
+
+                return m_manifestBasePath;
+            }
+        }
+
+        /// <summary>
+        /// Creates the file the native side keeps track of the live processes of a pip in, with the root process
+        /// (<paramref name="rootPid"/>) as its only member: a header followed by a bitmap indexed by pid.
+        /// </summary>
+        /// <remarks>
+        /// CODESYNC: Public/Src/Sandbox/Linux/process_tree.hpp
+        /// </remarks>
+        private static void CreateProcessTreeFile(string path, int rootPid)
+        {
+            const uint Magic = 0x45455254;
+            const uint Version = 1;
+            const int HeaderSize = 64;
+            const int LiveCountOffset = 16;
+
+            uint capacity = 4194304; // PID_MAX_LIMIT on 64-bit
+            if (uint.TryParse(File.ReadAllText("/proc/sys/kernel/pid_max").Trim(), out var pidMax))
+            {
+                capacity = pidMax;
+            }
+
+            capacity = Math.Max(capacity, (uint)rootPid + 1);
+
+            using var stream = new FileStream(path, FileMode.CreateNew, FileAccess.ReadWrite, FileShare.ReadWrite);
+            using var writer = new BinaryWriter(stream);
+            stream.SetLength(HeaderSize + (capacity + 63) / 64 * 8); // sparse: pages of the bitmap only materialize once touched
+            writer.Write(Magic);
+            writer.Write(Version);
+            writer.Write(capacity);
+            stream.Seek(LiveCountOffset, SeekOrigin.Begin);
+            writer.Write(1);
+            stream.Seek(HeaderSize + rootPid / 64 * 8, SeekOrigin.Begin);
+            writer.Write(1UL << (rootPid % 64));
+        }
+
+        /// <summary>
+        /// Creates the file the processes of a pip share the accesses they already reported through: a header followed by
+        /// an empty hash table and the arena its records are stored in.
+        /// </summary>
+        /// <remarks>
+        /// CODESYNC: Public/Src/Sandbox/Linux/shared_report_cache.hpp
+        /// </remarks>
+        internal static void CreateSharedReportCacheFile(string path)
+        {
+            const uint Magic = 0x48434352;
+            const uint Version = 1;
+            const int HeaderSize = 64;
+            const uint SlotCount = 1 << 17;
+            const uint ArenaSize = 16 << 20;
+
+            using var stream = new FileStream(path, FileMode.CreateNew, FileAccess.ReadWrite, FileShare.ReadWrite);
+            using var writer = new BinaryWriter(stream);
+            stream.SetLength(HeaderSize + SlotCount * sizeof(ulong) + ArenaSize); // sparse: pages only materialize once touched
+            writer.Write(Magic);
+            writer.Write(Version);
+            writer.Write(SlotCount);
+            writer.Write(ArenaSize);
+        }
+
+        /// <summary>
+        /// Creates the file the processes of a pip share where the libraries they loaded were found through: a header followed by
+        /// an empty hash table and the arena its records are stored in.
+        /// </summary>
+        /// <remarks>
+        /// CODESYNC: Public/Src/Sandbox/Linux/loader_search_cache.hpp
+        /// </remarks>
+        private static void CreateLoaderSearchCacheFile(string path)
+        {
+            const uint Magic = 0x4353444c;
+            const uint Version = 1;
+            const int HeaderSize = 64;
+            const uint SlotCount = 1 << 12;
+            const uint ArenaSize = 1 << 20;
+
+            using var stream = new FileStream(path, FileMode.CreateNew, FileAccess.ReadWrite, FileShare.ReadWrite);
+            using var writer = new BinaryWriter(stream);
+            stream.SetLength(HeaderSize + SlotCount * sizeof(ulong) + ArenaSize); // sparse: pages only materialize once touched
+            writer.Write(Magic);
+            writer.Write(Version);
+            writer.Write(SlotCount);
+            writer.Write(ArenaSize);
+        }
+
         /// <inheritdoc />
         public void NotifyPipProcessTerminated(long pipId, int processId)
         {
@@ -0,0 +1,254 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.Diagnostics.ContractsLight;
+using System.IO;
+using System.Threading;
+using BuildXL.Utilities.Configuration;
+
+namespace BuildXL.Processes
+{
+    /// <summary>
+    /// What the records of a <see cref="SandboxReportCapture"/> are
+    /// </summary>
+    public enum SandboxReportCaptureKind
+    {
+        /// <summary>
+        /// Report lines of the Windows sandbox (UTF-8), as passed to <see cref="SandboxedProcessReports.ReportLineReceived(string)"/>
+        /// </summary>
+        WindowsReportLines = 1,
+
+        /// <summary>
+        /// Text report messages read from the FIFO of the Linux sandbox
+        /// </summary>
+        LinuxTextReports = 2,
+
+        /// <summary>
+        /// Binary report payloads (one per packet) read from the FIFO or the ring of the Linux sandbox
+        /// </summary>
+        LinuxBinaryReports = 3,
+
+        /// <summary>
+        /// Access reports (one marshaled <c>Sandbox.AccessReport</c> per record) read from the queues of the macOS kernel extension
+        /// </summary>
+        MacOsAccessReports = 4,
+    }
+
+    /// <summary>
+    /// A file holding the raw report stream a sandbox sent for a pip, as the host received it (i.e., before any parsing), so that it can be
+    /// replayed into the same host side code later on: that makes for a repeatable benchmark of report parsing and processing that doesn't
+    /// need the tools of the pip to run (nor the sandbox the reports came from).
+    /// </summary>
+    /// <remarks>
+    /// Capturing is turned on by <see cref="EngineEnvironmentSettings.SandboxReportCaptureDirectory"/>, which gets one file per pip.
+    ///
+    /// Format (little endian): <see cref="Magic"/>, the <see cref="SandboxReportCaptureKind"/> (int32), then one record per report message:
+    /// the time it was received at (int64, ticks since the capture was created), its length (int32) and its bytes.
+    ///
+    /// Capturing is a diagnostic: a capture that can't be created or written to is simply given up on.
+    /// </remarks>
+    public sealed class SandboxReportCapture : IDisposable
+    {
+        /// <nodoc />
+        public const long Magic = 0x31504143524C5842; // "BXLRCAP1"
+
+        /// <nodoc />
+        public const string FileExtension = ".bxlreports";
+
+        private readonly object m_lock = new object();
+        private readonly Stopwatch m_stopwatch;
+        private BinaryWriter m_writer;
+
+        /// <summary>
+        /// Path of the capture file
+        /// </summary>
+        public string Path { get; }
+
+        /// <nodoc />
+        public SandboxReportCaptureKind Kind { get; }
+
+        private SandboxReportCapture(string path, SandboxReportCaptureKind kind, BinaryWriter writer)
+        {
+            Path = path;
+            Kind = kind;
+            m_writer = writer;
+            m_stopwatch = Stopwatch.StartNew();
+        }
+
+        /// <summary>
+        /// Creates the capture of the reports of a pip if <see cref="EngineEnvironmentSettings.SandboxReportCaptureDirectory"/> is set;
+        /// returns null otherwise (or if the file can't be created).
+        /// </summary>
+        public static SandboxReportCapture TryCreateForPip(long pipSemiStableHash, SandboxReportCaptureKind kind)
+        {
+            string directory = EngineEnvironmentSettings.SandboxReportCaptureDirectory.Value;
+            if (string.IsNullOrEmpty(directory))
+            {
+                return null;
+            }
+
+            // a pip may run several times (e.g., retries), keep all of its captures
+            string fileName = $"Pip{pipSemiStableHash:X16}-{DateTime.UtcNow.Ticks}{FileExtension}";
+            return TryCreate(System.IO.Path.Combine(directory, fileName), kind);
+        }
+
+        /// <summary>
+        /// Creates (or overwrites) a capture file; returns null if it can't be created.
+        /// </summary>
+        public static SandboxReportCapture TryCreate(string path, SandboxReportCaptureKind kind)
+        {
+            try
+            {
+                Directory.CreateDirectory(System.IO.Path.GetDirectoryName(path));
+                var stream = new FileStream(path, FileMode.Create, FileAccess.Write, FileShare.Read, bufferSize: 64 * 1024);
+                var writer = new BinaryWriter(stream);
+                writer.Write(Magic);
+                writer.Write((int)kind);
+                return new SandboxReportCapture(path, kind, writer);
+            }
+            catch (Exception ex) when (ex is IOException || ex is UnauthorizedAccessException)
+            {
+                return null;
+            }
+        }
+
+        /// <summary>
+        /// Appends a report message. Thread-safe; does nothing once the capture is disposed.
+        /// </summary>
+        public void Write(byte[] bytes, int offset, int length)
+        {
+            lock (m_lock)
+            {
+                if (m_writer == null)
+                {
+                    return;
+                }
+
+                try
+                {
+                    m_writer.Write(m_stopwatch.Elapsed.Ticks);
+                    m_writer.Write(length);
+                    m_writer.Write(bytes, offset, length);
+                }
+                catch (IOException)
+                {
+                    // e.g., out of disk space: stop capturing
+                    m_writer.Dispose();
+                    m_writer = null;
+                }
+            }
+        }
+
+        /// <summary>
+        /// Appends a report line (encoded as UTF-8)
+        /// </summary>
+        public void Write(string line)
+        {
+            byte[] bytes = System.Text.Encoding.UTF8.GetBytes(line);
+            Write(bytes, 0, bytes.Length);
+        }
+
+        /// <inheritdoc />
+        public void Dispose()
+        {
+            lock (m_lock)
+            {
+                try
+                {
+                    m_writer?.Dispose();
+                }
+                catch (IOException)
+                {
+                    // nothing to do about a capture that can't be flushed
+                }
+
+                m_writer = null;
+            }
+        }
+
+        /// <summary>
+        /// Reads the kind of a capture file
+        /// </summary>
+        public static SandboxReportCaptureKind ReadKind(string path)
+        {
+            using (var reader = new BinaryReader(File.OpenRead(path)))
+            {
+                return ReadHeader(reader, path);
+            }
+        }
+
+        /// <summary>
+        /// Enumerates the records of a capture file: the time each report message was received at (relative to the creation of the capture) and its bytes.
+        /// A record cut short (e.g., the build was killed while capturing) ends the enumeration.
+        /// </summary>
+        public static IEnumerable<(TimeSpan receivedAt, byte[] bytes)> ReadRecords(string path)
+        {
+            using (var reader = new BinaryReader(File.OpenRead(path)))
+            {
+                ReadHeader(reader, path);
+
+                long length = reader.BaseStream.Length;
+                while (reader.BaseStream.Position + sizeof(long) + sizeof(int) <= length)
+                {
+                    var receivedAt = TimeSpan.FromTicks(reader.ReadInt64());
+                    int count = reader.ReadInt32();
+                    if (count < 0 || reader.BaseStream.Position + count > length)
+                    {
+                        yield break;
+                    }
+
+                    yield return (receivedAt, reader.ReadBytes(count));
+                }
+            }
+        }
+
+        /// <summary>
+        /// Hands the records of a capture file to <paramref name="sink"/>, in order. With <paramref name="originalSpeed"/>, each record is handed
+        /// over no earlier than (relative to the first one) it was originally received; otherwise records are handed over as fast as the sink takes them.
+        /// Returns the number of records replayed.
+        /// </summary>
+        public static int Replay(string path, Action<byte[], int> sink, bool originalSpeed, CancellationToken cancellationToken = default)
+        {
+            Contract.Requires(sink != null);
+
+            int count = 0;
+            var stopwatch = Stopwatch.StartNew();
+            TimeSpan? firstReceivedAt = null;
+            foreach (var (receivedAt, bytes) in ReadRecords(path))
+            {
+                if (cancellationToken.IsCancellationRequested)
+                {
+                    break;
+                }
+
+                if (originalSpeed)
+                {
+                    firstReceivedAt ??= receivedAt;
+                    TimeSpan wait = (receivedAt - firstReceivedAt.Value) - stopwatch.Elapsed;
+                    if (wait > TimeSpan.Zero)
+                    {
+                        Thread.Sleep(wait);
+                    }
+                }
+
+                sink(bytes, bytes.Length);
+                count++;
+            }
+
+            return count;
+        }
+
+        private static SandboxReportCaptureKind ReadHeader(BinaryReader reader, string path)
+        {
+            if (reader.BaseStream.Length < sizeof(long) + sizeof(int) || reader.ReadInt64() != Magic)
+            {
+                throw new InvalidDataException($"'{path}' is not a sandbox report capture");
+            }
+
+            return (SandboxReportCaptureKind)reader.ReadInt32();
+        }
+    }
+}
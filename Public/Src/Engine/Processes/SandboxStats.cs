@@ -0,0 +1,142 @@
+﻿// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+using System;
+using System.Buffers.Binary;
+using System.Globalization;
+using System.Text;
+
+namespace BuildXL.Processes
+{
+    /// <summary>
+    /// The performance counters every sandbox reports in the same schema, so that the numbers of the pips of every platform can be compared.
+    /// </summary>
+    /// <remarks>
+    /// CODESYNC: Public/Src/Sandbox/Windows/DetoursServices/SandboxStats.h (see there for how each sandbox sends them).
+    /// Stats are added up over the processes of a pip (see <see cref="Add"/>), except for high-water marks, of which the maximum is kept.
+    /// Readers take the stats they know of: stats a newer sandbox sends are ignored, and stats an older one does not send are 0.
+    /// </remarks>
+    internal sealed class SandboxStats
+    {
+        /// <summary>Version of the stats this reads</summary>
+        public const uint Version = 1;
+
+        /// <summary>The stats, in the order the sandboxes send them</summary>
+        public enum Stat
+        {
+            /// <summary>Accesses found in the caches of already checked or reported accesses of the sandbox</summary>
+            CacheHits = 0,
+
+            /// <summary>Accesses not found in (and added to) those caches</summary>
+            CacheMisses,
+
+            /// <summary>Reports sent to the host</summary>
+            ReportsSent,
+
+            /// <summary>Reports not sent on their own because another report (or a summary of several) stands for them</summary>
+            ReportsCoalesced,
+
+            /// <summary>Bytes of report data sent to the host</summary>
+            BytesSent,
+
+            /// <summary>Time the sandbox spent intercepting operations, in nanoseconds</summary>
+            InterposerNs,
+
+            /// <summary>Most bytes the sandbox had allocated for its own use at once (a high-water mark)</summary>
+            AllocatedBytes,
+
+            /// <summary>Most entries waiting in a report queue at once (a high-water mark)</summary>
+            QueueHighWater,
+        }
+
+        /// <summary>Number of stats this knows of</summary>
+        public const int Count = 8;
+
+        /// <summary>Size of the header (version and count) of the binary form of the stats</summary>
+        public const int HeaderSize = 8;
+
+        private readonly ulong[] m_values = new ulong[Count];
+
+        /// <nodoc />
+        public ulong this[Stat stat]
+        {
+            get => m_values[(int)stat];
+            set => m_values[(int)stat] = value;
+        }
+
+        /// <summary>Whether <paramref name="stat"/> is combined by taking the maximum rather than the sum</summary>
+        public static bool IsHighWaterMark(Stat stat) => stat == Stat.AllocatedBytes || stat == Stat.QueueHighWater;
+
+        /// <summary>Adds <paramref name="other"/> (the stats of another process) to these ones</summary>
+        public void Add(SandboxStats other)
+        {
+            for (int i = 0; i < Count; i++)
+            {
+                m_values[i] = IsHighWaterMark((Stat)i) ? Math.Max(m_values[i], other.m_values[i]) : unchecked(m_values[i] + other.m_values[i]);
+            }
+        }
+
+        /// <summary>
+        /// Reads the binary form of the stats (a <c>SandboxStats</c> struct, little-endian) from the start of <paramref name="bytes"/>.
+        /// </summary>
+        public static bool TryRead(ReadOnlySpan<byte> bytes, out SandboxStats stats)
+        {
+            stats = null;
+            if (bytes.Length < HeaderSize || BinaryPrimitives.ReadUInt32LittleEndian(bytes) != Version)
+            {
+                return false;
+            }
+
+            uint count = BinaryPrimitives.ReadUInt32LittleEndian(bytes.Slice(4));
+            if ((ulong)bytes.Length < HeaderSize + 8UL * count)
+            {
+                return false;
+            }
+
+            stats = new SandboxStats();
+            for (int i = 0; i < Math.Min(count, (uint)Count); i++)
+            {
+                stats.m_values[i] = BinaryPrimitives.ReadUInt64LittleEndian(bytes.Slice(HeaderSize + 8 * i));
+            }
+
+            return true;
+        }
+
+        /// <summary>
+        /// Parses the text form of the stats (their values separated by ',', as the Windows sandbox sends them).
+        /// </summary>
+        public static bool TryParse(string str, out SandboxStats stats)
+        {
+            stats = null;
+            var items = str.Split(',');
+            var parsed = new SandboxStats();
+            for (int i = 0; i < items.Length; i++)
+            {
+                if (!ulong.TryParse(items[i], NumberStyles.None, CultureInfo.InvariantCulture, out var value))
+                {
+                    return false;
+                }
+
+                if (i < Count)
+                {
+                    parsed.m_values[i] = value;
+                }
+            }
+
+            stats = parsed;
+            return true;
+        }
+
+        /// <inheritdoc />
+        public override string ToString()
+        {
+            var builder = new StringBuilder();
+            for (int i = 0; i < Count; i++)
+            {
+                builder.Append(i == 0 ? string.Empty : ", ").Append((Stat)i).Append('=').Append(m_values[i].ToString(CultureInfo.InvariantCulture));
+            }
+
+            return builder.ToString();
+        }
+    }
+}
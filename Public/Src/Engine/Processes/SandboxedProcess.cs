@@ -66,6 +66,15 @@ namespace BuildXL.Processes
         private SandboxedProcessOutputBuilder m_output;
         private SandboxedProcessReports m_reports;
         private AsyncPipeReader m_reportReader;
+        private DetoursReportRing m_reportRing;
+        private DetoursSharedReparsePointCache m_sharedReparsePointCache;
+        private DetoursSharedReportedAccessCache m_sharedReportedAccessCache;
+        private readonly object m_reportsLock = new object();
+
+        /// <summary>
+        /// Copy of the report lines (see <see cref="EngineEnvironmentSettings.SandboxReportCaptureDirectory"/>); only written to under <see cref="m_reportsLock"/>
+        /// </summary>
+        private SandboxReportCapture m_reportCapture;
         private readonly SemaphoreSlim m_reportReaderSemaphore = TaskUtilities.CreateMutex();
         private Dictionary<uint, ReportedProcess> m_survivingChildProcesses;
         private readonly uint m_timeoutMins;
@@ -138,6 +147,8 @@ namespace BuildXL.Processes
                     info.SidebandWriter,
                     info.FileSystemView) : null;
 
+            m_reportCapture = m_reports != null ? SandboxReportCapture.TryCreateForPip(info.PipSemiStableHash, SandboxReportCaptureKind.WindowsReportLines) : null;
+
             Contract.Assume(inputEncoding != null);
             Contract.Assert(errorEncoding != null);
             Contract.Assert(outputEncoding != null);
@@ -389,6 +400,9 @@ namespace BuildXL.Processes
         [SuppressMessage("Microsoft.Usage", "CA2213:DisposableFieldsShouldBeDisposed", MessageId = "m_detouredProcess")]
         [SuppressMessage("Microsoft.Usage", "CA2213:DisposableFieldsShouldBeDisposed", MessageId = "m_reportReader")]
         [SuppressMessage("Microsoft.Usage", "CA2213:DisposableFieldsShouldBeDisposed", MessageId = "m_reportReaderSemaphore")]
+        [SuppressMessage("Microsoft.Usage", "CA2213:DisposableFieldsShouldBeDisposed", MessageId = "m_reportRing")]
+        [SuppressMessage("Microsoft.Usage", "CA2213:DisposableFieldsShouldBeDisposed", MessageId = "m_sharedReparsePointCache")]
+        [SuppressMessage("Microsoft.Usage", "CA2213:DisposableFieldsShouldBeDisposed", MessageId = "m_sharedReportedAccessCache")]
         [SuppressMessage("Microsoft.Usage", "CA2213:DisposableFieldsShouldBeDisposed", MessageId = "m_error")]
         [SuppressMessage("Microsoft.Usage", "CA2213:DisposableFieldsShouldBeDisposed", MessageId = "m_output")]
         public void Dispose()
@@ -402,6 +416,18 @@ namespace BuildXL.Processes
             m_detouredProcess?.Dispose();
             m_detouredProcess = null;
 
+            m_reportRing?.Dispose();
+            m_reportRing = null;
+
+            m_reportCapture?.Dispose();
+            m_reportCapture = null;
+
+            m_sharedReparsePointCache?.Dispose();
+            m_sharedReparsePointCache = null;
+
+            m_sharedReportedAccessCache?.Dispose();
+            m_sharedReportedAccessCache = null;
+
             m_output?.Dispose();
             m_output = null;
 
@@ -471,6 +497,46 @@ namespace BuildXL.Processes
                             DllNameX86 = s_binaryPaths.DllNameX86,
                         };
 
+                    if (m_reports != null && m_fileAccessManifest.ReportRingSlots > 0 && !string.IsNullOrEmpty(m_fileAccessManifest.InternalDetoursErrorNotificationFile))
+                    {
+                        // Reports put into the ring are received on its own thread, in parallel with (the few) lines still written to the pipe.
+                        m_reportRing = new DetoursReportRing(m_fileAccessManifest.InternalDetoursErrorNotificationFile, m_fileAccessManifest.ReportRingSlots, ReportLineReceived);
+                        m_reportRing.Start();
+                    }
+                    else if (m_fileAccessManifest != null)
+                    {
+                        m_fileAccessManifest.ReportRingSlots = 0;
+                    }
+
+                    if (m_fileAccessManifest != null && m_fileAccessManifest.SharedReparsePointCacheSlots > 0)
+                    {
+                        if (!string.IsNullOrEmpty(m_fileAccessManifest.InternalDetoursErrorNotificationFile))
+                        {
+                            // Lives until the sandboxed process is disposed, since processes of the pip may outlive the report pipe.
+                            m_sharedReparsePointCache = new DetoursSharedReparsePointCache(
+                                m_fileAccessManifest.InternalDetoursErrorNotificationFile,
+                                m_fileAccessManifest.SharedReparsePointCacheSlots);
+                        }
+                        else
+                        {
+                            m_fileAccessManifest.SharedReparsePointCacheSlots = 0;
+                        }
+                    }
+
+                    if (m_fileAccessManifest != null && m_fileAccessManifest.SharedReportedAccessSlots > 0)
+                    {
+                        if (!string.IsNullOrEmpty(m_fileAccessManifest.InternalDetoursErrorNotificationFile))
+                        {
+                            m_sharedReportedAccessCache = new DetoursSharedReportedAccessCache(
+                                m_fileAccessManifest.InternalDetoursErrorNotificationFile,
+                                m_fileAccessManifest.SharedReportedAccessSlots);
+                        }
+                        else
+                        {
+                            m_fileAccessManifest.SharedReportedAccessSlots = 0;
+                        }
+                    }
+
                     bool debugFlagsMatch = true;
                     ArraySegment<byte> manifestBytes = new ArraySegment<byte>();
                     if (m_fileAccessManifest != null)
@@ -546,7 +612,12 @@ namespace BuildXL.Processes
             SandboxedProcessFactory.Counters.IncrementCounter(SandboxedProcessFactory.SandboxedProcessCounters.AccessReportCount);
             using (SandboxedProcessFactory.Counters.StartStopwatch(SandboxedProcessFactory.SandboxedProcessCounters.HandleAccessReportDuration))
             {
-                return m_reports.ReportLineReceived(data);
+                // Lines come from both the report pipe and the report ring (if any).
+                lock (m_reportsLock)
+                {
+                    m_reportCapture?.Write(data);
+                    return m_reports.ReportLineReceived(data);
+                }
             }
         }
 
@@ -593,6 +664,14 @@ namespace BuildXL.Processes
                     m_reportReader.Dispose();
                     m_reportReader = null;
                 }
+
+                if (m_reportRing != null)
+                {
+                    // All processes are gone (or killed) now that the pipe has been closed, so the ring holds the last reports.
+                    await m_reportRing.CompleteAsync();
+                    m_reportRing.Dispose();
+                    m_reportRing = null;
+                }
             }
         }
 
@@ -72,6 +72,43 @@ namespace BuildXL.Processes
             [CounterType(CounterType.Numeric)]
             SandboxedProcessLifeTimeMs,
 
+            /// <summary>
+            /// Total number of calls to functions interposed by the Linux sandbox (only collected when <c>BuildXLLinuxSandboxInterposeStats</c> is set)
+            /// </summary>
+            [CounterType(CounterType.Numeric)]
+            LinuxSandboxInterposedCallCount,
+
+            /// <summary>
+            /// Total number of accesses the Linux sandbox did not report because they had already been reported (only collected when <c>BuildXLLinuxSandboxInterposeStats</c> is set)
+            /// </summary>
+            [CounterType(CounterType.Numeric)]
+            LinuxSandboxInterposedCacheHitCount,
+
+            /// <summary>
+            /// Total number of reports sent by the Linux sandbox from interposed functions (only collected when <c>BuildXLLinuxSandboxInterposeStats</c> is set)
+            /// </summary>
+            [CounterType(CounterType.Numeric)]
+            LinuxSandboxInterposedReportCount,
+
+            /// <summary>
+            /// Total time spent in Linux sandbox interposers on top of the real calls, in microseconds (only collected when <c>BuildXLLinuxSandboxInterposeStats</c> is set)
+            /// </summary>
+            [CounterType(CounterType.Numeric)]
+            LinuxSandboxInterposerOverheadUs,
+
+            /// <summary>
+            /// Number of processes whose Linux sandbox interposers took more of their wall time than the overhead budget (only collected when
+            /// <c>BuildXLLinuxSandboxOverheadBudgetPercent</c> is set)
+            /// </summary>
+            [CounterType(CounterType.Numeric)]
+            LinuxSandboxOverheadBudgetExceededCount,
+
+            /// <summary>
+            /// Number of processes that the Linux sandbox switched to deferred reports because they exceeded the overhead budget
+            /// </summary>
+            [CounterType(CounterType.Numeric)]
+            LinuxSandboxOverheadBudgetDegradedCount,
+
             /// <summary>
             /// Aggregate time spent checking paths for directory symlinks
             /// </summary>
@@ -354,6 +354,11 @@ namespace BuildXL.Processes
         /// </summary>
         public long SuspendedDurationMs { get; set; }
 
+        /// <summary>
+        /// Content hashes of the outputs the sandbox hashed while they were written, by path (see <see cref="SandboxedProcessReports.OutputContentHashes"/>); possibly null
+        /// </summary>
+        public IReadOnlyDictionary<string, byte[]> OutputContentHashes { get; internal set; }
+
         private bool ProcessCompletedExecution(SandboxedProcessPipExecutionStatus status) =>
             status != SandboxedProcessPipExecutionStatus.PreparationFailed && 
             status != SandboxedProcessPipExecutionStatus.Canceled &&
@@ -305,6 +305,23 @@ namespace BuildXL.Processes
                         (m_sandboxConfig.UnsafeSandboxConfiguration.PreserveOutputs == PreserveOutputsMode.Disabled || !pip.AllowPreserveOutputs),
                     UseLargeNtClosePreallocatedList = m_sandboxConfig.UseLargeNtClosePreallocatedList,
                     UseExtraThreadToDrainNtClose = m_sandboxConfig.UseExtraThreadToDrainNtClose,
+                    BatchReports = EngineEnvironmentSettings.WindowsSandboxBatchReports,
+                    BufferDebugMessages = EngineEnvironmentSettings.WindowsSandboxBufferDebugMessages,
+                    BinaryReports = EngineEnvironmentSettings.WindowsSandboxBinaryReports,
+                    ReportRingSlots = Math.Max(0, EngineEnvironmentSettings.WindowsSandboxReportRingSlots.Value ?? 0),
+                    SharedReparsePointCacheSlots = Math.Max(0, EngineEnvironmentSettings.WindowsSandboxSharedReparsePointCacheSlots.Value ?? 0),
+                    ReportOncePerPathAndAccess = EngineEnvironmentSettings.WindowsSandboxReportOncePerPathAndAccess,
+                    SharedReportedAccessSlots = Math.Max(0, EngineEnvironmentSettings.WindowsSandboxSharedReportedAccessSlots.Value ?? 0),
+                    UseCompactManifestTree = EngineEnvironmentSettings.WindowsSandboxCompactManifestTree,
+                    UseManifestPathFilter = EngineEnvironmentSettings.SandboxManifestPathFilter,
+                    CacheDosDeviceNames = EngineEnvironmentSettings.WindowsSandboxCacheDosDeviceNames,
+                    CollectDetourStatistics = EngineEnvironmentSettings.WindowsSandboxCollectDetourStatistics,
+                    NtCreateFileOnly = EngineEnvironmentSettings.WindowsSandboxNtCreateFileOnly,
+                    MinimalDetours = EngineEnvironmentSettings.WindowsSandboxMinimalDetours,
+                    DeferColdDetours = EngineEnvironmentSettings.WindowsSandboxDeferColdDetours,
+                    CacheProbeResults = EngineEnvironmentSettings.WindowsSandboxCacheProbeResults,
+                    CacheImagePathSearches = EngineEnvironmentSettings.WindowsSandboxCacheImagePathSearches,
+                    UseHotpatchDetours = EngineEnvironmentSettings.WindowsSandboxUseHotpatchDetours,
                     DisableDetours = m_sandboxConfig.UnsafeSandboxConfiguration.DisableDetours(),
                     LogProcessData = m_sandboxConfig.LogProcesses && m_sandboxConfig.LogProcessData,
                     IgnoreGetFinalPathNameByHandle = m_sandboxConfig.UnsafeSandboxConfiguration.IgnoreGetFinalPathNameByHandle,
@@ -332,6 +349,11 @@ namespace BuildXL.Processes
             m_disableConHostSharing = configuration.Engine.DisableConHostSharing;
             m_shouldPreserveOutputs = m_pip.AllowPreserveOutputs && m_sandboxConfig.UnsafeSandboxConfiguration.PreserveOutputs != PreserveOutputsMode.Disabled
                                       && m_sandboxConfig.UnsafeSandboxConfiguration.PreserveOutputsTrustLevel <= m_pip.PreserveOutputsTrustLevel;
+
+            // The enumeration probes of incremental tools are the only ones the observed accesses keep (see IsIncrementalToolAccess)
+            m_fileAccessManifest.SummarizeDirectoryEnumerations =
+                EngineEnvironmentSettings.WindowsSandboxSummarizeDirectoryEnumerations && !IsIncrementalPreserveOutputPip;
+
             m_processIdListener = processIdListener;
             m_pipEnvironment = pipEnvironment;
             m_pipDataRenderer = pipDataRenderer ?? new PipFragmentRenderer(m_pathTable);
@@ -2016,7 +2038,10 @@ namespace BuildXL.Processes
                 pipProperties: pipProperties,
                 timedOut: result.TimedOut,
                 retryInfo: retryInfo,
-                createdDirectories: createdDirectories);
+                createdDirectories: createdDirectories)
+            {
+                OutputContentHashes = result.OutputContentHashes,
+            };
         }
 
         private async Task<(bool Success, Dictionary<string, int> PipProperties)> TrySetPipPropertiesAsync(SandboxedProcessResult result)
@@ -2182,6 +2207,17 @@ namespace BuildXL.Processes
                 }
             }
 
+            if (m_sandboxConfig.DirectoriesWithoutReparsePoints != null)
+            {
+                foreach (var directoryWithoutReparsePoints in m_sandboxConfig.DirectoriesWithoutReparsePoints)
+                {
+                    m_fileAccessManifest.AddScope(
+                        directoryWithoutReparsePoints,
+                        mask: FileAccessPolicy.MaskNothing,
+                        values: FileAccessPolicy.NoReparsePoints);
+                }
+            }
+
             if (!OperatingSystemHelper.IsUnixOS)
             {
                 var binaryPaths = new BinaryPaths();
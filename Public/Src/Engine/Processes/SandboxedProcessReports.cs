@@ -7,14 +7,17 @@ using System.Collections.Generic;
 using System.Diagnostics.CodeAnalysis;
 using System.Diagnostics.ContractsLight;
 using System.Globalization;
+using System.IO;
 using System.Linq;
 using System.Threading;
 using BuildXL.Native.IO;
+using BuildXL.Native.IO.Windows;
 using BuildXL.Processes.Sideband;
 using BuildXL.Utilities;
 using BuildXL.Utilities.Collections;
 using BuildXL.Utilities.Instrumentation.Common;
 using JetBrains.Annotations;
+using Microsoft.Win32.SafeHandles;
 using static BuildXL.Processes.IDetoursEventListener;
 using static BuildXL.Utilities.FormattableStringEx;
 
@@ -42,6 +45,7 @@ namespace BuildXL.Processes
 
         private readonly Dictionary<string, string> m_pathCache = new Dictionary<string, string>(OperatingSystemHelper.PathComparer);
         private readonly Dictionary<AbsolutePath, bool> m_overrideAllowedWritePaths = new Dictionary<AbsolutePath, bool>();
+        private readonly FileAccessReportRecordParser m_fileAccessRecordParser = new FileAccessReportRecordParser();
 
         [CanBeNull]
         private readonly IDetoursEventListener m_detoursEventListener;
@@ -55,6 +59,11 @@ namespace BuildXL.Processes
         public readonly HashSet<ReportedFileAccess> ExplicitlyReportedFileAccesses = new HashSet<ReportedFileAccess>();
 
         public readonly List<ProcessDetouringStatusData> ProcessDetoursStatuses = new List<ProcessDetouringStatusData>();
+
+        /// <summary>
+        /// The summaries of the enumerations whose entries were not reported (see <see cref="FileAccessManifest.SummarizeDirectoryEnumerations"/>)
+        /// </summary>
+        public readonly List<DirectoryEnumerationSummary> DirectoryEnumerationSummaries = new List<DirectoryEnumerationSummary>();
         
         /// <summary>
         /// The last message count in the semaphore.
@@ -102,6 +111,10 @@ namespace BuildXL.Processes
         
         private readonly ISandboxFileSystemView m_fileSystemView;
 
+        private readonly object m_sandboxStatsLock = new object();
+        private SandboxStats m_sandboxStats;
+        private int m_sandboxStatsProcessCount;
+
         /// <summary>
         /// The max Detours heap size for processes of this pip.
         /// </summary>
@@ -114,6 +127,12 @@ namespace BuildXL.Processes
         /// </summary>
         public Failure<string> MessageProcessingFailure { get; internal set; }
 
+        /// <summary>
+        /// Content hashes (VSO0, without the algorithm id) of the files the processes of the pip wrote sequentially and did not change afterwards,
+        /// computed by the sandbox while they were written; null if the sandbox did not hash any (see <c>BuildXLLinuxSandboxHashOutputs</c>).
+        /// </summary>
+        public IReadOnlyDictionary<string, byte[]> OutputContentHashes { get; internal set; }
+
         public SandboxedProcessReports(
             FileAccessManifest manifest,
             PathTable pathTable,
@@ -147,6 +166,38 @@ namespace BuildXL.Processes
         internal void Freeze()
         {
             Volatile.Write(ref m_isFrozen, true);
+
+            SandboxStats stats;
+            int processCount;
+            lock (m_sandboxStatsLock)
+            {
+                stats = m_sandboxStats;
+                processCount = m_sandboxStatsProcessCount;
+                m_sandboxStats = null;
+            }
+
+            if (stats != null)
+            {
+                Tracing.Logger.Log.LogSandboxStatistics(m_loggingContext, PipSemiStableHash, processCount, stats.ToString());
+            }
+        }
+
+        /// <summary>
+        /// Adds the stats a process of the pip reported (see <see cref="SandboxStats"/>); they are logged, added up, when the reports are frozen.
+        /// </summary>
+        internal void AddSandboxStats(SandboxStats stats)
+        {
+            lock (m_sandboxStatsLock)
+            {
+                if (IsFrozen)
+                {
+                    return;
+                }
+
+                m_sandboxStats ??= new SandboxStats();
+                m_sandboxStats.Add(stats);
+                m_sandboxStatsProcessCount++;
+            }
         }
 
         /// <summary>
@@ -297,6 +348,25 @@ namespace BuildXL.Processes
                     return false;
                 }
                 break;
+                case ReportType.FileAccessRecord:
+                if (!FileAccessReportLineReceived(ref data, m_fileAccessRecordParser.TryParse, isAnAugmentedFileAccess: false, out errorMessage))
+                {
+                    MessageProcessingFailure = CreateMessageProcessingFailure(data, errorMessage);
+                    return false;
+                }
+                break;
+                case ReportType.DetourStatistics:
+                Tracing.Logger.Log.LogDetourStatistics(m_loggingContext, PipSemiStableHash, data);
+                break;
+                case ReportType.DirectoryEnumerationSummary:
+                if (!DirectoryEnumerationSummary.TryParse(data, out var summary, out errorMessage))
+                {
+                    MessageProcessingFailure = CreateMessageProcessingFailure(data, errorMessage);
+                    return false;
+                }
+
+                DirectoryEnumerationSummaries.Add(summary);
+                break;
                 default:
                 Contract.Assume(false);
                 break;
@@ -500,11 +570,21 @@ namespace BuildXL.Processes
                 out var allocatedPoolEntries,
                 out var maxHandleMapEntries,
                 out var handleMapEntries,
+                out var resolvedPathCacheLookups,
+                out var resolvedPathCacheHits,
+                out var injectedProcessCount,
+                out var injectionTimeInMicroseconds,
+                out var resolvedPathCacheEntries,
+                out var resolvedPathCacheBytes,
+                out var resolvedPathCacheEvictions,
+                out var sandboxStats,
                 out errorMessage))
             {
                 return false;
             }
 
+            AddSandboxStats(sandboxStats);
+
             Tracing.Logger.Log.LogDetoursMaxHeapSize(
                 m_loggingContext,
                 PipSemiStableHash,
@@ -516,7 +596,14 @@ namespace BuildXL.Processes
                 finalDetoursHeapSizeInBytes,
                 allocatedPoolEntries,
                 maxHandleMapEntries,
-                handleMapEntries);
+                handleMapEntries,
+                resolvedPathCacheLookups,
+                resolvedPathCacheHits,
+                injectedProcessCount,
+                injectionTimeInMicroseconds,
+                resolvedPathCacheEntries,
+                resolvedPathCacheBytes,
+                resolvedPathCacheEvictions);
 
             if (MaxDetoursHeapSize < unchecked((long)detoursMaxMemHeapSizeInBytes))
             {
@@ -649,6 +736,44 @@ namespace BuildXL.Processes
             return result;
         }
 
+        /// <summary>
+        /// Reads the USN of the file at 'path' if its policy asks for it to be reported after it is opened (see
+        /// <see cref="FileAccessManifest.HasReportUsnAfterOpenPolicies"/>), NoUsn otherwise or if the file cannot be opened anymore.
+        /// </summary>
+        /// <remarks>
+        /// The USN is read when the report is received rather than when the file was opened, which only differs if the file
+        /// changed in between; an access is reported with an unexpected USN (and the USN then read by Detours) only when
+        /// the manifest expects one.
+        /// </remarks>
+        private Usn TryReadUsnAfterOpen(string path)
+        {
+            if (OperatingSystemHelper.IsUnixOS
+                || !AbsolutePath.TryCreate(m_manifest.PathTable, path, out var absolutePath)
+                || (m_manifest.GetEffectivePolicy(absolutePath) & FileAccessPolicy.ReportUsnAfterOpen) == 0)
+            {
+                return ReportedFileAccess.NoUsn;
+            }
+
+            OpenFileResult openResult = FileUtilities.TryCreateOrOpenFile(
+                path,
+                FileDesiredAccess.None,
+                FileShare.ReadWrite | FileShare.Delete,
+                FileMode.Open,
+                FileFlagsAndAttributes.None,
+                out SafeFileHandle handle);
+
+            if (!openResult.Succeeded)
+            {
+                return ReportedFileAccess.NoUsn;
+            }
+
+            using (handle)
+            {
+                MiniUsnRecord? usnRecord = FileUtilities.ReadFileUsnByHandle(handle);
+                return usnRecord.HasValue ? usnRecord.Value.Usn : ReportedFileAccess.NoUsn;
+            }
+        }
+
         private bool FileAccessReportLineReceived<T>(ref T data, FileAccessReportProvider<T> parser, bool isAnAugmentedFileAccess, out string errorMessage)
         {
             Contract.Assume(!IsFrozen, "FileAccessReportLineReceived: !IsFrozen");
@@ -730,6 +855,19 @@ namespace BuildXL.Processes
                 return true;
             }
 
+            // Detours leaves the USNs it is only asked to report (i.e., not checked against an expected one) to the host
+            if (usn == ReportedFileAccess.NoUsn
+                && m_manifest.HasReportUsnAfterOpenPolicies
+                && !isAnAugmentedFileAccess
+                && explicitlyReported
+                && status == FileAccessStatus.Allowed
+                && error == 0
+                && (operation == ReportedFileOperation.CreateFile || operation == ReportedFileOperation.NtCreateFile || operation == ReportedFileOperation.ZwCreateFile)
+                && (openedFileOrDirectoryAttributes & FlagsAndAttributes.FILE_ATTRIBUTE_DIRECTORY) == 0)
+            {
+                usn = TryReadUsnAfterOpen(path);
+            }
+
             // A process id is only unique during the lifetime of the process (so there may be duplicates reported),
             // but the ID is at least consistent with other tracing tools including procmon.
             // For the purposes of event correlation, m_activeProcesses keeps track which process id maps to which process a the current time.
@@ -974,6 +1112,14 @@ namespace BuildXL.Processes
                 out uint allocatedPoolEntries,
                 out ulong maxHandleMapEntries,
                 out ulong handleMapEntries,
+                out ulong resolvedPathCacheLookups,
+                out ulong resolvedPathCacheHits,
+                out ulong injectedProcessCount,
+                out ulong injectionTimeInMicroseconds,
+                out ulong resolvedPathCacheEntries,
+                out ulong resolvedPathCacheBytes,
+                out ulong resolvedPathCacheEvictions,
+                out SandboxStats sandboxStats,
                 out string errorMessage)
             {
                 processName = default;
@@ -993,8 +1139,16 @@ namespace BuildXL.Processes
                 allocatedPoolEntries = 0;
                 maxHandleMapEntries = 0L;
                 handleMapEntries = 0L;
+                resolvedPathCacheLookups = 0L;
+                resolvedPathCacheHits = 0L;
+                injectedProcessCount = 0L;
+                injectionTimeInMicroseconds = 0L;
+                resolvedPathCacheEntries = 0L;
+                resolvedPathCacheBytes = 0L;
+                resolvedPathCacheEvictions = 0L;
+                sandboxStats = null;
 
-                const int NumberOfEntriesInMessage = 24;
+                const int NumberOfEntriesInMessage = 32;
 
                 var items = line.Split('|');
 
@@ -1034,7 +1188,15 @@ namespace BuildXL.Processes
                     ulong.TryParse(items[20], NumberStyles.None, CultureInfo.InvariantCulture, out finalDetoursHeapSizeInBytes) &&
                     uint.TryParse(items[21], NumberStyles.None, CultureInfo.InvariantCulture, out allocatedPoolEntries) &&
                     ulong.TryParse(items[22], NumberStyles.None, CultureInfo.InvariantCulture, out maxHandleMapEntries) &&
-                    ulong.TryParse(items[23], NumberStyles.None, CultureInfo.InvariantCulture, out handleMapEntries))
+                    ulong.TryParse(items[23], NumberStyles.None, CultureInfo.InvariantCulture, out handleMapEntries) &&
+                    ulong.TryParse(items[24], NumberStyles.None, CultureInfo.InvariantCulture, out resolvedPathCacheLookups) &&
+                    ulong.TryParse(items[25], NumberStyles.None, CultureInfo.InvariantCulture, out resolvedPathCacheHits) &&
+                    ulong.TryParse(items[26], NumberStyles.None, CultureInfo.InvariantCulture, out injectedProcessCount) &&
+                    ulong.TryParse(items[27], NumberStyles.None, CultureInfo.InvariantCulture, out injectionTimeInMicroseconds) &&
+                    ulong.TryParse(items[28], NumberStyles.None, CultureInfo.InvariantCulture, out resolvedPathCacheEntries) &&
+                    ulong.TryParse(items[29], NumberStyles.None, CultureInfo.InvariantCulture, out resolvedPathCacheBytes) &&
+                    ulong.TryParse(items[30], NumberStyles.None, CultureInfo.InvariantCulture, out resolvedPathCacheEvictions) &&
+                    SandboxStats.TryParse(items[31], out sandboxStats))
                 {
                     long fileTime = creationHighDateTime;
                     fileTime = fileTime << 32;
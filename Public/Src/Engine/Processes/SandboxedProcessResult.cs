@@ -119,6 +119,14 @@ namespace BuildXL.Processes
         /// </summary>
         public Failure<string> MessageProcessingFailure { get; set; }
 
+        /// <summary>
+        /// Content hashes of the outputs the sandbox hashed while they were written (see <see cref="SandboxedProcessReports.OutputContentHashes"/>).
+        /// </summary>
+        /// <remarks>
+        /// Not serialized: the hashes are only trusted by the process that observed the pip.
+        /// </remarks>
+        public IReadOnlyDictionary<string, byte[]> OutputContentHashes { get; set; }
+
         /// <summary>
         /// Time (in ms.) spent for startiing the process.
         /// </summary>
@@ -51,6 +51,8 @@ namespace BuildXL.Processes
 
         private readonly SandboxedProcessReports m_reports;
 
+        private readonly FileAccessManifest m_fileAccessManifest;
+
         private readonly ActionBlock<AccessReport> m_pendingReports;
 
         private readonly CancellableTimedAction m_perfCollector;
@@ -68,6 +70,11 @@ namespace BuildXL.Processes
 
         private readonly CancellationTokenSource m_timeoutTaskCancelationSource = new CancellationTokenSource();
 
+        /// <summary>
+        /// The cgroup the process tree of the pip runs in (see <see cref="EngineEnvironmentSettings.LinuxSandboxPipCgroupRoot"/>), null if it doesn't run in one
+        /// </summary>
+        private string m_cgroupPath;
+
         /// <summary>
         /// Id of the underlying pip.
         /// </summary>
@@ -89,6 +96,33 @@ namespace BuildXL.Processes
         /// </summary>
         private ulong m_sumOfReportCreationTimesUs;
 
+        /// <summary>
+        /// Per-interposer stats sent by the Linux sandbox (calls, cache hits, reports, total ns, real ns), summed up over all processes of the pip
+        /// </summary>
+        private readonly Dictionary<string, ulong[]> m_interposeStats = new Dictionary<string, ulong[]>();
+
+        /// <summary>
+        /// Timings of the timed reports of the Linux sandbox (see <see cref="AddReportTiming"/>); guarded by <see cref="m_lastReportSequenceNumbers"/>
+        /// </summary>
+        private ulong m_timedReportCount;
+        private ulong m_outOfOrderReportCount;
+        private ulong m_sumOfReportLatenciesNs;
+        private ulong m_maxReportLatencyNs;
+        private ulong m_firstReportTimestamp = ulong.MaxValue;
+        private ulong m_lastReportTimestamp;
+
+        /// <summary>
+        /// Sequence number of the last timed report received from each process of the pip
+        /// </summary>
+        private readonly Dictionary<uint, ulong> m_lastReportSequenceNumbers = new Dictionary<uint, ulong>();
+
+        /// <summary>
+        /// Last content hash the Linux sandbox sent for each file written by the processes of the pip, along with the size, modification time and inode
+        /// of the file when it was hashed
+        /// </summary>
+        private readonly Dictionary<string, (byte[] hash, long size, long mtimeSec, long mtimeNsec, ulong inode)> m_outputContentHashes =
+            new Dictionary<string, (byte[], long, long, long, ulong)>(OperatingSystemHelper.PathComparer);
+
         /// <summary>
         /// Timeout period for inactivity from the sandbox kernel extension.
         /// </summary>
@@ -165,6 +199,7 @@ namespace BuildXL.Processes
             Contract.Requires(info.SandboxConnection != null);
 
             PipId = info.FileAccessManifest.PipId;
+            m_fileAccessManifest = info.FileAccessManifest;
 
             SandboxConnection = info.SandboxConnection;
             ChildProcessTimeout = info.NestedProcessTerminationTimeout;
@@ -215,6 +250,12 @@ namespace BuildXL.Processes
                 return;
             }
 
+            if (m_cgroupPath != null && TryGetCgroupUsage(out var usage))
+            {
+                RegisterCgroupSample(usage);
+                return;
+            }
+
             var buffer = new Process.ProcessResourceUsage();
 
             // get processor times for the root process itself
@@ -241,6 +282,80 @@ namespace BuildXL.Processes
             }
         }
 
+        /// <summary>
+        /// With a cgroup, the kernel accounts for the whole process tree (including the processes that left it, which the process tree walk misses) in one read
+        /// </summary>
+        private void RegisterCgroupSample(Cgroup.CgroupUsage usage)
+        {
+            var buffer = new Process.ProcessResourceUsage();
+            int errCode = Interop.Unix.Process.GetProcessResourceUsage(ProcessId, ref buffer, includeChildProcesses: false);
+            if (errCode == 0)
+            {
+                m_perfAggregator.KernelTimeMs.RegisterSample(buffer.SystemTimeNs / 1000);
+                m_perfAggregator.UserTimeMs.RegisterSample(buffer.UserTimeNs / 1000);
+            }
+
+            m_perfAggregator.JobKernelTimeMs.RegisterSample(usage.CpuSystemUs / 1000);
+            m_perfAggregator.JobUserTimeMs.RegisterSample(usage.CpuUserUs / 1000);
+            m_perfAggregator.JobPeakMemoryBytes.RegisterSample(Math.Max(usage.MemoryPeakBytes, usage.MemoryCurrentBytes));
+            m_perfAggregator.JobMemoryBytes.RegisterSample(usage.MemoryCurrentBytes);
+            m_perfAggregator.JobDiskReadOps.RegisterSample(usage.IoReadOps);
+            m_perfAggregator.JobDiskBytesRead.RegisterSample(usage.IoReadBytes);
+            m_perfAggregator.JobDiskWriteOps.RegisterSample(usage.IoWriteOps);
+            m_perfAggregator.JobDiskBytesWritten.RegisterSample(usage.IoWriteBytes);
+            m_perfAggregator.JobNumberOfChildProcesses.RegisterSample(GetCurrentlyActiveChildProcesses().Count);
+        }
+
+        private bool TryGetCgroupUsage(out Cgroup.CgroupUsage usage)
+        {
+            usage = new Cgroup.CgroupUsage();
+            return Cgroup.GetUsage(m_cgroupPath, ref usage) == 0;
+        }
+
+        /// <summary>
+        /// Moves the (not yet fed) shell into a cgroup of its own, so that every process of the pip is created in there.
+        /// Running in a cgroup is an optimization of the accounting (and of killing): when it fails, the pip simply runs without one.
+        /// </summary>
+        private void TryMoveIntoPipCgroup(SandboxedProcessInfo info)
+        {
+            string root = EngineEnvironmentSettings.LinuxSandboxPipCgroupRoot.Value;
+            if (string.IsNullOrEmpty(root) || !OperatingSystemHelper.IsLinuxOS)
+            {
+                return;
+            }
+
+            // a pip may run several times (e.g., retries), possibly while the cgroup of an earlier run is still being torn down
+            string path = Path.Combine(root, $"Pip{info.PipSemiStableHash:X16}-{ProcessId}");
+            int error = Cgroup.Create(path);
+            if (error == 0)
+            {
+                error = Cgroup.AddProcess(path, ProcessId);
+                if (error != 0)
+                {
+                    Cgroup.Remove(path);
+                }
+            }
+
+            if (error != 0)
+            {
+                LogProcessState($"Could not run in cgroup '{path}' (errno: {error}), falling back to process tree accounting");
+                return;
+            }
+
+            m_cgroupPath = path;
+
+            int? memoryHighMb = EngineEnvironmentSettings.LinuxSandboxPipCgroupMemoryHighMb.Value;
+            if (memoryHighMb > 0)
+            {
+                error = Cgroup.SetMemoryHigh(path, (ulong)memoryHighMb.Value * 1024 * 1024);
+                LogProcessState($"Running in cgroup '{path}', memory.high: {memoryHighMb}MB (errno: {error})");
+            }
+            else
+            {
+                LogProcessState($"Running in cgroup '{path}'");
+            }
+        }
+
         /// <inheritdoc />
         protected override System.Diagnostics.Process CreateProcess(SandboxedProcessInfo info)
         {
@@ -286,6 +401,8 @@ namespace BuildXL.Processes
                     values: FileAccessPolicy.AllowReadAlways);
             }
 
+            TryMoveIntoPipCgroup(info);
+
             m_perfCollector?.Start();
 
             string processStdinFileName = await FlushStandardInputToFileIfNeededAsync(info);
@@ -313,7 +430,11 @@ namespace BuildXL.Processes
                 // NOTE: just by not keeping any references to 'info' should make the FileAccessManifest object
                 //       unreachable and thus available for garbage collection.  We call Release() here explicitly
                 //       just to emphasize the importance of reclaiming this memory.
-                info.FileAccessManifest.Release();
+                //       The accesses of an observe-only pip are checked here, against the manifest tree, as they are reported.
+                if (!info.FileAccessManifest.ObserveOnly)
+                {
+                    info.FileAccessManifest.Release();
+                }
             }
         }
 
@@ -372,6 +493,8 @@ namespace BuildXL.Processes
             // in any case must wait for pending reports to complete, because we must not freeze m_reports before that happens
             await m_pendingReports.Completion;
 
+            m_reports.OutputContentHashes = GetValidOutputContentHashes();
+
             // at this point this pip is done executing (it's only left to construct SandboxedProcessResult,
             // which is done by the base class) so notify the sandbox connection about it.
             SandboxConnection.NotifyPipFinished(PipId, this);
@@ -402,15 +525,191 @@ namespace BuildXL.Processes
                 KillAllChildProcesses();
             }
 
+            if (m_cgroupPath != null)
+            {
+                // the cgroup of a pip whose processes are not all reaped yet is left behind (EBUSY)
+                int error = Cgroup.Remove(m_cgroupPath);
+                if (error != 0)
+                {
+                    LogProcessState($"Could not remove cgroup '{m_cgroupPath}' (errno: {error})");
+                }
+            }
+
             if (m_pipKextStats != null)
             {
                 var statsJson = Newtonsoft.Json.JsonConvert.SerializeObject(m_pipKextStats.Value);
                 LogProcessState($"Process Kext Stats: {statsJson}");
             }
 
+            LogInterposeStats();
+            LogReportTimings();
+
             base.Dispose();
         }
 
+        /// <summary>
+        /// Accumulates the stats of one interposed function, as sent by one process of this pip.
+        /// </summary>
+        internal void AddInterposeStats(string name, ulong calls, ulong cacheHits, ulong reports, ulong totalNs, ulong realNs)
+        {
+            lock (m_interposeStats)
+            {
+                if (!m_interposeStats.TryGetValue(name, out var stats))
+                {
+                    stats = new ulong[5];
+                    m_interposeStats[name] = stats;
+                }
+
+                stats[0] += calls;
+                stats[1] += cacheHits;
+                stats[2] += reports;
+                stats[3] += totalNs;
+                stats[4] += realNs;
+            }
+        }
+
+        /// <summary>
+        /// Process <paramref name="pid"/> of this pip exceeded the overhead budget of the Linux sandbox (see
+        /// <see cref="EngineEnvironmentSettings.LinuxSandboxOverheadBudgetPercent"/>) and switched to <paramref name="mode"/>
+        /// ("deferReports", or "none" when its pip permits no cheaper way of observing it).
+        /// </summary>
+        internal void AddOverheadBudgetExceeded(uint pid, string processName, ulong overheadNs, ulong wallNs, uint budgetPercent, string mode)
+        {
+            Counters.IncrementCounter(SandboxedProcessCounters.LinuxSandboxOverheadBudgetExceededCount);
+            if (mode != "none")
+            {
+                Counters.IncrementCounter(SandboxedProcessCounters.LinuxSandboxOverheadBudgetDegradedCount);
+            }
+
+            LogProcessState($"Process {processName} ({pid}) exceeded the sandbox overhead budget ({budgetPercent}%): {overheadNs / 1000}us of interposer overhead in {wallNs / 1000}us, degraded to: {mode}");
+        }
+
+        /// <summary>
+        /// Accounts for the stats a process of the pip reported (see <see cref="SandboxStats"/>).
+        /// </summary>
+        internal void AddSandboxStats(SandboxStats stats) => m_reports.AddSandboxStats(stats);
+
+        /// <summary>
+        /// Accounts for a timed report of process <paramref name="pid"/> that was made at <paramref name="timestamp"/> (see <see cref="AccessReportRecord.Timestamp"/>)
+        /// and is processed now.
+        /// </summary>
+        internal void AddReportTiming(uint pid, ulong timestamp, ulong sequenceNumber)
+        {
+            // the timestamps are taken on the clock Stopwatch reads, in nanoseconds
+            ulong now = (ulong)(System.Diagnostics.Stopwatch.GetTimestamp() * (1_000_000_000.0 / System.Diagnostics.Stopwatch.Frequency));
+            ulong latencyNs = now > timestamp ? now - timestamp : 0;
+
+            lock (m_lastReportSequenceNumbers)
+            {
+                m_timedReportCount++;
+                m_sumOfReportLatenciesNs += latencyNs;
+                m_maxReportLatencyNs = Math.Max(m_maxReportLatencyNs, latencyNs);
+                m_firstReportTimestamp = Math.Min(m_firstReportTimestamp, timestamp);
+                m_lastReportTimestamp = Math.Max(m_lastReportTimestamp, timestamp);
+
+                if (m_lastReportSequenceNumbers.TryGetValue(pid, out ulong last) && sequenceNumber < last)
+                {
+                    m_outOfOrderReportCount++;
+                }
+                else
+                {
+                    m_lastReportSequenceNumbers[pid] = sequenceNumber;
+                }
+            }
+        }
+
+        private void LogReportTimings()
+        {
+            lock (m_lastReportSequenceNumbers)
+            {
+                if (m_timedReportCount == 0)
+                {
+                    return;
+                }
+
+                LogProcessState($"Process Report Timings: reports={m_timedReportCount}, processes={m_lastReportSequenceNumbers.Count}, outOfOrder={m_outOfOrderReportCount}, " +
+                    $"avgLatencyUs={m_sumOfReportLatenciesNs / m_timedReportCount / 1000}, maxLatencyUs={m_maxReportLatencyNs / 1000}, " +
+                    $"spanMs={(m_lastReportTimestamp - m_firstReportTimestamp) / 1_000_000}");
+            }
+        }
+
+        /// <summary>
+        /// Records the content hash of a file written by one process of this pip (a later hash of the same file replaces it).
+        /// </summary>
+        internal void AddOutputContentHash(string path, byte[] hash, long size, long mtimeSec, long mtimeNsec, ulong inode)
+        {
+            lock (m_outputContentHashes)
+            {
+                m_outputContentHashes[path] = (hash, size, mtimeSec, mtimeNsec, inode);
+            }
+        }
+
+        /// <summary>
+        /// The content hashes of the files that have not changed since they were hashed (i.e., that are still the same inode, of the same size and
+        /// modification time); null if there are none.
+        /// </summary>
+        private IReadOnlyDictionary<string, byte[]> GetValidOutputContentHashes()
+        {
+            lock (m_outputContentHashes)
+            {
+                if (m_outputContentHashes.Count == 0)
+                {
+                    return null;
+                }
+
+                var result = new Dictionary<string, byte[]>(m_outputContentHashes.Count, OperatingSystemHelper.PathComparer);
+                var statBuffer = new BuildXL.Interop.Unix.IO.StatBuffer();
+                foreach (var kvp in m_outputContentHashes)
+                {
+                    var hashed = kvp.Value;
+                    if (BuildXL.Interop.Unix.IO.StatFile(kvp.Key, followSymlink: false, ref statBuffer) == 0
+                        && statBuffer.InodeNumber == hashed.inode
+                        && statBuffer.Size == hashed.size
+                        && statBuffer.TimeLastModification == hashed.mtimeSec
+                        && statBuffer.TimeNSecLastModification == hashed.mtimeNsec)
+                    {
+                        result[kvp.Key] = hashed.hash;
+                    }
+                }
+
+                return result;
+            }
+        }
+
+        private void LogInterposeStats()
+        {
+            List<KeyValuePair<string, ulong[]>> stats;
+            lock (m_interposeStats)
+            {
+                if (m_interposeStats.Count == 0)
+                {
+                    return;
+                }
+
+                // most expensive interposers (time spent on top of the real call) first
+                stats = m_interposeStats
+                    .OrderByDescending(kvp => kvp.Value[3] > kvp.Value[4] ? kvp.Value[3] - kvp.Value[4] : 0)
+                    .ToList();
+            }
+
+            ulong totalOverheadNs = 0;
+            var summary = new StringBuilder();
+            foreach (var kvp in stats)
+            {
+                var s = kvp.Value;
+                ulong overheadNs = s[3] > s[4] ? s[3] - s[4] : 0;
+                totalOverheadNs += overheadNs;
+                summary.Append($"{Environment.NewLine}  {kvp.Key}: calls={s[0]}, cacheHits={s[1]}, reports={s[2]}, totalUs={s[3] / 1000}, realUs={s[4] / 1000}, overheadUs={overheadNs / 1000}");
+
+                Counters.AddToCounter(SandboxedProcessCounters.LinuxSandboxInterposedCallCount, (long)s[0]);
+                Counters.AddToCounter(SandboxedProcessCounters.LinuxSandboxInterposedCacheHitCount, (long)s[1]);
+                Counters.AddToCounter(SandboxedProcessCounters.LinuxSandboxInterposedReportCount, (long)s[2]);
+            }
+
+            Counters.AddToCounter(SandboxedProcessCounters.LinuxSandboxInterposerOverheadUs, (long)(totalOverheadNs / 1000));
+            LogProcessState($"Process Interpose Stats (overhead: {totalOverheadNs / 1000}us):{summary}");
+        }
+
         /// <summary>
         /// This method reads some collections from the non-thread-safe <see cref="m_reports"/> object.
         /// The callers must make sure that when they call this method no concurrent modifications are
@@ -423,6 +722,13 @@ namespace BuildXL.Processes
 
         private void KillAllChildProcesses()
         {
+            if (m_cgroupPath != null)
+            {
+                // gets every process of the pip, including the ones the sandbox doesn't know of (yet)
+                int error = Cgroup.Kill(m_cgroupPath);
+                LogProcessState($"KillAllChildProcesses: cgroup.kill = {error}");
+            }
+
             var distinctProcessIds = CoalesceProcesses(GetCurrentlyActiveChildProcesses())
                 .Select(p => p.ProcessId)
                 .ToHashSet();
@@ -538,6 +844,28 @@ namespace BuildXL.Processes
         // <inheritdoc />
         internal override JobObject.AccountingInformation GetJobAccountingInfo()
         {
+            // the pip is done: the cgroup holds the final (rather than the last sampled) usage of the whole process tree
+            if (m_cgroupPath != null && TryGetCgroupUsage(out var usage))
+            {
+                return new JobObject.AccountingInformation
+                {
+                    IO = new IOCounters(new IO_COUNTERS()
+                    {
+                        ReadOperationCount = usage.IoReadOps,
+                        ReadTransferCount = usage.IoReadBytes,
+                        WriteOperationCount = usage.IoWriteOps,
+                        WriteTransferCount = usage.IoWriteBytes
+                    }),
+                    MemoryCounters = ProcessMemoryCounters.CreateFromBytes(
+                        Math.Max(usage.MemoryPeakBytes, m_perfCollector is null ? 0 : Convert.ToUInt64(m_perfAggregator.JobPeakMemoryBytes.Maximum)),
+                        m_perfCollector is null ? usage.MemoryCurrentBytes : Convert.ToUInt64(m_perfAggregator.JobMemoryBytes.Average),
+                        0, 0),
+                    KernelTime = TimeSpan.FromTicks((long)usage.CpuSystemUs * 10),
+                    UserTime = TimeSpan.FromTicks((long)usage.CpuUserUs * 10),
+                    NumberOfProcesses = m_perfCollector is null ? 0 : Convert.ToUInt32(m_perfAggregator.JobNumberOfChildProcesses.Maximum),
+                };
+            }
+
             if (m_perfCollector is null)
             {
                 return base.GetJobAccountingInfo();
@@ -716,6 +1044,12 @@ namespace BuildXL.Processes
                     m_processExitTimeNs = report.Statistics.EnqueueTime;
                 }
 
+                // accesses of observe-only pips come unchecked (see FileAccessManifest.ObserveOnly)
+                if (report.Status == (uint)FileAccessStatus.CannotDeterminePolicy && m_fileAccessManifest.ObserveOnly && !CheckUncheckedAccess(ref report, reportPath))
+                {
+                    return;
+                }
+
                 var pathExists = true;
 
                 // special handling for MAC_LOOKUP:
@@ -768,6 +1102,10 @@ namespace BuildXL.Processes
                     if (SandboxConnection is SandboxConnectionKext)
                     {
                         m_pipKextStats = report.DecodePipKextStats();
+                        if (SandboxStats.TryRead(report.PathOrPipStats.AsSpan(PipKextStats.SandboxStatsOffset), out var sandboxStats))
+                        {
+                            AddSandboxStats(sandboxStats);
+                        }
                     }
                     m_pendingReports.Complete();
                 }
@@ -778,6 +1116,54 @@ namespace BuildXL.Processes
             }
         }
 
+        /// <summary>
+        /// Checks an access the native sandbox reported without checking it against the manifest, i.e., sets its status and whether it
+        /// is reported explicitly like PolicyResult::CheckReadAccess and PolicyResult::CheckWriteAccess do natively.
+        /// Returns false when the sandbox would not have reported the access.
+        /// </summary>
+        /// <remarks>
+        /// Only called for observe-only pips, which do not fail on unexpected accesses: disallowed accesses are reported, never denied.
+        /// </remarks>
+        private bool CheckUncheckedAccess(ref AccessReport report, string path)
+        {
+            if (!AbsolutePath.TryCreate(PathTable, path, out var absolutePath))
+            {
+                report.Status = (uint)FileAccessStatus.Allowed;
+                report.ExplicitLogging = 0;
+                return m_fileAccessManifest.ReportFileAccesses;
+            }
+
+            FileAccessPolicy policy = m_fileAccessManifest.GetEffectivePolicy(absolutePath);
+            bool allowed;
+            bool explicitReport;
+            switch ((RequestedAccess)report.RequestedAccess)
+            {
+                case RequestedAccess.Enumerate:
+                    // enumerations are always allowed, and only reported when asked for
+                    report.Status = (uint)FileAccessStatus.Allowed;
+                    report.ExplicitLogging = (policy & FileAccessPolicy.ReportDirectoryEnumerationAccess) != 0 ? 1u : 0u;
+                    return report.ExplicitLogging != 0;
+
+                case RequestedAccess.Write:
+                    allowed = (policy & FileAccessPolicy.AllowWrite) != 0;
+                    explicitReport = (policy & FileAccessPolicy.ReportAccess) != 0;
+                    break;
+
+                default:
+                    // reads and probes; lookups are probes of paths that do not exist
+                    bool exists = report.Operation != FileOperation.OpMacLookup;
+                    allowed = (policy & (exists ? FileAccessPolicy.AllowRead : FileAccessPolicy.AllowReadIfNonexistent)) != 0;
+                    explicitReport = (policy & (exists ? FileAccessPolicy.ReportAccessIfExistent : FileAccessPolicy.ReportAccessIfNonexistent)) != 0;
+                    break;
+            }
+
+            report.Status = (uint)(allowed ? FileAccessStatus.Allowed : FileAccessStatus.Denied);
+            report.ExplicitLogging = explicitReport ? 1u : 0u;
+            return explicitReport
+                || m_fileAccessManifest.ReportFileAccesses
+                || (!allowed && m_fileAccessManifest.ReportUnexpectedFileAccesses);
+        }
+
         private void ReportFileAccess(ref AccessReport report)
         {
             if (ReportsCompleted())
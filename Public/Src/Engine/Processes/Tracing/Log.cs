@@ -372,6 +372,31 @@ namespace BuildXL.Processes.Tracing
             long pipSemiStableHash,
             string message);
 
+        [GeneratedEvent(
+            (int)LogEventId.LogDetourStatistics,
+            EventGenerators = EventGenerators.LocalOnly,
+            EventLevel = Level.Verbose,
+            Keywords = (int)Keywords.UserMessage,
+            EventTask = (int)Tasks.PipExecutor,
+            Message = "[Pip{pipSemiStableHash:X16}] Detours statistics (process id|path cache lookups|ShouldResolveReparsePoint, ReparsePointTarget and ResolvedPaths cache hits|function:calls:microseconds...): {statistics}")]
+        public abstract void LogDetourStatistics(
+            LoggingContext context,
+            long pipSemiStableHash,
+            string statistics);
+
+        [GeneratedEvent(
+            (int)LogEventId.LogSandboxStatistics,
+            EventGenerators = EventGenerators.LocalOnly,
+            EventLevel = Level.Verbose,
+            Keywords = (int)Keywords.UserMessage,
+            EventTask = (int)Tasks.PipExecutor,
+            Message = "[Pip{pipSemiStableHash:X16}] Sandbox statistics (over {processCount} processes): {statistics}")]
+        public abstract void LogSandboxStatistics(
+            LoggingContext context,
+            long pipSemiStableHash,
+            int processCount,
+            string statistics);
+
         [GeneratedEvent(
             (int)LogEventId.LogRemotingDebugMessage,
             EventGenerators = EventGenerators.LocalOnly,
@@ -428,7 +453,7 @@ namespace BuildXL.Processes.Tracing
             EventLevel = Level.Verbose,
             Keywords = (int)(Keywords.UserMessage | Keywords.Diagnostics),
             EventTask = (int)Tasks.PipExecutor,
-            Message = EventConstants.PipPrefix + "Maximum detours heap size for process in the pip is {maxDetoursHeapSizeInBytes} bytes. The processName '{processName}'. The processId is: {processId}. The manifestSize in bytes is: {manifestSizeInBytes}. The finalDetoursHeapSize in bytes is: {finalDetoursHeapSizeInBytes}. The allocatedPoolEntries is: {allocatedPoolEntries}. The maxHandleMapEntries is: {maxHandleMapEntries}. The handleMapEntries is: {handleMapEntries}.")]
+            Message = EventConstants.PipPrefix + "Maximum detours heap size for process in the pip is {maxDetoursHeapSizeInBytes} bytes. The processName '{processName}'. The processId is: {processId}. The manifestSize in bytes is: {manifestSizeInBytes}. The finalDetoursHeapSize in bytes is: {finalDetoursHeapSizeInBytes}. The allocatedPoolEntries is: {allocatedPoolEntries}. The maxHandleMapEntries is: {maxHandleMapEntries}. The handleMapEntries is: {handleMapEntries}. The resolved path cache got {resolvedPathCacheHits} hits out of {resolvedPathCacheLookups} lookups, and ended up with {resolvedPathCacheEntries} entries taking about {resolvedPathCacheBytes} bytes after {resolvedPathCacheEvictions} evictions. Injecting {injectedProcessCount} child processes took {injectionTimeInMicroseconds} microseconds.")]
         public abstract void LogDetoursMaxHeapSize(
             LoggingContext context,
             long pipSemiStableHash,
@@ -440,7 +465,14 @@ namespace BuildXL.Processes.Tracing
             ulong finalDetoursHeapSizeInBytes,
             uint allocatedPoolEntries,
             ulong maxHandleMapEntries,
-            ulong handleMapEntries);
+            ulong handleMapEntries,
+            ulong resolvedPathCacheLookups,
+            ulong resolvedPathCacheHits,
+            ulong injectedProcessCount,
+            ulong injectionTimeInMicroseconds,
+            ulong resolvedPathCacheEntries,
+            ulong resolvedPathCacheBytes,
+            ulong resolvedPathCacheEvictions);
 
         [GeneratedEvent(
             (int)LogEventId.LogInternalDetoursErrorFileNotEmpty,
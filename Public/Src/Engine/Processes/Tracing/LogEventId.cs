@@ -136,6 +136,8 @@ namespace BuildXL.Processes.Tracing
         LogDetoursDebugMessage = 10101,
         LogAppleSandboxPolicyGenerated = 10102,
         LogMacKextFailure = 10103,
+        LogDetourStatistics = 10104,
+        LogSandboxStatistics = 10105,
 
         //// Container related errors
         FailedToMergeOutputsToOriginalLocation = 12202,
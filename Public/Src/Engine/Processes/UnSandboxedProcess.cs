@@ -310,6 +310,7 @@ namespace BuildXL.Processes
                 ExplicitlyReportedFileAccesses      = reports?.ExplicitlyReportedFileAccesses ?? EmptyFileAccessesSet,
                 Processes                           = CoalesceProcesses(reports?.Processes),
                 MessageProcessingFailure            = reports?.MessageProcessingFailure,
+                OutputContentHashes                 = reports?.OutputContentHashes,
                 DumpCreationException               = m_dumpCreationException,
                 DumpFileDirectory                   = TimeoutDumpDirectory,
                 PrimaryProcessTimes                 = GetProcessTimes(),
@@ -1489,7 +1489,8 @@ namespace BuildXL.Scheduler
                             processExecutionResult,
                             enableCaching: !skipCaching,
                             fingerprintComputation: fingerprintComputation,
-                            executionResult.ContainerConfiguration);
+                            executionResult.ContainerConfiguration,
+                            executionResult.OutputContentHashes);
                         LogSubPhaseDuration(operationContext, pip, SandboxedProcessCounters.PipExecutorPhaseStoringCacheContent, DateTime.UtcNow.Subtract(start));
                     }
 
@@ -4305,7 +4306,8 @@ namespace BuildXL.Scheduler
             ExecutionResult processExecutionResult,
             bool enableCaching,
             BoxRef<ProcessFingerprintComputationEventData> fingerprintComputation,
-            ContainerConfiguration containerConfiguration)
+            ContainerConfiguration containerConfiguration,
+            IReadOnlyDictionary<string, byte[]> outputContentHashes)
         {
             Contract.Requires(environment != null);
             Contract.Requires(process != null);
@@ -4538,7 +4540,8 @@ namespace BuildXL.Scheduler
                                                 operationContext,
                                                 process,
                                                 contentToStore,
-                                                outputData);
+                                                outputData,
+                                                outputContentHashes);
                                     }
                                 });
 
@@ -4731,7 +4734,8 @@ namespace BuildXL.Scheduler
             OperationContext operationContext,
             Process process,
             FileArtifactWithAttributes output,
-            FileOutputData outputData)
+            FileOutputData outputData,
+            IReadOnlyDictionary<string, byte[]> outputContentHashes)
         {
             Contract.Assert(output.CanBeReferencedOrCached());
 
@@ -4793,7 +4797,14 @@ namespace BuildXL.Scheduler
                     && !isReparsePoint;
 
                 Possible<TrackedFileContentInfo> possiblyStoredOutputArtifact = shouldStoreOutputToCache
-                    ? await StoreProcessOutputToCacheAsync(operationContext, environment, process, outputArtifact, output.IsUndeclaredFileRewrite, isReparsePoint)
+                    ? await StoreProcessOutputToCacheAsync(
+                        operationContext,
+                        environment,
+                        process,
+                        outputArtifact,
+                        output.IsUndeclaredFileRewrite,
+                        isReparsePoint,
+                        knownContentHash: isReparsePoint ? null : TryGetOutputContentHash(outputContentHashes, path))
                     : await TrackPipOutputAsync(
                         operationContext,
                         environment,
@@ -5198,7 +5209,23 @@ namespace BuildXL.Scheduler
         }
 
         /// <summary>
-        /// Hashes and stores the specified output artifact from a process.
+        /// The content hash the sandbox computed for the output at <paramref name="path"/> while the pip wrote it, if any and if it is
+        /// of the kind the cache uses (the sandbox only computes VSO0 hashes).
+        /// </summary>
+        private static ContentHash? TryGetOutputContentHash(IReadOnlyDictionary<string, byte[]> outputContentHashes, string path)
+        {
+            if (outputContentHashes == null
+                || ContentHashingUtilities.HashInfo.HashType != HashType.Vso0
+                || !outputContentHashes.TryGetValue(path, out var hash))
+            {
+                return null;
+            }
+
+            return new BlobIdentifier(hash, VsoHash.VsoAlgorithmId).ToContentHash();
+        }
+
+        /// <summary>
+        /// Hashes (unless <paramref name="knownContentHash"/> is given) and stores the specified output artifact from a process.
         /// </summary>
         private static async Task<Possible<TrackedFileContentInfo>> StoreProcessOutputToCacheAsync(
             OperationContext operationContext,
@@ -5206,7 +5233,8 @@ namespace BuildXL.Scheduler
             Process process,
             FileArtifact outputFileArtifact,
             bool isUndeclaredFileRewrite,
-            bool isReparsePoint = false)
+            bool isReparsePoint = false,
+            ContentHash? knownContentHash = null)
         {
             Contract.Requires(environment != null);
             Contract.Requires(process != null);
@@ -5219,6 +5247,7 @@ namespace BuildXL.Scheduler
                         GetFileRealizationMode(environment, process, isUndeclaredFileRewrite),
                         outputFileArtifact.Path,
                         tryFlushPageCacheToFileSystem: environment.Configuration.Sandbox.FlushPageCacheToFileSystemOnStoringOutputsToCache,
+                        knownContentHash: knownContentHash,
                         isReparsePoint: isReparsePoint,
                         isUndeclaredFileRewrite: isUndeclaredFileRewrite);
 
@@ -1088,6 +1088,16 @@ namespace BuildXL.Scheduler
         /// </summary>
         public ExecutionSampler ExecutionSampler { get; }
 
+        /// <summary>
+        /// Notifies the memory pressure transitions on Unix (see <see cref="OnMemoryPressureLevelChanged"/>); null when not available
+        /// </summary>
+        private IDisposable m_memoryPressureSubscription;
+
+        /// <summary>
+        /// Latest memory pressure level notified by <see cref="m_memoryPressureSubscription"/>
+        /// </summary>
+        private volatile Memory.PressureLevel m_latestMemoryPressureLevel = Memory.PressureLevel.Normal;
+
         /// <summary>
         /// Whether a low ram memory perf smell was reached
         /// </summary>
@@ -1537,6 +1547,15 @@ namespace BuildXL.Scheduler
 
             ExecutionLog?.BxlInvocation(new BxlInvocationEventData(m_configuration));
 
+            if (OperatingSystemHelper.IsUnixOS)
+            {
+                // Transitions only: start from the level of now
+                Memory.PressureLevel level = Memory.PressureLevel.Normal;
+                Memory.GetMemoryPressureLevel(ref level);
+                m_latestMemoryPressureLevel = level;
+                m_memoryPressureSubscription = Memory.SubscribeToMemoryPressureChanges(OnMemoryPressureLevelChanged);
+            }
+
             m_drainThread = new Thread(m_pipQueue.DrainQueues);
 
             if (!m_scheduleTerminating)
@@ -1547,6 +1566,29 @@ namespace BuildXL.Scheduler
             }
         }
 
+        /// <summary>
+        /// Rather than waiting for the next status update to notice a rising memory pressure, resources are managed right away.
+        /// </summary>
+        private void OnMemoryPressureLevelChanged(Memory.PressureLevel level)
+        {
+            Memory.PressureLevel previous = m_latestMemoryPressureLevel;
+            m_latestMemoryPressureLevel = level;
+
+            if (level > previous)
+            {
+                Task.Run(() =>
+                {
+                    lock (m_statusLock)
+                    {
+                        if (!m_isDisposed)
+                        {
+                            UpdateStatus(overwriteable: true);
+                        }
+                    }
+                });
+            }
+        }
+
         /// <summary>
         /// Marks that a pip was executed. This logs a stat the first time it is called
         /// </summary>
@@ -2675,6 +2717,20 @@ namespace BuildXL.Scheduler
             return 0;
         }
 
+#if PLATFORM_OSX
+        private bool TryGetMemoryPressureLevel(ref Memory.PressureLevel level)
+        {
+            // The subscription keeps the level up to date, no need to poll it
+            if (m_memoryPressureSubscription != null)
+            {
+                level = m_latestMemoryPressureLevel;
+                return true;
+            }
+
+            return Memory.GetMemoryPressureLevel(ref level) == Dispatch.MACOS_INTEROP_SUCCESS;
+        }
+#endif
+
         private void UpdateResourceAvailability(PerformanceCollector.MachinePerfInfo perfInfo)
         {
             var resourceManager = State.ResourceManager;
@@ -2805,7 +2861,7 @@ namespace BuildXL.Scheduler
 #if PLATFORM_OSX
                 bool simulateHighMemory = m_testHooks?.SimulateHighMemoryPressure ?? false;
                 Memory.PressureLevel pressureLevel = simulateHighMemory ? Memory.PressureLevel.Critical : Memory.PressureLevel.Normal;
-                var result = simulateHighMemory ? true : Memory.GetMemoryPressureLevel(ref pressureLevel) == Dispatch.MACOS_INTEROP_SUCCESS;
+                var result = simulateHighMemory ? true : TryGetMemoryPressureLevel(ref pressureLevel);
                 var startCancellingPips = false;
 
                 if (result)
@@ -7756,6 +7812,8 @@ namespace BuildXL.Scheduler
         /// <inheritdoc />
         public void Dispose()
         {
+            m_memoryPressureSubscription?.Dispose();
+
             lock (m_statusLock)
             {
                 m_isDisposed = true;
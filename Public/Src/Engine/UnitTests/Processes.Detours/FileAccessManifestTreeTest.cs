@@ -552,7 +552,7 @@ namespace Test.BuildXL.Processes.Detours
         /// which has 1 project and 100 C# files. (Access pattern made by csc.exe.)
         /// This is intended to be a stress test.
         /// </summary>
-        private void TestSolutionMockupManifestTest(int numFiles, bool serializeManifest = false)
+        private void TestSolutionMockupManifestTest(int numFiles, bool serializeManifest = false, bool useCompactManifestTree = false, bool useManifestPathFilter = false)
         {
             var pt = new PathTable();
             var fam =
@@ -562,7 +562,9 @@ namespace Test.BuildXL.Processes.Detours
                     IgnoreCodeCoverage = false,
                     ReportFileAccesses = false,
                     ReportUnexpectedFileAccesses = false,
-                    MonitorChildProcesses = false
+                    MonitorChildProcesses = false,
+                    UseCompactManifestTree = useCompactManifestTree,
+                    UseManifestPathFilter = useManifestPathFilter
                 };
 
             var vac = new ValidationDataCreator(fam, pt);
@@ -608,6 +610,24 @@ namespace Test.BuildXL.Processes.Detours
             TestSolutionMockupManifestTest(1000);
         }
 
+        [Theory]
+        [InlineData(true)]
+        [InlineData(false)]
+        public void TestSolution1000CompactManifestTree(bool serializeManifest)
+        {
+            TestSolutionMockupManifestTest(1000, serializeManifest, useCompactManifestTree: true);
+        }
+
+        [Theory]
+        [InlineData(true, false)]
+        [InlineData(false, false)]
+        [InlineData(true, true)]
+        [InlineData(false, true)]
+        public void TestSolution1000ManifestPathFilter(bool serializeManifest, bool useCompactManifestTree)
+        {
+            TestSolutionMockupManifestTest(1000, serializeManifest, useCompactManifestTree, useManifestPathFilter: true);
+        }
+
         [Fact]
         public void TestSolution5000()
         {
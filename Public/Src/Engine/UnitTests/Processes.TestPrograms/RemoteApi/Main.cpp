@@ -11,6 +11,14 @@
 // Response format (sent over stdout):
 //   commandName,result (0 for success or 1 for failure).
 //
+// Load mode (RemoteApi.exe /repeat:N [/threads:T]):
+//   All commands are read from stdin first. Then each of T threads (1 by default) runs the whole list of commands, in order, N times, so that
+//   the program can serve as a detoured workload of a known shape (e.g., to measure the throughput of the sandbox and its contention under
+//   concurrency). Instead of one response per command, one line per command of the list is written once every thread is done:
+//     commandName,invocations,failures,totalMicroseconds
+//   (across all threads; failures are expected for commands that can only succeed once, e.g. DeleteViaNtCreateFile), followed by
+//     Total,invocations,failures,elapsedMicroseconds,invocationsPerSecond
+//
 // Supported commands:
 //  EnumerateWithFindFirstFileEx: Takes a path parameter to be passed to FindFirstFileEx (e.g. C:\directory\*.h to find files ending in .h under C:\directory)
 //                             Directory enumeration is exhausted via calls to FindNextFile.
@@ -22,6 +30,8 @@
 //  EnumerateFileOrDirectoryByHandle: Takes a path parameter to open (e.g. C:\directory\) and enumerates members via NtQueryDirectoryFile.
 //                             Returns 0 on success or 1 on failure (note that success is returned if enumeration proceeded, even if no matches were found or if
 //                             the search path turned out to be a file rather than a directory).
+//  ProbeWithGetFileAttributes: Takes a path parameter and probes it with GetFileAttributes. Returns 0 if it exists or 1 otherwise.
+//  ReadWithCreateFile: Takes a path parameter to an existing file, opens it and reads it to the end. Returns 0 on success or 1 on failure.
 // TODO: These functions should be exposed as a Bond service. For now, we're starting with a trivial text format.
 
 #include "stdafx.h"
@@ -135,23 +145,124 @@ bool DeleteViaNtCreateFile(std::wstring const& path) {
     }
 }
 
+bool ProbeWithGetFileAttributes(std::wstring const& path) {
+    return GetFileAttributesW(path.c_str()) != INVALID_FILE_ATTRIBUTES;
+}
+
+bool ReadWithCreateFile(std::wstring const& path) {
+    HANDLE handle = CreateFileW(
+        path.c_str(),
+        GENERIC_READ,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        nullptr,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL,
+        NULL);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    char buffer[4096];
+    DWORD bytesRead = 0;
+    BOOL success;
+    while ((success = ReadFile(handle, buffer, sizeof(buffer), &bytesRead, nullptr)) && bytesRead != 0) {}
+
+    CloseHandle(handle);
+    return success == TRUE;
+}
+
 static CommandBase const* Commands[] = {
     new Command<SingleParam>(L"EnumerateWithFindFirstFileEx", EnumerateWithFindFirstFileEx),
     new Command<SingleParam>(L"EnumerateFileOrDirectoryByHandle", EnumerateFileOrDirectoryByHandle),
     new Command<SingleParam>(L"DeleteViaNtCreateFile", DeleteViaNtCreateFile),
     new Command<DualParam>(L"CreateHardLink", CreateHardLink),
+    new Command<SingleParam>(L"ProbeWithGetFileAttributes", ProbeWithGetFileAttributes),
+    new Command<SingleParam>(L"ReadWithCreateFile", ReadWithCreateFile),
     nullptr
 };
 
+// Splits a command line into its name and parameters.
+static std::vector<std::wstring> ParseCommandLine(std::wstring const& line) {
+    std::vector<std::wstring> parameters;
+    wchar_t const* tokenStart = line.c_str();
+    wchar_t const* tokenEnd = tokenStart;
+
+    for ( ; ; ) {
+        wchar_t c = *tokenEnd;
+        if (c == L',' || c == L'\0') {
+            parameters.push_back(
+                std::wstring(tokenStart, tokenEnd));
+
+            if (c == L'\0') { break; }
+
+            tokenEnd = tokenStart = tokenEnd + 1;
+        }
+        else {
+            tokenEnd++;
+        }
+    }
+
+    return parameters;
+}
+
+// A command of the list run in load mode, with the totals of its invocations.
+struct LoadCommand {
+    std::vector<std::wstring> parameters;
+    CommandBase const* command;
+    std::atomic<unsigned long long> invocations;
+    std::atomic<unsigned long long> failures;
+    std::atomic<unsigned long long> totalMicroseconds;
+
+    LoadCommand(std::vector<std::wstring> const& parameters, CommandBase const* command)
+        : parameters(parameters), command(command), invocations(0), failures(0), totalMicroseconds(0) {}
+};
+
+static void RunLoad(std::vector<std::unique_ptr<LoadCommand>> const& commands, unsigned long repeat) {
+    for (unsigned long i = 0; i < repeat; i++) {
+        for (auto const& loadCommand : commands) {
+            auto start = std::chrono::steady_clock::now();
+            CommandInvocationResult result = loadCommand->command->InvokeIfMatches(loadCommand->parameters);
+            auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+            loadCommand->invocations++;
+            loadCommand->totalMicroseconds += static_cast<unsigned long long>(elapsed.count());
+            if (result != Success) {
+                loadCommand->failures++;
+            }
+        }
+    }
+}
+
+// Returns whether 'argument' is the option 'name' followed by a positive number, which is then stored in 'value'.
+static bool TryParseCountOption(char const* argument, char const* name, unsigned long& value) {
+    size_t nameLength = strlen(name);
+    if (_strnicmp(argument, name, nameLength) != 0) {
+        return false;
+    }
+
+    char* end = nullptr;
+    value = strtoul(argument + nameLength, &end, 10);
+    return end != argument + nameLength && *end == '\0' && value > 0;
+}
+
 int main(int argc, char **argv)
 {
-    (void)argv; // Unused
+    unsigned long repeat = 0;
+    unsigned long threadCount = 1;
+    for (int i = 1; i < argc; i++) {
+        if (!TryParseCountOption(argv[i], "/repeat:", repeat) && !TryParseCountOption(argv[i], "/threads:", threadCount)) {
+            std::wcerr << L"Unexpected argument. Expected none (API commands are expected over stdin), or /repeat:N [/threads:T] for load mode." << std::endl;
+            return 1;
+        }
+    }
 
-    if (argc != 1) {
-        std::wcerr << L"No arguments expected. API commands are expected over stdin." << std::endl;
+    if (threadCount > 1 && repeat == 0) {
+        std::wcerr << L"/threads requires /repeat." << std::endl;
         return 1;
     }
 
+    std::vector<std::unique_ptr<LoadCommand>> loadCommands;
+
     std::wstring lineBuffer{};
     std::wcin.exceptions(std::ios_base::badbit);
     
@@ -169,27 +280,7 @@ int main(int argc, char **argv)
             }
         }
 
-        std::vector<std::wstring> parameters;
-        {
-            wchar_t const* tokenStart = lineBuffer.c_str();
-            wchar_t const* tokenEnd = tokenStart;
-
-            for ( ; ; ) {
-                wchar_t c = *tokenEnd;
-                if (c == L',' || c == L'\0') {
-                    parameters.push_back(
-                        std::wstring(tokenStart, tokenEnd));
-
-                    if (c == L'\0') { break; }
-
-                    tokenEnd = tokenStart = tokenEnd + 1;
-                }
-                else {
-                    tokenEnd++;
-                }
-            }
-        }
-
+        std::vector<std::wstring> parameters = ParseCommandLine(lineBuffer);
         if (parameters.size() == 0 || parameters[0].length() == 0) {
             std::wcerr << L"Bad command format. Expected commandName,parameter,parameter ; zero or more parameters separated by commas. Actual: '" << lineBuffer << "'" << std::endl;
             return 2;
@@ -199,12 +290,28 @@ int main(int argc, char **argv)
         for (CommandBase const** c = Commands; ; c++) {
             CommandBase const* cmd = *c;
             if (cmd == nullptr) {
-                std::wcerr << L"Unknown command name. Supported: [EnumerateWithFindFirstFileEx, DeleteViaNtCreateFile, CreateHardLink]. Actual: '" << commandName << "'" << std::endl;
+                std::wcerr << L"Unknown command name. Supported: [EnumerateWithFindFirstFileEx, EnumerateFileOrDirectoryByHandle, DeleteViaNtCreateFile, CreateHardLink, ProbeWithGetFileAttributes, ReadWithCreateFile]. Actual: '" << commandName << "'" << std::endl;
                 return 3;
             } 
 
             bool handled = false;
-            CommandInvocationResult result = cmd->InvokeIfMatches(parameters);
+            CommandInvocationResult result = CommandNameDoesNotMatch;
+            if (repeat > 0) {
+                // only check the command and its parameters now: it runs once the whole list is read
+                if (cmd->commandName == commandName) {
+                    if (cmd->requiredParameters + 1 != parameters.size()) {
+                        result = IncorrectParameterCount;
+                    }
+                    else {
+                        loadCommands.push_back(std::make_unique<LoadCommand>(parameters, cmd));
+                        break;
+                    }
+                }
+            }
+            else {
+                result = cmd->InvokeIfMatches(parameters);
+            }
+
             switch (result) {
             case Success:
                 handled = true;
@@ -230,5 +337,33 @@ int main(int argc, char **argv)
         }
     }
 
+    if (repeat > 0) {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for (unsigned long i = 1; i < threadCount; i++) {
+            threads.emplace_back(RunLoad, std::cref(loadCommands), repeat);
+        }
+
+        RunLoad(loadCommands, repeat);
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+
+        unsigned long long invocations = 0;
+        unsigned long long failures = 0;
+        for (auto const& loadCommand : loadCommands) {
+            std::wcout << loadCommand->parameters[0] << L"," << loadCommand->invocations.load() << L"," << loadCommand->failures.load() << L","
+                       << loadCommand->totalMicroseconds.load() << std::endl;
+            invocations += loadCommand->invocations.load();
+            failures += loadCommand->failures.load();
+        }
+
+        long long elapsedMicroseconds = elapsed.count() > 0 ? elapsed.count() : 1;
+        std::wcout << L"Total," << invocations << L"," << failures << L"," << elapsedMicroseconds << L","
+                   << (invocations * 1000000ULL / static_cast<unsigned long long>(elapsedMicroseconds)) << std::endl;
+    }
+
     return 0;
 }
@@ -34,11 +34,17 @@
 #include <winternl.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 #include <string>
 #include <vector>
 #include <memory>
 #include <iostream>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
 #pragma warning( pop )
 
 // These are taken from ntifs.h in the DDK. Ideally we could include it directly via DDK package.
@@ -0,0 +1,107 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+using System;
+using System.IO;
+using System.Runtime.InteropServices;
+using BuildXL.Cache.ContentStore.Hashing;
+using BuildXL.Utilities;
+using Test.BuildXL.TestUtilities.Xunit;
+using Xunit;
+using Xunit.Abstractions;
+
+namespace Test.BuildXL.Processes
+{
+    /// <summary>
+    /// Tests for the hashes the Linux sandbox computes for the outputs of pips while they are written (see output_hasher.hpp)
+    /// </summary>
+    [Trait("Category", "SandboxedLinuxOutputHasherTest")]
+    [TestClassIfSupported(requiresUnixBasedOperatingSystem: true)]
+    public sealed class SandboxedLinuxOutputHasherTest : TemporaryStorageTestBase
+    {
+        private const string LibBxlUtils = "libBxlUtils";
+        private const int HashSize = 32;
+        private const int PageSize = 64 * 1024;
+        private const int BlockSize = 2 * 1024 * 1024;
+        private static readonly UIntPtr s_noSeek = new UIntPtr(ulong.MaxValue);
+
+        // CODESYNC: Public/Src/Sandbox/Linux/test_exports.cpp
+        [DllImport(LibBxlUtils, EntryPoint = "hash_output_for_test")]
+        [return: MarshalAs(UnmanagedType.U1)]
+        private static extern bool HashOutput(
+            [MarshalAs(UnmanagedType.LPStr)] string path,
+            byte[] data,
+            UIntPtr length,
+            UIntPtr chunkLength,
+            UIntPtr seekAt,
+            [MarshalAs(UnmanagedType.U1)] bool rewrite,
+            byte[] hash);
+
+        public SandboxedLinuxOutputHasherTest(ITestOutputHelper output) : base(output)
+        {
+        }
+
+        [Theory]
+        [InlineData(0)]
+        [InlineData(1)]
+        [InlineData(PageSize)]
+        [InlineData(BlockSize)]
+        [InlineData(BlockSize + 1)]
+        [InlineData(2 * BlockSize)]
+        [InlineData(2 * BlockSize + PageSize + 7)]
+        public void HashMatchesVsoHash(int length)
+        {
+            if (!OperatingSystemHelper.IsLinuxOS)
+            {
+                return;
+            }
+
+            var data = RandomBytes(length);
+            var expected = VsoHash.CalculateBlobIdentifier(data).AlgorithmResultBytes;
+
+            // writes that straddle pages and blocks, as well as writes larger than a block
+            foreach (int chunkLength in new[] { 4096, 1000003, BlockSize + 1 })
+            {
+                var hash = new byte[HashSize];
+                XAssert.IsTrue(HashOutput(OutputPath(), data, (UIntPtr)(uint)length, (UIntPtr)(uint)chunkLength, s_noSeek, rewrite: false, hash));
+                XAssert.AreArraysEqual(expected, hash, true, $"length: {length}, chunk length: {chunkLength}");
+            }
+        }
+
+        [Theory]
+        [InlineData(1, 0)]
+        [InlineData(PageSize, PageSize / 2)]
+        [InlineData(BlockSize + 1, BlockSize)]
+        public void SeekedOutputIsNotReported(int length, int seekAt)
+        {
+            if (!OperatingSystemHelper.IsLinuxOS)
+            {
+                return;
+            }
+
+            XAssert.IsFalse(HashOutput(OutputPath(), RandomBytes(length), (UIntPtr)(uint)length, (UIntPtr)4096u, (UIntPtr)(uint)seekAt, rewrite: false, new byte[HashSize]));
+        }
+
+        [Theory]
+        [InlineData(2)]
+        [InlineData(BlockSize + 1)]
+        public void RewrittenOutputIsNotReported(int length)
+        {
+            if (!OperatingSystemHelper.IsLinuxOS)
+            {
+                return;
+            }
+
+            XAssert.IsFalse(HashOutput(OutputPath(), RandomBytes(length), (UIntPtr)(uint)length, (UIntPtr)4096u, s_noSeek, rewrite: true, new byte[HashSize]));
+        }
+
+        private string OutputPath() => Path.Combine(TemporaryDirectory, "output");
+
+        private static byte[] RandomBytes(int length)
+        {
+            var data = new byte[length];
+            new Random(length).NextBytes(data);
+            return data;
+        }
+    }
+}
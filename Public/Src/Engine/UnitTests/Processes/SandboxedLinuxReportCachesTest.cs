@@ -0,0 +1,439 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+using System;
+using System.IO;
+using System.Linq;
+using System.Runtime.InteropServices;
+using BuildXL.Processes;
+using BuildXL.Utilities;
+using Test.BuildXL.TestUtilities.Xunit;
+using Xunit;
+using Xunit.Abstractions;
+
+namespace Test.BuildXL.Processes
+{
+    /// <summary>
+    /// Tests for what the Linux sandbox remembers about the accesses it reported, to not report them again (see report_cache.hpp),
+    /// and about the fds it reported accesses through (see fd_table.hpp); as well as what the processes of a pip share about the
+    /// accesses any of them reported (see shared_report_cache.hpp)
+    /// </summary>
+    /// <remarks>
+    /// The caches of libBxlUtils.so the tests use are process-wide: every test works on paths of its own (under <see cref="m_root"/>).
+    /// </remarks>
+    [Trait("Category", "SandboxedLinuxReportCachesTest")]
+    [TestClassIfSupported(requiresUnixBasedOperatingSystem: true)]
+    public sealed class SandboxedLinuxReportCachesTest : TemporaryStorageTestBase
+    {
+        private const string LibBxlUtils = "libBxlUtils";
+
+        // CODESYNC: es_event_type_t in Public/Src/Sandbox/Linux/stdafx-linux.h
+        private const uint KindOpen = 10;
+        private const uint KindStat = 54;
+
+        // CODESYNC: Public/Src/Sandbox/Linux/fd_table.hpp
+        private const int FdTablePageSize = 1 << 10;
+        private const int FdTableMaxFd = FdTablePageSize * (1 << 10) - 1;
+
+        // CODESYNC: Public/Src/Engine/Processes/SandboxConnectionLinuxDetours.cs (CreateSharedReportCacheFile)
+        private const int SharedReportCacheHeaderSize = 64;
+        private const int SharedReportCacheSlotCount = 1 << 17;
+
+        private readonly string m_root = "/" + Guid.NewGuid().ToString();
+
+        // CODESYNC: Public/Src/Sandbox/Linux/test_exports.cpp
+        [DllImport(LibBxlUtils, EntryPoint = "report_cache_check_and_add_for_test")]
+        [return: MarshalAs(UnmanagedType.U1)]
+        private static extern bool ReportCacheCheckAndAdd(uint owner, uint kind, [MarshalAs(UnmanagedType.LPStr)] string path);
+
+        [DllImport(LibBxlUtils, EntryPoint = "report_cache_clear_for_test")]
+        private static extern void ReportCacheClear();
+
+        [DllImport(LibBxlUtils, EntryPoint = "fd_table_get_for_test")]
+        private static extern IntPtr FdTableGet(int fd, out UIntPtr length);
+
+        [DllImport(LibBxlUtils, EntryPoint = "fd_table_set_for_test")]
+        private static extern void FdTableSet(int fd, [MarshalAs(UnmanagedType.LPStr)] string path);
+
+        [DllImport(LibBxlUtils, EntryPoint = "fd_table_reset_for_test")]
+        private static extern void FdTableReset(int fd);
+
+        [DllImport(LibBxlUtils, EntryPoint = "fd_table_reset_range_for_test")]
+        private static extern void FdTableResetRange(uint first, uint last);
+
+        [DllImport(LibBxlUtils, EntryPoint = "fd_table_mark_write_reported_for_test")]
+        private static extern void FdTableMarkWriteReported(int fd);
+
+        [DllImport(LibBxlUtils, EntryPoint = "fd_table_is_write_reported_for_test")]
+        [return: MarshalAs(UnmanagedType.U1)]
+        private static extern bool FdTableIsWriteReported(int fd);
+
+        [DllImport(LibBxlUtils, EntryPoint = "fd_table_clear_write_reported_for_test")]
+        private static extern void FdTableClearWriteReported();
+
+        [DllImport(LibBxlUtils, EntryPoint = "shared_report_cache_add_for_test")]
+        [return: MarshalAs(UnmanagedType.U1)]
+        private static extern bool SharedReportCacheAdd(
+            [MarshalAs(UnmanagedType.LPStr)] string cachePath,
+            [MarshalAs(UnmanagedType.LPStr)] string programPath,
+            uint kind,
+            [MarshalAs(UnmanagedType.LPStr)] string path);
+
+        [DllImport(LibBxlUtils, EntryPoint = "shared_report_cache_contains_for_test")]
+        [return: MarshalAs(UnmanagedType.U1)]
+        private static extern bool SharedReportCacheContains(
+            [MarshalAs(UnmanagedType.LPStr)] string cachePath,
+            [MarshalAs(UnmanagedType.LPStr)] string programPath,
+            uint kind,
+            [MarshalAs(UnmanagedType.LPStr)] string path);
+
+        public SandboxedLinuxReportCachesTest(ITestOutputHelper output) : base(output)
+        {
+        }
+
+        [Fact]
+        public void ReportCacheHitsOnlyTheSameAccess()
+        {
+            if (!OperatingSystemHelper.IsLinuxOS)
+            {
+                return;
+            }
+
+            string path = m_root + "/dir/file";
+            XAssert.IsFalse(ReportCacheCheckAndAdd(0, KindOpen, path));
+            XAssert.IsTrue(ReportCacheCheckAndAdd(0, KindOpen, path));
+
+            // another kind of access, another process (reported on behalf of, see seccomp_supervisor.hpp), or another path
+            XAssert.IsFalse(ReportCacheCheckAndAdd(0, KindStat, path));
+            XAssert.IsFalse(ReportCacheCheckAndAdd(1234, KindOpen, path));
+            XAssert.IsFalse(ReportCacheCheckAndAdd(0, KindOpen, path + "2"));
+            XAssert.IsFalse(ReportCacheCheckAndAdd(0, KindOpen, path + "/"));
+            XAssert.IsFalse(ReportCacheCheckAndAdd(0, KindOpen, m_root + "/dir/fil"));
+
+            // each of which is remembered on its own
+            XAssert.IsTrue(ReportCacheCheckAndAdd(0, KindStat, path));
+            XAssert.IsTrue(ReportCacheCheckAndAdd(1234, KindOpen, path));
+            XAssert.IsTrue(ReportCacheCheckAndAdd(0, KindOpen, path + "2"));
+            XAssert.IsTrue(ReportCacheCheckAndAdd(0, KindOpen, path));
+        }
+
+        [Fact]
+        public void ReportCacheRemembersManyAccesses()
+        {
+            if (!OperatingSystemHelper.IsLinuxOS)
+            {
+                return;
+            }
+
+            // well within what the cache holds, but enough for many probe sequences to run into each other
+            const int Count = 20000;
+            for (int i = 0; i < Count; i++)
+            {
+                XAssert.IsFalse(ReportCacheCheckAndAdd(0, KindOpen, $"{m_root}/{i}"));
+            }
+
+            for (int i = 0; i < Count; i++)
+            {
+                XAssert.IsTrue(ReportCacheCheckAndAdd(0, KindOpen, $"{m_root}/{i}"), $"{i}");
+            }
+        }
+
+        [Fact]
+        public void ReportCacheForgetsEverythingWhenCleared()
+        {
+            if (!OperatingSystemHelper.IsLinuxOS)
+            {
+                return;
+            }
+
+            string path = m_root + "/file";
+            XAssert.IsFalse(ReportCacheCheckAndAdd(0, KindOpen, path));
+            ReportCacheClear();
+            XAssert.IsFalse(ReportCacheCheckAndAdd(0, KindOpen, path));
+            XAssert.IsTrue(ReportCacheCheckAndAdd(0, KindOpen, path));
+
+            // entries of a generation that comes around again after the generation counter wraps must not come back to life
+            for (int i = 0; i < 256; i++)
+            {
+                ReportCacheClear();
+            }
+
+            XAssert.IsFalse(ReportCacheCheckAndAdd(0, KindOpen, path));
+            XAssert.IsTrue(ReportCacheCheckAndAdd(0, KindOpen, path));
+        }
+
+        [Fact]
+        public void FdTableCachesPathsOfAnyFdInRange()
+        {
+            if (!OperatingSystemHelper.IsLinuxOS)
+            {
+                return;
+            }
+
+            FdTableResetRange(0, uint.MaxValue);
+
+            // fds on either side of page boundaries, and the last fd of the table
+            var fds = new[] { 0, 3, FdTablePageSize - 1, FdTablePageSize, 100000, FdTableMaxFd };
+            foreach (int fd in fds)
+            {
+                XAssert.IsNull(FdTableGetPath(fd));
+                FdTableSet(fd, $"{m_root}/{fd}");
+            }
+
+            foreach (int fd in fds)
+            {
+                XAssert.AreEqual($"{m_root}/{fd}", FdTableGetPath(fd));
+            }
+
+            // fds out of range are never cached
+            FdTableSet(FdTableMaxFd + 1, m_root);
+            FdTableSet(-1, m_root);
+            XAssert.IsNull(FdTableGetPath(FdTableMaxFd + 1));
+            XAssert.IsNull(FdTableGetPath(-1));
+
+            // a replaced fd gets the new path, a reset one none
+            FdTableSet(3, m_root + "/replaced");
+            XAssert.AreEqual(m_root + "/replaced", FdTableGetPath(3));
+            FdTableReset(3);
+            XAssert.IsNull(FdTableGetPath(3));
+            XAssert.AreEqual($"{m_root}/0", FdTableGetPath(0));
+        }
+
+        [Fact]
+        public void FdTablePathsAreInterned()
+        {
+            if (!OperatingSystemHelper.IsLinuxOS)
+            {
+                return;
+            }
+
+            FdTableResetRange(0, uint.MaxValue);
+
+            string path = m_root + "/shared";
+            FdTableSet(10, path);
+            FdTableSet(20000, path);
+            FdTableSet(11, path + "2");
+
+            XAssert.AreEqual(FdTableGet(10, out _), FdTableGet(20000, out _));
+            XAssert.AreNotEqual(FdTableGet(10, out _), FdTableGet(11, out _));
+
+            // an interned path outlives the fds it was cached for
+            IntPtr interned = FdTableGet(10, out _);
+            FdTableResetRange(0, uint.MaxValue);
+            FdTableSet(12, path);
+            XAssert.AreEqual(interned, FdTableGet(12, out _));
+            XAssert.AreEqual(path, Marshal.PtrToStringUTF8(interned));
+        }
+
+        [Fact]
+        public void FdTableResetRangeForgetsOnlyTheRange()
+        {
+            if (!OperatingSystemHelper.IsLinuxOS)
+            {
+                return;
+            }
+
+            FdTableResetRange(0, uint.MaxValue);
+
+            // spanning pages that were never created (as by close_range over all fds)
+            var kept = new[] { 4, 3 * FdTablePageSize + 1, FdTableMaxFd };
+            var reset = new[] { 5, FdTablePageSize, 3 * FdTablePageSize };
+            foreach (int fd in kept.Concat(reset))
+            {
+                FdTableSet(fd, $"{m_root}/{fd}");
+            }
+
+            FdTableResetRange(5, 3 * FdTablePageSize);
+            foreach (int fd in kept)
+            {
+                XAssert.AreEqual($"{m_root}/{fd}", FdTableGetPath(fd));
+            }
+
+            foreach (int fd in reset)
+            {
+                XAssert.IsNull(FdTableGetPath(fd), $"{fd}");
+            }
+
+            FdTableResetRange(5, uint.MaxValue);
+            XAssert.AreEqual($"{m_root}/4", FdTableGetPath(4));
+            XAssert.IsNull(FdTableGetPath(FdTableMaxFd));
+        }
+
+        [Fact]
+        public void FdTableWriteReportedGoesAwayWithThePath()
+        {
+            if (!OperatingSystemHelper.IsLinuxOS)
+            {
+                return;
+            }
+
+            FdTableResetRange(0, uint.MaxValue);
+
+            // nothing to flag if no path is cached
+            FdTableMarkWriteReported(7);
+            XAssert.IsFalse(FdTableIsWriteReported(7));
+
+            string path = m_root + "/written";
+            FdTableSet(7, path);
+            FdTableSet(8, path);
+            FdTableMarkWriteReported(7);
+            XAssert.IsTrue(FdTableIsWriteReported(7));
+            XAssert.IsFalse(FdTableIsWriteReported(8));
+            XAssert.AreEqual(path, FdTableGetPath(7));
+
+            // replacing the fd (e.g., dup2 over it) or closing it drops the flag
+            FdTableSet(7, path);
+            XAssert.IsFalse(FdTableIsWriteReported(7));
+            FdTableMarkWriteReported(7);
+            FdTableReset(7);
+            XAssert.IsFalse(FdTableIsWriteReported(7));
+
+            // as does a fork, without dropping the paths
+            FdTableSet(7, path);
+            FdTableMarkWriteReported(7);
+            FdTableMarkWriteReported(8);
+            FdTableClearWriteReported();
+            XAssert.IsFalse(FdTableIsWriteReported(7));
+            XAssert.IsFalse(FdTableIsWriteReported(8));
+            XAssert.AreEqual(path, FdTableGetPath(7));
+            XAssert.AreEqual(path, FdTableGetPath(8));
+        }
+
+        [Fact]
+        public void SharedReportCacheIsSharedByProcessesOfTheSameProgram()
+        {
+            if (!OperatingSystemHelper.IsLinuxOS)
+            {
+                return;
+            }
+
+            // every call maps the file anew, as the processes of a pip do
+            string cache = CreateSharedReportCache();
+            XAssert.IsFalse(SharedReportCacheContains(cache, "/usr/bin/cc", KindOpen, "/src/a.c"));
+            XAssert.IsTrue(SharedReportCacheAdd(cache, "/usr/bin/cc", KindOpen, "/src/a.c"));
+            XAssert.IsTrue(SharedReportCacheContains(cache, "/usr/bin/cc", KindOpen, "/src/a.c"));
+
+            // adding again changes nothing
+            XAssert.IsTrue(SharedReportCacheAdd(cache, "/usr/bin/cc", KindOpen, "/src/a.c"));
+            XAssert.IsTrue(SharedReportCacheContains(cache, "/usr/bin/cc", KindOpen, "/src/a.c"));
+
+            // another kind of access or another path
+            XAssert.IsFalse(SharedReportCacheContains(cache, "/usr/bin/cc", KindStat, "/src/a.c"));
+            XAssert.IsFalse(SharedReportCacheContains(cache, "/usr/bin/cc", KindOpen, "/src/a.cc"));
+            XAssert.IsFalse(SharedReportCacheContains(cache, "/usr/bin/cc", KindOpen, "/src/a."));
+
+            // the set lives in the file: another file knows nothing of it
+            XAssert.IsFalse(SharedReportCacheContains(CreateSharedReportCache(), "/usr/bin/cc", KindOpen, "/src/a.c"));
+        }
+
+        [Fact]
+        public void SharedReportCacheIsNotSharedByDifferentPrograms()
+        {
+            if (!OperatingSystemHelper.IsLinuxOS)
+            {
+                return;
+            }
+
+            // policies may depend on the executable, so the access of one program must still be reported for any other one
+            string cache = CreateSharedReportCache();
+            XAssert.IsTrue(SharedReportCacheAdd(cache, "/usr/bin/cc", KindOpen, "/src/a.c"));
+            XAssert.IsFalse(SharedReportCacheContains(cache, "/usr/bin/ld", KindOpen, "/src/a.c"));
+            XAssert.IsFalse(SharedReportCacheContains(cache, "/usr/bin/c", KindOpen, "/src/a.c"));
+            XAssert.IsFalse(SharedReportCacheContains(cache, "/usr/bin/cc2", KindOpen, "/src/a.c"));
+
+            XAssert.IsTrue(SharedReportCacheAdd(cache, "/usr/bin/ld", KindOpen, "/src/a.c"));
+            XAssert.IsTrue(SharedReportCacheContains(cache, "/usr/bin/ld", KindOpen, "/src/a.c"));
+            XAssert.IsTrue(SharedReportCacheContains(cache, "/usr/bin/cc", KindOpen, "/src/a.c"));
+        }
+
+        [Fact]
+        public void SharedReportCacheRemembersManyAccesses()
+        {
+            if (!OperatingSystemHelper.IsLinuxOS)
+            {
+                return;
+            }
+
+            const int Count = 20000;
+            string cache = CreateSharedReportCache();
+            for (int i = 0; i < Count; i++)
+            {
+                XAssert.IsTrue(SharedReportCacheAdd(cache, "/usr/bin/cc", KindOpen, $"/src/{i}"));
+            }
+
+            for (int i = 0; i < Count; i++)
+            {
+                XAssert.IsTrue(SharedReportCacheContains(cache, "/usr/bin/cc", KindOpen, $"/src/{i}"), $"{i}");
+            }
+        }
+
+        [Fact]
+        public void SharedReportCacheThatIsNotValidIsNotUsed()
+        {
+            if (!OperatingSystemHelper.IsLinuxOS)
+            {
+                return;
+            }
+
+            // wrong magic
+            string cache = CreateSharedReportCache();
+            using (var stream = new FileStream(cache, FileMode.Open, FileAccess.Write))
+            {
+                stream.WriteByte(0);
+            }
+
+            XAssert.IsFalse(SharedReportCacheAdd(cache, "/usr/bin/cc", KindOpen, "/src/a.c"));
+
+            // truncated
+            cache = CreateSharedReportCache();
+            using (var stream = new FileStream(cache, FileMode.Open, FileAccess.Write))
+            {
+                stream.SetLength(stream.Length - 1);
+            }
+
+            XAssert.IsFalse(SharedReportCacheAdd(cache, "/usr/bin/cc", KindOpen, "/src/a.c"));
+        }
+
+        [Fact]
+        public void SharedReportCacheIgnoresCorruptEntries()
+        {
+            if (!OperatingSystemHelper.IsLinuxOS)
+            {
+                return;
+            }
+
+            // any process of the pip can write anything to the file: entries pointing outside of the arena must not be followed
+            string cache = CreateSharedReportCache();
+            using (var stream = new FileStream(cache, FileMode.Open, FileAccess.Write))
+            {
+                stream.Seek(SharedReportCacheHeaderSize, SeekOrigin.Begin);
+                var garbage = new byte[SharedReportCacheSlotCount * sizeof(ulong)];
+                Array.Fill(garbage, (byte)0xff);
+                stream.Write(garbage, 0, garbage.Length);
+            }
+
+            XAssert.IsTrue(SharedReportCacheAdd(cache, "/usr/bin/cc", KindOpen, "/src/a.c"));
+            XAssert.IsFalse(SharedReportCacheContains(cache, "/usr/bin/cc", KindOpen, "/src/a.c"));
+        }
+
+        private string CreateSharedReportCache()
+        {
+            string path = Path.Combine(TemporaryDirectory, Guid.NewGuid().ToString() + ".rcache");
+            SandboxConnectionLinuxDetours.CreateSharedReportCacheFile(path);
+            return path;
+        }
+
+        private static string FdTableGetPath(int fd)
+        {
+            IntPtr path = FdTableGet(fd, out UIntPtr length);
+            if (path == IntPtr.Zero)
+            {
+                return null;
+            }
+
+            string result = Marshal.PtrToStringUTF8(path);
+            XAssert.AreEqual((ulong)result.Length, length.ToUInt64());
+            return result;
+        }
+    }
+}
@@ -0,0 +1,224 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+using System;
+using System.Buffers.Binary;
+using System.Linq;
+using System.Runtime.InteropServices;
+using System.Text;
+using BuildXL.Processes;
+using BuildXL.Utilities;
+using Test.BuildXL.TestUtilities.Xunit;
+using Xunit;
+using Xunit.Abstractions;
+
+namespace Test.BuildXL.Processes
+{
+    /// <summary>
+    /// Tests for how the binary reports of the Linux sandbox are framed (see report_format.hpp): the records the native side makes
+    /// must read back as they were made, anything else must be rejected, and records split across packets must be put back together.
+    /// </summary>
+    [Trait("Category", "SandboxedLinuxReportFramingTest")]
+    [TestClassIfSupported(requiresUnixBasedOperatingSystem: true)]
+    public sealed class SandboxedLinuxReportFramingTest : XunitBuildXLTest
+    {
+        private const string LibBxlUtils = "libBxlUtils";
+
+        // CODESYNC: Public/Src/Sandbox/Linux/report_format.hpp
+        private const int MaxPacketPayloadLength = 4096 - 12;
+
+        // CODESYNC: Public/Src/Sandbox/Linux/test_exports.cpp
+        [DllImport(LibBxlUtils, EntryPoint = "make_report_record_for_test")]
+        private static extern UIntPtr MakeReportRecord(
+            ushort kind,
+            uint pid,
+            uint operation,
+            uint processNameId,
+            [MarshalAs(UnmanagedType.U1)] bool timed,
+            ulong timestamp,
+            ulong sequenceNumber,
+            byte[] payload,
+            UIntPtr payloadLength,
+            byte[] buffer,
+            UIntPtr bufferSize);
+
+        public SandboxedLinuxReportFramingTest(ITestOutputHelper output) : base(output)
+        {
+        }
+
+        [Theory]
+        [InlineData(AccessReportRecord.KindAccess, false, 0)]
+        [InlineData(AccessReportRecord.KindAccess, false, 17)]
+        [InlineData(AccessReportRecord.KindAccess, true, 17)]
+        [InlineData(AccessReportRecord.KindProcessName, false, 9)]
+        [InlineData(AccessReportRecord.KindAccess, false, 3 * MaxPacketPayloadLength + 5)]
+        [InlineData(AccessReportRecord.KindAccess, true, 3 * MaxPacketPayloadLength + 5)]
+        public void RecordRoundTrips(ushort kind, bool timed, int payloadLength)
+        {
+            if (!OperatingSystemHelper.IsLinuxOS)
+            {
+                return;
+            }
+
+            string payload = Payload(payloadLength);
+            byte[] record = MakeRecord(kind, pid: 1234, operation: 7, processNameId: 3, timed, payload);
+
+            // followed by another record, which must not be read as part of the first one
+            byte[] next = MakeRecord(AccessReportRecord.KindAccess, pid: 1235, operation: 1, processNameId: 0, timed: false, "/next");
+            byte[] bytes = record.Concat(next).ToArray();
+
+            XAssert.IsTrue(AccessReportRecord.TryRead(bytes, out var read, out string error), error);
+            XAssert.AreEqual(record.Length, read.Length);
+            XAssert.AreEqual(kind, read.Kind);
+            XAssert.AreEqual(AccessReportRecord.PlatformPosix, read.Platform);
+            XAssert.AreEqual(1234u, read.ProcessId);
+            XAssert.AreEqual(7u, read.Operation);
+            XAssert.AreEqual(3u, read.ProcessNameId);
+            XAssert.AreEqual(timed, read.IsTimed);
+            XAssert.AreEqual(timed ? 42ul : 0ul, read.Timestamp);
+            XAssert.AreEqual(timed ? 5ul : 0ul, read.SequenceNumber);
+            XAssert.AreEqual(payloadLength, read.PayloadLength);
+            XAssert.AreEqual(payload, read.GetPayloadString());
+
+            XAssert.IsTrue(AccessReportRecord.TryRead(bytes.AsSpan(read.Length), out var second, out error), error);
+            XAssert.AreEqual(1235u, second.ProcessId);
+            XAssert.AreEqual("/next", second.GetPayloadString());
+        }
+
+        [Theory]
+        [InlineData(false)]
+        [InlineData(true)]
+        public void TruncatedRecordIsRejected(bool timed)
+        {
+            if (!OperatingSystemHelper.IsLinuxOS)
+            {
+                return;
+            }
+
+            byte[] record = MakeRecord(AccessReportRecord.KindAccess, pid: 1, operation: 1, processNameId: 0, timed, Payload(100));
+            for (int length = 0; length < record.Length; length++)
+            {
+                XAssert.IsFalse(AccessReportRecord.TryRead(record.AsSpan(0, length), out _, out string error), $"{length} bytes out of {record.Length}");
+                XAssert.IsNotNull(error);
+            }
+        }
+
+        [Fact]
+        public void CorruptRecordIsRejected()
+        {
+            if (!OperatingSystemHelper.IsLinuxOS)
+            {
+                return;
+            }
+
+            byte[] record = MakeRecord(AccessReportRecord.KindAccess, pid: 1, operation: 1, processNameId: 0, timed: false, Payload(100));
+            XAssert.IsTrue(AccessReportRecord.TryRead(record, out _, out string error), error);
+
+            // unsupported version
+            AssertRejected(record, bytes => BinaryPrimitives.WriteUInt16LittleEndian(bytes.AsSpan(4), AccessReportRecord.Version + 1));
+
+            // payload overlapping the header
+            AssertRejected(record, bytes => BinaryPrimitives.WriteUInt16LittleEndian(bytes.AsSpan(6), AccessReportRecord.MinHeaderSize - 1));
+
+            // timed, but the header has no room for the timing
+            AssertRejected(record, bytes => bytes[11] |= 0x4);
+
+            // payload past the end of the record
+            AssertRejected(record, bytes => BinaryPrimitives.WriteUInt32LittleEndian(bytes.AsSpan(48), 101));
+
+            // record past the end of the bytes
+            AssertRejected(record, bytes => BinaryPrimitives.WriteUInt32LittleEndian(bytes.AsSpan(0), (uint)bytes.Length + 1));
+        }
+
+        [Fact]
+        public void InterleavedFragmentsAreReassembledByWriter()
+        {
+            if (!OperatingSystemHelper.IsLinuxOS)
+            {
+                return;
+            }
+
+            var pool = new ArrayPool<byte>(4096);
+            using var fragments = new SandboxConnectionLinuxDetours.PacketFragments(pool);
+
+            // two records that do not fit in a packet, from writers 1 and 2, whose fragments arrive interleaved (as they would through
+            // the FIFO); writer 3 sends whole packets in between
+            byte[] first = MakeRecord(AccessReportRecord.KindAccess, pid: 10, operation: 1, processNameId: 0, timed: false, Payload(2 * MaxPacketPayloadLength));
+            byte[] second = MakeRecord(AccessReportRecord.KindAccess, pid: 20, operation: 2, processNameId: 0, timed: true, Payload(3 * MaxPacketPayloadLength + 1));
+            byte[] whole = MakeRecord(AccessReportRecord.KindAccess, pid: 30, operation: 3, processNameId: 0, timed: false, "/whole");
+
+            var firstPackets = Split(first);
+            var secondPackets = Split(second);
+            XAssert.AreEqual(3, firstPackets.Length);
+            XAssert.AreEqual(4, secondPackets.Length);
+
+            XAssert.IsFalse(Add(fragments, pool, 1, firstPackets[0], moreFragments: true, out _));
+            XAssert.IsFalse(Add(fragments, pool, 2, secondPackets[0], moreFragments: true, out _));
+            XAssert.IsTrue(Add(fragments, pool, 3, whole, moreFragments: false, out var payload));
+            XAssert.AreArraysEqual(whole, payload, true);
+            XAssert.IsFalse(Add(fragments, pool, 2, secondPackets[1], moreFragments: true, out _));
+            XAssert.IsFalse(Add(fragments, pool, 1, firstPackets[1], moreFragments: true, out _));
+            XAssert.IsFalse(Add(fragments, pool, 2, secondPackets[2], moreFragments: true, out _));
+            XAssert.AreEqual(2, fragments.PendingCount);
+
+            XAssert.IsTrue(Add(fragments, pool, 1, firstPackets[2], moreFragments: false, out payload));
+            XAssert.AreArraysEqual(first, payload, true);
+            XAssert.IsTrue(AccessReportRecord.TryRead(payload, out var record, out string error), error);
+            XAssert.AreEqual(10u, record.ProcessId);
+
+            XAssert.IsTrue(Add(fragments, pool, 3, whole, moreFragments: false, out payload));
+            XAssert.AreArraysEqual(whole, payload, true);
+
+            XAssert.IsTrue(Add(fragments, pool, 2, secondPackets[3], moreFragments: false, out payload));
+            XAssert.AreArraysEqual(second, payload, true);
+            XAssert.IsTrue(AccessReportRecord.TryRead(payload, out record, out error), error);
+            XAssert.AreEqual(20u, record.ProcessId);
+            XAssert.AreEqual(3 * MaxPacketPayloadLength + 1, record.PayloadLength);
+
+            XAssert.AreEqual(0, fragments.PendingCount);
+        }
+
+        private static void AssertRejected(byte[] record, Action<byte[]> corrupt)
+        {
+            byte[] bytes = (byte[])record.Clone();
+            corrupt(bytes);
+            XAssert.IsFalse(AccessReportRecord.TryRead(bytes, out _, out string error));
+            XAssert.IsNotNull(error);
+        }
+
+        private static bool Add(SandboxConnectionLinuxDetours.PacketFragments fragments, ArrayPool<byte> pool, uint writerId, byte[] packetPayload, bool moreFragments, out byte[] payload)
+        {
+            var payloadBytes = pool.GetInstance(packetPayload.Length);
+            Array.Copy(packetPayload, payloadBytes.Instance, packetPayload.Length);
+            int payloadLength = packetPayload.Length;
+            if (!fragments.TryComplete(writerId, moreFragments, ref payloadBytes, ref payloadLength))
+            {
+                payload = null;
+                return false;
+            }
+
+            payload = payloadBytes.Instance.Take(payloadLength).ToArray();
+            payloadBytes.Dispose();
+            return true;
+        }
+
+        /// <summary>The payloads of the packets a record is sent in when it does not fit in one</summary>
+        private static byte[][] Split(byte[] record)
+        {
+            return Enumerable.Range(0, (record.Length + MaxPacketPayloadLength - 1) / MaxPacketPayloadLength)
+                .Select(i => record.Skip(i * MaxPacketPayloadLength).Take(MaxPacketPayloadLength).ToArray())
+                .ToArray();
+        }
+
+        private static byte[] MakeRecord(ushort kind, uint pid, uint operation, uint processNameId, bool timed, string payload)
+        {
+            byte[] payloadBytes = Encoding.UTF8.GetBytes(payload);
+            byte[] buffer = new byte[payloadBytes.Length + 256];
+            int length = (int)MakeReportRecord(kind, pid, operation, processNameId, timed, 42, 5, payloadBytes, (UIntPtr)(uint)payloadBytes.Length, buffer, (UIntPtr)(uint)buffer.Length);
+            XAssert.IsTrue(length > 0);
+            return buffer.Take(length).ToArray();
+        }
+
+        private static string Payload(int length) => new string(Enumerable.Range(0, length).Select(i => (char)('a' + i % 26)).ToArray());
+    }
+}
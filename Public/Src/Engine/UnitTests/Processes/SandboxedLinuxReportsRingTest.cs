@@ -0,0 +1,196 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+using System;
+using System.Diagnostics;
+using System.IO;
+using System.Runtime.InteropServices;
+using System.Text;
+using System.Threading;
+using BuildXL.Processes;
+using BuildXL.Utilities;
+using Test.BuildXL.TestUtilities.Xunit;
+using Xunit;
+using Xunit.Abstractions;
+
+namespace Test.BuildXL.Processes
+{
+    /// <summary>
+    /// Tests for the shared-memory ring the Linux sandbox sends report packets through (see report_ring.hpp): the native producer
+    /// puts packets into a ring created by <see cref="SandboxConnectionLinuxDetours.ReportsRing"/>, which takes them out.
+    /// </summary>
+    [Trait("Category", "SandboxedLinuxReportsRingTest")]
+    [TestClassIfSupported(requiresUnixBasedOperatingSystem: true)]
+    public sealed class SandboxedLinuxReportsRingTest : TemporaryStorageTestBase
+    {
+        private const string LibBxlUtils = "libBxlUtils";
+        private const int SlotCount = 4;
+
+        // CODESYNC: Public/Src/Sandbox/Linux/test_exports.cpp
+        [DllImport(LibBxlUtils, EntryPoint = "ring_enqueue_for_test")]
+        [return: MarshalAs(UnmanagedType.U1)]
+        private static extern bool RingEnqueue(
+            [MarshalAs(UnmanagedType.LPStr)] string ringPath,
+            byte[] packet,
+            UIntPtr length,
+            uint claimerPid,
+            [MarshalAs(UnmanagedType.U1)] bool publish);
+
+        public SandboxedLinuxReportsRingTest(ITestOutputHelper output) : base(output)
+        {
+        }
+
+        [Fact]
+        public void PacketsWrapAround()
+        {
+            if (!OperatingSystemHelper.IsLinuxOS)
+            {
+                return;
+            }
+
+            using var ring = CreateRing();
+            var buffer = new byte[ring.SlotSize];
+
+            // every slot gets reused several times, at every offset from the start of the ring
+            for (int round = 0; round < 10; round++)
+            {
+                for (int i = 0; i < SlotCount - 1; i++)
+                {
+                    XAssert.IsTrue(Enqueue(ring, $"packet {round}.{i}"));
+                }
+
+                for (int i = 0; i < SlotCount - 1; i++)
+                {
+                    XAssert.IsTrue(ring.TryDequeue(buffer, out int length));
+                    XAssert.AreEqual($"packet {round}.{i}", Encoding.UTF8.GetString(buffer, 0, length));
+                }
+
+                XAssert.IsTrue(ring.IsEmpty);
+                XAssert.IsFalse(ring.TryDequeue(buffer, out _));
+            }
+
+            // a full ring takes no more packets until one is dequeued
+            for (int i = 0; i < SlotCount; i++)
+            {
+                XAssert.IsTrue(Enqueue(ring, $"full {i}"));
+            }
+
+            XAssert.IsFalse(Enqueue(ring, "overflow"));
+            XAssert.IsTrue(ring.TryDequeue(buffer, out int firstLength));
+            XAssert.AreEqual("full 0", Encoding.UTF8.GetString(buffer, 0, firstLength));
+            XAssert.IsTrue(Enqueue(ring, "after full"));
+
+            foreach (var expected in new[] { "full 1", "full 2", "full 3", "after full" })
+            {
+                XAssert.IsTrue(ring.TryDequeue(buffer, out int length));
+                XAssert.AreEqual(expected, Encoding.UTF8.GetString(buffer, 0, length));
+            }
+        }
+
+        [Fact]
+        public void UnpublishedSlotsAreSkippedWhenDraining()
+        {
+            if (!OperatingSystemHelper.IsLinuxOS)
+            {
+                return;
+            }
+
+            using var ring = CreateRing();
+            var buffer = new byte[ring.SlotSize];
+            uint pid = (uint)Process.GetCurrentProcess().Id;
+
+            // start off the beginning of the ring, so that the slots skipped over wrap around
+            for (int i = 0; i < SlotCount - 1; i++)
+            {
+                XAssert.IsTrue(Enqueue(ring, "warm-up"));
+                XAssert.IsTrue(ring.TryDequeue(buffer, out _));
+            }
+
+            XAssert.IsTrue(RingEnqueue(ring.Path, new byte[0], UIntPtr.Zero, pid, publish: false));
+            XAssert.IsTrue(Enqueue(ring, "after unpublished"));
+            XAssert.IsTrue(RingEnqueue(ring.Path, new byte[0], UIntPtr.Zero, pid, publish: false));
+            XAssert.IsTrue(Enqueue(ring, "last"));
+
+            // an unpublished slot holds back the ones after it...
+            XAssert.IsTrue(ring.IsEmpty);
+            XAssert.IsFalse(ring.TryDequeue(buffer, out _));
+
+            // ...until there are no producers left
+            XAssert.IsTrue(ring.TryDequeueSkippingUnpublished(buffer, out int length));
+            XAssert.AreEqual("after unpublished", Encoding.UTF8.GetString(buffer, 0, length));
+            XAssert.IsTrue(ring.TryDequeueSkippingUnpublished(buffer, out length));
+            XAssert.AreEqual("last", Encoding.UTF8.GetString(buffer, 0, length));
+            XAssert.IsFalse(ring.TryDequeueSkippingUnpublished(buffer, out _));
+
+            // the skipped slots are free again
+            for (int i = 0; i < SlotCount; i++)
+            {
+                XAssert.IsTrue(Enqueue(ring, $"reused {i}"));
+            }
+
+            for (int i = 0; i < SlotCount; i++)
+            {
+                XAssert.IsTrue(ring.TryDequeue(buffer, out length));
+                XAssert.AreEqual($"reused {i}", Encoding.UTF8.GetString(buffer, 0, length));
+            }
+        }
+
+        [Fact]
+        public void SlotOfLiveClaimerIsWaitedFor()
+        {
+            if (!OperatingSystemHelper.IsLinuxOS)
+            {
+                return;
+            }
+
+            using var ring = CreateRing();
+            XAssert.IsTrue(RingEnqueue(ring.Path, new byte[0], UIntPtr.Zero, (uint)Process.GetCurrentProcess().Id, publish: false));
+            XAssert.IsTrue(Enqueue(ring, "after unpublished"));
+
+            XAssert.IsFalse(ring.TrySkipAbandonedSlot(out _));
+            Thread.Sleep(SandboxConnectionLinuxDetours.ReportsRing.AbandonedSlotTimeout + TimeSpan.FromMilliseconds(100));
+            XAssert.IsFalse(ring.TrySkipAbandonedSlot(out _));
+            XAssert.IsFalse(ring.TryDequeue(new byte[ring.SlotSize], out _));
+        }
+
+        [Fact]
+        public void SlotOfExitedClaimerIsSkipped()
+        {
+            if (!OperatingSystemHelper.IsLinuxOS)
+            {
+                return;
+            }
+
+            uint exitedPid;
+            using (var process = Process.Start(new ProcessStartInfo("/bin/true") { UseShellExecute = false }))
+            {
+                process.WaitForExit();
+                exitedPid = (uint)process.Id;
+            }
+
+            using var ring = CreateRing();
+            var buffer = new byte[ring.SlotSize];
+            XAssert.IsTrue(RingEnqueue(ring.Path, new byte[0], UIntPtr.Zero, exitedPid, publish: false));
+            XAssert.IsTrue(Enqueue(ring, "after abandoned"));
+
+            // not right away: the claimer may just be slow to publish
+            XAssert.IsFalse(ring.TrySkipAbandonedSlot(out _));
+            Thread.Sleep(SandboxConnectionLinuxDetours.ReportsRing.AbandonedSlotTimeout + TimeSpan.FromMilliseconds(100));
+            XAssert.IsTrue(ring.TrySkipAbandonedSlot(out uint claimerPid));
+            XAssert.AreEqual(exitedPid, claimerPid);
+
+            XAssert.IsTrue(ring.TryDequeue(buffer, out int length));
+            XAssert.AreEqual("after abandoned", Encoding.UTF8.GetString(buffer, 0, length));
+            XAssert.IsFalse(ring.TrySkipAbandonedSlot(out _));
+        }
+
+        private SandboxConnectionLinuxDetours.ReportsRing CreateRing()
+            => new SandboxConnectionLinuxDetours.ReportsRing(Path.Combine(TemporaryDirectory, Guid.NewGuid().ToString() + ".ring"), SlotCount);
+
+        private static bool Enqueue(SandboxConnectionLinuxDetours.ReportsRing ring, string packet)
+        {
+            byte[] bytes = Encoding.UTF8.GetBytes(packet);
+            return RingEnqueue(ring.Path, bytes, (UIntPtr)(uint)bytes.Length, (uint)Process.GetCurrentProcess().Id, publish: true);
+        }
+    }
+}
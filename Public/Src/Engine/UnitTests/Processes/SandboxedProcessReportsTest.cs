@@ -98,5 +98,227 @@ namespace Test.BuildXL.Processes
             XAssert.AreEqual("*", enumeratePattern);
             XAssert.AreEqual("some args\r\n", processArgs);
         }
+
+        [Fact]
+        public void FileAccessRecordsReuseStringIds()
+        {
+            var parser = new FileAccessReportRecordParser();
+
+            // The first record defines the operation (id 1) and the path (id 2); the second one only refers to them.
+            var first = EncodeRecord(processId: 1234, requestedAccess: RequestedAccess.Write, Define(1, "CreateFile"), Define(2, "C:\\foo\\bar"));
+            var second = EncodeRecord(processId: 1234, requestedAccess: RequestedAccess.Read, Refer(1), Refer(2));
+
+            foreach (var (record, expectedAccess) in new[] { (first, RequestedAccess.Write), (second, RequestedAccess.Read) })
+            {
+                var data = record;
+                var ok = parser.TryParse(
+                    ref data,
+                    out var processId,
+                    out _,
+                    out _,
+                    out var operation,
+                    out var requestedAccess,
+                    out var status,
+                    out _,
+                    out _,
+                    out var usn,
+                    out _,
+                    out _,
+                    out _,
+                    out _,
+                    out _,
+                    out _,
+                    out var path,
+                    out var enumeratePattern,
+                    out var processArgs,
+                    out string errorMessage);
+
+                XAssert.IsTrue(ok, errorMessage);
+                XAssert.AreEqual(1234u, processId);
+                XAssert.AreEqual(ReportedFileOperation.CreateFile, operation);
+                XAssert.AreEqual(expectedAccess, requestedAccess);
+                XAssert.AreEqual(FileAccessStatus.Allowed, status);
+                XAssert.AreEqual(new Usn(0x123456789AUL), usn);
+                XAssert.AreEqual("C:\\foo\\bar", path);
+                XAssert.AreEqual(null, enumeratePattern);
+                XAssert.AreEqual(string.Empty, processArgs);
+            }
+
+            // Ids are scoped to the process that defined them
+            var other = EncodeRecord(processId: 5678, requestedAccess: RequestedAccess.Read, Refer(1), Refer(2));
+            XAssert.IsFalse(parser.TryParse(ref other, out _, out _, out _, out _, out _, out _, out _, out _, out _, out _, out _, out _, out _, out _, out _, out _, out _, out _, out _));
+        }
+
+        [Fact]
+        public void ReadAccessReportRecords()
+        {
+            // A UTF-8 record without header extension, then a UTF-16 one with 8 bytes of header extension and padding
+            var first = EncodeAccessReportRecord(kind: AccessReportRecord.KindAccess, flags: 1, extension: 0, payload: System.Text.Encoding.UTF8.GetBytes("/tmp/\u00e9t\u00e9"), padding: 0);
+            var second = EncodeAccessReportRecord(kind: AccessReportRecord.KindProcessName, flags: 2, extension: 8, payload: System.Text.Encoding.Unicode.GetBytes(@"C:\x.exe"), padding: 5);
+            var bytes = new byte[first.Length + second.Length];
+            first.CopyTo(bytes, 0);
+            second.CopyTo(bytes, first.Length);
+
+            XAssert.IsTrue(AccessReportRecord.TryRead(bytes, out var record, out string error), error);
+            XAssert.AreEqual(first.Length, record.Length);
+            XAssert.AreEqual(AccessReportRecord.KindAccess, record.Kind);
+            XAssert.AreEqual(AccessReportRecord.PlatformPosix, record.Platform);
+            XAssert.AreEqual(12u, record.Operation);
+            XAssert.AreEqual(1234u, record.ProcessId);
+            XAssert.AreEqual(1000u, record.RootProcessId);
+            XAssert.AreEqual(RequestedAccess.Write, record.RequestedAccess);
+            XAssert.AreEqual(1u, record.Status);
+            XAssert.AreEqual(2u, record.Error);
+            XAssert.AreEqual(3u, record.ProcessNameId);
+            XAssert.AreEqual(0x123456789Aul, record.PipId);
+            XAssert.IsTrue(record.ReportExplicitly);
+            XAssert.AreEqual("/tmp/\u00e9t\u00e9", record.GetPayloadString());
+
+            XAssert.IsTrue(AccessReportRecord.TryRead(new ReadOnlySpan<byte>(bytes, first.Length, second.Length), out record, out error), error);
+            XAssert.AreEqual(second.Length, record.Length);
+            XAssert.AreEqual(AccessReportRecord.KindProcessName, record.Kind);
+            XAssert.IsFalse(record.ReportExplicitly);
+            XAssert.AreEqual(AccessReportRecord.MinHeaderSize + 8, record.PayloadOffset);
+            XAssert.AreEqual(@"C:\x.exe", record.GetPayloadString());
+        }
+
+        [Fact]
+        public void ReadTimedAccessReportRecords()
+        {
+            // The timing starts the header extension; what follows it is skipped
+            var bytes = EncodeAccessReportRecord(kind: AccessReportRecord.KindAccess, flags: 4, extension: AccessReportRecord.TimingSize + 8, payload: new byte[] { (byte)'/' }, padding: 0);
+            BitConverter.GetBytes(123456789012ul).CopyTo(bytes, AccessReportRecord.MinHeaderSize);
+            BitConverter.GetBytes(42ul).CopyTo(bytes, AccessReportRecord.MinHeaderSize + 8);
+
+            XAssert.IsTrue(AccessReportRecord.TryRead(bytes, out var record, out string error), error);
+            XAssert.IsTrue(record.IsTimed);
+            XAssert.AreEqual(123456789012ul, record.Timestamp);
+            XAssert.AreEqual(42ul, record.SequenceNumber);
+            XAssert.AreEqual("/", record.GetPayloadString());
+
+            // not timed
+            var untimed = EncodeAccessReportRecord(kind: AccessReportRecord.KindAccess, flags: 0, extension: AccessReportRecord.TimingSize, payload: new byte[] { (byte)'/' }, padding: 0);
+            XAssert.IsTrue(AccessReportRecord.TryRead(untimed, out record, out error), error);
+            XAssert.IsFalse(record.IsTimed);
+            XAssert.AreEqual(0ul, record.Timestamp);
+
+            // timed, but too short a header for the timing
+            var shortHeader = EncodeAccessReportRecord(kind: AccessReportRecord.KindAccess, flags: 4, extension: 8, payload: new byte[] { (byte)'/' }, padding: 0);
+            XAssert.IsFalse(AccessReportRecord.TryRead(shortHeader, out _, out _));
+        }
+
+        [Fact]
+        public void RejectMalformedAccessReportRecords()
+        {
+            var record = EncodeAccessReportRecord(kind: AccessReportRecord.KindAccess, flags: 0, extension: 0, payload: new byte[] { (byte)'/' }, padding: 0);
+            XAssert.IsTrue(AccessReportRecord.TryRead(record, out _, out _));
+
+            // truncated
+            XAssert.IsFalse(AccessReportRecord.TryRead(new ReadOnlySpan<byte>(record, 0, record.Length - 1), out _, out _));
+            XAssert.IsFalse(AccessReportRecord.TryRead(new ReadOnlySpan<byte>(record, 0, AccessReportRecord.MinHeaderSize - 1), out _, out _));
+
+            // unknown version
+            var unknownVersion = (byte[])record.Clone();
+            unknownVersion[4] = 2;
+            XAssert.IsFalse(AccessReportRecord.TryRead(unknownVersion, out _, out _));
+
+            // header smaller than the fixed part
+            var shortHeader = (byte[])record.Clone();
+            shortHeader[6] = AccessReportRecord.MinHeaderSize - 4;
+            XAssert.IsFalse(AccessReportRecord.TryRead(shortHeader, out _, out _));
+
+            // payload past the end of the record
+            var longPayload = (byte[])record.Clone();
+            longPayload[48] = 2;
+            XAssert.IsFalse(AccessReportRecord.TryRead(longPayload, out _, out _));
+        }
+
+        [Fact]
+        public void ReadAndAddSandboxStats()
+        {
+            // Mirrors SandboxStats.h: version, count, values; this writer knows of one more stat than the reader
+            var bytes = new byte[SandboxStats.HeaderSize + 8 * (SandboxStats.Count + 1)];
+            var writer = new System.IO.BinaryWriter(new System.IO.MemoryStream(bytes));
+            writer.Write(SandboxStats.Version);
+            writer.Write((uint)SandboxStats.Count + 1);
+            for (ulong i = 0; i <= SandboxStats.Count; i++)
+            {
+                writer.Write(10 * (i + 1));
+            }
+
+            XAssert.IsTrue(SandboxStats.TryRead(bytes, out var stats));
+            XAssert.AreEqual(10ul, stats[SandboxStats.Stat.CacheHits]);
+            XAssert.AreEqual(80ul, stats[SandboxStats.Stat.QueueHighWater]);
+
+            // truncated, or of an unknown version
+            XAssert.IsFalse(SandboxStats.TryRead(new ReadOnlySpan<byte>(bytes, 0, bytes.Length - 1), out _));
+            bytes[0] = 2;
+            XAssert.IsFalse(SandboxStats.TryRead(bytes, out _));
+
+            // a writer that knows of fewer stats leaves the others at 0
+            XAssert.IsTrue(SandboxStats.TryParse("1,2,3,4,5,6,700", out var other), "1,2,3,4,5,6,700");
+            XAssert.AreEqual(0ul, other[SandboxStats.Stat.QueueHighWater]);
+            XAssert.IsFalse(SandboxStats.TryParse("1,x", out _));
+
+            // counts are added up, high-water marks are not
+            stats.Add(other);
+            XAssert.AreEqual(11ul, stats[SandboxStats.Stat.CacheHits]);
+            XAssert.AreEqual(66ul, stats[SandboxStats.Stat.InterposerNs]);
+            XAssert.AreEqual(700ul, stats[SandboxStats.Stat.AllocatedBytes]);
+            XAssert.AreEqual(80ul, stats[SandboxStats.Stat.QueueHighWater]);
+        }
+
+        // Mirrors AccessReportRecord.h
+        private static byte[] EncodeAccessReportRecord(ushort kind, byte flags, int extension, byte[] payload, int padding)
+        {
+            int headerSize = AccessReportRecord.MinHeaderSize + extension;
+            var record = new byte[headerSize + payload.Length + padding];
+            var writer = new System.IO.BinaryWriter(new System.IO.MemoryStream(record));
+            writer.Write((uint)record.Length);
+            writer.Write(AccessReportRecord.Version);
+            writer.Write((ushort)headerSize);
+            writer.Write(kind);
+            writer.Write(AccessReportRecord.PlatformPosix);
+            writer.Write(flags);
+            foreach (var field in new uint[] { 12, 1234, 1000, (uint)RequestedAccess.Write, 1, 2, 3 })
+            {
+                writer.Write(field);
+            }
+
+            writer.Write(0x123456789Aul);
+            writer.Write((uint)payload.Length);
+            payload.CopyTo(record, headerSize);
+            return record;
+        }
+
+        // Mirrors the encoding in SendReport.cpp
+        private static string EncodeNumber(ulong value)
+        {
+            var result = new System.Text.StringBuilder();
+            do
+            {
+                var digit = 0x4000 + (int)(value & 0x3FFF);
+                value >>= 14;
+                result.Append((char)(value != 0 ? digit + 0x4000 : digit));
+            }
+            while (value != 0);
+
+            return result.ToString();
+        }
+
+        private static string Define(uint id, string value) => EncodeNumber((id << 1) | 1) + EncodeNumber((ulong)value.Length) + value;
+
+        private static string Refer(uint id) => EncodeNumber(id << 1);
+
+        private static string EncodeRecord(uint processId, RequestedAccess requestedAccess, string operation, string path)
+        {
+            var result = new System.Text.StringBuilder();
+            foreach (var number in new ulong[] { 1, processId, 1, 2, (ulong)requestedAccess, (ulong)FileAccessStatus.Allowed, 1, 0, 0x123456789A, 0, 0, 0, 0, 0, 0 })
+            {
+                result.Append(EncodeNumber(number));
+            }
+
+            return result.Append(operation).Append(path).Append(Define(0, string.Empty)).Append(Define(0, string.Empty)).ToString();
+        }
     }
 }
@@ -12,6 +12,6 @@ namespace BuildXL.Pips.Fingerprints
         /// Until some automation for kernel extension building and deployment is in place, this number has to be kept in sync with the 'CFBundleVersion'
         /// inside the Info.plist file of the kernel extension code base. BuildXL will not work if a version mismatch is detected!
         /// </summary>
-        public const string RequiredKextVersionNumber = "3.3.99";
+        public const string RequiredKextVersionNumber = "3.4.0";
     }
 }
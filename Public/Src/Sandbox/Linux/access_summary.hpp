@@ -0,0 +1,255 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <new>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * The accesses a process made so far, deduplicated, for pips whose reports are only checked by the host (observe-only
+ * pips, see SandboxedPip::IsObserveOnly): nothing is denied natively, so there is no need to send every access as it is
+ * made.  BxlObserver adds the accesses here instead and sends them all at once (see Flush) right before the process
+ * exits, execs or forks, which turns one report per access into one (compressed) record per few thousand distinct ones.
+ *
+ * Accesses are merged by (path, operation, status, explicit logging flag, error): the requested access of an entry is the
+ * union of the requested accesses of the merged reports.  Entries keep the order in which they were first added, so the
+ * accesses to a path reach the host in the order they were made, only earlier.
+ *
+ * The summary is sent as kReportRecordAccessSummary records of at most kMaxRecordSize bytes of entries each; every entry is
+ *
+ *     operation, requestedAccess, status, reportExplicitly, error, sharedPrefixLength, suffixLength (LEB128 varints)
+ *     suffix bytes
+ *
+ * where the path of the entry is the first 'sharedPrefixLength' bytes of the path of the previous entry of the same record
+ * followed by the suffix (consecutive accesses tend to be in the same directory).
+ *
+ * CODESYNC: Public/Src/Engine/Processes/SandboxConnectionLinuxDetours.cs
+ *
+ * A process that is killed before it flushes loses its summary, which is why this is opt-in (see BxlEnvDeferReports).
+ * When the entries or the arena fill up, the summary is flushed early (from Add).
+ *
+ * IMPORTANT: like ReportCache, instances must have static storage duration (i.e., be zero-initialized).
+ */
+class AccessSummary final
+{
+public:
+    // maximum number of entry bytes a record sent by Flush carries
+    static const size_t kMaxRecordSize = 64 << 10;
+
+private:
+    static const uint32_t kMaxEntries = 8192;
+    static const uint32_t kSlotCount  = 2 * kMaxEntries;
+    static const uint32_t kArenaSize  = 1 << 20;
+
+    // bytes an encoded entry needs on top of its suffix (7 varints of at most 5 bytes)
+    static const size_t kMaxEntryOverhead = 7 * 5;
+
+    typedef struct
+    {
+        uint32_t hash;
+        uint32_t slot;
+        uint32_t offset;
+        uint32_t length;
+        uint32_t operation;
+        uint32_t requestedAccess;
+        uint32_t status;
+        uint32_t reportExplicitly;
+        uint32_t error;
+    } Entry;
+
+    std::timed_mutex mtx_;
+
+    // process the entries were reported on behalf of (see BxlObserver::GetReportingPid)
+    uint32_t pid_;
+    uint32_t count_;
+    uint32_t arenaPos_;
+
+    // index + 1 of the entry stored in each slot (0 if the slot is available)
+    uint32_t slots_[kSlotCount];
+    Entry entries_[kMaxEntries];
+    char arena_[kArenaSize];
+    uint8_t record_[kMaxRecordSize];
+
+    static inline uint32_t Hash(uint32_t operation, uint32_t status, uint32_t error, const char *path, size_t length)
+    {
+        uint64_t hash = (14695981039346656037ULL ^ ((uint64_t)operation << 40 | (uint64_t)status << 32 | error)) * 1099511628211ULL;
+        for (size_t i = 0; i < length; i++)
+        {
+            hash = (hash ^ (unsigned char)path[i]) * 1099511628211ULL;
+        }
+
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 33;
+        return (uint32_t)hash;
+    }
+
+    static inline size_t PutVarint(uint8_t *buf, uint32_t value)
+    {
+        size_t length = 0;
+        while (value >= 0x80)
+        {
+            buf[length++] = (uint8_t)(value | 0x80);
+            value >>= 7;
+        }
+
+        buf[length++] = (uint8_t)value;
+        return length;
+    }
+
+    void ClearUnlocked()
+    {
+        for (uint32_t i = 0; i < count_; i++)
+        {
+            slots_[entries_[i].slot] = 0;
+        }
+
+        count_ = 0;
+        arenaPos_ = 0;
+    }
+
+    // Sends the entries (in as many records as needed) through 'send(pid, bytes, length)' and clears the summary.
+    template<typename F>
+    void FlushUnlocked(F send)
+    {
+        size_t length = 0;
+        const char *previous = NULL;
+        uint32_t previousLength = 0;
+        for (uint32_t i = 0; i < count_; i++)
+        {
+            const Entry &entry = entries_[i];
+            const char *path = arena_ + entry.offset;
+            if (length + kMaxEntryOverhead + entry.length > kMaxRecordSize)
+            {
+                send(pid_, record_, length);
+                length = 0;
+                previous = NULL;
+                previousLength = 0;
+            }
+
+            uint32_t shared = 0;
+            while (shared < previousLength && shared < entry.length && previous[shared] == path[shared])
+            {
+                shared++;
+            }
+
+            length += PutVarint(&record_[length], entry.operation);
+            length += PutVarint(&record_[length], entry.requestedAccess);
+            length += PutVarint(&record_[length], entry.status);
+            length += PutVarint(&record_[length], entry.reportExplicitly);
+            length += PutVarint(&record_[length], entry.error);
+            length += PutVarint(&record_[length], shared);
+            length += PutVarint(&record_[length], entry.length - shared);
+            memcpy(&record_[length], path + shared, entry.length - shared);
+            length += entry.length - shared;
+
+            previous = path;
+            previousLength = entry.length;
+        }
+
+        if (length > 0)
+        {
+            send(pid_, record_, length);
+        }
+
+        ClearUnlocked();
+    }
+
+public:
+    /**
+     * Adds an access of process 'pid' to the summary, or merges it into the entry of the same access already there.  When
+     * the summary is full (or holds the accesses of another process), what it holds is sent (see Flush) first.
+     *
+     * Returns false if the summary could not be locked in time (e.g., when reporting from a signal handler interrupting
+     * a thread that is adding an access): the caller must then report the access right away.
+     */
+    template<typename F>
+    bool Add(uint32_t pid, uint32_t operation, uint32_t requestedAccess, uint32_t status, uint32_t reportExplicitly, uint32_t error,
+        const char *path, size_t length, F send)
+    {
+        if (length >= kArenaSize || !mtx_.try_lock_for(std::chrono::milliseconds(1)))
+        {
+            return false;
+        }
+
+        if (count_ > 0 && pid_ != pid)
+        {
+            FlushUnlocked(send);
+        }
+
+        pid_ = pid;
+        uint32_t hash = Hash(operation, status, error, path, length);
+        uint32_t slot = hash & (kSlotCount - 1);
+        for (;;)
+        {
+            uint32_t index = slots_[slot];
+            if (index == 0)
+            {
+                break;
+            }
+
+            Entry &entry = entries_[index - 1];
+            if (entry.hash == hash && entry.operation == operation && entry.status == status && entry.error == error &&
+                entry.reportExplicitly == reportExplicitly && entry.length == length && memcmp(arena_ + entry.offset, path, length) == 0)
+            {
+                entry.requestedAccess |= requestedAccess;
+                mtx_.unlock();
+                return true;
+            }
+
+            slot = (slot + 1) & (kSlotCount - 1);
+        }
+
+        if (count_ == kMaxEntries || arenaPos_ + length > kArenaSize)
+        {
+            // the slots of the flushed entries are available again, and so is the one found above
+            FlushUnlocked(send);
+            slot = hash & (kSlotCount - 1);
+        }
+
+        Entry &entry = entries_[count_];
+        entry.hash = hash;
+        entry.slot = slot;
+        entry.offset = arenaPos_;
+        entry.length = (uint32_t)length;
+        entry.operation = operation;
+        entry.requestedAccess = requestedAccess;
+        entry.status = status;
+        entry.reportExplicitly = reportExplicitly;
+        entry.error = error;
+        memcpy(arena_ + arenaPos_, path, length);
+        arenaPos_ += (uint32_t)length;
+        slots_[slot] = ++count_;
+
+        mtx_.unlock();
+        return true;
+    }
+
+    /**
+     * Sends the entries through 'send(pid, bytes, length)', once per record (see above), and clears the summary.
+     * Gives up (keeping the entries) if the summary could not be locked in time.
+     */
+    template<typename F>
+    void Flush(F send)
+    {
+        if (!mtx_.try_lock_for(std::chrono::milliseconds(1)))
+        {
+            return;
+        }
+
+        FlushUnlocked(send);
+        mtx_.unlock();
+    }
+
+    /** Drops the entries inherited from the parent; must be called in the child process right after fork. */
+    void ResetAfterFork()
+    {
+        new (&mtx_) std::timed_mutex();
+        ClearUnlocked();
+    }
+};
@@ -6,35 +6,256 @@
 
 // https://man7.org/linux/man-pages/man7/rtld-audit.7.html
 
+/**
+ * Symbol-bind mode (enabled via the BxlEnvAuditSymbind env var)
+ *
+ * This library is built with the same interposers as libDetours.so (detours.cpp).  In symbol-bind mode, whenever a
+ * process that libDetours.so was not preloaded into (e.g., because it cleared LD_PRELOAD) binds a function from libc
+ * that we interpose, la_symbind64 redirects the binding to our interposer, and makes the interposer forward to the
+ * definition the process was binding to.  The latter matters because this library lives in its own link-map namespace,
+ * with its own copy of libc (and hence its own errno, stdio, etc.): interposers must forward to the program's libc,
+ * while the BxlObserver itself keeps using ours (see GEN_FN_DEF_REAL).  Forward targets are resolved by the dynamic
+ * linker when the program binds them, instead of by one dlsym(RTLD_NEXT) lookup per interposed function.
+ *
+ * When libDetours.so is loaded, symbol auditing stays off and this library only reports loaded objects.
+ *
+ * NOTE: glibc versions before 2.35 do not call la_symbind64 for objects linked with -z now (BIND_NOW), so programs
+ *       built that way are not observed in this mode on older distros.
+ */
+static bool s_symbind = false;
+static bool s_detoursLoaded = false;
+static struct link_map *s_libc = NULL;
+static void *s_selfBase = NULL;
+static void *s_selfHandle = NULL;
+
+/**
+ * Loader search shortcutting (enabled when the host shares a LoaderSearchCache with the processes of the pip)
+ *
+ * When a library is loaded by name (no '/'), ld.so tries one candidate file after another (LD_LIBRARY_PATH, RUNPATH,
+ * ld.so.cache, default directories), and every candidate that is not there is a probe of an absent file.  The first
+ * process of the pip to load a library (in a given search context, see LoaderSearchCache) records the file ld.so
+ * found it at (la_objopen); the processes that load it after that skip the search (la_objsearch), so the probes of
+ * the pip are the ones its first search made.
+ *
+ * ld.so holds its load lock around both callbacks, so the pending search needs no synchronization.
+ */
+static bool s_searchContextInitialized = false;
+static uint64_t s_searchContext = 0;
+static char s_pendingSearchName[NAME_MAX + 1];
+static uint64_t s_pendingSearchContext = 0;
+static char s_cachedSearchPath[PATH_MAX];
+
+extern void init_audited_process(int (*on_exit_fn)(void (*)(int, void*), void*));
+
+static const char* base_name(struct link_map *map)
+{
+    const char *slash = map->l_name ? strrchr(map->l_name, '/') : NULL;
+    return slash ? slash + 1 : map->l_name;
+}
+
+static bool starts_with(const char *str, const char *prefix)
+{
+    return str && strncmp(str, prefix, strlen(prefix)) == 0;
+}
+
+// what (other than the name of the library) a search made for the object 'requester' depends on
+static uint64_t search_context(BxlObserver *bxl, struct link_map *requester)
+{
+    if (!s_searchContextInitialized)
+    {
+        // ld.so reads LD_LIBRARY_PATH once, at startup
+        s_searchContext = LoaderSearchCache::HashContext(LoaderSearchCache::HashContext(0, bxl->GetProgramPath()), getenv("LD_LIBRARY_PATH"));
+        s_searchContextInitialized = true;
+    }
+
+    // RUNPATH and $ORIGIN are those of the requesting object (the program itself has an empty name)
+    return LoaderSearchCache::HashContext(s_searchContext, requester != NULL ? requester->l_name : NULL);
+}
+
 /**
  * When invoking this function, the dynamic linker passes, in version, the highest version
  * of the auditing interface that the linker supports.  If necessary, the auditing library
  * can check that this version is sufficient for its requirements.  In our case, we just
  * return the same version.
- * 
+ *
  * @param version The highest version of the auditing interface that the linker supports.
  * @return The version of the auditing interface that this auditing library expects to use.
  */
-unsigned int la_version(unsigned int version)
+DLL_EXPORT unsigned int la_version(unsigned int version)
 {
+    const char *symbind = getenv(BxlEnvAuditSymbind);
+    s_symbind = symbind && *symbind == '1';
+
+    Dl_info info;
+    struct link_map *self = NULL;
+    if (s_symbind && dladdr1((void*)&la_version, &info, (void**)&self, RTLD_DL_LINKMAP) != 0 && self != NULL)
+    {
+        // glibc handles are link maps: looking symbols up in 'self' finds our interposers first
+        s_selfBase = info.dli_fbase;
+        s_selfHandle = self;
+    }
+    else
+    {
+        s_symbind = false;
+    }
+
     return version;
 }
 
 /**
  * The dynamic linker calls this function when a new shared object is loaded.
  * The map argument is a pointer to a link-map structure that describes the object.
- * 
+ *
  * Our implementation of this callback just forwards this call to the BxlObserver singleton instance.
- * 
+ *
  * @return A bit mask specifying whether symbol bindings for this object should be audited.
  */
-unsigned int la_objopen(struct link_map *map, Lmid_t lmid, uintptr_t *cookie)
+DLL_EXPORT unsigned int la_objopen(struct link_map *map, Lmid_t lmid, uintptr_t *cookie)
 {
+    BxlObserver *bxl = BxlObserver::GetInstance();
+
     // report if path is set
     if (map->l_name && *map->l_name == '/')
     {
-        BxlObserver::GetInstance()->report_audit_objopen(map->l_name);
+        bxl->report_audit_objopen(map->l_name);
+
+        // this is where the pending search (if any) ended up (see la_objsearch)
+        LoaderSearchCache *searchCache = bxl->GetLoaderSearchCache();
+        if (searchCache != NULL && s_pendingSearchName[0] != '\0' && strcmp(base_name(map), s_pendingSearchName) == 0)
+        {
+            searchCache->Add(s_pendingSearchContext, s_pendingSearchName, map->l_name);
+        }
+    }
+
+    s_pendingSearchName[0] = '\0';
+
+    if (!s_symbind || lmid != LM_ID_BASE)
+    {
+        return 0; // disable symbol auditing
+    }
+
+    if (map->l_name && *map->l_name && strcmp(map->l_name, bxl->GetDetoursLibPath()) == 0)
+    {
+        s_detoursLoaded = true;
+    }
+
+    if (s_detoursLoaded)
+    {
+        return 0;
     }
 
-    return 0; // disable symbol auditing; to enable, return LA_FLG_BINDTO | LA_FLG_BINDFROM;
-}
\ No newline at end of file
+    // only bindings (of other objects) to the libraries that define the functions we interpose are redirected
+    const char *name = base_name(map);
+    if (starts_with(name, "libc.so") || starts_with(name, "libpthread.so") || starts_with(name, "libdl.so"))
+    {
+        if (s_libc == NULL && starts_with(name, "libc.so"))
+        {
+            s_libc = map;
+        }
+
+        return LA_FLG_BINDTO;
+    }
+
+    return LA_FLG_BINDFROM;
+}
+
+/**
+ * The dynamic linker calls this function before it searches for a shared object, with the name it was asked for
+ * (flag LA_SER_ORIG), and then with every candidate file it is about to try.  The return value is the name to use
+ * instead (NULL skips the candidate).
+ *
+ * When the shared object was already searched for by some process of the pip, in the same context, we return the
+ * file it was found at: ld.so opens names that contain a '/' as they are, without searching.  Otherwise the search
+ * is left to ld.so, and la_objopen records where it ended up.
+ */
+DLL_EXPORT char* la_objsearch(const char *name, uintptr_t *cookie, unsigned int flag)
+{
+    if (flag != LA_SER_ORIG)
+    {
+        return (char*)name;
+    }
+
+    s_pendingSearchName[0] = '\0';
+
+    BxlObserver *bxl = BxlObserver::GetInstance();
+    LoaderSearchCache *searchCache = bxl->GetLoaderSearchCache();
+    size_t length = strlen(name);
+    if (searchCache == NULL || length == 0 || length > NAME_MAX || strchr(name, '/') != NULL)
+    {
+        return (char*)name;
+    }
+
+    // cookies are the link maps of the objects, unless la_objopen changes them (we don't)
+    uint64_t context = search_context(bxl, cookie != NULL ? (struct link_map*)*cookie : NULL);
+
+    // the file may be gone since (e.g., it was an output of the pip that got deleted), in which case ld.so searches again
+    struct stat st;
+    if (searchCache->TryGet(context, name, s_cachedSearchPath, sizeof(s_cachedSearchPath))
+        && bxl->real___xstat(1, s_cachedSearchPath, &st) == 0 && S_ISREG(st.st_mode))
+    {
+        return s_cachedSearchPath;
+    }
+
+    memcpy(s_pendingSearchName, name, length + 1);
+    s_pendingSearchContext = context;
+    return (char*)name;
+}
+
+/**
+ * The dynamic linker calls this function after all shared objects have been loaded, before control is passed to the
+ * application.  In symbol-bind mode (when libDetours.so was not loaded), this is where we do what the initializer
+ * of libDetours.so would have done.
+ */
+DLL_EXPORT void la_preinit(uintptr_t *cookie)
+{
+    if (!s_symbind || s_detoursLoaded || s_libc == NULL)
+    {
+        return;
+    }
+
+    // the program's libc (as opposed to ours, which is what on_exit would refer to here)
+    void *libc = dlmopen(LM_ID_BASE, s_libc->l_name, RTLD_LAZY | RTLD_NOLOAD);
+    if (libc == NULL)
+    {
+        return;
+    }
+
+    typedef int (*fn_on_exit)(void (*)(int, void*), void*);
+    fn_on_exit on_exit_fn = (fn_on_exit)dlsym(libc, "on_exit");
+    if (on_exit_fn != NULL)
+    {
+        init_audited_process(on_exit_fn);
+    }
+
+    dlclose(libc);
+}
+
+/**
+ * The dynamic linker calls this function when a binding occurs between two shared objects that have been marked for
+ * auditing notification by la_objopen().  The return value is the address to which control should be passed.
+ */
+DLL_EXPORT uintptr_t la_symbind64(Elf64_Sym *sym, unsigned int ndx, uintptr_t *refcook, uintptr_t *defcook, unsigned int *flags, const char *symname)
+{
+    *flags |= LA_SYMB_NOPLTENTER | LA_SYMB_NOPLTEXIT;
+
+    // dlopen and friends act on the namespace of their caller, so they must be called from the program itself
+    if (!s_symbind || s_detoursLoaded || ELF64_ST_TYPE(sym->st_info) != STT_FUNC || strncmp(symname, "dl", 2) == 0)
+    {
+        return sym->st_value;
+    }
+
+    // our interposer, if we have one (the lookup may also find a function of our own libc)
+    Dl_info info;
+    void *interposer = dlsym(s_selfHandle, symname);
+    if (interposer == NULL || dladdr(interposer, &info) == 0 || info.dli_fbase != s_selfBase)
+    {
+        return sym->st_value;
+    }
+
+    if (!BxlObserver::GetInstance()->RebindForwardTarget(symname, (void*)sym->st_value))
+    {
+        return sym->st_value;
+    }
+
+    return (uintptr_t)interposer;
+}
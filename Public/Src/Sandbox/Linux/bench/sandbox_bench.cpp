@@ -0,0 +1,412 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+/*
+ * Microbenchmarks for the interposition overhead of libDetours.so (see the 'bench' target of the Makefile).
+ *
+ *   sandbox_bench <path to libDetours.so> [-n <scale>] [-k <workload>]
+ *
+ * Every workload runs twice in a fresh child process: once natively (the baseline) and once with libDetours.so
+ * preloaded, and the time per operation of each run is reported side by side.  Sandboxed runs get a manifest
+ * (written by this program) that allows and reports every access, with reports going to /dev/null, so they pay
+ * for path resolution, policy checks and reporting just like a pip would (minus the managed side draining them).
+ *
+ * The manifest is laid out the way a release build of libDetours.so expects it (see FileAccessManifestParser.cpp);
+ * like the managed side, this program must be kept in sync with any change to that layout.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+static const char *kReportsPath = "/dev/null";
+
+typedef struct
+{
+    const char *name;
+    const char *description;
+    long baseOps;                           // operations at scale 1
+    double (*run)(const char *dir, long ops); // returns ns/op
+} Workload;
+
+static void fatal(const char *what)
+{
+    fprintf(stderr, "sandbox_bench: %s failed: %s\n", what, strerror(errno));
+    exit(1);
+}
+
+static inline uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static std::string file_name(const char *dir, long i)
+{
+    char buf[64];
+    snprintf(buf, sizeof(buf), "/f%06ld", i);
+    return std::string(dir) + buf;
+}
+
+// ------------------------------------------------------------------------------------------------------------------
+// Workloads (each runs in a child process, natively or sandboxed; inputs are created by the parent beforehand)
+// ------------------------------------------------------------------------------------------------------------------
+
+static const long kStatFiles = 1000;
+
+// stat over and over again the same set of files (the most common access of build tools probing for inputs);
+// the first round is not timed, i.e., this measures repeated accesses (which need no new reports)
+static double run_stat(const char *dir, long ops)
+{
+    std::vector<std::string> paths;
+    for (long i = 0; i < kStatFiles; i++) paths.push_back(file_name(dir, i));
+
+    struct stat st;
+    for (long i = 0; i < kStatFiles; i++)
+    {
+        if (stat(paths[i].c_str(), &st) != 0) fatal("stat");
+    }
+
+    uint64_t start = now_ns();
+    for (long i = 0; i < ops; i++)
+    {
+        if (stat(paths[i % kStatFiles].c_str(), &st) != 0) fatal("stat");
+    }
+
+    return (double)(now_ns() - start) / ops;
+}
+
+// open and close distinct files (every open is a first access)
+static double run_open_close(const char *dir, long ops)
+{
+    std::vector<std::string> paths;
+    for (long i = 0; i < ops; i++) paths.push_back(file_name(dir, i));
+
+    uint64_t start = now_ns();
+    for (long i = 0; i < ops; i++)
+    {
+        int fd = open(paths[i].c_str(), O_RDONLY);
+        if (fd == -1) fatal("open");
+        close(fd);
+    }
+
+    return (double)(now_ns() - start) / ops;
+}
+
+// open a file through a chain of nested directory symlinks (each level resolving through the previous one)
+static double run_symlink(const char *dir, long ops)
+{
+    std::string path = std::string(dir) + "/deep/file";
+
+    uint64_t start = now_ns();
+    for (long i = 0; i < ops; i++)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd == -1) fatal("open");
+        close(fd);
+    }
+
+    return (double)(now_ns() - start) / ops;
+}
+
+// write a file one line at a time through stdio (output-heavy tools logging to a file or to stdout)
+static double run_stdio(const char *dir, long ops)
+{
+    std::string path = std::string(dir) + "/stdio.log";
+    FILE *f = fopen(path.c_str(), "w");
+    if (f == NULL) fatal("fopen");
+
+    uint64_t start = now_ns();
+    for (long i = 0; i < ops; i++)
+    {
+        if (fputs("a line of output\n", f) == EOF) fatal("fputs");
+    }
+
+    double elapsed = (double)(now_ns() - start);
+    fclose(f);
+    return elapsed / ops;
+}
+
+// small writes to the same file (linkers and archivers writing their output a few bytes at a time)
+static double run_write(const char *dir, long ops)
+{
+    std::string path = std::string(dir) + "/write.out";
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) fatal("open");
+
+    char buf[16] = {0};
+    uint64_t start = now_ns();
+    for (long i = 0; i < ops; i++)
+    {
+        if (write(fd, buf, sizeof(buf)) != (ssize_t)sizeof(buf)) fatal("write");
+    }
+
+    double elapsed = (double)(now_ns() - start);
+    close(fd);
+    return elapsed / ops;
+}
+
+static char sSelfPath[PATH_MAX];
+
+// fork, then exec a chain of 'ops' processes (each one exec-ing the next until the chain ends)
+static double run_fork_exec(const char *dir, long ops)
+{
+    char remaining[32];
+    snprintf(remaining, sizeof(remaining), "%ld", ops);
+
+    uint64_t start = now_ns();
+    pid_t pid = fork();
+    if (pid == -1) fatal("fork");
+    if (pid == 0)
+    {
+        execl(sSelfPath, sSelfPath, "--chain", remaining, (char*)NULL);
+        _exit(127);
+    }
+
+    int status;
+    if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) fatal("fork+exec chain");
+    return (double)(now_ns() - start) / ops;
+}
+
+static int run_chain(long remaining)
+{
+    if (remaining <= 1)
+    {
+        return 0;
+    }
+
+    char next[32];
+    snprintf(next, sizeof(next), "%ld", remaining - 1);
+    execl(sSelfPath, sSelfPath, "--chain", next, (char*)NULL);
+    return 127;
+}
+
+static const Workload kWorkloads[] =
+{
+    { "stat",       "stat of 1000 files, round robin",              200000, run_stat },
+    { "open_close", "open+close of distinct files",                 100000, run_open_close },
+    { "symlink",    "open+close through 16 nested dir symlinks",    50000,  run_symlink },
+    { "write",      "16-byte writes to the same file",              500000, run_write },
+    { "stdio",      "fputs of a line to the same file",             1000000, run_stdio },
+    { "fork_exec",  "fork+exec chain (per process)",                200,    run_fork_exec },
+};
+
+static const int kWorkloadCount = sizeof(kWorkloads) / sizeof(kWorkloads[0]);
+
+// ------------------------------------------------------------------------------------------------------------------
+// Setup
+// ------------------------------------------------------------------------------------------------------------------
+
+static void append_u32(std::string &buf, uint32_t value)
+{
+    buf.append((const char*)&value, sizeof(value));
+}
+
+// An allow-all manifest that reports every access (release layout: no tags)
+static void write_manifest(const char *path)
+{
+    std::string fam;
+    append_u32(fam, 0xDB600000);                // debug flag (release)
+    append_u32(fam, 10);                        // injection timeout (minutes)
+    append_u32(fam, 0);                         // child processes to break away from job
+    append_u32(fam, 0);                         // translate paths
+    append_u32(fam, 0);                         // internal error notification file
+    append_u32(fam, 0x40);                      // flags: MonitorChildProcesses
+    append_u32(fam, 0);                         // extra flags
+    uint64_t pipId = 0xBE7C4;                   // pip id
+    fam.append((const char*)&pipId, sizeof(pipId));
+
+    std::string reports(kReportsPath);
+    reports.resize((reports.length() + 2) & ~(size_t)1, '\0'); // null-terminated, even size (odd sizes mean handles)
+    append_u32(fam, (uint32_t)reports.length());  // reports path
+    fam.append(reports);
+
+    append_u32(fam, 0);                         // dll block: string block size
+    append_u32(fam, 0);                         // dll block: string count
+    append_u32(fam, 0);                         // substitute process execution shim: all processes
+    append_u32(fam, 0);                         // substitute process execution shim: path
+
+    append_u32(fam, 0);                         // root record: hash
+    append_u32(fam, 0x0F | 0x50);               // root record: cone policy (AllowAll | ReportAccess)
+    append_u32(fam, 0x0F | 0x50);               // root record: node policy
+    append_u32(fam, 0);                         // root record: path id
+    append_u32(fam, 0);                         // root record: expected USN (low)
+    append_u32(fam, 0);                         // root record: expected USN (high)
+    append_u32(fam, 0);                         // root record: bucket count
+    fam.push_back('\0');                        // root record: partial path
+
+    FILE *f = fopen(path, "wb");
+    if (f == NULL || fwrite(fam.data(), 1, fam.size(), f) != fam.size() || fclose(f) != 0) fatal("writing the manifest");
+}
+
+static void create_inputs(const char *dir, long files)
+{
+    for (long i = 0; i < files; i++)
+    {
+        int fd = open(file_name(dir, i).c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd == -1) fatal("creating inputs");
+        close(fd);
+    }
+
+    // deep -> l15/sub, l15 -> l14/sub, ..., l1 -> l0/sub, l0 -> real (i.e., deep is real/sub/.../sub)
+    std::string base(dir);
+    std::string sub = base + "/real";
+    for (int i = 0; i <= 16; i++)
+    {
+        if (mkdir(sub.c_str(), 0755) != 0) fatal("mkdir");
+        if (i < 16) sub += "/sub";
+    }
+
+    int fd = open((sub + "/file").c_str(), O_WRONLY | O_CREAT, 0644);
+    if (fd == -1) fatal("creating inputs");
+    close(fd);
+
+    std::string target = "real";
+    for (int i = 0; i < 16; i++)
+    {
+        std::string link = base + "/l" + std::to_string(i);
+        if (symlink(target.c_str(), link.c_str()) != 0) fatal("symlink");
+        target = "l" + std::to_string(i) + "/sub";
+    }
+
+    if (symlink(target.c_str(), (base + "/deep").c_str()) != 0) fatal("symlink");
+}
+
+// Runs 'workload' in a child process (with the environment as currently set) and returns its ns/op
+static double run_in_child(int workload, const char *dir, long ops, bool sandboxed, const char *lib, const char *fam)
+{
+    int fds[2];
+    if (pipe(fds) != 0) fatal("pipe");
+
+    char workloadArg[16], opsArg[32], fdArg[16];
+    snprintf(workloadArg, sizeof(workloadArg), "%d", workload);
+    snprintf(opsArg, sizeof(opsArg), "%ld", ops);
+    snprintf(fdArg, sizeof(fdArg), "%d", fds[1]);
+
+    pid_t pid = fork();
+    if (pid == -1) fatal("fork");
+    if (pid == 0)
+    {
+        close(fds[0]);
+        if (sandboxed)
+        {
+            setenv("LD_PRELOAD", lib, 1);
+            setenv("__BUILDXL_DETOURS_PATH", lib, 1);
+            setenv("__BUILDXL_FAM_PATH", fam, 1);
+        }
+
+        execl(sSelfPath, sSelfPath, "--run", workloadArg, dir, opsArg, fdArg, (char*)NULL);
+        _exit(127);
+    }
+
+    close(fds[1]);
+    double result = -1;
+    FILE *out = fdopen(fds[0], "r");
+    if (out == NULL || fscanf(out, "%lf", &result) != 1) result = -1;
+    if (out != NULL) fclose(out);
+
+    int status;
+    if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0 || result < 0)
+    {
+        fprintf(stderr, "sandbox_bench: workload '%s' failed (%s)\n", kWorkloads[workload].name, sandboxed ? "sandboxed" : "native");
+        exit(1);
+    }
+
+    return result;
+}
+
+static void usage()
+{
+    fprintf(stderr, "usage: sandbox_bench <path to libDetours.so> [-n <scale>] [-k <workload>]\n");
+    fprintf(stderr, "workloads:\n");
+    for (int i = 0; i < kWorkloadCount; i++)
+    {
+        fprintf(stderr, "  %-12s %s\n", kWorkloads[i].name, kWorkloads[i].description);
+    }
+
+    exit(2);
+}
+
+int main(int argc, char **argv)
+{
+    ssize_t len = readlink("/proc/self/exe", sSelfPath, sizeof(sSelfPath) - 1);
+    if (len <= 0) fatal("readlink");
+    sSelfPath[len] = '\0';
+
+    // child modes
+    if (argc == 3 && strcmp(argv[1], "--chain") == 0)
+    {
+        return run_chain(atol(argv[2]));
+    }
+
+    if (argc == 6 && strcmp(argv[1], "--run") == 0)
+    {
+        const Workload &workload = kWorkloads[atoi(argv[2])];
+        double nsPerOp = workload.run(argv[3], atol(argv[4]));
+        dprintf(atoi(argv[5]), "%.1f\n", nsPerOp);
+        return 0;
+    }
+
+    if (argc < 2 || argv[1][0] == '-')
+    {
+        usage();
+    }
+
+    char lib[PATH_MAX];
+    if (realpath(argv[1], lib) == NULL) fatal(argv[1]);
+
+    double scale = 1;
+    const char *only = NULL;
+    for (int i = 2; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) scale = atof(argv[++i]);
+        else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) only = argv[++i];
+        else usage();
+    }
+
+    char dir[] = "/tmp/sandbox_bench.XXXXXX";
+    if (mkdtemp(dir) == NULL) fatal("mkdtemp");
+
+    std::string fam = std::string(dir) + "/bench.fam";
+    write_manifest(fam.c_str());
+
+    long maxFiles = kStatFiles;
+    for (int i = 0; i < kWorkloadCount; i++)
+    {
+        if (kWorkloads[i].run == run_open_close) maxFiles = std::max(maxFiles, (long)(kWorkloads[i].baseOps * scale));
+    }
+
+    create_inputs(dir, maxFiles);
+
+    printf("%-12s %12s %12s %12s %8s\n", "workload", "ops", "native ns/op", "bxl ns/op", "ratio");
+    for (int i = 0; i < kWorkloadCount; i++)
+    {
+        if (only != NULL && strcmp(only, kWorkloads[i].name) != 0)
+        {
+            continue;
+        }
+
+        long ops = std::max(1L, (long)(kWorkloads[i].baseOps * scale));
+        double native = run_in_child(i, dir, ops, false, lib, fam.c_str());
+        double sandboxed = run_in_child(i, dir, ops, true, lib, fam.c_str());
+        printf("%-12s %12ld %12.1f %12.1f %7.2fx\n", kWorkloads[i].name, ops, native, sandboxed, sandboxed / native);
+        fflush(stdout);
+    }
+
+    std::string cleanup = std::string("rm -rf ") + dir;
+    return system(cleanup.c_str()) == 0 ? 0 : 1;
+}
@@ -0,0 +1,43 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+
+#include "fanotify_observer.hpp"
+
+/*
+ * bxl-fanotify <path>...
+ *
+ * Observes every filesystem one of the given paths is on, for the pips registered over stdin (see FanotifyObserver::Run),
+ * until stdin is closed.  Meant to be started once per build by the host, with CAP_SYS_ADMIN and CAP_DAC_READ_SEARCH.
+ */
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <path>...\n", argv[0]);
+        return 2;
+    }
+
+    // a pip whose host side went away must not take the helper down with it
+    signal(SIGPIPE, SIG_IGN);
+
+    FanotifyObserver observer;
+    if (!observer.IsValid())
+    {
+        fprintf(stderr, "Could not initialize fanotify; errno: %d\n", errno);
+        return 2;
+    }
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!observer.AddMount(argv[i]))
+        {
+            return 2;
+        }
+    }
+
+    return observer.Run(STDIN_FILENO);
+}
@@ -1,6 +1,8 @@
 // Copyright (c) Microsoft Corporation.
 // Licensed under the MIT License.
 
+#include <inttypes.h>
+
 #include "bxl_observer.hpp"
 #include "IOHandler.hpp"
 
@@ -10,26 +12,172 @@ static void HandleAccessReport(AccessReport report, int _)
 }
 
 AccessCheckResult BxlObserver::sNotChecked = AccessCheckResult::Invalid();
+thread_local int InterposeStats::sCurrentHook = 0;
+thread_local int InterposeStats::sStripe = 0;
+thread_local int OverheadBudget::sDepth = 0;
+thread_local uint64_t OverheadBudget::sRealNs = 0;
+thread_local uint64_t OverheadBudget::sPendingNs = 0;
+thread_local uint32_t OverheadBudget::sPendingCalls = 0;
+thread_local BxlObserver::CopyRangeMemo BxlObserver::sCopyRangeMemo = { -1, -1, NULL, NULL };
+thread_local ReportBuffers::Buffer *ReportBuffers::sCurrent = NULL;
+thread_local BxlObserver *BxlObserver::sConstructing = NULL;
+thread_local int ReentrancyGuard::sDepth = 0;
 
 BxlObserver* BxlObserver::GetInstance()
 {
+    // interposers entered (nested, see ReentrancyGuard) while this thread constructs the instance must not wait for it
+    if (__builtin_expect(sConstructing != NULL, 0))
+    {
+        return sConstructing;
+    }
+
     static BxlObserver s_singleton;
     return &s_singleton;
 }
 
 BxlObserver::BxlObserver()
 {
+    sConstructing = this;
     empty_str_ = "";
     real_readlink("/proc/self/exe", progFullPath_, PATH_MAX);
 
     const char *rootPidStr = getenv(BxlEnvRootPid);
     rootPid_ = is_null_or_empty(rootPidStr) ? -1 : atoi(rootPidStr);
     disposed_ = false;
+    reportsFd_ = -1;
+
+    const char *binaryReportsStr = getenv(BxlEnvBinaryReports);
+    binaryReports_ = !is_null_or_empty(binaryReportsStr) && strcmp(binaryReportsStr, "1") == 0;
+
+    const char *seccompStr = getenv(BxlEnvSeccompStaticProcesses);
+    superviseStaticProcesses_ = !is_null_or_empty(seccompStr) && strcmp(seccompStr, "1") == 0;
+
+    const char *statsStr = getenv(BxlEnvInterposeStats);
+    collectStats_ = !is_null_or_empty(statsStr) && strcmp(statsStr, "1") == 0;
+
+    const char *cachePrefixesStr = getenv(BxlEnvCacheResolvedPrefixes);
+    cacheResolvedPrefixes_ = !is_null_or_empty(cachePrefixesStr) && strcmp(cachePrefixesStr, "1") == 0;
+    reportingPid_ = 0;
+    progName_ = __progname;
 
     InitFam();
     InitLogFile();
     InitDetoursLibPath();
+    InitReportsRing();
+    InitProcessTree();
+    InitSharedReportCache();
+#ifdef BXL_AUDIT_LIBRARY
+    InitLoaderSearchCache();
+#endif
+
+    // hashes are sent as binary records (see ReportContentHash)
+    const char *hashOutputsStr = getenv(BxlEnvHashOutputs);
+    hashOutputs_ = binaryReports_ && !is_null_or_empty(hashOutputsStr) && strcmp(hashOutputsStr, "1") == 0;
+    outputHasher_.Init([](int fd, struct stat *st) { return BxlObserver::GetInstance()->real___fxstat(1, fd, st); });
+
+    // nothing can be denied natively in observe-only pips, so their reports can wait (see AccessSummary)
+    const char *deferReportsStr = getenv(BxlEnvDeferReports);
+    deferReports_ = binaryReports_ && IsValid() && pip_->IsObserveOnly() && !is_null_or_empty(deferReportsStr) && strcmp(deferReportsStr, "1") == 0;
+
+    const char *timedReportsStr = getenv(BxlEnvTimedReports);
+    timedReports_ = binaryReports_ && !is_null_or_empty(timedReportsStr) && strcmp(timedReportsStr, "1") == 0;
+    reportSequenceNumber_ = 0;
+
+    // degrading is reported with a binary record
+    const char *overheadBudgetStr = getenv(BxlEnvOverheadBudget);
+    int overheadBudgetPercent = binaryReports_ && IsValid() && !is_null_or_empty(overheadBudgetStr) ? atoi(overheadBudgetStr) : 0;
+    overheadBudget_.Init(overheadBudgetPercent > 0 ? (uint32_t)overheadBudgetPercent : 0, InterposeStats::NowNs());
+
+    if (binaryReports_ && pthread_key_create(&reportBufferKey_, OnThreadExit) != 0)
+    {
+        _fatal("Could not create a thread-specific data key; errno: %d", errno);
+    }
+
+    sConstructing = NULL;
+}
+
+void BxlObserver::InitReportsRing()
+{
+    ring_ = NULL;
+    ringAbandoned_ = false;
+
+    const char *ringPath = getenv(BxlEnvReportsRingPath);
+    if (is_null_or_empty(ringPath))
+    {
+        return;
+    }
+
+    size_t size;
+    void *mapped = MapSharedFile(ringPath, /* minSize */ BxlReportRingHeaderSize, /* writable */ true, &size);
+    ring_ = ReportRing::Create(mapped, size);
+    if (ring_ == NULL)
+    {
+        _fatal("File '%s' does not contain a valid reports ring", ringPath);
+    }
+
+    // the ring carries report packets
+    binaryReports_ = true;
+}
+
+void BxlObserver::InitProcessTree()
+{
+    const char *treePath = getenv(BxlEnvProcessTreePath);
+    if (is_null_or_empty(treePath))
+    {
+        return;
+    }
+
+    size_t size;
+    void *mapped = MapSharedFile(treePath, /* minSize */ 1, /* writable */ true, &size);
+    if (!processTree_.Attach(mapped, size))
+    {
+        _fatal("File '%s' does not contain a valid process tree", treePath);
+    }
+}
+
+void BxlObserver::InitSharedReportCache()
+{
+    programHash_ = SharedReportCache::HashProgram(progFullPath_);
+
+    const char *cachePath = getenv(BxlEnvSharedReportCachePath);
+    if (is_null_or_empty(cachePath))
+    {
+        return;
+    }
+
+    // buffered reports can be lost (e.g., when a process is killed before flushing them), in which case the shared
+    // cache would make the pip lose the accesses of other processes too
+    if (binaryReports_)
+    {
+        LOG_DEBUG("Not using shared report cache '%s': reports are binary", cachePath);
+        return;
+    }
+
+    size_t size;
+    void *mapped = MapSharedFile(cachePath, /* minSize */ 1, /* writable */ true, &size);
+    if (!sharedCache_.Attach(mapped, size))
+    {
+        _fatal("File '%s' does not contain a valid report cache", cachePath);
+    }
+}
+
+#ifdef BXL_AUDIT_LIBRARY
+void BxlObserver::InitLoaderSearchCache()
+{
+    const char *cachePath = getenv(BxlEnvLoaderSearchCachePath);
+    if (is_null_or_empty(cachePath))
+    {
+        return;
+    }
+
+    size_t size;
+    void *mapped = MapSharedFile(cachePath, /* minSize */ 1, /* writable */ true, &size);
+    if (!loaderSearchCache_.Attach(mapped, size))
+    {
+        _fatal("File '%s' does not contain a valid loader search cache", cachePath);
+    }
 }
+#endif
 
 void BxlObserver::InitDetoursLibPath()
 {
@@ -45,6 +193,41 @@ void BxlObserver::InitDetoursLibPath()
     }
 }
 
+// Maps all of the file 'path' (for good: the mapping is never unmapped) and returns its address and its size in 'size'.
+// A 'writable' mapping is shared with every other process mapping the file, a read-only one is private.  Files shorter than
+// 'minSize' bytes are fatal; with a 'minSize' of 0, an empty file is not mapped and null is returned.
+void* BxlObserver::MapSharedFile(const char *path, size_t minSize, bool writable, size_t *size)
+{
+    int fd = real_open(path, (writable ? O_RDWR : O_RDONLY) | O_CLOEXEC, 0);
+    if (fd == -1)
+    {
+        _fatal("Could not open file '%s'; errno: %d", path, errno);
+    }
+
+    struct stat st;
+    if (real___fxstat(1, fd, &st) != 0)
+    {
+        _fatal("Could not stat file '%s'; errno: %d", path, errno);
+    }
+
+    if ((size_t)st.st_size < minSize)
+    {
+        _fatal("File '%s' is too small (%lld bytes)", path, (long long)st.st_size);
+    }
+
+    *size = st.st_size;
+    void *mapped = *size > 0
+        ? mmap(NULL, *size, writable ? PROT_READ | PROT_WRITE : PROT_READ, writable ? MAP_SHARED : MAP_PRIVATE, fd, 0)
+        : NULL;
+    real_close(fd); // the mapping stays valid after the descriptor is closed
+    if (mapped == MAP_FAILED)
+    {
+        _fatal("Could not map file '%s'; errno: %d", path, errno);
+    }
+
+    return mapped;
+}
+
 void BxlObserver::InitFam()
 {
     // read FAM env var
@@ -55,24 +238,20 @@ void BxlObserver::InitFam()
         return;
     }
 
-    // read FAM
-    FILE *famFile = real_fopen(famPath, "rb");
-    if (!famFile)
-    {
-        _fatal("Could not open file '%s'; errno: %d", famPath, errno);
-    }
+    // map FAM: the manifest is position independent and used in place, so all processes
+    // of a pip share the same (page cache) pages of it and none of them copies the whole thing
+    size_t famLength;
+    const char *famPayload = (const char*)MapSharedFile(famPath, /* minSize */ 0, /* writable */ false, &famLength);
 
-    fseek(famFile, 0, SEEK_END);
-    long famLength = ftell(famFile);
-    rewind(famFile);
+    // map the base manifest tree the one of the FAM is overlaid on, if any: it is written once per build and shared
+    // by the processes of all pips, which only parse (and map the pages of) the delta tree of their own FAM
+    const char *famBasePath = getenv(BxlEnvFamBasePath);
+    size_t famBaseLength = 0;
+    const char *famBase = is_null_or_empty(famBasePath) ? nullptr : (const char*)MapSharedFile(famBasePath, /* minSize */ 0, /* writable */ false, &famBaseLength);
 
-    char *famPayload = (char *)malloc(famLength);
-    real_fread(famPayload, famLength, 1, famFile);
-    real_fclose(famFile);
-
-    // create SandboxedPip (which parses FAM and throws on error)
-    pip_ = shared_ptr<SandboxedPip>(new SandboxedPip(getpid(), famPayload, famLength));
-    free(famPayload);
+    // create SandboxedPip (which parses FAM and throws on error); the mappings are never unmapped,
+    // i.e., they outlive the pip (which lives as long as this process)
+    pip_ = shared_ptr<SandboxedPip>(new SandboxedPip(getpid(), famPayload, famLength, /* copyPayload */ false, famBase, famBaseLength));
 
     // create sandbox
     sandbox_ = new Sandbox(0, Configuration::DetoursLinuxSandboxType);
@@ -86,6 +265,12 @@ void BxlObserver::InitFam()
     process_ = sandbox_->FindTrackedProcess(getpid());
     process_->SetPath(progFullPath_);
     sandbox_->SetAccessReportCallback(HandleAccessReport);
+
+    const char *scopesStr = getenv(BxlEnvLexicalUntrackedScopes);
+    if (!is_null_or_empty(scopesStr) && strcmp(scopesStr, "1") == 0)
+    {
+        untrackedScopes_.Build(pip_->GetManifestRecord(), pip_->GetFamFlags(), pip_->GetManifestBaseRecord());
+    }
 }
 
 void BxlObserver::InitLogFile()
@@ -102,15 +287,10 @@ void BxlObserver::InitLogFile()
     }
 }
 
-bool BxlObserver::IsCacheHit(es_event_type_t event, const string &path, const string &secondPath)
+bool BxlObserver::GetCacheKey(es_event_type_t event, const string &secondPath, es_event_type_t *key)
 {
-    // (1) IMPORTANT           : never do any of this stuff after this object has been disposed!
-    //     WHY                 : because the cache date structure is invalid at that point.
-    //     HOW CAN THIS HAPPEN : we may get called from "on_exit" handlers, at which point the
-    //                           global BxlObserver singleton instance can already be disposed.
-    // (2) never cache FORK, EXEC, EXIT and events that take 2 paths
-    if (disposed_ ||
-        secondPath.length() > 0 ||
+    // never cache FORK, EXEC, EXIT and events that take 2 paths
+    if (secondPath.length() > 0 ||
         event == ES_EVENT_TYPE_NOTIFY_FORK ||
         event == ES_EVENT_TYPE_NOTIFY_EXEC ||
         event == ES_EVENT_TYPE_NOTIFY_EXIT)
@@ -119,7 +299,6 @@ bool BxlObserver::IsCacheHit(es_event_type_t event, const string &path, const st
     }
 
     // coalesce some similar events
-    es_event_type_t key;
     switch (event)
     {
         case ES_EVENT_TYPE_NOTIFY_TRUNCATE:
@@ -133,7 +312,7 @@ bool BxlObserver::IsCacheHit(es_event_type_t event, const string &path, const st
         case ES_EVENT_TYPE_NOTIFY_UTIMES:
         case ES_EVENT_TYPE_NOTIFY_SETTIME:
         case ES_EVENT_TYPE_NOTIFY_SETACL:
-            key = ES_EVENT_TYPE_NOTIFY_WRITE;
+            *key = ES_EVENT_TYPE_NOTIFY_WRITE;
             break;
 
         case ES_EVENT_TYPE_NOTIFY_GETATTRLIST:
@@ -141,102 +320,803 @@ bool BxlObserver::IsCacheHit(es_event_type_t event, const string &path, const st
         case ES_EVENT_TYPE_NOTIFY_LISTEXTATTR:
         case ES_EVENT_TYPE_NOTIFY_ACCESS:
         case ES_EVENT_TYPE_NOTIFY_STAT:
-            key = ES_EVENT_TYPE_NOTIFY_STAT;
+            *key = ES_EVENT_TYPE_NOTIFY_STAT;
+            break;
+
+        default:
+            *key = event;
+            break;
+    }
+
+    return true;
+}
+
+bool BxlObserver::IsCacheHit(es_event_type_t event, const string &path, const string &secondPath)
+{
+    // IMPORTANT           : never do any of this stuff after this object has been disposed!
+    // WHY                 : because the cache date structure is invalid at that point.
+    // HOW CAN THIS HAPPEN : we may get called from "on_exit" handlers, at which point the
+    //                       global BxlObserver singleton instance can already be disposed.
+    es_event_type_t key;
+    if (disposed_ || !GetCacheKey(event, secondPath, &key))
+    {
+        return false;
+    }
+
+    // Lock-free (see report_cache.hpp): this code could possibly be executing from an interrupt routine
+    // or from who knows where, so to avoid deadlocks it's essential to never block here.
+    bool hit = cache_.CheckAndAdd(reportingPid_, key, path.c_str(), path.length());
+
+    // not seen by this process: maybe some other process of the pip already reported it (see shared_report_cache.hpp)
+    if (!hit && UsesSharedCache())
+    {
+        hit = sharedCache_.Contains(programHash_, key, path.c_str(), path.length());
+    }
+
+    sandboxCounters_.Add(hit ? kSandboxStatCacheHits : kSandboxStatCacheMisses, 1);
+    if (hit && collectStats_)
+    {
+        interposeStats_.AddToCurrent(kInterposeCacheHits, 1);
+    }
+
+    return hit;
+}
+
+void BxlObserver::AddToSharedCache(es_event_type_t event, const string &path, const string &secondPath)
+{
+    es_event_type_t key;
+    if (!disposed_ && UsesSharedCache() && GetCacheKey(event, secondPath, &key))
+    {
+        sharedCache_.Add(programHash_, key, path.c_str(), path.length());
+    }
+}
+
+int BxlObserver::GetReportsFd()
+{
+    int fd = reportsFd_.load();
+    if (fd != -1)
+    {
+        return fd;
+    }
+
+    if (!real_open)
+    {
+        _fatal("syscall 'open' not found; errno: %d", errno);
+    }
+
+    const char *reportsPath = GetReportsPath();
+    fd = real_open(reportsPath, O_WRONLY | O_APPEND | O_CLOEXEC, 0);
+    if (fd == -1)
+    {
+        _fatal("Could not open file '%s'; errno: %d", reportsPath, errno);
+    }
+
+    // never occupy one of the standard descriptors: if the host program closed any of those, it
+    // may later (re)open a file expecting to get that descriptor number back and write into it
+    if (fd <= STDERR_FILENO)
+    {
+        int highFd = fcntl(fd, F_DUPFD_CLOEXEC, STDERR_FILENO + 1);
+        if (highFd == -1)
+        {
+            _fatal("Could not duplicate file descriptor %d for '%s'; errno: %d", fd, reportsPath, errno);
+        }
+
+        real_close(fd);
+        fd = highFd;
+    }
+
+    // another thread could have opened the reports file in the meantime --> keep theirs
+    int expected = -1;
+    if (!reportsFd_.compare_exchange_strong(expected, fd))
+    {
+        real_close(fd);
+        fd = expected;
+    }
+
+    return fd;
+}
+
+bool BxlObserver::Send(const char *buf, size_t bufsiz)
+{
+    struct iovec iov = { (void*)buf, bufsiz };
+    return Send(&iov, 1, bufsiz);
+}
+
+bool BxlObserver::Send(const struct iovec *iov, int iovcnt, size_t bufsiz)
+{
+    // TODO: instead of failing, implement a critical section
+    if (bufsiz > PIPE_BUF)
+    {
+        _fatal("Cannot atomically send a buffer whose size (%ld) is greater than PIPE_BUF (%d)", bufsiz, PIPE_BUF);
+    }
+
+    sandboxCounters_.Add(kSandboxStatBytesSent, bufsiz);
+    return ring_ && !ringAbandoned_.load(std::memory_order_relaxed)
+        ? SendToRing(iov, iovcnt, bufsiz)
+        : SendToFifo(iov, iovcnt, bufsiz);
+}
+
+bool BxlObserver::SendToRing(const struct iovec *iov, int iovcnt, size_t bufsiz)
+{
+    bool ringDoorbell;
+    uint64_t depth;
+    uint64_t waitStartNs = 0;
+    int numAttempts = 0;
+    while (!ring_->TryEnqueue(iov, iovcnt, bufsiz, (uint32_t)getpid(), ringDoorbell, depth))
+    {
+        // the ring is full: wait for the reader to catch up (instead of falling back to the FIFO, which would
+        // reorder reports).  Every now and then, ring the doorbell in case the reader is waiting; that also
+        // makes us fail (instead of waiting forever) if the reader is gone.
+        if (++numAttempts % 64 == 0)
+        {
+            RingDoorbell();
+
+            // the reader is not catching up (e.g., it is stuck behind a slot that a live but stopped process claimed):
+            // send this packet and all the following ones of this process through the FIFO.  Reports of this process
+            // may then reach the host out of order, which beats waiting forever.
+            uint64_t nowNs = InterposeStats::NowNs();
+            if (waitStartNs == 0)
+            {
+                waitStartNs = nowNs;
+            }
+            else if (nowNs - waitStartNs > kRingFullTimeoutNs)
+            {
+                LOG_DEBUG("Reports ring still full after %lums: falling back to the reports FIFO", (nowNs - waitStartNs) / 1000000);
+                ringAbandoned_.store(true, std::memory_order_relaxed);
+                return SendToFifo(iov, iovcnt, bufsiz);
+            }
+
+            usleep(100);
+        }
+        else
+        {
+            sched_yield();
+        }
+    }
+
+    sandboxCounters_.Max(kSandboxStatQueueHighWater, depth);
+    if (ringDoorbell)
+    {
+        RingDoorbell();
+    }
+
+    return true;
+}
+
+void BxlObserver::RingDoorbell()
+{
+    ReportPacketHeader doorbell = { 0 };
+    struct iovec iov = { &doorbell, sizeof(doorbell) };
+    SendToFifo(&iov, 1, sizeof(doorbell));
+}
+
+bool BxlObserver::SendToFifo(const struct iovec *iov, int iovcnt, size_t bufsiz)
+{
+    ssize_t numWritten;
+    bool reopened = false;
+    while (true)
+    {
+        int fd = GetReportsFd();
+        numWritten = iovcnt == 1
+            ? real_write(fd, iov[0].iov_base, iov[0].iov_len)
+            : real_writev(fd, iov, iovcnt);
+        if (numWritten == -1 && errno == EINTR)
+        {
+            continue;
+        }
+
+        // the descriptor was closed behind our back (e.g., via a raw syscall) --> reopen once
+        if (numWritten == -1 && errno == EBADF && !reopened)
+        {
+            int expected = fd;
+            reportsFd_.compare_exchange_strong(expected, -1);
+            reopened = true;
+            continue;
+        }
+
+        break;
+    }
+
+    if (numWritten < bufsiz)
+    {
+        _fatal("Wrote only %ld bytes out of %ld", numWritten, bufsiz);
+    }
+
+    return true;
+}
+
+bool BxlObserver::SendReport(AccessReport &report)
+{
+    // there is no central sendbox process here (i.e., there is an instance of this
+    // guy in every child process), so the process tree size counted by the access
+    // handler is meaningless; see ReportProcessTreeCompleted instead
+    if (report.operation == FileOperation::kOpProcessTreeCompleted)
+    {
+        return true;
+    }
+
+    if (collectStats_)
+    {
+        interposeStats_.AddToCurrent(kInterposeReports, 1);
+    }
+
+    return binaryReports_
+        ? SendBinaryReport(report)
+        : SendTextReport(report);
+}
+
+bool BxlObserver::SendTextReport(AccessReport &report)
+{
+    const int PrefixLength = sizeof(uint);
+    char buffer[PIPE_BUF] = {0};
+    int maxMessageLength = PIPE_BUF - PrefixLength;
+    sandboxCounters_.Add(kSandboxStatReportsSent, 1);
+    int numWritten = snprintf(
+        &buffer[PrefixLength], maxMessageLength, "%s|%d|%d|%d|%d|%d|%d|%s\n",
+        progName_, GetReportingPid(), report.requestedAccess, report.status, report.reportExplicitly, report.error, report.operation, report.path);
+    if (numWritten == maxMessageLength)
+    {
+        // TODO: once 'send' is capable of sending more than PIPE_BUF at once, allocate a bigger buffer and send that
+        _fatal("Message truncated to fit PIPE_BUF (%d): %s", PIPE_BUF, buffer);
+    }
+
+    LOG_DEBUG("Sending report: %s", &buffer[PrefixLength]);
+    *(uint*)(buffer) = numWritten;
+    return Send(buffer, numWritten + PrefixLength);
+}
+
+bool BxlObserver::SendBinaryReport(AccessReport &report)
+{
+    size_t pathLength = strnlen(report.path, sizeof(report.path));
+    ReportRecordHeader record = MakeReportRecordHeader(kReportRecordAccess, (uint32_t)GetReportingPid(), pathLength);
+    record.requestedAccess = (uint32_t)report.requestedAccess;
+    record.status          = (uint32_t)report.status;
+    record.flags           = report.reportExplicitly ? kAccessRecordFlagReportExplicitly : 0;
+    record.error           = (uint32_t)report.error;
+    record.operation       = (uint32_t)report.operation;
+
+    LOG_DEBUG("Sending report: %d|%d|%d|%d|%d|%d|%s", record.pid, record.requestedAccess, record.status,
+        report.reportExplicitly, record.error, record.operation, report.path);
+
+    // process lifecycle events are never deferred, and a process must not be reported as exited before its accesses are
+    if (deferReports_ && !disposed_)
+    {
+        if (report.operation == FileOperation::kOpProcessExit)
+        {
+            FlushAccessSummary();
+        }
+        else if (report.operation != FileOperation::kOpProcessStart && report.operation != FileOperation::kOpProcessTreeCompleted &&
+            accessSummary_.Add(record.pid, record.operation, record.requestedAccess, record.status, (uint32_t)report.reportExplicitly, record.error,
+                report.path, pathLength, [this](uint32_t pid, const uint8_t *bytes, size_t length) { SendAccessSummary(pid, bytes, length); }))
+        {
+            sandboxCounters_.Add(kSandboxStatReportsCoalesced, 1);
+            return true;
+        }
+    }
+
+    sandboxCounters_.Add(kSandboxStatReportsSent, 1);
+
+    // the buffers must not be touched once this object has been disposed (e.g., when reporting from "on_exit" handlers)
+    if (disposed_)
+    {
+        return SendRecordUnbuffered(record, report.path, pathLength);
+    }
+
+    ReportBuffers::Buffer *buffer = GetReportBuffer();
+
+    // reports of the same path must reach the host in the order they were made: first send the report
+    // another thread may still be holding on to (see report_buffers.hpp)
+    uint32_t pathHash = ReportBuffers::HashPath(report.path, pathLength);
+    ReportBuffers::Buffer *pending = reportBuffers_.FindPending(buffer, pathHash);
+    if (pending != NULL)
+    {
+        FlushBuffer(pending);
+    }
+
+    // this code could also be executing from an interrupt routine, so never block here indefinitely.
+    if (!buffer->mtx.try_lock_for(chrono::milliseconds(1)))
+    {
+        return SendRecordUnbuffered(record, report.path, pathLength);
+    }
+
+    // ============================== in the critical section ================================
+
+    record.processNameId = InternProcessNameUnlocked(buffer, record.pid);
+    AppendRecordToBuffer(buffer, record, report.path, pathLength);
+    reportBuffers_.SetPending(buffer, pathHash);
+
+    // don't hold on to process lifecycle events: the host uses them to track the set of active processes
+    if (report.operation == FileOperation::kOpProcessStart || report.operation == FileOperation::kOpProcessExit)
+    {
+        FlushBufferUnlocked(buffer);
+    }
+
+    buffer->mtx.unlock();
+
+    // ========================================================================================
+
+    uint64_t now = ReportBuffers::NowNs();
+    if (reportBuffers_.ShouldSweep(now))
+    {
+        FlushStaleBuffers(now);
+    }
+
+    return true;
+}
+
+ReportBuffers::Buffer* BxlObserver::GetReportBuffer()
+{
+    bool claimed;
+    ReportBuffers::Buffer *buffer = reportBuffers_.Current((int)syscall(SYS_gettid), &claimed);
+    if (claimed)
+    {
+        // give the buffer back when this thread exits
+        pthread_setspecific(reportBufferKey_, buffer);
+    }
+
+    return buffer;
+}
+
+void BxlObserver::OnThreadExit(void *buffer)
+{
+    BxlObserver *bxl = BxlObserver::GetInstance();
+    ReportBuffers::Buffer *threadBuffer = (ReportBuffers::Buffer*)buffer;
+    if (!bxl->disposed_)
+    {
+        bxl->FlushBuffer(threadBuffer);
+    }
+
+    bxl->reportBuffers_.Release(threadBuffer);
+}
+
+uint32_t BxlObserver::InternProcessNameUnlocked(ReportBuffers::Buffer *buffer, uint32_t pid)
+{
+    // the process name is interned: it is sent once per process (and buffer, which is what keeps it
+    // ahead of the records referring to it) and then referred to by its id
+    const uint32_t ProcessNameId = 1;
+    if (buffer->processNameSentFor != pid)
+    {
+        size_t nameLength = strnlen(progName_, PATH_MAX);
+        ReportRecordHeader nameRecord = MakeReportRecordHeader(kReportRecordProcessName, pid, nameLength);
+        nameRecord.processNameId = ProcessNameId;
+        AppendRecordToBuffer(buffer, nameRecord, progName_, nameLength);
+        buffer->processNameSentFor = pid;
+    }
+
+    return ProcessNameId;
+}
+
+void BxlObserver::ReportStats()
+{
+    if (!binaryReports_ || disposed_)
+    {
+        return;
+    }
+
+    SandboxStats sandboxStats = MakeSandboxStats();
+    sandboxCounters_.Collect(sandboxStats);
+    SendBufferedRecord(kReportRecordSandboxStats, (uint32_t)GetReportingPid(), (const char*)&sandboxStats, sizeof(sandboxStats));
+
+    if (!collectStats_)
+    {
+        return;
+    }
+
+    char stats[8192];
+    size_t length = interposeStats_.Collect(stats, sizeof(stats));
+    if (length > 0)
+    {
+        SendBufferedRecord(kReportRecordInterposeStats, (uint32_t)GetReportingPid(), stats, length);
+    }
+}
+
+void BxlObserver::SendBufferedRecord(ReportRecordKind kind, uint32_t pid, const char *payload, size_t length)
+{
+    ReportRecordHeader record = MakeReportRecordHeader(kind, pid, length);
+
+    ReportBuffers::Buffer *buffer = GetReportBuffer();
+    if (!buffer->mtx.try_lock_for(chrono::milliseconds(1)))
+    {
+        SendRecordUnbuffered(record, payload, length);
+        return;
+    }
+
+    record.processNameId = InternProcessNameUnlocked(buffer, record.pid);
+    AppendRecordToBuffer(buffer, record, payload, length);
+    buffer->mtx.unlock();
+}
+
+void BxlObserver::ReportContentHash(const char *path, size_t pathLength, const uint8_t *hash, const struct stat &st)
+{
+    if (disposed_)
+    {
+        return;
+    }
+
+    // CODESYNC: Public/Src/Engine/Processes/SandboxConnectionLinuxDetours.cs
+    char str[PATH_MAX + 128];
+    size_t length = 0;
+    for (size_t i = 0; i < OutputHasher::kHashSize; i++)
+    {
+        length += sprintf(&str[length], "%02x", hash[i]);
+    }
+
+    length += snprintf(&str[length], sizeof(str) - length, "|%lld|%lld|%ld|%llu|%s",
+        (long long)st.st_size, (long long)st.st_mtim.tv_sec, (long)st.st_mtim.tv_nsec, (unsigned long long)st.st_ino, path);
+    if (length >= sizeof(str))
+    {
+        return;
+    }
+
+    SendBufferedRecord(kReportRecordContentHash, (uint32_t)GetReportingPid(), str, length);
+}
+
+void BxlObserver::SendAccessSummary(uint32_t pid, const uint8_t *bytes, size_t length)
+{
+    SendBufferedRecord(kReportRecordAccessSummary, pid, (const char*)bytes, length);
+}
+
+void BxlObserver::ExceedOverheadBudget(uint64_t nowNs)
+{
+    if (disposed_)
+    {
+        return;
+    }
+
+    const char *mode = "none";
+    if (pip_->IsObserveOnly())
+    {
+        mode = "deferReports";
+        deferReports_ = true;
+    }
+
+    char payload[128];
+    int length = snprintf(payload, sizeof(payload), "%" PRIu64 "|%" PRIu64 "|%u|%s",
+        overheadBudget_.GetOverheadNs(), overheadBudget_.GetWallNs(nowNs), overheadBudget_.GetBudgetPercent(), mode);
+
+    LOG_DEBUG("Overhead budget exceeded: %s", payload);
+    SendBufferedRecord(kReportRecordOverheadBudgetExceeded, (uint32_t)GetReportingPid(), payload, (size_t)length);
+}
+
+void BxlObserver::FlushAccessSummary()
+{
+    if (!deferReports_ || disposed_)
+    {
+        return;
+    }
+
+    accessSummary_.Flush([this](uint32_t pid, const uint8_t *bytes, size_t length) { SendAccessSummary(pid, bytes, length); });
+}
+
+void BxlObserver::AppendRecordToBuffer(ReportBuffers::Buffer *buffer, const ReportRecordHeader &record, const char *str, size_t strLength)
+{
+    // records that can never fit in a single packet are sent right away (after everything buffered before them)
+    if (sizeof(ReportPacketHeader) + RecordLength(record) > sizeof(buffer->data))
+    {
+        FlushBufferUnlocked(buffer);
+        SendRecordUnbuffered(record, str, strLength);
+        return;
+    }
+
+    if (buffer->length + RecordLength(record) > sizeof(buffer->data))
+    {
+        FlushBufferUnlocked(buffer);
+    }
+
+    if (buffer->length == 0)
+    {
+        buffer->length = sizeof(ReportPacketHeader);
+        buffer->firstRecordNs = ReportBuffers::NowNs();
+    }
+
+    ReportRecordHeader header = record;
+    AccessReportRecordTiming timing;
+    size_t headerLength = TimeRecord(header, timing);
+
+    memcpy(&buffer->data[buffer->length], &header, sizeof(ReportRecordHeader));
+    memcpy(&buffer->data[buffer->length + sizeof(ReportRecordHeader)], &timing, headerLength - sizeof(ReportRecordHeader));
+    memcpy(&buffer->data[buffer->length + headerLength], str, strLength);
+    buffer->length += header.length;
+}
+
+size_t BxlObserver::TimeRecord(ReportRecordHeader &record, AccessReportRecordTiming &timing)
+{
+    if (!timedReports_)
+    {
+        return sizeof(ReportRecordHeader);
+    }
+
+    // the timestamp is taken when the record is sent (or buffered): for deferred accesses (see AccessSummary), that is
+    // when their summary is sent
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    timing.timestamp = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    timing.sequenceNumber = reportSequenceNumber_.fetch_add(1, std::memory_order_relaxed) + 1;
+
+    record.flags      |= kAccessRecordFlagTimed;
+    record.headerSize += sizeof(AccessReportRecordTiming);
+    record.length     += sizeof(AccessReportRecordTiming);
+    return record.headerSize;
+}
+
+void BxlObserver::FlushBufferUnlocked(ReportBuffers::Buffer *buffer)
+{
+    if (buffer->length == 0)
+    {
+        return;
+    }
+
+    ReportPacketHeader *header = (ReportPacketHeader*)buffer->data;
+    header->length   = (uint32_t)(buffer->length - sizeof(ReportPacketHeader));
+    header->writerId = (uint32_t)syscall(SYS_gettid);
+    header->flags    = 0;
+
+    Send(buffer->data, buffer->length);
+    buffer->length = 0;
+
+    // whatever was pending in this buffer has been sent (see ReportBuffers::FindPending)
+    buffer->generation.fetch_add(1, std::memory_order_release);
+}
+
+void BxlObserver::FlushBuffer(ReportBuffers::Buffer *buffer)
+{
+    if (!buffer->mtx.try_lock_for(chrono::milliseconds(1)))
+    {
+        return;
+    }
+
+    FlushBufferUnlocked(buffer);
+    buffer->mtx.unlock();
+}
+
+void BxlObserver::FlushStaleBuffers(uint64_t now)
+{
+    reportBuffers_.ForEach([this, now](ReportBuffers::Buffer *buffer)
+    {
+        // only the owner and flushes ever take the lock, so it is (almost) never contended
+        if (buffer->mtx.try_lock())
+        {
+            if (buffer->length > 0 && now - buffer->firstRecordNs >= ReportBuffers::kMaxAgeNs)
+            {
+                FlushBufferUnlocked(buffer);
+            }
+
+            buffer->mtx.unlock();
+        }
+    });
+}
+
+bool BxlObserver::SendRecordUnbuffered(const ReportRecordHeader &record, const char *str, size_t strLength)
+{
+    // send the record in as many packets as needed; every packet is written atomically and all of
+    // them (except for the last one) are flagged so the reader knows to wait for more fragments
+    const size_t MaxPayloadLength = BxlReportPacketMaxSize - sizeof(ReportPacketHeader);
+    ReportPacketHeader header = { 0 };
+    header.writerId = (uint32_t)syscall(SYS_gettid);
+
+    // the header and its (timing) extension are contiguous
+    char headerBytes[sizeof(ReportRecordHeader) + sizeof(AccessReportRecordTiming)];
+    ReportRecordHeader timedRecord = record;
+    AccessReportRecordTiming timing;
+    size_t headerLength = TimeRecord(timedRecord, timing);
+    memcpy(headerBytes, &timedRecord, sizeof(ReportRecordHeader));
+    memcpy(headerBytes + sizeof(ReportRecordHeader), &timing, headerLength - sizeof(ReportRecordHeader));
+
+    size_t headerOffset = 0;
+    size_t strOffset = 0;
+    while (headerOffset < headerLength || strOffset < strLength)
+    {
+        struct iovec iov[3];
+        int iovcnt = 1;
+        size_t payloadLength = 0;
+
+        if (headerOffset < headerLength)
+        {
+            size_t n = std::min(headerLength - headerOffset, MaxPayloadLength);
+            iov[iovcnt++] = { (void*)(headerBytes + headerOffset), n };
+            headerOffset += n;
+            payloadLength += n;
+        }
+
+        if (payloadLength < MaxPayloadLength && strOffset < strLength)
+        {
+            size_t n = std::min(strLength - strOffset, MaxPayloadLength - payloadLength);
+            iov[iovcnt++] = { (void*)(str + strOffset), n };
+            strOffset += n;
+            payloadLength += n;
+        }
+
+        bool isLast = headerOffset == headerLength && strOffset == strLength;
+        header.length = (uint32_t)payloadLength;
+        header.flags  = isLast ? 0 : kReportPacketMoreFragments;
+        iov[0] = { &header, sizeof(ReportPacketHeader) };
+
+        Send(iov, iovcnt, sizeof(ReportPacketHeader) + payloadLength);
+    }
+
+    return true;
+}
+
+void BxlObserver::FlushReports()
+{
+    if (!binaryReports_ || disposed_)
+    {
+        return;
+    }
+
+    FlushAccessSummary();
+    reportBuffers_.ForEach([this](ReportBuffers::Buffer *buffer) { FlushBuffer(buffer); });
+}
+
+void BxlObserver::ResetStateAfterFork()
+{
+    cache_.Clear();
+
+    // counters collected so far belong to the parent
+    if (collectStats_)
+    {
+        interposeStats_.Clear();
+    }
+
+    sandboxCounters_.Clear();
+
+    // the records of the child are numbered on their own
+    reportSequenceNumber_ = 0;
+
+    ioUring_.ResetAfterFork();
+    outputHasher_.ResetAfterFork();
+    accessSummary_.ResetAfterFork();
+    overheadBudget_.ResetAfterFork(InterposeStats::NowNs());
+
+    // reports sent through the memo (and the fd table flags) were sent by the parent
+    sCopyRangeMemo.fdIn = -1;
+    fdTable_.ClearWriteReported();
+
+    // the parent reserved a slot for us (see BeginChildProcess), which only we can claim before we exit
+    if (TracksChildProcesses())
+    {
+        processTree_.Adopt(getpid());
+    }
 
-        default:
-            key = event;
-            break;
+    // the cwd (and resolved prefixes) are inherited, but the cwd cache could have been in the middle of an update
+    new (&cwdMtx_) std::mutex();
+    if (cwdSeq_.load(std::memory_order_relaxed) & 1)
+    {
+        cwdLength_ = 0;
+        cwdSeq_.fetch_add(1, std::memory_order_relaxed);
     }
 
-    // This code could possibly be executing from an interrupt routine or from who knows where,
-    // so to avoid deadlocks it's essential to never block here indefinitely.
-    if (!cacheMtx_.try_lock_for(chrono::milliseconds(1)))
+    if (!binaryReports_)
     {
-        return false; // failed to acquire mutex -> forget about it
+        return;
     }
 
-    // ============================== in the critical section ================================
+    reportBuffers_.ResetAfterFork((int)syscall(SYS_gettid));
+}
 
-    // make sure the mutex is released by the end
-    shared_ptr<timed_mutex> sp(&cacheMtx_, [](timed_mutex *mtx) { mtx->unlock(); });
+void BxlObserver::ReportOnBehalfOf(pid_t pid, const char *exePath)
+{
+    // the summary is sent along with the name of the process it belongs to
+    FlushAccessSummary();
 
-    unordered_map<es_event_type_t, unordered_set<string>>::iterator it = cache_.find(key);
-    if (it == cache_.end())
-    {
-        unordered_set<string> set;
-        set.insert(path);
-        cache_.insert(make_pair(key, set));
-        return false;
-    }
+    reportingPid_ = pid;
+    strlcpy(progFullPath_, exePath, PATH_MAX);
+    const char *lastSlash = strrchr(progFullPath_, '/');
+    progName_ = lastSlash ? lastSlash + 1 : progFullPath_;
 
-    return !it->second.insert(path).second;
+    process_ = shared_ptr<SandboxedProcess>(new SandboxedProcess(pid, pip_));
+    process_->SetPath(progFullPath_);
 }
 
-bool BxlObserver::Send(const char *buf, size_t bufsiz)
+void BxlObserver::report_exec(const char *syscallName, const char *procName, const char *file)
 {
-    if (!real_open)
-    {
-        _fatal("syscall 'open' not found; errno: %d", errno);
-    }
+    // first report 'procName' as is (without trying to resolve it) to ensure that a process name is reported before anything else
+    report_access(syscallName, ES_EVENT_TYPE_NOTIFY_EXEC, std::string(procName), empty_str_);
+    report_access(syscallName, ES_EVENT_TYPE_NOTIFY_EXEC, file);
+}
 
-    // TODO: instead of failing, implement a critical section
-    if (bufsiz > PIPE_BUF)
+void BxlObserver::report_child_process(const char *syscallName, pid_t childPid, const char *childPath)
+{
+    // Same report as IOHandler::HandleProcessFork sends, built (on the stack) and sent directly.  That handler also
+    // tracks the child in our Sandbox, which nothing consults here: every child gets its own BxlObserver.
+    if (!ReportsChildProcesses())
     {
-        _fatal("Cannot atomically send a buffer whose size (%ld) is greater than PIPE_BUF (%d)", bufsiz, PIPE_BUF);
+        return;
     }
 
-    const char *reportsPath = GetReportsPath();
-    int logFd = real_open(reportsPath, O_WRONLY | O_APPEND, 0);
-    if (logFd == -1)
+    AccessReport report =
     {
-        _fatal("Could not open file '%s'; errno: %d", reportsPath, errno);
-    }
+        .operation          = kOpProcessStart,
+        .pid                = childPid,
+        .rootPid            = pip_->GetProcessId(),
+        .requestedAccess    = (int)RequestedAccess::Read,
+        .status             = FileAccessStatus::FileAccessStatus_Allowed,
+        .reportExplicitly   = 0,
+        .error              = 0,
+        .pipId              = pip_->GetPipId(),
+        .path               = {0},
+        .stats              = {0}
+    };
+
+    strlcpy(report.path, childPath != NULL ? childPath : progFullPath_, sizeof(report.path));
+    LOG_DEBUG("(( %10s:%2d )) %s [Child: %d]", syscallName, ES_EVENT_TYPE_NOTIFY_FORK, report.path, childPid);
+    SendReport(report);
+}
 
-    ssize_t numWritten = real_write(logFd, buf, bufsiz);
-    if (numWritten < bufsiz)
+bool BxlObserver::BeginChildProcess()
+{
+    if (!TracksChildProcesses())
     {
-        _fatal("Wrote only %ld bytes out of %ld", numWritten, bufsiz);
+        return false;
     }
 
-    real_close(logFd);
+    processTree_.Reserve();
     return true;
 }
 
-bool BxlObserver::SendReport(AccessReport &report)
+void BxlObserver::EndChildProcess(bool begun, pid_t childPid, bool forked)
 {
-    // there is no central sendbox process here (i.e., there is an instance of this
-    // guy in every child process), so counting process tree size is not feasible
-    if (report.operation == FileOperation::kOpProcessTreeCompleted)
+    if (!begun)
     {
-        return true;
+        return;
     }
 
-    const int PrefixLength = sizeof(uint);
-    char buffer[PIPE_BUF] = {0};
-    int maxMessageLength = PIPE_BUF - PrefixLength;
-    int numWritten = snprintf(
-        &buffer[PrefixLength], maxMessageLength, "%s|%d|%d|%d|%d|%d|%d|%s\n",
-        __progname, getpid(), report.requestedAccess, report.status, report.reportExplicitly, report.error, report.operation, report.path);
-    if (numWritten == maxMessageLength)
+    // a forked child claims its slot itself: marking it here could mark a child that has already exited
+    bool tracked = childPid > 0 && (forked ? processTree_.CanTrack(childPid) : processTree_.Adopt(childPid));
+    if (!tracked && processTree_.Release())
     {
-        // TODO: once 'send' is capable of sending more than PIPE_BUF at once, allocate a bigger buffer and send that
-        _fatal("Message truncated to fit PIPE_BUF (%d): %s", PIPE_BUF, buffer);
+        ReportProcessTreeCompleted();
     }
+}
 
-    LOG_DEBUG("Sending report: %s", &buffer[PrefixLength]);
-    *(uint*)(buffer) = numWritten;
-    return Send(buffer, numWritten + PrefixLength);
+void BxlObserver::LeaveProcessTree()
+{
+    if (processTree_.IsAttached() && processTree_.Leave(getpid()))
+    {
+        ReportProcessTreeCompleted();
+    }
 }
 
-void BxlObserver::report_exec(const char *syscallName, const char *procName, const char *file)
+void BxlObserver::ReportProcessTreeCompleted()
 {
-    // first report 'procName' as is (without trying to resolve it) to ensure that a process name is reported before anything else
-    report_access(syscallName, ES_EVENT_TYPE_NOTIFY_EXEC, std::string(procName), empty_str_);
-    report_access(syscallName, ES_EVENT_TYPE_NOTIFY_EXEC, file);
+    if (!IsValid())
+    {
+        return;
+    }
+
+    AccessReport report =
+    {
+        .operation          = kOpProcessTreeCompleted,
+        .pid                = getpid(),
+        .rootPid            = pip_->GetProcessId(),
+        .requestedAccess    = (int)RequestedAccess::None,
+        .status             = FileAccessStatus::FileAccessStatus_Allowed,
+        .reportExplicitly   = 0,
+        .error              = 0,
+        .pipId              = pip_->GetPipId(),
+        .path               = {0},
+        .stats              = {0}
+    };
+
+    LOG_DEBUG("Process tree of pip %llx completed", (unsigned long long)pip_->GetPipId());
+    if (binaryReports_)
+    {
+        SendBinaryReport(report);
+        FlushReports();
+    }
+    else
+    {
+        SendTextReport(report);
+    }
 }
 
 AccessCheckResult BxlObserver::report_access(const char *syscallName, es_event_type_t eventType, const std::string &reportPath, const std::string &secondPath)
 {
+    if (ReentrancyGuard::IsNested())
+    {
+        return sNotChecked;
+    }
+
     if (IsCacheHit(eventType, reportPath, secondPath))
     {
         return sNotChecked;
@@ -249,12 +1129,19 @@ AccessCheckResult BxlObserver::report_access(const char *syscallName, es_event_t
         ? reportPath
         : std::string(progFullPath_);
 
-    IOEvent event(getpid(), 0, getppid(), eventType, ES_ACTION_TYPE_NOTIFY, reportPath, secondPath, execPath, mode, false);
+    pid_t pid = GetReportingPid();
+    pid_t ppid = reportingPid_ != 0 ? 0 : getppid();
+    IOEvent event(pid, 0, ppid, eventType, ES_ACTION_TYPE_NOTIFY, reportPath, secondPath, execPath, mode, false);
     return report_access(syscallName, event, /* checkCache */ false /* because already checked cache above */);
 }
 
 AccessCheckResult BxlObserver::report_access(const char *syscallName, IOEvent &event, bool checkCache)
 {
+    if (ReentrancyGuard::IsNested())
+    {
+        return sNotChecked;
+    }
+
     es_event_type_t eventType = event.GetEventType();
 
     if (checkCache && IsCacheHit(eventType, event.GetSrcPath(), event.GetDstPath()))
@@ -271,6 +1158,12 @@ AccessCheckResult BxlObserver::report_access(const char *syscallName, IOEvent &e
         result = handler.HandleEvent(event);
     }
 
+    // the report (if any) has been written by now; denied accesses must keep being checked by every process
+    if (!result.ShouldDenyAccess())
+    {
+        AddToSharedCache(eventType, event.GetSrcPath(), event.GetDstPath());
+    }
+
     LOG_DEBUG("(( %10s:%2d )) %s %s%s", syscallName, event.GetEventType(), event.GetEventPath(),
         !result.ShouldReport() ? "[Ignored]" : result.ShouldDenyAccess() ? "[Denied]" : "[Allowed]",
         result.ShouldDenyAccess() && IsFailingUnexpectedAccesses() ? "[Blocked]" : "");
@@ -280,19 +1173,166 @@ AccessCheckResult BxlObserver::report_access(const char *syscallName, IOEvent &e
 
 AccessCheckResult BxlObserver::report_access(const char *syscallName, es_event_type_t eventType, const char *pathname, int flags)
 {
-    return report_access(syscallName, eventType, normalize_path(pathname, flags), "");
+    // accesses of the observer's own internals (see ReentrancyGuard) are neither resolved nor reported
+    if (ReentrancyGuard::IsNested())
+    {
+        return sNotChecked;
+    }
+
+    // executables are always resolved: the resolved path is what the process is known by
+    if (eventType == ES_EVENT_TYPE_NOTIFY_EXEC)
+    {
+        return report_access(syscallName, eventType, normalize_path(pathname, flags, /* resolveUntracked */ true), "");
+    }
+
+    return IsLexicallyUntracked(pathname)
+        ? sNotChecked
+        : report_access(syscallName, eventType, normalize_path(pathname, flags), "");
 }
 
 AccessCheckResult BxlObserver::report_access_fd(const char *syscallName, es_event_type_t eventType, int fd)
 {
+    if (ReentrancyGuard::IsNested())
+    {
+        return sNotChecked;
+    }
+
     std::string fullpath = fd_to_path(fd);
-    return fullpath[0] == '/'
+    return fullpath[0] == '/' && !IsLexicallyUntracked(fullpath.c_str())
         ? report_access(syscallName, eventType, fullpath, empty_str_)
         : sNotChecked; // this file descriptor is a non-file (e.g., a pipe, or socket, etc.) so we don't care about it
 }
 
+AccessCheckResult BxlObserver::report_copy_range(const char *syscallName, int fdIn, int fdOut)
+{
+    if (ReentrancyGuard::IsNested())
+    {
+        return sNotChecked;
+    }
+
+    invalidate_output(fdOut);
+
+    size_t length;
+    CopyRangeMemo &memo = sCopyRangeMemo;
+    if (memo.fdIn == fdIn && memo.fdOut == fdOut && memo.pathIn != NULL &&
+        fdTable_.Get(fdIn, &length) == memo.pathIn && fdTable_.Get(fdOut, &length) == memo.pathOut)
+    {
+        if (collectStats_)
+        {
+            interposeStats_.AddToCurrent(kInterposeCacheHits, 1);
+        }
+
+        return sNotChecked;
+    }
+
+    // the source was reported when it was opened; resolving it here (once) is what lets us tell it apart later
+    fd_to_path(fdIn);
+    AccessCheckResult check = report_access_fd(syscallName, ES_EVENT_TYPE_NOTIFY_WRITE, fdOut);
+
+    // denied accesses must keep being checked (and reported, depending on the policy) on every call
+    memo.fdIn = -1;
+    if (!check.ShouldDenyAccess())
+    {
+        const char *pathIn = fdTable_.Get(fdIn, &length);
+        const char *pathOut = fdTable_.Get(fdOut, &length);
+        if (pathIn != NULL && pathOut != NULL)
+        {
+            memo.fdOut = fdOut;
+            memo.pathIn = pathIn;
+            memo.pathOut = pathOut;
+            memo.fdIn = fdIn;
+        }
+    }
+
+    return check;
+}
+
+AccessCheckResult BxlObserver::report_write_fd(const char *syscallName, int fd, bool sequential)
+{
+    if (ReentrancyGuard::IsNested())
+    {
+        return sNotChecked;
+    }
+
+    if (!sequential)
+    {
+        invalidate_output(fd);
+    }
+
+    if (fdTable_.IsWriteReported(fd))
+    {
+        if (collectStats_)
+        {
+            interposeStats_.AddToCurrent(kInterposeCacheHits, 1);
+        }
+
+        return sNotChecked;
+    }
+
+    AccessCheckResult check = report_access_fd(syscallName, ES_EVENT_TYPE_NOTIFY_WRITE, fd);
+
+    // denied accesses must keep being checked (and reported, depending on the policy) on every call
+    if (!check.ShouldDenyAccess())
+    {
+        fdTable_.MarkWriteReported(fd);
+    }
+
+    return check;
+}
+
+int BxlObserver::track_output(int fd, const std::string &path, int oflag)
+{
+    // rings submit writes we cannot hash (see OutputHasher)
+    if (!hashOutputs_ || fd < 0 || (oflag & O_ACCMODE) != O_WRONLY || path[0] != '/' || ioUring_.IsTracking() || ReentrancyGuard::IsNested())
+    {
+        return fd;
+    }
+
+    int savedErrno = errno;
+    struct stat st;
+    if (real___fxstat(1, fd, &st) == 0)
+    {
+        outputHasher_.Start(fd, path.c_str(), path.length(), st);
+    }
+
+    errno = savedErrno;
+    return fd;
+}
+
+// report "Create" if path does not exist and O_CREAT or O_TRUNC is specified
+// report "Write" if path exists and O_CREAT or O_TRUNC is specified (because this truncates the file regardless of its content)
+// otherwise, report "Read"
+AccessCheckResult BxlObserver::report_open(const char *syscallName, const std::string &pathStr, int oflag)
+{
+    if (ReentrancyGuard::IsNested())
+    {
+        return sNotChecked;
+    }
+
+    if (IsLexicallyUntracked(pathStr.c_str()))
+    {
+        return sNotChecked;
+    }
+
+    mode_t pathMode = get_mode(pathStr.c_str());
+    bool pathExists = pathMode != 0;
+    bool isCreate = !pathExists && (oflag & (O_CREAT|O_TRUNC));
+    bool isWrite = pathExists && (oflag & (O_CREAT|O_TRUNC) && (oflag & O_WRONLY));
+    IOEvent event(
+        GetReportingPid(), 0, reportingPid_ != 0 ? 0 : getppid(),
+        isCreate ? ES_EVENT_TYPE_NOTIFY_CREATE : isWrite ? ES_EVENT_TYPE_NOTIFY_WRITE : ES_EVENT_TYPE_NOTIFY_OPEN,
+        ES_ACTION_TYPE_NOTIFY,
+        pathStr, std::string(""), progFullPath_, pathMode, false);
+    return report_access(syscallName, event);
+}
+
 AccessCheckResult BxlObserver::report_access_at(const char *syscallName, es_event_type_t eventType, int dirfd, const char *pathname, int flags)
 {
+    if (ReentrancyGuard::IsNested())
+    {
+        return sNotChecked;
+    }
+
     if (pathname[0] == '/')
     {
         return report_access(syscallName, eventType, pathname, flags);
@@ -303,7 +1343,7 @@ AccessCheckResult BxlObserver::report_access_at(const char *syscallName, es_even
 
     if (dirfd == AT_FDCWD)
     {
-        if (!getcwd(fullpath, PATH_MAX))
+        if (!get_cwd(fullpath, PATH_MAX))
         {
             return sNotChecked;
         }
@@ -335,43 +1375,127 @@ ssize_t BxlObserver::read_path_for_fd(int fd, char *buf, size_t bufsiz)
 
 void BxlObserver::reset_fd_table_entry(int fd)
 {
-    if (fd >= 0 && fd < MAX_FD)
+    // the host program is closing (or replacing) our reports file descriptor --> forget it so that it gets reopened
+    int expected = fd;
+    reportsFd_.compare_exchange_strong(expected, -1);
+
+    if (outputHasher_.IsActive())
     {
-        fdTable_[fd] = empty_str_;
+        outputHasher_.Finish(fd, [this](const char *path, size_t pathLength, const uint8_t *hash, const struct stat &st)
+        {
+            ReportContentHash(path, pathLength, hash, st);
+        });
     }
+
+    fdTable_.Reset(fd);
+    ioUring_.Untrack(fd);
 }
 
-std::string BxlObserver::fd_to_path(int fd)
+void BxlObserver::reset_fd_table_range(unsigned int first, unsigned int last)
 {
-    char path[PATH_MAX] = {0};
+    int fd = reportsFd_.load();
+    if (fd != -1 && (unsigned int)fd >= first && (unsigned int)fd <= last)
+    {
+        reportsFd_.compare_exchange_strong(fd, -1);
+    }
+
+    fdTable_.ResetRange(first, last);
+    ioUring_.UntrackRange(first, last);
+    outputHasher_.StopRange(first, last);
+}
+
+void BxlObserver::reset_cwd()
+{
+    cwdGeneration_.fetch_add(1, std::memory_order_acq_rel);
+}
+
+bool BxlObserver::get_cwd(char *buf, size_t bufsiz)
+{
+    uint32_t generation = cwdGeneration_.load(std::memory_order_acquire);
+    uint32_t seq = cwdSeq_.load(std::memory_order_acquire);
+    if ((seq & 1) == 0)
+    {
+        size_t len = cwdLength_;
+        if (len > 0 && len < bufsiz && cwdCachedGeneration_ == generation)
+        {
+            memcpy(buf, cwd_, len + 1);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (cwdSeq_.load(std::memory_order_relaxed) == seq)
+            {
+                return true;
+            }
+        }
+    }
 
-    // ignore if fd is out of range
-    if (fd < 0 || fd >= MAX_FD)
+    if (!getcwd(buf, bufsiz))
     {
-        read_path_for_fd(fd, path, PATH_MAX);
-        return path;
+        return false;
+    }
+
+    size_t len = strlen(buf);
+    if (len > 0 && cwdMtx_.try_lock())
+    {
+        seq = cwdSeq_.load(std::memory_order_relaxed);
+        cwdSeq_.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        memcpy(cwd_, buf, len + 1);
+        cwdLength_ = len;
+        // tagged with the generation read *before* calling getcwd: if the cwd changed since, this is dead on arrival
+        cwdCachedGeneration_ = generation;
+        cwdSeq_.store(seq + 2, std::memory_order_release);
+        cwdMtx_.unlock();
     }
 
+    return true;
+}
+
+void BxlObserver::invalidate_resolved_paths()
+{
+    prefixCache_.Invalidate();
+    reset_cwd();
+}
+
+std::string BxlObserver::fd_to_path(int fd)
+{
     // check the file descriptor table
-    if (fdTable_[fd].length() > 0)
+    size_t length;
+    const char *cached = fdTable_.Get(fd, &length);
+    if (cached != NULL)
     {
-        return fdTable_[fd];
+        return std::string(cached, length);
     }
 
     // read from the filesystem and update the file descriptor table
-    read_path_for_fd(fd, path, PATH_MAX);
-    fdTable_[fd] = path;
+    char path[PATH_MAX] = {0};
+    ssize_t result = read_path_for_fd(fd, path, PATH_MAX - 1);
+    if (result > 0)
+    {
+        fdTable_.Set(fd, path, result);
+    }
+
     return path;
 }
 
-std::string BxlObserver::normalize_path_at(int dirfd, const char *pathname, int oflags)
+std::string BxlObserver::normalize_path_at(int dirfd, const char *pathname, int oflags, bool resolveUntracked)
 {
+    // nothing is reported for a nested interposer, so there is no point in resolving anything (see ReentrancyGuard)
+    if (ReentrancyGuard::IsNested())
+    {
+        return pathname != NULL ? std::string(pathname) : std::string();
+    }
+
     // no pathname given --> read path for dirfd
     if (pathname == NULL)
     {
         return fd_to_path(dirfd);
     }
 
+    // inside an untracked scope --> nothing to resolve the path for (none of its accesses are reported)
+    if (!resolveUntracked && IsLexicallyUntracked(pathname))
+    {
+        return pathname;
+    }
+
     char fullpath[PATH_MAX] = {0};
     size_t len = 0;
 
@@ -380,7 +1504,7 @@ std::string BxlObserver::normalize_path_at(int dirfd, const char *pathname, int
     {
         if (dirfd == AT_FDCWD)
         {
-            if (!getcwd(fullpath, PATH_MAX))
+            if (!get_cwd(fullpath, PATH_MAX))
             {
                 _fatal("Could not get CWD; errno: %d", errno);
             }
@@ -427,12 +1551,17 @@ static char* find_prev_slash(char *pStr)
 }
 
 // resolve any intermediate directory symlinks
-//   - TODO: cache this
+//   - intermediate dirs are looked up in (and added to) prefixCache_ if enabled; the final component is not cached
 //   - TODO: break symlink cycles
 void BxlObserver::resolve_path(char *fullpath, bool followFinalSymlink)
 {
     assert(fullpath[0] == '/');
 
+    // When reporting on behalf of other processes (i.e., in the seccomp supervisor) their renames
+    // happen behind our back (after the trapped syscall is let through), so nothing gets cached.
+    bool useCache = cacheResolvedPrefixes_ && reportingPid_ == 0;
+    uint32_t epoch = prefixCache_.Epoch();
+
     char readlinkBuf[PATH_MAX];
     char *pFullpath = fullpath + 1;
     while (true)
@@ -470,11 +1599,27 @@ void BxlObserver::resolve_path(char *fullpath, bool followFinalSymlink)
         // call readlink for intermediate dirs and the final path if followSymlink is true
         ssize_t nReadlinkBuf = -1;
         char ch = *pFullpath;
-        if (*pFullpath == '/' || (*pFullpath == '\0' && followFinalSymlink))
+        if (*pFullpath == '/')
         {
-            *pFullpath = '\0';
-            nReadlinkBuf = real_readlink(fullpath, readlinkBuf, PATH_MAX);
-            *pFullpath = ch;
+            // intermediate dir: consult the prefix cache first (only directories that exist end up in it)
+            size_t prefixLength = pFullpath - fullpath;
+            nReadlinkBuf = useCache ? prefixCache_.Lookup(fullpath, prefixLength, readlinkBuf) : -2;
+            if (nReadlinkBuf == -2)
+            {
+                *pFullpath = '\0';
+                nReadlinkBuf = real_readlink(fullpath, readlinkBuf, PATH_MAX - 1);
+                bool exists = nReadlinkBuf != -1 || errno == EINVAL;
+                *pFullpath = ch;
+
+                if (useCache && exists)
+                {
+                    prefixCache_.Add(epoch, fullpath, prefixLength, nReadlinkBuf == -1 ? NULL : readlinkBuf, nReadlinkBuf);
+                }
+            }
+        }
+        else if (*pFullpath == '\0' && followFinalSymlink)
+        {
+            nReadlinkBuf = real_readlink(fullpath, readlinkBuf, PATH_MAX - 1);
         }
 
         // if not a symlink --> either continue or exit if at the end of the path
@@ -518,35 +1663,150 @@ void BxlObserver::resolve_path(char *fullpath, bool followFinalSymlink)
     }
 }
 
-char** BxlObserver::ensure_env_value_with_log(char *const envp[], char const *envName)
+// Whether 'path' is one of the colon-separated values in 'list'
+static bool list_contains_path(const char *list, const char *path, size_t pathLength)
+{
+    for (const char *p = list; ; )
+    {
+        const char *end = strchrnul(p, ':');
+        if ((size_t)(end - p) == pathLength && strncmp(p, path, pathLength) == 0)
+        {
+            return true;
+        }
+
+        if (*end == '\0')
+        {
+            return false;
+        }
+
+        p = end + 1;
+    }
+}
+
+char** BxlObserver::ensureEnvs(char *const envp[])
 {
-    char *envValue = getenv(envName);
-    if (is_null_or_empty(envValue))
+    // CODESYNC: Public/Src/Engine/Processes/SandboxConnectionLinuxDetours.cs
+    static const char *const envNames[] =
+    {
+        BxlEnvFamPath, BxlEnvFamBasePath, BxlEnvLogPath, BxlEnvRootPid, BxlEnvDetoursPath, BxlEnvBinaryReports,
+        BxlEnvReportsRingPath, BxlEnvSeccompStaticProcesses, BxlEnvInterposeStats, BxlEnvAuditSymbind,
+        BxlEnvProcessTreePath, BxlEnvHashOutputs, BxlEnvDeferReports, BxlEnvOverheadBudget, BxlEnvLoaderSearchCachePath,
+        BxlEnvCacheResolvedPrefixes
+    };
+    static const int envCount = sizeof(envNames) / sizeof(envNames[0]);
+    static const size_t preloadPrefixLength = sizeof(LD_PRELOAD_ENV_VAR_PREFIX) - 1;
+
+    const char *values[envCount];
+    size_t nameLengths[envCount], valueLengths[envCount];
+    int found[envCount];
+    for (int i = 0; i < envCount; i++)
+    {
+        values[i] = getenv(envNames[i]);
+        nameLengths[i] = strlen(envNames[i]);
+        valueLengths[i] = is_null_or_empty(values[i]) ? 0 : strlen(values[i]);
+        found[i] = -1;
+    }
+
+    // Fast path: a single scan over envp.  Children of sandboxed processes nearly always inherit everything
+    // already in place, in which case envp is passed through untouched.  Like getenv, the last occurrence
+    // of a variable is the one that counts.
+    size_t detoursLibLength = strlen(detoursLibFullPath_);
+    int preloadIndex = -1;
+    int envpCount = 0;
+    for (char *const *pEnv = envp; pEnv && *pEnv; pEnv++, envpCount++)
+    {
+        const char *env = *pEnv;
+        if (env[0] == 'L' && strncmp(env, LD_PRELOAD_ENV_VAR_PREFIX, preloadPrefixLength) == 0)
+        {
+            preloadIndex = envpCount;
+        }
+        else if (env[0] == '_' && env[1] == '_')
+        {
+            for (int i = 0; i < envCount; i++)
+            {
+                if (strncmp(env, envNames[i], nameLengths[i]) == 0 && env[nameLengths[i]] == '=')
+                {
+                    found[i] = envpCount;
+                    break;
+                }
+            }
+        }
+    }
+
+    bool fixPreload = detoursLibLength > 0 &&
+        (preloadIndex == -1 || !list_contains_path(envp[preloadIndex] + preloadPrefixLength, detoursLibFullPath_, detoursLibLength));
+    int missingCount = fixPreload && preloadIndex == -1 ? 1 : 0;
+    size_t stringsSize = fixPreload
+        ? (preloadIndex == -1 ? preloadPrefixLength : strlen(envp[preloadIndex])) + 1 + detoursLibLength + 1
+        : 0;
+
+    bool fix[envCount];
+    for (int i = 0; i < envCount; i++)
+    {
+        fix[i] = valueLengths[i] > 0 &&
+            (found[i] == -1 || strcmp(envp[found[i]] + nameLengths[i] + 1, values[i]) != 0);
+        if (fix[i])
+        {
+            missingCount += found[i] == -1 ? 1 : 0;
+            stringsSize += nameLengths[i] + 1 + valueLengths[i] + 1;
+        }
+    }
+
+    if (stringsSize == 0)
     {
         return (char**)envp;
     }
 
-    char **newEnvp = ensure_env_value(envp, envName, envValue);
-    if (newEnvp != envp)
+    // Slow path: a single allocation holding the new pointer array, followed by all the rewritten entries
+    size_t pointersSize = (envpCount + missingCount + 1) * sizeof(char*);
+    char **newEnvp = (char**)malloc(pointersSize + stringsSize);
+    if (newEnvp == NULL)
     {
-        LOG_DEBUG("envp has been modified with %s added to %s", envValue, envName);
+        return (char**)envp;
     }
 
-    return newEnvp;
-}
+    if (envpCount > 0)
+    {
+        memcpy(newEnvp, envp, envpCount * sizeof(char*));
+    }
 
-char** BxlObserver::ensureEnvs(char *const envp[])
-{
-    char **newEnvp = ensure_paths_included_in_env(envp, LD_PRELOAD_ENV_VAR_PREFIX, detoursLibFullPath_, NULL);
-    if (newEnvp != envp)
+    int next = envpCount;
+    char *arena = (char*)newEnvp + pointersSize;
+    if (fixPreload)
     {
+        const char *current = preloadIndex == -1 ? LD_PRELOAD_ENV_VAR_PREFIX : envp[preloadIndex];
+        size_t currentLength = strlen(current);
+        char *entry = arena;
+        memcpy(arena, current, currentLength);
+        arena += currentLength;
+        if (arena[-1] != ':' && arena[-1] != '=')
+        {
+            *arena++ = ':';
+        }
+
+        memcpy(arena, detoursLibFullPath_, detoursLibLength + 1);
+        arena += detoursLibLength + 1;
+        newEnvp[preloadIndex == -1 ? next++ : preloadIndex] = entry;
         LOG_DEBUG("envp has been modified with %s added to %s", detoursLibFullPath_, "LD_PRELOAD");
     }
 
-    newEnvp = ensure_env_value_with_log(newEnvp, BxlEnvFamPath);
-    newEnvp = ensure_env_value_with_log(newEnvp, BxlEnvLogPath);
-    newEnvp = ensure_env_value_with_log(newEnvp, BxlEnvRootPid);
-    newEnvp = ensure_env_value_with_log(newEnvp, BxlEnvDetoursPath);
+    for (int i = 0; i < envCount; i++)
+    {
+        if (!fix[i])
+        {
+            continue;
+        }
+
+        char *entry = arena;
+        memcpy(arena, envNames[i], nameLengths[i]);
+        arena += nameLengths[i];
+        *arena++ = '=';
+        memcpy(arena, values[i], valueLengths[i] + 1);
+        arena += valueLengths[i] + 1;
+        newEnvp[found[i] == -1 ? next++ : found[i]] = entry;
+        LOG_DEBUG("envp has been modified with %s added to %s", values[i], envNames[i]);
+    }
 
+    newEnvp[next] = NULL;
     return newEnvp;
 }
\ No newline at end of file
@@ -13,7 +13,10 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <limits.h>
+#include <pthread.h>
+#include <spawn.h>
 #include <stddef.h>
+#include <sys/mman.h>
 #include <sys/sendfile.h>
 #include <sys/stat.h>
 #include <sys/syscall.h>
@@ -25,6 +28,7 @@
 
 #include <ostream>
 #include <sstream>
+#include <atomic>
 #include <chrono>
 #include <mutex>
 #include <unordered_set>
@@ -33,6 +37,23 @@
 #include "Sandbox.hpp"
 #include "SandboxedPip.hpp"
 #include "utils.h"
+#include "report_format.hpp"
+#include "fd_table.hpp"
+#include "io_uring_observer.hpp"
+#include "interpose_stats.hpp"
+#include "sandbox_counters.hpp"
+#include "overhead_budget.hpp"
+#include "output_hasher.hpp"
+#include "access_summary.hpp"
+#include "process_tree.hpp"
+#include "real_function.hpp"
+#include "report_buffers.hpp"
+#include "report_cache.hpp"
+#include "shared_report_cache.hpp"
+#include "loader_search_cache.hpp"
+#include "untracked_scopes.hpp"
+#include "resolved_prefix_cache.hpp"
+#include "report_ring.hpp"
 
 /*
  * We want to compile against glibc 2.17 so that we are compatible with a broad range of Linux distributions. (e.g., starting from CentOS7)
@@ -47,10 +68,12 @@
 /*
  * This header is compiled into two different libraries: libDetours.so and libAudit.so.
  *
- * When compiling libDetours.so, the ENABLE_INTERPOSING macro is defined, otherwise it is not.
+ * When compiling libDetours.so (and libBxlAudit.so, which carries the same interposers), the ENABLE_INTERPOSING macro
+ * is defined, otherwise it is not.
  *
  * When ENABLE_INTERPOSING is defined, we do not need static declarations for the system calls of interest, because
- * we resolve those dynamically via `dlsym(name)` calls.  That means that, even though we compile libDetours.so against
+ * we resolve those dynamically via `dlsym(name)` calls (lazily, the first time each is called; see RealFunction).
+ * That means that, even though we compile libDetours.so against
  * glibc 2.17 (where, for example, `copy_file_range` is not defined), when our libDetours.so is loaded into a process that
  * runs against a newer version of glibc, `dlsym("copy_file_range")` will still return a valid function pointer and we 
  * will be able to interpose system calls that are not necessarily present in the glibc 2.17.
@@ -68,6 +91,21 @@
     }
     #endif
 
+    // Library support for statx was added in glibc 2.28 (https://man7.org/linux/man-pages/man2/statx.2.html)
+    #if __GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 28)
+    struct statx;
+    inline int statx(int dirfd, const char *pathname, int flags, unsigned int mask, struct statx *statxbuf) {
+        return -1;
+    }
+    #endif
+
+    // Library support for close_range was added in glibc 2.34 (https://man7.org/linux/man-pages/man2/close_range.2.html)
+    #if __GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 34)
+    inline int close_range(unsigned int first, unsigned int last, int flags) {
+        return -1;
+    }
+    #endif
+
     // Library support for pwritev2 was added in glibc 2.26 (https://man7.org/linux/man-pages/man2/pwritev2.2.html)
     #if __GLIBC__ < 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ < 26)
     inline ssize_t pwritev2(int fd, const struct iovec *iov, int iovcnt, off_t offset, int flags) {
@@ -82,18 +120,48 @@ extern const char *__progname;
 
 // CODESYNC: Public/Src/Engine/Processes/SandboxConnectionLinuxDetours.cs
 #define BxlEnvFamPath "__BUILDXL_FAM_PATH"
+#define BxlEnvFamBasePath "__BUILDXL_FAM_BASE_PATH"
 #define BxlEnvLogPath "__BUILDXL_LOG_PATH"
 #define BxlEnvRootPid "__BUILDXL_ROOT_PID"
 #define BxlEnvDetoursPath "__BUILDXL_DETOURS_PATH"
+#define BxlEnvBinaryReports "__BUILDXL_BINARY_REPORTS"
+#define BxlEnvReportsRingPath "__BUILDXL_REPORTS_RING_PATH"
+#define BxlEnvSeccompStaticProcesses "__BUILDXL_SECCOMP_STATIC_PROCESSES"
+#define BxlEnvInterposeStats "__BUILDXL_INTERPOSE_STATS"
+#define BxlEnvAuditSymbind "__BUILDXL_AUDIT_SYMBIND"
+#define BxlEnvProcessTreePath "__BUILDXL_PROCESS_TREE_PATH"
+#define BxlEnvSharedReportCachePath "__BUILDXL_SHARED_REPORT_CACHE_PATH"
+#define BxlEnvLoaderSearchCachePath "__BUILDXL_LOADER_SEARCH_CACHE_PATH"
+#define BxlEnvLexicalUntrackedScopes "__BUILDXL_LEXICAL_UNTRACKED_SCOPES"
+#define BxlEnvHashOutputs "__BUILDXL_HASH_OUTPUTS"
+#define BxlEnvDeferReports "__BUILDXL_DEFER_REPORTS"
+#define BxlEnvTimedReports "__BUILDXL_TIMED_REPORTS"
+#define BxlEnvOverheadBudget "__BUILDXL_OVERHEAD_BUDGET"
+#define BxlEnvCacheResolvedPrefixes "__BUILDXL_CACHE_RESOLVED_PREFIXES"
 
 static const char LD_PRELOAD_ENV_VAR_PREFIX[] = "LD_PRELOAD=";
 
 #define ARRAYSIZE(arr) (sizeof(arr)/sizeof(arr[0]))
 
 #ifdef ENABLE_INTERPOSING
+  #ifdef BXL_AUDIT_LIBRARY
+    // libBxlAudit.so lives in its own link-map namespace (with its own libc), so the real functions dlsym(RTLD_NEXT)
+    // finds are only good for our own use; interposers forward to 'bound_<name>' instead, which la_symbind64 rebinds
+    // to the definition the audited program was binding to.
     #define GEN_FN_DEF_REAL(ret, name, ...)                                         \
         typedef ret (*fn_real_##name)(__VA_ARGS__);                                 \
-        const fn_real_##name real_##name = (fn_real_##name)dlsym(RTLD_NEXT, #name);
+        RealFunction<fn_real_##name> real_##name { #name };                         \
+        fn_real_##name bound_##name = nullptr;                                      \
+        const bool bound_registered_##name = RegisterBoundFunction(#name, (void**)&bound_##name);
+
+    #define FORWARD_TARGET(name) (bound_##name != nullptr ? bound_##name : real_##name.Get())
+  #else
+    #define GEN_FN_DEF_REAL(ret, name, ...)                                         \
+        typedef ret (*fn_real_##name)(__VA_ARGS__);                                 \
+        RealFunction<fn_real_##name> real_##name { #name };
+
+    #define FORWARD_TARGET(name) real_##name
+  #endif
 
     #define MAKE_BODY(B) \
         B \
@@ -105,8 +173,11 @@ static const char LD_PRELOAD_ENV_VAR_PREFIX[] = "LD_PRELOAD=";
     #define INTERPOSE_SOMETIMES(ret, name, short_circuit_check, ...) \
         DLL_EXPORT ret name(__VA_ARGS__) {                           \
             short_circuit_check                                      \
+            ReentrancyGuard bxl_guard;                               \
             BxlObserver *bxl = BxlObserver::GetInstance();           \
             BXL_LOG_DEBUG(bxl, "Intercepted %s", #name);             \
+            static const int bxl_hook = bxl->RegisterInterposer(#name); \
+            InterposeScope bxl_scope(bxl, bxl_hook);                 \
             MAKE_BODY
 
     #define INTERPOSE(ret, name, ...) \
@@ -116,6 +187,8 @@ static const char LD_PRELOAD_ENV_VAR_PREFIX[] = "LD_PRELOAD=";
         typedef ret (*fn_real_##name)(__VA_ARGS__); \
         const fn_real_##name real_##name = (fn_real_##name)name;
 
+    #define FORWARD_TARGET(name) real_##name
+
     #define IGNORE_BODY(B)
 
     #define INTERPOSE(ret, name, ...) IGNORE_BODY
@@ -125,8 +198,12 @@ static const char LD_PRELOAD_ENV_VAR_PREFIX[] = "LD_PRELOAD=";
     GEN_FN_DEF_REAL(ret, name, __VA_ARGS__)                                     \
     template<typename ...TArgs> result_t<ret> fwd_##name(TArgs&& ...args)       \
     {                                                                           \
-        ret result = real_##name(std::forward<TArgs>(args)...);                 \
+        uint64_t start = StatsStart();                                          \
+        int depth = ReentrancyGuard::Suspend();                                 \
+        ret result = FORWARD_TARGET(name)(std::forward<TArgs>(args)...);        \
         result_t<ret> return_value(result);                                     \
+        ReentrancyGuard::Resume(depth);                                         \
+        StatsAddRealCall(start);                                                \
         LOG_DEBUG("Forwarded syscall %s (errno: %d)",                           \
             RenderSyscall(#name, result, std::forward<TArgs>(args)...).c_str(), \
             return_value.get_errno());                                          \
@@ -185,6 +262,38 @@ public:
     }
 };
 
+/**
+ * Tells interposers entered by the observer itself apart.  Every interposer runs in a ReentrancyGuard (see INTERPOSE),
+ * and one entered while another interposer is running on the same thread is nested: libc helpers, dlsym and the like that
+ * the observer's internals call may reach interposed entry points, and what they access is none of the pip's business.
+ * A nested interposer resolves, looks up and reports nothing (see IsNested): it just calls the real function.
+ *
+ * The real call of every interposer (see fwd_<name>) runs outside the guard, since it may run code of the program whose
+ * accesses must be observed (library constructors run by dlopen, the function passed to clone, the child of fork).
+ */
+class ReentrancyGuard final
+{
+private:
+    // number of interposers running on this thread (initial-exec: libDetours.so is loaded at startup, through LD_PRELOAD)
+    static thread_local int sDepth __attribute__((tls_model("initial-exec")));
+
+    int previous_;
+
+public:
+    ReentrancyGuard() : previous_(sDepth) { sDepth = previous_ + 1; }
+    ~ReentrancyGuard() { sDepth = previous_; }
+
+    ReentrancyGuard(const ReentrancyGuard&) = delete;
+    ReentrancyGuard& operator=(const ReentrancyGuard&) = delete;
+
+    /** Whether the current interposer was entered from within another one. */
+    static inline bool IsNested() { return sDepth > 1; }
+
+    /** Leaves all guards of this thread (for the duration of a real call); returns what Resume must be called with. */
+    static inline int Suspend() { int depth = sDepth; sDepth = 0; return depth; }
+    static inline void Resume(int depth) { sDepth = depth; }
+};
+
 /**
  * Singleton class responsible for reporting accesses.
  *
@@ -197,7 +306,7 @@ class BxlObserver final
 {
 private:
     BxlObserver();
-    ~BxlObserver() { disposed_ = true; }
+    ~BxlObserver() { FlushReports(); disposed_ = true; }
     BxlObserver(const BxlObserver&) = delete;
     BxlObserver& operator = (const BxlObserver&) = delete;
 
@@ -207,29 +316,198 @@ private:
     char logFile_[PATH_MAX];
     char detoursLibFullPath_[PATH_MAX];
 
-    std::timed_mutex cacheMtx_;
-    std::unordered_map<es_event_type_t, std::unordered_set<std::string>> cache_;
-
-    // In a typical case, a process will not have more than 1024 open file descriptors at a time.
-    // File descriptors start at 3 (1 and 2 are reserved for stdout and stderr).
-    // Whenever a new file descriptor is created, the smallest available positive integer is assigned to it. 
-    // Whenever a file descriptor is closed, its value is returned to the pool and will be used for new ones.
-    // Setting the size of this table to 1024 should accommodate most of the common cases.
-    // File descriptors can be greater than 1024, and if that happens we just won't cache their paths.
-    static const int MAX_FD = 1024;
-    std::string fdTable_[MAX_FD];
+    ReportCache cache_;
+
+    // Directory prefixes already resolved by resolve_path (see resolved_prefix_cache.hpp), only used when
+    // cacheResolvedPrefixes_ is set (via the BxlEnvCacheResolvedPrefixes env var): other processes' changes go unnoticed
+    ResolvedPrefixCache prefixCache_;
+    bool cacheResolvedPrefixes_;
+
+    // Current working directory, so that relative paths can be made absolute without calling getcwd every time.
+    //
+    // chdir/fchdir (see reset_cwd) bump cwdGeneration_; the cached value is only used while its generation
+    // (read before calling getcwd) is the current one.  cwd_ itself is guarded by a seqlock: cwdSeq_ is odd
+    // while it is being updated, and cwdMtx_ (which is only ever try-locked) serializes updaters.
+    std::atomic<uint32_t> cwdGeneration_;
+    std::atomic<uint32_t> cwdSeq_;
+    std::mutex cwdMtx_;
+    uint32_t cwdCachedGeneration_;
+    size_t cwdLength_;
+    char cwd_[PATH_MAX];
+
+    // Paths of the file descriptors seen so far (see fd_table.hpp).  Entries are reset by the interposers of
+    // the functions that close or replace a file descriptor (close, close_range, dup2, dup3, fclose); new file descriptors
+    // always take the lowest number available, i.e., one whose entry must have been reset already.
+    FdTable fdTable_;
+
+    // The fd pair of the last copy_file_range/sendfile call (on this thread) whose report did not need to be checked
+    // again, along with the (interned, see FdTable) paths the fds referred to at the time.  The paths are compared
+    // by identity: if either fd has been closed or replaced since, its table entry is gone or points elsewhere.
+    typedef struct
+    {
+        int fdIn;
+        int fdOut;
+        const char *pathIn;
+        const char *pathOut;
+    } CopyRangeMemo;
+
+    static thread_local CopyRangeMemo sCopyRangeMemo;
+
+    // io_uring rings set up by this process, whose submissions are observed (see io_uring_observer.hpp)
+    IoUringObserver ioUring_;
+
     std::string empty_str_;
 
+    // File descriptor of the reports file (FIFO) specified by the FileAccessManifest.
+    //
+    // Opened lazily the first time a report is sent and kept open for the lifetime of the process
+    // (instead of opening/closing the reports file for every report).  It is opened with O_CLOEXEC
+    // so that it never leaks into an exec-ed image (which gets its own BxlObserver instance anyway).
+    // A forked child inherits this descriptor, which is fine because all writes go to the same FIFO
+    // and are atomic (see Send).  If the host program closes this descriptor, it is reset to -1 and
+    // reopened the next time a report is sent.
+    std::atomic<int> reportsFd_;
+
+    // When set (via the BxlEnvBinaryReports env var), reports are sent using the binary framing from report_format.hpp
+    // and are batched in per-thread buffers (see report_buffers.hpp) until a buffer is full or has been holding on to
+    // reports for too long, a process lifecycle event is reported, or FlushReports is called (which the interposers do
+    // before fork/exec/exit).  Reports still sitting in the buffers are lost if the process is killed by a signal, which
+    // is why this mode must be explicitly requested by the host.
+    bool binaryReports_;
+    ReportBuffers reportBuffers_;
+
+    // Its destructor flushes and gives back the report buffer of a thread that exits (see OnThreadExit)
+    pthread_key_t reportBufferKey_;
+
+    // When set (via the BxlEnvReportsRingPath env var), report packets are put into this shared-memory ring instead
+    // of being written to the reports FIFO; the FIFO is then only used to wake up the reader (see report_ring.hpp).
+    // Implies binary reports.
+    ReportRing *ring_;
+
+    // Set once this process gave up waiting for the ring to drain (see SendToRing): its packets go to the FIFO from then on.
+    std::atomic<bool> ringAbandoned_;
+
+    // How long SendToRing waits for a full ring to drain
+    static const uint64_t kRingFullTimeoutNs = 10ULL * 1000 * 1000 * 1000;
+
+    // When set (via the BxlEnvSeccompStaticProcesses env var), statically linked executables are exec-ed under
+    // a seccomp supervisor (see seccomp_supervisor.hpp).
+    bool superviseStaticProcesses_;
+
+    // When set (via the BxlEnvInterposeStats env var), interposers keep counters in 'interposeStats_' (see interpose_stats.hpp),
+    // which are sent to the host (ReportStats) before the process exits or execs.  Requires binary reports.
+    bool collectStats_;
+    InterposeStats interposeStats_;
+
+    // The counters of the schema shared by the sandboxes (see sandbox_counters.hpp), sent along with 'interposeStats_'
+    // (but kept whether or not those are).
+    SandboxCounters sandboxCounters_;
+
+    // When set (via the BxlEnvOverheadBudget env var, a percentage of the wall time), interposers time themselves as they
+    // do for 'interposeStats_', and a process whose interposers take more than that degrades (see ExceedOverheadBudget).
+    // Requires binary reports.
+    OverheadBudget overheadBudget_;
+
+    // When attached (via the BxlEnvProcessTreePath env var), the processes of the pip keep track of how many of them
+    // are alive, and the last one to exit reports the process tree as completed (see process_tree.hpp).
+    ProcessTree processTree_;
+
+    // When attached (via the BxlEnvSharedReportCachePath env var), accesses already reported by other processes of the pip
+    // are not reported again (see shared_report_cache.hpp); 'programHash_' identifies the executable of this process in it.
+    SharedReportCache sharedCache_;
+    uint32_t programHash_;
+
+    // When enabled (via the BxlEnvLexicalUntrackedScopes env var), paths that lie lexically inside an untracked scope of
+    // the manifest are neither resolved nor reported (see untracked_scopes.hpp)
+    UntrackedScopes untrackedScopes_;
+
+    // When set (via the BxlEnvHashOutputs env var), files written sequentially are hashed as they are written, and their
+    // hashes are sent to the host when they are closed (see output_hasher.hpp and ReportContentHash).  Requires binary reports.
+    bool hashOutputs_;
+    OutputHasher outputHasher_;
+
+    // When set (via the BxlEnvDeferReports env var, or when the process exceeds its overhead budget) for an observe-only pip,
+    // accesses are not sent as they are made but summarized, and the summary is sent when reports are flushed (see
+    // access_summary.hpp).  Requires binary reports.
+    std::atomic<bool> deferReports_;
+    AccessSummary accessSummary_;
+
+    // When set (via the BxlEnvTimedReports env var), records carry the time they were sent at and a sequence number
+    // (see AccessReportRecordTiming and TimeRecord).  Requires binary reports.
+    bool timedReports_;
+    std::atomic<uint64_t> reportSequenceNumber_;
+
+#ifdef BXL_AUDIT_LIBRARY
+    // Functions interposers forward to (see GEN_FN_DEF_REAL) by name, so that la_symbind64 can rebind them
+    static const int kMaxBoundFunctions = 256;
+    struct BoundFunction { const char *name; void **slot; };
+    BoundFunction boundFunctions_[kMaxBoundFunctions];
+    int boundFunctionCount_ = 0;
+
+    bool RegisterBoundFunction(const char *name, void **slot)
+    {
+        if (boundFunctionCount_ < kMaxBoundFunctions)
+        {
+            boundFunctions_[boundFunctionCount_++] = { name, slot };
+        }
+
+        return true;
+    }
+
+    // When attached (via the BxlEnvLoaderSearchCachePath env var), libraries another process of the pip already searched
+    // for are loaded straight from the file they were found at (see loader_search_cache.hpp and la_objsearch)
+    LoaderSearchCache loaderSearchCache_;
+    void InitLoaderSearchCache();
+#endif
+
+    // Process on whose behalf accesses are reported: 0 means this process (which is always the case except in a seccomp
+    // supervisor, which reports accesses of its tracees); 'progName_' is the name reported along with every access.
+    pid_t reportingPid_;
+    const char *progName_;
+
     std::shared_ptr<SandboxedPip> pip_;
     std::shared_ptr<SandboxedProcess> process_;
     Sandbox *sandbox_;
 
     void InitFam();
+    void* MapSharedFile(const char *path, size_t minSize, bool writable, size_t *size);
     void InitLogFile();
     void InitDetoursLibPath();
+    void InitReportsRing();
+    void InitProcessTree();
+    void InitSharedReportCache();
+    int GetReportsFd();
+    bool SendToFifo(const struct iovec *iov, int iovcnt, size_t bufsiz);
+    bool SendToRing(const struct iovec *iov, int iovcnt, size_t bufsiz);
+    void RingDoorbell();
     bool Send(const char *buf, size_t bufsiz);
+    bool Send(const struct iovec *iov, int iovcnt, size_t bufsiz);
+    bool SendTextReport(AccessReport &report);
+    bool SendBinaryReport(AccessReport &report);
+    bool SendRecordUnbuffered(const ReportRecordHeader &record, const char *str, size_t strLength);
+
+    // Sends a record other than an access report through the buffer of this thread (unbuffered if another thread holds it)
+    void SendBufferedRecord(ReportRecordKind kind, uint32_t pid, const char *payload, size_t length);
+    size_t TimeRecord(ReportRecordHeader &record, AccessReportRecordTiming &timing);
+    size_t RecordLength(const ReportRecordHeader &record) { return record.length + (timedReports_ ? sizeof(AccessReportRecordTiming) : 0); }
+    ReportBuffers::Buffer* GetReportBuffer();
+    void AppendRecordToBuffer(ReportBuffers::Buffer *buffer, const ReportRecordHeader &record, const char *str, size_t strLength);
+    uint32_t InternProcessNameUnlocked(ReportBuffers::Buffer *buffer, uint32_t pid);
+    void FlushBufferUnlocked(ReportBuffers::Buffer *buffer);
+    void FlushBuffer(ReportBuffers::Buffer *buffer);
+    void FlushStaleBuffers(uint64_t now);
+    static void OnThreadExit(void *buffer);
+    static bool GetCacheKey(es_event_type_t event, const string &secondPath, es_event_type_t *key);
     bool IsCacheHit(es_event_type_t event, const string &path, const string &secondPath);
-    char** ensure_env_value_with_log(char *const envp[], char const *envName);
+    void AddToSharedCache(es_event_type_t event, const string &path, const string &secondPath);
+
+    // accesses reported on behalf of another process (i.e., by a seccomp supervisor) are only cached per process
+    inline bool UsesSharedCache() const { return sharedCache_.IsAttached() && reportingPid_ == 0; }
+
+    void ReportProcessTreeCompleted();
+    void ReportContentHash(const char *path, size_t pathLength, const uint8_t *hash, const struct stat &st);
+    void SendAccessSummary(uint32_t pid, const uint8_t *bytes, size_t length);
+    void FlushAccessSummary();
 
     ssize_t read_path_for_fd(int fd, char *buf, size_t bufsiz);
 
@@ -243,6 +521,12 @@ private:
             !(pip_->AllowChildProcessesToBreakAway() && getpid() != rootPid_);
     }
 
+    // Children that break away are not part of the process tree
+    inline bool TracksChildProcesses()
+    {
+        return processTree_.IsAttached() && IsEnabled() && !pip_->AllowChildProcessesToBreakAway();
+    }
+
     void PrintArgs(std::stringstream& str, bool isFirst)
     {
     }
@@ -267,7 +551,13 @@ private:
 
     void resolve_path(char *fullpath, bool followFinalSymlink);
 
+    // Like getcwd, but served from cwd_ when possible
+    bool get_cwd(char *buf, size_t bufsiz);
+
     static BxlObserver *sInstance;
+
+    // the instance this thread is constructing, if any (see GetInstance)
+    static thread_local BxlObserver *sConstructing __attribute__((tls_model("initial-exec")));
     static AccessCheckResult sNotChecked;
 
 #if _DEBUG
@@ -282,13 +572,59 @@ public:
     static BxlObserver* GetInstance();
 
     bool SendReport(AccessReport &report);
+
+    /** Sends all batched reports (if any).  Must be called before the process image goes away (fork/exec/exit). */
+    void FlushReports();
+
+    /**
+     * Must be called in the child process right after fork: discards reports buffered by the parent
+     * and forgets what the parent has already reported (the child has to report its own accesses).
+     */
+    void ResetStateAfterFork();
+
+    /**
+     * Returns 'envp' if it already has LD_PRELOAD (including this library) and all the __BUILDXL_* variables
+     * this process was started with; otherwise returns a copy of it (in a single allocation) with those fixed up.
+     */
     char** ensureEnvs(char *const envp[]);
 
     const char* GetProgramPath() { return progFullPath_; }
+    pid_t GetReportingPid() { return reportingPid_ != 0 ? reportingPid_ : getpid(); }
+    bool IsSupervisingStaticProcesses() { return superviseStaticProcesses_; }
+
+    /**
+     * Makes all subsequent reports be made on behalf of process 'pid' running 'exePath'.
+     * Only to be used by a seccomp supervisor process (see seccomp_supervisor.hpp).
+     */
+    void ReportOnBehalfOf(pid_t pid, const char *exePath);
     const char* GetReportsPath() { int len; return IsValid() ? pip_->GetReportsPath(&len) : NULL; }
     const char* GetDetoursLibPath() { return detoursLibFullPath_; }
 
     void report_exec(const char *syscallName, const char *procName, const char *file);
+
+    /**
+     * Reports that this process has spawned 'childPid' (fork, clone, posix_spawn), running 'childPath' (NULL when it
+     * runs the image of this process, i.e., it was forked).  Allocation-free and lock-free (other than the reports
+     * buffer, see SendBinaryReport), since it runs right around process creation, possibly in a multithreaded parent.
+     */
+    void report_child_process(const char *syscallName, pid_t childPid, const char *childPath = NULL);
+
+    /** Whether report_child_process reports anything */
+    bool ReportsChildProcesses() { return IsEnabled() && !pip_->AllowChildProcessesToBreakAway(); }
+
+    /**
+     * Process tree tracking (see process_tree.hpp).  BeginChildProcess must be called right before creating a child
+     * process and EndChildProcess right after, with whatever BeginChildProcess returned and the pid of the child (-1 if
+     * it could not be created); 'forked' tells whether the child runs ResetStateAfterFork (i.e., marks itself).
+     */
+    bool BeginChildProcess();
+    void EndChildProcess(bool begun, pid_t childPid, bool forked);
+
+    /**
+     * Must be called right before this process exits, after its last report has been flushed: reports the process
+     * tree as completed if this is the last process of the tree to exit.
+     */
+    void LeaveProcessTree();
     void report_audit_objopen(const char *fullpath)
     {
         IOEvent event(ES_EVENT_TYPE_NOTIFY_OPEN, ES_ACTION_TYPE_NOTIFY, fullpath, progFullPath_, S_IFREG);
@@ -296,15 +632,135 @@ public:
     }
 
     AccessCheckResult report_access(const char *syscallName, IOEvent &event, bool checkCache = true);
+
+#ifdef BXL_AUDIT_LIBRARY
+    /**
+     * Makes 'fn' the function the interposer of 'name' forwards to; returns false if 'name' is not interposed.
+     * Called (by the audit library) when the audited program binds 'name', with the definition it binds to.
+     */
+    bool RebindForwardTarget(const char *name, void *fn)
+    {
+        for (int i = 0; i < boundFunctionCount_; i++)
+        {
+            if (strcmp(boundFunctions_[i].name, name) == 0)
+            {
+                *boundFunctions_[i].slot = fn;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /** The map of library searches shared by the processes of the pip, NULL if there is none. */
+    LoaderSearchCache* GetLoaderSearchCache() { return loaderSearchCache_.IsAttached() ? &loaderSearchCache_ : NULL; }
+#endif
+
+    inline int RegisterInterposer(const char *name) { return interposeStats_.Register(name); }
+    inline bool IsCollectingStats()                 { return collectStats_; }
+    inline uint64_t StatsStart()                    { return collectStats_ || overheadBudget_.IsEnabled() ? InterposeStats::NowNs() : 0; }
+    inline void StatsAddRealCall(uint64_t start)
+    {
+        if (start == 0)
+        {
+            return;
+        }
+
+        uint64_t ns = InterposeStats::NowNs() - start;
+        OverheadBudget::AddRealCall(ns);
+        if (collectStats_) interposeStats_.AddToCurrent(kInterposeRealNs, ns);
+    }
+    inline void StatsAddInterposerCall(int hook, uint64_t start)
+    {
+        uint64_t now = InterposeStats::NowNs();
+        if (collectStats_)
+        {
+            interposeStats_.Add(hook, kInterposeCalls, 1);
+            interposeStats_.Add(hook, kInterposeTotalNs, now - start);
+        }
+
+        uint64_t overheadNs;
+        bool exceeded = overheadBudget_.Leave(now - start, now, overheadNs);
+        sandboxCounters_.Add(kSandboxStatInterposerNs, overheadNs);
+        if (exceeded)
+        {
+            ExceedOverheadBudget(now);
+        }
+    }
+
+    /**
+     * The interposers of this process took more of its wall time than its budget (see OverheadBudget): switches to the
+     * cheapest way of observing it that its pip permits, and tells the host which one that is.  Observe-only pips (whose
+     * reports the host checks anyway) defer their reports from then on (see AccessSummary); the other ones have no cheaper
+     * way, as they must report (and possibly deny) every access as it is made, and only tell.
+     */
+    void ExceedOverheadBudget(uint64_t nowNs);
+
+    /**
+     * Sends (and resets) the counters collected so far (see SandboxCounters), followed by the interposer stats if they are
+     * being collected; a no-op without binary reports.
+     */
+    void ReportStats();
     AccessCheckResult report_access(const char *syscallName, es_event_type_t eventType, const char *pathname, int oflags = 0);
     AccessCheckResult report_access(const char *syscallName, es_event_type_t eventType, const std::string &reportPath, const std::string &secondPath);
 
     AccessCheckResult report_access_fd(const char *syscallName, es_event_type_t eventType, int fd);
+    AccessCheckResult report_open(const char *syscallName, const std::string &pathStr, int oflag);
     AccessCheckResult report_access_at(const char *syscallName, es_event_type_t eventType, int dirfd, const char *pathname, int oflags = 0);
 
+    /**
+     * Reports the write of a copy_file_range/sendfile call from 'fdIn' to 'fdOut'.  Tools copying large files call
+     * these in tight loops (one chunk at a time) over the same pair of fds: only the first call for a pair resolves
+     * and reports its paths, subsequent ones return right away (as long as neither fd has been closed or replaced).
+     */
+    AccessCheckResult report_copy_range(const char *syscallName, int fdIn, int fdOut);
+
+    /**
+     * Reports a write to 'fd' (directly or through a stdio stream).  Linkers, archivers and output-heavy tools issue
+     * these by the million, a few bytes at a time: once a write to the path of 'fd' has been reported (and allowed),
+     * subsequent calls only test a flag in the fd table, until the fd is closed or replaced (close, dup2, dup3, ...).
+     * Unless 'sequential' is set (write and writev, which hash what they write, see hash_write), the file of 'fd' stops
+     * being hashed.
+     */
+    AccessCheckResult report_write_fd(const char *syscallName, int fd, bool sequential = false);
+
+    /**
+     * Output hashing (see output_hasher.hpp), a no-op unless enabled.  track_output must be called right after opening
+     * 'path' with 'oflag', with the resulting fd (or -1), which it returns (errno is preserved); hash_write must be
+     * constructed right before forwarding a sequential write, and invalidate_output called for any other change to a file
+     * through 'fd'.  Outputs are hashed until they are closed (see reset_fd_table_entry).
+     */
+    int track_output(int fd, const std::string &path, int oflag);
+    inline OutputHasher::Write hash_write(int fd) { return OutputHasher::Write(outputHasher_, fd); }
+    inline void invalidate_output(int fd) { if (outputHasher_.IsActive()) outputHasher_.Invalidate(fd); }
+
+    /** Stops hashing all outputs: must be called before creating a child process (which could inherit their fds). */
+    inline void invalidate_outputs() { outputHasher_.InvalidateAll(); }
+
     void reset_fd_table_entry(int fd);
+
+    /** Like reset_fd_table_entry, for fds 'first' through 'last' (as closed by close_range). */
+    void reset_fd_table_range(unsigned int first, unsigned int last);
+
+    inline IoUringObserver& GetIoUringObserver() { return ioUring_; }
+
+    /** Must be called after successfully changing the current working directory. */
+    void reset_cwd();
+
+    /**
+     * Must be called after successfully removing or replacing an existing directory or symlink:
+     * forgets all cached path resolutions (including the current working directory).
+     */
+    void invalidate_resolved_paths();
     std::string fd_to_path(int fd);
-    std::string normalize_path_at(int dirfd, const char *pathname, int oflags = 0);
+    // Unless 'resolveUntracked' is set, an absolute 'pathname' inside an untracked scope is returned as is (see IsLexicallyUntracked)
+    std::string normalize_path_at(int dirfd, const char *pathname, int oflags = 0, bool resolveUntracked = false);
+
+    // Whether accesses to the absolute path 'path' can neither be denied nor reported, judging only from the path itself
+    inline bool IsLexicallyUntracked(const char *path) const
+    {
+        return reportingPid_ == 0 && path[0] == '/' && untrackedScopes_.Contains(path);
+    }
 
     inline bool LogDebugEnabled()
     {
@@ -335,9 +791,9 @@ public:
             : 0;
     }
 
-    std::string normalize_path(const char *pathname, int oflags = 0)
+    std::string normalize_path(const char *pathname, int oflags = 0, bool resolveUntracked = false)
     {
-        return normalize_path_at(AT_FDCWD, pathname, oflags);
+        return normalize_path_at(AT_FDCWD, pathname, oflags, resolveUntracked);
     }
 
     std::string normalize_fd(int fd)
@@ -367,6 +823,8 @@ public:
 
     GEN_FN_DEF(pid_t, fork, void);
     GEN_FN_DEF(int, clone, int (*fn)(void *), void *child_stack, int flags, void *arg, ... /* pid_t *ptid, void *newtls, pid_t *ctid */ );
+    GEN_FN_DEF(int, posix_spawn, pid_t *, const char *, const posix_spawn_file_actions_t *, const posix_spawnattr_t *, char *const[], char *const[]);
+    GEN_FN_DEF(int, posix_spawnp, pid_t *, const char *, const posix_spawn_file_actions_t *, const posix_spawnattr_t *, char *const[], char *const[]);
     GEN_FN_DEF_REAL(void, _exit, int);
     GEN_FN_DEF(int, fexecve, int, char *const[], char *const[]);
     GEN_FN_DEF(int, execv, const char *, char *const[]);
@@ -454,7 +912,13 @@ public:
     /* ============ don't need to be interposed ======================= */
     GEN_FN_DEF(int, dup, int oldfd);
     GEN_FN_DEF(int, dup2, int oldfd, int newfd);
+    GEN_FN_DEF(int, dup3, int oldfd, int newfd, int flags);
     GEN_FN_DEF(int, close, int fd);
+    GEN_FN_DEF(int, close_range, unsigned int first, unsigned int last, int flags);
+    GEN_FN_DEF(int, statx, int dirfd, const char *pathname, int flags, unsigned int mask, struct statx *statxbuf);
+    GEN_FN_DEF(long, syscall, long number, ...);
+    GEN_FN_DEF(int, chdir, const char *path);
+    GEN_FN_DEF(int, fchdir, int fd);
     GEN_FN_DEF(int, fclose, FILE *stream);
     GEN_FN_DEF(int, statfs, const char *, struct statfs *buf);
     GEN_FN_DEF(int, statfs64, const char *, struct statfs64 *buf);
@@ -469,3 +933,35 @@ public:
     GEN_FN_DEF(int, getdents64, unsigned int fd, struct linux_dirent64 *dirp, unsigned int count);
     =================================================================== */
 };
+
+/**
+ * Attributes everything that happens until the end of the scope to the interposer 'hook' (see InterposeStats);
+ * instantiated by the INTERPOSE macros.
+ */
+class InterposeScope final
+{
+private:
+    BxlObserver *bxl_;
+    int hook_;
+    int previous_;
+    uint64_t start_;
+
+public:
+    InterposeScope(BxlObserver *bxl, int hook) : bxl_(bxl), hook_(hook), previous_(0), start_(bxl->StatsStart())
+    {
+        if (start_ != 0)
+        {
+            previous_ = InterposeStats::Enter(hook);
+            OverheadBudget::Enter();
+        }
+    }
+
+    ~InterposeScope()
+    {
+        if (start_ != 0)
+        {
+            bxl_->StatsAddInterposerCall(hook_, start_);
+            InterposeStats::Leave(previous_);
+        }
+    }
+};
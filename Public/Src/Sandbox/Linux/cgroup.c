@@ -0,0 +1,296 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "cgroup.h"
+
+// io.stat has a line per device, which is the largest of the files read here
+#define CGROUP_FILE_BUFFER_SIZE 16384
+
+static int cgroup_file_path(const char *path, const char *name, char *buffer)
+{
+    if (path == NULL || *path == '\0')
+    {
+        return EINVAL;
+    }
+
+    return snprintf(buffer, PATH_MAX, "%s/%s", path, name) < PATH_MAX ? 0 : ENAMETOOLONG;
+}
+
+static int write_cgroup_file(const char *path, const char *name, const char *value)
+{
+    char file[PATH_MAX];
+    int result = cgroup_file_path(path, name, file);
+    if (result != 0)
+    {
+        return result;
+    }
+
+    int fd = open(file, O_WRONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        return errno;
+    }
+
+    // cgroup files take a value in a single write
+    size_t length = strlen(value);
+    result = write(fd, value, length) == (ssize_t)length ? 0 : errno;
+    close(fd);
+    return result;
+}
+
+// Reads (up to 'size' - 1 bytes of) a cgroup file into 'buffer', as a NUL terminated string
+static int read_cgroup_file(const char *path, const char *name, char *buffer, size_t size)
+{
+    char file[PATH_MAX];
+    int result = cgroup_file_path(path, name, file);
+    if (result != 0)
+    {
+        return result;
+    }
+
+    int fd = open(file, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        return errno;
+    }
+
+    size_t length = 0;
+    while (length < size - 1)
+    {
+        ssize_t count = read(fd, buffer + length, size - 1 - length);
+        if (count == -1 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (count <= 0)
+        {
+            result = count == 0 ? 0 : errno;
+            break;
+        }
+
+        length += count;
+    }
+
+    buffer[length] = '\0';
+    close(fd);
+    return result;
+}
+
+static int read_cgroup_value(const char *path, const char *name, uint64_t *value)
+{
+    char buffer[64];
+    int result = read_cgroup_file(path, name, buffer, sizeof(buffer));
+    if (result == 0)
+    {
+        *value = strtoull(buffer, NULL, 10);
+    }
+
+    return result;
+}
+
+// Looks up 'key' in the "<key> <value>" lines of a flat keyed file (cpu.stat, memory.events, cgroup.events)
+static uint64_t get_keyed_value(const char *content, const char *key)
+{
+    size_t keyLength = strlen(key);
+    const char *line = content;
+    while (line != NULL && *line != '\0')
+    {
+        if (strncmp(line, key, keyLength) == 0 && line[keyLength] == ' ')
+        {
+            return strtoull(line + keyLength + 1, NULL, 10);
+        }
+
+        line = strchr(line, '\n');
+        if (line != NULL) line++;
+    }
+
+    return 0;
+}
+
+// Sums the "<key>=<value>" fields of the lines (one per device) of a nested keyed file (io.stat)
+static void add_nested_keyed_values(const char *content, PipCgroupUsage *usage)
+{
+    const char *field = content;
+    while (*field != '\0')
+    {
+        size_t length = strcspn(field, " \n");
+        const char *value = memchr(field, '=', length);
+        if (value != NULL)
+        {
+            uint64_t number = strtoull(value + 1, NULL, 10);
+            size_t keyLength = value - field;
+            if (keyLength == 6 && strncmp(field, "rbytes", 6) == 0)      usage->io_read_bytes += number;
+            else if (keyLength == 6 && strncmp(field, "wbytes", 6) == 0) usage->io_write_bytes += number;
+            else if (keyLength == 4 && strncmp(field, "rios", 4) == 0)   usage->io_read_ops += number;
+            else if (keyLength == 4 && strncmp(field, "wios", 4) == 0)   usage->io_write_ops += number;
+        }
+
+        field += length;
+        if (*field != '\0') field++;
+    }
+}
+
+int pip_cgroup_create(const char *path)
+{
+    if (path == NULL || *path != '/')
+    {
+        return EINVAL;
+    }
+
+    char parent[PATH_MAX];
+    if (snprintf(parent, sizeof(parent), "%s", path) >= (int)sizeof(parent))
+    {
+        return ENAMETOOLONG;
+    }
+
+    char *separator = strrchr(parent, '/');
+    if (separator != parent)
+    {
+        *separator = '\0';
+        // all at once first; if one of them is not available (or not delegated), whichever are
+        if (write_cgroup_file(parent, "cgroup.subtree_control", "+memory +cpu +io") != 0)
+        {
+            write_cgroup_file(parent, "cgroup.subtree_control", "+memory");
+            write_cgroup_file(parent, "cgroup.subtree_control", "+cpu");
+            write_cgroup_file(parent, "cgroup.subtree_control", "+io");
+        }
+    }
+
+    return mkdir(path, 0755) == 0 || errno == EEXIST ? 0 : errno;
+}
+
+int pip_cgroup_add_process(const char *path, pid_t pid)
+{
+    char value[32];
+    snprintf(value, sizeof(value), "%d", (int)pid);
+    return write_cgroup_file(path, "cgroup.procs", value);
+}
+
+int pip_cgroup_set_memory_high(const char *path, uint64_t bytes)
+{
+    char value[32];
+    if (bytes == 0)
+    {
+        snprintf(value, sizeof(value), "max");
+    }
+    else
+    {
+        snprintf(value, sizeof(value), "%" PRIu64, bytes);
+    }
+
+    return write_cgroup_file(path, "memory.high", value);
+}
+
+int pip_cgroup_get_usage(const char *path, PipCgroupUsage *usage, long usageSize)
+{
+    if (usage == NULL || usageSize != (long)sizeof(PipCgroupUsage))
+    {
+        return EINVAL;
+    }
+
+    memset(usage, 0, sizeof(PipCgroupUsage));
+
+    // every cgroup (but the root one) has cgroup.events, whichever controllers are enabled
+    char buffer[CGROUP_FILE_BUFFER_SIZE];
+    int result = read_cgroup_file(path, "cgroup.events", buffer, sizeof(buffer));
+    if (result != 0)
+    {
+        return result;
+    }
+
+    usage->populated = get_keyed_value(buffer, "populated") != 0;
+
+    read_cgroup_value(path, "memory.current", &usage->memory_current);
+    read_cgroup_value(path, "memory.peak", &usage->memory_peak);
+
+    if (read_cgroup_file(path, "memory.events", buffer, sizeof(buffer)) == 0)
+    {
+        usage->memory_high_events = get_keyed_value(buffer, "high");
+        usage->memory_oom_kill = get_keyed_value(buffer, "oom_kill");
+    }
+
+    // cpu.stat is there even when the cpu controller is not enabled
+    if (read_cgroup_file(path, "cpu.stat", buffer, sizeof(buffer)) == 0)
+    {
+        usage->cpu_usage_usec = get_keyed_value(buffer, "usage_usec");
+        usage->cpu_user_usec = get_keyed_value(buffer, "user_usec");
+        usage->cpu_system_usec = get_keyed_value(buffer, "system_usec");
+    }
+
+    if (read_cgroup_file(path, "io.stat", buffer, sizeof(buffer)) == 0)
+    {
+        add_nested_keyed_values(buffer, usage);
+    }
+
+    return 0;
+}
+
+int pip_cgroup_kill(const char *path)
+{
+    int result = write_cgroup_file(path, "cgroup.kill", "1");
+    if (result != ENOENT)
+    {
+        return result;
+    }
+
+    // no cgroup.kill: processes forked while this runs are missed, callers kill again until the cgroup is not populated
+    char file[PATH_MAX];
+    result = cgroup_file_path(path, "cgroup.procs", file);
+    if (result != 0)
+    {
+        return result;
+    }
+
+    FILE *procs = fopen(file, "re");
+    if (procs == NULL)
+    {
+        return errno;
+    }
+
+    int pid;
+    while (fscanf(procs, "%d", &pid) == 1)
+    {
+        kill(pid, SIGKILL);
+    }
+
+    fclose(procs);
+    return 0;
+}
+
+int pip_cgroup_is_populated(const char *path, bool *populated)
+{
+    if (populated == NULL)
+    {
+        return EINVAL;
+    }
+
+    char buffer[256];
+    int result = read_cgroup_file(path, "cgroup.events", buffer, sizeof(buffer));
+    if (result == 0)
+    {
+        *populated = get_keyed_value(buffer, "populated") != 0;
+    }
+
+    return result;
+}
+
+int pip_cgroup_remove(const char *path)
+{
+    if (path == NULL || *path == '\0')
+    {
+        return EINVAL;
+    }
+
+    return rmdir(path) == 0 || errno == ENOENT ? 0 : errno;
+}
@@ -0,0 +1,81 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#ifndef cgroup_h
+#define cgroup_h
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include "utils.h"
+
+/**
+ * Per pip resource accounting and limits on top of cgroup v2: a pip runs in a cgroup of its own (created under a parent
+ * cgroup the build was delegated, see EngineEnvironmentSettings.LinuxSandboxPipCgroupRoot), so that the kernel accounts
+ * for (and can act on) the whole process tree of the pip, including the processes that escaped it (e.g., daemonized).
+ *
+ * All functions take the absolute path of the cgroup directory (e.g., /sys/fs/cgroup/bxl/pip1234) and return 0 on
+ * success, the error code (errno) otherwise.
+ */
+
+/**
+ * Usage of a cgroup, as read by 'pip_cgroup_get_usage'
+ * CODESYNC: Public/Src/Utilities/Interop/MacOS/Cgroup.cs
+ */
+typedef struct
+{
+    uint64_t memory_current;        // memory.current (bytes)
+    uint64_t memory_peak;           // memory.peak (bytes), 0 on kernels that don't have it (< 5.19)
+    uint64_t memory_high_events;    // memory.events 'high': number of times the cgroup was throttled by memory.high
+    uint64_t memory_oom_kill;       // memory.events 'oom_kill'
+    uint64_t cpu_usage_usec;        // cpu.stat 'usage_usec'
+    uint64_t cpu_user_usec;         // cpu.stat 'user_usec'
+    uint64_t cpu_system_usec;       // cpu.stat 'system_usec'
+    uint64_t io_read_bytes;         // io.stat 'rbytes', summed over all devices
+    uint64_t io_write_bytes;        // io.stat 'wbytes', summed over all devices
+    uint64_t io_read_ops;           // io.stat 'rios', summed over all devices
+    uint64_t io_write_ops;          // io.stat 'wios', summed over all devices
+    uint32_t populated;             // cgroup.events 'populated': whether some process is still in the cgroup
+    uint32_t padding;
+} PipCgroupUsage;
+
+/**
+ * Creates the cgroup 'path'. The memory, cpu and io controllers are enabled (best effort) in the parent first, so that
+ * the files of the new cgroup that 'pip_cgroup_get_usage' reads exist.  A cgroup that already exists is reused.
+ */
+DLL_EXPORT int pip_cgroup_create(const char *path);
+
+/**
+ * Moves the process 'pid' into the cgroup 'path'; the children it creates from then on are created in there as well.
+ */
+DLL_EXPORT int pip_cgroup_add_process(const char *path, pid_t pid);
+
+/**
+ * Sets memory.high of the cgroup 'path': past 'bytes', the processes of the cgroup are throttled and reclaimed from
+ * (instead of killed, as with memory.max).  0 removes the limit.
+ */
+DLL_EXPORT int pip_cgroup_set_memory_high(const char *path, uint64_t bytes);
+
+/**
+ * Reads the usage of the cgroup 'path' into 'usage' ('usageSize' must be sizeof(PipCgroupUsage)).  The accounting of any
+ * controller that is not enabled is left at 0; only a missing cgroup.events (i.e., no such cgroup) is an error.
+ */
+DLL_EXPORT int pip_cgroup_get_usage(const char *path, PipCgroupUsage *usage, long usageSize);
+
+/**
+ * Kills every process of the cgroup 'path' (cgroup.kill, which also gets the processes forked while it runs).  On kernels
+ * that don't have cgroup.kill (< 5.14), SIGKILL is sent to each process listed in cgroup.procs instead.
+ */
+DLL_EXPORT int pip_cgroup_kill(const char *path);
+
+/**
+ * Sets 'populated' to whether some (possibly not yet reaped) process is still in the cgroup 'path'.
+ */
+DLL_EXPORT int pip_cgroup_is_populated(const char *path, bool *populated);
+
+/**
+ * Removes the cgroup 'path', which must not be populated (EBUSY otherwise).  A cgroup that doesn't exist is not an error.
+ */
+DLL_EXPORT int pip_cgroup_remove(const char *path);
+
+#endif /* cgroup_h */
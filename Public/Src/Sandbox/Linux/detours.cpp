@@ -23,36 +23,81 @@
 #include <sys/xattr.h>
 
 #include "bxl_observer.hpp"
+#include "seccomp_supervisor.hpp"
 
 #define ERROR_RETURN_VALUE -1
 
+// System calls (and flags) that the headers of glibc 2.17 predate; numbers above 400 are the same on all architectures
+#ifndef SYS_io_uring_setup
+#define SYS_io_uring_setup 425
+#endif
+#ifndef SYS_io_uring_enter
+#define SYS_io_uring_enter 426
+#endif
+#ifndef SYS_close_range
+#define SYS_close_range 436
+#endif
+#ifndef SYS_openat2
+#define SYS_openat2 437
+#endif
+#ifndef SYS_statx
+  #if defined(__x86_64__)
+    #define SYS_statx 332
+  #elif defined(__aarch64__)
+    #define SYS_statx 291
+  #endif
+#endif
+#ifndef CLOSE_RANGE_CLOEXEC
+#define CLOSE_RANGE_CLOEXEC (1U << 2)
+#endif
+
 static std::string sEmptyStr("");
 
 INTERPOSE(void, _exit, int status)({
     bxl->report_access("_exit", ES_EVENT_TYPE_NOTIFY_EXIT, std::string(""), std::string(""));
+    bxl->ReportStats();
+    bxl->FlushReports();
+    bxl->LeaveProcessTree();
     bxl->real__exit(status);
     _exit(status);
 })
 
-static void report_child_process(const char *syscall, BxlObserver *bxl, pid_t childPid)
-{
-    string exePath(bxl->GetProgramPath());
-    IOEvent event(getpid(), childPid, getppid(), ES_EVENT_TYPE_NOTIFY_FORK, ES_ACTION_TYPE_NOTIFY, exePath, std::string(""), exePath, 0, false);
-    bxl->report_access(syscall, event);
-}
-
 INTERPOSE(pid_t, fork, void)({
+    // don't let the child inherit (and later resend) reports buffered so far
+    bxl->FlushReports();
+    bxl->invalidate_outputs();
+    bool begun = bxl->BeginChildProcess();
     result_t<pid_t> childPid = bxl->fwd_fork();
 
+    if (childPid.get() == 0)
+    {
+        bxl->ResetStateAfterFork();
+        return childPid.restore();
+    }
+
     // report fork only when we are in the parent process
+    bxl->EndChildProcess(begun, childPid.get(), /* forked */ true);
     if (childPid.get() > 0)
     {
-        report_child_process(__func__, bxl, childPid.get());
+        bxl->report_child_process(__func__, childPid.get());
     }
 
     return childPid.restore();
 })
 
+typedef struct
+{
+    int (*fn)(void *);
+    void *arg;
+} CloneTrampolineArg;
+
+static int clone_trampoline(void *arg)
+{
+    CloneTrampolineArg *trampolineArg = (CloneTrampolineArg*)arg;
+    BxlObserver::GetInstance()->ResetStateAfterFork();
+    return trampolineArg->fn(trampolineArg->arg);
+}
+
 INTERPOSE(int, clone, int (*fn)(void *), void *child_stack, int flags, void *arg, ... /* pid_t *ptid, void *newtls, pid_t *ctid */ )({
     va_list args;
     va_start(args, arg);
@@ -61,37 +106,181 @@ INTERPOSE(int, clone, int (*fn)(void *), void *child_stack, int flags, void *arg
     pid_t *ctid = va_arg(args, pid_t*);
     va_end(args);
 
+    // threads (CLONE_THREAD implies CLONE_VM) are not part of the process tree, share our state and do not write on behalf
+    // of anyone else: there is nothing to flush, track or report for them
+    if ((flags & CLONE_THREAD) != 0)
+    {
+        return bxl->fwd_clone(fn, child_stack, flags, arg, ptid, newtls, ctid).restore();
+    }
+
+    bxl->FlushReports();
+
+    // Without CLONE_VM the child gets a copy of our address space (just like with fork), so it must reset the
+    // observer state before running 'fn'; the trampoline's argument lives on our stack, which the child has a copy of.
+    CloneTrampolineArg trampolineArg;
+    trampolineArg.fn = fn;
+    trampolineArg.arg = arg;
+    if ((flags & CLONE_VM) == 0)
+    {
+        fn = clone_trampoline;
+        arg = &trampolineArg;
+    }
+
+    bxl->invalidate_outputs();
+    bool begun = bxl->BeginChildProcess();
     result_t<int> result = bxl->fwd_clone(fn, child_stack, flags, arg, ptid, newtls, ctid);
+    bxl->EndChildProcess(begun, result.get(), /* forked */ (flags & CLONE_VM) == 0);
     if (result.get() > 0)
     {
-        report_child_process(__func__, bxl, result.get());
+        bxl->report_child_process(__func__, result.get());
+    }
+
+    return result.restore();
+})
+
+// Finds the file 'file' names as exec would ('searchPath': as execvp would, i.e., in PATH if it has no slash) into
+// 'path' (PATH_MAX long); sets it to an empty string if there is no such executable in PATH.
+static void find_executable(BxlObserver *bxl, const char *file, bool searchPath, char *path)
+{
+    if (!searchPath || strchr(file, '/') != NULL)
+    {
+        strlcpy(path, file, PATH_MAX);
+        return;
+    }
+
+    const char *dirs = getenv("PATH");
+    path[0] = '\0';
+    while (dirs != NULL && *dirs != '\0')
+    {
+        const char *end = strchrnul(dirs, ':');
+        int dirLength = (int)(end - dirs);
+        snprintf(path, PATH_MAX, "%.*s/%s", dirLength, dirLength == 0 ? "." : dirs, file);
+        if (bxl->real_access(path, X_OK) == 0)
+        {
+            return;
+        }
+
+        path[0] = '\0';
+        dirs = *end == ':' ? end + 1 : NULL;
+    }
+}
+
+// glibc spawns the child with clone(CLONE_VM | CLONE_VFORK) and execs it without going through any of our
+// interposers (so there is no fork or copy of the address space to account for).  Spawns keep that fast path: the
+// environment is only rewritten when it lacks (or alters) our variables, see ensureEnvs.  The child is
+// reported from here, with the image it runs, so that it is known by that image even if it never loads this library
+// (e.g., it is statically linked; such children are not supervised, see supervise_if_static); once it does, it reports
+// itself as well.
+static int spawn_child(BxlObserver *bxl, const char *syscallName, bool searchPath, pid_t *pid, const char *file,
+    const posix_spawn_file_actions_t *file_actions, const posix_spawnattr_t *attrp, char *const argv[], char *const envp[])
+{
+    std::string childPath;
+    if (bxl->ReportsChildProcesses())
+    {
+        char path[PATH_MAX];
+        find_executable(bxl, file, searchPath, path);
+        childPath = path[0] != '\0' ? bxl->normalize_path(path, 0, /* resolveUntracked */ true) : std::string(file);
+    }
+
+    pid_t childPid;
+    char **childEnvp = bxl->ensureEnvs(envp);
+    bxl->invalidate_outputs();
+    bool begun = bxl->BeginChildProcess();
+    result_t<int> result = searchPath
+        ? bxl->fwd_posix_spawnp(&childPid, file, file_actions, attrp, argv, childEnvp)
+        : bxl->fwd_posix_spawn(&childPid, file, file_actions, attrp, argv, childEnvp);
+    bxl->EndChildProcess(begun, result.get() == 0 ? childPid : -1, /* forked */ false);
+
+    // unlike for exec, this process lives on
+    if (childEnvp != envp)
+    {
+        free(childEnvp);
+    }
+
+    if (result.get() == 0)
+    {
+        if (pid != NULL)
+        {
+            *pid = childPid;
+        }
+
+        bxl->report_child_process(syscallName, childPid, childPath.empty() ? NULL : childPath.c_str());
     }
 
     return result.restore();
+}
+
+INTERPOSE(int, posix_spawn, pid_t *pid, const char *path, const posix_spawn_file_actions_t *file_actions, const posix_spawnattr_t *attrp, char *const argv[], char *const envp[])({
+    return spawn_child(bxl, __func__, false, pid, path, file_actions, attrp, argv, envp);
 })
 
+INTERPOSE(int, posix_spawnp, pid_t *pid, const char *file, const posix_spawn_file_actions_t *file_actions, const posix_spawnattr_t *attrp, char *const argv[], char *const envp[])({
+    return spawn_child(bxl, __func__, true, pid, file, file_actions, attrp, argv, envp);
+})
+
+// An existing directory or symlink ('mode' is its mode before the call) has been successfully removed, moved or replaced
+static void invalidate_if_dir_or_symlink(BxlObserver *bxl, mode_t mode, int result)
+{
+    if (result != -1 && (S_ISDIR(mode) || S_ISLNK(mode)))
+    {
+        bxl->invalidate_resolved_paths();
+    }
+}
+
+// Statically linked executables don't load this library: exec them under a seccomp supervisor instead (if enabled).
+// Returns only in the process that must go on with the exec.
+static void supervise_if_static(BxlObserver *bxl, const char *file, bool searchPath)
+{
+    if (!bxl->IsSupervisingStaticProcesses())
+    {
+        return;
+    }
+
+    char path[PATH_MAX];
+    find_executable(bxl, file, searchPath, path);
+    if (path[0] != '\0' && SeccompSupervisor::IsStaticExecutable(bxl, path))
+    {
+        SeccompSupervisor::SuperviseExec(bxl, bxl->normalize_path(path, 0, /* resolveUntracked */ true).c_str());
+    }
+}
+
 INTERPOSE(int, fexecve, int fd, char *const argv[], char *const envp[])({
+    supervise_if_static(bxl, bxl->fd_to_path(fd).c_str(), false);
     bxl->report_access_fd(__func__, ES_EVENT_TYPE_NOTIFY_EXEC, fd);
+    bxl->ReportStats();
+    bxl->FlushReports();
     return bxl->fwd_fexecve(fd, argv, bxl->ensureEnvs(envp)).restore();
 })
 
 INTERPOSE(int, execv, const char *file, char *const argv[])({
+    supervise_if_static(bxl, file, false);
     bxl->report_exec(__func__, argv[0], file);
+    bxl->ReportStats();
+    bxl->FlushReports();
     return bxl->fwd_execv(file, argv).restore();
 })
 
 INTERPOSE(int, execve, const char *file, char *const argv[], char *const envp[])({
+    supervise_if_static(bxl, file, false);
     bxl->report_exec(__func__, argv[0], file);
+    bxl->ReportStats();
+    bxl->FlushReports();
     return bxl->fwd_execve(file, argv, bxl->ensureEnvs(envp)).restore();
 })
 
 INTERPOSE(int, execvp, const char *file, char *const argv[])({
+    supervise_if_static(bxl, file, true);
     bxl->report_exec(__func__, argv[0], file);
+    bxl->ReportStats();
+    bxl->FlushReports();
     return bxl->fwd_execvp(file, argv).restore();
 })
 
 INTERPOSE(int, execvpe, const char *file, char *const argv[], char *const envp[])({
+    supervise_if_static(bxl, file, true);
     bxl->report_exec(__func__, argv[0], file);
+    bxl->ReportStats();
+    bxl->FlushReports();
     return bxl->fwd_execvpe(file, argv, bxl->ensureEnvs(envp)).restore();
 })
 
@@ -174,32 +363,32 @@ INTERPOSE(size_t, fread, void *ptr, size_t size, size_t nmemb, FILE *stream)({
 })
 
 INTERPOSE(size_t, fwrite, const void *ptr, size_t size, size_t nmemb, FILE *stream)({
-    auto check = bxl->report_access_fd(__func__, ES_EVENT_TYPE_NOTIFY_WRITE, fileno(stream));
+    auto check = bxl->report_write_fd(__func__, fileno(stream));
     return bxl->check_and_fwd_fwrite(check, (size_t)0, ptr, size, nmemb, stream);
 })
 
 INTERPOSE(int, fputc, int c, FILE *stream)({
-    auto check = bxl->report_access_fd(__func__, ES_EVENT_TYPE_NOTIFY_WRITE, fileno(stream));
+    auto check = bxl->report_write_fd(__func__, fileno(stream));
     return bxl->check_and_fwd_fputc(check, ERROR_RETURN_VALUE, c, stream);
 })
 
 INTERPOSE(int, fputs, const char *s, FILE *stream)({
-    auto check = bxl->report_access_fd(__func__, ES_EVENT_TYPE_NOTIFY_WRITE, fileno(stream));
+    auto check = bxl->report_write_fd(__func__, fileno(stream));
     return bxl->check_and_fwd_fputs(check, ERROR_RETURN_VALUE, s, stream);
 })
 
 INTERPOSE(int, putc, int c, FILE *stream)({
-    auto check = bxl->report_access_fd(__func__, ES_EVENT_TYPE_NOTIFY_WRITE, fileno(stream));
+    auto check = bxl->report_write_fd(__func__, fileno(stream));
     return bxl->check_and_fwd_putc(check, ERROR_RETURN_VALUE, c, stream);
 })
 
 INTERPOSE(int, putchar, int c)({
-    auto check = bxl->report_access_fd(__func__, ES_EVENT_TYPE_NOTIFY_WRITE, fileno(stdout));
+    auto check = bxl->report_write_fd(__func__, fileno(stdout));
     return bxl->check_and_fwd_putchar(check, ERROR_RETURN_VALUE, c);
 })
 
 INTERPOSE(int, puts, const char *s)({
-    auto check = bxl->report_access_fd(__func__, ES_EVENT_TYPE_NOTIFY_WRITE, fileno(stdout));
+    auto check = bxl->report_write_fd(__func__, fileno(stdout));
     return bxl->check_and_fwd_puts(check, ERROR_RETURN_VALUE, s);
 })
 
@@ -213,22 +402,6 @@ INTERPOSE(int, faccessat, int dirfd, const char *pathname, int mode, int flags)(
     return bxl->check_and_fwd_faccessat(check, ERROR_RETURN_VALUE, dirfd, pathname, mode, flags);
 })
 
-// report "Create" if path does not exist and O_CREAT or O_TRUNC is specified
-// report "Write" if path exists and O_CREAT or O_TRUNC is specified (because this truncates the file regardless of its content)
-// otherwise, report "Read"
-static AccessCheckResult ReportFileOpen(BxlObserver *bxl, string &pathStr, int oflag)
-{
-    mode_t pathMode = bxl->get_mode(pathStr.c_str());
-    bool pathExists = pathMode != 0;
-    bool isCreate = !pathExists && (oflag & (O_CREAT|O_TRUNC));
-    bool isWrite = pathExists && (oflag & (O_CREAT|O_TRUNC) && (oflag & O_WRONLY));
-    IOEvent event(
-        isCreate ? ES_EVENT_TYPE_NOTIFY_CREATE : isWrite ? ES_EVENT_TYPE_NOTIFY_WRITE : ES_EVENT_TYPE_NOTIFY_OPEN,
-        ES_ACTION_TYPE_NOTIFY,
-        pathStr, bxl->GetProgramPath(), pathMode, false);
-    return bxl->report_access(__func__, event);
-}
-
 INTERPOSE(int, open, const char *path, int oflag, ...)({
     va_list args;
     va_start(args, oflag);
@@ -236,8 +409,8 @@ INTERPOSE(int, open, const char *path, int oflag, ...)({
     va_end(args);
 
     std::string pathStr = bxl->normalize_path(path);
-    AccessCheckResult check = ReportFileOpen(bxl, pathStr, oflag);
-    return bxl->check_and_fwd_open(check, ERROR_RETURN_VALUE, path, oflag, mode);
+    AccessCheckResult check = bxl->report_open(__func__, pathStr, oflag);
+    return bxl->track_output(bxl->check_and_fwd_open(check, ERROR_RETURN_VALUE, path, oflag, mode), pathStr, oflag);
 })
 
 INTERPOSE(int, open64, const char *path, int oflag, ...)({
@@ -247,8 +420,8 @@ INTERPOSE(int, open64, const char *path, int oflag, ...)({
     va_end(args);
 
     std::string pathStr = bxl->normalize_path(path);
-    AccessCheckResult check = ReportFileOpen(bxl, pathStr, oflag);
-    return bxl->check_and_fwd_open64(check, ERROR_RETURN_VALUE, path, oflag, mode);
+    AccessCheckResult check = bxl->report_open(__func__, pathStr, oflag);
+    return bxl->track_output(bxl->check_and_fwd_open64(check, ERROR_RETURN_VALUE, path, oflag, mode), pathStr, oflag);
 })
 
 INTERPOSE(int, openat, int dirfd, const char *pathname, int flags, ...)({
@@ -258,8 +431,8 @@ INTERPOSE(int, openat, int dirfd, const char *pathname, int flags, ...)({
     va_end(args);
 
     std::string pathStr = bxl->normalize_path_at(dirfd, pathname);
-    AccessCheckResult check = ReportFileOpen(bxl, pathStr, flags);
-    return bxl->check_and_fwd_openat(check, ERROR_RETURN_VALUE, dirfd, pathname, flags, mode);
+    AccessCheckResult check = bxl->report_open(__func__, pathStr, flags);
+    return bxl->track_output(bxl->check_and_fwd_openat(check, ERROR_RETURN_VALUE, dirfd, pathname, flags, mode), pathStr, flags);
 })
 
 INTERPOSE(int, openat64, int dirfd, const char *pathname, int flags, ...)({
@@ -269,8 +442,8 @@ INTERPOSE(int, openat64, int dirfd, const char *pathname, int flags, ...)({
     va_end(args);
 
     std::string pathStr = bxl->normalize_path_at(dirfd, pathname);
-    AccessCheckResult check = ReportFileOpen(bxl, pathStr, flags);
-    return bxl->check_and_fwd_openat(check, ERROR_RETURN_VALUE, dirfd, pathname, flags, mode);
+    AccessCheckResult check = bxl->report_open(__func__, pathStr, flags);
+    return bxl->track_output(bxl->check_and_fwd_openat(check, ERROR_RETURN_VALUE, dirfd, pathname, flags, mode), pathStr, flags);
 })
 
 INTERPOSE(int, creat, const char *pathname, mode_t mode)({
@@ -278,38 +451,47 @@ INTERPOSE(int, creat, const char *pathname, mode_t mode)({
 })
 
 INTERPOSE(ssize_t, write, int fd, const void *buf, size_t bufsiz)({
-    auto check = bxl->report_access_fd(__func__, ES_EVENT_TYPE_NOTIFY_WRITE, fd);
-    return bxl->check_and_fwd_write(check, (ssize_t)ERROR_RETURN_VALUE, fd, buf, bufsiz);
+    auto check = bxl->report_write_fd(__func__, fd, /* sequential */ true);
+    OutputHasher::Write hashed = bxl->hash_write(fd);
+    ssize_t written = bxl->check_and_fwd_write(check, (ssize_t)ERROR_RETURN_VALUE, fd, buf, bufsiz);
+    hashed.Written(buf, written);
+    return written;
 })
 
 INTERPOSE(ssize_t, pwrite, int fd, const void *buf, size_t count, off_t offset)({
-    auto check = bxl->report_access_fd(__func__, ES_EVENT_TYPE_NOTIFY_WRITE, fd);
+    auto check = bxl->report_write_fd(__func__, fd);
     return bxl->check_and_fwd_pwrite(check, (ssize_t)ERROR_RETURN_VALUE, fd, buf, count, offset);
 })
 
 INTERPOSE(ssize_t, writev, int fd, const struct iovec *iov, int iovcnt)({
-    auto check = bxl->report_access_fd(__func__, ES_EVENT_TYPE_NOTIFY_WRITE, fd);
-    return bxl->check_and_fwd_writev(check, (ssize_t)ERROR_RETURN_VALUE, fd, iov, iovcnt);
+    auto check = bxl->report_write_fd(__func__, fd, /* sequential */ true);
+    OutputHasher::Write hashed = bxl->hash_write(fd);
+    ssize_t written = bxl->check_and_fwd_writev(check, (ssize_t)ERROR_RETURN_VALUE, fd, iov, iovcnt);
+    hashed.Written(iov, iovcnt, written);
+    return written;
 })
 
 INTERPOSE(ssize_t, pwritev, int fd, const struct iovec *iov, int iovcnt, off_t offset)({
-    auto check = bxl->report_access_fd(__func__, ES_EVENT_TYPE_NOTIFY_WRITE, fd);
+    auto check = bxl->report_write_fd(__func__, fd);
     return bxl->check_and_fwd_pwritev(check, (ssize_t)ERROR_RETURN_VALUE, fd, iov, iovcnt, offset);
 })
 
 INTERPOSE(ssize_t, pwritev2, int fd, const struct iovec *iov, int iovcnt, off_t offset, int flags)({
-    auto check = bxl->report_access_fd(__func__, ES_EVENT_TYPE_NOTIFY_WRITE, fd);
+    auto check = bxl->report_write_fd(__func__, fd);
     return bxl->check_and_fwd_pwritev2(check, (ssize_t)ERROR_RETURN_VALUE, fd, iov, iovcnt, offset, flags);
 })
 
 INTERPOSE(ssize_t, pwrite64, int fd, const void *buf, size_t count, off_t offset)({
-    auto check = bxl->report_access_fd(__func__, ES_EVENT_TYPE_NOTIFY_WRITE, fd);
+    auto check = bxl->report_write_fd(__func__, fd);
     return bxl->check_and_fwd_pwrite64(check, (ssize_t)ERROR_RETURN_VALUE, fd, buf, count, offset);
 })
 
 INTERPOSE(int, remove, const char *pathname)({
     auto check = bxl->report_access(__func__, ES_EVENT_TYPE_NOTIFY_UNLINK, pathname, O_NOFOLLOW);
-    return bxl->check_and_fwd_remove(check, ERROR_RETURN_VALUE, pathname);
+    mode_t mode = bxl->get_mode(pathname);
+    result_t<int> result = bxl->check_and_fwd_remove(check, ERROR_RETURN_VALUE, pathname);
+    invalidate_if_dir_or_symlink(bxl, mode, result.get());
+    return result.restore();
 })
 
 INTERPOSE(int, truncate, const char *path, off_t length)({
@@ -318,6 +500,7 @@ INTERPOSE(int, truncate, const char *path, off_t length)({
 })
 
 INTERPOSE(int, ftruncate, int fd, off_t length)({
+    bxl->invalidate_output(fd);
     auto check = bxl->report_access_fd(__func__, ES_EVENT_TYPE_NOTIFY_WRITE, fd);
     return bxl->check_and_fwd_ftruncate(check, (ssize_t)ERROR_RETURN_VALUE, fd, length);
 })
@@ -332,7 +515,9 @@ INTERPOSE(int, ftruncate64, int fd, off_t length)({
 
 INTERPOSE(int, rmdir, const char *pathname)({
     auto check = bxl->report_access(__func__, ES_EVENT_TYPE_NOTIFY_UNLINK, pathname);
-    return bxl->check_and_fwd_rmdir(check, ERROR_RETURN_VALUE, pathname);
+    result_t<int> result = bxl->check_and_fwd_rmdir(check, ERROR_RETURN_VALUE, pathname);
+    invalidate_if_dir_or_symlink(bxl, S_IFDIR, result.get());
+    return result.restore();
 })
 
 INTERPOSE(int, renameat, int olddirfd, const char *oldpath, int newdirfd, const char *newpath)({
@@ -340,6 +525,7 @@ INTERPOSE(int, renameat, int olddirfd, const char *oldpath, int newdirfd, const
     string newStr = bxl->normalize_path_at(newdirfd, newpath, O_NOFOLLOW);
 
     mode_t mode = bxl->get_mode(oldStr.c_str());
+    mode_t newMode = bxl->get_mode(newStr.c_str());
     IOEvent event(ES_EVENT_TYPE_NOTIFY_RENAME, ES_ACTION_TYPE_NOTIFY, oldStr, bxl->GetProgramPath(), mode, false, newStr);
 
     // special case for 'rename' must check before forwarding the call and report after
@@ -354,6 +540,10 @@ INTERPOSE(int, renameat, int olddirfd, const char *oldpath, int newdirfd, const
         bxl->report_access(__func__, event);
     }
 
+    // a directory or a symlink was moved (or replaced) --> cached path resolutions may no longer hold
+    invalidate_if_dir_or_symlink(bxl, mode, result.get());
+    invalidate_if_dir_or_symlink(bxl, newMode, result.get());
+
     return result.restore();
 })
 
@@ -381,13 +571,19 @@ INTERPOSE(int, linkat, int fd1, const char *name1, int fd2, const char *name2, i
 
 INTERPOSE(int, unlink, const char *path)({
     auto check = bxl->report_access(__func__, ES_EVENT_TYPE_NOTIFY_UNLINK, path, O_NOFOLLOW);
-    return bxl->check_and_fwd_unlink(check, ERROR_RETURN_VALUE, path);
+    mode_t mode = bxl->get_mode(path);
+    result_t<int> result = bxl->check_and_fwd_unlink(check, ERROR_RETURN_VALUE, path);
+    invalidate_if_dir_or_symlink(bxl, mode, result.get());
+    return result.restore();
 })
 
 INTERPOSE(int, unlinkat, int dirfd, const char *path, int flags)({
     int oflags = (flags & AT_REMOVEDIR) ? 0 : O_NOFOLLOW;
     auto check = bxl->report_access_at(__func__, ES_EVENT_TYPE_NOTIFY_UNLINK, dirfd, path, oflags);
-    return bxl->check_and_fwd_unlinkat(check, ERROR_RETURN_VALUE, dirfd, path, flags);
+    mode_t mode = (flags & AT_REMOVEDIR) ? S_IFDIR : bxl->get_mode(bxl->normalize_path_at(dirfd, path, O_NOFOLLOW).c_str());
+    result_t<int> result = bxl->check_and_fwd_unlinkat(check, ERROR_RETURN_VALUE, dirfd, path, flags);
+    invalidate_if_dir_or_symlink(bxl, mode, result.get());
+    return result.restore();
 })
 
 INTERPOSE(int, symlink, const char *target, const char *linkPath)({
@@ -491,17 +687,17 @@ INTERPOSE(int, mknodat, int dirfd, const char *pathname, mode_t mode, dev_t dev)
 })
 
 INTERPOSE(int, vprintf, const char *fmt, va_list args)({
-    bxl->report_access_fd(__func__, ES_EVENT_TYPE_NOTIFY_WRITE, 1);
+    bxl->report_write_fd(__func__, 1);
     return bxl->fwd_vprintf(fmt, args).restore();
 })
 
 INTERPOSE(int, vfprintf, FILE *f, const char *fmt, va_list args)({
-    bxl->report_access_fd(__func__, ES_EVENT_TYPE_NOTIFY_WRITE, fileno(f));
+    bxl->report_write_fd(__func__, fileno(f));
     return bxl->fwd_vfprintf(f, fmt, args).restore();
 })
 
 INTERPOSE(int, vdprintf, int fd, const char *fmt, va_list args)({
-    bxl->report_access_fd(__func__, ES_EVENT_TYPE_NOTIFY_WRITE, fd);
+    bxl->report_write_fd(__func__, fd);
     return bxl->fwd_vdprintf(fd, fmt, args).restore();
 })
 
@@ -552,7 +748,7 @@ INTERPOSE(void*, dlopen, const char *filename, int flags)({
     if (filename && (strncmp(filename, LIBC_SO, libcSoNameLength) == 0))
     {
         BXL_LOG_DEBUG(bxl, "NOT forwarding dlopen(\"%s\", %d); returning dlopen(NULL, %d)", filename, flags, flags);
-        return bxl->real_dlopen((char*)NULL, flags);
+        return bxl->fwd_dlopen((char*)NULL, flags).restore();
     }
     else
     {
@@ -586,7 +782,7 @@ INTERPOSE(int, fchownat, int dirfd, const char *pathname, uid_t owner, gid_t gro
 })
 
 INTERPOSE(ssize_t, sendfile, int out_fd, int in_fd, off_t *offset, size_t count)({
-    auto check = bxl->report_access_fd(__func__, ES_EVENT_TYPE_NOTIFY_WRITE, out_fd);
+    auto check = bxl->report_copy_range(__func__, in_fd, out_fd);
     return bxl->check_and_fwd_sendfile(check, (ssize_t)ERROR_RETURN_VALUE, out_fd, in_fd, offset, count);
 })
 
@@ -595,14 +791,14 @@ INTERPOSE(ssize_t, sendfile64, int out_fd, int in_fd, off_t *offset, size_t coun
 })
 
 INTERPOSE(ssize_t, copy_file_range, int fd_in, loff_t *off_in, int fd_out, loff_t *off_out, size_t len, unsigned int flags)({
-    auto check = bxl->report_access_fd(__func__, ES_EVENT_TYPE_NOTIFY_WRITE, fd_out);
+    auto check = bxl->report_copy_range(__func__, fd_in, fd_out);
     return bxl->check_and_fwd_copy_file_range(check, (ssize_t)ERROR_RETURN_VALUE, fd_in, off_in, fd_out, off_out, len, flags);
 })
 
 INTERPOSE(int, name_to_handle_at, int dirfd, const char *pathname, struct file_handle *handle, int *mount_id, int flags)({
     int oflags = (flags & AT_SYMLINK_FOLLOW) ? 0 : O_NOFOLLOW;
     string pathStr = bxl->normalize_path_at(dirfd, pathname, oflags);
-    auto check = ReportFileOpen(bxl, pathStr, oflags);
+    auto check = bxl->report_open(__func__, pathStr, oflags);
     return bxl->check_and_fwd_name_to_handle_at(check, ERROR_RETURN_VALUE, dirfd, pathname, handle, mount_id, flags);
 })
 
@@ -611,16 +807,268 @@ INTERPOSE(int, close, int fd) ({
     return bxl->fwd_close(fd).restore();
 })
 
+INTERPOSE(int, dup2, int oldfd, int newfd) ({
+    bxl->reset_fd_table_entry(newfd);
+    return bxl->fwd_dup2(oldfd, newfd).restore();
+})
+
+INTERPOSE(int, dup3, int oldfd, int newfd, int flags) ({
+    bxl->reset_fd_table_entry(newfd);
+    return bxl->fwd_dup3(oldfd, newfd, flags).restore();
+})
+
+INTERPOSE(int, chdir, const char *path) ({
+    result_t<int> result = bxl->fwd_chdir(path);
+    if (result.get() != -1) bxl->reset_cwd();
+    return result.restore();
+})
+
+INTERPOSE(int, fchdir, int fd) ({
+    result_t<int> result = bxl->fwd_fchdir(fd);
+    if (result.get() != -1) bxl->reset_cwd();
+    return result.restore();
+})
+
 INTERPOSE(int, fclose, FILE *f) ({
     bxl->reset_fd_table_entry(fileno(f));
     return bxl->fwd_fclose(f).restore();
 })
 
+static void report_statx(BxlObserver *bxl, const char *syscall, int dirfd, const char *pathname, int flags)
+{
+    if (pathname == NULL)
+    {
+        return;
+    }
+
+    if (*pathname == '\0' && (flags & AT_EMPTY_PATH) && dirfd != AT_FDCWD)
+    {
+        bxl->report_access_fd(syscall, ES_EVENT_TYPE_NOTIFY_STAT, dirfd);
+    }
+    else
+    {
+        bxl->report_access_at(syscall, ES_EVENT_TYPE_NOTIFY_STAT, dirfd, pathname, (flags & AT_SYMLINK_NOFOLLOW) ? O_NOFOLLOW : 0);
+    }
+}
+
+INTERPOSE(int, statx, int dirfd, const char *pathname, int flags, unsigned int mask, struct statx *statxbuf)({
+    result_t<int> result = bxl->fwd_statx(dirfd, pathname, flags, mask, statxbuf);
+    report_statx(bxl, __func__, dirfd, pathname, flags);
+    return result.restore();
+})
+
+INTERPOSE(int, close_range, unsigned int first, unsigned int last, int flags)({
+    // with CLOSE_RANGE_CLOEXEC the fds stay open (they are only marked close-on-exec)
+    if ((flags & CLOSE_RANGE_CLOEXEC) == 0)
+    {
+        bxl->reset_fd_table_range(first, last);
+    }
+
+    return bxl->fwd_close_range(first, last, flags).restore();
+})
+
+static AccessCheckResult report_openat2(BxlObserver *bxl, const char *syscall, int dirfd, const char *pathname, const io_uring_abi::open_how *how)
+{
+    if (pathname == NULL || how == NULL)
+    {
+        return AccessCheckResult::Invalid();
+    }
+
+    std::string pathStr = bxl->normalize_path_at(dirfd, pathname);
+    return bxl->report_open(syscall, pathStr, (int)how->flags);
+}
+
+// Reports the access an io_uring submission queue entry is about to make (see IoUringObserver).  Entries are only
+// observed, never denied: they are already in the ring when we get to see them.
+static void report_io_uring_sqe(BxlObserver *bxl, const io_uring_abi::sqe &sqe)
+{
+    const char *path = (const char*)sqe.addr;
+    const char *path2 = (const char*)sqe.off;
+
+    // paths relative to a registered (fixed) file cannot be resolved
+    if ((sqe.flags & io_uring_abi::SQE_FIXED_FILE) && sqe.opcode != io_uring_abi::OP_CLOSE && (path == NULL || *path != '/'))
+    {
+        return;
+    }
+
+    switch (sqe.opcode)
+    {
+        case io_uring_abi::OP_OPENAT:
+            if (path != NULL) bxl->report_open("io_uring_openat", bxl->normalize_path_at(sqe.fd, path), (int)sqe.op_flags);
+            break;
+
+        case io_uring_abi::OP_OPENAT2:
+            report_openat2(bxl, "io_uring_openat2", sqe.fd, path, (const io_uring_abi::open_how*)sqe.off);
+            break;
+
+        case io_uring_abi::OP_STATX:
+            report_statx(bxl, "io_uring_statx", sqe.fd, path, (int)sqe.op_flags);
+            break;
+
+        case io_uring_abi::OP_CLOSE:
+            bxl->reset_fd_table_entry(sqe.fd);
+            break;
+
+        case io_uring_abi::OP_MKDIRAT:
+            if (path != NULL) report_create("io_uring_mkdirat", bxl, sqe.fd, path, S_IFDIR);
+            break;
+
+        case io_uring_abi::OP_UNLINKAT:
+            if (path != NULL)
+            {
+                int oflags = (sqe.op_flags & AT_REMOVEDIR) ? 0 : O_NOFOLLOW;
+                bxl->report_access_at("io_uring_unlinkat", ES_EVENT_TYPE_NOTIFY_UNLINK, sqe.fd, path, oflags);
+                bxl->invalidate_resolved_paths();
+            }
+            break;
+
+        case io_uring_abi::OP_RENAMEAT:
+            if (path != NULL && path2 != NULL)
+            {
+                string oldStr = bxl->normalize_path_at(sqe.fd, path, O_NOFOLLOW);
+                string newStr = bxl->normalize_path_at((int)sqe.len, path2, O_NOFOLLOW);
+                IOEvent event(ES_EVENT_TYPE_NOTIFY_RENAME, ES_ACTION_TYPE_NOTIFY, oldStr, bxl->GetProgramPath(), bxl->get_mode(oldStr.c_str()), false, newStr);
+                bxl->report_access("io_uring_renameat", event);
+                bxl->invalidate_resolved_paths();
+            }
+            break;
+
+        case io_uring_abi::OP_SYMLINKAT:
+            if (path2 != NULL)
+            {
+                IOEvent event(ES_EVENT_TYPE_NOTIFY_CREATE, ES_ACTION_TYPE_NOTIFY, bxl->normalize_path_at(sqe.fd, path2, O_NOFOLLOW), bxl->GetProgramPath(), S_IFLNK);
+                bxl->report_access("io_uring_symlinkat", event);
+            }
+            break;
+
+        case io_uring_abi::OP_LINKAT:
+            if (path != NULL && path2 != NULL)
+            {
+                bxl->report_access(
+                    "io_uring_linkat",
+                    ES_EVENT_TYPE_NOTIFY_LINK,
+                    bxl->normalize_path_at(sqe.fd, path, O_NOFOLLOW),
+                    bxl->normalize_path_at((int)sqe.len, path2, O_NOFOLLOW));
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+static RealFunction<long (*)(long, ...)> sRealSyscall("syscall");
+
+static inline bool is_observed_syscall(long number)
+{
+    switch (number)
+    {
+        case SYS_close:
+        case SYS_close_range:
+        case SYS_openat2:
+#ifdef SYS_statx
+        case SYS_statx:
+#endif
+        case SYS_io_uring_setup:
+        case SYS_io_uring_enter:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Functions without a libc wrapper (e.g., openat2) or used without one (e.g., by Rust's std or io_uring libraries)
+// are called through syscall(); we only look at the few system calls above (everything else goes straight through,
+// before even getting the BxlObserver instance, which itself issues syscall(SYS_gettid) calls).
+INTERPOSE_SOMETIMES(
+    long,
+    syscall,
+    va_list args;
+    va_start(args, number);
+    long a1 = va_arg(args, long);
+    long a2 = va_arg(args, long);
+    long a3 = va_arg(args, long);
+    long a4 = va_arg(args, long);
+    long a5 = va_arg(args, long);
+    long a6 = va_arg(args, long);
+    va_end(args);
+    if (!is_observed_syscall(number)) {
+        return sRealSyscall(number, a1, a2, a3, a4, a5, a6);
+    },
+    long number, ...)(
+{
+    switch (number)
+    {
+        case SYS_close:
+            bxl->reset_fd_table_entry((int)a1);
+            break;
+
+        case SYS_close_range:
+            if ((a3 & CLOSE_RANGE_CLOEXEC) == 0)
+            {
+                bxl->reset_fd_table_range((unsigned int)a1, (unsigned int)a2);
+            }
+            break;
+
+        case SYS_openat2:
+        {
+            AccessCheckResult check = report_openat2(bxl, "openat2", (int)a1, (const char*)a2, (const io_uring_abi::open_how*)a3);
+            return bxl->check_and_fwd_syscall(check, (long)ERROR_RETURN_VALUE, number, a1, a2, a3, a4, a5, a6);
+        }
+
+#ifdef SYS_statx
+        case SYS_statx:
+        {
+            result_t<long> result = bxl->fwd_syscall(number, a1, a2, a3, a4, a5, a6);
+            report_statx(bxl, "statx", (int)a1, (const char*)a2, (int)a3);
+            return result.restore();
+        }
+#endif
+
+        case SYS_io_uring_setup:
+        {
+            // writes submitted through a ring are not seen by OutputHasher
+            bxl->invalidate_outputs();
+            result_t<long> result = bxl->fwd_syscall(number, a1, a2, a3, a4, a5, a6);
+            if (result.get() >= 0)
+            {
+                bxl->GetIoUringObserver().Track((int)result.get(), (const io_uring_abi::params*)a2);
+            }
+            return result.restore();
+        }
+
+        case SYS_io_uring_enter:
+            bxl->GetIoUringObserver().ForEachPendingEntry((int)a1, (unsigned int)a2, [bxl](const io_uring_abi::sqe &sqe)
+            {
+                report_io_uring_sqe(bxl, sqe);
+            });
+            break;
+
+        default:
+            break;
+    }
+
+    return bxl->fwd_syscall(number, a1, a2, a3, a4, a5, a6).restore();
+})
+
 static void report_exit(int exitCode, void *args)
 {
-    BxlObserver::GetInstance()->report_access("on_exit", ES_EVENT_TYPE_NOTIFY_EXIT, std::string(""), std::string(""));
+    BxlObserver *bxl = BxlObserver::GetInstance();
+    bxl->report_access("on_exit", ES_EVENT_TYPE_NOTIFY_EXIT, std::string(""), std::string(""));
+    bxl->ReportStats();
+    bxl->FlushReports();
+    bxl->LeaveProcessTree();
 }
 
+#ifdef BXL_AUDIT_LIBRARY
+// invoked by the audit library (see la_preinit) when it observes a process that libDetours.so was not loaded into;
+// 'on_exit_fn' is the on_exit of the audited program (the one we link against belongs to the audit namespace)
+void init_audited_process(int (*on_exit_fn)(void (*)(int, void*), void*))
+{
+    on_exit_fn(report_exit, NULL);
+    BxlObserver::GetInstance()->report_access("__init__", ES_EVENT_TYPE_NOTIFY_EXEC, __progname);
+}
+#else
 // invoked by the loader when our shared library is dynamically loaded into a new host process
 void __attribute__ ((constructor)) _bxl_linux_sandbox_init(void)
 {
@@ -630,6 +1078,7 @@ void __attribute__ ((constructor)) _bxl_linux_sandbox_init(void)
     // report that a new process has been created 
     BxlObserver::GetInstance()->report_access("__init__", ES_EVENT_TYPE_NOTIFY_EXEC, __progname);
 }
+#endif
 
 // ==========================
 
@@ -643,7 +1092,6 @@ int main(int argc, char **argv)
 /* ============ Sometimes useful (for debugging) to interpose without access checking
 
 INTERPOSE(int, dup, int fd)               ({ return bxl->fwd_dup(fd).restore(); })
-INTERPOSE(int, dup2, int oldfd, int newfd)({ return bxl->fwd_dup2(oldfd, newfd).restore(); })
 
 =================================================================== */
 
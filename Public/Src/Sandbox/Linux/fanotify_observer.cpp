@@ -0,0 +1,808 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include <elf.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/epoll.h>
+#include <sys/fanotify.h>
+#include <sys/statfs.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "fanotify_observer.hpp"
+#include "IOHandler.hpp"
+
+#define FAN_LOG(fmt, ...) fprintf(stderr, "[bxl-fanotify] %s: " fmt "\n", __func__, __VA_ARGS__)
+
+// events that are turned into reports (FAN_ACCESS is not: every read is preceded by an open)
+static const uint64_t kObservedEvents =
+    FAN_OPEN | FAN_OPEN_EXEC | FAN_MODIFY | FAN_CLOSE_WRITE | FAN_CREATE | FAN_DELETE | FAN_MOVED_FROM | FAN_MOVED_TO | FAN_ONDIR;
+
+// events dropped by the kernel in the directories of muted scopes: those of the directory itself and of its entries
+static const uint64_t kIgnoredEvents = (kObservedEvents & ~FAN_OPEN_EXEC) | FAN_EVENT_ON_CHILD;
+
+// what the data of every epoll event is about (upper 32 bits), the lower 32 bits being the pid for kEpollExit
+static const uint64_t kEpollFanotify = 1ULL << 32;
+static const uint64_t kEpollControl  = 2ULL << 32;
+static const uint64_t kEpollExit     = 3ULL << 32;
+
+FanotifyObserver *FanotifyObserver::sInstance = nullptr;
+
+static inline uint64_t ToFsid(const int val[2])
+{
+    return (uint64_t)(uint32_t)val[0] << 32 | (uint32_t)val[1];
+}
+
+// Parent of 'pid' according to /proc/<pid>/stat, or -1 if 'pid' is gone
+static pid_t GetParentPid(pid_t pid)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        return -1;
+    }
+
+    char stat[512];
+    ssize_t length = read(fd, stat, sizeof(stat) - 1);
+    close(fd);
+    if (length <= 0)
+    {
+        return -1;
+    }
+
+    // the command name (in parentheses) may contain anything, the state and the parent pid follow its closing parenthesis
+    stat[length] = '\0';
+    const char *end = strrchr(stat, ')');
+    char state;
+    pid_t ppid;
+    return end != nullptr && sscanf(end + 1, " %c %d", &state, &ppid) == 2 ? ppid : -1;
+}
+
+static std::string GetExecutablePath(pid_t pid)
+{
+    char link[64];
+    char path[PATH_MAX];
+    snprintf(link, sizeof(link), "/proc/%d/exe", pid);
+    ssize_t length = readlink(link, path, sizeof(path) - 1);
+    return length > 0 ? std::string(path, length) : std::string();
+}
+
+// Whether 'path' is the program interpreter (PT_INTERP) of the ELF executable 'executable'
+static bool IsProgramInterpreter(const char *executable, const std::string &path)
+{
+    int fd = open(executable, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        return false;
+    }
+
+    char interpreter[PATH_MAX] = {0};
+    Elf64_Ehdr ehdr;
+    if (pread(fd, &ehdr, sizeof(ehdr), 0) == sizeof(ehdr) &&
+        memcmp(ehdr.e_ident, ELFMAG, SELFMAG) == 0 &&
+        ehdr.e_ident[EI_CLASS] == ELFCLASS64 &&
+        ehdr.e_phentsize == sizeof(Elf64_Phdr))
+    {
+        for (int i = 0; i < ehdr.e_phnum; i++)
+        {
+            Elf64_Phdr phdr;
+            if (pread(fd, &phdr, sizeof(phdr), ehdr.e_phoff + i * sizeof(phdr)) != sizeof(phdr))
+            {
+                break;
+            }
+
+            if (phdr.p_type == PT_INTERP && phdr.p_filesz < sizeof(interpreter))
+            {
+                if (pread(fd, interpreter, phdr.p_filesz, phdr.p_offset) != (ssize_t)phdr.p_filesz)
+                {
+                    interpreter[0] = '\0';
+                }
+
+                break;
+            }
+        }
+    }
+
+    close(fd);
+
+    // the interpreter is usually named through a symlink (e.g., /lib64/ld-linux-x86-64.so.2), reported paths never are
+    char resolved[PATH_MAX];
+    return interpreter[0] != '\0' && realpath(interpreter, resolved) != nullptr && path == resolved;
+}
+
+FanotifyObserver::FanotifyObserver()
+    : sandbox_(0, Configuration::DetoursLinuxSandboxType), buffer_(kEventBufferSize)
+{
+    fanotifyFd_ = fanotify_init(FAN_CLASS_NOTIF | FAN_CLOEXEC | FAN_NONBLOCK | FAN_REPORT_DFID_NAME | FAN_UNLIMITED_QUEUE, O_RDONLY | O_LARGEFILE | O_CLOEXEC);
+    epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+
+    struct epoll_event event = { .events = EPOLLIN, .data = { .u64 = kEpollFanotify } };
+    if (fanotifyFd_ != -1 && epollFd_ != -1 && epoll_ctl(epollFd_, EPOLL_CTL_ADD, fanotifyFd_, &event) != 0)
+    {
+        close(epollFd_);
+        epollFd_ = -1;
+    }
+
+    sInstance = this;
+    sandbox_.SetAccessReportCallback(HandleAccessReport);
+}
+
+FanotifyObserver::~FanotifyObserver()
+{
+    sandbox_.SetAccessReportCallback(nullptr);
+    sInstance = nullptr;
+
+    for (auto &pip : pips_)
+    {
+        close(pip.second.reportsFd);
+    }
+
+    for (auto &pidfd : pidfds_)
+    {
+        close(pidfd.second);
+    }
+
+    for (auto &mount : mounts_)
+    {
+        close(mount.fd);
+    }
+
+    if (epollFd_ != -1) close(epollFd_);
+    if (fanotifyFd_ != -1) close(fanotifyFd_);
+}
+
+bool FanotifyObserver::AddMount(const char *path)
+{
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    struct statfs st;
+    if (fd == -1 || fstatfs(fd, &st) != 0)
+    {
+        FAN_LOG("Could not open directory '%s'; errno: %d", path, errno);
+        if (fd != -1) close(fd);
+        return false;
+    }
+
+    if (fanotify_mark(fanotifyFd_, FAN_MARK_ADD | FAN_MARK_FILESYSTEM, kObservedEvents, fd, NULL) != 0)
+    {
+        FAN_LOG("Could not mark the filesystem of '%s'; errno: %d", path, errno);
+        close(fd);
+        return false;
+    }
+
+    // file handles are only reported for the filesystems marked here, so only these are needed to open them
+    mounts_.push_back({ ToFsid(st.f_fsid.__val), fd });
+    return true;
+}
+
+bool FanotifyObserver::StartPip(pid_t rootPid, const char *famPath)
+{
+    StopPip(rootPid);
+
+    int famFd = open(famPath, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (famFd == -1 || fstat(famFd, &st) != 0)
+    {
+        FAN_LOG("Could not open file '%s'; errno: %d", famPath, errno);
+        if (famFd != -1) close(famFd);
+        return false;
+    }
+
+    std::vector<char> fam(st.st_size);
+    ssize_t numRead = fam.empty() ? 0 : read(famFd, fam.data(), fam.size());
+    close(famFd);
+    if (numRead != (ssize_t)fam.size())
+    {
+        FAN_LOG("Could not read file '%s'; errno: %d", famPath, errno);
+        return false;
+    }
+
+    std::shared_ptr<SandboxedPip> pip;
+    try
+    {
+        pip = std::shared_ptr<SandboxedPip>(new SandboxedPip(rootPid, fam.data(), fam.size(), /* copyPayload */ true));
+    }
+    catch (BuildXLException &ex)
+    {
+        FAN_LOG("Could not parse file '%s': %s", famPath, ex.what());
+        return false;
+    }
+
+    int length;
+    const char *reportsPath = pip->GetReportsPath(&length);
+    int reportsFd = open(reportsPath, O_WRONLY | O_CLOEXEC);
+    if (reportsFd == -1)
+    {
+        FAN_LOG("Could not open reports file '%s'; errno: %d", reportsPath, errno);
+        return false;
+    }
+
+    if (!sandbox_.TrackRootProcess(pip))
+    {
+        FAN_LOG("Could not track root process %d", rootPid);
+        close(reportsFd);
+        return false;
+    }
+
+    // the manifest does not name the executable (see FileAccessManifestParser::GetProcessPath)
+    std::string executable = GetExecutablePath(rootPid);
+    if (!executable.empty())
+    {
+        sandbox_.FindTrackedProcess(rootPid)->SetPath(executable.c_str());
+    }
+
+    pips_[rootPid] = { pip, reportsFd, executable };
+    pip->GetUntrackedScopes(pips_[rootPid].untrackedScopes);
+    UpdateMutedScopes();
+
+    // pids that did not belong to any pip may belong to this one now (reused pids, or processes that were just being forked)
+    untracked_.clear();
+
+    if (!WatchExit(rootPid))
+    {
+        pendingExits_.push_back(rootPid);
+    }
+
+    return true;
+}
+
+void FanotifyObserver::StopPip(pid_t rootPid)
+{
+    auto pip = pips_.find(rootPid);
+    if (pip != pips_.end())
+    {
+        close(pip->second.reportsFd);
+        pips_.erase(pip);
+        UpdateMutedScopes();
+    }
+}
+
+void FanotifyObserver::HandleAccessReport(AccessReport report, int _)
+{
+    if (sInstance != nullptr)
+    {
+        sInstance->SendReport(report);
+    }
+}
+
+void FanotifyObserver::SendReport(AccessReport &report)
+{
+    auto pip = pips_.find(report.rootPid);
+    if (pip == pips_.end())
+    {
+        return; // stopped
+    }
+
+    // the process name is the one libDetours.so would report: that of the reporting process (the root process once it is gone)
+    std::shared_ptr<SandboxedProcess> process = sandbox_.FindTrackedProcess(report.pid);
+    const char *processPath = process != nullptr ? process->GetPath() : pip->second.rootExecutable.c_str();
+    const char *slash = strrchr(processPath, '/');
+    const char *progName = slash != nullptr ? slash + 1 : processPath;
+
+    // CODESYNC: BxlObserver::SendTextReport
+    const int PrefixLength = sizeof(uint);
+    char buffer[PIPE_BUF] = {0};
+    int maxMessageLength = PIPE_BUF - PrefixLength;
+    int numWritten = snprintf(
+        &buffer[PrefixLength], maxMessageLength, "%s|%d|%d|%d|%d|%d|%d|%s\n",
+        progName, report.pid, report.requestedAccess, report.status, report.reportExplicitly, report.error, report.operation, report.path);
+    if (numWritten >= maxMessageLength)
+    {
+        FAN_LOG("Message does not fit PIPE_BUF (%d), dropping it: %s", PIPE_BUF, &buffer[PrefixLength]);
+        return;
+    }
+
+    *(uint*)(buffer) = numWritten;
+    if (write(pip->second.reportsFd, buffer, numWritten + PrefixLength) != numWritten + PrefixLength)
+    {
+        FAN_LOG("Could not send report to pip %d; errno: %d", report.rootPid, errno);
+    }
+
+    // nothing is reported for a pip after its process tree has completed
+    if (report.operation == FileOperation::kOpProcessTreeCompleted)
+    {
+        StopPip(report.rootPid);
+    }
+}
+
+bool FanotifyObserver::WatchExit(pid_t pid)
+{
+    int pidfd = syscall(SYS_pidfd_open, pid, 0);
+    if (pidfd == -1)
+    {
+        return false;
+    }
+
+    struct epoll_event event = { .events = EPOLLIN, .data = { .u64 = kEpollExit | (uint32_t)pid } };
+    if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, pidfd, &event) != 0)
+    {
+        close(pidfd);
+        return false;
+    }
+
+    pidfds_[pid] = pidfd;
+    return true;
+}
+
+void FanotifyObserver::HandleExit(pid_t pid)
+{
+    auto pidfd = pidfds_.find(pid);
+    if (pidfd != pidfds_.end())
+    {
+        close(pidfd->second); // also removes it from the epoll set
+        pidfds_.erase(pidfd);
+    }
+
+    std::shared_ptr<SandboxedProcess> process = sandbox_.FindTrackedProcess(pid);
+    if (process == nullptr)
+    {
+        return;
+    }
+
+    IOEvent event(pid, 0, 0, ES_EVENT_TYPE_NOTIFY_EXIT, ES_ACTION_TYPE_NOTIFY, "", "", process->GetPath(), 0);
+    IOHandler handler(&sandbox_);
+    handler.SetProcess(process);
+    handler.HandleEvent(event);
+}
+
+std::shared_ptr<SandboxedProcess> FanotifyObserver::FindProcess(pid_t pid)
+{
+    std::shared_ptr<SandboxedProcess> process = sandbox_.FindTrackedProcess(pid);
+    if (process != nullptr || untracked_.find(pid) != untracked_.end())
+    {
+        return process;
+    }
+
+    // walk up to the closest tracked ancestor
+    std::vector<pid_t> chain;
+    for (pid_t current = pid; process == nullptr && (int)chain.size() < kMaxParentChain; )
+    {
+        chain.push_back(current);
+        current = GetParentPid(current);
+        if (current <= 1 || untracked_.find(current) != untracked_.end())
+        {
+            break;
+        }
+
+        process = sandbox_.FindTrackedProcess(current);
+    }
+
+    // report a fork for every process in between, from the ancestor down
+    for (auto child = chain.rbegin(); process != nullptr && child != chain.rend(); ++child)
+    {
+        std::string executable = GetExecutablePath(*child);
+        IOEvent event(process->GetPid(), *child, process->GetPid(), ES_EVENT_TYPE_NOTIFY_FORK, ES_ACTION_TYPE_NOTIFY, "", "",
+            executable.empty() ? std::string(process->GetPath()) : executable, 0);
+        IOHandler handler(&sandbox_);
+        handler.SetProcess(process);
+        handler.HandleEvent(event);
+
+        // not tracked when the pip allows child processes to break away
+        process = sandbox_.FindTrackedProcess(*child);
+        if (process != nullptr && !WatchExit(*child))
+        {
+            pendingExits_.push_back(*child);
+        }
+    }
+
+    if (process == nullptr)
+    {
+        if (untracked_.size() + chain.size() > kMaxUntracked)
+        {
+            untracked_.clear();
+        }
+
+        untracked_.insert(chain.begin(), chain.end());
+    }
+
+    return process;
+}
+
+bool FanotifyObserver::ResolveDirectory(uint64_t fsid, const struct file_handle *handle, std::string &path)
+{
+    std::string key((const char *)&fsid, sizeof(fsid));
+    key.append((const char *)handle, sizeof(struct file_handle) + handle->handle_bytes);
+
+    auto cached = directories_.find(key);
+    if (cached != directories_.end())
+    {
+        path = cached->second;
+        return true;
+    }
+
+    int mountFd = -1;
+    for (const auto &mount : mounts_)
+    {
+        if (mount.fsid == fsid)
+        {
+            mountFd = mount.fd;
+            break;
+        }
+    }
+
+    int fd = mountFd == -1 ? -1 : open_by_handle_at(mountFd, (struct file_handle *)handle, O_PATH | O_CLOEXEC);
+    if (fd == -1)
+    {
+        return false; // e.g., the directory is gone already
+    }
+
+    char link[64];
+    char resolved[PATH_MAX];
+    snprintf(link, sizeof(link), "/proc/self/fd/%d", fd);
+    ssize_t length = readlink(link, resolved, sizeof(resolved) - 1);
+    close(fd);
+    if (length <= 0 || resolved[0] != '/')
+    {
+        return false;
+    }
+
+    if (directories_.size() >= kMaxDirectories)
+    {
+        directories_.clear();
+    }
+
+    path.assign(resolved, length);
+    directories_.emplace(std::move(key), path);
+    return true;
+}
+
+void FanotifyObserver::HandleEvent(pid_t pid, uint64_t mask, const std::string &path)
+{
+    std::shared_ptr<SandboxedProcess> process = FindProcess(pid);
+    if (process == nullptr)
+    {
+        return;
+    }
+
+    // events on the same object that were not read yet are merged, so a single event may stand for several accesses
+    static const struct { uint64_t mask; es_event_type_t type; } kEventTypes[] =
+    {
+        { FAN_OPEN_EXEC,   ES_EVENT_TYPE_NOTIFY_EXEC   },
+        { FAN_OPEN,        ES_EVENT_TYPE_NOTIFY_OPEN   },
+        { FAN_CREATE,      ES_EVENT_TYPE_NOTIFY_CREATE },
+        { FAN_MOVED_TO,    ES_EVENT_TYPE_NOTIFY_CREATE },
+        { FAN_MODIFY,      ES_EVENT_TYPE_NOTIFY_WRITE  },
+        { FAN_CLOSE_WRITE, ES_EVENT_TYPE_NOTIFY_WRITE  },
+        { FAN_DELETE,      ES_EVENT_TYPE_NOTIFY_UNLINK },
+        { FAN_MOVED_FROM,  ES_EVENT_TYPE_NOTIFY_UNLINK },
+    };
+
+    mode_t mode = 0;
+    if (mask & FAN_ONDIR)
+    {
+        mode = S_IFDIR;
+    }
+    else
+    {
+        struct stat st;
+        mode = lstat(path.c_str(), &st) == 0 ? st.st_mode : S_IFREG;
+    }
+
+    // the accesses of the event are handled together once the exec (if any) has been, which changes the path of the process
+    std::vector<IOEvent> events;
+    for (const auto &eventType : kEventTypes)
+    {
+        if ((mask & eventType.mask) == 0)
+        {
+            continue;
+        }
+
+        es_event_type_t type = eventType.type;
+        if (type == ES_EVENT_TYPE_NOTIFY_EXEC)
+        {
+            // the program interpreter of a dynamically linked executable is opened for exec too, right after the executable
+            if (!IsProgramInterpreter(process->GetPath(), path))
+            {
+                IOEvent event(pid, 0, 0, ES_EVENT_TYPE_NOTIFY_EXEC, ES_ACTION_TYPE_NOTIFY, path, "", path, mode);
+                IOHandler handler(&sandbox_);
+                handler.SetProcess(process);
+                handler.HandleEvent(event);
+                continue;
+            }
+
+            type = ES_EVENT_TYPE_NOTIFY_OPEN;
+        }
+
+        auto pip = pips_.find(process->GetPip()->GetProcessId());
+        if (pip == pips_.end())
+        {
+            break; // stopped
+        }
+
+        std::string key = std::to_string(type) + "|" + process->GetPath() + "|" + path;
+        if (!pip->second.reported.insert(std::move(key)).second)
+        {
+            continue;
+        }
+
+        events.emplace_back(pid, 0, 0, type, ES_ACTION_TYPE_NOTIFY, path, "", process->GetPath(), mode);
+    }
+
+    if (!events.empty())
+    {
+        IOHandler handler(&sandbox_);
+        handler.SetProcess(process);
+        handler.HandleEvents(events.data(), events.size());
+    }
+}
+
+void FanotifyObserver::UpdateMutedScopes()
+{
+    std::set<std::string> scopes;
+
+    auto it = pips_.begin();
+    if (it != pips_.end())
+    {
+        scopes.insert(it->second.untrackedScopes.begin(), it->second.untrackedScopes.end());
+        for (++it; it != pips_.end() && !scopes.empty(); ++it)
+        {
+            scopes = SandboxedPip::IntersectUntrackedScopes(scopes, it->second.untrackedScopes);
+        }
+    }
+
+    // directories that are not muted anymore must not stay ignored: the pip that tracks them may be about to start
+    bool shrunk = false;
+    for (const std::string &muted : mutedScopes_)
+    {
+        if (!IsWithin(scopes, muted))
+        {
+            shrunk = true;
+            break;
+        }
+    }
+
+    mutedScopes_ = std::move(scopes);
+    if (shrunk)
+    {
+        FlushIgnoredDirectories();
+    }
+}
+
+bool FanotifyObserver::IsWithin(const std::set<std::string> &scopes, const std::string &path)
+{
+    for (const std::string &scope : scopes)
+    {
+        if (SandboxedPip::IsWithinScope(path, scope))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void FanotifyObserver::IgnoreDirectory(const std::string &directory)
+{
+    if (!kernelIgnore_ || !ignoredDirectories_.insert(directory).second)
+    {
+        return;
+    }
+
+    // evictable: the kernel may drop the mark (and the inode it pins) under memory pressure, the next event adds it back
+    if (fanotify_mark(fanotifyFd_, FAN_MARK_ADD | FAN_MARK_IGNORE_SURV | FAN_MARK_EVICTABLE, kIgnoredEvents, AT_FDCWD, directory.c_str()) != 0)
+    {
+        if (errno == EINVAL)
+        {
+            // FAN_MARK_IGNORE needs Linux 6.0: muted events are only dropped here
+            FAN_LOG("Ignore marks are not supported (errno: %d), muted scopes are filtered in user space", errno);
+            kernelIgnore_ = false;
+        }
+
+        ignoredDirectories_.erase(directory);
+    }
+}
+
+void FanotifyObserver::FlushIgnoredDirectories()
+{
+    if (ignoredDirectories_.empty())
+    {
+        return;
+    }
+
+    // the filesystem marks are not affected: without FAN_MARK_MOUNT or FAN_MARK_FILESYSTEM only inode marks are flushed
+    if (fanotify_mark(fanotifyFd_, FAN_MARK_FLUSH, 0, AT_FDCWD, NULL) != 0)
+    {
+        FAN_LOG("Could not flush ignore marks; errno: %d", errno);
+    }
+
+    ignoredDirectories_.clear();
+}
+
+bool FanotifyObserver::HandleEvents()
+{
+    while (true)
+    {
+        ssize_t length = read(fanotifyFd_, buffer_.data(), buffer_.size());
+        if (length == -1)
+        {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN) return true;
+
+            FAN_LOG("Could not read events; errno: %d", errno);
+            return false;
+        }
+
+        const struct fanotify_event_metadata *metadata = (const struct fanotify_event_metadata *)buffer_.data();
+        for (; FAN_EVENT_OK(metadata, length); metadata = FAN_EVENT_NEXT(metadata, length))
+        {
+            if (metadata->vers != FANOTIFY_METADATA_VERSION)
+            {
+                FAN_LOG("Unexpected event metadata version: %d", metadata->vers);
+                return false;
+            }
+
+            if (metadata->mask & FAN_Q_OVERFLOW)
+            {
+                // nothing can tell which accesses were lost, so none of the observed pips can be trusted anymore
+                FAN_LOG("Event queue overflow; %zu pips affected", pips_.size());
+                return false;
+            }
+
+            if (metadata->pid == getpid())
+            {
+                continue;
+            }
+
+            // the (only) information record of every event: the directory's handle and the name of the entry in it
+            const char *info = (const char *)metadata + metadata->metadata_len;
+            const char *end = (const char *)metadata + metadata->event_len;
+            while (info + sizeof(struct fanotify_event_info_header) <= end)
+            {
+                const struct fanotify_event_info_fid *fid = (const struct fanotify_event_info_fid *)info;
+                if (fid->hdr.len == 0)
+                {
+                    break;
+                }
+
+                info += fid->hdr.len;
+                if (fid->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID_NAME && fid->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID)
+                {
+                    continue;
+                }
+
+                const struct file_handle *handle = (const struct file_handle *)fid->handle;
+                std::string directory;
+                if (!ResolveDirectory(ToFsid(fid->fsid.val), handle, directory))
+                {
+                    continue;
+                }
+
+                // events on a directory itself are reported with its own handle and "." (or no name)
+                std::string path = directory;
+                const char *name = fid->hdr.info_type == FAN_EVENT_INFO_TYPE_DFID_NAME
+                    ? (const char *)handle->f_handle + handle->handle_bytes
+                    : "";
+                if (name[0] != '\0' && strcmp(name, ".") != 0)
+                {
+                    path.append(path.back() == '/' ? "" : "/").append(name);
+                }
+
+                // executables are never muted: the exec is what tells which program the process runs
+                if (IsMuted(path) && (metadata->mask & FAN_OPEN_EXEC) == 0)
+                {
+                    if (IsMuted(directory))
+                    {
+                        IgnoreDirectory(directory);
+                    }
+                }
+                else
+                {
+                    HandleEvent(metadata->pid, metadata->mask, path);
+
+                    // a directory moved out of a muted scope takes its ignore marks (and those of its subdirectories) along
+                    if ((metadata->mask & FAN_ONDIR) && (metadata->mask & FAN_MOVED_TO))
+                    {
+                        FlushIgnoredDirectories();
+                    }
+                }
+
+                // cached paths of the directory (or of anything below it) may be stale now
+                if ((metadata->mask & FAN_ONDIR) && (metadata->mask & (FAN_DELETE | FAN_MOVED_FROM)))
+                {
+                    directories_.clear();
+                }
+            }
+        }
+    }
+}
+
+bool FanotifyObserver::HandleControl(int fd, std::string &pending)
+{
+    char chunk[PIPE_BUF];
+    ssize_t length = read(fd, chunk, sizeof(chunk));
+    if (length == -1)
+    {
+        return errno == EINTR || errno == EAGAIN;
+    }
+
+    if (length == 0)
+    {
+        return false;
+    }
+
+    pending.append(chunk, length);
+    for (size_t newline; (newline = pending.find('\n')) != std::string::npos; pending.erase(0, newline + 1))
+    {
+        std::string line = pending.substr(0, newline);
+        size_t first = line.find('|');
+        size_t second = first == std::string::npos ? std::string::npos : line.find('|', first + 1);
+        std::string command = line.substr(0, first);
+        pid_t rootPid = first == std::string::npos ? 0 : atoi(line.c_str() + first + 1);
+
+        if (command == "start" && rootPid > 0 && second != std::string::npos)
+        {
+            StartPip(rootPid, line.c_str() + second + 1);
+        }
+        else if (command == "stop" && rootPid > 0)
+        {
+            StopPip(rootPid);
+        }
+        else
+        {
+            FAN_LOG("Ignoring unrecognized control line: %s", line.c_str());
+        }
+    }
+
+    return true;
+}
+
+int FanotifyObserver::Run(int controlFd)
+{
+    struct epoll_event control = { .events = EPOLLIN, .data = { .u64 = kEpollControl } };
+    if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, controlFd, &control) != 0)
+    {
+        FAN_LOG("Could not watch control file descriptor; errno: %d", errno);
+        return 1;
+    }
+
+    std::string pending;
+    struct epoll_event events[64];
+    while (true)
+    {
+        int count = epoll_wait(epollFd_, events, sizeof(events) / sizeof(events[0]), -1);
+        if (count == -1)
+        {
+            if (errno == EINTR) continue;
+
+            FAN_LOG("Could not wait for events; errno: %d", errno);
+            return 1;
+        }
+
+        // A process cannot make any access after its pidfd becomes readable, so handling all the events queued by now
+        // first means that its exit is reported after all of its accesses
+        if (!HandleEvents())
+        {
+            return 1;
+        }
+
+        bool controlOpen = true;
+        for (int i = 0; i < count; i++)
+        {
+            uint64_t data = events[i].data.u64;
+            if ((data & ~0xffffffffULL) == kEpollExit)
+            {
+                pendingExits_.push_back((pid_t)(uint32_t)data);
+            }
+            else if (data == kEpollControl)
+            {
+                controlOpen = HandleControl(controlFd, pending);
+            }
+        }
+
+        // exits may add more (children that could not be watched), so don't iterate over the vector itself
+        while (!pendingExits_.empty())
+        {
+            pid_t pid = pendingExits_.back();
+            pendingExits_.pop_back();
+            HandleExit(pid);
+        }
+
+        if (!controlOpen)
+        {
+            return 0;
+        }
+    }
+}
@@ -0,0 +1,146 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <memory>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "IOEvent.hpp"
+#include "Sandbox.hpp"
+
+/*
+ * Observes the file accesses of whole process trees through fanotify, without loading anything into the observed
+ * processes (i.e., it also sees statically linked executables and anything else libDetours.so cannot interpose).
+ *
+ * A single privileged helper (bxl-fanotify, see bxl_fanotify.cpp) runs per build: it marks every filesystem the build
+ * touches (FAN_MARK_FILESYSTEM) with a notification-only group reporting directory file handles and entry names
+ * (FAN_REPORT_DFID_NAME), and the host registers every observed pip with it before the pip's root process starts.
+ * Each event is attributed to the pip whose process tree the reporting process belongs to, turned into an IOEvent,
+ * and then goes through the regular Sandbox/IOHandler pipeline, so the host gets the same reports (over the same
+ * FIFO, in the text format of BxlObserver::SendTextReport) as it would from libDetours.so.
+ *
+ * Process trees are discovered lazily: the first event of an unknown process walks its parent chain (/proc/<pid>/stat)
+ * up to a tracked process, and a fork is reported for every process in between.  Exits are observed through pidfds, and
+ * since the helper is the only sandbox instance of the pip, it also reports when the pip's process tree completes.
+ *
+ * Events in the scopes no observed pip tracks (the intersection of their untracked scopes, like the muted paths of the
+ * EndpointSecurity sandbox) are dropped before they are attributed.  Filesystem marks cannot exclude anything, so the
+ * kernel is told to drop them through inode marks instead: the first muted event in a directory adds an ignore mark to it (FAN_MARK_IGNORE, Linux 6.0),
+ * so every directory of a muted scope that is accessed costs a single event.  Ignore marks are flushed whenever a scope is
+ * not muted anymore (before the pip that tracks it starts) and when a directory is moved out of a muted scope.
+ *
+ * Limitations:
+ *   - a process that exits (or whose parent exits) before its first event is read cannot be attributed, and its accesses
+ *     are not reported; this is an observer for pips that tolerate missing accesses, not a replacement of libDetours.so;
+ *   - accesses are reported after the fact, so nothing can be denied;
+ *   - opens are reported as reads (notification events carry no open flags), writes are reported when the file is
+ *     modified or closed after writing, and renames are reported as the removal and creation of the two entries;
+ *   - events on filesystems that are not marked are not seen;
+ *   - requires CAP_SYS_ADMIN (fanotify_init, FAN_MARK_FILESYSTEM) and CAP_DAC_READ_SEARCH (open_by_handle_at), Linux 5.9.
+ */
+class FanotifyObserver final
+{
+private:
+    struct Pip
+    {
+        std::shared_ptr<SandboxedPip> pip;
+        int reportsFd;
+        std::string rootExecutable;
+        std::vector<std::string> untrackedScopes;
+
+        // "<event type>|<executable>|<path>" of the accesses already reported for this pip
+        std::unordered_set<std::string> reported;
+    };
+
+    struct Mount
+    {
+        uint64_t fsid;
+        int fd;
+    };
+
+    static const size_t kEventBufferSize = 64 << 10;
+    static const int kMaxParentChain = 64;
+    static const size_t kMaxUntracked = 4096;
+    static const size_t kMaxDirectories = 64 << 10;
+
+    static FanotifyObserver *sInstance;
+
+    Sandbox sandbox_;
+    int fanotifyFd_;
+    int epollFd_;
+
+    std::vector<Mount> mounts_;
+
+    // observed pips, keyed by the process id of their root process
+    std::unordered_map<pid_t, Pip> pips_;
+
+    // pidfds of the tracked processes
+    std::unordered_map<pid_t, int> pidfds_;
+
+    // processes known not to belong to any pip (cleared whenever a pip starts, since it may adopt them)
+    std::unordered_set<pid_t> untracked_;
+
+    // paths of the directories reported by file handle, keyed by fsid and handle
+    std::unordered_map<std::string, std::string> directories_;
+
+    // scopes untracked by every observed pip (see UpdateMutedScopes), and the directories in them the kernel ignores
+    std::set<std::string> mutedScopes_;
+    std::unordered_set<std::string> ignoredDirectories_;
+    bool kernelIgnore_ = true;
+
+    // processes that exited before their exit could be watched, handled once the events read so far are handled
+    std::vector<pid_t> pendingExits_;
+
+    std::vector<char> buffer_;
+
+    static void HandleAccessReport(AccessReport report, int _);
+
+    void SendReport(AccessReport &report);
+    bool WatchExit(pid_t pid);
+    void HandleExit(pid_t pid);
+    std::shared_ptr<SandboxedProcess> FindProcess(pid_t pid);
+    bool ResolveDirectory(uint64_t fsid, const struct file_handle *handle, std::string &path);
+    void UpdateMutedScopes();
+    static bool IsWithin(const std::set<std::string> &scopes, const std::string &path);
+    inline bool IsMuted(const std::string &path) const { return IsWithin(mutedScopes_, path); }
+    void IgnoreDirectory(const std::string &directory);
+    void FlushIgnoredDirectories();
+    bool HandleEvents();
+    void HandleEvent(pid_t pid, uint64_t mask, const std::string &path);
+    bool HandleControl(int fd, std::string &pending);
+
+public:
+    FanotifyObserver();
+    ~FanotifyObserver();
+
+    FanotifyObserver(const FanotifyObserver&) = delete;
+    FanotifyObserver& operator=(const FanotifyObserver&) = delete;
+
+    /** Whether the fanotify group could be created (fails without CAP_SYS_ADMIN or on old kernels). */
+    bool IsValid() const { return fanotifyFd_ != -1 && epollFd_ != -1; }
+
+    /** Starts observing the whole filesystem 'path' is on. */
+    bool AddMount(const char *path);
+
+    /**
+     * Starts observing the pip whose manifest is stored in 'famPath' and whose root process is 'rootPid'.
+     * Must be called before the root process accesses anything.
+     */
+    bool StartPip(pid_t rootPid, const char *famPath);
+
+    /** Stops observing the pip whose root process is 'rootPid' (e.g., when it is cancelled). */
+    void StopPip(pid_t rootPid);
+
+    /**
+     * Reads control lines from 'controlFd' and reports events until 'controlFd' is closed.
+     *
+     * Control lines are "start|<root pid>|<manifest path>" and "stop|<root pid>".  Returns the exit code of the helper:
+     * non-zero when events were lost (queue overflow) or the observer failed.
+     */
+    int Run(int controlFd);
+};
@@ -0,0 +1,260 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+
+/*
+ * Maps file descriptors to the paths they were opened for, so that BxlObserver does not have to readlink
+ * /proc/self/fd/<fd> every time it reports an fd-based access.
+ *
+ * The table is a sparse two-level radix tree on the fd: the top level is a fixed array of pointers to pages of
+ * kPageSize entries, and a page is only mmap-ed the first time an fd falling into it is cached (so a process holding
+ * a handful of fds in the thousands does not pay for all the fds in between).  Entries are offsets into an arena of
+ * interned paths: every distinct path is copied into the arena exactly once (many fds typically refer to the same few
+ * files and directories) and never removed, so a reader that got an offset can use it without any synchronization.
+ *
+ * An entry can also be flagged as having had a write reported (see BxlObserver::report_write_fd): the flag goes away
+ * with the path, i.e., whenever the fd is closed or replaced, and all flags are cleared in a forked child.
+ *
+ * Lookups, updates and invalidations never block and never allocate on the heap.  When the arena or the intern table
+ * fills up, new paths are simply not cached anymore.  Fds beyond the range of the tree are never cached.
+ *
+ * IMPORTANT: like ReportCache, instances must have static storage duration (i.e., be zero-initialized).
+ */
+class FdTable final
+{
+private:
+    static const int kPageBits            = 10;
+    static const int kPageSize            = 1 << kPageBits;
+    static const int kPageCount           = 1 << 10;
+    static const uint32_t kSlotCount      = 1 << 14;
+    static const uint32_t kMaxProbes      = 32;
+    static const uint32_t kArenaSize      = 4 << 20;
+    static const uint32_t kNoRecord       = UINT32_MAX;
+    static const uint32_t kWriteReported  = 0x80000000; // never part of an arena offset (kArenaSize is much smaller)
+
+    typedef struct
+    {
+        uint32_t length;
+        char path[0];
+    } Record;
+
+    // arena offset + 1 of each fd's path (possibly flagged with kWriteReported); 0 means not cached
+    typedef struct
+    {
+        std::atomic<uint32_t> entries[kPageSize];
+    } Page;
+
+    std::atomic<Page*> pages_[kPageCount];
+
+    // intern table: open addressing over arena offsets (+ 1) of records, keyed by path
+    std::atomic<uint32_t> slots_[kSlotCount];
+    std::atomic<uint32_t> arenaPos_;
+    alignas(8) char arena_[kArenaSize];
+
+    static inline uint64_t Hash(const char *path, size_t length)
+    {
+        uint64_t hash = 14695981039346656037ULL;
+        for (size_t i = 0; i < length; i++)
+        {
+            hash = (hash ^ (unsigned char)path[i]) * 1099511628211ULL;
+        }
+
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 33;
+        return hash;
+    }
+
+    inline const Record* GetRecord(uint32_t entry) const
+    {
+        return (const Record*)(arena_ + entry - 1);
+    }
+
+    inline std::atomic<uint32_t>* GetEntry(int fd, bool create)
+    {
+        if (fd < 0 || fd >= kPageSize * kPageCount)
+        {
+            return NULL;
+        }
+
+        std::atomic<Page*> &slot = pages_[fd >> kPageBits];
+        Page *page = slot.load(std::memory_order_acquire);
+        if (page == NULL && create)
+        {
+            void *mem = mmap(NULL, sizeof(Page), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (mem == MAP_FAILED)
+            {
+                return NULL;
+            }
+
+            // anonymous memory is zeroed, i.e., all entries start out as not cached
+            Page *expected = NULL;
+            if (slot.compare_exchange_strong(expected, (Page*)mem, std::memory_order_acq_rel))
+            {
+                page = (Page*)mem;
+            }
+            else
+            {
+                munmap(mem, sizeof(Page));
+                page = expected;
+            }
+        }
+
+        return page != NULL ? &page->entries[fd & (kPageSize - 1)] : NULL;
+    }
+
+    uint32_t AddRecord(const char *path, size_t length)
+    {
+        size_t size = (sizeof(Record) + length + 1 + 7) & ~(size_t)7;
+        if (size > kArenaSize || arenaPos_.load(std::memory_order_relaxed) > kArenaSize - size)
+        {
+            return kNoRecord;
+        }
+
+        uint32_t offset = arenaPos_.fetch_add((uint32_t)size, std::memory_order_relaxed);
+        if (offset > kArenaSize - size)
+        {
+            return kNoRecord;
+        }
+
+        Record *record = (Record*)(arena_ + offset);
+        record->length = (uint32_t)length;
+        memcpy(record->path, path, length);
+        record->path[length] = '\0';
+        return offset;
+    }
+
+    // Returns the entry (arena offset + 1) of the interned copy of 'path', or 0 if it could not be interned
+    uint32_t Intern(const char *path, size_t length)
+    {
+        uint64_t hash = Hash(path, length);
+        uint32_t offset = kNoRecord;
+        for (uint32_t probe = 0, idx = hash & (kSlotCount - 1); probe < kMaxProbes; probe++, idx = (idx + 1) & (kSlotCount - 1))
+        {
+            uint32_t entry = slots_[idx].load(std::memory_order_acquire);
+            while (entry == 0)
+            {
+                if (offset == kNoRecord && (offset = AddRecord(path, length)) == kNoRecord)
+                {
+                    return 0;
+                }
+
+                if (slots_[idx].compare_exchange_weak(entry, offset + 1, std::memory_order_release, std::memory_order_acquire))
+                {
+                    return offset + 1;
+                }
+            }
+
+            const Record *record = GetRecord(entry);
+            if (record->length == length && memcmp(record->path, path, length) == 0)
+            {
+                // interned by someone else (the record we may have reserved is simply wasted)
+                return entry;
+            }
+        }
+
+        return 0;
+    }
+
+public:
+    /**
+     * Returns the cached path for 'fd' (NULL if not cached), and its length in 'length'.
+     * The returned string is null-terminated and stays valid for the lifetime of the process.
+     */
+    const char* Get(int fd, size_t *length)
+    {
+        std::atomic<uint32_t> *entry = GetEntry(fd, /* create */ false);
+        uint32_t value = entry != NULL ? entry->load(std::memory_order_acquire) : 0;
+        if (value == 0)
+        {
+            return NULL;
+        }
+
+        const Record *record = GetRecord(value & ~kWriteReported);
+        *length = record->length;
+        return record->path;
+    }
+
+    /** Whether a write was reported for the path cached for 'fd' (see MarkWriteReported). */
+    inline bool IsWriteReported(int fd)
+    {
+        std::atomic<uint32_t> *entry = GetEntry(fd, /* create */ false);
+        return entry != NULL && (entry->load(std::memory_order_relaxed) & kWriteReported) != 0;
+    }
+
+    /** Flags the path cached for 'fd' as having had a write reported; does nothing if no path is cached for 'fd'. */
+    void MarkWriteReported(int fd)
+    {
+        std::atomic<uint32_t> *entry = GetEntry(fd, /* create */ false);
+        if (entry == NULL)
+        {
+            return;
+        }
+
+        // on failure 'value' is reloaded: the fd was closed or replaced in the meantime, which must win
+        uint32_t value = entry->load(std::memory_order_relaxed);
+        while (value != 0 && (value & kWriteReported) == 0 &&
+               !entry->compare_exchange_weak(value, value | kWriteReported, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    /** Clears all the flags set by MarkWriteReported.  Only called right after fork, when no other thread exists. */
+    void ClearWriteReported()
+    {
+        for (int i = 0; i < kPageCount; i++)
+        {
+            Page *page = pages_[i].load(std::memory_order_relaxed);
+            for (int j = 0; page != NULL && j < kPageSize; j++)
+            {
+                page->entries[j].fetch_and(~kWriteReported, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /** Caches 'path' (of 'length' bytes) for 'fd'. */
+    void Set(int fd, const char *path, size_t length)
+    {
+        std::atomic<uint32_t> *entry = GetEntry(fd, /* create */ true);
+        uint32_t value;
+        if (entry != NULL && (value = Intern(path, length)) != 0)
+        {
+            entry->store(value, std::memory_order_release);
+        }
+    }
+
+    /** Forgets the paths cached for fds 'first' through 'last' (inclusive), visiting only the pages that exist. */
+    void ResetRange(unsigned int first, unsigned int last)
+    {
+        const unsigned int maxFd = kPageSize * kPageCount - 1;
+        last = last < maxFd ? last : maxFd;
+        for (unsigned int fd = first; fd <= last; )
+        {
+            Page *page = pages_[fd >> kPageBits].load(std::memory_order_acquire);
+            unsigned int pageEnd = (fd | (kPageSize - 1)) < last ? (fd | (kPageSize - 1)) : last;
+            for (; page != NULL && fd <= pageEnd; fd++)
+            {
+                page->entries[fd & (kPageSize - 1)].store(0, std::memory_order_release);
+            }
+
+            fd = pageEnd + 1;
+        }
+    }
+
+    /** Forgets the path cached for 'fd' (if any); must be called whenever 'fd' is closed or replaced. */
+    void Reset(int fd)
+    {
+        std::atomic<uint32_t> *entry = GetEntry(fd, /* create */ false);
+        if (entry != NULL)
+        {
+            entry->store(0, std::memory_order_release);
+        }
+    }
+};
@@ -0,0 +1,188 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+typedef enum
+{
+    // Number of times the interposer was entered
+    kInterposeCalls = 0,
+
+    // Number of accesses not reported because they had already been reported (see BxlObserver::IsCacheHit)
+    kInterposeCacheHits,
+
+    // Number of reports sent
+    kInterposeReports,
+
+    // Time spent in the interposer (including the real call), in nanoseconds
+    kInterposeTotalNs,
+
+    // Time spent in the real (forwarded) call, in nanoseconds
+    kInterposeRealNs,
+
+    kInterposeCounterCount
+} InterposeCounter;
+
+/*
+ * Cheap per-interposer counters (enabled via the BxlEnvInterposeStats env var).
+ *
+ * Every interposer registers itself (once) and gets an id, under which its counters are kept.  To keep threads from
+ * contending for the same cache lines, counters are striped: every thread picks one of kStripeCount sets of counters
+ * (based on its thread id) and only ever adds to that one; the stripes are summed up when the stats are collected.
+ *
+ * Counters are attributed to the interposer the calling thread is currently executing (see InterposeScope in
+ * bxl_observer.hpp); when an interposer calls another interposed function, the inner one is counted on its own.
+ *
+ * IMPORTANT: like ReportCache, instances must have static storage duration (i.e., be zero-initialized),
+ * because interposers may register before the owning BxlObserver has been constructed.
+ */
+class InterposeStats final
+{
+public:
+    static const int kStripeCount = 16;
+
+private:
+    static const int kMaxHooks   = 256;
+
+    typedef struct
+    {
+        std::atomic<uint64_t> counters[kMaxHooks][kInterposeCounterCount];
+    } Stripe;
+
+    std::atomic<const char*> names_[kMaxHooks];
+    std::atomic<int> hookCount_;
+    alignas(64) Stripe stripes_[kStripeCount];
+
+    static thread_local int sCurrentHook;
+    static thread_local int sStripe;
+
+public:
+    /** The set of counters the calling thread adds to (see SandboxCounters, which stripes its counters the same way). */
+    static inline int GetStripe()
+    {
+        // stored + 1 so that 0 (the initial value of every thread) means "not assigned yet"
+        if (sStripe == 0)
+        {
+            uint32_t tid = (uint32_t)syscall(SYS_gettid);
+            sStripe = (int)((tid * 2654435761u) >> 16) % kStripeCount + 1;
+        }
+
+        return sStripe - 1;
+    }
+
+    static inline uint64_t NowNs()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    }
+
+    /** Returns the id for interposer 'name' (-1 if no more interposers can be registered). */
+    int Register(const char *name)
+    {
+        int id = hookCount_.fetch_add(1, std::memory_order_relaxed);
+        if (id >= kMaxHooks)
+        {
+            return -1;
+        }
+
+        names_[id].store(name, std::memory_order_release);
+        return id;
+    }
+
+    /** Makes 'hook' the interposer the calling thread is executing; returns the previous one (to be passed to Leave). */
+    static inline int Enter(int hook)
+    {
+        int previous = sCurrentHook;
+        sCurrentHook = hook + 1;
+        return previous;
+    }
+
+    static inline void Leave(int previous)
+    {
+        sCurrentHook = previous;
+    }
+
+    inline void Add(int hook, InterposeCounter counter, uint64_t value)
+    {
+        if (hook >= 0 && hook < kMaxHooks)
+        {
+            stripes_[GetStripe()].counters[hook][counter].fetch_add(value, std::memory_order_relaxed);
+        }
+    }
+
+    /** Adds 'value' to 'counter' of the interposer the calling thread is currently executing (if any). */
+    inline void AddToCurrent(InterposeCounter counter, uint64_t value)
+    {
+        Add(sCurrentHook - 1, counter, value);
+    }
+
+    /**
+     * Renders (and resets) the counters of all interposers that have been called since the last time, as
+     * "<name>,<calls>,<cache hits>,<reports>,<total ns>,<real ns>;" entries.  Returns the number of characters written
+     * (entries that do not fit in 'buf' are dropped).
+     *
+     * CODESYNC: Public/Src/Engine/Processes/SandboxConnectionLinuxDetours.cs
+     */
+    size_t Collect(char *buf, size_t bufsiz)
+    {
+        size_t length = 0;
+        bool full = false;
+        int hookCount = hookCount_.load(std::memory_order_acquire);
+        hookCount = hookCount < kMaxHooks ? hookCount : kMaxHooks;
+        for (int hook = 0; hook < hookCount; hook++)
+        {
+            uint64_t totals[kInterposeCounterCount] = { 0 };
+            for (int stripe = 0; stripe < kStripeCount; stripe++)
+            {
+                for (int counter = 0; counter < kInterposeCounterCount; counter++)
+                {
+                    totals[counter] += stripes_[stripe].counters[hook][counter].exchange(0, std::memory_order_relaxed);
+                }
+            }
+
+            const char *name = names_[hook].load(std::memory_order_acquire);
+            if (full || totals[kInterposeCalls] == 0 || name == NULL)
+            {
+                continue;
+            }
+
+            int n = snprintf(buf + length, bufsiz - length, "%s,%lu,%lu,%lu,%lu,%lu;", name,
+                totals[kInterposeCalls], totals[kInterposeCacheHits], totals[kInterposeReports],
+                totals[kInterposeTotalNs], totals[kInterposeRealNs]);
+            if (n < 0 || (size_t)n >= bufsiz - length)
+            {
+                buf[length] = '\0';
+                full = true;
+                continue;
+            }
+
+            length += n;
+        }
+
+        return length;
+    }
+
+    /** Discards all counters (in the child process right after fork: they belong to the parent). */
+    void Clear()
+    {
+        for (int stripe = 0; stripe < kStripeCount; stripe++)
+        {
+            for (int hook = 0; hook < kMaxHooks; hook++)
+            {
+                for (int counter = 0; counter < kInterposeCounterCount; counter++)
+                {
+                    stripes_[stripe].counters[hook][counter].store(0, std::memory_order_relaxed);
+                }
+            }
+        }
+    }
+};
@@ -0,0 +1,253 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/mman.h>
+
+/*
+ * Mirrors of the (stable) io_uring ABI (see <linux/io_uring.h>), which the headers of glibc 2.17 predate.
+ */
+namespace io_uring_abi
+{
+    typedef struct
+    {
+        uint32_t head, tail, ring_mask, ring_entries, flags, dropped, array, resv1;
+        uint64_t user_addr;
+    } sqring_offsets;
+
+    typedef struct
+    {
+        uint32_t head, tail, ring_mask, ring_entries, overflow, cqes, flags, resv1;
+        uint64_t user_addr;
+    } cqring_offsets;
+
+    typedef struct
+    {
+        uint32_t sq_entries, cq_entries, flags, sq_thread_cpu, sq_thread_idle, features, wq_fd, resv[3];
+        sqring_offsets sq_off;
+        cqring_offsets cq_off;
+    } params;
+
+    typedef struct
+    {
+        uint8_t  opcode;
+        uint8_t  flags;
+        uint16_t ioprio;
+        int32_t  fd;
+        uint64_t off;       // or addr2
+        uint64_t addr;
+        uint32_t len;
+        uint32_t op_flags;  // open_flags, statx_flags, rename_flags, unlink_flags, hardlink_flags, ...
+        uint64_t user_data;
+        uint64_t pad[3];
+    } sqe;
+
+    typedef struct
+    {
+        uint64_t flags, mode, resolve;
+    } open_how;
+
+    static const uint8_t  OP_OPENAT         = 18;
+    static const uint8_t  OP_CLOSE          = 19;
+    static const uint8_t  OP_STATX          = 21;
+    static const uint8_t  OP_OPENAT2        = 28;
+    static const uint8_t  OP_RENAMEAT       = 35;
+    static const uint8_t  OP_UNLINKAT       = 36;
+    static const uint8_t  OP_MKDIRAT        = 37;
+    static const uint8_t  OP_SYMLINKAT      = 38;
+    static const uint8_t  OP_LINKAT         = 39;
+
+    static const uint8_t  SQE_FIXED_FILE    = 1U << 0;
+
+    static const uint32_t SETUP_SQPOLL      = 1U << 1;
+    static const uint32_t SETUP_SQE128      = 1U << 10;
+    static const uint32_t SETUP_NO_MMAP     = 1U << 14;
+    static const uint32_t SETUP_NO_SQARRAY  = 1U << 16;
+
+    static const off_t    OFF_SQ_RING       = 0;
+    static const off_t    OFF_SQES          = 0x10000000;
+}
+
+/*
+ * Lets interposers see the submission queue entries (SQEs) a process submits through io_uring rings.
+ *
+ * When a ring is set up (io_uring_setup), we map its submission queue and SQE array a second time, read-only, so that
+ * right before the process calls io_uring_enter we can walk the entries it is about to submit (from the kernel's head
+ * to the process' tail).  The ring itself is never touched: we do not take any locks the process would contend on,
+ * issue extra system calls per submission, or change how entries are batched, so rings keep their throughput.
+ *
+ * Limitations: entries of rings set up with IORING_SETUP_SQPOLL are consumed by a kernel thread without any
+ * io_uring_enter and cannot be observed this way (nor can rings with IORING_SETUP_NO_MMAP, whose memory we do not
+ * know); neither can accesses through registered (fixed) files relative to which paths are resolved.  Rings are only
+ * visible when set up through libc's syscall(), since the raw system call instructions liburing may use bypass any
+ * interposer.
+ *
+ * IMPORTANT: like ReportCache, instances must have static storage duration (i.e., be zero-initialized).
+ */
+class IoUringObserver final
+{
+private:
+    static const int kMaxRings = 16;
+
+    typedef struct
+    {
+        std::atomic<int> fd;     // ring fd + 1; 0 means the slot is free
+        const uint8_t *sqRing;
+        size_t sqRingSize;
+        const io_uring_abi::sqe *sqes;
+        size_t sqesSize;
+        uint32_t mask;
+        uint32_t sqeShift;       // 1 for 128-byte SQEs
+        bool hasArray;
+        io_uring_abi::sqring_offsets off;
+    } Ring;
+
+    Ring rings_[kMaxRings];
+    std::atomic<int> ringCount_;
+    std::mutex mtx_;
+
+    inline Ring* Find(int fd)
+    {
+        for (int i = 0; i < kMaxRings; i++)
+        {
+            if (rings_[i].fd.load(std::memory_order_acquire) == fd + 1)
+            {
+                return &rings_[i];
+            }
+        }
+
+        return NULL;
+    }
+
+    static void Unmap(Ring *ring)
+    {
+        if (ring->sqRing != NULL) munmap((void*)ring->sqRing, ring->sqRingSize);
+        if (ring->sqes != NULL) munmap((void*)ring->sqes, ring->sqesSize);
+        ring->sqRing = NULL;
+        ring->sqes = NULL;
+    }
+
+public:
+    /** Whether any ring is being tracked (cheap enough to check on every close). */
+    inline bool IsTracking() const { return ringCount_.load(std::memory_order_relaxed) > 0; }
+
+    /** Starts tracking the ring 'fd' that was just set up with 'params' (as filled in by the kernel). */
+    void Track(int fd, const io_uring_abi::params *params)
+    {
+        if (fd < 0 || params == NULL || (params->flags & (io_uring_abi::SETUP_SQPOLL | io_uring_abi::SETUP_NO_MMAP)) != 0)
+        {
+            return;
+        }
+
+        Ring ring;
+        ring.hasArray = (params->flags & io_uring_abi::SETUP_NO_SQARRAY) == 0;
+        ring.sqeShift = (params->flags & io_uring_abi::SETUP_SQE128) != 0 ? 1 : 0;
+        ring.off = params->sq_off;
+        ring.sqRingSize = ring.hasArray
+            ? params->sq_off.array + params->sq_entries * sizeof(uint32_t)
+            : params->sq_off.tail + sizeof(uint32_t);
+        ring.sqesSize = ((size_t)params->sq_entries << ring.sqeShift) * sizeof(io_uring_abi::sqe);
+
+        void *sqRing = mmap(NULL, ring.sqRingSize, PROT_READ, MAP_SHARED, fd, io_uring_abi::OFF_SQ_RING);
+        void *sqes = mmap(NULL, ring.sqesSize, PROT_READ, MAP_SHARED, fd, io_uring_abi::OFF_SQES);
+        ring.sqRing = sqRing != MAP_FAILED ? (const uint8_t*)sqRing : NULL;
+        ring.sqes = sqes != MAP_FAILED ? (const io_uring_abi::sqe*)sqes : NULL;
+        if (ring.sqRing == NULL || ring.sqes == NULL)
+        {
+            Unmap(&ring);
+            return;
+        }
+
+        ring.mask = *(const uint32_t*)(ring.sqRing + ring.off.ring_mask);
+
+        std::lock_guard<std::mutex> lock(mtx_);
+        for (int i = 0; i < kMaxRings; i++)
+        {
+            if (rings_[i].fd.load(std::memory_order_relaxed) == 0)
+            {
+                rings_[i].sqRing = ring.sqRing;
+                rings_[i].sqRingSize = ring.sqRingSize;
+                rings_[i].sqes = ring.sqes;
+                rings_[i].sqesSize = ring.sqesSize;
+                rings_[i].mask = ring.mask;
+                rings_[i].sqeShift = ring.sqeShift;
+                rings_[i].hasArray = ring.hasArray;
+                rings_[i].off = ring.off;
+                rings_[i].fd.store(fd + 1, std::memory_order_release);
+                ringCount_.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+        }
+
+        // too many rings: this one goes unobserved
+        Unmap(&ring);
+    }
+
+    /** In the child process right after fork: the rings are inherited, but the lock could have been held by another thread. */
+    void ResetAfterFork()
+    {
+        new (&mtx_) std::mutex();
+    }
+
+    /** Stops tracking 'fd' (if it is a ring); must be called whenever 'fd' is closed or replaced. */
+    void Untrack(int fd)
+    {
+        if (fd < 0)
+        {
+            return;
+        }
+
+        UntrackRange((unsigned int)fd, (unsigned int)fd);
+    }
+
+    /** Like Untrack, for fds 'first' through 'last' (inclusive). */
+    void UntrackRange(unsigned int first, unsigned int last)
+    {
+        if (!IsTracking())
+        {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(mtx_);
+        for (int i = 0; i < kMaxRings; i++)
+        {
+            int fd = rings_[i].fd.load(std::memory_order_relaxed) - 1;
+            if (fd >= 0 && (unsigned int)fd >= first && (unsigned int)fd <= last)
+            {
+                rings_[i].fd.store(0, std::memory_order_release);
+                Unmap(&rings_[i]);
+                ringCount_.fetch_sub(1, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /**
+     * Calls 'callback' with each of (at most 'toSubmit' of) the entries that the calling process is about to submit
+     * to ring 'fd' (if it is a ring we track).  Must be called right before forwarding io_uring_enter.
+     */
+    template<typename F>
+    void ForEachPendingEntry(int fd, unsigned int toSubmit, F callback)
+    {
+        Ring *ring = toSubmit > 0 && IsTracking() ? Find(fd) : NULL;
+        if (ring == NULL)
+        {
+            return;
+        }
+
+        uint32_t head = ((const std::atomic<uint32_t>*)(ring->sqRing + ring->off.head))->load(std::memory_order_acquire);
+        uint32_t tail = *(const volatile uint32_t*)(ring->sqRing + ring->off.tail);
+        const uint32_t *array = (const uint32_t*)(ring->sqRing + ring->off.array);
+        for (uint32_t pos = head; pos != tail && toSubmit > 0; pos++, toSubmit--)
+        {
+            uint32_t index = ring->hasArray ? array[pos & ring->mask] : pos;
+            index &= ring->mask;
+            callback(ring->sqes[index << ring->sqeShift]);
+        }
+    }
+};
@@ -0,0 +1,233 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * A lock-free, insert-only map shared by all the processes of a pip, from the libraries the dynamic linker searched for
+ * to the files it found them at (see la_objsearch in audit.cpp), so that the processes that load a library after the
+ * first one go straight to its file instead of probing every directory of the search path again.
+ *
+ * Where a library is found depends on more than its name: keys also carry a 'context', a hash of everything else the
+ * search depends on (the executable, the object the library is loaded for, LD_LIBRARY_PATH).
+ *
+ * The layout is that of SharedReportCache: the table and the arena live in a file (created by the host, see
+ * SandboxConnectionLinuxDetours) that every process maps, entries are offsets into the arena, and every offset is
+ * bounds-checked before the record it points to is looked at.
+ *
+ * CODESYNC: Public/Src/Engine/Processes/SandboxConnectionLinuxDetours.cs
+ *
+ * IMPORTANT: like SharedReportCache, instances must have static storage duration (i.e., be zero-initialized).
+ */
+class LoaderSearchCache final
+{
+private:
+    static const uint32_t kMagic       = 0x4353444c; // "LDSC"
+    static const uint32_t kVersion     = 1;
+    static const size_t kHeaderSize    = 64;
+    static const size_t kArenaPosOffset = 16;
+    static const uint32_t kMaxProbes   = 64;
+    static const uint32_t kNoRecord    = UINT32_MAX;
+
+    static const int kTagShift         = 40;
+    static const uint64_t kOffsetMask  = 0xffffffffff;
+
+    // the name is followed by the path, and the path by a '\0'
+    typedef struct
+    {
+        uint64_t context;
+        uint32_t nameLength;
+        uint32_t pathLength;
+        char data[0];
+    } Record;
+
+    std::atomic<uint64_t> *slots_;
+    std::atomic<uint32_t> *arenaPos_;
+    char *arena_;
+    uint32_t slotMask_;
+    uint32_t arenaSize_;
+
+    // same hash as SharedReportCache
+    static inline uint64_t Hash(uint64_t context, const char *name, size_t length)
+    {
+        uint64_t hash = (14695981039346656037ULL ^ context) * 1099511628211ULL;
+        for (size_t i = 0; i < length; i++)
+        {
+            hash = (hash ^ (unsigned char)name[i]) * 1099511628211ULL;
+        }
+
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 33;
+        hash *= 0xc4ceb9fe1a85ec53ULL;
+        hash ^= hash >> 33;
+        return hash;
+    }
+
+    static inline uint64_t MakeEntry(uint64_t hash, uint32_t offset)
+    {
+        // offsets are stored + 1 so that an entry is never 0
+        return (hash >> kTagShift << kTagShift) | ((uint64_t)offset + 1);
+    }
+
+    // the record 'entry' points to, if it is the one of (context, name)
+    inline const Record* Find(uint64_t entry, uint64_t hash, uint64_t context, const char *name, size_t length) const
+    {
+        if ((entry >> kTagShift) != (hash >> kTagShift))
+        {
+            return NULL;
+        }
+
+        uint64_t offset = (entry & kOffsetMask) - 1;
+        if (offset + sizeof(Record) + length > arenaSize_)
+        {
+            return NULL; // not a record this process could have written
+        }
+
+        const Record *record = (const Record*)(arena_ + offset);
+        if (record->context != context || record->nameLength != length || memcmp(record->data, name, length) != 0 ||
+            offset + sizeof(Record) + length + (uint64_t)record->pathLength + 1 > arenaSize_)
+        {
+            return NULL;
+        }
+
+        return record;
+    }
+
+    uint32_t AddRecord(uint64_t context, const char *name, size_t nameLength, const char *path, size_t pathLength)
+    {
+        size_t size = (sizeof(Record) + nameLength + pathLength + 1 + 7) & ~(size_t)7;
+        if (size > arenaSize_ || arenaPos_->load(std::memory_order_relaxed) > arenaSize_ - size)
+        {
+            return kNoRecord;
+        }
+
+        uint32_t offset = arenaPos_->fetch_add((uint32_t)size, std::memory_order_relaxed);
+        if (offset > arenaSize_ - size)
+        {
+            return kNoRecord; // lost the race for the last few bytes
+        }
+
+        Record *record = (Record*)(arena_ + offset);
+        record->context = context;
+        record->nameLength = (uint32_t)nameLength;
+        record->pathLength = (uint32_t)pathLength;
+        memcpy(record->data, name, nameLength);
+        memcpy(record->data + nameLength, path, pathLength);
+        record->data[nameLength + pathLength] = '\0';
+        return offset;
+    }
+
+public:
+    /** Folds 'str' into the search context 'context' (start from 0). */
+    static inline uint64_t HashContext(uint64_t context, const char *str)
+    {
+        return Hash(context, str, str != NULL ? strlen(str) : 0);
+    }
+
+    /** Whether the map is shared with the other processes of the pip (see Attach). */
+    inline bool IsAttached() const { return slots_ != NULL; }
+
+    /**
+     * Starts using the map stored in 'mapped' (a shared mapping of the whole backing file).
+     * Returns false (without using anything) if 'mapped' does not hold a valid map.
+     */
+    bool Attach(void *mapped, size_t size)
+    {
+        const uint32_t *header = (const uint32_t*)mapped;
+        if (size < kHeaderSize || header[0] != kMagic || header[1] != kVersion)
+        {
+            return false;
+        }
+
+        uint32_t slotCount = header[2];
+        uint32_t arenaSize = header[3];
+        if (slotCount == 0 || (slotCount & (slotCount - 1)) != 0 || arenaSize < sizeof(Record) ||
+            size < kHeaderSize + (size_t)slotCount * sizeof(uint64_t) + arenaSize)
+        {
+            return false;
+        }
+
+        slotMask_ = slotCount - 1;
+        arenaSize_ = arenaSize;
+        arenaPos_ = (std::atomic<uint32_t>*)((char*)mapped + kArenaPosOffset);
+        arena_ = (char*)mapped + kHeaderSize + (size_t)slotCount * sizeof(uint64_t);
+        slots_ = (std::atomic<uint64_t>*)((char*)mapped + kHeaderSize);
+        return true;
+    }
+
+    /**
+     * Copies the file (context, name) was found at by some process of the pip into 'path' (of size 'size') and returns
+     * true; returns false if it was not found yet (or does not fit).  Never blocks.
+     */
+    bool TryGet(uint64_t context, const char *name, char *path, size_t size) const
+    {
+        size_t length = strlen(name);
+        uint64_t hash = Hash(context, name, length);
+        for (uint32_t probe = 0, idx = hash & slotMask_; probe < kMaxProbes; probe++, idx = (idx + 1) & slotMask_)
+        {
+            uint64_t entry = slots_[idx].load(std::memory_order_acquire);
+            if (entry == 0)
+            {
+                return false;
+            }
+
+            const Record *record = Find(entry, hash, context, name, length);
+            if (record != NULL)
+            {
+                if (record->pathLength == 0 || record->pathLength >= size)
+                {
+                    return false;
+                }
+
+                memcpy(path, record->data + length, record->pathLength);
+                path[record->pathLength] = '\0';
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /**
+     * Records that (context, name) was found at 'path', unless some process of the pip already did (the first one wins).
+     *
+     * Never blocks and never allocates; safe to call concurrently from any number of threads and processes.
+     */
+    void Add(uint64_t context, const char *name, const char *path)
+    {
+        size_t length = strlen(name);
+        uint64_t hash = Hash(context, name, length);
+        uint32_t offset = kNoRecord;
+
+        for (uint32_t probe = 0, idx = hash & slotMask_; probe < kMaxProbes; probe++, idx = (idx + 1) & slotMask_)
+        {
+            uint64_t entry = slots_[idx].load(std::memory_order_acquire);
+            while (entry == 0)
+            {
+                if (offset == kNoRecord && (offset = AddRecord(context, name, length, path, strlen(path))) == kNoRecord)
+                {
+                    return;
+                }
+
+                // on failure 'entry' is reloaded: some other thread or process took this slot first, so re-examine it
+                if (slots_[idx].compare_exchange_weak(entry, MakeEntry(hash, offset), std::memory_order_release, std::memory_order_acquire))
+                {
+                    return;
+                }
+            }
+
+            if (Find(entry, hash, context, name, length) != NULL)
+            {
+                return;
+            }
+        }
+
+        // probe sequence too long: the table is (nearly) full, don't cache
+    }
+};
@@ -0,0 +1,541 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <limits.h>
+#include <mutex>
+#include <new>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+/*
+ * Incremental SHA-256 (FIPS 180-4).  Never allocates; the state is a handful of words, so one can live in every
+ * output being hashed.
+ */
+class Sha256 final
+{
+private:
+    uint32_t state_[8];
+    uint64_t length_;
+    uint8_t buffer_[64];
+    size_t buffered_;
+
+    static inline uint32_t Rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+    void Compress(const uint8_t *block)
+    {
+        static const uint32_t k[64] =
+        {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+        };
+
+        uint32_t w[64];
+        for (int i = 0; i < 16; i++)
+        {
+            w[i] = (uint32_t)block[4 * i] << 24 | (uint32_t)block[4 * i + 1] << 16 | (uint32_t)block[4 * i + 2] << 8 | block[4 * i + 3];
+        }
+
+        for (int i = 16; i < 64; i++)
+        {
+            uint32_t s0 = Rotr(w[i - 15], 7) ^ Rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = Rotr(w[i - 2], 17) ^ Rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint32_t a = state_[0], b = state_[1], c = state_[2], d = state_[3];
+        uint32_t e = state_[4], f = state_[5], g = state_[6], h = state_[7];
+        for (int i = 0; i < 64; i++)
+        {
+            uint32_t t1 = h + (Rotr(e, 6) ^ Rotr(e, 11) ^ Rotr(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+            uint32_t t2 = (Rotr(a, 2) ^ Rotr(a, 13) ^ Rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + t2;
+        }
+
+        state_[0] += a; state_[1] += b; state_[2] += c; state_[3] += d;
+        state_[4] += e; state_[5] += f; state_[6] += g; state_[7] += h;
+    }
+
+public:
+    static const size_t kHashSize = 32;
+
+    Sha256() { Reset(); }
+
+    void Reset()
+    {
+        static const uint32_t initial[8] =
+        {
+            0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+        };
+
+        memcpy(state_, initial, sizeof(state_));
+        length_ = 0;
+        buffered_ = 0;
+    }
+
+    void Update(const void *data, size_t length)
+    {
+        const uint8_t *bytes = (const uint8_t*)data;
+        length_ += length;
+
+        if (buffered_ > 0)
+        {
+            size_t n = length < sizeof(buffer_) - buffered_ ? length : sizeof(buffer_) - buffered_;
+            memcpy(buffer_ + buffered_, bytes, n);
+            buffered_ += n;
+            bytes += n;
+            length -= n;
+            if (buffered_ < sizeof(buffer_))
+            {
+                return;
+            }
+
+            Compress(buffer_);
+            buffered_ = 0;
+        }
+
+        for (; length >= sizeof(buffer_); bytes += sizeof(buffer_), length -= sizeof(buffer_))
+        {
+            Compress(bytes);
+        }
+
+        memcpy(buffer_, bytes, length);
+        buffered_ = length;
+    }
+
+    /** Writes the hash of everything passed to Update since the last Reset into 'hash'; Reset must be called before reusing the instance. */
+    void Final(uint8_t hash[kHashSize])
+    {
+        uint64_t bits = length_ * 8;
+        static const uint8_t padding[64] = { 0x80 };
+        Update(padding, buffered_ < 56 ? 56 - buffered_ : 120 - buffered_);
+
+        uint8_t lengthBytes[8];
+        for (int i = 0; i < 8; i++)
+        {
+            lengthBytes[i] = (uint8_t)(bits >> (56 - 8 * i));
+        }
+
+        Update(lengthBytes, sizeof(lengthBytes));
+        for (int i = 0; i < 8; i++)
+        {
+            hash[4 * i]     = (uint8_t)(state_[i] >> 24);
+            hash[4 * i + 1] = (uint8_t)(state_[i] >> 16);
+            hash[4 * i + 2] = (uint8_t)(state_[i] >> 8);
+            hash[4 * i + 3] = (uint8_t)state_[i];
+        }
+    }
+};
+
+/*
+ * Computes the content hashes (VSO0, i.e., the default content hash of the cache) of the files a process writes
+ * sequentially, while it writes them, so that the host does not have to read them back from disk to store them.
+ *
+ * Hashing starts when a regular file is opened write-only and is empty right after it is opened (i.e., it was created or
+ * truncated), and the bytes written to it (write, writev) are fed to the hash as they are written.  When the file is
+ * closed, its hash is handed out (see Finish) if nothing else could have changed it in the meantime: the file must still be
+ * a regular file, on the same inode, and exactly as large as the number of bytes hashed (which rules out any seek before
+ * a write).
+ *
+ * An output stops being hashed (Invalidate) whenever this process writes to the same file in any other way (pwrite, stdio
+ * streams, ftruncate, copy_file_range, ... through any fd), creates a child process (which could write through an inherited
+ * fd), or sets up an io_uring ring (whose writes are not observed).  Write-only fds cannot be mapped for writing, so the
+ * only changes left unnoticed are those other processes make through their own opens of the file while it is being
+ * written; the host only trusts a hash if the size and modification time of the file are still the reported ones.
+ *
+ * VSO0: the file is split into 64KB pages and 2MB blocks (32 pages); a block is identified by the SHA-256 of the SHA-256
+ * of each of its pages, and the file by rolling the identifiers of its blocks into a seed, in order, flagging the last one
+ * (CODESYNC: Public/Src/Cache/ContentStore/Hashing/VsoHash.cs).  Only the last full block is held on to, because it
+ * cannot be rolled in before it is known whether it is the last one.
+ *
+ * At most kMaxOutputs files are hashed at a time; files opened beyond that are not hashed.
+ *
+ * IMPORTANT: like ReportCache, instances must have static storage duration (i.e., be zero-initialized).
+ */
+class OutputHasher final
+{
+public:
+    static const size_t kHashSize = Sha256::kHashSize;
+
+private:
+    static const int kMaxOutputs     = 16;
+    static const size_t kPageSize    = 64 << 10;
+    static const int kPagesPerBlock  = 32;
+
+    // 'key' of an output that is being set up or released
+    static const int kBusy           = -1;
+
+    typedef struct
+    {
+        // fd + 1 of the file being hashed (0 if this output is unused, kBusy while being claimed)
+        std::atomic<int> key;
+
+        // set (without taking the lock) as soon as the file may have been changed by something we do not hash
+        std::atomic<bool> invalid;
+
+        // held while a write to the file is forwarded and hashed, so that the bytes are hashed in the order they are written
+        std::timed_mutex mtx;
+
+        dev_t device;
+        ino_t inode;
+        uint64_t length;
+        Sha256 page;
+        size_t pageLength;
+        Sha256 block;
+        int blockPages;
+        bool hasPendingBlock;
+        uint8_t pendingBlock[kHashSize];
+        bool rolled;
+        uint8_t rolling[kHashSize];
+        size_t pathLength;
+        char path[PATH_MAX];
+    } Output;
+
+    Output outputs_[kMaxOutputs];
+    std::atomic<int> active_;
+
+    // fstat, without going through any interposer (see Init)
+    int (*fstat_)(int fd, struct stat *st);
+
+    inline Output* Find(int fd)
+    {
+        for (int i = 0; i < kMaxOutputs; i++)
+        {
+            if (outputs_[i].key.load(std::memory_order_acquire) == fd + 1)
+            {
+                return &outputs_[i];
+            }
+        }
+
+        return NULL;
+    }
+
+    void Release(Output *output)
+    {
+        output->key.store(0, std::memory_order_release);
+        active_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    static void Roll(Output *output, const uint8_t blockId[kHashSize], bool isFinal)
+    {
+        static const char seed[] = "VSO Content Identifier Seed";
+        uint8_t finalByte = isFinal ? 1 : 0;
+
+        Sha256 sha;
+        if (output->rolled)
+        {
+            sha.Update(output->rolling, kHashSize);
+        }
+        else
+        {
+            sha.Update(seed, sizeof(seed) - 1);
+        }
+
+        sha.Update(blockId, kHashSize);
+        sha.Update(&finalByte, 1);
+        sha.Final(output->rolling);
+        output->rolled = true;
+    }
+
+    // Folds the current page into the current block; when that completes the block, it becomes the pending one
+    static void EndPage(Output *output)
+    {
+        uint8_t hash[kHashSize];
+        output->page.Final(hash);
+        output->page.Reset();
+        output->pageLength = 0;
+        output->block.Update(hash, kHashSize);
+
+        if (++output->blockPages == kPagesPerBlock)
+        {
+            if (output->hasPendingBlock)
+            {
+                Roll(output, output->pendingBlock, /* isFinal */ false);
+            }
+
+            output->block.Final(output->pendingBlock);
+            output->block.Reset();
+            output->blockPages = 0;
+            output->hasPendingBlock = true;
+        }
+    }
+
+    static void Append(Output *output, const uint8_t *data, size_t length)
+    {
+        while (length > 0)
+        {
+            // pages (and blocks) are only ended once more bytes follow them, so the last one is still open when the file is closed
+            if (output->pageLength == kPageSize)
+            {
+                EndPage(output);
+            }
+
+            size_t n = length < kPageSize - output->pageLength ? length : kPageSize - output->pageLength;
+            output->page.Update(data, n);
+            output->pageLength += n;
+            output->length += n;
+            data += n;
+            length -= n;
+        }
+    }
+
+    static void Compute(Output *output, uint8_t hash[kHashSize])
+    {
+        // an empty file is a single empty block
+        if (output->length > 0)
+        {
+            EndPage(output);
+        }
+
+        uint8_t finalBlock[kHashSize];
+        bool finalIsPending = output->hasPendingBlock && output->blockPages == 0;
+        if (finalIsPending)
+        {
+            memcpy(finalBlock, output->pendingBlock, kHashSize);
+        }
+        else
+        {
+            if (output->hasPendingBlock)
+            {
+                Roll(output, output->pendingBlock, /* isFinal */ false);
+            }
+
+            output->block.Final(finalBlock);
+        }
+
+        Roll(output, finalBlock, /* isFinal */ true);
+        memcpy(hash, output->rolling, kHashSize);
+    }
+
+public:
+    /**
+     * A write to an fd, during which the output hashed for that fd (if any) is locked.  Must be constructed right before
+     * forwarding the write; the bytes that were written are then passed to Written.
+     */
+    class Write final
+    {
+    private:
+        Output *output_;
+
+    public:
+        Write(OutputHasher &hasher, int fd) : output_(NULL)
+        {
+            if (!hasher.IsActive())
+            {
+                return;
+            }
+
+            Output *output = hasher.Find(fd);
+            if (output == NULL)
+            {
+                // some other fd may refer to one of the outputs
+                hasher.Invalidate(fd);
+                return;
+            }
+
+            // a signal handler writing to the same fd while the interrupted thread holds the lock must not deadlock
+            if (!output->mtx.try_lock_for(std::chrono::milliseconds(1)))
+            {
+                output->invalid.store(true, std::memory_order_relaxed);
+                return;
+            }
+
+            if (output->key.load(std::memory_order_acquire) != fd + 1)
+            {
+                output->mtx.unlock();
+                return;
+            }
+
+            output_ = output;
+        }
+
+        ~Write()
+        {
+            if (output_ != NULL)
+            {
+                output_->mtx.unlock();
+            }
+        }
+
+        Write(const Write&) = delete;
+        Write& operator=(const Write&) = delete;
+
+        void Written(const void *buf, ssize_t written)
+        {
+            if (output_ != NULL && written > 0)
+            {
+                Append(output_, (const uint8_t*)buf, (size_t)written);
+            }
+        }
+
+        void Written(const struct iovec *iov, int iovcnt, ssize_t written)
+        {
+            for (int i = 0; output_ != NULL && i < iovcnt && written > 0; i++)
+            {
+                size_t n = iov[i].iov_len < (size_t)written ? iov[i].iov_len : (size_t)written;
+                Append(output_, (const uint8_t*)iov[i].iov_base, n);
+                written -= n;
+            }
+        }
+    };
+
+    /** Must be called before any file is hashed; 'fstatFn' must be the real fstat (whose calls are not reported). */
+    void Init(int (*fstatFn)(int fd, struct stat *st)) { fstat_ = fstatFn; }
+
+    /** Whether any file is being hashed (cheap enough to check on every write). */
+    inline bool IsActive() const { return active_.load(std::memory_order_relaxed) > 0; }
+
+    /**
+     * Starts hashing the file 'path' (of 'pathLength' bytes) that 'fd' was just opened for, with 'st' being its status right
+     * after opening it.  Does nothing if the file is not an empty regular file or too many files are being hashed already.
+     */
+    void Start(int fd, const char *path, size_t pathLength, const struct stat &st)
+    {
+        if (fd < 0 || !S_ISREG(st.st_mode) || st.st_size != 0 || pathLength >= PATH_MAX)
+        {
+            return;
+        }
+
+        // an fd we did not see being closed (e.g., by a raw system call) was reused
+        Stop(fd);
+
+        for (int i = 0; i < kMaxOutputs; i++)
+        {
+            Output *output = &outputs_[i];
+            int expected = 0;
+            if (!output->key.compare_exchange_strong(expected, kBusy, std::memory_order_acquire))
+            {
+                continue;
+            }
+
+            std::lock_guard<std::timed_mutex> lock(output->mtx);
+            output->invalid.store(false, std::memory_order_relaxed);
+            output->device = st.st_dev;
+            output->inode = st.st_ino;
+            output->length = 0;
+            output->page.Reset();
+            output->pageLength = 0;
+            output->block.Reset();
+            output->blockPages = 0;
+            output->hasPendingBlock = false;
+            output->rolled = false;
+            output->pathLength = pathLength;
+            memcpy(output->path, path, pathLength);
+            output->path[pathLength] = '\0';
+
+            active_.fetch_add(1, std::memory_order_relaxed);
+            output->key.store(fd + 1, std::memory_order_release);
+            return;
+        }
+    }
+
+    /** Stops hashing whatever file is being hashed through the same file as 'fd' (through any fd). */
+    void Invalidate(int fd)
+    {
+        struct stat st;
+        if (!IsActive() || fstat_(fd, &st) != 0)
+        {
+            return;
+        }
+
+        for (int i = 0; i < kMaxOutputs; i++)
+        {
+            Output *output = &outputs_[i];
+            if (output->key.load(std::memory_order_acquire) > 0 && output->device == st.st_dev && output->inode == st.st_ino)
+            {
+                output->invalid.store(true, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /** Stops hashing all files (e.g., when a child process that inherits their fds is created). */
+    void InvalidateAll()
+    {
+        for (int i = 0; IsActive() && i < kMaxOutputs; i++)
+        {
+            outputs_[i].invalid.store(true, std::memory_order_relaxed);
+        }
+    }
+
+    /** Stops hashing the file of 'fd' (if any) without computing its hash. */
+    void Stop(int fd)
+    {
+        Output *output = IsActive() ? Find(fd) : NULL;
+        int expected = fd + 1;
+        if (output != NULL && output->key.compare_exchange_strong(expected, kBusy, std::memory_order_acquire))
+        {
+            Release(output);
+        }
+    }
+
+    /** Like Stop, for fds 'first' through 'last' (inclusive). */
+    void StopRange(unsigned int first, unsigned int last)
+    {
+        for (int i = 0; IsActive() && i < kMaxOutputs; i++)
+        {
+            int key = outputs_[i].key.load(std::memory_order_acquire);
+            if (key > 0 && (unsigned int)(key - 1) >= first && (unsigned int)(key - 1) <= last)
+            {
+                Stop(key - 1);
+            }
+        }
+    }
+
+    /**
+     * Must be called right before 'fd' is closed (or replaced): if the file of 'fd' was hashed, and still is what was hashed,
+     * calls 'callback(path, pathLength, hash, st)' with the hash of the file and its status.  Either way, the file is not
+     * hashed anymore.
+     */
+    template<typename F>
+    void Finish(int fd, F callback)
+    {
+        Output *output = IsActive() ? Find(fd) : NULL;
+        int expected = fd + 1;
+        if (output == NULL || !output->key.compare_exchange_strong(expected, kBusy, std::memory_order_acquire))
+        {
+            return;
+        }
+
+        struct stat st;
+        if (output->mtx.try_lock_for(std::chrono::milliseconds(1)))
+        {
+            if (!output->invalid.load(std::memory_order_relaxed) && fstat_(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+                st.st_dev == output->device && st.st_ino == output->inode && (uint64_t)st.st_size == output->length)
+            {
+                uint8_t hash[kHashSize];
+                Compute(output, hash);
+                callback(output->path, output->pathLength, hash, st);
+            }
+
+            output->mtx.unlock();
+        }
+
+        Release(output);
+    }
+
+    /** In the child process right after fork: the fds are shared with the parent, so nothing can be hashed anymore. */
+    void ResetAfterFork()
+    {
+        for (int i = 0; i < kMaxOutputs; i++)
+        {
+            // the lock could have been held by another thread of the parent
+            new (&outputs_[i].mtx) std::timed_mutex();
+            outputs_[i].key.store(0, std::memory_order_relaxed);
+        }
+
+        active_.store(0, std::memory_order_relaxed);
+    }
+};
@@ -0,0 +1,108 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+/*
+ * How much of the wall time of a process its interposers take on top of the real calls they forward to, checked against
+ * a budget: a percentage of the wall time (enabled via the BxlEnvOverheadBudget env var).  Once a process exceeds it,
+ * BxlObserver switches to the cheapest way of observing it that its pip permits and tells the host (see
+ * BxlObserver::ExceedOverheadBudget); this happens at most once per process.
+ *
+ * The overhead of a call is measured like the kInterposeTotalNs and kInterposeRealNs counters of InterposeStats (by
+ * InterposeScope), but only for the outermost interposer of a thread: an interposer that calls another interposed function
+ * already accounts for it.  Threads add up their overhead on their own and fold it into the total of the process every
+ * kFoldInterval calls, which is also when the budget is checked, so that a check costs nothing noticeable.  Processes that
+ * have not run for kMinWallNs yet are never over budget, as their start up (e.g., loading the manifest) dominates.
+ *
+ * IMPORTANT: like InterposeStats, instances must have static storage duration (i.e., be zero-initialized), because
+ * interposers may be entered before the owning BxlObserver has been constructed.
+ */
+class OverheadBudget final
+{
+private:
+    static const uint32_t kFoldInterval = 1024;
+    static const uint64_t kMinWallNs = 1000ULL * 1000 * 1000;
+
+    uint32_t budgetPercent_;
+    uint64_t startNs_;
+    std::atomic<uint64_t> overheadNs_;
+    std::atomic<bool> exceeded_;
+
+    static thread_local int sDepth;
+    static thread_local uint64_t sRealNs;
+    static thread_local uint64_t sPendingNs;
+    static thread_local uint32_t sPendingCalls;
+
+public:
+    /** Starts accounting for a process that started at 'nowNs'; a 'budgetPercent' of 0 disables the budget. */
+    void Init(uint32_t budgetPercent, uint64_t nowNs)
+    {
+        budgetPercent_ = budgetPercent;
+        startNs_ = nowNs;
+    }
+
+    inline bool IsEnabled() const { return budgetPercent_ != 0; }
+    inline uint32_t GetBudgetPercent() const { return budgetPercent_; }
+    inline uint64_t GetOverheadNs() const { return overheadNs_.load(std::memory_order_relaxed); }
+    inline uint64_t GetWallNs(uint64_t nowNs) const { return nowNs - startNs_; }
+
+    /** A forked child accounts for itself from 'nowNs' on; a parent that already exceeded the budget left it degraded. */
+    void ResetAfterFork(uint64_t nowNs)
+    {
+        startNs_ = nowNs;
+        overheadNs_.store(0, std::memory_order_relaxed);
+        sPendingNs = 0;
+        sPendingCalls = 0;
+    }
+
+    /** An interposer is entered (see InterposeScope). */
+    static inline void Enter()
+    {
+        sDepth++;
+    }
+
+    /** 'ns' were spent in a real call made by the interposer the calling thread is executing. */
+    static inline void AddRealCall(uint64_t ns)
+    {
+        sRealNs += ns;
+    }
+
+    /**
+     * The interposer the calling thread is executing, entered 'totalNs' before 'nowNs', is left.  Returns true (only once
+     * per process) when this makes the process exceed its budget.  'callOverheadNs' is set to the overhead of the call
+     * when it is the outermost one (and to 0 otherwise, the outermost call accounting for the nested ones).
+     */
+    inline bool Leave(uint64_t totalNs, uint64_t nowNs, uint64_t &callOverheadNs)
+    {
+        callOverheadNs = 0;
+        if (--sDepth > 0)
+        {
+            return false;
+        }
+
+        uint64_t realNs = sRealNs;
+        sRealNs = 0;
+        callOverheadNs = totalNs > realNs ? totalNs - realNs : 0;
+        sPendingNs += callOverheadNs;
+        if (++sPendingCalls < kFoldInterval || !IsEnabled())
+        {
+            return false;
+        }
+
+        uint64_t overheadNs = overheadNs_.fetch_add(sPendingNs, std::memory_order_relaxed) + sPendingNs;
+        sPendingNs = 0;
+        sPendingCalls = 0;
+
+        uint64_t wallNs = GetWallNs(nowNs);
+        if (wallNs < kMinWallNs || overheadNs * 100 <= wallNs * budgetPercent_ || exceeded_.load(std::memory_order_relaxed))
+        {
+            return false;
+        }
+
+        return !exceeded_.exchange(true, std::memory_order_relaxed);
+    }
+};
@@ -0,0 +1,111 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/*
+ * Shared-memory state through which the processes of a pip's process tree find out when the last one of them exits,
+ * so that the tree can be reported as completed without a central sandbox process.
+ *
+ * The backing file is created by the host (SandboxConnectionLinuxDetours) with the root process already accounted for
+ * and is mapped by every process.  It holds the number of live members of the tree and a bitmap with the pids of those
+ * members.  A process reserves a slot for a child right before creating it (so the count cannot drop to 0 in between)
+ * and the child's pid is marked as a member, either by the child itself (fork) or by the parent once it knows the pid
+ * (posix_spawn, clone with CLONE_VM).  Only members give their slot back when they exit, and they do so only once,
+ * i.e., the count never reaches 0 while a member is alive.
+ *
+ * Processes that never give their slot back (killed by a signal, exec-ed into a binary this library is not loaded into,
+ * spawned children that exit before the parent marks them) just keep the count from reaching 0: the host then falls
+ * back to waiting for the reports FIFO to be closed by all processes.
+ *
+ * CODESYNC: Public/Src/Engine/Processes/SandboxConnectionLinuxDetours.cs
+ *
+ * IMPORTANT: like ReportCache, instances must have static storage duration (i.e., be zero-initialized).
+ */
+class ProcessTree final
+{
+private:
+    static const uint32_t kMagic = 0x45455254; // "TREE"
+    static const uint32_t kVersion = 1;
+    static const size_t kHeaderSize = 64;
+    static const size_t kLiveCountOffset = 16;
+
+    std::atomic<int32_t> *liveCount_;
+    std::atomic<uint64_t> *members_;
+    uint32_t capacity_;
+
+    inline std::atomic<uint64_t>* WordOf(pid_t pid) { return &members_[(uint32_t)pid / 64]; }
+    static inline uint64_t BitOf(pid_t pid) { return 1ULL << ((uint32_t)pid % 64); }
+
+public:
+    /** Whether 'pid' fits in the bitmap, i.e., whether Adopt can succeed for it. */
+    inline bool CanTrack(pid_t pid) const { return pid > 0 && (uint32_t)pid < capacity_; }
+
+    /** Whether the tree is being tracked by this process (see Attach). */
+    inline bool IsAttached() const { return liveCount_ != NULL; }
+
+    /**
+     * Starts tracking the tree whose state is stored in 'mapped' (a shared mapping of the whole backing file).
+     * Returns false (without tracking anything) if 'mapped' does not hold a valid state.
+     */
+    bool Attach(void *mapped, size_t size)
+    {
+        const uint32_t *header = (const uint32_t*)mapped;
+        if (size < kHeaderSize || header[0] != kMagic || header[1] != kVersion || size < kHeaderSize + (header[2] + 63) / 64 * 8)
+        {
+            return false;
+        }
+
+        capacity_ = header[2];
+        members_ = (std::atomic<uint64_t>*)((char*)mapped + kHeaderSize);
+        liveCount_ = (std::atomic<int32_t>*)((char*)mapped + kLiveCountOffset);
+        return true;
+    }
+
+    /** Accounts for a child about to be created (before fork, posix_spawn or clone). */
+    inline void Reserve()
+    {
+        liveCount_->fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /** Gives back a slot taken by Reserve for a child that could not be created; returns whether the count dropped to 0. */
+    inline bool Release()
+    {
+        return liveCount_->fetch_sub(1, std::memory_order_acq_rel) == 1;
+    }
+
+    /**
+     * Marks 'pid', the child a slot was reserved for, as a member (a forked child marks itself).  Returns false if the
+     * pid cannot be tracked, in which case the slot must be given back (Release).
+     */
+    inline bool Adopt(pid_t pid)
+    {
+        if (!CanTrack(pid))
+        {
+            return false;
+        }
+
+        WordOf(pid)->fetch_or(BitOf(pid), std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Must be called right before process 'self' exits (after its last report has been sent).  Gives back the slot of
+     * 'self' if it is a member; returns whether it was the last member, i.e., whether the tree has completed.
+     */
+    bool Leave(pid_t self)
+    {
+        if (!CanTrack(self))
+        {
+            return false;
+        }
+
+        uint64_t previous = WordOf(self)->fetch_and(~BitOf(self), std::memory_order_acq_rel);
+        return (previous & BitOf(self)) != 0 && Release();
+    }
+};
@@ -0,0 +1,54 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <atomic>
+#include <dlfcn.h>
+#include <utility>
+
+/*
+ * A real (i.e., not interposed) libc function, looked up with dlsym(RTLD_NEXT) the first time it is called.
+ *
+ * There is one of these for every function we interpose (see GEN_FN_DEF_REAL), but most processes only ever call a
+ * handful of them, so resolving them on first use (instead of all of them whenever a BxlObserver is constructed,
+ * i.e., in every process) saves a lot of symbol lookups during startup.  Resolution is idempotent, so threads racing
+ * to resolve the same function simply store the same pointer.
+ *
+ * Callable just like the function pointer it replaces.
+ */
+template<typename Fn>
+class RealFunction final
+{
+private:
+    const char *name_;
+    std::atomic<Fn> fn_;
+
+    __attribute__((noinline)) Fn Resolve()
+    {
+        Fn fn = (Fn)dlsym(RTLD_NEXT, name_);
+        fn_.store(fn, std::memory_order_release);
+        return fn;
+    }
+
+public:
+    constexpr RealFunction(const char *name) : name_(name), fn_(nullptr) { }
+
+    RealFunction(const RealFunction&) = delete;
+    RealFunction& operator = (const RealFunction&) = delete;
+
+    /** Returns the real function (NULL if libc does not have it). */
+    inline Fn Get()
+    {
+        Fn fn = fn_.load(std::memory_order_acquire);
+        return fn != nullptr ? fn : Resolve();
+    }
+
+    explicit operator bool() { return Get() != nullptr; }
+
+    template<typename ...TArgs>
+    inline decltype(auto) operator()(TArgs&& ...args)
+    {
+        return Get()(std::forward<TArgs>(args)...);
+    }
+};
@@ -0,0 +1,186 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "report_format.hpp"
+
+/*
+ * Per-thread buffers in which BxlObserver batches binary report records (see report_format.hpp) into packets.
+ *
+ * A thread claims a buffer the first time it reports and gives it back when it exits, so threads of a process do not
+ * contend with each other while reporting; if all buffers are taken, the remaining threads share buffer 0.  Every buffer
+ * has its own mutex, which (besides the owner) is only ever taken to flush it.
+ *
+ * Batching per thread must not reorder accesses to the same path across threads (e.g., the host must see a write that
+ * happened before a read in that order).  Hence a small table remembers, for (a hash of) every path that was recently
+ * reported, the buffer it was put into along with that buffer's generation (which is bumped by every flush): a thread
+ * about to report a path that is still pending in the buffer of another thread first flushes that buffer.  Hash
+ * collisions only cause unnecessary flushes.
+ *
+ * Buffers are also flushed when they are full, when a process lifecycle event is reported, before fork/exec/exit (see
+ * BxlObserver::FlushReports) and, when a thread reports after a buffer has been holding on to records for longer than
+ * kMaxAgeNs, during a sweep of all buffers (which at most one thread at a time does, at most every kMaxAgeNs): there is no
+ * timer thread, which would for instance make unshare(CLONE_NEWUSER) fail in a process that was single-threaded.
+ *
+ * IMPORTANT: like ReportCache, instances must have static storage duration (i.e., be zero-initialized).
+ */
+class ReportBuffers final
+{
+public:
+    static const int kMaxBuffers = 64;
+    static const uint64_t kMaxAgeNs = 100 * 1000 * 1000;
+
+    typedef struct
+    {
+        std::timed_mutex mtx;
+        std::atomic<uint64_t> generation;   // bumped every time the buffer is flushed
+        std::atomic<int> owner;             // tid of the thread the buffer belongs to; 0 means the buffer is free
+        uint64_t firstRecordNs;             // when the oldest record still in the buffer was added
+        uint32_t processNameSentFor;        // pid whose name was last interned through this buffer
+        size_t length;
+        char data[BxlReportPacketMaxSize];
+    } Buffer;
+
+private:
+    static const uint32_t kPendingPathCount = 1024;
+    static const int kIndexShift = 48;
+    static const uint64_t kGenerationMask = (1ULL << kIndexShift) - 1;
+
+    Buffer buffers_[kMaxBuffers];
+
+    // buffer index (+ 1) << kIndexShift | generation of that buffer, by path hash
+    std::atomic<uint64_t> pendingPaths_[kPendingPathCount];
+    std::atomic<uint64_t> nextSweepNs_;
+
+    static thread_local Buffer *sCurrent;
+
+    inline uint64_t PendingEntry(const Buffer *buffer) const
+    {
+        return (uint64_t)(buffer - buffers_ + 1) << kIndexShift | (buffer->generation.load(std::memory_order_relaxed) & kGenerationMask);
+    }
+
+public:
+    static inline uint64_t NowNs()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    }
+
+    // FNV-1a followed by the murmur3 finalizer (like in ReportCache)
+    static inline uint32_t HashPath(const char *path, size_t length)
+    {
+        uint64_t hash = 14695981039346656037ULL;
+        for (size_t i = 0; i < length; i++)
+        {
+            hash = (hash ^ (unsigned char)path[i]) * 1099511628211ULL;
+        }
+
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 33;
+        return (uint32_t)hash;
+    }
+
+    /** The buffer of the calling thread ('tid'); claims one the first time.  'claimed' tells whether it was just claimed. */
+    Buffer* Current(int tid, bool *claimed)
+    {
+        *claimed = false;
+        if (sCurrent != NULL)
+        {
+            return sCurrent;
+        }
+
+        for (int i = 1; i < kMaxBuffers; i++)
+        {
+            int expected = 0;
+            if (buffers_[i].owner.load(std::memory_order_relaxed) == 0 &&
+                buffers_[i].owner.compare_exchange_strong(expected, tid, std::memory_order_acquire))
+            {
+                *claimed = true;
+                sCurrent = &buffers_[i];
+                return sCurrent;
+            }
+        }
+
+        // all taken: share buffer 0 (which nobody owns) with the other threads in this situation
+        sCurrent = &buffers_[0];
+        return sCurrent;
+    }
+
+    /** Gives back 'buffer' (which must have been flushed) once the thread that claimed it is gone. */
+    inline void Release(Buffer *buffer)
+    {
+        if (buffer != &buffers_[0])
+        {
+            buffer->owner.store(0, std::memory_order_release);
+        }
+    }
+
+    /**
+     * Returns the buffer (other than 'mine') that a record for the path with hash 'pathHash' was put into and that has not
+     * been flushed since, or NULL.
+     */
+    Buffer* FindPending(const Buffer *mine, uint32_t pathHash)
+    {
+        uint64_t entry = pendingPaths_[pathHash % kPendingPathCount].load(std::memory_order_acquire);
+        int index = (int)(entry >> kIndexShift) - 1;
+        if (index < 0 || &buffers_[index] == mine)
+        {
+            return NULL;
+        }
+
+        Buffer *buffer = &buffers_[index];
+        return (buffer->generation.load(std::memory_order_acquire) & kGenerationMask) == (entry & kGenerationMask) ? buffer : NULL;
+    }
+
+    /** Remembers that a record for the path with hash 'pathHash' was just put into 'buffer' (which must be locked). */
+    inline void SetPending(const Buffer *buffer, uint32_t pathHash)
+    {
+        pendingPaths_[pathHash % kPendingPathCount].store(PendingEntry(buffer), std::memory_order_release);
+    }
+
+    /** Whether the calling thread should sweep the buffers (see class comment); at most one does per kMaxAgeNs. */
+    bool ShouldSweep(uint64_t now)
+    {
+        uint64_t next = nextSweepNs_.load(std::memory_order_relaxed);
+        return now >= next && nextSweepNs_.compare_exchange_strong(next, now + kMaxAgeNs, std::memory_order_relaxed);
+    }
+
+    template<typename F>
+    void ForEach(F callback)
+    {
+        for (int i = 0; i < kMaxBuffers; i++)
+        {
+            callback(&buffers_[i]);
+        }
+    }
+
+    /**
+     * In the child process right after fork: whatever is in the buffers belongs to the parent process (and will be flushed
+     * by it), the mutexes could have been held by other threads of the parent, and only the calling thread is left.
+     */
+    void ResetAfterFork(int tid)
+    {
+        for (int i = 0; i < kMaxBuffers; i++)
+        {
+            Buffer *buffer = &buffers_[i];
+            new (&buffer->mtx) std::timed_mutex();
+            buffer->length = 0;
+            buffer->processNameSentFor = 0;
+            buffer->generation.fetch_add(1, std::memory_order_relaxed);
+            if (i != 0)
+            {
+                buffer->owner.store(buffer == sCurrent ? tid : 0, std::memory_order_relaxed);
+            }
+        }
+    }
+};
@@ -0,0 +1,171 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * A lock-free, insert-only set of (owner, event kind, path) triples used by BxlObserver (and by the macOS interposing library)
+ * to avoid sending duplicate reports (the owner is the process on whose behalf the access is reported, 0 meaning the current process).
+ *
+ * The set is an open-addressing hash table of 64-bit entries; the triples themselves are copied into a
+ * fixed-size arena.  An entry packs the high bits of the hash (tag), the generation the entry was created in and the
+ * offset of its record in the arena.  A thread adding a triple first copies the record into a freshly reserved piece of
+ * the arena and then publishes it by CAS-ing the entry into the first available slot of its probe sequence; entries
+ * are never removed, so a lookup that reaches an available slot knows the triple is not in the set.
+ *
+ * Clearing (which is only done in the child process right after fork, when no other thread exists) just bumps the
+ * generation and rewinds the arena: entries from a previous generation are treated as available slots (and their
+ * records are never looked at again).
+ *
+ * When the table or the arena fills up, triples are simply not added anymore: the cache is only an optimization,
+ * a miss merely results in a duplicate report.
+ *
+ * IMPORTANT: the state is not explicitly initialized; instances must have static storage duration (i.e., be zero-initialized)
+ * so that pages of the table and the arena that are never used are never touched either.
+ */
+class ReportCache final
+{
+private:
+    static const uint32_t kSlotCount      = 1 << 16;
+    static const uint32_t kMaxProbes      = 64;
+    static const uint32_t kArenaSize      = 4 << 20;
+    static const uint32_t kNoRecord       = UINT32_MAX;
+
+    static const int kGenerationShift     = 32;
+    static const int kTagShift            = 40;
+    static const uint64_t kGenerationMask = 0xff;
+    static const uint64_t kOffsetMask     = 0xffffffff;
+
+    typedef struct
+    {
+        uint32_t owner;
+        uint32_t kind;
+        uint32_t length;
+        char path[0];
+    } Record;
+
+    std::atomic<uint64_t> slots_[kSlotCount];
+    std::atomic<uint32_t> arenaPos_;
+    uint32_t generation_;
+    alignas(8) char arena_[kArenaSize];
+
+    // FNV-1a followed by the murmur3 finalizer (FNV alone does not mix the low bits, which select the slot, well enough)
+    static inline uint64_t Hash(uint32_t owner, uint32_t kind, const char *path, size_t length)
+    {
+        uint64_t hash = (14695981039346656037ULL ^ ((uint64_t)owner << 32 | kind)) * 1099511628211ULL;
+        for (size_t i = 0; i < length; i++)
+        {
+            hash = (hash ^ (unsigned char)path[i]) * 1099511628211ULL;
+        }
+
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 33;
+        hash *= 0xc4ceb9fe1a85ec53ULL;
+        hash ^= hash >> 33;
+        return hash;
+    }
+
+    inline bool IsLive(uint64_t entry) const
+    {
+        return entry != 0 && ((entry >> kGenerationShift) & kGenerationMask) == generation_;
+    }
+
+    inline uint64_t MakeEntry(uint64_t hash, uint32_t offset) const
+    {
+        // offsets are stored + 1 so that a live entry is never 0
+        return (hash >> kTagShift << kTagShift) | ((uint64_t)generation_ << kGenerationShift) | (offset + 1);
+    }
+
+    inline bool Matches(uint64_t entry, uint64_t hash, uint32_t owner, uint32_t kind, const char *path, size_t length) const
+    {
+        if ((entry >> kTagShift) != (hash >> kTagShift))
+        {
+            return false;
+        }
+
+        const Record *record = (const Record*)(arena_ + (entry & kOffsetMask) - 1);
+        return record->owner == owner && record->kind == kind && record->length == length && memcmp(record->path, path, length) == 0;
+    }
+
+    uint32_t AddRecord(uint32_t owner, uint32_t kind, const char *path, size_t length)
+    {
+        size_t size = (sizeof(Record) + length + 7) & ~(size_t)7;
+        if (size > kArenaSize || arenaPos_.load(std::memory_order_relaxed) > kArenaSize - size)
+        {
+            return kNoRecord;
+        }
+
+        uint32_t offset = arenaPos_.fetch_add((uint32_t)size, std::memory_order_relaxed);
+        if (offset > kArenaSize - size)
+        {
+            return kNoRecord; // lost the race for the last few bytes
+        }
+
+        Record *record = (Record*)(arena_ + offset);
+        record->owner = owner;
+        record->kind = kind;
+        record->length = (uint32_t)length;
+        memcpy(record->path, path, length);
+        return offset;
+    }
+
+public:
+    /**
+     * Adds (owner, kind, path) to the set.  Returns true if it was already there.
+     *
+     * Never blocks and never allocates; safe to call concurrently from any number of threads.
+     */
+    bool CheckAndAdd(uint32_t owner, uint32_t kind, const char *path, size_t length)
+    {
+        uint64_t hash = Hash(owner, kind, path, length);
+        uint32_t offset = kNoRecord;
+
+        for (uint32_t probe = 0, idx = hash & (kSlotCount - 1); probe < kMaxProbes; probe++, idx = (idx + 1) & (kSlotCount - 1))
+        {
+            uint64_t entry = slots_[idx].load(std::memory_order_acquire);
+            while (!IsLive(entry))
+            {
+                if (offset == kNoRecord && (offset = AddRecord(owner, kind, path, length)) == kNoRecord)
+                {
+                    return false;
+                }
+
+                // on failure 'entry' is reloaded: some other thread took this slot first, so re-examine it
+                if (slots_[idx].compare_exchange_weak(entry, MakeEntry(hash, offset), std::memory_order_release, std::memory_order_acquire))
+                {
+                    return false;
+                }
+            }
+
+            if (Matches(entry, hash, owner, kind, path, length))
+            {
+                return true;
+            }
+        }
+
+        // probe sequence too long: the table is (nearly) full, don't cache
+        return false;
+    }
+
+    /** Empties the set.  Not thread-safe: must only be called when no other thread can be using the cache (i.e., right after fork). */
+    void Clear()
+    {
+        generation_ = (generation_ + 1) & kGenerationMask;
+        if (generation_ == 0)
+        {
+            // wrapped around: entries created many generations ago would look live again
+            for (uint32_t i = 0; i < kSlotCount; i++)
+            {
+                slots_[i].store(0, std::memory_order_relaxed);
+            }
+        }
+
+        arenaPos_.store(0, std::memory_order_relaxed);
+    }
+};
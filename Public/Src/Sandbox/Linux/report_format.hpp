@@ -0,0 +1,91 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <stdint.h>
+#include <limits.h>
+
+#include "AccessReportRecord.h"
+
+/*
+ * Binary framing of access reports sent from libDetours.so/libBxlAudit.so to the BuildXL host.
+ *
+ * CODESYNC: Public/Src/Engine/Processes/SandboxConnectionLinuxDetours.cs, Public/Src/Engine/Processes/AccessReportRecord.cs
+ *
+ * Everything written to the reports FIFO is a sequence of packets.  Every packet is written with a single
+ * write/writev call whose total size never exceeds PIPE_BUF, i.e., packets written by different processes
+ * (or threads) never interleave.  A packet consists of a ReportPacketHeader followed by 'length' payload bytes.
+ *
+ * The payload of a packet is a sequence of whole records (see ReportRecordKind).  A record that does not fit in a single packet is split across multiple consecutive packets written by
+ * the same thread: all but the last one have the kReportPacketMoreFragments flag set, and the reader must concatenate their
+ * payloads (keyed by 'writerId') before parsing the records out of them.
+ *
+ * All integers are little-endian.
+ */
+
+#define BxlReportPacketMaxSize PIPE_BUF
+
+typedef enum
+{
+    // The payload of this packet is not complete; subsequent packets from the same writer must be appended to it.
+    kReportPacketMoreFragments = 1,
+} ReportPacketFlags;
+
+typedef struct
+{
+    // Number of payload bytes following this header
+    uint32_t length;
+
+    // Id of the thread that wrote this packet (used to reassemble fragmented records)
+    uint32_t writerId;
+
+    // ReportPacketFlags
+    uint32_t flags;
+} ReportPacketHeader;
+
+/*
+ * Access reports and process names are the shared records of AccessReportRecord.h (platform kAccessRecordPlatformPosix,
+ * UTF-8 payloads, no padding); the other kinds are specific to this sandbox.  With BxlEnvTimedReports, every record is
+ * timed (kAccessRecordFlagTimed) when it is sent; the header has no other extension.
+ */
+typedef enum
+{
+    // An access report; the payload is the reported path.
+    kReportRecordAccess = kAccessRecordKindAccess,
+
+    // Defines a process name; 'processNameId' is the id being defined, the payload is the name.
+    kReportRecordProcessName = kAccessRecordKindProcessName,
+
+    // Counters of process 'pid' (see SandboxCounters); the payload is a SandboxStats.  Only 'pid' and 'processNameId' are set.
+    kReportRecordSandboxStats = kAccessRecordKindSandboxStats,
+
+    // Interposer counters of process 'pid' (see InterposeStats::Collect for the format of the payload);
+    // only 'pid' and 'processNameId' are set.
+    kReportRecordInterposeStats = kAccessRecordKindSandboxSpecific,
+
+    // Content hash of a file process 'pid' wrote sequentially and closed (see OutputHasher); the payload is
+    // "<VSO0 hash, hex>|<size>|<mtime seconds>|<mtime nanoseconds>|<inode>|<path>".  Only 'pid' and 'processNameId' are set.
+    kReportRecordContentHash = kAccessRecordKindSandboxSpecific + 1,
+
+    // Accesses of process 'pid' that were deferred (see AccessSummary for the encoding of the payload);
+    // only 'pid' and 'processNameId' are set.
+    kReportRecordAccessSummary = kAccessRecordKindSandboxSpecific + 2,
+
+    // Process 'pid' exceeded its overhead budget (see OverheadBudget); the payload is
+    // "<overhead ns>|<wall ns>|<budget percent>|<mode it switched to>", the mode being "deferReports" or "none".
+    // Only 'pid' and 'processNameId' are set.
+    kReportRecordOverheadBudgetExceeded = kAccessRecordKindSandboxSpecific + 3,
+} ReportRecordKind;
+
+typedef AccessReportRecordHeader ReportRecordHeader;
+
+// A record of the given kind for process 'pid' with 'payloadLength' payload bytes
+inline ReportRecordHeader MakeReportRecordHeader(ReportRecordKind kind, uint32_t pid, size_t payloadLength)
+{
+    ReportRecordHeader record = MakeAccessReportRecordHeader((AccessRecordKind)kind, kAccessRecordPlatformPosix, payloadLength);
+    record.pid = pid;
+    return record;
+}
+
+static_assert(sizeof(ReportPacketHeader) == 12, "CODESYNC: SandboxConnectionLinuxDetours.cs");
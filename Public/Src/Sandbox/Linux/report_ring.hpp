@@ -0,0 +1,190 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#include "report_format.hpp"
+
+/*
+ * A bounded, multi-producer ring of report packets living in a memory-mapped file shared by all processes of a pip
+ * (the file is created and initialized by the BuildXL host, which is the only consumer).
+ *
+ * CODESYNC: Public/Src/Engine/Processes/SandboxConnectionLinuxDetours.cs
+ *
+ * The enqueue algorithm is the one used by lfds711_queue_bounded_manyproducer_manyconsumer (Dmitry Vyukov's bounded
+ * MPMC queue): every slot carries a sequence number; a producer claims position 'pos' by CAS-ing 'enqueuePos' when the
+ * sequence number of slot 'pos % slotCount' equals 'pos', copies its packet into the slot and then publishes it by
+ * setting the sequence number to 'pos + 1'.  The consumer releases the slot by setting its sequence number to
+ * 'pos + slotCount'.  Unlike liblfds, all the state lives in shared memory so it has to be position independent.
+ *
+ * A producer that dies between claiming a slot and publishing it would hold back the consumer (and, once the ring is
+ * full, every other producer) for good: producers record their pid in the slot they claim, and the consumer skips a
+ * slot that stays unpublished for too long when its claimer is gone.  Producers in turn only wait for so long for a
+ * full ring to drain before they fall back to the FIFO (see BxlObserver::SendToRing).
+ *
+ * Every slot holds exactly one packet (ReportPacketHeader + payload, see report_format.hpp), so the consumer parses
+ * ring slots exactly like it parses packets read from the reports FIFO.
+ *
+ * Doorbell: when the consumer runs out of packets it sets 'readerWaiting' and blocks reading the reports FIFO; a producer
+ * that publishes a packet and finds 'readerWaiting' set clears it and writes an empty packet to the FIFO to wake the
+ * consumer up.  Using the FIFO (rather than, e.g., an eventfd) keeps the existing completion semantics: the consumer
+ * knows that all reports have been received once all writers have closed the FIFO.
+ */
+
+#define BxlReportRingMagic   0x474e4952 // "RING"
+#define BxlReportRingVersion 2
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+
+    // Number of slots (must be a power of 2)
+    uint32_t slotCount;
+
+    // Maximum packet size that fits in a slot (at least BxlReportPacketMaxSize)
+    uint32_t slotSize;
+
+    alignas(64) std::atomic<uint64_t> enqueuePos;
+
+    // Written only by the consumer
+    alignas(64) std::atomic<uint64_t> dequeuePos;
+
+    alignas(64) std::atomic<uint32_t> readerWaiting;
+} ReportRingHeader;
+
+typedef struct
+{
+    std::atomic<uint64_t> sequence;
+
+    // Number of valid bytes in 'data'
+    uint32_t length;
+
+    // Pid of the producer that claimed the slot (0 until it is known, reset by the consumer when it releases the slot)
+    std::atomic<uint32_t> claimerPid;
+
+    // followed by 'slotSize' bytes of data
+    char data[0];
+} ReportRingSlot;
+
+#define BxlReportRingHeaderSize 256
+#define BxlReportRingSlotHeaderSize 16
+
+static_assert(sizeof(ReportRingHeader) <= BxlReportRingHeaderSize, "CODESYNC: SandboxConnectionLinuxDetours.cs");
+static_assert(sizeof(ReportRingSlot) == BxlReportRingSlotHeaderSize, "CODESYNC: SandboxConnectionLinuxDetours.cs");
+static_assert(offsetof(ReportRingHeader, enqueuePos) == 64, "CODESYNC: SandboxConnectionLinuxDetours.cs");
+static_assert(offsetof(ReportRingHeader, dequeuePos) == 128, "CODESYNC: SandboxConnectionLinuxDetours.cs");
+static_assert(offsetof(ReportRingHeader, readerWaiting) == 192, "CODESYNC: SandboxConnectionLinuxDetours.cs");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "ring atomics must be address-free to be shared across processes");
+
+class ReportRing final
+{
+private:
+    ReportRingHeader *header_;
+    uint64_t mask_;
+    size_t slotStride_;
+
+    inline ReportRingSlot* SlotAt(uint64_t pos)
+    {
+        return (ReportRingSlot*)((char*)header_ + BxlReportRingHeaderSize + (pos & mask_) * slotStride_);
+    }
+
+public:
+    /**
+     * Creates a ring on top of an already mapped region of 'mappedSize' bytes.
+     * Returns NULL if the region does not contain a valid ring.
+     */
+    static ReportRing* Create(void *mapped, size_t mappedSize)
+    {
+        ReportRingHeader *header = (ReportRingHeader*)mapped;
+        if (mappedSize < BxlReportRingHeaderSize ||
+            header->magic != BxlReportRingMagic ||
+            header->version != BxlReportRingVersion ||
+            header->slotCount == 0 ||
+            (header->slotCount & (header->slotCount - 1)) != 0 ||
+            header->slotSize < BxlReportPacketMaxSize)
+        {
+            return NULL;
+        }
+
+        size_t stride = BxlReportRingSlotHeaderSize + header->slotSize;
+        if (mappedSize < BxlReportRingHeaderSize + stride * header->slotCount)
+        {
+            return NULL;
+        }
+
+        return new ReportRing(header, stride);
+    }
+
+    ReportRing(ReportRingHeader *header, size_t slotStride)
+        : header_(header), mask_(header->slotCount - 1), slotStride_(slotStride) {}
+
+    /**
+     * Tries to enqueue a packet made of the given buffers (whose total length is 'length').
+     *
+     * 'claimerPid' is the pid of the calling process (see ReportRingSlot::claimerPid).
+     *
+     * Returns false if the ring is full.  Upon success, 'ringDoorbell' is set to indicate
+     * whether the caller must wake up the consumer, and 'depth' to the number of packets in the ring
+     * (as of when this one was enqueued, not counting the ones being dequeued).
+     */
+    bool TryEnqueue(const struct iovec *iov, int iovcnt, size_t length, uint32_t claimerPid, bool &ringDoorbell, uint64_t &depth)
+    {
+        ringDoorbell = false;
+        depth = 0;
+        if (length > header_->slotSize)
+        {
+            return false;
+        }
+
+        ReportRingSlot *slot;
+        uint64_t pos = header_->enqueuePos.load(std::memory_order_relaxed);
+        while (true)
+        {
+            slot = SlotAt(pos);
+            uint64_t seq = slot->sequence.load(std::memory_order_acquire);
+            int64_t diff = (int64_t)seq - (int64_t)pos;
+            if (diff == 0)
+            {
+                if (header_->enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false; // full
+            }
+            else
+            {
+                pos = header_->enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        slot->claimerPid.store(claimerPid, std::memory_order_relaxed);
+
+        char *dest = slot->data;
+        for (int i = 0; i < iovcnt; i++)
+        {
+            memcpy(dest, iov[i].iov_base, iov[i].iov_len);
+            dest += iov[i].iov_len;
+        }
+
+        slot->length = (uint32_t)length;
+        slot->sequence.store(pos + 1, std::memory_order_release);
+
+        uint64_t dequeuePos = header_->dequeuePos.load(std::memory_order_relaxed);
+        depth = pos + 1 > dequeuePos ? pos + 1 - dequeuePos : 0;
+
+        // pairs with the consumer setting 'readerWaiting' and then re-checking the ring before blocking
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        ringDoorbell = header_->readerWaiting.load(std::memory_order_relaxed) != 0 && header_->readerWaiting.exchange(0) != 0;
+        return true;
+    }
+};
@@ -0,0 +1,204 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
+/*
+ * A lock-free cache of path prefixes already visited by BxlObserver::resolve_path (much like the kernel's dentry cache):
+ * for every directory prefix it remembers whether it is a symlink and, if so, what its target is, so that resolving a
+ * path whose leading directories have been seen before does not cost a readlink per directory.
+ *
+ * Only prefixes that exist are cached (i.e., when readlink either succeeded or failed with EINVAL), which means that
+ * creating a new file system entry (including a symlink) never invalidates anything.  What does invalidate the cache is
+ * replacing or removing an existing directory or symlink: the interposers for rename, rmdir and unlink (of symlinks) call
+ * Invalidate.
+ *
+ * Unlike what the fd table caches (the path of a descriptor this process owns), directories and symlinks are state
+ * shared by all processes, and only the changes this process makes invalidate them: once another process (e.g., a
+ * child, or the parent the process was forked from) replaces a cached directory or symlink, paths under it are resolved
+ * (and reported) against what it used to be.  Checking entries would cost a system call per prefix, i.e., as much as
+ * not caching them, which is why the cache is only used when asked for (see BxlEnvCacheResolvedPrefixes), for pips
+ * known not to do that.
+ *
+ * Entries have the same layout as in ReportCache (hash tag, epoch, arena offset), with a 16-bit epoch: Invalidate bumps
+ * the epoch, which makes all existing entries dead at once.  Because other threads may be reading records of dead entries,
+ * the arena is never rewound; once it is full, nothing gets added anymore.  The same goes for the (unlikely) case of the
+ * epoch wrapping around: the cache is then disabled for good.
+ *
+ * A thread resolving a path must read the epoch before calling readlink and pass it to Add: that way, whatever it adds
+ * after a concurrent invalidation is dead on arrival.
+ *
+ * IMPORTANT: like ReportCache, instances must have static storage duration.
+ */
+class ResolvedPrefixCache final
+{
+private:
+    static const uint32_t kSlotCount      = 1 << 14;
+    static const uint32_t kMaxProbes      = 32;
+    static const uint32_t kArenaSize      = 2 << 20;
+    static const uint32_t kNotSymlink     = UINT32_MAX;
+
+    static const int kEpochShift          = 32;
+    static const int kTagShift            = 48;
+    static const uint64_t kEpochMask      = 0xffff;
+    static const uint64_t kOffsetMask     = 0xffffffff;
+
+    typedef struct
+    {
+        uint32_t prefixLength;
+
+        // Length of the symlink target following the prefix (kNotSymlink if the prefix is not a symlink)
+        uint32_t targetLength;
+        char data[0];
+    } Record;
+
+    std::atomic<uint64_t> slots_[kSlotCount];
+    std::atomic<uint32_t> arenaPos_;
+    std::atomic<uint32_t> epoch_;
+    std::atomic<bool> disabled_;
+    alignas(8) char arena_[kArenaSize];
+
+    static inline uint64_t Hash(const char *prefix, size_t length)
+    {
+        uint64_t hash = 14695981039346656037ULL;
+        for (size_t i = 0; i < length; i++)
+        {
+            hash = (hash ^ (unsigned char)prefix[i]) * 1099511628211ULL;
+        }
+
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 33;
+        return hash;
+    }
+
+    static inline bool IsLive(uint64_t entry, uint32_t epoch)
+    {
+        return entry != 0 && ((entry >> kEpochShift) & kEpochMask) == epoch;
+    }
+
+    inline const Record* Find(uint64_t entry, uint64_t hash, const char *prefix, size_t length) const
+    {
+        if ((entry >> kTagShift) != (hash >> kTagShift))
+        {
+            return NULL;
+        }
+
+        const Record *record = (const Record*)(arena_ + (entry & kOffsetMask) - 1);
+        return record->prefixLength == length && memcmp(record->data, prefix, length) == 0 ? record : NULL;
+    }
+
+public:
+    /** To be read before calling readlink for prefixes that are going to be added (see Add). */
+    uint32_t Epoch() const
+    {
+        return epoch_.load(std::memory_order_acquire) & kEpochMask;
+    }
+
+    /**
+     * Looks up 'prefix' (of 'length' bytes, not necessarily null-terminated).
+     *
+     * Returns -2 if not found, -1 if the prefix is not a symlink, or the length of its target
+     * otherwise (in which case the target is copied to 'target', which must hold PATH_MAX bytes).
+     */
+    ssize_t Lookup(const char *prefix, size_t length, char *target)
+    {
+        if (disabled_.load(std::memory_order_relaxed))
+        {
+            return -2;
+        }
+
+        uint64_t hash = Hash(prefix, length);
+        uint32_t epoch = Epoch();
+        for (uint32_t probe = 0, idx = hash & (kSlotCount - 1); probe < kMaxProbes; probe++, idx = (idx + 1) & (kSlotCount - 1))
+        {
+            uint64_t entry = slots_[idx].load(std::memory_order_acquire);
+            if (!IsLive(entry, epoch))
+            {
+                return -2;
+            }
+
+            const Record *record = Find(entry, hash, prefix, length);
+            if (record != NULL)
+            {
+                if (record->targetLength == kNotSymlink)
+                {
+                    return -1;
+                }
+
+                memcpy(target, record->data + length, record->targetLength);
+                return record->targetLength;
+            }
+        }
+
+        return -2;
+    }
+
+    /**
+     * Adds 'prefix', which is a symlink to 'target' ('targetLength' bytes) or not a symlink at all (if 'target' is NULL).
+     * 'epoch' is the value returned by Epoch before calling readlink on 'prefix'.
+     */
+    void Add(uint32_t epoch, const char *prefix, size_t length, const char *target, size_t targetLength)
+    {
+        if (disabled_.load(std::memory_order_relaxed) || epoch != Epoch())
+        {
+            return;
+        }
+
+        size_t dataLength = length + (target != NULL ? targetLength : 0);
+        size_t size = (sizeof(Record) + dataLength + 7) & ~(size_t)7;
+        if (size > kArenaSize || arenaPos_.load(std::memory_order_relaxed) > kArenaSize - size)
+        {
+            return;
+        }
+
+        uint32_t offset = arenaPos_.fetch_add((uint32_t)size, std::memory_order_relaxed);
+        if (offset > kArenaSize - size)
+        {
+            return;
+        }
+
+        Record *record = (Record*)(arena_ + offset);
+        record->prefixLength = (uint32_t)length;
+        record->targetLength = target != NULL ? (uint32_t)targetLength : kNotSymlink;
+        memcpy(record->data, prefix, length);
+        if (target != NULL)
+        {
+            memcpy(record->data + length, target, targetLength);
+        }
+
+        uint64_t hash = Hash(prefix, length);
+        uint64_t newEntry = (hash >> kTagShift << kTagShift) | ((uint64_t)epoch << kEpochShift) | (offset + 1);
+        for (uint32_t probe = 0, idx = hash & (kSlotCount - 1); probe < kMaxProbes; probe++, idx = (idx + 1) & (kSlotCount - 1))
+        {
+            uint64_t entry = slots_[idx].load(std::memory_order_acquire);
+            while (!IsLive(entry, epoch))
+            {
+                if (slots_[idx].compare_exchange_weak(entry, newEntry, std::memory_order_release, std::memory_order_acquire))
+                {
+                    return;
+                }
+            }
+
+            if (Find(entry, hash, prefix, length) != NULL)
+            {
+                return; // added by another thread in the meantime
+            }
+        }
+    }
+
+    /** Forgets everything that has been cached so far.  Thread-safe. */
+    void Invalidate()
+    {
+        if ((epoch_.fetch_add(1, std::memory_order_acq_rel) & kEpochMask) == kEpochMask)
+        {
+            disabled_.store(true, std::memory_order_relaxed);
+        }
+    }
+};
@@ -0,0 +1,72 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+#include "SandboxStats.h"
+#include "interpose_stats.hpp"
+
+/*
+ * The counters of this process in the schema shared by the sandboxes (see SandboxStats.h), sent to the host
+ * (BxlObserver::ReportStats) before the process exits or execs.
+ *
+ * Unlike InterposeStats, these are always kept (with binary reports): there are only a few of them, and they are
+ * striped the same way (see InterposeStats::GetStripe) so that threads do not contend for the same cache lines.
+ *
+ * IMPORTANT: like InterposeStats, instances must have static storage duration (i.e., be zero-initialized).
+ */
+class SandboxCounters final
+{
+private:
+    static const int kStripeCount = InterposeStats::kStripeCount;
+
+    typedef struct
+    {
+        alignas(64) std::atomic<uint64_t> values[kSandboxStatCount];
+    } Stripe;
+
+    Stripe stripes_[kStripeCount];
+
+public:
+    inline void Add(SandboxStat stat, uint64_t value)
+    {
+        stripes_[InterposeStats::GetStripe()].values[stat].fetch_add(value, std::memory_order_relaxed);
+    }
+
+    /** Raises high-water mark 'stat' to 'value' (if it is lower). */
+    inline void Max(SandboxStat stat, uint64_t value)
+    {
+        std::atomic<uint64_t> &current = stripes_[InterposeStats::GetStripe()].values[stat];
+        uint64_t seen = current.load(std::memory_order_relaxed);
+        while (seen < value && !current.compare_exchange_weak(seen, value, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    /** Adds (and resets) the counters collected so far to 'stats'. */
+    void Collect(SandboxStats &stats)
+    {
+        for (int stripe = 0; stripe < kStripeCount; stripe++)
+        {
+            for (int stat = 0; stat < kSandboxStatCount; stat++)
+            {
+                AddSandboxStat(stats, (SandboxStat)stat, stripes_[stripe].values[stat].exchange(0, std::memory_order_relaxed));
+            }
+        }
+    }
+
+    /** Discards all counters (in the child process right after fork: they belong to the parent). */
+    void Clear()
+    {
+        for (int stripe = 0; stripe < kStripeCount; stripe++)
+        {
+            for (int stat = 0; stat < kSandboxStatCount; stat++)
+            {
+                stripes_[stripe].values[stat].store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+};
@@ -0,0 +1,632 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#include <algorithm>
+#include <elf.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <linux/audit.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
+
+#include "seccomp_supervisor.hpp"
+
+// older kernel headers (e.g., the ones the manylinux images come with) don't have user notifications at all
+#if defined(SECCOMP_USER_NOTIF_FLAG_CONTINUE) && (defined(__x86_64__) || defined(__aarch64__))
+    #define BXL_SECCOMP_SUPPORTED 1
+#endif
+
+bool SeccompSupervisor::IsStaticExecutable(BxlObserver *bxl, const char *path)
+{
+    int fd = bxl->real_open(path, O_RDONLY | O_CLOEXEC, 0);
+    if (fd == -1)
+    {
+        return false;
+    }
+
+    bool isStatic = false;
+    Elf64_Ehdr ehdr;
+    if (pread(fd, &ehdr, sizeof(ehdr), 0) == sizeof(ehdr) &&
+        memcmp(ehdr.e_ident, ELFMAG, SELFMAG) == 0 &&
+        ehdr.e_ident[EI_CLASS] == ELFCLASS64 &&
+        (ehdr.e_type == ET_EXEC || ehdr.e_type == ET_DYN) &&
+        ehdr.e_phentsize == sizeof(Elf64_Phdr))
+    {
+        isStatic = true;
+        for (int i = 0; i < ehdr.e_phnum; i++)
+        {
+            Elf64_Phdr phdr;
+            if (pread(fd, &phdr, sizeof(phdr), ehdr.e_phoff + i * sizeof(phdr)) != sizeof(phdr) || phdr.p_type == PT_INTERP)
+            {
+                isStatic = false;
+                break;
+            }
+        }
+    }
+
+    bxl->real_close(fd);
+    return isStatic;
+}
+
+#ifndef BXL_SECCOMP_SUPPORTED
+
+void SeccompSupervisor::SuperviseExec(BxlObserver *bxl, const char *path)
+{
+    BXL_LOG_DEBUG(bxl, "Seccomp user notifications are not supported by this build; not supervising exec of %s", path);
+}
+
+#else
+
+#if defined(__x86_64__)
+    #define BXL_AUDIT_ARCH AUDIT_ARCH_X86_64
+#elif defined(__aarch64__)
+    #define BXL_AUDIT_ARCH AUDIT_ARCH_AARCH64
+#endif
+
+#define NO_ARG -1
+
+typedef enum
+{
+    kShapeAccess,   // a single path and a fixed event type
+    kShapeOpen,     // a single path; the event type depends on the open flags (see BxlObserver::report_open)
+    kShapeOpenHow,  // like kShapeOpen, but the open flags are in a 'struct open_how'
+    kShapeCreate,   // a single path being created; 'fixedFlags' is the file type
+    kShapeTwoPaths, // source and destination paths (rename, link)
+    kShapeExec,
+} SyscallShape;
+
+typedef enum
+{
+    kFollow,
+    kNoFollow,
+    kAtSymlinkNoFollow, // don't follow if AT_SYMLINK_NOFOLLOW is set in the flags
+    kAtRemoveDir,       // follow only if AT_REMOVEDIR is set in the flags (unlinkat)
+} FollowMode;
+
+typedef struct
+{
+    long nr;
+    const char *name;
+    SyscallShape shape;
+    es_event_type_t eventType;
+
+    // Indexes of syscall arguments (NO_ARG if not applicable); a missing 'dirfd' means AT_FDCWD
+    int dirfdArg;
+    int pathArg;
+    int dirfd2Arg;
+    int path2Arg;
+    int flagsArg;
+
+    FollowMode follow;
+
+    // Open flags for kShapeOpen when there is no flags argument; file type for kShapeCreate
+    int fixedFlags;
+} SupervisedSyscall;
+
+// Every syscall listed here traps (in the order listed), nothing else does.  The legacy syscalls are not available on every architecture.
+static const SupervisedSyscall kSupervisedSyscalls[] =
+{
+    //  nr                     name           shape           eventType                          dirfd   path    dirfd2  path2   flags   follow               fixedFlags
+    { __NR_openat,            "openat",      kShapeOpen,     ES_EVENT_TYPE_NOTIFY_OPEN,         0,      1,      NO_ARG, NO_ARG, 2,      kFollow,             0 },
+    { __NR_newfstatat,        "newfstatat",  kShapeAccess,   ES_EVENT_TYPE_NOTIFY_STAT,         0,      1,      NO_ARG, NO_ARG, 3,      kAtSymlinkNoFollow,  0 },
+    { __NR_statx,             "statx",       kShapeAccess,   ES_EVENT_TYPE_NOTIFY_STAT,         0,      1,      NO_ARG, NO_ARG, 2,      kAtSymlinkNoFollow,  0 },
+    { __NR_faccessat,         "faccessat",   kShapeAccess,   ES_EVENT_TYPE_NOTIFY_ACCESS,       0,      1,      NO_ARG, NO_ARG, NO_ARG, kFollow,             0 },
+    { __NR_readlinkat,        "readlinkat",  kShapeAccess,   ES_EVENT_TYPE_NOTIFY_READLINK,     0,      1,      NO_ARG, NO_ARG, NO_ARG, kNoFollow,           0 },
+    { __NR_unlinkat,          "unlinkat",    kShapeAccess,   ES_EVENT_TYPE_NOTIFY_UNLINK,       0,      1,      NO_ARG, NO_ARG, 2,      kAtRemoveDir,        0 },
+    { __NR_mkdirat,           "mkdirat",     kShapeCreate,   ES_EVENT_TYPE_NOTIFY_CREATE,       0,      1,      NO_ARG, NO_ARG, NO_ARG, kFollow,             S_IFDIR },
+    { __NR_mknodat,           "mknodat",     kShapeCreate,   ES_EVENT_TYPE_NOTIFY_CREATE,       0,      1,      NO_ARG, NO_ARG, NO_ARG, kFollow,             S_IFREG },
+    { __NR_renameat2,         "renameat2",   kShapeTwoPaths, ES_EVENT_TYPE_NOTIFY_RENAME,       0,      1,      2,      3,      NO_ARG, kNoFollow,           0 },
+    { __NR_linkat,            "linkat",      kShapeTwoPaths, ES_EVENT_TYPE_NOTIFY_LINK,         0,      1,      2,      3,      NO_ARG, kNoFollow,           0 },
+    { __NR_symlinkat,         "symlinkat",   kShapeCreate,   ES_EVENT_TYPE_NOTIFY_CREATE,       1,      2,      NO_ARG, NO_ARG, NO_ARG, kNoFollow,           S_IFLNK },
+    { __NR_fchmodat,          "fchmodat",    kShapeAccess,   ES_EVENT_TYPE_NOTIFY_SETMODE,      0,      1,      NO_ARG, NO_ARG, NO_ARG, kFollow,             0 },
+    { __NR_fchownat,          "fchownat",    kShapeAccess,   ES_EVENT_TYPE_AUTH_SETOWNER,       0,      1,      NO_ARG, NO_ARG, 4,      kAtSymlinkNoFollow,  0 },
+    { __NR_truncate,          "truncate",    kShapeAccess,   ES_EVENT_TYPE_NOTIFY_WRITE,        NO_ARG, 0,      NO_ARG, NO_ARG, NO_ARG, kFollow,             0 },
+    { __NR_utimensat,         "utimensat",   kShapeAccess,   ES_EVENT_TYPE_NOTIFY_SETTIME,      0,      1,      NO_ARG, NO_ARG, 3,      kAtSymlinkNoFollow,  0 },
+    { __NR_execve,            "execve",      kShapeExec,     ES_EVENT_TYPE_NOTIFY_EXEC,         NO_ARG, 0,      NO_ARG, NO_ARG, NO_ARG, kFollow,             0 },
+    { __NR_execveat,          "execveat",    kShapeExec,     ES_EVENT_TYPE_NOTIFY_EXEC,         0,      1,      NO_ARG, NO_ARG, 4,      kAtSymlinkNoFollow,  0 },
+#ifdef __NR_openat2
+    { __NR_openat2,           "openat2",     kShapeOpenHow,  ES_EVENT_TYPE_NOTIFY_OPEN,         0,      1,      NO_ARG, NO_ARG, NO_ARG, kFollow,             0 },
+#endif
+#ifdef __NR_faccessat2
+    { __NR_faccessat2,        "faccessat2",  kShapeAccess,   ES_EVENT_TYPE_NOTIFY_ACCESS,       0,      1,      NO_ARG, NO_ARG, 3,      kAtSymlinkNoFollow,  0 },
+#endif
+#ifdef __NR_open
+    { __NR_open,              "open",        kShapeOpen,     ES_EVENT_TYPE_NOTIFY_OPEN,         NO_ARG, 0,      NO_ARG, NO_ARG, 1,      kFollow,             0 },
+    { __NR_creat,             "creat",       kShapeOpen,     ES_EVENT_TYPE_NOTIFY_OPEN,         NO_ARG, 0,      NO_ARG, NO_ARG, NO_ARG, kFollow,             O_CREAT | O_WRONLY | O_TRUNC },
+    { __NR_stat,              "stat",        kShapeAccess,   ES_EVENT_TYPE_NOTIFY_STAT,         NO_ARG, 0,      NO_ARG, NO_ARG, NO_ARG, kFollow,             0 },
+    { __NR_lstat,             "lstat",       kShapeAccess,   ES_EVENT_TYPE_NOTIFY_STAT,         NO_ARG, 0,      NO_ARG, NO_ARG, NO_ARG, kNoFollow,           0 },
+    { __NR_access,            "access",      kShapeAccess,   ES_EVENT_TYPE_NOTIFY_ACCESS,       NO_ARG, 0,      NO_ARG, NO_ARG, NO_ARG, kFollow,             0 },
+    { __NR_readlink,          "readlink",    kShapeAccess,   ES_EVENT_TYPE_NOTIFY_READLINK,     NO_ARG, 0,      NO_ARG, NO_ARG, NO_ARG, kNoFollow,           0 },
+    { __NR_unlink,            "unlink",      kShapeAccess,   ES_EVENT_TYPE_NOTIFY_UNLINK,       NO_ARG, 0,      NO_ARG, NO_ARG, NO_ARG, kNoFollow,           0 },
+    { __NR_rmdir,             "rmdir",       kShapeAccess,   ES_EVENT_TYPE_NOTIFY_UNLINK,       NO_ARG, 0,      NO_ARG, NO_ARG, NO_ARG, kFollow,             0 },
+    { __NR_mkdir,             "mkdir",       kShapeCreate,   ES_EVENT_TYPE_NOTIFY_CREATE,       NO_ARG, 0,      NO_ARG, NO_ARG, NO_ARG, kFollow,             S_IFDIR },
+    { __NR_mknod,             "mknod",       kShapeCreate,   ES_EVENT_TYPE_NOTIFY_CREATE,       NO_ARG, 0,      NO_ARG, NO_ARG, NO_ARG, kFollow,             S_IFREG },
+    { __NR_rename,            "rename",      kShapeTwoPaths, ES_EVENT_TYPE_NOTIFY_RENAME,       NO_ARG, 0,      NO_ARG, 1,      NO_ARG, kNoFollow,           0 },
+    { __NR_renameat,          "renameat",    kShapeTwoPaths, ES_EVENT_TYPE_NOTIFY_RENAME,       0,      1,      2,      3,      NO_ARG, kNoFollow,           0 },
+    { __NR_link,              "link",        kShapeTwoPaths, ES_EVENT_TYPE_NOTIFY_LINK,         NO_ARG, 0,      NO_ARG, 1,      NO_ARG, kNoFollow,           0 },
+    { __NR_symlink,           "symlink",     kShapeCreate,   ES_EVENT_TYPE_NOTIFY_CREATE,       NO_ARG, 1,      NO_ARG, NO_ARG, NO_ARG, kNoFollow,           S_IFLNK },
+    { __NR_chmod,             "chmod",       kShapeAccess,   ES_EVENT_TYPE_NOTIFY_SETMODE,      NO_ARG, 0,      NO_ARG, NO_ARG, NO_ARG, kFollow,             0 },
+    { __NR_chown,             "chown",       kShapeAccess,   ES_EVENT_TYPE_AUTH_SETOWNER,       NO_ARG, 0,      NO_ARG, NO_ARG, NO_ARG, kFollow,             0 },
+    { __NR_lchown,            "lchown",      kShapeAccess,   ES_EVENT_TYPE_AUTH_SETOWNER,       NO_ARG, 0,      NO_ARG, NO_ARG, NO_ARG, kNoFollow,           0 },
+    { __NR_utime,             "utime",       kShapeAccess,   ES_EVENT_TYPE_NOTIFY_SETTIME,      NO_ARG, 0,      NO_ARG, NO_ARG, NO_ARG, kFollow,             0 },
+    { __NR_utimes,            "utimes",      kShapeAccess,   ES_EVENT_TYPE_NOTIFY_SETTIME,      NO_ARG, 0,      NO_ARG, NO_ARG, NO_ARG, kFollow,             0 },
+    { __NR_futimesat,         "futimesat",   kShapeAccess,   ES_EVENT_TYPE_NOTIFY_SETTIME,      0,      1,      NO_ARG, NO_ARG, NO_ARG, kFollow,             0 },
+#endif
+};
+
+static const SupervisedSyscall* FindSupervisedSyscall(long nr)
+{
+    for (size_t i = 0; i < ARRAYSIZE(kSupervisedSyscalls); i++)
+    {
+        if (kSupervisedSyscalls[i].nr == nr)
+        {
+            return &kSupervisedSyscalls[i];
+        }
+    }
+
+    return NULL;
+}
+
+static pid_t s_supervisedChild = 0;
+
+static void ForwardSignal(int sig)
+{
+    kill(s_supervisedChild, sig);
+}
+
+// only installed so that SIGCHLD interrupts poll (and the exited child gets reaped promptly)
+static void IgnoreSignal(int sig) {}
+
+int SeccompSupervisor::InstallFilter()
+{
+    const size_t numSyscalls = ARRAYSIZE(kSupervisedSyscalls);
+    struct sock_filter filter[numSyscalls + 6];
+    size_t pos = 0;
+
+    // syscalls made using a different ABI (e.g., i386 or x32 on x86_64) are not observed
+    filter[pos++] = BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, arch));
+    filter[pos++] = BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, BXL_AUDIT_ARCH, 1, 0);
+    filter[pos++] = BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW);
+    filter[pos++] = BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offsetof(struct seccomp_data, nr));
+    for (size_t i = 0; i < numSyscalls; i++)
+    {
+        // on match, jump over the remaining comparisons and the "allow" below
+        filter[pos++] = BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, (uint32_t)kSupervisedSyscalls[i].nr, (uint8_t)(numSyscalls - i), 0);
+    }
+    filter[pos++] = BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW);
+    filter[pos++] = BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_USER_NOTIF);
+
+    struct sock_fprog prog = { (unsigned short)pos, filter };
+    if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) != 0)
+    {
+        return -1;
+    }
+
+    return syscall(SYS_seccomp, SECCOMP_SET_MODE_FILTER, SECCOMP_FILTER_FLAG_NEW_LISTENER, &prog);
+}
+
+bool SeccompSupervisor::SendFd(int socket, int fd)
+{
+    char data = 0;
+    struct iovec iov = { &data, sizeof(data) };
+    char control[CMSG_SPACE(sizeof(int))] = {0};
+
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+
+    return sendmsg(socket, &msg, 0) == sizeof(data);
+}
+
+int SeccompSupervisor::ReceiveFd(int socket)
+{
+    char data;
+    struct iovec iov = { &data, sizeof(data) };
+    char control[CMSG_SPACE(sizeof(int))] = {0};
+
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t received;
+    while ((received = recvmsg(socket, &msg, MSG_CMSG_CLOEXEC)) == -1 && errno == EINTR);
+
+    // nothing received means that the child could not install the filter
+    struct cmsghdr *cmsg = received > 0 ? CMSG_FIRSTHDR(&msg) : NULL;
+    if (cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+    {
+        return -1;
+    }
+
+    int fd;
+    memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+    return fd;
+}
+
+static bool IsSingleThreaded(BxlObserver *bxl)
+{
+    DIR *dir = bxl->real_opendir("/proc/self/task");
+    if (dir == NULL)
+    {
+        return false;
+    }
+
+    int numThreads = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (entry->d_name[0] != '.')
+        {
+            numThreads++;
+        }
+    }
+
+    closedir(dir);
+    return numThreads == 1;
+}
+
+void SeccompSupervisor::SuperviseExec(BxlObserver *bxl, const char *path)
+{
+    // the supervisor keeps running the current process image, which would be wrong if other threads kept running too
+    if (!IsSingleThreaded(bxl))
+    {
+        BXL_LOG_DEBUG(bxl, "Process %d is multithreaded; not supervising exec", getpid());
+        return;
+    }
+
+    int sockets[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sockets) != 0)
+    {
+        BXL_LOG_DEBUG(bxl, "Could not create a socket pair (errno: %d); not supervising exec", errno);
+        return;
+    }
+
+    bxl->FlushReports();
+    pid_t child = bxl->real_fork();
+    if (child == -1)
+    {
+        BXL_LOG_DEBUG(bxl, "Could not fork (errno: %d); not supervising exec", errno);
+        bxl->real_close(sockets[0]);
+        bxl->real_close(sockets[1]);
+        return;
+    }
+
+    if (child == 0)
+    {
+        bxl->ResetStateAfterFork();
+        bxl->real_close(sockets[0]);
+
+        int listener = InstallFilter();
+        if (listener == -1)
+        {
+            BXL_LOG_DEBUG(bxl, "Could not install seccomp filter (errno: %d); exec-ing unsupervised", errno);
+        }
+        else
+        {
+            SendFd(sockets[1], listener);
+            bxl->real_close(listener);
+        }
+
+        bxl->real_close(sockets[1]);
+        return;
+    }
+
+    bxl->real_close(sockets[1]);
+    bxl->report_child_process("fork", child);
+
+    int listener = ReceiveFd(sockets[0]);
+    bxl->real_close(sockets[0]);
+
+    SeccompSupervisor supervisor(bxl, listener, child, path);
+    supervisor.Run();
+}
+
+void SeccompSupervisor::Run()
+{
+    char ownExePath[PATH_MAX];
+    strlcpy(ownExePath, bxl_->GetProgramPath(), PATH_MAX);
+
+    s_supervisedChild = child_;
+    struct sigaction forward = {};
+    forward.sa_handler = ForwardSignal;
+    for (int sig : { SIGHUP, SIGINT, SIGQUIT, SIGTERM, SIGUSR1, SIGUSR2 })
+    {
+        sigaction(sig, &forward, NULL);
+    }
+
+    struct sigaction ignore = {};
+    ignore.sa_handler = IgnoreSignal;
+    sigaction(SIGCHLD, &ignore, NULL);
+
+    if (listener_ != -1)
+    {
+        HandleNotifications();
+        bxl_->real_close(listener_);
+    }
+
+    if (!childExited_)
+    {
+        ReapChild(0);
+    }
+
+    // report our own exit (this process was supposed to be replaced by what is now the child)
+    SwitchTo(getpid(), ownExePath);
+    bxl_->report_access("_exit", ES_EVENT_TYPE_NOTIFY_EXIT, std::string(""), std::string(""));
+    bxl_->FlushReports();
+    ExitLikeChild();
+}
+
+void SeccompSupervisor::ReapChild(int options)
+{
+    int status;
+    pid_t pid;
+    while ((pid = waitpid(child_, &status, options)) == -1 && errno == EINTR);
+
+    if (pid != child_ || !(WIFEXITED(status) || WIFSIGNALED(status)))
+    {
+        return;
+    }
+
+    childExited_ = true;
+    childStatus_ = status;
+
+    // the child cannot report its own exit: it is not running libDetours.so
+    SwitchTo(child_, childExePath_);
+    bxl_->report_access("_exit", ES_EVENT_TYPE_NOTIFY_EXIT, std::string(""), std::string(""));
+}
+
+void SeccompSupervisor::SwitchTo(pid_t pid, const char *exePath)
+{
+    if (pid == child_ && exePath != childExePath_)
+    {
+        strlcpy(childExePath_, exePath, PATH_MAX);
+    }
+
+    bxl_->ReportOnBehalfOf(pid, exePath);
+    current_ = pid;
+}
+
+void SeccompSupervisor::HandleNotifications()
+{
+    struct seccomp_notif_sizes sizes;
+    if (syscall(SYS_seccomp, SECCOMP_GET_NOTIF_SIZES, 0, &sizes) != 0)
+    {
+        // can't happen when the filter could be installed
+        BXL_LOG_DEBUG(bxl_, "Could not get seccomp notification sizes; errno: %d", errno);
+        return;
+    }
+
+    // the kernel may use bigger structures than the ones we were compiled against
+    struct seccomp_notif *req = (struct seccomp_notif*)calloc(1, std::max((size_t)sizes.seccomp_notif, sizeof(struct seccomp_notif)));
+    struct seccomp_notif_resp *resp = (struct seccomp_notif_resp*)calloc(1, std::max((size_t)sizes.seccomp_notif_resp, sizeof(struct seccomp_notif_resp)));
+
+    while (true)
+    {
+        // the listener reports POLLHUP once no process uses the filter anymore
+        struct pollfd pfd = { listener_, POLLIN, 0 };
+        int numReady = poll(&pfd, 1, -1);
+        if (!childExited_)
+        {
+            ReapChild(WNOHANG);
+        }
+
+        if (numReady == -1 && errno == EINTR)
+        {
+            continue;
+        }
+
+        if (numReady <= 0 || (pfd.revents & POLLIN) == 0)
+        {
+            break;
+        }
+
+        memset(req, 0, sizes.seccomp_notif);
+        if (ioctl(listener_, SECCOMP_IOCTL_NOTIF_RECV, req) != 0)
+        {
+            continue; // e.g., the tracee got killed in the meantime
+        }
+
+        memset(resp, 0, sizes.seccomp_notif_resp);
+        resp->id = req->id;
+        resp->flags = SECCOMP_USER_NOTIF_FLAG_CONTINUE;
+
+        const SupervisedSyscall *sc = FindSupervisedSyscall(req->data.nr);
+        pid_t pid = req->pid;
+        const __u64 *args = req->data.args;
+
+        int flags = sc == NULL || sc->flagsArg == NO_ARG ? 0 : (int)args[sc->flagsArg];
+        int oflags = 0;
+        switch (sc == NULL ? kFollow : sc->follow)
+        {
+            case kFollow:            oflags = 0; break;
+            case kNoFollow:          oflags = O_NOFOLLOW; break;
+            case kAtSymlinkNoFollow: oflags = (flags & AT_SYMLINK_NOFOLLOW) ? O_NOFOLLOW : 0; break;
+            case kAtRemoveDir:       oflags = (flags & AT_REMOVEDIR) ? 0 : O_NOFOLLOW; break;
+        }
+
+        std::string path, path2;
+        bool resolved = sc != NULL &&
+            ResolvePath(pid, sc->dirfdArg == NO_ARG ? AT_FDCWD : args[sc->dirfdArg], args[sc->pathArg], oflags, path) &&
+            (sc->path2Arg == NO_ARG ||
+             ResolvePath(pid, sc->dirfd2Arg == NO_ARG ? AT_FDCWD : args[sc->dirfd2Arg], args[sc->path2Arg], oflags, path2));
+
+        int openFlags = sc == NULL ? 0 : sc->flagsArg == NO_ARG ? sc->fixedFlags : flags;
+        if (resolved && sc->shape == kShapeOpenHow)
+        {
+            // the flags are the first member of 'struct open_how'
+            uint64_t howFlags;
+            struct iovec local = { &howFlags, sizeof(howFlags) };
+            struct iovec remote = { (void*)args[2], sizeof(howFlags) };
+            resolved = process_vm_readv(pid, &local, 1, &remote, 1, 0) == sizeof(howFlags);
+            openFlags = (int)howFlags;
+        }
+
+        // what was read from a tracee that is gone (or whose syscall got interrupted) may be garbage
+        if (resolved && ioctl(listener_, SECCOMP_IOCTL_NOTIF_ID_VALID, &req->id) == 0)
+        {
+            if (pid != current_)
+            {
+                char procPath[64], exePath[PATH_MAX] = {0};
+                snprintf(procPath, sizeof(procPath), "/proc/%d/exe", pid);
+                bxl_->real_readlink(procPath, exePath, PATH_MAX - 1);
+                SwitchTo(pid, exePath);
+            }
+
+            AccessCheckResult check = AccessCheckResult::Invalid();
+            switch (sc->shape)
+            {
+                case kShapeAccess:
+                case kShapeTwoPaths:
+                    check = bxl_->report_access(sc->name, sc->eventType, path, path2);
+                    break;
+
+                case kShapeOpen:
+                case kShapeOpenHow:
+                    check = bxl_->report_open(sc->name, path, openFlags);
+                    break;
+
+                case kShapeCreate:
+                {
+                    IOEvent event(pid, 0, 0, ES_EVENT_TYPE_NOTIFY_CREATE, ES_ACTION_TYPE_NOTIFY, path, std::string(""), std::string(bxl_->GetProgramPath()), (mode_t)sc->fixedFlags, false);
+                    check = bxl_->report_access(sc->name, event);
+                    break;
+                }
+
+                case kShapeExec:
+                    // the exec of the child itself has already been reported by libDetours.so (running in the child)
+                    if (pid != child_ || skippedInitialExec_)
+                    {
+                        check = bxl_->report_access(sc->name, ES_EVENT_TYPE_NOTIFY_EXEC, path, std::string(""));
+                    }
+
+                    skippedInitialExec_ |= pid == child_;
+                    SwitchTo(pid, path.c_str());
+                    break;
+            }
+
+            if (bxl_->should_deny(check))
+            {
+                resp->flags = 0;
+                resp->error = -EPERM;
+            }
+        }
+
+        // fails if the tracee is gone, in which case there is nothing else to do
+        ioctl(listener_, SECCOMP_IOCTL_NOTIF_SEND, resp);
+    }
+
+    free(req);
+    free(resp);
+}
+
+bool SeccompSupervisor::ReadString(pid_t pid, uint64_t addr, char *buf, size_t bufsiz)
+{
+    // never read across a page boundary at once: the next page may not be mapped
+    const size_t PageSize = 4096;
+    size_t total = 0;
+    while (total < bufsiz)
+    {
+        size_t chunk = std::min(PageSize - ((addr + total) % PageSize), bufsiz - total);
+        struct iovec local = { buf + total, chunk };
+        struct iovec remote = { (void*)(addr + total), chunk };
+        ssize_t numRead = process_vm_readv(pid, &local, 1, &remote, 1, 0);
+        if (numRead <= 0)
+        {
+            return false;
+        }
+
+        if (memchr(buf + total, '\0', numRead) != NULL)
+        {
+            return true;
+        }
+
+        total += numRead;
+    }
+
+    return false; // longer than PATH_MAX
+}
+
+bool SeccompSupervisor::ResolvePath(pid_t pid, uint64_t dirfd, uint64_t addr, int oflags, std::string &result)
+{
+    // a NULL path (e.g., for utimensat) refers to 'dirfd' itself
+    char path[PATH_MAX] = {0};
+    if (addr != 0 && !ReadString(pid, addr, path, sizeof(path)))
+    {
+        return false;
+    }
+
+    char fullpath[PATH_MAX] = {0};
+    if (path[0] == '/')
+    {
+        strlcpy(fullpath, path, PATH_MAX);
+    }
+    else
+    {
+        // relative paths are resolved against the tracee's cwd or file descriptor
+        char procPath[64];
+        if ((int)dirfd == AT_FDCWD)
+        {
+            snprintf(procPath, sizeof(procPath), "/proc/%d/cwd", pid);
+        }
+        else
+        {
+            snprintf(procPath, sizeof(procPath), "/proc/%d/fd/%d", pid, (int)dirfd);
+        }
+
+        ssize_t len = bxl_->real_readlink(procPath, fullpath, PATH_MAX - 1);
+        if (len <= 0 || fullpath[0] != '/')
+        {
+            return false; // not a file (e.g., a pipe or a socket)
+        }
+
+        if (path[0] != '\0')
+        {
+            if (len + 1 + strlen(path) >= PATH_MAX)
+            {
+                return false;
+            }
+
+            fullpath[len] = '/';
+            strcpy(fullpath + len + 1, path);
+        }
+    }
+
+    result = bxl_->normalize_path(fullpath, oflags);
+    return true;
+}
+
+void SeccompSupervisor::ExitLikeChild()
+{
+    if (WIFSIGNALED(childStatus_))
+    {
+        int sig = WTERMSIG(childStatus_);
+        signal(sig, SIG_DFL);
+
+        sigset_t mask;
+        sigemptyset(&mask);
+        sigaddset(&mask, sig);
+        sigprocmask(SIG_UNBLOCK, &mask, NULL);
+        kill(getpid(), sig);
+
+        // not all signals terminate the process by default
+        bxl_->real__exit(128 + sig);
+    }
+
+    bxl_->real__exit(WEXITSTATUS(childStatus_));
+}
+
+#endif
@@ -0,0 +1,78 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include "bxl_observer.hpp"
+
+/*
+ * Observes statically linked executables (which never load libDetours.so) by means of seccomp user notifications.
+ *
+ * When enabled (via the BxlEnvSeccompStaticProcesses env var) and a process is about to exec a statically linked
+ * executable, the exec-ing process forks a child which installs a seccomp filter, hands the filter's listener over
+ * to its parent, and then goes on with the exec.  The filter traps only file-related syscalls (see kSupervisedSyscalls
+ * in seccomp_supervisor.cpp); every other syscall just pays for running a short BPF program.
+ *
+ * The parent becomes the supervisor: it receives a notification for every trapped syscall made by the child or any of
+ * its descendants (seccomp filters are inherited across fork and exec), reads the syscall arguments from the tracee's
+ * memory, reports the access through the regular BxlObserver/IOHandler pipeline on behalf of the tracee, and then
+ * either lets the syscall continue or fails it with EPERM (when the access must be denied).  Once all tracees are gone
+ * the supervisor exits with the exit status of the child (forwarding termination signals to the child in the meantime),
+ * so to its parent it looks as if it had exec-ed the static executable itself.
+ *
+ * Running the static executable in a child (rather than supervising the exec-ing process from a child of its own)
+ * makes all tracees descendants of the supervisor, which is what Yama (ptrace_scope = 1) requires for reading their memory.
+ *
+ * Limitations:
+ *   - syscall arguments are read at notification time, and a tracee is free to change them before the kernel reads them
+ *     when the syscall continues; this is an observer rather than a security boundary (just like libDetours.so);
+ *   - fd-based syscalls (write, fstat, fchmod, ...) are not trapped;
+ *   - dynamically linked descendants of a supervised process are reported both by libDetours.so and by the supervisor;
+ *   - the child runs with no_new_privs set (required for installing a filter without CAP_SYS_ADMIN);
+ *   - requires Linux 5.8 (SECCOMP_USER_NOTIF_FLAG_CONTINUE and the listener reporting POLLHUP); when the filter cannot be
+ *     installed, the child execs unsupervised.
+ */
+class SeccompSupervisor final
+{
+private:
+    BxlObserver *bxl_;
+    int listener_;
+    pid_t child_;
+    char childExePath_[PATH_MAX];
+    bool childExited_;
+    int childStatus_;
+    bool skippedInitialExec_;
+
+    // Tracee on whose behalf accesses are currently being reported
+    pid_t current_;
+
+    SeccompSupervisor(BxlObserver *bxl, int listener, pid_t child, const char *childExePath)
+        : bxl_(bxl), listener_(listener), child_(child), childExited_(false), childStatus_(0), skippedInitialExec_(false), current_(0)
+    {
+        strlcpy(childExePath_, childExePath, PATH_MAX);
+    }
+
+    static int InstallFilter();
+    static bool SendFd(int socket, int fd);
+    static int ReceiveFd(int socket);
+
+    void Run();
+    void ReapChild(int options);
+    void SwitchTo(pid_t pid, const char *exePath);
+    void HandleNotifications();
+    bool ReadString(pid_t pid, uint64_t addr, char *buf, size_t bufsiz);
+    bool ResolvePath(pid_t pid, uint64_t dirfd, uint64_t addr, int oflags, std::string &result);
+    void ExitLikeChild();
+
+public:
+    /** Returns whether 'path' is an ELF executable without a program interpreter (i.e., one that libDetours.so cannot observe). */
+    static bool IsStaticExecutable(BxlObserver *bxl, const char *path);
+
+    /**
+     * Must be called right before exec-ing the statically linked executable 'path'.
+     *
+     * Returns only in the (forked) process that is supposed to go on with the exec; the calling process becomes
+     * the supervisor and exits once the supervised process tree is gone.
+     */
+    static void SuperviseExec(BxlObserver *bxl, const char *path);
+};
@@ -0,0 +1,211 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * A lock-free, insert-only set of (program, event kind, path) triples shared by all the processes of a pip, through which
+ * a process finds out that an access was already reported by another process of the same pip (the program is a hash of
+ * the executable path, so that policies that depend on the executable still see the accesses of every executable).
+ *
+ * The layout is that of ReportCache, except that the table and the arena live in a file (created by the host, see
+ * SandboxConnectionLinuxDetours) that every process maps, and there are no generations: the set lives as long as the pip.
+ * Entries are offsets into the arena rather than pointers, and since any process of the pip can write to the mapping,
+ * every offset is bounds-checked before the record it points to is looked at.
+ *
+ * Unlike ReportCache, looking up (Contains) and adding (Add) are separate steps: a triple must only be added once its report
+ * has been written to the host, otherwise a process killed in between would take the report of another process with it.
+ *
+ * CODESYNC: Public/Src/Engine/Processes/SandboxConnectionLinuxDetours.cs
+ *
+ * IMPORTANT: like ReportCache, instances must have static storage duration (i.e., be zero-initialized).
+ */
+class SharedReportCache final
+{
+private:
+    static const uint32_t kMagic       = 0x48434352; // "RCCH"
+    static const uint32_t kVersion     = 1;
+    static const size_t kHeaderSize    = 64;
+    static const size_t kArenaPosOffset = 16;
+    static const uint32_t kMaxProbes   = 64;
+    static const uint32_t kNoRecord    = UINT32_MAX;
+
+    static const int kTagShift         = 40;
+    static const uint64_t kOffsetMask  = 0xffffffffff;
+
+    typedef struct
+    {
+        uint32_t program;
+        uint32_t kind;
+        uint32_t length;
+        char path[0];
+    } Record;
+
+    std::atomic<uint64_t> *slots_;
+    std::atomic<uint32_t> *arenaPos_;
+    char *arena_;
+    uint32_t slotMask_;
+    uint32_t arenaSize_;
+
+    // same hash as ReportCache
+    static inline uint64_t Hash(uint32_t program, uint32_t kind, const char *path, size_t length)
+    {
+        uint64_t hash = (14695981039346656037ULL ^ ((uint64_t)program << 32 | kind)) * 1099511628211ULL;
+        for (size_t i = 0; i < length; i++)
+        {
+            hash = (hash ^ (unsigned char)path[i]) * 1099511628211ULL;
+        }
+
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdULL;
+        hash ^= hash >> 33;
+        hash *= 0xc4ceb9fe1a85ec53ULL;
+        hash ^= hash >> 33;
+        return hash;
+    }
+
+    static inline uint64_t MakeEntry(uint64_t hash, uint32_t offset)
+    {
+        // offsets are stored + 1 so that an entry is never 0
+        return (hash >> kTagShift << kTagShift) | ((uint64_t)offset + 1);
+    }
+
+    inline bool Matches(uint64_t entry, uint64_t hash, uint32_t program, uint32_t kind, const char *path, size_t length) const
+    {
+        if ((entry >> kTagShift) != (hash >> kTagShift))
+        {
+            return false;
+        }
+
+        uint64_t offset = (entry & kOffsetMask) - 1;
+        if (offset + sizeof(Record) + length > arenaSize_)
+        {
+            return false; // not a record this process could have written
+        }
+
+        const Record *record = (const Record*)(arena_ + offset);
+        return record->program == program && record->kind == kind && record->length == length && memcmp(record->path, path, length) == 0;
+    }
+
+    uint32_t AddRecord(uint32_t program, uint32_t kind, const char *path, size_t length)
+    {
+        size_t size = (sizeof(Record) + length + 7) & ~(size_t)7;
+        if (size > arenaSize_ || arenaPos_->load(std::memory_order_relaxed) > arenaSize_ - size)
+        {
+            return kNoRecord;
+        }
+
+        uint32_t offset = arenaPos_->fetch_add((uint32_t)size, std::memory_order_relaxed);
+        if (offset > arenaSize_ - size)
+        {
+            return kNoRecord; // lost the race for the last few bytes
+        }
+
+        Record *record = (Record*)(arena_ + offset);
+        record->program = program;
+        record->kind = kind;
+        record->length = (uint32_t)length;
+        memcpy(record->path, path, length);
+        return offset;
+    }
+
+public:
+    /** Hash identifying the executable 'path' in the set. */
+    static inline uint32_t HashProgram(const char *path)
+    {
+        return (uint32_t)Hash(0, 0, path, strlen(path));
+    }
+
+    /** Whether the set is shared with the other processes of the pip (see Attach). */
+    inline bool IsAttached() const { return slots_ != NULL; }
+
+    /**
+     * Starts using the set stored in 'mapped' (a shared mapping of the whole backing file).
+     * Returns false (without using anything) if 'mapped' does not hold a valid set.
+     */
+    bool Attach(void *mapped, size_t size)
+    {
+        const uint32_t *header = (const uint32_t*)mapped;
+        if (size < kHeaderSize || header[0] != kMagic || header[1] != kVersion)
+        {
+            return false;
+        }
+
+        uint32_t slotCount = header[2];
+        uint32_t arenaSize = header[3];
+        if (slotCount == 0 || (slotCount & (slotCount - 1)) != 0 || arenaSize < sizeof(Record) ||
+            size < kHeaderSize + (size_t)slotCount * sizeof(uint64_t) + arenaSize)
+        {
+            return false;
+        }
+
+        slotMask_ = slotCount - 1;
+        arenaSize_ = arenaSize;
+        arenaPos_ = (std::atomic<uint32_t>*)((char*)mapped + kArenaPosOffset);
+        arena_ = (char*)mapped + kHeaderSize + (size_t)slotCount * sizeof(uint64_t);
+        slots_ = (std::atomic<uint64_t>*)((char*)mapped + kHeaderSize);
+        return true;
+    }
+
+    /** Whether (program, kind, path) was added by some process of the pip.  Never blocks. */
+    bool Contains(uint32_t program, uint32_t kind, const char *path, size_t length) const
+    {
+        uint64_t hash = Hash(program, kind, path, length);
+        for (uint32_t probe = 0, idx = hash & slotMask_; probe < kMaxProbes; probe++, idx = (idx + 1) & slotMask_)
+        {
+            uint64_t entry = slots_[idx].load(std::memory_order_acquire);
+            if (entry == 0)
+            {
+                return false;
+            }
+
+            if (Matches(entry, hash, program, kind, path, length))
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /**
+     * Adds (program, kind, path) to the set, unless it is already there.
+     *
+     * Never blocks and never allocates; safe to call concurrently from any number of threads and processes.
+     */
+    void Add(uint32_t program, uint32_t kind, const char *path, size_t length)
+    {
+        uint64_t hash = Hash(program, kind, path, length);
+        uint32_t offset = kNoRecord;
+
+        for (uint32_t probe = 0, idx = hash & slotMask_; probe < kMaxProbes; probe++, idx = (idx + 1) & slotMask_)
+        {
+            uint64_t entry = slots_[idx].load(std::memory_order_acquire);
+            while (entry == 0)
+            {
+                if (offset == kNoRecord && (offset = AddRecord(program, kind, path, length)) == kNoRecord)
+                {
+                    return;
+                }
+
+                // on failure 'entry' is reloaded: some other thread or process took this slot first, so re-examine it
+                if (slots_[idx].compare_exchange_weak(entry, MakeEntry(hash, offset), std::memory_order_release, std::memory_order_acquire))
+                {
+                    return;
+                }
+            }
+
+            if (Matches(entry, hash, program, kind, path, length))
+            {
+                return;
+            }
+        }
+
+        // probe sequence too long: the table is (nearly) full, don't cache
+    }
+};
@@ -0,0 +1,289 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+// Entry points of libBxlUtils.so through which the managed unit tests (Public/Src/Engine/UnitTests/Processes) exercise
+// the data structures of the libraries loaded into pips, which do not export anything but the functions they interpose.
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fd_table.hpp"
+#include "output_hasher.hpp"
+#include "report_cache.hpp"
+#include "report_format.hpp"
+#include "report_ring.hpp"
+#include "shared_report_cache.hpp"
+#include "utils.h"
+
+static FdTable s_fdTable;
+static OutputHasher s_outputHasher;
+static ReportCache s_reportCache;
+
+/** ReportCache::CheckAndAdd on the cache of this library, i.e., whether (owner, kind, path) was already added. */
+DLL_EXPORT bool report_cache_check_and_add_for_test(uint32_t owner, uint32_t kind, const char *path)
+{
+    return s_reportCache.CheckAndAdd(owner, kind, path, strlen(path));
+}
+
+/** ReportCache::Clear on the cache of this library (the tests calling it must not run concurrently with any other test using it). */
+DLL_EXPORT void report_cache_clear_for_test()
+{
+    s_reportCache.Clear();
+}
+
+/** FdTable::Get on the table of this library: the path cached for 'fd' (NULL if none) and its length in 'length'. */
+DLL_EXPORT const char* fd_table_get_for_test(int fd, size_t *length)
+{
+    return s_fdTable.Get(fd, length);
+}
+
+/** FdTable::Set on the table of this library. */
+DLL_EXPORT void fd_table_set_for_test(int fd, const char *path)
+{
+    s_fdTable.Set(fd, path, strlen(path));
+}
+
+/** FdTable::Reset on the table of this library. */
+DLL_EXPORT void fd_table_reset_for_test(int fd)
+{
+    s_fdTable.Reset(fd);
+}
+
+/** FdTable::ResetRange on the table of this library. */
+DLL_EXPORT void fd_table_reset_range_for_test(unsigned int first, unsigned int last)
+{
+    s_fdTable.ResetRange(first, last);
+}
+
+/** FdTable::MarkWriteReported on the table of this library. */
+DLL_EXPORT void fd_table_mark_write_reported_for_test(int fd)
+{
+    s_fdTable.MarkWriteReported(fd);
+}
+
+/** FdTable::IsWriteReported on the table of this library. */
+DLL_EXPORT bool fd_table_is_write_reported_for_test(int fd)
+{
+    return s_fdTable.IsWriteReported(fd);
+}
+
+/** FdTable::ClearWriteReported on the table of this library. */
+DLL_EXPORT void fd_table_clear_write_reported_for_test()
+{
+    s_fdTable.ClearWriteReported();
+}
+
+/**
+ * Writes a record of 'kind' for process 'pid' into 'buffer', framed like BxlObserver frames the records it sends
+ * (timed with 'timestamp' and 'sequenceNumber' if 'timed'; see report_format.hpp), followed by its 'payloadLength'
+ * bytes of payload.  Returns the length of the record, or 0 if it does not fit in 'bufferSize' bytes.
+ */
+DLL_EXPORT size_t make_report_record_for_test(uint16_t kind, uint32_t pid, uint32_t operation, uint32_t processNameId, bool timed,
+    uint64_t timestamp, uint64_t sequenceNumber, const char *payload, size_t payloadLength, char *buffer, size_t bufferSize)
+{
+    ReportRecordHeader record = MakeReportRecordHeader((ReportRecordKind)kind, pid, payloadLength);
+    record.operation = operation;
+    record.processNameId = processNameId;
+
+    AccessReportRecordTiming timing = { timestamp, sequenceNumber };
+    if (timed)
+    {
+        record.flags      |= kAccessRecordFlagTimed;
+        record.headerSize += sizeof(AccessReportRecordTiming);
+        record.length     += sizeof(AccessReportRecordTiming);
+    }
+
+    if (record.length > bufferSize)
+    {
+        return 0;
+    }
+
+    memcpy(buffer, &record, sizeof(record));
+    if (timed)
+    {
+        memcpy(buffer + sizeof(record), &timing, sizeof(timing));
+    }
+
+    memcpy(buffer + record.headerSize, payload, payloadLength);
+    return record.length;
+}
+
+/** Maps all of the file at 'path' for reading and writing (as the sandbox maps the files the host shares); NULL if it cannot. */
+static void* MapForTest(const char *path, size_t *size)
+{
+    int fd = open(path, O_RDWR | O_CLOEXEC);
+    if (fd == -1)
+    {
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    *size = st.st_size;
+    void *mapped = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    return mapped == MAP_FAILED ? NULL : mapped;
+}
+
+/**
+ * Enqueues the packet 'packet' ('length' bytes) for 'claimerPid' in the reports ring the host created at 'ringPath', like
+ * BxlObserver::SendToRing does.  Without 'publish', the slot is only claimed, as by a producer that died right after.
+ *
+ * Returns false if the ring is full (or not a valid ring).
+ */
+DLL_EXPORT bool ring_enqueue_for_test(const char *ringPath, const char *packet, size_t length, uint32_t claimerPid, bool publish)
+{
+    size_t size;
+    void *mapped = MapForTest(ringPath, &size);
+    ReportRing *ring = mapped != NULL ? ReportRing::Create(mapped, size) : NULL;
+    if (ring == NULL)
+    {
+        return false;
+    }
+
+    bool enqueued;
+    if (publish)
+    {
+        struct iovec iov = { (void*)packet, length };
+        bool ringDoorbell;
+        uint64_t depth;
+        enqueued = ring->TryEnqueue(&iov, 1, length, claimerPid, ringDoorbell, depth);
+    }
+    else
+    {
+        ReportRingHeader *header = (ReportRingHeader*)mapped;
+        uint64_t pos = header->enqueuePos.load();
+        ReportRingSlot *slot = (ReportRingSlot*)((char*)mapped + BxlReportRingHeaderSize +
+            (pos & (header->slotCount - 1)) * (BxlReportRingSlotHeaderSize + header->slotSize));
+        enqueued = slot->sequence.load() == pos && header->enqueuePos.compare_exchange_strong(pos, pos + 1);
+        if (enqueued)
+        {
+            slot->claimerPid.store(claimerPid);
+        }
+    }
+
+    delete ring;
+    munmap(mapped, size);
+    return enqueued;
+}
+
+/**
+ * Attaches a SharedReportCache to the file the host created at 'cachePath' (mapping it anew, like every process of a pip does)
+ * and calls 'action' on it.  Returns false if the file does not hold a valid set.
+ */
+template<typename Action>
+static bool WithSharedReportCache(const char *cachePath, Action action)
+{
+    size_t size;
+    void *mapped = MapForTest(cachePath, &size);
+    if (mapped == NULL)
+    {
+        return false;
+    }
+
+    static SharedReportCache cache;
+    bool attached = cache.Attach(mapped, size);
+    if (attached)
+    {
+        action(cache);
+    }
+
+    munmap(mapped, size);
+    return attached;
+}
+
+/** SharedReportCache::Add of (executable 'programPath', 'kind', 'path') to the set at 'cachePath'; false if it is not a valid set. */
+DLL_EXPORT bool shared_report_cache_add_for_test(const char *cachePath, const char *programPath, uint32_t kind, const char *path)
+{
+    return WithSharedReportCache(cachePath, [&](SharedReportCache &cache)
+    {
+        cache.Add(SharedReportCache::HashProgram(programPath), kind, path, strlen(path));
+    });
+}
+
+/** SharedReportCache::Contains of (executable 'programPath', 'kind', 'path') in the set at 'cachePath'; false if it is not a valid set. */
+DLL_EXPORT bool shared_report_cache_contains_for_test(const char *cachePath, const char *programPath, uint32_t kind, const char *path)
+{
+    bool contains = false;
+    return WithSharedReportCache(cachePath, [&](SharedReportCache &cache)
+    {
+        contains = cache.Contains(SharedReportCache::HashProgram(programPath), kind, path, strlen(path));
+    }) && contains;
+}
+
+/**
+ * Writes 'length' bytes of 'data' to (a new or truncated) 'path', 'chunkLength' bytes per write, hashing them as
+ * BxlObserver does for the outputs of a pip.  Unbeknownst to the hasher, the file is then changed in one of these
+ * ways: with 'seekAt' < 'length', the fd skips one byte once 'seekAt' bytes are written (leaving a hole); with
+ * 'rewrite', the first half of 'data' is written over the file through another fd that truncates it.
+ *
+ * Returns whether the hasher reported a hash when the fd was closed (it is then copied to 'hash', of 32 bytes).
+ */
+DLL_EXPORT bool hash_output_for_test(const char *path, const uint8_t *data, size_t length, size_t chunkLength, size_t seekAt, bool rewrite, uint8_t *hash)
+{
+    s_outputHasher.Init(fstat);
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) != 0)
+    {
+        return false;
+    }
+
+    s_outputHasher.Start(fd, path, strlen(path), st);
+    for (size_t written = 0; written < length;)
+    {
+        size_t n = chunkLength < length - written ? chunkLength : length - written;
+        if (seekAt >= written && seekAt < written + n)
+        {
+            n = seekAt - written;
+        }
+
+        if (n > 0)
+        {
+            OutputHasher::Write write(s_outputHasher, fd);
+            ssize_t result = ::write(fd, data + written, n);
+            write.Written(data + written, result);
+            if (result <= 0)
+            {
+                break;
+            }
+
+            written += result;
+        }
+
+        if (written == seekAt)
+        {
+            lseek(fd, 1, SEEK_CUR);
+            seekAt = SIZE_MAX;
+        }
+    }
+
+    if (rewrite)
+    {
+        int other = open(path, O_WRONLY | O_TRUNC);
+        if (other != -1)
+        {
+            (void)::write(other, data, length / 2);
+            close(other);
+        }
+    }
+
+    bool hashed = false;
+    s_outputHasher.Finish(fd, [&](const char*, size_t, const uint8_t *computed, const struct stat&)
+    {
+        memcpy(hash, computed, OutputHasher::kHashSize);
+        hashed = true;
+    });
+
+    close(fd);
+    return hashed;
+}
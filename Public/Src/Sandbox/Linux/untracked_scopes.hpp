@@ -0,0 +1,173 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+#pragma once
+
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "FileAccessManifestParser.hpp"
+
+/*
+ * The scopes of a pip's manifest in which no access can be denied or reported, i.e., cones that are untracked (all accesses
+ * allowed, none reported explicitly) and contain no node with a different policy.  BxlObserver checks absolute paths against
+ * them lexically, before resolving any symlinks: a path inside one of them is neither canonicalized nor reported.
+ *
+ * A path only matches if none of its components following the scope is "." or ".." (or empty), so it cannot lexically
+ * leave the scope.  Symlinks inside a scope are not followed either, which means that accesses reached through a symlink
+ * pointing out of an untracked scope are not reported (which is why this is opt-in, see UseLexicalUntrackedScopes).
+ *
+ * The scopes are collected once (Build), when the manifest is loaded, into a fixed-size arena; scopes that do not fit
+ * are simply not used.  After that the object is read-only, so Contains is safe to call from any thread.
+ *
+ * IMPORTANT: like ReportCache, instances must have static storage duration (i.e., be zero-initialized).
+ */
+class UntrackedScopes final
+{
+private:
+    static const int kMaxScopes = 128;
+    static const size_t kArenaSize = 16 << 10;
+
+    static const uint32_t kUntrackedPolicy = FileAccessPolicy_AllowAll | FileAccessPolicy_AllowSymlinkCreation;
+
+    // policies that make some accesses reported or denied
+    static const uint32_t kCheckedPolicy = FileAccessPolicy_ReportAccess | FileAccessPolicy_ReportUsnAfterOpen |
+        FileAccessPolicy_ReportDirectoryEnumerationAccess | FileAccessPolicy_OverrideAllowWriteForExistingFiles;
+
+    // offset of every scope in the arena (and its length); scopes are stored without a trailing separator
+    uint32_t offsets_[kMaxScopes];
+    uint32_t lengths_[kMaxScopes];
+    int count_;
+    size_t arenaPos_;
+    char arena_[kArenaSize];
+
+    static inline bool IsUntracked(uint32_t policy)
+    {
+        return (policy & kUntrackedPolicy) == kUntrackedPolicy && (policy & kCheckedPolicy) == 0;
+    }
+
+    // Post-order: returns whether the whole subtree rooted at 'node' (whose full path is 'path') is untracked, in which
+    // case the scopes its descendants added are replaced by the node itself.  A node of a delta tree overlaid on the base
+    // tree rooted at 'baseRoot' also has the children of its base record that it does not have itself (see
+    // ManifestRecord::BaseLinkFlag), which are in the base tree only.
+    bool Collect(PCManifestRecord node, PCManifestRecord baseRoot, char *path, size_t length)
+    {
+        int countBefore = count_;
+        size_t arenaPosBefore = arenaPos_;
+        bool untracked = IsUntracked(node->GetConePolicy()) && IsUntracked(node->GetNodePolicy());
+
+        for (uint32_t i = 0; i < node->GetBucketCount(); i++)
+        {
+            PCManifestRecord child = node->GetChildRecord(i);
+            if (child != nullptr)
+            {
+                untracked &= CollectChild(child, baseRoot, path, length);
+            }
+        }
+
+        PCManifestRecord baseNode = node->GetBaseRecord(baseRoot);
+        for (uint32_t i = 0; baseNode != nullptr && i < baseNode->GetBucketCount(); i++)
+        {
+            PCManifestRecord child = baseNode->GetChildRecord(i), deltaChild;
+            const char *partialPath = child != nullptr ? child->GetPartialPath() : nullptr;
+            if (child != nullptr && (node->GetBucketCount() == 0 || !node->FindChild(partialPath, strlen(partialPath), child->Hash, deltaChild)))
+            {
+                untracked &= CollectChild(child, /* baseRoot */ nullptr, path, length);
+            }
+        }
+
+        path[length] = '\0';
+        if (!untracked)
+        {
+            return false;
+        }
+
+        count_ = countBefore;
+        arenaPos_ = arenaPosBefore;
+        if (count_ < kMaxScopes && arenaPos_ + length <= kArenaSize)
+        {
+            offsets_[count_] = (uint32_t)arenaPos_;
+            lengths_[count_] = (uint32_t)length;
+            memcpy(arena_ + arenaPos_, path, length);
+            arenaPos_ += length;
+            count_++;
+        }
+
+        return true;
+    }
+
+    // Collects the subtree rooted at 'child', a child of the node whose full path is 'path'
+    bool CollectChild(PCManifestRecord child, PCManifestRecord baseRoot, char *path, size_t length)
+    {
+        const char *partialPath = child->GetPartialPath();
+        size_t partialLength = strlen(partialPath);
+        if (length + 1 + partialLength >= PATH_MAX)
+        {
+            return false;
+        }
+
+        path[length] = '/';
+        memcpy(path + length + 1, partialPath, partialLength + 1);
+        return Collect(child, baseRoot, path, length + 1 + partialLength);
+    }
+
+    // Whether 'rest' (what follows a scope and its separator) names something inside the scope without any "." or ".."
+    static bool StaysInside(const char *rest)
+    {
+        for (const char *component = rest; ; )
+        {
+            const char *end = strchrnul(component, '/');
+            size_t length = end - component;
+            if (length == 0 || (component[0] == '.' && (length == 1 || (length == 2 && component[1] == '.'))))
+            {
+                return false;
+            }
+
+            if (*end == '\0')
+            {
+                return true;
+            }
+
+            component = end + 1;
+        }
+    }
+
+public:
+    /**
+     * Collects the untracked scopes of the manifest rooted at 'root' (the Unix root node), overlaid on the base tree rooted
+     * at 'baseRoot' if any.  Nothing is collected when all accesses are reported anyway ('famFlags').  Not thread-safe: must
+     * be called before Contains.
+     */
+    void Build(PCManifestRecord root, FileAccessManifestFlag famFlags, PCManifestRecord baseRoot = nullptr)
+    {
+        count_ = 0;
+        arenaPos_ = 0;
+        if (root == nullptr || CheckReportAllFileAccesses(famFlags))
+        {
+            return;
+        }
+
+        char path[PATH_MAX] = {0};
+        Collect(root, baseRoot, path, 0);
+    }
+
+    /** Whether 'path' (absolute, not canonicalized) lies lexically inside one of the scopes. */
+    bool Contains(const char *path) const
+    {
+        size_t pathLength = count_ > 0 ? strlen(path) : 0;
+        for (int i = 0; i < count_; i++)
+        {
+            uint32_t length = lengths_[i];
+            if (pathLength > length && path[length] == '/' && memcmp(path, arena_ + offsets_[i], length) == 0 && StaysInside(path + length + 1))
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    inline bool IsEmpty() const { return count_ == 0; }
+};
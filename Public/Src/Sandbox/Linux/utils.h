@@ -1,10 +1,11 @@
 // Copyright (c) Microsoft Corporation.
 // Licensed under the MIT License.
 
+// Everything else is compiled with hidden visibility (see Makefile)
 #ifdef __cplusplus
-#define DLL_EXPORT extern "C"
+#define DLL_EXPORT extern "C" __attribute__((visibility("default")))
 #else
-#define DLL_EXPORT
+#define DLL_EXPORT __attribute__((visibility("default")))
 #endif
 
 DLL_EXPORT bool is_null_or_empty(char const *input);
@@ -24,6 +24,7 @@ bool GetDirectory(const char* absolutePath, std::string& directory);
 bool GetClrFilesAbsolutePath(const char* currentExePath, const char* clrFilesPath, std::string& clrFilesAbsolutePath);
 
 // Add all *.dll, *.ni.dll, *.exe, and *.ni.exe files from the specified directory to the tpaList string.
+// The list of a directory is cached (under TMPDIR) until the directory changes, so that launches don't walk it again.
 void AddFilesFromDirectoryToTpaList(const char* directory, std::string& tpaList);
 
 //
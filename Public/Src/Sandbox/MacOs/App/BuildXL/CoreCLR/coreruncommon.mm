@@ -13,11 +13,15 @@
 #include <assert.h>
 #include <dirent.h>
 #include <dlfcn.h>
+#include <fcntl.h>
 #include <limits.h>
+#include <functional>
 #include <set>
 #include <string>
 #include <string.h>
 #include <sys/stat.h>
+#include <utility>
+#include <vector>
 #if defined(__FreeBSD__)
 #include <sys/types.h>
 #include <sys/param.h>
@@ -44,6 +48,13 @@ static const char* serverGcVar = "COMPlus_gcServer";
 // Set to 1 for Globalization Invariant mode to be true. Default is false.
 static const char* globalizationInvariantVar = "CORECLR_GLOBAL_INVARIANT";
 
+// Name of the environment variable controlling the TPA list cache (see AddFilesFromDirectoryToTpaList).
+// If set to 0, the runtime directories are walked on every launch. The cache is on by default.
+static const char* tpaCacheVar = "BUILDXL_HOST_TPA_CACHE";
+
+// Name of the environment variable naming a ReadyToRun composite image to preload (see PreloadReadyToRunComposites).
+static const char* r2rCompositeVar = "BUILDXL_HOST_R2R_COMPOSITE";
+
 #if defined(__linux__)
 #define symlinkEntrypointExecutable "/proc/self/exe"
 #elif !defined(__APPLE__)
@@ -187,7 +198,9 @@ bool GetClrFilesAbsolutePath(const char* currentExePath, const char* clrFilesPat
     return true;
 }
 
-void AddFilesFromDirectoryToTpaList(const char* directory, std::string& tpaList)
+// Walks 'directory' once, collecting the files of each extension in directory order, and appends them to 'tpaList'
+// (all the files of the first extension, then the ones of the second one, etc.)
+static void ScanDirectoryForTpaList(const char* directory, std::string& tpaList)
 {
     const char * const tpaExtensions[] = {
                 ".ni.dll",      // Probe for .ni.dll first so that it's preferred if ni and il coexist in the same dir
@@ -195,6 +208,7 @@ void AddFilesFromDirectoryToTpaList(const char* directory, std::string& tpaList)
                 ".ni.exe",
                 ".exe",
                 };
+    const size_t extCount = sizeof(tpaExtensions) / sizeof(tpaExtensions[0]);
 
     DIR* dir = opendir(directory);
     if (dir == nullptr)
@@ -202,54 +216,24 @@ void AddFilesFromDirectoryToTpaList(const char* directory, std::string& tpaList)
         return;
     }
 
-    std::set<std::string> addedAssemblies;
+    // For each extension, the names (with and without the extension) of the files that have it
+    std::vector<std::pair<std::string, std::string>> filesByExt[extCount];
 
-    // Walk the directory for each extension separately so that we first get files with .ni.dll extension,
-    // then files with .dll extension, etc.
-    for (size_t extIndex = 0; extIndex < sizeof(tpaExtensions) / sizeof(tpaExtensions[0]); extIndex++)
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr)
     {
-        const char* ext = tpaExtensions[extIndex];
-        int extLength = (int) strlen(ext);
-
-        struct dirent* entry;
-
-        // For all entries in the directory
-        while ((entry = readdir(dir)) != nullptr)
+        // We are interested in files only
+        if (entry->d_type != DT_REG && entry->d_type != DT_LNK && entry->d_type != DT_UNKNOWN)
         {
-            // We are interested in files only
-            switch (entry->d_type)
-            {
-            case DT_REG:
-                break;
-
-            // Handle symlinks and file systems that do not support d_type
-            case DT_LNK:
-            case DT_UNKNOWN:
-                {
-                    std::string fullFilename;
-
-                    fullFilename.append(directory);
-                    fullFilename.append("/");
-                    fullFilename.append(entry->d_name);
-
-                    struct stat sb;
-                    if (stat(fullFilename.c_str(), &sb) == -1)
-                    {
-                        continue;
-                    }
-
-                    if (!S_ISREG(sb.st_mode))
-                    {
-                        continue;
-                    }
-                }
-                break;
-
-            default:
-                continue;
-            }
+            continue;
+        }
 
-            std::string filename(entry->d_name);
+        std::string filename(entry->d_name);
+        bool checkedIsFile = entry->d_type == DT_REG;
+        for (size_t extIndex = 0; extIndex < extCount; extIndex++)
+        {
+            const char* ext = tpaExtensions[extIndex];
+            int extLength = (int) strlen(ext);
 
             // Check if the extension matches the one we are looking for
             int extPos = (int) (filename.length() - extLength);
@@ -258,26 +242,228 @@ void AddFilesFromDirectoryToTpaList(const char* directory, std::string& tpaList)
                 continue;
             }
 
-            std::string filenameWithoutExt(filename.substr(0, extPos));
+            // Handle symlinks and file systems that do not support d_type (only stat-ing the candidates)
+            if (!checkedIsFile)
+            {
+                std::string fullFilename(directory);
+                fullFilename.append("/");
+                fullFilename.append(filename);
+
+                struct stat sb;
+                if (stat(fullFilename.c_str(), &sb) == -1 || !S_ISREG(sb.st_mode))
+                {
+                    break;
+                }
+
+                checkedIsFile = true;
+            }
+
+            filesByExt[extIndex].emplace_back(filename, filename.substr(0, extPos));
+        }
+    }
+
+    closedir(dir);
 
+    std::set<std::string> addedAssemblies;
+    for (size_t extIndex = 0; extIndex < extCount; extIndex++)
+    {
+        for (const auto& file : filesByExt[extIndex])
+        {
             // Make sure if we have an assembly with multiple extensions present,
             // we insert only one version of it.
-            if (addedAssemblies.find(filenameWithoutExt) == addedAssemblies.end())
+            if (addedAssemblies.insert(file.second).second)
             {
-                addedAssemblies.insert(filenameWithoutExt);
-
                 tpaList.append(directory);
                 tpaList.append("/");
-                tpaList.append(filename);
+                tpaList.append(file.first);
                 tpaList.append(":");
             }
         }
+    }
+}
+
+#if defined(__APPLE__)
+#define ST_MTIM(sb) (sb).st_mtimespec
+#else
+#define ST_MTIM(sb) (sb).st_mtim
+#endif
 
-        // Rewind the directory stream to be able to iterate over it for the next extension
-        rewinddir(dir);
+// Header of a TPA list cache file: the identity of the directory the list was computed for, followed by the directory path.
+// Adding, removing or renaming a file of the directory changes its mtime (replacing the runtime changes its inode), which
+// invalidates the list.
+static std::string GetTpaCacheHeader(const char* directory, const struct stat& dirStat)
+{
+    char header[128];
+    snprintf(header, sizeof(header), "BXLTPA1 %llu %llu %lld %ld ",
+        (unsigned long long) dirStat.st_dev, (unsigned long long) dirStat.st_ino,
+        (long long) ST_MTIM(dirStat).tv_sec, (long) ST_MTIM(dirStat).tv_nsec);
+
+    std::string result(header);
+    result.append(directory);
+    result.append("\n");
+    return result;
+}
+
+// Path of the file caching the TPA list of 'directory' (per user, under TMPDIR)
+static std::string GetTpaCachePath(const char* directory)
+{
+    const char* tmpDir = getenv("TMPDIR");
+    std::string cachePath(tmpDir != nullptr && tmpDir[0] != '\0' ? tmpDir : "/tmp");
+    if (cachePath.back() != '/')
+    {
+        cachePath.append("/");
     }
 
-    closedir(dir);
+    char name[64];
+    snprintf(name, sizeof(name), "bxl-tpa-%u-%016zx", (unsigned) getuid(), std::hash<std::string>()(directory));
+    cachePath.append(name);
+    return cachePath;
+}
+
+static bool TryReadTpaCache(const std::string& cachePath, const std::string& header, std::string& tpaList)
+{
+    FILE* file = fopen(cachePath.c_str(), "r");
+    if (file == nullptr)
+    {
+        return false;
+    }
+
+    std::string content;
+    char buffer[16 * 1024];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+        content.append(buffer, count);
+    }
+
+    bool succeeded = !ferror(file) && content.compare(0, header.length(), header) == 0;
+    fclose(file);
+
+    if (succeeded)
+    {
+        tpaList.append(content, header.length(), std::string::npos);
+    }
+
+    return succeeded;
+}
+
+// Best effort: a cache that can't be written just means the directory is walked again next time
+static void WriteTpaCache(const std::string& cachePath, const std::string& header, const std::string& list)
+{
+    // Written next to the cache and renamed over it, so that concurrent launches never read a partial list
+    std::string tempPath(cachePath);
+    tempPath.append(".");
+    tempPath.append(std::to_string(getpid()));
+
+    FILE* file = fopen(tempPath.c_str(), "w");
+    if (file == nullptr)
+    {
+        return;
+    }
+
+    bool written = fwrite(header.data(), 1, header.length(), file) == header.length()
+                && fwrite(list.data(), 1, list.length(), file) == list.length();
+    written = fclose(file) == 0 && written;
+
+    if (!written || rename(tempPath.c_str(), cachePath.c_str()) != 0)
+    {
+        unlink(tempPath.c_str());
+    }
+}
+
+void AddFilesFromDirectoryToTpaList(const char* directory, std::string& tpaList)
+{
+    const char* cacheEnabled = getenv(tpaCacheVar);
+    struct stat dirStat;
+    if ((cacheEnabled != nullptr && strcmp(cacheEnabled, "0") == 0) || stat(directory, &dirStat) == -1)
+    {
+        ScanDirectoryForTpaList(directory, tpaList);
+        return;
+    }
+
+    std::string header = GetTpaCacheHeader(directory, dirStat);
+    std::string cachePath = GetTpaCachePath(directory);
+    if (TryReadTpaCache(cachePath, header, tpaList))
+    {
+        return;
+    }
+
+    std::string list;
+    ScanDirectoryForTpaList(directory, list);
+    tpaList.append(list);
+
+    // Only cache a list that was computed for the directory as it still is
+    struct stat dirStatAfterScan;
+    if (stat(directory, &dirStatAfterScan) == 0 && GetTpaCacheHeader(directory, dirStatAfterScan) == header)
+    {
+        WriteTpaCache(cachePath, header, list);
+    }
+}
+
+// Asks the OS to read 'path' ahead (asynchronously), so that the runtime doesn't fault it in page by page
+static void PrefetchFile(const char* path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        return;
+    }
+
+#if defined(__APPLE__)
+    struct stat sb;
+    if (fstat(fd, &sb) == 0)
+    {
+        struct radvisory advisory;
+        advisory.ra_offset = 0;
+        advisory.ra_count = sb.st_size > INT_MAX ? INT_MAX : (int) sb.st_size;
+        fcntl(fd, F_RDADVISE, &advisory);
+    }
+#else
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+#endif
+
+    close(fd);
+}
+
+// ReadyToRun composite images (the precompiled code of several assemblies, shared by all of them) are by far the largest files
+// the runtime maps on startup: the ones of the TPA list, and the one 'r2rCompositeVar' names (which is added to the front of the
+// list when it isn't there yet), are read ahead while the runtime initializes.
+static void PreloadReadyToRunComposites(std::string& tpaList)
+{
+    static const char r2rSuffix[] = ".r2r.dll";
+    const size_t r2rSuffixLength = sizeof(r2rSuffix) - 1;
+
+    const char* composite = getenv(r2rCompositeVar);
+    if (composite != nullptr && composite[0] != '\0')
+    {
+        std::string entry(composite);
+        entry.append(":");
+        if (tpaList.compare(0, entry.length(), entry) != 0 && tpaList.find(":" + entry) == std::string::npos)
+        {
+            tpaList.insert(0, entry);
+        }
+    }
+
+    size_t start = 0;
+    while (start < tpaList.length())
+    {
+        size_t end = tpaList.find(':', start);
+        if (end == std::string::npos)
+        {
+            end = tpaList.length();
+        }
+
+        if (end - start > r2rSuffixLength && tpaList.compare(end - r2rSuffixLength, r2rSuffixLength, r2rSuffix) == 0)
+        {
+            PrefetchFile(tpaList.substr(start, end - start).c_str());
+        }
+        else if (composite != nullptr && tpaList.compare(start, end - start, composite) == 0)
+        {
+            PrefetchFile(composite);
+        }
+
+        start = end + 1;
+    }
 }
 
 const char* GetEnvValueBoolean(const char* envVariable)
@@ -377,6 +563,7 @@ int ExecuteManagedAssembly(
     }
 
     AddFilesFromDirectoryToTpaList(clrFilesAbsolutePath, tpaList);
+    PreloadReadyToRunComposites(tpaList);
 
     void* coreclrLib = dlopen(coreClrDllPath.c_str(), RTLD_NOW | RTLD_LOCAL);
     if (coreclrLib != nullptr)
@@ -6,6 +6,13 @@
 
 #include <EndpointSecurity/EndpointSecurity.h>
 #include <Foundation/Foundation.h>
+#include <mutex>
+#include <pthread.h>
+#include <unordered_map>
+#include <vector>
+
+class ESEventRing;
+class IOEvent;
 
 class ESClient final
 {
@@ -18,12 +25,67 @@ private:
     dispatch_queue_t eventQueue_ = nullptr;
     xpc_connection_t build_host_ = nullptr;
 
+    // The events this client observes, and whether it is currently subscribed to them (see SetSubscribed)
+    std::vector<es_event_type_t> events_;
+    bool subscribed_ = false;
+
+    // Whether allowed AUTH events may be cached by EndpointSecurity (see SetAuthResultCaching), 'caching_lock_' keeps a
+    // cacheable response from being made while the cache is being cleared
+    bool cache_auth_results_ = false;
+    pthread_rwlock_t caching_lock_;
+
+    // The ring events are handed to the build host through (see ESEventRing.hpp), nullptr if it could not be set up
+    static const size_t kEventRingSize = 4 * 1024 * 1024;
+    ESEventRing *ring_ = nullptr;
+    void *ring_memory_ = nullptr;
+    xpc_object_t doorbell_ = nullptr;
+
+    // Only used by the handler of 'client_', which EndpointSecurity calls on a serial queue
+    uint64_t next_event_id_ = 0;
+
+    // The AUTH events put into the ring, retained until the build host sends its decision
+    std::mutex pending_auth_lock_;
+    std::unordered_map<uint64_t, const es_message_t *> pending_auth_;
+
+    // Allows the AUTH event the build host has processed, caching the result if allowed
+    void RespondAllow(const es_message_t *message);
+
+    // Creates the event ring and sends it to the build host, events are sent as XPC messages if this fails
+    void CreateEventRing();
+
+    // Puts an event into the ring, returns false if it has to be sent as an XPC message instead
+    bool TryEnqueue(const es_message_t *message, const IOEvent &event);
+
+    // Applies a decision the build host sent back for an event of the ring
+    void HandleDecision(xpc_object_t decision);
+
 public:
 
     ESClient(dispatch_queue_t event_queue, pid_t host_pid, xpc_endpoint_t endpoint, es_event_type_t *events, uint32_t event_count);
     ~ESClient();
 
     int TearDown(xpc_object_t remote = nullptr, xpc_object_t reply = nullptr);
+
+    /*
+        Replaces the target path prefixes (an XPC array of strings) for which this client receives no events. Target path
+        muting requires macOS 13, on older systems this is a no-op and events keep being filtered by the build host.
+     */
+    bool SetMutedTargetPathPrefixes(xpc_object_t paths);
+
+    /*
+        Sets whether the results of allowed AUTH events may be cached by EndpointSecurity, so that repeating them (e.g. opening
+        the same file from the same executable) is answered by the kernel without a round-trip to this client. As the cache is
+        keyed by executable and file, not by process, the build host only enables it while no pip is active; disabling it
+        clears the cache, so a newly started pip never has its accesses answered from it.
+     */
+    bool SetAuthResultCaching(bool enabled);
+
+    /*
+        Subscribes to (or unsubscribes from) the events of this client. A client is subscribed when created; the build host
+        unsubscribes the clients that only matter to tracked processes while no pip is active, so an idle build agent does
+        not pay for their events.
+     */
+    bool SetSubscribed(bool subscribed);
 };
 
 
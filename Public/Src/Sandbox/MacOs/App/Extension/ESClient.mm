@@ -2,9 +2,11 @@
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
 
 #include <cstdio>
+#include <sys/mman.h>
 
 #include "ESClient.hpp"
 #include "ESConstants.hpp"
+#include "ESEventRing.hpp"
 #include "IOEvent.hpp"
 #include "XPCConstants.hpp"
 
@@ -16,18 +18,24 @@ ESClient::ESClient(dispatch_queue_t event_queue, pid_t host_pid, xpc_endpoint_t
 
     host_pid_ = host_pid;
     eventQueue_ = event_queue;
+    pthread_rwlock_init(&caching_lock_, NULL);
     build_host_ = xpc_connection_create_from_endpoint(endpoint);
 
     xpc_connection_set_event_handler(build_host_, ^(xpc_object_t message)
     {
         xpc_type_t type = xpc_get_type(message);
-        if (type == XPC_TYPE_ERROR)
+        if (type == XPC_TYPE_DICTIONARY)
+        {
+            HandleDecision(message);
+        }
+        else if (type == XPC_TYPE_ERROR)
         {
             // TODO: Implement proper protocol for XPC connection handling
         }
     });
 
     xpc_connection_resume(build_host_);
+    CreateEventRing();
 
     es_new_client_result_t result = es_new_client(&client_, ^(es_client_t *c, const es_message_t *message)
     {
@@ -58,15 +66,18 @@ ESClient::ESClient(dispatch_queue_t event_queue, pid_t host_pid, xpc_endpoint_t
         }
 
         IOEvent event(message);
-        size_t msg_length = IOEvent::max_size();
-        char msg[msg_length];
+        if (TryEnqueue(message, event))
+        {
+            return;
+        }
 
-        omemorystream oms(msg, sizeof(msg));
-        oms << event;
+        size_t msg_length = event.SerializedSize();
+        char msg[msg_length];
+        event.Serialize(msg, msg_length);
 
         xpc_object_t xpc_payload = xpc_dictionary_create(NULL, NULL, 0);
-        xpc_dictionary_set_string(xpc_payload, IOEventKey, msg);
-        xpc_dictionary_set_uint64(xpc_payload, IOEventLengthKey, event.Size());
+        xpc_dictionary_set_data(xpc_payload, IOEventKey, msg, msg_length);
+        xpc_dictionary_set_uint64(xpc_payload, IOEventLengthKey, msg_length);
 
         xpc_connection_send_message_with_reply(build_host_, xpc_payload, eventQueue_, ^(xpc_object_t response)
         {
@@ -84,18 +95,7 @@ ESClient::ESClient(dispatch_queue_t event_queue, pid_t host_pid, xpc_endpoint_t
                     break;
                 case xpc_response_auth:
                 {
-                    if (client_)
-                    {
-                        switch(message->event_type)
-                        {
-                            case ES_EVENT_TYPE_AUTH_OPEN:
-                                es_respond_flags_result(client_,message, 0x7fffffff, false);
-                                break;
-                            default:
-                                es_respond_auth_result(client_, message, ES_AUTH_RESULT_ALLOW, false);
-                                break;
-                        }
-                    }
+                    if (client_) RespondAllow(message);
                     break;
                 }
                 case xpc_response_error:
@@ -125,8 +125,8 @@ ESClient::ESClient(dispatch_queue_t event_queue, pid_t host_pid, xpc_endpoint_t
         exit(EXIT_FAILURE);
     }
 
-    es_return_t subscribe_result = es_subscribe(client_, (es_event_type_t *)events, event_count);
-    if (subscribe_result != ES_RETURN_SUCCESS)
+    events_.assign(events, events + event_count);
+    if (!SetSubscribed(true))
     {
         exit(EXIT_FAILURE);
     }
@@ -134,6 +134,151 @@ ESClient::ESClient(dispatch_queue_t event_queue, pid_t host_pid, xpc_endpoint_t
     log_debug("Successfully initialized an EndpointSecurity client, tracking: %d event(s).", event_count);
 }
 
+void ESClient::RespondAllow(const es_message_t *message)
+{
+    pthread_rwlock_rdlock(&caching_lock_);
+    bool cache = cache_auth_results_;
+
+    switch(message->event_type)
+    {
+        case ES_EVENT_TYPE_AUTH_OPEN:
+            es_respond_flags_result(client_,message, 0x7fffffff, cache);
+            break;
+        default:
+            es_respond_auth_result(client_, message, ES_AUTH_RESULT_ALLOW, cache);
+            break;
+    }
+
+    pthread_rwlock_unlock(&caching_lock_);
+}
+
+void ESClient::CreateEventRing()
+{
+    ring_memory_ = mmap(NULL, kEventRingSize, PROT_READ | PROT_WRITE, MAP_ANON | MAP_SHARED, -1, 0);
+    if (ring_memory_ == MAP_FAILED)
+    {
+        log_error("Could not allocate the EndpointSecurity event ring, error: %d", errno);
+        ring_memory_ = nullptr;
+        return;
+    }
+
+    xpc_object_t shmem = xpc_shmem_create(ring_memory_, kEventRingSize);
+    if (shmem == nullptr)
+    {
+        log_error("%s", "Could not share the EndpointSecurity event ring with the build host");
+        munmap(ring_memory_, kEventRingSize);
+        ring_memory_ = nullptr;
+        return;
+    }
+
+    ring_ = ESEventRing::Initialize(ring_memory_, kEventRingSize);
+
+    doorbell_ = xpc_dictionary_create(NULL, NULL, 0);
+    xpc_dictionary_set_bool(doorbell_, ESEventRingDoorbellKey, true);
+
+    // Sent before any event: messages of a connection are delivered in order
+    xpc_object_t post = xpc_dictionary_create(NULL, NULL, 0);
+    xpc_dictionary_set_value(post, ESEventRingKey, shmem);
+    xpc_connection_send_message(build_host_, post);
+    xpc_release(post);
+    xpc_release(shmem);
+}
+
+bool ESClient::TryEnqueue(const es_message_t *message, const IOEvent &event)
+{
+    if (ring_ == nullptr)
+    {
+        return false;
+    }
+
+    uint64_t id = ++next_event_id_;
+    bool auth = message->action_type == ES_ACTION_TYPE_AUTH;
+    if (auth)
+    {
+        // An AUTH event is answered once the build host sends its decision, long after this handler returned
+        if (@available(macOS 11.0, *))
+        {
+            es_retain_message(message);
+            std::lock_guard<std::mutex> lock(pending_auth_lock_);
+            pending_auth_[id] = message;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    bool ringDoorbell = false;
+    if (!ring_->TryEnqueue(event, id, auth ? kESEventRecordAuth : 0, event.GetProcessAuditToken(), ringDoorbell))
+    {
+        if (auth)
+        {
+            if (@available(macOS 11.0, *))
+            {
+                std::lock_guard<std::mutex> lock(pending_auth_lock_);
+                pending_auth_.erase(id);
+                es_release_message(message);
+            }
+        }
+
+        return false;
+    }
+
+    if (ringDoorbell)
+    {
+        xpc_connection_send_message(build_host_, doorbell_);
+    }
+
+    return true;
+}
+
+void ESClient::HandleDecision(xpc_object_t decision)
+{
+    uint64_t id = xpc_dictionary_get_uint64(decision, ESEventDecisionIdKey);
+    uint64_t status = xpc_dictionary_get_uint64(decision, "response");
+
+    size_t audit_token_length = 0;
+    const audit_token_t *audit_token = (const audit_token_t *) xpc_dictionary_get_data(decision, ESEventDecisionAuditTokenKey, &audit_token_length);
+
+    const es_message_t *message = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(pending_auth_lock_);
+        auto it = pending_auth_.find(id);
+        if (it != pending_auth_.end())
+        {
+            message = it->second;
+            pending_auth_.erase(it);
+        }
+    }
+
+    switch (status)
+    {
+        case xpc_response_mute_process:
+            if (client_ && audit_token != nullptr && audit_token_length == sizeof(audit_token_t)) es_mute_process(client_, audit_token);
+            break;
+        case xpc_response_auth:
+        {
+            if (client_ && message != nullptr) RespondAllow(message);
+            break;
+        }
+        case xpc_response_error:
+        case xpc_response_failure:
+        {
+            log_error("%s", "XPC event processing error - sandboxing is no longer reliable!\n");
+            exit(EXIT_FAILURE);
+            break;
+        }
+    }
+
+    if (message != nullptr)
+    {
+        if (@available(macOS 11.0, *))
+        {
+            es_release_message(message);
+        }
+    }
+}
+
 int ESClient::TearDown(xpc_object_t remote, xpc_object_t reply)
 {
     if (client_ != nullptr)
@@ -153,6 +298,19 @@ int ESClient::TearDown(xpc_object_t remote, xpc_object_t reply)
         }
 
         client_ = nullptr;
+        subscribed_ = false;
+
+        // No decision can be applied anymore
+        if (@available(macOS 11.0, *))
+        {
+            std::lock_guard<std::mutex> lock(pending_auth_lock_);
+            for (auto &pending : pending_auth_)
+            {
+                es_release_message(pending.second);
+            }
+
+            pending_auth_.clear();
+        }
 
         if (remote && reply)
         {
@@ -169,10 +327,113 @@ int ESClient::TearDown(xpc_object_t remote, xpc_object_t reply)
     return ES_RETURN_SUCCESS;
 }
 
+bool ESClient::SetMutedTargetPathPrefixes(xpc_object_t paths)
+{
+    if (client_ == nullptr)
+    {
+        return false;
+    }
+
+    if (@available(macOS 13.0, *))
+    {
+        if (es_unmute_all_target_paths(client_) != ES_RETURN_SUCCESS)
+        {
+            log_error("%s", "Failed unmuting EndpointSecurity target paths!\n");
+            return false;
+        }
+
+        __block bool success = true;
+        xpc_array_apply(paths, ^bool(size_t index, xpc_object_t value)
+        {
+            const char *path = xpc_string_get_string_ptr(value);
+            if (path != nullptr && es_mute_path(client_, path, ES_MUTE_PATH_TYPE_TARGET_PREFIX) != ES_RETURN_SUCCESS)
+            {
+                log_error("Failed muting EndpointSecurity target path prefix: %{public}s\n", path);
+                success = false;
+            }
+
+            return true;
+        });
+
+        log_debug("Muted %zu EndpointSecurity target path prefix(es).", xpc_array_get_count(paths));
+        return success;
+    }
+
+    return true;
+}
+
+bool ESClient::SetAuthResultCaching(bool enabled)
+{
+    if (client_ == nullptr)
+    {
+        return false;
+    }
+
+    pthread_rwlock_wrlock(&caching_lock_);
+
+    bool success = true;
+    cache_auth_results_ = enabled;
+    if (!enabled && es_clear_cache(client_) != ES_CLEAR_CACHE_RESULT_SUCCESS)
+    {
+        log_error("%s", "Failed clearing the EndpointSecurity cache!\n");
+        success = false;
+    }
+
+    pthread_rwlock_unlock(&caching_lock_);
+
+    log_debug("EndpointSecurity auth result caching: %d", enabled);
+    return success;
+}
+
+bool ESClient::SetSubscribed(bool subscribed)
+{
+    if (client_ == nullptr)
+    {
+        return false;
+    }
+
+    if (subscribed == subscribed_)
+    {
+        return true;
+    }
+
+    es_return_t result = subscribed
+        ? es_subscribe(client_, events_.data(), (uint32_t)events_.size())
+        : es_unsubscribe(client_, events_.data(), (uint32_t)events_.size());
+
+    if (result != ES_RETURN_SUCCESS)
+    {
+        log_error("Failed %{public}s EndpointSecurity events!\n", subscribed ? "subscribing to" : "unsubscribing from");
+        return false;
+    }
+
+    subscribed_ = subscribed;
+    log_debug("EndpointSecurity client %{public}s %zu event(s).", subscribed ? "subscribed to" : "unsubscribed from", events_.size());
+    return true;
+}
+
 ESClient::~ESClient()
 {
     if (ES_RETURN_SUCCESS == TearDown())
     {
         log_debug("%s", "Successfully cleaned-up EndpointSecurity client.");
     }
+
+    pthread_rwlock_destroy(&caching_lock_);
+
+    // The build host keeps its own mapping of the ring
+    delete ring_;
+    ring_ = nullptr;
+
+    if (ring_memory_ != nullptr)
+    {
+        munmap(ring_memory_, kEventRingSize);
+        ring_memory_ = nullptr;
+    }
+
+    if (doorbell_ != nullptr)
+    {
+        xpc_release(doorbell_);
+        doorbell_ = nullptr;
+    }
 }
@@ -30,6 +30,13 @@ static os_log_t logger = os_log_create("com.microsoft.buildxl.sandbox", "Logger"
 
  */
 
+/*
+
+ The lifetime and exit clients are always subscribed. The write, read, probe and lookup clients only report accesses of tracked
+ processes, so the build host only keeps them subscribed while a pip is active (see ESClient::SetSubscribed).
+
+ */
+
 const es_event_type_t es_lifetime_events_[] =
 {
     ES_EVENT_TYPE_AUTH_EXEC,
@@ -19,6 +19,9 @@ enum XPCCommands : unsigned int
     xpc_get_es_connection,
     xpc_set_es_connection,
     xpc_kill_es_connection,
+    xpc_set_es_muted_paths,
+    xpc_set_es_auth_caching,
+    xpc_set_es_io_subscriptions,
 };
 
 #endif /* XPCConstants_h */
@@ -30,6 +30,15 @@ ESClient *lookup_client = nullptr;
 #define TEAR_DOWN(client) \
     if (client != nullptr) client->TearDown(peer, reply);
 
+#define MUTE_TARGET_PATHS(client, paths, success) \
+    if (client != nullptr) success &= client->SetMutedTargetPathPrefixes(paths);
+
+#define SET_AUTH_CACHING(client, enabled, success) \
+    if (client != nullptr) success &= client->SetAuthResultCaching(enabled);
+
+#define SET_SUBSCRIBED(client, subscribed, success) \
+    if (client != nullptr) success &= client->SetSubscribed(subscribed);
+
 int main(void)
 {
     // One consumer queue per event bucket and client
@@ -121,6 +130,62 @@ int main(void)
                                 }
                                 break;
                             }
+                            case xpc_set_es_muted_paths:
+                            {
+                                // Only the read, probe and lookup clients mute untracked scopes: process lifetime events must
+                                // always be observed and writes (e.g. renames) may have a destination outside of the muted scope
+                                xpc_object_t paths = xpc_dictionary_get_value(message, "paths");
+                                bool success = paths != nullptr && xpc_get_type(paths) == XPC_TYPE_ARRAY;
+
+                                if (success)
+                                {
+                                    MUTE_TARGET_PATHS(read_client, paths, success)
+                                    MUTE_TARGET_PATHS(probe_client, paths, success)
+                                    MUTE_TARGET_PATHS(lookup_client, paths, success)
+                                }
+
+                                xpc_object_t reply = xpc_dictionary_create_reply(message);
+                                xpc_dictionary_set_uint64(reply, "response", success ? xpc_response_success : xpc_response_failure);
+                                xpc_connection_send_message(peer, reply);
+
+                                break;
+                            }
+                            case xpc_set_es_auth_caching:
+                            {
+                                // Every client subscribes to some AUTH events, all of them have to stop caching before a pip starts
+                                bool enabled = xpc_dictionary_get_bool(message, "enabled");
+                                bool success = true;
+
+                                SET_AUTH_CACHING(lifetime_client, enabled, success)
+                                SET_AUTH_CACHING(exit_client, enabled, success)
+                                SET_AUTH_CACHING(write_client, enabled, success)
+                                SET_AUTH_CACHING(read_client, enabled, success)
+                                SET_AUTH_CACHING(probe_client, enabled, success)
+                                SET_AUTH_CACHING(lookup_client, enabled, success)
+
+                                xpc_object_t reply = xpc_dictionary_create_reply(message);
+                                xpc_dictionary_set_uint64(reply, "response", success ? xpc_response_success : xpc_response_failure);
+                                xpc_connection_send_message(peer, reply);
+
+                                break;
+                            }
+                            case xpc_set_es_io_subscriptions:
+                            {
+                                // Process lifetime events must always be observed, the accesses only matter while a pip is active
+                                bool subscribed = xpc_dictionary_get_bool(message, "subscribed");
+                                bool success = true;
+
+                                SET_SUBSCRIBED(write_client, subscribed, success)
+                                SET_SUBSCRIBED(read_client, subscribed, success)
+                                SET_SUBSCRIBED(probe_client, subscribed, success)
+                                SET_SUBSCRIBED(lookup_client, subscribed, success)
+
+                                xpc_object_t reply = xpc_dictionary_create_reply(message);
+                                xpc_dictionary_set_uint64(reply, "response", success ? xpc_response_success : xpc_response_failure);
+                                xpc_connection_send_message(peer, reply);
+
+                                break;
+                            }
                         }
                     }
                 }
@@ -2,20 +2,242 @@
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
 
 #include "Detours.hpp"
-#include "MemoryStreams.hpp"
+#include "BackendSelector.hpp"
 #include "PathCacheEntry.hpp"
+#include "report_cache.hpp"
 #include "Trie.hpp"
 #include "XPCConstants.hpp"
 
+#include <set>
+
 #pragma mark Static state
 
 static std::once_flag InitializeOpenPathCache;
 static std::once_flag InitializeWritePathCache;
-static std::once_flag InitializeXPC;
+static std::once_flag InitializeExecutablePath;
+static std::once_flag InitializeEndpointSecurityOnlyExecutables;
 
 static xpc_connection_t bxl_connection = nullptr;
+// The process that set up 'bxl_connection': a forked child inherits the connection of its parent but can't use it
+static std::atomic<pid_t> bxl_connection_pid(0);
+static os_unfair_lock bxl_connection_lock = OS_UNFAIR_LOCK_INIT;
+static dispatch_queue_t bxl_reply_queue = nullptr;
 static thread_local bool bxl_realpath_execution = false;
 
+#pragma mark Event Batching
+
+// Reports of ordinary file accesses are only needed by BuildXL, not by the interposed call itself, so they are accumulated
+// in a per-thread batch and sent as a single message whose acknowledgement is handled asynchronously.  A batch is sent once
+// it is full or old, when its thread exits, and before any process tree event (fork / exec / exit), which is still sent
+// synchronously so that the sandbox has seen everything reported before it by the time the interposed call proceeds.
+//
+// Setting BUILDXL_DETOURS_SYNC_REPORTING in the environment turns batching off (every event is then sent synchronously).
+
+#define kEventBatchCapacity     (16 * 1024)
+#define kEventBatchMaxEvents    64
+#define kEventBatchMaxDelayNs   (10 * NSEC_PER_MSEC)
+
+struct EventBatch
+{
+    os_unfair_lock lock;
+    uint32_t count;
+    size_t length;
+    uint64_t firstEventTime;
+    EventBatch *next;
+    char data[kEventBatchCapacity];
+};
+
+// All the batches, so that they can be sent before the process exits
+static os_unfair_lock bxl_batches_lock = OS_UNFAIR_LOCK_INIT;
+static EventBatch *bxl_batches = nullptr;
+
+static const bool bxl_batching_enabled = getenv("BUILDXL_DETOURS_SYNC_REPORTING") == nullptr;
+
+// Set while the current thread holds the lock of its batch, so that events reported meanwhile (e.g., by interposed calls
+// made by XPC itself) are sent synchronously instead of deadlocking on that lock
+static thread_local bool bxl_batch_locked = false;
+
+static void send_batch(EventBatch *batch)
+{
+    if (batch->count == 0)
+    {
+        return;
+    }
+
+    xpc_object_t xpc_payload = xpc_dictionary_create(NULL, NULL, 0);
+    xpc_dictionary_set_data(xpc_payload, IOEventBatchKey, batch->data, batch->length);
+    xpc_dictionary_set_uint64(xpc_payload, IOEventBatchCountKey, batch->count);
+
+    xpc_connection_send_message_with_reply(bxl_connection, xpc_payload, bxl_reply_queue, ^(xpc_object_t response)
+    {
+        uint64_t status = xpc_response_error;
+        if (xpc_get_type(response) == XPC_TYPE_DICTIONARY)
+        {
+            status = xpc_dictionary_get_uint64(response, "response");
+        }
+
+        if (status != xpc_response_success)
+        {
+            log_debug("Sending a batch of events to XPC bridge service failed, aborting because conistent sandboxing can't be guaranteed - status(%lld)", status);
+            abort();
+        }
+    });
+
+    xpc_release(xpc_payload);
+    batch->count = 0;
+    batch->length = 0;
+}
+
+static void lock_batch(EventBatch *batch)
+{
+    os_unfair_lock_lock(&batch->lock);
+    bxl_batch_locked = true;
+}
+
+static void unlock_batch(EventBatch *batch)
+{
+    bxl_batch_locked = false;
+    os_unfair_lock_unlock(&batch->lock);
+}
+
+static void flush_batch(EventBatch *batch)
+{
+    lock_batch(batch);
+    send_batch(batch);
+    unlock_batch(batch);
+}
+
+static void flush_all_batches()
+{
+    if (bxl_batch_locked)
+    {
+        return;
+    }
+
+    os_unfair_lock_lock(&bxl_batches_lock);
+    for (EventBatch *batch = bxl_batches; batch != nullptr; batch = batch->next)
+    {
+        flush_batch(batch);
+    }
+    os_unfair_lock_unlock(&bxl_batches_lock);
+}
+
+struct ThreadEventBatch final
+{
+    EventBatch *batch = nullptr;
+
+    EventBatch* get()
+    {
+        if (batch == nullptr)
+        {
+            batch = (EventBatch *) calloc(1, sizeof(EventBatch));
+            if (batch != nullptr)
+            {
+                batch->lock = OS_UNFAIR_LOCK_INIT;
+                os_unfair_lock_lock(&bxl_batches_lock);
+                batch->next = bxl_batches;
+                bxl_batches = batch;
+                os_unfair_lock_unlock(&bxl_batches_lock);
+            }
+        }
+
+        return batch;
+    }
+
+    ~ThreadEventBatch()
+    {
+        if (batch == nullptr)
+        {
+            return;
+        }
+
+        os_unfair_lock_lock(&bxl_batches_lock);
+        for (EventBatch **link = &bxl_batches; *link != nullptr; link = &(*link)->next)
+        {
+            if (*link == batch)
+            {
+                *link = batch->next;
+                break;
+            }
+        }
+        os_unfair_lock_unlock(&bxl_batches_lock);
+
+        flush_batch(batch);
+        free(batch);
+        batch = nullptr;
+    }
+};
+
+static thread_local ThreadEventBatch bxl_thread_batch;
+
+// Appends the (already resolved) event to the batch of the current thread; returns false if the event has to be sent on its own
+static bool add_to_batch(const IOEventView &event)
+{
+    size_t size = event.SerializedSize();
+    if (bxl_batch_locked || sizeof(uint32_t) + size > kEventBatchCapacity)
+    {
+        return false;
+    }
+
+    EventBatch *batch = bxl_thread_batch.get();
+    if (batch == nullptr)
+    {
+        return false;
+    }
+
+    lock_batch(batch);
+
+    if (batch->length + sizeof(uint32_t) + size > kEventBatchCapacity)
+    {
+        send_batch(batch);
+    }
+
+    uint32_t length = (uint32_t) size;
+    memcpy(batch->data + batch->length, &length, sizeof(length));
+    event.Serialize(batch->data + batch->length + sizeof(length), size);
+    batch->length += sizeof(length) + size;
+
+    uint64_t now = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+    if (batch->count++ == 0)
+    {
+        batch->firstEventTime = now;
+    }
+
+    if (batch->count >= kEventBatchMaxEvents || now - batch->firstEventTime >= kEventBatchMaxDelayNs)
+    {
+        send_batch(batch);
+    }
+
+    unlock_batch(batch);
+    return true;
+}
+
+// Sends the pending events of the current thread; called before forking so that the child doesn't inherit them
+static void flush_thread_batch()
+{
+    if (bxl_thread_batch.batch != nullptr && !bxl_batch_locked)
+    {
+        flush_batch(bxl_thread_batch.batch);
+    }
+}
+
+// In a forked child only the forking thread exists: forget all other batches (their locks may have been held at the time of fork)
+static void reset_batches_in_child()
+{
+    bxl_batches_lock = OS_UNFAIR_LOCK_INIT;
+    bxl_batches = nullptr;
+
+    EventBatch *batch = bxl_thread_batch.batch;
+    if (batch != nullptr)
+    {
+        batch->lock = OS_UNFAIR_LOCK_INIT;
+        batch->count = 0;
+        batch->length = 0;
+        batch->next = nullptr;
+        bxl_batches = batch;
+    }
+}
+
 #pragma mark Utility Functions
 
 char *bxl_realpath(const char* file_name, char* buffer)
@@ -26,6 +248,161 @@ char *bxl_realpath(const char* file_name, char* buffer)
     return result;
 }
 
+#pragma mark Path Resolution Cache
+
+// Resolving a path with realpath costs a lookup (and a readlink for every symlink) per path component, for every reported
+// event.  Instead, the directory of an absolute path is resolved once and cached, so that resolving the path itself only takes
+// an lstat of its last component (to find out whether that is a symlink, in which case it's left to realpath).  The cache is a
+// small direct-mapped table keyed by the directory as it appears in the path, compared exactly since volumes may be
+// case-sensitive.  It is invalidated as a whole (by bumping its generation) by interposed calls that may change how directories
+// resolve: rename, unlink, and symlink.
+//
+// Setting BUILDXL_DETOURS_NO_REALPATH_CACHE in the environment turns the cache off (every path is then resolved with realpath).
+
+#define kResolvedDirectoryCacheSize 128
+
+struct ResolvedDirectory
+{
+    os_unfair_lock lock;
+    uint64_t generation;
+    size_t directoryLength;
+    size_t resolvedLength;
+    char directory[PATH_MAX];
+    char resolved[PATH_MAX];
+};
+
+// Zero initialized: unlocked slots of generation 0, which never matches since the current generation starts at 1
+static ResolvedDirectory bxl_resolved_directories[kResolvedDirectoryCacheSize];
+static std::atomic<uint64_t> bxl_resolved_directories_generation(1);
+
+static const bool bxl_realpath_cache_enabled = getenv("BUILDXL_DETOURS_NO_REALPATH_CACHE") == nullptr;
+
+static inline ResolvedDirectory* get_resolved_directory_slot(const char *directory, size_t length)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++)
+    {
+        hash = (hash ^ (unsigned char) directory[i]) * 16777619u;
+    }
+
+    return &bxl_resolved_directories[hash % kResolvedDirectoryCacheSize];
+}
+
+static bool lookup_resolved_directory(const char *directory, size_t length, char *resolved, size_t *resolved_length)
+{
+    ResolvedDirectory *slot = get_resolved_directory_slot(directory, length);
+    uint64_t generation = bxl_resolved_directories_generation.load(std::memory_order_acquire);
+
+    os_unfair_lock_lock(&slot->lock);
+    bool found = slot->generation == generation && slot->directoryLength == length && memcmp(slot->directory, directory, length) == 0;
+    if (found)
+    {
+        memcpy(resolved, slot->resolved, slot->resolvedLength + 1);
+        *resolved_length = slot->resolvedLength;
+    }
+    os_unfair_lock_unlock(&slot->lock);
+
+    return found;
+}
+
+// 'generation' must be read before 'directory' got resolved, so that a resolution racing with an invalidation is never cached
+static void store_resolved_directory(const char *directory, size_t length, const char *resolved, size_t resolved_length, uint64_t generation)
+{
+    ResolvedDirectory *slot = get_resolved_directory_slot(directory, length);
+
+    os_unfair_lock_lock(&slot->lock);
+    slot->generation = generation;
+    slot->directoryLength = length;
+    slot->resolvedLength = resolved_length;
+    memcpy(slot->directory, directory, length);
+    memcpy(slot->resolved, resolved, resolved_length + 1);
+    os_unfair_lock_unlock(&slot->lock);
+}
+
+static inline void invalidate_resolved_directories()
+{
+    bxl_resolved_directories_generation.fetch_add(1, std::memory_order_release);
+}
+
+// In a forked child only the forking thread exists: the locks of the slots may have been held at the time of fork
+static void reset_resolved_directories_in_child()
+{
+    for (size_t i = 0; i < kResolvedDirectoryCacheSize; i++)
+    {
+        bxl_resolved_directories[i].lock = OS_UNFAIR_LOCK_INIT;
+    }
+
+    invalidate_resolved_directories();
+}
+
+// Resolves 'path' into 'buffer' (of at least PATH_MAX bytes) with the same outcome as 'bxl_realpath', including for paths whose
+// last component doesn't exist (the resolved directory followed by that component).  Returns true when the mode of 'path' (as
+// stat would report it, 0 if it doesn't exist) was found out along the way and stored in 'mode'.
+static bool resolve_path(const char *path, char *buffer, mode_t *mode)
+{
+    const char *last = strrchr(path, '/');
+    if (!bxl_realpath_cache_enabled || path[0] != '/' || last == nullptr)
+    {
+        bxl_realpath(path, buffer);
+        return false;
+    }
+
+    last++;
+    size_t last_length = strlen(last);
+    size_t directory_length = last - path - 1;
+    if (directory_length == 0)
+    {
+        directory_length = 1;
+    }
+
+    if (last_length == 0 || strcmp(last, ".") == 0 || strcmp(last, "..") == 0 || directory_length >= PATH_MAX)
+    {
+        bxl_realpath(path, buffer);
+        return false;
+    }
+
+    char resolved_directory[PATH_MAX] = { '\0' };
+    size_t resolved_length = 0;
+    if (!lookup_resolved_directory(path, directory_length, resolved_directory, &resolved_length))
+    {
+        uint64_t generation = bxl_resolved_directories_generation.load(std::memory_order_acquire);
+
+        char directory[PATH_MAX] = { '\0' };
+        memcpy(directory, path, directory_length);
+        if (bxl_realpath(directory, resolved_directory) == nullptr)
+        {
+            bxl_realpath(path, buffer);
+            return false;
+        }
+
+        resolved_length = strlen(resolved_directory);
+        store_resolved_directory(directory, directory_length, resolved_directory, resolved_length, generation);
+    }
+
+    struct stat sb;
+    bool exists = lstat(path, &sb) == 0;
+    bool leave_to_realpath = exists ? S_ISLNK(sb.st_mode) : errno != ENOENT;
+
+    size_t separator_length = resolved_length == 1 ? 0 : 1;
+    if (leave_to_realpath || resolved_length + separator_length + last_length >= PATH_MAX)
+    {
+        bxl_realpath(path, buffer);
+        return false;
+    }
+
+    memcpy(buffer, resolved_directory, resolved_length);
+    if (separator_length > 0)
+    {
+        buffer[resolved_length] = '/';
+    }
+    memcpy(buffer + resolved_length + separator_length, last, last_length + 1);
+
+    // The last component is not a symlink, so its lstat is what stat would have reported
+    *mode = exists ? sb.st_mode : 0;
+    return true;
+}
+
 int setup_xpc()
 {
     char queue_name[PATH_MAX] = { '\0' };
@@ -34,6 +411,7 @@ int setup_xpc()
      dispatch_queue_t xpc_queue = dispatch_queue_create(queue_name, dispatch_queue_attr_make_with_qos_class(
         DISPATCH_QUEUE_SERIAL, QOS_CLASS_USER_INTERACTIVE, -1
     ));
+    bxl_reply_queue = xpc_queue;
 
     xpc_connection_t xpc_connection = xpc_connection_create_mach_service("com.microsoft.buildxl.sandbox", NULL, 0);
     xpc_connection_set_event_handler(xpc_connection, ^(xpc_object_t message)
@@ -91,44 +469,132 @@ inline void handle_xpc_setup()
     }
 }
 
-inline void send_to_sandbox(IOEvent &event, es_event_type_t type = ES_EVENT_TYPE_LAST, bool force_xpc_init = false, bool resolve_paths = true)
+// Sets up the connection to the sandbox unless this process already did: every image (i.e., once per exec) and every forked child
+// has to go through the handshake once, but a process that execs again, or reports the exec of a path that then fails, reuses its own
+static void ensure_xpc_connection()
 {
-    if (event.IsPlistEvent() || event.IsDirectorySpecialCharacterEvent())
+    pid_t pid = getpid();
+    if (bxl_connection_pid.load(std::memory_order_acquire) == pid)
     {
         return;
     }
 
-    std::call_once(InitializeXPC, []()
+    os_unfair_lock_lock(&bxl_connection_lock);
+    if (bxl_connection_pid.load(std::memory_order_relaxed) != pid)
     {
         handle_xpc_setup();
-    });
+        bxl_connection_pid.store(pid, std::memory_order_release);
+    }
+    os_unfair_lock_unlock(&bxl_connection_lock);
+}
+
+// In a forked child only the forking thread exists: the connection lock may have been held at the time of fork
+static void reset_xpc_connection_lock_in_child()
+{
+    bxl_connection_lock = OS_UNFAIR_LOCK_INIT;
+}
+
+#pragma mark Report Cache
 
-    // Some interposed syscalls invalidate XPC sessions, re-initialize when required
-    if (force_xpc_init)
+// Tools tend to access the same paths over and over (e.g., stat-ing the same files), and every report costs a serialization and
+// a message to the sandbox, which would only find out that the access had been reported already.  Reports that this process has
+// sent before (once resolved: same event type, path, mode and modification flag) are therefore dropped before they are sent; the
+// cache is the lock-free one of the Linux sandbox (see report_cache.hpp), cleared in forked children, whose reports carry their
+// own pid.  Process tree events and events with a destination path are always sent.
+//
+// Setting BUILDXL_DETOURS_NO_REPORT_CACHE in the environment turns the cache off (every event is then sent).
+
+static ReportCache bxl_report_cache;
+static const bool bxl_report_cache_enabled = getenv("BUILDXL_DETOURS_NO_REPORT_CACHE") == nullptr;
+
+static_assert(ES_EVENT_TYPE_LAST < (1 << 15), "Event types must fit in the low bits of a report cache kind");
+
+static bool is_reported_already(const IOEventView &event)
+{
+    if (!bxl_report_cache_enabled || event.GetEventPath(DST_PATH)[0] != '\0')
     {
-        handle_xpc_setup();
+        return false;
+    }
+
+    // the mode only keeps its file type bits, which is what a probe reports
+    uint32_t kind = ((uint32_t)(event.GetMode() & S_IFMT) << 16) | ((event.FSEntryModified() ? 1u : 0u) << 15) | (uint32_t)event.GetEventType();
+    const char *path = event.GetEventPath(SRC_PATH);
+    return bxl_report_cache.CheckAndAdd(0, kind, path, strlen(path));
+}
+
+// In a forked child only the forking thread exists, which is the only time the cache can be cleared
+static void reset_report_cache_in_child()
+{
+    bxl_report_cache.Clear();
+}
+
+inline void send_to_sandbox(IOEventView &event, es_event_type_t type = ES_EVENT_TYPE_LAST, bool resolve_paths = true)
+{
+    if (event.IsPlistEvent() || event.IsDirectorySpecialCharacterEvent())
+    {
+        return;
     }
 
+    ensure_xpc_connection();
+
+    // The event borrows these buffers once its paths are resolved, they must live until it's serialized
+    char src_resolved[PATH_MAX + 1];
+    char dst_resolved[PATH_MAX + 1];
+    src_resolved[0] = dst_resolved[0] = '\0';
+
     if (resolve_paths)
     {
-        char src_resolved[PATH_MAX + 1] = { '\0' };
-        bxl_realpath(event.GetEventPath(SRC_PATH), src_resolved);
+        mode_t mode = 0;
+        if (resolve_path(event.GetEventPath(SRC_PATH), src_resolved, &mode))
+        {
+            event.SupplyMode(mode);
+        }
         event.SetEventPath(src_resolved, SRC_PATH);
 
-        char dst_resolved[PATH_MAX + 1] = { '\0' };
-        bxl_realpath(event.GetEventPath(DST_PATH), dst_resolved);
-        event.SetEventPath(dst_resolved, DST_PATH);
+        // Most events have no destination path, and an empty path resolves to an empty path
+        if (event.GetEventPath(DST_PATH)[0] != '\0')
+        {
+            resolve_path(event.GetEventPath(DST_PATH), dst_resolved, &mode);
+            event.SetEventPath(dst_resolved, DST_PATH);
+        }
     }
 
-    size_t msg_length = IOEvent::max_size();
-    char msg[msg_length];
+    es_event_type_t event_type = event.GetEventType();
+    bool is_process_tree_event =
+        event_type == ES_EVENT_TYPE_NOTIFY_FORK ||
+        event_type == ES_EVENT_TYPE_NOTIFY_EXEC ||
+        event_type == ES_EVENT_TYPE_NOTIFY_EXIT;
+
+    if (!is_process_tree_event && is_reported_already(event))
+    {
+        return;
+    }
+
+    if (bxl_batching_enabled)
+    {
+        if (!is_process_tree_event && add_to_batch(event))
+        {
+            return;
+        }
+
+        // everything reported so far must reach the sandbox before this event (and exec / exit take all other threads down)
+        if (event_type != ES_EVENT_TYPE_NOTIFY_FORK)
+        {
+            flush_all_batches();
+        }
+        else
+        {
+            flush_thread_batch();
+        }
+    }
 
-    omemorystream oms(msg, sizeof(msg));
-    oms << event;
+    size_t msg_length = event.SerializedSize();
+    char msg[msg_length];
+    event.Serialize(msg, msg_length);
 
     xpc_object_t xpc_payload = xpc_dictionary_create(NULL, NULL, 0);
-    xpc_dictionary_set_string(xpc_payload, IOEventKey, msg);
-    xpc_dictionary_set_uint64(xpc_payload, IOEventLengthKey, event.Size());
+    xpc_dictionary_set_data(xpc_payload, IOEventKey, msg, msg_length);
+    xpc_dictionary_set_uint64(xpc_payload, IOEventLengthKey, msg_length);
 
     xpc_object_t response = xpc_connection_send_message_with_reply_sync(bxl_connection, xpc_payload);
     xpc_type_t xpc_type = xpc_get_type(response);
@@ -174,6 +640,94 @@ inline std::string get_executable_path(pid_t pid)
     return success > 0 ? fullpath : "/unknown-process";
 }
 
+// The executable of this process only changes on exec, which loads this library anew
+static char bxl_executable_path[PATH_MAX] = { '\0' };
+
+inline const char* get_current_executable_path()
+{
+    std::call_once(InitializeExecutablePath, []()
+    {
+        if (proc_pidpath(getpid(), (void *) bxl_executable_path, PATH_MAX) <= 0)
+        {
+            strlcpy(bxl_executable_path, "/unknown-process", PATH_MAX);
+        }
+    });
+
+    return bxl_executable_path;
+}
+
+#pragma mark Backend Selection
+
+// In a Hybrid sandbox, the host picks the executables whose processes are cheaper to observe with EndpointSecurity alone and lists
+// them (with an 'E') in the cache file named by BackendSelector::kBackendCacheEnvVar (see BackendSelector.hpp): the images they are
+// exec'd into are not injected with this library, and neither are their descendants (EndpointSecurity still observes all of them).
+// The file is read with plain syscalls, which (made from this image) are not interposed and thus not reported as accesses of the pip.
+
+static std::set<std::string> *bxl_endpoint_security_only_executables = nullptr;
+
+static void load_endpoint_security_only_executables()
+{
+    const char *cache_path = getenv(BackendSelector::kBackendCacheEnvVar);
+    if (cache_path == nullptr || cache_path[0] == '\0')
+    {
+        return;
+    }
+
+    int fd = open(cache_path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        return;
+    }
+
+    std::string content;
+    char buffer[16 * 1024];
+    ssize_t count;
+    while ((count = read(fd, buffer, sizeof(buffer))) > 0)
+    {
+        content.append(buffer, count);
+    }
+    close(fd);
+
+    std::set<std::string> *executables = new std::set<std::string>();
+    size_t start = 0;
+    while (start < content.length())
+    {
+        size_t end = content.find('\n', start);
+        if (end == std::string::npos)
+        {
+            end = content.length();
+        }
+
+        // "<backend>\t<statistics, tab separated>\t<path>"
+        if (end - start > 2 && content[start] == BackendSelector::kEndpointSecurity && content[start + 1] == '\t')
+        {
+            size_t separator = content.rfind('\t', end - 1);
+            if (separator != std::string::npos && separator > start + 1 && separator + 1 < end)
+            {
+                executables->insert(content.substr(separator + 1, end - separator - 1));
+            }
+        }
+
+        start = end + 1;
+    }
+
+    bxl_endpoint_security_only_executables = executables;
+}
+
+// Whether the executable 'path' (as passed to exec, a path without a '/' is looked up in PATH and never matches) is only observed by EndpointSecurity
+static bool is_endpoint_security_only(const char *path)
+{
+    std::call_once(InitializeEndpointSecurityOnlyExecutables, load_endpoint_security_only_executables);
+    if (bxl_endpoint_security_only_executables == nullptr || bxl_endpoint_security_only_executables->empty() ||
+        path == nullptr || strchr(path, '/') == nullptr)
+    {
+        return false;
+    }
+
+    char resolved[PATH_MAX];
+    return realpath(path, resolved) != nullptr && bxl_endpoint_security_only_executables->count(resolved) > 0;
+}
+
 #pragma mark Spawn / Fork Family Functions
 
 extern char** environ;
@@ -221,6 +775,35 @@ char** extend_env_with_interposing_lib(char *const *env, char* interpose)
     return new_env;
 }
 
+// Returns a copy of 'env' without the entry injecting this library
+char** remove_interposing_lib(char *const *env)
+{
+    uint count = 0;
+    while (env[count]) count++;
+
+    char **new_env = (char **) malloc(sizeof(char *) * (count + 1));
+
+    uint new_count = 0;
+    for (uint i = 0; i < count; i++)
+    {
+        if (strstr(env[i], "libBuildXLDetours") == NULL)
+        {
+            new_env[new_count++] = env[i];
+        }
+    }
+
+    new_env[new_count] = NULL;
+    return new_env;
+}
+
+// The environment of a child that is exec'd into 'path'
+char** get_env_for_child(const char *path, char *const *env)
+{
+    return is_endpoint_security_only(path)
+        ? remove_interposing_lib(env)
+        : extend_env_with_interposing_lib(env, get_env_interposing_entry(env));
+}
+
 int bxl_posix_spawn(pid_t *child_pid,
     const char *path,
     const posix_spawn_file_actions_t *file_actions,
@@ -234,8 +817,7 @@ int bxl_posix_spawn(pid_t *child_pid,
     pid_t pid = getpid();
     pid_t ppid = getppid();
 
-    char *interpose = get_env_interposing_entry(envp);
-    char **new_env = extend_env_with_interposing_lib(envp, interpose);
+    char **new_env = get_env_for_child(path, envp);
 
     int result = posix_spawn(child_pid, path, file_actions, attrp, argv, new_env);
     FORK_EVENT_CONSTRUCTOR(result, child_pid, pid, ppid, ==)
@@ -255,8 +837,7 @@ int bxl_posix_spawnp(pid_t *child_pid,
     pid_t pid = getpid();
     pid_t ppid = getppid();
 
-    char *interpose = get_env_interposing_entry(envp);
-    char **new_env = extend_env_with_interposing_lib(envp, interpose);
+    char **new_env = get_env_for_child(file, envp);
 
     int result = posix_spawnp(child_pid, file, file_actions, attrp, argv, new_env);
     FORK_EVENT_CONSTRUCTOR(result, child_pid, pid, ppid, ==)
@@ -265,6 +846,7 @@ DYLD_INTERPOSE(bxl_posix_spawnp, posix_spawnp)
 
 pid_t blx_fork(void)
 {
+    flush_thread_batch();
     pid_t result = fork();
     FORK_EVENT_CONSTRUCTOR(result, &result, getpid(), getppid(), >)
 }
@@ -272,6 +854,7 @@ DYLD_INTERPOSE(blx_fork, fork)
 
 pid_t blx_vfork(void)
 {
+    flush_thread_batch();
     pid_t result = vfork();
     FORK_EVENT_CONSTRUCTOR(result, &result, getpid(), getppid(), >)
 }
@@ -284,8 +867,7 @@ int bxl_execve(const char *path, char *const argv[], char *const envp[])
 {
     // Sending the event has to happen prior to the execve call as it only ever returns on error
     EXEC_EVENT_CONSTRUCTOR(path)
-    char *interpose = get_env_interposing_entry(envp);
-    char **new_env = extend_env_with_interposing_lib(envp, interpose);
+    char **new_env = get_env_for_child(path, envp);
 
     return execve(path, argv, new_env);
 }
@@ -316,6 +898,11 @@ DYLD_INTERPOSE(bxl__Exit, _Exit)
 
 void __attribute__ ((constructor)) _bxl_linux_sandbox_init(void)
 {
+    pthread_atfork(flush_thread_batch, nullptr, reset_batches_in_child);
+    pthread_atfork(nullptr, nullptr, reset_resolved_directories_in_child);
+    pthread_atfork(nullptr, nullptr, reset_xpc_connection_lock_in_child);
+    pthread_atfork(nullptr, nullptr, reset_report_cache_in_child);
+
     atexit_b(^()
     {
         EXIT_EVENT_CONSTRUCTOR()
@@ -345,7 +932,7 @@ int bxl_open(const char *path, int oflag)
 
         std::shared_ptr<PathCacheEntry> entry(new PathCacheEntry(path, 0));
         openedPaths_->insert(path, entry);
-        IOEvent event(getpid(), 0, getppid(), type, ES_ACTION_TYPE_NOTIFY, path, "", get_executable_path(getpid()), true);
+        IOEventView event(getpid(), 0, getppid(), type, ES_ACTION_TYPE_NOTIFY, path, "", get_current_executable_path(), true);
         send_to_sandbox(event);
     }
 
@@ -367,7 +954,7 @@ int bxl_close(int fildes)
     if (result == 0 && success == 0)
     {
         // TODO: Explore ways to infer if the closed file was actually modified e.g. open() path/handle cache then lookup + mod time check on close?
-        IOEvent event(getpid(), 0, getppid(), ES_EVENT_TYPE_NOTIFY_CLOSE, path, "", get_executable_path(getpid()));
+        IOEventView event(getpid(), 0, getppid(), ES_EVENT_TYPE_NOTIFY_CLOSE, path, "", get_current_executable_path());
         send_to_sandbox(event);
     }
     errno = old_errno;
@@ -396,6 +983,7 @@ DYLD_INTERPOSE(bxl_link, link)
 int bxl_symlink(const char *path1, const char *path2)
 {
     int result = symlink(path1, path2);
+    invalidate_resolved_directories();
     DEFAULT_EVENT_CONSTRUCTOR_NO_RESOLVE(ES_EVENT_TYPE_NOTIFY_CREATE, path1, path2, true, true)
 }
 DYLD_INTERPOSE(bxl_symlink, symlink)
@@ -403,6 +991,7 @@ DYLD_INTERPOSE(bxl_symlink, symlink)
 int bxl_unlink(const char *path)
 {
     int result = unlink(path);
+    invalidate_resolved_directories();
     DEFAULT_EVENT_CONSTRUCTOR_NO_RESOLVE(ES_EVENT_TYPE_NOTIFY_UNLINK, path, "", true, true)
 }
 DYLD_INTERPOSE(bxl_unlink, unlink)
@@ -500,6 +1089,7 @@ DYLD_INTERPOSE(bxl_acl_get_link_np, acl_get_link_np)
 int bxl_rename(const char *src, const char *dst)
 {
     int result = rename(src, dst);
+    invalidate_resolved_directories();
     DEFAULT_EVENT_CONSTRUCTOR(ES_EVENT_TYPE_NOTIFY_RENAME, src, dst, false)
 }
 DYLD_INTERPOSE(bxl_rename, rename)
@@ -6,13 +6,16 @@
 
 #include <assert.h>
 #include <libproc.h>
+#include <os/lock.h>
 #include <os/log.h>
+#include <pthread.h>
 #include <spawn.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/clonefile.h>
 #include <sys/fcntl.h>
 #include <sys/fsgetpath.h>
+#include <sys/stat.h>
 
 #include <EndpointSecurity/EndpointSecurity.h>
 
@@ -35,7 +38,7 @@ static os_log_t logger = os_log_create(DETOURS_BUNDLE_IDENTIFIER, "Logger");
 
 #define DEFAULT_EVENT_CONSTRUCTOR(type, src, dst, mode) \
     int old_errno = errno; \
-    IOEvent event(getpid(), 0, getppid(), type, ES_ACTION_TYPE_NOTIFY, src, dst, get_executable_path(getpid()), mode); \
+    IOEventView event(getpid(), 0, getppid(), type, ES_ACTION_TYPE_NOTIFY, src, dst, get_current_executable_path(), mode); \
     send_to_sandbox(event, type); \
     errno = old_errno; \
     return result;
@@ -43,25 +46,25 @@ static os_log_t logger = os_log_create(DETOURS_BUNDLE_IDENTIFIER, "Logger");
 #define DEFAULT_EVENT_CONSTRUCTOR_NO_RESOLVE(type, src, dst, mode, report) \
     int old_errno = errno; \
     if (report) { \
-        IOEvent event(getpid(), 0, getppid(), type, ES_ACTION_TYPE_NOTIFY, src, dst, get_executable_path(getpid()), true); \
-        send_to_sandbox(event, type, false, false); \
+        IOEventView event(getpid(), 0, getppid(), type, ES_ACTION_TYPE_NOTIFY, src, dst, get_current_executable_path(), true); \
+        send_to_sandbox(event, type, false); \
     } \
     errno = old_errno; \
     return result;
 
 #define EXEC_EVENT_CONSTRUCTOR(path) \
-    IOEvent event(getpid(), 0, getppid(), ES_EVENT_TYPE_NOTIFY_EXEC, ES_ACTION_TYPE_NOTIFY, path, "", get_executable_path(getpid()), false); \
-    send_to_sandbox(event, ES_EVENT_TYPE_NOTIFY_EXEC, true);\
+    IOEventView event(getpid(), 0, getppid(), ES_EVENT_TYPE_NOTIFY_EXEC, ES_ACTION_TYPE_NOTIFY, path, "", get_current_executable_path(), false); \
+    send_to_sandbox(event, ES_EVENT_TYPE_NOTIFY_EXEC);\
 
 #define EXIT_EVENT_CONSTRUCTOR() \
-    IOEvent event(getpid(), 0, getppid(), ES_EVENT_TYPE_NOTIFY_EXIT, ES_ACTION_TYPE_NOTIFY, "", "", get_executable_path(getpid()), false); \
+    IOEventView event(getpid(), 0, getppid(), ES_EVENT_TYPE_NOTIFY_EXIT, ES_ACTION_TYPE_NOTIFY, "", "", get_current_executable_path(), false); \
     send_to_sandbox(event, ES_EVENT_TYPE_NOTIFY_EXIT);
 
 #define FORK_EVENT_CONSTRUCTOR(result, child_pid, pid, ppid, cmp) \
     int old_errno = errno; \
     if (result cmp 0) { \
         std::string fullpath = get_executable_path(*child_pid); \
-        IOEvent event(pid, *child_pid, ppid, ES_EVENT_TYPE_NOTIFY_FORK, ES_ACTION_TYPE_NOTIFY, "", "", fullpath, false); \
+        IOEventView event(pid, *child_pid, ppid, ES_EVENT_TYPE_NOTIFY_FORK, ES_ACTION_TYPE_NOTIFY, "", "", fullpath.c_str(), false); \
         send_to_sandbox(event, ES_EVENT_TYPE_NOTIFY_FORK); \
     } \
     errno = old_errno; \
@@ -69,7 +72,7 @@ static os_log_t logger = os_log_create(DETOURS_BUNDLE_IDENTIFIER, "Logger");
 
 #define STAT_EVENT_CONSTRUCTOR(type, src) \
     int old_errno = errno; \
-    IOEvent event(getpid(), 0, getppid(), type, ES_ACTION_TYPE_NOTIFY, src, "", get_executable_path(getpid()), s->st_mode); \
+    IOEventView event(getpid(), 0, getppid(), type, ES_ACTION_TYPE_NOTIFY, src, "", get_current_executable_path(), s->st_mode); \
     send_to_sandbox(event, type); \
     errno = old_errno; \
     return result;
@@ -81,7 +84,7 @@ static os_log_t logger = os_log_create(DETOURS_BUNDLE_IDENTIFIER, "Logger");
         if (!reported) { \
             std::shared_ptr<PathCacheEntry> entry(new PathCacheEntry(fildes)); \
             trackedPaths_->insert(path, entry); \
-            IOEvent event(getpid(), 0, getppid(), ES_EVENT_TYPE_NOTIFY_WRITE, ES_ACTION_TYPE_NOTIFY, path, dst, get_executable_path(getpid())); \
+            IOEventView event(getpid(), 0, getppid(), ES_EVENT_TYPE_NOTIFY_WRITE, ES_ACTION_TYPE_NOTIFY, path, dst, get_current_executable_path()); \
             send_to_sandbox(event, ES_EVENT_TYPE_NOTIFY_WRITE); \
         } \
     } \
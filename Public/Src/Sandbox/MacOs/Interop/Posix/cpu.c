@@ -1,6 +1,9 @@
 // Copyright (c) Microsoft. All rights reserved.
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
 
+#include <stdlib.h>
+#include <sys/sysctl.h>
+
 #include "cpu.h"
 
 int GetCpuLoadInfo(CpuLoadInfo *buffer, long bufferSize)
@@ -36,6 +39,137 @@ int GetCpuLoadInfo(CpuLoadInfo *buffer, long bufferSize)
     buffer->systemTime = totalSystemTime;
     buffer->userTime = totalUserTime;
     buffer->idleTime = totalIdleTime;
-    
+
+    vm_deallocate(mach_task_self(), (vm_address_t)cpuInfo, cpuInfoCount * sizeof(integer_t));
+
+    return KERN_SUCCESS;
+}
+
+typedef struct {
+    // Busy (user, nice and system) and total ticks of every logical core at the previous sample
+    natural_t *busyTicks;
+    natural_t *totalTicks;
+    natural_t numCores;
+
+    // Number of logical efficiency cores (numbered first), 0 on machines with a single kind of core
+    int numEfficiencyCores;
+} CpuUtilizationSampler;
+
+static int GetSysctlInt(const char *name, int defaultValue)
+{
+    int value;
+    size_t size = sizeof(value);
+    return sysctlbyname(name, &value, &size, NULL, 0) == 0 ? value : defaultValue;
+}
+
+void *CreateCpuUtilizationSampler(void)
+{
+    CpuUtilizationSampler *sampler = calloc(1, sizeof(CpuUtilizationSampler));
+    if (sampler == NULL)
+    {
+        return NULL;
+    }
+
+    // Apple silicon reports one performance level per kind of core, level 0 being the performance cores
+    if (GetSysctlInt("hw.nperflevels", 1) > 1)
+    {
+        sampler->numEfficiencyCores = GetSysctlInt("hw.perflevel1.logicalcpu", 0);
+    }
+
+    return sampler;
+}
+
+void ReleaseCpuUtilizationSampler(void *sampler)
+{
+    if (sampler != NULL)
+    {
+        free(((CpuUtilizationSampler *)sampler)->busyTicks);
+        free(((CpuUtilizationSampler *)sampler)->totalTicks);
+        free(sampler);
+    }
+}
+
+static inline double Percent(uint64_t busy, uint64_t total)
+{
+    return total == 0 ? 0.0 : 100.0 * busy / total;
+}
+
+int SampleCpuUtilization(void *samplerPtr, CpuUtilization *buffer, double *coreUtilization, int coreCount, long bufferSize)
+{
+    if (sizeof(CpuUtilization) != bufferSize)
+    {
+        printf("ERROR: Wrong size of CpuUtilization buffer; expected %ld, received %ld\n", sizeof(CpuUtilization), bufferSize);
+        return KERN_MEMORY_ERROR;
+    }
+
+    CpuUtilizationSampler *sampler = (CpuUtilizationSampler *)samplerPtr;
+    if (sampler == NULL)
+    {
+        return KERN_INVALID_ARGUMENT;
+    }
+
+    mach_msg_type_number_t cpuInfoCount;
+    processor_info_array_t cpuInfo;
+    natural_t numberOfLogicalCores = 0U;
+
+    kern_return_t error = host_processor_info(mach_host_self(), PROCESSOR_CPU_LOAD_INFO, &numberOfLogicalCores, &cpuInfo, &cpuInfoCount);
+    if (error != KERN_SUCCESS)
+    {
+        return error;
+    }
+
+    // Start over (i.e., measure since boot) whenever the number of cores changes
+    if (numberOfLogicalCores != sampler->numCores)
+    {
+        free(sampler->busyTicks);
+        free(sampler->totalTicks);
+        sampler->busyTicks = calloc(numberOfLogicalCores, sizeof(natural_t));
+        sampler->totalTicks = calloc(numberOfLogicalCores, sizeof(natural_t));
+        sampler->numCores = sampler->busyTicks && sampler->totalTicks ? numberOfLogicalCores : 0;
+        if (sampler->numCores == 0)
+        {
+            vm_deallocate(mach_task_self(), (vm_address_t)cpuInfo, cpuInfoCount * sizeof(integer_t));
+            return KERN_RESOURCE_SHORTAGE;
+        }
+    }
+
+    int numEfficiencyCores = sampler->numEfficiencyCores < (int)numberOfLogicalCores ? sampler->numEfficiencyCores : 0;
+    uint64_t busy = 0, total = 0, efficiencyBusy = 0, efficiencyTotal = 0;
+
+    for (natural_t i = 0; i < numberOfLogicalCores; ++i)
+    {
+        natural_t *ticks = (natural_t *)&cpuInfo[CPU_STATE_MAX * i];
+        natural_t coreBusy = ticks[CPU_STATE_USER] + ticks[CPU_STATE_NICE] + ticks[CPU_STATE_SYSTEM];
+        natural_t coreTotal = coreBusy + ticks[CPU_STATE_IDLE];
+
+        // The tick counters are 32 bit and wrap around, unsigned differences stay correct across a wrap
+        natural_t busyDelta = coreBusy - sampler->busyTicks[i];
+        natural_t totalDelta = coreTotal - sampler->totalTicks[i];
+        sampler->busyTicks[i] = coreBusy;
+        sampler->totalTicks[i] = coreTotal;
+
+        busy += busyDelta;
+        total += totalDelta;
+        if ((int)i < numEfficiencyCores)
+        {
+            efficiencyBusy += busyDelta;
+            efficiencyTotal += totalDelta;
+        }
+
+        if (coreUtilization != NULL && (int)i < coreCount)
+        {
+            coreUtilization[i] = Percent(busyDelta, totalDelta);
+        }
+    }
+
+    vm_deallocate(mach_task_self(), (vm_address_t)cpuInfo, cpuInfoCount * sizeof(integer_t));
+
+    buffer->numCores = numberOfLogicalCores;
+    buffer->numEfficiencyCores = numEfficiencyCores;
+    buffer->numPerformanceCores = numberOfLogicalCores - numEfficiencyCores;
+    buffer->utilization = Percent(busy, total);
+    buffer->efficiencyUtilization = Percent(efficiencyBusy, efficiencyTotal);
+    buffer->performanceUtilization = Percent(busy - efficiencyBusy, total - efficiencyTotal);
+
     return KERN_SUCCESS;
 }
@@ -15,4 +15,38 @@ typedef struct {
 
 int GetCpuLoadInfo(CpuLoadInfo *buffer, long bufferSize);
 
+// CPU utilization since the previous sample of a sampler (unit: percent)
+typedef struct {
+    double utilization;
+    double performanceUtilization;
+    double efficiencyUtilization;
+    int numCores;
+    int numPerformanceCores;
+    int numEfficiencyCores;
+} CpuUtilization;
+
+/*!
+ * Creates a sampler that keeps the CPU ticks of its previous sample, so that every sample directly returns the utilization
+ * over the interval since the previous one.  Every poller should own a sampler, a sampler is not safe to use concurrently.
+ * @result The sampler, or NULL if it could not be allocated.
+*/
+void *CreateCpuUtilizationSampler(void);
+
+/*! Releases a sampler created with 'CreateCpuUtilizationSampler' */
+void ReleaseCpuUtilizationSampler(void *sampler);
+
+/*!
+ * Samples the CPU ticks of every logical core and returns the utilization since the previous sample (since boot for the first one).
+ *
+ * On Apple silicon, the utilization of the performance and the efficiency clusters is returned separately (the kernel numbers
+ * the efficiency cores first); elsewhere every core counts as a performance core.
+ * @param sampler Sampler created with 'CreateCpuUtilizationSampler'
+ * @param buffer Receives the utilization of the whole machine and of each cluster
+ * @param coreUtilization If not NULL, receives the utilization of each of the first 'coreCount' logical cores
+ * @param coreCount Capacity of 'coreUtilization'
+ * @param bufferSize Allocated size of the 'CpuUtilization' struct
+ * @result KERN_SUCCESS on success, error code otherwise.
+*/
+int SampleCpuUtilization(void *sampler, CpuUtilization *buffer, double *coreUtilization, int coreCount, long bufferSize);
+
 #endif /* cpu_h */
@@ -1,11 +1,18 @@
 // Copyright (c) Microsoft. All rights reserved.
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
 
+#include <copyfile.h>
+#include <dispatch/dispatch.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <string.h>
+#include <stdlib.h>
+#include <sys/attr.h>
+#include <sys/clonefile.h>
 #include <sys/errno.h>
 #include <sys/mount.h>
 #include <sys/stat.h>
+#include <sys/vnode.h>
 #include <unistd.h>
 
 #include "io.h"
@@ -88,6 +95,304 @@ int StatFileDescriptor(intptr_t fd, StatBuffer *statBuffer, long bufferSize)
     return result;
 }
 
+// Number of paths stat-ed by one work item of 'StatFiles'; small enough to keep every CPU busy, large enough to amortize
+// the scheduling cost and to keep runs of paths from the same directory together
+#define STAT_FILES_CHUNK_SIZE 256
+
+// Returns the length of the directory part of 'path' (up to and excluding the last '/'), or -1 if it has none or is the root
+static ssize_t DirectoryLength(const char *path)
+{
+    const char *lastSlash = strrchr(path, '/');
+    return lastSlash == NULL || lastSlash == path ? -1 : lastSlash - path;
+}
+
+static int StatChunk(const char **paths, int count, bool followSymlink, StatBuffer *statBuffers, int *results)
+{
+    int numSucceeded = 0;
+    int dirFd = -1;
+    const char *dirPath = NULL;
+    ssize_t dirLength = -1;
+    char dirBuffer[PATH_MAX];
+
+    for (int i = 0; i < count; i++)
+    {
+        const char *path = paths[i];
+        ssize_t length = DirectoryLength(path);
+
+        if (length != dirLength || dirPath == NULL || strncmp(path, dirPath, length) != 0)
+        {
+            if (dirFd >= 0)
+            {
+                close(dirFd);
+                dirFd = -1;
+            }
+
+            dirPath = path;
+            dirLength = length;
+            if (length > 0 && length < PATH_MAX)
+            {
+                memcpy(dirBuffer, path, length);
+                dirBuffer[length] = '\0';
+                while ((dirFd = open(dirBuffer, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) < 0 && errno == EINTR);
+            }
+        }
+
+        struct stat fileStat;
+        int result;
+        if (dirFd >= 0)
+        {
+            int flags = followSymlink ? 0 : AT_SYMLINK_NOFOLLOW;
+            while ((result = fstatat(dirFd, path + dirLength + 1, &fileStat, flags)) < 0 && errno == EINTR);
+        }
+        else
+        {
+            result = CallStat(path, followSymlink, &fileStat);
+        }
+
+        if (result == 0)
+        {
+            ConvertStatToStatBuffer(&fileStat, &statBuffers[i]);
+            results[i] = 0;
+            numSucceeded++;
+        }
+        else
+        {
+            results[i] = errno;
+        }
+    }
+
+    if (dirFd >= 0)
+    {
+        close(dirFd);
+    }
+
+    return numSucceeded;
+}
+
+int StatFiles(const char **paths, int count, bool followSymlink, StatBuffer *statBuffers, int *results, long bufferSize)
+{
+    if (sizeof(StatBuffer) != bufferSize)
+    {
+        printf("ERROR: Wrong size of StatBuffer buffer; expected %ld, received %ld\n", sizeof(StatBuffer), bufferSize);
+        return RUNTIME_ERROR;
+    }
+
+    if (count <= STAT_FILES_CHUNK_SIZE)
+    {
+        return StatChunk(paths, count, followSymlink, statBuffers, results);
+    }
+
+    size_t numChunks = (count + STAT_FILES_CHUNK_SIZE - 1) / STAT_FILES_CHUNK_SIZE;
+    dispatch_apply(numChunks, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t chunk)
+    {
+        int start = (int)chunk * STAT_FILES_CHUNK_SIZE;
+        int chunkCount = count - start < STAT_FILES_CHUNK_SIZE ? count - start : STAT_FILES_CHUNK_SIZE;
+        StatChunk(paths + start, chunkCount, followSymlink, statBuffers + start, results + start);
+    });
+
+    int numSucceeded = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (results[i] == 0) numSucceeded++;
+    }
+
+    return numSucceeded;
+}
+
+int CloneOrCopyFile(const char *source, const char *destination, bool followSymlink)
+{
+    if (clonefile(source, destination, followSymlink ? 0 : CLONE_NOFOLLOW) == 0)
+    {
+        return 0;
+    }
+
+    // Only fall back to copying when cloning is impossible, any other failure would fail the copy the same way
+    if (errno != ENOTSUP && errno != EXDEV)
+    {
+        return errno;
+    }
+
+    copyfile_flags_t flags = COPYFILE_DATA | COPYFILE_SECURITY | COPYFILE_EXCL | (followSymlink ? 0 : COPYFILE_NOFOLLOW);
+    return copyfile(source, destination, NULL, flags) == 0 ? 0 : errno;
+}
+
+// Number of files materialized by one work item of 'CloneOrCopyFiles'; clones are cheap metadata operations, so chunks
+// keep the scheduling cost of a batch of small files down
+#define CLONE_FILES_CHUNK_SIZE 32
+
+int CloneOrCopyFiles(const char **sources, const char **destinations, int count, bool followSymlink, int *results)
+{
+    size_t numChunks = (count + CLONE_FILES_CHUNK_SIZE - 1) / CLONE_FILES_CHUNK_SIZE;
+    dispatch_apply(numChunks, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t chunk)
+    {
+        int start = (int)chunk * CLONE_FILES_CHUNK_SIZE;
+        int end = count - start < CLONE_FILES_CHUNK_SIZE ? count : start + CLONE_FILES_CHUNK_SIZE;
+        for (int i = start; i < end; i++)
+        {
+            results[i] = CloneOrCopyFile(sources[i], destinations[i], followSymlink);
+        }
+    });
+
+    int numSucceeded = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (results[i] == 0) numSucceeded++;
+    }
+
+    return numSucceeded;
+}
+
+// Attributes requested by 'EnumerateDirectoryWithAttributes', they are returned in the order of their bit values
+static struct attrlist s_enumerationAttributes =
+{
+    .bitmapcount = ATTR_BIT_MAP_COUNT,
+    .commonattr  = ATTR_CMN_RETURNED_ATTRS | ATTR_CMN_ERROR | ATTR_CMN_NAME | ATTR_CMN_DEVID | ATTR_CMN_OBJTYPE |
+                   ATTR_CMN_CRTIME | ATTR_CMN_MODTIME | ATTR_CMN_CHGTIME | ATTR_CMN_ACCTIME |
+                   ATTR_CMN_OWNERID | ATTR_CMN_GRPID | ATTR_CMN_ACCESSMASK | ATTR_CMN_FILEID,
+    .dirattr     = ATTR_DIR_LINKCOUNT,
+    .fileattr    = ATTR_FILE_LINKCOUNT | ATTR_FILE_DATALENGTH,
+};
+
+#define MIN_ENUMERATION_BUFFER_SIZE (16 * 1024)
+
+// A record is less than four times the size of the attribute entry it is converted from, so an attribute buffer of a quarter
+// of the output buffer guarantees that every entry returned by one getattrlistbulk call fits into the output buffer
+#define ENUMERATION_ATTRIBUTE_BUFFER_RATIO 4
+
+// Attributes are packed at 4 byte boundaries, so wider values are read with memcpy
+#define READ_ATTRIBUTE(cursor, value) do { memcpy(&(value), (cursor), sizeof(value)); (cursor) += sizeof(value); } while (0)
+
+static mode_t ObjectTypeToMode(fsobj_type_t type)
+{
+    switch (type)
+    {
+        case VREG:  return S_IFREG;
+        case VDIR:  return S_IFDIR;
+        case VLNK:  return S_IFLNK;
+        case VBLK:  return S_IFBLK;
+        case VCHR:  return S_IFCHR;
+        case VFIFO: return S_IFIFO;
+        case VSOCK: return S_IFSOCK;
+        default:    return 0;
+    }
+}
+
+// Converts one getattrlistbulk entry into a record at 'record', returns the length of the record, 0 if the entry is
+// skipped or UINT32_MAX (with errno set) if the record does not fit
+static uint32_t ConvertAttributesToRecord(const char *entry, char *record, const char *recordEnd)
+{
+    const char *cursor = entry + sizeof(uint32_t);
+
+    attribute_set_t returned;
+    READ_ATTRIBUTE(cursor, returned);
+
+    // An entry whose attributes could not all be read is still returned, with the attributes that were read
+    if (returned.commonattr & ATTR_CMN_ERROR)
+    {
+        cursor += sizeof(uint32_t);
+    }
+
+    if (!(returned.commonattr & ATTR_CMN_NAME))
+    {
+        return 0;
+    }
+
+    const char *nameInfoStart = cursor;
+    attrreference_t nameInfo;
+    READ_ATTRIBUTE(cursor, nameInfo);
+    const char *name = nameInfoStart + nameInfo.attr_dataoffset;
+    uint32_t nameLength = (uint32_t)strnlen(name, nameInfo.attr_length);
+
+    uint32_t recordLength = (uint32_t)((sizeof(DirectoryEntryRecord) + nameLength + 1 + 7) & ~7ul);
+    if (record + recordLength > recordEnd)
+    {
+        errno = ENOBUFS;
+        return UINT32_MAX;
+    }
+
+    DirectoryEntryRecord *header = (DirectoryEntryRecord *)record;
+    memset(header, 0, sizeof(DirectoryEntryRecord));
+    header->recordLength = recordLength;
+    header->nameLength = nameLength;
+    memcpy(record + sizeof(DirectoryEntryRecord), name, nameLength);
+    record[sizeof(DirectoryEntryRecord) + nameLength] = '\0';
+
+    StatBuffer *statBuffer = &header->stat;
+    struct timespec time;
+    uint32_t value32;
+
+    if (returned.commonattr & ATTR_CMN_DEVID)    { dev_t dev; READ_ATTRIBUTE(cursor, dev); statBuffer->st_dev = dev; }
+    if (returned.commonattr & ATTR_CMN_OBJTYPE)  { fsobj_type_t type; READ_ATTRIBUTE(cursor, type); statBuffer->st_mode |= ObjectTypeToMode(type); }
+    if (returned.commonattr & ATTR_CMN_CRTIME)   { READ_ATTRIBUTE(cursor, time); statBuffer->st_birthtimespec = time.tv_sec; statBuffer->st_birthtimespec_nsec = time.tv_nsec; }
+    if (returned.commonattr & ATTR_CMN_MODTIME)  { READ_ATTRIBUTE(cursor, time); statBuffer->st_mtimespec = time.tv_sec; statBuffer->st_mtimespec_nsec = time.tv_nsec; }
+    if (returned.commonattr & ATTR_CMN_CHGTIME)  { READ_ATTRIBUTE(cursor, time); statBuffer->st_ctimespec = time.tv_sec; statBuffer->st_ctimespec_nsec = time.tv_nsec; }
+    if (returned.commonattr & ATTR_CMN_ACCTIME)  { READ_ATTRIBUTE(cursor, time); statBuffer->st_atimespec = time.tv_sec; statBuffer->st_atimespec_nsec = time.tv_nsec; }
+    if (returned.commonattr & ATTR_CMN_OWNERID)  { READ_ATTRIBUTE(cursor, value32); statBuffer->st_uid = value32; }
+    if (returned.commonattr & ATTR_CMN_GRPID)    { READ_ATTRIBUTE(cursor, value32); statBuffer->st_gid = value32; }
+    if (returned.commonattr & ATTR_CMN_ACCESSMASK) { READ_ATTRIBUTE(cursor, value32); statBuffer->st_mode |= value32 & ~S_IFMT; }
+    if (returned.commonattr & ATTR_CMN_FILEID)   { uint64_t fileId; READ_ATTRIBUTE(cursor, fileId); statBuffer->st_ino = fileId; }
+    if (returned.dirattr & ATTR_DIR_LINKCOUNT)   { READ_ATTRIBUTE(cursor, value32); statBuffer->st_nlink = value32; }
+    if (returned.fileattr & ATTR_FILE_LINKCOUNT) { READ_ATTRIBUTE(cursor, value32); statBuffer->st_nlink = value32; }
+    if (returned.fileattr & ATTR_FILE_DATALENGTH) { off_t size; READ_ATTRIBUTE(cursor, size); statBuffer->st_size = size; }
+
+    return recordLength;
+}
+
+int EnumerateDirectoryWithAttributes(intptr_t fd, char *buffer, long bufferSize, long statBufferSize)
+{
+    if (sizeof(StatBuffer) != statBufferSize)
+    {
+        printf("ERROR: Wrong size of StatBuffer buffer; expected %ld, received %ld\n", sizeof(StatBuffer), statBufferSize);
+        return RUNTIME_ERROR;
+    }
+
+    if (buffer == NULL || bufferSize < MIN_ENUMERATION_BUFFER_SIZE)
+    {
+        errno = EINVAL;
+        return RUNTIME_ERROR;
+    }
+
+    size_t attributeBufferSize = bufferSize / ENUMERATION_ATTRIBUTE_BUFFER_RATIO;
+    char *attributeBuffer = malloc(attributeBufferSize);
+    if (attributeBuffer == NULL)
+    {
+        errno = ENOMEM;
+        return RUNTIME_ERROR;
+    }
+
+    int count;
+    char *record = buffer;
+
+    // Returning 0 means the directory is exhausted, so keep reading if every entry of a batch was skipped
+    do
+    {
+        while ((count = getattrlistbulk(ToFileDescriptorUnchecked(fd), &s_enumerationAttributes, attributeBuffer, attributeBufferSize, 0)) < 0 && errno == EINTR);
+
+        const char *entry = attributeBuffer;
+        for (int i = 0; i < count; i++)
+        {
+            uint32_t entryLength;
+            memcpy(&entryLength, entry, sizeof(entryLength));
+
+            uint32_t recordLength = ConvertAttributesToRecord(entry, record, buffer + bufferSize);
+            if (recordLength == UINT32_MAX)
+            {
+                count = -1;
+                break;
+            }
+
+            record += recordLength;
+            entry += entryLength;
+        }
+    } while (count > 0 && record == buffer);
+
+    int savedErrno = errno;
+    free(attributeBuffer);
+    errno = savedErrno;
+
+    return count < 0 ? RUNTIME_ERROR : (int)(record - buffer);
+}
+
 intptr_t Open(const char *path, int32_t flags, int32_t mode)
 {
     int result;
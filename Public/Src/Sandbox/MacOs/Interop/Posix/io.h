@@ -47,6 +47,48 @@ int StatFile(const char *path, bool followSymlink, StatBuffer *statBuffer, long
 */
 int StatFileDescriptor(intptr_t fd, StatBuffer *statBuffer, long bufferSize);
 
+/*!
+ * Materializes 'source' at 'destination' (which must not exist): creates a copy-on-write clone (clonefile) where the file
+ * system supports it, otherwise (e.g., HFS+ volumes or when crossing volumes) falls back to copying the data and the permissions.
+ * @param source File to copy
+ * @param destination Path of the new file
+ * @param followSymlink Whether to copy the target of a symlink, if false, a symlink is copied as a symlink
+ * @result 0 on success, the error code (errno) otherwise.
+*/
+int CloneOrCopyFile(const char *source, const char *destination, bool followSymlink);
+
+/*!
+ * Same as 'CloneOrCopyFile' for many files at once; the files are processed concurrently.
+ * @param results Set to 0 for every file that was successfully materialized, the error code (errno) otherwise
+ * @result Number of files successfully materialized.
+*/
+int CloneOrCopyFiles(const char **sources, const char **destinations, int count, bool followSymlink, int *results);
+
+/*!
+ * Header of every record written by 'EnumerateDirectoryWithAttributes'; it is followed by the NUL terminated (UTF-8)
+ * name of the entry and padding up to 'recordLength'.
+ */
+typedef struct {
+    uint32_t recordLength;           /* Length of the record (including this header), a multiple of 8 */
+    uint32_t nameLength;             /* Length of the name following this header (excluding the NUL terminator) */
+    StatBuffer stat;                 /* Attributes of the entry, see 'EnumerateDirectoryWithAttributes' */
+} DirectoryEntryRecord;
+
+/*!
+ * Reads the next entries (together with their attributes) of the directory 'fd' into 'buffer' as packed 'DirectoryEntryRecord's.
+ * Call repeatedly until 0 is returned to enumerate the whole directory.
+ *
+ * The attributes are read with getattrlistbulk, so a whole buffer of entries costs a single system call instead of a
+ * readdir plus a stat per entry.  The attributes are the ones 'lstat' would return, except that the size of a
+ * directory is always reported as 0.  Entries "." and ".." are not returned.
+ * @param fd Descriptor of the directory, opened for reading
+ * @param buffer Buffer receiving the records
+ * @param bufferSize Size of 'buffer', at least 16KB
+ * @param statBufferSize Allocated size of the 'StatBuffer' struct
+ * @result Number of bytes written to 'buffer', 0 once the directory is exhausted, RUNTIME_ERROR (with errno set) on failure.
+*/
+int EnumerateDirectoryWithAttributes(intptr_t fd, char *buffer, long bufferSize, long statBufferSize);
+
 /*!
  * Opens file specified by path.
  * @param path Given path to open
@@ -56,6 +98,22 @@ int StatFileDescriptor(intptr_t fd, StatBuffer *statBuffer, long bufferSize);
 */
 intptr_t Open(const char *path, int32_t flags, int32_t mode);
 
+/*!
+ * Returns information about many files at once, see 'StatFile'.
+ *
+ * The paths are split into chunks that are processed concurrently.  Within a chunk, consecutive paths in the same
+ * directory are resolved relative to a single descriptor of that directory, so callers that pass paths in sorted
+ * order (e.g., an enumeration of a source tree) pay for the directory lookup once per directory instead of once per file.
+ * @param paths Locations of the files
+ * @param count Number of entries in 'paths', 'statBuffers' and 'results'
+ * @param followSymlink Whether to follow symlinks
+ * @param statBuffers Buffers where the file information is stored, one per path
+ * @param results Set to 0 for every file that was successfully stat-ed, the error code (errno) otherwise
+ * @param bufferSize Allocated size of one 'StatBuffer' struct
+ * @result Number of files successfully stat-ed, or RUNTIME_ERROR if 'bufferSize' is wrong.
+*/
+int StatFiles(const char **paths, int count, bool followSymlink, StatBuffer *statBuffers, int *results, long bufferSize);
+
 ssize_t SafeReadLink(const char *path, char *buffer, size_t bufferSize);
 
 int SetTimeStampsForFilePath(const char *path, bool followSymlink, StatBuffer buffer);
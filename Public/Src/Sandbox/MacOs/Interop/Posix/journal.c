@@ -0,0 +1,248 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <CoreServices/CoreServices.h>
+#include <dispatch/dispatch.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/errno.h>
+#include <sys/stat.h>
+
+#include "journal.h"
+
+typedef struct {
+    char *path;
+    uint32_t flags;
+} JournalChange;
+
+typedef struct {
+    JournalChange *changes;
+    size_t count;
+    size_t capacity;
+    bool historyLost;
+    bool historyDone;
+    bool outOfMemory;
+    dispatch_semaphore_t done;
+} JournalReadContext;
+
+uint64_t GetCurrentJournalEventId(void)
+{
+    return FSEventsGetCurrentEventId();
+}
+
+int GetJournalVolumeId(const char *path, char *buffer, long bufferSize)
+{
+    struct stat fileStat;
+    if (stat(path, &fileStat) != 0)
+    {
+        return errno;
+    }
+
+    CFUUIDRef uuid = FSEventsCopyUUIDForDevice(fileStat.st_dev);
+    if (uuid == NULL)
+    {
+        return ENOTSUP;
+    }
+
+    CFStringRef uuidString = CFUUIDCreateString(NULL, uuid);
+    CFRelease(uuid);
+    if (uuidString == NULL)
+    {
+        return ENOMEM;
+    }
+
+    bool copied = CFStringGetCString(uuidString, buffer, bufferSize, kCFStringEncodingUTF8);
+    CFRelease(uuidString);
+    return copied ? 0 : ENAMETOOLONG;
+}
+
+static void AddChange(JournalReadContext *context, const char *path, uint32_t flags)
+{
+    if (context->count == context->capacity)
+    {
+        size_t capacity = context->capacity == 0 ? 64 : context->capacity * 2;
+        JournalChange *changes = (JournalChange *)realloc(context->changes, capacity * sizeof(JournalChange));
+        if (changes == NULL)
+        {
+            context->outOfMemory = true;
+            return;
+        }
+
+        context->changes = changes;
+        context->capacity = capacity;
+    }
+
+    // directories are reported with a trailing '/'
+    size_t length = strlen(path);
+    while (length > 1 && path[length - 1] == '/') length--;
+
+    char *copy = strndup(path, length);
+    if (copy == NULL)
+    {
+        context->outOfMemory = true;
+        return;
+    }
+
+    context->changes[context->count].path = copy;
+    context->changes[context->count].flags = flags;
+    context->count++;
+}
+
+static void OnJournalEvents(ConstFSEventStreamRef stream, void *info, size_t numEvents, void *eventPaths,
+                            const FSEventStreamEventFlags eventFlags[], const FSEventStreamEventId eventIds[])
+{
+    JournalReadContext *context = (JournalReadContext *)info;
+    const char **paths = (const char **)eventPaths;
+
+    for (size_t i = 0; i < numEvents && !context->historyDone; i++)
+    {
+        FSEventStreamEventFlags flags = eventFlags[i];
+        if ((flags & kFSEventStreamEventFlagHistoryDone) != 0)
+        {
+            context->historyDone = true;
+            dispatch_semaphore_signal(context->done);
+            break;
+        }
+
+        if ((flags & (kFSEventStreamEventFlagUserDropped | kFSEventStreamEventFlagKernelDropped | kFSEventStreamEventFlagEventIdsWrapped)) != 0)
+        {
+            context->historyLost = true;
+            continue;
+        }
+
+        // a root that was moved or deleted, or a volume (un)mounted under a root, invalidates everything under it
+        bool recursive = (flags & (kFSEventStreamEventFlagMustScanSubDirs | kFSEventStreamEventFlagRootChanged |
+                                   kFSEventStreamEventFlagMount | kFSEventStreamEventFlagUnmount)) != 0;
+        AddChange(context, paths[i], recursive ? JOURNAL_CHANGE_RECURSIVE : 0);
+    }
+}
+
+static int CompareChanges(const void *a, const void *b)
+{
+    return strcmp(((const JournalChange *)a)->path, ((const JournalChange *)b)->path);
+}
+
+static bool IsUnder(const char *path, const char *ancestor)
+{
+    size_t length = strlen(ancestor);
+    return strncmp(path, ancestor, length) == 0 && (path[length] == '/' || (length == 1 && ancestor[0] == '/'));
+}
+
+// Reports the sorted changes, merging the duplicates and skipping the ones under the last reported recursive change. The latter is
+// best effort (e.g., "/a-b" sorts between "/a" and "/a/c"), but never drops a change that is not covered by a reported one.
+static void ReportChanges(JournalReadContext *context, JournalChangeCallback callback)
+{
+    qsort(context->changes, context->count, sizeof(JournalChange), CompareChanges);
+
+    const char *lastRecursive = NULL;
+    size_t i = 0;
+    while (i < context->count)
+    {
+        const char *path = context->changes[i].path;
+        uint32_t flags = context->changes[i].flags;
+        for (i++; i < context->count && strcmp(context->changes[i].path, path) == 0; i++)
+        {
+            flags |= context->changes[i].flags;
+        }
+
+        if (lastRecursive != NULL && IsUnder(path, lastRecursive))
+        {
+            continue;
+        }
+
+        callback(path, flags);
+        if ((flags & JOURNAL_CHANGE_RECURSIVE) != 0)
+        {
+            lastRecursive = path;
+        }
+    }
+}
+
+int ReadJournalChanges(const char **roots, int rootCount, uint64_t sinceEventId, JournalChangeCallback callback, uint64_t *lastEventId)
+{
+    if (roots == NULL || rootCount <= 0 || callback == NULL || lastEventId == NULL)
+    {
+        return EINVAL;
+    }
+
+    CFMutableArrayRef paths = CFArrayCreateMutable(NULL, rootCount, &kCFTypeArrayCallBacks);
+    for (int i = 0; i < rootCount; i++)
+    {
+        CFStringRef path = CFStringCreateWithCString(NULL, roots[i], kCFStringEncodingUTF8);
+        if (path != NULL)
+        {
+            CFArrayAppendValue(paths, path);
+            CFRelease(path);
+        }
+    }
+
+    // the next call starts from here: changes made from now on are (at worst) reported twice, never missed
+    uint64_t currentEventId = FSEventsGetCurrentEventId();
+
+    JournalReadContext context = { 0 };
+    context.done = dispatch_semaphore_create(0);
+
+    FSEventStreamContext streamContext = { 0, &context, NULL, NULL, NULL };
+    FSEventStreamRef stream = FSEventStreamCreate(NULL, &OnJournalEvents, &streamContext, paths, sinceEventId, /*latency*/ 0,
+                                                  kFSEventStreamCreateFlagNoDefer | kFSEventStreamCreateFlagWatchRoot);
+    CFRelease(paths);
+    if (stream == NULL)
+    {
+        dispatch_release(context.done);
+        return ENOMEM;
+    }
+
+    dispatch_queue_t queue = dispatch_queue_create("com.microsoft.buildxl.interop.journal", DISPATCH_QUEUE_SERIAL);
+    FSEventStreamSetDispatchQueue(stream, queue);
+
+    int result = 0;
+    bool started = FSEventStreamStart(stream);
+    if (!started)
+    {
+        result = EIO;
+    }
+    else if (dispatch_semaphore_wait(context.done, dispatch_time(DISPATCH_TIME_NOW, JOURNAL_READ_TIMEOUT_SEC * NSEC_PER_SEC)) != 0)
+    {
+        result = ETIMEDOUT;
+    }
+
+    // the callback runs on 'queue': once the stream is stopped there, 'context' is no longer written to
+    dispatch_sync(queue, ^{
+        if (started) FSEventStreamStop(stream);
+        FSEventStreamInvalidate(stream);
+    });
+
+    FSEventStreamRelease(stream);
+    dispatch_release(queue);
+    dispatch_release(context.done);
+
+    if (result == 0 && context.outOfMemory)
+    {
+        result = ENOMEM;
+    }
+
+    if (result == 0)
+    {
+        if (context.historyLost)
+        {
+            for (int i = 0; i < rootCount; i++)
+            {
+                callback(roots[i], JOURNAL_CHANGE_RECURSIVE | JOURNAL_CHANGE_HISTORY_LOST);
+            }
+        }
+        else
+        {
+            ReportChanges(&context, callback);
+        }
+
+        *lastEventId = currentEventId;
+    }
+
+    for (size_t i = 0; i < context.count; i++)
+    {
+        free(context.changes[i].path);
+    }
+
+    free(context.changes);
+    return result;
+}
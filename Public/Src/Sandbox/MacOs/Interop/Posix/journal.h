@@ -0,0 +1,64 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef journal_h
+#define journal_h
+
+#include "Dependencies.h"
+
+/*!
+ * A change journal on top of FSEvents: the event ids of FSEvents are persistent (fseventsd keeps the history of every volume
+ * that supports it), so a caller that remembers the id returned by 'ReadJournalChanges' can later ask for what changed since,
+ * instead of scanning its trees again.
+ *
+ * FSEvents reports directories, not files: a change means "some entry of this directory changed" and has to be followed by
+ * an enumeration of that directory.  Ids only make sense for the event database they come from, which is identified by
+ * 'GetJournalVolumeId'; when that id changes (e.g., the database was purged or the volume reformatted), the history is gone.
+ */
+
+/*! Every entry under the path (not only its direct entries) may have changed */
+#define JOURNAL_CHANGE_RECURSIVE    0x1
+
+/*!
+ * The history since the requested id is not (fully) available (e.g., events were dropped or the ids wrapped around): the
+ * change is reported once per root, together with JOURNAL_CHANGE_RECURSIVE, and the roots have to be scanned entirely
+ */
+#define JOURNAL_CHANGE_HISTORY_LOST 0x2
+
+/*! How long (in seconds) 'ReadJournalChanges' waits for FSEvents to replay the history before giving up */
+#define JOURNAL_READ_TIMEOUT_SEC    30
+
+/*!
+ * Called once per (coalesced) changed directory.
+ * @param path Absolute path of the directory, without a trailing '/'
+ * @param flags JOURNAL_CHANGE_* flags
+ */
+typedef void (*JournalChangeCallback)(const char *path, uint32_t flags);
+
+/*!
+ * Returns the id of the most recent FSEvents event (the id to pass to 'ReadJournalChanges' to see the changes from now on).
+ */
+uint64_t GetCurrentJournalEventId(void);
+
+/*!
+ * Copies the UUID of the FSEvents database of the volume on which 'path' resides into 'buffer' (as a NUL terminated string).
+ * @result 0 on success, ENOTSUP if the volume has no event database, the error code (errno) otherwise.
+ */
+int GetJournalVolumeId(const char *path, char *buffer, long bufferSize);
+
+/*!
+ * Reports the directories under 'roots' that changed after the event 'sinceEventId'.
+ *
+ * The changes are coalesced before they are reported: a directory is reported once (with the union of its flags), and not at
+ * all when one of its ancestors is reported with JOURNAL_CHANGE_RECURSIVE.  They are reported on the calling thread, after the
+ * history has been read.
+ * @param roots Absolute paths of the trees to look at
+ * @param rootCount Number of entries in 'roots'
+ * @param sinceEventId Id returned by an earlier call (or by 'GetCurrentJournalEventId')
+ * @param callback Receives the changes
+ * @param lastEventId Set to the id to pass to the next call; changes made while this call runs may be reported by both
+ * @result 0 on success, ETIMEDOUT if the history could not be read within JOURNAL_READ_TIMEOUT_SEC, the error code otherwise.
+ */
+int ReadJournalChanges(const char **roots, int rootCount, uint64_t sinceEventId, JournalChangeCallback callback, uint64_t *lastEventId);
+
+#endif /* journal_h */
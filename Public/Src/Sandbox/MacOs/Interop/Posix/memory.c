@@ -1,7 +1,17 @@
 // Copyright (c) Microsoft. All rights reserved.
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
 
+#include <dispatch/dispatch.h>
+#include <stdlib.h>
+
 #include "memory.h"
+#include "process.h"
+
+typedef struct {
+    dispatch_queue_t queue;
+    dispatch_source_t source;
+    dispatch_semaphore_t cancelled;
+} MemoryPressureNotifications;
 
 int GetRamUsageInfo(RamUsageInfo *buffer, long bufferSize)
 {
@@ -71,6 +81,14 @@ static uint64_t ProcessTreeResidentSize(pid_t pid, const rlim_t max_proc_count,
 
 int GetPeakWorkingSetSize(pid_t pid, uint64_t *buffer, bool includeChildren)
 {
+    // Pips tracked by the sandbox are sampled periodically, only walk process trees it does not know about
+    ProcessTreeUsage usage;
+    if (includeChildren && GetProcessTreeUsage(pid, &usage))
+    {
+        *buffer = usage.residentSize;
+        return KERN_SUCCESS;
+    }
+
     struct rlimit rl;
     bool success = getrlimit(RLIMIT_NPROC, &rl) == 0;
 
@@ -94,3 +112,71 @@ int GetMemoryPressureLevel(int *level)
     size_t length = sizeof(int);
     return sysctlbyname("kern.memorystatus_vm_pressure_level", level, &length, NULL, 0);
 }
+
+void *StartMemoryPressureNotifications(MemoryPressureCallback callback)
+{
+    if (callback == NULL)
+    {
+        return NULL;
+    }
+
+    MemoryPressureNotifications *notifications = (MemoryPressureNotifications *)calloc(1, sizeof(MemoryPressureNotifications));
+    if (notifications == NULL)
+    {
+        return NULL;
+    }
+
+    notifications->queue = dispatch_queue_create("com.microsoft.buildxl.interop.memorypressure", DISPATCH_QUEUE_SERIAL);
+    notifications->source = dispatch_source_create(DISPATCH_SOURCE_TYPE_MEMORYPRESSURE, 0,
+                                                   DISPATCH_MEMORYPRESSURE_NORMAL | DISPATCH_MEMORYPRESSURE_WARN | DISPATCH_MEMORYPRESSURE_CRITICAL,
+                                                   notifications->queue);
+    if (notifications->source == NULL)
+    {
+        dispatch_release(notifications->queue);
+        free(notifications);
+        return NULL;
+    }
+
+    notifications->cancelled = dispatch_semaphore_create(0);
+
+    dispatch_source_t source = notifications->source;
+    dispatch_semaphore_t cancelled = notifications->cancelled;
+    dispatch_source_set_event_handler(source, ^{
+        // transitions that happen in a row are coalesced: the current level is the one that matters
+        int level;
+        if (GetMemoryPressureLevel(&level) != 0)
+        {
+            unsigned long data = dispatch_source_get_data(source);
+            level = (data & DISPATCH_MEMORYPRESSURE_CRITICAL) != 0 ? DISPATCH_MEMORYPRESSURE_CRITICAL
+                  : (data & DISPATCH_MEMORYPRESSURE_WARN) != 0     ? DISPATCH_MEMORYPRESSURE_WARN
+                  :                                                  DISPATCH_MEMORYPRESSURE_NORMAL;
+        }
+
+        callback(level);
+    });
+
+    // runs on the queue once the event handler has returned (if it was running)
+    dispatch_source_set_cancel_handler(source, ^{
+        dispatch_semaphore_signal(cancelled);
+    });
+
+    dispatch_resume(source);
+    return notifications;
+}
+
+void StopMemoryPressureNotifications(void *handle)
+{
+    MemoryPressureNotifications *notifications = (MemoryPressureNotifications *)handle;
+    if (notifications == NULL)
+    {
+        return;
+    }
+
+    dispatch_source_cancel(notifications->source);
+    dispatch_semaphore_wait(notifications->cancelled, DISPATCH_TIME_FOREVER);
+
+    dispatch_release(notifications->source);
+    dispatch_release(notifications->cancelled);
+    dispatch_release(notifications->queue);
+    free(notifications);
+}
@@ -27,4 +27,14 @@ int GetRamUsageInfo(RamUsageInfo *buffer, long bufferSize);
 int GetPeakWorkingSetSize(pid_t pid, uint64_t *buffer, bool includeChildren);
 int GetMemoryPressureLevel(int *level);
 
+// Receives the memory pressure level (DISPATCH_MEMORYPRESSURE_NORMAL, _WARN or _CRITICAL) whenever it changes
+typedef void (*MemoryPressureCallback)(int level);
+
+// Calls 'callback' (on a private serial queue) on every memory pressure transition, until the returned handle is passed to
+// 'StopMemoryPressureNotifications'. Returns NULL if the notifications can't be set up.
+void *StartMemoryPressureNotifications(MemoryPressureCallback callback);
+
+// Once this returns, 'callback' is not (and won't be) running anymore: must not be called from 'callback'
+void StopMemoryPressureNotifications(void *notifications);
+
 #endif /* memory_h */
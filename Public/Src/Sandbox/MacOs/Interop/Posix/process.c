@@ -5,6 +5,7 @@
 #include <dispatch/dispatch.h>
 #include <inttypes.h>
 #include <signal.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/sysctl.h>
@@ -12,6 +13,19 @@
 
 #include "process.h"
 
+static _Atomic(ProcessTreeUsageProvider) tree_usage_provider = NULL;
+
+void SetProcessTreeUsageProvider(ProcessTreeUsageProvider provider)
+{
+    atomic_store(&tree_usage_provider, provider);
+}
+
+bool GetProcessTreeUsage(pid_t rootPid, ProcessTreeUsage *usage)
+{
+    ProcessTreeUsageProvider provider = atomic_load(&tree_usage_provider);
+    return provider != NULL && provider(rootPid, usage);
+}
+
 int GetProcessResourceUsage(pid_t pid, ProcessResourceUsage *buffer, long bufferSize, bool includeChildProcesses)
 {
     if (sizeof(ProcessResourceUsage) != bufferSize)
@@ -54,6 +68,14 @@ int GetProcessResourceUsage(pid_t pid, ProcessResourceUsage *buffer, long buffer
     {
         buffer->systemTime += rusage.ri_child_system_time;
         buffer->userTime += rusage.ri_child_user_time;
+
+        ProcessTreeUsage usage;
+        if (GetProcessTreeUsage(pid, &usage))
+        {
+            buffer->rss = usage.residentSize;
+            buffer->peak_rss = usage.peakResidentSize;
+            buffer->child_count = usage.processCount - 1;
+        }
     }
 
     return KERN_SUCCESS;
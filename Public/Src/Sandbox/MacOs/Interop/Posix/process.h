@@ -22,6 +22,27 @@ typedef struct {
 
 int GetProcessResourceUsage(pid_t pid, ProcessResourceUsage *buffer, long bufferSize, bool includeChildProcesses);
 
+// Resource usage of a whole process tree, as last sampled by the sandbox
+typedef struct {
+    uint64_t residentSize;
+    uint64_t peakResidentSize;
+    int processCount;
+} ProcessTreeUsage;
+
+// Answers tree queries from state the sandbox keeps up to date, returns false for process trees it does not know about
+typedef bool (*ProcessTreeUsageProvider)(pid_t rootPid, ProcessTreeUsage *usage);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void SetProcessTreeUsageProvider(ProcessTreeUsageProvider provider);
+bool GetProcessTreeUsage(pid_t rootPid, ProcessTreeUsage *usage);
+
+#ifdef __cplusplus
+}
+#endif
+
 typedef struct {
     char *outputPath;
 } CoreDumpConfiguration;
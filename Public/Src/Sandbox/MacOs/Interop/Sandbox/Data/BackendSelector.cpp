@@ -0,0 +1,218 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "BackendSelector.hpp"
+#include "BuildXLSandboxShared.hpp"
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+
+#include <stdio.h>
+
+static uint64_t NowNs()
+{
+    return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void BackendSelector::Stats::Add(const Stats &other)
+{
+    processes              += other.processes;
+    lifetimeNs             += other.lifetimeNs;
+    interposedEvents       += other.interposedEvents;
+    endpointSecurityEvents += other.endpointSecurityEvents;
+    matchedEvents          += other.matchedEvents;
+    endpointSecurityLagNs  += other.endpointSecurityLagNs;
+}
+
+void BackendSelector::Stats::Halve()
+{
+    processes              /= 2;
+    lifetimeNs             /= 2;
+    interposedEvents       /= 2;
+    endpointSecurityEvents /= 2;
+    matchedEvents          /= 2;
+    endpointSecurityLagNs  /= 2;
+}
+
+char BackendSelector::Decide(const Stats &stats)
+{
+    if (stats.processes < kMinProcesses || stats.interposedEvents == 0 || stats.lifetimeNs == 0)
+    {
+        return kInterposing;
+    }
+
+    // (events / ns) * 1e9 without overflowing for long running tools
+    double eventsPerSecond = (double) stats.interposedEvents * 1e9 / (double) stats.lifetimeNs;
+    bool covered = stats.matchedEvents * 100 >= stats.interposedEvents * kMinCoveragePercent;
+    bool timely = stats.matchedEvents > 0 && stats.endpointSecurityLagNs / stats.matchedEvents <= kMaxEndpointSecurityLagNs;
+
+    return eventsPerSecond >= kMinInterposedEventsPerSecond && covered && timely ? kEndpointSecurity : kInterposing;
+}
+
+void BackendSelector::Load(const char *path)
+{
+    cachePath_.assign(path);
+    executables_.clear();
+
+    std::ifstream file(cachePath_);
+    std::string line;
+    if (!std::getline(file, line) || line != kCacheHeader)
+    {
+        return;
+    }
+
+    while (std::getline(file, line))
+    {
+        std::istringstream fields(line);
+        ExecutableStats entry;
+        std::string backend, executable;
+        if (!std::getline(fields, backend, '\t') || backend.length() != 1)
+        {
+            continue;
+        }
+
+        fields >> entry.stats.processes >> entry.stats.lifetimeNs >> entry.stats.interposedEvents
+               >> entry.stats.endpointSecurityEvents >> entry.stats.matchedEvents >> entry.stats.endpointSecurityLagNs;
+        if (!fields || fields.get() != '\t' || !std::getline(fields, executable) || executable.empty())
+        {
+            continue;
+        }
+
+        entry.backend = backend[0];
+        executables_[executable] = entry;
+    }
+
+    log_debug("Loaded Hybrid backend statistics of %zu executables from %{public}s", executables_.size(), cachePath_.c_str());
+}
+
+void BackendSelector::FoldProcess(const ProcessStats &process)
+{
+    Stats stats = process.stats;
+    stats.processes = 1;
+    stats.lifetimeNs = process.lastEventNs - process.firstEventNs;
+
+    ExecutableStats &entry = executables_[process.executable];
+    entry.stats.Add(stats);
+    if (entry.stats.processes >= kMaxProcesses)
+    {
+        entry.stats.Halve();
+    }
+}
+
+void BackendSelector::RecordEvent(const IOEvent &event, IOEventBacking backing, bool matched, uint64_t lagNs)
+{
+    if (!IsEnabled())
+    {
+        return;
+    }
+
+    uint64_t now = NowNs();
+    pid_t pid = event.GetPid();
+    es_event_type_t eventType = event.GetEventType();
+
+    auto it = processes_.find(pid);
+    if (it != processes_.end() && (eventType == ES_EVENT_TYPE_NOTIFY_EXIT || eventType == ES_EVENT_TYPE_NOTIFY_EXEC))
+    {
+        // Both sources report the exit (and the exec): the first report ends the process (or its image), the second one is ignored
+        if (eventType == ES_EVENT_TYPE_NOTIFY_EXEC && it->second.executable == event.GetSrcPath())
+        {
+            return;
+        }
+
+        it->second.lastEventNs = now;
+        FoldProcess(it->second);
+        processes_.erase(it);
+        it = processes_.end();
+
+        if (eventType == ES_EVENT_TYPE_NOTIFY_EXIT)
+        {
+            return;
+        }
+    }
+
+    if (it == processes_.end())
+    {
+        if (eventType == ES_EVENT_TYPE_NOTIFY_EXIT)
+        {
+            return;
+        }
+
+        ProcessStats process;
+        process.executable = eventType == ES_EVENT_TYPE_NOTIFY_EXEC ? event.GetSrcPath() : event.GetExecutablePath();
+        process.firstEventNs = now;
+        it = processes_.emplace(pid, std::move(process)).first;
+    }
+
+    ProcessStats &process = it->second;
+    process.lastEventNs = now;
+
+    if (backing == IOEventBacking::Interposing)
+    {
+        process.stats.interposedEvents++;
+    }
+    else
+    {
+        process.stats.endpointSecurityEvents++;
+    }
+
+    if (matched)
+    {
+        process.stats.matchedEvents++;
+        if (backing == IOEventBacking::EndpointSecurity)
+        {
+            process.stats.endpointSecurityLagNs += lagNs;
+        }
+    }
+}
+
+bool BackendSelector::Save()
+{
+    if (!IsEnabled())
+    {
+        return false;
+    }
+
+    for (const auto &process : processes_)
+    {
+        FoldProcess(process.second);
+    }
+
+    processes_.clear();
+
+    // Written next to the cache and renamed over it: the interposing library of a running build may be reading it
+    std::string tempPath = cachePath_ + "." + std::to_string(getpid());
+    size_t endpointSecurityOnly = 0;
+    {
+        std::ofstream file(tempPath, std::ios::trunc);
+        file << kCacheHeader << "\n";
+        for (auto &executable : executables_)
+        {
+            ExecutableStats &entry = executable.second;
+            entry.backend = Decide(entry.stats);
+            endpointSecurityOnly += entry.backend == kEndpointSecurity ? 1 : 0;
+
+            file << entry.backend << '\t' << entry.stats.processes << '\t' << entry.stats.lifetimeNs << '\t'
+                 << entry.stats.interposedEvents << '\t' << entry.stats.endpointSecurityEvents << '\t'
+                 << entry.stats.matchedEvents << '\t' << entry.stats.endpointSecurityLagNs << '\t' << executable.first << "\n";
+        }
+
+        file.flush();
+        if (!file)
+        {
+            file.close();
+            unlink(tempPath.c_str());
+            return false;
+        }
+    }
+
+    if (rename(tempPath.c_str(), cachePath_.c_str()) != 0)
+    {
+        unlink(tempPath.c_str());
+        return false;
+    }
+
+    log_debug("Saved Hybrid backend statistics of %zu executables (%zu observed with EndpointSecurity only) to %{public}s",
+              executables_.size(), endpointSecurityOnly, cachePath_.c_str());
+    return true;
+}
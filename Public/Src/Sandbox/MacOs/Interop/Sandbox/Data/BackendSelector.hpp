@@ -0,0 +1,118 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef BackendSelector_hpp
+#define BackendSelector_hpp
+
+#include "stdafx.h"
+#include "IOEvent.hpp"
+
+#include <map>
+#include <string>
+#include <unordered_map>
+
+/*!
+ * Picks, per executable, the source a Hybrid sandbox observes its processes with.  Both sources report most accesses, but
+ * they don't cost the same: every access the interposing library reports is a message sent (and often a path resolved) in
+ * the process itself, whereas EndpointSecurity observes from the outside.  A tool making millions of small accesses pays for
+ * the former on every one of them, for reports that EndpointSecurity delivers anyway.
+ *
+ * The Hybrid event queue feeds every event of a tracked process to 'RecordEvent', which keeps per executable statistics: how
+ * many events per second its processes report through each source, how many of the interposed ones EndpointSecurity reported
+ * too (the events the deduplicator matched), and how much later EndpointSecurity did (its observed latency).  An executable
+ * whose processes report a lot through interposing, most of which EndpointSecurity also reports without lagging behind, is
+ * observed with EndpointSecurity only: the interposing library is not injected into the images it execs (see Detours.cpp).
+ *
+ * The statistics, and the decisions made from them, persist across builds in a cache file: decisions are only applied by the
+ * interposing library of the next build, which reads the file named by 'kBackendCacheEnvVar'.  Format (text, one executable
+ * per line): "<I|E>\t<processes>\t<lifetime ns>\t<interposed events>\t<ES events>\t<matched events>\t<ES lag ns>\t<path>".
+ *
+ * Not thread-safe: meant to be used from the serial queue that merges the events of both sources.
+ */
+class BackendSelector final
+{
+
+public:
+
+    /*! Environment variable naming the cache file to the interposing library of the processes of a Hybrid sandbox */
+    static constexpr const char *kBackendCacheEnvVar = "BUILDXL_HYBRID_BACKENDS";
+
+    static const char kInterposing      = 'I';
+    static const char kEndpointSecurity = 'E';
+
+private:
+
+    static constexpr const char *kCacheHeader = "BXLBACKENDS1";
+
+    /*! An executable needs this many processes observed (in this and earlier builds) before it is switched to EndpointSecurity */
+    static const uint64_t kMinProcesses = 3;
+
+    /*! Interposed events per second (over the lifetime of its processes) from which an executable is worth switching */
+    static const uint64_t kMinInterposedEventsPerSecond = 20000;
+
+    /*! Which part (in percent) of the interposed events EndpointSecurity must have reported too */
+    static const uint64_t kMinCoveragePercent = 98;
+
+    /*! How much later (on average) EndpointSecurity may report an access the interposing library reported first */
+    static const uint64_t kMaxEndpointSecurityLagNs = 20 * 1000 * 1000;
+
+    /*! The statistics of an executable are halved once it has this many processes, so that they follow the tool as it changes */
+    static const uint64_t kMaxProcesses = 1000;
+
+    struct Stats
+    {
+        uint64_t processes = 0;
+        uint64_t lifetimeNs = 0;
+        uint64_t interposedEvents = 0;
+        uint64_t endpointSecurityEvents = 0;
+        uint64_t matchedEvents = 0;
+        uint64_t endpointSecurityLagNs = 0;
+
+        void Add(const Stats &other);
+        void Halve();
+    };
+
+    struct ProcessStats
+    {
+        std::string executable;
+        uint64_t firstEventNs = 0;
+        uint64_t lastEventNs = 0;
+        Stats stats;
+    };
+
+    struct ExecutableStats
+    {
+        char backend = kInterposing;
+        Stats stats;
+    };
+
+    std::string cachePath_;
+    std::unordered_map<pid_t, ProcessStats> processes_;
+    std::map<std::string, ExecutableStats> executables_;
+
+    void FoldProcess(const ProcessStats &process);
+    static char Decide(const Stats &stats);
+
+public:
+
+    BackendSelector() = default;
+
+    BackendSelector(const BackendSelector&) = delete;
+    BackendSelector& operator=(const BackendSelector&) = delete;
+
+    inline bool IsEnabled() const { return !cachePath_.empty(); }
+
+    /*! Loads the statistics of earlier builds from 'path' (a missing or unreadable file is treated as empty) and enables the selector */
+    void Load(const char *path);
+
+    /*!
+     * Records an event of a tracked process.  'matched' tells whether the deduplicator recognized it as reported by the other
+     * source already, in which case 'lagNs' is how long after the other report it arrived.
+     */
+    void RecordEvent(const IOEvent &event, IOEventBacking backing, bool matched, uint64_t lagNs);
+
+    /*! Folds the processes still running into the statistics, decides on every executable and writes the cache file */
+    bool Save();
+};
+
+#endif /* BackendSelector_hpp */
@@ -0,0 +1,262 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef ESEventRing_hpp
+#define ESEventRing_hpp
+
+#include <atomic>
+#include <bsm/libbsm.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "IOEvent.hpp"
+
+/*!
+ * A bounded, single-producer single-consumer ring of serialized IOEvents in memory shared (through xpc_shmem) by an
+ * EndpointSecurity client of the system extension, the producer, and the EndpointSecuritySandbox of the build host, the
+ * consumer.  Without it, every event is an XPC message the host replies to, and creating and answering these messages is
+ * most of what the extension does at high event rates; with it, handing an event to the host is a copy into the ring.
+ *
+ * Every EndpointSecurity client creates a ring of its own: EndpointSecurity calls the handler of a client on a serial queue,
+ * which is thus the single producer, and the host drains the ring from the handler of the connection of the client, which
+ * XPC serializes too.  Records are variable sized (an ESEventRecord followed by the event), 8-byte aligned, and never wrap
+ * around the end of the ring: a record that does not fit before the end is preceded by a padding record (or, if not even a
+ * record header fits, by the remaining bytes, which the consumer skips as well).  'head' and 'tail' are byte positions that
+ * only grow; the producer publishes records by storing 'head' (release), the consumer frees them by storing 'tail'.  All the
+ * state lives in the shared memory, which both processes map at different addresses, hence it is position independent.
+ *
+ * Doorbell: when the consumer runs out of records it sets 'readerWaiting' and returns; a producer that publishes a record and
+ * finds 'readerWaiting' set clears it and sends an ESEventRingDoorbellKey message on the XPC connection, upon which the host
+ * drains the ring again.  A busy host thus receives no message at all for most events.
+ *
+ * Reverse channel: NOTIFY events the host is done with are not answered.  The host only sends a message back (a dictionary
+ * with the 'response' and the ESEventDecisionIdKey and ESEventDecisionAuditTokenKey of the record) for events whose process
+ * has to be muted and for the AUTH events (flagged with kESEventRecordAuth), which the extension holds on to until then.
+ *
+ * Events that don't fit in the ring (it is full, or the event is larger than a quarter of it) are sent as XPC messages, as
+ * without a ring.  The host drains the ring before it processes such a message, so that the events of a client stay in order.
+ */
+
+#define ESEventRingMagic   0x474e5245 // "ERNG"
+#define ESEventRingVersion 1
+
+#define ESEventRingHeaderSize 256
+
+// Keys of the messages a client sends on its connection: the ring (an xpc_shmem, sent once before any event), and the doorbell
+#define ESEventRingKey "ESEventRing"
+#define ESEventRingDoorbellKey "ESEventRing::Doorbell"
+
+// Keys of the decisions the host sends back on the connection of a client
+#define ESEventDecisionIdKey "ESEventRing::Id"
+#define ESEventDecisionAuditTokenKey "ESEventRing::AuditToken"
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+
+    // Number of bytes of records (a power of 2)
+    uint32_t capacity;
+    uint32_t reserved;
+
+    alignas(64) std::atomic<uint64_t> head;
+
+    // Written only by the consumer
+    alignas(64) std::atomic<uint64_t> tail;
+
+    alignas(64) std::atomic<uint32_t> readerWaiting;
+} ESEventRingHeader;
+
+static const uint32_t kESEventRecordAuth    = 0x1;
+static const uint32_t kESEventRecordPadding = 0x2;
+
+typedef struct
+{
+    // Number of bytes of the serialized event that follows
+    uint32_t length;
+    uint32_t flags;
+
+    // Identifies the event in the decisions the host sends back
+    uint64_t id;
+
+    // The process that caused the event, for the host to send back along with a decision to mute it
+    audit_token_t auditToken;
+} ESEventRecord;
+
+static_assert(sizeof(ESEventRingHeader) <= ESEventRingHeaderSize, "ring header too large");
+static_assert(sizeof(ESEventRecord) % 8 == 0, "records must keep the ring 8-byte aligned");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "ring atomics must be address-free to be shared across processes");
+
+class ESEventRing final
+{
+
+private:
+
+    ESEventRingHeader *header_;
+    char *records_;
+    uint64_t capacity_;
+
+    ESEventRing(void *memory) : header_((ESEventRingHeader *) memory), records_((char *) memory + ESEventRingHeaderSize), capacity_(header_->capacity) {}
+
+    static inline uint64_t RecordSize(uint32_t length)
+    {
+        return (sizeof(ESEventRecord) + length + 7) & ~(uint64_t) 7;
+    }
+
+public:
+
+    ESEventRing(const ESEventRing&) = delete;
+    ESEventRing& operator=(const ESEventRing&) = delete;
+
+    /*! Lays out an empty ring in 'memory' (of 'size' bytes, page aligned) for the producer, returns nullptr if it is too small */
+    static ESEventRing* Initialize(void *memory, size_t size)
+    {
+        if (size < ESEventRingHeaderSize + 4096)
+        {
+            return nullptr;
+        }
+
+        uint64_t capacity = 4096;
+        while (capacity * 2 <= size - ESEventRingHeaderSize && capacity * 2 <= UINT32_MAX)
+        {
+            capacity *= 2;
+        }
+
+        ESEventRingHeader *header = (ESEventRingHeader *) memory;
+        header->version = ESEventRingVersion;
+        header->capacity = (uint32_t) capacity;
+        header->head.store(0, std::memory_order_relaxed);
+        header->tail.store(0, std::memory_order_relaxed);
+
+        // No consumer is draining yet: the first record rings the doorbell
+        header->readerWaiting.store(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        header->magic = ESEventRingMagic;
+
+        return new ESEventRing(memory);
+    }
+
+    /*! Attaches the consumer to a ring initialized by the producer, returns nullptr if 'memory' does not hold a valid ring */
+    static ESEventRing* Attach(void *memory, size_t size)
+    {
+        ESEventRingHeader *header = (ESEventRingHeader *) memory;
+        if (memory == nullptr || size < ESEventRingHeaderSize ||
+            header->magic != ESEventRingMagic ||
+            header->version != ESEventRingVersion ||
+            header->capacity < 4096 ||
+            (header->capacity & (header->capacity - 1)) != 0 ||
+            size < ESEventRingHeaderSize + (size_t) header->capacity)
+        {
+            return nullptr;
+        }
+
+        return new ESEventRing(memory);
+    }
+
+    /*!
+     * Producer: copies 'event' into the ring.  Returns false if it does not fit, in which case the caller sends the event
+     * some other way.  Upon success, 'ringDoorbell' tells whether the caller must wake the consumer up.
+     */
+    bool TryEnqueue(const IOEvent &event, uint64_t id, uint32_t flags, const audit_token_t *auditToken, bool &ringDoorbell)
+    {
+        ringDoorbell = false;
+
+        size_t length = event.SerializedSize();
+        uint64_t size = RecordSize((uint32_t) length);
+        if (length > UINT32_MAX || size > capacity_ / 4)
+        {
+            return false;
+        }
+
+        uint64_t head = header_->head.load(std::memory_order_relaxed);
+        uint64_t offset = head & (capacity_ - 1);
+        uint64_t padding = capacity_ - offset < size ? capacity_ - offset : 0;
+        if (capacity_ - (head - header_->tail.load(std::memory_order_acquire)) < padding + size)
+        {
+            return false; // full
+        }
+
+        if (padding >= sizeof(ESEventRecord))
+        {
+            ESEventRecord skip = { 0, kESEventRecordPadding, 0, {} };
+            memcpy(records_ + offset, &skip, sizeof(skip));
+        }
+
+        head += padding;
+        offset = head & (capacity_ - 1);
+
+        ESEventRecord record = { (uint32_t) length, flags, id, *auditToken };
+        memcpy(records_ + offset, &record, sizeof(record));
+        event.Serialize(records_ + offset + sizeof(record), length);
+
+        header_->head.store(head + size, std::memory_order_release);
+
+        // pairs with the consumer setting 'readerWaiting' and then re-checking the ring before returning
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        ringDoorbell = header_->readerWaiting.load(std::memory_order_relaxed) != 0 && header_->readerWaiting.exchange(0) != 0;
+        return true;
+    }
+
+    /*!
+     * Consumer: hands every record in the ring to 'callback' (as 'const ESEventRecord &, const char *event'), which must be
+     * done with the event when it returns, until the ring is empty; then sets 'readerWaiting' for the next record to ring the
+     * doorbell.  Returns the number of events.
+     */
+    template <typename Callback>
+    size_t Drain(Callback callback)
+    {
+        size_t count = 0;
+        uint64_t tail = header_->tail.load(std::memory_order_relaxed);
+        while (true)
+        {
+            uint64_t head = header_->head.load(std::memory_order_acquire);
+            if (tail == head)
+            {
+                header_->readerWaiting.store(1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (header_->head.load(std::memory_order_acquire) == tail)
+                {
+                    return count;
+                }
+
+                header_->readerWaiting.store(0, std::memory_order_relaxed);
+                continue;
+            }
+
+            while (tail != head)
+            {
+                uint64_t offset = tail & (capacity_ - 1);
+                if (capacity_ - offset < sizeof(ESEventRecord))
+                {
+                    tail += capacity_ - offset;
+                    continue;
+                }
+
+                ESEventRecord record;
+                memcpy(&record, records_ + offset, sizeof(record));
+                if (record.flags & kESEventRecordPadding)
+                {
+                    tail += capacity_ - offset;
+                    continue;
+                }
+
+                // A record never wraps, and is never larger than a quarter of the ring: anything else means a corrupted ring
+                if (RecordSize(record.length) > capacity_ - offset)
+                {
+                    log_error("Dropping the EndpointSecurity events of a corrupted event ring (record of length %u)", record.length);
+                    tail = head;
+                    break;
+                }
+
+                callback(const_cast<const ESEventRecord &>(record), (const char *) records_ + offset + sizeof(record));
+                tail += RecordSize(record.length);
+                count++;
+            }
+
+            header_->tail.store(tail, std::memory_order_release);
+        }
+    }
+};
+
+#endif /* ESEventRing_hpp */
@@ -0,0 +1,105 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "EventDeduplicator.hpp"
+
+#include <chrono>
+
+bool EventDeduplicator::IsEligible(const IOEvent &event)
+{
+    switch (event.GetEventType())
+    {
+        case ES_EVENT_TYPE_NOTIFY_FORK:
+        case ES_EVENT_TYPE_NOTIFY_EXEC:
+        case ES_EVENT_TYPE_NOTIFY_EXIT:
+            return false;
+        default:
+            return event.GetActionType() == ES_ACTION_TYPE_NOTIFY;
+    }
+}
+
+uint64_t EventDeduplicator::Hash(const IOEvent &event)
+{
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&hash](const void *data, size_t length)
+    {
+        const unsigned char *bytes = (const unsigned char *) data;
+        for (size_t i = 0; i < length; i++)
+        {
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+    };
+
+    pid_t pid = event.GetPid();
+    es_event_type_t eventType = event.GetEventType();
+    mix(&pid, sizeof(pid));
+    mix(&eventType, sizeof(eventType));
+
+    // The terminating NUL keeps ("ab", "c") and ("a", "bc") apart
+    mix(event.GetSrcPath().c_str(), event.GetSrcPath().length() + 1);
+    mix(event.GetDstPath().c_str(), event.GetDstPath().length() + 1);
+
+    return hash;
+}
+
+uint64_t EventDeduplicator::Now()
+{
+    return (uint64_t) std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool EventDeduplicator::Matches(const Slot &slot, uint64_t hash, const IOEvent &event)
+{
+    return slot.used &&
+           slot.hash == hash &&
+           slot.pid == event.GetPid() &&
+           slot.eventType == event.GetEventType() &&
+           slot.srcPath == event.GetSrcPath() &&
+           slot.dstPath == event.GetDstPath();
+}
+
+bool EventDeduplicator::IsDuplicate(const IOEvent &event, IOEventBacking backing, uint64_t *lagNs)
+{
+    if (!IsEligible(event))
+    {
+        return false;
+    }
+
+    uint64_t hash = Hash(event);
+    Slot &slot = SlotFor(hash);
+    uint64_t lag = Now() - slot.timestamp;
+    if (!Matches(slot, hash, event) || slot.backing == backing || lag > kWindowNs)
+    {
+        return false;
+    }
+
+    slot.used = false;
+    if (lagNs != nullptr)
+    {
+        *lagNs = lag;
+    }
+
+    return true;
+}
+
+void EventDeduplicator::Remember(const IOEvent &event, IOEventBacking backing)
+{
+    if (!IsEligible(event))
+    {
+        return;
+    }
+
+    uint64_t hash = Hash(event);
+    Slot &slot = SlotFor(hash);
+
+    slot.used      = true;
+    slot.hash      = hash;
+    slot.timestamp = Now();
+    slot.pid       = event.GetPid();
+    slot.eventType = event.GetEventType();
+    slot.backing   = backing;
+
+    // Assigning reuses the capacity of the strings, so a slot stops allocating once it has seen a path as long as the current one
+    slot.srcPath.assign(event.GetSrcPath());
+    slot.dstPath.assign(event.GetDstPath());
+}
@@ -0,0 +1,80 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef EventDeduplicator_hpp
+#define EventDeduplicator_hpp
+
+#include "stdafx.h"
+#include "IOEvent.hpp"
+
+#include <string>
+#include <vector>
+
+/*!
+ * Recognizes events a Hybrid sandbox receives from both of its sources: an access is reported once by the EndpointSecurity
+ * clients and once by the interposing library, and the second report carries no new information.  Two events are the same
+ * access when their process id, event type, and paths are equal and they arrived from different sources within a short window.
+ *
+ * Only plain notifications are considered: process tree events (fork, exec, exit) and authorization events have side effects
+ * beyond reporting an access and are never reported as duplicates.
+ *
+ * Remembered events live in a fixed number of slots (a newer event evicts an older one hashing to the same slot), which bounds
+ * the memory used at the cost of letting some duplicates through; an event that isn't an exact duplicate is never matched.
+ *
+ * Not thread-safe: meant to be used from the serial queue that merges the events of both sources.
+ */
+class EventDeduplicator final
+{
+
+private:
+
+    static const uint32_t kSlotCountBits = 12;
+    static const uint32_t kSlotCount     = 1 << kSlotCountBits;
+
+    /*! How long (in nanoseconds) an event is remembered for */
+    static const uint64_t kWindowNs      = 100 * 1000 * 1000;
+
+    struct Slot
+    {
+        bool used = false;
+        uint64_t hash = 0;
+        uint64_t timestamp = 0;
+        pid_t pid = 0;
+        es_event_type_t eventType;
+        IOEventBacking backing;
+        std::string srcPath;
+        std::string dstPath;
+    };
+
+    std::vector<Slot> slots_;
+
+    static bool IsEligible(const IOEvent &event);
+    static uint64_t Hash(const IOEvent &event);
+    static uint64_t Now();
+
+    inline Slot& SlotFor(uint64_t hash) { return slots_[hash & (kSlotCount - 1)]; }
+
+    static bool Matches(const Slot &slot, uint64_t hash, const IOEvent &event);
+
+public:
+
+    EventDeduplicator() : slots_(kSlotCount) { }
+
+    EventDeduplicator(const EventDeduplicator&) = delete;
+    EventDeduplicator& operator=(const EventDeduplicator&) = delete;
+
+    /*!
+     * Returns true if the other source reported the same access within the window.  The remembered event is forgotten in that
+     * case, so that each report of one source cancels out at most one report of the other.  When 'lagNs' is given, it is set to
+     * how long after the other report this one arrived.
+     */
+    bool IsDuplicate(const IOEvent &event, IOEventBacking backing, uint64_t *lagNs = nullptr);
+
+    /*!
+     * Remembers 'event' as reported by 'backing'.  Should only be called for events that were actually handled, so that a
+     * duplicate is never dropped in favor of a report that got ignored (e.g. because its process wasn't tracked yet).
+     */
+    void Remember(const IOEvent &event, IOEventBacking backing);
+};
+
+#endif /* EventDeduplicator_hpp */
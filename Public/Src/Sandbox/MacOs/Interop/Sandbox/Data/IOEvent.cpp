@@ -226,18 +226,16 @@ IOEvent::IOEvent(const es_message_t *msg)
 
 // When inserting the detours library dynamically, interposed executables automatically search for the default Info.plist
 // file in the executable directory, we are ignoring these events because they are triggered by the interposing and normally don't happen!
-const bool IOEvent::IsPlistEvent() const
+static bool IsPlistPath(const char *src_path, const char *executable)
 {
-    size_t match = src_path_.find("Info.plist");
-    if (match != std::string::npos)
+    const char *match = strstr(src_path, "Info.plist");
+    if (match != nullptr)
     {
-        size_t directory = executable_.find_last_of("/");
-        if (directory != std::string::npos)
+        const char *directory = strrchr(executable, '/');
+        if (directory != nullptr)
         {
-            std::string path = src_path_.substr(0, match);
-            std::string base_path = executable_.substr(0, directory + 1);
-
-            return base_path.compare(path) == 0;
+            size_t length = match - src_path;
+            return length == (size_t) (directory - executable + 1) && memcmp(src_path, executable, length) == 0;
         }
     }
 
@@ -245,87 +243,187 @@ const bool IOEvent::IsPlistEvent() const
 }
 
 // Ignore events that refer to the directory special characters '.' and '..'
+static bool IsDirectorySpecialCharacterPath(const char *src_path)
+{
+    return strcmp(src_path, ".") == 0 || strcmp(src_path, "..") == 0;
+}
+
+// Writes 'header' (of which the caller only fills in the event fields) followed by the strings, see IOEvent::Serialize()
+static size_t WriteEvent(IOEventHeader &header, const char *const strings[], const size_t lengths[], char *buffer, size_t capacity)
+{
+    size_t size = sizeof(IOEventHeader);
+    for (int i = 0; i < IOEventStringCount; i++)
+    {
+        size += lengths[i];
+    }
+
+    if (size > capacity || size > UINT32_MAX)
+    {
+        return 0;
+    }
+
+    header.magic      = IOEventMagic;
+    header.version    = IOEventVersion;
+    header.headerSize = sizeof(IOEventHeader);
+
+    uint32_t offset = sizeof(IOEventHeader);
+    for (int i = 0; i < IOEventStringCount; i++)
+    {
+        uint32_t length = (uint32_t) lengths[i];
+        header.strings[i] = { offset, length };
+        memcpy(buffer + offset, strings[i], length);
+        offset += length;
+    }
+
+    // The buffer may not be aligned (e.g. when the event is part of a batch), hence the copy
+    memcpy(buffer, &header, sizeof(header));
+    return size;
+}
+
+const bool IOEvent::IsPlistEvent() const
+{
+    return IsPlistPath(src_path_.c_str(), executable_.c_str());
+}
+
 const bool IOEvent::IsDirectorySpecialCharacterEvent() const
 {
-    return src_path_.compare(".") == 0 || src_path_.compare("..") == 0;
+    return IsDirectorySpecialCharacterPath(src_path_.c_str());
+}
+
+const size_t IOEvent::SerializedSize() const
+{
+    return sizeof(IOEventHeader) + executable_.length() + src_path_.length() + dst_path_.length();
+}
+
+size_t IOEvent::Serialize(char *buffer, size_t capacity) const
+{
+    IOEventHeader header;
+    memset(&header, 0, sizeof(header));
+    header.pid        = pid_;
+    header.cpid       = cpid_;
+    header.ppid       = ppid_;
+    header.oppid      = oppid_;
+    header.eventType  = (uint32_t) eventType_;
+    header.actionType = (uint32_t) actionType_;
+    header.mode       = (uint32_t) mode_;
+    header.modified   = modified_ ? 1 : 0;
+
+    const char *strings[IOEventStringCount] = { executable_.data(), src_path_.data(), dst_path_.data() };
+    const size_t lengths[IOEventStringCount] = { executable_.length(), src_path_.length(), dst_path_.length() };
+
+    return WriteEvent(header, strings, lengths, buffer, capacity);
+}
+
+static bool ReadHeader(const char *buffer, size_t length, IOEventHeader &header)
+{
+    if (buffer == nullptr || length < sizeof(IOEventHeader))
+    {
+        return false;
+    }
+
+    memcpy(&header, buffer, sizeof(header));
+    return header.magic == IOEventMagic && header.version == IOEventVersion && header.headerSize == sizeof(IOEventHeader);
 }
 
-const size_t IOEvent::Size() const
+bool IOEvent::PeekProcessIds(const char *buffer, size_t length, pid_t *pid, pid_t *ppid)
 {
-    return
-        std::to_string(pid_).length() +
-        std::to_string(cpid_).length() +
-        std::to_string(ppid_).length() +
-        std::to_string(eventType_).length() +
-        std::to_string(actionType_).length() +
-        std::to_string(mode_).length() +
-        std::to_string(modified_).length() +
-        executable_.length() + (executable_.length() > 0 ? 1 : 0) +
-        src_path_.length() + (src_path_.length() > 0 ? 1 : 0) +
-        dst_path_.length() + (dst_path_.length() > 0 ? 1 : 0) +
-        7; // 7 delimiters + 1 per string (if string is present)
+    IOEventHeader header;
+    if (!ReadHeader(buffer, length, header))
+    {
+        return false;
+    }
+
+    *pid = header.pid;
+    *ppid = header.ppid;
+    return true;
 }
 
-omemorystream& operator<<(omemorystream &os, const IOEvent &event)
+bool IOEvent::PeekHeader(const char *buffer, size_t length, IOEventHeader *header)
 {
-    os
-    << event.pid_        << "|"
-    << event.cpid_       << "|"
-    << event.ppid_       << "|"
-    << event.eventType_  << "|"
-    << event.actionType_ << "|"
-    << event.mode_       << "|"
-    << event.modified_   << "|"
-    ;
-
-    if (event.executable_.size() > 0)
+    return ReadHeader(buffer, length, *header);
+}
+
+bool IOEvent::Deserialize(const char *buffer, size_t length, IOEvent &event)
+{
+    IOEventHeader header;
+    if (!ReadHeader(buffer, length, header))
     {
-        os << event.executable_ << "|";
+        return false;
     }
 
-    if (event.src_path_.size() > 0)
+    std::string *strings[IOEventStringCount] = { &event.executable_, &event.src_path_, &event.dst_path_ };
+    for (int i = 0; i < IOEventStringCount; i++)
     {
-        os << event.src_path_ << "|";
+        const IOEventStringRef &ref = header.strings[i];
+        if (ref.offset < sizeof(IOEventHeader) || ref.offset > length || ref.length > length - ref.offset)
+        {
+            return false;
+        }
+
+        strings[i]->assign(buffer + ref.offset, ref.length);
     }
 
-    if (event.dst_path_.size() > 0)
+    event.pid_        = header.pid;
+    event.cpid_       = header.cpid;
+    event.ppid_       = header.ppid;
+    event.oppid_      = header.oppid;
+    event.eventType_  = (es_event_type_t) header.eventType;
+    event.actionType_ = (es_action_type_t) header.actionType;
+    event.mode_       = (mode_t) header.mode;
+    event.modified_   = header.modified != 0;
+
+    return true;
+}
+
+#pragma mark IOEventView
+
+const mode_t IOEventView::GetMode() const
+{
+    if (!modeKnown_)
     {
-        os << event.dst_path_ << "|";
+        struct stat s;
+        mode_ = stat(src_path_, &s) == 0 ? s.st_mode : 0;
+        modeKnown_ = true;
     }
 
-    return os;
+    return mode_;
+}
+
+const bool IOEventView::IsPlistEvent() const
+{
+    return IsPlistPath(src_path_, executable_);
 }
 
-std::istream& operator>>(std::istream &is, es_event_type_t &t)
+const bool IOEventView::IsDirectorySpecialCharacterEvent() const
 {
-    unsigned int value = 0;
-    is >> value;
-    t = (es_event_type_t) value;
-    return is;
+    return IsDirectorySpecialCharacterPath(src_path_);
 }
 
-std::istream& operator>>(std::istream &is, es_action_type_t &t)
+const size_t IOEventView::SerializedSize() const
 {
-    unsigned int value = 0;
-    is >> value;
-    t = (es_action_type_t) value;
-    return is;
+    return sizeof(IOEventHeader) + strlen(executable_) + strlen(src_path_) + strlen(dst_path_);
+}
+
+size_t IOEventView::Serialize(char *buffer, size_t capacity) const
+{
+    IOEventHeader header;
+    memset(&header, 0, sizeof(header));
+    header.pid        = pid_;
+    header.cpid       = cpid_;
+    header.ppid       = ppid_;
+    header.oppid      = ppid_;
+    header.eventType  = (uint32_t) eventType_;
+    header.actionType = (uint32_t) actionType_;
+    header.mode       = (uint32_t) GetMode();
+    header.modified   = modified_ ? 1 : 0;
+
+    const char *strings[IOEventStringCount] = { executable_, src_path_, dst_path_ };
+    const size_t lengths[IOEventStringCount] = { strlen(executable_), strlen(src_path_), strlen(dst_path_) };
+
+    return WriteEvent(header, strings, lengths, buffer, capacity);
 }
 
-imemorystream& operator>>(imemorystream &is, IOEvent &event)
+IOEvent IOEventView::ToIOEvent() const
 {
-    is
-    >> event.pid_
-    >> event.cpid_
-    >> event.ppid_
-    >> event.eventType_
-    >> event.actionType_
-    >> event.mode_
-    >> event.modified_
-    >> event.executable_
-    >> event.src_path_
-    >> event.dst_path_
-    ;
-
-    return is;
+    return IOEvent(pid_, cpid_, ppid_, eventType_, actionType_, std::string(src_path_), std::string(dst_path_), std::string(executable_), GetMode(), modified_);
 }
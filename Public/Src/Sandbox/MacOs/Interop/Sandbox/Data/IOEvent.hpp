@@ -16,8 +16,6 @@
 #include <bsm/libbsm.h>
 #endif
 
-#include "MemoryStreams.hpp"
-
 #define SRC_PATH 0
 #define DST_PATH 1
 
@@ -51,11 +49,50 @@ enum class ProcessCallbackResult
 #define IOEventKey "IOEvent"
 #define IOEventLengthKey "IOEvent::Length"
 
-struct IOEvent final
+// A batch of serialized events sent as one message: every event is preceded by its length (as a uint32_t)
+#define IOEventBatchKey "IOEvent::Batch"
+#define IOEventBatchCountKey "IOEvent::BatchCount"
+
+// Binary encoding of an IOEvent: a fixed size header followed by the (not NUL terminated) executable, src and dst paths.
+// IMPORTANT: Bump the version whenever the layout of the header changes, producers and consumers must agree on it!
+#define IOEventMagic 0x45584c42 // 'BXLE'
+#define IOEventVersion 1
+
+struct IOEventStringRef final
+{
+    uint32_t offset;
+    uint32_t length;
+};
+
+enum IOEventString
+{
+    IOEventStringExecutable = 0,
+    IOEventStringSrcPath,
+    IOEventStringDstPath,
+    IOEventStringCount
+};
+
+struct IOEventHeader final
 {
-    friend omemorystream& operator<<(omemorystream &os, const IOEvent &event);
-    friend imemorystream& operator>>(imemorystream &is, IOEvent &event);
+    uint32_t magic;
+    uint16_t version;
+    uint16_t headerSize;
+    int32_t pid;
+    int32_t cpid;
+    int32_t ppid;
+    int32_t oppid;
+    uint32_t eventType;
+    uint32_t actionType;
+    uint32_t mode;
+    uint8_t modified;
+    uint8_t reserved[3];
+
+    // Offsets are relative to the start of the header
+    IOEventStringRef strings[IOEventStringCount];
+};
 
+struct IOEvent final
+{
 private:
 
     pid_t pid_;
@@ -166,19 +203,120 @@ public:
     const bool IsPlistEvent() const;
     const bool IsDirectorySpecialCharacterEvent() const;
 
-    const size_t Size() const;
+    // Number of bytes Serialize() writes
+    const size_t SerializedSize() const;
+
+    // Writes the binary encoding of the event into buffer, returns the number of bytes written or 0 if capacity is too small
+    size_t Serialize(char *buffer, size_t capacity) const;
+
+    // Decodes an event written by Serialize(), returns false if buffer does not hold a well-formed event of the current version
+    static bool Deserialize(const char *buffer, size_t length, IOEvent &event);
+
+    // Reads the process ids of an event written by Serialize() without decoding it, returns false if the header is not well-formed
+    static bool PeekProcessIds(const char *buffer, size_t length, pid_t *pid, pid_t *ppid);
+
+    // Reads the header of an event written by Serialize() without decoding its strings, returns false if it is not well-formed
+    static bool PeekHeader(const char *buffer, size_t length, IOEventHeader *header);
+};
+
+// A non-owning event for the interposing library: it borrows the executable and path buffers of its caller (which must outlive it),
+// so constructing one copies no strings, and it only stats its source path for the mode once the mode is needed (e.g. when it gets
+// serialized).  Use ToIOEvent() for an owned event whenever it has to outlive the buffers of its caller (e.g. to cross threads).
+struct IOEventView final
+{
+private:
+
+    pid_t pid_;
+    pid_t cpid_;
+    pid_t ppid_;
+    es_event_type_t eventType_;
+    es_action_type_t actionType_;
+    bool modified_;
+
+    const char *executable_;
+    const char *src_path_;
+    const char *dst_path_;
+
+    // When false, 'mode_' is computed from the source path the first time it is requested
+    mutable bool modeKnown_;
+    mutable mode_t mode_;
+
+public:
+
+    IOEventView() = delete;
+
+    IOEventView(pid_t pid,
+                pid_t cpid,
+                pid_t ppid,
+                es_event_type_t type,
+                es_action_type_t action,
+                const char *src, const char *dst,
+                const char *exec,
+                bool get_mode = true,
+                bool modified = false)
+    : pid_(pid), cpid_(cpid), ppid_(ppid), eventType_(type), actionType_(action), modified_(modified),
+      executable_(exec), src_path_(src != nullptr ? src : ""), dst_path_(dst != nullptr ? dst : ""),
+      modeKnown_(!get_mode), mode_(0)
+    {
+        assert(exec != nullptr && exec[0] != '\0');
+    }
+
+    inline const pid_t GetPid() const { return pid_; }
+    inline const pid_t GetParentPid() const { return ppid_; }
+    inline const pid_t GetChildPid() const { return cpid_; }
+    inline const char* GetExecutablePath() const { return executable_; }
+    inline const es_event_type_t GetEventType() const { return eventType_; }
+    inline const es_action_type_t GetActionType() const { return actionType_; }
+
+    inline const char* GetEventPath(int index = SRC_PATH) const { return index == SRC_PATH ? src_path_ : dst_path_; }
 
-    static inline const size_t max_size()
+    // Makes the event borrow 'value' (which must outlive it) as the given path
+    inline void SetEventPath(const char *value, int index = SRC_PATH)
     {
-        // IMPORTANT: Keep this in sync with the de- and serialization logic in the implementation file (IOEvent.cpp), especially Size()!
-        return (3 * std::to_string(PID_MAX).length()) +   // Pids
-               (3 * std::to_string(USHRT_MAX).length()) + // Type + Action + Mode
-               std::to_string(true).length() +            // Modified
-               (3 * PATH_MAX) +                           // Executable, src and dst paths
-               10;                                        // Delimiters
+        if (index == SRC_PATH)
+        {
+            src_path_ = value;
+        }
+        else
+        {
+            dst_path_ = value;
+        }
     }
+
+    // Lets the caller supply the mode of the source path when it already knows it (e.g. from an lstat of its own), so that the
+    // event doesn't have to stat it again; has no effect on events created without 'get_mode' or whose mode is already known
+    inline void SupplyMode(mode_t mode) const
+    {
+        if (!modeKnown_)
+        {
+            mode_ = mode;
+            modeKnown_ = true;
+        }
+    }
+
+    const mode_t GetMode() const;
+    inline const bool FSEntryModified() const { return modified_; }
+
+    const bool IsPlistEvent() const;
+    const bool IsDirectorySpecialCharacterEvent() const;
+
+    // Number of bytes Serialize() writes
+    const size_t SerializedSize() const;
+
+    // Writes the same binary encoding as IOEvent::Serialize(), returns the number of bytes written or 0 if capacity is too small
+    size_t Serialize(char *buffer, size_t capacity) const;
+
+    // Copies the event into an owned IOEvent
+    IOEvent ToIOEvent() const;
 };
 
-typedef ProcessCallbackResult (*process_callback)(void *sandbox, const IOEvent event, pid_t host, IOEventBacking backing);
+typedef ProcessCallbackResult (*process_callback)(void *sandbox, const IOEvent &event, pid_t host, IOEventBacking backing);
+
+// Decides from the header of a serialized event alone (before any of its strings is decoded) whether the event is processed at all:
+// returns false, with the response to the event in 'result', for the events that are dropped (e.g. the ones of untracked processes)
+typedef bool (*classify_callback)(void *sandbox, const IOEventHeader &header, pid_t host, IOEventBacking backing, ProcessCallbackResult *result);
+
+// Returns the key events are sharded by for processing: events with equal keys are processed in order
+typedef uint64_t (*shard_key_callback)(void *sandbox, pid_t pid, pid_t ppid);
 
 #endif /* IOEvent_hpp */
@@ -0,0 +1,194 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "BuildXLException.hpp"
+#include "BuildXLSandboxShared.hpp"
+#include "PidTable.hpp"
+
+PidTable::PidTable()
+{
+    keys_ = new std::atomic<uint64_t>[kCapacity];
+    parents_ = new std::atomic<uint64_t>[kCapacity];
+    if (keys_ == nullptr || parents_ == nullptr)
+    {
+        throw BuildXLException("Could not allocate memory for the process id table!");
+    }
+
+    for (uint32_t i = 0; i < kCapacity; i++)
+    {
+        keys_[i].store(0, std::memory_order_relaxed);
+        parents_[i].store(0, std::memory_order_relaxed);
+    }
+
+    sequence_ = 0;
+    count_ = 0;
+}
+
+PidTable::~PidTable()
+{
+    delete[] keys_;
+    delete[] parents_;
+}
+
+uint32_t PidTable::Probe(pid_t pid) const
+{
+    uint32_t index = Home(pid);
+    for (uint32_t i = 0; i < kCapacity; i++, index = (index + 1) & kMask)
+    {
+        uint64_t key = keys_[index].load(std::memory_order_acquire);
+        if (key == 0 || KeyPid(key) == pid)
+        {
+            return index;
+        }
+    }
+
+    // Unreachable while the table holds fewer than 'kCapacity' entries
+    return index;
+}
+
+bool PidTable::Lookup(pid_t pid, PidInfo *info) const
+{
+    while (true)
+    {
+        uint32_t sequence = sequence_.load(std::memory_order_acquire);
+        if (sequence & 1)
+        {
+            continue;
+        }
+
+        uint32_t index = Probe(pid);
+        uint64_t key = keys_[index].load(std::memory_order_acquire);
+        uint64_t parents = parents_[index].load(std::memory_order_acquire);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence_.load(std::memory_order_relaxed) != sequence)
+        {
+            continue;
+        }
+
+        if (key == 0 || KeyPid(key) != pid)
+        {
+            return false;
+        }
+
+        info->flags = KeyFlags(key);
+        info->allowlistedParent = (pid_t) (parents >> 32);
+        info->forceForkedParent = (pid_t) (uint32_t) parents;
+        return true;
+    }
+}
+
+void PidTable::BeginWrite()
+{
+    sequence_.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void PidTable::EndWrite()
+{
+    sequence_.fetch_add(1, std::memory_order_release);
+}
+
+bool PidTable::Set(pid_t pid, PidFlags flag, pid_t parent)
+{
+    const std::lock_guard<std::mutex> lock(writeLock_);
+
+    uint32_t index = Probe(pid);
+    uint64_t key = keys_[index].load(std::memory_order_relaxed);
+    uint32_t flags = key != 0 ? KeyFlags(key) : kPidFlagsNone;
+
+    if (flags & flag)
+    {
+        return false;
+    }
+
+    if (key == 0 && count_.load(std::memory_order_relaxed) >= kMaxCount)
+    {
+        log_error("Process id table is full, could not add PID(%d)", pid);
+        return false;
+    }
+
+    uint64_t parents = parents_[index].load(std::memory_order_relaxed);
+    if (flag == kPidFlagsAllowlisted)
+    {
+        parents = ((uint64_t) (uint32_t) parent << 32) | (parents & 0xFFFFFFFF);
+    }
+    else if (flag == kPidFlagsForceForked)
+    {
+        parents = (parents & 0xFFFFFFFF00000000) | (uint32_t) parent;
+    }
+
+    BeginWrite();
+    parents_[index].store(parents, std::memory_order_relaxed);
+    keys_[index].store(MakeKey(pid, flags | flag), std::memory_order_release);
+    EndWrite();
+
+    if (key == 0)
+    {
+        count_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    return true;
+}
+
+bool PidTable::Clear(pid_t pid, PidFlags flag)
+{
+    const std::lock_guard<std::mutex> lock(writeLock_);
+
+    uint32_t index = Probe(pid);
+    uint64_t key = keys_[index].load(std::memory_order_relaxed);
+    if (key == 0 || (KeyFlags(key) & flag) == 0)
+    {
+        return false;
+    }
+
+    uint32_t flags = KeyFlags(key) & ~flag;
+
+    BeginWrite();
+    if (flags == kPidFlagsNone)
+    {
+        RemoveAt(index);
+    }
+    else
+    {
+        keys_[index].store(MakeKey(pid, flags), std::memory_order_relaxed);
+    }
+    EndWrite();
+
+    if (flags == kPidFlagsNone)
+    {
+        count_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    return true;
+}
+
+void PidTable::RemoveAt(uint32_t index)
+{
+    uint32_t hole = index;
+    uint32_t next = (hole + 1) & kMask;
+
+    while (true)
+    {
+        uint64_t key = keys_[next].load(std::memory_order_relaxed);
+        if (key == 0)
+        {
+            break;
+        }
+
+        // The entry at 'next' can fill the hole unless its home slot lies cyclically within (hole, next]
+        uint32_t home = Home(KeyPid(key));
+        bool homeInRange = hole <= next ? (hole < home && home <= next) : (hole < home || home <= next);
+        if (!homeInRange)
+        {
+            keys_[hole].store(key, std::memory_order_relaxed);
+            parents_[hole].store(parents_[next].load(std::memory_order_relaxed), std::memory_order_relaxed);
+            hole = next;
+        }
+
+        next = (next + 1) & kMask;
+    }
+
+    keys_[hole].store(0, std::memory_order_relaxed);
+    parents_[hole].store(0, std::memory_order_relaxed);
+}
@@ -0,0 +1,111 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef PidTable_hpp
+#define PidTable_hpp
+
+#include "stdafx.h"
+
+#include <atomic>
+#include <mutex>
+#include <sys/types.h>
+
+/*! The kinds of state a process id can be associated with in a 'PidTable' */
+enum PidFlags : uint32_t
+{
+    kPidFlagsNone         = 0,
+    kPidFlagsTracked      = 1 << 0,
+    kPidFlagsAllowlisted  = 1 << 1,
+    kPidFlagsForceForked  = 1 << 2,
+};
+
+/*! A consistent snapshot of everything a 'PidTable' knows about a process id */
+struct PidInfo final
+{
+    uint32_t flags = kPidFlagsNone;
+
+    /*! Parent process id recorded when the process was allowlisted */
+    pid_t allowlistedParent = 0;
+
+    /*! Parent process id recorded when a fork event was forced for the process */
+    pid_t forceForkedParent = 0;
+
+    inline bool Has(PidFlags flag) const { return (flags & flag) != 0; }
+};
+
+/*!
+ * A fixed capacity, open addressing (linear probing) table that classifies process ids.
+ *
+ * Lookups never block: they run optimistically and are retried if a concurrent update moved entries around,
+ * which is detected through a sequence counter that is odd while an update is in progress. Updates (rare compared
+ * to lookups, they happen on process creation and termination) are serialized by a mutex. Entries are deleted by
+ * shifting subsequent entries of the probe sequence backwards, so no tombstones accumulate over time.
+ */
+class PidTable final
+{
+
+private:
+
+    static const uint32_t kCapacityBits = 15;
+    static const uint32_t kCapacity     = 1 << kCapacityBits;
+    static const uint32_t kMask         = kCapacity - 1;
+
+    /*! Insertions fail once the table is three quarters full to keep probe sequences short */
+    static const uint32_t kMaxCount     = kCapacity / 4 * 3;
+
+    /*! Process id (upper half) and flags (lower half) of a slot; 0 marks an empty slot */
+    std::atomic<uint64_t> *keys_;
+
+    /*! Allowlisted parent (upper half) and force forked parent (lower half) of a slot */
+    std::atomic<uint64_t> *parents_;
+
+    std::atomic<uint32_t> sequence_;
+    std::atomic<uint32_t> count_;
+    std::mutex writeLock_;
+
+    static inline uint32_t Home(pid_t pid)           { return ((uint32_t) pid * 0x9E3779B1u) >> (32 - kCapacityBits); }
+    static inline pid_t KeyPid(uint64_t key)         { return (pid_t) (key >> 32); }
+    static inline uint32_t KeyFlags(uint64_t key)    { return (uint32_t) key; }
+    static inline uint64_t MakeKey(pid_t pid, uint32_t flags) { return ((uint64_t) (uint32_t) pid << 32) | flags; }
+
+    /*! Index of the slot holding 'pid' or of the empty slot ending its probe sequence */
+    uint32_t Probe(pid_t pid) const;
+
+    /*! Empties slot 'index' and moves subsequent entries of the same cluster back to keep all probe sequences intact */
+    void RemoveAt(uint32_t index);
+
+    void BeginWrite();
+    void EndWrite();
+
+public:
+
+    PidTable();
+    ~PidTable();
+
+    PidTable(const PidTable&) = delete;
+    PidTable& operator=(const PidTable&) = delete;
+
+    /*! Lock-free. Returns false (and leaves 'info' untouched) when no state is associated with 'pid'. */
+    bool Lookup(pid_t pid, PidInfo *info) const;
+
+    /*! Lock-free. Returns true when 'flag' is set for 'pid'. */
+    inline bool Has(pid_t pid, PidFlags flag) const
+    {
+        PidInfo info;
+        return Lookup(pid, &info) && info.Has(flag);
+    }
+
+    /*!
+     * Sets 'flag' for 'pid' and, for 'kPidFlagsAllowlisted' and 'kPidFlagsForceForked', records 'parent'.
+     * Returns false if 'flag' was already set (nothing is changed in that case) or the table is full.
+     */
+    bool Set(pid_t pid, PidFlags flag, pid_t parent = 0);
+
+    /*! Clears 'flag' for 'pid', returns false if it was not set. */
+    bool Clear(pid_t pid, PidFlags flag);
+
+    /*! Number of process ids currently associated with some state */
+    inline uint32_t Count() const { return count_.load(std::memory_order_relaxed); }
+};
+
+#endif /* PidTable_hpp */
@@ -0,0 +1,123 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef PolicySearchMemo_hpp
+#define PolicySearchMemo_hpp
+
+#include <atomic>
+#include <stdint.h>
+#include <string.h>
+
+#include "PolicySearch.h"
+
+/*!
+ * Memoizes policy search cursors of directories, so that a search for a path can resume from the cursor of its
+ * parent directory (see FindFileAccessPolicyInTreeEx) instead of walking the manifest tree from the root.
+ * Processes tend to access many files in the same few directories (e.g., headers in include directories), so
+ * most searches then only have to match the final path component.
+ *
+ * The cursor of a path is the same whether the path is searched for itself or as the parent of another one, so the
+ * accessed paths are memoized in the same table: a path that some process of the pip already accessed (e.g., a header
+ * every compiler process includes) needs no search at all.
+ *
+ * The memo is a direct-mapped table: a directory whose slot is taken simply evicts the previous occupant.  Each slot
+ * is guarded by a seqlock (odd sequence number while it is being written); writers never wait (a slot that is being
+ * written by someone else is just not updated), and readers treat a torn read as a miss.
+ *
+ * Cursors point into the manifest of the pip, so a memo must not outlive the SandboxedPip it was populated from.
+ * Only usable where cursors carry no parent pointers (i.e., not on Windows).
+ */
+class PolicySearchMemo final
+{
+private:
+
+    static const size_t kEntryCount       = 1024;
+    static const size_t kMaxPrefixLength  = 240;
+
+    struct Entry
+    {
+        std::atomic<uint32_t> seq;
+        uint32_t length;
+        PolicySearchCursor cursor;
+        char prefix[kMaxPrefixLength];
+    };
+
+    Entry entries_[kEntryCount];
+
+    static inline size_t Index(const char *prefix, size_t length)
+    {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < length; i++)
+        {
+            hash = (hash ^ (unsigned char)prefix[i]) * 16777619u;
+        }
+
+        return (hash ^ (hash >> 16)) & (kEntryCount - 1);
+    }
+
+public:
+
+    PolicySearchMemo()
+    {
+        for (size_t i = 0; i < kEntryCount; i++)
+        {
+            entries_[i].seq = 0;
+            entries_[i].length = 0;
+        }
+    }
+
+    PolicySearchMemo(const PolicySearchMemo&) = delete;
+    PolicySearchMemo& operator = (const PolicySearchMemo&) = delete;
+
+    static inline bool CanMemoize(size_t length) { return length > 0 && length <= kMaxPrefixLength; }
+
+    /*! Looks up the cursor memoized for 'prefix' (the first 'length' characters of it). */
+    bool TryGet(const char *prefix, size_t length, PolicySearchCursor *cursor) const
+    {
+        if (!CanMemoize(length))
+        {
+            return false;
+        }
+
+        const Entry &entry = entries_[Index(prefix, length)];
+        uint32_t seq = entry.seq.load(std::memory_order_acquire);
+        if ((seq & 1) != 0 || entry.length != length || memcmp(entry.prefix, prefix, length) != 0)
+        {
+            return false;
+        }
+
+        PolicySearchCursor result = entry.cursor;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (entry.seq.load(std::memory_order_relaxed) != seq)
+        {
+            return false;
+        }
+
+        *cursor = result;
+        return true;
+    }
+
+    /*! Memoizes 'cursor' as the result of searching for 'prefix' (the first 'length' characters of it). */
+    void Put(const char *prefix, size_t length, const PolicySearchCursor &cursor)
+    {
+        if (!CanMemoize(length))
+        {
+            return;
+        }
+
+        Entry &entry = entries_[Index(prefix, length)];
+        uint32_t seq = entry.seq.load(std::memory_order_relaxed);
+        if ((seq & 1) != 0 || !entry.seq.compare_exchange_strong(seq, seq + 1, std::memory_order_acquire))
+        {
+            return;
+        }
+
+        std::atomic_thread_fence(std::memory_order_release);
+        entry.length = (uint32_t)length;
+        entry.cursor = cursor;
+        memcpy(entry.prefix, prefix, length);
+        entry.seq.store(seq + 2, std::memory_order_release);
+    }
+};
+
+#endif /* PolicySearchMemo_hpp */
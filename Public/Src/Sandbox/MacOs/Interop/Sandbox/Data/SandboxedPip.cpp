@@ -4,19 +4,113 @@
 #include "SandboxedPip.hpp"
 #include "BuildXLException.hpp"
 
+#pragma mark Untracked scopes
+
+static bool IsUntrackedPolicy(FileAccessPolicy policy)
+{
+    return (policy & FileAccessPolicy_AllowAll) == FileAccessPolicy_AllowAll &&
+           (policy & (FileAccessPolicy_ReportAccess | FileAccessPolicy_ReportDirectoryEnumerationAccess)) == 0;
+}
+
+static bool IsUntrackedCone(PCManifestRecord node)
+{
+    if (!IsUntrackedPolicy(node->GetConePolicy()) || !IsUntrackedPolicy(node->GetNodePolicy()))
+    {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < node->GetBucketCount(); i++)
+    {
+        PCManifestRecord child = node->GetChildRecord(i);
+        if (child != nullptr && !IsUntrackedCone(child))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void CollectUntrackedScopes(PCManifestRecord node, const std::string &path, std::vector<std::string> &scopes)
+{
+    for (uint32_t i = 0; i < node->GetBucketCount(); i++)
+    {
+        PCManifestRecord child = node->GetChildRecord(i);
+        if (child == nullptr)
+        {
+            continue;
+        }
+
+        std::string childPath = path + "/" + child->GetPartialPath();
+        if (IsUntrackedCone(child))
+        {
+            scopes.push_back(childPath);
+        }
+        else
+        {
+            CollectUntrackedScopes(child, childPath, scopes);
+        }
+    }
+}
+
+bool SandboxedPip::IsWithinScope(const std::string &path, const std::string &scope)
+{
+    return path.compare(0, scope.length(), scope) == 0 && (path.length() == scope.length() || path[scope.length()] == '/');
+}
+
+std::set<std::string> SandboxedPip::IntersectUntrackedScopes(const std::set<std::string> &left, const std::vector<std::string> &right)
+{
+    std::set<std::string> result;
+    for (const std::string &l : left)
+    {
+        for (const std::string &r : right)
+        {
+            if (IsWithinScope(r, l))
+            {
+                result.insert(r);
+            }
+            else if (IsWithinScope(l, r))
+            {
+                result.insert(l);
+            }
+        }
+    }
+
+    return result;
+}
+
 #pragma mark SandboxedPip Implementation
 
 SandboxedPip::SandboxedPip(pid_t pid, const char *payload, size_t length)
+    : SandboxedPip(pid, payload, length, /* copyPayload */ true)
+{
+}
+
+SandboxedPip::SandboxedPip(pid_t pid, const char *payload, size_t length, bool copyPayload)
+    : SandboxedPip(pid, payload, length, copyPayload, /* base */ nullptr, 0)
+{
+}
+
+SandboxedPip::SandboxedPip(pid_t pid, const char *payload, size_t length, bool copyPayload, const char *base, size_t baseLength)
 {
     log_debug("Initializing with pid (%d) from: %{public}s", pid, __FUNCTION__);
 
-    payload_ = (char *) malloc(length);
-    if (payload == NULL)
+    ownsPayload_ = copyPayload;
+    if (copyPayload)
+    {
+        payload_ = (char *) malloc(length);
+        if (payload_ == NULL)
+        {
+            throw BuildXLException("Could not allocate memory for FAM payload storage!");
+        }
+
+        memcpy(payload_, payload, length);
+    }
+    else
     {
-        throw BuildXLException("Could not allocate memory for FAM payload storage!");
+        payload_ = (char *) payload;
     }
 
-    memcpy(payload_, payload, length);
     fam_.init((BYTE*)payload_, length);
 
     if (fam_.HasErrors())
@@ -25,6 +119,17 @@ SandboxedPip::SandboxedPip(pid_t pid, const char *payload, size_t length)
         throw BuildXLException(error.append(fam_.Error()));
     }
 
+    if (base != nullptr && !fam_.initBase((const BYTE*)base, baseLength))
+    {
+        std::string error= "Base FileAccessManifest tree parsing exception, error: ";
+        throw BuildXLException(error.append(fam_.Error()));
+    }
+
+    if (base == nullptr && fam_.IsOverlaid())
+    {
+        throw BuildXLException("FileAccessManifest parsing exception, error: the manifest tree is overlaid on a base tree that was not given");
+    }
+
     processId_ = pid;
     processTreeCount_ = 1;
 }
@@ -32,5 +137,25 @@ SandboxedPip::SandboxedPip(pid_t pid, const char *payload, size_t length)
 SandboxedPip::~SandboxedPip()
 {
     log_debug("Releasing pip object (%#llX) - freed from %{public}s", GetPipId(),  __FUNCTION__);
-    free(payload_);
+    if (ownsPayload_)
+    {
+        free(payload_);
+    }
+}
+
+void SandboxedPip::GetUntrackedScopes(std::vector<std::string> &scopes) const
+{
+    if (CheckReportAllFileAccesses(GetFamFlags()))
+    {
+        return;
+    }
+
+    // The scopes are collected from the tree of the manifest only, which lacks most of them when it is overlaid on a base tree
+    if (GetManifestBaseRecord() != nullptr)
+    {
+        return;
+    }
+
+    // The root itself is never considered, muting everything would hide process lifetime related accesses as well
+    CollectUntrackedScopes(GetManifestRecord(), "", scopes);
 }
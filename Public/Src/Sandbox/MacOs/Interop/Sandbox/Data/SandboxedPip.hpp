@@ -6,6 +6,11 @@
 
 #include "BuildXLSandboxShared.hpp"
 #include "FileAccessManifestParser.hpp"
+#include "PolicySearchMemo.hpp"
+
+#include <set>
+#include <string>
+#include <vector>
 
 /*!
  * Represents the root of the process tree being tracked.
@@ -29,16 +34,35 @@ private:
     /*! File access manifest payload bytes */
     char *payload_;
 
+    /*! Whether 'payload_' is a private copy (to be freed by this object) or memory owned by the creator of this object */
+    bool ownsPayload_;
+
     /*! File access manifest (contains pointers into the 'payload_' byte array */
     FileAccessManifestParseResult fam_;
 
     /*! Number of processses in this pip's process tree */
     std::atomic<int> processTreeCount_;
 
+    /*! Policy search cursors of recently accessed directories, shared by all processes of this pip (it is thread-safe) */
+    mutable PolicySearchMemo policyMemo_;
+
 public:
 
     SandboxedPip() = delete;
     SandboxedPip(pid_t pid, const char *payload, size_t length);
+
+    /*!
+     * When 'copyPayload' is false, the manifest is used in place (it is position independent), in which case
+     * 'payload' must stay valid (and unmodified) for the lifetime of this object.
+     */
+    SandboxedPip(pid_t pid, const char *payload, size_t length, bool copyPayload);
+
+    /*!
+     * Same as above, for a manifest whose tree is overlaid on the base manifest tree 'base' (see FileAccessManifest.ManifestTreeBase),
+     * which is always used in place: 'base' must stay valid (and unmodified) for the lifetime of this object.  A manifest written
+     * against a base tree cannot be used without it.
+     */
+    SandboxedPip(pid_t pid, const char *payload, size_t length, bool copyPayload, const char *base, size_t baseLength);
     ~SandboxedPip();
 
     /*! Process id of the root process of this pip. */
@@ -50,9 +74,24 @@ public:
     /*! File access manifest record for this pip (to be used for checking file accesses) */
     inline const PCManifestRecord GetManifestRecord() const { return fam_.GetUnixRootNode(); }
 
+    /*! Root of the base manifest tree the tree of this pip is overlaid on, nullptr if it has none */
+    inline const PCManifestRecord GetManifestBaseRecord() const { return fam_.GetBaseRootNode(); }
+
+    /*! Cursor to search the manifest of this pip from (starting at its Unix root node), overlaid on its base tree if any */
+    inline PolicySearchCursor GetManifestRootCursor() const { return PolicySearchCursor(GetManifestRecord(), GetManifestBaseRecord()); }
+
     /*! File access manifest flags */
     inline const FileAccessManifestFlag GetFamFlags() const { return fam_.GetFamFlags(); }
 
+    /*!
+     * When this returns true, the accesses of this pip are reported without being checked against its manifest: nothing can
+     * be denied (unexpected accesses do not fail the pip) and the host applies the policies to the reports instead.
+     */
+    inline bool IsObserveOnly() const
+    {
+        return CheckObserveOnly(fam_.GetFamExtraFlags()) && !CheckFailUnexpectedFileAccesses(GetFamFlags());
+    }
+
     /*!
      * Returns the full path of the root process of this pip.
      * The lenght of the path is stored in the 'length' argument because the path is not necessarily 0-terminated.
@@ -66,6 +105,22 @@ public:
     /*! When this returns true, child processes should not be tracked. */
     bool AllowChildProcessesToBreakAway() const             { return fam_.AllowChildProcessesToBreakAway(); }
 
+    /*!
+     * Collects the outermost absolute paths whose whole cone is untracked by this pip's manifest (every access is allowed
+     * and nothing is ever reported), i.e., accesses beneath them never have to be observed.  Nothing is collected when the
+     * manifest asks for all file accesses to be reported.
+     */
+    void GetUntrackedScopes(std::vector<std::string> &scopes) const;
+
+    /*! True when 'path' is 'scope' or lies beneath it */
+    static bool IsWithinScope(const std::string &path, const std::string &scope);
+
+    /*! Paths that are covered by a scope of both 'left' and 'right', i.e., the innermost of every pair of nested scopes */
+    static std::set<std::string> IntersectUntrackedScopes(const std::set<std::string> &left, const std::vector<std::string> &right);
+
+    /*! Memo used to resume manifest searches from the cursor of the parent directory (see AccessHandler::FindManifestRecord) */
+    inline PolicySearchMemo* GetPolicySearchMemo() const    { return &policyMemo_; }
+
 
 #pragma mark Process Tree Tracking
 
@@ -4,6 +4,9 @@
 #include "BuildXLException.hpp"
 #include "Trie.hpp"
 
+#include <new>
+#include <string.h>
+
 template <typename T>
 std::atomic<uint> Node<T>::s_numUintNodes(0);
 
@@ -11,52 +14,84 @@ template <typename T>
 std::atomic<uint> Node<T>::s_numPathNodes(0);
 
 template <typename T>
-Node<T>::Node(uint numChildren)
+Edge<T>* Node<T>::findEdge(uint8_t key) const
 {
-    if (numChildren == s_uintNodeChildrenCount) ++s_numUintNodes;
-    else if (numChildren == s_pathNodeChildrenCount) ++s_numPathNodes;
-
-    record_ = nullptr;
-    childrenLength_ = numChildren;
+    Children *children = children_.load(std::memory_order_acquire);
+    if (children == nullptr)
+    {
+        return nullptr;
+    }
 
-    children_ = (Node **) malloc(numChildren * sizeof(Node *));
-    if (children_)
+    uint count = children->count.load(std::memory_order_acquire);
+    for (uint i = 0; i < count; i++)
     {
-        for (int i = 0; i < childrenLength_; i++)
+        if (children->keys[i] == key)
         {
-            children_[i] = nullptr;
+            return children->edges[i].load(std::memory_order_acquire);
         }
     }
+
+    return nullptr;
 }
 
-template <typename T>
-Node<T>::~Node()
+// ================================== class TrieArena ==================================
+
+TrieArena::~TrieArena()
 {
-    if (children_)
+    while (chunks_ != nullptr)
     {
-        for (int i = 0; i < childrenLength_; i++)
+        Chunk *next = chunks_->next;
+        free(chunks_);
+        chunks_ = next;
+    }
+
+    used_ = 0;
+    allocatedBytes_ = 0;
+}
+
+void* TrieArena::allocate(size_t size)
+{
+    const size_t alignment = alignof(std::max_align_t);
+    size = (size + alignment - 1) & ~(alignment - 1);
+
+    if (chunks_ == nullptr || used_ + size > chunks_->size)
+    {
+        size_t chunkSize = chunks_ == nullptr ? s_minChunkSize : chunks_->size * 2;
+        if (chunkSize > s_maxChunkSize) chunkSize = s_maxChunkSize;
+        if (chunkSize < size) chunkSize = size;
+
+        Chunk *chunk = (Chunk *) malloc(sizeof(Chunk) + chunkSize);
+        if (chunk == nullptr)
         {
-            children_[i] = nullptr;
+            return nullptr;
         }
 
-        free(children_);
-        children_ = nullptr;
-    }
+        chunk->next = chunks_;
+        chunk->size = chunkSize;
 
-    if (record_ != nullptr) record_.reset();
+        chunks_ = chunk;
+        used_ = 0;
+        allocatedBytes_ += sizeof(Chunk) + chunkSize;
+    }
 
-    if (length() == s_uintNodeChildrenCount) --s_numUintNodes;
-    else if (length() == s_pathNodeChildrenCount) --s_numPathNodes;
+    void *result = (char *) (chunks_ + 1) + used_;
+    used_ += size;
+    return result;
 }
 
 // ================================== class Trie ==================================
 
 template <typename T>
-Trie<T>::Trie(TrieKind kind)
+std::atomic<uint64_t> Trie<T>::s_uintArenaBytes(0);
+
+template <typename T>
+std::atomic<uint64_t> Trie<T>::s_pathArenaBytes(0);
+
+template <typename T>
+Trie<T>::Trie(TrieKind kind) : kind_(kind), size_(0), onChangeCallback_(nullptr), onChangeData_(nullptr)
 {
-    kind_ = kind;
     root_ = createNode();
-    if (root_->children_ == nullptr)
+    if (root_ == nullptr)
     {
         throw BuildXLException("Trie creation failed as no root node could be allocated!");
     }
@@ -65,50 +100,230 @@ Trie<T>::Trie(TrieKind kind)
 template <typename T>
 Trie<T>::~Trie()
 {
-    traverse(/*computeKey*/ false, /*callbackArgs*/ nullptr, [](Trie<T>*, void*, uint64_t, Node<T> *node)
+    // The memory of the nodes is released along with the arena, the nodes only need to release their records
+    traverse(/*computeKey*/ false, /*callbackArgs*/ nullptr, [](Trie<T> *me, void*, uint64_t, Node<T> *node)
     {
-        delete node;
+        if (me->kind_ == kUintTrie) --Node<T>::s_numUintNodes;
+        else --Node<T>::s_numPathNodes;
+
+        node->~Node();
     });
 
+    if (kind_ == kUintTrie) s_uintArenaBytes -= arena_.allocatedBytes();
+    else s_pathArenaBytes -= arena_.allocatedBytes();
+
     root_ = nullptr;
     size_ = 0;
 }
 
 template <typename T>
-bool Trie<T>::findChildNode(Node<T> *node, int idx, bool createIfMissing)
+void Trie<T>::accountArenaGrowth(size_t before)
 {
-    if (idx < 0 || idx >= node->length())
+    size_t growth = arena_.allocatedBytes() - before;
+    if (growth == 0) return;
+
+    if (kind_ == kUintTrie) s_uintArenaBytes += growth;
+    else s_pathArenaBytes += growth;
+}
+
+template <typename T>
+Node<T>* Trie<T>::createNode()
+{
+    size_t before = arena_.allocatedBytes();
+    void *memory = arena_.allocate(sizeof(Node<T>));
+    accountArenaGrowth(before);
+
+    // This should never happen except if we run out of memory.
+    if (memory == nullptr)
     {
-        return false;
+        return nullptr;
     }
 
-    bool childNodeExists = node->children()[idx] != nullptr;
+    if (kind_ == kUintTrie) ++Node<T>::s_numUintNodes;
+    else ++Node<T>::s_numPathNodes;
 
-    if (childNodeExists)
+    return new (memory) Node<T>();
+}
+
+template <typename T>
+Edge<T>* Trie<T>::createEdge(Node<T> *child, const uint8_t *label, uint length)
+{
+    size_t before = arena_.allocatedBytes();
+    Edge<T> *edge = (Edge<T> *) arena_.allocate(sizeof(Edge<T>) + length);
+    accountArenaGrowth(before);
+
+    if (edge == nullptr)
     {
-        return true;
+        return nullptr;
     }
 
-    // child is missing
-    if (!createIfMissing)
+    edge->child = child;
+    edge->length = length;
+    memcpy(edge->label, label, length);
+
+    return edge;
+}
+
+template <typename T>
+typename Node<T>::Children* Trie<T>::createChildren(uint capacity)
+{
+    typedef typename Node<T>::Children Children;
+
+    // Layout: the header, followed by 'capacity' edges, followed by 'capacity' keys
+    size_t before = arena_.allocatedBytes();
+    char *memory = (char *) arena_.allocate(sizeof(Children) + capacity * (sizeof(std::atomic<Edge<T>*>) + sizeof(uint8_t)));
+    accountArenaGrowth(before);
+
+    if (memory == nullptr)
     {
-        return false;
+        return nullptr;
     }
 
-    Node<T>* newNode = createNode();
+    Children *children = new (memory) Children();
+    children->capacity = capacity;
+    children->count.store(0, std::memory_order_relaxed);
+    children->edges = (std::atomic<Edge<T>*> *) (memory + sizeof(Children));
+    children->keys = (uint8_t *) (children->edges + capacity);
 
-    // This should never happen except if we run out of memory.
-    if (newNode == nullptr)
+    for (uint i = 0; i < capacity; i++)
+    {
+        new (&children->edges[i]) std::atomic<Edge<T>*>(nullptr);
+        children->keys[i] = 0;
+    }
+
+    return children;
+}
+
+template <typename T>
+bool Trie<T>::publishEdge(Node<T> *node, Edge<T> *edge)
+{
+    typedef typename Node<T>::Children Children;
+
+    uint8_t key = edge->label[0];
+    Children *children = node->children_.load(std::memory_order_relaxed);
+    uint count = children != nullptr ? children->count.load(std::memory_order_relaxed) : 0;
+
+    for (uint i = 0; i < count; i++)
+    {
+        if (children->keys[i] == key)
+        {
+            children->edges[i].store(edge, std::memory_order_release);
+            return true;
+        }
+    }
+
+    if (children != nullptr && count < children->capacity)
+    {
+        children->keys[count] = key;
+        children->edges[count].store(edge, std::memory_order_relaxed);
+        children->count.store(count + 1, std::memory_order_release);
+        return true;
+    }
+
+    // No room left: publish a bigger copy of the block.  Keys are unique, so a full block of the maximum capacity
+    // already contains every possible key and never gets here.
+    uint maxCapacity = kind_ == kUintTrie ? Node<T>::s_uintNodeChildrenCount : Node<T>::s_pathNodeChildrenCount;
+    uint capacity = children == nullptr ? Node<T>::s_minChildrenCapacity : children->capacity * 2;
+    if (capacity > maxCapacity) capacity = maxCapacity;
+
+    Children *grown = createChildren(capacity);
+    if (grown == nullptr)
     {
         return false;
     }
 
-    // TODO: Make thread safe!
-    node->children()[idx] = newNode;
+    for (uint i = 0; i < count; i++)
+    {
+        grown->keys[i] = children->keys[i];
+        grown->edges[i].store(children->edges[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+
+    grown->keys[count] = key;
+    grown->edges[count].store(edge, std::memory_order_relaxed);
+    grown->count.store(count + 1, std::memory_order_relaxed);
 
+    // The outgrown block stays in the arena since concurrent lookups may still be reading it
+    node->children_.store(grown, std::memory_order_release);
     return true;
 }
 
+template <typename T>
+Node<T>* Trie<T>::findExistingNode(const uint8_t *keys, size_t length) const
+{
+    Node<T> *node = root_;
+    size_t pos = 0;
+    while (pos < length)
+    {
+        Edge<T> *edge = node->findEdge(keys[pos]);
+        if (edge == nullptr || edge->length > length - pos || memcmp(edge->label, keys + pos, edge->length) != 0)
+        {
+            return nullptr;
+        }
+
+        pos += edge->length;
+        node = edge->child;
+    }
+
+    return node;
+}
+
+template <typename T>
+Node<T>* Trie<T>::createNodes(const uint8_t *keys, size_t length)
+{
+    Node<T> *node = root_;
+    size_t pos = 0;
+    while (pos < length)
+    {
+        Edge<T> *edge = node->findEdge(keys[pos]);
+        if (edge == nullptr)
+        {
+            // The rest of the key becomes the label of a single edge to a new leaf
+            Node<T> *leaf = createNode();
+            Edge<T> *newEdge = leaf != nullptr ? createEdge(leaf, keys + pos, (uint) (length - pos)) : nullptr;
+            return newEdge != nullptr && publishEdge(node, newEdge) ? leaf : nullptr;
+        }
+
+        uint common = 1;
+        while (common < edge->length && pos + common < length && edge->label[common] == keys[pos + common])
+        {
+            common++;
+        }
+
+        if (common < edge->length)
+        {
+            // Split the edge: a new node takes over the first 'common' indices of its label.  The new node isn't
+            // reachable until the edge to it is published, so it can be populated first.
+            Node<T> *middle = createNode();
+            Edge<T> *lower = middle != nullptr ? createEdge(edge->child, edge->label + common, edge->length - common) : nullptr;
+            Edge<T> *upper = lower != nullptr ? createEdge(middle, edge->label, common) : nullptr;
+            if (upper == nullptr || !publishEdge(middle, lower) || !publishEdge(node, upper))
+            {
+                return nullptr;
+            }
+
+            edge = upper;
+        }
+
+        pos += edge->length;
+        node = edge->child;
+    }
+
+    return node;
+}
+
+template <typename T>
+Node<T>* Trie<T>::findNode(const uint8_t *keys, size_t length, bool createIfMissing)
+{
+    Node<T> *node = findExistingNode(keys, length);
+    if (node != nullptr || !createIfMissing)
+    {
+        return node;
+    }
+
+    const std::lock_guard<std::mutex> lock(writeLock_);
+    return createNodes(keys, length);
+}
+
 template <typename T>
 TrieResult Trie<T>::makeSentinel(Node<T> *node, std::shared_ptr<T> record)
 {
@@ -531,48 +746,48 @@ static uint64_t pow10(int exp)
 template <typename T>
 Node<T>* Trie<T>::findPathNode(const char *path, bool createIfMissing)
 {
-    Node<T> *currNode = root_;
-    unsigned char ch;
-    while ((ch = *path++) != '\0')
+    size_t length = strlen(path);
+
+    uint8_t stackKeys[PATH_MAX];
+    std::unique_ptr<uint8_t[]> heapKeys;
+    uint8_t *keys = stackKeys;
+    if (length > sizeof(stackKeys))
     {
-        int idx = s_char2idx<T>[ch];
-        if (!findChildNode(currNode, idx, createIfMissing))
+        heapKeys.reset(new (std::nothrow) uint8_t[length]);
+        keys = heapKeys.get();
+        if (keys == nullptr)
         {
             return nullptr;
         }
-        currNode = currNode->children()[idx];
     }
 
-    return currNode;
-}
-
-template <typename T>
-Node<T>* Trie<T>::findUintNode(uint64_t key, bool createIfMissing)
-{
-    Node<T> *currNode = root_;
-
-    while (true)
+    for (size_t i = 0; i < length; i++)
     {
-        assert(currNode->length() == 10);
-
-        int lsd = key % 10;
-
-        if (!findChildNode(currNode, lsd, createIfMissing))
+        int idx = s_char2idx<T>[(unsigned char) path[i]];
+        if (idx < 0)
         {
             return nullptr;
         }
 
-        currNode = currNode->children()[lsd];
+        keys[i] = (uint8_t) idx;
+    }
 
-        if (key < 10)
-        {
-            break;
-        }
+    return findNode(keys, length, createIfMissing);
+}
 
+template <typename T>
+Node<T>* Trie<T>::findUintNode(uint64_t key, bool createIfMissing)
+{
+    // Digits are consumed starting from the least significant one
+    uint8_t keys[20];
+    size_t length = 0;
+    do
+    {
+        keys[length++] = key % 10;
         key = key / 10;
-    }
+    } while (key > 0);
 
-    return currNode;
+    return findNode(keys, length, createIfMissing);
 }
 
 template <typename T>
@@ -674,9 +889,23 @@ void Trie<T>::traverse(bool computeKey, void *callbackArgs, traverse_fn callback
         uint32_t depth = stack->depth;
 
         Node<T> *curr = pop(&stack);
-        for (int i = 0; i < curr->length(); ++i)
+        typename Node<T>::Children *children = curr->children_.load(std::memory_order_acquire);
+        uint count = children != nullptr ? children->count.load(std::memory_order_acquire) : 0;
+        for (uint i = 0; i < count; ++i)
         {
-            push(&stack, curr->children()[i], computeKey ? (i * pow10<T>(depth) + key) : 0, depth + 1);
+            Edge<T> *edge = children->edges[i].load(std::memory_order_acquire);
+
+            uint64_t childKey = 0;
+            if (computeKey)
+            {
+                childKey = key;
+                for (uint j = 0; j < edge->length; j++)
+                {
+                    childKey += edge->label[j] * pow10<T>(depth + j);
+                }
+            }
+
+            push(&stack, edge->child, childKey, depth + edge->length);
         }
 
         // the callback may deallocate 'curr' node, hence this must be the last statement in this loop
@@ -8,14 +8,75 @@
 
 #include <atomic>
 #include <memory>
+#include <mutex>
+#include <cstddef>
 #include <limits.h>
 #include <sys/types.h>
 
 template <typename T> class Trie;
+template <typename T> class Node;
+
+/*!
+ * A bump allocator backing all the nodes (and their blocks of children) of a single Trie.
+ *
+ * Nodes are never removed from a trie (removing a key only releases its record), so nothing is ever returned
+ * to the arena; all of its memory is released at once when the trie is destroyed.
+ */
+class TrieArena final
+{
+private:
+
+    /*! The size of the first chunk; every subsequent chunk is twice as big, up to 's_maxChunkSize' */
+    static const size_t s_minChunkSize = 4 * 1024;
+    static const size_t s_maxChunkSize = 1024 * 1024;
+
+    /*! The header of a chunk; the memory handed out follows it */
+    struct alignas(std::max_align_t) Chunk {
+        Chunk *next;
+        size_t size;
+    };
+
+    Chunk *chunks_;
+    size_t used_;
+    size_t allocatedBytes_;
+
+public:
+
+    TrieArena() : chunks_(nullptr), used_(0), allocatedBytes_(0) { }
+    ~TrieArena();
+
+    TrieArena(const TrieArena&) = delete;
+    TrieArena& operator=(const TrieArena&) = delete;
+
+    /*! Returns 'size' bytes aligned for any type, or NULL if the system is out of memory */
+    void* allocate(size_t size);
+
+    /*! The total number of bytes requested from the system so far */
+    inline size_t allocatedBytes() const { return allocatedBytes_; }
+};
+
+/*!
+ * A labeled edge to a child node.  The label is a (non-empty) sequence of key indices, so that a chain of nodes
+ * with a single child each (e.g., the characters of a path component) is collapsed into a single edge.
+ *
+ * Edges are immutable once published; when an edge must be split, a new edge is published in its place.
+ */
+template <typename T>
+struct Edge final
+{
+    Node<T> *child;
+    uint length;
+    uint8_t label[0];
+};
 
 /*!
  * A node in a Trie.
  * Only accessible to its friend class Trie.
+ *
+ * The children of a node are kept in a block that grows with the number of children: the key of every child
+ * (i.e., the first index of the label of the edge leading to it) is stored next to the edge, so a node only pays
+ * for the children it has rather than for all the possible ones.  A block that is outgrown is left in the arena
+ * (a reader may still be looking at it) and the new one is published in its place.
  */
 template <typename T>
 class Node final
@@ -29,8 +90,7 @@ private:
 
     /*!
      * The value 65 is chosen so that all ASCII characters between 32 (' ') and 122 ('z')
-     * get a unique entry in the 'children_' array.  The formula for mapping a character
-     * ch to an array index is:
+     * get a unique index.  The formula for mapping a character ch to an index is:
      *
      *   toupper(ch) - 32
      */
@@ -39,26 +99,37 @@ private:
     /*! For 10 digits */
     static const uint s_uintNodeChildrenCount = 10;
 
+    /*! The capacity of the first block of children of a node */
+    static const uint s_minChildrenCapacity = 2;
+
+    typedef struct Children {
+        /*! The number of entries in 'edges' and 'keys' */
+        uint capacity;
+
+        /*! The number of entries in use; an entry is filled in before it is made visible by incrementing this */
+        std::atomic<uint> count;
+
+        /*! The edges to the children of the node */
+        std::atomic<Edge<T>*> *edges;
+
+        /*! The key of the child at the same position in 'edges' */
+        uint8_t *keys;
+    } Children;
+
     /*! Arbitrary value */
     std::shared_ptr<T> record_;
 
-    /*! The length of the 'children_' array (i.e., the the number of allocated nodes) */
-    uint childrenLength_;
-
-    /*! Pre-allocated pointers to all possible children nodes. */
-    Node **children_;
+    /*! The current block of children (NULL when there are none) */
+    std::atomic<Children*> children_;
 
-    uint length()     const { return childrenLength_; }
-    Node** children() const { return children_; }
+    Node() : record_(nullptr), children_(nullptr) { }
 
-    static Node* createUintNode() { return new Node(s_uintNodeChildrenCount); }
-    static Node* createPathNode() { return new Node(s_pathNodeChildrenCount); }
+    /*! Returns the edge whose label starts with 'key', or NULL if there is none */
+    Edge<T>* findEdge(uint8_t key) const;
 
 public:
 
-    Node() = delete;
-    Node(uint numChildren);
-    ~Node();
+    ~Node() { record_.reset(); }
 };
 
 // ================================== class Trie ==================================
@@ -85,7 +156,8 @@ typedef enum {
  * Paths are considered case-insensitive.  Attempting to add a path with a non-ascii
  * character will fail gracefully by returning 'kTrieResultFailure'.
  *
- * Thread-safe.  Non-blocking.
+ * Thread-safe.  Lookups are non-blocking; changes to the shape of the tree (i.e., adding keys that aren't
+ * already in it) are serialized by a lock.
  */
 template <typename T>
 class Trie final
@@ -96,24 +168,30 @@ public:
     typedef void (*for_each_fn)(void *data, uint64_t key, const std::shared_ptr<T> value);
     typedef bool (*filter_fn)(void *data, const std::shared_ptr<T> value);
 
+    /*! The number of nodes of all uint tries and the memory (nodes, edges, and blocks of children) they take up */
     static void getUintNodeCounts(uint *count, double *sizeMB)
     {
-        getNodeCounts(Node<T>::s_numUintNodes, Node<T>::s_uintNodeChildrenCount, count, sizeMB);
+        getNodeCounts(Node<T>::s_numUintNodes, s_uintArenaBytes, count, sizeMB);
     }
 
+    /*! The number of nodes of all path tries and the memory (nodes, edges, and blocks of children) they take up */
     static void getPathNodeCounts(uint *count, double *sizeMB)
     {
-        getNodeCounts(Node<T>::s_numPathNodes, Node<T>::s_pathNodeChildrenCount, count, sizeMB);
+        getNodeCounts(Node<T>::s_numPathNodes, s_pathArenaBytes, count, sizeMB);
     }
 
 private:
 
     static const uint BytesInAMegabyte = 1 << 20;
 
-    inline static void getNodeCounts(uint count, uint numChildren, uint *outCount, double *outSizeMB)
+    /*! The number of bytes taken up by the arenas of all uint and path tries respectively */
+    static std::atomic<uint64_t> s_uintArenaBytes;
+    static std::atomic<uint64_t> s_pathArenaBytes;
+
+    inline static void getNodeCounts(uint count, uint64_t bytes, uint *outCount, double *outSizeMB)
     {
         *outCount = count;
-        *outSizeMB = (1.0 * count * (sizeof(Node<T>) + numChildren * sizeof(Node<T>*))) / BytesInAMegabyte;
+        *outSizeMB = (1.0 * bytes) / BytesInAMegabyte;
     }
 
     typedef enum { kUintTrie, kPathTrie } TrieKind;
@@ -122,6 +200,15 @@ private:
     /*! The root of the tree. */
     Node<T> *root_;
 
+    /*! Backs all the nodes, edges, and blocks of children of this tree */
+    TrieArena arena_;
+
+    /*!
+     * Serializes all changes to the shape of the tree.  Lookups never take this lock: every change is made
+     * visible to them with a single atomic store of either a block of children, an edge, or a children count.
+     */
+    std::mutex writeLock_;
+
     /*! The kind of keys this tree accepts */
     TrieKind kind_;
 
@@ -137,17 +224,39 @@ private:
     /*! Invokes the 'onChangeCallback_' if it's set and 'newCount' is different from 'oldCount' */
     void triggerOnChange(int oldCount, int newCount) const;
 
+    /*! Allocates a new node from the arena and accounts for it in the node counts of the kind of this tree */
+    Node<T>* createNode();
+
+    /*! Allocates a new (empty) block of children with room for 'capacity' children from the arena */
+    typename Node<T>::Children* createChildren(uint capacity);
+
+    /*! Allocates a new edge to 'child' from the arena, labeled with 'label[0..length)' */
+    Edge<T>* createEdge(Node<T> *child, const uint8_t *label, uint length);
+
+    /*!
+     * Makes 'edge' an edge of 'node', either by replacing the existing edge with the same key or by adding it
+     * (growing the block of children of 'node' if needed).  Must be called while holding 'writeLock_'.
+     *
+     * @result False IFF the system is out of memory.
+     */
+    bool publishEdge(Node<T> *node, Edge<T> *edge);
+
+    /*! Updates the arena byte counter of the kind of this tree after the arena has grown from 'before' bytes */
+    void accountArenaGrowth(size_t before);
+
     /*!
-     * Checks if a child node of 'node' exists at position 'idx'.
-     * If no such child node exists and 'createIfMissing' is true,
-     * a new child node is created and saved at position 'idx'.
+     * Finds the node corresponding to the sequence of key indices 'keys[0..length)'.
      *
-     * @param node The parent node.  Must not be null.
-     * @param idx Must be between 0 (inclusive) and 'node.length()' (exclusive); otherwise this method returns false.
-     * @param createIfMissing When true, this method creates a new child node at position 'idx' if one doesn't already exist.
-     * @result True IFF 'node' contains a child node at position 'idx' after this method returns.
+     * When 'createIfMissing' is true, missing nodes are created (splitting edges as necessary) while holding
+     * 'writeLock_'; otherwise the lookup is lock-free, and NULL is returned if no such node exists.
      */
-    bool findChildNode(Node<T> *node, int idx, bool createIfMissing);
+    Node<T>* findNode(const uint8_t *keys, size_t length, bool createIfMissing);
+
+    /*! Lock-free part of 'findNode': returns the node for 'keys' IFF it already exists */
+    Node<T>* findExistingNode(const uint8_t *keys, size_t length) const;
+
+    /*! Part of 'findNode' that creates missing nodes; must be called while holding 'writeLock_' */
+    Node<T>* createNodes(const uint8_t *keys, size_t length);
 
     /*!
      * Ensures that 'node' has its 'record_' field set to a non-null value.
@@ -255,14 +364,6 @@ private:
     /*! Calls 'findPathNode' with 'createIfMissing' set to false. */
     inline Node<T>* findExistingNodeForPath(const char *key) { return findPathNode(key, false); }
 
-    /*! Creates either a Uint or a Path node, based on the kind of this trie. */
-    inline Node<T>* createNode()
-    {
-        return kind_ == kUintTrie ? Node<T>::createUintNode() :
-               kind_ == kPathTrie ? Node<T>::createPathNode() :
-               nullptr;
-    }
-
 public:
 
     Trie() = delete;
@@ -6,11 +6,83 @@
 #include "DetoursSandbox.hpp"
 #include "XPCConstants.hpp"
 
-DetoursSandbox::DetoursSandbox(pid_t host_pid, process_callback callback, void *sandbox, xpc_connection_t bridge)
+void DetoursSandbox::HandleEvent(void *sandbox, const char *msg, size_t msg_length)
 {
-    assert(callback != nullptr && bridge != nullptr);
+    IOEventHeader header;
+    ProcessCallbackResult result;
+    if (IOEvent::PeekHeader(msg, msg_length, &header) && !classifyCallback_(sandbox, header, hostPid_, IOEventBacking::Interposing, &result))
+    {
+        return;
+    }
+
+    IOEvent event;
+    if (!IOEvent::Deserialize(msg, msg_length, event))
+    {
+        log_error("Dropping malformed interposed event of length %zu", msg_length);
+        return;
+    }
+
+    eventCallback_(sandbox, const_cast<const IOEvent &>(event), hostPid_, IOEventBacking::Interposing);
+}
+
+void DetoursSandbox::HandleMessage(void *sandbox, xpc_object_t message)
+{
+    size_t batch_length = 0;
+    const char *batch = (const char *) xpc_dictionary_get_data(message, IOEventBatchKey, &batch_length);
+    if (batch != nullptr)
+    {
+        // a batch of events, each preceded by its length
+        size_t offset = 0;
+        uint32_t msg_length = 0;
+        while (offset + sizeof(msg_length) <= batch_length)
+        {
+            memcpy(&msg_length, batch + offset, sizeof(msg_length));
+            offset += sizeof(msg_length);
+            if (msg_length > batch_length - offset)
+            {
+                break;
+            }
+
+            HandleEvent(sandbox, batch + offset, msg_length);
+            offset += msg_length;
+        }
+    }
+    else
+    {
+        size_t msg_length = 0;
+        const char *msg = (const char *) xpc_dictionary_get_data(message, IOEventKey, &msg_length);
+        HandleEvent(sandbox, msg, msg_length);
+    }
+}
+
+dispatch_queue_t DetoursSandbox::GetQueueForMessage(void *sandbox, xpc_object_t message)
+{
+    size_t length = 0;
+    const char *msg = (const char *) xpc_dictionary_get_data(message, IOEventBatchKey, &length);
+    if (msg != nullptr)
+    {
+        // skip the length prefix of the first event
+        msg = length > sizeof(uint32_t) ? msg + sizeof(uint32_t) : nullptr;
+        length = length > sizeof(uint32_t) ? length - sizeof(uint32_t) : 0;
+    }
+    else
+    {
+        msg = (const char *) xpc_dictionary_get_data(message, IOEventKey, &length);
+    }
+
+    pid_t pid = 0, ppid = 0;
+    return IOEvent::PeekProcessIds(msg, length, &pid, &ppid)
+        ? eventShards_->GetQueue(shardKeyCallback_(sandbox, pid, ppid))
+        : eventShards_->GetQueue(0);
+}
+
+DetoursSandbox::DetoursSandbox(pid_t host_pid, process_callback callback, classify_callback classify, shard_key_callback shard_key, void *sandbox, xpc_connection_t bridge)
+{
+    assert(callback != nullptr && classify != nullptr && shard_key != nullptr && bridge != nullptr);
 
     eventCallback_ = callback;
+    classifyCallback_ = classify;
+    shardKeyCallback_ = shard_key;
     xpc_bridge_ = bridge;
     hostPid_ = host_pid;
 
@@ -21,6 +93,8 @@ DetoursSandbox::DetoursSandbox(pid_t host_pid, process_callback callback, void *
         DISPATCH_QUEUE_SERIAL, QOS_CLASS_USER_INTERACTIVE, -1
     ));
 
+    eventShards_ = new EventQueuePool(queueName);
+
     detours_ = xpc_connection_create(NULL, NULL);
     xpc_connection_set_event_handler(detours_, ^(xpc_object_t peer)
     {
@@ -32,19 +106,20 @@ DetoursSandbox::DetoursSandbox(pid_t host_pid, process_callback callback, void *
                 xpc_type_t type = xpc_get_type(message);
                 if (type == XPC_TYPE_DICTIONARY)
                 {
-                    const char *msg = xpc_dictionary_get_string(message, IOEventKey);
-                    const uint64_t msg_length = xpc_dictionary_get_uint64(message, IOEventLengthKey);
+                    xpc_retain(message);
+                    xpc_retain(peer);
 
-                    imemorystream ims(msg, msg_length);
-                    ims.imbue(std::locale(ims.getloc(), new PipeDelimiter));
-                    IOEvent event;
-                    ims >> event;
+                    dispatch_async(GetQueueForMessage(sandbox, message), ^{
+                        HandleMessage(sandbox, message);
 
-                    eventCallback_(sandbox, const_cast<const IOEvent &>(event), hostPid_, IOEventBacking::Interposing);
+                        xpc_object_t reply = xpc_dictionary_create_reply(message);
+                        xpc_dictionary_set_uint64(reply, "response", xpc_response_success);
+                        xpc_connection_send_message((xpc_connection_t) peer, reply);
+                        xpc_release(reply);
 
-                    xpc_object_t reply = xpc_dictionary_create_reply(message);
-                    xpc_dictionary_set_uint64(reply, "response", xpc_response_success);
-                    xpc_connection_send_message((xpc_connection_t) peer, reply);
+                        xpc_release(message);
+                        xpc_release(peer);
+                    });
                 }
                 else if (type == XPC_TYPE_ERROR)
                 {
@@ -102,6 +177,12 @@ DetoursSandbox::~DetoursSandbox()
     xpc_connection_cancel(detours_);
     xpc_release(detours_);
 
+    // Messages still being received may be handed to the shards, wait for them before the shards are drained
+    if (eventQueue_ != nullptr)
+    {
+        dispatch_sync(eventQueue_, ^{});
+    }
+
     xpc_bridge_ = nullptr;
     detours_ = nullptr;
 
@@ -110,5 +191,12 @@ DetoursSandbox::~DetoursSandbox()
         dispatch_release(eventQueue_);
     }
 
+    if (eventShards_ != nullptr)
+    {
+        eventShards_->Drain();
+        delete eventShards_;
+        eventShards_ = nullptr;
+    }
+
     eventCallback_ = nullptr;
 }
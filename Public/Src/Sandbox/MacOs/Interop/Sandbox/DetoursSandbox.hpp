@@ -5,6 +5,7 @@
 #define DetoursSandbox_hpp
 
 #include "stdafx.h"
+#include "EventQueuePool.hpp"
 #include "IOEvent.hpp"
 
 class DetoursSandbox final
@@ -15,10 +16,26 @@ private:
     pid_t hostPid_;
     dispatch_queue_t eventQueue_ = nullptr;
     process_callback eventCallback_ = nullptr;
+    classify_callback classifyCallback_ = nullptr;
+    shard_key_callback shardKeyCallback_ = nullptr;
 
 #if __APPLE__
     xpc_connection_t xpc_bridge_ = nullptr;
     xpc_connection_t detours_ = nullptr;
+
+    // Messages are received on 'eventQueue_' and processed on one of these, see 'shard_key_callback'
+    EventQueuePool *eventShards_ = nullptr;
+#endif
+
+    /*! Deserializes a single event reported by the interposing library and passes it on to the event callback, unless it is classified as dropped */
+    void HandleEvent(void *sandbox, const char *msg, size_t msg_length);
+
+#if __APPLE__
+    /*! Deserializes a message (a single event or a batch of events) and passes all events on to the event callback */
+    void HandleMessage(void *sandbox, xpc_object_t message);
+
+    /*! Returns the queue a message is processed on, all events of a batch are reported by the same process */
+    dispatch_queue_t GetQueueForMessage(void *sandbox, xpc_object_t message);
 #endif
     
 public:
@@ -27,7 +44,7 @@ public:
     ~DetoursSandbox();
     
 #if __APPLE__
-    DetoursSandbox(pid_t host_pid, process_callback callback, void *sandbox, xpc_connection_t bridge);
+    DetoursSandbox(pid_t host_pid, process_callback callback, classify_callback classify, shard_key_callback shard_key, void *sandbox, xpc_connection_t bridge);
 #endif
 };
 
@@ -2,17 +2,21 @@
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
 
 #include <iostream>
+#include <sys/mman.h>
 
 #include "BuildXLSandboxShared.hpp"
 #include "BuildXLException.hpp"
 #include "EndpointSecuritySandbox.hpp"
+#include "ESEventRing.hpp"
 #include "XPCConstants.hpp"
 
-EndpointSecuritySandbox::EndpointSecuritySandbox(pid_t host_pid, process_callback callback, void *sandbox, xpc_connection_t bridge)
+EndpointSecuritySandbox::EndpointSecuritySandbox(pid_t host_pid, process_callback callback, classify_callback classify, shard_key_callback shard_key, void *sandbox, xpc_connection_t bridge)
 {
-    assert(callback != nullptr && bridge != nullptr);
+    assert(callback != nullptr && classify != nullptr && shard_key != nullptr && bridge != nullptr);
 
     eventCallback_ = callback;
+    classifyCallback_ = classify;
+    shardKeyCallback_ = shard_key;
     xpc_bridge_ = bridge;
     hostPid_ = host_pid;
 
@@ -23,44 +27,61 @@ EndpointSecuritySandbox::EndpointSecuritySandbox(pid_t host_pid, process_callbac
         DISPATCH_QUEUE_SERIAL, QOS_CLASS_USER_INTERACTIVE, -1
     ));
 
+    eventShards_ = new EventQueuePool(queueName);
+
     es_connection_ = xpc_connection_create(NULL, NULL);
     xpc_connection_set_event_handler(es_connection_, ^(xpc_object_t peer)
     {
         xpc_type_t type = xpc_get_type(peer);
         if (type != XPC_TYPE_ERROR)
         {
+            // The event ring of the client on the other end of 'peer' (see ESEventRing.hpp), only used by the handler of 'peer'
+            __block ESEventRing *ring = nullptr;
+            __block void *ring_memory = nullptr;
+            __block size_t ring_size = 0;
+
             xpc_connection_set_event_handler((xpc_connection_t) peer, ^(xpc_object_t message)
             {
                 xpc_type_t type = xpc_get_type(message);
                 if (type == XPC_TYPE_DICTIONARY)
                 {
-                    const char *msg = xpc_dictionary_get_string(message, IOEventKey);
-                    const uint64_t msg_length = xpc_dictionary_get_uint64(message, IOEventLengthKey);
-
-                    imemorystream ims(msg, msg_length);
-                    ims.imbue(std::locale(ims.getloc(), new PipeDelimiter));
-                    IOEvent event;
-                    ims >> event;
+                    xpc_object_t shmem = xpc_dictionary_get_value(message, ESEventRingKey);
+                    if (shmem != nullptr && ring == nullptr && xpc_get_type(shmem) == XPC_TYPE_SHMEM)
+                    {
+                        ring_size = xpc_shmem_map(shmem, &ring_memory);
+                        ring = ESEventRing::Attach(ring_memory, ring_size);
+                        if (ring == nullptr)
+                        {
+                            log_error("Ignoring the malformed EndpointSecurity event ring of size %zu", ring_size);
+                        }
+                    }
 
-                    ProcessCallbackResult result = eventCallback_ != nullptr ? eventCallback_(sandbox, const_cast<const IOEvent &>(event), hostPid_, IOEventBacking::EndpointSecurity) : ProcessCallbackResult::Done;
+                    // Doorbells only say that there are events in the ring; events that did not fit in it come after the ones that did
+                    if (ring != nullptr)
+                    {
+                        DrainRing(sandbox, (xpc_connection_t) peer, ring);
+                    }
 
-                    uint64_t response = xpc_response_error;
-                    switch (result)
+                    size_t msg_length = 0;
+                    const char *msg = (const char *) xpc_dictionary_get_data(message, IOEventKey, &msg_length);
+                    if (msg == nullptr)
                     {
-                        case ProcessCallbackResult::Done:
-                            response = xpc_response_success;
-                            break;
-                        case ProcessCallbackResult::MuteSource:
-                            response = xpc_response_mute_process;
-                            break;
-                        case ProcessCallbackResult::Auth:
-                            response = xpc_response_auth;
-                            break;
+                        return;
                     }
 
-                    xpc_object_t reply = xpc_dictionary_create_reply(message);
-                    xpc_dictionary_set_uint64(reply, "response", response);
-                    xpc_connection_send_message((xpc_connection_t) peer, reply);
+                    // 'msg' points into 'message', both have to outlive the asynchronous processing
+                    xpc_retain(message);
+                    xpc_retain(peer);
+
+                    dispatch_async(GetQueueForEvent(sandbox, msg, msg_length), ^{
+                        xpc_object_t reply = xpc_dictionary_create_reply(message);
+                        xpc_dictionary_set_uint64(reply, "response", ProcessEvent(sandbox, msg, msg_length));
+                        xpc_connection_send_message((xpc_connection_t) peer, reply);
+                        xpc_release(reply);
+
+                        xpc_release(message);
+                        xpc_release(peer);
+                    });
                 }
                 else if (type == XPC_TYPE_ERROR)
                 {
@@ -70,7 +91,15 @@ EndpointSecuritySandbox::EndpointSecuritySandbox(pid_t host_pid, process_callbac
                     }
                     else if (message == XPC_ERROR_CONNECTION_INVALID)
                     {
+                        // The client is gone, no more events are put into its ring
+                        delete ring;
+                        ring = nullptr;
 
+                        if (ring_memory != nullptr)
+                        {
+                            munmap(ring_memory, ring_size);
+                            ring_memory = nullptr;
+                        }
                     }
                 }
             });
@@ -110,6 +139,147 @@ EndpointSecuritySandbox::EndpointSecuritySandbox(pid_t host_pid, process_callbac
     }
 }
 
+dispatch_queue_t EndpointSecuritySandbox::GetQueueForEvent(void *sandbox, const char *msg, size_t msg_length)
+{
+    pid_t pid = 0, ppid = 0;
+    return IOEvent::PeekProcessIds(msg, msg_length, &pid, &ppid)
+        ? eventShards_->GetQueue(shardKeyCallback_(sandbox, pid, ppid))
+        : eventShards_->GetQueue(0);
+}
+
+uint64_t EndpointSecuritySandbox::ProcessEvent(void *sandbox, const char *msg, size_t msg_length)
+{
+    // Most events are answered from their header alone, only the ones that are processed get decoded
+    IOEventHeader header;
+    ProcessCallbackResult result = ProcessCallbackResult::Done;
+    bool decoded = IOEvent::PeekHeader(msg, msg_length, &header);
+    if (decoded && eventCallback_ != nullptr && classifyCallback_(sandbox, header, hostPid_, IOEventBacking::EndpointSecurity, &result))
+    {
+        IOEvent event;
+        decoded = IOEvent::Deserialize(msg, msg_length, event);
+        if (decoded)
+        {
+            result = eventCallback_(sandbox, const_cast<const IOEvent &>(event), hostPid_, IOEventBacking::EndpointSecurity);
+        }
+    }
+
+    if (!decoded)
+    {
+        log_error("Dropping malformed EndpointSecurity event of length %zu", msg_length);
+    }
+
+    switch (result)
+    {
+        case ProcessCallbackResult::Done:
+            return xpc_response_success;
+        case ProcessCallbackResult::MuteSource:
+            return xpc_response_mute_process;
+        case ProcessCallbackResult::Auth:
+            return xpc_response_auth;
+    }
+
+    return xpc_response_error;
+}
+
+void EndpointSecuritySandbox::DrainRing(void *sandbox, xpc_connection_t peer, ESEventRing *ring)
+{
+    ring->Drain([&](const ESEventRecord &record, const char *event)
+    {
+        // The record is freed once this returns, the event is processed asynchronously
+        size_t msg_length = record.length;
+        char *msg = (char *) malloc(msg_length);
+        if (msg == nullptr)
+        {
+            log_error("Dropping EndpointSecurity event of length %zu, out of memory", msg_length);
+            return;
+        }
+
+        memcpy(msg, event, msg_length);
+
+        uint64_t id = record.id;
+        bool auth = (record.flags & kESEventRecordAuth) != 0;
+        audit_token_t audit_token = record.auditToken;
+        xpc_retain(peer);
+
+        dispatch_async(GetQueueForEvent(sandbox, msg, msg_length), ^{
+            uint64_t response = ProcessEvent(sandbox, msg, msg_length);
+            free(msg);
+
+            // Only decisions are sent back: the extension holds on to AUTH events until it gets theirs
+            if (auth || response != xpc_response_success)
+            {
+                xpc_object_t decision = xpc_dictionary_create(NULL, NULL, 0);
+                xpc_dictionary_set_uint64(decision, "response", response);
+                xpc_dictionary_set_uint64(decision, ESEventDecisionIdKey, id);
+                xpc_dictionary_set_data(decision, ESEventDecisionAuditTokenKey, &audit_token, sizeof(audit_token));
+                xpc_connection_send_message(peer, decision);
+                xpc_release(decision);
+            }
+
+            xpc_release(peer);
+        });
+    });
+}
+
+bool EndpointSecuritySandbox::SetMutedPathPrefixes(const std::set<std::string> &paths)
+{
+    xpc_object_t array = xpc_array_create(NULL, 0);
+    for (const std::string &path : paths)
+    {
+        xpc_array_set_string(array, XPC_ARRAY_APPEND, path.c_str());
+    }
+
+    xpc_object_t post = xpc_dictionary_create(NULL, NULL, 0);
+    xpc_dictionary_set_uint64(post, "command", xpc_set_es_muted_paths);
+    xpc_dictionary_set_value(post, "paths", array);
+    xpc_release(array);
+
+    xpc_object_t response = xpc_connection_send_message_with_reply_sync(xpc_bridge_, post);
+    xpc_release(post);
+
+    uint64_t status = xpc_get_type(response) == XPC_TYPE_DICTIONARY ? xpc_dictionary_get_uint64(response, "response") : 0;
+    xpc_release(response);
+
+    if (status != xpc_response_success)
+    {
+        log_error("Could not update the muted EndpointSecurity path prefixes - status: %lld", status);
+        return false;
+    }
+
+    return true;
+}
+
+bool EndpointSecuritySandbox::SetAuthResultCaching(bool enabled)
+{
+    return SendSetting(xpc_set_es_auth_caching, "enabled", enabled, "auth result caching");
+}
+
+bool EndpointSecuritySandbox::SetIOEventSubscriptions(bool subscribed)
+{
+    return SendSetting(xpc_set_es_io_subscriptions, "subscribed", subscribed, "I/O event subscriptions");
+}
+
+bool EndpointSecuritySandbox::SendSetting(uint64_t command, const char *key, bool value, const char *description)
+{
+    xpc_object_t post = xpc_dictionary_create(NULL, NULL, 0);
+    xpc_dictionary_set_uint64(post, "command", command);
+    xpc_dictionary_set_bool(post, key, value);
+
+    xpc_object_t response = xpc_connection_send_message_with_reply_sync(xpc_bridge_, post);
+    xpc_release(post);
+
+    uint64_t status = xpc_get_type(response) == XPC_TYPE_DICTIONARY ? xpc_dictionary_get_uint64(response, "response") : 0;
+    xpc_release(response);
+
+    if (status != xpc_response_success)
+    {
+        log_error("Could not set EndpointSecurity %{public}s to %d - status: %lld", description, value, status);
+        return false;
+    }
+
+    return true;
+}
+
 EndpointSecuritySandbox::~EndpointSecuritySandbox()
 {
     xpc_object_t post = xpc_dictionary_create(NULL, NULL, 0);
@@ -119,6 +289,12 @@ EndpointSecuritySandbox::~EndpointSecuritySandbox()
     xpc_connection_cancel(es_connection_);
     xpc_release(es_connection_);
 
+    // Events still being received may be handed to the shards, wait for them before the shards are drained
+    if (eventQueue_ != nullptr)
+    {
+        dispatch_sync(eventQueue_, ^{});
+    }
+
     xpc_bridge_ = nullptr;
     es_connection_ = nullptr;
 
@@ -127,6 +303,13 @@ EndpointSecuritySandbox::~EndpointSecuritySandbox()
         dispatch_release(eventQueue_);
     }
 
+    if (eventShards_ != nullptr)
+    {
+        eventShards_->Drain();
+        delete eventShards_;
+        eventShards_ = nullptr;
+    }
+
     eventCallback_ = nullptr;
 
     log_debug("%s", "Successfully shut-down EndpointSecurity sandbox subsystem.");
@@ -4,8 +4,16 @@
 #ifndef EndpointSecuritySandbox_hpp
 #define EndpointSecuritySandbox_hpp
 
+#include "EventQueuePool.hpp"
 #include "IOEvent.hpp"
 
+#include <set>
+#include <string>
+
+#if __APPLE__
+class ESEventRing;
+#endif
+
 class EndpointSecuritySandbox final
 {
 
@@ -14,10 +22,29 @@ private:
     pid_t hostPid_;
     dispatch_queue_t eventQueue_ = nullptr;
     process_callback eventCallback_ = nullptr;
+    classify_callback classifyCallback_ = nullptr;
+    shard_key_callback shardKeyCallback_ = nullptr;
+    
+#if __APPLE__
+    // Events are received on 'eventQueue_' and processed on one of these, see 'shard_key_callback'
+    EventQueuePool *eventShards_ = nullptr;
+#endif
     
 #if __APPLE__
     xpc_connection_t xpc_bridge_ = nullptr;
     xpc_connection_t es_connection_ = nullptr;
+
+    // Synchronously sends a boolean setting to the extension, returns false if it was rejected
+    bool SendSetting(uint64_t command, const char *key, bool value, const char *description);
+
+    // The shard a serialized event is processed on
+    dispatch_queue_t GetQueueForEvent(void *sandbox, const char *msg, size_t msg_length);
+
+    // Processes a serialized event, returns the response for the extension (see XPCCommands)
+    uint64_t ProcessEvent(void *sandbox, const char *msg, size_t msg_length);
+
+    // Hands the events of the ring of a client to their shards, see ESEventRing.hpp
+    void DrainRing(void *sandbox, xpc_connection_t peer, ESEventRing *ring);
 #endif
     
 public:
@@ -26,7 +53,18 @@ public:
     ~EndpointSecuritySandbox();
     
 #if __APPLE__
-    EndpointSecuritySandbox(pid_t host_pid, process_callback callback, void *sandbox, xpc_connection_t bridge);
+    EndpointSecuritySandbox(pid_t host_pid, process_callback callback, classify_callback classify, shard_key_callback shard_key, void *sandbox, xpc_connection_t bridge);
+
+    // Replaces the set of target path prefixes the EndpointSecurity clients ignore, returns false if the extension rejected the update
+    bool SetMutedPathPrefixes(const std::set<std::string> &paths);
+
+    // Sets whether the EndpointSecurity clients let the kernel cache the AUTH events they allow (disabling clears the cache),
+    // returns false if the extension rejected the update
+    bool SetAuthResultCaching(bool enabled);
+
+    // Subscribes the EndpointSecurity clients that observe file accesses to their events (or unsubscribes them), returns false
+    // if the extension rejected the update
+    bool SetIOEventSubscriptions(bool subscribed);
 #endif
 };
 
@@ -8,150 +8,185 @@
 #include "IOHandler.hpp"
 #include "Sandbox.hpp"
 
-static ProcessCallbackResult _process_event(Sandbox *sandbox, const IOEvent &event, pid_t host, IOEventBacking backing)
+// Classifies an event from its process ids alone: the events of the host and of processes no pip is interested in (most of the
+// EndpointSecurity events of a busy machine) are answered without decoding, formatting or looking up anything else. Returns false,
+// with the response to the event in 'result', for the events that are not processed any further.
+static bool _classify_event(Sandbox *sandbox, pid_t pid, pid_t ppid, pid_t oppid, es_action_type_t action, pid_t host, IOEventBacking backing, ProcessCallbackResult *result)
 {
-    pid_t pid = event.GetPid();
     if (pid == host)
     {
-        if (event.GetActionType() == ES_ACTION_TYPE_AUTH)
-        {
-            return ProcessCallbackResult::Auth;
-        }
-
-        return ProcessCallbackResult::Done;
+        *result = action == ES_ACTION_TYPE_AUTH ? ProcessCallbackResult::Auth : ProcessCallbackResult::Done;
+        return false;
     }
 
-    bool isInterposedEvent = backing == IOEventBacking::Interposing;
+    // Interposed events are only reported by the processes of pips
+    if (backing == IOEventBacking::Interposing)
+    {
+        return true;
+    }
 
-    bool ppid_found = sandbox->GetAllowlistedPidMap().find(event.GetParentPid()) != sandbox->GetAllowlistedPidMap().end();
-    bool original_ppid_found = sandbox->GetAllowlistedPidMap().find(event.GetOriginalParentPid()) != sandbox->GetAllowlistedPidMap().end();
+    PidTable &pids = sandbox->GetPidTable();
+    if (pids.Has(ppid, kPidFlagsAllowlisted) || (oppid != ppid && pids.Has(oppid, kPidFlagsAllowlisted)))
+    {
+        return true;
+    }
 
-    size_t msg_length = IOEvent::max_size();
-    char msg[msg_length];
+    *result = action == ES_ACTION_TYPE_AUTH ? ProcessCallbackResult::Auth : ProcessCallbackResult::MuteSource;
+    return false;
+}
 
-    omemorystream oms(msg, sizeof(msg));
-    oms << event;
+static ProcessCallbackResult _process_event(Sandbox *sandbox, const IOEvent &event, pid_t host, IOEventBacking backing)
+{
+    pid_t pid = event.GetPid();
 
-    if (isInterposedEvent || (ppid_found || original_ppid_found))
+    ProcessCallbackResult result;
+    if (!_classify_event(sandbox, pid, event.GetParentPid(), event.GetOriginalParentPid(), event.GetActionType(), host, backing, &result))
     {
-        IOHandler handler = IOHandler(sandbox);
+        return result;
+    }
 
-        if (isInterposedEvent)
-        {
-            // Some Apple tools use posix_spawn* family functions to execute other binaries - those binaries sometimes do
-            // synchronous operations, blocking the caller until their execution finishes. This leads to fork events being reported
-            // after all other I/O events when interposing within the new binary. Because there is no way to get the child pid before
-            // the posix_spawn* call returns, we have to manually add a fork event here if the parent of the binary in question is
-            // already being tracked.
+    bool isInterposedEvent = backing == IOEventBacking::Interposing;
 
-            if (event.GetEventType() == ES_EVENT_TYPE_NOTIFY_FORK && !sandbox->GetForceForkedPidMap().empty())
+    PidTable &pids = sandbox->GetPidTable();
+
+    IOHandler handler = IOHandler(sandbox);
+    bool isTracked = false;
+
+    if (isInterposedEvent)
+    {
+        // Some Apple tools use posix_spawn* family functions to execute other binaries - those binaries sometimes do
+        // synchronous operations, blocking the caller until their execution finishes. This leads to fork events being reported
+        // after all other I/O events when interposing within the new binary. Because there is no way to get the child pid before
+        // the posix_spawn* call returns, we have to manually add a fork event here if the parent of the binary in question is
+        // already being tracked.
+
+        PidInfo child;
+        if (event.GetEventType() == ES_EVENT_TYPE_NOTIFY_FORK && pids.Lookup(event.GetChildPid(), &child) && child.Has(kPidFlagsForceForked))
+        {
+            if (child.forceForkedParent == event.GetPid())
             {
-                auto it = sandbox->GetForceForkedPidMap().find(event.GetChildPid());
-                if (it != sandbox->GetForceForkedPidMap().end())
-                {
-                    if (it->first == event.GetChildPid() && it->second == event.GetPid())
-                    {
-                        sandbox->RemoveProcessPid(sandbox->GetForceForkedPidMap(), event.GetChildPid());
+                pids.Clear(event.GetChildPid(), kPidFlagsForceForked);
 
-                        log_debug("Ignoring fork event, previously forced fork for child PID(%d) and PPID(%d) with path: %{public}s",
-                                  event.GetChildPid(), event.GetPid(), event.GetExecutablePath());
+                log_debug("Ignoring fork event, previously forced fork for child PID(%d) and PPID(%d) with path: %{public}s",
+                          event.GetChildPid(), event.GetPid(), event.GetExecutablePath());
 
-                        return ProcessCallbackResult::Done;
-                    }
-                }
+                return ProcessCallbackResult::Done;
             }
+        }
 
-            bool isTracked = handler.TryInitializeWithTrackedProcess(pid);
-            if (!isTracked && (event.GetEventType() != ES_EVENT_TYPE_NOTIFY_EXEC && event.GetEventType() != ES_EVENT_TYPE_NOTIFY_EXIT))
-            {
-                IOEvent fork_event(event.GetParentPid(), event.GetPid(), event.GetParentPid(), ES_EVENT_TYPE_NOTIFY_FORK, ES_ACTION_TYPE_NOTIFY, "", "", event.GetExecutablePath(), false);
+        isTracked = handler.TryInitializeWithTrackedProcess(pid);
+        if (!isTracked && (event.GetEventType() != ES_EVENT_TYPE_NOTIFY_EXEC && event.GetEventType() != ES_EVENT_TYPE_NOTIFY_EXIT))
+        {
+            IOEvent fork_event(event.GetParentPid(), event.GetPid(), event.GetParentPid(), ES_EVENT_TYPE_NOTIFY_FORK, ES_ACTION_TYPE_NOTIFY, "", "", event.GetExecutablePath(), false);
 
-                IOHandler handler = IOHandler(sandbox);
-                if (handler.TryInitializeWithTrackedProcess(fork_event.GetPid()))
-                {
-                    log_debug("Forced fork event for child PID(%d) and PPID(%d) with path: %{public}s",
-                              fork_event.GetChildPid(), fork_event.GetPid(), fork_event.GetExecutablePath());
+            IOHandler handler = IOHandler(sandbox);
+            if (handler.TryInitializeWithTrackedProcess(fork_event.GetPid()))
+            {
+                log_debug("Forced fork event for child PID(%d) and PPID(%d) with path: %{public}s",
+                          fork_event.GetChildPid(), fork_event.GetPid(), fork_event.GetExecutablePath());
 
-                    sandbox->GetForceForkedPidMap().emplace(fork_event.GetChildPid(), fork_event.GetPid());
-                    handler.HandleEvent(fork_event);
-                }
+                pids.Set(fork_event.GetChildPid(), kPidFlagsForceForked, fork_event.GetPid());
+                handler.HandleEvent(fork_event);
             }
         }
+    }
 
-        if (handler.TryInitializeWithTrackedProcess(pid))
-        {
-    #pragma clang diagnostic push
-    #pragma clang diagnostic ignored "-Wswitch"
+    // A process that just got tracked through a forced fork is looked up again
+    if (isTracked || handler.TryInitializeWithTrackedProcess(pid))
+    {
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wswitch"
 
-            if (!isInterposedEvent)
+        if (!isInterposedEvent)
+        {
+            switch (event.GetEventType())
             {
-                switch (event.GetEventType())
+                case ES_EVENT_TYPE_NOTIFY_FORK:
                 {
-                    case ES_EVENT_TYPE_NOTIFY_FORK:
-                    {
-                        sandbox->SetProcessPidPair(sandbox->GetAllowlistedPidMap(), pid, event.GetParentPid());
-                        break;
-                    }
-                    case ES_EVENT_TYPE_NOTIFY_EXIT:
-                        sandbox->RemoveProcessPid(sandbox->GetAllowlistedPidMap(), pid);
-                        break;
+                    pids.Set(pid, kPidFlagsAllowlisted, event.GetParentPid());
+                    break;
                 }
+                case ES_EVENT_TYPE_NOTIFY_EXIT:
+                    pids.Clear(pid, kPidFlagsAllowlisted);
+                    break;
             }
+        }
 
-            handler.HandleEvent(event);
+        handler.HandleEvent(event);
 
-    #pragma clang diagnostic pop
-        }
-        else
-        {
-            // TODO: Delete
-            size_t msg_length = IOEvent::max_size();
-            char msg[msg_length];
+#pragma clang diagnostic pop
+    }
 
-            omemorystream oms(msg, sizeof(msg));
-            oms << event;
-            log_debug("Not tracked: %{public}.*s",(int) event.Size(), msg);
-        }
+    return event.GetActionType() == ES_ACTION_TYPE_AUTH ? ProcessCallbackResult::Auth : ProcessCallbackResult::Done;
+}
 
-        if (event.GetActionType() == ES_ACTION_TYPE_AUTH)
+static bool classify_event(void *handle, const IOEventHeader &header, pid_t host, IOEventBacking backing, ProcessCallbackResult *result)
+{
+    Sandbox* sandbox = (Sandbox *) handle;
+#if __APPLE__
+    if (sandbox->IsRunningHybrid())
+    {
+        // Whether a process is interesting depends on the events of both sources queued before its own, which are only known on
+        // the queue merging them: all that can be told here is whether the event is the host's own
+        if (header.pid == host)
         {
-            return ProcessCallbackResult::Auth;
+            *result = ProcessCallbackResult::Done;
+            return false;
         }
+
+        return true;
     }
-    else
-    {
-        switch (backing)
-        {
-            case IOEventBacking::EndpointSecurity:
-            {
-                if (event.GetActionType() == ES_ACTION_TYPE_AUTH)
-                {
-                    return ProcessCallbackResult::Auth;
-                }
+#endif
 
-                return ProcessCallbackResult::MuteSource;
-                break;
-            }
-            case IOEventBacking::Interposing:
-            {
-                assert(false); // Should never happen when interposed events are handled!
-                break;
-            }
-        }
+    return _classify_event(sandbox, header.pid, header.ppid, header.oppid, (es_action_type_t) header.actionType, host, backing, result);
+}
+
+// Events are sharded by the root process id of the pip they belong to. A process that is not tracked (yet), e.g. because
+// its fork event is still queued, is attributed to the pip of its parent; everything else is sharded by its parent pid.
+static uint64_t event_shard_key(void *handle, pid_t pid, pid_t ppid)
+{
+    Sandbox* sandbox = (Sandbox *) handle;
+
+    std::shared_ptr<SandboxedProcess> process = sandbox->FindTrackedProcess(pid);
+    if (process == nullptr)
+    {
+        process = sandbox->FindTrackedProcess(ppid);
     }
 
-    return ProcessCallbackResult::Done;
+    return process != nullptr ? process->GetPip()->GetProcessId() : ppid;
 }
 
-static ProcessCallbackResult process_event(void *handle, const IOEvent event, pid_t host, IOEventBacking backing)
+static ProcessCallbackResult process_event(void *handle, const IOEvent &event, pid_t host, IOEventBacking backing)
 {
     Sandbox* sandbox = (Sandbox *) handle;
 #if __APPLE__
     if (sandbox->IsRunningHybrid())
     {
+        // The only copy of the event, which has to outlive its caller
+        IOEvent *pending = new IOEvent(event);
         dispatch_async(sandbox->GetHybridQueue(), ^{
+            std::unique_ptr<IOEvent> owned(pending);
+            const IOEvent &event = *owned;
+
+            // Both sources report most accesses, only the first report of an access is processed
+            EventDeduplicator &deduplicator = sandbox->GetHybridEventDeduplicator();
+            BackendSelector &backendSelector = sandbox->GetHybridBackendSelector();
+            uint64_t lagNs = 0;
+            if (deduplicator.IsDuplicate(event, backing, &lagNs))
+            {
+                backendSelector.RecordEvent(event, backing, /* matched */ true, lagNs);
+                return;
+            }
+
             // TODO: We can't mute processes when merging ES and detours events asynchronously without introducing some async callback
             _process_event(sandbox, event, host, backing);
+
+            // An event is handled IFF its process is tracked (possibly through a fork forced while processing it)
+            if (sandbox->GetPidTable().Has(event.GetPid(), kPidFlagsTracked))
+            {
+                deduplicator.Remember(event, backing);
+                backendSelector.RecordEvent(event, backing, /* matched */ false, 0);
+            }
         });
 
         return ProcessCallbackResult::Done;
@@ -0,0 +1,71 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef EventQueuePool_h
+#define EventQueuePool_h
+
+#if __APPLE__
+
+#include <dispatch/dispatch.h>
+#include <thread>
+#include <vector>
+
+#define EVENT_QUEUE_POOL_MAX_SIZE 16
+
+/*!
+ * A fixed set of serial dispatch queues that events are sharded onto by a key (the root process id of the pip an event
+ * belongs to), so events sharing a key are processed in order while events of different pips are processed in parallel.
+ */
+class EventQueuePool final
+{
+
+private:
+
+    std::vector<dispatch_queue_t> queues_;
+
+public:
+
+    EventQueuePool() = delete;
+
+    EventQueuePool(const char *name)
+    {
+        unsigned int count = std::thread::hardware_concurrency();
+        count = count == 0 ? 1 : (count > EVENT_QUEUE_POOL_MAX_SIZE ? EVENT_QUEUE_POOL_MAX_SIZE : count);
+
+        char queueName[PATH_MAX] = { '\0' };
+        for (unsigned int i = 0; i < count; i++)
+        {
+            snprintf(queueName, sizeof(queueName), "%s.shard_%u", name, i);
+            queues_.push_back(dispatch_queue_create(queueName, dispatch_queue_attr_make_with_qos_class(
+                DISPATCH_QUEUE_SERIAL, QOS_CLASS_USER_INTERACTIVE, -1
+            )));
+        }
+    }
+
+    ~EventQueuePool()
+    {
+        for (dispatch_queue_t queue : queues_)
+        {
+            dispatch_release(queue);
+        }
+
+        queues_.clear();
+    }
+
+    inline size_t Size() const { return queues_.size(); }
+
+    // Blocks until all work enqueued so far has been processed, must not be called from any of the queues of this pool
+    void Drain() const
+    {
+        for (dispatch_queue_t queue : queues_)
+        {
+            dispatch_sync(queue, ^{});
+        }
+    }
+
+    inline dispatch_queue_t GetQueue(uint64_t key) const { return queues_[key % queues_.size()]; }
+};
+
+#endif /* __APPLE__ */
+
+#endif /* EventQueuePool_h */
@@ -20,8 +20,88 @@ PolicySearchCursor AccessHandler::FindManifestRecord(const char *absolutePath, s
     assert(absolutePath[0] == '/');
     const char *pathWithoutRootSentinel = absolutePath + 1;
 
-    size_t len = pathLength == -1 ? strlen(pathWithoutRootSentinel) : pathLength;
-    return FindFileAccessPolicyInTreeEx(GetPip()->GetManifestRecord(), pathWithoutRootSentinel, len);
+    size_t len = pathLength == -1 ? strlen(pathWithoutRootSentinel) : pathLength - 1;
+    PolicySearchMemo *policyMemo = GetPip()->GetPolicySearchMemo();
+
+    // The same paths are accessed over and over by the processes of a pip: a path that was already searched for needs no search
+    PolicySearchCursor cursor;
+    if (policyMemo->TryGet(pathWithoutRootSentinel, len, &cursor))
+    {
+        return cursor;
+    }
+
+    // Search for the parent directory first (or get its cursor from the memo) and then resume from there:
+    // Find(root, "a/b/c") is equivalent to Find(Find(root, "a/b"), "c").
+    size_t dirLength = len;
+    while (dirLength > 0 && pathWithoutRootSentinel[dirLength - 1] != '/')
+    {
+        dirLength--;
+    }
+
+    size_t parentLength = dirLength > 0 ? dirLength - 1 : 0;
+    if (!PolicySearchMemo::CanMemoize(parentLength))
+    {
+        cursor = FindFileAccessPolicyInTreeEx(GetPip()->GetManifestRootCursor(), pathWithoutRootSentinel, len);
+        policyMemo->Put(pathWithoutRootSentinel, len, cursor);
+        return cursor;
+    }
+
+    // While a batch is handled, the accesses that follow each other mostly are in the same directory
+    if (pendingReports_ != nullptr && lastParent_.length() == parentLength && memcmp(lastParent_.data(), pathWithoutRootSentinel, parentLength) == 0)
+    {
+        cursor = FindFileAccessPolicyInTreeEx(lastParentCursor_, pathWithoutRootSentinel + dirLength, len - dirLength);
+        policyMemo->Put(pathWithoutRootSentinel, len, cursor);
+        return cursor;
+    }
+
+    PolicySearchCursor parentCursor;
+    if (!policyMemo->TryGet(pathWithoutRootSentinel, parentLength, &parentCursor))
+    {
+        // the search expects a null-terminated path
+        char parent[PATH_MAX];
+        memcpy(parent, pathWithoutRootSentinel, parentLength);
+        parent[parentLength] = '\0';
+        parentCursor = FindFileAccessPolicyInTreeEx(GetPip()->GetManifestRootCursor(), parent, parentLength);
+        policyMemo->Put(pathWithoutRootSentinel, parentLength, parentCursor);
+    }
+
+    if (pendingReports_ != nullptr)
+    {
+        lastParent_.assign(pathWithoutRootSentinel, parentLength);
+        lastParentCursor_ = parentCursor;
+    }
+
+    cursor = FindFileAccessPolicyInTreeEx(parentCursor, pathWithoutRootSentinel + dirLength, len - dirLength);
+    policyMemo->Put(pathWithoutRootSentinel, len, cursor);
+    return cursor;
+}
+
+void AccessHandler::BeginBatch(std::vector<AccessReport> *reports)
+{
+    assert(pendingReports_ == nullptr && reports != nullptr);
+    pendingReports_ = reports;
+    lastParent_.clear();
+}
+
+void AccessHandler::EndBatch()
+{
+    assert(pendingReports_ != nullptr);
+    sandbox_->SendAccessReports(pendingReports_->data(), pendingReports_->size());
+    pendingReports_->clear();
+    pendingReports_ = nullptr;
+    lastParent_.clear();
+}
+
+void AccessHandler::SendReport(AccessReport &report)
+{
+    if (pendingReports_ != nullptr)
+    {
+        pendingReports_->push_back(report);
+    }
+    else
+    {
+        sandbox_->SendAccessReport(report, GetPip());
+    }
 }
 
 void AccessHandler::SetProcessPath(AccessReport *report)
@@ -50,11 +130,87 @@ ReportResult AccessHandler::ReportFileOpAccess(FileOperation operation,
 
     assert(strlen(policyResult.Path()) > 0);
     strlcpy(report.path, policyResult.Path(), sizeof(report.path));
-    sandbox_->SendAccessReport(report, GetPip());
+    SendReport(report);
 
     return kReported;
 }
 
+ReportResult AccessHandler::ReportUncheckedAccess(FileOperation operation,
+                                                  const char *path,
+                                                  RequestedAccess requestedAccess,
+                                                  FileAccessStatus status,
+                                                  pid_t processID)
+{
+    AccessReport report =
+    {
+        .operation          = operation,
+        .pid                = processID,
+        .rootPid            = GetProcessId(),
+        .requestedAccess    = (DWORD)requestedAccess,
+        .status             = status,
+        .reportExplicitly   = 0,
+        .error              = 0,
+        .pipId              = GetPipId(),
+        .path               = {0},
+        .stats              = {0}
+    };
+
+    assert(strlen(path) > 0);
+    strlcpy(report.path, path, sizeof(report.path));
+    SendReport(report);
+
+    return kReported;
+}
+
+bool AccessHandler::TryReportUnchecked(FileOperation operation, const char *path, CheckFunc checker, const pid_t pid, bool isDir, AccessCheckResult *result)
+{
+    RequestedAccess access;
+    if (isDir && (checker == Checkers::CheckWrite || checker == Checkers::CheckProbe || checker == Checkers::CheckExecute))
+    {
+        // probing a directory is allowed and never reported explicitly, whatever its policy (see PolicyResult::CheckReadAccess)
+        *result = AccessCheckResult(
+            RequestedAccess::Probe,
+            ResultAction::Allow,
+            CheckReportAnyAccess(GetFamFlags(), /* accessDenied */ false) ? ReportLevel::Report : ReportLevel::Ignore);
+
+        if (result->ShouldReport())
+        {
+            ReportUncheckedAccess(operation, path, RequestedAccess::Probe, FileAccessStatus::FileAccessStatus_Allowed, pid);
+        }
+
+        return true;
+    }
+    else if (checker == Checkers::CheckEnumerateDir || (isDir && (checker == Checkers::CheckRead || checker == Checkers::CheckReadWrite)))
+    {
+        access = RequestedAccess::Enumerate;
+    }
+    else if (checker == Checkers::CheckRead || checker == Checkers::CheckReadWrite || checker == Checkers::CheckExecute)
+    {
+        access = RequestedAccess::Read;
+    }
+    else if (checker == Checkers::CheckLookup)
+    {
+        access = RequestedAccess::Lookup;
+    }
+    else if (checker == Checkers::CheckProbe)
+    {
+        access = RequestedAccess::Probe;
+    }
+    else if (checker == Checkers::CheckWrite)
+    {
+        access = RequestedAccess::Write;
+    }
+    else
+    {
+        // symlink and directory creation: what is reported depends on whether the policy allows it
+        return false;
+    }
+
+    *result = AccessCheckResult(access, ResultAction::Allow, ReportLevel::Report);
+    ReportUncheckedAccess(operation, path, access, FileAccessStatus::FileAccessStatus_CannotDeterminePolicy, pid);
+    return true;
+}
+
 bool AccessHandler::ReportProcessTreeCompleted(pid_t processId)
 {
     AccessReport report =
@@ -72,7 +228,7 @@ bool AccessHandler::ReportProcessTreeCompleted(pid_t processId)
     };
 
     SetProcessPath(&report);
-    sandbox_->SendAccessReport(report, GetPip());
+    SendReport(report);
 
     return kReported;
 }
@@ -94,7 +250,7 @@ bool AccessHandler::ReportProcessExited(pid_t childPid)
     };
 
     SetProcessPath(&report);
-    sandbox_->SendAccessReport(report, GetPip());
+    SendReport(report);
 
     return kReported;
 }
@@ -117,14 +273,14 @@ bool AccessHandler::ReportChildProcessSpawned(pid_t childPid)
 
     SetProcessPath(&report);
     assert(strlen(report.path) > 0);
-    sandbox_->SendAccessReport(report, GetPip());
+    SendReport(report);
 
     return kReported;
 }
 
-PolicyResult AccessHandler::PolicyForPath(const char *absolutePath)
+PolicyResult AccessHandler::PolicyForPath(const char *absolutePath, size_t pathLength)
 {
-    PolicySearchCursor cursor = FindManifestRecord(absolutePath);
+    PolicySearchCursor cursor = FindManifestRecord(absolutePath, pathLength);
     if (!cursor.IsValid())
     {
         log_error("Invalid policy cursor for path '%s'", absolutePath);
@@ -133,29 +289,20 @@ PolicyResult AccessHandler::PolicyForPath(const char *absolutePath)
     return PolicyResult(GetPip()->GetFamFlags(), absolutePath, cursor);
 }
 
-static bool is_prefix(const char *s1, const char *s2)
-{
-    int c;
-    while ((c = *s2++) != '\0')
-    {
-        if (c != *s1++)
-        {
-            return false;
-        }
-    }
-
-    return true;
-}
+static const char kDataPartitionPrefix[] = "/System/Volumes/Data/";
+static const size_t kDataPartitionPrefixLength = sizeof(kDataPartitionPrefix) - 1;
 
-const char* AccessHandler::IgnoreDataPartitionPrefix(const char* path)
+const char* AccessHandler::IgnoreDataPartitionPrefix(const char* path, size_t *length)
 {
-    const char *marker = path;
-    if (is_prefix(marker, kDataPartitionPrefix))
+    // A compare of a constant length (with the length checked upfront) compiles to a couple of wide loads and compares
+    if (*length >= kDataPartitionPrefixLength && memcmp(path, kDataPartitionPrefix, kDataPartitionPrefixLength) == 0)
     {
-        marker += kAdjustedPrefixLength;
+        // keep the separator, the remainder still has to be an absolute path
+        *length -= kDataPartitionPrefixLength - 1;
+        return path + kDataPartitionPrefixLength - 1;
     }
 
-    return marker;
+    return path;
 }
 
 AccessCheckResult AccessHandler::CheckAndReportInternal(FileOperation operation,
@@ -164,8 +311,15 @@ AccessCheckResult AccessHandler::CheckAndReportInternal(FileOperation operation,
                                                         const pid_t pid,
                                                         bool isDir)
 {
-    PolicyResult policy = PolicyForPath(IgnoreDataPartitionPrefix(path));
     AccessCheckResult result = AccessCheckResult::Invalid();
+    if (GetPip()->IsObserveOnly() && TryReportUnchecked(operation, path, checker, pid, isDir, &result))
+    {
+        return result;
+    }
+
+    size_t length = strlen(path);
+    const char *policyPath = IgnoreDataPartitionPrefix(path, &length);
+    PolicyResult policy = PolicyForPath(policyPath, length);
     checker(policy, isDir, &result);
 
     if (!result.ShouldReport())
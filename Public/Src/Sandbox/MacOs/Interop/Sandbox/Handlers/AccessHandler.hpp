@@ -7,6 +7,10 @@
 #include "Sandbox.hpp"
 #include "Checkers.hpp"
 #include "IOEvent.hpp"
+#include "PolicySearchMemo.hpp"
+
+#include <string>
+#include <vector>
 
 enum ReportResult
 {
@@ -22,25 +26,58 @@ struct AccessHandler
 
 private:
 
-    const char *IgnoreDataPartitionPrefix(const char* path);
-    const char *kDataPartitionPrefix = "/System/Volumes/Data/";
-    const size_t kAdjustedPrefixLength = strlen("/System/Volumes/Data");
+    /*! Strips the data partition prefix off 'path' (of length '*length'), updating '*length' accordingly */
+    const char *IgnoreDataPartitionPrefix(const char* path, size_t *length);
 
     Sandbox *sandbox_;
 
     std::shared_ptr<SandboxedProcess> process_;
 
+    /*! While a batch is handled (see BeginBatch), the reports to send at its end and the cursor of the last parent directory searched */
+    std::vector<AccessReport> *pendingReports_;
+    std::string lastParent_;
+    PolicySearchCursor lastParentCursor_;
+
+    /*! Sends 'report' right away, or queues it when a batch is being handled */
+    void SendReport(AccessReport &report);
+
     ReportResult ReportFileOpAccess(FileOperation operation,
                                     PolicyResult policy,
                                     AccessCheckResult accessCheckResult,
                                     pid_t processID);
 
+    ReportResult ReportUncheckedAccess(FileOperation operation,
+                                       const char *path,
+                                       RequestedAccess requestedAccess,
+                                       FileAccessStatus status,
+                                       pid_t processID);
+
+    /*!
+     * Reports an access of an observe-only pip (see SandboxedPip::IsObserveOnly) without looking up its policy: the access
+     * 'checker' would check is reported as is (with FileAccessStatus_CannotDeterminePolicy), for the host to check it.
+     * Returns false (reporting nothing) for the checkers whose access depends on the policy, which are then run as usual.
+     */
+    bool TryReportUnchecked(FileOperation operation, const char *path, CheckFunc checker, const pid_t pid, bool isDir, AccessCheckResult *result);
+
 protected:
 
     inline Sandbox* GetSandbox()                                const { return sandbox_; }
     inline const std::shared_ptr<SandboxedProcess> GetProcess() const { return process_; }
     inline const std::shared_ptr<SandboxedPip> GetPip()         const { return process_->GetPip(); }
 
+    /*!
+     * Until EndBatch, reports are queued in 'reports' rather than sent one by one, and consecutive searches of paths in the same
+     * directory resume from the cursor of that directory without going through the memo of the pip (see FindManifestRecord).
+     */
+    void BeginBatch(std::vector<AccessReport> *reports);
+
+    /*! Sends the reports queued since BeginBatch, in order */
+    void EndBatch();
+
+    /*!
+     * 'pathLength' is the length of 'absolutePath' (computed when -1); paths already searched for by a process of the pip are
+     * not searched again, and other searches resume from the pip's memoized parent cursors
+     */
     PolicySearchCursor FindManifestRecord(const char *absolutePath, size_t pathLength = -1);
 
     /*!
@@ -83,6 +120,7 @@ public:
     {
         sandbox_           = sandbox;
         process_           = nullptr;
+        pendingReports_    = nullptr;
     }
 
     ~AccessHandler()
@@ -103,7 +141,16 @@ public:
      */
     bool TryInitializeWithTrackedProcess(pid_t pid);
 
-    inline void SetProcess(std::shared_ptr<SandboxedProcess> process) { process_ = process; }
+    inline void SetProcess(std::shared_ptr<SandboxedProcess> process)
+    {
+        // the cursor of the last parent directory points into the manifest of the pip of the previous process
+        if (process_ != nullptr && (process == nullptr || process->GetPip() != process_->GetPip()))
+        {
+            lastParent_.clear();
+        }
+
+        process_ = process;
+    }
 
     inline bool HasTrackedProcess()             const { return process_ != nullptr; }
     inline pid_t GetProcessId()                 const { return GetPip()->GetProcessId(); }
@@ -111,7 +158,7 @@ public:
     inline int GetProcessTreeSize()             const { return GetPip()->GetTreeSize(); }
     inline FileAccessManifestFlag GetFamFlags() const { return GetPip()->GetFamFlags(); }
 
-    PolicyResult PolicyForPath(const char *absolutePath);
+    PolicyResult PolicyForPath(const char *absolutePath, size_t pathLength = -1);
 
     bool ReportProcessTreeCompleted(pid_t processId);
     bool ReportProcessExited(pid_t childPid);
@@ -306,3 +306,38 @@ AccessCheckResult IOHandler::HandleEvent(const IOEvent &event)
             throw BuildXLException(message);
     }
 }
+
+void IOHandler::HandleEvents(const IOEvent *events, size_t count)
+{
+    std::vector<AccessReport> reports;
+    BeginBatch(&reports);
+
+    try
+    {
+        bool tracked = false;
+        bool exited = false;
+        for (size_t i = 0; i < count; i++)
+        {
+            const IOEvent &event = events[i];
+            pid_t pid = event.GetPid();
+            if (i == 0 || exited || pid != events[i - 1].GetPid())
+            {
+                // the process at hand is still tracked unless it just exited (its pid may be reused)
+                tracked = (!exited && HasTrackedProcess() && GetProcess()->GetPid() == pid) || TryInitializeWithTrackedProcess(pid);
+            }
+
+            exited = event.GetEventType() == ES_EVENT_TYPE_NOTIFY_EXIT;
+            if (tracked)
+            {
+                HandleEvent(event);
+            }
+        }
+    }
+    catch (...)
+    {
+        EndBatch();
+        throw;
+    }
+
+    EndBatch();
+}
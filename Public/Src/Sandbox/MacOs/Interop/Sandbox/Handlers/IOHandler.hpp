@@ -15,6 +15,14 @@ public:
 
     AccessCheckResult HandleEvent(const IOEvent &event);
 
+    /*!
+     * Handles 'count' events in order, e.g., a burst read at once.  The tracked process is looked up once for every run of events
+     * of the same process (a process this handler was initialized with is used as is), and the events of processes that are not
+     * tracked are skipped.  The reports of the events are sent together once all of them are handled.  Meant for notifications:
+     * the results of the access checks are not returned.
+     */
+    void HandleEvents(const IOEvent *events, size_t count);
+
 #pragma mark Process life cycle
 
     AccessCheckResult HandleProcessFork(const IOEvent &event);
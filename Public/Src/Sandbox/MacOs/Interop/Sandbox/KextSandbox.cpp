@@ -2,6 +2,11 @@
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
 
 #include <IOKit/kext/KextManager.h>
+#include <algorithm>
+#include <atomic>
+#include <pthread/qos.h>
+#include <thread>
+#include <vector>
 #include "KextSandbox.hpp"
 
 class AutoRelease
@@ -21,6 +26,155 @@ public:
     }
 };
 
+/*!
+ * A bounded single producer / single consumer queue of access reports, which lets one thread drain a kext report queue
+ * while another one hands the reports to the managed side.  Draining therefore never waits for report processing (or for
+ * the managed runtime, e.g. during a garbage collection) unless the ring is full.
+ *
+ * Neither side takes a lock: slots are handed over through the 'head_' and 'tail_' counters, and a side only sleeps on its
+ * semaphore after announcing it through its 'waiting' flag, so the other side only signals when someone is actually waiting.
+ */
+class AccessReportRing final
+{
+private:
+
+    static const uint64_t kCapacity = 1024;
+    static const uint64_t kMask     = kCapacity - 1;
+
+    std::vector<AccessReport> slots_;
+
+    // Next slot to be consumed (only written by the consumer) and next slot to be produced (only written by the producer)
+    std::atomic<uint64_t> head_;
+    std::atomic<uint64_t> tail_;
+
+    std::atomic<int> pendingError_;
+    std::atomic<bool> closed_;
+
+    std::atomic<bool> consumerWaiting_;
+    std::atomic<bool> producerWaiting_;
+    dispatch_semaphore_t reportsAvailable_;
+    dispatch_semaphore_t spaceAvailable_;
+
+    template <typename Predicate>
+    static void WaitUntil(std::atomic<bool> &waiting, dispatch_semaphore_t semaphore, Predicate ready)
+    {
+        while (!ready())
+        {
+            waiting.store(true);
+            if (ready())
+            {
+                // A signal racing with this check only causes one spurious wakeup later on
+                waiting.store(false);
+                break;
+            }
+
+            dispatch_semaphore_wait(semaphore, DISPATCH_TIME_FOREVER);
+        }
+    }
+
+    static void Notify(std::atomic<bool> &waiting, dispatch_semaphore_t semaphore)
+    {
+        if (waiting.exchange(false))
+        {
+            dispatch_semaphore_signal(semaphore);
+        }
+    }
+
+public:
+
+    AccessReportRing() : slots_(kCapacity), head_(0), tail_(0), pendingError_(0), closed_(false),
+                         consumerWaiting_(false), producerWaiting_(false)
+    {
+        reportsAvailable_ = dispatch_semaphore_create(0);
+        spaceAvailable_ = dispatch_semaphore_create(0);
+    }
+
+    ~AccessReportRing()
+    {
+        dispatch_release(reportsAvailable_);
+        dispatch_release(spaceAvailable_);
+    }
+
+    AccessReportRing(const AccessReportRing&) = delete;
+    AccessReportRing& operator=(const AccessReportRing&) = delete;
+
+    // Producer side: blocks while the ring is full
+    void Push(const AccessReport *reports, int count)
+    {
+        uint64_t pushed = 0;
+        while (pushed < (uint64_t) count)
+        {
+            uint64_t tail = tail_.load(std::memory_order_relaxed);
+            WaitUntil(producerWaiting_, spaceAvailable_, [&] { return tail - head_.load() < kCapacity; });
+
+            uint64_t n = std::min<uint64_t>(kCapacity - (tail - head_.load()), count - pushed);
+            for (uint64_t i = 0; i < n; i++)
+            {
+                slots_[(tail + i) & kMask] = reports[pushed + i];
+            }
+
+            tail_.store(tail + n);
+            pushed += n;
+            Notify(consumerWaiting_, reportsAvailable_);
+        }
+    }
+
+    // Producer side: 'status' is handed to the consumer ahead of any reports it has not taken yet
+    void ReportError(int status)
+    {
+        pendingError_.store(status);
+        Notify(consumerWaiting_, reportsAvailable_);
+    }
+
+    // Producer side: no more reports are going to be pushed
+    void Close()
+    {
+        closed_.store(true);
+        Notify(consumerWaiting_, reportsAvailable_);
+    }
+
+    /*!
+     * Consumer side: blocks until reports (at most 'kAccessReportBatchSize' contiguous ones, which stay valid until 'Pop'
+     * is called), an error (with a 'count' of 0) or the end of the ring are available.  Returns false at the end of the ring.
+     */
+    bool Next(const AccessReport **reports, int *count, int *status)
+    {
+        WaitUntil(consumerWaiting_, reportsAvailable_, [&]
+        {
+            return tail_.load() != head_.load(std::memory_order_relaxed) || pendingError_.load() != 0 || closed_.load();
+        });
+
+        int error = pendingError_.exchange(0);
+        if (error != 0)
+        {
+            *reports = nullptr;
+            *count = 0;
+            *status = error;
+            return true;
+        }
+
+        uint64_t head = head_.load(std::memory_order_relaxed);
+        uint64_t available = tail_.load() - head;
+        if (available == 0)
+        {
+            // Closed and fully drained, 'closed_' is only set after the last report has been pushed
+            return false;
+        }
+
+        *reports = &slots_[head & kMask];
+        *count = (int) std::min<uint64_t>(std::min<uint64_t>(available, kCapacity - (head & kMask)), kAccessReportBatchSize);
+        *status = REPORT_QUEUE_SUCCESS;
+        return true;
+    }
+
+    // Consumer side: releases the slots of the last 'count' reports returned from 'Next'
+    void Pop(int count)
+    {
+        head_.store(head_.load(std::memory_order_relaxed) + count);
+        Notify(producerWaiting_, spaceAvailable_);
+    }
+};
+
 extern "C"
 {
 #pragma mark Private forward declarations
@@ -101,6 +255,8 @@ extern "C"
             return;
         }
 
+        memoryInfo->queueCount = 0;
+
         do
         {
             if (!SendClientAttached(info))
@@ -110,39 +266,55 @@ extern "C"
                 continue;
             }
 
-            mach_port_t port = IODataQueueAllocateNotificationPort();
-            if (port == MACH_PORT_NULL)
+            // The kext creates a number of queues for the client (one per CPU), which are mapped until one can't be
+            for (uint i = 0; i < kMaxReportQueues; i++)
             {
-                log_error("%s", "Failed allocating notification port for shared memory region");
-                memoryInfo->error = KEXT_MACH_PORT_CREATION_ERROR;
-                continue;
-            }
-            memoryInfo->port = port;
+                mach_vm_size_t size = 0;
+                mach_vm_address_t address = 0;
+                kern_return_t result = IOConnectMapMemory(info.connection, FileAccessReporting + i, mach_task_self(), &address, &size, kIOMapAnywhere);
+                if (result != KERN_SUCCESS)
+                {
+                    if (i == 0)
+                    {
+                        log_error("%s", "Failed mapping shared memory region");
+                        memoryInfo->error = KEXT_SHARED_MEMORY_CREATION_ERROR;
+                    }
 
-            kern_return_t result = IOConnectSetNotificationPort(info.connection, FileAccessReporting, port, 0);
-            if (result != KERN_SUCCESS)
-            {
-                log_error("%s", "Failed allocating notification port for shared memory region");
-                memoryInfo->error = KEXT_NOTIFICATION_PORT_ERROR;
-                continue;
+                    break;
+                }
+
+                memoryInfo->addresses[i] = address;
+                memoryInfo->queueCount++;
             }
 
-            mach_vm_size_t size = 0;
-            mach_vm_address_t address = 0;
-            result = IOConnectMapMemory(info.connection, FileAccessReporting, mach_task_self(), &address, &size, kIOMapAnywhere);
-            if (result != KERN_SUCCESS)
+            for (uint i = 0; i < memoryInfo->queueCount && memoryInfo->error == KERN_SUCCESS; i++)
             {
-                log_error("%s", "Failed mapping shared memory region");
-                memoryInfo->error = KEXT_SHARED_MEMORY_CREATION_ERROR;
-                continue;
+                mach_port_t port = IODataQueueAllocateNotificationPort();
+                if (port == MACH_PORT_NULL)
+                {
+                    log_error("%s", "Failed allocating notification port for shared memory region");
+                    memoryInfo->error = KEXT_MACH_PORT_CREATION_ERROR;
+                    break;
+                }
+                memoryInfo->ports[i] = port;
+
+                kern_return_t result = IOConnectSetNotificationPort(info.connection, FileAccessReporting + i, port, 0);
+                if (result != KERN_SUCCESS)
+                {
+                    log_error("%s", "Failed allocating notification port for shared memory region");
+                    memoryInfo->error = KEXT_NOTIFICATION_PORT_ERROR;
+                    break;
+                }
             }
-            memoryInfo->address = address;
         }
         while(false);
 
         if (memoryInfo->error != KERN_SUCCESS)
         {
-            if (MACH_PORT_VALID(memoryInfo->port)) mach_port_destroy(mach_task_self(), memoryInfo->port);
+            for (uint i = 0; i < memoryInfo->queueCount; i++)
+            {
+                if (MACH_PORT_VALID(memoryInfo->ports[i])) mach_port_destroy(mach_task_self(), memoryInfo->ports[i]);
+            }
         }
     }
 
@@ -161,15 +333,18 @@ extern "C"
             return;
         }
 
-        log_debug("%s", "Freeing mapped memory, mach port for shared data queue");
-        if (memoryInfo.address != 0)
+        log_debug("%s", "Freeing mapped memory, mach ports for shared data queues");
+        for (uint i = 0; i < memoryInfo.queueCount && i < kMaxReportQueues; i++)
         {
-            IOConnectUnmapMemory(info.connection, FileAccessReporting, memoryInfo.port, memoryInfo.address);
-        }
+            if (memoryInfo.addresses[i] != 0)
+            {
+                IOConnectUnmapMemory(info.connection, FileAccessReporting + i, mach_task_self(), memoryInfo.addresses[i]);
+            }
 
-        if (MACH_PORT_VALID(memoryInfo.port))
-        {
-            mach_port_destroy(mach_task_self(), memoryInfo.port);
+            if (MACH_PORT_VALID(memoryInfo.ports[i]))
+            {
+                mach_port_destroy(mach_task_self(), memoryInfo.ports[i]);
+            }
         }
     }
 
@@ -331,9 +506,116 @@ extern "C"
 
 #pragma mark IOSharedDataQueue consumer code
 
+    typedef void (^AccessReportBatchHandler)(const AccessReport *reports, int count, int status);
+
+    /**
+     * Drains the report queue at 'address' until it is torn down, decoding its entries straight out of the shared memory
+     * region and handing the reports to 'handler' in batches of up to 'kAccessReportBatchSize'.  A batch is handed over
+     * as soon as it is full or the queue runs dry, so no report is ever held back while waiting for more data.
+     * Errors are passed to 'handler' as an empty batch with a status other than REPORT_QUEUE_SUCCESS.
+     */
+    static void DrainReportQueue(mach_vm_address_t address, mach_port_t port, AccessReportBatchHandler handler)
+    {
+        log_debug("Listening for data on shared queue from process: %d", getpid());
+
+        std::vector<AccessReport> batch(kAccessReportBatchSize);
+        int count = 0;
+
+        IODataQueueMemory *queue = (IODataQueueMemory *)address;
+        do
+        {
+            IODataQueueEntry *entry;
+            while ((entry = IODataQueuePeek(queue)) != NULL)
+            {
+                // An entry holds one or more encoded reports (see EncodeAccessReport)
+                const char *data = (const char *)entry->data;
+                uint32_t entrySize = entry->size;
+                uint64_t dequeueTime = GetMachAbsoluteTime();
+
+                uint32_t offset = 0;
+                while (offset < entrySize)
+                {
+                    uint32_t reportSize = DecodeAccessReport(data + offset, entrySize - offset, batch[count]);
+                    if (reportSize == 0)
+                    {
+                        log_error("AccessReport encoding mismatch :: entry size: %d, offset: %d", entrySize, offset);
+                        handler(NULL, 0, REPORT_QUEUE_DEQUEUE_ERROR);
+                        break;
+                    }
+
+                    offset += reportSize;
+                    batch[count].stats.dequeueTime = dequeueTime;
+                    if (++count == kAccessReportBatchSize)
+                    {
+                        handler(batch.data(), count, REPORT_QUEUE_SUCCESS);
+                        count = 0;
+                    }
+                }
+
+                // Everything has been decoded out of the entry, release its space to the producer without copying it
+                kern_return_t result = IODataQueueDequeue(queue, NULL, NULL);
+                if (result != kIOReturnSuccess)
+                {
+                    log_error("Received bogus access report entry: Error Code: %#X", result);
+                    handler(NULL, 0, REPORT_QUEUE_DEQUEUE_ERROR);
+                    return;
+                }
+            }
+
+            if (count > 0)
+            {
+                handler(batch.data(), count, REPORT_QUEUE_SUCCESS);
+                count = 0;
+            }
+        }
+        while (IODataQueueWaitForAvailableData(queue, port) == kIOReturnSuccess);
+
+        log_debug("Exiting ListenForFileAccessReports for PID (%d)", getpid());
+    }
+
     /**
-     * Call this function once only from a dedicated thread and pass a valid C# delegate callback, the address to
-     * the shared memory region and a valid mach port.
+     * Pipelines DrainReportQueue with the processing of the reports: a dedicated reader thread drains the queue into an
+     * AccessReportRing while the calling thread hands the reports to 'handler', so the kext queue keeps being drained
+     * while 'handler' is busy.  Returns once the queue has been torn down and every report has been handled.
+     */
+    static void PipelineReportQueue(mach_vm_address_t address, mach_port_t port, AccessReportBatchHandler handler)
+    {
+        AccessReportRing ring;
+        AccessReportRing *ringRef = &ring;
+
+        std::thread reader([ringRef, address, port]
+        {
+            pthread_set_qos_class_self_np(QOS_CLASS_USER_INTERACTIVE, 0);
+            DrainReportQueue(address, port, ^(const AccessReport *reports, int count, int status)
+            {
+                if (status != REPORT_QUEUE_SUCCESS)
+                {
+                    ringRef->ReportError(status);
+                }
+                else
+                {
+                    ringRef->Push(reports, count);
+                }
+            });
+
+            ringRef->Close();
+        });
+
+        const AccessReport *reports;
+        int count;
+        int status;
+        while (ring.Next(&reports, &count, &status))
+        {
+            handler(reports, count, status);
+            ring.Pop(count);
+        }
+
+        reader.join();
+    }
+
+    /**
+     * Call this function once per report queue (see KextSharedMemoryInfo), each from a dedicated thread, and pass a valid
+     * C# delegate callback, the address to the shared memory region of the queue and its mach port.
      */
     __cdecl void ListenForFileAccessReports(AccessReportCallback callback, long accessReportSize, mach_vm_address_t address, mach_port_t port)
     {
@@ -354,39 +636,47 @@ extern "C"
             return;
         }
 
-        log_debug("Listening for data on shared queue from process: %d", getpid());
-
-        IODataQueueMemory *queue = (IODataQueueMemory *)address;
-        do
+        PipelineReportQueue(address, port, ^(const AccessReport *reports, int count, int status)
         {
-            while (IODataQueueDataAvailable(queue))
+            if (status != REPORT_QUEUE_SUCCESS)
             {
-                AccessReport report;
-                uint32_t reportSize = sizeof(report);
-
-                kern_return_t result = IODataQueueDequeue(queue, &report, &reportSize);
+                callback(AccessReport{}, status);
+            }
 
-                if (result != kIOReturnSuccess)
-                {
-                    log_error("Received bogus access report: PID(%d) PIP(%#llX) Error Code: %#X", report.rootPid, report.pipId, result);
-                    callback(AccessReport{}, REPORT_QUEUE_DEQUEUE_ERROR);
-                    return;
-                }
+            for (int i = 0; i < count; i++)
+            {
+                callback(reports[i], status);
+            }
+        });
+    }
 
-                if (reportSize != sizeof(report))
-                {
-                    log_error("AccessReport size mismatch :: reported: %d, expected: %ld", reportSize, sizeof(report));
-                    callback(AccessReport{}, REPORT_QUEUE_DEQUEUE_ERROR);
-                    continue;
-                }
+    /**
+     * Same as ListenForFileAccessReports, except that 'callback' receives the reports in batches: the managed transition
+     * is paid once per batch instead of once per report.  The reports are only valid for the duration of the callback.
+     */
+    __cdecl void ListenForFileAccessReportBatches(AccessReportBatchCallback callback, long accessReportSize, mach_vm_address_t address, mach_port_t port)
+    {
+        if (sizeof(AccessReport) != accessReportSize)
+        {
+            log_error("Wrong size of the AccessReport buffer: expected %ld, received %ld",
+                      sizeof(AccessReport), accessReportSize);
+            if (callback != NULL) callback(NULL, 0, KEXT_WRONG_BUFFER_SIZE);
+            return;
+        }
 
-                report.stats.dequeueTime = GetMachAbsoluteTime();
-                callback(report, REPORT_QUEUE_SUCCESS);
+        if (callback == NULL || address == 0 || !MACH_PORT_VALID(port))
+        {
+            if (callback != NULL)
+            {
+                callback(NULL, 0, REPORT_QUEUE_CONNECTION_ERROR);
             }
+            return;
         }
-        while (IODataQueueWaitForAvailableData(queue, port) == kIOReturnSuccess);
 
-        log_debug("Exiting ListenForFileAccessReports for PID (%d)", getpid());
+        PipelineReportQueue(address, port, ^(const AccessReport *reports, int count, int status)
+        {
+            callback(reports, count, status);
+        });
     }
 
     uint64_t GetMachAbsoluteTime()
@@ -14,6 +14,9 @@
 #define KEXT_THREAD_ID_ERROR                       0x80
 #define KEXT_WRONG_BUFFER_SIZE                     0x100
 
+// The number of reports handed to an AccessReportBatchCallback at most
+#define kAccessReportBatchSize                     64
+
 #include "Common.hpp"
 
 typedef struct {
@@ -22,10 +25,12 @@ typedef struct {
     IONotificationPortRef port;
 } KextConnectionInfo;
 
+// The report queues of the client: each one is to be drained by its own thread (see ListenForFileAccessReports)
 typedef struct {
     int error;
-    mach_vm_address_t address;
-    mach_port_t port;
+    uint queueCount;
+    mach_vm_address_t addresses[kMaxReportQueues];
+    mach_port_t ports[kMaxReportQueues];
 } KextSharedMemoryInfo;
 
 extern "C"
@@ -52,6 +57,9 @@ extern "C"
 
     __cdecl void ListenForFileAccessReports(AccessReportCallback callback, long accessReportSize, mach_vm_address_t address, mach_port_t port);
 
+    typedef void (__cdecl *AccessReportBatchCallback)(const AccessReport *reports, int count, int status);
+    __cdecl void ListenForFileAccessReportBatches(AccessReportBatchCallback callback, long accessReportSize, mach_vm_address_t address, mach_port_t port);
+
     uint64_t GetMachAbsoluteTime(void);
     __cdecl void KextVersionString(char *version, int size);
 
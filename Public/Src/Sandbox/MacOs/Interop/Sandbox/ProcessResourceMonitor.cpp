@@ -0,0 +1,144 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#if __APPLE__
+
+#include <libproc.h>
+#include <vector>
+
+#include "ProcessResourceMonitor.hpp"
+
+ProcessResourceMonitor::ProcessResourceMonitor()
+{
+    queue_ = dispatch_queue_create("com.microsoft.buildxl.interop.resource_monitor", dispatch_queue_attr_make_with_qos_class(
+        DISPATCH_QUEUE_SERIAL, QOS_CLASS_UTILITY, 0
+    ));
+
+    uint64_t interval = kSampleIntervalMs * NSEC_PER_MSEC;
+    timer_ = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, queue_);
+    dispatch_source_set_timer(timer_, dispatch_time(DISPATCH_TIME_NOW, interval), interval, interval / 10);
+    dispatch_source_set_event_handler(timer_, ^{ Sample(); });
+    dispatch_resume(timer_);
+}
+
+ProcessResourceMonitor::~ProcessResourceMonitor()
+{
+    dispatch_source_cancel(timer_);
+
+    // Cancellation only prevents further invocations, wait for one that might be in flight before tearing anything down
+    dispatch_sync(queue_, ^{});
+
+    dispatch_release(timer_);
+    dispatch_release(queue_);
+}
+
+void ProcessResourceMonitor::TrackRoot(pid_t rootPid)
+{
+    const std::lock_guard<std::mutex> lock(lock_);
+
+    RemoveLocked(rootPid);
+    roots_[rootPid] = rootPid;
+    trees_[rootPid] = Tree();
+    trees_[rootPid].processCount = 1;
+}
+
+void ProcessResourceMonitor::TrackChild(pid_t childPid, pid_t rootPid)
+{
+    const std::lock_guard<std::mutex> lock(lock_);
+
+    auto tree = trees_.find(rootPid);
+    if (tree == trees_.end())
+    {
+        return;
+    }
+
+    if (roots_.emplace(childPid, rootPid).second)
+    {
+        tree->second.processCount++;
+    }
+}
+
+void ProcessResourceMonitor::Untrack(pid_t pid)
+{
+    const std::lock_guard<std::mutex> lock(lock_);
+    RemoveLocked(pid);
+}
+
+void ProcessResourceMonitor::RemoveLocked(pid_t pid)
+{
+    auto root = roots_.find(pid);
+    if (root == roots_.end())
+    {
+        return;
+    }
+
+    auto tree = trees_.find(root->second);
+    if (tree != trees_.end() && --tree->second.processCount <= 0)
+    {
+        trees_.erase(tree);
+    }
+
+    roots_.erase(root);
+}
+
+bool ProcessResourceMonitor::GetTreeUsage(pid_t rootPid, ProcessTreeUsage *usage)
+{
+    const std::lock_guard<std::mutex> lock(lock_);
+
+    auto tree = trees_.find(rootPid);
+    if (tree == trees_.end() || !tree->second.sampled)
+    {
+        return false;
+    }
+
+    usage->residentSize = tree->second.residentSize;
+    usage->peakResidentSize = tree->second.peakResidentSize;
+    usage->processCount = tree->second.processCount;
+    return true;
+}
+
+void ProcessResourceMonitor::Sample()
+{
+    std::vector<std::pair<pid_t, pid_t>> members;
+    {
+        const std::lock_guard<std::mutex> lock(lock_);
+        if (roots_.empty())
+        {
+            return;
+        }
+
+        members.assign(roots_.begin(), roots_.end());
+    }
+
+    // Query the processes without holding the lock, so tracking never waits for the sampler
+    std::unordered_map<pid_t, uint64_t> residentSizes;
+    for (const auto &member : members)
+    {
+        rusage_info_current rusage;
+        uint64_t &residentSize = residentSizes[member.second];
+        if (proc_pid_rusage(member.first, RUSAGE_INFO_CURRENT, (rusage_info_t *)&rusage) == 0)
+        {
+            residentSize += rusage.ri_resident_size;
+        }
+    }
+
+    const std::lock_guard<std::mutex> lock(lock_);
+    for (const auto &residentSize : residentSizes)
+    {
+        // The tree may have been replaced or forgotten while sampling, which is fine: the next sample corrects it
+        auto tree = trees_.find(residentSize.first);
+        if (tree == trees_.end())
+        {
+            continue;
+        }
+
+        tree->second.sampled = true;
+        tree->second.residentSize = residentSize.second;
+        if (residentSize.second > tree->second.peakResidentSize)
+        {
+            tree->second.peakResidentSize = residentSize.second;
+        }
+    }
+}
+
+#endif /* __APPLE__ */
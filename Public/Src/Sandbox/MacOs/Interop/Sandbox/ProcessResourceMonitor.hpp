@@ -0,0 +1,75 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef ProcessResourceMonitor_hpp
+#define ProcessResourceMonitor_hpp
+
+#if __APPLE__
+
+#include <dispatch/dispatch.h>
+#include <mutex>
+#include <unordered_map>
+
+#include "process.h"
+
+/*!
+ * Keeps the resource usage of every tracked process tree, so that polling the usage of a pip does not have to walk its
+ * process tree.  Membership is maintained incrementally from the fork and exit events the sandbox already handles, and a
+ * single timer on a private serial queue samples every member once per interval and aggregates the samples per root.
+ *
+ * The cost of a query is therefore constant, and the sampling cost only depends on the number of tracked processes, no matter
+ * how many pips are running or how often their usage is polled.
+ */
+class ProcessResourceMonitor final
+{
+
+private:
+
+    static const uint64_t kSampleIntervalMs = 250;
+
+    struct Tree
+    {
+        int processCount = 0;
+        bool sampled = false;
+        uint64_t residentSize = 0;
+        uint64_t peakResidentSize = 0;
+    };
+
+    std::mutex lock_;
+
+    // Root process id of the pip every tracked process belongs to
+    std::unordered_map<pid_t, pid_t> roots_;
+
+    // Aggregates of every process tree, keyed by root process id
+    std::unordered_map<pid_t, Tree> trees_;
+
+    dispatch_queue_t queue_ = nullptr;
+    dispatch_source_t timer_ = nullptr;
+
+    void Sample();
+    void RemoveLocked(pid_t pid);
+
+public:
+
+    ProcessResourceMonitor();
+    ~ProcessResourceMonitor();
+
+    ProcessResourceMonitor(const ProcessResourceMonitor&) = delete;
+    ProcessResourceMonitor& operator=(const ProcessResourceMonitor&) = delete;
+
+    /*! Starts a new process tree rooted at 'rootPid', replacing whatever 'rootPid' was associated with before */
+    void TrackRoot(pid_t rootPid);
+
+    /*! Adds 'childPid' to the process tree rooted at 'rootPid' */
+    void TrackChild(pid_t childPid, pid_t rootPid);
+
+    /*! Removes 'pid' from its process tree, the tree is forgotten once its last process is gone */
+    void Untrack(pid_t pid);
+
+    /*! Returns false if no process tree is rooted at 'rootPid' or it has not been sampled yet */
+    bool GetTreeUsage(pid_t rootPid, ProcessTreeUsage *usage);
+};
+
+#endif /* __APPLE__ */
+
+#endif /* ProcessResourceMonitor_hpp */
@@ -7,6 +7,13 @@
 
 static Sandbox* sandbox;
 
+#if __APPLE__
+static bool GetTrackedProcessTreeUsage(pid_t rootPid, ProcessTreeUsage *usage)
+{
+    return sandbox->GetResourceMonitor().GetTreeUsage(rootPid, usage);
+}
+#endif
+
 extern "C"
 {
 #pragma mark Exported interop methods
@@ -23,10 +30,17 @@ extern "C"
             info->error = SB_INSTANCE_ERROR;
             return;
         }
+
+#if __APPLE__
+        SetProcessTreeUsageProvider(&GetTrackedProcessTreeUsage);
+#endif
     }
 
     void DeinitializeSandbox()
     {
+#if __APPLE__
+        SetProcessTreeUsageProvider(NULL);
+#endif
         delete sandbox;
         log_debug("%s", "Successfully shut-down gerneric sandbox subsystem.");
     }
@@ -50,6 +64,21 @@ extern "C"
 
         log_debug("Listening for observation reports for build host with pid (%d)...", getpid());
     }
+
+    void SetHybridBackendCache(const char *cachePath)
+    {
+#if __APPLE__
+        if (sandbox == nullptr || !sandbox->IsRunningHybrid() || cachePath == nullptr)
+        {
+            return;
+        }
+
+        // Must happen before the first pip starts: the selector is otherwise only used from the Hybrid event queue
+        dispatch_sync(sandbox->GetHybridQueue(), ^{
+            sandbox->GetHybridBackendSelector().Load(cachePath);
+        });
+#endif
+    }
 }
 
 #pragma mark Generic sandbox stubs
@@ -91,7 +120,7 @@ Sandbox::Sandbox(pid_t host_pid, Configuration config)
     hostPid_ = host_pid;
     configuration_ = config;
 
-    if (!SetProcessPidPair(GetAllowlistedPidMap(), host_pid, getppid()))
+    if (!pids_.Set(host_pid, kPidFlagsAllowlisted, getppid()))
     {
         throw BuildXLException("Could not allowlist build host process id!");
     }
@@ -125,16 +154,16 @@ Sandbox::Sandbox(pid_t host_pid, Configuration config)
     {
 #if __APPLE__
         case EndpointSecuritySandboxType: {
-            es_ = new EndpointSecuritySandbox(host_pid, &process_event, (void *)this, xpc_bridge_);
+            es_ = new EndpointSecuritySandbox(host_pid, &process_event, &classify_event, &event_shard_key, (void *)this, xpc_bridge_);
             break;
         }
         case DetoursSandboxType: {
-            detours_ = new DetoursSandbox(host_pid, &process_event, (void *)this, xpc_bridge_);
+            detours_ = new DetoursSandbox(host_pid, &process_event, &classify_event, &event_shard_key, (void *)this, xpc_bridge_);
             break;
         }
         case HybridSandboxType: {
-            es_ = new EndpointSecuritySandbox(host_pid, &process_event, (void *)this, xpc_bridge_);
-            detours_ = new DetoursSandbox(host_pid, &process_event, (void *)this, xpc_bridge_);
+            es_ = new EndpointSecuritySandbox(host_pid, &process_event, &classify_event, &event_shard_key, (void *)this, xpc_bridge_);
+            detours_ = new DetoursSandbox(host_pid, &process_event, &classify_event, &event_shard_key, (void *)this, xpc_bridge_);
             break;
         }
 #elif __linux__
@@ -144,6 +173,14 @@ Sandbox::Sandbox(pid_t host_pid, Configuration config)
         default:
             throw BuildXLException("Could not infer sandbox configuration setting, aborting!");
     }
+
+#if __APPLE__
+    // No pip is active yet
+    if (es_ != nullptr)
+    {
+        UpdateForActivePips(false);
+    }
+#endif
 }
 
 Sandbox::~Sandbox()
@@ -166,6 +203,14 @@ Sandbox::~Sandbox()
         delete detours_;
     }
 
+    // Both sources are gone, so are the events of this build: the statistics are final
+    if (hybird_event_queue_ && hybridBackendSelector_.IsEnabled())
+    {
+        dispatch_sync(hybird_event_queue_, ^{
+            hybridBackendSelector_.Save();
+        });
+    }
+
     xpc_connection_cancel(xpc_bridge_);
     xpc_release(xpc_bridge_);
     xpc_bridge_ = nullptr;
@@ -179,7 +224,7 @@ Sandbox::~Sandbox()
 
 std::shared_ptr<SandboxedProcess> Sandbox::FindTrackedProcess(pid_t pid)
 {
-    return trackedProcesses_->get(pid);
+    return pids_.Has(pid, kPidFlagsTracked) ? trackedProcesses_->get(pid) : nullptr;
 }
 
 bool Sandbox::TrackRootProcess(std::shared_ptr<SandboxedPip> pip)
@@ -217,6 +262,14 @@ bool Sandbox::TrackRootProcess(std::shared_ptr<SandboxedPip> pip)
         else
         {
             bool insertedNew = result == TrieResult::kTrieResultInserted;
+            if (insertedNew)
+            {
+                pids_.Set(pid, kPidFlagsTracked);
+#if __APPLE__
+                resourceMonitor_.TrackRoot(pid);
+                RegisterUntrackedScopes(pip);
+#endif
+            }
             log_debug("Tracking root process PID(%d), PipId: %#llX, tree size: %d, path: %{public}s, code: %d",
                       pid, pip->GetPipId(), pip->GetTreeSize(), process->GetPath(), result);
 
@@ -277,6 +330,10 @@ bool Sandbox::TrackChildProcess(pid_t childPid, const char *childExecutable, std
         // copy the path from the parent process (because the child process always starts out as a fork of the parent)
         childProcess->SetPath(childExecutable);
         pip->IncrementProcessTreeCount();
+        pids_.Set(childPid, kPidFlagsTracked);
+#if __APPLE__
+        resourceMonitor_.TrackChild(childPid, pip->GetProcessId());
+#endif
 
         log_debug("Track entry %d -> %d, PipId: %#llX, New tree size: %d", childPid, pip->GetProcessId(), pip->GetPipId(), pip->GetTreeSize());
 
@@ -294,7 +351,8 @@ error:
 
 bool Sandbox::UntrackProcess(pid_t pid, std::shared_ptr<SandboxedProcess> process)
 {
-    // remove the mapping for 'pid'
+    // remove the mapping for 'pid' (lookups stop finding it as soon as the tracked flag is cleared)
+    pids_.Clear(pid, kPidFlagsTracked);
     auto removeResult = trackedProcesses_->remove(pid);
     bool removedExisting = removeResult == TrieResult::kTrieResultRemoved;
     if (removedExisting)
@@ -304,12 +362,119 @@ bool Sandbox::UntrackProcess(pid_t pid, std::shared_ptr<SandboxedProcess> proces
 
     std::shared_ptr<SandboxedPip> pip = process->GetPip();
 
+#if __APPLE__
+    if (removedExisting)
+    {
+        resourceMonitor_.Untrack(pid);
+    }
+
+    if (removedExisting && pip->GetTreeSize() == 0)
+    {
+        UnregisterUntrackedScopes(pip->GetPipId());
+    }
+#endif
+
     log_debug("Untrack entry %d (%{public}s) -> %d, PipId: %#llX, New tree size: %d, Code: %d",
               pid, process->GetPath(), pip->GetProcessId(), pip->GetPipId(), pip->GetTreeSize(), removeResult);
 
     return removedExisting;
 }
 
+#if __APPLE__
+
+#pragma mark EndpointSecurity muting
+
+void Sandbox::RegisterUntrackedScopes(std::shared_ptr<SandboxedPip> pip)
+{
+    if (es_ == nullptr)
+    {
+        return;
+    }
+
+    std::vector<std::string> scopes;
+    pip->GetUntrackedScopes(scopes);
+
+    const std::lock_guard<std::mutex> lock(mute_mutex_);
+    if (untrackedScopes_.empty())
+    {
+        UpdateForActivePips(true);
+    }
+
+    untrackedScopes_[pip->GetPipId()] = std::move(scopes);
+    UpdateMutedPaths();
+}
+
+void Sandbox::UnregisterUntrackedScopes(pipid_t pipId)
+{
+    if (es_ == nullptr)
+    {
+        return;
+    }
+
+    const std::lock_guard<std::mutex> lock(mute_mutex_);
+    if (untrackedScopes_.erase(pipId) > 0)
+    {
+        UpdateMutedPaths();
+        if (untrackedScopes_.empty())
+        {
+            UpdateForActivePips(false);
+        }
+    }
+}
+
+// Called when the first pip becomes active and when the last one is gone. Both updates are sent synchronously (like for muting), so
+// a pip that starts while no other one is active never runs before they are applied:
+//   - the clients observing file accesses are only subscribed while a pip is active, since only tracked processes are reported;
+//   - EndpointSecurity caches AUTH results by executable and file, regardless of the process, so a result cached for an untracked
+//     process would also answer the same access made by a tracked one. Results are therefore only cached while no pip is active,
+//     and the cache is cleared when the first pip becomes active.
+void Sandbox::UpdateForActivePips(bool anyActive)
+{
+    if (anyActive)
+    {
+        es_->SetIOEventSubscriptions(true);
+        es_->SetAuthResultCaching(false);
+    }
+    else
+    {
+        es_->SetAuthResultCaching(true);
+        es_->SetIOEventSubscriptions(false);
+    }
+
+    log_debug("Updated EndpointSecurity clients, active pips: %d", anyActive);
+}
+
+// Must be called while holding 'mute_mutex_'. A path can only be muted when it is untracked by every active pip, because
+// muting applies to the EndpointSecurity clients globally. The update is sent synchronously so that a newly started pip
+// never runs while a path it tracks is still muted.
+void Sandbox::UpdateMutedPaths()
+{
+    std::set<std::string> paths;
+
+    auto it = untrackedScopes_.begin();
+    if (it != untrackedScopes_.end())
+    {
+        paths.insert(it->second.begin(), it->second.end());
+        for (++it; it != untrackedScopes_.end() && !paths.empty(); ++it)
+        {
+            paths = SandboxedPip::IntersectUntrackedScopes(paths, it->second);
+        }
+    }
+
+    if (paths == mutedPaths_)
+    {
+        return;
+    }
+
+    if (es_->SetMutedPathPrefixes(paths))
+    {
+        log_debug("Muted %zu untracked path prefix(es) for %zu active pip(s)", paths.size(), untrackedScopes_.size());
+        mutedPaths_ = std::move(paths);
+    }
+}
+
+#endif
+
 void const Sandbox::SendAccessReport(AccessReport &report, std::shared_ptr<SandboxedPip> pip)
 {
     assert(strlen(report.path) > 0);
@@ -318,3 +483,19 @@ void const Sandbox::SendAccessReport(AccessReport &report, std::shared_ptr<Sandb
     log_debug("Enqueued PID(%d), Root PID(%d), PIP(%#llX), Operation: %{public}s, Path: %{public}s, Status: %d",
               report.pid, report.rootPid, report.pipId, OpNames[report.operation], report.path, report.status);
 }
+
+void const Sandbox::SendAccessReports(const AccessReport *reports, size_t count)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        assert(strlen(reports[i].path) > 0);
+        accessReportCallback_(reports[i], REPORT_QUEUE_SUCCESS);
+    }
+
+    log_debug("Enqueued a batch of %zu reports", count);
+}
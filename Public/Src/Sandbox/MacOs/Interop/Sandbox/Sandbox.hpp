@@ -4,17 +4,24 @@
 #ifndef Sandbox_h
 #define Sandbox_h
 
+#include "BackendSelector.hpp"
 #include "BuildXLException.hpp"
 #include "Common.hpp"
 #include "DetoursSandbox.hpp"
 #include "EndpointSecuritySandbox.hpp"
+#include "EventDeduplicator.hpp"
 #include "IOEvent.hpp"
+#include "PidTable.hpp"
+#include "ProcessResourceMonitor.hpp"
 #include "SandboxedPip.hpp"
 #include "SandboxedProcess.hpp"
 #include "Trie.hpp"
 
 #include <signal.h>
 #include <map>
+#include <set>
+#include <string>
+#include <vector>
 
 #define SB_WRONG_BUFFER_SIZE    0x8
 #define SB_INSTANCE_ERROR       0x16
@@ -37,6 +44,9 @@ extern "C"
     void InitializeSandbox(SandboxConnectionInfo *info, pid_t host_pid);
     void DeinitializeSandbox();
 
+    // Hybrid sandbox only: enables the per executable backend selection (see BackendSelector.hpp), persisted in 'cachePath'
+    void SetHybridBackendCache(const char *cachePath);
+
     void __cdecl ObserverFileAccessReports(SandboxConnectionInfo *info, AccessReportCallback callback, long accessReportSize);
 };
 
@@ -52,13 +62,33 @@ private:
     
 #if __APPLE__
     dispatch_queue_t hybird_event_queue_;
+
+    // Accesses reported by both the EndpointSecurity clients and the interposing library, only used from 'hybird_event_queue_'
+    EventDeduplicator hybridEventDeduplicator_;
+
+    // Per executable overhead statistics of both sources, only used from 'hybird_event_queue_'
+    BackendSelector hybridBackendSelector_;
     xpc_connection_t xpc_bridge_ = nullptr;
-    std::mutex access_mutex;
+
+    // Untracked scopes of every active pip and the path prefixes currently muted in the EndpointSecurity clients (their intersection);
+    // file accesses are only observed while a pip is active and AUTH results only cached by EndpointSecurity while none is
+    std::mutex mute_mutex_;
+    std::map<pipid_t, std::vector<std::string>> untrackedScopes_;
+    std::set<std::string> mutedPaths_;
+
+    // Resource usage of every tracked process tree, kept in sync with 'trackedProcesses_'
+    ProcessResourceMonitor resourceMonitor_;
+
+    void RegisterUntrackedScopes(std::shared_ptr<SandboxedPip> pip);
+    void UnregisterUntrackedScopes(pipid_t pipId);
+    void UpdateMutedPaths();
+    void UpdateForActivePips(bool anyActive);
 #endif
     
-    std::map<pid_t, pid_t> allowlistedPids_;
-    std::map<pid_t, pid_t> forceForkedPids_;
-    
+    // Tracked, allowlisted and force forked state of every process id, classifying a pid takes a single lock-free lookup
+    PidTable pids_;
+
+    // Owns the SandboxedProcess objects, only consulted for pids 'pids_' has marked as tracked
     Trie<SandboxedProcess> *trackedProcesses_ = nullptr;
     AccessReportCallback accessReportCallback_ = nullptr;
     
@@ -76,33 +106,12 @@ public:
 #if __APPLE__
     inline const bool IsRunningHybrid() const { return configuration_ == Configuration::HybridSandboxType; }
     inline const dispatch_queue_t GetHybridQueue() const { return hybird_event_queue_; }
+    inline EventDeduplicator& GetHybridEventDeduplicator() { return hybridEventDeduplicator_; }
+    inline BackendSelector& GetHybridBackendSelector() { return hybridBackendSelector_; }
+    inline ProcessResourceMonitor& GetResourceMonitor() { return resourceMonitor_; }
 #endif
     
-    inline std::map<pid_t, pid_t>& GetAllowlistedPidMap() { return allowlistedPids_; }
-    inline std::map<pid_t, pid_t>& GetForceForkedPidMap() { return forceForkedPids_; }
-    
-    inline const bool SetProcessPidPair(std::map<pid_t, pid_t>& map, pid_t pid, pid_t ppid)
-    {
-#if __APPLE__
-        const std::lock_guard<std::mutex> lock(access_mutex);
-#endif
-        return map.emplace(pid, ppid).second;
-    }
-    
-    inline const bool RemoveProcessPid(std::map<pid_t, pid_t>& map, pid_t pid)
-    {
-#if __APPLE__
-        const std::lock_guard<std::mutex> lock(access_mutex);
-#endif
-        
-        auto result = map.find(pid);
-        if (result != map.end())
-        {
-            return (map.erase(pid) == 1);
-        }
-        
-        return false;
-    }
+    inline PidTable& GetPidTable() { return pids_; }
     
     inline const void SetAccessReportCallback(AccessReportCallback callback) { accessReportCallback_ = callback; }
     
@@ -112,6 +121,9 @@ public:
     bool UntrackProcess(pid_t pid, std::shared_ptr<SandboxedProcess> process);
     
     void const SendAccessReport(AccessReport &report, std::shared_ptr<SandboxedPip> pip);
+
+    // Sends the reports of a batch of events (see IOHandler::HandleEvents), in order
+    void const SendAccessReports(const AccessReport *reports, size_t count);
 };
 
 #endif /* Sandbox_h */
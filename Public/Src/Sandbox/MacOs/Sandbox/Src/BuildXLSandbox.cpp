@@ -2,6 +2,7 @@
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
 
 #include <kern/clock.h>
+#include <sys/sysctl.h>
 
 #include "Alloc.hpp"
 #include "BuildXLSandbox.hpp"
@@ -31,6 +32,18 @@ static KextConfig sDefaultConfig =
     }
 };
 
+static UInt32 GetCpuCount()
+{
+    int numCpus = 1;
+    size_t size = sizeof(numCpus);
+    if (sysctlbyname("hw.ncpu", &numCpus, &size, nullptr, 0) != 0 || numCpus < 1)
+    {
+        numCpus = 1;
+    }
+
+    return (UInt32)numCpus;
+}
+
 bool BuildXLSandbox::init(OSDictionary *dictionary)
 {
     if (!super::init(dictionary))
@@ -51,13 +64,29 @@ bool BuildXLSandbox::init(OSDictionary *dictionary)
         return false;
     }
 
+    Alloc::InitializeZones();
+
+    latenciesCount_ = GetCpuCount();
+    latencies_ = Alloc::New<LatencyHistograms>(latenciesCount_);
+    if (!latencies_)
+    {
+        latenciesCount_ = 0;
+        return false;
+    }
+
     ResetCounters();
-    resourceManager_ = ResourceManager::create(&counters_.resourceCounters);
+    resourceManager_ = ResourceManager::create(&counters_.resourceCounters, &counters_.reportCounters);
     if (!resourceManager_)
     {
         return false;
     }
 
+    vnodePathCache_ = VNodePathCache::create();
+    if (!vnodePathCache_)
+    {
+        return false;
+    }
+
     Configure(&sDefaultConfig);
     if (!InitializeTries())
     {
@@ -77,12 +106,23 @@ void BuildXLSandbox::free(void)
         lock_ = nullptr;
     }
 
+    if (latencies_)
+    {
+        Alloc::Delete<LatencyHistograms>(latencies_, latenciesCount_);
+        latencies_ = nullptr;
+        latenciesCount_ = 0;
+    }
+
     OSSafeReleaseNULL(resourceManager_);
+    OSSafeReleaseNULL(vnodePathCache_);
     OSSafeReleaseNULL(trackedProcesses_);
     OSSafeReleaseNULL(connectedClients_);
 
     bxl_sysctl_unregister();
 
+    // Everything that allocated from the zones is gone by now.
+    Alloc::DrainZones();
+
     super::free();
 }
 
@@ -155,13 +195,13 @@ void BuildXLSandbox::InitializePolicyStructures()
 
 bool BuildXLSandbox::InitializeTries()
 {
-    connectedClients_ = Trie::createUintTrie();
+    connectedClients_ = ProcessTable::create();
     if (!connectedClients_)
     {
         return false;
     }
 
-    trackedProcesses_ = Trie::createUintTrie();
+    trackedProcesses_ = ProcessTable::create();
     if (!trackedProcesses_)
     {
         return false;
@@ -285,7 +325,7 @@ void BuildXLSandbox::OnLastClientDisconnected()
     ResetCounters();
     UninitializeListeners();
 
-    // re-initialize tries to force deallocation of trie nodes
+    // re-initialize the tables to force deallocation of their chunks
     OSSafeReleaseNULL(trackedProcesses_);
     OSSafeReleaseNULL(connectedClients_);
     InitializeTries();
@@ -309,14 +349,19 @@ void BuildXLSandbox::Configure(const KextConfig *config)
     }
 }
 
+UInt32 BuildXLSandbox::GetReportQueueCount()
+{
+    return min(GetCpuCount(), (UInt32)kMaxReportQueues);
+}
+
 UInt32 BuildXLSandbox::GetReportQueueEntryCount()
 {
-    return (config_.reportQueueSizeMB * 1024 * 1024) / sizeof(AccessReport);
+    return (config_.reportQueueSizeMB * 1024 * 1024) / sizeof(AccessReport) / GetReportQueueCount();
 }
 
 ClientInfo* BuildXLSandbox::GetClientInfo(pid_t clientPid)
 {
-    return connectedClients_->getAs<ClientInfo>(clientPid);
+    return connectedClients_->getRetainedAs<ClientInfo>(clientPid);
 }
 
 IOReturn BuildXLSandbox::AllocateNewClient(pid_t clientPid)
@@ -329,7 +374,7 @@ IOReturn BuildXLSandbox::AllocateNewClient(pid_t clientPid)
         .entrySize      = sizeof(AccessReport),
         .enableBatching = config_.enableReportBatching,
         .counters       = &counters_.reportCounters
-    });
+    }, GetReportQueueCount());
     AutoRelease _(client);
 
     if (client == nullptr)
@@ -390,25 +435,27 @@ IOReturn BuildXLSandbox::DeallocateClient(pid_t clientPid)
     return kIOReturnError;
 }
 
-IOReturn BuildXLSandbox::SetReportQueueNotificationPort(mach_port_t port, pid_t clientPid)
+IOReturn BuildXLSandbox::SetReportQueueNotificationPort(mach_port_t port, pid_t clientPid, uint queueIndex)
 {
     EnterMonitor
 
     ClientInfo *client = GetClientInfo(clientPid);
+    AutoRelease _(client);
     bool success =
         client != nullptr &&
-        client->setNotifactonPort(port);
+        client->setNotifactonPort(port, queueIndex);
 
     return success ? kIOReturnSuccess : kIOReturnError;
 }
 
-IOMemoryDescriptor* const BuildXLSandbox::GetReportQueueMemoryDescriptor(pid_t clientPid)
+IOMemoryDescriptor* const BuildXLSandbox::GetReportQueueMemoryDescriptor(pid_t clientPid, uint queueIndex)
 {
     EnterMonitor
 
     ClientInfo *client = GetClientInfo(clientPid);
+    AutoRelease _(client);
     return client != nullptr
-        ? client->getMemoryDescriptor()
+        ? client->getMemoryDescriptor(queueIndex)
         : nullptr;
 }
 
@@ -418,10 +465,12 @@ bool const BuildXLSandbox::SendAccessReport(AccessReport &report, SandboxedPip *
 
     pid_t clientPid = pip->getClientPid();
     ClientInfo *client = GetClientInfo(clientPid);
+    AutoRelease _(client);
 
     Timespan getClientInfoDuration  = stopwatch.lap();
     Counters()->getClientInfo      += getClientInfoDuration;
     pip->Counters()->getClientInfo += getClientInfoDuration;
+    RecordLatency(kLatencyGetClientInfo, getClientInfoDuration);
 
     if (client == nullptr)
     {
@@ -431,11 +480,16 @@ bool const BuildXLSandbox::SendAccessReport(AccessReport &report, SandboxedPip *
 
     AddTimeStampToAccessReport(&report, enqueueTime);
 
-    bool success = client->enqueueReport({.report = report, .cacheRecord = cacheRecord});
+    bool success = client->enqueueReport({.report = report, .cacheRecord = cacheRecord, .pip = pip});
+    if (success)
+    {
+        pip->Counters()->reportCounters.totalNumSent++;
+    }
 
     Timespan reportFileAccessDuration  = stopwatch.lap();
     Counters()->reportFileAccess      += reportFileAccessDuration;
     pip->Counters()->reportFileAccess += reportFileAccessDuration;
+    RecordLatency(kLatencyReportFileAccess, reportFileAccessDuration);
 
     log_error_or_debug(
         g_bxl_verbose_logging, !success,
@@ -449,7 +503,7 @@ SandboxedProcess* BuildXLSandbox::FindTrackedProcess(pid_t pid)
 {
     // NOTE: this has to be very fast when we are not tracking any processes (i.e., trackedProcesses_ is empty)
     //       because this is called on every single file access any process makes
-    return trackedProcesses_->getAs<SandboxedProcess>(pid);
+    return trackedProcesses_->getRetainedAs<SandboxedProcess>(pid);
 }
 
 bool BuildXLSandbox::TrackRootProcess(SandboxedPip *pip)
@@ -502,7 +556,7 @@ bool BuildXLSandbox::TrackRootProcess(SandboxedPip *pip)
 
 static OSObject* ProcessFactory(void *data)
 {
-    // It is IMPORTANT to retain 'process' here.  This function is used as a factory for Trie::getOrAdd which
+    // It is IMPORTANT to retain 'process' here.  This function is used as a factory for ProcessTable::getOrAdd which
     // expects it to increase the ref count of the object it returns (as a constructor would).
     // The 'getOrAdd' method immediatelly releases this object if it ends up creating it but not using it;
     // if it does end up using it, it releases it upon its removal from the trie.
@@ -620,11 +674,13 @@ IntrospectResponse BuildXLSandbox::Introspect() const
     {
         .numAttachedClients  = connectedClients_->getCount(),
         .counters            = counters_,
+        .latencies           = {0},
         .memory              =
         {
             .totalAllocatedBytes = Alloc::numCurrentlyAllocatedBytes(),
             .fastNodes           = COUNT_AND_SIZE(NodeFast),
             .lightNodes          = COUNT_AND_SIZE(NodeLight),
+            .compactNodes        = COUNT_AND_SIZE(NodeCompact),
             .cacheRecords        = COUNT_AND_SIZE(CacheRecord)
         },
         .kextConfig          = config_,
@@ -632,6 +688,16 @@ IntrospectResponse BuildXLSandbox::Introspect() const
         .pips                = {0}
     };
 
+    for (int i = 0; i < latenciesCount_; i++)
+    {
+        for (int kind = 0; kind < kLatencyKindCount; kind++)
+        {
+            result.latencies.histograms[kind] += latencies_[i].histograms[kind];
+        }
+    }
+
+    Alloc::GetZoneUsage(result.memory.zones);
+
     ReportCounters *reportCounters = &result.counters.reportCounters;
     reportCounters->freeListSizeMB =
         (sizeof(ConcurrentSharedDataQueue::ElemPayload)) * reportCounters->freeListNodeCount.count() * 1.0 / BytesInAMegabyte;
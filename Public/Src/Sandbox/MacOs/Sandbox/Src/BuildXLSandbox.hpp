@@ -6,14 +6,17 @@
 
 #include <IOKit/IOService.h>
 #include <sys/kauth.h>
+#include <kern/cpu_number.h>
 
 #include "AutoRelease.hpp"
 #include "Listeners.hpp"
 #include "BuildXLSandboxShared.hpp"
 #include "ConcurrentDictionary.hpp"
 #include "ClientInfo.hpp"
+#include "ProcessTable.hpp"
 #include "ResourceManager.hpp"
 #include "SandboxedProcess.hpp"
+#include "VNodePathCache.hpp"
 
 #if RELEASE
     #define kSharedDataQueueSizeDefault 256
@@ -41,11 +44,18 @@ private:
 
     AllCounters counters_;
 
+    /*!
+     * Latency histograms, one set per CPU so that recording a latency doesn't contend with other CPUs
+     * (see 'RecordLatency'); they are summed up on introspection.
+     */
+    LatencyHistograms *latencies_;
+    uint latenciesCount_;
+
     /*!
      * A dictionary (PID -> ClientInfo*) keeping track of connected clients.
      * The key in the dictionary is the process id of the connected client.
      */
-    Trie *connectedClients_;
+    ProcessTable *connectedClients_;
 
     /*!
      * Configuration.
@@ -61,6 +71,9 @@ private:
      */
     ResourceManager *resourceManager_;
 
+    /*! Remembers the paths of recently resolved vnodes (see 'GetVnodePath') */
+    VNodePathCache *vnodePathCache_;
+
     /*! Recursive lock used for synchronization */
     BXLRecursiveLock *lock_;
 
@@ -79,9 +92,12 @@ private:
      *     is being tracked, hence, a VERY EFFICIENT implementation of utmost importance;
      *
      *   - when a tracked process exits the process is removed from this dictionary.
+     *
+     * Indexed by pid (see 'ProcessTable'), so that a lookup is two loads rather than a walk over the digits of the pid.
      */
-    Trie *trackedProcesses_;
+    ProcessTable *trackedProcesses_;
 
+    /*! Returns the (retained) ClientInfo of client 'clientPid' or NULL; the caller is responsible for releasing it. */
     ClientInfo* GetClientInfo(pid_t clientPid);
 
     void InitializePolicyStructures();
@@ -102,6 +118,10 @@ public:
     void Configure(const KextConfig *config);
     inline const KextConfig GetConfig() { return config_; }
 
+    /*! The number of report queues of each client: one per CPU, up to kMaxReportQueues */
+    UInt32 GetReportQueueCount();
+
+    /*! The number of entries of each report queue, so that the queues of a client take 'reportQueueSizeMB' */
     UInt32 GetReportQueueEntryCount();
 
     IOReturn AllocateNewClient(pid_t clientPid);
@@ -111,27 +131,54 @@ public:
     void UninitializeListeners();
 
     AllCounters* Counters()           { return &counters_; }
+
+    /*! Adds 'duration' to the latency histogram of the given kind (of the current CPU). */
+    inline void RecordLatency(LatencyKind kind, Timespan duration)
+    {
+        latencies_[(uint)cpu_number() % latenciesCount_].histograms[kind] += duration;
+    }
     ResourceManager* ResourceManger() { return resourceManager_; }
 
+    /*!
+     * Drop-in replacement for 'vn_getpath' which serves paths of recently resolved vnodes
+     * from 'vnodePathCache_' (unless disabled via the 'bxl_enable_vnode_path_cache' sysctl).
+     */
+    inline int GetVnodePath(vnode_t vp, char *buffer, int *length)
+    {
+        return g_bxl_enable_vnode_path_cache
+            ? vnodePathCache_->getPath(vp, buffer, length)
+            : vn_getpath(vp, buffer, length);
+    }
+
+    /*! Must be called whenever a file or a directory is renamed, because that changes the paths of existing vnodes. */
+    inline void InvalidateVnodePaths()
+    {
+        vnodePathCache_->invalidateAll();
+    }
+
     inline void ResetCounters()
     {
         counters_ = {0};
+        for (int i = 0; i < latenciesCount_; i++)
+        {
+            latencies_[i] = {0};
+        }
     }
 
     /*!
-     * Sets the notification port for the shared data queue for the client process 'pid'.
+     * Sets the notification port for the shared data queue with the given index for the client process 'pid'.
      */
-    IOReturn SetReportQueueNotificationPort(mach_port_t port, pid_t pid);
+    IOReturn SetReportQueueNotificationPort(mach_port_t port, pid_t pid, uint queueIndex);
 
     /*!
-     * Returns a newly allocated memory descriptor of the shared data queue for the client process 'pid'.
+     * Returns a newly allocated memory descriptor of the shared data queue with the given index for the client process 'pid'.
      *
      * NOTE: the caller is responsible for releasing the returned object.
      */
-    IOMemoryDescriptor* const GetReportQueueMemoryDescriptor(pid_t pid);
+    IOMemoryDescriptor* const GetReportQueueMemoryDescriptor(pid_t pid, uint queueIndex);
 
     /*!
-     * Send the access report to only one queue using the round robin strategy
+     * Send the access report to the queue of its pip (see ReportQueueIndex)
      */
     bool const SendAccessReport(AccessReport &report, SandboxedPip *pip, const CacheRecord *cacheRecord);
 
@@ -179,9 +226,18 @@ public:
 
     /*!
      * Returns a SandboxedProcess pointer corresponding to 'pid' if such process is being tracked.
+     * The returned object is retained (no lock is taken, so the process may be untracked concurrently);
+     * the caller is responsible for releasing it.
      */
     SandboxedProcess* FindTrackedProcess(pid_t pid);
 
+    /*!
+     * Whether process 'pid' may be tracked: false means FindTrackedProcess(pid) would return NULL.  This only reads the slot
+     * of 'pid' in the table of tracked processes (see ProcessTable::mayContain), which lets the listeners, called for every
+     * process of the machine, dismiss untracked processes without a lookup.
+     */
+    bool MayBeTrackedProcess(pid_t pid) const { return trackedProcesses_->mayContain(pid); }
+
     /*!
      * Introspect the current state of the sandbox.
      */
@@ -86,54 +86,47 @@ IOReturn BuildXLSandboxClient::registerNotificationPort(mach_port_t port, UInt32
     }
 
     // Extend this to add additional shared data queues later, e.g. logging
-    switch(type)
+    if (type >= FileAccessReporting && type < FileAccessReporting + kMaxReportQueues)
     {
-        case FileAccessReporting:
+        pid_t pid = proc_selfpid();
+        IOReturn result = sandbox_->SetReportQueueNotificationPort(port, pid, type - FileAccessReporting);
+        if (result != kIOReturnSuccess)
         {
-            pid_t pid = proc_selfpid();
-            IOReturn result = sandbox_->SetReportQueueNotificationPort(port, pid);
-            if (result != kIOReturnSuccess)
-            {
-                log_error("%s", "Failed setting the notifacation port!");
-                return result;
-            }
-
-            LogVerbose("Registered port for pid (%d)", pid);
-            break;
+            log_error("%s", "Failed setting the notifacation port!");
+            return result;
         }
-        default:
-            return kIOReturnBadArgument;
+
+        LogVerbose("Registered port %d for pid (%d)", type - FileAccessReporting, pid);
+        return kIOReturnSuccess;
     }
 
-    return kIOReturnSuccess;
+    return kIOReturnBadArgument;
 }
 
 // Called in response to IOConnectMapMemory from user space
 IOReturn BuildXLSandboxClient::clientMemoryForType(UInt32 type, IOOptionBits *options, IOMemoryDescriptor **memory)
 {
-    switch (type)
+    // The client maps the queues one after the other, until it gets an error (it has as many queues as GetReportQueueCount)
+    if (type >= FileAccessReporting && type < FileAccessReporting + kMaxReportQueues)
     {
-        case FileAccessReporting:
+        pid_t pid = proc_selfpid();
+        *options = 0;
+        // NOTE: GetReportQueueMemoryDescriptor allocates a new object that must be released;
+        //       here we are assigning that value to '*memory' which is as an "out argument",
+        //       so the caller is responsible for releasing it.  Concretely, the caller is
+        //       the super class IOUserClient, which indeed releases this object appropriately.
+        *memory = sandbox_->GetReportQueueMemoryDescriptor(pid, type - FileAccessReporting);
+        if (*memory == nullptr)
         {
-            pid_t pid = proc_selfpid();
-            *options = 0;
-            // NOTE: GetReportQueueMemoryDescriptor allocates a new object that must be released;
-            //       here we are assigning that value to '*memory' which is as an "out argument",
-            //       so the caller is responsible for releasing it.  Concretely, the caller is
-            //       the super class IOUserClient, which indeed releases this object appropriately.
-            *memory = sandbox_->GetReportQueueMemoryDescriptor(pid);
-            if (*memory == nullptr)
-            {
-                log_error("%s", "Descriptor creation failed!");
-                return kIOReturnVMError;
-            }
-
-            LogVerbose("Descriptor set for pid (%d)", pid);
-            return kIOReturnSuccess;
-        }
-        default:
+            LogVerbose("No descriptor %d for pid (%d)", type - FileAccessReporting, pid);
             return kIOReturnBadArgument;
+        }
+
+        LogVerbose("Descriptor %d set for pid (%d)", type - FileAccessReporting, pid);
+        return kIOReturnSuccess;
     }
+
+    return kIOReturnBadArgument;
 }
 
 #pragma mark IPC implementation
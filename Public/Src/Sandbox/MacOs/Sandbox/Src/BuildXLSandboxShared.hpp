@@ -15,10 +15,13 @@
 #include <IOKit/IOKitLib.h>
 #include <IOKit/IODataQueueClient.h>
 #include <mach/mach_time.h>
+#include <string.h>
 #endif
 
 #include "stdafx.h"
 #include "DataTypes.h"
+#include "AccessReportRecord.h"
+#include "SandboxStats.h"
 #include "Kauth/OpNames.hpp"
 
 #pragma mark Custom data types
@@ -104,6 +107,27 @@ public:
        if (g_bxl_enable_counters) OSDecrementAtomic(&count_);
 #else
         --count_;
+#endif
+    }
+
+    void operator+= (uint32_t value)
+    {
+#if MAC_OS_SANDBOX
+       if (g_bxl_enable_counters) OSAddAtomic(value, &count_);
+#else
+        count_ += value;
+#endif
+    }
+
+    // Raises the count to 'value' (for high-water marks), unless it is higher already
+    void updateMax(uint32_t value)
+    {
+#if MAC_OS_SANDBOX
+       if (!g_bxl_enable_counters) return;
+       uint32_t current;
+       while ((current = count_) < value && !OSCompareAndSwap(current, value, &count_)) { }
+#else
+        if (count_ < value) count_ = value;
 #endif
     }
 } Counter;
@@ -137,6 +161,96 @@ private:
     }
 } DurationCounter;
 
+#define kLatencyHistogramBucketCount 32
+
+/*!
+ * Histogram of durations with power-of-two buckets: bucket i counts the durations (in nanoseconds) between 2^i and 2^(i+1),
+ * except that the first bucket also counts durations shorter than that, and the last one also counts durations longer than that.
+ */
+typedef struct LatencyHistogram {
+    uint32_t buckets[kLatencyHistogramBucketCount];
+
+    static uint BucketIndex(uint64_t nanos)
+    {
+        uint index = nanos < 2 ? 0 : 63 - __builtin_clzll(nanos);
+        return index < kLatencyHistogramBucketCount ? index : kLatencyHistogramBucketCount - 1;
+    }
+
+    /*! Upper bound (in nanoseconds) of the durations counted by the i-th bucket */
+    static uint64_t BucketUpperBoundNanos(uint index) { return 1ull << (index + 1); }
+
+    void operator+= (Timespan timespan)
+    {
+        uint32_t *bucket = &buckets[BucketIndex(timespan.nanos())];
+#if MAC_OS_SANDBOX
+        if (g_bxl_enable_counters) OSIncrementAtomic(bucket);
+#else
+        ++(*bucket);
+#endif
+    }
+
+    void operator+= (const LatencyHistogram &other)
+    {
+        for (int i = 0; i < kLatencyHistogramBucketCount; i++)
+        {
+            buckets[i] += other.buckets[i];
+        }
+    }
+
+    uint64_t count() const
+    {
+        uint64_t total = 0;
+        for (int i = 0; i < kLatencyHistogramBucketCount; i++)
+        {
+            total += buckets[i];
+        }
+
+        return total;
+    }
+
+    /*! Upper bound (in nanoseconds) of the bucket in which the given percentile (from [0..100]) falls, or 0 if there are no samples */
+    uint64_t percentileNanos(double percentile) const
+    {
+        uint64_t total = count();
+        if (total == 0)
+        {
+            return 0;
+        }
+
+        uint64_t rank = (uint64_t)(total * percentile / 100);
+        if (rank >= total) rank = total - 1;
+        uint64_t seen = 0;
+        for (int i = 0; i < kLatencyHistogramBucketCount; i++)
+        {
+            seen += buckets[i];
+            if (seen > rank)
+            {
+                return BucketUpperBoundNanos(i);
+            }
+        }
+
+        return BucketUpperBoundNanos(kLatencyHistogramBucketCount - 1);
+    }
+} LatencyHistogram;
+
+/*! What a latency histogram (see 'LatencyHistograms') measures: either one step of handling an event or a whole listener scope */
+typedef enum {
+    kLatencyFindTrackedProcess,
+    kLatencySetLastLookedUpPath,
+    kLatencyCheckPolicy,
+    kLatencyCacheLookup,
+    kLatencyGetClientInfo,
+    kLatencyReportFileAccess,
+    kLatencyFileOpScope,
+    kLatencyVnodeScope,
+    kLatencyTrustedBsdScope,
+    kLatencyKindCount
+} LatencyKind;
+
+typedef struct {
+    LatencyHistogram histograms[kLatencyKindCount];
+} LatencyHistograms;
+
 typedef struct {
     pipid_t pipId;
     pid_t processId;
@@ -155,10 +269,24 @@ typedef struct {
 
 typedef struct {
     Counter totalNumSent;
+    Counter numSentEntries;
     Counter numQueued;
     Counter freeListNodeCount;
     double freeListSizeMB;
     Counter numCoalescedReports;
+
+    // Bytes of the encoded reports sent
+    Counter numBytesSent;
+
+    // Most reports found queued (in the queue the report went to) when a report was enqueued
+    Counter maxQueued;
+
+    // Number of times a report queue was found full, upon which its reports are held back until the client catches up
+    Counter numQueueFullStalls;
+
+    // Number of report queues currently held back (maintained whether counters are enabled or not, see ResourceManager);
+    // signed, because resetting the counters while a queue is stalled makes it go below 0 once the queue catches up
+    int numStalledQueues;
 } ReportCounters;
 
 typedef struct {
@@ -166,11 +294,22 @@ typedef struct {
     double size;
 } CountAndSize;
 
+// The number of zones Alloc serves small allocations from (see Alloc.hpp)
+#define kAllocZoneCount 8
+
+typedef struct {
+    uint blockSize;
+    uint numBlocks;  // blocks allocated from the kernel (in use or free)
+    uint numFree;    // blocks kept in the free list of the zone
+} ZoneUsage;
+
 typedef struct {
     int64_t totalAllocatedBytes;
     CountAndSize fastNodes;
     CountAndSize lightNodes;
+    CountAndSize compactNodes;
     CountAndSize cacheRecords;
+    ZoneUsage zones[kAllocZoneCount];
 } MemoryCountsAndSizes;
 
 typedef struct {
@@ -187,6 +326,7 @@ typedef struct {
     Counter numForks;
     Counter numCacheHits;
     Counter numCacheMisses;
+    Counter numCacheEvictions;
 } AllCounters;
 
 typedef struct {
@@ -223,6 +363,8 @@ typedef struct {
     pid_t clientPid;
     pipid_t pipId;
     uint64_t cacheSize;
+    uint32_t cacheNodeCount;
+    uint64_t cacheSizeBytes;
     int32_t treeSize;
     AllCounters counters;
     int8_t numReportedChildren;
@@ -233,16 +375,32 @@ typedef struct {
 typedef struct {
     uint numAttachedClients;
     AllCounters counters;
+    LatencyHistograms latencies;
     MemoryCountsAndSizes memory;
     KextConfig kextConfig;
     uint numReportedPips;
     PipInfo pips[kMaxReportedPips];
 } IntrospectResponse;
 
+// The memory type and the notification port type of the i-th report queue of a client are FileAccessReporting + i
 typedef enum {
     FileAccessReporting,
 } ReportQueueType;
 
+// The maximum number of report queues of a client (the kext creates one per CPU, up to this many)
+#define kMaxReportQueues 8
+
+// The index of the report queue the reports of a pip are sent to.  All the reports of a pip go through the same queue, so they
+// are received in the order in which they were enqueued, while the reports of different pips are spread over the queues.
+inline uint ReportQueueIndex(pipid_t pipId, uint queueCount)
+{
+    uint64_t hash = (uint64_t)pipId;
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return (uint)(hash % queueCount);
+}
+
 typedef struct {
     uint64_t creationTime;
     uint64_t enqueueTime;
@@ -261,8 +419,13 @@ typedef struct {
     uint32_t cacheNodeSize;
     uint32_t numForks;
     uint32_t numHardLinkRetries;
+
+    // The stats of the pip in the schema shared by the sandboxes
+    SandboxStats sandboxStats;
 } PipCompletionStats; // sizeof(PipCompletionStats) must be less than MAXPATHLEN, i.e., 1024
 
+static_assert(offsetof(PipCompletionStats, sandboxStats) == 48, "CODESYNC: Public/Src/Utilities/Interop/MacOS/Sandbox.cs");
+
 typedef struct {
     FileOperation operation;
     pid_t pid;
@@ -284,6 +447,110 @@ typedef struct {
     AccessReportStatistics stats;
 } AccessReport;
 
+#pragma mark Report queue encoding
+
+/*!
+ * Reports are laid out in the report queue as the access report records shared by the sandboxes (see AccessReportRecord.h), where a
+ * report takes only the bytes of its path (or of its PipCompletionStats) instead of the full path buffer.  The header of every record
+ * is extended with the AccessReportStatistics of the report, and records are padded to kEncodedAccessReportAlignment.
+ *
+ * The record of a process tree completed report is of kind kEncodedReportKindPipCompletion: its payload is the PipCompletionStats
+ * of the pip rather than a path.  The path of every other report is followed by its terminating null character.
+ */
+#define kEncodedAccessReportAlignment 8
+#define kEncodedAccessReportHeaderSize ((uint32_t)(sizeof(AccessReportRecordHeader) + sizeof(AccessReportStatistics)))
+#define kEncodedReportKindPipCompletion kAccessRecordKindSandboxSpecific
+
+// The maximum size of an entry of the report queue; the encoded reports of an entry are laid out one after the other
+#define kReportQueueEntrySizeMax (16 * 1024)
+
+// The size of the payload of a report: the PipCompletionStats of a process tree completed report, or the path of any other report
+// (followed by its terminating null character)
+inline uint32_t AccessReportPayloadSize(const AccessReport &report)
+{
+    return report.operation == kOpProcessTreeCompleted
+        ? (uint32_t)sizeof(PipCompletionStats)
+        : (uint32_t)strnlen(report.path, sizeof(report.path) - 1) + 1;
+}
+
+inline uint32_t EncodedAccessReportSize(uint32_t payloadSize)
+{
+    return AccessReportRecordLength(kEncodedAccessReportHeaderSize, payloadSize, kEncodedAccessReportAlignment);
+}
+
+/*!
+ * Encodes the report into the buffer, which must have room for EncodedAccessReportSize(AccessReportPayloadSize(report)) bytes.
+ *
+ * @result The number of bytes written.
+ */
+inline uint32_t EncodeAccessReport(const AccessReport &report, char *buffer)
+{
+    uint32_t payloadSize = AccessReportPayloadSize(report);
+    AccessReportRecordHeader header = MakeAccessReportRecordHeader(
+        report.operation == kOpProcessTreeCompleted ? (AccessRecordKind)kEncodedReportKindPipCompletion : kAccessRecordKindAccess,
+        kAccessRecordPlatformPosix,
+        payloadSize);
+
+    header.length          = EncodedAccessReportSize(payloadSize);
+    header.headerSize      = (uint16_t)kEncodedAccessReportHeaderSize;
+    header.flags           = report.reportExplicitly ? kAccessRecordFlagReportExplicitly : 0;
+    header.operation       = (uint32_t)report.operation;
+    header.pid             = (uint32_t)report.pid;
+    header.rootPid         = (uint32_t)report.rootPid;
+    header.requestedAccess = (uint32_t)report.requestedAccess;
+    header.status          = (uint32_t)report.status;
+    header.error           = (uint32_t)report.error;
+    header.pipId           = (uint64_t)report.pipId;
+
+    memcpy(buffer, &header, sizeof(header));
+    memcpy(buffer + sizeof(header), &report.stats, sizeof(report.stats));
+    memcpy(buffer + kEncodedAccessReportHeaderSize, report.path, payloadSize); // the path and the PipCompletionStats share the same storage
+    memset(buffer + kEncodedAccessReportHeaderSize + payloadSize, 0, header.length - kEncodedAccessReportHeaderSize - payloadSize);
+    return header.length;
+}
+
+/*!
+ * Decodes the report at the start of the buffer, which has 'length' bytes.
+ *
+ * @result The number of bytes the encoded report takes, or 0 if the buffer does not start with a valid encoded report.
+ */
+inline uint32_t DecodeAccessReport(const char *buffer, uint32_t length, AccessReport &report)
+{
+    AccessReportRecordHeader header;
+    if (length < kEncodedAccessReportHeaderSize)
+    {
+        return 0;
+    }
+
+    memcpy(&header, buffer, sizeof(header));
+    if (header.version != kAccessRecordVersion ||
+        header.headerSize < kEncodedAccessReportHeaderSize ||
+        header.payloadLength == 0 ||
+        header.payloadLength > sizeof(report.path) ||
+        header.length > length ||
+        header.headerSize + header.payloadLength > header.length)
+    {
+        return 0;
+    }
+
+    report.operation        = (FileOperation)header.operation;
+    report.pid              = (pid_t)header.pid;
+    report.rootPid          = (pid_t)header.rootPid;
+    report.requestedAccess  = header.requestedAccess;
+    report.status           = header.status;
+    report.reportExplicitly = (header.flags & kAccessRecordFlagReportExplicitly) != 0;
+    report.error            = header.error;
+    report.pipId            = (pipid_t)header.pipId;
+    memcpy(&report.stats, buffer + sizeof(header), sizeof(report.stats));
+    memcpy(report.path, buffer + header.headerSize, header.payloadLength);
+    if (header.kind != kEncodedReportKindPipCompletion)
+    {
+        report.path[header.payloadLength - 1] = '\0';
+    }
+
+    return header.length;
+}
+
 inline bool HasAnyFlags(const int source, const int bitMask)
 {
     return (source & bitMask) != 0;
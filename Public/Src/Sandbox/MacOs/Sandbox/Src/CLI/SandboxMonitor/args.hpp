@@ -11,6 +11,8 @@
   m(stacked,     bool,   false)                \
   m(no_header,   bool,   false)                \
   m(interactive, bool,   false)                \
+  m(json,        bool,   false)                \
+  m(interval_ms, int,    0)                    \
   m(ps_fmt,      string, "%cpu,%mem,ucomm")
 
 GEN_CONFIG_DECL(ALL_ARGS)
@@ -46,6 +48,16 @@ void ConfigureArgs() {
         ->ShortName("i")
         ->Description("Runs the monitor continuously until interrupted.");
     
+    Config::argMeta(kArg_json)
+        ->LongName("json")
+        ->ShortName("j")
+        ->Description("Streams one line of JSON (counters, latencies and per-pip stats) per update until interrupted.");
+
+    Config::argMeta(kArg_interval_ms)
+        ->LongName("interval-ms")
+        ->ShortName("ms")
+        ->Description("Delay between updates in milliseconds (takes precedence over --delay when set).");
+
     Config::argMeta(kArg_ps_fmt)
         ->LongName("ps-fmt")
         ->ShortName("f")
@@ -0,0 +1,117 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef json_hpp
+#define json_hpp
+
+#include <cstdio>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/*!
+ * Minimal streaming JSON writer: values are written straight to the output stream as they are added, so emitting a
+ * sample never builds an intermediate document.  The closing brace/bracket is written when the object goes out of scope.
+ */
+class JsonWriter
+{
+private:
+    ostream &out_;
+    const char close_;
+    bool empty_;
+
+    JsonWriter(ostream &out, char open, char close) : out_(out), close_(close), empty_(true)
+    {
+        out_ << open;
+    }
+
+    void separator()
+    {
+        if (!empty_) out_ << ',';
+        empty_ = false;
+    }
+
+    void key(const char *name)
+    {
+        separator();
+        writeString(name);
+        out_ << ':';
+    }
+
+    void writeString(const string &str)
+    {
+        out_ << '"';
+        for (char c : str)
+        {
+            switch (c)
+            {
+                case '"':  out_ << "\\\""; break;
+                case '\\': out_ << "\\\\"; break;
+                case '\n': out_ << "\\n";  break;
+                case '\t': out_ << "\\t";  break;
+                default:
+                    if ((unsigned char)c < 0x20)
+                    {
+                        char escaped[8];
+                        snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                        out_ << escaped;
+                    }
+                    else
+                    {
+                        out_ << c;
+                    }
+            }
+        }
+        out_ << '"';
+    }
+
+public:
+
+    /*! Starts writing an object to 'out' */
+    explicit JsonWriter(ostream &out) : JsonWriter(out, '{', '}') { }
+
+    JsonWriter(const JsonWriter&) = delete;
+    JsonWriter& operator=(const JsonWriter&) = delete;
+
+    ~JsonWriter()
+    {
+        out_ << close_;
+    }
+
+    JsonWriter& field(const char *name, uint64_t value) { key(name); out_ << value; return *this; }
+    JsonWriter& field(const char *name, int64_t value)  { key(name); out_ << value; return *this; }
+    JsonWriter& field(const char *name, uint32_t value) { return field(name, (uint64_t)value); }
+    JsonWriter& field(const char *name, int32_t value)  { return field(name, (int64_t)value); }
+    JsonWriter& field(const char *name, double value)   { key(name); out_ << value; return *this; }
+    JsonWriter& field(const char *name, bool value)     { key(name); out_ << (value ? "true" : "false"); return *this; }
+    JsonWriter& field(const char *name, const string &value) { key(name); writeString(value); return *this; }
+    JsonWriter& field(const char *name, const char *value)   { key(name); writeString(value); return *this; }
+
+    JsonWriter& object(const char *name, function<void(JsonWriter&)> writeMembers)
+    {
+        key(name);
+        JsonWriter nested(out_, '{', '}');
+        writeMembers(nested);
+        return *this;
+    }
+
+    /*! Writes an array of objects: 'writeElement' is called for every element, each with a fresh object writer */
+    template <typename T>
+    JsonWriter& array(const char *name, const vector<T> &elements, function<void(JsonWriter&, const T&)> writeElement)
+    {
+        key(name);
+        JsonWriter nested(out_, '[', ']');
+        for (const T &element : elements)
+        {
+            nested.separator();
+            JsonWriter item(out_, '{', '}');
+            writeElement(item, element);
+        }
+        return *this;
+    }
+};
+
+#endif /* json_hpp */
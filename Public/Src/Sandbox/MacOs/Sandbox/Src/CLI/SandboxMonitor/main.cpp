@@ -12,8 +12,10 @@
 #include <string>
 #include <sstream>
 #include <ncurses.h>
+#include <sys/time.h>
 
 #import "args.hpp"
+#import "json.hpp"
 #import "ps.hpp"
 #import "lambda.hpp"
 #import "render.hpp"
@@ -27,7 +29,7 @@ GEN_CONFIG_DEF(ALL_ARGS)
 string renderClientId(pid_t clientId)
 {
     stringstream str;
-    str << ps(clientId, "ucomm=") << ":" << clientId;
+    str << process_name(clientId) << ":" << clientId;
     return str.str();
 }
 
@@ -69,6 +71,15 @@ string renderCounter(DurationCounter cnt)
     return str.str();
 }
 
+string renderLatency(const LatencyHistogram &histogram)
+{
+    stringstream str;
+    str << renderDouble(histogram.percentileNanos(50) / 1000.0) << "/"
+        << renderDouble(histogram.percentileNanos(99) / 1000.0) << "/"
+        << renderDouble(histogram.percentileNanos(100) / 1000.0) << "us";
+    return str.str();
+}
+
 static const uint BytesInAMegabyte = 1 << 20;
 
 string renderBytesAsMebabytes(double bytes)
@@ -107,10 +118,15 @@ vector<vector<HeaderColumn<Tuple>>> getStackedHeaders(const Config &cfg)
             {   8, "#C+",     to_getter(t.pip.counters.numCacheHits) },
             {   8, "#C-",     to_getter(t.pip.counters.numCacheMisses) },
             {   8, "#C",      to_getter(t.pip.cacheSize) },
+            {   8, "#CN",     to_getter(t.pip.cacheNodeCount) },
+            {   8, "C(KB)",   to_getter(t.pip.cacheSizeBytes / 1024) },
+            {   4, "#CE",     to_getter(t.pip.counters.numCacheEvictions) },
             {   4, "C%",      to_getter((int)floor(PERCENT(t.pip.counters.numCacheHits.count(), t.pip.counters.numCacheMisses.count()))) },
             {   8, "avg(FP)", to_getter(t.pip.counters.findTrackedProcess) },
             {   8, "avg(SP)", to_getter(t.pip.counters.setLastLookedUpPath) },
             {   8, "avg(PC)", to_getter(t.pip.counters.checkPolicy) },
+            {   8, "#Rep",    to_getter(t.pip.counters.reportCounters.totalNumSent) },
+            {   8, "#Coal",   to_getter(t.pip.counters.reportCounters.numCoalescedReports) },
             {   8, "avg(CL)", to_getter(t.pip.counters.cacheLookup) },
             {   8, "avg(GC)", to_getter(t.pip.counters.getClientInfo) },
             {   8, "avg(RF)", to_getter(t.pip.counters.reportFileAccess) },
@@ -188,6 +204,147 @@ void renderProcesses(const Config *cfg, const Renderer<Tuple> *renderer, const I
     }
 }
 
+#pragma mark JSON streaming
+
+static void writeCounters(JsonWriter &json, AllCounters counters)
+{
+    auto writeDuration = [](DurationCounter cnt)
+    {
+        return [cnt](JsonWriter &o) mutable
+        {
+            o.field("count", cnt.count()).field("micros", cnt.duration().micros());
+        };
+    };
+
+    json.object("findTrackedProcess",  writeDuration(counters.findTrackedProcess))
+        .object("setLastLookedUpPath", writeDuration(counters.setLastLookedUpPath))
+        .object("checkPolicy",         writeDuration(counters.checkPolicy))
+        .object("cacheLookup",         writeDuration(counters.cacheLookup))
+        .object("getClientInfo",       writeDuration(counters.getClientInfo))
+        .object("reportFileAccess",    writeDuration(counters.reportFileAccess))
+        .object("accessHandler",       writeDuration(counters.accessHandler))
+        .object("resources", [&counters](JsonWriter &o)
+        {
+            const ResourceCounters &rc = counters.resourceCounters;
+            o.field("cpuUsageBasisPoints", (uint32_t) rc.cpuUsage.value)
+             .field("availableRamMB", rc.availableRamMB)
+             .field("numTrackedProcesses", rc.numTrackedProcesses)
+             .field("numBlockedProcesses", rc.numBlockedProcesses);
+        })
+        .object("reports", [&counters](JsonWriter &o)
+        {
+            ReportCounters &rc = counters.reportCounters;
+            o.field("totalNumSent", rc.totalNumSent.count())
+             .field("numSentEntries", rc.numSentEntries.count())
+             .field("numQueued", rc.numQueued.count())
+             .field("numCoalescedReports", rc.numCoalescedReports.count())
+             .field("numBytesSent", rc.numBytesSent.count())
+             .field("maxQueued", rc.maxQueued.count())
+             .field("numQueueFullStalls", rc.numQueueFullStalls.count())
+             .field("numStalledQueues", rc.numStalledQueues)
+             .field("freeListNodeCount", rc.freeListNodeCount.count())
+             .field("freeListSizeMB", rc.freeListSizeMB);
+        })
+        .field("numHardLinkRetries", counters.numHardLinkRetries.count())
+        .field("numForks", counters.numForks.count())
+        .field("numCacheHits", counters.numCacheHits.count())
+        .field("numCacheMisses", counters.numCacheMisses.count())
+        .field("numCacheEvictions", counters.numCacheEvictions.count());
+}
+
+static void writeLatencies(JsonWriter &json, const LatencyHistograms &latencies)
+{
+    static const char *names[kLatencyKindCount] =
+    {
+        "findTrackedProcess", "setLastLookedUpPath", "checkPolicy", "cacheLookup",
+        "getClientInfo", "reportFileAccess", "fileOpScope", "vnodeScope", "trustedBsdScope"
+    };
+
+    for (int i = 0; i < kLatencyKindCount; i++)
+    {
+        const LatencyHistogram &histogram = latencies.histograms[i];
+        json.object(names[i], [&histogram](JsonWriter &o)
+        {
+            o.field("count", histogram.count())
+             .field("p50Nanos", histogram.percentileNanos(50))
+             .field("p99Nanos", histogram.percentileNanos(99))
+             .field("maxNanos", histogram.percentileNanos(100));
+        });
+    }
+}
+
+static void writeProcess(JsonWriter &json, const ProcessInfo &proc)
+{
+    json.field("pid", proc.pid);
+
+    proc_stats stats;
+    if (get_proc_stats(proc.pid, &stats))
+    {
+        json.field("name", stats.name)
+            .field("ppid", stats.ppid)
+            .field("residentSize", stats.residentSize)
+            .field("virtualSize", stats.virtualSize)
+            .field("userTimeNs", stats.userTimeNs)
+            .field("systemTimeNs", stats.systemTimeNs)
+            .field("numThreads", stats.numThreads);
+    }
+}
+
+/*!
+ * Writes one sample as a single line of JSON, so the output can be consumed as newline-delimited JSON.
+ * Process information is read with proc_pidinfo, no process is spawned per sample.
+ */
+void writeJsonSample(const IntrospectResponse *response, const char *version, bool isDebug, ostream &output)
+{
+    struct timeval now;
+    gettimeofday(&now, nullptr);
+
+    {
+        JsonWriter json(output);
+        json.field("timestampMs", (uint64_t) now.tv_sec * 1000 + now.tv_usec / 1000)
+            .field("version", version)
+            .field("debug", isDebug)
+            .field("numAttachedClients", response->numAttachedClients)
+            .object("counters", [response](JsonWriter &o) { writeCounters(o, response->counters); })
+            .object("latencies", [response](JsonWriter &o) { writeLatencies(o, response->latencies); })
+            .object("memory", [response](JsonWriter &o)
+            {
+                const MemoryCountsAndSizes &memory = response->memory;
+                auto writeCountAndSize = [](CountAndSize cnt)
+                {
+                    return [cnt](JsonWriter &c) { c.field("count", cnt.count).field("size", cnt.size); };
+                };
+
+                o.field("totalAllocatedBytes", (int64_t) memory.totalAllocatedBytes)
+                 .object("fastNodes", writeCountAndSize(memory.fastNodes))
+                 .object("lightNodes", writeCountAndSize(memory.lightNodes))
+                 .object("compactNodes", writeCountAndSize(memory.compactNodes))
+                 .object("cacheRecords", writeCountAndSize(memory.cacheRecords))
+                 .array<ZoneUsage>("zones", vector<ZoneUsage>(memory.zones, memory.zones + kAllocZoneCount), [](JsonWriter &z, const ZoneUsage &zone)
+                 {
+                     z.field("blockSize", zone.blockSize)
+                      .field("numBlocks", zone.numBlocks)
+                      .field("numFree", zone.numFree);
+                 });
+            })
+            .array<PipInfo>("pips", GetPips(response), [](JsonWriter &o, const PipInfo &pip)
+            {
+                o.field("pipId", renderPipId(pip.pipId))
+                 .field("pid", pip.pid)
+                 .field("clientPid", pip.clientPid)
+                 .field("client", process_name(pip.clientPid))
+                 .field("treeSize", pip.treeSize)
+                 .field("cacheSize", pip.cacheSize)
+                 .field("cacheNodeCount", pip.cacheNodeCount)
+                 .field("cacheSizeBytes", pip.cacheSizeBytes)
+                 .object("counters", [&pip](JsonWriter &c) { writeCounters(c, pip.counters); })
+                 .array<ProcessInfo>("processes", GetPipChildren(pip), writeProcess);
+            });
+    }
+
+    output << endl;
+}
+
 void printValidPsKeywords()
 {
     cout << "Valid keywords: ";
@@ -292,7 +449,7 @@ int main(int argc, const char * argv[])
     {
         if (loopCount++ > 0)
         {
-            sleep(cfg.delay);
+            usleep(cfg.interval_ms > 0 ? cfg.interval_ms * 1000 : cfg.delay * 1000000);
         }
         
         if (g_interrupted)
@@ -300,6 +457,20 @@ int main(int argc, const char * argv[])
             break;
         }
 
+        IntrospectResponse response;
+        if (!IntrospectKernelExtension(info, &response))
+        {
+            error("%s", "Failed to introspect sandbox kernel extension");
+            exitCode = 1;
+            break;
+        }
+
+        if (cfg.json)
+        {
+            writeJsonSample(&response, version, isDebug, cout);
+            continue;
+        }
+
         stringstream output;
         
         // render information about interactive mode
@@ -311,14 +482,6 @@ int main(int argc, const char * argv[])
             output << "(" << loopCount << ")" << endl;
         }
 
-        IntrospectResponse response;
-        if (!IntrospectKernelExtension(info, &response))
-        {
-            error("%s", "Failed to introspect sandbox kernel extension");
-            exitCode = 1;
-            break;
-        }
-
         // render header
         if (!cfg.no_header)
         {
@@ -355,21 +518,49 @@ int main(int argc, const char * argv[])
                    << renderCounter(response.counters.reportFileAccess) << " / "
                    << renderCounter(response.counters.accessHandler)
                    << endl;
+            const LatencyHistogram *latencies = response.latencies.histograms;
+            output << "Latencies  :: "
+                   << "p50/p99/max(FindProcess/SetLastPath/PolicyCheck/CacheLookup/GetClient/ReportFileAccess): "
+                   << renderLatency(latencies[kLatencyFindTrackedProcess]) << " / "
+                   << renderLatency(latencies[kLatencySetLastLookedUpPath]) << " / "
+                   << renderLatency(latencies[kLatencyCheckPolicy]) << " / "
+                   << renderLatency(latencies[kLatencyCacheLookup]) << " / "
+                   << renderLatency(latencies[kLatencyGetClientInfo]) << " / "
+                   << renderLatency(latencies[kLatencyReportFileAccess])
+                   << endl;
+            output << "Scopes     :: "
+                   << "p50/p99/max(FileOp/Vnode/TrustedBSD): "
+                   << renderLatency(latencies[kLatencyFileOpScope]) << " / "
+                   << renderLatency(latencies[kLatencyVnodeScope]) << " / "
+                   << renderLatency(latencies[kLatencyTrustedBsdScope])
+                   << endl;
             output << "Reports    :: "
                    << "#Queued: " << to_string(response.counters.reportCounters.numQueued)
                    << ", Total: " << to_string(response.counters.reportCounters.totalNumSent)
+                   << ", #Entries: " << to_string(response.counters.reportCounters.numSentEntries)
                    << ", #HardLink retries: " << to_string(response.counters.numHardLinkRetries)
                    << ", #CoalescedReports: " << to_string(response.counters.reportCounters.numCoalescedReports)
                    << " (" << renderDouble(PERCENT(response.counters.reportCounters.numCoalescedReports.count(), response.counters.reportCounters.totalNumSent.count())) << "%)"
+                   << ", #QueueFullStalls: " << to_string(response.counters.reportCounters.numQueueFullStalls)
+                   << " (" << response.counters.reportCounters.numStalledQueues << " stalled)"
                    << endl;
             output << "Memory     :: "
                    << "FastTrieNodes: " << renderCountAndSize(response.memory.fastNodes)
                    << ", LightTrieNodes: " << renderCountAndSize(response.memory.lightNodes)
+                   << ", CompactTrieNodes: " << renderCountAndSize(response.memory.compactNodes)
                    << ", CacheRecords: " << renderCountAndSize(response.memory.cacheRecords)
                    << ", FreeListNodes: " << to_string(response.counters.reportCounters.freeListNodeCount)
                    << " (" << renderDouble(response.counters.reportCounters.freeListSizeMB) << " MB)"
                    << ", IONew allocations: " << renderBytesAsMebabytes(response.memory.totalAllocatedBytes)
                    << endl;
+            output << "Zones      :: ";
+            for (int i = 0; i < kAllocZoneCount; i++)
+            {
+                const ZoneUsage &zone = response.memory.zones[i];
+                output << (i > 0 ? ", " : "") << zone.blockSize << "B: " << zone.numBlocks - zone.numFree << "/" << zone.numBlocks
+                       << " (" << renderBytesAsMebabytes((double)zone.blockSize * zone.numBlocks) << ")";
+            }
+            output << endl;
             output << "Processes  :: #Client: " << response.numAttachedClients
                    << ", #Pips: " << response.numReportedPips
                    << ", Available RAM: " << counters->availableRamMB << " MB"
@@ -389,7 +580,7 @@ int main(int argc, const char * argv[])
             clrscr();
         cout << output.str();
 
-    } while (cfg.interactive && !g_interrupted);
+    } while ((cfg.interactive || cfg.json) && !g_interrupted);
 
     DeinitializeKextConnection(info);
 
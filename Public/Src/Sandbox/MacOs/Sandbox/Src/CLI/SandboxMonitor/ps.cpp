@@ -3,6 +3,8 @@
 
 #include "ps.hpp"
 #include <array>
+#include <libproc.h>
+#include <mach/mach_time.h>
 #include <sstream>
 #include <regex>
 
@@ -36,3 +38,31 @@ string ps(pid_t pid, const string &cols)
     string stdout = exec(str.str().c_str());
     return regex_replace(stdout, regex("\\s*\n$"), "");
 }
+
+bool get_proc_stats(pid_t pid, proc_stats *stats)
+{
+    struct proc_taskallinfo info;
+    if (proc_pidinfo(pid, PROC_PIDTASKALLINFO, 0, &info, sizeof(info)) != sizeof(info))
+    {
+        return false;
+    }
+
+    // task times are reported in mach absolute time units
+    static mach_timebase_info_data_t timebase = { 0, 0 };
+    if (timebase.denom == 0) mach_timebase_info(&timebase);
+
+    stats->name         = info.pbsd.pbi_name[0] != '\0' ? info.pbsd.pbi_name : info.pbsd.pbi_comm;
+    stats->ppid         = info.pbsd.pbi_ppid;
+    stats->residentSize = info.ptinfo.pti_resident_size;
+    stats->virtualSize  = info.ptinfo.pti_virtual_size;
+    stats->userTimeNs   = info.ptinfo.pti_total_user * timebase.numer / timebase.denom;
+    stats->systemTimeNs = info.ptinfo.pti_total_system * timebase.numer / timebase.denom;
+    stats->numThreads   = info.ptinfo.pti_threadnum;
+    return true;
+}
+
+string process_name(pid_t pid)
+{
+    char name[2 * MAXCOMLEN + 1] = { '\0' };
+    return proc_name(pid, name, sizeof(name)) > 0 ? string(name) : string();
+}
@@ -13,4 +13,18 @@ extern set<string> ps_keywords;
 string exec(const char *cmd);
 string ps(pid_t pid, const string &cols);
 
+// Process information read directly from the kernel (proc_pidinfo), i.e., without forking a 'ps' process
+typedef struct {
+    string name;
+    pid_t ppid;
+    uint64_t residentSize;
+    uint64_t virtualSize;
+    uint64_t userTimeNs;
+    uint64_t systemTimeNs;
+    int32_t numThreads;
+} proc_stats;
+
+bool get_proc_stats(pid_t pid, proc_stats *stats);
+string process_name(pid_t pid);
+
 #endif /* ps_hpp */
@@ -36,6 +36,8 @@ bool CacheRecord::init()
     }
 
     requestedAccess_ = RequestedAccess::None;
+    lookupChecked_   = 0;
+    policyState_     = kPolicyCursorNotSet;
     return true;
 }
 
@@ -9,11 +9,13 @@
 #include "BuildXLSandboxShared.hpp"
 #include "FileAccessHelpers.h"
 #include "BXLLocks.hpp"
+#include "PolicySearch.h"
 
 #define CacheRecord BXL_CLASS(CacheRecord)
 
 /*!
- * A cache record where we keep track of already reported accesses for a given path.
+ * A cache record where we keep track of already reported accesses for a given path, and of the result of
+ * searching the manifest of the pip for it.
  */
 class CacheRecord : public OSObject
 {
@@ -27,6 +29,21 @@ private:
      * A bitwise disjunction of reported accesses.
      */
     RequestedAccess requestedAccess_;
+
+    /*!
+     * Set (to 1) once a lookup of the path has been checked, whether it was reported or not.
+     */
+    volatile UInt32 lookupChecked_;
+
+    /*!
+     * The policy search cursor of the path (see 'TryGetPolicyCursor'), valid once 'policyState_' is kPolicyCursorSet.
+     */
+    PolicySearchCursor policyCursor_;
+    volatile UInt32 policyState_;
+
+    static const UInt32 kPolicyCursorNotSet  = 0;
+    static const UInt32 kPolicyCursorSetting = 1;
+    static const UInt32 kPolicyCursorSet     = 2;
     
     /*!
      * Determines if the given 'checkResult' should be deemed a cache hit (and thus not reported).
@@ -61,6 +78,46 @@ public:
      * @return Whether 'checkResult' was a cache hit.
      */
     bool CheckAndUpdate(const AccessCheckResult *checkResult);
+
+    /*!
+     * Atomically determines if a lookup of the path has already been checked and, if not, marks it as checked.
+     *
+     * Lookups are never denied and their check result only depends on the path, so once a lookup of a path
+     * has been checked (and reported, if it had to be), repeated lookups of it (e.g., probes of a nonexistent
+     * path) need neither a policy search nor a report.
+     *
+     * @return Whether a lookup of the path had already been checked.
+     */
+    bool CheckAndMarkLookup() { return !OSCompareAndSwap(0, 1, &lookupChecked_); }
+
+    /*!
+     * Gets the policy search cursor of the path, if some process of the pip already searched the manifest for it.
+     *
+     * The policy of a path only depends on the manifest of the pip, so the processes of the pip search for a path once;
+     * the cursor is immutable once set, hence readers never wait.
+     */
+    bool TryGetPolicyCursor(PolicySearchCursor *cursor) const
+    {
+        if (policyState_ != kPolicyCursorSet)
+        {
+            return false;
+        }
+
+        OSMemoryBarrier();
+        *cursor = policyCursor_;
+        return true;
+    }
+
+    /*! Sets the policy search cursor of the path, unless it is already set (or being set). */
+    void SetPolicyCursor(const PolicySearchCursor &cursor)
+    {
+        if (OSCompareAndSwap(kPolicyCursorNotSet, kPolicyCursorSetting, &policyState_))
+        {
+            policyCursor_ = cursor;
+            OSMemoryBarrier();
+            policyState_ = kPolicyCursorSet;
+        }
+    }
     
 #pragma mark Static Methods
     
@@ -7,12 +7,12 @@
 
 OSDefineMetaClassAndStructors(ClientInfo, OSObject)
 
-ClientInfo* ClientInfo::create(const InitArgs& args)
+ClientInfo* ClientInfo::create(const InitArgs& args, uint queueCount)
 {
     auto *instance = new ClientInfo;
     if (instance)
     {
-        bool initialized = instance->init(args);
+        bool initialized = instance->init(args, queueCount);
         if (!initialized)
         {
             instance->release();
@@ -28,7 +28,7 @@ ClientInfo* ClientInfo::create(const InitArgs& args)
     return instance;
 }
 
-bool ClientInfo::init(const InitArgs& args)
+bool ClientInfo::init(const InitArgs& args, uint queueCount)
 {
     if (!super::init())
     {
@@ -37,13 +37,24 @@ bool ClientInfo::init(const InitArgs& args)
 
     frozen_          = false;
     reportCounters_  = args.counters;
+    queueCount_      = 0;
 
-    queue_ = ConcurrentSharedDataQueue::create(args);
-    if (queue_ == nullptr)
+    if (queueCount == 0 || queueCount > kMaxReportQueues)
     {
         return false;
     }
 
+    for (uint i = 0; i < queueCount; i++)
+    {
+        queues_[i] = ConcurrentSharedDataQueue::create(args);
+        if (queues_[i] == nullptr)
+        {
+            return false;
+        }
+
+        queueCount_++;
+    }
+
     lock_ = BXLRecursiveLockAlloc();
     if (lock_ == nullptr)
     {
@@ -55,7 +66,12 @@ bool ClientInfo::init(const InitArgs& args)
 
 void ClientInfo::free()
 {
-    OSSafeReleaseNULL(queue_);
+    for (uint i = 0; i < queueCount_; i++)
+    {
+        OSSafeReleaseNULL(queues_[i]);
+    }
+
+    queueCount_ = 0;
 
     if (lock_)
     {
@@ -66,39 +82,22 @@ void ClientInfo::free()
     super::free();
 }
 
-bool ClientInfo::createQueue(uint32_t entryCount, uint32_t entrySize, bool enableBatching)
-{
-    EnterMonitor
-
-    if (frozen_ || queue_ != nullptr) return false;
-
-    queue_ = ConcurrentSharedDataQueue::create(
-    {
-        .entryCount = entryCount,
-        .entrySize  = entrySize,
-        .enableBatching = enableBatching,
-        .counters = reportCounters_
-    });
-
-    return queue_ != nullptr;
-}
-
-bool ClientInfo::setNotifactonPort(mach_port_t port)
+bool ClientInfo::setNotifactonPort(mach_port_t port, uint queueIndex)
 {
     EnterMonitor
 
-    if (frozen_ || queue_ == nullptr) return false;
+    if (frozen_ || queueIndex >= queueCount_) return false;
 
-    queue_->setNotificationPort(port);
+    queues_[queueIndex]->setNotificationPort(port);
     return true;
 }
 
-IOMemoryDescriptor* ClientInfo::getMemoryDescriptor()
+IOMemoryDescriptor* ClientInfo::getMemoryDescriptor(uint queueIndex)
 {
     EnterMonitor
 
-    return !frozen_ && queue_
-        ? queue_->getMemoryDescriptor()
+    return !frozen_ && queueIndex < queueCount_
+        ? queues_[queueIndex]->getMemoryDescriptor()
         : nullptr;
 }
 
@@ -106,9 +105,13 @@ bool ClientInfo::setFailureNotificationHandler(OSAsyncReference64 ref, OSObject
 {
     EnterMonitor
 
-    if (frozen_ || queue_ == nullptr) return false;
+    if (frozen_ || queueCount_ == 0) return false;
+
+    for (uint i = 0; i < queueCount_; i++)
+    {
+        queues_[i]->setClientAsyncFailureHandle(ref, client);
+    }
 
-    queue_->setClientAsyncFailureHandle(ref, client);
     return true;
 }
 
@@ -116,5 +119,5 @@ bool ClientInfo::enqueueReport(const EnqueueArgs &args)
 {
     frozen_ = true;
 
-    return queue_ && queue_->enqueueReport(args);
+    return queueCount_ > 0 && queues_[ReportQueueIndex(args.report.pipId, queueCount_)]->enqueueReport(args);
 }
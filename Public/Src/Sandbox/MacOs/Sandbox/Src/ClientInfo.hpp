@@ -34,14 +34,18 @@ private:
     ReportCounters *reportCounters_;
 
     /*!
-     * A wrapper around IOSharedDataQueue.
+     * The report queues of the client (wrappers around IOSharedDataQueue), each drained by its own thread in the client.
+     * The reports of a pip are always sent to the same queue (see ReportQueueIndex).
      */
-    ConcurrentSharedDataQueue *queue_;
+    ConcurrentSharedDataQueue *queues_[kMaxReportQueues];
+
+    /*! The number of queues in 'queues_' */
+    uint queueCount_;
 
     /*!
      * A client becomes frozen after the first call to 'enqueueData'.
      *
-     * Once frozen, all calls that mutate the queue (e.g., 'setNotifactonPort', etc.) are denied.
+     * Once frozen, all calls that mutate the queues (e.g., 'setNotifactonPort', etc.) are denied.
      */
     bool frozen_;
 
@@ -50,7 +54,7 @@ private:
      *
      * @result indicates success.
      */
-    bool init(const InitArgs& args);
+    bool init(const InitArgs& args, uint queueCount);
 
 public:
 
@@ -59,38 +63,33 @@ public:
      */
     void free() override;
 
-    /*!
-     * Creates a shared data queue for this client.  May only be called once.
-     *
-     * @result indicates success (it's False, e.g., if a queue had already been created).
-     */
-    bool createQueue(uint32_t entryCount, uint32_t entrySize, bool enableBatching);
+    /*! The number of report queues of this client */
+    uint getQueueCount() const { return queueCount_; }
 
     /*!
-     * Sets the notification port for the underlying shared data queue.
+     * Sets the notification port for the shared data queue with the given index.
      *
-     * 'createQueue' must be called prior to calling this method.
-     *
-     * @result indicates success (it's False, e.g., if 'createQueue' hadn't been called first).
+     * @result indicates success (it's False, e.g., if there is no queue with the given index).
      */
-    bool setNotifactonPort(mach_port_t port);
+    bool setNotifactonPort(mach_port_t port, uint queueIndex);
 
     /*!
-     * Returns the memory descriptor of the underlying shared data queue.
+     * Returns the memory descriptor of the shared data queue with the given index.
      *
-     * @result a newly allocated memory descriptor.  The caller is responsible for releasing it.
+     * @result a newly allocated memory descriptor (or nullptr if there is no queue with the given index).
+     *         The caller is responsible for releasing it.
      */
-    IOMemoryDescriptor* getMemoryDescriptor();
+    IOMemoryDescriptor* getMemoryDescriptor(uint queueIndex);
 
     /*!
-     * Sets the failure notification async callback handle for the underlying shared data queue.
+     * Sets the failure notification async callback handle for all the shared data queues.
      *
      * @result indicates success.
      */
     bool setFailureNotificationHandler(OSAsyncReference64 ref, OSObject *client);
 
     /*!
-     * Enqueues a report into the underlying shared data queue.
+     * Enqueues a report into the shared data queue of the pip of the report.
      *
      * @result indicates success.
      */
@@ -98,8 +97,12 @@ public:
 
 #pragma mark Static Methods
 
-    /*! Static factory method, following the OSObject pattern */
-    static ClientInfo* create(const InitArgs& args);
+    /*!
+     * Static factory method, following the OSObject pattern.
+     *
+     * Creates 'queueCount' (at most kMaxReportQueues) shared data queues, each created with 'args'.
+     */
+    static ClientInfo* create(const InitArgs& args, uint queueCount);
 };
 
 #endif /* ClientInfo_hpp */
@@ -3,6 +3,8 @@
 
 #include <IOKit/IOMemoryDescriptor.h>
 #include <IOKit/IODataQueueShared.h>
+#include <kern/clock.h>
+#include <kern/sched_prim.h>
 #include "Alloc.hpp"
 #include "BuildXLSandboxClient.hpp"
 #include "ConcurrentSharedDataQueue.hpp"
@@ -67,6 +69,12 @@ QueueElem* ConcurrentSharedDataQueue::allocateElem(const EnqueueArgs &args)
         payload->cacheRecord->retain();
     }
 
+    payload->pip = args.pip;
+    if (payload->pip)
+    {
+        payload->pip->retain();
+    }
+
     return payload->queueElem;
 }
 
@@ -75,6 +83,7 @@ void ConcurrentSharedDataQueue::releaseElem(QueueElem *elem)
     ElemPayload *payload = getValue(elem);
     payload->queueElem = elem;
     OSSafeReleaseNULL(payload->cacheRecord);
+    OSSafeReleaseNULL(payload->pip);
     lfds711_freelist_push(freeList_, &payload->freeListElem, nullptr);
 }
 
@@ -107,9 +116,15 @@ bool ConcurrentSharedDataQueue::init(const InitArgs& args)
     }
 
     drainingDone_                 = false;
+    drainerWaiting_               = false;
     unrecoverableFailureOccurred_ = false;
     reportCounters_               = args.counters;
     enableBatching_               = args.enableBatching;
+    batchSize_                    = 0;
+    batchCount_                   = 0;
+    batchStartTime_               = 0;
+
+    nanoseconds_to_absolutetime(kBatchFlushIntervalNs, &batchFlushInterval_);
 
     lock_ = BXLRecursiveLockAlloc();
     if (lock_ == nullptr)
@@ -167,6 +182,7 @@ bool ConcurrentSharedDataQueue::init(const InitArgs& args)
 void ConcurrentSharedDataQueue::free()
 {
     drainingDone_ = true;
+    thread_wakeup((event_t)&drainerWaiting_);
 
     // wait for consumer thread to finish
     if (consumerThread_ != nullptr)
@@ -276,21 +292,71 @@ bool ConcurrentSharedDataQueue::enqueueReport(const EnqueueArgs &args)
         return false;
     }
 
-    return enableBatching_
-        ? enqueueWithBatching(args)
-        : enqueueWithLocking(args);
+    LFDS711_MISC_MAKE_VALID_ON_CURRENT_LOGICAL_CORE_INITS_COMPLETED_BEFORE_NOW_ON_ANY_OTHER_LOGICAL_CORE;
+
+    QueueElem *elem = allocateElem(args);
+    if (elem == nullptr)
+    {
+        return false;
+    }
+
+    lfds711_queue_umm_enqueue(pendingReports_, elem);
+    reportCounters_->numQueued++;
+    if (args.pip != nullptr)
+    {
+        args.pip->Counters()->reportCounters.maxQueued.updateMax(reportCounters_->numQueued.count());
+    }
+
+    // The enqueue above is a full barrier, so either the drainer sees the report before it starts waiting or this sees it waiting
+    if (drainerWaiting_)
+    {
+        thread_wakeup((event_t)&drainerWaiting_);
+    }
+
+    return true;
 }
 
-bool ConcurrentSharedDataQueue::enqueueWithLocking(const EnqueueArgs &args)
+static uint s_backoffIntervalsMs[] = {1, 2, 4, 8, 16, 32, 64};
+static uint s_backoffIntervalsLen = sizeof(s_backoffIntervalsMs) / sizeof(s_backoffIntervalsMs[0]);
+
+bool ConcurrentSharedDataQueue::waitForQueueSpace(const char *encodedReports, uint32_t size)
 {
-    EnterMonitor
+    reportCounters_->numQueueFullStalls++;
+    OSIncrementAtomic(&reportCounters_->numStalledQueues);
 
-    return sendReport(args.report);
+    uint64_t deadline;
+    clock_interval_to_deadline(kQueueFullTimeoutMs, kMillisecondScale, &deadline);
+
+    bool sent = false;
+    uint backoffCounter = 0;
+    while (!sent && !drainingDone_ && mach_absolute_time() < deadline)
+    {
+        uint backoffIndex = backoffCounter < s_backoffIntervalsLen ? backoffCounter : s_backoffIntervalsLen - 1;
+        IOSleep(s_backoffIntervalsMs[backoffIndex]);
+        ++backoffCounter;
+
+        sent = queue_->enqueue((void*)encodedReports, (UInt32)size);
+    }
+
+    OSDecrementAtomic(&reportCounters_->numStalledQueues);
+    return sent;
 }
 
-bool ConcurrentSharedDataQueue::sendReport(const AccessReport &report)
+bool ConcurrentSharedDataQueue::sendReports(const char *encodedReports, uint32_t size, uint count)
 {
-    bool sent = queue_->enqueue((void*)&report, sizeof(AccessReport));
+    bool sent = queue_->enqueue((void*)encodedReports, (UInt32)size);
+    if (!sent)
+    {
+        // the client is behind --> hold on to the entry rather than failing the client right away
+        sent = waitForQueueSpace(encodedReports, size);
+    }
+
+    if (!sent && drainingDone_)
+    {
+        // this queue is being freed, there is no one to report to anymore
+        return false;
+    }
+
     if (!sent)
     {
         log_error("Could not send data to shared queue from TID(%lld)", thread_tid(current_thread()));
@@ -300,38 +366,67 @@ bool ConcurrentSharedDataQueue::sendReport(const AccessReport &report)
     }
     else
     {
-        reportCounters_->totalNumSent++;
+        reportCounters_->totalNumSent += count;
+        reportCounters_->numSentEntries++;
+        reportCounters_->numBytesSent += size;
     }
 
     return sent;
 }
 
-bool ConcurrentSharedDataQueue::enqueueWithBatching(const EnqueueArgs &args)
+void ConcurrentSharedDataQueue::addToBatch(const AccessReport &report, SandboxedPip *pip)
 {
-    LFDS711_MISC_MAKE_VALID_ON_CURRENT_LOGICAL_CORE_INITS_COMPLETED_BEFORE_NOW_ON_ANY_OTHER_LOGICAL_CORE;
+    uint32_t size = EncodedAccessReportSize(AccessReportPayloadSize(report));
+    if (batchSize_ + size > sizeof(batch_))
+    {
+        flushBatch();
+    }
 
-    QueueElem *elem = allocateElem(args);
-    if (elem == nullptr)
+    if (pip != nullptr)
     {
-        return false;
+        pip->Counters()->reportCounters.numBytesSent += size;
     }
 
-    lfds711_queue_umm_enqueue(pendingReports_, elem);
-    reportCounters_->numQueued++;
+    if (batchCount_ == 0)
+    {
+        batchStartTime_ = mach_absolute_time();
+    }
 
-    return true;
+    batchSize_ += EncodeAccessReport(report, batch_ + batchSize_);
+    batchCount_++;
 }
 
-static uint s_backoffIntervalsMs[] = {1, 2, 4, 8, 16, 32, 64};
-static uint s_backoffIntervalsLen = sizeof(s_backoffIntervalsMs) / sizeof(s_backoffIntervalsMs[0]);
+void ConcurrentSharedDataQueue::flushBatch()
+{
+    if (batchCount_ > 0)
+    {
+        sendReports(batch_, batchSize_, batchCount_);
+        batchSize_ = 0;
+        batchCount_ = 0;
+    }
+}
 
-void ConcurrentSharedDataQueue::drainQueue()
+void ConcurrentSharedDataQueue::waitForReports(uint milliseconds)
 {
-    if (!enableBatching_)
+    assert_wait_timeout((event_t)&drainerWaiting_, THREAD_UNINT, milliseconds, kMillisecondScale);
+    drainerWaiting_ = true;
+    OSMemoryBarrier();
+
+    // A report added before 'drainerWaiting_' was set did not wake this thread up: look for one before blocking
+    long long count = 0;
+    lfds711_queue_umm_query(pendingReports_, LFDS711_QUEUE_UMM_QUERY_SINGLETHREADED_GET_COUNT, NULL, &count);
+    if (count > 0 || drainingDone_)
     {
-        return;
+        // Block anyway (the wait is already asserted), but only for as long as it takes to wake this thread up
+        thread_wakeup((event_t)&drainerWaiting_);
     }
 
+    thread_block(THREAD_CONTINUE_NULL);
+    drainerWaiting_ = false;
+}
+
+void ConcurrentSharedDataQueue::drainQueue()
+{
     LFDS711_MISC_MAKE_VALID_ON_CURRENT_LOGICAL_CORE_INITS_COMPLETED_BEFORE_NOW_ON_ANY_OTHER_LOGICAL_CORE;
 
     uint backoffCounter = 0;
@@ -340,8 +435,22 @@ void ConcurrentSharedDataQueue::drainQueue()
         QueueElem *elem;
         if (!lfds711_queue_umm_dequeue(pendingReports_, &elem) || elem == nullptr)
         {
+            // Nothing is pending: a batch that is not full yet waits for more reports, but not for longer than the flush interval
+            if (batchCount_ > 0)
+            {
+                if (mach_absolute_time() - batchStartTime_ >= batchFlushInterval_)
+                {
+                    flushBatch();
+                }
+                else
+                {
+                    IOSleep(/*milliseconds*/ s_backoffIntervalsMs[0]);
+                    continue;
+                }
+            }
+
             uint backoffIndex = backoffCounter < s_backoffIntervalsLen ? backoffCounter : s_backoffIntervalsLen - 1;
-            IOSleep(/*milliseconds*/ s_backoffIntervalsMs[backoffIndex]);
+            waitForReports(s_backoffIntervalsMs[backoffIndex]);
             ++backoffCounter;
             continue;
         }
@@ -350,19 +459,34 @@ void ConcurrentSharedDataQueue::drainQueue()
         reportCounters_->numQueued--;
         ElemPayload *payload = getValue(elem);
 
-        if (payload->cacheRecord == nullptr)
+        if (!enableBatching_)
+        {
+            // Without batching every report is its own entry, and reports are not coalesced
+            addToBatch(payload->report, payload->pip);
+            flushBatch();
+        }
+        else if (payload->cacheRecord == nullptr)
         {
-            sendReport(payload->report);
+            addToBatch(payload->report, payload->pip);
         }
         else if (payload->cacheRecord->HasStrongerRequestedAccess((RequestedAccess)payload->report.requestedAccess))
         {
             reportCounters_->numCoalescedReports++;
+            if (payload->pip)
+            {
+                payload->pip->Counters()->reportCounters.numCoalescedReports++;
+            }
         }
         else
         {
-            sendReport(payload->report);
+            addToBatch(payload->report, payload->pip);
         }
 
         releaseElem(elem);
     }
+
+    if (!unrecoverableFailureOccurred_)
+    {
+        flushBatch();
+    }
 }
@@ -12,6 +12,7 @@
 
 extern "C" {
 #include "liblfds711.h"
+#include "SandboxedPip.hpp"
 }
 
 typedef lfds711_queue_umm_state   Queue;
@@ -19,7 +20,13 @@ typedef lfds711_queue_umm_element QueueElem;
 typedef lfds711_freelist_state    FreeList;
 typedef lfds711_freelist_element  FreeListElem;
 
-#define MAX_DATA_SIZE sizeof(AccessReport)
+#define MAX_DATA_SIZE kReportQueueEntrySizeMax
+
+// How long (in nanoseconds) a report may wait in a batch that is not full before the batch is sent, when no more reports are pending
+#define kBatchFlushIntervalNs (1 * NSEC_PER_MSEC)
+
+// How long (in milliseconds) an entry waits for the client to make room in a full shared IO queue before giving up on the client
+#define kQueueFullTimeoutMs (10 * 1000)
 
 typedef struct{
     OSObject* userClient;
@@ -29,7 +36,16 @@ typedef struct{
 #define ConcurrentSharedDataQueue BXL_CLASS(ConcurrentSharedDataQueue)
 
 /*!
- * A straightforward wrapper around IOSharedDataQueue to provide a thread-safe way of enqueuing entries.
+ * A wrapper around IOSharedDataQueue to provide a thread-safe way of enqueuing entries.
+ *
+ * Listeners never touch the shared IO queue: they only push their reports into a lock-free queue, which a dedicated
+ * kernel thread drains into the shared IO queue.  That thread is the only writer of the shared IO queue, so no listener
+ * ever waits on another one (or on the client) to report an access.
+ *
+ * The lock-free queue grows on demand, which is what absorbs bursts: when the shared IO queue is full (the client is
+ * behind), the draining thread holds on to its entry and retries until the client makes room (see 'kQueueFullTimeoutMs'),
+ * meanwhile reports keep piling up in the lock-free queue.  Such a stall is signaled through the report counters (see
+ * 'ReportCounters::numStalledQueues'), which the resource manager uses to throttle the creation of new processes.
  */
 class ConcurrentSharedDataQueue : public OSObject
 {
@@ -50,6 +66,9 @@ public:
 
         /*! May be NULL */
         const CacheRecord *cacheRecord;
+
+        /*! May be NULL; retained until the report is drained so that coalesced reports are attributed to their pip */
+        SandboxedPip *pip;
     } EnqueueArgs;
 
     typedef struct {
@@ -57,6 +76,7 @@ public:
         FreeListElem freeListElem;
         AccessReport report;
         const CacheRecord *cacheRecord;
+        SandboxedPip *pip;
     } ElemPayload;
 
 private:
@@ -81,10 +101,10 @@ private:
     /*!
      * Whether or not batching is enabled.
      *
-     * When enabled, all reports are first added to a lock-free queue ('pendingReports_')
-     * and a dedicated thread is used to drain it.  Otherwise, reports are added directly
-     * to a shared IO queue ('queue_') (which is done in a critical section, since the
-     * shared IO queue is not thread-safe).
+     * Either way, all reports are first added to a lock-free queue ('pendingReports_') which
+     * 'consumerThread_' drains.  When enabled, the drained reports (minus the ones coalesced
+     * through their cache record) are packed into as few entries of the shared IO queue as
+     * possible.  Otherwise, every report is sent as its own entry, as soon as it is drained.
      */
     bool enableBatching_;
 
@@ -97,14 +117,12 @@ private:
     FreeList *freeList_;
 
     /*!
-     * A lock-free queue where reports are batched before being sent to the client.
-     * This is used only if batching is enabled (see 'enableBatching_').
+     * A lock-free queue where listeners add reports before 'consumerThread_' sends them to the client.
      */
     Queue *pendingReports_;
 
     /*!
-     * A dedicated thread for draining 'pendingReports_'.
-     * If batching is not enabled, this thread immediately finished without doing any work.
+     * A dedicated thread for draining 'pendingReports_' into 'queue_' (the only thread that writes to 'queue_').
      */
     Thread *consumerThread_;
 
@@ -113,11 +131,45 @@ private:
      */
     volatile bool drainingDone_;
 
+    /*!
+     * Set while 'consumerThread_' is waiting for reports, so that the listener that adds one wakes it up
+     * instead of leaving it to its backoff interval.
+     */
+    volatile bool drainerWaiting_;
+
+    /*!
+     * The encoded reports drained from 'pendingReports_' that have not been sent yet (used only by 'consumerThread_').
+     * They are sent in a single entry of the shared IO queue, which the client is notified about once.
+     */
+    char batch_[MAX_DATA_SIZE];
+
+    /*! The number of bytes of 'batch_' in use */
+    uint32_t batchSize_;
+
+    /*! The number of reports in 'batch_' */
+    uint batchCount_;
+
+    /*! When (in mach absolute time) the first report of 'batch_' was added to it */
+    uint64_t batchStartTime_;
+
+    /*! 'kBatchFlushIntervalNs' in mach absolute time units */
+    uint64_t batchFlushInterval_;
+
     void drainQueue();
 
+    /*! Blocks 'consumerThread_' until a report is added to 'pendingReports_' or 'milliseconds' elapse. */
+    void waitForReports(uint milliseconds);
+
+    /*! Adds a report of 'pip' (if known) to 'batch_', sending the batch first if the report does not fit in it. */
+    void addToBatch(const AccessReport &report, SandboxedPip *pip);
+
+    /*! Sends the reports in 'batch_' (if any) as one entry of the shared IO queue. */
+    void flushBatch();
+
     /*!
      * Indicates if an unrecoverable error has occured. This happens when the sandbox was not able to successfully
-     * enqueue an access report message. There is no logic to recover from this and mostly indicates that either a)
+     * enqueue an access report message, even after waiting 'kQueueFullTimeoutMs' for the client to make room for it.
+     * There is no logic to recover from this and mostly indicates that either a)
      * the report queue size is to small for the amount of transfered reports or b) the number of connections to the
      * sandbox kernel connection and with it the number of threads draining the report queues in user space are not
      * sufficient. After this occures, the extension has to be reloaded!
@@ -127,19 +179,18 @@ private:
     QueueElem* allocateElem(const EnqueueArgs &args);
     void releaseElem(QueueElem *elem);
 
-    /*! * Enqueues the data to a lock-free queue ('pendingReports_') without entering the critical section. */
-    bool enqueueWithBatching(const EnqueueArgs &args);
-
-    /*! Enters the critical section and then calls 'send' (which enqueues the data to the shared IO queue). */
-    bool enqueueWithLocking(const EnqueueArgs &args);
-
     /*!
-     * Enqueues the data to the shared IO queue.
+     * Enqueues the given number of encoded reports (at most 'MAX_DATA_SIZE' bytes) to the shared IO queue, as a single entry.
      *
-     * IMPORTANT: the IO queue is not thread-safe and this method does not ensure synchronization;
-     * ensuring proper synchronization is the responsibility of the callers.
+     * IMPORTANT: the IO queue is not thread-safe; this method must only be called from 'consumerThread_'.
+     */
+    bool sendReports(const char *encodedReports, uint32_t size, uint count);
+
+    /*!
+     * Retries enqueuing an entry to the full shared IO queue until the client makes room for it, this queue is freed, or
+     * 'kQueueFullTimeoutMs' elapse.  Must only be called from 'consumerThread_'.
      */
-    bool sendReport(const AccessReport &report);
+    bool waitForQueueSpace(const char *encodedReports, uint32_t size);
 
     /*!
      * Initializes this object, following the OSObject pattern.
@@ -156,7 +207,8 @@ public:
     void free() override;
 
     /*!
-     * Enters monitor then delegates to IOSharedDataQueue::enqueue.
+     * Adds the report to a lock-free queue ('pendingReports_') without entering the critical section
+     * and wakes up 'consumerThread_' if it is waiting for reports.
      */
     bool enqueueReport(const EnqueueArgs &args);
 
@@ -66,14 +66,14 @@ inline uint32_t ParseUint32(const BYTE *&cursor)
 const char *CheckValidUnixManifestTreeRoot(PCManifestRecord node)
 {
     // empty manifest is ok
-    if (node->BucketCount == 0)
+    if (node->GetBucketCount() == 0)
     {
         return nullptr;
     }
 
     // otherwise, there must be exactly one root node corresponding to the unix root sentinel '/'
     // (see UnixPathRootSentinel from HierarchicalNameTable.cs)
-    if (node->BucketCount != 1)
+    if (node->GetBucketCount() != 1)
     {
         return "Root manifest node is expected to have exactly one child (corresponding to the unix root sentinel: '/')";
     }
@@ -165,6 +165,25 @@ bool FileAccessManifestParseResult::init(const BYTE *payload, size_t payloadSize
     return !HasErrors();
 }
 
+bool FileAccessManifestParseResult::initBase(const BYTE *base, size_t baseSize)
+{
+    if (base == nullptr || baseSize < sizeof(ManifestRecord))
+    {
+        error_ = "The base manifest tree is empty";
+        return false;
+    }
+
+    PCManifestRecord baseRoot = Parse<PCManifestRecord>(base);
+    error_ = baseRoot->CheckValid();
+    if (HasErrors()) return false;
+
+    error_ = CheckValidUnixManifestTreeRoot(baseRoot);
+    if (HasErrors()) return false;
+
+    baseRoot_ = baseRoot;
+    return true;
+}
+
 // Debugging helper
 void FileAccessManifestParseResult::PrintManifestTree(PCManifestRecord node,
                                                       const int indent,
@@ -181,7 +200,7 @@ void FileAccessManifestParseResult::PrintManifestTree(PCManifestRecord node,
            node->GetConePolicy() & FileAccessPolicy_ReportAccess,
            node->GetNodePolicy() & FileAccessPolicy_ReportAccess);
 
-    for (int i = 0; i < node->BucketCount; i++)
+    for (int i = 0; i < node->GetBucketCount(); i++)
     {
         PCManifestRecord child = node->GetChildRecord(i);
         if (child == nullptr) continue;
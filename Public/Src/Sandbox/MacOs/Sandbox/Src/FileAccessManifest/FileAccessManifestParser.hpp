@@ -6,6 +6,13 @@
 
 #include "FileAccessHelpers.h"
 
+/*!
+ * Locates the sections of a file access manifest payload.  Parsing never copies or rebuilds anything: the payload
+ * produced by the managed side is position independent and already laid out for lookups (every manifest record carries
+ * the precomputed hash of its path segment and its children are laid out as a hash table), so 'init' only visits the
+ * fixed size header sections and records pointers into the payload, at a cost independent of the size of the manifest
+ * tree.  The payload can therefore be used in place and shared, e.g., mapped read-only by every process of a pip.
+ */
 struct FileAccessManifestParseResult
 {
 
@@ -21,7 +28,8 @@ private:
     PCManifestReport report_;
     PCManifestDllBlock dllBlock_;
     PCManifestSubstituteProcessExecutionShim shim_;
-    PCManifestRecord root_;
+    PCManifestRecord root_ = nullptr;
+    PCManifestRecord baseRoot_ = nullptr;
     const char *error_;
 
     template <class T> T Parse(const BYTE *&payload)
@@ -44,13 +52,24 @@ public:
 
     bool init(const BYTE *payload, size_t payloadSize);
 
+    /*!
+     * Overlays the manifest tree on the base tree 'base' (a serialized manifest tree shared by the pips of a build, see
+     * FileAccessManifest.ManifestTreeBase), which is used in place like the payload and must outlive this object.
+     */
+    bool initBase(const BYTE *base, size_t baseSize);
+
+    /*! Whether the manifest tree is a delta tree, which cannot be searched without the base tree it was written against */
+    inline bool IsOverlaid() const                      { return root_ != nullptr && root_->HasBaseLink(); }
+
     inline bool IsValid() const                         { return error_ == nullptr; }
     inline bool HasErrors() const                       { return !IsValid(); }
     inline const char* Error() const                    { return error_; }
     inline PCManifestRecord GetManifestRootNode() const { return root_; }
-    inline PCManifestRecord GetUnixRootNode() const     { return root_->BucketCount > 0 ? root_->GetChildRecord(0) : root_; }
+    inline PCManifestRecord GetUnixRootNode() const     { return root_->GetBucketCount() > 0 ? root_->GetChildRecord(0) : root_; }
+    inline PCManifestRecord GetBaseRootNode() const     { return baseRoot_; }
     inline PCManifestPipId GetPipId() const             { return pipId_; }
     inline FileAccessManifestFlag GetFamFlags() const   { return static_cast<FileAccessManifestFlag>(flags_->Flags); }
+    inline FileAccessManifestExtraFlag GetFamExtraFlags() const { return static_cast<FileAccessManifestExtraFlag>(extraFlags_->ExtraFlags); }
     inline bool AllowChildProcessesToBreakAway() const  { return manifestChildProcessesToBreakAwayFromJob_->Count > 0; }
     inline const char* GetReportsPath(int *length) const
     {
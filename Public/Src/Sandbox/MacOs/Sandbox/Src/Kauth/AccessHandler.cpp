@@ -2,16 +2,25 @@
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
 
 #include "AccessHandler.hpp"
+#include "AutoRelease.hpp"
 #include "OpNames.hpp"
 #include "Stopwatch.hpp"
 
 bool AccessHandler::TryInitializeWithTrackedProcess(pid_t pid)
 {
+    // the common case (a process of the machine no pip is running): not worth timing
+    if (!sandbox_->MayBeTrackedProcess(pid))
+    {
+        return false;
+    }
+
     Stopwatch stopwatch;
     SandboxedProcess *process = sandbox_->FindTrackedProcess(pid);
+    AutoRelease _(process);
     Timespan duration = stopwatch.lap();
 
     sandbox_->Counters()->findTrackedProcess += duration;
+    sandbox_->RecordLatency(kLatencyFindTrackedProcess, duration);
 
     if (process == nullptr || CheckDisableDetours(process->getPip()->getFamFlags()))
     {
@@ -99,6 +108,21 @@ bool AccessHandler::ReportProcessTreeCompleted()
         .stats     = { .creationTime = creationTimestamp_ }
     };
 
+    // The same counters in the schema shared by the sandboxes (see SandboxStats.h); what the kext allocates for a pip is its path cache
+    AllCounters *counters = GetPip()->Counters();
+    SandboxStats &stats = report.pipStats.sandboxStats;
+    stats = MakeSandboxStats();
+    stats.values[kSandboxStatCacheHits]        = counters->numCacheHits.count();
+    stats.values[kSandboxStatCacheMisses]      = counters->numCacheMisses.count();
+    stats.values[kSandboxStatReportsSent]      = counters->reportCounters.totalNumSent.count();
+    stats.values[kSandboxStatReportsCoalesced] = counters->reportCounters.numCoalescedReports.count();
+    stats.values[kSandboxStatBytesSent]        = counters->reportCounters.numBytesSent.count();
+    stats.values[kSandboxStatInterposerNs]     = counters->accessHandler.duration().nanos();
+    stats.values[kSandboxStatAllocatedBytes]   =
+        (uint64_t)report.pipStats.cacheRecordCount * report.pipStats.cacheRecordSize +
+        (uint64_t)report.pipStats.cacheNodeCount * report.pipStats.cacheNodeSize;
+    stats.values[kSandboxStatQueueHighWater]   = counters->reportCounters.maxQueued.count();
+
     return sandbox_->SendAccessReport(report, GetPip(), /*cacheRecord*/ nullptr);
 }
 
@@ -150,12 +174,20 @@ void AccessHandler::LogAccessDenied(const char *path,
         proc_selfpid(), GetPipId(), path, action, errorMessage);
 }
 
-PolicyResult AccessHandler::PolicyForPath(const char *absolutePath)
+PolicyResult AccessHandler::PolicyForPath(const char *absolutePath, CacheRecord *cacheRecord)
 {
-    PolicySearchCursor cursor = FindManifestRecord(absolutePath);
-    if (!cursor.IsValid())
+    PolicySearchCursor cursor;
+    if (cacheRecord == nullptr || !cacheRecord->TryGetPolicyCursor(&cursor))
     {
-        log_error("Invalid policy cursor for path '%s'", absolutePath);
+        cursor = FindManifestRecord(absolutePath);
+        if (!cursor.IsValid())
+        {
+            log_error("Invalid policy cursor for path '%s'", absolutePath);
+        }
+        else if (cacheRecord != nullptr)
+        {
+            cacheRecord->SetPolicyCursor(cursor);
+        }
     }
 
     return PolicyResult(GetPip()->getFamFlags(), absolutePath, cursor);
@@ -239,19 +271,19 @@ bool AccessHandler::CheckAccess(vnode_t vp,
                                 vfs_context_t ctx,
                                 CheckFunc checker,
                                 PolicyResult *policy,
-                                AccessCheckResult *result)
+                                AccessCheckResult *result,
+                                char *lastLookupPath)
 {
     bool isDir = vnode_isdir(vp);
     checker(*policy, isDir, result);
 
     bool notAllowed = result->GetFileAccessStatus() != FileAccessStatus_Allowed;
-    const char *lastLookupPath;
     // special handling for denied accesses to files with multiple hard links
     if (
-        notAllowed &&                                               // access is denied for current policy
-        (lastLookupPath = GetPip()->getLastLookedUpPath()) &&       // we remembered a path that was last looked up
-        strncmp(lastLookupPath, policy->Path(), MAXPATHLEN) != 0 && // that path is different from the policy path
-        VNodeMatchesPath(vp, ctx, lastLookupPath))                  // both paths point to the same vnode
+        notAllowed &&                                                   // access is denied for current policy
+        GetPip()->getLastLookedUpPath(lastLookupPath, MAXPATHLEN) &&    // we remembered a path that was last looked up
+        strncmp(lastLookupPath, policy->Path(), MAXPATHLEN) != 0 &&     // that path is different from the policy path
+        VNodeMatchesPath(vp, ctx, lastLookupPath))                      // both paths point to the same vnode
     {
         // update policy and check again
         sandbox_->Counters()->numHardLinkRetries++;
@@ -275,12 +307,28 @@ AccessCheckResult AccessHandler::CheckAndReportInternal(FileOperation operation,
 {    
     Stopwatch stopwatch;
 
+    // 0: the record of the path in the cache of the pip, which also memoizes its policy search (see 'CacheRecord::TryGetPolicyCursor');
+    //    a path whose lookup has already been checked needs no policy search at all (see 'CacheRecord::CheckAndMarkLookup')
+    CacheRecord *cacheRecord = GetPip()->cacheLookup(path);
+    AutoRelease releaseCacheRecord(cacheRecord);
+    if (operation == kOpMacLookup && cacheRecord != nullptr && cacheRecord->CheckAndMarkLookup())
+    {
+        Timespan lookupCacheDuration       = stopwatch.lap();
+        sandbox_->Counters()->cacheLookup += lookupCacheDuration;
+        GetPip()->Counters()->cacheLookup += lookupCacheDuration;
+        sandbox_->RecordLatency(kLatencyCacheLookup, lookupCacheDuration);
+        GetPip()->Counters()->numCacheHits++;
+        return AccessCheckResult(RequestedAccess::Lookup, ResultAction::Allow, ReportLevel::Ignore);
+    }
+
     // 1: check operation against given policy
-    PolicyResult policy = PolicyForPath(IgnoreCatalinaDataPartitionPrefix(path));
+    // the policy may end up pointing into 'lastLookupPath' (see 'CheckAccess')
+    char lastLookupPath[MAXPATHLEN];
+    PolicyResult policy = PolicyForPath(IgnoreCatalinaDataPartitionPrefix(path), cacheRecord);
     AccessCheckResult result = AccessCheckResult::Invalid();
     if (vp != nullptr && ctx != nullptr)
     {
-        CheckAccess(vp, ctx, checker, &policy, &result);
+        CheckAccess(vp, ctx, checker, &policy, &result, lastLookupPath);
     }
     else
     {
@@ -290,6 +338,7 @@ AccessCheckResult AccessHandler::CheckAndReportInternal(FileOperation operation,
     Timespan checkPolicyDuration       = stopwatch.lap();
     GetPip()->Counters()->checkPolicy += checkPolicyDuration;
     sandbox_->Counters()->checkPolicy += checkPolicyDuration;
+    sandbox_->RecordLatency(kLatencyCheckPolicy, checkPolicyDuration);
     
     // 2: skip if this access should not be reported
     if (!result.ShouldReport())
@@ -298,12 +347,12 @@ AccessCheckResult AccessHandler::CheckAndReportInternal(FileOperation operation,
     }
 
     // 3: check cache to see if the same access has already been reported
-    CacheRecord *cacheRecord = GetPip()->cacheLookup(path);
     bool cacheHit = cacheRecord != nullptr && cacheRecord->CheckAndUpdate(&result);
 
     Timespan cacheLookupDuration       = stopwatch.lap();
     sandbox_->Counters()->cacheLookup += cacheLookupDuration;
     GetPip()->Counters()->cacheLookup += cacheLookupDuration;
+    sandbox_->RecordLatency(kLatencyCacheLookup, cacheLookupDuration);
 
     if (!cacheHit)
     {
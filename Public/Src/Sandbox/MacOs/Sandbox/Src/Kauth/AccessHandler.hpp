@@ -30,6 +30,9 @@ private:
 
     uint64_t creationTimestamp_;
 
+    /*! The histogram to which the lifetime of this handler is added (i.e., the listener scope this handler serves) */
+    LatencyKind scopeLatencyKind_;
+
     ReportResult ReportFileOpAccess(FileOperation operation,
                                     PolicyResult policy,
                                     AccessCheckResult accessCheckResult,
@@ -83,9 +86,12 @@ protected:
      * @param checker Checker function to apply to policy
      * @param policy Current policy; can be MUTATED by this method if the first check fails
      * @param result Where the result is stored
+     * @param lastLookupPath Buffer of MAXPATHLEN chars into which the last looked up path is copied; when the policy
+     *                       is updated, it points into this buffer, so the buffer must outlive the policy
      * @result Indicates whether the policy was updated with a new path
      */
-    bool CheckAccess(vnode_t vp, vfs_context_t ctx, CheckFunc checker, PolicyResult *policy, AccessCheckResult *result);
+    bool CheckAccess(vnode_t vp, vfs_context_t ctx, CheckFunc checker, PolicyResult *policy, AccessCheckResult *result,
+                     char *lastLookupPath);
 
     /*!
      * Template for checking and reporting file accesses.
@@ -128,9 +134,10 @@ protected:
 
 public:
 
-    AccessHandler(BuildXLSandbox *sandbox)
+    AccessHandler(BuildXLSandbox *sandbox, LatencyKind scopeLatencyKind)
     {
         creationTimestamp_ = mach_absolute_time();
+        scopeLatencyKind_  = scopeLatencyKind;
         sandbox_           = sandbox;
         process_           = nullptr;
     }
@@ -139,7 +146,11 @@ public:
     {
         Timespan duration = Timespan::fromNanoseconds(mach_absolute_time() - creationTimestamp_);
         if (process_) GetPip()->Counters()->accessHandler += duration;
-        if (sandbox_) sandbox_->Counters()->accessHandler += duration;
+        if (sandbox_)
+        {
+            sandbox_->Counters()->accessHandler += duration;
+            sandbox_->RecordLatency(scopeLatencyKind_, duration);
+        }
         OSSafeReleaseNULL(process_);
     }
 
@@ -162,7 +173,8 @@ public:
     inline int GetProcessTreeSize()             const { return GetPip()->getTreeSize(); }
     inline FileAccessManifestFlag GetFamFlags() const { return GetPip()->getFamFlags(); }
 
-    PolicyResult PolicyForPath(const char *absolutePath);
+    /*! The policy of 'absolutePath'; when given the cache record of the path, the search is memoized in (or taken from) it. */
+    PolicyResult PolicyForPath(const char *absolutePath, CacheRecord *cacheRecord = nullptr);
 
     bool ReportProcessTreeCompleted();
     bool ReportProcessExited(pid_t childPid);
@@ -11,7 +11,7 @@ class FileOpHandler : public AccessHandler
 public:
 
     FileOpHandler(BuildXLSandbox *sandbox) :
-        AccessHandler(sandbox) { }
+        AccessHandler(sandbox, kLatencyFileOpScope) { }
 
     int HandleFileOpEvent(const kauth_cred_t credential,
                           const void *idata,
@@ -6,13 +6,22 @@
 
 int TrustedBsdHandler::HandleLookup(const char *path)
 {
+    // A thread that looks up the path it just looked up (e.g., 'stat' followed by 'open', or namei retrying a lookup)
+    // has nothing to save, and its lookup has already been checked and reported: skip it altogether
+    if (GetPip()->isLastLookedUpPath(path))
+    {
+        GetPip()->Counters()->numCacheHits++;
+        return KERN_SUCCESS;
+    }
+
     // set last looked up path
     Stopwatch stopwatch;
-    GetPip()->setLastLookedUpPath(path);
+    GetPip()->setLastLookedUpPath(proc_selfpid(), path);
 
     Timespan duration = stopwatch.lap();
     GetSandbox()->Counters()->setLastLookedUpPath += duration;
     GetPip()->Counters()->setLastLookedUpPath += duration;
+    GetSandbox()->RecordLatency(kLatencySetLastLookedUpPath, duration);
 
     // Check, report, but never deny lookups
     CheckAndReport(kOpMacLookup, path, Checkers::CheckLookup, /*isDir*/ false);
@@ -24,7 +33,7 @@ int TrustedBsdHandler::HandleReadVnode(vnode_t vnode, FileOperation operationToR
     // get symlink path
     char path[MAXPATHLEN];
     int len = MAXPATHLEN;
-    int err = vn_getpath(vnode, path, &len);
+    int err = GetSandbox()->GetVnodePath(vnode, path, &len);
     if (err)
     {
         log_error("Could not get VNnode path for %d operation; error code: %#X", operationToReport, err);
@@ -72,7 +81,7 @@ int TrustedBsdHandler::HandleVnodeWrite(vnode_t vnode, FileOperation operation)
 {
     char path[MAXPATHLEN];
     int len = MAXPATHLEN;
-    int err = vn_getpath(vnode, path, &len);
+    int err = GetSandbox()->GetVnodePath(vnode, path, &len);
     if (err)
     {
         log_error("Could not get VNnode path for write operation; error code: %#X", err);
@@ -105,7 +114,7 @@ void TrustedBsdHandler::HandleProcessWantsToFork(const pid_t parentProcessPid)
     // TODO: this should be configurable via FAM
     if (parentProcessPid == GetProcessId())
     {
-        GetSandbox()->ResourceManger()->WaitForCpu();
+        GetSandbox()->ResourceManger()->WaitForCpu(GetPip()->getAdmissionBucket(), GetPip()->getCreationTime());
     }
 }
 
@@ -128,7 +137,7 @@ void TrustedBsdHandler::HandleProcessExec(const vnode_t vp)
 {
     // get the full path to 'vp' and save it to process->processName_
     int len = MAXPATHLEN;
-    vn_getpath(vp, GetProcess()->getPathBuffer(), &len);
+    GetSandbox()->GetVnodePath(vp, GetProcess()->getPathBuffer(), &len);
 
     // report child process to clients only (tracking happens on 'fork's not 'exec's)
     ReportChildProcessSpawned(GetProcess()->getPid());
@@ -137,6 +146,7 @@ void TrustedBsdHandler::HandleProcessExec(const vnode_t vp)
 void TrustedBsdHandler::HandleProcessExit(const pid_t pid)
 {
     ReportProcessExited(pid);
+    GetPip()->clearLastLookedUpPaths(pid);
     HandleProcessUntracked(pid);
 }
 
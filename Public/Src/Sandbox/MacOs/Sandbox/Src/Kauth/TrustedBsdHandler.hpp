@@ -11,7 +11,7 @@ class TrustedBsdHandler : public AccessHandler
 public:
 
     TrustedBsdHandler(BuildXLSandbox *sandbox)
-        : AccessHandler(sandbox) { }
+        : AccessHandler(sandbox, kLatencyTrustedBsdScope) { }
 
     int HandleLookup(const char *path);
 
@@ -163,7 +163,7 @@ int VNodeHandler::HandleVNodeEvent(const kauth_cred_t credential,
     int len = MAXPATHLEN;
     char path[MAXPATHLEN] = {0};
 
-    int errno = vn_getpath(vp, path, &len);
+    int errno = GetSandbox()->GetVnodePath(vp, path, &len);
     if (errno != 0)
     {
         return KAUTH_RESULT_DEFER;
@@ -27,7 +27,7 @@ class VNodeHandler : public AccessHandler
 {
 public:
 
-    VNodeHandler(BuildXLSandbox *sandbox) : AccessHandler(sandbox) { }
+    VNodeHandler(BuildXLSandbox *sandbox) : AccessHandler(sandbox, kLatencyVnodeScope) { }
 
     int HandleVNodeEvent(const kauth_cred_t credential,
                          const void *idata,
@@ -16,8 +16,9 @@ int RELEVANT_KAUTH_VNODE_BITS =
 
 void *Listeners::g_dispatcher = nullptr;
 
-static int ComputeAbsolutePath(struct vnode *vp, const char *const relPath, size_t relPathLen, char *resultBuf, int resultBufLen)
+static int ComputeAbsolutePath(BuildXLSandbox *sandbox, struct vnode *vp, const char *const relPath, size_t relPathLen, char *resultBuf, int resultBufLen)
 {
+    assert(sandbox != nullptr);
     assert(vp != nullptr);
     assert(relPath != nullptr);
     assert(relPathLen >= 0);
@@ -27,7 +28,7 @@ static int ComputeAbsolutePath(struct vnode *vp, const char *const relPath, size
     // compute full path by getting the absolute path of 'vp' and appending the relative path 'relPath'
     int len = resultBufLen;
     int err = 0;
-    if ((err = vn_getpath(vp, resultBuf, &len)) != 0)
+    if ((err = sandbox->GetVnodePath(vp, resultBuf, &len)) != 0)
     {
         return err;
     }
@@ -66,6 +67,12 @@ int Listeners::buildxl_file_op_listener(kauth_cred_t credential,
 {
     BuildXLSandbox *sandbox = OSDynamicCast(BuildXLSandbox, reinterpret_cast<OSObject *>(idata));
 
+    // renames (done by any process) change the paths of existing vnodes
+    if (action == KAUTH_FILEOP_RENAME || action == KAUTH_FILEOP_EXCHANGE)
+    {
+        sandbox->InvalidateVnodePaths();
+    }
+
     FileOpHandler fileOpHandler = FileOpHandler(sandbox);
     if (!fileOpHandler.TryInitializeWithTrackedProcess(proc_selfpid()))
     {
@@ -128,7 +135,7 @@ int Listeners::mpo_vnode_check_lookup_pre(kauth_cred_t cred,
 
         size_t pathlen = strnlen(path, MAXPATHLEN);
         char fullpath[MAXPATHLEN] = {0};
-        int errorCode = ComputeAbsolutePath(dvp, path, pathlen, fullpath, sizeof(fullpath));
+        int errorCode = ComputeAbsolutePath((BuildXLSandbox*)g_dispatcher, dvp, path, pathlen, fullpath, sizeof(fullpath));
         if (errorCode != 0)
         {
             log_error("Could not get vnode path, error code: %#X", errorCode);
@@ -245,7 +252,7 @@ int Listeners::mpo_vnode_check_create(kauth_cred_t cred,
     {
         // compute full path by getting the absolute path of 'dvp' and appending the component name provided by 'cnp'
         char path[MAXPATHLEN] = {0};
-        ComputeAbsolutePath(dvp, cnp->cn_nameptr, cnp->cn_namelen, path, sizeof(path));
+        ComputeAbsolutePath((BuildXLSandbox*)g_dispatcher, dvp, cnp->cn_nameptr, cnp->cn_namelen, path, sizeof(path));
         bool isDir = vap->va_type == VDIR;
         bool isSymlink = vap->va_type == VLNK;
         return handler.HandleVNodeCreateEvent(path, isDir, isSymlink);
@@ -284,7 +291,7 @@ int Listeners::mpo_vnode_check_clone(kauth_cred_t cred,
 
     int len = MAXPATHLEN;
     char sourcePath[MAXPATHLEN];
-    int err = vn_getpath(vp, sourcePath, &len);
+    int err = ((BuildXLSandbox*)g_dispatcher)->GetVnodePath(vp, sourcePath, &len);
     if (err != 0)
     {
         log_error("Could not obtain vnode path inside vnode_check_clone; error: %d", err);
@@ -298,7 +305,7 @@ int Listeners::mpo_vnode_check_clone(kauth_cred_t cred,
     }
 
     char destPath[MAXPATHLEN];
-    err = ComputeAbsolutePath(dvp, cnp->cn_nameptr, cnp->cn_namelen, destPath, MAXPATHLEN);
+    err = ComputeAbsolutePath((BuildXLSandbox*)g_dispatcher, dvp, cnp->cn_nameptr, cnp->cn_namelen, destPath, MAXPATHLEN);
     if (err != 0)
     {
         log_error("Could not compute absolute path inside vnode_check_clone; error: %d", err);
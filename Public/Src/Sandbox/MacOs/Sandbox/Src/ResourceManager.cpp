@@ -7,12 +7,21 @@
 
 OSDefineMetaClassAndStructors(ResourceManager, OSObject)
 
-ResourceManager* ResourceManager::create(ResourceCounters *counters)
+// Throttling due to low RAM is released only once available RAM is this much (in percent) above the minimum
+static const uint kRamHysteresisPercent = 10;
+
+// Max number of tokens a pip can accumulate in its admission bucket
+static const uint kAdmissionBucketCapacity = 2;
+
+// A pip earns one admission token per this many nanoseconds
+static const uint64_t kAdmissionTokenIntervalNs = 1000ull * 1000 * 1000;
+
+ResourceManager* ResourceManager::create(ResourceCounters *counters, const ReportCounters *reportCounters)
 {
     ResourceManager *instance = new ResourceManager;
     if (instance != nullptr)
     {
-        if (!instance->init(counters))
+        if (!instance->init(counters, reportCounters))
         {
             OSSafeReleaseNULL(instance);
         }
@@ -21,7 +30,7 @@ ResourceManager* ResourceManager::create(ResourceCounters *counters)
     return instance;
 }
 
-bool ResourceManager::init(ResourceCounters *counters)
+bool ResourceManager::init(ResourceCounters *counters, const ReportCounters *reportCounters)
 {
     if (!super::init())
     {
@@ -35,7 +44,11 @@ bool ResourceManager::init(ResourceCounters *counters)
         .minAvailableRamMB = 0,
     };
 
-    counters_ = counters;
+    counters_       = counters;
+    reportCounters_ = reportCounters;
+    waiters_        = nullptr;
+    cpuThrottled_   = false;
+    ramThrottled_   = false;
 
     procBarrier_ = BXLLockAlloc();
     if (procBarrier_ == nullptr)
@@ -50,7 +63,15 @@ void ResourceManager::free()
 {
     if (procBarrier_ != nullptr)
     {
-        BXLLockWakeup(procBarrier_, this, /*oneThread*/ false);
+        BXLLockLock(procBarrier_);
+        while (waiters_ != nullptr)
+        {
+            Waiter *waiter = waiters_;
+            waiters_ = waiter->next;
+            waiter->admitted = true;
+            BXLLockWakeup(procBarrier_, waiter, /*oneThread*/ true);
+        }
+        BXLLockUnlock(procBarrier_);
         BXLLockFree(procBarrier_);
         procBarrier_ = nullptr;
     }
@@ -73,11 +94,67 @@ static bool shouldThrottle(basis_points value, percent threshold)
     return isThresholdValid(threshold) && !isBelowThreshold(value, threshold);
 }
 
-inline bool ResourceManager::shouldThrottleProcesses() const
+AdmissionBucket ResourceManager::CreateAdmissionBucket()
 {
     return
-        counters_->availableRamMB < thresholds_.minAvailableRamMB ||
-        shouldThrottle(counters_->cpuUsage, thresholds_.cpuUsageBlock);
+    {
+        .tokens         = 0,
+        .lastRefillTime = mach_absolute_time(),
+    };
+}
+
+static bool takeToken(AdmissionBucket *bucket)
+{
+    uint64_t tokenInterval;
+    nanoseconds_to_absolutetime(kAdmissionTokenIntervalNs, &tokenInterval);
+
+    uint64_t now = mach_absolute_time();
+    uint64_t earned = (now - bucket->lastRefillTime) / tokenInterval;
+    if (earned > 0)
+    {
+        bucket->tokens = earned >= kAdmissionBucketCapacity - bucket->tokens
+            ? kAdmissionBucketCapacity
+            : bucket->tokens + (uint)earned;
+        bucket->lastRefillTime += earned * tokenInterval;
+    }
+
+    if (bucket->tokens == 0)
+    {
+        return false;
+    }
+
+    bucket->tokens--;
+    return true;
+}
+
+void ResourceManager::updateThrottlingState()
+{
+    uint availableRamMB = counters_->availableRamMB;
+    uint minRamMB = thresholds_.minAvailableRamMB;
+    ramThrottled_ = ramThrottled_
+        ? availableRamMB < minRamMB + (minRamMB * kRamHysteresisPercent) / 100
+        : availableRamMB < minRamMB;
+
+    basis_points cpuUsage = counters_->cpuUsage;
+    cpuThrottled_ = cpuThrottled_
+        ? !isBelowThreshold(cpuUsage, thresholds_.GetCpuUsageForWakeup())
+        : shouldThrottle(cpuUsage, thresholds_.cpuUsageBlock);
+}
+
+bool ResourceManager::tryAdmit(AdmissionBucket *bucket, bool isHeadOfQueue)
+{
+    if (ramThrottled_ || reportCounters_->numStalledQueues > 0)
+    {
+        return false;
+    }
+
+    if (cpuThrottled_)
+    {
+        return takeToken(bucket);
+    }
+
+    // don't let a newly arriving process jump ahead of the already blocked ones
+    return isHeadOfQueue || waiters_ == nullptr;
 }
 
 inline bool ResourceManager::IsProcessThrottlingEnabled() const
@@ -93,7 +170,7 @@ void ResourceManager::UpdateNumTrackedProcesses(uint newCount)
     OSCompareAndSwap(oldCount, newCount, &counters_->numTrackedProcesses);
     if (newCount < oldCount)
     {
-        wakeupBlockedProcesses(/* justOne */ newCount == oldCount - 1);
+        wakeupBlockedProcesses(/* maxCount */ oldCount - newCount);
     }
 }
 
@@ -101,10 +178,7 @@ void ResourceManager::UpdateCpuUsage(basis_points cpuUsage)
 {
     basis_points oldCpuUsage = counters_->cpuUsage;
     OSCompareAndSwap(oldCpuUsage.value, cpuUsage.value, &counters_->cpuUsage.value);
-    if (isBelowThreshold(cpuUsage, thresholds_.GetCpuUsageForWakeup()))
-    {
-        wakeupBlockedProcesses(/* justOne */ true);
-    }
+    wakeupBlockedProcesses(/* maxCount */ 1);
 }
 
 void ResourceManager::UpdateAvailableRam(uint availableRamMB)
@@ -113,34 +187,74 @@ void ResourceManager::UpdateAvailableRam(uint availableRamMB)
     OSCompareAndSwap(oldRam, availableRamMB, &counters_->availableRamMB);
     if (availableRamMB > oldRam)
     {
-        wakeupBlockedProcesses(/* justOne */ true);
+        wakeupBlockedProcesses(/* maxCount */ 1);
     }
 }
 
-void ResourceManager::WaitForCpu()
+void ResourceManager::WaitForCpu(AdmissionBucket *bucket, uint64_t priority)
 {
     if (!IsProcessThrottlingEnabled())
     {
         return;
     }
-    
-    if (shouldThrottleProcesses())
+
+    BXLLockLock(procBarrier_);
+    updateThrottlingState();
+    if (!tryAdmit(bucket, /* isHeadOfQueue */ false))
     {
-        BXLLockLock(procBarrier_);
-        while (shouldThrottleProcesses())
+        Waiter self =
+        {
+            .priority = priority,
+            .bucket   = bucket,
+            .admitted = false,
+            .next     = nullptr,
+        };
+
+        // insert after all waiters with the same or better priority
+        Waiter **link = &waiters_;
+        while (*link != nullptr && (*link)->priority <= priority)
         {
-            OSIncrementAtomic(&counters_->numBlockedProcesses);
-            BXLLockSleep(procBarrier_, this, THREAD_INTERRUPTIBLE);
-            OSDecrementAtomic(&counters_->numBlockedProcesses);
+            link = &(*link)->next;
         }
-        BXLLockUnlock(procBarrier_);
+
+        self.next = *link;
+        *link = &self;
+
+        OSIncrementAtomic(&counters_->numBlockedProcesses);
+        while (!self.admitted)
+        {
+            BXLLockSleep(procBarrier_, &self, THREAD_INTERRUPTIBLE);
+        }
+        OSDecrementAtomic(&counters_->numBlockedProcesses);
     }
+    BXLLockUnlock(procBarrier_);
 }
 
-void ResourceManager::wakeupBlockedProcesses(bool justOne)
+void ResourceManager::wakeupBlockedProcesses(uint maxCount)
 {
-    if (procBarrier_ != nullptr && counters_->numBlockedProcesses > 0 && !shouldThrottleProcesses())
+    if (procBarrier_ == nullptr || counters_->numBlockedProcesses == 0)
     {
-        BXLLockWakeup(procBarrier_, this, justOne);
+        return;
+    }
+
+    BXLLockLock(procBarrier_);
+    updateThrottlingState();
+    Waiter **link = &waiters_;
+    while (*link != nullptr && maxCount > 0 && !ramThrottled_)
+    {
+        Waiter *waiter = *link;
+        if (tryAdmit(waiter->bucket, /* isHeadOfQueue */ link == &waiters_))
+        {
+            *link = waiter->next;
+            waiter->admitted = true;
+            BXLLockWakeup(procBarrier_, waiter, /*oneThread*/ true);
+            maxCount--;
+        }
+        else
+        {
+            // CPU is saturated: skip over waiters whose pips have no tokens left
+            link = &waiter->next;
+        }
     }
+    BXLLockUnlock(procBarrier_);
 }
@@ -11,6 +11,16 @@
 
 #define ResourceManager BXL_CLASS(ResourceManager)
 
+/*!
+ * Per-pip token bucket used by 'ResourceManager' to let a pip keep making progress while the CPU is saturated.
+ *
+ * NOTE: only ever accessed while holding the lock of the resource manager.
+ */
+typedef struct {
+    uint tokens;
+    uint64_t lastRefillTime;
+} AdmissionBucket;
+
 /*!
  * This class is where resource usage information is collected and where all the decisions are made
  * regarding any throttling due to insufficient available resources.
@@ -18,6 +28,18 @@
  * This class relies on being externally notified whenever
  *   - number of tracked processes changed (see 'UpdateNumTrackedProcesses')
  *   - CPU/RAM usage changed (see 'Update{Cpu|Ram}Usage')
+ *
+ * Throttling is engaged when CPU usage reaches the blocking threshold or available RAM drops below the minimum,
+ * and is released only once CPU usage falls below the wakeup threshold and available RAM recovers to a margin
+ * above the minimum (so that it doesn't oscillate around a single value).
+ *
+ * Blocked processes are admitted in priority order (processes of older pips first).  While only the CPU is
+ * saturated, a pip may still be admitted by spending a token from its 'AdmissionBucket'; tokens are earned at
+ * a fixed rate, so long running pips are not starved by a steady stream of new ones.  Low RAM is never bypassed.
+ *
+ * Neither is a client falling behind on its reports: while some report queue is stalled on a full shared queue (see
+ * 'ReportCounters::numStalledQueues'), no process is admitted, so that a burst of new processes doesn't add to a backlog
+ * of reports the client may not be able to catch up with.  Blocked processes are re-evaluated on every CPU update.
  */
 class ResourceManager : public OSObject
 {
@@ -25,9 +47,25 @@ private:
 
     OSDeclareDefaultStructors(ResourceManager)
 
+    /*! A blocked process, linked into the 'waiters_' list (which is sorted by 'priority'). */
+    struct Waiter
+    {
+        uint64_t priority;
+        AdmissionBucket *bucket;
+        bool admitted;
+        Waiter *next;
+    };
+
     BXLLock *procBarrier_;
     ResourceThresholds thresholds_;
 
+    /*! Blocked processes, in the order in which they should be admitted.  Guarded by 'procBarrier_'. */
+    Waiter *waiters_;
+
+    /*! Current throttling state (with hysteresis applied).  Guarded by 'procBarrier_'. */
+    bool cpuThrottled_;
+    bool ramThrottled_;
+
     /*!
      * Shared counters (with all other clients) for counting the number of active/pending/blocked processes.
      *
@@ -35,24 +73,31 @@ private:
      */
     ResourceCounters *counters_;
 
+    /*! Shared report counters, only read (see 'ReportCounters::numStalledQueues') */
+    const ReportCounters *reportCounters_;
+
     /*!
-     * Wakes up one or more blocked processes if the throttling condition
-     * (see 'shouldThrottleProcesses') is not met any longer.
-     *
-     * @param justOne Whether to wake up one or all blocked processes.
+     * Admits (and wakes up) up to 'maxCount' blocked processes, in priority order, for which 'tryAdmit' succeeds.
+     */
+    void wakeupBlockedProcesses(uint maxCount);
+
+    /*!
+     * Re-evaluates 'cpuThrottled_' and 'ramThrottled_' against the current counters, applying hysteresis.
+     * Must be called while holding 'procBarrier_'.
      */
-    void wakeupBlockedProcesses(bool justOne);
+    void updateThrottlingState();
 
     /*!
-     * Returns whether the condition for throttling processes is met, which is:
-     *   - current CPU usage is greater or equal than the cpu usage threshold, AND
-     *   - current number of tracked processes is greater or equal than the tracked processes threshold.
+     * Returns whether a process whose pip owns 'bucket' may be admitted right now, which is when:
+     *   - RAM is not throttled and no report queue is stalled, AND
+     *   - CPU is not throttled and no other process is queued ahead of it, OR a token was taken from 'bucket'.
+     * Must be called while holding 'procBarrier_'.
      */
-    bool shouldThrottleProcesses() const;
+    bool tryAdmit(AdmissionBucket *bucket, bool isHeadOfQueue);
 
 protected:
 
-    bool init(ResourceCounters *counters);
+    bool init(ResourceCounters *counters, const ReportCounters *reportCounters);
     void free() override;
 
 public:
@@ -88,19 +133,29 @@ public:
     void UpdateAvailableRam(uint availableRamMB);
 
     /*!
-     * Blocks the current thread if 'IsProcessThrottlingEnabled()' and 'ShouldThrottleProcesses()' are both true.
+     * Returns a bucket to be used by a newly created pip.  The bucket starts out empty so that new pips
+     * don't get to bypass throttling before they've been running for a while.
+     */
+    static AdmissionBucket CreateAdmissionBucket();
+
+    /*!
+     * Blocks the current thread if 'IsProcessThrottlingEnabled()' is true and the process may not be admitted
+     * right now (see class description).
+     *
+     * The blocked thread will be awakened once it's admitted.
      *
-     * The blocked thread will be awakened whenever that condition changes.
+     * @param bucket   Admission bucket of the pip on whose behalf the current thread wants to create a process.
+     * @param priority Admission priority (blocked processes with lower values are admitted first).
      *
      * NOTE: should not be called from an interrupt routine, or everything will grind to a halt.
      */
-    void WaitForCpu();
+    void WaitForCpu(AdmissionBucket *bucket, uint64_t priority);
 
     /*!
      * Factory method.
      * @return New instance or NULL.
      */
-    static ResourceManager* create(ResourceCounters *counters);
+    static ResourceManager* create(ResourceCounters *counters, const ReportCounters *reportCounters);
 };
 
 #endif /* ResourceManager_hpp */
@@ -18,6 +18,8 @@ bool SandboxedPip::init(pid_t clientPid, pid_t processPid, Buffer *payload)
     payload_          = payload;
     processId_        = processPid;
     processTreeCount_ = 1;
+    creationTime_     = mach_absolute_time();
+    admissionBucket_  = ResourceManager::CreateAdmissionBucket();
     counters_         = {0};
     disableCaching_   = !g_bxl_enable_cache;
     cacheCallCnt_     = 0;
@@ -93,6 +95,8 @@ PipInfo SandboxedPip::introspect()
         .clientPid           = getClientPid(),
         .pipId               = getPipId(),
         .cacheSize           = getPathCacheElemCount(),
+        .cacheNodeCount      = getPathCacheNodeCount(),
+        .cacheSizeBytes      = getPathCacheSizeBytes(),
         .treeSize            = getTreeSize(),
         .counters            = counters_,
         .numReportedChildren = 0,
@@ -100,42 +104,43 @@ PipInfo SandboxedPip::introspect()
     };
 }
 
-bool SandboxedPip::RefreshDisableCaching()
+void SandboxedPip::RefreshPathCache()
 {
-    if (!disableCaching_)
+    if (oldPathCache_ != nullptr || !ShouldEvictPathCache())
     {
-        if (ShouldDisableCaching())
-        {
-            // once caching is disabled, it must stay disabled
-            disableCaching_ = true;
-            Trie *oldCache = pathCache_;
-            Trie *newCache = Trie::createPathTrie();
-            if (OSCompareAndSwapPtr(oldCache, newCache, &pathCache_))
-            {
-                // we swapped --> save oldCache for garbage collection
-                // (releasing is immediately is dangerous because it might still be in use in a concurrent thread)
-                oldPathCache_ = oldCache;
-            }
-            else
-            {
-                // someone else did it --> release newCache that was created for nothing
-                OSSafeReleaseNULL(newCache);
-            }
-        }
+        return;
     }
 
-    return disableCaching_;
-}
+    Trie *oldCache = pathCache_;
+    Trie *newCache = Trie::createPathTrie();
+    if (newCache == nullptr)
+    {
+        return;
+    }
+
+    // claim the slot for garbage collection first: whoever claims it is the only one to evict, until it is collected
+    if (!OSCompareAndSwapPtr(nullptr, oldCache, &oldPathCache_))
+    {
+        OSSafeReleaseNULL(newCache);
+        return;
+    }
 
-# define PCT(a, b) (int)(((a) * 1.0) / ((a) + (b)) * 100)
+    if (OSCompareAndSwapPtr(oldCache, newCache, &pathCache_))
+    {
+        // evicting a cache only means that some accesses get reported again
+        counters_.numCacheEvictions++;
+    }
+    else
+    {
+        // can't happen since caches are only swapped by whoever holds the claim --> undo the claim
+        oldPathCache_ = nullptr;
+        OSSafeReleaseNULL(newCache);
+    }
+}
 
-inline bool SandboxedPip::ShouldDisableCaching()
+inline bool SandboxedPip::ShouldEvictPathCache()
 {
-    return
-        // above the min_entries threshold
-        pathCache_->getCount() > g_bxl_disable_cache_min_entries &&
-        // below the max_hit_pct threshold
-        PCT(counters_.numCacheHits, counters_.numCacheMisses) < g_bxl_disable_cache_max_hit_pct;
+    return getPathCacheSizeBytes() > g_bxl_path_cache_max_size_mb * 1024ull * 1024;
 }
 
 #undef super
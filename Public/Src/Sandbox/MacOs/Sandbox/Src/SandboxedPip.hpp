@@ -16,6 +16,7 @@
 #include "FileAccessManifestParser.hpp"
 #include "Buffer.hpp"
 #include "PolicyResult.h"
+#include "ResourceManager.hpp"
 #include "ThreadLocal.hpp"
 #include "Trie.hpp"
 
@@ -52,25 +53,31 @@ private:
     /*! Number of processses in this pip's process tree */
     int processTreeCount_;
 
+    /*! Absolute time at which this pip was created (older pips get precedence when processes are throttled) */
+    uint64_t creationTime_;
+
+    /*! Tokens for creating processes while the CPU is saturated (see 'ResourceManager') */
+    AdmissionBucket admissionBucket_;
+
     /*!
      * Maps every accessed path to a 'CacheRecord' object (which contains caching information regarding that path).
      * IMPORTANT: increment/decrement cacheCallCnt_ around every use.
      */
     Trie *pathCache_;
 
-    /*! Old path cache left to be garbage collected (in 'cacheLookup' method) after caching was dynamically disabled. */
+    /*!
+     * Old path cache left to be garbage collected (in 'cacheLookup' method) after it was evicted for exceeding
+     * the memory budget.  No other cache is evicted until this one is garbage collected.
+     */
     Trie *oldPathCache_;
 
     /*! Counts the number of concurrent calls to 'pathCache_' */
     int cacheCallCnt_;
 
-    /*!
-     * Starts out as false and becomes true if we decide to disable caching for this pip.
-     * INVARIANT: once disabled, it stays disabled.
-     */
+    /*! True if caching was disabled (globally) when this pip was created. */
     bool disableCaching_;
 
-    /*! A thread-local storage for remembering the last looked up path by every thread. */
+    /*! A thread-local storage for remembering the last looked up path by every thread (of every process in this pip). */
     ThreadLocal *lastPathLookup_;
 
     /*! Various counters.  IMPORTANT: counters may be globally disabled so no logic may rely on their values. */
@@ -116,14 +123,14 @@ public:
     /*! Various counters. */
     AllCounters* Counters() { return &counters_; }
 
-    /*! Number of elements in the 'lastPathLookup' dictionary. */
+    /*! Number of threads with a path in the 'lastPathLookup' table. */
     uint getLastPathLookupElemCount() const { return lastPathLookup_->getCount(); }
 
-    /*! Number of nodes in the 'lastPathLookup' dictionary. */
-    uint getLastPathLookupNodeCount() const { return lastPathLookup_->getNodeCount(); }
+    /*! Number of slots in the 'lastPathLookup' table. */
+    uint getLastPathLookupNodeCount() const { return lastPathLookup_->getSlotCount(); }
 
-    /*! Size in bytes of each node in the 'lastPathLookup' dictionary. */
-    uint getLastPathLookupNodeSize() const { return lastPathLookup_->getNodeSize(); }
+    /*! Size in bytes of each slot in the 'lastPathLookup' table. */
+    uint getLastPathLookupNodeSize() const { return lastPathLookup_->getSlotSize(); }
 
     /*! Number of elements in the 'pathCache' dictionary. */
     uint getPathCacheElemCount() { AutoIncDec cnt(&cacheCallCnt_); return pathCache_->getCount(); }
@@ -134,25 +141,45 @@ public:
     /*! Size in bytes of each node in the 'pathCache' dictionary. */
     uint getPathCacheNodeSize() { AutoIncDec cnt(&cacheCallCnt_); return pathCache_->getNodeSize(); }
 
+    /*! Approximate number of bytes taken by the 'pathCache' dictionary (its nodes and cache records). */
+    uint64_t getPathCacheSizeBytes()
+    {
+        AutoIncDec cnt(&cacheCallCnt_);
+        return
+            pathCache_->getCount() * (uint64_t)sizeof(CacheRecord) +
+            pathCache_->getNodeCount() * (uint64_t)pathCache_->getNodeSize();
+    }
+
     /*!
-     * Uses a thread-local storage to save a given path as the last path that was looked up on the current thread.
+     * Uses a thread-local storage to save a given path as the last path that was looked up on the current thread
+     * (which belongs to process 'pid').
      */
-    void setLastLookedUpPath(const char *path)
+    void setLastLookedUpPath(pid_t pid, const char *path)
     {
-        const OSSymbol *pathSym = OSSymbol::withCString(path);
-        lastPathLookup_->insert(pathSym);
-        OSSafeReleaseNULL(pathSym);
+        lastPathLookup_->set(pid, path);
     }
 
     /*!
-     * Returns the last path saved by the current thread by calling the 'setLastLookedUpPath' method.
+     * Copies the last path saved by the current thread by calling the 'setLastLookedUpPath' method into 'buffer'.
+     * Returns false if there is no such path.
      *
      * (In practice, this is the path associated with the last MAC_LOOKUP event that happened on the current thread).
      */
-    const char* getLastLookedUpPath()
+    bool getLastLookedUpPath(char *buffer, size_t bufferSize)
+    {
+        return lastPathLookup_->get(buffer, bufferSize);
+    }
+
+    /*! Returns true when 'path' is the last path saved by the current thread by calling the 'setLastLookedUpPath' method. */
+    bool isLastLookedUpPath(const char *path)
     {
-        OSSymbol *value = OSDynamicCast(OSSymbol, lastPathLookup_->get());
-        return value != nullptr ? value->getCStringNoCopy() : nullptr;
+        return lastPathLookup_->matches(path);
+    }
+
+    /*! Forgets the paths saved by the threads of process 'pid' (e.g., because it exited). */
+    void clearLastLookedUpPaths(pid_t pid)
+    {
+        lastPathLookup_->removeForProcess(pid);
     }
 
     /*! Information about this pip that can be queried from user space */
@@ -169,37 +196,49 @@ public:
     /*! Atomically dencrements this pip's process tree size and returns the size before decrement. */
     int decrementProcessTreeCount() { return OSDecrementAtomic(&processTreeCount_); }
 
+    /*! Absolute time at which this pip was created. */
+    uint64_t getCreationTime() const { return creationTime_; }
+
+    /*! Token bucket used by the resource manager when throttling processes of this pip. */
+    AdmissionBucket* getAdmissionBucket() { return &admissionBucket_; }
+
 #pragma mark Report Caching
 
     /*!
      * Looks up a 'CacheRecord' associated with a given path.
      * If no such record exists, a new one is created and associated with the path.
      * Return value of NULL indicates that there is an inherent reason why the path cannot be added to cache.
+     *
+     * The returned record is retained (because the cache it came from may be evicted and released at any time);
+     * the caller is responsible for releasing it.
      */
     CacheRecord* cacheLookup(const char *path)
     {
         AutoIncDec callCnt(&cacheCallCnt_);
 
-        // check if we dynamically decided to disable caching for this pip
-        if (RefreshDisableCaching())
+        if (disableCaching_)
         {
-            // If caching is disabled, and no one else is using pathCache_, and we came here first:
-            //   --> safe to release old path cache left to be garbage collected
-            // NOTE: even if someone else comes in after we've checked `cacheCallCnt_ == 1`, 
-            //       because once caching is disabled it stays disabled, they'll get to use the new path 
-            //       cache object, so it's still safe to release oldPathCache_)
-            if (cacheCallCnt_ == 1 && callCnt.ValueBeforeTheIncrement() == 0 && oldPathCache_ != nullptr)
-            {
-                OSSafeReleaseNULL(oldPathCache_);
-            }
-
             return nullptr;
         }
-        else
+
+        // If there is an evicted cache, and no one else is using pathCache_, and we came here first:
+        //   --> safe to release old path cache left to be garbage collected
+        // NOTE: even if someone else comes in after we've checked `cacheCallCnt_ == 1`,
+        //       they'll get to use the new path cache object, so it's still safe to release oldPathCache_)
+        if (cacheCallCnt_ == 1 && callCnt.ValueBeforeTheIncrement() == 0 && oldPathCache_ != nullptr)
+        {
+            OSSafeReleaseNULL(oldPathCache_);
+        }
+
+        RefreshPathCache();
+
+        CacheRecord *record = OSDynamicCast(CacheRecord, pathCache_->getOrAdd(path, nullptr, CacheRecordFactory));
+        if (record != nullptr)
         {
-            OSObject *value = pathCache_->getOrAdd(path, nullptr, CacheRecordFactory);
-            return OSDynamicCast(CacheRecord, value);
+            record->retain();
         }
+
+        return record;
     }
 
 #pragma mark Static Methods
@@ -209,8 +248,8 @@ public:
 
 private:
 
-    bool RefreshDisableCaching();
-    inline bool ShouldDisableCaching();
+    void RefreshPathCache();
+    inline bool ShouldEvictPathCache();
 };
 
 #endif /* SandboxedPip_hpp */
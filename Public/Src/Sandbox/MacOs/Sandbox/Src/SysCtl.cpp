@@ -12,10 +12,12 @@ int g_bxl_verbose_logging = 0;
 int g_bxl_enable_cache = 1;
 int g_bxl_enable_counters = 1;	
 int g_bxl_enable_light_trie = 1;
+int g_bxl_enable_compact_trie = 1;
 
-// for caching to be disabled for a pip, it must have at least 20000 entries and no more than 20% cache hit rate
-int g_bxl_disable_cache_min_entries = 20000;
-int g_bxl_disable_cache_max_hit_pct = 20;
+// once the path cache of a pip grows (approximately) bigger than this, it is evicted and the pip starts over with an empty one
+int g_bxl_path_cache_max_size_mb = 32;
+
+int g_bxl_enable_vnode_path_cache = 1;
 
 SYSCTL_INT(_kern,                               // parent
            OID_AUTO,                            // oid
@@ -51,19 +53,27 @@ SYSCTL_INT(_kern,
 
 SYSCTL_INT(_kern,
            OID_AUTO,
-           bxl_disable_cache_min_entries,
+           bxl_enable_compact_trie,
+           CTLFLAG_RW,
+           &g_bxl_enable_compact_trie,
+           g_bxl_enable_compact_trie,
+           "Enable/Disable compact trie implementation (lock-free lookups and uses way less memory; takes precedence over the light one)");
+
+SYSCTL_INT(_kern,
+           OID_AUTO,
+           bxl_path_cache_max_size_mb,
            CTLFLAG_RW,
-           &g_bxl_disable_cache_min_entries,
-           g_bxl_disable_cache_min_entries,
-           "For pip caching to be disabled, the cache must have at least this many entries");
+           &g_bxl_path_cache_max_size_mb,
+           g_bxl_path_cache_max_size_mb,
+           "Memory budget (in MB) of the path cache of a pip; a cache exceeding it is evicted");
 
 SYSCTL_INT(_kern,
            OID_AUTO,
-           bxl_disable_cache_max_hit_pct,
+           bxl_enable_vnode_path_cache,
            CTLFLAG_RW,
-           &g_bxl_disable_cache_max_hit_pct,
-           g_bxl_disable_cache_max_hit_pct,
-           "For pip caching to be disabled, its cache hit rate must be less than this percent");
+           &g_bxl_enable_vnode_path_cache,
+           g_bxl_enable_vnode_path_cache,
+           "Enable/Disable caching of recently resolved vnode paths");
 
 void bxl_sysctl_register()
 {
@@ -71,8 +81,9 @@ void bxl_sysctl_register()
     sysctl_register_oid(&sysctl__kern_bxl_verbose_logging);
     sysctl_register_oid(&sysctl__kern_bxl_enable_cache);
     sysctl_register_oid(&sysctl__kern_bxl_enable_light_trie);
-    sysctl_register_oid(&sysctl__kern_bxl_disable_cache_min_entries);
-    sysctl_register_oid(&sysctl__kern_bxl_disable_cache_max_hit_pct);
+    sysctl_register_oid(&sysctl__kern_bxl_enable_compact_trie);
+    sysctl_register_oid(&sysctl__kern_bxl_path_cache_max_size_mb);
+    sysctl_register_oid(&sysctl__kern_bxl_enable_vnode_path_cache);
 }
 
 void bxl_sysctl_unregister()
@@ -81,6 +92,7 @@ void bxl_sysctl_unregister()
     sysctl_unregister_oid(&sysctl__kern_bxl_verbose_logging);
     sysctl_unregister_oid(&sysctl__kern_bxl_enable_cache);
     sysctl_unregister_oid(&sysctl__kern_bxl_enable_light_trie);
-    sysctl_unregister_oid(&sysctl__kern_bxl_disable_cache_min_entries);
-    sysctl_unregister_oid(&sysctl__kern_bxl_disable_cache_max_hit_pct);
+    sysctl_unregister_oid(&sysctl__kern_bxl_enable_compact_trie);
+    sysctl_unregister_oid(&sysctl__kern_bxl_path_cache_max_size_mb);
+    sysctl_unregister_oid(&sysctl__kern_bxl_enable_vnode_path_cache);
 }
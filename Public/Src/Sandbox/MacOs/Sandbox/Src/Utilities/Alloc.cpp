@@ -3,4 +3,108 @@
 
 #include "Alloc.hpp"
 
+// A free block holds the free list element that links it into the free list of its zone.
+static_assert(sizeof(lfds711_freelist_element) <= 32, "The smallest zone must fit a free list element.");
+
 int64_t Alloc::currentAllocBytes_ = 0;
+bool Alloc::zonesInitialized_ = false;
+Alloc::Zone Alloc::zones_[kAllocZoneCount];
+const uint Alloc::zoneBlockSizes_[kAllocZoneCount] = { 32, 64, 128, 256, 512, 1024, 1536, kAllocZoneMaxBlockSize };
+
+void* Alloc::Allocate(size_t size)
+{
+    int index = ZoneIndex(size);
+    if (index < 0)
+    {
+        return IOMalloc(size);
+    }
+
+    Zone &zone = zones_[index];
+    if (zonesInitialized_)
+    {
+        lfds711_freelist_element *elem = nullptr;
+        if (lfds711_freelist_pop(&zone.freeList, &elem, nullptr))
+        {
+            OSDecrementAtomic(&zone.numFree);
+            return elem;
+        }
+    }
+
+    void *block = IOMalloc(zoneBlockSizes_[index]);
+    if (block)
+    {
+        OSIncrementAtomic(&zone.numBlocks);
+    }
+
+    return block;
+}
+
+void Alloc::Free(void *ptr, size_t size)
+{
+    int index = ZoneIndex(size);
+    if (index < 0)
+    {
+        IOFree(ptr, size);
+        return;
+    }
+
+    Zone &zone = zones_[index];
+    if (zonesInitialized_ && zone.numFree < kAllocZoneMaxFreeBytes / zoneBlockSizes_[index])
+    {
+        lfds711_freelist_element *elem = (lfds711_freelist_element*)ptr;
+        LFDS711_FREELIST_SET_VALUE_IN_ELEMENT(*elem, ptr);
+        lfds711_freelist_push(&zone.freeList, elem, nullptr);
+        OSIncrementAtomic(&zone.numFree);
+        return;
+    }
+
+    OSDecrementAtomic(&zone.numBlocks);
+    IOFree(ptr, zoneBlockSizes_[index]);
+}
+
+void Alloc::InitializeZones()
+{
+    if (zonesInitialized_)
+    {
+        return;
+    }
+
+    for (int i = 0; i < kAllocZoneCount; i++)
+    {
+        lfds711_freelist_init_valid_on_current_logical_core(&zones_[i].freeList, nullptr, 0, nullptr);
+        zones_[i].numFree = 0;
+    }
+
+    LFDS711_MISC_MAKE_VALID_ON_CURRENT_LOGICAL_CORE_INITS_COMPLETED_BEFORE_NOW_ON_ANY_OTHER_LOGICAL_CORE;
+    zonesInitialized_ = true;
+}
+
+void Alloc::DrainZones()
+{
+    if (!zonesInitialized_)
+    {
+        return;
+    }
+
+    zonesInitialized_ = false;
+    for (int i = 0; i < kAllocZoneCount; i++)
+    {
+        lfds711_freelist_cleanup(&zones_[i].freeList, [](lfds711_freelist_state *fs, lfds711_freelist_element *elem)
+                                 {
+                                     Zone *zone = (Zone*)((char*)fs - offsetof(Zone, freeList));
+                                     OSDecrementAtomic(&zone->numBlocks);
+                                     OSDecrementAtomic(&zone->numFree);
+                                     IOFree(elem, zoneBlockSizes_[zone - zones_]);
+                                 });
+    }
+}
+
+void Alloc::GetZoneUsage(ZoneUsage (&usage)[kAllocZoneCount])
+{
+    for (int i = 0; i < kAllocZoneCount; i++)
+    {
+        usage[i].blockSize = zoneBlockSizes_[i];
+        usage[i].numBlocks = (uint)zones_[i].numBlocks;
+        usage[i].numFree   = (uint)zones_[i].numFree;
+    }
+}
@@ -8,20 +8,61 @@
 #include <IOKit/IOService.h>
 #include "BuildXLSandboxShared.hpp"
 
+extern "C" {
+#include "liblfds711.h"
+}
+
+/*!
+ * Allocations of up to kAllocZoneMaxBlockSize bytes (e.g., report queue payloads and elements, trie node children and traversal
+ * stacks) are rounded up to the block size of one of kAllocZoneCount zones.  Each zone keeps the blocks freed to it in a lock-free
+ * free list, so that allocating on the listener path is a pop from that list; only when the list is empty is the block allocated
+ * from the kernel.  A zone keeps at most kAllocZoneMaxFreeBytes bytes of free blocks; blocks freed beyond that go back to the kernel.
+ *
+ * Blocks are always allocated from (and freed to) the kernel with the size of their zone, so that a block can be freed whether or
+ * not the zones are initialized (see InitializeZones and DrainZones).
+ */
+#define kAllocZoneMaxBlockSize 2048
+#define kAllocZoneMaxFreeBytes (4 * 1024 * 1024)
+
 class Alloc
 {
 private:
 
+    typedef struct {
+        lfds711_freelist_state freeList;
+        SInt32 numBlocks;
+        SInt32 numFree;
+    } Zone;
+
     static int64_t currentAllocBytes_;
+    static bool zonesInitialized_;
+    static Zone zones_[kAllocZoneCount];
+    static const uint zoneBlockSizes_[kAllocZoneCount];
 
     Alloc() {}
 
+    /*! Returns the zone of an allocation of 'size' bytes, or -1 if it is too big for any zone. */
+    static int ZoneIndex(size_t size)
+    {
+        if (size > kAllocZoneMaxBlockSize)
+        {
+            return -1;
+        }
+
+        int index = 0;
+        while (zoneBlockSizes_[index] < size) index++;
+        return index;
+    }
+
+    static void* Allocate(size_t size);
+    static void Free(void *ptr, size_t size);
+
 public:
 
     template <class Type>
     static Type* New(size_t count)
     {
-        Type *result = IONew(Type, count);
+        Type *result = (Type*)Allocate(sizeof(Type) * count);
         if (result)
         {
             OSAddAtomic64(sizeof(Type) * count, &currentAllocBytes_);
@@ -32,7 +73,12 @@ public:
     template <class Type>
     static void Delete(Type* ptr, size_t count)
     {
-        IODelete(ptr, Type, count);
+        if (ptr == nullptr)
+        {
+            return;
+        }
+
+        Free(ptr, sizeof(Type) * count);
         OSAddAtomic64(-(sizeof(Type) * count), &currentAllocBytes_);
     }
 
@@ -43,6 +89,22 @@ public:
     {
         return currentAllocBytes_;
     }
+
+    /*!
+     * Sets up the free lists of the zones; until then (and after DrainZones), blocks go straight to and from the kernel.
+     */
+    static void InitializeZones();
+
+    /*!
+     * Returns the free blocks of every zone to the kernel and stops caching freed blocks.  Must be called once nothing else
+     * allocates or frees (i.e., when the kext is being unloaded).
+     */
+    static void DrainZones();
+
+    /*!
+     * Fills in the usage of every zone.
+     */
+    static void GetZoneUsage(ZoneUsage (&usage)[kAllocZoneCount]);
 };
 
 #endif /* Alloc_hpp */
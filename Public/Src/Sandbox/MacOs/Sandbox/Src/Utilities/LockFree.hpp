@@ -0,0 +1,428 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef LockFree_hpp
+#define LockFree_hpp
+
+/*!
+ * Typed wrappers around the lock-free data structures of the vendored liblfds711 (third_party/liblfds711), so that users don't have to
+ * deal with its state/element structs, void* keys and values, and init_valid_on_current_logical_core / cleanup boilerplate:
+ *
+ *   LockFreeFreeList      intrusive free list (lfds711_freelist) of the items that embed an lfds711_freelist_element
+ *   LockFreeBoundedQueue  bounded many-producer many-consumer queue (lfds711_queue_bmm) of pointers
+ *   LockFreeRingBuffer    bounded ring buffer (lfds711_ringbuffer) of pointers, in which a write to a full buffer overwrites the oldest item
+ *   LockFreeAddOnlyHash   add-only hash table (lfds711_hash_a) from integral or pointer keys to pointers
+ *
+ * Everything a structure allocates (element arrays, hash elements) comes from its 'Allocator', a class with the static members
+ *
+ *   template <class T> static T* New(size_t count);            // nullptr if out of memory; the memory must be 16-byte aligned
+ *   template <class T> static void Delete(T *ptr, size_t count);
+ *
+ * 'LockFreeDefaultAllocator' is the kext allocator (Alloc) in the kext, a private heap of the process on Windows and malloc elsewhere.
+ * Since liblfds keeps absolute pointers in its states, these structures cannot live in memory shared by processes that map it at
+ * different addresses (see report_ring.hpp in the Linux sandbox for a position independent ring).
+ *
+ * The states are members of the wrappers: a wrapper must not be moved, and must be allocated with the alignment of its class (that of
+ * the liblfds states, LFDS711_PAL_ATOMIC_ISOLATION_IN_BYTES), which liblfds asserts. A structure is initialized by its constructor;
+ * since this may fail (no exceptions here), a structure that allocates must be checked with 'IsValid' before it is used. As with
+ * liblfds, the threads other than the one that constructed a structure must see its initialization (e.g., the structure is handed to
+ * them through a lock or a thread creation, or they call 'LockFreeMakeInitsVisible') before they use it; the destructor must only run
+ * once no other thread uses it.
+ */
+
+#if MAC_OS_SANDBOX
+#include "Alloc.hpp"
+#elif defined(_WIN32)
+#include <windows.h>
+#else
+#include <stdlib.h>
+#endif
+
+extern "C" {
+#include "liblfds711.h"
+}
+
+/*! Makes the initializations of the structures constructed (on other logical cores) so far visible on the current logical core. */
+inline void LockFreeMakeInitsVisible()
+{
+    LFDS711_MISC_MAKE_VALID_ON_CURRENT_LOGICAL_CORE_INITS_COMPLETED_BEFORE_NOW_ON_ANY_OTHER_LOGICAL_CORE;
+}
+
+// ----------------------------------------------------------------------------
+// Allocators
+// ----------------------------------------------------------------------------
+
+#if MAC_OS_SANDBOX
+
+class LockFreeKextAllocator
+{
+public:
+    template <class T> static T* New(size_t count)              { return Alloc::New<T>(count); }
+    template <class T> static void Delete(T *ptr, size_t count) { Alloc::Delete<T>(ptr, count); }
+};
+
+typedef LockFreeKextAllocator LockFreeDefaultAllocator;
+
+#elif defined(_WIN32)
+
+/*! Allocates from a heap of its own, so that the lock-free structures don't contend on (or fragment) the process heap. */
+class LockFreePrivateHeapAllocator
+{
+public:
+    template <class T> static T* New(size_t count)
+    {
+        HANDLE heap = GetHeap();
+        return heap != NULL ? static_cast<T*>(HeapAlloc(heap, 0, sizeof(T) * count)) : nullptr;
+    }
+
+    template <class T> static void Delete(T *ptr, size_t)
+    {
+        if (ptr != nullptr)
+        {
+            HeapFree(GetHeap(), 0, ptr);
+        }
+    }
+
+private:
+    static HANDLE GetHeap()
+    {
+        static HANDLE volatile s_heap = NULL;
+        HANDLE heap = s_heap;
+        if (heap == NULL)
+        {
+            heap = HeapCreate(0, 0, 0);
+            if (heap != NULL && InterlockedCompareExchangePointer(const_cast<PVOID volatile*>(&s_heap), heap, NULL) != NULL)
+            {
+                HeapDestroy(heap);
+                heap = s_heap;
+            }
+        }
+
+        return heap;
+    }
+};
+
+typedef LockFreePrivateHeapAllocator LockFreeDefaultAllocator;
+
+#else
+
+class LockFreeMallocAllocator
+{
+public:
+    template <class T> static T* New(size_t count)              { return static_cast<T*>(malloc(sizeof(T) * count)); }
+    template <class T> static void Delete(T *ptr, size_t)       { free(ptr); }
+};
+
+typedef LockFreeMallocAllocator LockFreeDefaultAllocator;
+
+#endif
+
+// ----------------------------------------------------------------------------
+// LockFreeFreeList
+// ----------------------------------------------------------------------------
+
+/*!
+ * A free list of the items of type T, which embed the lfds711_freelist_element 'Element' (at most one free list at a time per element).
+ * The free list never allocates: it only links the items that are pushed into it, which stay owned by the caller.
+ */
+template <class T, lfds711_freelist_element T::*Element>
+class LockFreeFreeList
+{
+public:
+
+    LockFreeFreeList()
+    {
+        lfds711_freelist_init_valid_on_current_logical_core(&state_, nullptr, 0, nullptr);
+    }
+
+    ~LockFreeFreeList()
+    {
+        lfds711_freelist_cleanup(&state_, nullptr);
+    }
+
+    void Push(T *item)
+    {
+        lfds711_freelist_element *element = &(item->*Element);
+        LFDS711_FREELIST_SET_VALUE_IN_ELEMENT(*element, item);
+        lfds711_freelist_push(&state_, element, nullptr);
+    }
+
+    /*! Returns nullptr if the free list is empty. */
+    T* Pop()
+    {
+        lfds711_freelist_element *element = nullptr;
+        return lfds711_freelist_pop(&state_, &element, nullptr)
+            ? static_cast<T*>(LFDS711_FREELIST_GET_VALUE_FROM_ELEMENT(*element))
+            : nullptr;
+    }
+
+    /*! Pops every item and passes it to 'callback' (e.g., to free it). */
+    template <class Callback>
+    void Drain(Callback callback)
+    {
+        for (T *item = Pop(); item != nullptr; item = Pop())
+        {
+            callback(item);
+        }
+    }
+
+private:
+
+    lfds711_freelist_state state_;
+
+    LockFreeFreeList(const LockFreeFreeList&) = delete;
+    LockFreeFreeList& operator=(const LockFreeFreeList&) = delete;
+};
+
+// ----------------------------------------------------------------------------
+// LockFreeBoundedQueue
+// ----------------------------------------------------------------------------
+
+/*!
+ * A FIFO queue of at most 'capacity' (a power of two, at least 2) pointers to T, which any number of threads may enqueue into and dequeue
+ * from at once. The queue does not own the items: those still in the queue when it is destroyed are dropped.
+ */
+template <class T, class Allocator = LockFreeDefaultAllocator>
+class LockFreeBoundedQueue
+{
+public:
+
+    explicit LockFreeBoundedQueue(size_t capacity)
+        : capacity_(capacity), elements_(nullptr)
+    {
+        if (capacity < 2 || (capacity & (capacity - 1)) != 0)
+        {
+            return;
+        }
+
+        elements_ = Allocator::template New<lfds711_queue_bmm_element>(capacity);
+        if (elements_ != nullptr)
+        {
+            lfds711_queue_bmm_init_valid_on_current_logical_core(&state_, elements_, capacity, nullptr);
+        }
+    }
+
+    ~LockFreeBoundedQueue()
+    {
+        if (elements_ != nullptr)
+        {
+            lfds711_queue_bmm_cleanup(&state_, nullptr);
+            Allocator::Delete(elements_, capacity_);
+        }
+    }
+
+    bool IsValid() const { return elements_ != nullptr; }
+
+    /*! Returns false if the queue is full. */
+    bool Enqueue(T *item)
+    {
+        return lfds711_queue_bmm_enqueue(&state_, nullptr, item) != 0;
+    }
+
+    /*! Returns nullptr if the queue is empty. */
+    T* Dequeue()
+    {
+        void *item = nullptr;
+        return lfds711_queue_bmm_dequeue(&state_, nullptr, &item) ? static_cast<T*>(item) : nullptr;
+    }
+
+    /*! May be off while other threads use the queue. */
+    size_t ApproximateCount()
+    {
+        lfds711_pal_uint_t count = 0;
+        lfds711_queue_bmm_query(&state_, LFDS711_QUEUE_BMM_QUERY_GET_POTENTIALLY_INACCURATE_COUNT, nullptr, &count);
+        return (size_t)count;
+    }
+
+private:
+
+    size_t capacity_;
+    lfds711_queue_bmm_element *elements_;
+    lfds711_queue_bmm_state state_;
+
+    LockFreeBoundedQueue(const LockFreeBoundedQueue&) = delete;
+    LockFreeBoundedQueue& operator=(const LockFreeBoundedQueue&) = delete;
+};
+
+// ----------------------------------------------------------------------------
+// LockFreeRingBuffer
+// ----------------------------------------------------------------------------
+
+/*!
+ * A FIFO ring of at most 'capacity' pointers to T, which any number of threads may write to and read from at once. A write to a full ring
+ * overwrites (and returns) the oldest item, so writers never fail; the ring does not own the items, those still in it when it is
+ * destroyed are dropped.
+ */
+template <class T, class Allocator = LockFreeDefaultAllocator>
+class LockFreeRingBuffer
+{
+public:
+
+    explicit LockFreeRingBuffer(size_t capacity)
+        : elementCount_(capacity + 1), elements_(nullptr)
+    {
+        if (capacity == 0)
+        {
+            return;
+        }
+
+        // liblfds uses one of the elements as the dummy element of its queue
+        elements_ = Allocator::template New<lfds711_ringbuffer_element>(elementCount_);
+        if (elements_ != nullptr)
+        {
+            lfds711_ringbuffer_init_valid_on_current_logical_core(&state_, elements_, elementCount_, nullptr);
+        }
+    }
+
+    ~LockFreeRingBuffer()
+    {
+        if (elements_ != nullptr)
+        {
+            lfds711_ringbuffer_cleanup(&state_, nullptr);
+            Allocator::Delete(elements_, elementCount_);
+        }
+    }
+
+    bool IsValid() const { return elements_ != nullptr; }
+
+    /*! Returns the item that was overwritten to make room for 'item', or nullptr if the ring was not full. */
+    T* Write(T *item)
+    {
+        lfds711_misc_flag overwritten = LFDS711_MISC_FLAG_LOWERED;
+        void *overwrittenItem = nullptr;
+        lfds711_ringbuffer_write(&state_, nullptr, item, &overwritten, nullptr, &overwrittenItem);
+        return overwritten == LFDS711_MISC_FLAG_RAISED ? static_cast<T*>(overwrittenItem) : nullptr;
+    }
+
+    /*! Returns nullptr if the ring is empty. */
+    T* Read()
+    {
+        void *item = nullptr;
+        return lfds711_ringbuffer_read(&state_, nullptr, &item) ? static_cast<T*>(item) : nullptr;
+    }
+
+private:
+
+    size_t elementCount_;
+    lfds711_ringbuffer_element *elements_;
+    lfds711_ringbuffer_state state_;
+
+    LockFreeRingBuffer(const LockFreeRingBuffer&) = delete;
+    LockFreeRingBuffer& operator=(const LockFreeRingBuffer&) = delete;
+};
+
+// ----------------------------------------------------------------------------
+// LockFreeAddOnlyHash
+// ----------------------------------------------------------------------------
+
+/*!
+ * A hash table from keys of type Key (an integral or pointer type that fits in a pointer) to pointers to Value, which any number of
+ * threads may add to and look up at once. Entries can't be removed (nor their value replaced): the table only grows until it is destroyed,
+ * so it suits caches whose set of keys is bounded. The table does not own the values.
+ *
+ * Each of the 'bucketCount' buckets is an (unbalanced) lock-free binary tree: pick a bucket count in the order of the expected entry count.
+ */
+template <class Key, class Value, class Allocator = LockFreeDefaultAllocator>
+class LockFreeAddOnlyHash
+{
+    static_assert(sizeof(Key) <= sizeof(void*), "Keys are stored in place of liblfds' void* keys");
+
+public:
+
+    explicit LockFreeAddOnlyHash(size_t bucketCount)
+        : bucketCount_(bucketCount), bucketBytes_(nullptr), buckets_(nullptr)
+    {
+        if (bucketCount == 0)
+        {
+            return;
+        }
+
+        // The bucket states must be aligned on LFDS711_PAL_ATOMIC_ISOLATION_IN_BYTES, which is more than allocators guarantee
+        bucketBytes_ = Allocator::template New<char>(BucketAllocationSize());
+        if (bucketBytes_ != nullptr)
+        {
+            lfds711_pal_uint_t address = (lfds711_pal_uint_t)bucketBytes_ + LFDS711_PAL_ATOMIC_ISOLATION_IN_BYTES - 1;
+            buckets_ = (lfds711_btree_au_state*)(address - address % LFDS711_PAL_ATOMIC_ISOLATION_IN_BYTES);
+
+            // The user state is given to the trees of the buckets, from which lfds711_hash_a_cleanup takes the state of the table
+            lfds711_hash_a_init_valid_on_current_logical_core(&state_, buckets_, bucketCount, &CompareKeys, &HashKey,
+                                                              LFDS711_HASH_A_EXISTING_KEY_FAIL, &state_);
+        }
+    }
+
+    ~LockFreeAddOnlyHash()
+    {
+        if (buckets_ != nullptr)
+        {
+            lfds711_hash_a_cleanup(&state_, [](lfds711_hash_a_state *, lfds711_hash_a_element *element)
+                                   {
+                                       Allocator::Delete(element, 1);
+                                   });
+            Allocator::Delete(bucketBytes_, BucketAllocationSize());
+        }
+    }
+
+    bool IsValid() const { return buckets_ != nullptr; }
+
+    /*!
+     * Adds 'value' for 'key' and returns it, unless the table already has an entry for 'key': then the value of that entry is returned.
+     * Returns nullptr if out of memory.
+     */
+    Value* GetOrAdd(Key key, Value *value)
+    {
+        lfds711_hash_a_element *element = Allocator::template New<lfds711_hash_a_element>(1);
+        if (element == nullptr)
+        {
+            return nullptr;
+        }
+
+        LFDS711_HASH_A_SET_KEY_IN_ELEMENT(*element, key);
+        LFDS711_HASH_A_SET_VALUE_IN_ELEMENT(*element, value);
+
+        lfds711_hash_a_element *existing = nullptr;
+        if (lfds711_hash_a_insert(&state_, element, &existing) == LFDS711_HASH_A_PUT_RESULT_FAILURE_EXISTING_KEY)
+        {
+            Allocator::Delete(element, 1);
+            return static_cast<Value*>(LFDS711_HASH_A_GET_VALUE_FROM_ELEMENT(*existing));
+        }
+
+        return value;
+    }
+
+    /*! Returns nullptr if the table has no entry for 'key'. */
+    Value* Find(Key key)
+    {
+        lfds711_hash_a_element *element = nullptr;
+        return lfds711_hash_a_get_by_key(&state_, &CompareKeys, &HashKey, ToPointer(key), &element)
+            ? static_cast<Value*>(LFDS711_HASH_A_GET_VALUE_FROM_ELEMENT(*element))
+            : nullptr;
+    }
+
+private:
+
+    size_t bucketCount_;
+    char *bucketBytes_;
+    lfds711_btree_au_state *buckets_;
+    lfds711_hash_a_state state_;
+
+    size_t BucketAllocationSize() const { return bucketCount_ * sizeof(lfds711_btree_au_state) + LFDS711_PAL_ATOMIC_ISOLATION_IN_BYTES - 1; }
+
+    static void* ToPointer(Key key) { return (void*)(lfds711_pal_uint_t)key; }
+
+    static int CompareKeys(void const *newKey, void const *existingKey)
+    {
+        lfds711_pal_uint_t a = (lfds711_pal_uint_t)newKey, b = (lfds711_pal_uint_t)existingKey;
+        return a < b ? -1 : (a > b ? 1 : 0);
+    }
+
+    static void HashKey(void const *key, lfds711_pal_uint_t *hash)
+    {
+        *hash = 0;
+        LFDS711_HASH_A_HASH_FUNCTION((void*)&key, sizeof(key), *hash);
+    }
+
+    LockFreeAddOnlyHash(const LockFreeAddOnlyHash&) = delete;
+    LockFreeAddOnlyHash& operator=(const LockFreeAddOnlyHash&) = delete;
+};
+
+#endif /* LockFree_hpp */
@@ -0,0 +1,337 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "ProcessTable.hpp"
+#include "Alloc.hpp"
+
+#define super OSObject
+
+OSDefineMetaClassAndStructors(ProcessTable, OSObject)
+
+ProcessTable* ProcessTable::create()
+{
+    ProcessTable *instance = new ProcessTable;
+    if (instance != nullptr)
+    {
+        if (!instance->init())
+        {
+            OSSafeReleaseNULL(instance);
+        }
+    }
+
+    return instance;
+}
+
+bool ProcessTable::init()
+{
+    static_assert(sizeof(Chunk) <= kAllocZoneMaxBlockSize, "a chunk must fit in an allocation zone");
+
+    if (!super::init())
+    {
+        return false;
+    }
+
+    size_ = 0;
+    onChangeData_ = nullptr;
+    onChangeCallback_ = nullptr;
+    readers_ = 0;
+    retired_ = nullptr;
+
+    chunks_ = Alloc::New<Chunk*>(kChunkCount);
+    if (chunks_ == nullptr)
+    {
+        return false;
+    }
+
+    memset(chunks_, 0, sizeof(Chunk*) * kChunkCount);
+    return true;
+}
+
+void ProcessTable::free()
+{
+    if (chunks_ != nullptr)
+    {
+        for (uint i = 0; i < kChunkCount; i++)
+        {
+            if (chunks_[i] == nullptr)
+            {
+                continue;
+            }
+
+            for (uint j = 0; j < kChunkSize; j++)
+            {
+                OSSafeReleaseNULL((*chunks_[i])[j]);
+            }
+
+            Alloc::Delete<Chunk>(chunks_[i], 1);
+        }
+
+        Alloc::Delete<Chunk*>(chunks_, kChunkCount);
+        chunks_ = nullptr;
+    }
+
+    // no one can be reading from this table anymore
+    while (retired_ != nullptr)
+    {
+        Retired *entry = retired_;
+        retired_ = entry->next;
+        OSSafeReleaseNULL(entry->record);
+        Alloc::Delete<Retired>(entry, 1);
+    }
+
+    size_ = 0;
+
+    super::free();
+}
+
+OSObject** ProcessTable::findSlot(uint64_t pid, bool createIfMissing)
+{
+    if (pid > kPidMax)
+    {
+        return nullptr;
+    }
+
+    Chunk *chunk = chunks_[pid / kChunkSize];
+    if (chunk == nullptr)
+    {
+        if (!createIfMissing)
+        {
+            return nullptr;
+        }
+
+        Chunk *newChunk = Alloc::New<Chunk>(1);
+        if (newChunk == nullptr)
+        {
+            return nullptr;
+        }
+
+        memset(newChunk, 0, sizeof(Chunk));
+        if (OSCompareAndSwapPtr(nullptr, newChunk, &chunks_[pid / kChunkSize]))
+        {
+            chunk = newChunk;
+        }
+        else
+        {
+            // someone else came first --> use theirs
+            Alloc::Delete<Chunk>(newChunk, 1);
+            chunk = chunks_[pid / kChunkSize];
+        }
+    }
+
+    return &(*chunk)[pid % kChunkSize];
+}
+
+OSObject* ProcessTable::getRetained(uint64_t pid)
+{
+    // most lookups are for pids that have no record --> don't make them count as readers
+    if (!mayContain(pid))
+    {
+        return nullptr;
+    }
+
+    // a record can only be released once there are no readers, so it's safe to retain it here
+    OSIncrementAtomic(&readers_);
+    OSObject **slot = findSlot(pid, false);
+    OSObject *record = slot != nullptr ? *slot : nullptr;
+    if (record != nullptr)
+    {
+        record->retain();
+    }
+
+    if (OSDecrementAtomic(&readers_) == 1 && retired_ != nullptr)
+    {
+        reclaim();
+    }
+
+    return record;
+}
+
+void ProcessTable::retire(OSObject *record)
+{
+    Retired *entry = Alloc::New<Retired>(1);
+    if (entry == nullptr)
+    {
+        // can't defer releasing it --> wait for the current readers (which only retain a record) to finish
+        while (readers_ != 0);
+        OSSafeReleaseNULL(record);
+        return;
+    }
+
+    entry->record = record;
+    do
+    {
+        entry->next = retired_;
+    } while (!OSCompareAndSwapPtr(entry->next, entry, &retired_));
+
+    reclaim();
+}
+
+void ProcessTable::reclaim()
+{
+    // take all the retired records: they were all removed from the table before this point,
+    // so a reader that could have seen any of them must have been counted in 'readers_' already
+    Retired *list;
+    do
+    {
+        list = retired_;
+    } while (list != nullptr && !OSCompareAndSwapPtr(list, nullptr, &retired_));
+
+    bool noReaders = readers_ == 0;
+    while (list != nullptr)
+    {
+        Retired *entry = list;
+        list = entry->next;
+        if (noReaders)
+        {
+            OSSafeReleaseNULL(entry->record);
+            Alloc::Delete<Retired>(entry, 1);
+        }
+        else
+        {
+            // some reader may still be retaining it --> put it back
+            do
+            {
+                entry->next = retired_;
+            } while (!OSCompareAndSwapPtr(entry->next, entry, &retired_));
+        }
+    }
+}
+
+OSObject* ProcessTable::getOrAdd(uint64_t pid, void *factoryArgs, Trie::factory_fn factory, TrieResult *result)
+{
+    OSObject **slot = findSlot(pid, true);
+    if (slot == nullptr)
+    {
+        if (result) *result = Trie::kTrieResultFailure;
+        return nullptr;
+    }
+
+    TrieResult addResult = Trie::kTrieResultAlreadyExists;
+    if (*slot == nullptr)
+    {
+        OSObject *newRecord = factory(factoryArgs);
+        if (newRecord != nullptr)
+        {
+            if (OSCompareAndSwapPtr(nullptr, newRecord, slot))
+            {
+                // we updated the slot --> retain (by not releasing created newRecord) and increase the size
+                int oldCount = OSIncrementAtomic(&size_);
+                triggerOnChange(oldCount, oldCount + 1);
+                addResult = Trie::kTrieResultInserted;
+            }
+            else
+            {
+                // someone else came first --> release 'newRecord' that we created for nothing
+                OSSafeReleaseNULL(newRecord);
+            }
+        }
+    }
+
+    if (result) *result = addResult;
+    return *slot;
+}
+
+ProcessTable::TrieResult ProcessTable::insert(uint64_t pid, const OSObject *value)
+{
+    OSObject **slot = value != nullptr ? findSlot(pid, true) : nullptr;
+    if (slot == nullptr)
+    {
+        return Trie::kTrieResultFailure;
+    }
+
+    if (OSCompareAndSwapPtr(nullptr, (void*)value, slot))
+    {
+        // previous value was NULL and we updated the slot --> retain the new value and increment size
+        value->retain();
+        int oldCount = OSIncrementAtomic(&size_);
+        triggerOnChange(oldCount, oldCount + 1);
+        return Trie::kTrieResultInserted;
+    }
+    else
+    {
+        // the slot was not empty or someone else came first --> bail and return "already exists"
+        return Trie::kTrieResultAlreadyExists;
+    }
+}
+
+ProcessTable::TrieResult ProcessTable::remove(uint64_t pid)
+{
+    OSObject **slot = findSlot(pid, false);
+    if (slot == nullptr || *slot == nullptr)
+    {
+        return Trie::kTrieResultAlreadyEmpty;
+    }
+
+    OSObject *previousValue = *slot;
+    if (OSCompareAndSwapPtr(previousValue, nullptr, slot))
+    {
+        // we updated the slot --> release previous value (once no one can be reading it) and decrease size
+        retire(previousValue);
+        int oldCount = OSDecrementAtomic(&size_);
+        triggerOnChange(oldCount, oldCount - 1);
+        return Trie::kTrieResultRemoved;
+    }
+    else
+    {
+        // someone else came first --> declare race and do nothing
+        return Trie::kTrieResultRace;
+    }
+}
+
+bool ProcessTable::onChange(void *callbackArgs, Trie::on_change_fn callback)
+{
+    if (onChangeCallback_) return false;
+    onChangeData_ = callbackArgs;
+    onChangeCallback_ = callback;
+    return true;
+}
+
+void ProcessTable::triggerOnChange(int oldCount, int newCount) const
+{
+    if (onChangeCallback_ && oldCount != newCount)
+    {
+        onChangeCallback_(onChangeData_, oldCount, newCount);
+    }
+}
+
+void ProcessTable::forEach(void *callbackArgs, Trie::for_each_fn callback)
+{
+    for (uint64_t pid = 0; pid <= kPidMax; pid++)
+    {
+        if (chunks_[pid / kChunkSize] == nullptr)
+        {
+            // skip the whole chunk
+            pid += kChunkSize - 1 - pid % kChunkSize;
+            continue;
+        }
+
+        OSObject *record = getRetained(pid);
+        if (record)
+        {
+            callback(callbackArgs, pid, record);
+            record->release();
+        }
+    }
+}
+
+void ProcessTable::removeMatching(void *filterArgs, Trie::filter_fn filter)
+{
+    for (uint64_t pid = 0; pid <= kPidMax; pid++)
+    {
+        if (chunks_[pid / kChunkSize] == nullptr)
+        {
+            pid += kChunkSize - 1 - pid % kChunkSize;
+            continue;
+        }
+
+        OSObject *record = getRetained(pid);
+        if (record)
+        {
+            if (filter(filterArgs, record))
+            {
+                remove(pid);
+            }
+            record->release();
+        }
+    }
+}
@@ -0,0 +1,159 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef ProcessTable_hpp
+#define ProcessTable_hpp
+
+#include <IOKit/IOService.h>
+#include "BuildXLSandboxShared.hpp"
+#include "Trie.hpp"
+
+#define ProcessTable BXL_CLASS(ProcessTable)
+
+/*!
+ * A thread-safe dictionary keyed by process id, implemented as a two-level table indexed by the pid itself.
+ *
+ * Process ids are bounded by PID_MAX, so instead of walking a decimal-digit trie of the pid (one node per digit), a lookup
+ * loads the chunk covering the pid from a fixed directory and the record from that chunk.  Chunks are allocated the first
+ * time a pid they cover is added and are only freed with the table, so readers never take a lock.
+ *
+ * Records are retained and released the same way 'Trie' does: adding a record retains it; a record that is removed (or
+ * replaced) is only released once no reader in 'getRetained' can be looking at it (similar to RCU).
+ *
+ * Exposes the subset of the uint 'Trie' interface used for process ids, with the same results.  Pids outside of
+ * [0, kPidMax] are never found and can't be added ('kTrieResultFailure').
+ *
+ * Thread-safe.
+ */
+class ProcessTable : public OSObject
+{
+    OSDeclareDefaultStructors(ProcessTable);
+
+public:
+
+    typedef Trie::TrieResult TrieResult;
+
+    /*! See: https://opensource.apple.com/source/xnu/xnu-1699.24.23/bsd/sys/proc_internal.h */
+    static const uint kPidMax = 99999;
+
+private:
+
+    /*! Number of records per chunk: a chunk is the largest block the allocation zones hand out (see 'Alloc') */
+    static const uint kChunkSize  = 256;
+    static const uint kChunkCount = (kPidMax + kChunkSize) / kChunkSize;
+
+    typedef OSObject* Chunk[kChunkSize];
+
+    /*! The chunks of this table; NULL until a pid covered by it is added */
+    Chunk **chunks_;
+
+    /*! Number of records stored */
+    uint size_;
+
+    /*! Callback function to call whenever the size of the table changes. */
+    Trie::on_change_fn onChangeCallback_;
+
+    /*! Payload for the 'onChangeCallback_' function */
+    void *onChangeData_;
+
+    /*! A record that was removed from this table but may still be looked at by a reader (see 'getRetained') */
+    typedef struct Retired {
+        OSObject *record;
+        Retired *next;
+    } Retired;
+
+    /*! Number of threads currently reading a record in 'getRetained' */
+    int readers_;
+
+    /*! Records waiting to be released once there are no readers (a lock-free stack) */
+    Retired *retired_;
+
+    /*! Returns the slot of 'pid', allocating its chunk when 'createIfMissing' is set; NULL if out of range (or out of memory) */
+    OSObject** findSlot(uint64_t pid, bool createIfMissing);
+
+    /*! Same as in 'Trie' */
+    void retire(OSObject *record);
+    void reclaim();
+    void triggerOnChange(int oldCount, int newCount) const;
+
+    OSObject* getRetained(uint64_t pid);
+
+    bool init() override;
+
+protected:
+
+    void free() override;
+
+public:
+
+    /*! Returns the number of records stored. */
+    uint getCount() const { return size_; }
+
+    /*! Callback to be invoked every time the size of this table changes (only one can be installed). */
+    bool onChange(void *callbackArgs, Trie::on_change_fn callback);
+
+    /*! Invokes 'callback' for every record in this table, in order of pids. */
+    void forEach(void *callbackArgs, Trie::for_each_fn callback);
+
+    /*! Removes all the records matching a given filter. */
+    void removeMatching(void *filterArgs, Trie::filter_fn filter);
+
+    /*!
+     * Whether some record may be associated with 'pid': a plain read of its slot, which neither retains the record nor counts
+     * as a reader (i.e., doesn't write the 'readers_' counter all the threads of the machine share).  Meant for rejecting
+     * the pids that have no record cheaply; as with any lookup, a record may be added (or removed) right after it returns.
+     */
+    bool mayContain(uint64_t pid) const
+    {
+        if (pid > kPidMax)
+        {
+            return false;
+        }
+
+        Chunk *chunk = chunks_[pid / kChunkSize];
+        return chunk != nullptr && (*chunk)[pid % kChunkSize] != nullptr;
+    }
+
+    /*!
+     * Returns the record associated with 'pid' (cast to T) or NULL.  The record is not retained, so this may only be used
+     * by callers that otherwise synchronize with its removal.
+     */
+    template<typename T>
+    T* getAs(uint64_t pid)
+    {
+        OSObject **slot = findSlot(pid, false);
+        return slot != nullptr ? OSDynamicCast(T, *slot) : nullptr;
+    }
+
+    /*!
+     * Returns the record associated with 'pid' (cast to T) after retaining it, or NULL.  The caller is responsible for
+     * releasing the returned object.
+     */
+    template<typename T>
+    T* getRetainedAs(uint64_t pid)
+    {
+        OSObject *record = getRetained(pid);
+        T *result = OSDynamicCast(T, record);
+        if (result == nullptr)
+        {
+            OSSafeReleaseNULL(record);
+        }
+        return result;
+    }
+
+    /*! Same as 'Trie::getOrAdd' */
+    OSObject* getOrAdd(uint64_t pid, void *factoryArgs, Trie::factory_fn factory, TrieResult *result = nullptr);
+
+    /*! Same as 'Trie::insert': kTrieResultInserted, kTrieResultAlreadyExists, or kTrieResultFailure */
+    TrieResult insert(uint64_t pid, const OSObject *value);
+
+    /*! Same as 'Trie::remove': kTrieResultRemoved, kTrieResultAlreadyEmpty, or kTrieResultRace */
+    TrieResult remove(uint64_t pid);
+
+    /*!
+     * Static factory method.  The caller is responsible for releasing it by calling 'release()'.
+     */
+    static ProcessTable* create();
+};
+
+#endif /* ProcessTable_hpp */
@@ -2,8 +2,7 @@
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
 
 #include "ThreadLocal.hpp"
-#include "BuildXLSandboxShared.hpp"
-#include "SandboxedPip.hpp"
+#include "Alloc.hpp"
 
 #define super OSObject
 
@@ -32,42 +31,210 @@ bool ThreadLocal::init()
         return false;
     }
 
-    dict_ = Trie::createUintTrie();
-    if (dict_ == nullptr)
+    clock_ = 0;
+    slots_ = Alloc::New<Slot>(kSlotCount);
+    if (slots_ == nullptr)
     {
         return false;
     }
 
+    for (int i = 0; i < kSlotCount; i++)
+    {
+        slots_[i].tid     = 0;
+        slots_[i].seq     = 0;
+        slots_[i].pid     = 0;
+        slots_[i].lastUse = 0;
+        slots_[i].path[0] = '\0';
+    }
+
     return true;
 }
 
 void ThreadLocal::free()
 {
-    if (dict_)
+    if (slots_)
     {
-        OSSafeReleaseNULL(dict_);
+        Alloc::Delete<Slot>(slots_, kSlotCount);
+        slots_ = nullptr;
     }
 
     super::free();
 }
 
-#pragma mark count/insert/remove/get methods
+#pragma mark count/set/get/remove methods
+
+uint ThreadLocal::getCount() const
+{
+    uint count = 0;
+    for (int i = 0; i < kSlotCount; i++)
+    {
+        if (slots_[i].tid != 0) count++;
+    }
+
+    return count;
+}
+
+ThreadLocal::Slot* ThreadLocal::findSlot(uint64_t tid) const
+{
+    uint start = hash(tid);
+    for (int i = 0; i < kMaxProbes; i++)
+    {
+        Slot *slot = &slots_[(start + i) % kSlotCount];
+        if (slot->tid == tid)
+        {
+            return slot;
+        }
+    }
+
+    return nullptr;
+}
+
+ThreadLocal::Slot* ThreadLocal::pickSlotToClaim(uint64_t tid) const
+{
+    // a free slot or, if there is none, the least recently used one
+    uint start = hash(tid);
+    Slot *candidate = nullptr;
+    for (int i = 0; i < kMaxProbes; i++)
+    {
+        Slot *slot = &slots_[(start + i) % kSlotCount];
+        if (slot->tid == 0)
+        {
+            return slot;
+        }
+        else if (candidate == nullptr || slot->lastUse < candidate->lastUse)
+        {
+            candidate = slot;
+        }
+    }
+
+    return candidate;
+}
 
-bool ThreadLocal::insert(const OSObject *value)
+bool ThreadLocal::tryLock(Slot *slot, uint32_t *outSeq)
 {
-    auto result = dict_->replace(self_tid(), value);
-    return
-        result == Trie::TrieResult::kTrieResultInserted ||
-        result == Trie::TrieResult::kTrieResultReplaced;
+    uint32_t seq = slot->seq;
+    if ((seq & 1) != 0 || !OSCompareAndSwap(seq, seq + 1, &slot->seq))
+    {
+        return false;
+    }
+
+    *outSeq = seq + 1;
+    return true;
 }
 
-bool ThreadLocal::remove()
+void ThreadLocal::unlock(Slot *slot, uint32_t seq)
 {
-    auto result = dict_->remove(self_tid());
-    return result == Trie::TrieResult::kTrieResultRemoved;
+    OSCompareAndSwap(seq, seq + 1, &slot->seq);
 }
 
-OSObject* ThreadLocal::get() const
+bool ThreadLocal::set(pid_t pid, const char *path)
 {
-    return dict_->get(self_tid());
+    uint64_t tid = self_tid();
+    Slot *slot = findSlot(tid);
+    bool claiming = slot == nullptr;
+    if (claiming)
+    {
+        slot = pickSlotToClaim(tid);
+    }
+
+    // the owner of a slot only changes while holding its lock, so someone else may be reclaiming this slot
+    uint64_t expectedOwner = claiming ? slot->tid : tid;
+    uint32_t seq;
+    if (!tryLock(slot, &seq))
+    {
+        return false;
+    }
+
+    bool owned = slot->tid == expectedOwner;
+    if (owned)
+    {
+        slot->tid     = tid;
+        slot->pid     = pid;
+        slot->lastUse = OSIncrementAtomic64((volatile SInt64*)&clock_) + 1;
+        strlcpy(slot->path, path, sizeof(slot->path));
+    }
+
+    unlock(slot, seq);
+    return owned;
+}
+
+bool ThreadLocal::get(char *buffer, size_t bufferSize) const
+{
+    uint64_t tid = self_tid();
+    Slot *slot = findSlot(tid);
+    if (slot == nullptr || bufferSize == 0)
+    {
+        return false;
+    }
+
+    uint32_t seq = slot->seq;
+    if ((seq & 1) != 0)
+    {
+        return false;
+    }
+
+    // not using strlcpy: the path may change while being copied, so it may not be terminated where its old length says
+    size_t maxLen = min(bufferSize, sizeof(slot->path)) - 1;
+    size_t len = 0;
+    while (len < maxLen && slot->path[len] != '\0')
+    {
+        buffer[len] = slot->path[len];
+        len++;
+    }
+
+    buffer[len] = '\0';
+    OSMemoryBarrier();
+
+    // the copy is only good if no one wrote to (or reclaimed) the slot in the meantime
+    return slot->seq == seq && slot->tid == tid && buffer[0] != '\0';
+}
+
+bool ThreadLocal::matches(const char *path) const
+{
+    uint64_t tid = self_tid();
+    Slot *slot = findSlot(tid);
+    if (slot == nullptr || path == nullptr || path[0] == '\0')
+    {
+        return false;
+    }
+
+    uint32_t seq = slot->seq;
+    if ((seq & 1) != 0)
+    {
+        return false;
+    }
+
+    bool equal = strncmp(slot->path, path, sizeof(slot->path)) == 0;
+    OSMemoryBarrier();
+
+    // like in 'get', the comparison is only good if no one wrote to (or reclaimed) the slot in the meantime
+    return equal && slot->seq == seq && slot->tid == tid;
+}
+
+void ThreadLocal::removeForProcess(pid_t pid)
+{
+    for (int i = 0; i < kSlotCount; i++)
+    {
+        Slot *slot = &slots_[i];
+        uint64_t owner = slot->tid;
+        if (owner == 0 || slot->pid != pid)
+        {
+            continue;
+        }
+
+        uint32_t seq;
+        if (!tryLock(slot, &seq))
+        {
+            continue;
+        }
+
+        if (slot->tid == owner && slot->pid == pid)
+        {
+            slot->path[0] = '\0';
+            slot->lastUse = 0;
+            slot->tid     = 0;
+        }
+
+        unlock(slot, seq);
+    }
 }
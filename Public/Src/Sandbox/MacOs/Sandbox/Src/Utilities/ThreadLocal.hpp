@@ -6,12 +6,18 @@
 
 #include <IOKit/IOService.h>
 #include <IOKit/IOLib.h>
-#include "Trie.hpp"
+#include <sys/param.h>
+#include "BuildXLSandboxShared.hpp"
 
 #define ThreadLocal BXL_CLASS(ThreadLocal)
 
 /*!
- * A straightforward wrapper around a concurrent dictionary that uses current thread's id as the implicit key.
+ * A fixed-size table of slots, each holding a path for one thread, that uses current thread's id as the implicit key.
+ *
+ * A thread finds its slot by hashing its id and probing a few neighbouring slots, so setting and getting a path
+ * requires neither a lock nor an allocation.  A slot is released when the process of its thread exits
+ * (see 'removeForProcess'); when all the probed slots are taken, the least recently used one is reclaimed.
+ * A path that is lost that way (or because of a concurrent reclaim) is simply reported as missing.
  */
 class ThreadLocal : public OSObject
 {
@@ -19,14 +25,55 @@ class ThreadLocal : public OSObject
 
 private:
 
-    /* backing dictionary */
-    Trie *dict_;
+    /*! Number of slots in the table */
+    static const uint kSlotCount = 32;
+
+    /*! Number of slots a thread probes, starting from the one its id hashes to */
+    static const uint kMaxProbes = 8;
+
+    typedef struct {
+        /*! Id of the thread owning this slot (0 when free); only changed while holding the lock (see 'seq') */
+        volatile uint64_t tid;
+
+        /*! Odd while the slot is being written; readers give up when it changes under them */
+        volatile uint32_t seq;
+
+        /*! Process id of the owning thread */
+        pid_t pid;
+
+        /*! The value of 'clock_' when this slot was last written */
+        volatile uint64_t lastUse;
+
+        char path[MAXPATHLEN];
+    } Slot;
+
+    /* backing slots */
+    Slot *slots_;
+
+    /* Incremented every time a path is set */
+    volatile uint64_t clock_;
 
     static uint64_t self_tid()
     {
         return thread_tid(current_thread());
     }
 
+    static uint hash(uint64_t tid)
+    {
+        return (uint)((tid * 0x9E3779B97F4A7C15ull) >> 32);
+    }
+
+    /*! Returns the slot owned by the thread with id 'tid' or NULL if it doesn't own one */
+    Slot* findSlot(uint64_t tid) const;
+
+    /*! Returns the slot a thread with id 'tid' should claim when it doesn't own one */
+    Slot* pickSlotToClaim(uint64_t tid) const;
+
+    /*! Tries to become the only writer of 'slot'; 'outSeq' receives the value to pass to 'unlock' */
+    static bool tryLock(Slot *slot, uint32_t *outSeq);
+
+    static void unlock(Slot *slot, uint32_t seq);
+
 protected:
 
     /*!
@@ -44,42 +91,44 @@ protected:
 public:
 
     /*!
-     * @return Number of entries in this collection
+     * @return Number of slots currently owned by some thread
      */
-    uint getCount() { return dict_->getCount(); }
+    uint getCount() const;
 
     /*!
-     * @return Number of nodes in the underlying dictionary.
+     * @return Number of slots in this table.
      */
-    uint getNodeCount() { return dict_->getNodeCount(); }
+    uint getSlotCount() const { return kSlotCount; }
 
     /*!
-     * @return Size in bytes of each node in the underlying dictionary.
+     * @return Size in bytes of each slot in this table.
      */
-    uint getNodeSize() { return dict_->getNodeSize(); }
+    uint getSlotSize() const { return sizeof(Slot); }
 
     /*!
-     * Associates 'value' with current thread.
+     * Associates 'path' with current thread (which belongs to process 'pid').
      *
-     * @param value Value to associate with the current thread.
-     * @result is True when no previous value was associated with the current thread
-     *         and False when an existing value is updated to point to the new value.
+     * @result is True when the path was saved and False when it couldn't be saved because of a race.
      */
-    bool insert(const OSObject *value);
+    bool set(pid_t pid, const char *path);
 
     /*!
-     * Removes the value currently associated with the current thread (if any).
+     * Copies the path currently associated with the current thread (if any) into 'buffer'.
      *
-     * @result is True when there was a previous value was associated with the current
-     *         thread and False when there wasn't.
+     * @result is True when a path was copied and False when no path is associated with the current thread.
      */
-    bool remove();
+    bool get(char *buffer, size_t bufferSize) const;
 
     /*!
-     * @result the value currently associated with the current thread (if any).
+     * @result is True when 'path' is the path currently associated with the current thread (compared without copying it).
      */
-    OSObject* get() const;
-    
+    bool matches(const char *path) const;
+
+    /*!
+     * Releases all the slots owned by the threads of process 'pid'.
+     */
+    void removeForProcess(pid_t pid);
+
 #pragma mark Static Methods
 
     /*!
@@ -2,6 +2,7 @@
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
 
 #include "Trie.hpp"
+#include "Alloc.hpp"
 #include "Monitor.hpp"
 
 #define super OSObject
@@ -31,9 +32,14 @@ bool Trie::init(TrieKind kind)
 
     size_ = 0;
     nodeCount_ = 0;
-    kind_ = mergeKindAndImpl(kind, g_bxl_enable_light_trie ? kLightTrie : kFastTrie);
+    kind_ = mergeKindAndImpl(kind,
+                             g_bxl_enable_compact_trie ? kCompactTrie :
+                             g_bxl_enable_light_trie   ? kLightTrie :
+                             kFastTrie);
     onChangeData_ = nullptr;
     onChangeCallback_ = nullptr;
+    readers_ = 0;
+    retired_ = nullptr;
 
     lock_ = BXLRecursiveLockAlloc();
     if (!lock_)
@@ -57,6 +63,15 @@ void Trie::free()
                  OSSafeReleaseNULL(n);
              });
 
+    // no one can be reading from this trie anymore
+    while (retired_ != nullptr)
+    {
+        Retired *entry = retired_;
+        retired_ = entry->next;
+        OSSafeReleaseNULL(entry->record);
+        Alloc::Delete<Retired>(entry, 1);
+    }
+
     BXLRecursiveLockFree(lock_);
     lock_ = nullptr;
     root_ = nullptr;
@@ -100,6 +115,75 @@ OSObject* Trie::get(Node *node)
     return node != nullptr ? node->record_ : nullptr;
 }
 
+OSObject* Trie::getRetained(Node *node)
+{
+    // a record can only be released once there are no readers, so it's safe to retain it here
+    OSIncrementAtomic(&readers_);
+    OSObject *record = node != nullptr ? node->record_ : nullptr;
+    if (record != nullptr)
+    {
+        record->retain();
+    }
+
+    if (OSDecrementAtomic(&readers_) == 1 && retired_ != nullptr)
+    {
+        reclaim();
+    }
+
+    return record;
+}
+
+void Trie::retire(OSObject *record)
+{
+    Retired *entry = Alloc::New<Retired>(1);
+    if (entry == nullptr)
+    {
+        // can't defer releasing it --> wait for the current readers (which only retain a record) to finish
+        while (readers_ != 0);
+        OSSafeReleaseNULL(record);
+        return;
+    }
+
+    entry->record = record;
+    do
+    {
+        entry->next = retired_;
+    } while (!OSCompareAndSwapPtr(entry->next, entry, &retired_));
+
+    reclaim();
+}
+
+void Trie::reclaim()
+{
+    // take all the retired records: they were all removed from the trie before this point,
+    // so a reader that could have seen any of them must have been counted in 'readers_' already
+    Retired *list;
+    do
+    {
+        list = retired_;
+    } while (list != nullptr && !OSCompareAndSwapPtr(list, nullptr, &retired_));
+
+    bool noReaders = readers_ == 0;
+    while (list != nullptr)
+    {
+        Retired *entry = list;
+        list = entry->next;
+        if (noReaders)
+        {
+            OSSafeReleaseNULL(entry->record);
+            Alloc::Delete<Retired>(entry, 1);
+        }
+        else
+        {
+            // some reader may still be retaining it --> put it back
+            do
+            {
+                entry->next = retired_;
+            } while (!OSCompareAndSwapPtr(entry->next, entry, &retired_));
+        }
+    }
+}
+
 OSObject* Trie::getOrAdd(Node *node, void *factoryArgs, factory_fn factory, TrieResult *result)
 {
     if (node == nullptr) return nullptr;
@@ -123,8 +207,8 @@ Trie::TrieResult Trie::replace(Node *node, const OSObject *value)
 
         if (previousValue != nullptr)
         {
-            // this node was not empty --> release the previous record
-            OSSafeReleaseNULL(previousValue);
+            // this node was not empty --> release the previous record (once no one can be reading it)
+            retire(previousValue);
             return kTrieResultReplaced;
         }
         else
@@ -175,8 +259,8 @@ Trie::TrieResult Trie::remove(Node *node)
 
     if (OSCompareAndSwapPtr(previousValue, nullptr, &node->record_))
     {
-        // we updated record_ --> release previous value and decrease size
-        OSSafeReleaseNULL(previousValue);
+        // we updated record_ --> release previous value (once no one can be reading it) and decrease size
+        retire(previousValue);
         int oldCount = OSDecrementAtomic(&size_);
         triggerOnChange(oldCount, oldCount - 1);
         return kTrieResultRemoved;
@@ -548,15 +632,14 @@ void Trie::triggerOnChange(int oldCount, int newCount) const
 
 void Trie::forEach(void *callbackArgs, for_each_fn callback)
 {
-    typedef struct { for_each_fn callback; void *args; } State;
-    State state = { .callback = callback, .args = callbackArgs };
+    typedef struct { for_each_fn callback; void *args; Trie *me; } State;
+    State state = { .callback = callback, .args = callbackArgs, .me = this };
     traverse(/*computeKey*/ isUintTrie(), /*callbackArgs*/ &state, [](void *s, uint64_t key, Node *node)
              {
                  State *state = (State*)s;
-                 OSObject *record = node->record_;
+                 OSObject *record = state->me->getRetained(node);
                  if (record)
                  {
-                     record->retain();
                      state->callback(state->args, key, record);
                      record->release();
                  }
@@ -570,10 +653,9 @@ void Trie::removeMatching(void *filterArgs, filter_fn filter)
     traverse(/*computeKey*/ false, /*callbackArgs*/ &state, [](void *s, uint64_t, Node *node)
              {
                  State *state = (State*)s;
-                 OSObject *record = node->record_;
+                 OSObject *record = state->me->getRetained(node);
                  if (record)
                  {
-                     record->retain();
                      if (state->filter(state->args, record))
                      {
                          state->me->remove(node);
@@ -14,13 +14,15 @@
  *
  * Only 2 types of keys are allowed: (1) an unsigned integer, and (2) an ascii path.
  *
- * Additionally, two different implementations are provided: fast and light.  The former
- * is lock-free and fast but has a potentially huge memory footprint; the latter has a
- * much smaller memory footprint, is not lock-free, but still has good performance.
+ * Additionally, three different implementations are provided: fast, light, and compact.  The first
+ * is lock-free and fast but has a potentially huge memory footprint; the second has a
+ * much smaller memory footprint, is not lock-free, but still has good performance; the last
+ * one has lock-free lookups and a memory footprint close to the light one (see 'NodeCompact').
  *
  * Each node in a tree can be assigned a record which must be a pointer to an arbitrary OSObject.
  * Once an OSObject is added to a trie, it is automatically retained by the trie; once it is removed,
- * it is automatically released by this trie; this is analogous to how OSDictionary works.
+ * it is automatically released by this trie (as soon as no reader in 'getRetained' can be looking at it);
+ * this is analogous to how OSDictionary works.
  *
  * Paths are considered case-insensitive.  Attempting to add a path with a non-ascii
  * character will fail gracefully by returning 'kTrieResultFailure'.
@@ -51,17 +53,18 @@ public:
 private:
 
     const uint kKindBitMask = 1;
-    const uint kImplBitMask = 1 << 1;
+    const uint kImplShift   = 1;
 
     typedef enum { kUintTrie = 0, kPathTrie = 1 } TrieKind;
-    typedef enum { kFastTrie = 0, kLightTrie = 1 } TrieImpl;
+    typedef enum { kFastTrie = 0, kLightTrie = 1, kCompactTrie = 2 } TrieImpl;
 
-    uint mergeKindAndImpl(TrieKind knd, TrieImpl impl) { return kKindBitMask * knd + kImplBitMask * impl; }
+    uint mergeKindAndImpl(TrieKind knd, TrieImpl impl) { return knd + (impl << kImplShift); }
 
-    bool isUintTrie()  { return (kind_ & kKindBitMask) == kUintTrie; }
-    bool isPathTrie()  { return !isUintTrie(); }
-    bool isFastTrie()  { return (kind_ & kImplBitMask) == kFastTrie; }
-    bool isLightTrie() { return !isFastTrie(); }
+    bool isUintTrie()    { return (kind_ & kKindBitMask) == kUintTrie; }
+    bool isPathTrie()    { return !isUintTrie(); }
+    bool isFastTrie()    { return (kind_ >> kImplShift) == kFastTrie; }
+    bool isLightTrie()   { return (kind_ >> kImplShift) == kLightTrie; }
+    bool isCompactTrie() { return (kind_ >> kImplShift) == kCompactTrie; }
 
     /*! The root of the tree. */
     Node *root_;
@@ -84,6 +87,27 @@ private:
     /*! Used only when modifying a node's list of children */
     BXLRecursiveLock *lock_;
 
+    /*! A record that was removed from this trie but may still be looked at by a reader (see 'getRetained') */
+    typedef struct Retired {
+        OSObject *record;
+        Retired *next;
+    } Retired;
+
+    /*! Number of threads currently reading a record in 'getRetained' */
+    int readers_;
+
+    /*! Records waiting to be released once there are no readers (a lock-free stack) */
+    Retired *retired_;
+
+    /*!
+     * Instead of releasing a record that was just removed (or replaced), defers releasing it until no reader
+     * can be looking at it anymore, so that readers never have to take a lock (similar to RCU).
+     */
+    void retire(OSObject *record);
+
+    /*! Releases the retired records if there are no readers; otherwise leaves them for a later attempt. */
+    void reclaim();
+
     /*! Initialized a new Trie.  The return value indicates the success of the operation. */
     bool init(TrieKind kind);
 
@@ -120,6 +144,12 @@ private:
      */
     OSObject* get(Node *node);
 
+    /*!
+     * Same as 'get' except that the returned record is retained, which is safe to do even if the record is
+     * concurrently removed from this trie (see 'retire').  The caller is responsible for releasing it.
+     */
+    OSObject* getRetained(Node *node);
+
     /*!
      * Attempts to associate 'value' with 'node', even if there is already a value associated with 'node'.
      *
@@ -200,9 +230,10 @@ private:
     /*! Creates either a Uint or a Path node, based on the kind of this trie. */
     Node* createNode(uint key)
     {
-        Node* node = isLightTrie() ? (Node*)NodeLight::create(key) :
-                     isUintTrie()  ? (Node*)NodeFast::createUintNode() :
-                     isPathTrie()  ? (Node*)NodeFast::createPathNode() :
+        Node* node = isLightTrie()   ? (Node*)NodeLight::create(key) :
+                     isCompactTrie() ? (isUintTrie() ? (Node*)NodeCompact::createUintNode() : (Node*)NodeCompact::createPathNode()) :
+                     isUintTrie()    ? (Node*)NodeFast::createUintNode() :
+                     isPathTrie()    ? (Node*)NodeFast::createPathNode() :
                      nullptr;
         if (node != nullptr)
         {
@@ -234,7 +265,13 @@ public:
     /*!
      * Returns the size in bytes of each node in this tree.
      */
-    uint getNodeSize() { return isLightTrie() ? sizeof(NodeLight) : sizeof(NodeFast); }
+    uint getNodeSize()
+    {
+        return isLightTrie()   ? sizeof(NodeLight) :
+               isCompactTrie() ? sizeof(NodeCompact) :
+               sizeof(NodeFast);
+    }
+
     /*!
      * Callback to be invoked every time the size of this tree changes.
      */
@@ -309,6 +346,24 @@ public:
         return OSDynamicCast(T, get(key));
     }
 
+    /*!
+     * Returns the record associated with 'key' (cast to T) after retaining it, or NULL.
+     *
+     * Unlike 'get', this can be used by callers that don't otherwise synchronize with the removal of
+     * records from this trie.  The caller is responsible for releasing the returned object.
+     */
+    template<typename T>
+    T* getRetainedAs(uint64_t key)
+    {
+        OSObject *record = getRetained(findExistingNodeForUint(key));
+        T *result = OSDynamicCast(T, record);
+        if (result == nullptr)
+        {
+            OSSafeReleaseNULL(record);
+        }
+        return result;
+    }
+
     OSObject* getOrAdd(uint64_t key, void *factoryArgs, factory_fn factory, TrieResult *result = nullptr)
     {
         return getOrAdd(findOrCreateNodeForUint(key), factoryArgs, factory, result);
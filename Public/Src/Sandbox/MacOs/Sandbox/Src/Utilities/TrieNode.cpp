@@ -8,6 +8,7 @@
 OSDefineMetaClassAndAbstractStructors(Node, OSObject)
 OSDefineMetaClassAndStructors(NodeLight, Node)
 OSDefineMetaClassAndStructors(NodeFast, Node)
+OSDefineMetaClassAndStructors(NodeCompact, Node)
 
 uint Node::s_numUintNodes = 0;
 uint Node::s_numPathNodes = 0;
@@ -310,3 +311,235 @@ void NodeFast::traverse(bool computeKey, void *callbackArgs, traverse_fn callbac
         callback(callbackArgs, key, curr);
     }
 }
+
+// ============================== class NodeCompact ==============================
+
+NodeCompact* NodeCompact::create(uint maxKey)
+{
+    NodeCompact *instance = new NodeCompact;
+    if (instance == nullptr)
+    {
+        goto error;
+    }
+
+    if (!instance->init(maxKey))
+    {
+        goto error;
+    }
+
+    return instance;
+
+error:
+    OSSafeReleaseNULL(instance);
+    return nullptr;
+}
+
+bool NodeCompact::init(uint maxKey)
+{
+    if (!Node::init())
+    {
+        return false;
+    }
+
+    maxKey_   = maxKey;
+    children_ = nullptr;
+
+    return true;
+}
+
+void NodeCompact::free()
+{
+    // Intentionally not releasing the children nodes because Trie is responsible for releasing all its nodes
+    deleteChildren(children_);
+    children_ = nullptr;
+
+    Node::free();
+}
+
+NodeCompact::Children* NodeCompact::createChildren(uint capacity, bool direct)
+{
+    Children *children = (Children*)Alloc::New<char>(childrenSize(capacity));
+    if (children == nullptr)
+    {
+        return nullptr;
+    }
+
+    children->capacity = capacity;
+    children->direct   = direct;
+    children->retired  = nullptr;
+    for (int i = 0; i < capacity; i++)
+    {
+        children->nodes[i] = nullptr;
+    }
+
+    return children;
+}
+
+void NodeCompact::deleteChildren(Children *children)
+{
+    while (children != nullptr)
+    {
+        Children *retired = children->retired;
+        Alloc::Delete<char>((char*)children, childrenSize(children->capacity));
+        children = retired;
+    }
+}
+
+NodeCompact* NodeCompact::getChild(uint key) const
+{
+    Children *children = children_;
+    if (children == nullptr)
+    {
+        return nullptr;
+    }
+
+    if (children->direct)
+    {
+        return children->nodes[key];
+    }
+
+    // the key of a child is set before the child is published, and children are never moved within a block
+    for (int i = 0; i < children->capacity; i++)
+    {
+        NodeCompact *child = children->nodes[i];
+        if (child == nullptr)
+        {
+            return nullptr;
+        }
+        else if (children->keys[i] == key)
+        {
+            return child;
+        }
+    }
+
+    return nullptr;
+}
+
+NodeCompact* NodeCompact::addChild(uint key)
+{
+    Children *children = children_;
+    int numChildren = 0;
+    if (children != nullptr && !children->direct)
+    {
+        while (numChildren < children->capacity && children->nodes[numChildren] != nullptr)
+        {
+            numChildren++;
+        }
+    }
+
+    // the current block is either missing or full --> create a bigger one and copy the children over
+    if (children == nullptr || (!children->direct && numChildren == children->capacity))
+    {
+        uint capacity = children == nullptr                              ? s_minChildrenCapacity :
+                        children->capacity < s_maxSparseChildrenCapacity ? s_maxSparseChildrenCapacity :
+                        maxKey_;
+        bool direct = capacity >= maxKey_;
+        if (direct)
+        {
+            capacity = maxKey_;
+        }
+
+        Children *newChildren = createChildren(capacity, direct);
+        if (newChildren == nullptr)
+        {
+            return nullptr;
+        }
+
+        for (int i = 0; i < numChildren; i++)
+        {
+            if (direct)
+            {
+                newChildren->nodes[children->keys[i]] = children->nodes[i];
+            }
+            else
+            {
+                newChildren->keys[i]  = children->keys[i];
+                newChildren->nodes[i] = children->nodes[i];
+            }
+        }
+
+        // the old block is kept around because lock-free readers may still be looking at it
+        newChildren->retired = children;
+        if (!OSCompareAndSwapPtr(children, newChildren, &children_))
+        {
+            // can't happen since children are only added while holding the lock
+            newChildren->retired = nullptr;
+            deleteChildren(newChildren);
+            return nullptr;
+        }
+
+        children = newChildren;
+    }
+
+    NodeCompact *newNode = NodeCompact::create(maxKey_);
+    if (newNode == nullptr)
+    {
+        return nullptr;
+    }
+
+    int slot = children->direct ? key : numChildren;
+    if (!children->direct)
+    {
+        children->keys[slot] = key;
+    }
+
+    if (!OSCompareAndSwapPtr(nullptr, newNode, &children->nodes[slot]))
+    {
+        // can't happen since children are only added while holding the lock
+        OSSafeReleaseNULL(newNode);
+        return nullptr;
+    }
+
+    return newNode;
+}
+
+Node* NodeCompact::findChild(uint key, bool createIfMissing, BXLRecursiveLock *lock, bool *outNewNodeCreated)
+{
+    *outNewNodeCreated = false;
+
+    if (key < 0 || key >= maxKey_)
+    {
+        return nullptr;
+    }
+
+    NodeCompact *childNode = getChild(key);
+    if (childNode != nullptr || !createIfMissing)
+    {
+        return childNode;
+    }
+
+    // child is missing --> look again while holding the lock and add it if still missing
+    Monitor __monitor(lock);
+
+    childNode = getChild(key);
+    if (childNode != nullptr)
+    {
+        return childNode;
+    }
+
+    childNode = addChild(key);
+    *outNewNodeCreated = childNode != nullptr;
+    return childNode;
+}
+
+void NodeCompact::traverse(bool computeKey, void *callbackArgs, traverse_fn callback)
+{
+    Stack *stack = nullptr;
+    push(&stack, this, /*key*/ 0, /*depth*/ 0);
+    while (stack != nullptr)
+    {
+        uint64_t key = stack->key;
+        uint32_t depth = stack->depth;
+
+        NodeCompact *curr = (NodeCompact*)pop(&stack);
+        Children *children = curr->children_;
+        for (int i = 0; children != nullptr && i < children->capacity; ++i)
+        {
+            uint childKey = children->direct ? i : children->keys[i];
+            push(&stack, children->nodes[i], computeKey ? (childKey * pow10(depth) + key) : 0, depth + 1);
+        }
+
+        // the callback may deallocate 'curr' node, hence this must be the last statement in this loop
+        callback(callbackArgs, key, curr);
+    }
+}
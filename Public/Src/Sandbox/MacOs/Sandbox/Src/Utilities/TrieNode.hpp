@@ -12,6 +12,7 @@
 #define Node BXL_CLASS(Node)
 #define NodeLight BXL_CLASS(NodeLight)
 #define NodeFast BXL_CLASS(NodeFast)
+#define NodeCompact BXL_CLASS(NodeCompact)
 #define Trie BXL_CLASS(Trie)
 
 class Node;
@@ -147,4 +148,76 @@ protected:
     void free() override;
 };
 
+/* =================== class NodeCompact ====================== */
+
+/*!
+ * A node whose children are kept in a block that grows with the number of children, similar to the nodes
+ * of an adaptive radix tree: a leaf has no block, a node with up to 4 (and then 16) children keeps their keys
+ * next to them, and a node with more children gets a block with an entry for every possible key (like NodeFast).
+ *
+ * Lookups are lock-free: children are published with a CAS (like in NodeFast) and a block that is outgrown is
+ * not freed until the node is (a reader may still be looking at it), but kept in the 'retired' list of the new block.
+ * Adding a child (and growing the block) is done under the lock of the trie.
+ */
+class NodeCompact : public Node
+{
+    OSDeclareDefaultStructors(NodeCompact);
+
+private:
+
+    /*! The capacity of the first block of a node */
+    static const uint s_minChildrenCapacity = 4;
+
+    /*! The capacity of the largest block that keeps the keys of the children; the next one is a direct block */
+    static const uint s_maxSparseChildrenCapacity = 16;
+
+    typedef struct Children {
+        /*! The number of entries in 'nodes' */
+        uint capacity;
+
+        /*! When true, 'nodes' is indexed by key; otherwise, the child in 'nodes[i]' has key 'keys[i]' */
+        bool direct;
+
+        /*! The keys of the children, when not 'direct' */
+        uint8_t keys[s_maxSparseChildrenCapacity];
+
+        /*! The block this one replaced */
+        Children *retired;
+
+        /*! The children; the ones of a block that is not 'direct' are all at the front */
+        NodeCompact *nodes[0];
+    } Children;
+
+    /*! The number of possible keys of the children of this node (i.e., 's_uintNodeMaxKey' or 's_pathNodeMaxKey') */
+    uint maxKey_;
+
+    /*! The current block of children (NULL when there are none) */
+    Children *children_;
+
+    bool init(uint maxKey);
+
+    static NodeCompact* create(uint maxKey);
+
+    static size_t childrenSize(uint capacity) { return sizeof(Children) + capacity * sizeof(NodeCompact*); }
+    static Children* createChildren(uint capacity, bool direct);
+    static void deleteChildren(Children *children);
+
+    /*! Returns the child with key 'key' from the current block, or NULL if there is none */
+    NodeCompact* getChild(uint key) const;
+
+    /*! Adds a new child with key 'key', growing the block if needed.  Must be called while holding the lock of the trie. */
+    NodeCompact* addChild(uint key);
+
+public:
+
+    static NodeCompact* createUintNode() { return create(s_uintNodeMaxKey); }
+    static NodeCompact* createPathNode() { return create(s_pathNodeMaxKey); }
+
+protected:
+
+    Node* findChild(uint key, bool createIfMissing, BXLRecursiveLock *lock, bool *outNewNodeCreated) override;
+    void traverse(bool computeKey, void *callbackArgs, traverse_fn callback) override;
+    void free() override;
+};
+
 #endif /* TrieNode_hpp */
@@ -0,0 +1,111 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "VNodePathCache.hpp"
+#include "Alloc.hpp"
+
+#define super OSObject
+
+OSDefineMetaClassAndStructors(VNodePathCache, OSObject)
+
+VNodePathCache* VNodePathCache::create()
+{
+    VNodePathCache *instance = new VNodePathCache;
+    if (instance)
+    {
+        bool initialized = instance->init();
+        if (!initialized)
+        {
+            instance->release();
+            instance = nullptr;
+        }
+    }
+
+    return instance;
+}
+
+bool VNodePathCache::init()
+{
+    if (!super::init())
+    {
+        return false;
+    }
+
+    generation_ = 0;
+    slots_ = Alloc::New<Slot>(kSlotCount);
+    if (slots_ == nullptr)
+    {
+        return false;
+    }
+
+    for (int i = 0; i < kSlotCount; i++)
+    {
+        slots_[i].seq        = 0;
+        slots_[i].vnode      = nullptr;
+        slots_[i].vid        = 0;
+        slots_[i].generation = 0;
+        slots_[i].length     = 0;
+        slots_[i].path[0]    = '\0';
+    }
+
+    return true;
+}
+
+void VNodePathCache::free()
+{
+    if (slots_)
+    {
+        Alloc::Delete<Slot>(slots_, kSlotCount);
+        slots_ = nullptr;
+    }
+
+    super::free();
+}
+
+int VNodePathCache::getPath(vnode_t vp, char *buffer, int *length)
+{
+    int bufferSize = *length;
+    uint32_t vid = vnode_vid(vp);
+    uint64_t generation = generation_;
+    Slot *slot = slotFor(vp);
+
+    uint32_t seq = slot->seq;
+    if ((seq & 1) == 0 && slot->vnode == vp && slot->vid == vid && slot->generation == generation)
+    {
+        int len = slot->length;
+        if (len > 0 && len <= bufferSize && len <= sizeof(slot->path))
+        {
+            memcpy(buffer, slot->path, len);
+            OSMemoryBarrier();
+
+            // the copy is only good if no one wrote to the slot in the meantime
+            if (slot->seq == seq)
+            {
+                buffer[len - 1] = '\0';
+                *length = len;
+                return 0;
+            }
+        }
+    }
+
+    int err = vn_getpath(vp, buffer, length);
+    if (err != 0 || *length <= 0 || *length > sizeof(slot->path))
+    {
+        return err;
+    }
+
+    // remember the path unless someone else is writing to this slot right now
+    seq = slot->seq;
+    if ((seq & 1) == 0 && OSCompareAndSwap(seq, seq + 1, &slot->seq))
+    {
+        slot->vnode      = vp;
+        slot->vid        = vid;
+        slot->generation = generation;
+        slot->length     = *length;
+        memcpy(slot->path, buffer, *length);
+        OSMemoryBarrier();
+        OSCompareAndSwap(seq + 1, seq + 2, &slot->seq);
+    }
+
+    return 0;
+}
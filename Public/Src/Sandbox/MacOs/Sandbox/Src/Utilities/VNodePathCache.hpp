@@ -0,0 +1,110 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef VNodePathCache_hpp
+#define VNodePathCache_hpp
+
+#include <IOKit/IOService.h>
+#include <IOKit/IOLib.h>
+#include <sys/param.h>
+#include <sys/vnode.h>
+#include "BuildXLSandboxShared.hpp"
+
+#define VNodePathCache BXL_CLASS(VNodePathCache)
+
+/*!
+ * A fixed-size, direct-mapped table that remembers the paths of recently resolved vnodes, so that repeated
+ * accesses to the same file don't have to call 'vn_getpath' every time.
+ *
+ * A vnode is identified by its address together with its vid; the kernel changes the vid of a vnode when it
+ * is reclaimed, so an entry for a reclaimed (and possibly reused) vnode never matches again.  Renaming a file
+ * or a directory changes the paths of existing vnodes, so every rename bumps a generation number (see
+ * 'invalidateAll') which invalidates all entries at once.
+ *
+ * Neither lookups nor updates take a lock: every slot is guarded by a sequence number; a reader whose copy
+ * raced with a writer simply reports a miss, and a writer that finds a slot busy simply skips caching.
+ */
+class VNodePathCache : public OSObject
+{
+    OSDeclareDefaultStructors(VNodePathCache);
+
+private:
+
+    /*! Number of slots in the table */
+    static const uint kSlotCount = 256;
+
+    typedef struct {
+        /*! Odd while the slot is being written; readers give up when it changes under them */
+        volatile uint32_t seq;
+
+        /*! Identity of the vnode whose path is stored in this slot (NULL when free) */
+        vnode_t vnode;
+        uint32_t vid;
+
+        /*! The value of 'generation_' when the path was resolved */
+        uint64_t generation;
+
+        /*! Length of 'path' including the terminating '\0' (same as what 'vn_getpath' returns) */
+        int length;
+
+        char path[MAXPATHLEN];
+    } Slot;
+
+    /* backing slots */
+    Slot *slots_;
+
+    /* Incremented every time all entries must be invalidated */
+    volatile uint64_t generation_;
+
+    Slot* slotFor(vnode_t vp) const
+    {
+        return &slots_[(uint)((((uint64_t)vp) * 0x9E3779B97F4A7C15ull) >> 32) % kSlotCount];
+    }
+
+protected:
+
+    bool init() override;
+    void free() override;
+
+public:
+
+    /*!
+     * @return Number of slots in this table.
+     */
+    uint getSlotCount() const { return kSlotCount; }
+
+    /*!
+     * @return Size in bytes of each slot in this table.
+     */
+    uint getSlotSize() const { return sizeof(Slot); }
+
+    /*!
+     * Invalidates all the entries (e.g., because a file or a directory was renamed).
+     */
+    void invalidateAll() { OSIncrementAtomic64((volatile SInt64*)&generation_); }
+
+    /*!
+     * Same contract as 'vn_getpath': copies the path of 'vp' into 'buffer' and sets '*length' to the length of
+     * the path including the terminating '\0'.  The path is served from the table when possible, otherwise it is
+     * resolved with 'vn_getpath' and remembered.
+     *
+     * @result 0 when successful, the error returned by 'vn_getpath' otherwise.
+     */
+    int getPath(vnode_t vp, char *buffer, int *length);
+
+#pragma mark Static Methods
+
+    /*!
+     * Factory method, following the OSObject pattern.
+     *
+     * First creates an object (by calling 'new'), then invokes 'init' on the newly create object.
+     *
+     * If either of the steps fails, nullptr is returned.
+     *
+     * When object creation succeeds but initialization fails, 'release' is called on the created
+     * object and nullptr is returned.
+     */
+    static VNodePathCache* create();
+};
+
+#endif /* VNodePathCache_hpp */
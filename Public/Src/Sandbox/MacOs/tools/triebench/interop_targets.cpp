@@ -0,0 +1,48 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+// The trie of the interop library, with the record type the detours library uses (see Trie.cpp and PathCacheEntry.hpp)
+
+#include <string.h>
+
+#include "Trie.hpp"
+#include "PathCacheEntry.hpp"
+#include "trie_bench.hpp"
+
+typedef Trie<PathCacheEntry> PathTrie;
+
+// Every entry is the same record: what's measured is the dictionary, not allocating and freeing records
+static const std::shared_ptr<PathCacheEntry> s_record = std::make_shared<PathCacheEntry>("/", 1);
+
+static inline bool Added(TrieResult result)
+{
+    return result == kTrieResultInserted || result == kTrieResultAlreadyExists;
+}
+
+static void* CreateTrie(bool pathKeys)  { return pathKeys ? PathTrie::createPathTrie() : PathTrie::createUintTrie(); }
+static void DestroyTrie(void *dict)     { delete (PathTrie *)dict; }
+
+static bool InsertPath(void *dict, const char *path) { return Added(((PathTrie *)dict)->insert(path, s_record)); }
+static bool GetPath(void *dict, const char *path)    { return ((PathTrie *)dict)->get(path) != nullptr; }
+static bool RemovePath(void *dict, const char *path) { return ((PathTrie *)dict)->remove(path) == kTrieResultRemoved; }
+
+static bool InsertUint(void *dict, uint64_t key) { return Added(((PathTrie *)dict)->insert(key, s_record)); }
+static bool GetUint(void *dict, uint64_t key)    { return ((PathTrie *)dict)->get(key) != nullptr; }
+static bool RemoveUint(void *dict, uint64_t key) { return ((PathTrie *)dict)->remove(key) == kTrieResultRemoved; }
+
+static int64_t MemoryBytes()
+{
+    uint count;
+    double uintMB, pathMB;
+    PathTrie::getUintNodeCounts(&count, &uintMB);
+    PathTrie::getPathNodeCounts(&count, &pathMB);
+    return (int64_t)((uintMB + pathMB) * (1 << 20));
+}
+
+const TrieBenchTarget g_interopTargets[] =
+{
+    { "interop", "interop Trie<T> (arena-allocated nodes and edges, lock-free lookups)",
+      CreateTrie, DestroyTrie, InsertPath, GetPath, RemovePath, InsertUint, GetUint, RemoveUint, MemoryBytes },
+};
+
+const size_t g_interopTargetCount = sizeof(g_interopTargets) / sizeof(g_interopTargets[0]);
@@ -0,0 +1,102 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+// The tries (and the process table) of the kext, built against the OSObject shims (see shims/IOKit)
+
+#include "ProcessTable.hpp"
+#include "Trie.hpp"
+#include "trie_bench.hpp"
+
+// The sysctls of the kext (see SysCtl.cpp): the layout of a trie is picked by the first two when it is created
+int g_bxl_enable_light_trie        = 0;
+int g_bxl_enable_compact_trie      = 0;
+int g_bxl_enable_counters          = 0;
+int g_bxl_verbose_logging          = 0;
+int g_bxl_enable_cache             = 1;
+int g_bxl_path_cache_max_size_mb   = 0;
+int g_bxl_enable_vnode_path_cache  = 0;
+
+os_log_t logger = OS_LOG_DEFAULT;
+
+int64_t g_ioMallocBytes = 0;
+
+#define BenchRecord BXL_CLASS(BenchRecord)
+
+class BenchRecord : public OSObject
+{
+    OSDeclareDefaultStructors(BenchRecord);
+};
+
+OSDefineMetaClassAndStructors(BenchRecord, OSObject)
+
+// Every entry is the same record: what's measured is the dictionary, not allocating and freeing records
+static BenchRecord *s_record = new BenchRecord;
+
+static inline bool Added(Trie::TrieResult result)
+{
+    return result == Trie::kTrieResultInserted || result == Trie::kTrieResultAlreadyExists;
+}
+
+template <int light, int compact>
+static void* CreateTrie(bool pathKeys)
+{
+    g_bxl_enable_light_trie   = light;
+    g_bxl_enable_compact_trie = compact;
+    return pathKeys ? Trie::createPathTrie() : Trie::createUintTrie();
+}
+
+static void DestroyTrie(void *dict)        { ((Trie *)dict)->release(); }
+
+static bool InsertPath(void *dict, const char *path) { return Added(((Trie *)dict)->insert(path, s_record)); }
+static bool GetPath(void *dict, const char *path)    { return ((Trie *)dict)->get(path) != nullptr; }
+static bool RemovePath(void *dict, const char *path) { return ((Trie *)dict)->remove(path) == Trie::kTrieResultRemoved; }
+
+static bool InsertUint(void *dict, uint64_t key) { return Added(((Trie *)dict)->insert(key, s_record)); }
+static bool RemoveUint(void *dict, uint64_t key) { return ((Trie *)dict)->remove(key) == Trie::kTrieResultRemoved; }
+
+// Like the listeners look up processes (see ProcessTable::getRetainedAs)
+static bool GetUint(void *dict, uint64_t key)
+{
+    BenchRecord *record = ((Trie *)dict)->getRetainedAs<BenchRecord>(key);
+    bool found = record != nullptr;
+    OSSafeReleaseNULL(record);
+    return found;
+}
+
+static void* CreateProcessTable(bool pathKeys) { return pathKeys ? nullptr : ProcessTable::create(); }
+
+static void DestroyProcessTable(void *dict) { ((ProcessTable *)dict)->release(); }
+
+static bool InsertPid(void *dict, uint64_t pid)
+{
+    return Added(((ProcessTable *)dict)->insert(pid, s_record));
+}
+
+static bool GetPid(void *dict, uint64_t pid)
+{
+    BenchRecord *record = ((ProcessTable *)dict)->getRetainedAs<BenchRecord>(pid);
+    bool found = record != nullptr;
+    OSSafeReleaseNULL(record);
+    return found;
+}
+
+static bool RemovePid(void *dict, uint64_t pid)
+{
+    return ((ProcessTable *)dict)->remove(pid) == Trie::kTrieResultRemoved;
+}
+
+static int64_t MemoryBytes() { return __atomic_load_n(&g_ioMallocBytes, __ATOMIC_RELAXED); }
+
+const TrieBenchTarget g_kextTargets[] =
+{
+    { "kext-fast",    "kext Trie, NodeFast (lock-free, 65 children per path node)",
+      CreateTrie<0, 0>, DestroyTrie, InsertPath, GetPath, RemovePath, InsertUint, GetUint, RemoveUint, MemoryBytes },
+    { "kext-light",   "kext Trie, NodeLight (sorted children under the trie lock)",
+      CreateTrie<1, 0>, DestroyTrie, InsertPath, GetPath, RemovePath, InsertUint, GetUint, RemoveUint, MemoryBytes },
+    { "kext-compact", "kext Trie, NodeCompact (lock-free lookups, growable children)",
+      CreateTrie<0, 1>, DestroyTrie, InsertPath, GetPath, RemovePath, InsertUint, GetUint, RemoveUint, MemoryBytes },
+    { "kext-pids",    "kext ProcessTable (pid keys only)",
+      CreateProcessTable, DestroyProcessTable, nullptr, nullptr, nullptr, InsertPid, GetPid, RemovePid, MemoryBytes },
+};
+
+const size_t g_kextTargetCount = sizeof(g_kextTargets) / sizeof(g_kextTargets[0]);
@@ -0,0 +1,146 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef TrieBench_IOLib_h
+#define TrieBench_IOLib_h
+
+/*
+ * User-space stand-ins for the parts of the kernel's IOLib (and libkern's OSAtomic) the kext utilities use: allocations
+ * (counted, see 'g_ioMallocBytes'), locks (on top of pthreads), atomics (the compiler's builtins) and sleeping.
+ */
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../kern/assert.h"
+#include "../libkern/libkern.h"
+#include "../mach/mach_types.h"
+
+typedef int8_t   SInt8;
+typedef int16_t  SInt16;
+typedef int32_t  SInt32;
+typedef int64_t  SInt64;
+typedef uint8_t  UInt8;
+typedef uint16_t UInt16;
+typedef uint32_t UInt32;
+typedef uint64_t UInt64;
+typedef unsigned int uint;
+typedef int IOReturn;
+
+#define kIOReturnSuccess 0
+#define kIOReturnError   0x2bc
+
+#define THREAD_UNINT        0
+#define THREAD_INTERRUPTIBLE 1
+
+/*! The number of bytes currently allocated through IOMalloc (and by 'new' for OSObjects, see IOService.h) */
+extern int64_t g_ioMallocBytes;
+
+static inline void* IOMalloc(size_t size)
+{
+    void *result = malloc(size);
+    if (result != nullptr)
+    {
+        __atomic_add_fetch(&g_ioMallocBytes, (int64_t)size, __ATOMIC_RELAXED);
+    }
+    return result;
+}
+
+static inline void IOFree(void *address, size_t size)
+{
+    if (address != nullptr)
+    {
+        __atomic_sub_fetch(&g_ioMallocBytes, (int64_t)size, __ATOMIC_RELAXED);
+        free(address);
+    }
+}
+
+static inline void IOSleep(unsigned milliseconds)
+{
+    usleep(milliseconds * 1000);
+}
+
+static inline void IOLog(const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+}
+
+#pragma mark Atomics
+
+// Like the kernel's, these return the value before the update; the casts match the macros of libkern/OSAtomic.h
+#define OSIncrementAtomic(address)           __atomic_fetch_add((volatile SInt32 *)(address), 1, __ATOMIC_SEQ_CST)
+#define OSDecrementAtomic(address)           __atomic_fetch_sub((volatile SInt32 *)(address), 1, __ATOMIC_SEQ_CST)
+#define OSAddAtomic(amount, address)         __atomic_fetch_add((volatile SInt32 *)(address), (SInt32)(amount), __ATOMIC_SEQ_CST)
+#define OSAddAtomic64(amount, address)       __atomic_fetch_add((volatile SInt64 *)(address), (SInt64)(amount), __ATOMIC_SEQ_CST)
+#define OSIncrementAtomic8(address)          __atomic_fetch_add((volatile SInt8 *)(address), 1, __ATOMIC_SEQ_CST)
+#define OSMemoryBarrier()                    __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+static inline bool OSCompareAndSwap(UInt32 oldValue, UInt32 newValue, volatile void *address)
+{
+    return __atomic_compare_exchange_n((volatile UInt32 *)address, &oldValue, newValue, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+static inline bool OSCompareAndSwapPtr(const void *oldValue, const void *newValue, volatile void *address)
+{
+    void *expected = (void *)oldValue;
+    return __atomic_compare_exchange_n((void * volatile *)address, &expected, (void *)newValue, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+#pragma mark Locks
+
+typedef struct { pthread_mutex_t mutex; } IORecursiveLock;
+typedef struct { pthread_mutex_t mutex; pthread_cond_t cond; } IOLock;
+typedef struct { pthread_rwlock_t rwlock; } IORWLock;
+
+static inline IORecursiveLock* IORecursiveLockAlloc()
+{
+    IORecursiveLock *lock = (IORecursiveLock *)malloc(sizeof(IORecursiveLock));
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&lock->mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+    return lock;
+}
+
+static inline void IORecursiveLockFree(IORecursiveLock *lock)   { pthread_mutex_destroy(&lock->mutex); free(lock); }
+static inline void IORecursiveLockLock(IORecursiveLock *lock)   { pthread_mutex_lock(&lock->mutex); }
+static inline void IORecursiveLockUnlock(IORecursiveLock *lock) { pthread_mutex_unlock(&lock->mutex); }
+
+static inline IOLock* IOLockAlloc()
+{
+    IOLock *lock = (IOLock *)malloc(sizeof(IOLock));
+    pthread_mutex_init(&lock->mutex, nullptr);
+    pthread_cond_init(&lock->cond, nullptr);
+    return lock;
+}
+
+static inline void IOLockFree(IOLock *lock)   { pthread_cond_destroy(&lock->cond); pthread_mutex_destroy(&lock->mutex); free(lock); }
+static inline void IOLockLock(IOLock *lock)   { pthread_mutex_lock(&lock->mutex); }
+static inline void IOLockUnlock(IOLock *lock) { pthread_mutex_unlock(&lock->mutex); }
+
+// Every waiter of a lock is woken up regardless of its event: the callers re-check their condition in a loop
+static inline int IOLockSleep(IOLock *lock, void *event, UInt32 interType) { return pthread_cond_wait(&lock->cond, &lock->mutex); }
+static inline void IOLockWakeup(IOLock *lock, void *event, bool oneThread) { pthread_cond_broadcast(&lock->cond); }
+
+static inline IORWLock* IORWLockAlloc()
+{
+    IORWLock *lock = (IORWLock *)malloc(sizeof(IORWLock));
+    pthread_rwlock_init(&lock->rwlock, nullptr);
+    return lock;
+}
+
+static inline void IORWLockFree(IORWLock *lock)   { pthread_rwlock_destroy(&lock->rwlock); free(lock); }
+static inline void IORWLockRead(IORWLock *lock)   { pthread_rwlock_rdlock(&lock->rwlock); }
+static inline void IORWLockWrite(IORWLock *lock)  { pthread_rwlock_wrlock(&lock->rwlock); }
+static inline void IORWLockUnlock(IORWLock *lock) { pthread_rwlock_unlock(&lock->rwlock); }
+
+#endif /* TrieBench_IOLib_h */
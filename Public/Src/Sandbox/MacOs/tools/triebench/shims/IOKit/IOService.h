@@ -0,0 +1,107 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef TrieBench_IOService_h
+#define TrieBench_IOService_h
+
+/*
+ * A user-space stand-in for libkern's OSObject: reference counting (an object is freed once its last reference is released,
+ * with 'free' overridden the way the kext classes do), the structors and meta class declarations (which only count instances),
+ * and allocations that are counted along with the IOMalloc ones, so that the memory a trie takes up can be measured.
+ */
+
+#include <atomic>
+#include <new>
+#include <stddef.h>
+
+#include "IOLib.h"
+
+class OSMetaClass
+{
+public:
+    const char *className;
+    size_t classSize;
+    mutable std::atomic<int> instanceCount;
+
+    OSMetaClass(const char *name, size_t size) : className(name), classSize(size), instanceCount(0) { }
+
+    int getInstanceCount() const { return instanceCount.load(std::memory_order_relaxed); }
+};
+
+class OSObject
+{
+private:
+    mutable std::atomic<int> retainCount_;
+
+public:
+    OSObject() : retainCount_(1) { }
+    virtual ~OSObject() { }
+
+    OSObject(const OSObject&) = delete;
+    OSObject& operator=(const OSObject&) = delete;
+
+    static void* operator new(size_t size)
+    {
+        void *result = IOMalloc(size);
+        if (result == nullptr)
+        {
+            throw std::bad_alloc();
+        }
+        return result;
+    }
+
+    static void operator delete(void *address, size_t size) { IOFree(address, size); }
+
+    virtual bool init() { return true; }
+    virtual void free() { delete this; }
+
+    void retain() const { retainCount_.fetch_add(1, std::memory_order_relaxed); }
+
+    void release() const
+    {
+        if (retainCount_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            const_cast<OSObject *>(this)->free();
+        }
+    }
+
+    int getRetainCount() const { return retainCount_.load(std::memory_order_relaxed); }
+};
+
+#define OSDeclareCommonStructors(className)                                      \
+    public:                                                                     \
+        static OSMetaClass gMetaClass;                                          \
+        static const OSMetaClass * const metaClass;                             \
+    private:
+
+#define OSDeclareDefaultStructors(className)                                     \
+    OSDeclareCommonStructors(className)                                         \
+    public:                                                                     \
+        className();                                                            \
+    protected:                                                                  \
+        virtual ~className();                                                   \
+    private:
+
+#define OSDeclareAbstractStructors(className)                                    \
+    OSDeclareCommonStructors(className)                                         \
+    protected:                                                                  \
+        className();                                                            \
+        virtual ~className();                                                   \
+    private:
+
+#define OSDefineMetaClassAndStructors(className, superclassName)                 \
+    OSMetaClass className::gMetaClass(#className, sizeof(className));            \
+    const OSMetaClass * const className::metaClass = &className::gMetaClass;    \
+    className::className() { gMetaClass.instanceCount++; }                       \
+    className::~className() { gMetaClass.instanceCount--; }
+
+#define OSDefineMetaClassAndAbstractStructors(className, superclassName)         \
+    OSDefineMetaClassAndStructors(className, superclassName)
+
+#define OSDynamicCast(type, instance) \
+    (dynamic_cast<type *>(const_cast<OSObject *>(static_cast<const OSObject *>(instance))))
+
+#define OSSafeReleaseNULL(instance) \
+    do { if ((instance) != nullptr) { (instance)->release(); (instance) = nullptr; } } while (0)
+
+#endif /* TrieBench_IOService_h */
@@ -0,0 +1,12 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef TrieBench_libkern_h
+#define TrieBench_libkern_h
+
+// The C library functions libkern provides to the kernel
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#endif /* TrieBench_libkern_h */
@@ -0,0 +1,93 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef TrieBench_liblfds711_h
+#define TrieBench_liblfds711_h
+
+/*
+ * A stand-in for the (lock-free) freelist of liblfds 7.1.1 that Alloc's zones are built on, guarded by a spin lock.  The bench
+ * never initializes the zones (see trie_bench.cpp), so the utilities allocate straight from IOMalloc and this is only compiled.
+ *
+ * NOTE: included from within an extern "C" block (see Alloc.hpp), hence plain C only.
+ */
+
+#include <stddef.h>
+
+#define LFDS711_PAL_ATOMIC_ISOLATION_IN_BYTES 128
+
+struct lfds711_freelist_element
+{
+    struct lfds711_freelist_element *next;
+    void *value;
+};
+
+struct lfds711_freelist_state
+{
+    int lock;
+    struct lfds711_freelist_element *top;
+    void *user_state;
+};
+
+#define LFDS711_FREELIST_SET_VALUE_IN_ELEMENT(element, new_value) ((element).value = (void *)(new_value))
+#define LFDS711_FREELIST_GET_VALUE_FROM_ELEMENT(element)          ((element).value)
+
+#define LFDS711_MISC_MAKE_VALID_ON_CURRENT_LOGICAL_CORE_INITS_COMPLETED_BEFORE_NOW_ON_ANY_OTHER_LOGICAL_CORE __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+static inline void lfds711_freelist_lock(struct lfds711_freelist_state *fs)
+{
+    while (__atomic_exchange_n(&fs->lock, 1, __ATOMIC_ACQUIRE)) { }
+}
+
+static inline void lfds711_freelist_unlock(struct lfds711_freelist_state *fs)
+{
+    __atomic_store_n(&fs->lock, 0, __ATOMIC_RELEASE);
+}
+
+static inline void lfds711_freelist_init_valid_on_current_logical_core(struct lfds711_freelist_state *fs,
+                                                                       struct lfds711_freelist_element **elimination_array,
+                                                                       size_t elimination_array_size_in_elements,
+                                                                       void *user_state)
+{
+    fs->lock = 0;
+    fs->top = NULL;
+    fs->user_state = user_state;
+}
+
+static inline void lfds711_freelist_cleanup(struct lfds711_freelist_state *fs,
+                                            void (*element_cleanup_callback)(struct lfds711_freelist_state *fs,
+                                                                             struct lfds711_freelist_element *fe))
+{
+    struct lfds711_freelist_element *fe = fs->top;
+    fs->top = NULL;
+    while (fe != NULL)
+    {
+        struct lfds711_freelist_element *next = fe->next;
+        if (element_cleanup_callback != NULL)
+        {
+            element_cleanup_callback(fs, fe);
+        }
+        fe = next;
+    }
+}
+
+static inline void lfds711_freelist_push(struct lfds711_freelist_state *fs, struct lfds711_freelist_element *fe, void *psl)
+{
+    lfds711_freelist_lock(fs);
+    fe->next = fs->top;
+    fs->top = fe;
+    lfds711_freelist_unlock(fs);
+}
+
+static inline int lfds711_freelist_pop(struct lfds711_freelist_state *fs, struct lfds711_freelist_element **fe, void *psl)
+{
+    lfds711_freelist_lock(fs);
+    *fe = fs->top;
+    if (*fe != NULL)
+    {
+        fs->top = (*fe)->next;
+    }
+    lfds711_freelist_unlock(fs);
+    return *fe != NULL;
+}
+
+#endif /* TrieBench_liblfds711_h */
@@ -0,0 +1,21 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef TrieBench_libproc_h
+#define TrieBench_libproc_h
+
+// Only for compiling PathCacheEntry.hpp (the record type of the interop trie) where there is no libproc (i.e., not on macOS)
+
+#include <assert.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifndef F_GETPATH
+#define F_GETPATH 50
+#endif
+
+extern "C" int proc_pidpath(int pid, void *buffer, uint32_t bufferSize);
+
+#endif /* TrieBench_libproc_h */
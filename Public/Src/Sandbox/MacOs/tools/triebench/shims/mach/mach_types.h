@@ -0,0 +1,20 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef TrieBench_mach_types_h
+#define TrieBench_mach_types_h
+
+#if __APPLE__
+#include_next <mach/mach_types.h>
+#else
+#include <stdint.h>
+
+typedef int      kern_return_t;
+typedef uint64_t mach_vm_address_t;
+typedef uint64_t mach_vm_size_t;
+
+#define KERN_SUCCESS 0
+#define KERN_FAILURE 5
+#endif
+
+#endif /* TrieBench_mach_types_h */
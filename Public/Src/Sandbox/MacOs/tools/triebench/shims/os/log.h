@@ -0,0 +1,24 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef TrieBench_os_log_h
+#define TrieBench_os_log_h
+
+#if __APPLE__
+#include_next <os/log.h>
+#else
+#include <stdio.h>
+
+typedef void *os_log_t;
+
+#define OS_LOG_DEFAULT nullptr
+
+#define os_log_create(subsystem, category) nullptr
+
+#define os_log(log, format, ...)       fprintf(stderr, format "\n", ##__VA_ARGS__)
+#define os_log_info(log, format, ...)  fprintf(stderr, format "\n", ##__VA_ARGS__)
+#define os_log_debug(log, format, ...) fprintf(stderr, format "\n", ##__VA_ARGS__)
+#define os_log_error(log, format, ...) fprintf(stderr, format "\n", ##__VA_ARGS__)
+#endif
+
+#endif /* TrieBench_os_log_h */
@@ -0,0 +1,28 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef TrieBench_prelude_h
+#define TrieBench_prelude_h
+
+/*
+ * Included ahead of every kext source (see the Makefile): the kext headers define macros that clash with the C and C++
+ * standard libraries (e.g., 'log' in BuildXLSandboxShared.hpp, 'wprintf' in stdafx-mac-kext.h), which is harmless only if
+ * the standard headers the shims need have been read before.
+ */
+
+#include <assert.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <wchar.h>
+
+#include <atomic>
+#include <new>
+#include <string>
+
+#endif /* TrieBench_prelude_h */
@@ -0,0 +1,9 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+// Shadows Linux/stdafx-linux.h, which DetoursServices/stdafx.h picks outside macOS: the kext sources get the kext flavor
+// of stdafx on any host
+
+#include "stdafx-mac-kext.h"
@@ -0,0 +1,12 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef TrieBench_sys_sysctl_h
+#define TrieBench_sys_sysctl_h
+
+// The kext utilities only declare the globals its sysctls are backed by (see SysCtl.hpp), which the bench defines itself
+#if __APPLE__
+#include_next <sys/sysctl.h>
+#endif
+
+#endif /* TrieBench_sys_sysctl_h */
@@ -0,0 +1,10 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef TrieBench_sys_systm_h
+#define TrieBench_sys_systm_h
+
+// Kernel-only header: all the kext utilities need from it is the C library (see libkern.h)
+#include "../libkern/libkern.h"
+
+#endif /* TrieBench_sys_systm_h */
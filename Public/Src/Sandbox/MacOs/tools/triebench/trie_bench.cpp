@@ -0,0 +1,392 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+/*
+ * Concurrency benchmark of the tries of the kext and of the interop library, run in user space (see the Makefile).
+ *
+ *   trie_bench [-t <threads,...>] [-k path|pid|both] [-n <entries>] [-g <gets per entry>] [-i <target,...>]
+ *
+ * For every target (see trie_bench.hpp), kind of keys and number of threads (1 to 64, default 1,2,4,8,16,32,64), a fresh
+ * dictionary is filled with the keys by all the threads at once, then looked up (with 1 in 10 lookups missing), then emptied
+ * again, and the throughput of each phase is reported along with the memory the dictionary took up per entry when full.
+ * Threads insert and remove interleaved keys (thread i the keys i, i + threads, ...), so that they contend on the same
+ * nodes the way concurrent pips do.
+ *
+ * The keys are generated deterministically, to look like what the kext tracks:
+ *   - paths: files under a few roots (a build's repo and output directories, an SDK, the temp directory) that share long
+ *     prefixes, with a skewed choice of directory names so that some directories are much wider than others;
+ *   - pids: a run of mostly consecutive pids (as processes get launched one after another), wrapping around at 99999.
+ *
+ * The kext utilities are compiled against the shims in 'shims' (OSObject, IOLib, ...), which allocate with malloc: the
+ * numbers tell how layouts compare to one another, not what they cost in the kernel.  Alloc's zones are not initialized,
+ * so blocks of children go straight to the (counted) IOMalloc shim.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "trie_bench.hpp"
+
+static const int   kMaxThreads = 64;
+static const uint  kMaxPid     = 99999;
+static const uint  kMissEvery  = 10;
+
+typedef struct
+{
+    std::vector<int> threads;
+    bool paths;
+    bool pids;
+    size_t entries;
+    size_t getsPerEntry;
+    std::vector<std::string> targets;
+} Options;
+
+typedef struct
+{
+    std::vector<std::string> paths;
+    std::vector<uint64_t> uints;
+} Keys;
+
+typedef struct
+{
+    double insertNs;
+    double getNs;
+    double removeNs;
+    double bytesPerEntry;
+    size_t errors;
+} Result;
+
+static inline uint64_t now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void usage()
+{
+    fprintf(stderr, "usage: trie_bench [-t <threads,...>] [-k path|pid|both] [-n <entries>] [-g <gets per entry>] [-i <target,...>]\n");
+    exit(1);
+}
+
+static std::vector<std::string> split(const char *list)
+{
+    std::vector<std::string> result;
+    std::string item;
+    for (const char *c = list; ; c++)
+    {
+        if (*c == ',' || *c == '\0')
+        {
+            if (!item.empty()) result.push_back(item);
+            item.clear();
+            if (*c == '\0') break;
+        }
+        else
+        {
+            item += *c;
+        }
+    }
+    return result;
+}
+
+// ------------------------------------------------------------------------------------------------------------------
+// Keys
+// ------------------------------------------------------------------------------------------------------------------
+
+static const char *kRoots[] =
+{
+    "/Users/runner/work/1/s/",
+    "/Users/runner/work/1/s/Out/Objects/",
+    "/Applications/Xcode.app/Contents/Developer/Platforms/MacOSX.platform/Developer/SDKs/MacOSX.sdk/usr/include/",
+    "/private/var/folders/5x/0lx8vdxs4xl2gqctb4w3cmc00000gn/T/",
+};
+
+static const char *kNames[] =
+{
+    "Public", "Src", "Engine", "Cache", "Sandbox", "Tools", "Utilities", "Core", "Collections", "Storage", "Processes",
+    "Scheduler", "FrontEnd", "Script", "Interop", "Native", "Test", "UnitTests", "Ide", "Pips", "Graph", "Distribution",
+    "Configuration", "Tracing", "Serialization", "obj", "bin", "debug", "release", "netcoreapp", "osx-x64", "include",
+    "sys", "mach", "libkern", "IOKit", "net", "netinet", "resources", "generated",
+};
+
+static const char *kExtensions[] = { ".cs", ".cpp", ".hpp", ".h", ".dll", ".pdb", ".json", ".txt", ".o", ".dsc" };
+
+template <typename T, size_t N>
+static constexpr size_t countof(T (&)[N]) { return N; }
+
+// Skewed towards the first few of 'count' items
+static inline size_t skewed(std::mt19937_64 &rng, size_t count)
+{
+    double u = std::uniform_real_distribution<double>(0, 1)(rng);
+    return std::min(count - 1, (size_t)(u * u * u * count));
+}
+
+static std::string random_path(std::mt19937_64 &rng)
+{
+    std::string path = kRoots[skewed(rng, countof(kRoots))];
+    size_t depth = 1 + std::uniform_int_distribution<size_t>(0, 6)(rng);
+    for (size_t i = 0; i < depth; i++)
+    {
+        path += kNames[skewed(rng, countof(kNames))];
+        if (rng() % 4 == 0)
+        {
+            path += std::to_string(skewed(rng, 64));
+        }
+        path += '/';
+    }
+
+    path += kNames[rng() % countof(kNames)];
+    path += '_';
+    path += std::to_string(rng() % 10000);
+    path += kExtensions[rng() % countof(kExtensions)];
+    return path;
+}
+
+// 'present' keys are inserted; 'absent' ones (a tenth as many) are only looked up
+static void generate_keys(const Options &options, Keys &present, Keys &absent)
+{
+    std::mt19937_64 rng(0x6275696c64786cULL);
+
+    size_t absentCount = std::max<size_t>(1, options.entries / kMissEvery);
+    if (options.paths)
+    {
+        std::unordered_set<std::string> seen;
+        while (present.paths.size() + absent.paths.size() < options.entries + absentCount)
+        {
+            std::string path = random_path(rng);
+            if (!seen.insert(path).second) continue;
+            (present.paths.size() < options.entries ? present.paths : absent.paths).push_back(path);
+        }
+    }
+
+    if (options.pids)
+    {
+        // a run of consecutive pids (with the odd gap) wrapping around, of which every 10th is absent (already exited)
+        size_t count = std::min<size_t>(options.entries + absentCount, kMaxPid - 100);
+        uint64_t pid = 300 + rng() % 1000;
+        for (size_t i = 0; i < count; i++)
+        {
+            pid += 1 + (rng() % 8 == 0 ? rng() % 4 : 0);
+            if (pid > kMaxPid) pid = 100 + pid % kMaxPid;
+            (i % kMissEvery == kMissEvery - 1 ? absent.uints : present.uints).push_back(pid);
+        }
+
+        // pids run over their range at most once, but the gaps may make them run into the first ones
+        std::unordered_set<uint64_t> seen;
+        auto duplicate = [&seen](uint64_t key) { return !seen.insert(key).second; };
+        present.uints.erase(std::remove_if(present.uints.begin(), present.uints.end(), duplicate), present.uints.end());
+        absent.uints.erase(std::remove_if(absent.uints.begin(), absent.uints.end(), duplicate), absent.uints.end());
+    }
+}
+
+// ------------------------------------------------------------------------------------------------------------------
+// Phases
+// ------------------------------------------------------------------------------------------------------------------
+
+// Runs 'work(thread)' on 'threads' threads that start at once, returns the wall time of the slowest one
+template <typename Work>
+static uint64_t run_threads(int threads, Work work)
+{
+    std::atomic<int> ready(0);
+    std::atomic<bool> go(false);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++)
+    {
+        workers.emplace_back([&, t]()
+        {
+            ready++;
+            while (!go.load(std::memory_order_acquire)) std::this_thread::yield();
+            work(t);
+        });
+    }
+
+    while (ready.load() < threads) std::this_thread::yield();
+    uint64_t start = now_ns();
+    go.store(true, std::memory_order_release);
+    for (auto &worker : workers) worker.join();
+    return now_ns() - start;
+}
+
+static inline uint64_t xorshift(uint64_t &state)
+{
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+}
+
+template <typename Key, typename Insert, typename Get, typename Remove>
+static Result run(const TrieBenchTarget &target, void *dict, const std::vector<Key> &keys, const std::vector<Key> &absentKeys,
+                  int threads, size_t getsPerEntry, Insert insert, Get get, Remove remove)
+{
+    Result result = {};
+    std::atomic<size_t> errors(0);
+    size_t count = keys.size();
+
+    int64_t before = target.memoryBytes();
+    uint64_t ns = run_threads(threads, [&](int t)
+    {
+        size_t failed = 0;
+        for (size_t i = t; i < count; i += threads) failed += !insert(dict, keys[i]);
+        errors += failed;
+    });
+    result.insertNs = (double)ns / count;
+    result.bytesPerEntry = (double)(target.memoryBytes() - before) / count;
+
+    size_t gets = count * getsPerEntry / threads;
+    ns = run_threads(threads, [&](int t)
+    {
+        size_t failed = 0;
+        uint64_t state = 0x9e3779b97f4a7c15ULL * (t + 1);
+        for (size_t i = 0; i < gets; i++)
+        {
+            uint64_t r = xorshift(state);
+            if (r % kMissEvery == 0)
+            {
+                failed += get(dict, absentKeys[(r >> 8) % absentKeys.size()]);
+            }
+            else
+            {
+                failed += !get(dict, keys[(r >> 8) % count]);
+            }
+        }
+        errors += failed;
+    });
+    result.getNs = (double)ns / (gets * threads);
+
+    ns = run_threads(threads, [&](int t)
+    {
+        size_t failed = 0;
+        for (size_t i = t; i < count; i += threads) failed += !remove(dict, keys[i]);
+        errors += failed;
+    });
+    result.removeNs = (double)ns / count;
+
+    result.errors = errors;
+    return result;
+}
+
+static void report(const TrieBenchTarget &target, const char *kind, size_t entries, int threads, const Result &result)
+{
+    auto mops = [](double ns) { return ns > 0 ? 1000.0 / ns : 0; };
+    printf("%-13s %-5s %8zu %7d %10.2f %10.2f %10.2f %10.1f",
+           target.name, kind, entries, threads,
+           mops(result.insertNs), mops(result.getNs), mops(result.removeNs), result.bytesPerEntry);
+    if (result.errors > 0)
+    {
+        printf("   (%zu unexpected results)", result.errors);
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+static void run_target(const TrieBenchTarget &target, const Options &options, const Keys &present, const Keys &absent)
+{
+    for (int threads : options.threads)
+    {
+        if (options.paths && target.insertPath != nullptr)
+        {
+            void *dict = target.create(true);
+            auto get = [&target](void *d, const std::string &key) { return target.getPath(d, key.c_str()); };
+            Result result = run(target, dict, present.paths, absent.paths, threads, options.getsPerEntry,
+                                [&target](void *d, const std::string &key) { return target.insertPath(d, key.c_str()); },
+                                get,
+                                [&target](void *d, const std::string &key) { return target.removePath(d, key.c_str()); });
+            target.destroy(dict);
+            report(target, "path", present.paths.size(), threads, result);
+        }
+
+        if (options.pids && target.insertUint != nullptr)
+        {
+            void *dict = target.create(false);
+            Result result = run(target, dict, present.uints, absent.uints, threads, options.getsPerEntry,
+                                target.insertUint, target.getUint, target.removeUint);
+            target.destroy(dict);
+            report(target, "pid", present.uints.size(), threads, result);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Options options = { { 1, 2, 4, 8, 16, 32, 64 }, true, true, 200000, 4, { } };
+
+    for (int i = 1; i < argc; i++)
+    {
+        const char *arg = argv[i];
+        if (i + 1 >= argc || arg[0] != '-' || strlen(arg) != 2) usage();
+        const char *value = argv[++i];
+        switch (arg[1])
+        {
+            case 't':
+                options.threads.clear();
+                for (const std::string &item : split(value))
+                {
+                    int threads = atoi(item.c_str());
+                    if (threads < 1 || threads > kMaxThreads) usage();
+                    options.threads.push_back(threads);
+                }
+                break;
+            case 'k':
+                options.paths = strcmp(value, "path") == 0 || strcmp(value, "both") == 0;
+                options.pids  = strcmp(value, "pid") == 0  || strcmp(value, "both") == 0;
+                if (!options.paths && !options.pids) usage();
+                break;
+            case 'n':
+                options.entries = strtoul(value, nullptr, 10);
+                if (options.entries == 0) usage();
+                break;
+            case 'g':
+                options.getsPerEntry = strtoul(value, nullptr, 10);
+                break;
+            case 'i':
+                options.targets = split(value);
+                break;
+            default:
+                usage();
+        }
+    }
+
+    std::vector<const TrieBenchTarget *> targets;
+    for (size_t i = 0; i < g_kextTargetCount; i++) targets.push_back(&g_kextTargets[i]);
+    for (size_t i = 0; i < g_interopTargetCount; i++) targets.push_back(&g_interopTargets[i]);
+    if (!options.targets.empty())
+    {
+        targets.erase(std::remove_if(targets.begin(), targets.end(), [&options](const TrieBenchTarget *target)
+        {
+            return std::find(options.targets.begin(), options.targets.end(), target->name) == options.targets.end();
+        }), targets.end());
+    }
+
+    if (targets.empty())
+    {
+        fprintf(stderr, "trie_bench: no such target; targets are:\n");
+        for (size_t i = 0; i < g_kextTargetCount; i++) fprintf(stderr, "  %-13s %s\n", g_kextTargets[i].name, g_kextTargets[i].description);
+        for (size_t i = 0; i < g_interopTargetCount; i++) fprintf(stderr, "  %-13s %s\n", g_interopTargets[i].name, g_interopTargets[i].description);
+        return 1;
+    }
+
+    Keys present, absent;
+    generate_keys(options, present, absent);
+
+    printf("%-13s %-5s %8s %7s %10s %10s %10s %10s\n",
+           "target", "keys", "entries", "threads", "insert M/s", "get M/s", "remove M/s", "bytes/key");
+    for (const TrieBenchTarget *target : targets)
+    {
+        run_target(*target, options, present, absent);
+    }
+
+    return 0;
+}
@@ -0,0 +1,38 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#ifndef trie_bench_hpp
+#define trie_bench_hpp
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*!
+ * A dictionary under test.  The kext and the interop tries can't be compiled into one translation unit (both define a
+ * 'Trie' and a 'Node', and the kext one only builds against the OSObject shims), hence each is wrapped into one of these.
+ *
+ * 'create' returns nullptr if the target doesn't support the kind of keys; 'memoryBytes' is the memory all the instances of
+ * the target currently take up (excluding the records, which are shared by all entries).
+ */
+typedef struct
+{
+    const char *name;
+    const char *description;
+    void* (*create)(bool pathKeys);
+    void (*destroy)(void *dict);
+    bool (*insertPath)(void *dict, const char *path);
+    bool (*getPath)(void *dict, const char *path);
+    bool (*removePath)(void *dict, const char *path);
+    bool (*insertUint)(void *dict, uint64_t key);
+    bool (*getUint)(void *dict, uint64_t key);
+    bool (*removeUint)(void *dict, uint64_t key);
+    int64_t (*memoryBytes)();
+} TrieBenchTarget;
+
+extern const TrieBenchTarget g_kextTargets[];
+extern const size_t g_kextTargetCount;
+
+extern const TrieBenchTarget g_interopTargets[];
+extern const size_t g_interopTargetCount;
+
+#endif /* trie_bench_hpp */
@@ -9,6 +9,8 @@
 // BuildXL-specific changes (forked from MSR version):
 //  - Support for detouring 32-bit from 64-bit (without UpdImports)
 //  - ETW tracing (see tracing.cpp).
+//  - Page permissions changed once per page in a transaction (see detour_make_target_writable).
+//  - Hotpatch detours through the padding before hotpatchable functions (see DetourSetHotpatchAware).
 
 #include "target.h"
 #include <windows.h>
@@ -85,9 +87,9 @@ struct _DETOUR_TRAMPOLINE
     BYTE            rbCode[30];     // target code + jmp to pbRemain
     BYTE            cbCode;         // size of moved target code.
     BYTE            cbCodeBreak;    // padding to make debugging easier.
-    BYTE            rbRestore[22];  // original target code.
+    BYTE            rbRestore[22];  // original padding (cbHotpatch bytes) and target code.
     BYTE            cbRestore;      // size of original target code.
-    BYTE            cbRestoreBreak; // padding to make debugging easier.
+    BYTE            cbHotpatch;     // size of the padding before the target used by a hotpatch jmp.
     _DETOUR_ALIGN   rAlign[8];      // instruction alignment array.
     PBYTE           pbRemain;       // first instruction after moved code. [free list]
     PBYTE           pbDetour;       // first instruction of detour function.
@@ -196,6 +198,26 @@ inline ULONG detour_is_code_filler(PBYTE pbCode)
     return 0;
 }
 
+// BuildXL: Whether the code starts with the 2-byte nop of a hotpatchable function (see DetourSetHotpatchAware).
+inline BOOL detour_is_hotpatch_prologue(PBYTE pbCode)
+{
+    return (pbCode[0] == 0x8b && pbCode[1] == 0xff) ||  // mov edi,edi
+           (pbCode[0] == 0x66 && pbCode[1] == 0x90);    // xchg ax,ax
+}
+
+// BuildXL: Replaces the first 2 bytes of a hotpatchable function with a jmp to the padding before it, in one write.
+inline PBYTE detour_gen_jmp_hotpatch(PBYTE pbCode, BYTE cbPadding)
+{
+    BYTE bDisplacement = (BYTE)(0 - (cbPadding + 2));
+    *(UNALIGNED USHORT *)pbCode = (USHORT)(0xeb | (bDisplacement << 8));  // jmp -imm8
+    return pbCode + 2;
+}
+
+inline BYTE detour_hotpatch_size(PDETOUR_TRAMPOLINE pTrampoline)
+{
+    return pTrampoline->cbHotpatch;
+}
+
 #endif // DETOURS_X86
 
 ///////////////////////////////////////////////////////////////////////// X64.
@@ -209,9 +231,9 @@ struct _DETOUR_TRAMPOLINE
     BYTE            rbCode[30];     // target code + jmp to pbRemain.
     BYTE            cbCode;         // size of moved target code.
     BYTE            cbCodeBreak;    // padding to make debugging easier.
-    BYTE            rbRestore[30];  // original target code.
+    BYTE            rbRestore[30];  // original padding (cbHotpatch bytes) and target code.
     BYTE            cbRestore;      // size of original target code.
-    BYTE            cbRestoreBreak; // padding to make debugging easier.
+    BYTE            cbHotpatch;     // size of the padding before the target used by a hotpatch jmp.
     _DETOUR_ALIGN   rAlign[8];      // instruction alignment array.
     PBYTE           pbRemain;       // first instruction after moved code. [free list]
     PBYTE           pbDetour;       // first instruction of detour function.
@@ -321,6 +343,27 @@ inline ULONG detour_is_code_filler(PBYTE pbCode)
     return 0;
 }
 
+// BuildXL: Whether the code starts like a hotpatchable function (see DetourSetHotpatchAware). x64 has no dedicated
+// hotpatch nop: /hotpatch only guarantees that the first instruction is at least 2 bytes long, so that is what is checked.
+inline BOOL detour_is_hotpatch_prologue(PBYTE pbCode)
+{
+    PBYTE pbNext = (PBYTE)DetourCopyInstruction(NULL, NULL, pbCode, NULL, NULL);
+    return pbNext - pbCode >= 2 && !detour_does_code_end_function(pbCode);
+}
+
+// BuildXL: Replaces the first 2 bytes of a hotpatchable function with a jmp to the padding before it, in one write.
+inline PBYTE detour_gen_jmp_hotpatch(PBYTE pbCode, BYTE cbPadding)
+{
+    BYTE bDisplacement = (BYTE)(0 - (cbPadding + 2));
+    *(UNALIGNED USHORT *)pbCode = (USHORT)(0xeb | (bDisplacement << 8));  // jmp -imm8
+    return pbCode + 2;
+}
+
+inline BYTE detour_hotpatch_size(PDETOUR_TRAMPOLINE pTrampoline)
+{
+    return pTrampoline->cbHotpatch;
+}
+
 #endif // DETOURS_X64
 
 //////////////////////////////////////////////////////////////////////// IA64.
@@ -482,6 +525,13 @@ inline ULONG detour_is_code_filler(PBYTE pbCode)
     return 0;
 }
 
+inline BYTE detour_hotpatch_size(PDETOUR_TRAMPOLINE pTrampoline)
+{
+    // Hotpatch detours are not supported on IA64.
+    (void)pTrampoline;
+    return 0;
+}
+
 #endif // DETOURS_IA64
 
 #ifdef DETOURS_ARM
@@ -631,6 +681,13 @@ inline ULONG detour_is_code_filler(PBYTE pbCode)
     return 0;
 }
 
+inline BYTE detour_hotpatch_size(PDETOUR_TRAMPOLINE pTrampoline)
+{
+    // Hotpatch detours are not supported on ARM.
+    (void)pTrampoline;
+    return 0;
+}
+
 #endif // DETOURS_ARM
 
 //////////////////////////////////////////////// Trampoline Memory Management.
@@ -640,9 +697,16 @@ struct DETOUR_REGION
     ULONG               dwSignature;
     DETOUR_REGION *     pNext;  // Next region in list of regions.
     DETOUR_TRAMPOLINE * pFree;  // List of free trampolines in this region.
+    // BuildXL: The trampolines that have never been used are not put on the free list when the region is allocated,
+    // but handed out in order from pUnused, so that the pages of the region are only touched when they are needed
+    // (a process usually only needs the trampolines of the first pages of one region).
+    DETOUR_TRAMPOLINE * pUnused;
 };
 typedef DETOUR_REGION * PDETOUR_REGION;
 
+// The region header takes the place of the first trampoline of the region.
+C_ASSERT(sizeof(DETOUR_REGION) <= sizeof(DETOUR_TRAMPOLINE));
+
 const ULONG DETOUR_REGION_SIGNATURE = 'Rrtd';
 const ULONG DETOUR_REGION_SIZE = 0x10000;
 const ULONG DETOUR_TRAMPOLINES_PER_REGION = (DETOUR_REGION_SIZE
@@ -671,6 +735,20 @@ static void detour_runnable_trampoline_regions()
     }
 }
 
+// The next trampoline that can be allocated from a region (a freed one first), or NULL if the region is full.
+static PDETOUR_TRAMPOLINE detour_region_next_free(PDETOUR_REGION pRegion)
+{
+    if (pRegion->pFree != NULL) {
+        return pRegion->pFree;
+    }
+
+    if (pRegion->pUnused < ((PDETOUR_TRAMPOLINE)pRegion) + 1 + DETOUR_TRAMPOLINES_PER_REGION) {
+        return pRegion->pUnused;
+    }
+
+    return NULL;
+}
+
 static PBYTE detour_alloc_round_down_to_region(PBYTE pbTry)
 {
     // WinXP64 returns free areas that aren't REGION aligned to 32-bit applications.
@@ -808,24 +886,29 @@ static PDETOUR_TRAMPOLINE detour_alloc_trampoline(PBYTE pbTarget)
     }
 
     // First check the default region for an valid free block.
-    if (s_pRegion != NULL && s_pRegion->pFree != NULL &&
-        s_pRegion->pFree >= pLo && s_pRegion->pFree <= pHi) {
+    if (s_pRegion != NULL && detour_region_next_free(s_pRegion) != NULL &&
+        detour_region_next_free(s_pRegion) >= pLo && detour_region_next_free(s_pRegion) <= pHi) {
 
       found_region:
-        pTrampoline = s_pRegion->pFree;
+        pTrampoline = detour_region_next_free(s_pRegion);
         // do a last sanity check on region.
-        if (pTrampoline < pLo || pTrampoline > pHi) {
+        if (pTrampoline == NULL || pTrampoline < pLo || pTrampoline > pHi) {
             return NULL;
         }
-        s_pRegion->pFree = (PDETOUR_TRAMPOLINE)pTrampoline->pbRemain;
+        if (pTrampoline == s_pRegion->pFree) {
+            s_pRegion->pFree = (PDETOUR_TRAMPOLINE)pTrampoline->pbRemain;
+        }
+        else {
+            s_pRegion->pUnused++;
+        }
         memset(pTrampoline, 0xcc, sizeof(*pTrampoline));
         return pTrampoline;
     }
 
     // Then check the existing regions for a valid free block.
     for (s_pRegion = s_pRegions; s_pRegion != NULL; s_pRegion = s_pRegion->pNext) {
-        if (s_pRegion != NULL && s_pRegion->pFree != NULL &&
-            s_pRegion->pFree >= pLo && s_pRegion->pFree <= pHi) {
+        if (detour_region_next_free(s_pRegion) != NULL &&
+            detour_region_next_free(s_pRegion) >= pLo && detour_region_next_free(s_pRegion) <= pHi) {
             goto found_region;
         }
     }
@@ -869,14 +952,8 @@ static PDETOUR_TRAMPOLINE detour_alloc_trampoline(PBYTE pbTarget)
         DETOUR_TRACE(("  Allocated region %p..%p\n\n",
                       s_pRegion, ((PBYTE)s_pRegion) + DETOUR_REGION_SIZE - 1));
 
-        // Put everything but the first trampoline on the free list.
-        PBYTE pFree = NULL;
-        pTrampoline = ((PDETOUR_TRAMPOLINE)s_pRegion) + 1;
-        for (int i = DETOUR_TRAMPOLINES_PER_REGION - 1; i > 1; i--) {
-            pTrampoline[i].pbRemain = pFree;
-            pFree = (PBYTE)&pTrampoline[i];
-        }
-        s_pRegion->pFree = (PDETOUR_TRAMPOLINE)pFree;
+        // Every trampoline after the region header is unused.
+        s_pRegion->pUnused = ((PDETOUR_TRAMPOLINE)s_pRegion) + 1;
         goto found_region;
     }
 
@@ -957,12 +1034,87 @@ struct DetourOperation
 
 static BOOL                 s_fIgnoreTooSmall       = FALSE;
 static BOOL                 s_fRetainRegions        = FALSE;
+static BOOL                 s_fHotpatchAware        = FALSE;
 
 static LONG                 s_nPendingThreadId      = 0; // Thread owning pending transaction.
 static LONG                 s_nPendingError         = NO_ERROR;
 static PVOID *              s_ppPendingError        = NULL;
 static DetourThread *       s_pPendingThreads       = NULL;
 static DetourOperation *    s_pPendingOperations    = NULL;
+static ULONG_PTR            s_cbPage                = 0;
+
+// BuildXL: The targets of a transaction are often close to each other (e.g., the exports of kernelbase.dll), so the
+// permissions of the pages they are in are changed (and restored and flushed) once per page rather than once per target.
+static PBYTE detour_page_of(PBYTE pbAddress)
+{
+    if (s_cbPage == 0) {
+        SYSTEM_INFO si;
+        GetSystemInfo(&si);
+        s_cbPage = si.dwPageSize;
+    }
+
+    return (PBYTE)((ULONG_PTR)pbAddress & ~(s_cbPage - 1));
+}
+
+// The code written by a detour starts at its target, or in the padding before it for a hotpatch detour (see DetourSetHotpatchAware).
+static PBYTE detour_patch_start(PBYTE pbTarget, PDETOUR_TRAMPOLINE pTrampoline)
+{
+    return pbTarget - detour_hotpatch_size(pTrampoline);
+}
+
+static ULONG detour_patch_size(PDETOUR_TRAMPOLINE pTrampoline)
+{
+    return detour_hotpatch_size(pTrampoline) + pTrampoline->cbRestore;
+}
+
+// Whether a page is in the pages of the target of an operation in the list starting at pOperations.
+// Returns that operation, or NULL.
+static DetourOperation * detour_find_operation_on_page(DetourOperation *pOperations, PBYTE pbPage)
+{
+    for (DetourOperation *o = pOperations; o != NULL; o = o->pNext) {
+        PBYTE pbStart = detour_patch_start(o->pbTarget, o->pTrampoline);
+        if (pbPage >= detour_page_of(pbStart) &&
+            pbPage <= detour_page_of(pbStart + detour_patch_size(o->pTrampoline) - 1)) {
+            return o;
+        }
+    }
+
+    return NULL;
+}
+
+// Makes the pages of a target writable, unless a pending operation already did it, in which case the
+// permissions the pages had before the transaction are returned.
+static BOOL detour_make_target_writable(PBYTE pbTarget, ULONG cbTarget, DWORD *pdwOld)
+{
+    DetourOperation *first = detour_find_operation_on_page(s_pPendingOperations, detour_page_of(pbTarget));
+    if (first != NULL &&
+        detour_page_of(detour_patch_start(first->pbTarget, first->pTrampoline)) == detour_page_of(pbTarget) &&
+        detour_find_operation_on_page(s_pPendingOperations, detour_page_of(pbTarget + cbTarget - 1)) != NULL) {
+        *pdwOld = first->dwPerm;
+        return TRUE;
+    }
+
+    return VirtualProtect(pbTarget, cbTarget, PAGE_EXECUTE_READWRITE, pdwOld);
+}
+
+#if defined(DETOURS_X86) || defined(DETOURS_X64)
+// Whether the target is preceded by enough padding (nop or brk) for the jmp of a hotpatch detour.
+static BOOL detour_is_hotpatch_padding(PBYTE pbTarget)
+{
+    // The page before the one of the target may not be mapped.
+    PBYTE pbStart = pbTarget - SIZE_OF_JMP;
+    if (detour_page_of(pbStart) != detour_page_of(pbTarget)) {
+        return FALSE;
+    }
+
+    for (PBYTE pbCode = pbStart; pbCode < pbTarget; pbCode++) {
+        if (*pbCode != 0x90 && *pbCode != 0xcc) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+#endif
 
 //////////////////////////////////////////////////////////////////////////////
 //
@@ -993,6 +1145,16 @@ BOOL WINAPI DetourSetRetainRegions(BOOL fRetain)
     return fPrevious;
 }
 
+// BuildXL: When set, a target that starts like a hotpatchable function (e.g., mov edi,edi on x86) and that is preceded by padding
+// is detoured by a jmp in the padding and a short jmp to it over its first instruction, which is the only one moved to the
+// trampoline: the instructions after it are neither decoded nor relocated. Other targets are detoured as usual.
+BOOL WINAPI DetourSetHotpatchAware(BOOL fHotpatchAware)
+{
+    BOOL fPrevious = s_fHotpatchAware;
+    s_fHotpatchAware = fHotpatchAware;
+    return fPrevious;
+}
+
 LONG WINAPI DetourTransactionBegin()
 {
     // Only one transaction is allowed at a time.
@@ -1111,9 +1273,14 @@ LONG WINAPI DetourTransactionCommitEx(PVOID **pppFailedPointer)
     // Insert or remove each of the detours.
     for (DetourOperation *o = s_pPendingOperations; o != NULL; o = o->pNext) {
         if (o->fIsRemove) {
+            // The target first, so that the padding of a hotpatch detour is no longer jumped to when it is restored.
+            BYTE cbHotpatch = detour_hotpatch_size(o->pTrampoline);
             CopyMemory(o->pbTarget,
-                       o->pTrampoline->rbRestore,
+                       o->pTrampoline->rbRestore + cbHotpatch,
                        o->pTrampoline->cbRestore);
+            CopyMemory(o->pbTarget - cbHotpatch,
+                       o->pTrampoline->rbRestore,
+                       cbHotpatch);
 #ifdef DETOURS_IA64
             *o->ppbPointer = (PBYTE)o->pTrampoline->ppldTarget;
 #endif // DETOURS_IA64
@@ -1154,14 +1321,27 @@ LONG WINAPI DetourTransactionCommitEx(PVOID **pppFailedPointer)
 
 #ifdef DETOURS_X64
             detour_gen_jmp_indirect(o->pTrampoline->rbCodeIn, &o->pTrampoline->pbDetour);
-            PBYTE pbCode = detour_gen_jmp_immediate(o->pbTarget, o->pTrampoline->rbCodeIn);
-            detour_gen_brk(pbCode, o->pTrampoline->pbRemain);
+            if (o->pTrampoline->cbHotpatch != 0) {
+                // The rest of the first instruction is left as is: it is never executed.
+                detour_gen_jmp_immediate(o->pbTarget - o->pTrampoline->cbHotpatch, o->pTrampoline->rbCodeIn);
+                detour_gen_jmp_hotpatch(o->pbTarget, o->pTrampoline->cbHotpatch);
+            }
+            else {
+                PBYTE pbCode = detour_gen_jmp_immediate(o->pbTarget, o->pTrampoline->rbCodeIn);
+                detour_gen_brk(pbCode, o->pTrampoline->pbRemain);
+            }
             *o->ppbPointer = o->pTrampoline->rbCode;
 #endif // DETOURS_X64
 
 #ifdef DETOURS_X86
-            PBYTE pbCode = detour_gen_jmp_immediate(o->pbTarget, o->pTrampoline->pbDetour);
-            detour_gen_brk(pbCode, o->pTrampoline->pbRemain);
+            if (o->pTrampoline->cbHotpatch != 0) {
+                detour_gen_jmp_immediate(o->pbTarget - o->pTrampoline->cbHotpatch, o->pTrampoline->pbDetour);
+                detour_gen_jmp_hotpatch(o->pbTarget, o->pTrampoline->cbHotpatch);
+            }
+            else {
+                PBYTE pbCode = detour_gen_jmp_immediate(o->pbTarget, o->pTrampoline->pbDetour);
+                detour_gen_brk(pbCode, o->pTrampoline->pbRemain);
+            }
             *o->ppbPointer = o->pTrampoline->rbCode;
 #endif // DETOURS_X86
 
@@ -1290,12 +1470,21 @@ LONG WINAPI DetourTransactionCommitEx(PVOID **pppFailedPointer)
     }
 
     // Restore all of the page permissions and flush the icache.
+    // BuildXL: The pages of a target that also are pages of the target of a later operation in the list (i.e., an operation
+    // added earlier to the transaction) are restored and flushed with that operation.
     HANDLE hProcess = GetCurrentProcess();
     for (DetourOperation *o = s_pPendingOperations; o != NULL;) {
-        // We don't care if this fails, because the code is still accessible.
-        DWORD dwOld;
-        VirtualProtect(o->pbTarget, o->pTrampoline->cbRestore, o->dwPerm, &dwOld);
-        FlushInstructionCache(hProcess, o->pbTarget, o->pTrampoline->cbRestore);
+        PBYTE pbStart = detour_patch_start(o->pbTarget, o->pTrampoline);
+        ULONG cbPatch = detour_patch_size(o->pTrampoline);
+        PBYTE pbFirstPage = detour_page_of(pbStart);
+        PBYTE pbLastPage = detour_page_of(pbStart + cbPatch - 1);
+        if (detour_find_operation_on_page(o->pNext, pbFirstPage) == NULL ||
+            detour_find_operation_on_page(o->pNext, pbLastPage) == NULL) {
+            // We don't care if this fails, because the code is still accessible.
+            DWORD dwOld;
+            VirtualProtect(pbStart, cbPatch, o->dwPerm, &dwOld);
+            FlushInstructionCache(hProcess, pbFirstPage, (pbLastPage - pbFirstPage) + s_cbPage);
+        }
 
         if (o->fIsRemove && o->pTrampoline) {
             detour_free_trampoline(o->pTrampoline);
@@ -1518,6 +1707,16 @@ LONG WINAPI DetourAttachEx(PVOID *ppPointer,
     ULONG cbTarget = 0;
     ULONG cbJump = SIZE_OF_JMP;
     ULONG nAlign = 0;
+    ULONG cbHotpatch = 0;
+
+#if defined(DETOURS_X86) || defined(DETOURS_X64)
+    // BuildXL: A hotpatch detour only overwrites (and so only moves) the first instruction, which is at least 2 bytes long.
+    if (s_fHotpatchAware && detour_is_hotpatch_padding(pbTarget) && detour_is_hotpatch_prologue(pbTarget)) {
+        cbHotpatch = SIZE_OF_JMP;
+        cbJump = 2;
+    }
+    pTrampoline->cbHotpatch = (BYTE)cbHotpatch;
+#endif
 
 #ifdef DETOURS_ARM
     // On ARM, we need an extra instruction when the function isn't 32-bit aligned.
@@ -1625,7 +1824,7 @@ LONG WINAPI DetourAttachEx(PVOID *ppPointer,
 
     pTrampoline->cbCode = (BYTE)(pbTrampoline - pTrampoline->rbCode);
     pTrampoline->cbRestore = (BYTE)cbTarget;
-    CopyMemory(pTrampoline->rbRestore, pbTarget, cbTarget);
+    CopyMemory(pTrampoline->rbRestore, pbTarget - cbHotpatch, cbHotpatch + cbTarget);
 
 #if !defined(DETOURS_IA64)
     if (cbTarget > sizeof(pTrampoline->rbCode) - cbJump) {
@@ -1696,7 +1895,7 @@ LONG WINAPI DetourAttachEx(PVOID *ppPointer,
 #endif // DETOURS_ARM
 
     DWORD dwOld = 0;
-    if (!VirtualProtect(pbTarget, cbTarget, PAGE_EXECUTE_READWRITE, &dwOld)) {
+    if (!detour_make_target_writable(pbTarget - cbHotpatch, cbHotpatch + cbTarget, &dwOld)) {
         DETOUR_TRACE_ERROR(L"VirtualProtect(%p) failed: %d\n",
             pbTarget, GetLastError());
         error = GetLastError();
@@ -1860,8 +2059,7 @@ LONG WINAPI DetourDetach(PVOID *ppPointer,
     }
 
     DWORD dwOld = 0;
-    if (!VirtualProtect(pbTarget, cbTarget,
-                        PAGE_EXECUTE_READWRITE, &dwOld)) {
+    if (!detour_make_target_writable(detour_patch_start(pbTarget, pTrampoline), detour_patch_size(pTrampoline), &dwOld)) {
         DETOUR_TRACE_ERROR(L"VirtualProtect(%p) failed: %d\n",
             pbTarget, GetLastError());
         error = GetLastError();
@@ -830,10 +830,45 @@ PVOID WINAPI DetourFindPayload(HMODULE hModule, REFGUID rguid, DWORD * pcbData)
     }
 }
 
+// Looks for a payload in the image at pvImage, which is typically where the process that copied the payload
+// in (see DetourCopyPayloadToProcess) asked for it to be. Unlike DetourFindPayload, the address does not need
+// to be the one of a module: nothing is read unless the address is the start of a committed, readable region.
+PVOID WINAPI DetourFindPayloadAt(PVOID pvImage, REFGUID rguid, DWORD * pcbData)
+{
+    if (pcbData) {
+        *pcbData = 0;
+    }
+
+    MEMORY_BASIC_INFORMATION mbi;
+    ZeroMemory(&mbi, sizeof(mbi));
+    if (pvImage == NULL ||
+        VirtualQuery(pvImage, &mbi, sizeof(mbi)) == 0 ||
+        mbi.AllocationBase != pvImage ||
+        mbi.State != MEM_COMMIT ||
+        (mbi.Protect & (PAGE_READONLY | PAGE_READWRITE | PAGE_EXECUTE_READ | PAGE_EXECUTE_READWRITE)) == 0 ||
+        (mbi.Protect & PAGE_GUARD) != 0) {
+
+        SetLastError(ERROR_MOD_NOT_FOUND);
+        return NULL;
+    }
+
+    return DetourFindPayload((HMODULE)pvImage, rguid, pcbData);
+}
+
 PVOID WINAPI DetourFindPayloadEx(REFGUID rguid, DWORD * pcbData)
 {
+    // Payloads written into an executable (see DetourBinarySetPayload) are in its own image: look there before
+    // walking every region of the address space.
+    HMODULE hExe = GetModuleHandleW(NULL);
+    PVOID pvData = DetourFindPayload(hExe, rguid, pcbData);
+    if (pvData != NULL) {
+        return pvData;
+    }
+
     for (HMODULE hMod = NULL; (hMod = DetourEnumerateModules(hMod)) != NULL;) {
-        PVOID pvData;
+        if (hMod == hExe) {
+            continue;
+        }
 
         pvData = DetourFindPayload(hMod, rguid, pcbData);
         if (pvData != NULL) {
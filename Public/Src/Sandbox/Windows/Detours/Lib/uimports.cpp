@@ -12,6 +12,7 @@
 // BuildXL-specific changes (forked from MSR version):
 //  - Support for detouring 32-bit from 64-bit (without UpdImports)
 //  - ETW tracing (see tracing.cpp).
+//  - The section headers are read with a single ReadProcessMemory.
 
 // UpdateImports32 aka UpdateImports64
 static BOOL UPDATE_IMPORTS_XX(HANDLE hProcess,
@@ -22,6 +23,7 @@ static BOOL UPDATE_IMPORTS_XX(HANDLE hProcess,
 {
     BOOL fSucceeded = FALSE;
     BYTE * pbNew = NULL;
+    IMAGE_SECTION_HEADER * pish = NULL;
 
     PBYTE pbModule = (PBYTE)hModule;
 
@@ -36,6 +38,10 @@ static BOOL UPDATE_IMPORTS_XX(HANDLE hProcess,
             delete[] pbNew;
             pbNew = NULL;
         }
+        if (pish != NULL) {
+            delete[] pish;
+            pish = NULL;
+        }
         return fSucceeded;
     }
 
@@ -78,18 +84,26 @@ static BOOL UPDATE_IMPORTS_XX(HANDLE hProcess,
         FIELD_OFFSET(IMAGE_NT_HEADERS_XX, OptionalHeader) +
         inh.FileHeader.SizeOfOptionalHeader;
 
-    for (DWORD i = 0; i < inh.FileHeader.NumberOfSections; i++) {
-        IMAGE_SECTION_HEADER ish;
-        ZeroMemory(&ish, sizeof(ish));
+    // BuildXL: All the section headers are read at once (rather than one ReadProcessMemory per section).
+    if (inh.FileHeader.NumberOfSections != 0) {
+        pish = new IMAGE_SECTION_HEADER [inh.FileHeader.NumberOfSections];
+        if (pish == NULL) {
+            DETOUR_TRACE(("new IMAGE_SECTION_HEADER [NumberOfSections] failed.\n"));
+            goto finish;
+        }
 
-        if (!ReadProcessMemory(hProcess, pbModule + dwSec + sizeof(ish) * i, &ish,
-                               sizeof(ish), NULL)) {
+        if (!ReadProcessMemory(hProcess, pbModule + dwSec, pish,
+                               sizeof(*pish) * inh.FileHeader.NumberOfSections, NULL)) {
             DETOUR_TRACE_ERROR(L"ReadProcessMemory(ish@%p..%p) failed: %d\n",
-                          pbModule + dwSec + sizeof(ish) * i,
-                          pbModule + dwSec + sizeof(ish) * (i + 1),
+                          pbModule + dwSec,
+                          pbModule + dwSec + sizeof(*pish) * inh.FileHeader.NumberOfSections,
                           GetLastError());
             goto finish;
         }
+    }
+
+    for (DWORD i = 0; i < inh.FileHeader.NumberOfSections; i++) {
+        IMAGE_SECTION_HEADER &ish = pish[i];
 
         DETOUR_TRACE(("ish[%d] : va=%08x sr=%d\n", i, ish.VirtualAddress, ish.SizeOfRawData));
 
@@ -301,12 +315,15 @@ static BOOL UPDATE_IMPORTS_XX(HANDLE hProcess,
     inh.OptionalHeader.CheckSum = 0;
 #endif // IGNORE_CHECKSUMS
 
+#if IGNORE_CHECKSUMS
 	// Overwrite DOS header with the updated one.
+	// BuildXL: The DOS header is only updated when the checksums are fixed in it (see e_res above).
     if (!WriteProcessMemory(hProcess, pbModule, &idh, sizeof(idh), NULL)) {
         DETOUR_TRACE_ERROR(L"WriteProcessMemory(idh) failed: %d\n", GetLastError());
         goto finish;
     }
     DETOUR_TRACE(("WriteProcessMemory(idh:%p..%p)\n", pbModule, pbModule + sizeof(idh)));
+#endif // IGNORE_CHECKSUMS
 
 	// Overwrite PE header with the updated one.
     if (!WriteProcessMemory(hProcess, pbModule + idh.e_lfanew, &inh, sizeof(inh), NULL)) {
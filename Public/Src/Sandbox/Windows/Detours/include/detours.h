@@ -235,6 +235,7 @@ LONG WINAPI DetourDetach(PVOID *ppPointer,
 
 BOOL WINAPI DetourSetIgnoreTooSmall(BOOL fIgnore);
 BOOL WINAPI DetourSetRetainRegions(BOOL fRetain);
+BOOL WINAPI DetourSetHotpatchAware(BOOL fHotpatchAware);
 
 ////////////////////////////////////////////////////////////// Code Functions.
 //
@@ -262,6 +263,7 @@ BOOL WINAPI DetourEnumerateImports(HMODULE hModule,
 
 PVOID WINAPI DetourFindPayload(HMODULE hModule, REFGUID rguid, DWORD *pcbData);
 PVOID WINAPI DetourFindPayloadEx(REFGUID rguid, DWORD * pcbData);
+PVOID WINAPI DetourFindPayloadAt(PVOID pvImage, REFGUID rguid, DWORD * pcbData);
 DWORD WINAPI DetourGetSizeOfPayloads(HMODULE hModule);
 
 ///////////////////////////////////////////////// Persistent Binary Functions.
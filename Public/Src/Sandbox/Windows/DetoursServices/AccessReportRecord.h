@@ -0,0 +1,137 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// The binary access report record shared by the sandboxes: one versioned, little-endian, length-prefixed layout that
+// the host can read in place (see AccessReportRecord.cs) instead of splitting report lines or unmarshaling structures.
+//
+// CODESYNC: Public/Src/Engine/Processes/AccessReportRecord.cs
+//
+// A record is an AccessReportRecordHeader, 'headerSize - sizeof(AccessReportRecordHeader)' bytes of header extension
+// (fields a sandbox adds to every record it sends, e.g., the timestamps of the macOS kext), 'payloadLength' payload
+// bytes and padding up to 'length'. Readers must skip the extension and the padding they don't know about: writers may
+// grow the header within a version (new fields go at the end), and pad records to the alignment their transport needs.
+// The one extension all sandboxes agree on is the AccessReportRecordTiming of timed records (kAccessRecordFlagTimed),
+// which comes first; the extension of a sandbox follows it.
+//
+// The payload of an access record is its path, without a terminating null character, in UTF-8 or (with
+// kAccessRecordFlagUtf16Path) in UTF-16. How the other kinds of records are framed (e.g., in packets or queue entries)
+// is up to the transport of each sandbox.
+
+#define kAccessRecordVersion 1
+
+typedef enum
+{
+    // A file access; the payload is the reported path.
+    kAccessRecordKindAccess = 1,
+
+    // Defines the name of process 'pid': 'processNameId' is the id being defined, the payload is the name.
+    kAccessRecordKindProcessName = 2,
+
+    // The performance counters of process 'pid'; the payload is a SandboxStats (see SandboxStats.h).
+    kAccessRecordKindSandboxStats = 3,
+
+    // Kinds from here on are defined by each sandbox (see e.g. report_format.hpp in the Linux sandbox).
+    kAccessRecordKindSandboxSpecific = 0x100,
+} AccessRecordKind;
+
+typedef enum
+{
+    // 'operation' is a ReportedFileOperation of the Windows sandbox.
+    kAccessRecordPlatformWindows = 1,
+
+    // 'operation' is a FileOperation of the macOS and Linux sandboxes (see BuildXLSandboxShared.hpp).
+    kAccessRecordPlatformPosix = 2,
+} AccessRecordPlatform;
+
+typedef enum
+{
+    // The access is to be reported even if the policy does not ask for it (i.e. "report explicitly").
+    kAccessRecordFlagReportExplicitly = 0x1,
+
+    // The payload is UTF-16 (little-endian) rather than UTF-8.
+    kAccessRecordFlagUtf16Path = 0x2,
+
+    // The header extension starts with an AccessReportRecordTiming.
+    kAccessRecordFlagTimed = 0x4,
+} AccessRecordFlags;
+
+typedef struct
+{
+    // Total length of the record: header (with its extension), payload and padding
+    uint32_t length;
+
+    // kAccessRecordVersion
+    uint16_t version;
+
+    // Offset of the payload from the start of the record; at least sizeof(AccessReportRecordHeader)
+    uint16_t headerSize;
+
+    // AccessRecordKind
+    uint16_t kind;
+
+    // AccessRecordPlatform
+    uint8_t platform;
+
+    // AccessRecordFlags
+    uint8_t flags;
+
+    uint32_t operation;
+    uint32_t pid;
+    uint32_t rootPid;
+    uint32_t requestedAccess;
+    uint32_t status;
+    uint32_t error;
+
+    // Id of a process name previously defined by a kAccessRecordKindProcessName record of the same pid (0 if unknown)
+    uint32_t processNameId;
+
+    // Semi-stable hash of the pip the access belongs to (0 if the host already knows it from the transport)
+    uint64_t pipId;
+
+    uint32_t payloadLength;
+    uint32_t reserved;
+} AccessReportRecordHeader;
+
+static_assert(sizeof(AccessReportRecordHeader) == 56, "CODESYNC: AccessReportRecord.cs");
+static_assert(offsetof(AccessReportRecordHeader, pipId) == 40, "CODESYNC: AccessReportRecord.cs");
+
+// When a record was made, for timed records (reports are only timed on request, see the sandbox of each platform)
+typedef struct
+{
+    // Nanoseconds on the monotonic clock the host's Stopwatch reads: CLOCK_MONOTONIC on Linux,
+    // mach_absolute_time (CLOCK_UPTIME_RAW) on macOS, QueryPerformanceCounter on Windows
+    uint64_t timestamp;
+
+    // Increases with every timed record process 'pid' makes: the records of the threads of a process may reach the
+    // host out of order, which this puts back in order
+    uint64_t sequenceNumber;
+} AccessReportRecordTiming;
+
+static_assert(sizeof(AccessReportRecordTiming) == 16, "CODESYNC: AccessReportRecord.cs");
+
+// The length of a record with 'headerSize' bytes of header and 'payloadLength' bytes of payload, padded to 'alignment' (a power of 2)
+inline uint32_t AccessReportRecordLength(size_t headerSize, size_t payloadLength, uint32_t alignment = 1)
+{
+    uint32_t length = (uint32_t)(headerSize + payloadLength);
+    return (length + alignment - 1) & ~(alignment - 1);
+}
+
+// Returns a header with the given kind and platform, its lengths set for an unpadded record without header extension
+inline AccessReportRecordHeader MakeAccessReportRecordHeader(AccessRecordKind kind, AccessRecordPlatform platform, size_t payloadLength)
+{
+    AccessReportRecordHeader header;
+    memset(&header, 0, sizeof(header));
+    header.length        = AccessReportRecordLength(sizeof(header), payloadLength);
+    header.version       = kAccessRecordVersion;
+    header.headerSize    = (uint16_t)sizeof(header);
+    header.kind          = (uint16_t)kind;
+    header.platform      = (uint8_t)platform;
+    header.payloadLength = (uint32_t)payloadLength;
+    return header;
+}
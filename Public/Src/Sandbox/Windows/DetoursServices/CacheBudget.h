@@ -0,0 +1,89 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <vector>
+
+// The memory budget of a cache that would otherwise grow with everything a long-lived process (e.g., an MSBuild node, VBCSCompiler
+// or a test host) ever does. The cache charges the (estimated) size of every entry it keeps and releases it when the entry goes;
+// once the total is over the budget, it evicts entries (see EvictWithClock) until it is back under it.
+//
+// Only caches whose entries can be dropped at any time without changing what is reported (i.e., whose misses only cost I/O) can
+// have a budget. The counters are only written under the lock of the cache, but can be read at any time (see ReportDetourStatistics).
+class CacheBudget
+{
+public:
+    explicit CacheBudget(size_t budgetBytes)
+        : m_budgetBytes(budgetBytes), m_bytes(0), m_entries(0), m_evictions(0), m_clockHand(0) {}
+
+    CacheBudget(const CacheBudget&) = delete;
+    CacheBudget& operator=(const CacheBudget&) = delete;
+
+    inline bool IsOverBudget() const { return Bytes() > m_budgetBytes; }
+
+    inline void Charge(size_t bytes)
+    {
+        m_bytes.store(Bytes() + bytes, std::memory_order_relaxed);
+        m_entries.store(Entries() + 1, std::memory_order_relaxed);
+    }
+
+    inline void Release(size_t bytes)
+    {
+        m_bytes.store(Bytes() - bytes, std::memory_order_relaxed);
+        m_entries.store(Entries() - 1, std::memory_order_relaxed);
+    }
+
+    inline void CountEviction() { m_evictions.store(Evictions() + 1, std::memory_order_relaxed); }
+
+    // The bucket the clock hand goes to next, out of bucketCount
+    inline size_t AdvanceClockHand(size_t bucketCount) { return m_clockHand++ % bucketCount; }
+
+    inline size_t BudgetBytes() const { return m_budgetBytes; }
+    inline size_t Bytes() const { return m_bytes.load(std::memory_order_relaxed); }
+    inline size_t Entries() const { return m_entries.load(std::memory_order_relaxed); }
+    inline size_t Evictions() const { return m_evictions.load(std::memory_order_relaxed); }
+
+private:
+    const size_t m_budgetBytes;
+    std::atomic<size_t> m_bytes;
+    std::atomic<size_t> m_entries;
+    std::atomic<size_t> m_evictions;
+    size_t m_clockHand;
+};
+
+// CLOCK (second chance) eviction over the buckets of an unordered map whose values have a 'mutable std::atomic<bool> Referenced',
+// set when the entry is inserted or found, and a 'size_t Size', the bytes charged to the budget for it. The hand goes round the
+// buckets, giving the entries that were referenced since it last went by another chance and evicting the others, until the map is
+// back under budget: entries that keep being looked up stay, the ones that are not will go. Must be called with the map locked for writing.
+template<typename Map>
+void EvictWithClock(Map& map, CacheBudget& budget)
+{
+    // Two rounds at most: the first one may only find entries that were referenced
+    const size_t bucketCount = map.bucket_count();
+    std::vector<typename Map::key_type> victims;
+    for (size_t visited = 0; budget.IsOverBudget() && !map.empty() && visited < 2 * bucketCount; visited++)
+    {
+        const size_t bucket = budget.AdvanceClockHand(bucketCount);
+        for (auto iter = map.begin(bucket); iter != map.end(bucket); ++iter)
+        {
+            if (!iter->second.Referenced.exchange(false, std::memory_order_relaxed))
+            {
+                victims.push_back(iter->first);
+            }
+        }
+
+        // Erasing does not rehash, so the buckets stay where they are
+        for (const auto& key : victims)
+        {
+            auto found = map.find(key);
+            budget.Release(found->second.Size);
+            budget.CountEviction();
+            map.erase(found);
+        }
+
+        victims.clear();
+    }
+}
@@ -3,15 +3,14 @@
 
 #include "CanonicalizedPath.h"
 
-// Applies GetFullPathnameW to 'path'. This function should not be used on \\?\ or \??\ style paths.
-static DWORD GetFullPath(__in PCWSTR path, std::wstring& fullPath)
+// Applies GetFullPathnameW to 'path', storing the result in 'fullPath' (which must be empty). This function should not be used on \\?\ or \??\ style paths.
+DWORD CanonicalizedPath::GetFullPath(__in PCWSTR path, CanonicalizedPath& fullPath)
 {
-    // First, we try with a fixed-sized buffer, which should be good enough for all practical cases
+    // First, we try with the inline buffer, which should be good enough for all practical cases
 
-    WCHAR wszBuffer[MAX_PATH];
-    DWORD nBufferLength = sizeof(wszBuffer) / sizeof(WCHAR);
+    DWORD nBufferLength = CANONICALIZED_PATH_INLINE_LENGTH + 1;
 
-    DWORD result = GetFullPathNameW(path, nBufferLength, wszBuffer, NULL);
+    DWORD result = GetFullPathNameW(path, nBufferLength, fullPath.m_inlineBuffer, NULL);
 
     if (result == 0)
     {
@@ -22,7 +21,7 @@ static DWORD GetFullPath(__in PCWSTR path, std::wstring& fullPath)
     {
         // The buffer was big enough. The return value indicates the length of the full path, NOT INCLUDING the terminating null character.
         // http://msdn.microsoft.com/en-us/library/windows/desktop/aa364963(v=vs.85).aspx
-        fullPath = std::wstring(wszBuffer, static_cast<size_t>(result));
+        fullPath.m_length = static_cast<size_t>(result);
     }
     else
     {
@@ -30,10 +29,9 @@ static DWORD GetFullPath(__in PCWSTR path, std::wstring& fullPath)
 
         // Note that in this case, the return value indicates the required buffer length, INCLUDING the terminating null character.
         // http://msdn.microsoft.com/en-us/library/windows/desktop/aa364963(v=vs.85).aspx
-        unique_ptr<wchar_t[]> buffer(new wchar_t[result]);
-        assert(buffer.get());
+        wchar_t* buffer = fullPath.Allocate(result - 1);
 
-        DWORD result2 = GetFullPathNameW(path, result, buffer.get(), NULL);
+        DWORD result2 = GetFullPathNameW(path, result, buffer, NULL);
 
         if (result2 == 0)
         {
@@ -42,7 +40,7 @@ static DWORD GetFullPath(__in PCWSTR path, std::wstring& fullPath)
 
         if (result2 < result)
         {
-            fullPath = std::wstring(buffer.get(), result2);
+            fullPath.m_length = static_cast<size_t>(result2);
         }
         else
         {
@@ -53,9 +51,32 @@ static DWORD GetFullPath(__in PCWSTR path, std::wstring& fullPath)
     return ERROR_SUCCESS;
 }
 
+wchar_t* CanonicalizedPath::Allocate(size_t length) {
+    assert(m_heapBuffer == nullptr && m_length == 0);
+
+    m_length = length;
+    if (length <= CANONICALIZED_PATH_INLINE_LENGTH) {
+        return m_inlineBuffer;
+    }
+
+    m_heapBuffer = reinterpret_cast<HeapBuffer*>(new char[offsetof(HeapBuffer, Chars) + (length + 1) * sizeof(wchar_t)]);
+    assert(m_heapBuffer);
+    m_heapBuffer->ReferenceCount = 1;
+    return m_heapBuffer->Chars;
+}
+
+void CanonicalizedPath::Release() {
+    if (m_heapBuffer != nullptr && InterlockedDecrement(&m_heapBuffer->ReferenceCount) == 0) {
+        delete[] reinterpret_cast<char*>(m_heapBuffer);
+    }
+
+    Type = PathType::Null;
+    m_length = 0;
+    m_heapBuffer = nullptr;
+    m_inlineBuffer[0] = L'\0';
+}
+
 CanonicalizedPath CanonicalizedPath::Canonicalize(wchar_t const* noncanonicalPath) {
-    PathType pathType;
-    std::wstring fullPath;
     if (IsWin32NtPathName(noncanonicalPath)) {
         // Caller is using escape syntax to avoid Win32 interpretation of path.
         // That's actually really good for us.  The text after the prefix is
@@ -63,51 +84,56 @@ CanonicalizedPath CanonicalizedPath::Canonicalize(wchar_t const* noncanonicalPat
         // the kernel's effective algorithm for translating to an NT path is something like 
         //    IsWin32NtPathName(path) ? path : GetFullPathName(path),
         // and in fact GetFullPathName(path) and path aren't always equivalent if IsWin32NtPathName(path).
-        pathType = PathType::Win32Nt;
-        fullPath = std::wstring(noncanonicalPath);
+        return CanonicalizedPath(PathType::Win32Nt, noncanonicalPath, wcslen(noncanonicalPath));
     }
-    else {
-        // The path is not a Win32-NT pathname so it is subject to GetFullPathName canonicalization by the kernel.
-        // So, C:\foo\..\bar becomes C:\bar. But also \\.\C:\foo\..\bar becomes \\.\C:\bar ; note that the local device (\\.\)
-        // prefix is preserved. That's fine for reporting (we keep it as m_canonicalizedPath), but for computing special cases
-        // and traversing the manifest tree, we should further canonicalize to the plain C:\bar (C: is in the tree, \\.\ isn't understood). 
-        // Note that even non-drive-letter devices like \\.\nul, \\.\Harddisk0Partition1, etc. can safely become nul and Harddisk0Partition1 respectively; 
-        // imagine the manifest tree root as implicitly \??\ (the session's DosDevices namespace).
-
-        DWORD error = GetFullPath(noncanonicalPath, fullPath);
-        if (error != ERROR_SUCCESS) {
-            return CanonicalizedPath();
-        }
 
-        // Note that GetFullPath("nul") == "\\.\nul" (similar for other classic devices), so we check for the local device type after that step.
-        pathType = IsLocalDevicePathName(fullPath.c_str()) ? PathType::LocalDevice : PathType::Win32;
+    // The path is not a Win32-NT pathname so it is subject to GetFullPathName canonicalization by the kernel.
+    // So, C:\foo\..\bar becomes C:\bar. But also \\.\C:\foo\..\bar becomes \\.\C:\bar ; note that the local device (\\.\)
+    // prefix is preserved. That's fine for reporting (we keep it as m_canonicalizedPath), but for computing special cases
+    // and traversing the manifest tree, we should further canonicalize to the plain C:\bar (C: is in the tree, \\.\ isn't understood). 
+    // Note that even non-drive-letter devices like \\.\nul, \\.\Harddisk0Partition1, etc. can safely become nul and Harddisk0Partition1 respectively; 
+    // imagine the manifest tree root as implicitly \??\ (the session's DosDevices namespace).
+
+    // The full path is written right into the result, which is returned as is (no copy) on success.
+    CanonicalizedPath fullPath;
+    DWORD error = GetFullPath(noncanonicalPath, fullPath);
+    if (error != ERROR_SUCCESS) {
+        return CanonicalizedPath();
     }
 
-    return CanonicalizedPath(pathType, std::move(fullPath));
+    // Note that GetFullPath("nul") == "\\.\nul" (similar for other classic devices), so we check for the local device type after that step.
+    fullPath.Type = IsLocalDevicePathName(fullPath.Chars()) ? PathType::LocalDevice : PathType::Win32;
+    return fullPath;
 }
 
 CanonicalizedPath CanonicalizedPath::Extend(wchar_t const* additionalComponents, size_t* extensionStartIndex) const {
     assert(additionalComponents);
-    assert(!IsNull() && m_value);
+    assert(!IsNull());
     while (IsDirectorySeparator(additionalComponents[0])) {
         additionalComponents++;
     }
 
-    std::wstring extended{};
-    extended.reserve(wcslen(additionalComponents) + Length() + 1);
-    extended.append(*m_value);
+    wchar_t const* chars = Chars();
+    size_t additionalLength = wcslen(additionalComponents);
+    size_t extensionStart = m_length > 0 && !IsDirectorySeparator(chars[m_length - 1]) ? m_length + 1 : m_length;
 
-    if (!extended.empty() && !IsDirectorySeparator(extended.back())) {
-        extended.push_back(NT_DIRECTORY_SEPARATOR);
+    CanonicalizedPath extended;
+    wchar_t* extendedChars = extended.Allocate(extensionStart + additionalLength);
+    extended.Type = Type;
+
+    wmemcpy(extendedChars, chars, m_length);
+    if (extensionStart > m_length) {
+        extendedChars[m_length] = NT_DIRECTORY_SEPARATOR;
     }
 
+    // Including the null terminator
+    wmemcpy(extendedChars + extensionStart, additionalComponents, additionalLength + 1);
+
     if (extensionStartIndex != nullptr) {
-        *extensionStartIndex = extended.size();
+        *extensionStartIndex = extensionStart;
     }
 
-    extended.append(additionalComponents);
-
-    return CanonicalizedPath(Type, std::move(extended));
+    return extended;
 }
 
 wchar_t const* CanonicalizedPath::GetLastComponent() const {
@@ -128,10 +154,10 @@ wchar_t const* CanonicalizedPath::GetLastComponent() const {
 }
 
 CanonicalizedPath CanonicalizedPath::RemoveLastComponent() const {
-    assert(!IsNull() && m_value);
+    assert(!IsNull());
 
     // If the last path separator is at zero-based index N, we want the preceding N characters.
     // If there are no path separators (or a path separator at index 0), we want a zero length string.
-    size_t lastSeparatorIndex = FindFinalPathSeparator(m_value->c_str());
-    return CanonicalizedPath(Type, m_value->substr(0, lastSeparatorIndex));
+    size_t lastSeparatorIndex = FindFinalPathSeparator(Chars());
+    return CanonicalizedPath(Type, Chars(), lastSeparatorIndex);
 }
@@ -5,26 +5,62 @@
 
 #include "FileAccessHelpers.h"
 
+// Number of characters (without the null terminator) of the paths stored in a CanonicalizedPath itself, i.e., without any heap allocation.
+// Covers most paths: longer ones are rare, since most tools still don't support them.
+#define CANONICALIZED_PATH_INLINE_LENGTH MAX_PATH
+
 // Immutable, typed, and canonical path string. The represented path is absolute, free of .. and . traversals, redundant path separators, etc.
 // A canonicalized path is independent of the current directory (which is mutable and process global).
-// Since the path is immutable, the underlying storage for the path string is shared among instances under copy construction and assignment.
+// Paths of up to CANONICALIZED_PATH_INLINE_LENGTH characters are stored inline, so canonicalizing them does not allocate;
+// the storage of longer paths is allocated once and, since the path is immutable, shared among instances under copy construction and assignment.
 struct CanonicalizedPath {
     CanonicalizedPath()
-        : Type(PathType::Null), m_value(nullptr)
-    { }
+        : Type(PathType::Null), m_length(0), m_heapBuffer(nullptr)
+    {
+        m_inlineBuffer[0] = L'\0';
+    }
 
     CanonicalizedPath(PathType type, wchar_t const* value, size_t valuePrefixLength)
-        : Type(type), m_value(std::make_shared<std::wstring>(value, valuePrefixLength))
-    { }
+        : Type(type), m_length(0), m_heapBuffer(nullptr)
+    {
+        wchar_t* chars = Allocate(valuePrefixLength);
+        wmemcpy(chars, value, valuePrefixLength);
+        chars[valuePrefixLength] = L'\0';
+    }
 
     CanonicalizedPath(CanonicalizedPath&& other)
-        : Type(other.Type), m_value(std::move(other.m_value))
+        : Type(PathType::Null), m_length(0), m_heapBuffer(nullptr)
     {
-        other.Type = PathType::Null;
+        MoveFrom(other);
+    }
+
+    CanonicalizedPath(const CanonicalizedPath& other)
+        : Type(PathType::Null), m_length(0), m_heapBuffer(nullptr)
+    {
+        CopyFrom(other);
+    }
+
+    CanonicalizedPath& operator=(CanonicalizedPath&& other) {
+        if (this != &other) {
+            Release();
+            MoveFrom(other);
+        }
+
+        return *this;
+    }
+
+    CanonicalizedPath& operator=(const CanonicalizedPath& other) {
+        if (this != &other) {
+            Release();
+            CopyFrom(other);
+        }
+
+        return *this;
     }
 
-    CanonicalizedPath(const CanonicalizedPath& other) = default;
-    CanonicalizedPath& operator=(const CanonicalizedPath&) = default;
+    ~CanonicalizedPath() {
+        Release();
+    }
 
     CanonicalizedPath Extend(wchar_t const* additionalComponents, size_t* extensionStartIndex = nullptr) const;
     CanonicalizedPath RemoveLastComponent() const;
@@ -32,11 +68,11 @@ struct CanonicalizedPath {
     bool IsNull() const { return Type == PathType::Null; }
 
     size_t Length() const {
-        return m_value ? m_value->length() : 0;
+        return m_length;
     }
 
     wchar_t const* GetPathString() const {
-        return m_value ? m_value->c_str() : nullptr;
+        return IsNull() ? nullptr : Chars();
     }
 
     // Returns the path string with the type prefix (\\?\, \??\, or \\.\) omitted if present.
@@ -64,11 +100,55 @@ struct CanonicalizedPath {
     PathType Type;
 
 private:
-    // Private constructor for Canonicalize, which creates a wstring for m_value.
-    // This constructor allocates a new shared_ptr managed string but moves the contents rather than copying them.
-    CanonicalizedPath(PathType type, std::wstring&& value)
-        : Type(type), m_value(std::make_shared<std::wstring>(std::move(value)))
-    { }
+    // Storage of the paths that don't fit inline, shared by all the instances holding the same path (the path is immutable once constructed).
+    struct HeapBuffer {
+        volatile LONG ReferenceCount;
+        wchar_t Chars[1];
+    };
+
+    wchar_t const* Chars() const {
+        return m_heapBuffer != nullptr ? m_heapBuffer->Chars : m_inlineBuffer;
+    }
+
+    // Makes room for a path of the given length (plus its null terminator), which the caller then writes into the returned storage.
+    // Only to be used by the functions constructing a path, on an empty instance.
+    wchar_t* Allocate(size_t length);
+
+    // Frees (or stops sharing) the storage, leaving an empty, null path.
+    void Release();
+
+    // Applies GetFullPathNameW to 'path', writing the result right into the storage of 'fullPath'.
+    static DWORD GetFullPath(__in PCWSTR path, CanonicalizedPath& fullPath);
+
+    void CopyFrom(const CanonicalizedPath& other) {
+        Type = other.Type;
+        m_length = other.m_length;
+        if (other.m_heapBuffer != nullptr) {
+            InterlockedIncrement(&other.m_heapBuffer->ReferenceCount);
+            m_heapBuffer = other.m_heapBuffer;
+        }
+        else {
+            wmemcpy(m_inlineBuffer, other.m_inlineBuffer, other.m_length + 1);
+        }
+    }
+
+    void MoveFrom(CanonicalizedPath& other) {
+        if (other.m_heapBuffer != nullptr) {
+            Type = other.Type;
+            m_length = other.m_length;
+            m_heapBuffer = other.m_heapBuffer;
+            other.m_heapBuffer = nullptr;
+        }
+        else {
+            CopyFrom(other);
+        }
+
+        other.Type = PathType::Null;
+        other.m_length = 0;
+        other.m_inlineBuffer[0] = L'\0';
+    }
 
-    std::shared_ptr<std::wstring> m_value;
+    size_t m_length;
+    HeapBuffer* m_heapBuffer;
+    wchar_t m_inlineBuffer[CANONICALIZED_PATH_INLINE_LENGTH + 1];
 };
@@ -92,8 +92,47 @@ inline bool CheckReportAnyAccess(FileAccessManifestFlag flags, bool accessDenied
 //
 enum class FileAccessManifestExtraFlag {
     None = 0x0,
+    BatchReports = 0x1,
+    BinaryReports = 0x2,
+    ReportRing = 0x4,
+    SharedReparsePointCache = 0x8,
+    ReportOncePerPathAndAccess = 0x10,
+    CacheDosDeviceNames = 0x20,
+    CollectDetourStatistics = 0x40,
+    ObserveOnly = 0x80,
+    NtCreateFileOnly = 0x100,
+    MinimalDetours = 0x200,
+    DeferColdDetours = 0x400,
+    CacheProbeResults = 0x800,
+    CacheImagePathSearches = 0x1000,
+    AllowManifestRetarget = 0x2000,
+    SummarizeDirectoryEnumerations = 0x4000,
+    UseHotpatchDetours = 0x8000,
+    SharedReportedAccesses = 0x10000,
+    BufferDebugMessages = 0x20000,
 };
 
+DEFINE_ENUM_FLAG_OPERATORS(FileAccessManifestExtraFlag)
+
+inline bool CheckBatchReports(FileAccessManifestExtraFlag flags) { return (flags & FileAccessManifestExtraFlag::BatchReports) != FileAccessManifestExtraFlag::None; }
+inline bool CheckBinaryReports(FileAccessManifestExtraFlag flags) { return (flags & FileAccessManifestExtraFlag::BinaryReports) != FileAccessManifestExtraFlag::None; }
+inline bool CheckReportRing(FileAccessManifestExtraFlag flags) { return (flags & FileAccessManifestExtraFlag::ReportRing) != FileAccessManifestExtraFlag::None; }
+inline bool CheckSharedReparsePointCache(FileAccessManifestExtraFlag flags) { return (flags & FileAccessManifestExtraFlag::SharedReparsePointCache) != FileAccessManifestExtraFlag::None; }
+inline bool CheckReportOncePerPathAndAccess(FileAccessManifestExtraFlag flags) { return (flags & FileAccessManifestExtraFlag::ReportOncePerPathAndAccess) != FileAccessManifestExtraFlag::None; }
+inline bool CheckCacheDosDeviceNames(FileAccessManifestExtraFlag flags) { return (flags & FileAccessManifestExtraFlag::CacheDosDeviceNames) != FileAccessManifestExtraFlag::None; }
+inline bool CheckCollectDetourStatistics(FileAccessManifestExtraFlag flags) { return (flags & FileAccessManifestExtraFlag::CollectDetourStatistics) != FileAccessManifestExtraFlag::None; }
+inline bool CheckObserveOnly(FileAccessManifestExtraFlag flags) { return (flags & FileAccessManifestExtraFlag::ObserveOnly) != FileAccessManifestExtraFlag::None; }
+inline bool CheckNtCreateFileOnly(FileAccessManifestExtraFlag flags) { return (flags & FileAccessManifestExtraFlag::NtCreateFileOnly) != FileAccessManifestExtraFlag::None; }
+inline bool CheckMinimalDetours(FileAccessManifestExtraFlag flags) { return (flags & FileAccessManifestExtraFlag::MinimalDetours) != FileAccessManifestExtraFlag::None; }
+inline bool CheckDeferColdDetours(FileAccessManifestExtraFlag flags) { return (flags & FileAccessManifestExtraFlag::DeferColdDetours) != FileAccessManifestExtraFlag::None; }
+inline bool CheckCacheProbeResults(FileAccessManifestExtraFlag flags) { return (flags & FileAccessManifestExtraFlag::CacheProbeResults) != FileAccessManifestExtraFlag::None; }
+inline bool CheckCacheImagePathSearches(FileAccessManifestExtraFlag flags) { return (flags & FileAccessManifestExtraFlag::CacheImagePathSearches) != FileAccessManifestExtraFlag::None; }
+inline bool CheckAllowManifestRetarget(FileAccessManifestExtraFlag flags) { return (flags & FileAccessManifestExtraFlag::AllowManifestRetarget) != FileAccessManifestExtraFlag::None; }
+inline bool CheckSummarizeDirectoryEnumerations(FileAccessManifestExtraFlag flags) { return (flags & FileAccessManifestExtraFlag::SummarizeDirectoryEnumerations) != FileAccessManifestExtraFlag::None; }
+inline bool CheckUseHotpatchDetours(FileAccessManifestExtraFlag flags) { return (flags & FileAccessManifestExtraFlag::UseHotpatchDetours) != FileAccessManifestExtraFlag::None; }
+inline bool CheckSharedReportedAccesses(FileAccessManifestExtraFlag flags) { return (flags & FileAccessManifestExtraFlag::SharedReportedAccesses) != FileAccessManifestExtraFlag::None; }
+inline bool CheckBufferDebugMessages(FileAccessManifestExtraFlag flags) { return (flags & FileAccessManifestExtraFlag::BufferDebugMessages) != FileAccessManifestExtraFlag::None; }
+
 //
 // CODESYNC: Keep this in sync with the C# version declared in Public\Src\Engine\Processes\FileAccessPolicy.cs
 //
@@ -144,6 +183,10 @@ enum FileAccessPolicy
     // If set, full reparse point tracking should be done for this path/file
     FileAccessPolicy_EnableFullReparsePointParsing = 0x1000,
 
+    // If set, this path/file and everything under it are guaranteed not to be reparse points, so only the directories above the scope
+    // are checked for reparse points
+    FileAccessPolicy_NoReparsePoints = 0x2000,
+
     // If set, then we will report all attempts to access files under this scope (whether existent or not).
     // BuildXL uses this information to discover dynamic dependencies, such as #include-ed files.
     FileAccessPolicy_ReportAccess = FileAccessPolicy_ReportAccessIfNonExistent | FileAccessPolicy_ReportAccessIfExistent,
@@ -184,7 +227,10 @@ enum class ReportType
     ReportType_ProcessData = 4,
     ReportType_ProcessDetouringStatus = 5,
     ReportType_AugmentedFileAccess = 6,
-    ReportType_Max = 7,
+    ReportType_FileAccessRecord = 7,
+    ReportType_DetourStatistics = 8,
+    ReportType_DirectoryEnumerationSummary = 9,
+    ReportType_Max = 10,
 };
 
 // Keep this in sync with the C# version declared in FileAccessManifest.cs
@@ -599,6 +645,41 @@ typedef struct ManifestSubstituteProcessExecutionShim_t
 } ManifestSubstituteProcessExecutionShim_t;
 typedef const ManifestSubstituteProcessExecutionShim_t * PCManifestSubstituteProcessExecutionShim;
 
+// ==========================================================================
+// == ManifestPathFilter
+// ==========================================================================
+// A Bloom filter of the paths of the records of a manifest tree (see ManifestRecord::PathFilterFlag and FileAccessManifest.UseManifestPathFilter),
+// so that a search can tell that a path has no record without probing the children of the record it reached.
+//
+// A path is identified by the hashes of its components (the hashes of the partial paths of the records), chained from the root with
+// ExtendPathHash. Each path sets 3 bits of one of the WordCount (a power of two) words of the filter.
+typedef struct ManifestPathFilter_t
+{
+    typedef uint32_t WordType;
+
+    static const uint32_t RootPathHash = 0x9E3779B9;
+
+    WordType WordCount;
+    WordType Words[ANYSIZE_ARRAY];
+
+    // CODESYNC: FileAccessManifest.cs (Node.ExtendPathHash)
+    static inline uint32_t ExtendPathHash(uint32_t parentPathHash, uint32_t childHash) {
+        return (((parentPathHash << 5) | (parentPathHash >> 27)) ^ childHash) * 0x85EBCA6B;
+    }
+
+    // False if no record has the path; true if one may have it.
+    // CODESYNC: FileAccessManifest.cs (Node.AddToPathFilter)
+    inline bool MayContain(uint32_t pathHash) const {
+        uint32_t x = pathHash ^ (pathHash >> 16);
+        x *= 0xC2B2AE35;
+        x ^= x >> 13;
+        uint32_t y = x * 0x9E3779B1;
+        WordType mask = (1u << (y >> 27)) | (1u << ((y >> 22) & 31)) | (1u << ((y >> 17) & 31));
+        return (this->Words[x & (this->WordCount - 1)] & mask) == mask;
+    }
+} ManifestPathFilter;
+typedef const ManifestPathFilter * PCManifestPathFilter;
+
 // ==========================================================================
 // == ManifestRecord
 // ==========================================================================
@@ -625,6 +706,27 @@ typedef struct ManifestRecord_t
     ChildOffsetType     Buckets[ANYSIZE_ARRAY];
     // PartialPathType PartialPath (after the end of the Buckets array)
 
+    // Set in the bucket count of a record whose children are laid out in the compact layout (see FileAccessManifest.UseCompactManifestTree):
+    //   Buckets[0]                           number of home slots (a child with hash h is at or after slot h % home slot count)
+    //   Buckets[1 .. 1 + slots)              child offsets, placed by linear probing without wrapping (0 when the slot is empty)
+    //   Buckets[1 + slots .. 1 + 2 * slots)  child hashes, so that a lookup probes consecutive hashes without touching the child records
+    //   PartialPath
+    // A probe that starts at a home slot reaches an empty slot before the end of the slots, and there are always at least
+    // CompactLayoutProbeWidth slots from any home slot and from the slot after any occupied slot, so that probes can read blocks of hashes.
+    // Leaves are always in the original layout.
+    static const BucketCountType CompactLayoutFlag = 0x80000000;
+    static const BucketCountType CompactLayoutProbeWidth = 4;
+
+    // Set in the bucket count of the root record of a tree that has a path filter: the filter (a ManifestPathFilter) follows the
+    // partial path of the record (padded to 4 bytes), before the records of the children.
+    static const BucketCountType PathFilterFlag = 0x40000000;
+
+    // Set in the bucket count of a record of a delta tree (see FileAccessManifest.ManifestTreeBase) that has a record with the same path in the
+    // base tree the delta tree is overlaid on: the offset of that base record from the root record of the base tree (a ChildOffsetType) follows
+    // the partial path of the record (padded to 4 bytes), before the path filter if any. A child that the record does not have is looked up among
+    // the children of the base record, and the search carries on in the base tree from there (see FindFileAccessPolicyInTreeEx).
+    static const BucketCountType BaseLinkFlag = 0x20000000;
+
     inline USN GetExpectedUsn() const {
         return (((USN)this->ExpectedUsnHi) << 32) | this->ExpectedUsnLo;
     }
@@ -643,11 +745,44 @@ typedef struct ManifestRecord_t
         return static_cast<FileAccessPolicy>(this->NodePolicy);
     }
 
+    inline bool IsCompactLayout() const {
+        return (this->BucketCount & CompactLayoutFlag) != 0;
+    }
+
+    inline bool HasPathFilter() const {
+        return (this->BucketCount & PathFilterFlag) != 0;
+    }
+
+    inline bool HasBaseLink() const {
+        return (this->BucketCount & BaseLinkFlag) != 0;
+    }
+
+    // Number of child slots (0 for a leaf), whatever the layout
+    inline BucketCountType GetBucketCount() const {
+        return this->BucketCount & ~(CompactLayoutFlag | PathFilterFlag | BaseLinkFlag);
+    }
+
+    inline const ChildOffsetType* GetChildOffsets() const {
+        return IsCompactLayout() ? &this->Buckets[1] : this->Buckets;
+    }
+
+    // Compact layout only
+    inline BucketCountType GetHomeSlotCount() const {
+        assert(IsCompactLayout());
+        return this->Buckets[0];
+    }
+
+    // Compact layout only
+    inline const HashType* GetChildHashes() const {
+        assert(IsCompactLayout());
+        return &this->Buckets[1 + GetBucketCount()];
+    }
+
     PCManifestRecord GetChildRecord(BucketCountType index) const
     {
-        assert(index < this->BucketCount);
+        assert(index < GetBucketCount());
 
-        ChildOffsetType childOffset = this->Buckets[index];
+        ChildOffsetType childOffset = GetChildOffsets()[index];
         if (childOffset == 0)
         {
             return nullptr;
@@ -661,7 +796,8 @@ typedef struct ManifestRecord_t
 
     bool IsCollisionChainStart(BucketCountType index) const
     {
-        assert(index < this->BucketCount);
+        assert(!IsCompactLayout());
+        assert(index < GetBucketCount());
 
         ChildOffsetType childOffset = this->Buckets[index];
         return (childOffset & FileAccessBucketOffsetFlag::ChainStart) != 0;
@@ -669,7 +805,8 @@ typedef struct ManifestRecord_t
 
     bool IsCollisionChainContinuation(BucketCountType index) const
     {
-        assert(index < this->BucketCount);
+        assert(!IsCompactLayout());
+        assert(index < GetBucketCount());
 
         ChildOffsetType childOffset = this->Buckets[index];
         return (childOffset & FileAccessBucketOffsetFlag::ChainContinuation) != 0;
@@ -677,16 +814,32 @@ typedef struct ManifestRecord_t
 
     PartialPathType GetPartialPath() const
     {
-        BucketCountType numBuckets = this->BucketCount;
-        PartialPathType path = reinterpret_cast<PartialPathType>(&(this->Buckets[numBuckets]));
+        BucketCountType numBuckets = GetBucketCount();
+        PartialPathType path = reinterpret_cast<PartialPathType>(IsCompactLayout()
+            ? &(this->Buckets[1 + 2 * numBuckets])
+            : &(this->Buckets[numBuckets]));
 
         return path;
     }
 
+    // Root record only (see PathFilterFlag); nullptr if the tree has no path filter.
+    PCManifestPathFilter GetPathFilter() const;
+
+    // Delta tree records only (see BaseLinkFlag): the record with the same path in the base tree rooted at baseRoot; nullptr if there is none.
+    PCManifestRecord GetBaseRecord(PCManifestRecord baseRoot) const;
+
+    __success(return)
+    bool FindChild(
+        __in  PCPathChar target,
+        __in  size_t targetLength,
+        __out PCManifestRecord& child) const;
+
+    // Same as above, given the hash (HashPath) of the target.
     __success(return)
     bool FindChild(
         __in  PCPathChar target,
         __in  size_t targetLength,
+        __in  DWORD hash,
         __out PCManifestRecord& child) const;
 } ManifestRecord;
 typedef const ManifestRecord * PCManifestRecord; // duplicated for use in scopes outside of the struct
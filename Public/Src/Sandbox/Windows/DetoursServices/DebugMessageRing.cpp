@@ -0,0 +1,201 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "stdafx.h"
+
+#include "DataTypes.h"
+#include "DebugMessageRing.h"
+#include "DebuggingHelpers.h"
+#include "FileAccessHelpers.h"
+#include "globals.h"
+
+#define DEBUG_MESSAGE_RING_SLOT_COUNT 256 // a power of 2
+#define DEBUG_MESSAGE_RING_SLOT_CAPACITY 512 // in characters
+#define DEBUG_MESSAGE_FLUSH_CAPACITY (64 * 1024 / sizeof(wchar_t)) // in characters
+#define DEBUG_MESSAGE_FLUSH_INTERVAL_MS 100
+
+typedef struct DebugMessageSlot_t
+{
+    volatile LONG64 Sequence;
+    size_t Length; // in characters
+    wchar_t Text[DEBUG_MESSAGE_RING_SLOT_CAPACITY];
+} DebugMessageSlot;
+
+static DebugMessageSlot g_debugMessageSlots[DEBUG_MESSAGE_RING_SLOT_COUNT];
+static volatile LONG64 g_debugMessageEnqueuePos;
+static volatile LONG g_debugMessagesDropped;
+static volatile LONG g_debugMessageFlushScheduled;
+static bool g_bufferDebugMessages;
+static PTP_TIMER g_debugMessageFlushTimer;
+
+// Only held by the consumer: it guards the dequeue position and the flush buffer.
+static SRWLOCK g_debugMessageFlushLock = SRWLOCK_INIT;
+static LONG64 g_debugMessageDequeuePos;
+static wchar_t g_debugMessageFlushBuffer[DEBUG_MESSAGE_FLUSH_CAPACITY];
+
+static VOID CALLBACK DebugMessageFlushTimerCallback(PTP_CALLBACK_INSTANCE instance, PVOID context, PTP_TIMER timer)
+{
+    UNREFERENCED_PARAMETER(instance);
+    UNREFERENCED_PARAMETER(context);
+    UNREFERENCED_PARAMETER(timer);
+
+    FlushDebugMessages();
+}
+
+// Arms the flush timer unless a flush is pending already; the flush clears g_debugMessageFlushScheduled before it drains the
+// ring, so a message added while it runs schedules the next one.
+static void ScheduleDebugMessageFlush()
+{
+    if (InterlockedCompareExchange(&g_debugMessageFlushScheduled, 1, 0) != 0) {
+        return;
+    }
+
+    // Negative due times are relative, in 100 nanosecond units.
+    ULARGE_INTEGER dueTime;
+    dueTime.QuadPart = (ULONGLONG)(-((LONGLONG)DEBUG_MESSAGE_FLUSH_INTERVAL_MS * 10000));
+    FILETIME fileDueTime;
+    fileDueTime.dwHighDateTime = dueTime.HighPart;
+    fileDueTime.dwLowDateTime = dueTime.LowPart;
+    SetThreadpoolTimer(g_debugMessageFlushTimer, &fileDueTime, 0, 0);
+}
+
+void InitializeDebugMessageRing()
+{
+    if (g_bufferDebugMessages || !BufferDebugMessages()) {
+        return;
+    }
+
+    for (LONG64 i = 0; i < DEBUG_MESSAGE_RING_SLOT_COUNT; i++) {
+        g_debugMessageSlots[i].Sequence = i;
+    }
+
+    g_debugMessageFlushTimer = CreateThreadpoolTimer(DebugMessageFlushTimerCallback, nullptr, nullptr);
+    if (g_debugMessageFlushTimer == nullptr) {
+        Dbg(L"Warning: Could not create the debug message flush timer (GLE=%d); debug messages will not be buffered.", GetLastError());
+        return;
+    }
+
+    g_bufferDebugMessages = true;
+}
+
+bool TryBufferDebugMessage(_In_reads_(length) wchar_t const* line, size_t length)
+{
+    if (!g_bufferDebugMessages) {
+        return false;
+    }
+
+    DebugMessageSlot* slot;
+    LONG64 pos = g_debugMessageEnqueuePos;
+    for (;;) {
+        slot = &g_debugMessageSlots[pos & (DEBUG_MESSAGE_RING_SLOT_COUNT - 1)];
+        LONG64 diff = slot->Sequence - pos;
+        if (diff == 0) {
+            LONG64 current = InterlockedCompareExchange64(&g_debugMessageEnqueuePos, pos + 1, pos);
+            if (current == pos) {
+                break;
+            }
+
+            pos = current;
+        }
+        else if (diff < 0) {
+            // Full: the consumer has not released this slot yet.
+            InterlockedIncrement(&g_debugMessagesDropped);
+            ScheduleDebugMessageFlush();
+            return true;
+        }
+        else {
+            pos = g_debugMessageEnqueuePos;
+        }
+    }
+
+    if (length > DEBUG_MESSAGE_RING_SLOT_CAPACITY) {
+        // Keeps the line terminator, so that the managed side still sees one line.
+        wmemcpy(slot->Text, line, DEBUG_MESSAGE_RING_SLOT_CAPACITY - 2);
+        wmemcpy(slot->Text + DEBUG_MESSAGE_RING_SLOT_CAPACITY - 2, L"\r\n", 2);
+        slot->Length = DEBUG_MESSAGE_RING_SLOT_CAPACITY;
+    }
+    else {
+        wmemcpy(slot->Text, line, length);
+        slot->Length = length;
+    }
+
+    // Full barrier: the message is visible before the slot is published.
+    InterlockedExchange64(&slot->Sequence, pos + 1);
+
+    ScheduleDebugMessageFlush();
+    return true;
+}
+
+// Failures are not reported: doing so (through Dbg) would log into the ring that is being flushed.
+static void WriteDebugMessages(_In_reads_(length) wchar_t const* data, size_t length)
+{
+    OVERLAPPED overlapped;
+    ZeroMemory(&overlapped, sizeof(OVERLAPPED));
+    // This offset specifies "append".
+    overlapped.Offset = 0xFFFFFFFF;
+    overlapped.OffsetHigh = 0xFFFFFFFF;
+
+    DWORD bytesWritten;
+    WriteFile(g_reportFileHandle, data, (DWORD)(sizeof(wchar_t) * length), &bytesWritten, &overlapped);
+}
+
+void FlushDebugMessages(bool processDetaching)
+{
+    if (!g_bufferDebugMessages || g_reportFileHandle == NULL || g_reportFileHandle == INVALID_HANDLE_VALUE) {
+        return;
+    }
+
+    if (processDetaching) {
+        if (!TryAcquireSRWLockExclusive(&g_debugMessageFlushLock)) {
+            return;
+        }
+    }
+    else {
+        AcquireSRWLockExclusive(&g_debugMessageFlushLock);
+    }
+
+    DWORD lastError = GetLastError();
+    InterlockedExchange(&g_debugMessageFlushScheduled, 0);
+
+    size_t length = 0;
+    for (;;) {
+        DebugMessageSlot* slot = &g_debugMessageSlots[g_debugMessageDequeuePos & (DEBUG_MESSAGE_RING_SLOT_COUNT - 1)];
+        if (slot->Sequence != g_debugMessageDequeuePos + 1) {
+            // Empty (or the next message is not published yet, in which case its producer schedules another flush).
+            break;
+        }
+
+        if (length + slot->Length > DEBUG_MESSAGE_FLUSH_CAPACITY) {
+            WriteDebugMessages(g_debugMessageFlushBuffer, length);
+            length = 0;
+        }
+
+        wmemcpy(g_debugMessageFlushBuffer + length, slot->Text, slot->Length);
+        length += slot->Length;
+
+        InterlockedExchange64(&slot->Sequence, g_debugMessageDequeuePos + DEBUG_MESSAGE_RING_SLOT_COUNT);
+        g_debugMessageDequeuePos++;
+    }
+
+    LONG dropped = InterlockedExchange(&g_debugMessagesDropped, 0);
+    if (dropped > 0) {
+        wchar_t line[128];
+        int lineLength = swprintf_s(line, L"%d,Warning: Dropped %d debug messages: the debug message ring was full.\r\n", ReportType::ReportType_DebugMessage, dropped);
+        if (lineLength > 0) {
+            if (length + lineLength > DEBUG_MESSAGE_FLUSH_CAPACITY) {
+                WriteDebugMessages(g_debugMessageFlushBuffer, length);
+                length = 0;
+            }
+
+            wmemcpy(g_debugMessageFlushBuffer + length, line, lineLength);
+            length += lineLength;
+        }
+    }
+
+    if (length > 0) {
+        WriteDebugMessages(g_debugMessageFlushBuffer, length);
+    }
+
+    SetLastError(lastError);
+    ReleaseSRWLockExclusive(&g_debugMessageFlushLock);
+}
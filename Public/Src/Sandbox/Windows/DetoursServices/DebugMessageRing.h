@@ -0,0 +1,30 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <windows.h>
+
+// When FileAccessManifestExtraFlag::BufferDebugMessages is set, the debug messages of a process (see Dbg) are not written
+// to the report pipe by the thread that logs them: they are put into a bounded, per-process ring, which threads add to
+// without taking a lock, and which is written out in a single pipe write DEBUG_MESSAGE_FLUSH_INTERVAL_MS after a message
+// was added, whenever the report batch is flushed (i.e., right before a child process is created and when the process
+// detaches, see FlushReportBatch) and before an internal error is handled (see HandleDetoursInjectionAndCommunicationErrors).
+//
+// The ring is Dmitry Vyukov's bounded MPMC queue (like ReportRing, but in process memory and with a slot per message):
+// a producer claims position 'pos' by CAS-ing the enqueue position when the sequence number of slot 'pos % slotCount'
+// equals 'pos', copies its message into the slot and publishes it by setting the sequence number to 'pos + 1'; the flush,
+// the only consumer, releases the slot by setting it to 'pos + slotCount'. Messages longer than a slot are truncated;
+// messages logged while the ring is full are dropped, and how many were is reported by the next flush. Messages still
+// in the ring when the process is terminated (TerminateProcess) are lost; hence buffering is opt-in.
+
+// Sets up the ring if FileAccessManifestExtraFlag::BufferDebugMessages is set; to be called once the manifest is parsed.
+void InitializeDebugMessageRing();
+
+// Puts a complete report line (type prefix and line terminator included) into the ring.
+// Returns false if debug messages are not buffered, in which case the caller writes the line itself.
+bool TryBufferDebugMessage(_In_reads_(length) wchar_t const* line, size_t length);
+
+// Writes out the buffered debug messages.
+// Pass processDetaching when the process is exiting: the thread holding the flush lock (if any) will never release it.
+void FlushDebugMessages(bool processDetaching = false);
@@ -4,6 +4,7 @@
 #include "stdafx.h"
 
 #include "globals.h"
+#include "DebugMessageRing.h"
 #include "DebuggingHelpers.h"
 #include "FileAccessHelpers.h"
 #include "DetoursServices.h"
@@ -112,6 +113,8 @@ static void WriteMessage(PCWSTR text)
 
 void HandleDetoursInjectionAndCommunicationErrors(int errorCode, LPCWSTR eventLogMsgPtr, LPCWSTR eventLogMsgId)
 {
+    // The process may exit below: the debug messages logged up to the error are written out first.
+    FlushDebugMessages();
     fflush(stdout);
     fflush(stderr);
     std::wstring strMsg(eventLogMsgPtr);
@@ -140,6 +143,10 @@ void Dbg(PCWSTR format, ...)
     report.append(resultArgs);
     report.append(L"\r\n");
 
+    if (TryBufferDebugMessage(report.c_str(), report.length())) {
+        return;
+    }
+
     PCWSTR buffer = report.c_str();
 
 #if SUPER_VERBOSE
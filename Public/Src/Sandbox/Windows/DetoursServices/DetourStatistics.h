@@ -0,0 +1,194 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include "FileAccessHelpers.h"
+#include "DetoursTracing.h"
+
+// When FileAccessManifestExtraFlag::CollectDetourStatistics is set, every detoured function counts its calls and the time
+// spent in it, excluding the time spent in the detoured functions it calls (hence a call to CreateFileW does not count the
+// time of the NtCreateFile call it makes, which is counted by NtCreateFile). The statistics are sent when the process
+// detaches, as a ReportType_DetourStatistics report, along with the hit counts of the resolved path cache.
+//
+// The counters are spread over cache lines by thread, like the ones of the resolved path cache (see PathCacheStatistics).
+//
+// The same scopes emit the DetourCall events of the ETW provider of DetoursServices (see DetoursTracing.h) when a session
+// enables them, with or without CollectDetourStatistics.
+
+// All the detoured functions (see DetouredFunctions.h)
+#define FOR_ALL_DETOUR_STATISTICS(X) \
+    X(ZwSetInformationFile) \
+    X(CreateProcessW) \
+    X(CreateProcessA) \
+    X(CreateFileW) \
+    X(CloseHandle) \
+    X(CreateFileA) \
+    X(GetVolumePathNameW) \
+    X(DefineDosDeviceW) \
+    X(GetFileAttributesW) \
+    X(GetFileAttributesA) \
+    X(GetFileAttributesExW) \
+    X(GetFileAttributesExA) \
+    X(CopyFileW) \
+    X(CopyFileA) \
+    X(CopyFileExW) \
+    X(CopyFileExA) \
+    X(MoveFileW) \
+    X(MoveFileA) \
+    X(MoveFileExW) \
+    X(MoveFileExA) \
+    X(MoveFileWithProgressW) \
+    X(MoveFileWithProgressA) \
+    X(ReplaceFileW) \
+    X(ReplaceFileA) \
+    X(DeleteFileW) \
+    X(DeleteFileA) \
+    X(CreateHardLinkW) \
+    X(CreateHardLinkA) \
+    X(CreateSymbolicLinkW) \
+    X(CreateSymbolicLinkA) \
+    X(FindFirstFileW) \
+    X(FindFirstFileA) \
+    X(FindFirstFileExW) \
+    X(FindFirstFileExA) \
+    X(FindNextFileW) \
+    X(FindNextFileA) \
+    X(GetFileInformationByHandleEx) \
+    X(FindClose) \
+    X(GetFileInformationByHandle) \
+    X(SetFileInformationByHandle) \
+    X(OpenFileMappingW) \
+    X(OpenFileMappingA) \
+    X(GetTempFileNameW) \
+    X(GetTempFileNameA) \
+    X(CreateDirectoryW) \
+    X(CreateDirectoryA) \
+    X(CreateDirectoryExW) \
+    X(CreateDirectoryExA) \
+    X(RemoveDirectoryW) \
+    X(RemoveDirectoryA) \
+    X(DecryptFileW) \
+    X(DecryptFileA) \
+    X(EncryptFileW) \
+    X(EncryptFileA) \
+    X(OpenEncryptedFileRawW) \
+    X(OpenEncryptedFileRawA) \
+    X(OpenFileById) \
+    X(GetFinalPathNameByHandleA) \
+    X(GetFinalPathNameByHandleW) \
+    X(NtQueryDirectoryFile) \
+    X(ZwQueryDirectoryFile) \
+    X(ZwCreateFile) \
+    X(NtCreateFile) \
+    X(ZwOpenFile) \
+    X(NtOpenFile) \
+    X(NtClose)
+
+enum DetourStatisticsId
+{
+#define GEN_DETOUR_STATISTICS_ID(name) DetourStatisticsId_##name,
+    FOR_ALL_DETOUR_STATISTICS(GEN_DETOUR_STATISTICS_ID)
+#undef GEN_DETOUR_STATISTICS_ID
+    DetourStatisticsId_Count
+};
+
+#define DETOUR_STATISTICS_STRIPES 16
+
+typedef struct __declspec(align(64)) DetourStatistics_t
+{
+    volatile LONG64 Calls[DetourStatisticsId_Count];
+
+    // In QueryPerformanceCounter ticks
+    volatile LONG64 Ticks[DetourStatisticsId_Count];
+} DetourStatistics;
+
+extern DetourStatistics g_detourStatistics[DETOUR_STATISTICS_STRIPES];
+
+inline const char* GetDetourStatisticsName(DetourStatisticsId id)
+{
+#define GEN_DETOUR_STATISTICS_NAME(name) #name,
+    static const char* const names[DetourStatisticsId_Count] = { FOR_ALL_DETOUR_STATISTICS(GEN_DETOUR_STATISTICS_NAME) };
+#undef GEN_DETOUR_STATISTICS_NAME
+    return names[id];
+}
+
+// Counts a call to a detoured function, and the time until the end of the scope. Must be the first statement of the function.
+class DetourStatisticsScope
+{
+public:
+    DetourStatisticsScope(DetourStatisticsId id)
+        : m_id(id), m_start(0), m_nestedTicks(0), m_parent(nullptr), m_collect(CollectDetourStatistics()),
+          m_trace(IsDetoursTracingEnabled(DETOURS_TRACE_KEYWORD_DETOURS))
+    {
+        if (!m_collect && !m_trace)
+        {
+            return;
+        }
+
+        LARGE_INTEGER start;
+        QueryPerformanceCounter(&start);
+        m_start = start.QuadPart;
+        m_parent = gt_current;
+        gt_current = this;
+    }
+
+    ~DetourStatisticsScope()
+    {
+        if (m_start == 0)
+        {
+            return;
+        }
+
+        LARGE_INTEGER end;
+        QueryPerformanceCounter(&end);
+        LONG64 elapsed = end.QuadPart - m_start;
+
+        gt_current = m_parent;
+        if (m_parent != nullptr)
+        {
+            m_parent->m_nestedTicks += elapsed;
+        }
+
+        if (m_collect)
+        {
+            // Thread ids are multiples of 4
+            DetourStatistics& statistics = g_detourStatistics[(GetCurrentThreadId() >> 2) % DETOUR_STATISTICS_STRIPES];
+            InterlockedIncrement64(&statistics.Calls[m_id]);
+            InterlockedAdd64(&statistics.Ticks[m_id], elapsed - m_nestedTicks);
+        }
+
+        if (m_trace)
+        {
+            TraceDetourCall(GetDetourStatisticsName(m_id), elapsed, elapsed - m_nestedTicks);
+        }
+    }
+
+private:
+    // The innermost scope of the thread
+    static __declspec(thread) DetourStatisticsScope* gt_current;
+
+    DetourStatisticsId m_id;
+    LONG64 m_start;
+    LONG64 m_nestedTicks;
+    DetourStatisticsScope* m_parent;
+    bool m_collect;
+    bool m_trace;
+
+    DetourStatisticsScope(const DetourStatisticsScope&) = delete;
+    DetourStatisticsScope& operator=(const DetourStatisticsScope&) = delete;
+};
+
+#define DETOUR_STATISTICS(name) DetourStatisticsScope detourStatisticsScope(DetourStatisticsId_##name)
+
+// Sums the counters of all threads.
+inline void SumDetourStatistics(DetourStatisticsId id, ULONG64& calls, ULONG64& ticks)
+{
+    calls = 0;
+    ticks = 0;
+    for (size_t i = 0; i < DETOUR_STATISTICS_STRIPES; i++)
+    {
+        calls += g_detourStatistics[i].Calls[id];
+        ticks += g_detourStatistics[i].Ticks[id];
+    }
+}
@@ -92,6 +92,12 @@ typedef BOOL (WINAPI *GetVolumePathNameW_t)(
     __in                          DWORD cchBufferLength
     );
 
+typedef BOOL (WINAPI *DefineDosDeviceW_t)(
+    __in     DWORD dwFlags,
+    __in     LPCWSTR lpDeviceName,
+    __in_opt LPCWSTR lpTargetPath
+    );
+
 typedef DWORD (WINAPI *GetFileAttributesW_t)(
     __in LPCWSTR lpFileName
     );
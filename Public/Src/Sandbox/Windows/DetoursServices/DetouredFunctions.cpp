@@ -5,10 +5,17 @@
 
 #include "DetouredFunctions.h"
 #include "DetouredScope.h"
+#include "DetourStatistics.h"
+#include "DetoursTracing.h"
+#include "DosDeviceTable.h"
+#include "FilesCheckedForAccess.h"
 #include "HandleOverlay.h"
 #include "MetadataOverrides.h"
+#include "ProbeCache.h"
 #include "ResolvedPathCache.h"
+#include "ScratchArena.h"
 #include "SendReport.h"
+#include "SharedReparsePointCache.h"
 #include "StringOperations.h"
 #include "SubstituteProcessExecution.h"
 #include "UnicodeConverter.h"
@@ -53,6 +60,16 @@ static size_t GetLevelToEnableFullReparsePointParsing(const PolicyResult& policy
     return IgnoreFullReparsePointResolving() ? policyResult.FindLowestConsecutiveLevelThatStillHasProperty(FileAccessPolicy::FileAccessPolicy_EnableFullReparsePointParsing) : 0;
 }
 
+/// <summary>
+/// Given a policy result, get the level of the file path from which the manifest guarantees that there are no reparse points
+/// (see <code>FileAccessPolicy_NoReparsePoints</code>): only the levels below the returned level may be reparse points.
+/// Returns SIZE_MAX if the path is not under a scope without reparse points.
+/// </summary>
+static size_t GetLevelWithoutReparsePoints(const PolicyResult& policyResult)
+{
+    return policyResult.NoReparsePoints() ? policyResult.FindLowestConsecutiveLevelThatStillHasProperty(FileAccessPolicy::FileAccessPolicy_NoReparsePoints) : SIZE_MAX;
+}
+
 /// <summary>
 /// Checks if a file is a reparse point by calling <code>GetFileAttributesW</code>.
 /// </summary>
@@ -132,18 +149,18 @@ static bool AccessReparsePointTarget(
 }
 
 /// <summary>
-/// Gets the final full path by handle.
+/// Gets the final full path by handle, with the given flags.
 /// </summary>
 /// <remarks>
 /// This function encapsulates calls to <code>GetFinalPathNameByHandleW</code> and allocates memory as needed.
 /// </remarks>
-static DWORD DetourGetFinalPathByHandle(_In_ HANDLE hFile, _Inout_ wstring& fullPath)
+static DWORD DetourGetFinalPathByHandle(_In_ HANDLE hFile, _Inout_ wstring& fullPath, _In_ DWORD dwFlags)
 {
     // First, try with a fixed-sized buffer which should be good enough for all practical cases.
     wchar_t wszBuffer[MAX_PATH];
     DWORD nBufferLength = std::extent<decltype(wszBuffer)>::value;
 
-    DWORD result = GetFinalPathNameByHandleW(hFile, wszBuffer, nBufferLength, FILE_NAME_NORMALIZED);
+    DWORD result = GetFinalPathNameByHandleW(hFile, wszBuffer, nBufferLength, dwFlags);
     if (result == 0)
     {
         DWORD ret = GetLastError();
@@ -164,7 +181,7 @@ static DWORD DetourGetFinalPathByHandle(_In_ HANDLE hFile, _Inout_ wstring& full
         unique_ptr<wchar_t[]> buffer(new wchar_t[result]);
         assert(buffer.get());
 
-        DWORD next_result = GetFinalPathNameByHandleW(hFile, buffer.get(), result, FILE_NAME_NORMALIZED);
+        DWORD next_result = GetFinalPathNameByHandleW(hFile, buffer.get(), result, dwFlags);
         if (next_result == 0)
         {
             DWORD ret = GetLastError();
@@ -184,6 +201,31 @@ static DWORD DetourGetFinalPathByHandle(_In_ HANDLE hFile, _Inout_ wstring& full
     return ERROR_SUCCESS;
 }
 
+/// <summary>
+/// Gets the final full path by handle.
+/// </summary>
+/// <remarks>
+/// Getting the DOS path of a handle makes GetFinalPathNameByHandle query the mount manager for the DOS name of the volume.
+/// When DOS device names are cached (see DosDeviceTable), the NT path is asked for instead and its volume is translated with the table,
+/// unless the table cannot translate it. This is only done when Detoured_GetFinalPathNameByHandleW does not translate the paths it returns,
+/// since an NT path would not be translated like the DOS one.
+/// </remarks>
+static DWORD DetourGetFinalPathByHandle(_In_ HANDLE hFile, _Inout_ wstring& fullPath)
+{
+    const DosDeviceTable* dosDevices = IgnoreGetFinalPathNameByHandle() ? GetGlobalDosDeviceTable() : nullptr;
+    if (dosDevices != nullptr)
+    {
+        wstring ntPath;
+        if (DetourGetFinalPathByHandle(hFile, ntPath, FILE_NAME_NORMALIZED | VOLUME_NAME_NT) == ERROR_SUCCESS
+            && dosDevices->TryTranslate(ntPath.c_str(), ntPath.length(), fullPath))
+        {
+            return ERROR_SUCCESS;
+        }
+    }
+
+    return DetourGetFinalPathByHandle(hFile, fullPath, FILE_NAME_NORMALIZED);
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /////////////////////////////////////////////// Resolved path cache /////////////////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -194,7 +236,16 @@ static void PathCache_Invalidate(const std::wstring& path, bool isDirectory, con
         return;
     }
 
+    // The outcome of a probe is part of what the probe cache records, so only changes of how paths resolve invalidate it.
+    InvalidateProbeCache();
+
     ResolvedPathCache::Instance().Invalidate(path, isDirectory);
+
+    SharedReparsePointCache* sharedCache = GetGlobalSharedReparsePointCache();
+    if (sharedCache != NULL)
+    {
+        sharedCache->Invalidate(path, isDirectory);
+    }
 }
 
 static const Possible<std::pair<std::wstring, DWORD>> PathCache_GetResolvedPathAndType(const std::wstring& path, const PolicyResult& policyResult)
@@ -206,7 +257,26 @@ static const Possible<std::pair<std::wstring, DWORD>> PathCache_GetResolvedPathA
         return p;
     }
 
-    return ResolvedPathCache::Instance().GetResolvedPathAndType(path);
+    auto result = ResolvedPathCache::Instance().GetResolvedPathAndType(path);
+
+    // Targets queried by other processes of the pip (the parent included) are adopted by this process' cache
+    SharedReparsePointCache* sharedCache = GetGlobalSharedReparsePointCache();
+    if (!result.Found && sharedCache != NULL && sharedCache->TryGet(path, result.Value.first, result.Value.second))
+    {
+        result.Found = true;
+        ResolvedPathCache::Instance().InsertResolvedPathWithType(path, result.Value.first, result.Value.second);
+    }
+
+    PathCacheStatistics& statistics = GetPathCacheStatistics();
+    InterlockedIncrement64(&statistics.Lookups);
+    if (result.Found)
+    {
+        InterlockedIncrement64(&statistics.ReparsePointTargetCacheHitCount);
+    }
+
+    TraceCacheLookup("ReparsePointTarget", result.Found);
+
+    return result;
 }
 
 static bool PathCache_InsertResolvedPathWithType(const std::wstring& path, std::wstring& resolved, DWORD reparsePointType, const PolicyResult& policyResult)
@@ -216,6 +286,12 @@ static bool PathCache_InsertResolvedPathWithType(const std::wstring& path, std::
         return true;
     }
 
+    SharedReparsePointCache* sharedCache = GetGlobalSharedReparsePointCache();
+    if (sharedCache != NULL)
+    {
+        sharedCache->Insert(path, resolved, reparsePointType);
+    }
+
     return ResolvedPathCache::Instance().InsertResolvedPathWithType(path, resolved, reparsePointType);
 }
 
@@ -228,7 +304,17 @@ static const Possible<bool> PathCache_GetResolvingCheckResult(const std::wstring
         return p;
     }
 
-    return ResolvedPathCache::Instance().GetResolvingCheckResult(path);
+    auto result = ResolvedPathCache::Instance().GetResolvingCheckResult(path);
+    PathCacheStatistics& statistics = GetPathCacheStatistics();
+    InterlockedIncrement64(&statistics.Lookups);
+    if (result.Found)
+    {
+        InterlockedIncrement64(&statistics.ShouldResolveReparsePointCacheHitCount);
+    }
+
+    TraceCacheLookup("ShouldResolveReparsePoint", result.Found);
+
+    return result;
 }
 
 static bool PathCache_InsertResolvingCheckResult(const std::wstring& path, bool result, const PolicyResult& policyResult)
@@ -264,7 +350,17 @@ static const Possible<ResolvedPathCacheEntries> PathCache_GetResolvedPaths(const
         return p;
     }
 
-    return ResolvedPathCache::Instance().GetResolvedPaths(path, preserveLastReparsePointInPath);
+    auto result = ResolvedPathCache::Instance().GetResolvedPaths(path, preserveLastReparsePointInPath);
+    PathCacheStatistics& statistics = GetPathCacheStatistics();
+    InterlockedIncrement64(&statistics.Lookups);
+    if (result.Found)
+    {
+        InterlockedIncrement64(&statistics.ResolvedPathsCacheHitCount);
+    }
+
+    TraceCacheLookup("ResolvedPaths", result.Found);
+
+    return result;
 }
 
 /// <summary>
@@ -325,11 +421,6 @@ static bool TryGetReparsePointTarget(_In_ const wstring& path, _In_ HANDLE hInpu
     auto io_result = PathCache_GetResolvedPathAndType(path, policyResult);
     if (io_result.Found)
     {
-
-#if MEASURE_REPARSEPOINT_RESOLVING_IMPACT
-        InterlockedIncrement(&g_reparsePointTargetCacheHitCount);
-#endif // MEASURE_REPARSEPOINT_RESOLVING_IMPACT
-
         target = io_result.Value.first;
         reparsePointType = io_result.Value.second;
         if (reparsePointType == 0x0)
@@ -442,9 +533,18 @@ static bool ShouldResolveReparsePointsInPath(
         return false;
     }
 
+    // Under a scope without reparse points, only the directories above the scope need to be checked. A drive (level 0) is never
+    // a reparse point, so there is nothing left to check for a scope right below a drive.
+    size_t levelWithoutReparsePoints = GetLevelWithoutReparsePoints(policyResult);
+    if (levelWithoutReparsePoints <= 1)
+    {
+        return false;
+    }
+
     if (IgnoreFullReparsePointResolvingForPath(policyResult))
     {
-        return AccessReparsePointTarget(path.GetPathString(), dwFlagsAndAttributes, INVALID_HANDLE_VALUE);
+        // Only the path itself is checked, which is not a reparse point if it is under a scope without reparse points.
+        return levelWithoutReparsePoints == SIZE_MAX && AccessReparsePointTarget(path.GetPathString(), dwFlagsAndAttributes, INVALID_HANDLE_VALUE);
     }
 
     // BuildXL can delete file by opening a handle using 'FILE_FLAG_DELETE_ON_CLOSE' attribute or 'DELETE' access (Posix delete).
@@ -466,27 +566,23 @@ static bool ShouldResolveReparsePointsInPath(
     auto result = PathCache_GetResolvingCheckResult(path.GetPathStringWithoutTypePrefix(), policyResult);
     if (result.Found)
     {
-#if MEASURE_REPARSEPOINT_RESOLVING_IMPACT
-        InterlockedIncrement(&g_shouldResolveReparsePointCacheHitCount);
-#endif // MEASURE_REPARSEPOINT_RESOLVING_IMPACT
         return result.Value;
     }
 
-    std::vector<std::wstring> atoms;
-    int err = TryDecomposePath(path.GetPathStringWithoutTypePrefix(), atoms);
-    if (err != 0)
-    {
-        Dbg(L"ShouldResolveReparsePointsInPath: _wsplitpath_s failed, not resolving path: %d", err);
-        return false;
-    }
+    // Every prefix of the path we check is a prefix of the path string itself, so the components are walked in place
+    // and the resolver only ever holds one prefix (its storage is reserved upfront).
+    wchar_t const* pathString = path.GetPathStringWithoutTypePrefix();
+    size_t pathLength = wcslen(pathString);
+    PathComponentIterator components(pathString, pathLength);
 
     wstring target;
     wstring resolver;
+    resolver.reserve(pathLength);
     size_t level = 0;
     size_t levelToEnforceReparsePointParsingFrom = GetLevelToEnableFullReparsePointParsing(policyResult);
-    for(auto iter = atoms.begin(); iter != atoms.end(); iter++)
+    while (level < levelWithoutReparsePoints && components.MoveNext())
     {
-        resolver.append(*iter);
+        resolver.assign(pathString, components.PrefixLength());
 
         if (level >= levelToEnforceReparsePointParsingFrom && TryGetReparsePointTarget(resolver, INVALID_HANDLE_VALUE, target, policyResult))
         {
@@ -495,14 +591,9 @@ static bool ShouldResolveReparsePointsInPath(
         }
 
         level++;
-
-        resolver.append(L"\\");
     }
 
-    // remove the trailing backslash
-    resolver.pop_back();
-
-    if (level >= levelToEnforceReparsePointParsingFrom && TryGetReparsePointTarget(resolver, INVALID_HANDLE_VALUE, target, policyResult))
+    if (!resolver.empty() && level >= levelToEnforceReparsePointParsingFrom && level < levelWithoutReparsePoints && TryGetReparsePointTarget(resolver, INVALID_HANDLE_VALUE, target, policyResult))
     {
         PathCache_InsertResolvingCheckResult(path.GetPathStringWithoutTypePrefix(), true, policyResult);
         return true;
@@ -528,6 +619,44 @@ static void InvalidateReparsePointCacheIfNeeded(bool pathContainsReparsePoints,
     }
 }
 
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////// Probe cache ////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Returns the probe cache if the probes of the path can use it (see ProbeCache), NULL otherwise.
+// Only absolute paths are cached, so that what is recorded for a path does not depend on the current directory.
+static ProbeCache* GetProbeCacheForPath(LPCWSTR path)
+{
+    ProbeCache* cache = GetGlobalProbeCache();
+    return cache != NULL && (IsDriveBasedAbsolutePath(path) || IsWin32NtPathName(path)) ? cache : NULL;
+}
+
+// Gets the outcome of a probe from its read context; returns false if the probe is not cached, i.e., when it failed
+// for another reason than the path not existing (its report would carry that error).
+static bool TryGetProbeOutcome(const FileReadContext& readContext, DWORD error, ProbeOutcome& outcome)
+{
+    if (readContext.Existence == FileExistence::Nonexistent)
+    {
+        outcome = ProbeOutcome::Absent;
+        return true;
+    }
+
+    if (readContext.Existence == FileExistence::Existent && error == ERROR_SUCCESS)
+    {
+        outcome = readContext.OpenedDirectory ? ProbeOutcome::Directory : ProbeOutcome::File;
+        return true;
+    }
+
+    return false;
+}
+
+static bool ProbeCache_IsHandled(ProbeCache* cache, LPCWSTR path, size_t length, ProbeOutcome outcome)
+{
+    bool handled = cache->IsHandled(path, length, outcome);
+    TraceCacheLookup("Probes", handled);
+    return handled;
+}
+
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 /////////////////////////////////////////// Symlink traversal utilities /////////////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -1521,10 +1650,6 @@ static bool EnforceChainOfReparsePointAccesses(
         resolvedLookUpTable = cachedEntries.Value.second;
     }
 
-#if MEASURE_REPARSEPOINT_RESOLVING_IMPACT
-    InterlockedIncrement(&g_resolvedPathsCacheHitCout);
-#endif // MEASURE_REPARSEPOINT_RESOLVING_IMPACT
-
     bool success = true;
     auto contextOperationName = cached ? L"ReparsePointTargetCached" : L"ReparsePointTarget";
 
@@ -1575,7 +1700,7 @@ static bool EnforceChainOfReparsePointAccessesForNonCreateFile(
     const bool enforceAccess = true,
     const bool isCreateDirectory = false)
 {
-    if (!IgnoreNonCreateFileReparsePoints() && !IgnoreReparsePoints())
+    if (!IgnoreNonCreateFileReparsePoints() && !IgnoreReparsePoints() && !policyResult.NoReparsePoints())
     {
         CanonicalizedPath canonicalPath = CanonicalizedPath::Canonicalize(fileOperationContext.NoncanonicalPath);
 
@@ -1927,6 +2052,84 @@ typedef struct _FILE_MODE_INFORMATION {
     ULONG Mode;
 } FILE_MODE_INFORMATION, *PFILE_MODE_INFORMATION;
 
+/// <summary>
+/// Gets the path of a handle from the overlay registered when it was opened, if that path can stand in for the final path of the handle.
+/// </summary>
+/// <remarks>
+/// The canonicalized path of an overlay is the path its handle was opened with, and its policy is the one that path was checked against,
+/// so no kernel query (see DetourGetFinalPathByHandle) is needed for it. That path is the final one unless it goes through a reparse point,
+/// which is only ruled out by the manifest (see GetLevelWithoutReparsePoints) or by an earlier check of the path, or uses short names, which
+/// the kernel expands. Renames through the handle re-register its overlay (see UpdateHandleOverlayAfterRename).
+/// </remarks>
+static bool TryGetPathFromHandleOverlay(_In_ HANDLE hFile, _Inout_ wstring& fullPath, _Inout_ HandleOverlayRef& overlay)
+{
+    HandleOverlayRef candidate = TryLookupHandleOverlay(hFile);
+    if (candidate == nullptr || candidate->Type == HandleType::Find || candidate->Policy.GetCanonicalizedPath().IsNull())
+    {
+        return false;
+    }
+
+    const CanonicalizedPath& path = candidate->Policy.GetCanonicalizedPath();
+    if (wcschr(path.GetPathString(), L'~') != nullptr)
+    {
+        return false;
+    }
+
+    if (!IgnoreReparsePoints() && GetLevelWithoutReparsePoints(candidate->Policy) > 1)
+    {
+        Possible<bool> shouldResolve = PathCache_GetResolvingCheckResult(path.GetPathStringWithoutTypePrefix(), candidate->Policy);
+        if (!shouldResolve.Found || shouldResolve.Value)
+        {
+            return false;
+        }
+    }
+
+    fullPath.assign(path.GetPathString());
+    overlay = candidate;
+    return true;
+}
+
+/// <summary>
+/// Gets the path of a handle, from its overlay if possible (see TryGetPathFromHandleOverlay) and with DetourGetFinalPathByHandle otherwise.
+/// The overlay the path was taken from, if any, is returned in 'overlay' so that its policy can be used too (see InitializePolicyForHandlePath).
+/// </summary>
+static DWORD DetourGetPathByHandle(_In_ HANDLE hFile, _Inout_ wstring& fullPath, _Inout_ HandleOverlayRef& overlay)
+{
+    if (TryGetPathFromHandleOverlay(hFile, fullPath, overlay))
+    {
+        return ERROR_SUCCESS;
+    }
+
+    return DetourGetFinalPathByHandle(hFile, fullPath);
+}
+
+/// <summary>
+/// Initializes the policy of a path obtained with DetourGetPathByHandle, reusing the policy of the overlay it was taken from.
+/// </summary>
+static bool InitializePolicyForHandlePath(_Inout_ PolicyResult& policyResult, _In_ const wstring& path, _In_ const HandleOverlayRef& overlay)
+{
+    if (overlay != nullptr)
+    {
+        policyResult = overlay->Policy;
+        return true;
+    }
+
+    return policyResult.Initialize(path.c_str());
+}
+
+/// <summary>
+/// Re-registers the overlay of a handle whose file was just renamed through it, with the policy of the destination of the rename,
+/// so that the path of the handle is not recovered from a stale overlay (nor its final path, see HandleOverlay::FinalPath).
+/// </summary>
+static void UpdateHandleOverlayAfterRename(_In_ HANDLE hFile, _In_ const PolicyResult& destinationPolicy)
+{
+    HandleOverlayRef overlay = TryLookupHandleOverlay(hFile);
+    if (overlay != nullptr)
+    {
+        RegisterHandleOverlay(hFile, overlay->AccessCheck, destinationPolicy, overlay->Type);
+    }
+}
+
 static bool TryGetFileNameFromFileInformation(
     _In_  PWCHAR   fileName,
     _In_  ULONG    fileNameLength,
@@ -1949,10 +2152,11 @@ static bool TryGetFileNameFromFileInformation(
     if (rootDirectory != nullptr)
     {
         wstring dirPath;
+        HandleOverlayRef rootDirectoryOverlay;
 
-        if (DetourGetFinalPathByHandle(rootDirectory, dirPath) != ERROR_SUCCESS)
+        if (DetourGetPathByHandle(rootDirectory, dirPath, rootDirectoryOverlay) != ERROR_SUCCESS)
         {
-            Dbg(L"TryGetFileNameFromFileInformation: DetourGetFinalPathByHandle: %d", GetLastError());
+            Dbg(L"TryGetFileNameFromFileInformation: DetourGetPathByHandle: %d", GetLastError());
             SetLastError(lastError);
             return false;
         }
@@ -1994,13 +2198,14 @@ NTSTATUS HandleFileRenameInformation(
 
     DWORD lastError = GetLastError();
     wstring sourcePath;
+    HandleOverlayRef sourceOverlay;
 
-    DWORD getFinalPathByHandle = DetourGetFinalPathByHandle(FileHandle, sourcePath);
+    DWORD getFinalPathByHandle = DetourGetPathByHandle(FileHandle, sourcePath, sourceOverlay);
     if ((getFinalPathByHandle != ERROR_SUCCESS) || IsSpecialDeviceName(sourcePath.c_str()) || IsNullOrEmptyW(sourcePath.c_str()))
     {
         if (getFinalPathByHandle != ERROR_SUCCESS)
         {
-            Dbg(L"HandleFileRenameInformation: DetourGetFinalPathByHandle: %d", getFinalPathByHandle);
+            Dbg(L"HandleFileRenameInformation: DetourGetPathByHandle: %d", getFinalPathByHandle);
         }
 
         SetLastError(lastError);
@@ -2048,7 +2253,7 @@ NTSTATUS HandleFileRenameInformation(
 
     PolicyResult sourcePolicyResult;
 
-    if (!sourcePolicyResult.Initialize(sourcePath.c_str()))
+    if (!InitializePolicyForHandlePath(sourcePolicyResult, sourcePath, sourceOverlay))
     {
         sourcePolicyResult.ReportIndeterminatePolicyAndSetLastError(sourceOpContext);
         return DETOURS_STATUS_ACCESS_DENIED;
@@ -2125,6 +2330,11 @@ NTSTATUS HandleFileRenameInformation(
     ReportIfNeeded(sourceAccessCheck, sourceOpContext, sourcePolicyResult, ntError);
     ReportIfNeeded(destAccessCheck, destinationOpContext, destPolicyResult, ntError);
 
+    if (NT_SUCCESS(result))
+    {
+        UpdateHandleOverlayAfterRename(FileHandle, destPolicyResult);
+    }
+
     if (renameDirectory)
     {
         for each(auto entry in filesAndDirectoriesToReport)
@@ -2283,13 +2493,14 @@ NTSTATUS HandleFileDispositionInformation(
 
     DWORD lastError = GetLastError();
     wstring sourcePath;
+    HandleOverlayRef sourceOverlay;
 
-    DWORD getFinalPathByHandle = DetourGetFinalPathByHandle(FileHandle, sourcePath);
+    DWORD getFinalPathByHandle = DetourGetPathByHandle(FileHandle, sourcePath, sourceOverlay);
     if ((getFinalPathByHandle != ERROR_SUCCESS) || IsSpecialDeviceName(sourcePath.c_str()) || IsNullOrEmptyW(sourcePath.c_str()))
     {
         if (getFinalPathByHandle != ERROR_SUCCESS)
         {
-            Dbg(L"HandleFileDispositionInformation: DetourGetFinalPathByHandle: %d", getFinalPathByHandle);
+            Dbg(L"HandleFileDispositionInformation: DetourGetPathByHandle: %d", getFinalPathByHandle);
         }
 
         SetLastError(lastError);
@@ -2312,7 +2523,7 @@ NTSTATUS HandleFileDispositionInformation(
 
     PolicyResult sourcePolicyResult;
 
-    if (!sourcePolicyResult.Initialize(sourcePath.c_str()))
+    if (!InitializePolicyForHandlePath(sourcePolicyResult, sourcePath, sourceOverlay))
     {
         sourcePolicyResult.ReportIndeterminatePolicyAndSetLastError(sourceOpContext);
         return DETOURS_STATUS_ACCESS_DENIED;
@@ -2373,13 +2584,14 @@ NTSTATUS HandleFileModeInformation(
 
     DWORD lastError = GetLastError();
     wstring sourcePath;
+    HandleOverlayRef sourceOverlay;
 
-    DWORD getFinalPathByHandle = DetourGetFinalPathByHandle(FileHandle, sourcePath);
+    DWORD getFinalPathByHandle = DetourGetPathByHandle(FileHandle, sourcePath, sourceOverlay);
     if ((getFinalPathByHandle != ERROR_SUCCESS) || IsSpecialDeviceName(sourcePath.c_str()) || IsNullOrEmptyW(sourcePath.c_str()))
     {
         if (getFinalPathByHandle != ERROR_SUCCESS)
         {
-            Dbg(L"HandleFileModeInformation: DetourGetFinalPathByHandle: %d", getFinalPathByHandle);
+            Dbg(L"HandleFileModeInformation: DetourGetPathByHandle: %d", getFinalPathByHandle);
         }
 
         SetLastError(lastError);
@@ -2402,7 +2614,7 @@ NTSTATUS HandleFileModeInformation(
 
     PolicyResult sourcePolicyResult;
 
-    if (!sourcePolicyResult.Initialize(sourcePath.c_str()))
+    if (!InitializePolicyForHandlePath(sourcePolicyResult, sourcePath, sourceOverlay))
     {
         sourcePolicyResult.ReportIndeterminatePolicyAndSetLastError(sourceOpContext);
         return DETOURS_STATUS_ACCESS_DENIED;
@@ -2461,13 +2673,14 @@ NTSTATUS HandleFileNameInformation(
 
     DWORD lastError = GetLastError();
     wstring sourcePath;
+    HandleOverlayRef sourceOverlay;
 
-    DWORD getFinalPathByHandle = DetourGetFinalPathByHandle(FileHandle, sourcePath);
+    DWORD getFinalPathByHandle = DetourGetPathByHandle(FileHandle, sourcePath, sourceOverlay);
     if ((getFinalPathByHandle != ERROR_SUCCESS) || IsSpecialDeviceName(sourcePath.c_str()) || IsNullOrEmptyW(sourcePath.c_str()))
     {
         if (getFinalPathByHandle != ERROR_SUCCESS)
         {
-            Dbg(L"HandleFileNameInformation: DetourGetFinalPathByHandle: %d", getFinalPathByHandle);
+            Dbg(L"HandleFileNameInformation: DetourGetPathByHandle: %d", getFinalPathByHandle);
         }
 
         SetLastError(lastError);
@@ -2516,7 +2729,7 @@ NTSTATUS HandleFileNameInformation(
 
     PolicyResult sourcePolicyResult;
 
-    if (!sourcePolicyResult.Initialize(sourcePath.c_str()))
+    if (!InitializePolicyForHandlePath(sourcePolicyResult, sourcePath, sourceOverlay))
     {
         sourcePolicyResult.ReportIndeterminatePolicyAndSetLastError(sourceOpContext);
         return DETOURS_STATUS_ACCESS_DENIED;
@@ -2592,6 +2805,11 @@ NTSTATUS HandleFileNameInformation(
     ReportIfNeeded(sourceAccessCheck, sourceOpContext, sourcePolicyResult, ntError);
     ReportIfNeeded(destAccessCheck, destinationOpContext, destPolicyResult, ntError);
 
+    if (NT_SUCCESS(result))
+    {
+        UpdateHandleOverlayAfterRename(FileHandle, destPolicyResult);
+    }
+
     if (renameDirectory)
     {
         for each(auto entry in filesAndDirectoriesToReport)
@@ -2613,6 +2831,7 @@ NTSTATUS NTAPI Detoured_ZwSetInformationFile(
     _In_  ULONG                  Length,
     _In_  FILE_INFORMATION_CLASS FileInformationClass)
 {
+    DETOUR_STATISTICS(ZwSetInformationFile);
     // if this is not an enabled case that we are covering, just call the Real_Function.
     FILE_INFORMATION_CLASS_EXTRA fileInformationClassExtra = (FILE_INFORMATION_CLASS_EXTRA)FileInformationClass;
 
@@ -2697,6 +2916,10 @@ BOOL WINAPI Detoured_CreateProcessW(
     _In_        LPSTARTUPINFOW        lpStartupInfo,
     _Out_       LPPROCESS_INFORMATION lpProcessInformation)
 {
+    DETOUR_STATISTICS(CreateProcessW);
+    // Whatever this process reported so far must reach BuildXL before anything its child reports.
+    FlushReportBatch();
+
     bool injectedShim = false;
     BOOL ret = MaybeInjectSubstituteProcessShim(
         lpApplicationName,
@@ -2733,7 +2956,12 @@ BOOL WINAPI Detoured_CreateProcessW(
             lpProcessInformation);
     }
 
-    CanonicalizedPath imagePath = GetImagePath(lpApplicationName, lpCommandLine);
+    // Finding the image of the process may need the file system (e.g., to search the PATH), so it is only done when the
+    // image matters: for the report of the read of the image, or when there are processes that break away from the job.
+    // Otherwise the path stays null, which skips both.
+    CanonicalizedPath imagePath = !IgnoreCreateProcessReport() || !g_processNamesToBreakAwayFromJob->empty()
+        ? GetImagePath(lpApplicationName, lpCommandLine)
+        : CanonicalizedPath();
 
     if (ShouldBreakawayFromJob(imagePath))
     {
@@ -2874,6 +3102,7 @@ BOOL WINAPI Detoured_CreateProcessA(
     _In_        LPSTARTUPINFOA        lpStartupInfo,
     _Out_       LPPROCESS_INFORMATION lpProcessInformation)
 {
+    DETOUR_STATISTICS(CreateProcessA);
     // Note that we only do Real_CreateProcessA
     // for the case of not doing child processes.
     // Otherwise this converts to CreateProcessW
@@ -2982,6 +3211,7 @@ HANDLE WINAPI Detoured_CreateFileW(
     _In_     DWORD                 dwFlagsAndAttributes,
     _In_opt_ HANDLE                hTemplateFile)
 {
+    DETOUR_STATISTICS(CreateFileW);
     DetouredScope scope;
 
     // The are potential complication here: How to handle a call to CreateFile with the FILE_FLAG_OPEN_REPARSE_POINT?
@@ -2998,6 +3228,43 @@ HANDLE WINAPI Detoured_CreateFileW(
             hTemplateFile);
     }
 
+    // An open that only probes the path is cached (see ProbeCache) when it found nothing: that is the only outcome that does
+    // not come with a handle (which a cached probe would have to open, and register an overlay for, anyway).
+    ProbeCache* probeCache =
+        WantsProbeOnlyAccess(dwDesiredAccess) && dwCreationDisposition == OPEN_EXISTING
+        ? GetProbeCacheForPath(lpFileName)
+        : NULL;
+    LONG probeCacheGeneration = probeCache != NULL ? probeCache->GetGeneration() : 0;
+    size_t pathLength = probeCache != NULL ? wcslen(lpFileName) : 0;
+
+    if (probeCache != NULL && ProbeCache_IsHandled(probeCache, lpFileName, pathLength, ProbeOutcome::Absent))
+    {
+        // The path was absent when last probed: if it still is, there is nothing else to do.
+        HANDLE probeHandle = Real_CreateFileW(
+            lpFileName,
+            dwDesiredAccess,
+            dwShareMode,
+            lpSecurityAttributes,
+            dwCreationDisposition,
+            dwFlagsAndAttributes,
+            hTemplateFile);
+
+        DWORD probeError = GetLastError();
+        FileReadContext probeContext;
+        probeContext.InferExistenceFromError(probeError);
+        if (probeHandle == INVALID_HANDLE_VALUE && probeContext.Existence == FileExistence::Nonexistent)
+        {
+            SetLastError(probeError);
+            return INVALID_HANDLE_VALUE;
+        }
+
+        // Otherwise, the probe is checked (and made again) as usual.
+        if (probeHandle != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(probeHandle);
+        }
+    }
+
     DWORD error = ERROR_SUCCESS;
 
     FileOperationContext opContext(
@@ -3127,8 +3394,10 @@ HANDLE WINAPI Detoured_CreateFileW(
         reportUsn = handle != INVALID_HANDLE_VALUE && policyResult.ReportUsnAfterOpen();
         bool checkUsn = handle != INVALID_HANDLE_VALUE && policyResult.GetExpectedUsn() != -1;
 
+        // The USN is only read here when it has to match an expected one: a USN that is only reported is left to the host,
+        // which reads it when it receives the report (see SandboxedProcessReports), so that most opens don't pay for an ioctl.
         DWORD getUsnError = ERROR_SUCCESS;
-        if ((reportUsn || checkUsn) && !TryGetUsn(handle, /* inout */ usn, /* inout */ getUsnError))
+        if (checkUsn && !TryGetUsn(handle, /* inout */ usn, /* inout */ getUsnError))
         {
             WriteWarningOrErrorF(L"Could not obtain USN for file path '%s'. Error: %d",
                 policyResult.GetCanonicalizedPath().GetPathString(), getUsnError);
@@ -3244,6 +3513,10 @@ HANDLE WINAPI Detoured_CreateFileW(
         HandleType handleType = readContext.OpenedDirectory ? HandleType::Directory : HandleType::File;
         RegisterHandleOverlay(handle, accessCheck, policyResult, handleType);
     }
+    else if (probeCache != NULL && accessCheck.Result == ResultAction::Allow && readContext.Existence == FileExistence::Nonexistent)
+    {
+        probeCache->SetHandled(lpFileName, pathLength, ProbeOutcome::Absent, probeCacheGeneration);
+    }
 
     // Propagate the correct error code to the caller.
     SetLastError(error);
@@ -3253,6 +3526,7 @@ HANDLE WINAPI Detoured_CreateFileW(
 IMPLEMENTED(Detoured_CloseHandle)
 BOOL WINAPI Detoured_CloseHandle(_In_ HANDLE handle)
 {
+    DETOUR_STATISTICS(CloseHandle);
     DetouredScope scope;
 
     if (scope.Detoured_IsDisabled() || IsNullOrInvalidHandle(handle))
@@ -3277,6 +3551,7 @@ HANDLE WINAPI Detoured_CreateFileA(
     _In_     DWORD                 dwFlagsAndAttributes,
     _In_opt_ HANDLE                hTemplateFile)
 {
+    DETOUR_STATISTICS(CreateFileA);
     {
         DetouredScope scope;
         if (scope.Detoured_IsDisabled() || IsNullOrEmptyA(lpFileName))
@@ -3318,6 +3593,7 @@ BOOL WINAPI Detoured_GetVolumePathNameW(
     _In_  DWORD   cchBufferLength
     )
 {
+    DETOUR_STATISTICS(GetVolumePathNameW);
     // The reason for this scope check is that GetVolumePathNameW calls many other detoured APIs.
     // We do not need to have any reports for file accesses from these APIs, because thay are not what the application called.
     // (It was purely inserted by us.)
@@ -3326,9 +3602,35 @@ BOOL WINAPI Detoured_GetVolumePathNameW(
     return Real_GetVolumePathNameW(lpszFileName, lpszVolumePathName, cchBufferLength);
 }
 
+// Detoured_DefineDosDeviceW
+//
+// No BuildXL policy applies to DOS devices, but the drives of the process may change, which the DOS device names
+// cached by the process (see DosDeviceTable) must reflect.
+//
+// Note: There is no need to detour DefineDosDeviceA because it calls DefineDosDeviceW.
+IMPLEMENTED(Detoured_DefineDosDeviceW)
+BOOL WINAPI Detoured_DefineDosDeviceW(
+    _In_     DWORD   dwFlags,
+    _In_     LPCWSTR lpDeviceName,
+    _In_opt_ LPCWSTR lpTargetPath
+    )
+{
+    DETOUR_STATISTICS(DefineDosDeviceW);
+    BOOL result = Real_DefineDosDeviceW(dwFlags, lpDeviceName, lpTargetPath);
+    if (result)
+    {
+        DWORD lastError = GetLastError();
+        InvalidateDosDeviceTable();
+        SetLastError(lastError);
+    }
+
+    return result;
+}
+
 IMPLEMENTED(Detoured_GetFileAttributesW)
 DWORD WINAPI Detoured_GetFileAttributesW(_In_  LPCWSTR lpFileName)
 {
+    DETOUR_STATISTICS(GetFileAttributesW);
     DetouredScope scope;
     if (scope.Detoured_IsDisabled() || IsNullOrEmptyW(lpFileName) || IsSpecialDeviceName(lpFileName))
     {
@@ -3336,20 +3638,10 @@ DWORD WINAPI Detoured_GetFileAttributesW(_In_  LPCWSTR lpFileName)
         return Real_GetFileAttributesW(lpFileName);
     }
 
-    FileOperationContext fileOperationContext = FileOperationContext::CreateForRead(L"GetFileAttributes", lpFileName);
-
-    PolicyResult policyResult;
-    if (!policyResult.Initialize(lpFileName))
-    {
-        policyResult.ReportIndeterminatePolicyAndSetLastError(fileOperationContext);
-        return INVALID_FILE_ATTRIBUTES;
-    }
-
-    if (!AdjustOperationContextAndPolicyResultWithFullyResolvedPath(fileOperationContext, policyResult, true))
-    {
-        return INVALID_FILE_ATTRIBUTES;
-    }
+    ProbeCache* probeCache = GetProbeCacheForPath(lpFileName);
+    LONG probeCacheGeneration = probeCache != NULL ? probeCache->GetGeneration() : 0;
 
+    // The query is made first, so that a probe the cache already handled only costs the query itself.
     DWORD attributes = INVALID_FILE_ATTRIBUTES;
     DWORD error = ERROR_SUCCESS;
 
@@ -3364,11 +3656,43 @@ DWORD WINAPI Detoured_GetFileAttributesW(_In_  LPCWSTR lpFileName)
     FileReadContext fileReadContext;
     fileReadContext.InferExistenceFromError(error);
     fileReadContext.OpenedDirectory = IsDirectoryFromAttributes(attributes, !ProbeDirectorySymlinkAsDirectory());
+
+    size_t pathLength = 0;
+    ProbeOutcome probeOutcome;
+    bool cacheProbe = probeCache != NULL && TryGetProbeOutcome(fileReadContext, error, probeOutcome);
+    if (cacheProbe)
+    {
+        pathLength = wcslen(lpFileName);
+        if (ProbeCache_IsHandled(probeCache, lpFileName, pathLength, probeOutcome))
+        {
+            SetLastError(error);
+            return attributes;
+        }
+    }
+
+    FileOperationContext fileOperationContext = FileOperationContext::CreateForRead(L"GetFileAttributes", lpFileName);
     fileOperationContext.OpenedFileOrDirectoryAttributes = attributes;
 
+    PolicyResult policyResult;
+    if (!policyResult.Initialize(lpFileName))
+    {
+        policyResult.ReportIndeterminatePolicyAndSetLastError(fileOperationContext);
+        return INVALID_FILE_ATTRIBUTES;
+    }
+
+    if (!AdjustOperationContextAndPolicyResultWithFullyResolvedPath(fileOperationContext, policyResult, true))
+    {
+        return INVALID_FILE_ATTRIBUTES;
+    }
+
     AccessCheckResult accessCheck = policyResult.CheckReadAccess(RequestedReadAccess::Probe, fileReadContext);
     ReportIfNeeded(accessCheck, fileOperationContext, policyResult, error);
 
+    if (cacheProbe && accessCheck.Result == ResultAction::Allow)
+    {
+        probeCache->SetHandled(lpFileName, pathLength, probeOutcome, probeCacheGeneration);
+    }
+
     if (accessCheck.ShouldDenyAccess())
     {
         error = accessCheck.DenialError();
@@ -3382,6 +3706,7 @@ DWORD WINAPI Detoured_GetFileAttributesW(_In_  LPCWSTR lpFileName)
 IMPLEMENTED(Detoured_GetFileAttributesA)
 DWORD WINAPI Detoured_GetFileAttributesA(_In_  LPCSTR lpFileName)
 {
+    DETOUR_STATISTICS(GetFileAttributesA);
     {
         DetouredScope scope;
         if (scope.Detoured_IsDisabled() || IsNullOrEmptyA(lpFileName))
@@ -3401,22 +3726,16 @@ BOOL WINAPI Detoured_GetFileAttributesExW(
     _In_  GET_FILEEX_INFO_LEVELS fInfoLevelId,
     _Out_ LPVOID                 lpFileInformation)
 {
+    DETOUR_STATISTICS(GetFileAttributesExW);
     DetouredScope scope;
     if (scope.Detoured_IsDisabled() || IsNullOrEmptyW(lpFileName) || IsSpecialDeviceName(lpFileName))
     {
         return Real_GetFileAttributesExW(lpFileName, fInfoLevelId, lpFileInformation);
     }
 
-    FileOperationContext fileOperationContext = FileOperationContext::CreateForRead(L"GetFileAttributesEx", lpFileName);
-
-    PolicyResult policyResult;
-    if (!policyResult.Initialize(lpFileName))
-    {
-        policyResult.ReportIndeterminatePolicyAndSetLastError(fileOperationContext);
-
-        lpFileInformation = nullptr;
-        return FALSE;
-    }
+    // Only the standard information tells whether the path is a directory.
+    ProbeCache* probeCache = fInfoLevelId == GetFileExInfoStandard ? GetProbeCacheForPath(lpFileName) : NULL;
+    LONG probeCacheGeneration = probeCache != NULL ? probeCache->GetGeneration() : 0;
 
     DWORD error = ERROR_SUCCESS;
     BOOL querySucceeded = TRUE;
@@ -3432,12 +3751,6 @@ BOOL WINAPI Detoured_GetFileAttributesExW(
     WIN32_FILE_ATTRIBUTE_DATA* fileStandardInfo = (fInfoLevelId == GetFileExInfoStandard && lpFileInformation != nullptr) ?
         (WIN32_FILE_ATTRIBUTE_DATA*)lpFileInformation : nullptr;
 
-    if (!AdjustOperationContextAndPolicyResultWithFullyResolvedPath(fileOperationContext, policyResult, true))
-    {
-        lpFileInformation = nullptr;
-        return FALSE;
-    }
-
     // Now we can make decisions based on existence and type.
     FileReadContext fileReadContext;
     fileReadContext.InferExistenceFromError(error);
@@ -3445,11 +3758,49 @@ BOOL WINAPI Detoured_GetFileAttributesExW(
         querySucceeded
         && fileStandardInfo != nullptr
         && IsDirectoryFromAttributes(fileStandardInfo->dwFileAttributes, !ProbeDirectorySymlinkAsDirectory());
+
+    size_t pathLength = 0;
+    ProbeOutcome probeOutcome;
+    bool cacheProbe = probeCache != NULL && fileStandardInfo != nullptr && TryGetProbeOutcome(fileReadContext, error, probeOutcome);
+    if (cacheProbe)
+    {
+        pathLength = wcslen(lpFileName);
+        if (ProbeCache_IsHandled(probeCache, lpFileName, pathLength, probeOutcome))
+        {
+            SetLastError(error);
+            return querySucceeded;
+        }
+    }
+
+    FileOperationContext fileOperationContext = FileOperationContext::CreateForRead(L"GetFileAttributesEx", lpFileName);
     fileOperationContext.OpenedFileOrDirectoryAttributes = querySucceeded && fileStandardInfo != nullptr ? fileStandardInfo->dwFileAttributes : INVALID_FILE_ATTRIBUTES;
 
+    PolicyResult policyResult;
+    if (!policyResult.Initialize(lpFileName))
+    {
+        policyResult.ReportIndeterminatePolicyAndSetLastError(fileOperationContext);
+
+        lpFileInformation = nullptr;
+        return FALSE;
+    }
+
+    if (!AdjustOperationContextAndPolicyResultWithFullyResolvedPath(fileOperationContext, policyResult, true))
+    {
+        lpFileInformation = nullptr;
+        return FALSE;
+    }
+
     AccessCheckResult accessCheck = policyResult.CheckReadAccess(RequestedReadAccess::Probe, fileReadContext);
     ReportIfNeeded(accessCheck, fileOperationContext, policyResult, error);
 
+    // Probes whose timestamps are overridden are not cached: the cached ones return the real information.
+    if (cacheProbe
+        && accessCheck.Result == ResultAction::Allow
+        && !(querySucceeded && policyResult.ShouldOverrideTimestamps(accessCheck)))
+    {
+        probeCache->SetHandled(lpFileName, pathLength, probeOutcome, probeCacheGeneration);
+    }
+
     // No need to enforce chain of reparse point accesess because if the path points to a symbolic link,
     // then GetFileAttributes returns attributes for the symbolic link.
     if (accessCheck.ShouldDenyAccess())
@@ -3476,6 +3827,7 @@ BOOL WINAPI Detoured_GetFileAttributesExA(
     _In_  GET_FILEEX_INFO_LEVELS fInfoLevelId,
     _Out_ LPVOID                 lpFileInformation)
 {
+    DETOUR_STATISTICS(GetFileAttributesExA);
     {
         DetouredScope scope;
         if (scope.Detoured_IsDisabled() || IsNullOrEmptyA(lpFileName))
@@ -3510,6 +3862,7 @@ BOOL WINAPI Detoured_CopyFileW(
     _In_ BOOL bFailIfExists
     )
 {
+    DETOUR_STATISTICS(CopyFileW);
     // Don't duplicate complex access-policy logic between CopyFileEx and CopyFile.
     // This forwarder is identical to the internal implementation of CopyFileExW
     // so it should be safe to always forward at our level.
@@ -3528,6 +3881,7 @@ BOOL WINAPI Detoured_CopyFileA(
     _In_ LPCSTR lpNewFileName,
     _In_ BOOL   bFailIfExists)
 {
+    DETOUR_STATISTICS(CopyFileA);
     {
         DetouredScope scope;
         if (scope.Detoured_IsDisabled() || IsNullOrEmptyA(lpExistingFileName) || IsNullOrEmptyA(lpNewFileName))
@@ -3556,6 +3910,7 @@ BOOL WINAPI Detoured_CopyFileExW(
     _In_opt_ LPBOOL             pbCancel,
     _In_     DWORD              dwCopyFlags)
 {
+    DETOUR_STATISTICS(CopyFileExW);
     DetouredScope scope;
     if (scope.Detoured_IsDisabled() ||
         IsNullOrEmptyW(lpExistingFileName) ||
@@ -3573,10 +3928,29 @@ BOOL WINAPI Detoured_CopyFileExW(
     }
 
     FileOperationContext sourceOpContext = FileOperationContext::CreateForRead(L"CopyFile_Source", lpExistingFileName);
+    FileOperationContext destinationOpContext = FileOperationContext(
+        L"CopyFile_Dest",
+        GENERIC_WRITE,
+        0,
+        CREATE_ALWAYS,
+        FILE_ATTRIBUTE_NORMAL,
+        lpNewFileName);
+    destinationOpContext.Correlate(sourceOpContext);
+
+    // The source and the destination of a copy tend to share a long prefix, whose policy search is shared
     PolicyResult sourcePolicyResult;
-    if (!sourcePolicyResult.Initialize(lpExistingFileName))
+    PolicyResult destPolicyResult;
+    if (!PolicyResult::InitializePair(lpExistingFileName, lpNewFileName, sourcePolicyResult, destPolicyResult))
     {
-        sourcePolicyResult.ReportIndeterminatePolicyAndSetLastError(sourceOpContext);
+        if (sourcePolicyResult.IsIndeterminate())
+        {
+            sourcePolicyResult.ReportIndeterminatePolicyAndSetLastError(sourceOpContext);
+        }
+        else
+        {
+            destPolicyResult.ReportIndeterminatePolicyAndSetLastError(destinationOpContext);
+        }
+
         return FALSE;
     }
 
@@ -3590,22 +3964,6 @@ BOOL WINAPI Detoured_CopyFileExW(
         return FALSE;
     }
 
-    FileOperationContext destinationOpContext = FileOperationContext(
-        L"CopyFile_Dest",
-        GENERIC_WRITE,
-        0,
-        CREATE_ALWAYS,
-        FILE_ATTRIBUTE_NORMAL,
-        lpNewFileName);
-    destinationOpContext.Correlate(sourceOpContext);
-
-    PolicyResult destPolicyResult;
-    if (!destPolicyResult.Initialize(lpNewFileName))
-    {
-        destPolicyResult.ReportIndeterminatePolicyAndSetLastError(destinationOpContext);
-        return FALSE;
-    }
-
     // When COPY_FILE_COPY_SYMLINK is specified, then no need to enforce chain of symlink accesses.
     if (!copySymlink && !EnforceChainOfReparsePointAccessesForNonCreateFile(sourceOpContext, sourcePolicyResult))
     {
@@ -3697,6 +4055,7 @@ BOOL WINAPI Detoured_CopyFileExA(
     _In_opt_ LPBOOL             pbCancel,
     _In_     DWORD              dwCopyFlags)
 {
+    DETOUR_STATISTICS(CopyFileExA);
     {
         DetouredScope scope;
         if (scope.Detoured_IsDisabled() || IsNullOrEmptyA(lpExistingFileName) || IsNullOrEmptyA(lpNewFileName))
@@ -3734,6 +4093,7 @@ BOOL WINAPI Detoured_MoveFileW(
     _In_ LPCWSTR lpExistingFileName,
     _In_ LPCWSTR lpNewFileName)
 {
+    DETOUR_STATISTICS(MoveFileW);
     return Detoured_MoveFileWithProgressW(
         lpExistingFileName,
         lpNewFileName,
@@ -3747,6 +4107,7 @@ BOOL WINAPI Detoured_MoveFileA(
     _In_ LPCSTR lpExistingFileName,
     _In_ LPCSTR lpNewFileName)
 {
+    DETOUR_STATISTICS(MoveFileA);
     {
         DetouredScope scope;
         if (scope.Detoured_IsDisabled() || IsNullOrEmptyA(lpExistingFileName) || IsNullOrEmptyA(lpNewFileName))
@@ -3774,6 +4135,7 @@ BOOL WINAPI Detoured_MoveFileExW(
     _In_opt_ LPCWSTR lpNewFileName,
     _In_     DWORD   dwFlags)
 {
+    DETOUR_STATISTICS(MoveFileExW);
     return Detoured_MoveFileWithProgressW(
         lpExistingFileName,
         lpNewFileName,
@@ -3788,6 +4150,7 @@ BOOL WINAPI Detoured_MoveFileExA(
     _In_opt_  LPCSTR lpNewFileName,
     _In_      DWORD  dwFlags)
 {
+    DETOUR_STATISTICS(MoveFileExA);
     {
         DetouredScope scope;
         if (scope.Detoured_IsDisabled() || IsNullOrEmptyA(lpExistingFileName) || IsNullOrEmptyA(lpNewFileName))
@@ -3829,6 +4192,7 @@ BOOL WINAPI Detoured_MoveFileWithProgressW(
     _In_opt_  LPVOID             lpData,
     _In_      DWORD              dwFlags)
 {
+    DETOUR_STATISTICS(MoveFileWithProgressW);
     DetouredScope scope;
     if (scope.Detoured_IsDisabled()
         || IsNullOrEmptyW(lpExistingFileName)
@@ -3863,20 +4227,6 @@ BOOL WINAPI Detoured_MoveFileWithProgressW(
         lpExistingFileName);
     sourceOpContext.OpenedFileOrDirectoryAttributes = existingFileOrDirectoryAttribute;
 
-    PolicyResult sourcePolicyResult;
-    if (!sourcePolicyResult.Initialize(lpExistingFileName))
-    {
-        sourcePolicyResult.ReportIndeterminatePolicyAndSetLastError(sourceOpContext);
-        return FALSE;
-    }
-
-    PathCache_Invalidate(sourcePolicyResult.GetCanonicalizedPath().GetPathStringWithoutTypePrefix(), moveDirectory, sourcePolicyResult);
-
-    if (!AdjustOperationContextAndPolicyResultWithFullyResolvedPath(sourceOpContext, sourcePolicyResult, !moveDirectory))
-    {
-        return FALSE;
-    }
-
     // When MOVEFILE_COPY_ALLOWED is set, If the file is to be moved to a different volume, then the function simulates
     // the move by using the CopyFile and DeleteFile functions. In moving symlink using MOVEFILE_COPY_ALLOWED flag,
     // the call to CopyFile function passes COPY_FILE_SYMLINK, which makes the CopyFile function copies the symlink itself
@@ -3892,11 +4242,27 @@ BOOL WINAPI Detoured_MoveFileWithProgressW(
     destinationOpContext.Correlate(sourceOpContext);
     destinationOpContext.OpenedFileOrDirectoryAttributes = existingFileOrDirectoryAttribute;
 
+    // The source and the destination of a move tend to share a long prefix, whose policy search is shared
+    PolicyResult sourcePolicyResult;
     PolicyResult destPolicyResult;
+    if (!PolicyResult::InitializePair(lpExistingFileName, lpNewFileName, sourcePolicyResult, destPolicyResult))
+    {
+        if (sourcePolicyResult.IsIndeterminate())
+        {
+            sourcePolicyResult.ReportIndeterminatePolicyAndSetLastError(sourceOpContext);
+        }
+        else
+        {
+            destPolicyResult.ReportIndeterminatePolicyAndSetLastError(destinationOpContext);
+        }
+
+        return FALSE;
+    }
 
-    if (!destPolicyResult.Initialize(lpNewFileName))
+    PathCache_Invalidate(sourcePolicyResult.GetCanonicalizedPath().GetPathStringWithoutTypePrefix(), moveDirectory, sourcePolicyResult);
+
+    if (!AdjustOperationContextAndPolicyResultWithFullyResolvedPath(sourceOpContext, sourcePolicyResult, !moveDirectory))
     {
-        destPolicyResult.ReportIndeterminatePolicyAndSetLastError(destinationOpContext);
         return FALSE;
     }
 
@@ -4006,6 +4372,7 @@ BOOL WINAPI Detoured_MoveFileWithProgressA(
     _In_opt_ LPVOID             lpData,
     _In_     DWORD              dwFlags)
 {
+    DETOUR_STATISTICS(MoveFileWithProgressA);
     {
         DetouredScope scope;
         if (scope.Detoured_IsDisabled() || IsNullOrEmptyA(lpExistingFileName))
@@ -4037,9 +4404,15 @@ BOOL WINAPI Detoured_ReplaceFileW(
     __reserved LPVOID  lpExclude,
     __reserved LPVOID  lpReserved)
 {
+    DETOUR_STATISTICS(ReplaceFileW);
     auto path = CanonicalizedPath::Canonicalize(lpReplacedFileName);
     PolicyResult policyResult;
-    policyResult.Initialize(lpReplacedFileName);
+    if (!path.IsNull())
+    {
+        // The path is only canonicalized once
+        policyResult.Initialize(path);
+    }
+
     PathCache_Invalidate(path.GetPathStringWithoutTypePrefix(), false, policyResult);
 
     // TODO:implement detours logic
@@ -4060,6 +4433,7 @@ BOOL WINAPI Detoured_ReplaceFileA(
     __reserved  LPVOID lpExclude,
     __reserved  LPVOID lpReserved)
 {
+    DETOUR_STATISTICS(ReplaceFileA);
     {
         DetouredScope scope;
         if (scope.Detoured_IsDisabled()
@@ -4152,6 +4526,7 @@ static AccessCheckResult DeleteFileSafeProbe(AccessCheckResult writeAccessCheck,
 IMPLEMENTED(Detoured_DeleteFileW)
 BOOL WINAPI Detoured_DeleteFileW(_In_ LPCWSTR lpFileName)
 {
+    DETOUR_STATISTICS(DeleteFileW);
     DetouredScope scope;
     if (scope.Detoured_IsDisabled() ||
         IsNullOrEmptyW(lpFileName) ||
@@ -4233,6 +4608,7 @@ BOOL WINAPI Detoured_DeleteFileW(_In_ LPCWSTR lpFileName)
 IMPLEMENTED(Detoured_DeleteFileA)
 BOOL WINAPI Detoured_DeleteFileA(_In_ LPCSTR lpFileName)
 {
+    DETOUR_STATISTICS(DeleteFileA);
     {
         DetouredScope scope;
         if (scope.Detoured_IsDisabled() || IsNullOrEmptyA(lpFileName))
@@ -4251,6 +4627,7 @@ BOOL WINAPI Detoured_CreateHardLinkW(
     _In_       LPCWSTR               lpExistingFileName,
     __reserved LPSECURITY_ATTRIBUTES lpSecurityAttributes)
 {
+    DETOUR_STATISTICS(CreateHardLinkW);
     DetouredScope scope;
     if (scope.Detoured_IsDisabled() ||
         IsNullOrEmptyW(lpFileName) ||
@@ -4356,6 +4733,7 @@ BOOL WINAPI Detoured_CreateHardLinkA(
     __reserved LPSECURITY_ATTRIBUTES lpSecurityAttributes
     )
 {
+    DETOUR_STATISTICS(CreateHardLinkA);
     {
         DetouredScope scope;
         if (scope.Detoured_IsDisabled() || IsNullOrEmptyA(lpFileName) || IsNullOrEmptyA(lpExistingFileName))
@@ -4381,6 +4759,7 @@ BOOLEAN WINAPI Detoured_CreateSymbolicLinkW(
     _In_ LPCWSTR lpTargetFileName,
     _In_ DWORD   dwFlags)
 {
+    DETOUR_STATISTICS(CreateSymbolicLinkW);
     DetouredScope scope;
     if (scope.Detoured_IsDisabled() ||
         IgnoreReparsePoints() ||
@@ -4467,6 +4846,7 @@ BOOLEAN WINAPI Detoured_CreateSymbolicLinkA(
     _In_ LPCSTR lpTargetFileName,
     _In_ DWORD  dwFlags)
 {
+    DETOUR_STATISTICS(CreateSymbolicLinkA);
     {
         DetouredScope scope;
         if (scope.Detoured_IsDisabled() || IsNullOrEmptyA(lpSymlinkFileName) || IsNullOrEmptyA(lpTargetFileName))
@@ -4491,6 +4871,7 @@ HANDLE WINAPI Detoured_FindFirstFileW(
     _In_  LPCWSTR            lpFileName,
     _Out_ LPWIN32_FIND_DATAW lpFindFileData)
 {
+    DETOUR_STATISTICS(FindFirstFileW);
     // FindFirstFileExW is a strict superset. This line is essentially the same as the FindFirstFileW thunk in \minkernel\kernelbase\filefind.c
     return Detoured_FindFirstFileExW(lpFileName, FindExInfoStandard, lpFindFileData, FindExSearchNameMatch, NULL, 0);
 }
@@ -4500,6 +4881,7 @@ HANDLE WINAPI Detoured_FindFirstFileA(
     _In_   LPCSTR             lpFileName,
     _Out_  LPWIN32_FIND_DATAA lpFindFileData)
 {
+    DETOUR_STATISTICS(FindFirstFileA);
     // TODO:replace with Detoured_FindFirstFileW below
     return Real_FindFirstFileA(
         lpFileName,
@@ -4509,6 +4891,77 @@ HANDLE WINAPI Detoured_FindFirstFileA(
     // The output value differs too - WIN32_FIND_DATA{A, W}
 }
 
+/// <summary>
+/// Whether a successful enumeration of the given directory with the given filter was already reported by this process.
+/// </summary>
+/// <remarks>
+/// Tools enumerate the same directories over and over (e.g., every time a glob is evaluated). The report of such an enumeration
+/// does not depend on the function doing it, and BuildXL does not tell identical reports of a process apart (see ReportedFileAccess.Equals),
+/// so only the first one needs to be sent.
+/// </remarks>
+static bool IsDirectoryEnumerationAlreadyReported(
+    AccessCheckResult const& directoryAccessCheck,
+    PolicyResult const& directoryPolicyResult,
+    wchar_t const* filter,
+    DWORD error)
+{
+    if (error != ERROR_SUCCESS
+        || directoryAccessCheck.Access != RequestedAccess::Enumerate
+        || !directoryAccessCheck.ShouldReport())
+    {
+        return false;
+    }
+
+    // Filters of enumerations either are empty or have a wildcard, which paths can't have.
+    wstring key(directoryPolicyResult.GetCanonicalizedPath().GetPathString());
+    if (filter != nullptr && *filter != L'\0')
+    {
+        key.push_back(L'\\');
+        key.append(filter);
+    }
+
+    return !GetGlobalReportedDirectoryEnumerations()->TryRegisterPath(key.c_str(), key.length());
+}
+
+/// <summary>
+/// Counts an entry found by an enumeration whose entries are summarized (see SummarizeDirectoryEnumerations).
+/// </summary>
+static void AddEnumeratedEntry(HandleOverlay& overlay, wchar_t const* name)
+{
+    // Like the enumerations of BuildXL the summary is checked against, the pseudo entries are left out
+    if (wcscmp(name, L".") == 0 || wcscmp(name, L"..") == 0)
+    {
+        return;
+    }
+
+    overlay.EnumeratedEntryCount++;
+    overlay.EnumerationMembershipHash = AddToEnumerationMembershipHash(overlay.EnumerationMembershipHash, name);
+}
+
+/// <summary>
+/// Sends the summary of a complete enumeration unless this process already sent the same one, i.e., unless the membership
+/// of the directory did not change since it last enumerated it with the same filter (see IsDirectoryEnumerationAlreadyReported).
+/// </summary>
+static void ReportDirectoryEnumerationSummaryIfNeeded(
+    wchar_t const* directory,
+    wchar_t const* filter,
+    uint64_t entryCount,
+    uint64_t membershipHash)
+{
+    // '|' can be neither in paths nor in filters, so these keys are not those of the enumerations
+    wchar_t summary[40];
+    int length = swprintf_s(summary, L"|%I64x|%I64x", entryCount, membershipHash);
+    wstring key(directory);
+    key.push_back(L'|');
+    key.append(filter);
+    key.append(summary, length > 0 ? length : 0);
+
+    if (GetGlobalReportedDirectoryEnumerations()->TryRegisterPath(key.c_str(), key.length()))
+    {
+        ReportDirectoryEnumerationSummary(directory, filter, entryCount, membershipHash);
+    }
+}
+
 /// <summary>
 /// Enforces allowed access for a path that leads to the target of a reparse point.
 /// </summary>
@@ -4543,8 +4996,15 @@ HANDLE WINAPI ReportFindFirstFileExWAccesses(
     PolicyResult directoryPolicyResult;
     directoryPolicyResult.Initialize(canonicalizedPathIncludingFilter.RemoveLastComponent());
 
+    // The short names of the entries are scrubbed (see below and FindNextFile), so the file system does not need to look them up,
+    // and an enumeration (of a possibly large directory) is better served by fewer, larger queries. The caller can't tell the difference.
+    FINDEX_INFO_LEVELS realInfoLevelId = FindExInfoBasic;
+    DWORD realAdditionalFlags = PathContainsWildcard(canonicalizedPathIncludingFilter.GetLastComponent())
+        ? dwAdditionalFlags | FIND_FIRST_EX_LARGE_FETCH
+        : dwAdditionalFlags;
+
     DWORD error = ERROR_SUCCESS;
-    HANDLE searchHandle = Real_FindFirstFileExW(lpFileName, fInfoLevelId, lpFindFileData, fSearchOp, lpSearchFilter, dwAdditionalFlags);
+    HANDLE searchHandle = Real_FindFirstFileExW(lpFileName, realInfoLevelId, lpFindFileData, fSearchOp, lpSearchFilter, realAdditionalFlags);
     error = GetLastError();
 
     // Note that we check success via the returned handle. This function does not call SetLastError(ERROR_SUCCESS) on success. We stash
@@ -4589,6 +5049,10 @@ HANDLE WINAPI ReportFindFirstFileExWAccesses(
         directoryAccessCheck.Level = ReportLevel::Report;
     }
 
+    // The entries of a reported enumeration may be summarized rather than reported one by one: BuildXL only looks at the
+    // enumeration (see SummarizeDirectoryEnumerations).
+    bool summarizeEntries = isEnumeration && directoryAccessCheck.ShouldReport() && SummarizeDirectoryEnumerations();
+
     // Now, we can establish a policy for the file actually found.
     // - If enumerating, we can only do this on success (some file actually found) - if the wildcard matches nothing, we can't invent a name for which to report an antidependency.
     //   TODO: This is okay, but we need to complement this behavior with reporting the enumeration on the directory.
@@ -4622,7 +5086,16 @@ HANDLE WINAPI ReportFindFirstFileExWAccesses(
     // For the enumeration itself, we report ERROR_SUCCESS in the case that no matches were found (the directory itself exists).
     // FindFirstFileEx indicates no matches with ERROR_FILE_NOT_FOUND.
     DWORD enumerationError = (success || error == ERROR_FILE_NOT_FOUND) ? ERROR_SUCCESS : error;
-    ReportIfNeeded(directoryAccessCheck, fileOperationContext, directoryPolicyResult, success ? ERROR_SUCCESS : enumerationError, -1, filter);
+    if (!IsDirectoryEnumerationAlreadyReported(directoryAccessCheck, directoryPolicyResult, filter, enumerationError))
+    {
+        ReportIfNeeded(directoryAccessCheck, fileOperationContext, directoryPolicyResult, enumerationError, -1, filter);
+    }
+
+    if (summarizeEntries && !success && error == ERROR_FILE_NOT_FOUND)
+    {
+        // Nothing matches the filter: the enumeration is complete already
+        ReportDirectoryEnumerationSummaryIfNeeded(directoryPolicyResult.GetCanonicalizedPath().GetPathString(), filter, 0, 0);
+    }
 
     // TODO: Respect ShouldDenyAccess for directoryAccessCheck.
 
@@ -4643,7 +5116,10 @@ HANDLE WINAPI ReportFindFirstFileExWAccesses(
             isEnumeration ? RequestedReadAccess::EnumerationProbe : RequestedReadAccess::Probe,
             readContext);
 
-        ReportIfNeeded(fileAccessCheck, fileOperationContext, filePolicyResult, success ? ERROR_SUCCESS : error);
+        if (!summarizeEntries)
+        {
+            ReportIfNeeded(fileAccessCheck, fileOperationContext, filePolicyResult, success ? ERROR_SUCCESS : error);
+        }
 
         if (fileAccessCheck.ShouldDenyAccess())
         {
@@ -4663,7 +5139,14 @@ HANDLE WINAPI ReportFindFirstFileExWAccesses(
         else if (success && isEnumeration)
         {
             // We are returning a find handle that might return more results; mark it so that we can respond to FindNextFile on it.
-            RegisterHandleOverlay(searchHandle, directoryAccessCheck, directoryPolicyResult, HandleType::Find);
+            HandleOverlayRef overlay = RegisterHandleOverlay(searchHandle, directoryAccessCheck, directoryPolicyResult, HandleType::Find);
+            if (summarizeEntries)
+            {
+                overlay->SummarizeEnumeration = true;
+                overlay->EnumerationDirectory.assign(directoryPolicyResult.GetCanonicalizedPath().GetPathString());
+                overlay->EnumerationFilter.assign(filter);
+                AddEnumeratedEntry(*overlay, &findFileDataAtLevel->cFileName[0]);
+            }
         }
 
         if (success && filePolicyResult.ShouldOverrideTimestamps(fileAccessCheck))
@@ -4695,6 +5178,7 @@ HANDLE WINAPI Detoured_FindFirstFileExW(
     __reserved LPVOID             lpSearchFilter,
     _In_       DWORD              dwAdditionalFlags)
 {
+    DETOUR_STATISTICS(FindFirstFileExW);
     DetouredScope scope;
     if (scope.Detoured_IsDisabled() ||
         IsNullOrEmptyW(lpFileName) ||
@@ -4748,6 +5232,7 @@ HANDLE WINAPI Detoured_FindFirstFileExA(
     __reserved LPVOID             lpSearchFilter,
     _In_       DWORD              dwAdditionalFlags)
 {
+    DETOUR_STATISTICS(FindFirstFileExA);
     // TODO: Note that we can't simply forward to FindFirstFileW here after a unicode conversion.
     // The output value differs too - WIN32_FIND_DATA{A, W}
 
@@ -4765,6 +5250,7 @@ BOOL WINAPI Detoured_FindNextFileW(
     _In_  HANDLE             hFindFile,
     _Out_ LPWIN32_FIND_DATAW lpFindFileData)
 {
+    DETOUR_STATISTICS(FindNextFileW);
     DetouredScope scope;
     DWORD error = ERROR_SUCCESS;
     BOOL result = Real_FindNextFileW(hFindFile, lpFindFileData);
@@ -4778,6 +5264,22 @@ BOOL WINAPI Detoured_FindNextFileW(
     if (!result)
     {
         // TODO: This is likely ERROR_NO_MORE_FILES; is there anything more to check or report when enumeration ends?
+        if (error == ERROR_NO_MORE_FILES)
+        {
+            // The enumeration is complete: the summary of its entries can be sent (once, FindNextFile may be called again)
+            HandleOverlayRef overlay = TryLookupHandleOverlay(hFindFile);
+            if (overlay != nullptr && overlay->SummarizeEnumeration)
+            {
+                overlay->SummarizeEnumeration = false;
+                ReportDirectoryEnumerationSummaryIfNeeded(
+                    overlay->EnumerationDirectory.c_str(),
+                    overlay->EnumerationFilter.c_str(),
+                    overlay->EnumeratedEntryCount,
+                    overlay->EnumerationMembershipHash);
+                SetLastError(error);
+            }
+        }
+
         return result;
     }
 
@@ -4789,9 +5291,16 @@ BOOL WINAPI Detoured_FindNextFileW(
         wchar_t const* enumeratedComponent = &lpFindFileData->cFileName[0];
         PolicyResult filePolicyResult = overlay->Policy.GetPolicyForSubpath(enumeratedComponent);
 
-        if (!AdjustOperationContextAndPolicyResultWithFullyResolvedPath(fileOperationContext, overlay->Policy, true))
+        // The policy of the handle is that of the fully resolved directory once this has succeeded: resolving it again would not change it.
+        if (!overlay->PolicyHasBeenResolved)
         {
-            return FALSE;
+            if (!AdjustOperationContextAndPolicyResultWithFullyResolvedPath(fileOperationContext, overlay->Policy, true))
+            {
+                return FALSE;
+            }
+
+            overlay->PolicyHasBeenResolved = true;
+            overlay->OverrideTimestamps = overlay->Policy.ShouldOverrideTimestamps(overlay->AccessCheck);
         }
 
         FileReadContext readContext;
@@ -4800,7 +5309,14 @@ BOOL WINAPI Detoured_FindNextFileW(
         fileOperationContext.OpenedFileOrDirectoryAttributes = lpFindFileData->dwFileAttributes;
 
         AccessCheckResult accessCheck = filePolicyResult.CheckReadAccess(RequestedReadAccess::EnumerationProbe, readContext);
-        ReportIfNeeded(accessCheck, fileOperationContext, filePolicyResult, result ? ERROR_SUCCESS : error);
+        if (overlay->SummarizeEnumeration)
+        {
+            AddEnumeratedEntry(*overlay, enumeratedComponent);
+        }
+        else
+        {
+            ReportIfNeeded(accessCheck, fileOperationContext, filePolicyResult, result ? ERROR_SUCCESS : error);
+        }
 
         if (filePolicyResult.ShouldOverrideTimestamps(accessCheck))
         {
@@ -4821,6 +5337,9 @@ BOOL WINAPI Detoured_FindNextFileW(
 #if SUPER_VERBOSE
         Dbg(L"FindNextFile: Failed to find a handle overlay for policy information; conservatively not overriding timestamps");
 #endif // SUPER_VERBOSE
+
+        // The handle may still come from FindFirstFileExW, which does not query short names (only the first character is set then)
+        ScrubShortFileName(lpFindFileData);
     }
 
     SetLastError(error);
@@ -4832,6 +5351,7 @@ BOOL WINAPI Detoured_FindNextFileA(
     _In_  HANDLE             hFindFile,
     _Out_ LPWIN32_FIND_DATAA lpFindFileData)
 {
+    DETOUR_STATISTICS(FindNextFileA);
     // TODO:replace with the same logic as Detoured_FindNextFileW
     // Note that we can't simply forward to FindFirstFileW here after a unicode conversion.
     // The output value differs too - WIN32_FIND_DATA{A, W}
@@ -4847,6 +5367,7 @@ BOOL WINAPI Detoured_GetFileInformationByHandleEx(
     _Out_ LPVOID                    lpFileInformation,
     _In_  DWORD                     dwBufferSize)
 {
+    DETOUR_STATISTICS(GetFileInformationByHandleEx);
     DetouredScope scope;
 
     DWORD error = ERROR_SUCCESS;
@@ -4858,7 +5379,8 @@ BOOL WINAPI Detoured_GetFileInformationByHandleEx(
 
     error = GetLastError();
 
-    if (scope.Detoured_IsDisabled() || IsNullOrInvalidHandle(hFile) || fileInformationClass != FileBasicInfo || lpFileInformation == nullptr)
+    // There are no timestamps to override when the query fails
+    if (scope.Detoured_IsDisabled() || !result || IsNullOrInvalidHandle(hFile) || fileInformationClass != FileBasicInfo || lpFileInformation == nullptr)
     {
         return result;
     }
@@ -4869,7 +5391,7 @@ BOOL WINAPI Detoured_GetFileInformationByHandleEx(
     HandleOverlayRef overlay = TryLookupHandleOverlay(hFile);
     if (overlay != nullptr)
     {
-        if (overlay->Policy.ShouldOverrideTimestamps(overlay->AccessCheck))
+        if (overlay->OverrideTimestamps)
         {
 #if SUPER_VERBOSE
             Dbg(L"GetFileInformationByHandleEx: Overriding timestamps for %s", overlay->Policy.GetCanonicalizedPath().GetPathString());
@@ -4891,6 +5413,7 @@ BOOL WINAPI Detoured_GetFileInformationByHandleEx(
 IMPLEMENTED(Detoured_FindClose)
 BOOL WINAPI Detoured_FindClose(_In_ HANDLE handle)
 {
+    DETOUR_STATISTICS(FindClose);
     DetouredScope scope;
 
     DWORD error = ERROR_SUCCESS;
@@ -4916,13 +5439,15 @@ BOOL WINAPI Detoured_GetFileInformationByHandle(
     _In_  HANDLE                       hFile,
     _Out_ LPBY_HANDLE_FILE_INFORMATION lpFileInformation)
 {
+    DETOUR_STATISTICS(GetFileInformationByHandle);
     DetouredScope scope;
 
     DWORD error = ERROR_SUCCESS;
     BOOL result = Real_GetFileInformationByHandle(hFile, lpFileInformation);
     error = GetLastError();
 
-    if (scope.Detoured_IsDisabled() || IsNullOrInvalidHandle(hFile) || lpFileInformation == nullptr)
+    // There are no timestamps to override when the query fails
+    if (scope.Detoured_IsDisabled() || !result || IsNullOrInvalidHandle(hFile) || lpFileInformation == nullptr)
     {
         return result;
     }
@@ -4930,7 +5455,7 @@ BOOL WINAPI Detoured_GetFileInformationByHandle(
     HandleOverlayRef overlay = TryLookupHandleOverlay(hFile);
     if (overlay != nullptr)
     {
-        if (overlay->Policy.ShouldOverrideTimestamps(overlay->AccessCheck))
+        if (overlay->OverrideTimestamps)
         {
 #if SUPER_VERBOSE
             Dbg(L"GetFileInformationByHandle: Overriding timestamps for %s", overlay->Policy.GetCanonicalizedPath().GetPathString());
@@ -4954,7 +5479,8 @@ static BOOL DeleteUsingSetFileInformationByHandle(
     _In_ FILE_INFO_BY_HANDLE_CLASS FileInformationClass,
     _In_ LPVOID                    lpFileInformation,
     _In_ DWORD                     dwBufferSize,
-    _In_ const wstring&            fullPath)
+    _In_ const wstring&            fullPath,
+    _In_ const HandleOverlayRef&   overlay)
 {
     FileOperationContext sourceOpContext = FileOperationContext(
         L"SetFileInformationByHandle_Source",
@@ -4966,7 +5492,7 @@ static BOOL DeleteUsingSetFileInformationByHandle(
 
     PolicyResult sourcePolicyResult;
 
-    if (!sourcePolicyResult.Initialize(fullPath.c_str()))
+    if (!InitializePolicyForHandlePath(sourcePolicyResult, fullPath, overlay))
     {
         sourcePolicyResult.ReportIndeterminatePolicyAndSetLastError(sourceOpContext);
         return FALSE;
@@ -5008,7 +5534,8 @@ static BOOL RenameUsingSetFileInformationByHandle(
     _In_ FILE_INFO_BY_HANDLE_CLASS FileInformationClass,
     _In_ LPVOID                    lpFileInformation,
     _In_ DWORD                     dwBufferSize,
-    _In_ const wstring&            fullPath)
+    _In_ const wstring&            fullPath,
+    _In_ const HandleOverlayRef&   overlay)
 {
     DWORD openedFileOrDirectoryAttribute;
     bool renameDirectory = IsHandleOrPathToDirectory(hFile, fullPath.c_str(), true, /*ref*/ openedFileOrDirectoryAttribute);
@@ -5025,7 +5552,7 @@ static BOOL RenameUsingSetFileInformationByHandle(
 
     PolicyResult sourcePolicyResult;
 
-    if (!sourcePolicyResult.Initialize(fullPath.c_str()))
+    if (!InitializePolicyForHandlePath(sourcePolicyResult, fullPath, overlay))
     {
         sourcePolicyResult.ReportIndeterminatePolicyAndSetLastError(sourceOpContext);
         return FALSE;
@@ -5125,6 +5652,11 @@ static BOOL RenameUsingSetFileInformationByHandle(
     ReportIfNeeded(sourceAccessCheck, sourceOpContext, sourcePolicyResult, error);
     ReportIfNeeded(destAccessCheck, destinationOpContext, destPolicyResult, error);
 
+    if (result)
+    {
+        UpdateHandleOverlayAfterRename(hFile, destPolicyResult);
+    }
+
     if (renameDirectory)
     {
         for each(auto entry in filesAndDirectoriesToReport)
@@ -5145,6 +5677,7 @@ BOOL WINAPI Detoured_SetFileInformationByHandle(
     _In_ LPVOID                    lpFileInformation,
     _In_ DWORD                     dwBufferSize)
 {
+    DETOUR_STATISTICS(SetFileInformationByHandle);
     bool isDisposition =
         FileInformationClass == FILE_INFO_BY_HANDLE_CLASS::FileDispositionInfo
         || FileInformationClass == FILE_INFO_BY_HANDLE_CLASS::FileDispositionInfoEx;
@@ -5210,13 +5743,14 @@ BOOL WINAPI Detoured_SetFileInformationByHandle(
     DWORD lastError = GetLastError();
 
     wstring srcPath;
+    HandleOverlayRef srcOverlay;
 
-    DWORD getFinalPathByHandle = DetourGetFinalPathByHandle(hFile, srcPath);
+    DWORD getFinalPathByHandle = DetourGetPathByHandle(hFile, srcPath, srcOverlay);
     if ((getFinalPathByHandle != ERROR_SUCCESS) || IsSpecialDeviceName(srcPath.c_str()) || IsNullOrEmptyW(srcPath.c_str()))
     {
         if (getFinalPathByHandle != ERROR_SUCCESS)
         {
-            Dbg(L"Detoured_SetFileInformationByHandle: DetourGetFinalPathByHandle: %d", getFinalPathByHandle);
+            Dbg(L"Detoured_SetFileInformationByHandle: DetourGetPathByHandle: %d", getFinalPathByHandle);
         }
 
         SetLastError(lastError);
@@ -5234,13 +5768,15 @@ BOOL WINAPI Detoured_SetFileInformationByHandle(
             FileInformationClass,
             lpFileInformation,
             dwBufferSize,
-            srcPath)
+            srcPath,
+            srcOverlay)
         : RenameUsingSetFileInformationByHandle(
             hFile,
             FileInformationClass,
             lpFileInformation,
             dwBufferSize,
-            srcPath);
+            srcPath,
+            srcOverlay);
 }
 
 HANDLE WINAPI Detoured_OpenFileMappingW(
@@ -5248,6 +5784,7 @@ HANDLE WINAPI Detoured_OpenFileMappingW(
     _In_ BOOL    bInheritHandle,
     _In_ LPCWSTR lpName)
 {
+    DETOUR_STATISTICS(OpenFileMappingW);
     // TODO:implement detours logic
     return Real_OpenFileMappingW(
         dwDesiredAccess,
@@ -5260,6 +5797,7 @@ HANDLE WINAPI Detoured_OpenFileMappingA(
     _In_  BOOL   bInheritHandle,
     _In_  LPCSTR lpName)
 {
+    DETOUR_STATISTICS(OpenFileMappingA);
     {
         DetouredScope scope;
         if (scope.Detoured_IsDisabled() || IsNullOrEmptyA(lpName))
@@ -5288,6 +5826,7 @@ UINT WINAPI Detoured_GetTempFileNameW(
     _In_  UINT    uUnique,
     _Out_ LPTSTR  lpTempFileName)
 {
+    DETOUR_STATISTICS(GetTempFileNameW);
     // TODO:implement detours logic
     return Real_GetTempFileNameW(
         lpPathName,
@@ -5302,6 +5841,7 @@ UINT WINAPI Detoured_GetTempFileNameA(
     _In_  UINT   uUnique,
     _Out_ LPSTR  lpTempFileName)
 {
+    DETOUR_STATISTICS(GetTempFileNameA);
     // TODO:implement detours logic
     return Real_GetTempFileNameA(
         lpPathName,
@@ -5397,6 +5937,7 @@ BOOL WINAPI Detoured_CreateDirectoryW(
     _In_     LPCWSTR               lpPathName,
     _In_opt_ LPSECURITY_ATTRIBUTES lpSecurityAttributes)
 {
+    DETOUR_STATISTICS(CreateDirectoryW);
     DetouredScope scope;
     if (scope.Detoured_IsDisabled() ||
         IsNullOrEmptyW(lpPathName) ||
@@ -5484,6 +6025,7 @@ BOOL WINAPI Detoured_CreateDirectoryA(
     _In_     LPCSTR                lpPathName,
     _In_opt_ LPSECURITY_ATTRIBUTES lpSecurityAttributes)
 {
+    DETOUR_STATISTICS(CreateDirectoryA);
     {
         DetouredScope scope;
         if (scope.Detoured_IsDisabled() || IsNullOrEmptyA(lpPathName))
@@ -5505,6 +6047,7 @@ BOOL WINAPI Detoured_CreateDirectoryExW(
     _In_     LPCWSTR               lpNewDirectory,
     _In_opt_ LPSECURITY_ATTRIBUTES lpSecurityAttributes)
 {
+    DETOUR_STATISTICS(CreateDirectoryExW);
     // TODO:implement detours logic
     return Real_CreateDirectoryExW(
         lpTemplateDirectory,
@@ -5517,6 +6060,7 @@ BOOL WINAPI Detoured_CreateDirectoryExA(
     _In_     LPCSTR                lpNewDirectory,
     _In_opt_ LPSECURITY_ATTRIBUTES lpSecurityAttributes)
 {
+    DETOUR_STATISTICS(CreateDirectoryExA);
     {
         DetouredScope scope;
         if (scope.Detoured_IsDisabled() ||
@@ -5540,6 +6084,7 @@ BOOL WINAPI Detoured_CreateDirectoryExA(
 IMPLEMENTED(Detoured_RemoveDirectoryW)
 BOOL WINAPI Detoured_RemoveDirectoryW(_In_ LPCWSTR lpPathName)
 {
+    DETOUR_STATISTICS(RemoveDirectoryW);
     DetouredScope scope;
     if (scope.Detoured_IsDisabled() ||
         IsNullOrEmptyW(lpPathName) ||
@@ -5613,6 +6158,7 @@ BOOL WINAPI Detoured_RemoveDirectoryW(_In_ LPCWSTR lpPathName)
 IMPLEMENTED(Detoured_RemoveDirectoryA)
 BOOL WINAPI Detoured_RemoveDirectoryA(_In_ LPCSTR lpPathName)
 {
+    DETOUR_STATISTICS(RemoveDirectoryA);
     {
         DetouredScope scope;
         if (scope.Detoured_IsDisabled() || IsNullOrEmptyA(lpPathName))
@@ -5629,6 +6175,7 @@ BOOL WINAPI Detoured_DecryptFileW(
     _In_       LPCWSTR lpFileName,
     __reserved DWORD dwReserved)
 {
+    DETOUR_STATISTICS(DecryptFileW);
     // TODO:implement detours logic
     return Real_DecryptFileW(
         lpFileName,
@@ -5639,6 +6186,7 @@ BOOL WINAPI Detoured_DecryptFileA(
     _In_       LPCSTR lpFileName,
     __reserved DWORD dwReserved)
 {
+    DETOUR_STATISTICS(DecryptFileA);
     {
         DetouredScope scope;
         if (scope.Detoured_IsDisabled() || IsNullOrEmptyA(lpFileName))
@@ -5657,12 +6205,14 @@ BOOL WINAPI Detoured_DecryptFileA(
 
 BOOL WINAPI Detoured_EncryptFileW(_In_ LPCWSTR lpFileName)
 {
+    DETOUR_STATISTICS(EncryptFileW);
     // TODO:implement detours logic
     return Real_EncryptFileW(lpFileName);
 }
 
 BOOL WINAPI Detoured_EncryptFileA(_In_ LPCSTR lpFileName)
 {
+    DETOUR_STATISTICS(EncryptFileA);
     {
         DetouredScope scope;
         if (scope.Detoured_IsDisabled() || IsNullOrEmptyA(lpFileName))
@@ -5680,6 +6230,7 @@ DWORD WINAPI Detoured_OpenEncryptedFileRawW(
     _In_  ULONG   ulFlags,
     _Out_ PVOID*  pvContext)
 {
+    DETOUR_STATISTICS(OpenEncryptedFileRawW);
     // TODO:implement detours logic
     return Real_OpenEncryptedFileRawW(
         lpFileName,
@@ -5692,6 +6243,7 @@ DWORD WINAPI Detoured_OpenEncryptedFileRawA(
     _In_  ULONG  ulFlags,
     _Out_ PVOID* pvContext)
 {
+    DETOUR_STATISTICS(OpenEncryptedFileRawA);
     {
         DetouredScope scope;
         if (scope.Detoured_IsDisabled() || IsNullOrEmptyA(lpFileName))
@@ -5723,6 +6275,7 @@ HANDLE WINAPI Detoured_OpenFileById(
     _In_opt_ LPSECURITY_ATTRIBUTES lpSecurityAttributes,
     _In_     DWORD                 dwFlags)
 {
+    DETOUR_STATISTICS(OpenFileById);
     // TODO:implement detours logic
     return Real_OpenFileById(
         hFile,
@@ -5740,6 +6293,7 @@ DWORD WINAPI Detoured_GetFinalPathNameByHandleA(
     _In_  DWORD cchFilePath,
     _In_  DWORD dwFlags)
 {
+    DETOUR_STATISTICS(GetFinalPathNameByHandleA);
     unique_ptr<wchar_t[]> wideFilePathBuffer(new wchar_t[cchFilePath]);
     DWORD err = Detoured_GetFinalPathNameByHandleW(hFile, wideFilePathBuffer.get(), cchFilePath, dwFlags);
 
@@ -5801,6 +6355,7 @@ DWORD WINAPI Detoured_GetFinalPathNameByHandleW(
     _In_  DWORD  cchFilePath,
     _In_  DWORD  dwFlags)
 {
+    DETOUR_STATISTICS(GetFinalPathNameByHandleW);
     DetouredScope scope;
 
     if (scope.Detoured_IsDisabled() || IgnoreGetFinalPathNameByHandle())
@@ -5808,26 +6363,58 @@ DWORD WINAPI Detoured_GetFinalPathNameByHandleW(
         return Real_GetFinalPathNameByHandleW(hFile, lpszFilePath, cchFilePath, dwFlags);
     }
 
-    DWORD err = Real_GetFinalPathNameByHandleW(hFile, lpszFilePath, cchFilePath, dwFlags);
-
-    if (err == 0)
+    // The translated path is memoized in the overlay of the handle, per flags (see HandleOverlay::FinalPath)
+    HandleOverlayRef overlay = TryLookupHandleOverlay(hFile);
+    wstring normalizedPath;
+    bool found = false;
+    if (overlay != nullptr)
     {
-        SetLastError(err);
+        AcquireSRWLockShared(&overlay->FinalPathLock);
+        if (overlay->HasFinalPath && overlay->FinalPathFlags == dwFlags)
+        {
+            normalizedPath.assign(overlay->FinalPath);
+            found = true;
+        }
+
+        ReleaseSRWLockShared(&overlay->FinalPathLock);
     }
-    else if (err < cchFilePath)
+
+    if (!found)
     {
-        wstring normalizedPath;
+        DWORD err = Real_GetFinalPathNameByHandleW(hFile, lpszFilePath, cchFilePath, dwFlags);
+
+        if (err == 0)
+        {
+            SetLastError(err);
+            return err;
+        }
+
+        if (err >= cchFilePath)
+        {
+            return err;
+        }
+
         TranslateFilePath(wstring(lpszFilePath), normalizedPath, false);
 
-        if (normalizedPath.length() <= cchFilePath)
+        if (overlay != nullptr)
         {
-            wcscpy_s(lpszFilePath, cchFilePath, normalizedPath.c_str());
+            AcquireSRWLockExclusive(&overlay->FinalPathLock);
+            overlay->FinalPath.assign(normalizedPath);
+            overlay->FinalPathFlags = dwFlags;
+            overlay->HasFinalPath = true;
+            ReleaseSRWLockExclusive(&overlay->FinalPathLock);
         }
+    }
 
+    // Like GetFinalPathNameByHandleW, the length of the path is returned when it fits in the buffer (with its terminating null character), and the
+    // size the buffer needs otherwise.
+    if (normalizedPath.length() < cchFilePath)
+    {
+        wcscpy_s(lpszFilePath, cchFilePath, normalizedPath.c_str());
         return (DWORD)normalizedPath.length();
     }
 
-    return err;
+    return (DWORD)normalizedPath.length() + 1;
 }
 
 // Detoured_NtQueryDirectoryFile
@@ -5869,6 +6456,7 @@ NTSTATUS NTAPI Detoured_NtQueryDirectoryFile(
     _In_opt_ PUNICODE_STRING        FileName,
     _In_     BOOLEAN                RestartScan)
 {
+    DETOUR_STATISTICS(NtQueryDirectoryFile);
     DetouredScope scope;
     LPCWSTR directoryName = nullptr;
     wstring filter;
@@ -5975,7 +6563,11 @@ NTSTATUS NTAPI Detoured_NtQueryDirectoryFile(
             overlay->EnumerationHasBeenReported = NT_SUCCESS(result) && directoryAccessCheck.ShouldReport();
 
             // We can report the status for directory now.
-            ReportIfNeeded(directoryAccessCheck, fileOperationContext, directoryPolicyResult, (DWORD)(NT_SUCCESS(result) ? ERROR_SUCCESS : result), -1, filter.c_str());
+            DWORD enumerationError = (DWORD)(NT_SUCCESS(result) ? ERROR_SUCCESS : result);
+            if (!IsDirectoryEnumerationAlreadyReported(directoryAccessCheck, directoryPolicyResult, filter.c_str(), enumerationError))
+            {
+                ReportIfNeeded(directoryAccessCheck, fileOperationContext, directoryPolicyResult, enumerationError, -1, filter.c_str());
+            }
         }
     }
 
@@ -5998,6 +6590,7 @@ NTSTATUS NTAPI Detoured_ZwQueryDirectoryFile(
     _In_opt_ PUNICODE_STRING        FileName,
     _In_     BOOLEAN                RestartScan)
 {
+    DETOUR_STATISTICS(ZwQueryDirectoryFile);
     DetouredScope scope;
     LPCWSTR directoryName = nullptr;
     wstring filter;
@@ -6104,7 +6697,11 @@ NTSTATUS NTAPI Detoured_ZwQueryDirectoryFile(
             overlay->EnumerationHasBeenReported = NT_SUCCESS(result) && directoryAccessCheck.ShouldReport();
 
             // We can report the status for directory now.
-            ReportIfNeeded(directoryAccessCheck, fileOperationContext, overlay->Policy, (DWORD)(NT_SUCCESS(result) ? ERROR_SUCCESS : result));
+            DWORD enumerationError = (DWORD)(NT_SUCCESS(result) ? ERROR_SUCCESS : result);
+            if (!IsDirectoryEnumerationAlreadyReported(directoryAccessCheck, overlay->Policy, nullptr, enumerationError))
+            {
+                ReportIfNeeded(directoryAccessCheck, fileOperationContext, overlay->Policy, enumerationError);
+            }
         }
     }
 
@@ -6161,8 +6758,10 @@ static bool PathFromObjectAttributesViaId(POBJECT_ATTRIBUTES attributes, Canonic
     return true;
 }
 
-// Helper function converts OBJECT_ATTRIBUTES into CanonicalizedPath
-static bool PathFromObjectAttributes(POBJECT_ATTRIBUTES attributes, CanonicalizedPath &path, ULONG createOptions)
+// Helper function converts OBJECT_ATTRIBUTES into CanonicalizedPath.
+// If the path is relative to a root directory, its overlay is returned in 'rootDirectoryOverlay' (when not null), so the policy search
+// of the path can resume from the one of the directory.
+static bool PathFromObjectAttributes(POBJECT_ATTRIBUTES attributes, CanonicalizedPath &path, ULONG createOptions, HandleOverlayRef* rootDirectoryOverlay = nullptr)
 {
     if ((createOptions & FILE_OPEN_BY_FILE_ID) != 0)
     {
@@ -6188,10 +6787,15 @@ static bool PathFromObjectAttributes(POBJECT_ATTRIBUTES attributes, Canonicalize
     }
 
     // Convert the ObjectName (buffer with a size) to be null-terminated.
-    wstring name(attributes->ObjectName->Buffer, (size_t)(attributes->ObjectName->Length / sizeof(wchar_t)));
+    ScratchString name(attributes->ObjectName->Buffer, (size_t)(attributes->ObjectName->Length / sizeof(wchar_t)));
 
     if (overlay != nullptr)
     {
+        if (rootDirectoryOverlay != nullptr)
+        {
+            *rootDirectoryOverlay = overlay;
+        }
+
         // If there is no 'name' set (name is empty), just use the canonicalized path. Otherwise need to extend,
         // so '\' is appended to the canonicalized path and then the name is appended.
         path = name.empty() ? overlay->Policy.GetCanonicalizedPath() : overlay->Policy.GetCanonicalizedPath().Extend(name.c_str());
@@ -6280,6 +6884,7 @@ NTSTATUS NTAPI Detoured_ZwCreateFile(
     _In_opt_ PVOID              EaBuffer,
     _In_     ULONG              EaLength)
 {
+    DETOUR_STATISTICS(ZwCreateFile);
     DetouredScope scope;
 
     // As a performance workaround, neuter the FILE_RANDOM_ACCESS hint (even if Detoured_IsDisabled() and there's another detoured API higher on the stack).
@@ -6288,11 +6893,12 @@ NTSTATUS NTAPI Detoured_ZwCreateFile(
     CreateOptions &= ~FILE_RANDOM_ACCESS;
 
     CanonicalizedPath path;
+    HandleOverlayRef rootDirectoryOverlay;
 
     if (scope.Detoured_IsDisabled() ||
         !MonitorZwCreateOpenQueryFile() ||
         ObjectAttributes == nullptr ||
-        !PathFromObjectAttributes(ObjectAttributes, path, CreateOptions) ||
+        !PathFromObjectAttributes(ObjectAttributes, path, CreateOptions, &rootDirectoryOverlay) ||
         IsSpecialDeviceName(path.GetPathString()))
     {
         return Real_ZwCreateFile(
@@ -6318,7 +6924,7 @@ NTSTATUS NTAPI Detoured_ZwCreateFile(
         path.GetPathString());
 
     PolicyResult policyResult;
-    if (!policyResult.Initialize(path.GetPathString()))
+    if (!policyResult.Initialize(path.GetPathString(), rootDirectoryOverlay != nullptr ? &rootDirectoryOverlay->Policy : nullptr))
     {
         policyResult.ReportIndeterminatePolicyAndSetLastError(opContext);
         return DETOURS_STATUS_ACCESS_DENIED;
@@ -6581,6 +7187,7 @@ NTSTATUS NTAPI Detoured_NtCreateFile(
     _In_opt_ PVOID              EaBuffer,
     _In_     ULONG              EaLength)
 {
+    DETOUR_STATISTICS(NtCreateFile);
     DetouredScope scope;
 
     // As a performance workaround, neuter the FILE_RANDOM_ACCESS hint (even if Detoured_IsDisabled() and there's another detoured API higher on the stack).
@@ -6589,10 +7196,11 @@ NTSTATUS NTAPI Detoured_NtCreateFile(
     CreateOptions &= ~FILE_RANDOM_ACCESS;
 
     CanonicalizedPath path;
+    HandleOverlayRef rootDirectoryOverlay;
 
     if (scope.Detoured_IsDisabled() ||
         ObjectAttributes == nullptr ||
-        !PathFromObjectAttributes(ObjectAttributes, path, CreateOptions) ||
+        !PathFromObjectAttributes(ObjectAttributes, path, CreateOptions, &rootDirectoryOverlay) ||
         IsSpecialDeviceName(path.GetPathString()))
     {
         return Real_NtCreateFile(
@@ -6620,7 +7228,7 @@ NTSTATUS NTAPI Detoured_NtCreateFile(
         path.GetPathString());
 
     PolicyResult policyResult;
-    if (!policyResult.Initialize(path.GetPathString()))
+    if (!policyResult.Initialize(path.GetPathString(), rootDirectoryOverlay != nullptr ? &rootDirectoryOverlay->Policy : nullptr))
     {
         policyResult.ReportIndeterminatePolicyAndSetLastError(opContext);
         return DETOURS_STATUS_ACCESS_DENIED;
@@ -6697,6 +7305,20 @@ NTSTATUS NTAPI Detoured_NtCreateFile(
             }
         }
 
+        if (!forceReadOnlyForRequestedRWAccess && accessCheck.ShouldDenyAccess() && MinimalDetours() &&
+            CreateDisposition == FILE_OPEN && !WantsWriteAccess(DesiredAccess) && CheckIfNtCreateMayDeleteFile(CreateOptions, DesiredAccess))
+        {
+            // DeleteFile is not detoured (see MinimalDetours), so treat the deletion of an absent file the way Detoured_DeleteFileW does:
+            // as a probe, letting the real call fail.
+            DWORD probeError;
+            DWORD attributes;
+            AccessCheckResult probeAccessCheck = DeleteFileSafeProbe(accessCheck, opContext, policyResult, /*out*/ &probeError, /*ref*/ attributes);
+            if (!probeAccessCheck.ShouldDenyAccess())
+            {
+                accessCheck = probeAccessCheck;
+            }
+        }
+
         if (!forceReadOnlyForRequestedRWAccess && accessCheck.ShouldDenyAccess())
         {
             ReportIfNeeded(accessCheck, opContext, policyResult, accessCheck.DenialError());
@@ -6799,6 +7421,52 @@ NTSTATUS NTAPI Detoured_NtCreateFile(
         }
     }
 
+    // When CreateFileW is not detoured (see NtCreateFileOnly), the USN match it enforces (or reports) is done here instead.
+    USN usn = -1; // -1, or 0xFFFFFFFFFFFFFFFF indicates that USN could/was not obtained
+    if (NtCreateFileOnly() && !readContext.OpenedDirectory && !IsNullOrInvalidHandle(*FileHandle))
+    {
+        bool reportUsn = policyResult.ReportUsnAfterOpen();
+        bool checkUsn = policyResult.GetExpectedUsn() != -1;
+        bool unexpectedUsn = false;
+
+        // As in Detoured_CreateFileW, a USN that is only reported is left to the host.
+        DWORD getUsnError = ERROR_SUCCESS;
+        if (checkUsn && !TryGetUsn(*FileHandle, /* inout */ usn, /* inout */ getUsnError))
+        {
+            WriteWarningOrErrorF(L"Could not obtain USN for file path '%s'. Error: %d",
+                policyResult.GetCanonicalizedPath().GetPathString(), getUsnError);
+            MaybeBreakOnAccessDenied();
+
+            ReportFileAccess(
+                opContext,
+                FileAccessStatus::FileAccessStatus_CannotDeterminePolicy,
+                policyResult,
+                AccessCheckResult(RequestedAccess::None, ResultAction::Deny, ReportLevel::Report),
+                getUsnError,
+                usn);
+
+            NtClose(*FileHandle);
+            *FileHandle = INVALID_HANDLE_VALUE;
+
+            SetLastError(ERROR_ACCESS_DENIED);
+            return DETOURS_STATUS_ACCESS_DENIED;
+        }
+
+        if (checkUsn && usn != policyResult.GetExpectedUsn())
+        {
+            WriteWarningOrErrorF(L"USN mismatch.  Actual USN: 0x%08x, expected USN: 0x%08x.",
+                policyResult.GetCanonicalizedPath().GetPathString(), usn, policyResult.GetExpectedUsn());
+            unexpectedUsn = true;
+        }
+
+        // As in Detoured_CreateFileW: ReportUsnAfterOpen implies reporting, and a USN mismatch is reported (but never denied).
+        if (reportUsn || unexpectedUsn)
+        {
+            accessCheck.Level = ReportLevel::ReportExplicit;
+            accessCheck = AccessCheckResult::Combine(accessCheck, accessCheck.With(ReportLevel::ReportExplicit));
+        }
+    }
+
     bool isHandleToReparsePoint = (CreateOptions & FILE_OPEN_REPARSE_POINT) != 0;
     bool shouldReportAccessCheck = true;
 
@@ -6844,7 +7512,7 @@ NTSTATUS NTAPI Detoured_NtCreateFile(
 
     if (shouldReportAccessCheck)
     {
-        ReportIfNeeded(accessCheck, opContext, policyResult, RtlNtStatusToDosError(result));
+        ReportIfNeeded(accessCheck, opContext, policyResult, RtlNtStatusToDosError(result), usn);
     }
 
     InvalidateReparsePointCacheIfNeeded(shouldResolveReparsePointsInPath, opContext.DesiredAccess, opContext.FlagsAndAttributes, readContext.OpenedDirectory,
@@ -6885,14 +7553,16 @@ NTSTATUS NTAPI Detoured_ZwOpenFile(
     _In_  ULONG              ShareAccess,
     _In_  ULONG              OpenOptions)
 {
+    DETOUR_STATISTICS(ZwOpenFile);
     DetouredScope scope;
 
     CanonicalizedPath path;
+    HandleOverlayRef rootDirectoryOverlay;
 
     if (scope.Detoured_IsDisabled() ||
         !MonitorZwCreateOpenQueryFile() ||
         ObjectAttributes == nullptr ||
-        !PathFromObjectAttributes(ObjectAttributes, path, OpenOptions) ||
+        !PathFromObjectAttributes(ObjectAttributes, path, OpenOptions, &rootDirectoryOverlay) ||
         IsSpecialDeviceName(path.GetPathString()))
     {
         return Real_ZwOpenFile(
@@ -6913,7 +7583,7 @@ NTSTATUS NTAPI Detoured_ZwOpenFile(
         path.GetPathString());
 
     PolicyResult policyResult;
-    if (!policyResult.Initialize(path.GetPathString()))
+    if (!policyResult.Initialize(path.GetPathString(), rootDirectoryOverlay != nullptr ? &rootDirectoryOverlay->Policy : nullptr))
     {
         policyResult.ReportIndeterminatePolicyAndSetLastError(opContext);
         return DETOURS_STATUS_ACCESS_DENIED;
@@ -7161,6 +7831,7 @@ NTSTATUS NTAPI Detoured_NtOpenFile(
     _In_  ULONG              ShareAccess,
     _In_  ULONG              OpenOptions)
 {
+    DETOUR_STATISTICS(NtOpenFile);
     // We don't EnterLoggingScope for NtOpenFile or NtCreateFile for two reasons:
     // - Of course these get called.
     // - It's hard to predict library loads (e.g. even by a statically linked CRT), which complicates testing of other call logging.
@@ -7186,6 +7857,7 @@ NTSTATUS NTAPI Detoured_NtOpenFile(
 IMPLEMENTED(Detoured_NtClose)
 NTSTATUS NTAPI Detoured_NtClose(_In_ HANDLE handle)
 {
+    DETOUR_STATISTICS(NtClose);
 #if MEASURE_DETOURED_NT_CLOSE_IMPACT
     InterlockedIncrement(&g_ntCloseHandeCount);
 #endif // MEASURE_DETOURED_NT_CLOSE_IMPACT
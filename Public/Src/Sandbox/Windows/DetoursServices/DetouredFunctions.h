@@ -104,6 +104,13 @@ BOOL WINAPI Detoured_GetVolumePathNameW(
     __in                          DWORD cchBufferLength
     );
 
+// See DefineDosDevice on MSDN: https://docs.microsoft.com/en-us/windows/win32/api/fileapi/nf-fileapi-definedosdevicew
+BOOL WINAPI Detoured_DefineDosDeviceW(
+    __in     DWORD dwFlags,
+    __in     LPCWSTR lpDeviceName,
+    __in_opt LPCWSTR lpTargetPath
+    );
+
 // See GetFileAttributes on MSDN: http://msdn.microsoft.com/en-us/library/windows/desktop/aa915578(v=vs.85).aspx
 DWORD WINAPI Detoured_GetFileAttributesW(
     __in  LPCWSTR lpFileName
@@ -5,7 +5,9 @@
 using namespace std;
 #include "DetouredProcessInjector.h"
 #include "DetoursHelpers.h"
+#include "DetoursTracing.h"
 #include "DeviceMap.h"
+#include "ManifestRetarget.h"
 #include <iomanip>
 #include "buildXL_mem.h"
 
@@ -14,6 +16,26 @@ bool DetouredProcessInjector::s_is64BitProcess = sizeof(void *) == 8;
 
 unsigned long g_injectionTimeoutInMinutes = 0;
 
+// Number of processes injected by this process and the time it took (see InjectProcess)
+volatile LONG64 g_injectedProcessCount = 0;
+volatile LONG64 g_injectionTimeInMicroseconds = 0;
+
+static LONG64 GetPerformanceFrequency()
+{
+    LARGE_INTEGER frequency;
+    return QueryPerformanceFrequency(&frequency) && frequency.QuadPart > 0 ? frequency.QuadPart : 1;
+}
+
+static const LONG64 s_performanceFrequency = GetPerformanceFrequency();
+
+// Size of the headers DetourCopyPayloadToProcess puts in front of a payload (see BuildPayloadImage)
+static const uint32_t s_payloadImageHeaderSize =
+    sizeof(IMAGE_DOS_HEADER) +
+    sizeof(IMAGE_NT_HEADERS) +
+    sizeof(IMAGE_SECTION_HEADER) +
+    sizeof(DETOUR_SECTION_HEADER) +
+    sizeof(DETOUR_SECTION_RECORD);
+
 // Address of the function that checks if a process is a Wow64 process. Not all
 // versions of Windows have this function, so this value could be null. Casting
 // from FARPROC causes warning, disable
@@ -41,11 +63,14 @@ void DetouredProcessInjector::Clear()
     _mapDirectory.reset();
     _remoteInjectorPipe.reset();
     _reportPipe.reset();
-    _payload.reset(nullptr);
+    _payload = nullptr;
+    _ownedPayload.reset(nullptr);
     _payloadSize = 0;
     _otherHandles.clear();
     _dllX64.clear();
     _dllX86.clear();
+    _payloadImage.reset(nullptr);
+    _payloadImageSize = 0;
 }
 
 // Initialize object with the payload wrapper that has the following data:
@@ -127,18 +152,11 @@ bool DetouredProcessInjector::Init(const byte *payloadWrapper, std::wstring& err
         }
     }
 
-    // Copy payload
+    // The payload is used in place: the wrapper is the Detours payload copied into this process by its parent
+    // (see LocalInjectProcess), which is never freed. Copying the file access manifest it contains (which can be large)
+    // would be a waste of time and memory for every process.
     _payloadSize = size;
-    _payload = make_unique<byte[]>(size);
-    if (size == 0)
-    {
-        _payload.reset(nullptr);
-    }
-    else {
-        byte *newPayload = new byte[size];
-        memcpy_s(newPayload, size, handles, size);
-        _payload.reset(newPayload);
-    }
+    _payload = size == 0 ? nullptr : reinterpret_cast<LPCBYTE>(handles);
 
     _initialized = true;
     return true;
@@ -165,11 +183,13 @@ void DetouredProcessInjector::Init(
     _payloadSize = payloadSize;
     if (payloadSize == 0)
     {
-        _payload.reset(nullptr);
+        _payload = nullptr;
+        _ownedPayload.reset(nullptr);
     }
     else {
-        _payload = make_unique<byte[]>(payloadSize);
-        memcpy_s(_payload.get(), payloadSize, payload, payloadSize);
+        _ownedPayload = make_unique<byte[]>(payloadSize);
+        memcpy_s(_ownedPayload.get(), payloadSize, payload, payloadSize);
+        _payload = _ownedPayload.get();
     }
 
     SetHandles(otherHandleCount, otherHandles);
@@ -186,19 +206,171 @@ void DetouredProcessInjector::SetHandles(uint32_t otherHandleCount, PHANDLE othe
     else {
         _otherHandles.assign(otherHandles, otherHandles + otherHandleCount);
     }
+
+    // The handles are part of the payload image
+    _payloadImage.reset(nullptr);
+    _payloadImageSize = 0;
 }
 
-DWORD DetouredProcessInjector::LocalInjectProcess(HANDLE processHandle, bool inheritedHandles)
+void DetouredProcessInjector::Reset()
 {
     LockGuard lock(_injectorLock);
+    Clear();
+}
+
+// Build the memory image DetourCopyPayloadToProcess would write into a child: the headers that make the payload
+// look like a module (this is how DetourFindPayload finds it in the child), followed by the payload wrapper (see Init)
+// with the handles of this process. None of it depends on the child, so instead of having DetourCopyPayloadToProcess
+// write every piece of it (and copying the payload into a new wrapper) for every child, the image is built once
+// and written into each child at once.
+void DetouredProcessInjector::BuildPayloadImage()
+{
+    uint32_t wrapperSize = WrapperSize();
+    uint32_t size = s_payloadImageHeaderSize + wrapperSize;
+
+    // The allocated image is zeroed
+    std::unique_ptr<byte[]> image = make_unique<byte[]>(size);
+    byte *target = image.get();
+
+    IMAGE_DOS_HEADER *idh = reinterpret_cast<IMAGE_DOS_HEADER *>(target);
+    idh->e_magic = IMAGE_DOS_SIGNATURE;
+    idh->e_lfanew = sizeof(IMAGE_DOS_HEADER);
+    target += sizeof(IMAGE_DOS_HEADER);
+
+    IMAGE_NT_HEADERS *inh = reinterpret_cast<IMAGE_NT_HEADERS *>(target);
+    inh->Signature = IMAGE_NT_SIGNATURE;
+    inh->FileHeader.SizeOfOptionalHeader = sizeof(inh->OptionalHeader);
+    inh->FileHeader.Characteristics = IMAGE_FILE_DLL;
+    inh->FileHeader.NumberOfSections = 1;
+    inh->OptionalHeader.Magic = IMAGE_NT_OPTIONAL_HDR_MAGIC;
+    target += sizeof(IMAGE_NT_HEADERS);
+
+    IMAGE_SECTION_HEADER *ish = reinterpret_cast<IMAGE_SECTION_HEADER *>(target);
+    memcpy(ish->Name, ".detour", sizeof(ish->Name));
+    ish->VirtualAddress = static_cast<DWORD>((target + sizeof(IMAGE_SECTION_HEADER)) - image.get());
+    ish->SizeOfRawData = sizeof(DETOUR_SECTION_HEADER) + sizeof(DETOUR_SECTION_RECORD) + wrapperSize;
+    target += sizeof(IMAGE_SECTION_HEADER);
+
+    DETOUR_SECTION_HEADER *dsh = reinterpret_cast<DETOUR_SECTION_HEADER *>(target);
+    dsh->cbHeaderSize = sizeof(DETOUR_SECTION_HEADER);
+    dsh->nSignature = DETOUR_SECTION_HEADER_SIGNATURE;
+    dsh->nDataOffset = sizeof(DETOUR_SECTION_HEADER);
+    dsh->cbDataSize = sizeof(DETOUR_SECTION_HEADER) + sizeof(DETOUR_SECTION_RECORD) + wrapperSize;
+    target += sizeof(DETOUR_SECTION_HEADER);
+
+    DETOUR_SECTION_RECORD *dsr = reinterpret_cast<DETOUR_SECTION_RECORD *>(target);
+    dsr->cbBytes = wrapperSize + sizeof(DETOUR_SECTION_RECORD);
+    dsr->nReserved = 0;
+    dsr->guid = _payloadGuid;
+    target += sizeof(DETOUR_SECTION_RECORD);
+
+    // Write sizes
+    uint32_t *sizes = reinterpret_cast<uint32_t *>(target);
+    *sizes++ = wrapperSize;
+    *sizes++ = static_cast<uint32_t>(c_minHandleCount + _otherHandles.size());
+
+    // Write handles, as inherited by the children. They are overwritten in the children that don't inherit them.
+    uint64_t *handles = reinterpret_cast<uint64_t *>(sizes);
+    *handles++ = HandleToUint64(_mapDirectory.get());
+    *handles++ = HandleToUint64(_remoteInjectorPipe.get());
+    *handles++ = HandleToUint64(_reportPipe.get());
+    for (auto i : _otherHandles)
+    {
+        *handles++ = HandleToUint64(i);
+    }
+
+    // Copy payload
+    if (_payloadSize > 0)
+    {
+        memcpy(handles, _payload, _payloadSize);
+    }
+
+    _payloadImage = std::move(image);
+    _payloadImageSize = size;
+}
 
-    // Install detours
-    LPCSTR dll = isWow64Process(processHandle) ? _dllX86.data() : _dllX64.data();
+LPCBYTE DetouredProcessInjector::GetPayloadImage(uint32_t &size)
+{
+    LockGuard lock(_injectorLock);
+
+    if (_payloadImage == nullptr)
+    {
+        BuildPayloadImage();
+    }
+
+    size = _payloadImageSize;
+    return _payloadImage.get();
+}
+
+DWORD DetouredProcessInjector::CopyPayloadImageToProcess(HANDLE processHandle, bool inheritedHandles, PBYTE *remoteBase)
+{
+    uint32_t size;
+    LPCBYTE image = GetPayloadImage(size);
+
+    // The child looks for the image at the preferred address first
+    PBYTE base = reinterpret_cast<PBYTE>(VirtualAllocEx(processHandle, DETOURS_PREFERRED_PAYLOAD_ADDRESS, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+    if (base == nullptr)
+    {
+        base = reinterpret_cast<PBYTE>(VirtualAllocEx(processHandle, nullptr, size, MEM_COMMIT, PAGE_READWRITE));
+    }
+
+    if (base == nullptr)
+    {
+        return GetLastError();
+    }
+
+    SIZE_T written = 0;
+    if (!WriteProcessMemory(processHandle, base, image, size, &written) || written != size)
+    {
+        DWORD err = GetLastError();
+        VirtualFreeEx(processHandle, base, 0, MEM_RELEASE);
+        return err == ERROR_SUCCESS ? ERROR_PARTIAL_COPY : err;
+    }
+
+    if (!inheritedHandles)
+    {
+        vector<uint64_t> handles;
+        handles.reserve(c_minHandleCount + _otherHandles.size());
+        handles.push_back(DuplicateHandleToUint64(processHandle, _mapDirectory.get()));
+        handles.push_back(DuplicateHandleToUint64(processHandle, _remoteInjectorPipe.get()));
+        handles.push_back(DuplicateHandleToUint64(processHandle, _reportPipe.get()));
+        for (auto i : _otherHandles)
+        {
+            handles.push_back(DuplicateHandleToUint64(processHandle, i));
+        }
+
+        // The handles follow the sizes at the start of the wrapper
+        SIZE_T handlesSize = handles.size() * sizeof(uint64_t);
+        if (!WriteProcessMemory(processHandle, base + s_payloadImageHeaderSize + 2 * sizeof(uint32_t), handles.data(), handlesSize, &written) ||
+            written != handlesSize)
+        {
+            DWORD err = GetLastError();
+            VirtualFreeEx(processHandle, base, 0, MEM_RELEASE);
+            return err == ERROR_SUCCESS ? ERROR_PARTIAL_COPY : err;
+        }
+    }
+
+    if (remoteBase != nullptr)
+    {
+        *remoteBase = base;
+    }
+
+    return ERROR_SUCCESS;
+}
+
+DWORD DetouredProcessInjector::LocalInjectProcess(HANDLE processHandle, bool inheritedHandles)
+{
+    // Once the object is initialized, only the payload image is written (under the lock, when the first child is injected),
+    // so several children can be injected at once.
+    bool isTargetWow64Process = isWow64Process(processHandle);
+
+    // Install detours. The import table that is rewritten is the one of the child, so this is done for every child.
+    LPCSTR dll = isTargetWow64Process ? _dllX86.data() : _dllX64.data();
     if (!DetourUpdateProcessWithDll(processHandle, &dll, 1))
     {
         DWORD err = GetLastError();
         Dbg(L"DetouredProcessInjector::LocalInjectProcess - Failed to inject %S from %s process into %s process: 0x%08x",
-              dll, s_isWow64Process ? L"WOW64" : L"Native", isWow64Process(processHandle) ? L"WOW64" : L"Native", (int)err);
+              dll, s_isWow64Process ? L"WOW64" : L"Native", isTargetWow64Process ? L"WOW64" : L"Native", (int)err);
         return err;
     }
 
@@ -208,49 +380,99 @@ DWORD DetouredProcessInjector::LocalInjectProcess(HANDLE processHandle, bool inh
         Dbg(L"DetouredProcessInjector::LocalInjectProcess - Failed to apply mapping handle %d from %s to %s process: 0x%08x",
             (uint32_t)((intptr_t)_mapDirectory.get() & UINT32_MAX),
             s_isWow64Process ? L"WOW64" : L"Native",
-            isWow64Process(processHandle) ? L"WOW64" : L"Native", (int)err);
+            isTargetWow64Process ? L"WOW64" : L"Native", (int)err);
         return err;
     }
 
-    // Allocate space for the payload wrapper.
-    uint32_t size = WrapperSize();
-    std::unique_ptr<byte[]> payloadWrapper = make_unique<byte[]>(size);
-
-    // Write sizes
-    uint32_t *sizes = reinterpret_cast<uint32_t *>(payloadWrapper.get());
-    *sizes++ = size;
-    *sizes++ = static_cast<uint32_t>(c_minHandleCount + _otherHandles.size());
+    DWORD err = CopyPayloadImageToProcess(processHandle, inheritedHandles);
+    if (err != ERROR_SUCCESS)
+    {
+        Dbg(L"DetouredProcessInjector::LocalInjectProcess - Failed to copy payload to process: 0x%08x", (int)err);
+        return err;
+    }
 
-    // Write handles
-    uint64_t *handles = reinterpret_cast<uint64_t *>(sizes);
-    *handles++ = inheritedHandles ? HandleToUint64(_mapDirectory.get()) : DuplicateHandleToUint64(processHandle, _mapDirectory.get());
-    *handles++ = inheritedHandles ? HandleToUint64(_remoteInjectorPipe.get()) : DuplicateHandleToUint64(processHandle, _remoteInjectorPipe.get());
-    *handles++ = inheritedHandles ? HandleToUint64(_reportPipe.get()) : DuplicateHandleToUint64(processHandle, _reportPipe.get());
+    return ERROR_SUCCESS;
+}
 
-    if (!_otherHandles.empty())
+DWORD DetouredProcessInjector::RetargetProcess(HANDLE processHandle, DWORD timeoutMs)
+{
+    DWORD processId = GetProcessId(processHandle);
+    wchar_t name[ManifestRetargetObjectNameLength];
+
+    GetManifestRetargetObjectName(name, ManifestRetargetObjectNameLength, processId, ManifestRetargetSectionKind);
+    unique_handle<nullptr> section(OpenFileMappingW(FILE_MAP_ALL_ACCESS, FALSE, name));
+    GetManifestRetargetObjectName(name, ManifestRetargetObjectNameLength, processId, ManifestRetargetRequestEventKind);
+    unique_handle<nullptr> requestEvent(OpenEventW(EVENT_MODIFY_STATE, FALSE, name));
+    GetManifestRetargetObjectName(name, ManifestRetargetObjectNameLength, processId, ManifestRetargetDoneEventKind);
+    unique_handle<nullptr> doneEvent(OpenEventW(SYNCHRONIZE, FALSE, name));
+    if (!section.isValid() || !requestEvent.isValid() || !doneEvent.isValid())
     {
-        for (auto i : _otherHandles)
-        {
-            *handles++ = inheritedHandles ? HandleToUint64(i) : DuplicateHandleToUint64(processHandle, i);
-        }
+        // The process was not created with AllowManifestRetarget (or is gone)
+        DWORD err = GetLastError();
+        Dbg(L"DetouredProcessInjector::RetargetProcess - Process %d does not accept retarget requests: 0x%08x", (int)processId, (int)err);
+        return err == ERROR_SUCCESS ? ERROR_NOT_SUPPORTED : err;
     }
 
-    // Copy payload
-    errno_t memcpyerror = memcpy_s(handles, _payloadSize, _payload.get(), _payloadSize);
-    if (memcpyerror != 0)
+    // Requests are not queued: the caller sends one at a time to a given process
+    ManifestRetargetRequest *request = reinterpret_cast<ManifestRetargetRequest *>(
+        MapViewOfFile(section.get(), FILE_MAP_ALL_ACCESS, 0, 0, sizeof(ManifestRetargetRequest)));
+    if (request == nullptr)
     {
-        Dbg(L"DetouredProcessInjector::LocalInjectProcess - Failed to do memcpy: 0x%08x", (int)memcpyerror);
-        return ERROR_PARTIAL_COPY;
+        return GetLastError();
     }
 
-    if (!DetourCopyPayloadToProcess(processHandle, _payloadGuid, payloadWrapper.get(), size))
+    // The handles of a new pip are never inherited by a running process
+    PBYTE remoteBase = nullptr;
+    DWORD err = CopyPayloadImageToProcess(processHandle, false, &remoteBase);
+    if (err == ERROR_SUCCESS)
     {
-        DWORD err = GetLastError();
-        Dbg(L"DetouredProcessInjector::LocalInjectProcess - Failed to copy payload to process: 0x%08x", (int)err);
-        return err;
+        request->PayloadImage = reinterpret_cast<uint64_t>(remoteBase);
+        request->TimeoutMs = timeoutMs;
+        request->Status = MANIFEST_RETARGET_PENDING;
+        SetEvent(requestEvent.get());
+
+        // The process gives up waiting for a quiescent point after timeoutMs, give it some more time to answer
+        HANDLE handles[] = { doneEvent.get(), processHandle };
+        DWORD waitTimeout = timeoutMs == INFINITE ? INFINITE : timeoutMs + 30000;
+        DWORD wait = WaitForMultipleObjects(2, handles, FALSE, waitTimeout);
+        if (wait == WAIT_OBJECT_0)
+        {
+            // The process frees the image once it runs under it, and never touches a rejected one
+            err = request->Status;
+            if (err != ERROR_SUCCESS)
+            {
+                VirtualFreeEx(processHandle, remoteBase, 0, MEM_RELEASE);
+            }
+        }
+        else
+        {
+            // A request that is not answered may still be handled, so the image is left alone
+            err = wait == WAIT_OBJECT_0 + 1 ? ERROR_PROCESS_ABORTED : WAIT_TIMEOUT;
+        }
     }
 
-    return ERROR_SUCCESS;
+    UnmapViewOfFile(request);
+    return err;
+}
+
+DWORD DetouredProcessInjector::InjectProcess(HANDLE processHandle, bool inheritedHandles)
+{
+    LARGE_INTEGER start;
+    QueryPerformanceCounter(&start);
+
+    bool remote = NeedRemoteInjection(processHandle);
+    DWORD err = remote
+        ? RemoteInjectProcess(processHandle, inheritedHandles)
+        : LocalInjectProcess(processHandle, inheritedHandles);
+
+    LARGE_INTEGER end;
+    QueryPerformanceCounter(&end);
+
+    InterlockedIncrement64(&g_injectedProcessCount);
+    InterlockedAdd64(&g_injectionTimeInMicroseconds, (end.QuadPart - start.QuadPart) * 1000000 / s_performanceFrequency);
+    TraceProcessInjection(GetProcessId(processHandle), remote, err, end.QuadPart - start.QuadPart);
+
+    return err;
 }
 
 DWORD DetouredProcessInjector::RemoteInjectProcess(HANDLE processHandle, bool inheritedHandles) const
@@ -420,3 +642,21 @@ DWORD WINAPI DetouredProcessInjector_Inject(DetouredProcessInjector *injector, D
 
     return injector->LocalInjectProcess(processHandle.get(), false);
 }
+
+DWORD WINAPI DetouredProcessInjector_Retarget(DetouredProcessInjector *injector, DWORD pid, DWORD timeoutMs)
+{
+    if (injector == nullptr || !injector->IsValid()) {
+        Dbg(L"DetouredProcessInjector_Retarget: injector is not valid");
+        return ERROR_INVALID_FUNCTION;
+    }
+
+    unique_handle<nullptr> processHandle(OpenProcess(PROCESS_ALL_ACCESS, FALSE, pid));
+
+    if (!processHandle.isValid())
+    {
+        Dbg(L"DetouredProcessInjector_Retarget: process handle is not valid");
+        return GetLastError();
+    }
+
+    return injector->RetargetProcess(processHandle.get(), timeoutMs);
+}
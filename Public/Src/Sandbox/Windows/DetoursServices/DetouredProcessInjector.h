@@ -38,7 +38,9 @@ private:
     unique_handle<INVALID_HANDLE_VALUE> _mapDirectory;
     unique_handle<INVALID_HANDLE_VALUE> _remoteInjectorPipe;
     unique_handle<INVALID_HANDLE_VALUE> _reportPipe;
-    unique_ptr<byte[]> _payload = nullptr;
+    // The payload, which is either owned (_ownedPayload) or the one passed to this process by its parent (see Init)
+    LPCBYTE _payload = nullptr;
+    unique_ptr<byte[]> _ownedPayload = nullptr;
     uint32_t _payloadSize = 0;
     vector<HANDLE> _otherHandles;
     string _dllX86;
@@ -46,6 +48,10 @@ private:
     GUID _payloadGuid;
     bool _initialized = false;
 
+    // The memory image of the payload copied into every child (see BuildPayloadImage), built when the first child is injected
+    unique_ptr<byte[]> _payloadImage = nullptr;
+    uint32_t _payloadImageSize = 0;
+
     CRITICAL_SECTION _injectorLock;
 
     class LockGuard
@@ -92,6 +98,13 @@ private:
     // process. For now we have an additional condition for WOW64 to WOW64 bit process
     // when we need to do drive mapping due to a kernel thunk bug in WOW64.
     //
+    // A native 64 bit process injects its WOW64 children itself (the 64 bit Detours rewrites
+    // their 32 bit import table, see UpdateImports32 in creatwth.cpp), so only WOW64 parents
+    // go through the pipe. The reverse cannot be done in-process: the image, the import table
+    // Detours would allocate near it and the pages whose protection it changes may all lie
+    // above 4GB in a 64 bit child, where VirtualQueryEx, VirtualAllocEx and VirtualProtectEx
+    // of a WOW64 process cannot reach.
+    //
     // Disable the warning about processHandle being unused and
     // change the check to the one commented out when the bug is fixed.
 #pragma warning( push )
@@ -110,6 +123,15 @@ private:
         return static_cast<uint32_t>(2 * sizeof(uint32_t) + (c_minHandleCount + _otherHandles.size()) * sizeof(uint64_t) + _payloadSize);
     }
 
+    // Build the payload image. Must be called with the lock held.
+    void BuildPayloadImage();
+
+    // Get the payload image, building it if needed. The image does not change until the object is cleared.
+    LPCBYTE GetPayloadImage(uint32_t &size);
+
+    // Copy the payload image into the specified process, duplicating the handles it contains if they are not inherited.
+    // The address of the copy is returned in remoteBase, if given.
+    DWORD CopyPayloadImageToProcess(HANDLE processHandle, bool inheritedHandles, PBYTE *remoteBase = nullptr);
 
     // Clear the object (free memory, etc.)
     void Clear();
@@ -144,6 +166,9 @@ public:
     // Set "other" handles. These are duplicated if needed.
     void SetHandles(uint32_t otherHandleCount, PHANDLE otherHandles);
 
+    // Drop the data (closing the handles), so that the object can be initialized again (see ManifestRetarget.h)
+    void Reset();
+
     inline bool IsValid() const
     {
 #ifdef _DEBUG
@@ -156,7 +181,7 @@ public:
     HANDLE MapDirectory() const { return _mapDirectory.get(); }
     HANDLE RemoteInjectorPipe() const { return _remoteInjectorPipe.get(); }
     HANDLE ReportPipe() const { return _reportPipe.get(); }
-    LPCBYTE Payload() const { return _payload.get(); }
+    LPCBYTE Payload() const { return _payload; }
     uint32_t PayloadSize() const { return _payloadSize; }
     uint32_t OtherHandleCount() const { return static_cast<uint32_t>(_otherHandles.size()); }
     const HANDLE *OtherHandles() const { return _otherHandles.data(); }
@@ -173,12 +198,13 @@ public:
     DWORD RemoteInjectProcess(HANDLE processHandle, bool inheritedHandles) const;
 
     // Do either local or remote injection, depending on bitness of the
-    // injector and injectee processes.
-    DWORD InjectProcess(HANDLE processHandle, bool inheritedHandles)
-    {
-        return NeedRemoteInjection(processHandle) ? RemoteInjectProcess(processHandle, inheritedHandles) :
-            LocalInjectProcess(processHandle, inheritedHandles);
-    }
+    // injector and injectee processes. The time it takes is added to the injection counters
+    // (see g_injectedProcessCount).
+    DWORD InjectProcess(HANDLE processHandle, bool inheritedHandles);
+
+    // Move a running detoured process, created with FileAccessManifestExtraFlag::AllowManifestRetarget, to the
+    // manifest stored in the object (see ManifestRetarget.h). Waits for the process to handle the request.
+    DWORD RetargetProcess(HANDLE processHandle, DWORD timeoutMs);
 
     // No default constructor, no copies
     DetouredProcessInjector() = delete;
@@ -10,3 +10,39 @@
 // ----------------------------------------------------------------------------
 
 __declspec(thread) size_t DetouredScope::gt_DetouredCount = 0;
+
+bool DetouredScope::s_quiescenceEnabled = false;
+SRWLOCK DetouredScope::s_quiescenceLock = SRWLOCK_INIT;
+
+// ----------------------------------------------------------------------------
+// FUNCTION DEFINITIONS
+// ----------------------------------------------------------------------------
+
+bool DetouredScope::TryEnterQuiescence(DWORD timeoutMs)
+{
+    assert(s_quiescenceEnabled && gt_DetouredCount == 0);
+
+    // Counted as a scope first, so the detoured functions called while waiting don't take the lock shared
+    ++gt_DetouredCount;
+
+    // Polled rather than waited for: a waiting exclusive owner would block the threads entering a detoured function
+    ULONGLONG start = GetTickCount64();
+    while (!TryAcquireSRWLockExclusive(&s_quiescenceLock))
+    {
+        if (GetTickCount64() - start >= timeoutMs)
+        {
+            --gt_DetouredCount;
+            return false;
+        }
+
+        Sleep(1);
+    }
+
+    return true;
+}
+
+void DetouredScope::LeaveQuiescence()
+{
+    ReleaseSRWLockExclusive(&s_quiescenceLock);
+    --gt_DetouredCount;
+}
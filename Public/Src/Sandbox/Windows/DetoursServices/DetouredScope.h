@@ -17,26 +17,49 @@ Implements APIs involving ignoring contexts for detouring.
 // The goal of the scope is not detour any Windows APIs which are called as a result
 // of already detoured APIs. There is no need to spend additional resources
 // on applying BuildXL's access policy more than once.
+//
+// When quiescence is enabled (see ManifestRetarget.h), the top level scopes also hold s_quiescenceLock shared,
+// so that a thread can wait for no other thread to be in a detoured function (see TryEnterQuiescence).
 class DetouredScope
 {
 private:
     static __declspec(thread) size_t gt_DetouredCount;
 
+    static bool s_quiescenceEnabled;
+    static SRWLOCK s_quiescenceLock;
+
 public:
     DetouredScope()
     {
-        ++gt_DetouredCount;
+        if (++gt_DetouredCount == 1 && s_quiescenceEnabled)
+        {
+            AcquireSRWLockShared(&s_quiescenceLock);
+        }
     }
 
     ~DetouredScope()
     {
-        --gt_DetouredCount;
+        if (--gt_DetouredCount == 0 && s_quiescenceEnabled)
+        {
+            ReleaseSRWLockShared(&s_quiescenceLock);
+        }
     }
 
     // This function returns false except for the top level scope.
     // NOTE: This function is not static to ensure we always declare a scope.
     inline bool Detoured_IsDisabled() { return gt_DetouredCount != 1; }
 
+    // Makes the top level scopes hold s_quiescenceLock. Must be called before any function is detoured.
+    static void EnableQuiescence() { s_quiescenceEnabled = true; }
+
+    // Waits (for at most timeoutMs) for no other thread to be in a detoured function, then keeps them from entering one until
+    // LeaveQuiescence is called. The detoured functions called by the calling thread meanwhile are not detoured.
+    // Returns false if the timeout expired. Threads waiting to enter a detoured function are never blocked by the wait itself:
+    // a thread in a detoured function may be waiting for one of them.
+    static bool TryEnterQuiescence(DWORD timeoutMs);
+
+    static void LeaveQuiescence();
+
 private:
     // make copy-safe by explicitly deleting copy constructors
     DetouredScope(const DetouredScope &) = delete;
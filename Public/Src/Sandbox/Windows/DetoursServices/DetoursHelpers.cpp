@@ -13,7 +13,11 @@
 #include "DeviceMap.h"
 #include "CanonicalizedPath.h"
 #include "PolicyResult.h"
-#include <list>
+#include "ReportedAccessCache.h"
+#include "ImagePathCache.h"
+#include "DetoursTracing.h"
+#include "ShimProcessMatchTable.h"
+#include "TranslatePathTrie.h"
 #include <string>
 #include <stdio.h>
 #include <stack>
@@ -48,21 +52,19 @@ void TranslateFilePath(_In_ const std::wstring& inFileName, _Out_ std::wstring&
     }
 
     CanonicalizedPath canonicalizedPath = CanonicalizedPath::Canonicalize(inFileName.c_str());
-    std::wstring tempStr(canonicalizedPath.GetPathString());
+    wchar_t const* canonicalizedString = canonicalizedPath.GetPathString();
 
     // If the canonicalized string is null or empty, just return. No need to do anything.
-    if (tempStr.empty() || tempStr.c_str() == nullptr)
+    if (canonicalizedString == nullptr || canonicalizedString[0] == L'\0')
     {
         return;
     }
 
-    const std::wstring prefix(L"\\??\\");
-    bool hasPrefix = !tempStr.compare(0, prefix.size(), prefix);
+    // The prefixes are checked on the canonicalized string in place; the only copy made is the (unprefixed) string being translated.
+    bool hasPrefix = wcsncmp(canonicalizedString, NT_PATH_PREFIX, wcslen(NT_PATH_PREFIX)) == 0;
+    bool hasPrefixNt = wcsncmp(canonicalizedString, NT_LONG_PATH_PREFIX, wcslen(NT_LONG_PATH_PREFIX)) == 0;
 
-    const std::wstring prefixNt(L"\\\\?\\");
-    bool hasPrefixNt = !tempStr.compare(0, prefixNt.size(), prefixNt);
-
-    tempStr.assign(canonicalizedPath.GetPathStringWithoutTypePrefix());
+    std::wstring tempStr(canonicalizedPath.GetPathStringWithoutTypePrefix());
 
     bool translated = false;
     bool needsTranslation = true;
@@ -72,77 +74,44 @@ void TranslateFilePath(_In_ const std::wstring& inFileName, _Out_ std::wstring&
         Dbg(L"TranslateFilePath-0: initial: '%s'", tempStr.c_str());
     }
 
-    std::list<TranslatePathTuple*> manifestTranslatePathTuples(g_pManifestTranslatePathTuples->begin(), g_pManifestTranslatePathTuples->end());
+    // Every translation is used at most once, so that translations cannot loop.
+    std::vector<size_t> usedTranslations;
+    size_t translationIndex = 0;
+    size_t longestPath = 0;
 
     while (needsTranslation)
     {
-        needsTranslation = false;
-        size_t longestPath = 0;
-        std::list<TranslatePathTuple*>::iterator replacementIt;
-
-        std::wstring lowCaseFinalPath(tempStr);
-        for (basic_string<wchar_t>::iterator p = lowCaseFinalPath.begin();
-            p != lowCaseFinalPath.end(); ++p) {
-            *p = towlower(*p);
-        }
-
-        // Find the longest path that can be used for translation from the g_pManifestTranslatePathTuples list.
+        // Find the longest path that can be used for translation (see TranslatePathTrie::TryFind).
         // Note: The g_pManifestTranslatePathTuples always comes canonicalized from the managed code.
-        for (std::list<TranslatePathTuple*>::iterator it = manifestTranslatePathTuples.begin(); it != manifestTranslatePathTuples.end(); ++it)
-        {
-            TranslatePathTuple* tpTuple = *it;
-            const std::wstring& lowCaseTargetPath = tpTuple->GetFromPath();
-            size_t targetLen = lowCaseTargetPath.length();
-            bool mayBeDirectoryPath = false;
-
-            int comp = lowCaseFinalPath.compare(0, targetLen, lowCaseTargetPath);
-
-            if (comp != 0)
-            {
-                // The path to be translated can be a directory path that does not have trailing '\\'.
-
-                if (lowCaseFinalPath.back() != L'\\'
-                    && lowCaseTargetPath.back() == L'\\'
-                    && lowCaseFinalPath.length() == (targetLen - 1))
-                {
-                    std::wstring lowCaseFinalPathWithBs = lowCaseFinalPath + L'\\';
-                    comp = lowCaseFinalPathWithBs.compare(0, targetLen, lowCaseTargetPath);
-                    mayBeDirectoryPath = true;
-                }
-            }
-
-            if (comp == 0)
-            {
-                if (longestPath < targetLen)
-                {
-                    replacementIt = it;
-                    longestPath = !mayBeDirectoryPath ? targetLen : targetLen - 1;
-                    translated = true;
-                    needsTranslation = true;
-                }
-            }
-        }
+        needsTranslation = g_pManifestTranslatePathTrie->TryFind(tempStr, usedTranslations, translationIndex, longestPath);
 
         // Translate using the longest translation path.
         if (needsTranslation)
         {
-            TranslatePathTuple* replacementTuple = *replacementIt;
+            TranslatePathTuple* replacementTuple = (*g_pManifestTranslatePathTuples)[translationIndex];
+            translated = true;
 
-            std::wstring t(replacementTuple->GetToPath());
-            t.append(tempStr, longestPath);
+            // Only the debug message needs the string as it was before the translation
+            std::wstring from;
+            if (debug)
+            {
+                from.assign(tempStr);
+            }
+
+            // The translated prefix is replaced in place, rather than building the translated string aside
+            tempStr.replace(0, longestPath, replacementTuple->GetToPath());
 
             if (debug)
             {
                 Dbg(
                     L"TranslateFilePath-1: from: '%s', to '%s' (used mapping: '%s' --> '%s')",
+                    from.c_str(),
                     tempStr.c_str(),
-                    t.c_str(),
                     replacementTuple->GetFromPath().c_str(),
                     replacementTuple->GetToPath().c_str());
             }
 
-            tempStr.assign(t);
-            manifestTranslatePathTuples.erase(replacementIt);
+            usedTranslations.push_back(translationIndex);
         }
     }
 
@@ -150,13 +119,13 @@ void TranslateFilePath(_In_ const std::wstring& inFileName, _Out_ std::wstring&
     {
         if (hasPrefix)
         {
-            outFileName.assign(prefix);
+            outFileName.assign(NT_PATH_PREFIX);
         }
         else
         {
             if (hasPrefixNt)
             {
-                outFileName.assign(prefixNt);
+                outFileName.assign(NT_LONG_PATH_PREFIX);
             }
             else
             {
@@ -173,83 +142,91 @@ void TranslateFilePath(_In_ const std::wstring& inFileName, _Out_ std::wstring&
     }
 }
 
-// Some perform file accesses, which don't yet fall into any configurable file access manifest category.
-// These files now can be allowlisted, but there are already users deployed without the allowlisting feature
-// that rely on these file accesses not blocked.
-// These are some tools that use internal files or do some implicit directory creation, etc.
-// In this list the tools are the CCI based set of products, csc compiler, resource compiler, build.exe trace log, etc.
-// For such tools we allow file accesses on the special file patterns and report the access to BuildXL. BuildXL filters these
-// accesses, but makes sure that there are reports for these accesses if some of them are declared as outputs.
-bool GetSpecialCaseRulesForSpecialTools(
-    __in  PCWSTR absolutePath,
-    __in  size_t absolutePathLength,
-    __out FileAccessPolicy& policy)
+// The special-case rule that only applies to the files of one kind of tool (see GetSpecialCaseRulesForSpecialTools): whether the given
+// path is one of the files the tool accesses without declaring them.
+typedef bool (*SpecialToolFileRule)(PCWSTR absolutePath, size_t absolutePathLength);
+
+// Some tools emit temporary files into the same directory as the final output file.
+static bool LooksLikeToolTempFile(PCWSTR absolutePath, size_t absolutePathLength)
 {
-    assert(absolutePath);
-    assert(absolutePathLength == wcslen(absolutePath));
+    return HasSuffix(absolutePath, absolutePathLength, L".tmp");
+}
+
+// The native resource compiler (RC) emits temporary files into the same directory as the final output file.
+static bool LooksLikeRCTempFile(PCWSTR absolutePath, size_t absolutePathLength)
+{
+    return StringLooksLikeRCTempFile(absolutePath, absolutePathLength);
+}
 
-    switch (GetProcessKind())
+// The Mt tool emits temporary files into the same directory as the final output file.
+static bool LooksLikeMtTempFile(PCWSTR absolutePath, size_t absolutePathLength)
+{
+    return StringLooksLikeMtTempFile(absolutePath, absolutePathLength, L".tmp");
+}
+
+// The cc-line of tools like to find pdb files by using the pdb path embedded in a dll/exe.
+// If the dll/exe was built with different roots, then this results in somewhat random file accesses.
+static bool LooksLikePdbFile(PCWSTR absolutePath, size_t absolutePathLength)
+{
+    return HasSuffix(absolutePath, absolutePathLength, L".pdb");
+}
+
+// The rule of the kind of the current process, picked once by InitProcessKind; nullptr if the process gets no special treatment.
+static SpecialToolFileRule g_specialToolFileRule = nullptr;
+
+static SpecialToolFileRule GetSpecialToolFileRule(SpecialProcessKind kind)
+{
+    switch (kind)
     {
     case SpecialProcessKind::Csc:
     case SpecialProcessKind::Cvtres:
     case SpecialProcessKind::Resonexe:
-        // Some tools emit temporary files into the same directory
-        // as the final output file.
-        if (HasSuffix(absolutePath, absolutePathLength, L".tmp")) {
-#if SUPER_VERBOSE
-            Dbg(L"special case: temp file: %s", absolutePath);
-#endif // SUPER_VERBOSE
-            int intPolicy = (int)policy | (int)FileAccessPolicy_AllowAll;
-            policy = (FileAccessPolicy)intPolicy;
-            return true;
-        }
-        break;
+        return LooksLikeToolTempFile;
 
     case SpecialProcessKind::RC:
-        // The native resource compiler (RC) emits temporary files into the same
-        // directory as the final output file.
-        if (StringLooksLikeRCTempFile(absolutePath, absolutePathLength)) {
-#if SUPER_VERBOSE
-            Dbg(L"special case: temp file: %s", absolutePath);
-#endif // SUPER_VERBOSE
-            int intPolicy = (int)policy | (int)FileAccessPolicy_AllowAll;
-            policy = (FileAccessPolicy)intPolicy;
-            return true;
-        }
-        break;
+        return LooksLikeRCTempFile;
 
     case SpecialProcessKind::Mt:
-        // The Mt tool emits temporary files into the same directory as the final output file.
-        if (StringLooksLikeMtTempFile(absolutePath, absolutePathLength, L".tmp")) {
-#if SUPER_VERBOSE
-            Dbg(L"special case: temp file: %s", absolutePath);
-#endif // SUPER_VERBOSE
-            int intPolicy = (int)policy | (int)FileAccessPolicy_AllowAll;
-            policy = (FileAccessPolicy)intPolicy;
-            return true;
-        }
-        break;
+        return LooksLikeMtTempFile;
 
     case SpecialProcessKind::CCCheck:
     case SpecialProcessKind::CCDocGen:
     case SpecialProcessKind::CCRefGen:
     case SpecialProcessKind::CCRewrite:
-        // The cc-line of tools like to find pdb files by using the pdb path embedded in a dll/exe.
-        // If the dll/exe was built with different roots, then this results in somewhat random file accesses.
-        if (HasSuffix(absolutePath, absolutePathLength, L".pdb")) {
-#if SUPER_VERBOSE
-            Dbg(L"special case: pdb file: %s", absolutePath);
-#endif // SUPER_VERBOSE
-            int intPolicy = (int)policy | (int)FileAccessPolicy_AllowAll;
-            policy = (FileAccessPolicy)intPolicy;
-            return true;
-        }
-        break;
+        return LooksLikePdbFile;
 
     case SpecialProcessKind::WinDbg:
     case SpecialProcessKind::NotSpecial:
+    default:
         // no special treatment
-        break;
+        return nullptr;
+    }
+}
+
+// Some perform file accesses, which don't yet fall into any configurable file access manifest category.
+// These files now can be allowlisted, but there are already users deployed without the allowlisting feature
+// that rely on these file accesses not blocked.
+// These are some tools that use internal files or do some implicit directory creation, etc.
+// In this list the tools are the CCI based set of products, csc compiler, resource compiler, build.exe trace log, etc.
+// For such tools we allow file accesses on the special file patterns and report the access to BuildXL. BuildXL filters these
+// accesses, but makes sure that there are reports for these accesses if some of them are declared as outputs.
+// The rule of the tool is picked once (see InitProcessKind), so that the processes of other tools only check for the build.exe trace log.
+bool GetSpecialCaseRulesForSpecialTools(
+    __in  PCWSTR absolutePath,
+    __in  size_t absolutePathLength,
+    __out FileAccessPolicy& policy)
+{
+    assert(absolutePath);
+    assert(absolutePathLength == wcslen(absolutePath));
+
+    SpecialToolFileRule rule = g_specialToolFileRule;
+    if (rule != nullptr && rule(absolutePath, absolutePathLength)) {
+#if SUPER_VERBOSE
+        Dbg(L"special case: tool file: %s", absolutePath);
+#endif // SUPER_VERBOSE
+        int intPolicy = (int)policy | (int)FileAccessPolicy_AllowAll;
+        policy = (FileAccessPolicy)intPolicy;
+        return true;
     }
 
     // build.exe and tracelog.dll capture dependency information in temporary files in the object root called _buildc_dep_out.<pass#>
@@ -402,6 +379,15 @@ bool LocateFileAccessManifest(
     manifest = NULL;
     manifestSize = 0;
 
+    // Unless the address was taken in this process, the injector put the payload at the preferred address
+    DWORD preferredPayloadSize;
+    const void* preferredPayload = DetourFindPayloadAt(DETOURS_PREFERRED_PAYLOAD_ADDRESS, __uuidof(IDetourServicesManifest), &preferredPayloadSize);
+    if (preferredPayload != NULL) {
+        manifest = preferredPayload;
+        manifestSize = preferredPayloadSize;
+        return true;
+    }
+
     HMODULE previousModule = NULL;
     for (;;) {
         HMODULE currentModule = DetourEnumerateModules(previousModule);
@@ -439,7 +425,7 @@ inline void VerifyManifestTree(PCManifestRecord const record)
     record->AssertValid();
 
     // loop through every item on every level recursively and verify tags are correct
-    ManifestRecord::BucketCountType numBuckets = record->BucketCount;
+    ManifestRecord::BucketCountType numBuckets = record->GetBucketCount();
     for (ManifestRecord::BucketCountType i = 0; i < numBuckets; i++)
     {
         PCManifestRecord child = record->GetChildRecord(i);
@@ -642,7 +628,8 @@ static void LoadSubstituteProcessExecutionPluginDll()
 
 bool ParseFileAccessManifest(
     const void* payload,
-    DWORD)
+    DWORD,
+    bool reportProcessImageAccess)
 {
     if (g_manifestPtr != nullptr) {
         // Fail if the pointer is not null. We are loading the Dll, so we could have not loaded this yet.
@@ -680,9 +667,10 @@ bool ParseFileAccessManifest(
     assert(payloadSize > 0);
     assert(payloadBytes != nullptr);
 
-    g_manifestPtr = VirtualAlloc(nullptr, payloadSize, MEM_COMMIT, PAGE_READWRITE);
+    // The manifest is used in place (see DetouredProcessInjector::Init): it is not copied, only protected against writes.
+    g_manifestPtr = const_cast<byte*>(payloadBytes);
     g_manifestSizePtr = (PDWORD)VirtualAlloc(nullptr, sizeof(DWORD), MEM_COMMIT, PAGE_READWRITE);
-    if (g_manifestPtr == nullptr || g_manifestSizePtr == nullptr)
+    if (g_manifestSizePtr == nullptr)
     {
         // Error allocating memory.
         wprintf(L"Error allocating virtual memory.");
@@ -691,15 +679,6 @@ bool ParseFileAccessManifest(
         return false;
     }
 
-    if (memcpy_s(g_manifestPtr, payloadSize, payloadBytes, payloadSize))
-    {
-        // Could't copy the payload.
-        wprintf(L"Error copying payload to virtual memory.");
-        fwprintf(stderr, L"Error copying payload to virtual memory");
-        HandleDetoursInjectionAndCommunicationErrors(DETOURS_PAYLOAD_PARSE_FAILED_11, L"Error copying payload to virtual memory: exit(-53).", DETOURS_WINDOWS_LOG_MESSAGE_11);
-        return false;
-    }
-
     *g_manifestSizePtr = payloadSize;
 
     DWORD oldProtection = 0;
@@ -807,6 +786,7 @@ bool ParseFileAccessManifest(
 
         if (!translateFrom.empty() && !translateTo.empty())
         {
+            g_pManifestTranslatePathTrie->Insert(translateFrom, g_pManifestTranslatePathTuples->size());
             g_pManifestTranslatePathTuples->push_back(new TranslatePathTuple(translateFrom, translateTo));
 
             if (translateFrom.back() == L'\\')
@@ -901,7 +881,7 @@ bool ParseFileAccessManifest(
         }
         else {
             // NOTE: This calls the real CreateFileW(), not our detoured version, because we have not yet installed
-            // our detoured functions.
+            // our detoured functions (or, when the process is retargeted, they are disabled on this thread).
             g_reportFileHandle = CreateFileW(
                 report->Report.ReportPath,
                 FILE_WRITE_ACCESS,
@@ -960,16 +940,19 @@ bool ParseFileAccessManifest(
         SkipWriteCharsString(payloadBytes, offset);  // Skip 64-bit path.
 #endif
         uint32_t numProcessMatches = ParseUint32(payloadBytes, offset);
-        g_pShimProcessMatches = new vector<ShimProcessMatch*>();
+        g_pShimProcessMatchTable = new ShimProcessMatchTable();
         for (uint32_t i = 0; i < numProcessMatches; i++)
         {
-            wchar_t *processName = CreateStringFromWriteChars(payloadBytes, offset);
-            wchar_t *argumentMatch = CreateStringFromWriteChars(payloadBytes, offset);
-            g_pShimProcessMatches->push_back(new ShimProcessMatch(processName, argumentMatch));
+            std::wstring processName;
+            std::wstring argumentMatch;
+            AppendStringFromWriteChars(payloadBytes, offset, processName);
+            AppendStringFromWriteChars(payloadBytes, offset, argumentMatch);
+            g_pShimProcessMatchTable->Add(processName, argumentMatch);
         }
     }
 
-    if (g_SubstituteProcessExecutionPluginDllPath != nullptr)
+    // A retargeted process keeps the plugin of its first manifest: loading a DLL at a quiescent point could deadlock (see ManifestRetarget.cpp)
+    if (g_SubstituteProcessExecutionPluginDllPath != nullptr && g_SubstituteProcessExecutionPluginDllHandle == nullptr)
     {
         LoadSubstituteProcessExecutionPluginDll();
     }
@@ -977,10 +960,17 @@ bool ParseFileAccessManifest(
     g_manifestTreeRoot = reinterpret_cast<PCManifestRecord>(&payloadBytes[offset]);
     VerifyManifestRoot(g_manifestTreeRoot);
 
-    //
-    // Try to read module file and check permissions.
-    //
+    if (reportProcessImageAccess)
+    {
+        ReportProcessImageAccess();
+    }
 
+    return true;
+}
+
+void ReportProcessImageAccess()
+{
+    // Try to read module file and check permissions.
     WCHAR wszFileName[MAX_PATH];
     DWORD nFileName = GetModuleFileNameW(NULL, wszFileName, MAX_PATH);
     if (nFileName == 0 || nFileName == MAX_PATH) {
@@ -999,7 +989,7 @@ bool ParseFileAccessManifest(
             AccessCheckResult(RequestedAccess::None, ResultAction::Deny, ReportLevel::Report),
             GetLastError(),
             -1);
-        return true;
+        return;
     }
 
     FileOperationContext fileOperationContext = FileOperationContext::CreateForRead(L"Process", wszFileName);
@@ -1007,7 +997,7 @@ bool ParseFileAccessManifest(
     PolicyResult policyResult;
     if (!policyResult.Initialize(wszFileName)) {
         policyResult.ReportIndeterminatePolicyAndSetLastError(fileOperationContext);
-        return true;
+        return;
     }
 
     FileReadContext fileReadContext;
@@ -1023,8 +1013,58 @@ bool ParseFileAccessManifest(
         readCheck,
         ERROR_SUCCESS, // No interesting error code to observe or return to anyone.
         -1);
+}
 
-    return true;
+void ReleaseFileAccessManifest()
+{
+    // The report pipe is owned by the injector, only a report file is opened by ParseFileAccessManifest
+    if (g_reportFileHandle != NULL && g_reportFileHandle != INVALID_HANDLE_VALUE && g_reportFileHandle != g_pDetouredProcessInjector->ReportPipe())
+    {
+        CloseHandle(g_reportFileHandle);
+    }
+
+    g_reportFileHandle = NULL;
+
+    if (g_messageCountSemaphore != nullptr && g_messageCountSemaphore != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(g_messageCountSemaphore);
+    }
+
+    g_messageCountSemaphore = INVALID_HANDLE_VALUE;
+
+    g_processNamesToBreakAwayFromJob->clear();
+    for (TranslatePathTuple* tuple : *g_pManifestTranslatePathTuples)
+    {
+        delete tuple;
+    }
+
+    g_pManifestTranslatePathTuples->clear();
+    delete g_pManifestTranslatePathTrie;
+    g_pManifestTranslatePathTrie = new TranslatePathTrie();
+    g_pManifestTranslatePathLookupTable->clear();
+
+    delete[] g_internalDetoursErrorNotificationFile;
+    g_internalDetoursErrorNotificationFile = nullptr;
+    delete[] g_SubstituteProcessExecutionShimPath;
+    g_SubstituteProcessExecutionShimPath = nullptr;
+    delete[] g_SubstituteProcessExecutionPluginDllPath;
+    g_SubstituteProcessExecutionPluginDllPath = nullptr;
+    delete g_pShimProcessMatchTable;
+    g_pShimProcessMatchTable = nullptr;
+    g_ProcessExecutionShimAllProcesses = false;
+
+    g_manifestTreeRoot = nullptr;
+    g_manifestChildProcessesToBreakAwayFromJob = nullptr;
+    g_manifestTranslatePathsStrings = nullptr;
+    g_manifestInternalDetoursErrorNotificationFileString = nullptr;
+
+    // The manifest itself lives in the payload, which belongs to whoever located it
+    VirtualFree(g_manifestSizePtr, 0, MEM_RELEASE);
+    g_manifestSizePtr = nullptr;
+    g_manifestPtr = nullptr;
+
+    // Closes the report pipe and the other handles of the manifest
+    g_pDetouredProcessInjector->Reset();
 }
 
 bool LocateAndParseFileAccessManifest()
@@ -1075,6 +1115,7 @@ void InitProcessKind()
     for (size_t i = 0; i < count; i++) {
         if (HasSuffix(wszFileName, nFileName, pairs[i].Name)) {
             g_ProcessKind = pairs[i].Kind;
+            g_specialToolFileRule = GetSpecialToolFileRule(pairs[i].Kind);
             return;
         }
     }
@@ -1085,6 +1126,29 @@ void ReportIfNeeded(AccessCheckResult const& checkResult, FileOperationContext c
         return;
     }
 
+    ReportedAccessCache* reportedAccesses = GetGlobalReportedAccessCache();
+    SharedReportedAccessCache* sharedReportedAccesses = GetGlobalSharedReportedAccessCache();
+    if ((reportedAccesses != nullptr || sharedReportedAccesses != nullptr)
+        && checkResult.GetFileAccessStatus() == FileAccessStatus::FileAccessStatus_Allowed
+        && !policyResult.IsIndeterminate()
+        && usn == -1
+        && (checkResult.Access != RequestedAccess::Enumerate || filter == nullptr || *filter == L'\0')) {
+        // Denied accesses, and accesses whose report carries more than the path and the requested access, are always reported.
+        // The accesses of the process itself are looked up first, which does not touch memory shared with the other processes of the pip.
+        CanonicalizedPath const& path = policyResult.GetCanonicalizedPath();
+        bool succeeded = error == ERROR_SUCCESS;
+        bool explicitReport = checkResult.Level == ReportLevel::ReportExplicit;
+        if (reportedAccesses != nullptr
+            && reportedAccesses->CheckAndUpdate(path.GetPathString(), path.Length(), checkResult.Access, succeeded, explicitReport)) {
+            return;
+        }
+
+        if (sharedReportedAccesses != nullptr
+            && sharedReportedAccesses->CheckAndUpdate(path.GetPathString(), path.Length(), checkResult.Access, succeeded, explicitReport)) {
+            return;
+        }
+    }
+
     if (checkResult.ShouldDenyAccess()) {
         // Although policyResult may have contained the translated path, TranslateFilePath is called again for debugging purpose.
         std::wstring outFile;
@@ -1266,10 +1330,44 @@ static CanonicalizedPath GetCanonicalizedApplicationPath(_In_ LPCWSTR lpApplicat
     // to find the full path. We cannot rely on GetFullPathNameW (as in CanonicalizedPath) because
     // GetFullPathNameW will simply prepend the file name with the current directory, which result in
     // a non-existent path for executables like "cmd.exe".
+    ImagePathCache* imagePathCache = GetGlobalImagePathCache();
+    std::wstring applicationName;
+    std::wstring currentDirectory;
+    uint64_t environmentPathHash = 0;
+    LONG generation = 0;
+
+    if (imagePathCache != nullptr && ImagePathCache::GetSearchContext(currentDirectory, environmentPathHash))
+    {
+        applicationName.assign(lpApplicationName);
+
+        CanonicalizedPath cachedPath;
+        bool hit = imagePathCache->TryGet(applicationName, currentDirectory, environmentPathHash, cachedPath);
+        TraceCacheLookup("ImagePaths", hit);
+        if (hit)
+        {
+            return cachedPath;
+        }
+
+        generation = imagePathCache->BeginSearch(applicationName);
+    }
+    else
+    {
+        imagePathCache = nullptr;
+    }
+
     std::wstring applicationPath;
-    return SearchFullPath(nullptr, lpApplicationName, L".exe", applicationPath) != ERROR_SUCCESS
-        ? CanonicalizedPath()
-        : CanonicalizedPath::Canonicalize(applicationPath.c_str());;
+    if (SearchFullPath(nullptr, lpApplicationName, L".exe", applicationPath) != ERROR_SUCCESS)
+    {
+        return CanonicalizedPath();
+    }
+
+    CanonicalizedPath imagePath = CanonicalizedPath::Canonicalize(applicationPath.c_str());
+    if (imagePathCache != nullptr && !imagePath.IsNull())
+    {
+        imagePathCache->Add(applicationName, currentDirectory, environmentPathHash, imagePath, generation);
+    }
+
+    return imagePath;
 }
 
 CanonicalizedPath GetImagePath(_In_opt_ LPCWSTR lpApplicationName, _In_opt_ LPWSTR lpCommandLine)
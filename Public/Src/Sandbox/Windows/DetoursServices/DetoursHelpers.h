@@ -33,6 +33,11 @@
 #define DETOURS_ADD_TO_SILO_ERROR_20                -62
 #define DETOURS_CREATE_PROCESS_ATTRIBUTE_LIST_21    -63
 
+// Where DetouredProcessInjector asks for the payload image to be in the processes it injects, so that they
+// find it without walking their address space (see LocateFileAccessManifest). The address is low enough for
+// 32-bit processes, and is only a preference: when it is taken, the image goes wherever the system puts it.
+#define DETOURS_PREFERRED_PAYLOAD_ADDRESS ((PVOID)(ULONG_PTR)0x20000000)
+
 #define DETOURS_WINDOWS_LOG_MESSAGE_1  L"DominoDetoursService:1"
 #define DETOURS_WINDOWS_LOG_MESSAGE_2  L"DominoDetoursService:2"
 #define DETOURS_WINDOWS_LOG_MESSAGE_3  L"DominoDetoursService:3"
@@ -96,9 +101,18 @@ bool LocateFileAccessManifest(
     __out const void*& manifest,
     __out DWORD& manifestSize);
 
+// Parses the manifest into the globals. The access to the image of the process is reported unless reportProcessImageAccess is false,
+// in which case the caller has to call ReportProcessImageAccess.
 bool ParseFileAccessManifest(
     const void* payload,
-    DWORD payloadSize);
+    DWORD payloadSize,
+    bool reportProcessImageAccess = true);
+
+void ReportProcessImageAccess();
+
+// Undoes ParseFileAccessManifest, so that another manifest can be parsed (see ManifestRetarget.h).
+// Only safe when no thread is in a detoured function.
+void ReleaseFileAccessManifest();
 
 bool LocateAndParseFileAccessManifest();
 
@@ -16,6 +16,7 @@
 #include <crtdbg.h>
 
 #include "DataTypes.h"
+#include "DebugMessageRing.h"
 #include "DebuggingHelpers.h"
 #include "DetouredFunctions.h"
 #include "DetouredFunctionTypes.h"
@@ -25,12 +26,24 @@
 #include "globals.h"
 #include "buildXL_mem.h"
 #include "DetouredScope.h"
+#include "DetourStatistics.h"
+#include "DetoursTracing.h"
 #include "StringOperations.h"
 #include "HandleOverlay.h"
 #include "DetouredProcessInjector.h"
 #include "SendReport.h"
 #include <Psapi.h>
+#include <TlHelp32.h>
 #include "FilesCheckedForAccess.h"
+#include "ReportedAccessCache.h"
+#include "ProbeCache.h"
+#include "ImagePathCache.h"
+#include "DosDeviceTable.h"
+#include "ManifestRetarget.h"
+#include "ReportRing.h"
+#include "ReportStringTable.h"
+#include "SharedReparsePointCache.h"
+#include "TranslatePathTrie.h"
 #include "locale.h"
 
 #define BUILDXL_DETOURS_CREATE_PROCESS_RETRY_COUNT 5
@@ -77,11 +90,10 @@ volatile LONG g_msTimeInAddClosedList = 0;
 volatile LONG g_msTimeInRemoveClosedList = 0;
 #endif // #if MEASURE_DETOURED_NT_CLOSE_IMPACT
 
-#if MEASURE_REPARSEPOINT_RESOLVING_IMPACT
-volatile ULONGLONG g_shouldResolveReparsePointCacheHitCount;
-volatile ULONGLONG g_reparsePointTargetCacheHitCount;
-volatile ULONGLONG g_resolvedPathsCacheHitCout;
-#endif // MEASURE_REPARSEPOINT_RESOLVING_IMPACT
+PathCacheStatistics g_pathCacheStatistics[PATH_CACHE_STATISTICS_STRIPES];
+
+DetourStatistics g_detourStatistics[DETOUR_STATISTICS_STRIPES];
+__declspec(thread) DetourStatisticsScope* DetourStatisticsScope::gt_current = nullptr;
 
 
 extern "C" {
@@ -232,6 +244,7 @@ PManifestChildProcessesToBreakAwayFromJob g_manifestChildProcessesToBreakAwayFro
 unordered_set<std::wstring, CaseInsensitiveStringHasher, CaseInsensitiveStringComparer>* g_processNamesToBreakAwayFromJob = nullptr;
 PManifestTranslatePathsStrings g_manifestTranslatePathsStrings;
 vector<TranslatePathTuple*>* g_pManifestTranslatePathTuples = nullptr;
+TranslatePathTrie* g_pManifestTranslatePathTrie = nullptr;
 unordered_set<std::wstring>* g_pManifestTranslatePathLookupTable = nullptr;
 
 PManifestInternalDetoursErrorNotificationFileString g_manifestInternalDetoursErrorNotificationFileString;
@@ -273,7 +286,7 @@ bool g_ProcessExecutionShimAllProcesses;
 wchar_t* g_SubstituteProcessExecutionPluginDllPath = nullptr;
 HMODULE g_SubstituteProcessExecutionPluginDllHandle;
 SubstituteProcessExecutionPluginFunc g_SubstituteProcessExecutionPluginFunc;
-vector<ShimProcessMatch*>* g_pShimProcessMatches = nullptr;
+ShimProcessMatchTable* g_pShimProcessMatchTable = nullptr;
 
 //
 // Real Windows API function pointers
@@ -290,6 +303,7 @@ VirtualAlloc_t Real_VirtualAlloc;
 
 CreateFileA_t Real_CreateFileA;
 GetVolumePathNameW_t Real_GetVolumePathNameW;
+DefineDosDeviceW_t Real_DefineDosDeviceW;
 GetFileAttributesA_t Real_GetFileAttributesA;
 GetFileAttributesW_t Real_GetFileAttributesW;
 GetFileAttributesExW_t Real_GetFileAttributesExW;
@@ -1006,6 +1020,11 @@ static int __cdecl CrtDebugHook(int nReportType, wchar_t* szMsg, int* pnRet) {
 
 static bool DllProcessDetach()
 {
+    if (CollectDetourStatistics())
+    {
+        ReportDetourStatistics();
+    }
+
     if (ShouldLogProcessData())
     {
         FILETIME creationTime;
@@ -1019,12 +1038,14 @@ static bool DllProcessDetach()
         if (GetProcessIoCounters(currentProcess, &counters) == 0)
         {
             Dbg(L"DllProcessDetach failed GetProcessIoConters with GLE=%d.", GetLastError());
+            FlushReportBatch(/* processDetaching */ true);
             return TRUE;
         }
 
         if (GetProcessTimes(currentProcess, &creationTime, &exitTime, &kernelTime, &userTime) == 0)
         {
             Dbg(L"DllProcessDetach failed GetProcessTimes with GLE=%d.", GetLastError());
+            FlushReportBatch(/* processDetaching */ true);
             return TRUE;
         }
 
@@ -1040,9 +1061,12 @@ static bool DllProcessDetach()
         // report in BuildXL to reduce the time difference between the time the report
         // is generated, and handling of the report message.
         GetSystemTimeAsFileTime(&exitTime);
+        PublishSlabAllocatorCounters();
         ReportProcessData(counters, creationTime, exitTime, kernelTime, userTime, exitCode, g_parentProcessId, (LONG64)g_detoursMaxAllocatedMemoryInBytes);
     }
 
+    FlushReportBatch(/* processDetaching */ true);
+
 #if MEASURE_DETOURED_NT_CLOSE_IMPACT    
     // Do some statistical information logging for different measurements
     Dbg(L"Populate NtClose pool list entries time: %d ms.", g_msTimeToPopulatePoolList);
@@ -1054,12 +1078,22 @@ static bool DllProcessDetach()
 #endif // MEASURE_DETOURED_NT_CLOSE_IMPACT
 
 #if MEASURE_REPARSEPOINT_RESOLVING_IMPACT
+    LONG64 shouldResolveReparsePointCacheHitCount = 0;
+    LONG64 reparsePointTargetCacheHitCount = 0;
+    LONG64 resolvedPathsCacheHitCount = 0;
+    for (size_t i = 0; i < PATH_CACHE_STATISTICS_STRIPES; i++)
+    {
+        shouldResolveReparsePointCacheHitCount += g_pathCacheStatistics[i].ShouldResolveReparsePointCacheHitCount;
+        reparsePointTargetCacheHitCount += g_pathCacheStatistics[i].ReparsePointTargetCacheHitCount;
+        resolvedPathsCacheHitCount += g_pathCacheStatistics[i].ResolvedPathsCacheHitCount;
+    }
+
     if (!IgnoreFullReparsePointResolving())
     {
-        Dbg(L"Intial resolver result cache hit count for PID(%d) and PPID(%d): %ld", g_shouldResolveReparsePointCacheHitCount, g_currentProcessId, g_parentProcessId);
+        Dbg(L"Intial resolver result cache hit count for PID(%d) and PPID(%d): %I64d", g_currentProcessId, g_parentProcessId, shouldResolveReparsePointCacheHitCount);
     }
-    Dbg(L"ReparsePoint target resolver cache hit count for PID(%d) and PPID(%d): %ld", g_reparsePointTargetCacheHitCount, g_currentProcessId, g_parentProcessId);
-    Dbg(L"Resolved paths cache hit count for PID(%d) and PPID(%d): %ld", g_resolvedPathsCacheHitCout, g_currentProcessId, g_parentProcessId);
+    Dbg(L"ReparsePoint target resolver cache hit count for PID(%d) and PPID(%d): %I64d", g_currentProcessId, g_parentProcessId, reparsePointTargetCacheHitCount);
+    Dbg(L"Resolved paths cache hit count for PID(%d) and PPID(%d): %I64d", g_currentProcessId, g_parentProcessId, resolvedPathsCacheHitCount);
 #endif // MEASURE_REPARSEPOINT_RESOLVING_IMPACT
 
     return TRUE;
@@ -1078,6 +1112,11 @@ static bool DllProcessDetach()
         delete g_pManifestTranslatePathTuples;
     }
 
+    if (g_pManifestTranslatePathTrie != nullptr)
+    {
+        delete g_pManifestTranslatePathTrie;
+    }
+
     if (g_pManifestTranslatePathLookupTable != nullptr)
     {
         delete g_pManifestTranslatePathLookupTable;
@@ -1090,6 +1129,7 @@ static bool DllProcessDetach()
 
     if (g_hPrivateHeap != nullptr)
     {
+        ShutdownSlabAllocator();
         HeapDestroy(g_hPrivateHeap);
     }
 
@@ -1134,6 +1174,119 @@ then the process cannot execute with the desired behavior (of enforcing file acc
 // Flipped to true when DllProcessAttach has completed for the Detouring case.
 bool g_isAttached = false;
 
+// Detoured functions almost no tool calls, which DllProcessAttach leaves to AttachColdDetours when DeferColdDetours is set.
+#define FOR_ALL_COLD_DETOURS(m) \
+    m(DecryptFileW)             \
+    m(DecryptFileA)             \
+    m(EncryptFileW)             \
+    m(EncryptFileA)             \
+    m(OpenEncryptedFileRawW)    \
+    m(OpenEncryptedFileRawA)    \
+    m(OpenFileById)
+
+// Cold detoured functions that are not detoured at all with minimal detours (see MinimalDetours).
+#define FOR_ALL_COLD_NON_MINIMAL_DETOURS(m) \
+    m(ReplaceFileW)                         \
+    m(ReplaceFileA)                         \
+    m(OpenFileMappingW)                     \
+    m(OpenFileMappingA)                     \
+    m(GetTempFileNameW)                     \
+    m(GetTempFileNameA)
+
+// Attaches the cold detours (see DeferColdDetours) from a background thread once the process runs.
+//
+// Unlike in DllProcessAttach, other threads may be running, so they are suspended for the transaction (DetourUpdateThread
+// moves those that are in the middle of a patched prologue); the heaps are locked first, so that no thread is suspended
+// while holding a heap lock the transaction needs (Detours allocates its operations while the threads are suspended).
+static DWORD WINAPI AttachColdDetours(LPVOID lpParam)
+{
+    UNREFERENCED_PARAMETER(lpParam);
+
+    DWORD const currentProcessId = GetCurrentProcessId();
+    DWORD const currentThreadId = GetCurrentThreadId();
+    vector<HANDLE> threads;
+
+    HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, 0);
+    if (snapshot == INVALID_HANDLE_VALUE)
+    {
+        Dbg(L"AttachColdDetours: CreateToolhelp32Snapshot failed with GLE=%d.", GetLastError());
+        return 1;
+    }
+
+    THREADENTRY32 entry;
+    entry.dwSize = sizeof(entry);
+    for (BOOL more = Thread32First(snapshot, &entry); more; more = Thread32Next(snapshot, &entry))
+    {
+        if (entry.th32OwnerProcessID == currentProcessId && entry.th32ThreadID != currentThreadId)
+        {
+            HANDLE thread = OpenThread(THREAD_SUSPEND_RESUME | THREAD_GET_CONTEXT | THREAD_SET_CONTEXT, FALSE, entry.th32ThreadID);
+            if (thread != nullptr)
+            {
+                threads.push_back(thread);
+            }
+        }
+    }
+
+    CloseHandle(snapshot);
+
+#define ATTACH_COLD(Name) \
+    if (error == NO_ERROR) { \
+        Real_##Name = ::Name; \
+        error = DetourAttach((PVOID*)&Real_##Name, Detoured_##Name); \
+    }
+#define ATTACH_COLD_UNLESS_MINIMAL(Name) \
+    if (!minimalDetours) { \
+        ATTACH_COLD(Name); \
+    }
+// end #define ATTACH_COLD
+
+    bool minimalDetours = MinimalDetours();
+    HANDLE processHeap = GetProcessHeap();
+    HeapLock(g_hPrivateHeap);
+    HeapLock(processHeap);
+
+    LONG error = DetourTransactionBegin();
+    for (HANDLE thread : threads)
+    {
+        if (error == NO_ERROR)
+        {
+            error = DetourUpdateThread(thread);
+        }
+    }
+
+#pragma warning( push )
+#pragma warning( disable : 5039)
+    FOR_ALL_COLD_DETOURS(ATTACH_COLD)
+    FOR_ALL_COLD_NON_MINIMAL_DETOURS(ATTACH_COLD_UNLESS_MINIMAL)
+#pragma warning( pop )
+
+    error = error == NO_ERROR ? DetourTransactionCommit() : error;
+    if (error != NO_ERROR)
+    {
+        DetourTransactionAbort();
+    }
+
+    HeapUnlock(processHeap);
+    HeapUnlock(g_hPrivateHeap);
+
+#undef ATTACH_COLD_UNLESS_MINIMAL
+#undef ATTACH_COLD
+
+    for (HANDLE thread : threads)
+    {
+        CloseHandle(thread);
+    }
+
+    if (error != NO_ERROR)
+    {
+        // The functions are not detoured, so their accesses are only seen by the detours of the Nt functions they call (if any).
+        Dbg(L"AttachColdDetours: the cold detours could not be attached. Error: %d", (int)error);
+        return 1;
+    }
+
+    return 0;
+}
+
 static bool DllProcessAttach()
 {
 #if MEASURE_DETOURED_NT_CLOSE_IMPACT
@@ -1156,6 +1309,7 @@ static bool DllProcessAttach()
 
     g_processNamesToBreakAwayFromJob = new unordered_set<std::wstring, CaseInsensitiveStringHasher, CaseInsensitiveStringComparer>();
     g_pManifestTranslatePathTuples = new vector<TranslatePathTuple*>();
+    g_pManifestTranslatePathTrie = new TranslatePathTrie();
     g_pManifestTranslatePathLookupTable = new unordered_set<std::wstring>();
     g_pDetouredProcessInjector = new DetouredProcessInjector(g_manifestGuid);
 
@@ -1177,6 +1331,15 @@ static bool DllProcessAttach()
     InitProcessKind();
     InitializeHandleOverlay();
     InitializeFilesCheckedForWriteAccesses();
+    InitializeReportedDirectoryEnumerations();
+    InitializeReportStringTable();
+    InitializeReportRing();
+    InitializeDebugMessageRing();
+    InitializeSharedReparsePointCache();
+    InitializeReportedAccessCache();
+    InitializeProbeCache();
+    InitializeImagePathCache();
+    InitializeDosDeviceTable();
 
     // If there are configured processes that will break away from the sandbox, expose
     // an environment variable with the handle pointer to the detour manifest.
@@ -1200,7 +1363,45 @@ static bool DllProcessAttach()
     }
 // end #define ATTACH
 
+// Functions whose accesses are all checked by the detours of the Nt functions they call (see MinimalDetours)
+#define ATTACH_UNLESS_MINIMAL(Name) \
+    if (minimalDetours) { \
+        Real_##Name = ::Name; \
+    } \
+    else { \
+        ATTACH(Name); \
+    }
+// end #define ATTACH_UNLESS_MINIMAL
+
+// Cold functions (see FOR_ALL_COLD_DETOURS) are detoured later, by AttachColdDetours, when DeferColdDetours is set
+#define ATTACH_COLD(Name) \
+    if (deferColdDetours) { \
+        Real_##Name = ::Name; \
+    } \
+    else { \
+        ATTACH(Name); \
+    }
+#define ATTACH_COLD_UNLESS_MINIMAL(Name) \
+    if (minimalDetours) { \
+        Real_##Name = ::Name; \
+    } \
+    else { \
+        ATTACH_COLD(Name); \
+    }
+// end #define ATTACH_COLD
+
     bool failed = false;
+    bool minimalDetours = MinimalDetours();
+    bool deferColdDetours = DeferColdDetours();
+
+    // Detoured functions have to be counted before the first one is entered (see ManifestRetarget.h)
+    if (AllowManifestRetarget())
+    {
+        DetouredScope::EnableQuiescence();
+    }
+
+    // Also used by the transaction that attaches the cold detours
+    DetourSetHotpatchAware(UseHotpatchDetours() ? TRUE : FALSE);
 
     error = DetourTransactionBegin();
     if (error != NO_ERROR) {
@@ -1217,10 +1418,18 @@ static bool DllProcessAttach()
         ATTACH(CreateProcessW);
 
         if (GetProcessKind() != SpecialProcessKind::WinDbg) {
-            ATTACH(CreateFileW);
-            ATTACH(CreateFileA);
+            if (NtCreateFileOnly()) {
+                // CreateFile ends up in NtCreateFile, whose detour does all the work (see NtCreateFileOnly)
+                Real_CreateFileW = ::CreateFileW;
+                Real_CreateFileA = ::CreateFileA;
+            }
+            else {
+                ATTACH(CreateFileW);
+                ATTACH(CreateFileA);
+            }
        
             ATTACH(GetVolumePathNameW);
+            ATTACH(DefineDosDeviceW);
             ATTACH(GetFileAttributesA);
             ATTACH(GetFileAttributesW);
             ATTACH(GetFileAttributesExW);
@@ -1228,25 +1437,27 @@ static bool DllProcessAttach()
 
             ATTACH(GetFileInformationByHandle);
             ATTACH(GetFileInformationByHandleEx);
-            ATTACH(SetFileInformationByHandle);
-
-            ATTACH(CopyFileW);
-            ATTACH(CopyFileA);
-            ATTACH(CopyFileExW);
-            ATTACH(CopyFileExA);
-            ATTACH(MoveFileW);
-            ATTACH(MoveFileA);
-            ATTACH(MoveFileExW);
-            ATTACH(MoveFileExA);
-            ATTACH(MoveFileWithProgressW);
-            ATTACH(MoveFileWithProgressA);
-            ATTACH(ReplaceFileW);
-            ATTACH(ReplaceFileA);
-            ATTACH(DeleteFileA);
-            ATTACH(DeleteFileW);
-
-            ATTACH(CreateHardLinkW);
-            ATTACH(CreateHardLinkA);
+            ATTACH_UNLESS_MINIMAL(SetFileInformationByHandle);
+
+            // Copies, moves, deletions and hard links come down to NtCreateFile and ZwSetInformationFile
+            ATTACH_UNLESS_MINIMAL(CopyFileW);
+            ATTACH_UNLESS_MINIMAL(CopyFileA);
+            ATTACH_UNLESS_MINIMAL(CopyFileExW);
+            ATTACH_UNLESS_MINIMAL(CopyFileExA);
+            ATTACH_UNLESS_MINIMAL(MoveFileW);
+            ATTACH_UNLESS_MINIMAL(MoveFileA);
+            ATTACH_UNLESS_MINIMAL(MoveFileExW);
+            ATTACH_UNLESS_MINIMAL(MoveFileExA);
+            ATTACH_UNLESS_MINIMAL(MoveFileWithProgressW);
+            ATTACH_UNLESS_MINIMAL(MoveFileWithProgressA);
+            ATTACH_UNLESS_MINIMAL(DeleteFileA);
+            ATTACH_UNLESS_MINIMAL(DeleteFileW);
+
+            ATTACH_UNLESS_MINIMAL(CreateHardLinkW);
+            ATTACH_UNLESS_MINIMAL(CreateHardLinkA);
+
+            // Always detoured: symbolic links are created through FSCTL_SET_REPARSE_POINT, and enumerations (NtQueryDirectoryFileEx),
+            // probes (NtQueryAttributesFile) and the encryption functions (EFS) do not go through the detoured Nt functions
             ATTACH(CreateSymbolicLinkW);
             ATTACH(CreateSymbolicLinkA);
             ATTACH(FindFirstFileW);
@@ -1256,26 +1467,18 @@ static bool DllProcessAttach()
             ATTACH(FindNextFileW);
             ATTACH(FindNextFileA);
             ATTACH(FindClose);
-            ATTACH(OpenFileMappingW);
-            ATTACH(OpenFileMappingA);
-            ATTACH(GetTempFileNameW);
-            ATTACH(GetTempFileNameA);
             ATTACH(CreateDirectoryW);
             ATTACH(CreateDirectoryA);
             ATTACH(CreateDirectoryExW);
             ATTACH(CreateDirectoryExA);
             ATTACH(RemoveDirectoryW);
             ATTACH(RemoveDirectoryA);
-            ATTACH(DecryptFileW);
-            ATTACH(DecryptFileA);
-            ATTACH(EncryptFileW);
-            ATTACH(EncryptFileA);
-            ATTACH(OpenEncryptedFileRawW);
-            ATTACH(OpenEncryptedFileRawA);
-            ATTACH(OpenFileById);
             ATTACH(GetFinalPathNameByHandleW);
             ATTACH(GetFinalPathNameByHandleA);
 
+            FOR_ALL_COLD_DETOURS(ATTACH_COLD)
+            FOR_ALL_COLD_NON_MINIMAL_DETOURS(ATTACH_COLD_UNLESS_MINIMAL)
+
             ATTACH(NtCreateFile);
             ATTACH(NtOpenFile);
             ATTACH(ZwCreateFile);
@@ -1319,8 +1522,30 @@ static bool DllProcessAttach()
         g_BreakOnAccessDenied = true;
     }
 
+#undef ATTACH_COLD_UNLESS_MINIMAL
+#undef ATTACH_COLD
+#undef ATTACH_UNLESS_MINIMAL
 #undef ATTACH
 
+    // The thread only starts running once DllMain returns (it waits for the loader lock)
+    if (deferColdDetours && !DisableDetours() && GetProcessKind() != SpecialProcessKind::WinDbg)
+    {
+        HANDLE coldDetoursThread = CreateThread(nullptr, 0, AttachColdDetours, nullptr, 0, nullptr);
+        if (coldDetoursThread == nullptr)
+        {
+            Dbg(L"Warning: Could not create the thread attaching the cold detours. GLE=%d", GetLastError());
+        }
+        else
+        {
+            CloseHandle(coldDetoursThread);
+        }
+    }
+
+    if (!DisableDetours())
+    {
+        InitializeManifestRetarget();
+    }
+
     g_isAttached = true;
 
     if (!IgnorePreloadedDlls())
@@ -1399,6 +1624,7 @@ static bool DllProcessAttach()
 
     g_processNamesToBreakAwayFromJob = new unordered_set<std::wstring, CaseInsensitiveStringHasher, CaseInsensitiveStringComparer>();
     g_pManifestTranslatePathTuples = new vector<TranslatePathTuple*>();
+    g_pManifestTranslatePathTrie = new TranslatePathTrie();
     g_pManifestTranslatePathLookupTable = new unordered_set<std::wstring>();
     g_pDetouredProcessInjector = new DetouredProcessInjector(g_manifestGuid);
 
@@ -1438,17 +1664,23 @@ _In_ PVOID reserved)
 {
     switch (reason) {
     case DLL_PROCESS_ATTACH:
+        RegisterDetoursTracing();
         if (DllProcessAttach()) {
             return TRUE;
         }
 #ifdef DETOURS_SERVICES_NATIVES_LIBRARY
         DebuggerOutputDebugString(L"DllProcessAttach() failed.\r\n", true);
 #endif // DETOURS_SERVICES_NATIVES_LIBRARY
+        UnregisterDetoursTracing();
         return FALSE;
 
     case DLL_PROCESS_DETACH:
-        if (DllProcessDetach()) {
-            return TRUE;
+        {
+            bool detached = DllProcessDetach();
+            UnregisterDetoursTracing();
+            if (detached) {
+                return TRUE;
+            }
         }
 #ifdef DETOURS_SERVICES_NATIVES_LIBRARY
 #if MEASURE_DETOURED_NT_CLOSE_IMPACT
@@ -0,0 +1,41 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "stdafx.h"
+
+#include "DetoursTracing.h"
+
+// CODESYNC: the GUID is the one ETW derives from the name (see DetoursTracing.h)
+TRACELOGGING_DEFINE_PROVIDER(
+    g_detoursTraceProvider,
+    "BuildXL.DetoursServices",
+    (0x80652929, 0xe74a, 0x59f5, 0x8d, 0xd5, 0x58, 0x4b, 0x86, 0xad, 0x65, 0x2d));
+
+static LONG64 g_detoursTraceQpcFrequency = 1;
+
+void RegisterDetoursTracing()
+{
+    LARGE_INTEGER frequency;
+    if (QueryPerformanceFrequency(&frequency) && frequency.QuadPart > 0)
+    {
+        g_detoursTraceQpcFrequency = frequency.QuadPart;
+    }
+
+    // Tracing is best effort: when registration fails, the provider is simply never enabled.
+    TraceLoggingRegister(g_detoursTraceProvider);
+}
+
+void UnregisterDetoursTracing()
+{
+    TraceLoggingUnregister(g_detoursTraceProvider);
+}
+
+ULONG64 DetoursTracingTicksToMicroseconds(LONG64 ticks)
+{
+    if (ticks <= 0)
+    {
+        return 0;
+    }
+
+    return (ticks / g_detoursTraceQpcFrequency) * 1000000 + (ticks % g_detoursTraceQpcFrequency) * 1000000 / g_detoursTraceQpcFrequency;
+}
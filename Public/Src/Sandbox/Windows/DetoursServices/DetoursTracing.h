@@ -0,0 +1,114 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <TraceLoggingProvider.h>
+#include <winmeta.h>
+
+// TraceLogging (ETW) events of DetoursServices, to attribute the cost of the sandbox on build machines (e.g., from a WPR trace)
+// without turning on Dbg logging or rebuilding. The provider is "BuildXL.DetoursServices" (whose GUID,
+// {80652929-E74A-59F5-8DD5-584B86AD652D}, is derived from the name, so sessions can enable it as "*BuildXL.DetoursServices");
+// each group of events has its own keyword, and all events are at the verbose level.
+//
+// The provider is registered for the lifetime of the DLL (see DllProcessAttach). When no session enables a keyword, emitting one
+// of its events is a single check of the enablement mask of the provider (TraceLoggingWrite evaluates nothing else).
+//
+// Unlike the rest of DetoursServices, the events are not sent to BuildXL: they are only seen by the ETW sessions.
+
+TRACELOGGING_DECLARE_PROVIDER(g_detoursTraceProvider);
+
+// DetourCall: one event per call of a detoured function (see DetourStatisticsScope), when it returns, with its inclusive
+// and exclusive (i.e., excluding the detoured functions it calls) durations. Very verbose.
+#define DETOURS_TRACE_KEYWORD_DETOURS   0x1ULL
+
+// CacheLookup: one event per lookup in the resolved path cache, the files checked for access and the handle overlays.
+#define DETOURS_TRACE_KEYWORD_CACHES    0x2ULL
+
+// ReportWrite: one event per write of report data to the report pipe (or ring), with its size and line count.
+#define DETOURS_TRACE_KEYWORD_REPORTS   0x4ULL
+
+// ProcessInjection: one event per child process DetouredProcessInjector injects, with the duration of the injection.
+#define DETOURS_TRACE_KEYWORD_INJECTION 0x8ULL
+
+// Registers / unregisters the provider; called once each, when the DLL is attached / detached.
+void RegisterDetoursTracing();
+void UnregisterDetoursTracing();
+
+// Converts QueryPerformanceCounter ticks to microseconds.
+ULONG64 DetoursTracingTicksToMicroseconds(LONG64 ticks);
+
+inline bool IsDetoursTracingEnabled(ULONGLONG keyword)
+{
+    return TraceLoggingProviderEnabled(g_detoursTraceProvider, WINEVENT_LEVEL_VERBOSE, keyword);
+}
+
+inline void TraceDetourCall(const char* function, LONG64 inclusiveTicks, LONG64 exclusiveTicks)
+{
+    DWORD error = GetLastError();
+    TraceLoggingWrite(
+        g_detoursTraceProvider,
+        "DetourCall",
+        TraceLoggingLevel(WINEVENT_LEVEL_VERBOSE),
+        TraceLoggingKeyword(DETOURS_TRACE_KEYWORD_DETOURS),
+        TraceLoggingString(function, "Function"),
+        TraceLoggingUInt64(DetoursTracingTicksToMicroseconds(inclusiveTicks), "InclusiveMicroseconds"),
+        TraceLoggingUInt64(DetoursTracingTicksToMicroseconds(exclusiveTicks), "ExclusiveMicroseconds"));
+    SetLastError(error);
+}
+
+inline void TraceCacheLookup(const char* cache, bool hit)
+{
+    if (!IsDetoursTracingEnabled(DETOURS_TRACE_KEYWORD_CACHES))
+    {
+        return;
+    }
+
+    DWORD error = GetLastError();
+    TraceLoggingWrite(
+        g_detoursTraceProvider,
+        "CacheLookup",
+        TraceLoggingLevel(WINEVENT_LEVEL_VERBOSE),
+        TraceLoggingKeyword(DETOURS_TRACE_KEYWORD_CACHES),
+        TraceLoggingString(cache, "Cache"),
+        TraceLoggingBool(hit, "Hit"));
+    SetLastError(error);
+}
+
+inline void TraceReportWrite(size_t bytes, LONG lines)
+{
+    if (!IsDetoursTracingEnabled(DETOURS_TRACE_KEYWORD_REPORTS))
+    {
+        return;
+    }
+
+    DWORD error = GetLastError();
+    TraceLoggingWrite(
+        g_detoursTraceProvider,
+        "ReportWrite",
+        TraceLoggingLevel(WINEVENT_LEVEL_VERBOSE),
+        TraceLoggingKeyword(DETOURS_TRACE_KEYWORD_REPORTS),
+        TraceLoggingUInt64((ULONG64)bytes, "Bytes"),
+        TraceLoggingInt32(lines, "Lines"));
+    SetLastError(error);
+}
+
+inline void TraceProcessInjection(DWORD processId, bool remote, DWORD result, LONG64 ticks)
+{
+    if (!IsDetoursTracingEnabled(DETOURS_TRACE_KEYWORD_INJECTION))
+    {
+        return;
+    }
+
+    DWORD error = GetLastError();
+    TraceLoggingWrite(
+        g_detoursTraceProvider,
+        "ProcessInjection",
+        TraceLoggingLevel(WINEVENT_LEVEL_VERBOSE),
+        TraceLoggingKeyword(DETOURS_TRACE_KEYWORD_INJECTION),
+        TraceLoggingUInt32(processId, "ProcessId"),
+        TraceLoggingBool(remote, "Remote"),
+        TraceLoggingUInt32(result, "Result"),
+        TraceLoggingUInt64(DetoursTracingTicksToMicroseconds(ticks), "Microseconds"));
+    SetLastError(error);
+}
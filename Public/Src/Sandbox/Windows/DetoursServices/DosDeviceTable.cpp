@@ -0,0 +1,183 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "DosDeviceTable.h"
+
+// If we are building this for tests, we don't want to use the builxl private heap that only exists when running under detours
+#ifndef TEST
+    #include "stdafx.h"
+    #include "buildXL_mem.h"
+    #include "DetouredScope.h"
+    #include "FileAccessHelpers.h"
+#endif
+
+#include <wchar.h>
+
+// The \Device\Mup is the device used for the UNC shares (see DeviceMap.cpp)
+static const wchar_t c_mupDeviceName[] = L"\\Device\\Mup\\";
+static const size_t c_mupDeviceNameLength = sizeof(c_mupDeviceName) / sizeof(wchar_t) - 1;
+static const wchar_t c_dosPathPrefix[] = L"\\\\?\\";
+static const wchar_t c_uncPathPrefix[] = L"\\\\?\\UNC\\";
+
+void DosDeviceTable::AddPrefix(wchar_t drive, const std::wstring& name)
+{
+    if (name.empty())
+    {
+        return;
+    }
+
+    for (Prefix& prefix : m_prefixes)
+    {
+        if (_wcsicmp(prefix.Name.c_str(), name.c_str()) == 0)
+        {
+            if (prefix.Drive != drive)
+            {
+                prefix.Drive = 0;
+            }
+
+            return;
+        }
+    }
+
+    m_prefixes.push_back({ name, drive });
+}
+
+void DosDeviceTable::AddDrive(wchar_t drive, const std::wstring& deviceName, const std::wstring& volumeName)
+{
+    AddPrefix(drive, deviceName);
+    AddPrefix(drive, volumeName);
+}
+
+bool DosDeviceTable::TryTranslate(const wchar_t* path, size_t pathLength, std::wstring& dosPath) const
+{
+    if (pathLength >= c_mupDeviceNameLength && _wcsnicmp(path, c_mupDeviceName, c_mupDeviceNameLength) == 0)
+    {
+        // Paths opened through a mapped drive have the redirector in their NT path (e.g. "\Device\Mup\;Z:0000000000001234\server\share"),
+        // which is dropped from their DOS path: leave those to the OS.
+        if (pathLength > c_mupDeviceNameLength && path[c_mupDeviceNameLength] == L';')
+        {
+            return false;
+        }
+
+        dosPath.assign(c_uncPathPrefix);
+        dosPath.append(path + c_mupDeviceNameLength, pathLength - c_mupDeviceNameLength);
+        return true;
+    }
+
+    for (const Prefix& prefix : m_prefixes)
+    {
+        size_t prefixLength = prefix.Name.length();
+        if (pathLength > prefixLength && path[prefixLength] == L'\\' && _wcsnicmp(path, prefix.Name.c_str(), prefixLength) == 0)
+        {
+            if (prefix.Drive == 0)
+            {
+                return false;
+            }
+
+            dosPath.assign(c_dosPathPrefix);
+            dosPath.push_back(prefix.Drive);
+            dosPath.push_back(L':');
+            dosPath.append(path + prefixLength, pathLength - prefixLength);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+#ifndef TEST
+static bool s_cacheDosDeviceNames = false;
+static const DosDeviceTable* volatile s_dosDeviceTable = NULL;
+static volatile LONG s_dosDeviceTableGeneration = 0;
+
+static DosDeviceTable* BuildDosDeviceTable()
+{
+    // The functions below are not called by the process: any file access they make must not be reported.
+    DetouredScope scope;
+
+    DosDeviceTable* table = new DosDeviceTable();
+    DWORD drives = GetLogicalDrives();
+    for (wchar_t drive = L'A'; drive <= L'Z'; drive++)
+    {
+        if ((drives & (1 << (drive - L'A'))) == 0)
+        {
+            continue;
+        }
+
+        wchar_t driveName[] = { drive, L':', L'\0' };
+        wchar_t rootPath[] = { drive, L':', L'\\', L'\0' };
+
+        // The paths of network drives are UNC paths
+        UINT driveType = GetDriveTypeW(rootPath);
+        if (driveType == DRIVE_REMOTE || driveType == DRIVE_NO_ROOT_DIR || driveType == DRIVE_UNKNOWN)
+        {
+            continue;
+        }
+
+        // Only drives that are volumes (and not, e.g., substituted directories) are added
+        wchar_t deviceName[MAX_PATH];
+        wchar_t volumeName[MAX_PATH];
+        if (QueryDosDeviceW(driveName, deviceName, MAX_PATH) == 0
+            || _wcsnicmp(deviceName, L"\\Device\\", 8) != 0
+            || !GetVolumeNameForVolumeMountPointW(rootPath, volumeName, MAX_PATH))
+        {
+            continue;
+        }
+
+        std::wstring volume(volumeName);
+        if (!volume.empty() && volume.back() == L'\\')
+        {
+            volume.pop_back();
+        }
+
+        table->AddDrive(drive, deviceName, volume);
+    }
+
+    return table;
+}
+
+void InitializeDosDeviceTable()
+{
+    s_cacheDosDeviceNames = CacheDosDeviceNames();
+}
+
+const DosDeviceTable* GetGlobalDosDeviceTable()
+{
+    if (!s_cacheDosDeviceNames)
+    {
+        return NULL;
+    }
+
+    const DosDeviceTable* table = s_dosDeviceTable;
+    if (table != NULL)
+    {
+        return table;
+    }
+
+    LONG generation = s_dosDeviceTableGeneration;
+    DosDeviceTable* built = BuildDosDeviceTable();
+    table = reinterpret_cast<const DosDeviceTable*>(InterlockedCompareExchangePointer((PVOID volatile*)&s_dosDeviceTable, built, NULL));
+    if (table != NULL)
+    {
+        // Another thread built it first
+        delete built;
+        return table;
+    }
+
+    if (s_dosDeviceTableGeneration != generation)
+    {
+        // The drives changed while the table was built: the next lookup builds it again
+        InvalidateDosDeviceTable();
+    }
+
+    return built;
+}
+
+void InvalidateDosDeviceTable()
+{
+    // The table that is dropped is not freed, since other threads may still be translating paths with it.
+    // The drives of a process hardly ever change.
+    InterlockedIncrement(&s_dosDeviceTableGeneration);
+    InterlockedExchangePointer((PVOID volatile*)&s_dosDeviceTable, NULL);
+}
+#endif // TEST
@@ -0,0 +1,51 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#define EXPORT __declspec( dllexport )
+
+#include <string>
+#include <vector>
+
+// The drive letters of the volumes of the process, by the NT device name (e.g. "\Device\HarddiskVolume3") and by the volume GUID name
+// (e.g. "\\?\Volume{...}") of each volume, so that a path that starts with either can be turned into the path GetFinalPathNameByHandle
+// returns with VOLUME_NAME_DOS without the query to the mount manager that it does for it, and UNC paths ("\Device\Mup\...")
+// into "\\?\UNC\..." paths.
+//
+// A volume with more than one drive letter is not translated, since which one the mount manager picks is not known, and neither are
+// volumes without a drive letter (e.g., the ones mounted in a directory): for those, the OS has to be asked.
+// This class is not thread safe for writing; translations can be done concurrently once all drives have been added.
+class DosDeviceTable {
+public:
+    // Adds a drive (e.g., L'C') with the NT device name of its volume and the volume GUID name of the volume (without a trailing backslash)
+    EXPORT void AddDrive(wchar_t drive, const std::wstring& deviceName, const std::wstring& volumeName);
+
+    // Translates a path that starts with the NT device name or the volume GUID name of a drive, followed by a backslash, or with "\Device\Mup\"
+    // into a "\\?\" path. Returns false (leaving dosPath unchanged) if the path does not start with any of them.
+    EXPORT bool TryTranslate(const wchar_t* path, size_t pathLength, std::wstring& dosPath) const;
+
+private:
+    struct Prefix {
+        std::wstring Name;
+
+        // 0 when the prefix is ambiguous
+        wchar_t Drive;
+    };
+
+    void AddPrefix(wchar_t drive, const std::wstring& name);
+
+    std::vector<Prefix> m_prefixes;
+};
+
+#ifndef TEST
+// Sets up the table of the process (if FileAccessManifestExtraFlag::CacheDosDeviceNames is set). Must be called after the manifest has been parsed.
+// The table itself is only built the first time it is needed.
+void InitializeDosDeviceTable();
+
+// Returns the table of the process, building it if needed, or NULL if DOS device names are not cached.
+const DosDeviceTable* GetGlobalDosDeviceTable();
+
+// Makes the next GetGlobalDosDeviceTable build the table again, e.g., when the process defines a DOS device.
+void InvalidateDosDeviceTable();
+#endif // TEST
@@ -337,6 +337,50 @@ inline bool Should##flag_name() { return Check##flag_name(g_fileAccessManifestFl
 
 FOR_ALL_FAM_FLAGS(GEN_CHECK_GLOBAL_FAM_FLAG)
 inline bool ReportAnyAccess(bool accessDenied) { return CheckReportAnyAccess(g_fileAccessManifestFlags, accessDenied); }
+inline bool BatchReports() { return CheckBatchReports(g_fileAccessManifestExtraFlags); }
+inline bool BinaryReports() { return CheckBinaryReports(g_fileAccessManifestExtraFlags); }
+inline bool UseReportRing() { return CheckReportRing(g_fileAccessManifestExtraFlags); }
+inline bool UseSharedReparsePointCache() { return CheckSharedReparsePointCache(g_fileAccessManifestExtraFlags); }
+inline bool ReportOncePerPathAndAccess() { return CheckReportOncePerPathAndAccess(g_fileAccessManifestExtraFlags); }
+inline bool CacheDosDeviceNames() { return CheckCacheDosDeviceNames(g_fileAccessManifestExtraFlags); }
+inline bool CollectDetourStatistics() { return CheckCollectDetourStatistics(g_fileAccessManifestExtraFlags); }
+
+// Only the Win32 functions whose accesses do not all go through a detoured Nt function are detoured (see DllProcessAttach);
+// only honored when NtCreateFile and the renames, links and deletions of ZwSetInformationFile are fully monitored.
+inline bool MinimalDetours()
+{
+    return CheckMinimalDetours(g_fileAccessManifestExtraFlags)
+        && MonitorNtCreateFile()
+        && !IgnoreZwRenameFileInformation()
+        && !IgnoreZwOtherFileInformation();
+}
+
+// CreateFileW/CreateFileA are not detoured, so that their accesses are checked (once) by Detoured_NtCreateFile;
+// only honored when NtCreateFile is fully monitored (otherwise some of its accesses would not be enforced).
+inline bool NtCreateFileOnly() { return (CheckNtCreateFileOnly(g_fileAccessManifestExtraFlags) && MonitorNtCreateFile()) || MinimalDetours(); }
+
+// The rarely called functions (see FOR_ALL_COLD_DETOURS) are detoured from a background thread rather than by DllProcessAttach.
+inline bool DeferColdDetours() { return CheckDeferColdDetours(g_fileAccessManifestExtraFlags); }
+
+// Probes whose policy was already checked and reported (see ProbeCache) are not checked again.
+inline bool CacheProbeResults() { return CheckCacheProbeResults(g_fileAccessManifestExtraFlags); }
+
+// The image paths found by searching the application names of created processes are remembered (see ImagePathCache).
+inline bool CacheImagePathSearches() { return CheckCacheImagePathSearches(g_fileAccessManifestExtraFlags); }
+
+// BuildXL may move the process to the manifest of another pip while it runs (see ManifestRetarget.h).
+inline bool AllowManifestRetarget() { return CheckAllowManifestRetarget(g_fileAccessManifestExtraFlags); }
+
+// The entries found by FindFirstFileEx/FindNextFile are summarized by one report per enumeration (see ReportDirectoryEnumerationSummary)
+// instead of being reported one by one, unless all accesses are to be reported.
+inline bool SummarizeDirectoryEnumerations() { return CheckSummarizeDirectoryEnumerations(g_fileAccessManifestExtraFlags) && !ReportAnyAccess(false); }
+
+// Hotpatchable functions are detoured through the padding before them (see DetourSetHotpatchAware).
+inline bool UseHotpatchDetours() { return CheckUseHotpatchDetours(g_fileAccessManifestExtraFlags); }
+
+// The processes of the pip share the accesses they reported (see SharedReportedAccessCache).
+inline bool UseSharedReportedAccesses() { return CheckSharedReportedAccesses(g_fileAccessManifestExtraFlags); }
+inline bool BufferDebugMessages() { return CheckBufferDebugMessages(g_fileAccessManifestExtraFlags); }
 
 inline LPCTSTR InternalDetoursErrorNotificationFile()
 {
@@ -2,31 +2,94 @@
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
 
 #include "FilesCheckedForAccess.h"
+#include "DetoursTracing.h"
 #include "string.h"
 
 FilesCheckedForAccess::FilesCheckedForAccess()
 {
-    InitializeCriticalSection(&m_lock);
+    for (Shard& shard : m_shards) {
+        InitializeSRWLock(&shard.Lock);
+    }
+
+    for (size_t i = 0; i < FILES_CHECKED_FOR_ACCESS_PUBLISHED_SLOTS; i++) {
+        m_published[i] = nullptr;
+    }
+}
+
+bool FilesCheckedForAccess::IsPublished(const wchar_t* path, size_t length, uint64_t hash) const {
+    for (uint64_t probe = 0; probe < FILES_CHECKED_FOR_ACCESS_MAX_PROBES; probe++) {
+        // Pairs with the interlocked operation that published the path, after it was constructed.
+        const std::wstring* published = (const std::wstring*)ReadPointerAcquire(
+            (PVOID const volatile*)&m_published[(hash + probe) & (FILES_CHECKED_FOR_ACCESS_PUBLISHED_SLOTS - 1)]);
+        if (published == nullptr) {
+            // Slots are filled in order and never emptied: the path would have been put here.
+            return false;
+        }
+
+        if (published->length() == length && CaseInsensitiveStringComparer::AreEqual(published->c_str(), path, length)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void FilesCheckedForAccess::Publish(const std::wstring* path, uint64_t hash) {
+    for (uint64_t probe = 0; probe < FILES_CHECKED_FOR_ACCESS_MAX_PROBES; probe++) {
+        PVOID volatile* slot = (PVOID volatile*)&m_published[(hash + probe) & (FILES_CHECKED_FOR_ACCESS_PUBLISHED_SLOTS - 1)];
+        if (*slot == nullptr && InterlockedCompareExchangePointer(slot, (PVOID)path, nullptr) == nullptr) {
+            return;
+        }
+    }
 }
 
 bool FilesCheckedForAccess::TryRegisterPath(const CanonicalizedPath& path) {
+    return TryRegisterPath(path.GetPathString(), path.Length());
+}
+
+bool FilesCheckedForAccess::TryRegisterPath(const wchar_t* chars, size_t length) {
+    uint64_t hash = CaseInsensitiveStringHasher::Hash(chars, length);
+
+    if (IsPublished(chars, length, hash)) {
+        TraceCacheLookup("FilesCheckedForAccess", true);
+        return false;
+    }
+
+    Shard& shard = ShardOf(hash);
     std::pair<std::unordered_set<std::wstring>::iterator, bool> result;
-    
-    EnterCriticalSection(&m_lock);
-    result = m_pathSet.insert(path.GetPathString());
-    LeaveCriticalSection(&m_lock);
 
+    AcquireSRWLockExclusive(&shard.Lock);
+    result = shard.PathSet.emplace(chars, length);
+    ReleaseSRWLockExclusive(&shard.Lock);
+
+    if (result.second) {
+        // Elements of an unordered_set don't move, and paths are never removed.
+        Publish(&*result.first, hash);
+    }
+
+    TraceCacheLookup("FilesCheckedForAccess", !result.second);
     return result.second;
 }
 
 bool FilesCheckedForAccess::IsRegistered(const CanonicalizedPath& path) {
-    std::unordered_set<std::wstring>::iterator result;
-    
-    EnterCriticalSection(&m_lock);
-    result = m_pathSet.find(path.GetPathString());
-    LeaveCriticalSection(&m_lock);
+    const wchar_t* chars = path.GetPathString();
+    size_t length = path.Length();
+    uint64_t hash = CaseInsensitiveStringHasher::Hash(chars, length);
+
+    if (IsPublished(chars, length, hash)) {
+        TraceCacheLookup("FilesCheckedForAccess", true);
+        return true;
+    }
+
+    Shard& shard = ShardOf(hash);
+    bool found;
 
-    return (result != m_pathSet.end());
+    AcquireSRWLockShared(&shard.Lock);
+    found = shard.PathSet.find(std::wstring(chars, length)) != shard.PathSet.end();
+    ReleaseSRWLockShared(&shard.Lock);
+
+    TraceCacheLookup("FilesCheckedForAccess", found);
+    return found;
 }
 
 FilesCheckedForAccess* g_filesCheckedForAccess = NULL;
@@ -40,3 +103,23 @@ FilesCheckedForAccess* GetGlobalFilesCheckedForAccesses() {
     assert(g_filesCheckedForAccess != NULL);
     return g_filesCheckedForAccess;
 }
+
+FilesCheckedForAccess* g_reportedDirectoryEnumerations = NULL;
+
+void InitializeReportedDirectoryEnumerations() {
+    assert(g_reportedDirectoryEnumerations == NULL);
+    g_reportedDirectoryEnumerations = new FilesCheckedForAccess();
+}
+
+FilesCheckedForAccess* GetGlobalReportedDirectoryEnumerations() {
+    assert(g_reportedDirectoryEnumerations != NULL);
+    return g_reportedDirectoryEnumerations;
+}
+
+void ReleaseFilesCheckedForAccesses() {
+    // The published paths are owned by the shards
+    delete g_filesCheckedForAccess;
+    g_filesCheckedForAccess = NULL;
+    delete g_reportedDirectoryEnumerations;
+    g_reportedDirectoryEnumerations = NULL;
+}
@@ -9,21 +9,51 @@
 #include <cwctype>
 #include <algorithm>
 
+// The set is split into shards (by path hash), each with its own lock, so that threads checking different paths
+// (e.g., the code generation threads of link.exe or the many threads of MSBuild nodes) do not contend on a single lock.
+#define FILES_CHECKED_FOR_ACCESS_SHARD_COUNT 16
+
+// Number of slots of the lock-free table of registered paths (a power of 2), and how many of them a path can go in
+#define FILES_CHECKED_FOR_ACCESS_PUBLISHED_SLOTS 4096
+#define FILES_CHECKED_FOR_ACCESS_MAX_PROBES 8
+
 // Keeps a set of case-insensitive paths that were checked for access 
 // All operations are thread-safe
+//
+// Paths are checked over and over, but only registered once: besides the shards, which own the paths, registered paths are
+// published in a fixed-size table (open addressing over the path hashes) that is looked up without taking any lock,
+// so that checking a path that is already registered does not take a lock. The table is insert-only and best effort:
+// the paths that don't fit are only found in their shard.
 class FilesCheckedForAccess {
 public:
     FilesCheckedForAccess();
     // Tries to register that a given path was checked for access
     // Returns whether the path was not registered before
     bool TryRegisterPath(const CanonicalizedPath& path);
+    bool TryRegisterPath(const wchar_t* path, size_t length);
     
     // Returns whether the given path is registered.
     bool IsRegistered(const CanonicalizedPath& path);
 
 private:
-    std::unordered_set<std::wstring, CaseInsensitiveStringHasher, CaseInsensitiveStringComparer> m_pathSet;
-    CRITICAL_SECTION m_lock;
+    struct Shard {
+        std::unordered_set<std::wstring, CaseInsensitiveStringHasher, CaseInsensitiveStringComparer> PathSet;
+        SRWLOCK Lock;
+    };
+
+    inline Shard& ShardOf(uint64_t hash) {
+        // The low bits pick the slots of the published table
+        return m_shards[(hash >> 32) % FILES_CHECKED_FOR_ACCESS_SHARD_COUNT];
+    }
+
+    // Whether the path is in the published table; a path that is not may still be registered.
+    bool IsPublished(const wchar_t* path, size_t length, uint64_t hash) const;
+
+    // Puts a path, owned by its shard, into the published table (if there is a free slot for it).
+    void Publish(const std::wstring* path, uint64_t hash);
+
+    Shard m_shards[FILES_CHECKED_FOR_ACCESS_SHARD_COUNT];
+    const std::wstring* volatile m_published[FILES_CHECKED_FOR_ACCESS_PUBLISHED_SLOTS];
 };
 
 // Sets up structures for recording write access checks.
@@ -32,3 +62,14 @@ void InitializeFilesCheckedForWriteAccesses();
 // Returns a pointer to the global instance of FilesCheckedForWriteAccess
 // Assumes InitializeFilesCheckedForWriteAccesses() has been called
 FilesCheckedForAccess* GetGlobalFilesCheckedForAccesses();
+
+// Sets up structures for recording the directory enumerations reported by the process.
+void InitializeReportedDirectoryEnumerations();
+
+// Returns a pointer to the global set of reported directory enumerations, each registered as the path of the directory followed by the filter
+// Assumes InitializeReportedDirectoryEnumerations() has been called
+FilesCheckedForAccess* GetGlobalReportedDirectoryEnumerations();
+
+// Drops both global sets (see ManifestRetarget.h); the Initialize functions above set them up again.
+// Only safe when no thread is in a detoured function.
+void ReleaseFilesCheckedForAccesses();
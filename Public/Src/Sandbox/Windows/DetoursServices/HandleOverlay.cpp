@@ -3,6 +3,7 @@
 
 #include "stdafx.h"
 #include "HandleOverlay.h"
+#include "DetoursTracing.h"
 #include <map>
 #include "buildXL_mem.h"
 
@@ -16,11 +17,15 @@
 #define NT_CLOSE_CLEANUP_THRESHOLD 500
 #define LARGE_LIST_MULTIPLIER 20
 
+// The overlay map is split into shards (by handle value), each with its own lock, so that threads working on different handles
+// (e.g., the many threads of MSBuild nodes or of the compiler server) do not contend on a single lock for every open and close.
+#define HANDLE_OVERLAY_SHARD_COUNT 64
+
 bool g_initialized;
-CRITICAL_SECTION g_handleOverlayLock;
 
 class HandleOverlayMap;
-HandleOverlayMap* g_handleOverlayMap;
+struct HandleOverlayShard;
+HandleOverlayShard* g_handleOverlayShards;
 PSLIST_HEADER g_pClosedHandles = nullptr;
 
 // Used to pre-create entries for closed handles in NtClose, 
@@ -43,7 +48,7 @@ public:
     void MapRegisterHandleOverlay(HANDLE handle, HandleOverlayRef& newRef) {
         
         // Now, insert (move-assign to empty) or replace (destruct then move-assign). Note that despite perhaps
-        // holding g_handleOverlayLock, we require here that shared_ptr is thread safe for refcount changes (as documented).
+        // holding the lock of the shard, we require here that shared_ptr is thread safe for refcount changes (as documented).
         // When destructing, we need to atomically decrement the ref-count ; some other routine may still be using another ref to the same overlay.
         m_map[handle] = std::move(newRef);
 
@@ -73,34 +78,67 @@ public:
         }
     }
 
-    void CloseHandleOverlay(HANDLE handle) {
-        size_t removed = m_map.erase(handle);
-        if (removed != 0 && ShouldLogProcessData())
+    // Removes the overlay of the given handle (if any), returning it so that it can be released outside of the lock.
+    HandleOverlayRef CloseHandleOverlay(HANDLE handle) {
+        auto iter = m_map.find(handle);
+        if (iter == m_map.end()) {
+            return HandleOverlayRef();
+        }
+
+        HandleOverlayRef removed = std::move(iter->second);
+        m_map.erase(iter);
+        if (ShouldLogProcessData())
         {
-            InterlockedAdd64(&g_detoursHandleHeapEntries, -((LONG64)removed));
+            InterlockedDecrement64(&g_detoursHandleHeapEntries);
         }
+
+        return removed;
+    }
+
+    // Removes all the overlays, moving them into the given (empty) map so that they can be released outside of the lock.
+    void CloseAllHandleOverlays(std::map<HANDLE, HandleOverlayRef>& removed) {
+        if (ShouldLogProcessData())
+        {
+            InterlockedAdd64(&g_detoursHandleHeapEntries, -(LONG64)m_map.size());
+        }
+
+        removed.swap(m_map);
     }
 
 private:
     std::map<HANDLE, HandleOverlayRef> m_map;
 };
 
-// Holds g_handleOverlayLock
+struct HandleOverlayShard {
+    CRITICAL_SECTION Lock;
+    HandleOverlayMap Map;
+};
+
+static inline HandleOverlayShard* GetHandleOverlayShard(HANDLE handle) {
+    assert(g_handleOverlayShards != nullptr);
+
+    // The two low bits of kernel handle values are always 0.
+    return &g_handleOverlayShards[((ULONG_PTR)handle >> 2) % HANDLE_OVERLAY_SHARD_COUNT];
+}
+
+// Holds the lock of the shard of the given handle
 struct HandleOverlayLockGuard {
-    HandleOverlayLockGuard() {
+    HandleOverlayLockGuard(HANDLE handle) : m_shard(GetHandleOverlayShard(handle)) {
         assert(g_initialized);
-        EnterCriticalSection(&g_handleOverlayLock);
+        EnterCriticalSection(&m_shard->Lock);
     }
 
     ~HandleOverlayLockGuard() {
-        LeaveCriticalSection(&g_handleOverlayLock);
+        LeaveCriticalSection(&m_shard->Lock);
     }
 
     // This is a member function to make sure we always get the map inside a lock.
-    inline HandleOverlayMap* GetGlobalOverlayMap() {
-        assert(g_handleOverlayMap != nullptr);
-        return g_handleOverlayMap;
+    inline HandleOverlayMap* GetOverlayMap() {
+        return &m_shard->Map;
     }
+
+private:
+    HandleOverlayShard* m_shard;
 };
 
 static void PopulateNtCloseListPool()
@@ -176,10 +214,13 @@ void StartCleanupNtClosedHandlesThread()
 void InitializeHandleOverlay() {
 
     assert(!g_initialized);
-    InitializeCriticalSection(&g_handleOverlayLock);
-    // Always create the OverlayMap.This is called from DllAttach, so it is inside alock already.
+    // Always create the shards of the OverlayMap. This is called from DllAttach, so it is inside alock already.
     // Doing it here, we save check and creating the map inside the GetOverlayMap.
-    g_handleOverlayMap = new HandleOverlayMap();
+    g_handleOverlayShards = new HandleOverlayShard[HANDLE_OVERLAY_SHARD_COUNT];
+    for (unsigned i = 0; i < HANDLE_OVERLAY_SHARD_COUNT; i++)
+    {
+        InitializeCriticalSection(&g_handleOverlayShards[i].Lock);
+    }
 
     // The NtClose(d) handles are in the g_pClosedHandles. (It is a lock free list.)
     // Since allocation of memory is unsafe inside the NtClose execution path (there should
@@ -206,7 +247,7 @@ void InitializeHandleOverlay() {
     g_initialized = true;
 }
 
-void RegisterHandleOverlay(HANDLE handle, AccessCheckResult const& accessCheck, PolicyResult const& policy, HandleType type) {
+HandleOverlayRef RegisterHandleOverlay(HANDLE handle, AccessCheckResult const& accessCheck, PolicyResult const& policy, HandleType type) {
     if (UseExtraThreadToDrainNtClose())
     {
         RemoveClosedHandles();
@@ -230,11 +271,16 @@ void RegisterHandleOverlay(HANDLE handle, AccessCheckResult const& accessCheck,
     // These two clearly point to a deadlock due to inverted lock aquisition.
     HandleOverlayRef overlay = TryLookupHandleOverlay(handle, false);
 
+    // newRef is moved into the map
+    HandleOverlayRef registered = newRef;
+
     {
-        HandleOverlayLockGuard lock;
-        HandleOverlayMap* map = lock.GetGlobalOverlayMap();
+        HandleOverlayLockGuard lock(handle);
+        HandleOverlayMap* map = lock.GetOverlayMap();
         map->MapRegisterHandleOverlay(handle, newRef);
     }
+
+    return registered;
 }
 
 HandleOverlayRef TryLookupHandleOverlay(HANDLE handle, bool drain) {
@@ -243,9 +289,15 @@ HandleOverlayRef TryLookupHandleOverlay(HANDLE handle, bool drain) {
         RemoveClosedHandles();
     }
 
-    HandleOverlayLockGuard lock;
-    HandleOverlayMap* map = lock.GetGlobalOverlayMap();
-    return map->TryLookupHandleOverlay(handle);
+    HandleOverlayRef overlay;
+    {
+        HandleOverlayLockGuard lock(handle);
+        HandleOverlayMap* map = lock.GetOverlayMap();
+        overlay = map->TryLookupHandleOverlay(handle);
+    }
+
+    TraceCacheLookup("HandleOverlay", overlay != nullptr);
+    return overlay;
 }
 
 void CloseHandleOverlay(HANDLE handle, bool inRecursion) {
@@ -273,12 +325,26 @@ void CloseHandleOverlay(HANDLE handle, bool inRecursion) {
     {
         // Extra scope here to make sure the lock is destroied before the overlay above goes out of scope
         // and releases the last ref to the object pointer.
-        HandleOverlayLockGuard lock;
-        HandleOverlayMap* map = lock.GetGlobalOverlayMap();
+        HandleOverlayLockGuard lock(handle);
+        HandleOverlayMap* map = lock.GetOverlayMap();
         map->CloseHandleOverlay(handle);
     }
 }
 
+void CloseAllHandleOverlays() {
+    for (unsigned i = 0; i < HANDLE_OVERLAY_SHARD_COUNT; i++)
+    {
+        // Declared outside of the lock, so the overlays are released after leaving it (see CloseHandleOverlay).
+        std::map<HANDLE, HandleOverlayRef> removed;
+        {
+            HandleOverlayShard* shard = &g_handleOverlayShards[i];
+            EnterCriticalSection(&shard->Lock);
+            shard->Map.CloseAllHandleOverlays(removed);
+            LeaveCriticalSection(&shard->Lock);
+        }
+    }
+}
+
 void AddClosedHandle(HANDLE handle) {
     // Be safe and check all the list pointers as well since a NtClose (where this method is called from)
     // can come very early in the execution of a process.
@@ -299,6 +365,9 @@ void AddClosedHandle(HANDLE handle) {
 
         if (pEntry == nullptr)
         {
+            // The overlay is left behind: removing it from here is not safe, since NtClose may be called (possibly on a thread
+            // that already holds the lock of this shard, which is recursive) from inside a heap call made while the shard is
+            // being changed, and removing it may free memory.
             Dbg(L"Warning: No available entries in g_pClosedHandlesPool list.");
         }
         else
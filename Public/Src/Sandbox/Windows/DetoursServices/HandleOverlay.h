@@ -26,7 +26,9 @@ struct HandleOverlay {
     // Constructs a handle overlay for a handle, wrapping the creating operation's policy / access check.
     // The policy represents what operations should be allowed via operations on this handle.
     HandleOverlay(AccessCheckResult const& accessCheck, PolicyResult const& policy, HandleType type)
-        : Policy(policy), AccessCheck(accessCheck), Type(type), EnumerationHasBeenReported(false) { }
+        : Policy(policy), AccessCheck(accessCheck), Type(type), EnumerationHasBeenReported(false), PolicyHasBeenResolved(false),
+          OverrideTimestamps(policy.ShouldOverrideTimestamps(accessCheck)), SummarizeEnumeration(false), EnumeratedEntryCount(0),
+          EnumerationMembershipHash(0), FinalPathLock(SRWLOCK_INIT), HasFinalPath(false), FinalPathFlags(0) { }
 
     HandleOverlay(const HandleOverlay& other) = default;
     HandleOverlay& operator=(const HandleOverlay&) = default;
@@ -39,6 +41,32 @@ struct HandleOverlay {
     // by NtQueryDirectoryFile. It prevents multiple reports for the same directory
     // (some big enumerations require multiple calls to NtQueryDirectoryFile).
     bool EnumerationHasBeenReported;
+
+    // This flag is set when FindNextFile has replaced the policy of a find handle by the policy of the fully resolved path
+    // of the directory, so that the reparse points of the directory are not resolved again for every enumerated entry.
+    bool PolicyHasBeenResolved;
+
+    // Whether the timestamps returned by the metadata queries on this handle (e.g. GetFileInformationByHandle) are overridden,
+    // i.e., Policy.ShouldOverrideTimestamps(AccessCheck), decided once for all the queries on the handle.
+    // Must be updated whenever Policy or AccessCheck are.
+    bool OverrideTimestamps;
+
+    // Set on a find handle whose entries are summarized rather than reported (see SummarizeDirectoryEnumerations), until the
+    // summary is sent: the directory (as in the report of the enumeration) and the filter of the enumeration, and the number
+    // and membership hash of the entries found so far.
+    bool SummarizeEnumeration;
+    uint64_t EnumeratedEntryCount;
+    uint64_t EnumerationMembershipHash;
+    std::wstring EnumerationDirectory;
+    std::wstring EnumerationFilter;
+
+    // The result of the last GetFinalPathNameByHandleW on this handle (as translated by Detoured_GetFinalPathNameByHandleW) and the flags it was
+    // queried with, guarded by FinalPathLock: tools normalize the paths of their handles over and over, and the path of a handle only changes
+    // when it is renamed through it, which re-registers its overlay (see UpdateHandleOverlayAfterRename).
+    SRWLOCK FinalPathLock;
+    bool HasFinalPath;
+    DWORD FinalPathFlags;
+    std::wstring FinalPath;
 };
 
 // Sets up structures for recording handle overlays.
@@ -51,10 +79,10 @@ void InitializeHandleOverlay();
 // deallocated until all uses of it are complete.
 typedef std::shared_ptr<HandleOverlay> HandleOverlayRef;
 
-// Creates or replaces an overlay for the given handle (intended for the time at which a handle is created).
+// Creates or replaces an overlay for the given handle (intended for the time at which a handle is created), and returns it.
 // The new overlays wraps the policy / access check determined for the handle so far.
 // The policy represents what operations should be allowed via operations on this handle.
-void RegisterHandleOverlay(HANDLE handle, AccessCheckResult const& accessCheck, PolicyResult const& policy, HandleType type);
+HandleOverlayRef RegisterHandleOverlay(HANDLE handle, AccessCheckResult const& accessCheck, PolicyResult const& policy, HandleType type);
 
 // Tries to look up an existing overlay for the given handle. The returned ref may wrap nullptr in the event that there was no overlay found.
 HandleOverlayRef TryLookupHandleOverlay(HANDLE handle, bool drain = true);
@@ -63,6 +91,10 @@ HandleOverlayRef TryLookupHandleOverlay(HANDLE handle, bool drain = true);
 // longer succeed. Concurrent users that already have a ref to the overlay may continue to use it safely.
 void CloseHandleOverlay(HANDLE handle, bool inRecursion = false);
 
+// Disassociates every overlay from its handle, e.g., when the process is retargeted (see ManifestRetarget.h): the overlays hold
+// policies of the previous manifest, and the operations on the handles opened until then are not reported anymore.
+void CloseAllHandleOverlays();
+
 // Adds a closed handle to the closed handle list.
 void AddClosedHandle(HANDLE handle);
 
@@ -0,0 +1,183 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "stdafx.h"
+
+#include "ImagePathCache.h"
+#include "UtilityHelpers.h"
+
+#include <memory>
+
+// Start of the last component of a path (the whole path if it has a single one)
+static const wchar_t* GetFileName(const wchar_t* path, size_t length)
+{
+    const wchar_t* fileName = path;
+    for (size_t i = 0; i < length; i++) {
+        if (path[i] == L'\\' || path[i] == L'/') {
+            fileName = path + i + 1;
+        }
+    }
+
+    return fileName;
+}
+
+static inline LONG64 NameBit(const wchar_t* fileName, size_t length)
+{
+    return 1LL << (CaseInsensitiveStringHasher::Hash(fileName, length) & 63);
+}
+
+// The bit of the file name a search of the given name looks for: SearchPathW appends the default extension (.exe) to a name that
+// does not have one.
+static LONG64 SearchedNameBit(const std::wstring& name)
+{
+    const wchar_t* fileName = GetFileName(name.c_str(), name.length());
+    std::wstring searchedName(fileName, name.c_str() + name.length() - fileName);
+    if (searchedName.find(L'.') == std::wstring::npos) {
+        searchedName.append(L".exe");
+    }
+
+    return NameBit(searchedName.c_str(), searchedName.length());
+}
+
+// Reads a string through a Win32 function that returns the required length (including the null character) when the buffer is too small.
+template <typename TGetter>
+static bool GetDynamicString(TGetter getter, std::wstring& value)
+{
+    wchar_t buffer[MAX_PATH];
+    SetLastError(ERROR_SUCCESS);
+    DWORD result = getter(buffer, (DWORD)std::extent<decltype(buffer)>::value);
+    if (result < std::extent<decltype(buffer)>::value) {
+        value.assign(buffer, result);
+        return result != 0 || GetLastError() == ERROR_SUCCESS;
+    }
+
+    std::unique_ptr<wchar_t[]> dynamicBuffer(new wchar_t[result]);
+    DWORD result2 = getter(dynamicBuffer.get(), result);
+    if (result2 == 0 || result2 >= result) {
+        return false;
+    }
+
+    value.assign(dynamicBuffer.get(), result2);
+    return true;
+}
+
+ImagePathCache::ImagePathCache()
+    : m_generation(0), m_searchedNames(0), m_count(0), m_next(0)
+{
+    InitializeSRWLock(&m_lock);
+}
+
+bool ImagePathCache::GetSearchContext(std::wstring& currentDirectory, uint64_t& pathHash)
+{
+    DWORD error = GetLastError();
+
+    bool succeeded = GetDynamicString([](LPWSTR buffer, DWORD size) { return GetCurrentDirectoryW(size, buffer); }, currentDirectory);
+
+    std::wstring path;
+    if (succeeded) {
+        // An unset PATH reads as empty (GetEnvironmentVariableW fails with ERROR_ENVVAR_NOT_FOUND then).
+        if (!GetDynamicString([](LPWSTR buffer, DWORD size) { return GetEnvironmentVariableW(L"PATH", buffer, size); }, path)) {
+            succeeded = GetLastError() == ERROR_ENVVAR_NOT_FOUND;
+            path.clear();
+        }
+    }
+
+    pathHash = CaseInsensitiveStringHasher::Hash(path.c_str(), path.length());
+
+    SetLastError(error);
+    return succeeded;
+}
+
+bool ImagePathCache::TryGet(const std::wstring& name, const std::wstring& currentDirectory, uint64_t pathHash, CanonicalizedPath& imagePath)
+{
+    bool found = false;
+
+    AcquireSRWLockShared(&m_lock);
+    for (size_t i = 0; i < m_count; i++) {
+        const Entry& entry = m_entries[i];
+        if (entry.PathHash == pathHash
+            && CaseInsensitiveStringComparer()(entry.Name, name)
+            && CaseInsensitiveStringComparer()(entry.CurrentDirectory, currentDirectory)) {
+            imagePath = entry.ImagePath;
+            found = true;
+            break;
+        }
+    }
+    ReleaseSRWLockShared(&m_lock);
+
+    return found;
+}
+
+LONG ImagePathCache::BeginSearch(const std::wstring& name)
+{
+    // The bit is set before the search, so that a write made during the search invalidates it.
+    InterlockedOr64(&m_searchedNames, SearchedNameBit(name));
+    return ReadAcquire(&m_generation);
+}
+
+void ImagePathCache::Add(const std::wstring& name, const std::wstring& currentDirectory, uint64_t pathHash, const CanonicalizedPath& imagePath, LONG generation)
+{
+    AcquireSRWLockExclusive(&m_lock);
+    if (m_generation == generation) {
+        Entry& entry = m_entries[m_next];
+        entry.Name = name;
+        entry.CurrentDirectory = currentDirectory;
+        entry.PathHash = pathHash;
+        entry.ImagePath = imagePath;
+
+        m_next = (m_next + 1) % IMAGE_PATH_CACHE_ENTRIES;
+        if (m_count < IMAGE_PATH_CACHE_ENTRIES) {
+            m_count++;
+        }
+    }
+    ReleaseSRWLockExclusive(&m_lock);
+}
+
+void ImagePathCache::InvalidateForWrittenPath(const wchar_t* path)
+{
+    // The bits of replaced entries (and of searches that found nothing) are only cleared by an invalidation: at worst, a write
+    // drops the entries needlessly.
+    LONG64 searchedNames = ReadAcquire64(&m_searchedNames);
+    if (searchedNames == 0 || path == nullptr) {
+        return;
+    }
+
+    size_t length = wcslen(path);
+    const wchar_t* fileName = GetFileName(path, length);
+    if ((searchedNames & NameBit(fileName, path + length - fileName)) == 0) {
+        return;
+    }
+
+    // The filter is cleared before the generation is bumped: a search that sets its bit in between reads either generation, and
+    // the older one makes Add drop it.
+    AcquireSRWLockExclusive(&m_lock);
+    InterlockedExchange64(&m_searchedNames, 0);
+    InterlockedIncrement(&m_generation);
+    m_count = 0;
+    m_next = 0;
+    ReleaseSRWLockExclusive(&m_lock);
+}
+
+ImagePathCache* g_imagePathCache = NULL;
+
+void InitializeImagePathCache() {
+    assert(g_imagePathCache == NULL);
+    if (CacheImagePathSearches()) {
+        g_imagePathCache = new ImagePathCache();
+    }
+}
+
+ImagePathCache* GetGlobalImagePathCache() {
+    return g_imagePathCache;
+}
+
+void InvalidateImagePathCacheForWrite(const wchar_t* path) {
+    if (g_imagePathCache != NULL) {
+        g_imagePathCache->InvalidateForWrittenPath(path);
+    }
+}
+
+void ReleaseImagePathCache() {
+    delete g_imagePathCache;
+    g_imagePathCache = NULL;
+}
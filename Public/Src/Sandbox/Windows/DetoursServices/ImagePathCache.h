@@ -0,0 +1,76 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include "CanonicalizedPath.h"
+#include "FileAccessHelpers.h"
+
+#include <string>
+
+// Number of searches the cache remembers (a process typically launches a handful of distinct tools)
+#define IMAGE_PATH_CACHE_ENTRIES 32
+
+// The image paths found by searching the non-rooted application names of the processes a process creates (see GetImagePath and
+// FileAccessManifestExtraFlag::CacheImagePathSearches), so that creating the same tool again does not probe the search path again.
+//
+// What SearchPathW finds depends on the name, on the current directory and on the PATH of the process: an entry is keyed by the three
+// of them (PATH by hash), which are read again for every lookup, so a process that changes its current directory or its environment
+// simply misses. It also depends on the files of the searched directories: whenever the process writes (i.e., creates, replaces, renames
+// or deletes) a file with the name a search looks for, every entry is dropped (see InvalidateForWrittenPath). Like for the resolved path
+// cache, the changes made by other processes (including the children of the process) are not seen. Searches that found nothing are not
+// remembered.
+//
+// Entries are protected by an SRW lock, and replaced round robin once the table is full. Writes are checked against a 64-bit filter of
+// the names the searches looked for, so writing any other file costs a hash and a bit test.
+class ImagePathCache {
+public:
+    ImagePathCache();
+
+    // The current directory and the hash of PATH, which (with the name) identify a search; false if either cannot be read.
+    static bool GetSearchContext(std::wstring& currentDirectory, uint64_t& pathHash);
+
+    // Gets the image path a search of the name found in the given context, if it is remembered.
+    bool TryGet(const std::wstring& name, const std::wstring& currentDirectory, uint64_t pathHash, CanonicalizedPath& imagePath);
+
+    // Called before the real search of the name; returns the generation to pass to Add.
+    LONG BeginSearch(const std::wstring& name);
+
+    // Remembers what a search of the name found. 'generation' is the generation before the search was made: if the cache has been
+    // invalidated since, the search may have missed the written file and is not remembered.
+    void Add(const std::wstring& name, const std::wstring& currentDirectory, uint64_t pathHash, const CanonicalizedPath& imagePath, LONG generation);
+
+    // Drops every entry if a search may have looked for the (last component of the) given path, which the process is about to write.
+    void InvalidateForWrittenPath(const wchar_t* path);
+
+private:
+    struct Entry {
+        std::wstring Name;
+        std::wstring CurrentDirectory;
+        uint64_t PathHash;
+        CanonicalizedPath ImagePath;
+    };
+
+    SRWLOCK m_lock;
+    volatile LONG m_generation;
+
+    // One bit per (hash of the) file name the searches since the last invalidation looked for
+    volatile LONG64 m_searchedNames;
+
+    size_t m_count;
+    size_t m_next;
+    Entry m_entries[IMAGE_PATH_CACHE_ENTRIES];
+};
+
+// Sets up the cache (if FileAccessManifestExtraFlag::CacheImagePathSearches is set). Must be called after the manifest has been parsed.
+void InitializeImagePathCache();
+
+// Returns the global cache, or NULL if every search goes to the file system.
+ImagePathCache* GetGlobalImagePathCache();
+
+// Drops the entries of the global cache (if any) that a write of the given path may make stale.
+void InvalidateImagePathCacheForWrite(const wchar_t* path);
+
+// Drops the global cache, if any (see ManifestRetarget.h); InitializeImagePathCache sets it up again.
+// Only safe when no thread is in a detoured function.
+void ReleaseImagePathCache();
@@ -0,0 +1,175 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "stdafx.h"
+
+#include "DebugMessageRing.h"
+#include "DebuggingHelpers.h"
+#include "DetouredScope.h"
+#include "DetoursHelpers.h"
+#include "DetoursServices.h"
+#include "FileAccessHelpers.h"
+#include "FilesCheckedForAccess.h"
+#include "globals.h"
+#include "HandleOverlay.h"
+#include "ImagePathCache.h"
+#include "ManifestRetarget.h"
+#include "ProbeCache.h"
+#include "ReportedAccessCache.h"
+#include "ReportRing.h"
+#include "ReportStringTable.h"
+#include "ResolvedPathCache.h"
+#include "SendReport.h"
+#include "SharedReparsePointCache.h"
+
+// ----------------------------------------------------------------------------
+// GLOBALS
+// ----------------------------------------------------------------------------
+
+static ManifestRetargetRequest* s_retargetRequest = nullptr;
+static HANDLE s_retargetRequestEvent = nullptr;
+static HANDLE s_retargetDoneEvent = nullptr;
+
+// The payload image of the last retarget. The one the process was created with is never freed (it is not ours to free,
+// see LocateFileAccessManifest).
+static PVOID s_retargetPayloadImage = nullptr;
+
+// ----------------------------------------------------------------------------
+// FUNCTION DEFINITIONS
+// ----------------------------------------------------------------------------
+
+// Replaces the manifest and everything derived from it. Must be called at a quiescent point.
+static bool SwapFileAccessManifest(const void* payload, DWORD payloadSize)
+{
+    // The reports that are still batched belong to the current pip
+    FlushReportBatch();
+
+    ReleaseReportRing();
+    ReleaseSharedReparsePointCache();
+    ReleaseReportedAccessCache();
+    ReleaseProbeCache();
+    ReleaseImagePathCache();
+    ReleaseFilesCheckedForAccesses();
+    ReleaseReportStringTable();
+    CloseAllHandleOverlays();
+    ResolvedPathCache::Instance().Clear();
+    ReleaseFileAccessManifest();
+
+    // The image of the process is reported once detoured functions are entered again (see HandleRetargetRequest)
+    if (!ParseFileAccessManifest(payload, payloadSize, /*reportProcessImageAccess*/ false))
+    {
+        return false;
+    }
+
+    InitializeFilesCheckedForWriteAccesses();
+    InitializeReportedDirectoryEnumerations();
+    InitializeReportStringTable();
+    InitializeReportRing();
+    InitializeDebugMessageRing();
+    InitializeSharedReparsePointCache();
+    InitializeReportedAccessCache();
+    InitializeProbeCache();
+    InitializeImagePathCache();
+    return true;
+}
+
+static DWORD HandleRetargetRequest(PVOID payloadImage, DWORD timeoutMs)
+{
+    DWORD payloadSize = 0;
+    const void* payload = DetourFindPayloadAt(payloadImage, __uuidof(IDetourServicesManifest), &payloadSize);
+    if (payload == nullptr)
+    {
+        Dbg(L"ManifestRetarget: no manifest found at %p", payloadImage);
+        return ERROR_INVALID_DATA;
+    }
+
+    if (!DetouredScope::TryEnterQuiescence(timeoutMs))
+    {
+        return WAIT_TIMEOUT;
+    }
+
+    bool parsed = SwapFileAccessManifest(payload, payloadSize);
+    DetouredScope::LeaveQuiescence();
+
+    if (!parsed)
+    {
+        // The previous manifest is gone already, there is nothing left to run under
+        TerminateProcess(GetCurrentProcess(), ERROR_INVALID_DATA);
+        return ERROR_INVALID_DATA;
+    }
+
+    // Takes the loader lock, which a thread suspended at the quiescent point could have been holding
+    ReportProcessImageAccess();
+
+    if (s_retargetPayloadImage != nullptr)
+    {
+        VirtualFree(s_retargetPayloadImage, 0, MEM_RELEASE);
+    }
+
+    s_retargetPayloadImage = payloadImage;
+    return ERROR_SUCCESS;
+}
+
+static DWORD WINAPI ManifestRetargetThread(LPVOID)
+{
+    while (WaitForSingleObject(s_retargetRequestEvent, INFINITE) == WAIT_OBJECT_0)
+    {
+        if (s_retargetRequest->Status != MANIFEST_RETARGET_PENDING)
+        {
+            continue;
+        }
+
+        s_retargetRequest->Status = HandleRetargetRequest(
+            reinterpret_cast<PVOID>(static_cast<ULONG_PTR>(s_retargetRequest->PayloadImage)),
+            s_retargetRequest->TimeoutMs);
+        SetEvent(s_retargetDoneEvent);
+    }
+
+    return 0;
+}
+
+void InitializeManifestRetarget()
+{
+    if (!AllowManifestRetarget())
+    {
+        return;
+    }
+
+    wchar_t name[ManifestRetargetObjectNameLength];
+    GetManifestRetargetObjectName(name, ManifestRetargetObjectNameLength, GetCurrentProcessId(), ManifestRetargetSectionKind);
+    HANDLE section = CreateFileMappingW(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0, sizeof(ManifestRetargetRequest), name);
+    if (section == nullptr)
+    {
+        Dbg(L"Warning: Could not create the manifest retarget section. GLE=%d", GetLastError());
+        return;
+    }
+
+    // The section stays mapped (and the handle open) for the lifetime of the process
+    s_retargetRequest = reinterpret_cast<ManifestRetargetRequest*>(MapViewOfFile(section, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(ManifestRetargetRequest)));
+    if (s_retargetRequest == nullptr)
+    {
+        Dbg(L"Warning: Could not map the manifest retarget section. GLE=%d", GetLastError());
+        CloseHandle(section);
+        return;
+    }
+
+    GetManifestRetargetObjectName(name, ManifestRetargetObjectNameLength, GetCurrentProcessId(), ManifestRetargetRequestEventKind);
+    s_retargetRequestEvent = CreateEventW(nullptr, FALSE, FALSE, name);
+    GetManifestRetargetObjectName(name, ManifestRetargetObjectNameLength, GetCurrentProcessId(), ManifestRetargetDoneEventKind);
+    s_retargetDoneEvent = CreateEventW(nullptr, FALSE, FALSE, name);
+    if (s_retargetRequestEvent == nullptr || s_retargetDoneEvent == nullptr)
+    {
+        Dbg(L"Warning: Could not create the manifest retarget events. GLE=%d", GetLastError());
+        return;
+    }
+
+    // The thread only starts running once DllMain returns (it waits for the loader lock)
+    HANDLE thread = CreateThread(nullptr, 0, ManifestRetargetThread, nullptr, 0, nullptr);
+    if (thread == nullptr)
+    {
+        Dbg(L"Warning: Could not create the manifest retarget thread. GLE=%d", GetLastError());
+        return;
+    }
+
+    CloseHandle(thread);
+}
@@ -0,0 +1,57 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <windows.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Moving a running detoured process to the manifest of another pip (see FileAccessManifestExtraFlag::AllowManifestRetarget),
+// so that a long-lived tool (e.g., a compiler server) can serve several pips while each of them gets its own policy and report pipe.
+//
+// When the flag is set, the detoured process creates a request section and two auto-reset events (a request and a done event) named
+// after its process id, and a thread waiting for the request event:
+//   1. BuildXL copies the payload image of the new pip into the process (like for a child, see DetouredProcessInjector::RetargetProcess),
+//      writes its address and a timeout into the section, sets the status to MANIFEST_RETARGET_PENDING and signals the request event.
+//   2. The thread waits for a quiescent point, i.e., for no thread to be in a detoured function (see DetouredScope::TryEnterQuiescence).
+//      Threads entering a detoured function meanwhile are not blocked: the thread polls until it gets one or the timeout expires.
+//   3. At the quiescent point, the reports of the current pip are flushed, the state derived from its manifest (the caches, the handle
+//      overlays, the report ring) is dropped and the new manifest is parsed. Detoured functions are entered again once this is done.
+//   4. The thread writes the status and signals the done event. On failure the process keeps its manifest, unless the new one cannot be
+//      parsed, in which case the process is terminated (it has no manifest left).
+//
+// Not covered: children created before the retarget keep the manifest they were created with, the substitute process execution plugin
+// is the one of the first manifest, and accesses through handles opened before the retarget are not reported.
+//
+// The objects live in the Local namespace of the session: the names only guard against mistakes, not against the tools of other pips.
+
+// Status of a request that is not yet handled
+#define MANIFEST_RETARGET_PENDING ERROR_IO_PENDING
+
+typedef struct ManifestRetargetRequest_t
+{
+    // Address (in the detoured process) of the payload image of the new manifest
+    volatile uint64_t PayloadImage;
+
+    // How long the detoured process waits for a quiescent point
+    volatile DWORD TimeoutMs;
+
+    // MANIFEST_RETARGET_PENDING until the request is handled, a Win32 error code afterwards
+    volatile DWORD Status;
+} ManifestRetargetRequest;
+
+#define ManifestRetargetSectionKind L"Section"
+#define ManifestRetargetRequestEventKind L"Request"
+#define ManifestRetargetDoneEventKind L"Done"
+
+// Name of one of the objects of the process with the given id (kind is one of the ManifestRetarget*Kind)
+inline void GetManifestRetargetObjectName(wchar_t* buffer, size_t count, DWORD processId, PCWSTR kind)
+{
+    swprintf_s(buffer, count, L"Local\\BuildXL-ManifestRetarget-%08lx-%s", processId, kind);
+}
+
+#define ManifestRetargetObjectNameLength 64
+
+// Creates the objects and the thread handling the requests (detoured process only). Called once the detoured functions are installed.
+void InitializeManifestRetarget();
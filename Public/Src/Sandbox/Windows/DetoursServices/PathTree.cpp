@@ -31,27 +31,23 @@ PathTree::~PathTree()
 
 bool PathTree::TryInsert(const std::wstring& path)
 {
-    std::vector<std::wstring> elements;
-    int err = TryDecomposePath(path, elements);
-    if (err != 0)
-    {
-        Dbg(L"PathTree::TryInsert: TryDecomposePath failed, not resolving path: %d", err);
-        return false;
-    }
-
     TreeNode* currentNode = m_root;
 
-    for (unsigned int i = 0; i < elements.size(); i++)
+    PathComponentIterator elements(path.c_str(), path.length());
+    bool hasElement = elements.MoveNext();
+    while (hasElement)
     {
+        PathComponent element = elements.Current();
+
         // Only the last element is a final node
-        bool isIntermediate = (i != (elements.size() - 1));
-        currentNode = Append(elements[i], currentNode, isIntermediate);
+        hasElement = elements.MoveNext();
+        currentNode = Append(element, currentNode, /*isIntermediate*/ hasElement);
     }
 
     return true;
 }
 
-TreeNode* PathTree::Append(std::wstring& atom, TreeNode* node, bool isIntermediate)
+TreeNode* PathTree::Append(const PathComponent& atom, TreeNode* node, bool isIntermediate)
 {
     // First check if the node is already there
     auto search = node->children.find(atom);
@@ -62,10 +58,12 @@ TreeNode* PathTree::Append(std::wstring& atom, TreeNode* node, bool isIntermedia
         return search->second;
     }
 
-    // It is not there. Create it and add it as a child of the given node
+    // It is not there. Create it and add it as a child of the given node (keyed by its own copy of the atom)
     TreeNode* newNode = new TreeNode();
+    newNode->atom.assign(atom.Chars, atom.Length);
+    newNode->atomHash = atom.Hash;
     newNode->intermediate = isIntermediate;
-    node->children.emplace(atom, newNode);
+    node->children.emplace(newNode->Key(), newNode);
 
     return newNode;
 }
@@ -73,7 +71,7 @@ TreeNode* PathTree::Append(std::wstring& atom, TreeNode* node, bool isIntermedia
 void PathTree::RetrieveAndRemoveAllDescendants(const std::wstring& path, std::vector<std::wstring>& descendants)
 {
     // Find the trace in the tree that matches the path
-    std::vector<std::pair<std::wstring, TreeNode*>> nodeTrace;
+    std::vector<TreeNode*> nodeTrace;
     if (!TryFind(path, nodeTrace))
     {
         return;
@@ -87,27 +85,26 @@ void PathTree::RetrieveAndRemoveAllDescendants(const std::wstring& path, std::ve
     std::wstring normalizedPath;
     if (it != nodeTrace.end())
     {
-        normalizedPath.append(it->first);
+        normalizedPath.append((*it)->atom);
         it++;
     }
 
     for (; it != nodeTrace.end(); it++)
     {
         normalizedPath.append(L"\\");
-        normalizedPath.append(it->first);
+        normalizedPath.append((*it)->atom);
     }
 
 
     // Pop all the descendants of the leaf node and build the descendant collection
-    RetrieveAndRemoveAllDescendants(normalizedPath, nodeTrace.back().second, descendants);
+    RetrieveAndRemoveAllDescendants(normalizedPath, nodeTrace.back(), descendants);
 
     // Let's walk upwards, towards the root, removing all intermediates with no branching
     // The presence of these nodes won't affect future computation of descendants but it can slow
     // down searches
     while (!nodeTrace.empty())
     {
-        std::pair<std::wstring, TreeNode*> pair = nodeTrace.back();
-        TreeNode* node = pair.second;
+        TreeNode* node = nodeTrace.back();
 
         nodeTrace.pop_back();
 
@@ -115,8 +112,8 @@ void PathTree::RetrieveAndRemoveAllDescendants(const std::wstring& path, std::ve
         // (no children after removing the last edge)
         if (node != m_root && node->intermediate && node->children.size() == 0)
         {
-            TreeNode* predecesor = nodeTrace.back().second;
-            predecesor->children.erase(pair.first);
+            TreeNode* predecesor = nodeTrace.back();
+            predecesor->children.erase(node->Key());
             delete node;
         }
         else
@@ -137,7 +134,7 @@ void PathTree::RetrieveAndRemoveAllDescendants(const std::wstring& path, TreeNod
         if (node != m_root)
         {
             descendant.append(L"\\");
-            descendant.append(iter->first);
+            descendant.append(iter->second->atom);
         }
 
         // Add it to the collection only if it is a final path
@@ -159,23 +156,16 @@ void PathTree::RetrieveAndRemoveAllDescendants(const std::wstring& path, TreeNod
     node->children.clear();
 }
 
-bool PathTree::TryFind(const std::wstring& path, std::vector<std::pair<std::wstring, TreeNode*>>& nodeTrace)
+bool PathTree::TryFind(const std::wstring& path, std::vector<TreeNode*>& nodeTrace)
 {
-    std::vector<std::wstring> elements;
-    int err = TryDecomposePath(path, elements);
-    if (err != 0)
-    {
-        Dbg(L"PathTree::TryFind: TryDecomposePath failed, not resolving path: %d", err);
-        return false;
-    }
-
     auto currentNode = m_root;
 
-    nodeTrace.push_back(std::make_pair(L"", m_root));
+    nodeTrace.push_back(m_root);
 
-    for (unsigned int i = 0; i < elements.size(); i++)
+    PathComponentIterator elements(path.c_str(), path.length());
+    while (elements.MoveNext())
     {
-        auto search = currentNode->children.find(elements[i]);
+        auto search = currentNode->children.find(elements.Current());
 
         if (search == currentNode->children.end())
         {
@@ -183,7 +173,7 @@ bool PathTree::TryFind(const std::wstring& path, std::vector<std::pair<std::wstr
         }
 
         currentNode = search->second;
-        nodeTrace.push_back(std::make_pair(search->first, currentNode));
+        nodeTrace.push_back(currentNode);
     }
 
     return true;
@@ -205,7 +195,7 @@ std::wstring PathTree::ToDebugString(TreeNode* node, std::wstring indent)
 
     for (auto iter = node->children.begin(); iter != node->children.end(); iter++)
     {
-        result.append(indent + iter->first + (!iter->second->intermediate ? L"*" : L"") + L"\r\n");
+        result.append(indent + iter->second->atom + (!iter->second->intermediate ? L"*" : L"") + L"\r\n");
         result.append(ToDebugString(iter->second, indent + L"\t"));
     }
 
@@ -7,23 +7,41 @@
 
 #define EXPORT __declspec( dllexport )
 
-#include <map>
 #include <stack>
+#include <unordered_map>
 #include "UtilityHelpers.h"
+#include "StringOperations.h"
+
+// Hashes and compares path components like the manifest does (see PathComponentIterator), so that the components of a path
+// can be looked up in place: the hash code of a component is computed once, when the path is split.
+struct PathComponentHasher {
+    size_t operator()(const PathComponent& component) const { return component.Hash; }
+};
+
+struct PathComponentComparer {
+    bool operator()(const PathComponent& lhs, const PathComponent& rhs) const { return ArePathComponentsEqual(lhs, rhs); }
+};
 
 // A node in a PathTree
 struct TreeNode {
-    // Edges to children, with the path atom that leads to it
-    std::map<std::wstring, TreeNode*, CaseInsensitiveStringLessThan> children;
+    // The path atom that leads to this node (with the casing it was first inserted with), and its hash code
+    std::wstring atom;
+    DWORD atomHash;
+    // Edges to children, keyed by (a view of) the atom of the child
+    std::unordered_map<PathComponent, TreeNode*, PathComponentHasher, PathComponentComparer> children;
     // Whether the node is an intermediate node or it represents a path that was explicitly inserted
     bool intermediate;
+
+    // The key of this node in the children of its parent
+    PathComponent Key() const { return PathComponent { atom.c_str(), atom.length(), atomHash }; }
 };
 
 // An n-ary tree where nodes are path atoms. Drive letters are at the root and traces in the tree represent paths.
 // This class is not thread safe
 class PathTree {
 public:
-    // Adds a path to the tree. Returns whether the provided path could be properly interpreted.
+    // Adds a path to the tree. Returns whether the provided path could be properly interpreted (which every path can be,
+    // now that paths are split in place, see PathComponentIterator).
     EXPORT bool TryInsert(const std::wstring& path);
 
     // Adds all explicitly inserted descendants of the given path into the given vector
@@ -47,11 +65,11 @@ public:
 
 private:
     // Adds an edge from the given node with the provided atom
-    TreeNode* Append(std::wstring& atom, TreeNode* node, bool isIntermediate);
+    TreeNode* Append(const PathComponent& atom, TreeNode* node, bool isIntermediate);
 
-    // Tries to find the provided path in the current tree. On success, returns the trace in the tree that leads to the
-    // path final atom
-    bool TryFind(const std::wstring& path, std::vector<std::pair<std::wstring, TreeNode*>>& nodeTrace);
+    // Tries to find the provided path in the current tree. On success, returns the trace in the tree (the root first) that
+    // leads to the path final atom
+    bool TryFind(const std::wstring& path, std::vector<TreeNode*>& nodeTrace);
 
     // Removes all descendants from the given node and builds the descendants collection using the given path as a prefix
     void RetrieveAndRemoveAllDescendants(const std::wstring& path, TreeNode* lastNode, std::vector<std::wstring>& descendants);
@@ -5,6 +5,9 @@
 #include "DetoursHelpers.h"
 #include "SendReport.h"
 #include "FilesCheckedForAccess.h"
+#include "ImagePathCache.h"
+
+#include <memory>
 
 bool PolicyResult::Initialize(PCPathChar path)
 {
@@ -21,6 +24,21 @@ bool PolicyResult::Initialize(PCPathChar path)
     return true;
 }
 
+bool PolicyResult::Initialize(PCPathChar path, PolicyResult const* directoryPolicy)
+{
+    assert(m_isIndeterminate);
+    assert(path);
+
+    CanonicalizedPathType canonicalizedPath = CanonicalizedPath::Canonicalize(path);
+    if (canonicalizedPath.IsNull()) {
+        // This policy remains indeterminate.
+        return false;
+    }
+
+    InitializeFromCursor(canonicalizedPath, g_manifestTreeRoot, nullptr, directoryPolicy);
+    return true;
+}
+
 void PolicyResult::Initialize(CanonicalizedPathType const& canonicalizedPath)
 {
     // Initializing from a canonicalized path without a cursor; use the global tree root as the start cursor, and the entire path (without the type prefix)
@@ -31,7 +49,151 @@ void PolicyResult::Initialize(CanonicalizedPathType const& canonicalizedPath)
     InitializeFromCursor(canonicalizedPath, g_manifestTreeRoot, nullptr);
 }
 
-void PolicyResult::InitializeFromCursor(CanonicalizedPathType const& canonicalizedPath, PolicySearchCursor const& policySearchCursor, PCPathChar const searchSuffix)
+bool PolicyResult::InitializePair(PCPathChar path, PCPathChar otherPath, PolicyResult& policy, PolicyResult& otherPolicy)
+{
+    assert(policy.m_isIndeterminate && otherPolicy.m_isIndeterminate);
+    assert(path && otherPath);
+
+    CanonicalizedPathType canonicalizedPath = CanonicalizedPath::Canonicalize(path);
+    CanonicalizedPathType otherCanonicalizedPath = CanonicalizedPath::Canonicalize(otherPath);
+    if (canonicalizedPath.IsNull() || otherCanonicalizedPath.IsNull()) {
+        // The policy that can be determined still is, so that only the other one remains indeterminate.
+        if (!canonicalizedPath.IsNull()) {
+            policy.Initialize(canonicalizedPath);
+        }
+
+        if (!otherCanonicalizedPath.IsNull()) {
+            otherPolicy.Initialize(otherCanonicalizedPath);
+        }
+
+        return false;
+    }
+
+    policy.SetCanonicalizedPath(canonicalizedPath);
+    otherPolicy.SetCanonicalizedPath(otherCanonicalizedPath);
+
+    PCPathChar translatedPath = policy.GetTranslatedPathWithoutTypePrefix();
+    PCPathChar otherTranslatedPath = otherPolicy.GetTranslatedPathWithoutTypePrefix();
+    size_t translatedPathLength = wcslen(translatedPath);
+    size_t otherTranslatedPathLength = wcslen(otherTranslatedPath);
+
+    // The longest directory both paths are under, which is not one ending with a separator (see GetRemainderLengthUnderDirectory)
+    size_t commonLength = 0;
+    for (size_t i = 0; i < translatedPathLength && i < otherTranslatedPathLength && IsPathCharEqual(translatedPath[i], otherTranslatedPath[i]); i++) {
+        if (i > 0 && IsDirectorySeparator(translatedPath[i]) && IsDirectorySeparator(otherTranslatedPath[i]) && !IsDirectorySeparator(translatedPath[i - 1])) {
+            commonLength = i;
+        }
+    }
+
+    if (commonLength == 0) {
+        policy.InitializeFromSearch(translatedPath, translatedPathLength, FindPolicyFromRoot(g_manifestTreeRoot, translatedPath, translatedPathLength, nullptr));
+        otherPolicy.InitializeFromSearch(otherTranslatedPath, otherTranslatedPathLength, FindPolicyFromRoot(g_manifestTreeRoot, otherTranslatedPath, otherTranslatedPathLength, nullptr));
+        return true;
+    }
+
+    PolicySearchCursor directoryCursor = FindDirectoryPolicyFromRoot(g_manifestTreeRoot, translatedPath, translatedPathLength, commonLength);
+    size_t remainderLength = translatedPathLength - commonLength - 1;
+    size_t otherRemainderLength = otherTranslatedPathLength - commonLength - 1;
+    policy.InitializeFromSearch(
+        translatedPath,
+        translatedPathLength,
+        FindFileAccessPolicyInTreeEx(directoryCursor, translatedPath + commonLength + 1, remainderLength));
+    otherPolicy.InitializeFromSearch(
+        otherTranslatedPath,
+        otherTranslatedPathLength,
+        FindFileAccessPolicyInTreeEx(directoryCursor, otherTranslatedPath + commonLength + 1, otherRemainderLength));
+    return true;
+}
+
+// Returns the length of the remainder of 'path' to search for from the cursor of 'directory' (i.e., what follows the separator after
+// 'directory', which may be empty), or -1 if 'path' is not a path under 'directory', or not one whose search can resume from its cursor.
+//
+// A search stops and resumes at path component boundaries, so resuming the search of a directory with the rest of a path under it
+// yields the same cursor as searching the entire path. But leading separators are part of the component that follows them
+// (e.g., \\server), so that only holds when the directory does not end with a separator.
+static ptrdiff_t GetRemainderLengthUnderDirectory(PCPathChar directory, size_t directoryLength, PCPathChar path, size_t pathLength)
+{
+    if (directoryLength == 0 || IsDirectorySeparator(directory[directoryLength - 1])) {
+        return -1;
+    }
+
+    if (directoryLength < pathLength ? !IsDirectorySeparator(path[directoryLength]) : directoryLength > pathLength) {
+        return -1;
+    }
+
+    // Like the policy search, which looks for path components in the tree with NormalizePathChar
+    for (size_t i = 0; i < directoryLength; i++) {
+        if (!IsPathCharEqual(directory[i], path[i])) {
+            return -1;
+        }
+    }
+
+    return directoryLength == pathLength ? 0 : (ptrdiff_t)(pathLength - directoryLength - 1);
+}
+
+// The directory of the last path a thread searched from the root of the tree, and the cursor of that directory
+struct LastDirectoryCursor
+{
+    ManifestRecord const* Root = nullptr;
+    std::wstring Directory;
+    PolicySearchCursor Cursor;
+};
+
+// Allocated on the first search of a thread, so threads that never do any don't pay for it
+static LastDirectoryCursor& GetLastDirectoryCursor()
+{
+    thread_local std::unique_ptr<LastDirectoryCursor> t_lastDirectory;
+    if (!t_lastDirectory) {
+        t_lastDirectory.reset(new LastDirectoryCursor());
+    }
+
+    return *t_lastDirectory;
+}
+
+PolicySearchCursor PolicyResult::FindPolicyFromRoot(PolicySearchCursor const& rootCursor, PCPathChar translatedPath, size_t translatedPathLength, PolicyResult const* directoryPolicy)
+{
+    // The cursor of a policy is only known to be the one of its own (translated) path when no paths are translated:
+    // otherwise it may have been found from the cursor of an untranslated parent (see GetPolicyForSubpath).
+    if (directoryPolicy != nullptr &&
+        !directoryPolicy->IsIndeterminate() &&
+        directoryPolicy->m_policySearchCursor.IsValid() &&
+        g_pManifestTranslatePathTuples->empty()) {
+        PCPathChar directory = directoryPolicy->GetTranslatedPathWithoutTypePrefix();
+        ptrdiff_t remainderLength = GetRemainderLengthUnderDirectory(directory, wcslen(directory), translatedPath, translatedPathLength);
+        if (remainderLength >= 0) {
+            return FindFileAccessPolicyInTreeEx(directoryPolicy->m_policySearchCursor, translatedPath + translatedPathLength - remainderLength, remainderLength);
+        }
+    }
+
+    size_t directoryLength = FindFinalPathSeparator(translatedPath);
+    if (directoryLength == 0 || IsDirectorySeparator(translatedPath[directoryLength - 1])) {
+        return FindFileAccessPolicyInTreeEx(rootCursor, translatedPath, translatedPathLength);
+    }
+
+    size_t remainderLength = translatedPathLength - directoryLength - 1;
+    return FindFileAccessPolicyInTreeEx(
+        FindDirectoryPolicyFromRoot(rootCursor, translatedPath, translatedPathLength, directoryLength),
+        translatedPath + directoryLength + 1,
+        remainderLength);
+}
+
+PolicySearchCursor PolicyResult::FindDirectoryPolicyFromRoot(PolicySearchCursor const& rootCursor, PCPathChar translatedPath, size_t translatedPathLength, size_t directoryLength)
+{
+    LastDirectoryCursor& lastDirectory = GetLastDirectoryCursor();
+    if (lastDirectory.Root != rootCursor.Record ||
+        lastDirectory.Directory.length() != directoryLength ||
+        GetRemainderLengthUnderDirectory(lastDirectory.Directory.c_str(), directoryLength, translatedPath, translatedPathLength) < 0) {
+        // The path to search must be null-terminated: the directory is searched in the copy kept for the next searches
+        lastDirectory.Root = nullptr;
+        lastDirectory.Directory.assign(translatedPath, directoryLength);
+        lastDirectory.Cursor = FindFileAccessPolicyInTreeEx(rootCursor, lastDirectory.Directory.c_str(), directoryLength);
+        lastDirectory.Root = rootCursor.Record;
+    }
+
+    return lastDirectory.Cursor;
+}
+
+void PolicyResult::InitializeFromCursor(CanonicalizedPathType const& canonicalizedPath, PolicySearchCursor const& policySearchCursor, PCPathChar const searchSuffix, PolicyResult const* directoryPolicy)
 {
     assert(m_isIndeterminate);
     assert(m_canonicalizedPath.IsNull());
@@ -39,18 +201,30 @@ void PolicyResult::InitializeFromCursor(CanonicalizedPathType const& canonicaliz
 
     // The path is already canonicalized; now we are committed to set a policy, which doesn't fail.
     // We will do so via special-case rules (no policy search or cursor) or via the policy tree (which is searched, producing a cursor).
-    m_canonicalizedPath = canonicalizedPath;
+    SetCanonicalizedPath(canonicalizedPath);
 
-    TranslateFilePath(std::wstring(canonicalizedPath.GetPathString()), m_translatedPath, false);
     wchar_t const* translatedSearchSuffix = searchSuffix != nullptr ? searchSuffix : GetTranslatedPathWithoutTypePrefix();
     size_t searchSuffixLength = wcslen(translatedSearchSuffix);
 
-    PolicySearchCursor newCursor = FindFileAccessPolicyInTreeEx(policySearchCursor, translatedSearchSuffix, searchSuffixLength);
-    Initialize(canonicalizedPath, newCursor);
+    PolicySearchCursor newCursor = searchSuffix != nullptr
+        ? FindFileAccessPolicyInTreeEx(policySearchCursor, translatedSearchSuffix, searchSuffixLength)
+        : FindPolicyFromRoot(policySearchCursor, translatedSearchSuffix, searchSuffixLength, directoryPolicy);
+    InitializeFromSearch(translatedSearchSuffix, searchSuffixLength, newCursor);
+}
 
-    if (GetSpecialCaseRulesForCoverageAndSpecialDevices(translatedSearchSuffix, searchSuffixLength, canonicalizedPath.Type, /*out*/ m_policy)) {
+void PolicyResult::SetCanonicalizedPath(CanonicalizedPathType const& canonicalizedPath)
+{
+    m_canonicalizedPath = canonicalizedPath;
+    TranslateFilePath(std::wstring(canonicalizedPath.GetPathString()), m_translatedPath, false);
+}
+
+void PolicyResult::InitializeFromSearch(PCPathChar translatedSearchSuffix, size_t searchSuffixLength, PolicySearchCursor const& cursor)
+{
+    Initialize(m_canonicalizedPath, cursor);
+
+    if (GetSpecialCaseRulesForCoverageAndSpecialDevices(translatedSearchSuffix, searchSuffixLength, m_canonicalizedPath.Type, /*out*/ m_policy)) {
 #if SUPER_VERBOSE
-        Dbg(L"match (special case rules.1): %s - policySearchCursor: %x, searchSuffix: %s", canonicalizedPath.GetPathString(), policySearchCursor, searchSuffix);
+        Dbg(L"match (special case rules.1): %s - searchSuffix: %s", m_canonicalizedPath.GetPathString(), translatedSearchSuffix);
 #endif // SUPER_VERBOSE
     }
     else
@@ -58,7 +232,7 @@ void PolicyResult::InitializeFromCursor(CanonicalizedPathType const& canonicaliz
         if (GetSpecialCaseRulesForSpecialTools(translatedSearchSuffix, searchSuffixLength, /*out*/ m_policy))
         {
 #if SUPER_VERBOSE
-            Dbg(L"match (special case rules.2): %s - policySearchCursor: %x, searchSuffix: %s", canonicalizedPath.GetPathString(), policySearchCursor, searchSuffix);
+            Dbg(L"match (special case rules.2): %s - searchSuffix: %s", m_canonicalizedPath.GetPathString(), translatedSearchSuffix);
 #endif // SUPER_VERBOSE
         }
     }
@@ -107,6 +281,10 @@ void PolicyResult::ReportIndeterminatePolicyAndSetLastError(FileOperationContext
 #if !(MAC_OS_SANDBOX) && !(MAC_OS_LIBRARY)
 bool PolicyResult::AllowWrite() const {
 
+    // Every write (creation, replacement, rename or deletion of a file) is checked here first; a write may change what a search
+    // of an application name finds (whether or not it is allowed, since it may proceed anyway).
+    InvalidateImagePathCacheForWrite(m_canonicalizedPath.GetPathString());
+
     bool isWriteAllowedByPolicy = (m_policy & FileAccessPolicy_AllowWrite) != 0;
 
     // Send a special message to managed code if the policy to override allowed writes based on file existence is set
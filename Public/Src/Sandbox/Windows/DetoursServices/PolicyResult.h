@@ -36,12 +36,12 @@ public:
     //
     // It does check the cursor to see if the search was truncated, and if so clears
     // the `FileAccessPolicy_ExactPathPolicies` bits in the stored `m_policy` field.
-    void Initialize(CanonicalizedPathType path, PolicySearchCursor cursor);
+    void Initialize(CanonicalizedPathType const& path, PolicySearchCursor cursor);
 
     PolicyResult(const PolicyResult& other) = default;
     PolicyResult& operator=(const PolicyResult&) = default;
 
-    CanonicalizedPathType Path() const        { return m_canonicalizedPath; }
+    CanonicalizedPathType const& Path() const { return m_canonicalizedPath; }
 
 #if _WIN32
 
@@ -52,7 +52,24 @@ private:
     /// Checks the file access manifest to determine a policy for the given already-canonicalized path.
     /// The policy search is resumed from the given cursor, applying searchSuffix. The path generating policySearchCursor combined with searchSuffix
     /// must be equivalent to canonicalizedPath (we are avoiding wasted work in re-traversing some prefix of canonicalizedPath in the policy tree).
-    void InitializeFromCursor(CanonicalizedPathType const& canonicalizedPath, PolicySearchCursor const& policySearchCursor, PCPathChar const searchSuffix);
+    /// If searchSuffix is null, the search is for the entire path and starts at policySearchCursor (the root of the tree), unless it can resume
+    /// from the cursor of a directory containing the path (see FindPolicyFromRoot).
+    void InitializeFromCursor(CanonicalizedPathType const& canonicalizedPath, PolicySearchCursor const& policySearchCursor, PCPathChar const searchSuffix, PolicyResult const* directoryPolicy = nullptr);
+
+    /// Searches the policy tree from the given root for the given translated path (without type prefix). The search resumes from the cursor of 'directoryPolicy'
+    /// (if any) when the path is under that directory, or else from the cursor of the directory of the last path searched by the thread when
+    /// the path is in the same directory (tools tend to access several files of a directory in a row).
+    static PolicySearchCursor FindPolicyFromRoot(PolicySearchCursor const& rootCursor, PCPathChar translatedPath, size_t translatedPathLength, PolicyResult const* directoryPolicy);
+
+    /// Searches the policy tree from the given root for the directory made of the first directoryLength characters of the given translated path,
+    /// reusing the cursor of the last directory searched by the thread when it is the same directory.
+    static PolicySearchCursor FindDirectoryPolicyFromRoot(PolicySearchCursor const& rootCursor, PCPathChar translatedPath, size_t translatedPathLength, size_t directoryLength);
+
+    /// Sets the canonicalized path and its translation, which is what the policy tree is searched for.
+    void SetCanonicalizedPath(CanonicalizedPathType const& canonicalizedPath);
+
+    /// Completes the initialization with the cursor found for the given (translated) search suffix, to which the special case rules are applied.
+    void InitializeFromSearch(PCPathChar translatedSearchSuffix, size_t searchSuffixLength, PolicySearchCursor const& cursor);
 
 public:
     PolicyResult()
@@ -83,9 +100,21 @@ public:
     /// If 'false' is returned, the caller should fail the access and report the failure with ReportIndeterminatePolicyAndSetLastError.
     bool Initialize(PCPathChar path);
 
+    /// Like Initialize(PCPathChar), for a path that is likely under the path of 'directoryPolicy' (e.g., the root directory of an NtCreateFile call),
+    /// if not null: if it is, the policy search resumes from the cursor of that directory instead of starting from the root of the tree.
+    bool Initialize(PCPathChar path, PolicyResult const* directoryPolicy);
+
     /// Checks the file access manifest to determine a policy for the given already-canonicalized path.
     void Initialize(CanonicalizedPathType const& canonicalizedPath);
 
+    /// Like Initialize(PCPathChar), for the two paths of an operation on a pair of files (e.g., the source and the destination of a copy or a move),
+    /// which usually share a long prefix: the policy tree is searched once for the longest directory both (translated) paths are under, and the
+    /// search of each path resumes from the cursor of that directory.
+    ///
+    /// The return value indicates if policy determination succeeded for both paths. If 'false' is returned, the caller should fail the access
+    /// and report the failure with ReportIndeterminatePolicyAndSetLastError for the policy that is indeterminate.
+    static bool InitializePair(PCPathChar path, PCPathChar otherPath, PolicyResult& policy, PolicyResult& otherPolicy);
+
     // Sends a report with FileAccessStatus_CannotDeterminePolicy and calls SetLastError to indicate failure to callers.
     // This may only be called when Initialize returned false (thus IsIndeterminate), indicating a failure to detemrine policy.
     // TODO: This is a poorly exercised and very exceptional path; for simplicity consider throwing (failfast exception?)
@@ -172,6 +201,7 @@ public:
     bool IndicateUntracked() const { return ((m_policy & FileAccessPolicy_AllowAll) == FileAccessPolicy_AllowAll) && ((m_policy & FileAccessPolicy_ReportAccess) == 0); }
     bool TreatDirectorySymlinkAsDirectory() const { return (m_policy & FileAccessPolicy_TreatDirectorySymlinkAsDirectory) != 0; }
     bool EnableFullReparsePointParsing() const { return (m_policy & FileAccessPolicy_EnableFullReparsePointParsing) != 0; }
+    bool NoReparsePoints() const { return (m_policy & FileAccessPolicy_NoReparsePoints) != 0; }
     DWORD GetPathId() const { return m_policySearchCursor.IsValid() ? m_policySearchCursor.Record->GetPathId() : 0; }
     FileAccessPolicy GetPolicy() const { return m_policy; }
     USN GetExpectedUsn() const { return m_policySearchCursor.GetExpectedUsn(); }
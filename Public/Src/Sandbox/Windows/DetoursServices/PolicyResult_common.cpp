@@ -3,7 +3,7 @@
 
 #include "PolicyResult.h"
 
-PathValidity ProbePathForValidity(CanonicalizedPathType canonicalizedPath) {
+PathValidity ProbePathForValidity(CanonicalizedPathType const& canonicalizedPath) {
 #if _WIN32
     LPCWSTR path = canonicalizedPath.GetPathString();
     // Note that this unfortunately touches the disk, whereas we really just need to validate
@@ -36,7 +36,7 @@ PathValidity ProbePathForValidity(CanonicalizedPathType canonicalizedPath) {
     return PathValidity::Valid; // Optimism!
 }
 
-void PolicyResult::Initialize(CanonicalizedPathType path, PolicySearchCursor cursor)
+void PolicyResult::Initialize(CanonicalizedPathType const& path, PolicySearchCursor cursor)
 {
     assert(IsIndeterminate());
     assert(cursor.IsValid());
@@ -4,54 +4,7 @@
 #include "stdafx.h"
 #include "PolicySearch.h"
 #include "StringOperations.h"
-
-/// GetPartialPathAndRemainder
-///
-/// Takes a path and trims out the first partial path. Because the contract
-/// for this and all functions is not to modify or copy strings, return the
-/// length of the partial path, and the caller will use absolutePath along
-/// with the return value and treat that as if it were the partial path.
-/// Keep in mind that said partial path string is not null-terminated.
-///
-/// Remainder is the string beginning after the dividing path separator.
-///
-/// Returns:
-///     The length of the partial path, not including the null terminator or path separator.
-/// Outputs:
-///     absolutePath (unmodified): The partial path (as a prefix of absolutePath), with no path separator.
-///     remainder: The remainder of the input string after the partial path has been stripped off.
-static size_t GetPartialPathAndRemainder(
-    __in  PCPathChar absolutePath,
-    __in  size_t absolutePathLength,
-    __out PCPathChar& remainder)
-{
-    assert(absolutePath);
-    assert(absolutePathLength == pathlen(absolutePath));
-    
-    size_t found = 0; // look for a path separator or end of string
-    // Skip all the leading PathSeparators.
-    // This is needed for the case of network path ("\\foo-server\bar").
-    while (IsDirectorySeparator(absolutePath[found]))
-    {
-        found++;
-    }
-
-    for (; found < absolutePathLength && !(IsDirectorySeparator(absolutePath[found])); found++);
-
-    remainder = (absolutePath + found);
-
-    if (found < absolutePathLength) {
-        assert(IsDirectorySeparator(remainder[0]) && (remainder[0] != L'\0'));
-        // we found a path separator, and we need to increment the remainder past the path separator
-        remainder++;
-    }
-    else {
-        // absolutely do not increment past the null terminator
-        assert(remainder[0] == L'\0');
-    }
-
-    return found;
-}
+#include "StringOperationsSimd.h"
 
 PolicySearchCursor FindFileAccessPolicyInTreeEx(
     __in  PolicySearchCursor const& cursor,
@@ -73,25 +26,50 @@ PolicySearchCursor FindFileAccessPolicyInTreeEx(
     }
 
     // Terminal cases: Maybe we can't walk further down the tree, or maybe we've matched all of the path.
-    ManifestRecord::BucketCountType numBuckets = cursor.Record->BucketCount;
-    bool isLeaf = numBuckets == 0; // we found a leaf, even if there is more path, we have gone as far as we can
+    // A record of a delta tree that links to a base record is no leaf: its children may all be in the base tree.
+    ManifestRecord::BucketCountType numBuckets = cursor.Record->GetBucketCount();
+    bool overlaysBase = cursor.BaseRoot != nullptr && cursor.Record->HasBaseLink();
+    bool isLeaf = numBuckets == 0 && !overlaysBase; // we found a leaf, even if there is more path, we have gone as far as we can
     bool endOfPath = absolutePath[0] == 0; // no more path to search, wherever we ended up is the node to consider
     if (isLeaf || endOfPath)
     {
-        return PolicySearchCursor(cursor.Record, cursor.Level, cursor.Parent, /*searchWasTruncated*/ !endOfPath);
+        return PolicySearchCursor(cursor.Record, cursor.Level, cursor.Parent, /*searchWasTruncated*/ !endOfPath, cursor.PathFilter, cursor.PathHash, cursor.BaseRoot);
     }
 
-    // We're now committed to tokenizing a further path component, and trying to find a matching child.
-
-    PCPathChar remainder = NULL;
-    size_t partialPathLength = GetPartialPathAndRemainder(absolutePath, absolutePathLength, /*out*/ remainder);
+    // We're now committed to tokenizing a further path component (a prefix of absolutePath, along with its hash; there is one
+    // since the path is not empty), and trying to find a matching child.
+    PathComponentIterator components(absolutePath, absolutePathLength);
+    components.MoveNext();
+    size_t partialPathLength = components.Current().Length;
+    DWORD hash = components.Current().Hash;
+    PCPathChar remainder = components.Remainder();
     assert(absolutePath + partialPathLength <= remainder);
-    assert(remainder >= absolutePath);
     assert(remainder <= absolutePath + absolutePathLength);
 
+    uint32_t childPathHash = 0;
+    bool mayHaveChild = numBuckets != 0;
+    if (cursor.PathFilter != nullptr && mayHaveChild)
+    {
+        // The filter has no false negatives: if it does not have the path of the child, there is no such child.
+        childPathHash = ManifestPathFilter::ExtendPathHash(cursor.PathHash, hash);
+        mayHaveChild = cursor.PathFilter->MayContain(childPathHash);
+    }
+
     PCManifestRecord childRecord = NULL;
-    bool childFound = cursor.Record->FindChild(absolutePath, partialPathLength, /*out*/ childRecord);
-    if (!childFound || childRecord == NULL)
+    bool childFound = mayHaveChild && cursor.Record->FindChild(absolutePath, partialPathLength, hash, /*out*/ childRecord) && childRecord != NULL;
+    PCManifestRecord baseRoot = cursor.BaseRoot;
+    PCManifestPathFilter pathFilter = cursor.PathFilter;
+    if (!childFound && overlaysBase)
+    {
+        // A delta tree leaves out the children that are the same in its base tree: look the child up in the base record, and carry on in the
+        // base tree (which has no links to follow, nor the path filter of the delta tree) if it is there.
+        PCManifestRecord baseRecord = cursor.Record->GetBaseRecord(baseRoot);
+        childFound = baseRecord->GetBucketCount() != 0 && baseRecord->FindChild(absolutePath, partialPathLength, hash, /*out*/ childRecord) && childRecord != NULL;
+        baseRoot = nullptr;
+        pathFilter = nullptr;
+    }
+
+    if (!childFound)
     {
         // There was path to consume, and a chance of finding a child record, but that didn't work.
         // So, this is a third terminal case (but we had to do a bit of work to determine so).
@@ -101,10 +79,13 @@ PolicySearchCursor FindFileAccessPolicyInTreeEx(
     assert(childRecord != NULL);
 
     // childRecord's partialPath is a prefix of remainder.
-    size_t remainderLength = absolutePathLength - (remainder - absolutePath);
+    size_t remainderLength = components.RemainderLength();
     assert(remainderLength == pathlen(remainder));
     // Recursive step: Consume some more of the path, if any. Note that we always recurse with a non-truncated cursor due to the terminal cases above.
-    return FindFileAccessPolicyInTreeEx(PolicySearchCursor(childRecord, cursor.Level + 1, MakePPolicySearchCursor(cursor)), remainder, remainderLength);
+    return FindFileAccessPolicyInTreeEx(
+        PolicySearchCursor(childRecord, cursor.Level + 1, MakePPolicySearchCursor(cursor), /*searchWasTruncated*/ false, pathFilter, childPathHash, baseRoot),
+        remainder,
+        remainderLength);
 }
 
 #ifdef BUILDXL_NATIVES_LIBRARY
@@ -130,6 +111,117 @@ BOOL WINAPI FindFileAccessPolicyInTree(
 }
 #endif // BUILDXL_NATIVES_LIBRARY
 
+/// FindChildInCompactLayout
+///
+/// FindChild for a record whose children are in the compact layout (see ManifestRecord::CompactLayoutFlag).
+/// The child hashes are compared from the home slot of the hash on, a block of CompactLayoutProbeWidth slots
+/// at a time where SSE2 is available, until a block (or slot) is empty. Only the children whose hash matches are touched.
+__success(return)
+static bool FindChildInCompactLayout(
+    __in  PCManifestRecord record,
+    __in  DWORD hash,
+    __in  PCPathChar target,
+    __in  size_t targetLength,
+    __out PCManifestRecord& child)
+{
+    const ManifestRecord::ChildOffsetType* offsets = record->GetChildOffsets();
+    const ManifestRecord::HashType* hashes = record->GetChildHashes();
+    ManifestRecord::BucketCountType index = hash % record->GetHomeSlotCount();
+
+#if SIMD_PATH_OPERATIONS
+    static_assert(ManifestRecord::CompactLayoutProbeWidth * sizeof(ManifestRecord::HashType) == sizeof(__m128i), "A block of slots is probed at once");
+
+    __m128i targetHash = _mm_set1_epi32(static_cast<int>(hash));
+    for (;; index += ManifestRecord::CompactLayoutProbeWidth)
+    {
+        assert(index + ManifestRecord::CompactLayoutProbeWidth <= record->GetBucketCount());
+
+        __m128i blockHashes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(hashes + index));
+        __m128i blockOffsets = _mm_loadu_si128(reinterpret_cast<const __m128i*>(offsets + index));
+        int emptySlots = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(blockOffsets, _mm_setzero_si128())));
+        int matchingSlots = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(blockHashes, targetHash))) & ~emptySlots;
+
+        for (ManifestRecord::BucketCountType i = 0; matchingSlots != 0; i++, matchingSlots >>= 1)
+        {
+            if ((matchingSlots & 1) != 0)
+            {
+                child = record->GetChildRecord(index + i);
+                if (ArePathsEqual(target, child->GetPartialPath(), targetLength))
+                {
+                    return true;
+                }
+            }
+        }
+
+        if (emptySlots != 0)
+        {
+            return false;
+        }
+    }
+#else
+    for (; offsets[index] != 0; index++)
+    {
+        assert(index < record->GetBucketCount());
+
+        if (hashes[index] == hash)
+        {
+            child = record->GetChildRecord(index);
+            if (ArePathsEqual(target, child->GetPartialPath(), targetLength))
+            {
+                return true;
+            }
+        }
+    }
+
+    return false;
+#endif // SIMD_PATH_OPERATIONS
+}
+
+/// GetPathFilter
+///
+/// The filter follows the partial path of the root record, whose serialized size (with its null terminator) is padded to 4 bytes.
+PCManifestPathFilter ManifestRecord::GetPathFilter() const
+{
+    if (!this->HasPathFilter())
+    {
+        return nullptr;
+    }
+
+    PartialPathType partialPath = this->GetPartialPath();
+    size_t partialPathSize = (pathlen(partialPath) + 1) * sizeof(PathChar);
+    partialPathSize = (partialPathSize + 3) & ~static_cast<size_t>(3);
+
+    if (this->HasBaseLink())
+    {
+        partialPathSize += sizeof(ChildOffsetType);
+    }
+
+    PCManifestPathFilter filter = reinterpret_cast<PCManifestPathFilter>(reinterpret_cast<const BYTE *>(partialPath) + partialPathSize);
+    assert(filter->WordCount != 0 && (filter->WordCount & (filter->WordCount - 1)) == 0);
+    return filter;
+}
+
+/// GetBaseRecord
+///
+/// The offset of the base record follows the partial path of the record, whose serialized size (with its null terminator) is padded to 4 bytes.
+PCManifestRecord ManifestRecord::GetBaseRecord(PCManifestRecord baseRoot) const
+{
+    if (!this->HasBaseLink() || baseRoot == nullptr)
+    {
+        return nullptr;
+    }
+
+    PartialPathType partialPath = this->GetPartialPath();
+    size_t partialPathSize = (pathlen(partialPath) + 1) * sizeof(PathChar);
+    partialPathSize = (partialPathSize + 3) & ~static_cast<size_t>(3);
+
+    ChildOffsetType baseOffset = *reinterpret_cast<const ChildOffsetType *>(reinterpret_cast<const BYTE *>(partialPath) + partialPathSize);
+    PCManifestRecord baseRecord = reinterpret_cast<PCManifestRecord>(reinterpret_cast<const BYTE *>(baseRoot) + baseOffset);
+    baseRecord->AssertValid();
+
+    return baseRecord;
+}
+
 /// FindChild
 ///
 /// Search for the given partial path in the children of the given node.
@@ -140,8 +232,22 @@ __in  PCPathChar target,
 __in  size_t targetLength,
 __out PCManifestRecord& child) const
 {
-    DWORD hash = HashPath(target, targetLength);
-    ManifestRecord::BucketCountType numBuckets = this->BucketCount;
+    return this->FindChild(target, targetLength, HashPath(target, targetLength), child);
+}
+
+__success(return)
+bool ManifestRecord::FindChild(
+__in  PCPathChar target,
+__in  size_t targetLength,
+__in  DWORD hash,
+__out PCManifestRecord& child) const
+{
+    if (this->IsCompactLayout())
+    {
+        return FindChildInCompactLayout(this, hash, target, targetLength, child);
+    }
+
+    ManifestRecord::BucketCountType numBuckets = this->GetBucketCount();
 
     // We are searching a hash-table that has been constructed in FileAccessManifest.cs
     ManifestRecord::BucketCountType index = hash % numBuckets;
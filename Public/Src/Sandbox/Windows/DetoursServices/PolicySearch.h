@@ -24,30 +24,48 @@ struct PolicySearchCursor {
 #endif
 
     PolicySearchCursor()
-        : Record(nullptr), Level(0), Parent(nullptr), SearchWasTruncated(true)
+        : Record(nullptr), Level(0), Parent(nullptr), SearchWasTruncated(true), PathFilter(nullptr), PathHash(0), BaseRoot(nullptr)
     {
         assert(!IsValid());
     };
 
     // Implicit conversion constructor to start a search from a manifest record.
+    // A search from the root of a tree that has a path filter uses that filter.
     PolicySearchCursor(ManifestRecord const* record)
-        : Record(record), Level(0), Parent(nullptr), SearchWasTruncated(false)
+        : Record(record), Level(0), Parent(nullptr), SearchWasTruncated(false),
+          PathFilter(record != nullptr ? record->GetPathFilter() : nullptr), PathHash(ManifestPathFilter::RootPathHash), BaseRoot(nullptr)
+    {
+        assert(record != nullptr);
+    }
+
+    // Starts a search from a record of a delta tree overlaid on the base tree rooted at baseRoot (see ManifestRecord::BaseLinkFlag);
+    // a null baseRoot searches the tree of the record alone, as above.
+    PolicySearchCursor(ManifestRecord const* record, ManifestRecord const* baseRoot)
+        : Record(record), Level(0), Parent(nullptr), SearchWasTruncated(false),
+          PathFilter(record != nullptr ? record->GetPathFilter() : nullptr), PathHash(ManifestPathFilter::RootPathHash), BaseRoot(baseRoot)
     {
         assert(record != nullptr);
     }
 
     PolicySearchCursor(ManifestRecord const* record, size_t level, PPolicySearchCursor parent)
-        : Record(record), Level(level), Parent(parent), SearchWasTruncated(false)
+        : Record(record), Level(level), Parent(parent), SearchWasTruncated(false), PathFilter(nullptr), PathHash(0), BaseRoot(nullptr)
     { 
         assert(record != nullptr);
     }
 
     PolicySearchCursor(ManifestRecord const* record, size_t level, PPolicySearchCursor parent, bool searchWasTruncated)
-        : Record(record), Level(level), Parent(parent), SearchWasTruncated(searchWasTruncated)
+        : Record(record), Level(level), Parent(parent), SearchWasTruncated(searchWasTruncated), PathFilter(nullptr), PathHash(0), BaseRoot(nullptr)
     { 
         assert(record != nullptr);
     }
 
+    PolicySearchCursor(ManifestRecord const* record, size_t level, PPolicySearchCursor parent, bool searchWasTruncated, PCManifestPathFilter pathFilter, uint32_t pathHash,
+                       ManifestRecord const* baseRoot = nullptr)
+        : Record(record), Level(level), Parent(parent), SearchWasTruncated(searchWasTruncated), PathFilter(pathFilter), PathHash(pathHash), BaseRoot(baseRoot)
+    {
+        assert(record != nullptr);
+    }
+
     // Gets the expected USN corresponding to this match. Returns -1 if this match was not for the complete
     // path (and so a USN is not known) or if the cursor is invalid.
     USN GetExpectedUsn() const {
@@ -77,6 +95,15 @@ struct PolicySearchCursor {
     // be marked truncated. Resuming a search for "B" should still return C:\foo (for a hypothetical C:\foo\A\B) rather
     // than matching to C:\foo\B.
     bool SearchWasTruncated;
+
+    // The path filter of the tree, if the search started from its root (nullptr otherwise), and the path hash
+    // (see ManifestPathFilter::ExtendPathHash) of Record, with which the paths of its children are looked up in the filter.
+    PCManifestPathFilter PathFilter;
+    uint32_t PathHash;
+
+    // The root of the base tree Record is overlaid on while the search is in a delta tree (nullptr otherwise, including once
+    // the search has moved on to the base tree): see ManifestRecord::BaseLinkFlag.
+    ManifestRecord const* BaseRoot;
 };
 
 // Given a start cursor (which may be the root of a policy tree),
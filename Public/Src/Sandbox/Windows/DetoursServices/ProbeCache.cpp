@@ -0,0 +1,143 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "stdafx.h"
+
+#include "buildXL_mem.h"
+#include "ProbeCache.h"
+#include "UtilityHelpers.h"
+
+static inline LONG64 OutcomeBit(ProbeOutcome outcome)
+{
+    return 1LL << (int)outcome;
+}
+
+static inline LONG StateGeneration(LONG64 state)
+{
+    return (LONG)(state >> 32);
+}
+
+ProbeCache::ProbeCache()
+    : m_generation(0)
+{
+    ZeroMemory(m_slots, sizeof(m_slots));
+}
+
+ProbeCache::~ProbeCache()
+{
+    for (Slot& slot : m_slots) {
+        dd_free(slot.PathEntry);
+    }
+}
+
+ProbeCache::Slot* ProbeCache::FindSlot(const wchar_t* path, size_t length, bool claim)
+{
+    uint64_t hash = CaseInsensitiveStringHasher::Hash(path, length);
+    Entry* newEntry = nullptr;
+
+    for (uint64_t probe = 0; probe < PROBE_CACHE_MAX_PROBES; probe++) {
+        Slot* slot = &m_slots[(hash + probe) & (PROBE_CACHE_SLOTS - 1)];
+
+        // Pairs with the interlocked operation that published the entry, after it was filled.
+        Entry* entry = (Entry*)ReadPointerAcquire((PVOID const volatile*)&slot->PathEntry);
+        if (entry == nullptr) {
+            // Paths are never removed, so the path is not further down either.
+            if (!claim) {
+                return nullptr;
+            }
+
+            if (newEntry == nullptr) {
+                newEntry = (Entry*)dd_malloc(offsetof(Entry, Path) + (length + 1) * sizeof(wchar_t));
+                if (newEntry == nullptr) {
+                    return nullptr;
+                }
+
+                newEntry->Hash = hash;
+                newEntry->Length = length;
+                memcpy(newEntry->Path, path, length * sizeof(wchar_t));
+                newEntry->Path[length] = L'\0';
+            }
+
+            entry = (Entry*)InterlockedCompareExchangePointer((PVOID volatile*)&slot->PathEntry, newEntry, nullptr);
+            if (entry == nullptr) {
+                return slot;
+            }
+
+            // Someone else claimed the slot meanwhile, maybe for the same path.
+        }
+
+        if (entry->Hash == hash && entry->Length == length && CaseInsensitiveStringComparer::AreEqual(entry->Path, path, length)) {
+            dd_free(newEntry);
+            return slot;
+        }
+    }
+
+    dd_free(newEntry);
+    return nullptr;
+}
+
+bool ProbeCache::IsHandled(const wchar_t* path, size_t length, ProbeOutcome outcome)
+{
+    Slot* slot = FindSlot(path, length, false);
+    if (slot == nullptr) {
+        return false;
+    }
+
+    LONG64 state = ReadAcquire64(&slot->State);
+    return StateGeneration(state) == ReadAcquire(&m_generation) && (state & OutcomeBit(outcome)) != 0;
+}
+
+void ProbeCache::SetHandled(const wchar_t* path, size_t length, ProbeOutcome outcome, LONG generation)
+{
+    Slot* slot = FindSlot(path, length, true);
+    if (slot == nullptr) {
+        return;
+    }
+
+    LONG64 state = ReadAcquire64(&slot->State);
+    for (;;) {
+        LONG64 updated = StateGeneration(state) == generation
+            ? state | OutcomeBit(outcome)
+            : ((LONG64)generation << 32) | OutcomeBit(outcome);
+
+        if (updated == state) {
+            return;
+        }
+
+        LONG64 previous = InterlockedCompareExchange64(&slot->State, updated, state);
+        if (previous == state) {
+            return;
+        }
+
+        state = previous;
+    }
+}
+
+void ProbeCache::Invalidate()
+{
+    InterlockedIncrement(&m_generation);
+}
+
+ProbeCache* g_probeCache = NULL;
+
+void InitializeProbeCache() {
+    assert(g_probeCache == NULL);
+    if (CacheProbeResults()) {
+        g_probeCache = new ProbeCache();
+    }
+}
+
+ProbeCache* GetGlobalProbeCache() {
+    return g_probeCache;
+}
+
+void InvalidateProbeCache() {
+    if (g_probeCache != NULL) {
+        g_probeCache->Invalidate();
+    }
+}
+
+void ReleaseProbeCache() {
+    delete g_probeCache;
+    g_probeCache = NULL;
+}
@@ -0,0 +1,84 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include "FileAccessHelpers.h"
+
+// Number of slots of the table (a power of 2), and how many of them a path can go in
+#define PROBE_CACHE_SLOTS 16384
+#define PROBE_CACHE_MAX_PROBES 16
+
+// What a probe of a path found
+enum class ProbeOutcome {
+    Absent = 0,
+    File = 1,
+    Directory = 2,
+};
+
+// The probes (GetFileAttributes(Ex)W, and CreateFileW without any data access) a process already checked and reported, by path and
+// outcome (see FileAccessManifestExtraFlag::CacheProbeResults), so that probing the same path again with the same outcome only costs
+// the real call: the policy of a probe only depends on the path and on whether the probe found a file, a directory or nothing.
+//
+// The paths are the ones passed to the detoured functions, as they were passed (absolute paths only, so that the key does not depend on
+// the current directory), compared case-insensitively; a path probed under two spellings takes two slots.
+//
+// Since the outcome is part of what is recorded, creating or deleting the file itself does not matter, but what is recorded is only valid
+// until the process changes how paths resolve (e.g., replaces a directory with a directory symlink), i.e., whenever the resolved path caches
+// are invalidated (see InvalidateProbeCache). Rather than tracking which paths are affected, every recorded outcome is dropped then, by
+// bumping a generation that each slot is stamped with. Like for the resolved path cache, the changes made by other processes are not seen.
+//
+// Like ReportedAccessCache, the table is a fixed-size, insert-only hash table that does not take any lock: a slot is claimed by publishing
+// an (immutable) entry for the path with a CAS, and its outcomes (with their generation) are updated with interlocked operations.
+// Best effort: when there is no slot left for a path, its probes are always checked.
+class ProbeCache {
+public:
+    ProbeCache();
+    ~ProbeCache();
+
+    // Whether a probe of the path with the given outcome was already checked and reported since the last invalidation.
+    bool IsHandled(const wchar_t* path, size_t length, ProbeOutcome outcome);
+
+    // The current generation, to be read before the real probe and passed to SetHandled.
+    LONG GetGeneration() const { return ReadAcquire(&m_generation); }
+
+    // Records that a probe of the path with the given outcome was checked (and allowed) and reported. 'generation' is the generation
+    // before the probe was made: if the cache has been invalidated since, the outcome is recorded in a stale generation (i.e., dropped).
+    void SetHandled(const wchar_t* path, size_t length, ProbeOutcome outcome, LONG generation);
+
+    // Drops every recorded outcome.
+    void Invalidate();
+
+private:
+    struct Entry {
+        uint64_t Hash;
+        size_t Length;
+        wchar_t Path[1];
+    };
+
+    struct Slot {
+        Entry* volatile PathEntry;
+
+        // The generation the outcomes were recorded in (high 32 bits), and one bit per recorded outcome
+        volatile LONG64 State;
+    };
+
+    // Finds the slot of the path (claiming one if 'claim' is set); returns nullptr if there is none.
+    Slot* FindSlot(const wchar_t* path, size_t length, bool claim);
+
+    volatile LONG m_generation;
+    Slot m_slots[PROBE_CACHE_SLOTS];
+};
+
+// Sets up the cache (if FileAccessManifestExtraFlag::CacheProbeResults is set). Must be called after the manifest has been parsed.
+void InitializeProbeCache();
+
+// Returns the global cache, or NULL if every probe is checked.
+ProbeCache* GetGlobalProbeCache();
+
+// Drops the outcomes recorded by the global cache, if any; called whenever the resolved path caches are invalidated.
+void InvalidateProbeCache();
+
+// Drops the global cache, if any (see ManifestRetarget.h); InitializeProbeCache sets it up again.
+// Only safe when no thread is in a detoured function.
+void ReleaseProbeCache();
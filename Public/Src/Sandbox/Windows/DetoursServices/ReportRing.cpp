@@ -0,0 +1,184 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "stdafx.h"
+
+#include <string>
+
+#include "DebuggingHelpers.h"
+#include "FileAccessHelpers.h"
+#include "globals.h"
+#include "ReportRing.h"
+
+// CODESYNC: DetoursReportRing.cs (section and event names)
+#define REPORT_RING_SECTION_SUFFIX L"_ReportRing"
+#define REPORT_RING_EVENT_SUFFIX L"_ReportRingEvent"
+
+// Most slots ever waiting for the consumer (see GetReportRingHighWaterMark); kept across rings, as a retarget replaces the ring.
+static volatile LONG64 g_reportRingHighWaterMark = 0;
+
+ReportRing::ReportRing(ReportRingHeader* header, HANDLE doorbell)
+    : m_header(header), m_mask(header->SlotCount - 1), m_slotStride(ReportRingSlotHeaderSize + header->SlotSize), m_doorbell(doorbell), m_abandoned(false)
+{
+}
+
+ReportRing* ReportRing::Open(const wchar_t* errorNotificationFile)
+{
+    // Kernel object names don't allow '\\'
+    std::wstring baseName(errorNotificationFile);
+    for (wchar_t& c : baseName) {
+        if (c == L'\\') {
+            c = L'_';
+        }
+    }
+
+    std::wstring sectionName = baseName + REPORT_RING_SECTION_SUFFIX;
+    HANDLE section = OpenFileMappingW(FILE_MAP_READ | FILE_MAP_WRITE, FALSE, sectionName.c_str());
+    if (section == NULL) {
+        Dbg(L"Warning: Could not open the report ring '%s' (GLE=%d); reports are written to the report pipe.", sectionName.c_str(), GetLastError());
+        return NULL;
+    }
+
+    // The view keeps the section alive.
+    void* view = MapViewOfFile(section, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, 0);
+    CloseHandle(section);
+    if (view == NULL) {
+        Dbg(L"Warning: Could not map the report ring '%s' (GLE=%d); reports are written to the report pipe.", sectionName.c_str(), GetLastError());
+        return NULL;
+    }
+
+    MEMORY_BASIC_INFORMATION info;
+    size_t mappedSize = VirtualQuery(view, &info, sizeof(info)) == sizeof(info) ? info.RegionSize : 0;
+    ReportRingHeader* header = (ReportRingHeader*)view;
+    if (mappedSize < ReportRingHeaderSize ||
+        header->Magic != ReportRingMagic ||
+        header->Version != ReportRingVersion ||
+        header->SlotCount == 0 ||
+        (header->SlotCount & (header->SlotCount - 1)) != 0 ||
+        header->SlotSize == 0 ||
+        mappedSize < ReportRingHeaderSize + (size_t)header->SlotCount * (ReportRingSlotHeaderSize + header->SlotSize)) {
+        Dbg(L"Warning: The report ring '%s' is not valid; reports are written to the report pipe.", sectionName.c_str());
+        UnmapViewOfFile(view);
+        return NULL;
+    }
+
+    std::wstring eventName = baseName + REPORT_RING_EVENT_SUFFIX;
+    HANDLE doorbell = OpenEventW(EVENT_MODIFY_STATE, FALSE, eventName.c_str());
+    if (doorbell == NULL) {
+        Dbg(L"Warning: Could not open the report ring event '%s' (GLE=%d); reports are written to the report pipe.", eventName.c_str(), GetLastError());
+        UnmapViewOfFile(view);
+        return NULL;
+    }
+
+    return new ReportRing(header, doorbell);
+}
+
+ReportRing::~ReportRing()
+{
+    UnmapViewOfFile(m_header);
+    CloseHandle(m_doorbell);
+}
+
+bool ReportRing::Enqueue(const void* data, size_t length)
+{
+    uint32_t slotSize = m_header->SlotSize;
+    LONG64 slotsNeeded = length == 0 ? 1 : (LONG64)((length + slotSize - 1) / slotSize);
+    if (slotsNeeded > (LONG64)m_header->SlotCount || m_abandoned) {
+        return false;
+    }
+
+    ULONGLONG fullSince = 0;
+    LONG64 pos = m_header->EnqueuePos;
+    for (DWORD attempt = 0;; attempt++) {
+        LONG64 last = pos + slotsNeeded - 1;
+        LONG64 diff = SlotAt(last)->Sequence - last;
+        if (diff == 0) {
+            LONG64 current = InterlockedCompareExchange64(&m_header->EnqueuePos, pos + slotsNeeded, pos);
+            if (current == pos) {
+                break;
+            }
+
+            pos = current;
+        }
+        else if (diff < 0) {
+            // Full: give the consumer (which cannot be waiting for data at this point) a chance to catch up.
+            ULONGLONG now = GetTickCount64();
+            if (fullSince == 0) {
+                fullSince = now;
+            }
+            else if (now - fullSince > ReportRingFullTimeoutMs) {
+                Dbg(L"Warning: The report ring stayed full for %llu ms; reports are written to the report pipe.", now - fullSince);
+                m_abandoned = true;
+                return false;
+            }
+
+            Sleep(attempt < 16 ? 0 : 1);
+            pos = m_header->EnqueuePos;
+        }
+        else {
+            pos = m_header->EnqueuePos;
+        }
+    }
+
+    // Tells the consumer whose slots these are (see TrySkipAbandonedSlot in DetoursReportRing.cs).
+    LONG pid = (LONG)GetCurrentProcessId();
+    for (LONG64 i = 0; i < slotsNeeded; i++) {
+        SlotAt(pos + i)->ClaimerPid = pid;
+    }
+
+    // The slots claimed so far that the consumer has not released yet, these ones included.
+    LONG64 depth = pos + slotsNeeded - m_header->DequeuePos;
+    LONG64 highWaterMark = g_reportRingHighWaterMark;
+    while (depth > highWaterMark) {
+        LONG64 current = InterlockedCompareExchange64(&g_reportRingHighWaterMark, depth, highWaterMark);
+        if (current == highWaterMark) {
+            break;
+        }
+
+        highWaterMark = current;
+    }
+
+    const char* source = (const char*)data;
+    for (LONG64 i = 0; i < slotsNeeded; i++) {
+        ReportRingSlot* slot = SlotAt(pos + i);
+        uint32_t chunk = (uint32_t)(length < slotSize ? length : slotSize);
+        memcpy((char*)slot + ReportRingSlotHeaderSize, source, chunk);
+        slot->Length = chunk;
+        slot->Flags = i + 1 < slotsNeeded ? ReportRingSlotFlag_Continued : 0;
+
+        // Publishes the slot (the interlocked operation is a full barrier).
+        InterlockedExchange64(&slot->Sequence, pos + i + 1);
+
+        source += chunk;
+        length -= chunk;
+    }
+
+    // The interlocked operation above pairs with the consumer setting ReaderWaiting and then re-checking the ring before waiting.
+    if (m_header->ReaderWaiting != 0 && InterlockedExchange(&m_header->ReaderWaiting, 0) != 0) {
+        SetEvent(m_doorbell);
+    }
+
+    return true;
+}
+
+ReportRing* g_reportRing = NULL;
+
+void InitializeReportRing() {
+    assert(g_reportRing == NULL);
+    if (UseReportRing() && g_internalDetoursErrorNotificationFile != nullptr) {
+        g_reportRing = ReportRing::Open(g_internalDetoursErrorNotificationFile);
+    }
+}
+
+ReportRing* GetGlobalReportRing() {
+    return g_reportRing;
+}
+
+LONG64 GetReportRingHighWaterMark() {
+    return g_reportRingHighWaterMark;
+}
+
+void ReleaseReportRing() {
+    delete g_reportRing;
+    g_reportRing = NULL;
+}
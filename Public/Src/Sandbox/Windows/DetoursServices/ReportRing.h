@@ -0,0 +1,130 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <windows.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A bounded, multi-producer ring of report data living in a section shared by all processes of a pip
+// (see FileAccessManifestExtraFlag::ReportRing). The section, and an auto-reset event used as a doorbell, are created
+// and initialized by BuildXL, which is the only consumer; their names are derived from the internal error notification file
+// (like the name of the message count semaphore).
+//
+// CODESYNC: Public/Src/Engine/Processes/Internal/DetoursReportRing.cs
+//
+// The algorithm is Dmitry Vyukov's bounded MPMC queue (also used by the Linux sandbox, see report_ring.hpp): every slot
+// carries a sequence number; a producer claims position 'pos' by CAS-ing 'enqueuePos' when the sequence number of slot
+// 'pos % slotCount' equals 'pos', copies its data into the slot and publishes it by setting the sequence number to 'pos + 1'.
+// The consumer releases the slot by setting its sequence number to 'pos + slotCount'. Data that does not fit in one slot is
+// put into consecutive slots, all claimed by a single CAS (since the consumer releases slots in order, the last one being free
+// means they all are), with every slot but the last one flagged as being continued by the next one.
+//
+// A producer that is terminated between claiming slots and publishing them would hold back the consumer (and, once the ring is
+// full, every other producer) for good: producers record their pid in the slots they claim, and the consumer skips a slot that
+// stays unpublished for too long when its claimer is gone. Producers in turn only wait for so long for a full ring to drain
+// before they write to the report pipe instead (see ReportRing::Enqueue).
+//
+// Doorbell: when the consumer runs out of data it sets 'readerWaiting' and waits on the event; a producer that publishes data
+// and finds 'readerWaiting' set clears it and signals the event, i.e., the event is only signaled when the consumer may be
+// blocked, not for every report. The report pipe keeps giving the completion semantics: the consumer knows that all reports
+// have been put into the ring once all processes have closed the pipe.
+
+#define ReportRingMagic   0x474e4952 // "RING"
+#define ReportRingVersion 2
+
+#define ReportRingHeaderSize 256
+#define ReportRingSlotHeaderSize 24
+
+// How long a producer waits for a full ring to drain before it gives up on the ring
+#define ReportRingFullTimeoutMs 10000
+
+#define ReportRingSlotFlag_Continued 0x1
+
+typedef struct ReportRingHeader_t
+{
+    uint32_t Magic;
+    uint32_t Version;
+
+    // Number of slots (a power of 2)
+    uint32_t SlotCount;
+
+    // Number of data bytes a slot can hold
+    uint32_t SlotSize;
+
+    uint8_t Padding0[48];
+    volatile LONG64 EnqueuePos;
+
+    // Written only by the consumer
+    uint8_t Padding1[56];
+    volatile LONG64 DequeuePos;
+
+    uint8_t Padding2[56];
+    volatile LONG ReaderWaiting;
+} ReportRingHeader;
+
+typedef struct ReportRingSlot_t
+{
+    volatile LONG64 Sequence;
+
+    // Number of valid bytes in the data following the slot header
+    uint32_t Length;
+    uint32_t Flags;
+
+    // Id of the process that claimed the slot (0 until it is known, reset by the consumer when it releases the slot)
+    volatile LONG ClaimerPid;
+    uint32_t Reserved;
+} ReportRingSlot;
+
+static_assert(sizeof(ReportRingHeader) <= ReportRingHeaderSize, "CODESYNC: DetoursReportRing.cs");
+static_assert(sizeof(ReportRingSlot) == ReportRingSlotHeaderSize, "CODESYNC: DetoursReportRing.cs");
+static_assert(offsetof(ReportRingHeader, EnqueuePos) == 64, "CODESYNC: DetoursReportRing.cs");
+static_assert(offsetof(ReportRingHeader, DequeuePos) == 128, "CODESYNC: DetoursReportRing.cs");
+static_assert(offsetof(ReportRingHeader, ReaderWaiting) == 192, "CODESYNC: DetoursReportRing.cs");
+
+class ReportRing {
+public:
+    // Maps the ring and opens the doorbell event created by BuildXL for the given internal error notification file.
+    // Returns NULL if either cannot be opened or if the section does not contain a valid ring.
+    static ReportRing* Open(const wchar_t* errorNotificationFile);
+
+    // Puts the given data into the ring, waiting for the consumer to make room if needed.
+    // Returns false (without putting anything into the ring) if the data is larger than the whole ring, or if the ring stayed
+    // full for ReportRingFullTimeoutMs (e.g., the consumer is held back by a slot of a process that is suspended), after which
+    // it always returns false: the caller then writes the data (and all the data that follows) to the report pipe, which may
+    // deliver it before data already in the ring, but beats waiting forever.
+    bool Enqueue(const void* data, size_t length);
+
+    // Unmaps the ring; the data put into it stays there for the consumer.
+    ~ReportRing();
+
+private:
+    ReportRing(ReportRingHeader* header, HANDLE doorbell);
+
+    inline ReportRingSlot* SlotAt(LONG64 pos) const
+    {
+        return (ReportRingSlot*)((char*)m_header + ReportRingHeaderSize + ((uint64_t)pos & m_mask) * m_slotStride);
+    }
+
+    ReportRingHeader* m_header;
+    uint64_t m_mask;
+    size_t m_slotStride;
+    HANDLE m_doorbell;
+
+    // Set once this process gave up waiting for the ring to drain (see Enqueue)
+    volatile bool m_abandoned;
+};
+
+// Opens the ring (if FileAccessManifestExtraFlag::ReportRing is set). Must be called after the manifest has been parsed.
+void InitializeReportRing();
+
+// Returns the global ring, or NULL if reports are not put into a ring.
+ReportRing* GetGlobalReportRing();
+
+// Returns the most slots this process ever found waiting for the consumer (its own data included) when it put data into a ring.
+LONG64 GetReportRingHighWaterMark();
+
+// Closes the global ring, if any (see ManifestRetarget.h); InitializeReportRing opens the one of the current manifest.
+// Only safe when no thread is in a detoured function.
+void ReleaseReportRing();
@@ -0,0 +1,63 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "stdafx.h"
+
+#include "ReportStringTable.h"
+
+ReportStringTable::ReportStringTable()
+{
+    InitializeCriticalSection(&m_lock);
+}
+
+ReportStringTable::~ReportStringTable()
+{
+    DeleteCriticalSection(&m_lock);
+}
+
+DWORD ReportStringTable::GetId(const wchar_t* str, size_t length, bool& mustSend) {
+    DWORD id = 0;
+    mustSend = true;
+
+    EnterCriticalSection(&m_lock);
+    auto existing = m_ids.find(std::wstring(str, length));
+    if (existing != m_ids.end()) {
+        id = existing->second;
+        mustSend = !m_sent[id - 1];
+    }
+    else if (m_ids.size() < MaxEntries) {
+        id = (DWORD)m_ids.size() + 1;
+        m_ids.emplace(std::wstring(str, length), id);
+        m_sent.push_back(false);
+    }
+    LeaveCriticalSection(&m_lock);
+
+    return id;
+}
+
+void ReportStringTable::MarkSent(DWORD id) {
+    if (id == 0) {
+        return;
+    }
+
+    EnterCriticalSection(&m_lock);
+    m_sent[id - 1] = true;
+    LeaveCriticalSection(&m_lock);
+}
+
+ReportStringTable* g_reportStringTable = NULL;
+
+void InitializeReportStringTable() {
+    assert(g_reportStringTable == NULL);
+    g_reportStringTable = new ReportStringTable();
+}
+
+ReportStringTable* GetGlobalReportStringTable() {
+    assert(g_reportStringTable != NULL);
+    return g_reportStringTable;
+}
+
+void ReleaseReportStringTable() {
+    delete g_reportStringTable;
+    g_reportStringTable = NULL;
+}
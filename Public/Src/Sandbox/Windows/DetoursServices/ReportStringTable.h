@@ -0,0 +1,45 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <windows.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Assigns process-scoped ids to the strings (paths, operation names) of binary file access reports
+// (see FileAccessManifestExtraFlag::BinaryReports), so that a string is only sent in full the first time it is reported.
+// All operations are thread-safe
+class ReportStringTable {
+public:
+    // Bounds the memory used by the table; strings reported once the table is full are always sent in full.
+    static const DWORD MaxEntries = 64 * 1024;
+
+    ReportStringTable();
+    ~ReportStringTable();
+
+    // Returns the id of the given string, assigning one the first time (0 if the table is full).
+    // mustSend tells whether the string has to be sent along with the id: until a report defining the id has actually
+    // been sent (see MarkSent), every report of the string must define it, since any of them could reach BuildXL first.
+    DWORD GetId(const wchar_t* str, size_t length, bool& mustSend);
+
+    // Records that a report defining the given id (as returned by GetId) has been sent.
+    void MarkSent(DWORD id);
+
+private:
+    std::unordered_map<std::wstring, DWORD> m_ids;
+    std::vector<bool> m_sent; // indexed by id - 1
+    CRITICAL_SECTION m_lock;
+};
+
+// Sets up the table of strings sent in binary file access reports.
+void InitializeReportStringTable();
+
+// Returns a pointer to the global instance of ReportStringTable
+// Assumes InitializeReportStringTable() has been called
+ReportStringTable* GetGlobalReportStringTable();
+
+// Drops the global table (see ManifestRetarget.h): the ids it assigned mean nothing to whoever reads the next report pipe.
+// InitializeReportStringTable sets it up again. Only safe when no thread is in a detoured function.
+void ReleaseReportStringTable();
@@ -0,0 +1,286 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "stdafx.h"
+
+#include <string>
+
+#include "buildXL_mem.h"
+#include "DebuggingHelpers.h"
+#include "globals.h"
+#include "ReportedAccessCache.h"
+#include "UtilityHelpers.h"
+
+// CODESYNC: DetoursSharedReportedAccessCache.cs (section name)
+#define SHARED_REPORTED_ACCESS_CACHE_SECTION_SUFFIX L"_ReportedAccesses"
+
+// Number of bits of the accesses of a combination of 'succeeded' and 'explicitReport'
+#define ACCESS_GROUP_BITS 8
+
+static_assert((int)RequestedAccess::Lookup < (1 << ACCESS_GROUP_BITS), "All requested accesses must fit in a group.");
+
+// CODESYNC: Public/Src/Sandbox/MacOs/Sandbox/Src/CacheRecord.cpp (implies)
+static RequestedAccess Implies(RequestedAccess access)
+{
+    RequestedAccess result = RequestedAccess::None;
+
+    // Probe implies Lookup
+    if ((access & RequestedAccess::Probe) != RequestedAccess::None) {
+        result |= RequestedAccess::Lookup;
+    }
+
+    // Read implies Probe (and, transitively, Lookup)
+    if ((access & RequestedAccess::Read) != RequestedAccess::None) {
+        result |= RequestedAccess::Probe | RequestedAccess::Lookup;
+    }
+
+    // Write implies Read (and, transitively, Probe and Lookup)
+    if ((access & RequestedAccess::Write) != RequestedAccess::None) {
+        result |= RequestedAccess::Read | RequestedAccess::Probe | RequestedAccess::Lookup;
+    }
+
+    return result;
+}
+
+static inline int AccessGroupShift(bool succeeded, bool explicitReport)
+{
+    return ((succeeded ? 2 : 0) + (explicitReport ? 1 : 0)) * ACCESS_GROUP_BITS;
+}
+
+// Records the access in the accesses of a path, returning whether the accesses recorded until then covered it
+static bool RecordAccess(volatile LONG* accesses, RequestedAccess access, bool succeeded, bool explicitReport)
+{
+    LONG accessBits = (LONG)access;
+    LONG recorded = InterlockedOr(accesses, (LONG)(access | Implies(access)) << AccessGroupShift(succeeded, explicitReport));
+
+    // An explicit report is only covered by explicit reports, a non-explicit one by both.
+    LONG covering = (recorded >> AccessGroupShift(succeeded, true)) & ((1 << ACCESS_GROUP_BITS) - 1);
+    if (!explicitReport) {
+        covering |= (recorded >> AccessGroupShift(succeeded, false)) & ((1 << ACCESS_GROUP_BITS) - 1);
+    }
+
+    return (covering & accessBits) == accessBits;
+}
+
+ReportedAccessCache::ReportedAccessCache()
+{
+    ZeroMemory(m_slots, sizeof(m_slots));
+}
+
+ReportedAccessCache::~ReportedAccessCache()
+{
+    for (Slot& slot : m_slots) {
+        dd_free(slot.PathEntry);
+    }
+}
+
+ReportedAccessCache::Slot* ReportedAccessCache::FindOrClaimSlot(const wchar_t* path, size_t length)
+{
+    uint64_t hash = CaseInsensitiveStringHasher::Hash(path, length);
+    Entry* newEntry = nullptr;
+
+    for (uint64_t probe = 0; probe < REPORTED_ACCESS_CACHE_MAX_PROBES; probe++) {
+        Slot* slot = &m_slots[(hash + probe) & (REPORTED_ACCESS_CACHE_SLOTS - 1)];
+
+        // Pairs with the interlocked operation that published the entry, after it was filled.
+        Entry* entry = (Entry*)ReadPointerAcquire((PVOID const volatile*)&slot->PathEntry);
+        if (entry == nullptr) {
+            if (newEntry == nullptr) {
+                newEntry = (Entry*)dd_malloc(offsetof(Entry, Path) + (length + 1) * sizeof(wchar_t));
+                if (newEntry == nullptr) {
+                    return nullptr;
+                }
+
+                newEntry->Hash = hash;
+                newEntry->Length = length;
+                memcpy(newEntry->Path, path, length * sizeof(wchar_t));
+                newEntry->Path[length] = L'\0';
+            }
+
+            entry = (Entry*)InterlockedCompareExchangePointer((PVOID volatile*)&slot->PathEntry, newEntry, nullptr);
+            if (entry == nullptr) {
+                return slot;
+            }
+
+            // Someone else claimed the slot meanwhile, maybe for the same path.
+        }
+
+        if (entry->Hash == hash && entry->Length == length && CaseInsensitiveStringComparer::AreEqual(entry->Path, path, length)) {
+            dd_free(newEntry);
+            return slot;
+        }
+    }
+
+    dd_free(newEntry);
+    return nullptr;
+}
+
+bool ReportedAccessCache::CheckAndUpdate(const wchar_t* path, size_t length, RequestedAccess access, bool succeeded, bool explicitReport)
+{
+    Slot* slot = FindOrClaimSlot(path, length);
+    if (slot == nullptr) {
+        return false;
+    }
+
+    return RecordAccess(&slot->Accesses, access, succeeded, explicitReport);
+}
+
+SharedReportedAccessCache::SharedReportedAccessCache(SharedReportedAccessCacheHeader* header, uint64_t imageHash)
+    : m_header(header), m_mask(header->SlotCount - 1), m_imageHash(imageHash)
+{
+}
+
+static inline uint64_t MixHash(uint64_t hash)
+{
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+// A case-insensitive hash of the path that is independent of CaseInsensitiveStringHasher::Hash (different basis and prime,
+// folded with 'seed')
+static uint64_t CheckHash(const wchar_t* path, size_t length, uint64_t seed)
+{
+    uint64_t hash = 0x84222325cbf29ce4ULL ^ seed;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (uint64_t)towlower(path[i])) * 0x100000001b3ULL + 0x9e3779b97f4a7c15ULL;
+    }
+
+    return MixHash(hash ^ length);
+}
+
+SharedReportedAccessCache* SharedReportedAccessCache::Open(const wchar_t* errorNotificationFile)
+{
+    // Kernel object names don't allow '\\'
+    std::wstring sectionName(errorNotificationFile);
+    for (wchar_t& c : sectionName) {
+        if (c == L'\\') {
+            c = L'_';
+        }
+    }
+
+    sectionName += SHARED_REPORTED_ACCESS_CACHE_SECTION_SUFFIX;
+    HANDLE section = OpenFileMappingW(FILE_MAP_READ | FILE_MAP_WRITE, FALSE, sectionName.c_str());
+    if (section == NULL) {
+        Dbg(L"Warning: Could not open the shared reported access cache '%s' (GLE=%d).", sectionName.c_str(), GetLastError());
+        return NULL;
+    }
+
+    // The view keeps the section alive.
+    void* view = MapViewOfFile(section, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, 0);
+    CloseHandle(section);
+    if (view == NULL) {
+        Dbg(L"Warning: Could not map the shared reported access cache '%s' (GLE=%d).", sectionName.c_str(), GetLastError());
+        return NULL;
+    }
+
+    MEMORY_BASIC_INFORMATION info;
+    size_t mappedSize = VirtualQuery(view, &info, sizeof(info)) == sizeof(info) ? info.RegionSize : 0;
+    SharedReportedAccessCacheHeader* header = (SharedReportedAccessCacheHeader*)view;
+    if (mappedSize < SharedReportedAccessCacheHeaderSize ||
+        header->Magic != SharedReportedAccessCacheMagic ||
+        header->Version != SharedReportedAccessCacheVersion ||
+        header->SlotCount == 0 ||
+        (header->SlotCount & (header->SlotCount - 1)) != 0 ||
+        header->SlotSize != sizeof(SharedReportedAccessCacheSlot) ||
+        mappedSize < SharedReportedAccessCacheHeaderSize + (size_t)header->SlotCount * sizeof(SharedReportedAccessCacheSlot)) {
+        Dbg(L"Warning: The shared reported access cache '%s' is not valid.", sectionName.c_str());
+        UnmapViewOfFile(view);
+        return NULL;
+    }
+
+    // Without its image, a process does not share the accesses it reported.
+    WCHAR imagePath[MAX_PATH];
+    DWORD imagePathLength = GetModuleFileNameW(NULL, imagePath, MAX_PATH);
+    if (imagePathLength == 0 || imagePathLength == MAX_PATH) {
+        Dbg(L"Warning: Could not get the image of the process for the shared reported access cache (GLE=%d).", GetLastError());
+        UnmapViewOfFile(view);
+        return NULL;
+    }
+
+    return new SharedReportedAccessCache(header, CaseInsensitiveStringHasher::Hash(imagePath, imagePathLength));
+}
+
+SharedReportedAccessCache::~SharedReportedAccessCache()
+{
+    UnmapViewOfFile(m_header);
+}
+
+bool SharedReportedAccessCache::CheckAndUpdate(const wchar_t* path, size_t length, RequestedAccess access, bool succeeded, bool explicitReport)
+{
+    LONG64 hash = (LONG64)MixHash(CaseInsensitiveStringHasher::Hash(path, length) ^ MixHash(m_imageHash));
+    if (hash == 0) {
+        hash = 1;
+    }
+
+    LONG64 check = (LONG64)CheckHash(path, length, m_imageHash);
+    if (check == 0) {
+        check = 1;
+    }
+
+    for (uint64_t probe = 0; probe < SharedReportedAccessCacheMaxProbes; probe++) {
+        SharedReportedAccessCacheSlot* slot = SlotAt((uint64_t)hash + probe);
+        LONG64 claimed = ReadAcquire64(&slot->Hash);
+        if (claimed == 0) {
+            // Whoever claims the slot first (maybe for the same path) owns it.
+            claimed = InterlockedCompareExchange64(&slot->Hash, hash, 0);
+            if (claimed == 0) {
+                // Accesses are recorded before the check is published: nobody else can match the slot until then.
+                bool covered = RecordAccess(&slot->Accesses, access, succeeded, explicitReport);
+                InterlockedExchange64(&slot->Check, check);
+                return covered;
+            }
+        }
+
+        if (claimed != hash) {
+            continue;
+        }
+
+        LONG64 claimedCheck = ReadAcquire64(&slot->Check);
+        if (claimedCheck == 0) {
+            // Claimed for this hash, but not published yet: report this access rather than wait.
+            return false;
+        }
+
+        if (claimedCheck == check) {
+            return RecordAccess(&slot->Accesses, access, succeeded, explicitReport);
+        }
+
+        // Another path (or image) with the same hash owns the slot.
+    }
+
+    return false;
+}
+
+ReportedAccessCache* g_reportedAccessCache = NULL;
+SharedReportedAccessCache* g_sharedReportedAccessCache = NULL;
+
+void InitializeReportedAccessCache() {
+    assert(g_reportedAccessCache == NULL && g_sharedReportedAccessCache == NULL);
+    if (ReportOncePerPathAndAccess()) {
+        g_reportedAccessCache = new ReportedAccessCache();
+    }
+
+    if (UseSharedReportedAccesses() && g_internalDetoursErrorNotificationFile != nullptr) {
+        g_sharedReportedAccessCache = SharedReportedAccessCache::Open(g_internalDetoursErrorNotificationFile);
+    }
+}
+
+ReportedAccessCache* GetGlobalReportedAccessCache() {
+    return g_reportedAccessCache;
+}
+
+SharedReportedAccessCache* GetGlobalSharedReportedAccessCache() {
+    return g_sharedReportedAccessCache;
+}
+
+void ReleaseReportedAccessCache() {
+    delete g_reportedAccessCache;
+    g_reportedAccessCache = NULL;
+
+    delete g_sharedReportedAccessCache;
+    g_sharedReportedAccessCache = NULL;
+}
@@ -0,0 +1,142 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include "FileAccessHelpers.h"
+
+// Number of slots of the table (a power of 2), and how many of them a path can go in
+#define REPORTED_ACCESS_CACHE_SLOTS 16384
+#define REPORTED_ACCESS_CACHE_MAX_PROBES 16
+
+// The accesses a process already reported, by path (see FileAccessManifestExtraFlag::ReportOncePerPathAndAccess), so that ReportIfNeeded
+// does not report again an access to a path that the process already reported with the same or a stronger requested access
+// (like CacheRecord::HasStrongerRequestedAccess in the macOS sandbox): Write implies Read, which implies Probe, which implies Lookup.
+//
+// BuildXL only cares about the strongest access of a process to a path, with two exceptions that are taken into account:
+// - whether the access succeeded (e.g., probing an absent file and then the same file once it exists are both reported), and
+// - whether the report is explicit (an explicit report is not covered by a non-explicit one).
+//
+// The table is a fixed-size, insert-only hash table (open addressing over the path hashes) that does not take any lock: a slot
+// is claimed by publishing an (immutable) entry for the path with a CAS, and its accesses are updated with interlocked operations.
+// Best effort: when there is no slot left for a path, its accesses are always reported.
+class ReportedAccessCache {
+public:
+    ReportedAccessCache();
+    ~ReportedAccessCache();
+
+    // Atomically:
+    //   (1) determines whether the given access to the path is covered by the accesses already recorded for the path, and
+    //   (2) if not, records it, so that it covers subsequent identical (or weaker) accesses.
+    // Returns whether the access was covered, i.e., need not be reported.
+    bool CheckAndUpdate(const wchar_t* path, size_t length, RequestedAccess access, bool succeeded, bool explicitReport);
+
+private:
+    struct Entry {
+        uint64_t Hash;
+        size_t Length;
+        wchar_t Path[1];
+    };
+
+    struct Slot {
+        Entry* volatile PathEntry;
+
+        // The recorded accesses (with the accesses they imply), one byte per combination of 'succeeded' and 'explicitReport'
+        volatile LONG Accesses;
+    };
+
+    // Finds (or claims) the slot of the path; returns nullptr if there is no slot left for it.
+    Slot* FindOrClaimSlot(const wchar_t* path, size_t length);
+
+    Slot m_slots[REPORTED_ACCESS_CACHE_SLOTS];
+};
+
+#define SharedReportedAccessCacheMagic   0x43415253 // "SRAC"
+#define SharedReportedAccessCacheVersion 2
+
+#define SharedReportedAccessCacheHeaderSize 64
+#define SharedReportedAccessCacheMaxProbes 16
+
+typedef struct SharedReportedAccessCacheHeader_t
+{
+    uint32_t Magic;
+    uint32_t Version;
+
+    // Number of slots (a power of 2)
+    uint32_t SlotCount;
+
+    // Size of a slot (sizeof(SharedReportedAccessCacheSlot))
+    uint32_t SlotSize;
+} SharedReportedAccessCacheHeader;
+
+typedef struct SharedReportedAccessCacheSlot_t
+{
+    // Hash of the path and of the image of the process (never 0, which marks a free slot)
+    volatile LONG64 Hash;
+
+    // Second hash of the path and image, independent of 'Hash', set right after the slot is claimed (0 until then)
+    volatile LONG64 Check;
+
+    // Like ReportedAccessCache::Slot::Accesses
+    volatile LONG Accesses;
+    uint32_t Reserved;
+} SharedReportedAccessCacheSlot;
+
+static_assert(sizeof(SharedReportedAccessCacheHeader) <= SharedReportedAccessCacheHeaderSize, "CODESYNC: DetoursSharedReportedAccessCache.cs");
+static_assert(sizeof(SharedReportedAccessCacheSlot) == 24, "CODESYNC: DetoursSharedReportedAccessCache.cs");
+
+// The accesses reported by all the processes of a pip (see FileAccessManifestExtraFlag::SharedReportedAccesses), so that the children
+// of a pip (e.g., cmd.exe -> cl.exe -> mspdbsrv.exe) do not report again the accesses their parent (or a sibling) already reported. Accesses
+// are covered like in ReportedAccessCache, which is what each process consults first.
+//
+// CODESYNC: Public/Src/Engine/Processes/Internal/DetoursSharedReportedAccessCache.cs
+//
+// The table lives in a section created (zeroed) by BuildXL under a name derived from the internal error notification file, like
+// SharedReparsePointCache. Paths are only known by two independent (case-insensitive) hashes, which are the same for processes of
+// any bitness: a slot is claimed for the first one with a CAS, and its accesses are updated with interlocked operations. An access
+// is only covered when both hashes match, so that a collision of the first one makes the path be reported rather than dropped.
+// Insert-only and best effort: when there is no slot left for a path, its accesses are reported.
+//
+// Both hashes also cover the image of the process (like the program hash of the Linux SharedReportCache): an access a process
+// reported only covers the same access of processes of the same executable, as what BuildXL does with a report (e.g., match it
+// against the file access allowlist) depends on the executable that made it.
+class SharedReportedAccessCache {
+public:
+    // Maps the table created by BuildXL for the given internal error notification file.
+    // Returns NULL if it cannot be opened or if the section does not contain a valid table.
+    static SharedReportedAccessCache* Open(const wchar_t* errorNotificationFile);
+
+    // Like ReportedAccessCache::CheckAndUpdate, for the whole pip.
+    bool CheckAndUpdate(const wchar_t* path, size_t length, RequestedAccess access, bool succeeded, bool explicitReport);
+
+    // Unmaps the table
+    ~SharedReportedAccessCache();
+
+private:
+    SharedReportedAccessCache(SharedReportedAccessCacheHeader* header, uint64_t imageHash);
+
+    inline SharedReportedAccessCacheSlot* SlotAt(uint64_t index) const
+    {
+        return (SharedReportedAccessCacheSlot*)((char*)m_header + SharedReportedAccessCacheHeaderSize) + (index & m_mask);
+    }
+
+    SharedReportedAccessCacheHeader* m_header;
+    uint64_t m_mask;
+
+    // Case-insensitive hash of the image of this process
+    uint64_t m_imageHash;
+};
+
+// Sets up the cache (if FileAccessManifestExtraFlag::ReportOncePerPathAndAccess is set) and opens the shared one (if
+// FileAccessManifestExtraFlag::SharedReportedAccesses is set). Must be called after the manifest has been parsed.
+void InitializeReportedAccessCache();
+
+// Returns the global cache, or NULL if every access is reported.
+ReportedAccessCache* GetGlobalReportedAccessCache();
+
+// Returns the global cache shared by the processes of the pip, or NULL if they don't share the accesses they reported.
+SharedReportedAccessCache* GetGlobalSharedReportedAccessCache();
+
+// Drops both global caches, if any (see ManifestRetarget.h); InitializeReportedAccessCache sets them up again.
+// Only safe when no thread is in a detoured function.
+void ReleaseReportedAccessCache();
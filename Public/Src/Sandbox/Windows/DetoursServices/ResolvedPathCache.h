@@ -3,13 +3,18 @@
 
 #pragma once
 
+#include <atomic>
 #include <map>
-#include <set>
 #include <memory>
 #include <shared_mutex>
+#include <unordered_map>
 #include <vector>
 
-#include "PathTree.h"
+#include "CacheBudget.h"
+#include "UtilityHelpers.h"
+
+// Memory budget of each of the maps of the resolved path cache (see CacheBudget)
+#define RESOLVED_PATH_CACHE_BUDGET_BYTES (16 * 1024 * 1024)
 
 typedef std::shared_mutex ResolvedPathCacheLock;
 typedef std::unique_lock<ResolvedPathCacheLock> ResolvedPathCacheWriteLock;
@@ -31,28 +36,31 @@ template<typename K> struct Possible
 // Raw pointers are not used because the creation of the object is in a different location than the removal/destruction of the object, and it is hard to know when the last reference will be gone.
 typedef std::pair<std::shared_ptr<std::vector<std::wstring>>, std::shared_ptr<std::map<std::wstring, ResolvedPathType, CaseInsensitiveStringLessThan>>> ResolvedPathCacheEntries;
 
-static CaseInsensitiveStringLessThan caseInsensitiveLessThan = CaseInsensitiveStringLessThan();
-
-// Case insensitive comparer for the target cache to handle pairs (wstring, bool). Delegates the wstrings to
-// the CaseInsensitiveStringLessThan class.
-struct CaseInsensitiveTargetCacheLessThan : public std::binary_function<std::pair<std::wstring, bool>, std::pair<std::wstring, bool>, bool> {
-    bool operator()(const std::pair<std::wstring, bool>& lhs, const std::pair<std::wstring, bool>& rhs) const {
-        if (lhs.second != rhs.second)
-        {
-            return lhs.second;
-        }
-        else
-        {
-            return caseInsensitiveLessThan.operator()(lhs.first, rhs.first);
-        }
-    }
-};
+// Case insensitive hash map keyed by paths: lookups hash the path once and compare it only against the paths in one bucket,
+// rather than doing a case-insensitive comparison against every path on the way down a tree.
+template<typename V> using CaseInsensitivePathMap = std::unordered_map<std::wstring, V, CaseInsensitiveStringHasher, CaseInsensitiveStringComparer>;
 
 // A note on how paths are stored in the cache: Paths coming from detoured functions may vary in casing and may or may not
 // have a trailing slash. Standard path canonicalization done as part of setting up the detours policy does not take care of these 
 // differences, but the resolved path cache should treat those as equivalent paths (e.g C:\foo, C:\FOO and C:\foo\ should be considered equivalent directories).
 // All cache related structures use a case insensitive comparer for paths. Observe this doesn't change any user-facing paths (i.e. 
-// paths reported or used for real accesses)
+// paths reported or used for real accesses). Lookups don't allocate: the trailing slash is only copied away when there is one.
+//
+// Lookups are served first from a small per-thread copy of the results of recent lookups (see ThreadCache), so that a lookup
+// that hits (the common case when resolving the reparse points of a path) does not touch any state shared with other threads:
+// taking m_lock even for reading writes its reader count, which every thread doing lookups would keep stealing from the others.
+// The per-thread copies are stamped with the generation of the cache when they were made, and Invalidate moves the cache to
+// a new generation, which makes all of them stale at once. Only found results are copied: inserts never change a result
+// that was found (they only replace entries that are stale), so they don't need to move the generation.
+//
+// Invalidation is lazy: Invalidate only records the generation at which a path (or a directory and everything under it) was
+// invalidated, and the entries inserted before that generation are treated as absent by lookups, which drop them when they can,
+// and replaced by inserts (see IsStale). This keeps Invalidate, which runs when files are created, moved or deleted, from walking
+// the entries under a directory while holding m_lock exclusively, which would keep every other thread from resolving paths.
+//
+// Each map has a memory budget (see CacheBudget), past which the entries that were not looked up lately are evicted, so that
+// a long-lived process that goes through many paths keeps a bounded cache. Only lookups that go to the maps count as references:
+// the results a thread has copies of are the ones it found lately anyway, and evicting an entry leaves those copies valid.
 class ResolvedPathCache {
 public:
     inline bool InsertResolvingCheckResult(const std::wstring& path, bool result)
@@ -64,18 +72,13 @@ public:
             return false;
         }
 
-        const std::wstring normalizedPath = Normalize(path);
-        if (!m_pathTree.TryInsert(normalizedPath))
-        {
-            return false;
-        }
-
-        return m_resolverCache.emplace(normalizedPath, result).second;
+        return Insert(m_resolverCache, Normalize(path), result);
     }
 
     inline const Possible<bool> GetResolvingCheckResult(const std::wstring& path)
     {
-        return Find(m_resolverCache, Normalize(path));
+        std::wstring buffer;
+        return Find(m_resolverCache, GetThreadCache().ResolverCache, NormalizeForLookup(path, buffer));
     }
 
     inline bool InsertResolvedPathWithType(const std::wstring& path, std::wstring& resolved, DWORD type)
@@ -86,18 +89,13 @@ public:
             return false;
         }
 
-        const std::wstring normalizedPath = Normalize(path);
-        if (!m_pathTree.TryInsert(normalizedPath))
-        {
-            return false;
-        }
-
-        return m_targetCache.emplace(normalizedPath, std::make_pair(resolved, type)).second;
+        return Insert(m_targetCache, Normalize(path), std::make_pair(resolved, type));
     }
 
     inline const Possible<std::pair<std::wstring, DWORD>> GetResolvedPathAndType(const std::wstring& path)
     {
-        return Find(m_targetCache, Normalize(path));
+        std::wstring buffer;
+        return Find(m_targetCache, GetThreadCache().TargetCache, NormalizeForLookup(path, buffer));
     }
 
     inline bool InsertResolvedPaths(
@@ -112,181 +110,404 @@ public:
             return false;
         }
 
-        std::wstring normalizedPath = Normalize(path);
+        return Insert(Paths(preserveLastReparsePointInPath), Normalize(path), std::make_pair(insertion_order, resolved_paths));
+    }
+
+    inline const Possible<ResolvedPathCacheEntries> GetResolvedPaths(const std::wstring& path, bool preserveLastReparsePointInPath)
+    {
+        std::wstring buffer;
+        return Find(
+            Paths(preserveLastReparsePointInPath),
+            GetThreadCache().ResolvedPaths[preserveLastReparsePointInPath ? 1 : 0],
+            NormalizeForLookup(path, buffer));
+    }
+
+    // Invalidates the entries of the path and, if it is a directory, the ones of all paths under it. The entries of the paths
+    // whose resolution went through an invalidated path are invalidated too: if A is a symlink to B, and B is invalidated, so is A,
+    // since removing or recreating B may change what A resolves to.
+    void Invalidate(const std::wstring& path, bool isDirectory)
+    {
+        const std::wstring normalizedPath = Normalize(path);
+        ResolvedPathCacheWriteLock w_lock(m_lock);
+
+        // The invalidations are kept until there are enough of them to make it worth sweeping the stale entries away
+        if (m_invalidations.size() >= MaxInvalidations)
+        {
+            DropStaleEntries();
+        }
+
+        // Makes the results copied by all threads, and all entries inserted so far for the path, stale
+        const uint64_t generation = NextGeneration();
+        m_generation.store(generation, std::memory_order_release);
+
+        Invalidation& invalidation = m_invalidations[normalizedPath];
+        invalidation.Path = generation;
+        if (isDirectory)
+        {
+            // This is for absent path probes, if something probes a\b\c and suddently a\b changes, a\b\c might point somewhere different.  The same is not true for file symlinks
+            invalidation.Tree = generation;
+        }
+    }
+
+    // Drops every entry, and makes the results copied by all threads stale. Used when the process is retargeted (see ManifestRetarget.h):
+    // it can't tell what was created, moved or deleted while it was waiting for the next pip.
+    void Clear()
+    {
+        ResolvedPathCacheWriteLock w_lock(m_lock);
+        Clear(m_resolverCache);
+        Clear(m_targetCache);
+        Clear(m_paths[0]);
+        Clear(m_paths[1]);
+        m_invalidations.clear();
+        m_generation.store(NextGeneration(), std::memory_order_release);
+    }
 
-        if (!m_pathTree.TryInsert(normalizedPath))
+    // Sums the budget counters of the maps
+    void GetBudgetStatistics(size_t& entries, size_t& bytes, size_t& evictions) const
+    {
+        entries = 0;
+        bytes = 0;
+        evictions = 0;
+        for (const CacheBudget* budget : { &m_resolverCache.Budget, &m_targetCache.Budget, &m_paths[0].Budget, &m_paths[1].Budget })
         {
-            return false;
+            entries += budget->Entries();
+            bytes += budget->Bytes();
+            evictions += budget->Evictions();
         }
+    }
+
+    ResolvedPathCache() : m_generation(NextGeneration()) {}
+    ~ResolvedPathCache() = default;
+    ResolvedPathCache(const ResolvedPathCache&) = delete;
+    ResolvedPathCache& operator=(const ResolvedPathCache&) = delete;
+
+    static ResolvedPathCache& Instance()
+    {
+        static ResolvedPathCache instance;
+        return instance;
+    }
+
+private:
+    // Number of results of each kind a thread keeps copies of
+    static const size_t ThreadCacheSize = 64;
+
+    // Number of invalidated paths after which the stale entries are dropped and the invalidations forgotten
+    static const size_t MaxInvalidations = 1024;
+
+    // A value of the cache, with the generation of the cache at which it was known to be valid (see IsStale).
+    // The generation is moved forward by lookups that find the value is still valid, which only hold m_lock for reading.
+    // Referenced and Size are for the eviction of the entry (see EvictWithClock).
+    template<typename V> struct CacheEntry
+    {
+        CacheEntry(uint64_t generation, V&& value) : Generation(generation), Value(std::move(value)), Referenced(true), Size(0) {}
+
+        mutable std::atomic<uint64_t> Generation;
+        V Value;
+        mutable std::atomic<bool> Referenced;
+        size_t Size;
+    };
+
+    template<typename V> struct CacheMap
+    {
+        CacheMap() : Budget(RESOLVED_PATH_CACHE_BUDGET_BYTES) {}
+
+        CaseInsensitivePathMap<CacheEntry<V>> Map;
+        CacheBudget Budget;
+    };
+
+    // The generations at which a path was invalidated (0 if never): Path for the path itself, Tree for everything under it
+    struct Invalidation
+    {
+        uint64_t Path = 0;
+        uint64_t Tree = 0;
+    };
 
-        for (auto iter = resolved_paths->begin(); iter != resolved_paths->end(); ++iter)
+    // A copy of a found result; Generation is 0 for unused entries
+    template<typename V> struct ThreadCacheEntry
+    {
+        uint64_t Generation = 0;
+        size_t Hash = 0;
+        std::wstring Path;
+        V Value;
+    };
+
+    // Direct-mapped (by path hash) copies of the results of the lookups recently done by a thread.
+    // There is one per thread, shared by all instances: the generations of all instances are distinct (see NextGeneration),
+    // so the copies made for one instance are always stale for any other.
+    struct ThreadCache
+    {
+        ThreadCacheEntry<bool> ResolverCache[ThreadCacheSize];
+        ThreadCacheEntry<std::pair<std::wstring, DWORD>> TargetCache[ThreadCacheSize];
+        ThreadCacheEntry<ResolvedPathCacheEntries> ResolvedPaths[2][ThreadCacheSize];
+    };
+
+    // Allocated on the first lookup of a thread, so threads that never do any don't pay for it
+    static ThreadCache& GetThreadCache()
+    {
+        thread_local std::unique_ptr<ThreadCache> t_cache;
+        if (!t_cache)
+        {
+            t_cache.reset(new ThreadCache());
+        }
+
+        return *t_cache;
+    }
+
+    static uint64_t NextGeneration()
+    {
+        static std::atomic<uint64_t> s_lastGeneration(0);
+        return ++s_lastGeneration;
+    }
+
+    // Inserts a value unless there is one for the path already that is not stale. Must be called with m_lock held for writing.
+    template<typename V>
+    bool Insert(CacheMap<V>& map, const std::wstring& normalizedPath, V value)
+    {
+        const uint64_t generation = m_generation.load(std::memory_order_relaxed);
+        auto result = map.Map.try_emplace(normalizedPath, generation, std::move(value));
+        CacheEntry<V>& entry = result.first->second;
+        if (!result.second)
         {
-            if (!m_pathTree.TryInsert(Normalize(iter->first)))
+            if (!IsStale(normalizedPath, entry))
             {
                 return false;
             }
+
+            // try_emplace does not move from the value when the path is already in the map
+            map.Budget.Release(entry.Size);
+            entry.Value = std::move(value);
+            entry.Generation.store(generation, std::memory_order_relaxed);
+            entry.Referenced.store(true, std::memory_order_relaxed);
+        }
+
+        entry.Size = EntrySize(result.first->first, entry.Value);
+        map.Budget.Charge(entry.Size);
+        if (map.Budget.IsOverBudget())
+        {
+            EvictWithClock(map.Map, map.Budget);
         }
 
-        for (auto iter = insertion_order->begin(); iter != insertion_order->end(); ++iter)
+        return true;
+    }
+
+    // Estimates of the memory taken by an entry of a map: its node, and whatever its key and value point to
+    static size_t StringSize(const std::wstring& s)
+    {
+        // Short strings are stored in the string itself
+        return s.capacity() > 7 ? (s.capacity() + 1) * sizeof(wchar_t) : 0;
+    }
+
+    static size_t ValueSize(bool) { return 0; }
+
+    static size_t ValueSize(const std::pair<std::wstring, DWORD>& value) { return StringSize(value.first); }
+
+    static size_t ValueSize(const ResolvedPathCacheEntries& value)
+    {
+        // The objects the shared pointers point to, each with its control block
+        size_t size = 2 * (sizeof(std::vector<std::wstring>) + 2 * sizeof(void*));
+        if (value.first)
         {
-            auto reverseLookup = m_paths_reverse.find(*iter);
-            if (reverseLookup != m_paths_reverse.end())
+            size += value.first->capacity() * sizeof(std::wstring);
+            for (const std::wstring& path : *value.first)
             {
-                reverseLookup->second.insert(normalizedPath);
+                size += StringSize(path);
             }
-            else
+        }
+
+        if (value.second)
+        {
+            for (const auto& resolved : *value.second)
             {
-                std::set<std::wstring, CaseInsensitiveStringLessThan> set = { normalizedPath };
-                m_paths_reverse.emplace(std::make_pair(*iter, set));
+                size += sizeof(resolved) + 4 * sizeof(void*) + StringSize(resolved.first);
             }
         }
 
-        return m_paths.emplace(std::make_pair(normalizedPath, preserveLastReparsePointInPath), std::make_pair(insertion_order, resolved_paths)).second;
+        return size;
     }
 
-    inline const Possible<ResolvedPathCacheEntries> GetResolvedPaths(const std::wstring& path, bool preserveLastReparsePointInPath)
+    template<typename V>
+    static size_t EntrySize(const std::wstring& path, const V& value)
     {
-        return Find(m_paths, std::make_pair(Normalize(path), preserveLastReparsePointInPath));
+        return sizeof(std::pair<const std::wstring, CacheEntry<V>>) + 2 * sizeof(void*) + StringSize(path) + ValueSize(value);
     }
 
-    void Invalidate(const std::wstring& path, bool isDirectory)
+    // Find should not return a pointer, as that memory can become invalid if a different thread adds/removes from the map.
+    // Instead, the value store in the map should be a pointer so that the memory isn't copied.
+    template<typename V>
+    const Possible<V> Find(CacheMap<V>& map, ThreadCacheEntry<V>* threadCache, const std::wstring& path)
     {
-        ResolvedPathCacheWriteLock w_lock(m_lock);
-
-        const std::wstring normalizedPath = Normalize(path);
+        const size_t hash = CaseInsensitiveStringHasher()(path);
+        ThreadCacheEntry<V>& entry = threadCache[hash % ThreadCacheSize];
+        Possible<V> p;
 
-        // Invalidating the back references to this normalized path is important only because by deleting or creating this link other links type (intermediate/fully resolved) may be out of date.
-        InvalidateThisPath(normalizedPath);
+        // Only reads shared state, and m_generation is only written by Invalidate
+        if (entry.Generation == m_generation.load(std::memory_order_acquire)
+            && entry.Hash == hash
+            && CaseInsensitiveStringComparer()(entry.Path, path))
+        {
+            p.Found = true;
+            p.Value = entry.Value;
+            return p;
+        }
 
-        if (isDirectory)
         {
+            ResolvedPathCacheReadLock r_lock(m_lock);
+            auto iter = map.Map.find(path);
+            if (iter == map.Map.end())
+            {
+                p.Found = false;
+                return p;
+            }
 
-            // Invalidate all its descendants
-            // This is for absent path probes, if something probes a\b\c and suddently a\b changes, a\b\c might point somewhere different.  The same is not true for file symlinks
-            std::vector<std::wstring> descendants;
-            m_pathTree.RetrieveAndRemoveAllDescendants(normalizedPath, descendants);
-            for (auto iter = descendants.begin(); iter != descendants.end(); ++iter)
+            if (!IsStale(iter->first, iter->second))
+            {
+                p.Found = true;
+                p.Value = iter->second.Value;
+
+                // Checked first so that entries that keep being found don't keep being written to
+                if (!iter->second.Referenced.load(std::memory_order_relaxed))
+                {
+                    iter->second.Referenced.store(true, std::memory_order_relaxed);
+                }
+
+                // The generation can't move while the lock is held, so the copy is stale as soon as the result may have been invalidated
+                entry.Generation = m_generation.load(std::memory_order_relaxed);
+                entry.Hash = hash;
+                entry.Path = path;
+                entry.Value = iter->second.Value;
+                return p;
+            }
+        }
+
+        // The entry was invalidated: drop it if that doesn't mean waiting for other threads (an insert replaces it otherwise)
+        ResolvedPathCacheWriteLock w_lock(m_lock, std::try_to_lock);
+        if (w_lock.owns_lock())
+        {
+            auto iter = map.Map.find(path);
+            if (iter != map.Map.end() && IsStale(iter->first, iter->second))
             {
-                InvalidateThisPath(*iter);
+                map.Budget.Release(iter->second.Size);
+                map.Map.erase(iter);
             }
         }
+
+        p.Found = false;
+        return p;
     }
 
-    /*
-     * Suppose we have symlink chain A-> B ->C
-     * In m_paths, we have:
-     * A -> [B]      (1)
-     * B -> [C]      (2)
-     * In m_paths_reverse we have:
-     * C -> [B]      (3)
-     * B -> [A]      (4)
-     * 
-     * To invalidate B, we:
-     * Iterate  through (2), and remove B from (3) from m_paths_reverse
-     * Remove (2) from m_paths
-     * Iterate through (4), and remove (1) from m_paths
-     * Remove (4) from m_paths_reverse
-     *
-     * Having the back pointers avoids O(n^2) search to remove the right value from m_paths
-     */
-    void InvalidateThisPath(const std::wstring& path)
+    // Whether an entry was invalidated after it was inserted. Must be called with m_lock held.
+    // An entry that isn't is known to be valid at the current generation, which saves checking it again until the next invalidation.
+    template<typename V>
+    bool IsStale(const std::wstring& normalizedPath, const CacheEntry<V>& entry) const
     {
-        m_resolverCache.erase(path);
-        m_targetCache.erase(path);
-
-        // Erase B from (3)
-        // This must go before 'Erase B from (2)' because it needs to be able to find [C]
-        ErasePathFromReversePaths(path, false);
-        ErasePathFromReversePaths(path, true);
-
-        // Erase B from (2)
-        m_paths.erase(std::make_pair(path, true));
-        m_paths.erase(std::make_pair(path, false));
+        const uint64_t current = m_generation.load(std::memory_order_relaxed);
+        const uint64_t generation = entry.Generation.load(std::memory_order_relaxed);
+        if (generation == current)
+        {
+            return false;
+        }
 
-        // Erase B from (1)
-        // This must go before 'Erase B from (4)' because it needs to be able to find [A]
-        EraseReversePathFromPaths(path);
+        if (IsInvalidatedSince(normalizedPath, generation) || DependsOnPathInvalidatedSince(entry.Value, generation))
+        {
+            return true;
+        }
 
-        // Erase B from (4)
-        m_paths_reverse.erase(path);
+        entry.Generation.store(current, std::memory_order_relaxed);
+        return false;
     }
 
-    /// <summary>
-    /// Given a path, remove the pointers to that path in m_paths_reverse
-    /// </summary>
-    void ErasePathFromReversePaths(const std::wstring& path, bool preserveLastReparsePointInPath)
+    // Only the resolved paths depend on other paths: the ones the resolution went through
+    template<typename V> static bool DependsOnPathInvalidatedSince(const V&, uint64_t) { return false; }
+
+    bool DependsOnPathInvalidatedSince(const ResolvedPathCacheEntries& entries, uint64_t generation) const
     {
-        // Find (B) in (2)
-        auto lookup = m_paths.find(std::make_pair(path, preserveLastReparsePointInPath));
-        if (lookup != m_paths.end())
+        for (const std::wstring& path : *entries.first)
         {
-            // Iterate through [C] in (2)
-            for (auto it = lookup->second.first->begin(), it_next = it; it != lookup->second.first->end(); it = it_next)
+            if (IsInvalidatedSince(path, generation))
             {
-                ++it_next;
-                // Find C in (3)
-                auto reverseLookup = m_paths_reverse.find(*it);
-                if (reverseLookup != m_paths_reverse.end())
-                {
-                    // Remove B from (3)
-                    reverseLookup->second.erase(path);
-                }
+                return true;
             }
         }
+
+        return false;
     }
 
-    /// <summary>
-    /// Given a path, remove pointers to that path in m_paths
-    /// </summary>
-    void EraseReversePathFromPaths(const std::wstring& path)
+    // Whether the path, or a directory it is under, was invalidated after the given generation
+    bool IsInvalidatedSince(const std::wstring& path, uint64_t generation) const
     {
-        // Find (B) in (4)
-        auto reverseLookup = m_paths_reverse.find(path);
-        if (reverseLookup != m_paths_reverse.end())
+        if (m_invalidations.empty())
         {
-            // Iterate through [A] in (4)
-            for (auto it = reverseLookup->second.begin(), it_next = it; it != reverseLookup->second.end(); it = it_next)
+            return false;
+        }
+
+        std::wstring buffer;
+        const std::wstring& normalizedPath = NormalizeForLookup(path, buffer);
+        auto found = m_invalidations.find(normalizedPath);
+        if (found != m_invalidations.end() && found->second.Path > generation)
+        {
+            return true;
+        }
+
+        std::wstring directory;
+        for (size_t length = normalizedPath.length(); length > 0; length--)
+        {
+            if (!IsDirectorySeparator(normalizedPath[length - 1]) || length == 1)
             {
-                ++it_next;
-                // Remove (A) from (1)
-                m_paths.erase(std::make_pair(*it, true));
-                m_paths.erase(std::make_pair(*it, false));
+                continue;
+            }
+
+            directory.assign(normalizedPath, 0, length - 1);
+            found = m_invalidations.find(directory);
+            if (found != m_invalidations.end() && found->second.Tree > generation)
+            {
+                return true;
             }
         }
+
+        return false;
     }
 
-    ResolvedPathCache() = default;
-    ~ResolvedPathCache() = default;
-    ResolvedPathCache(const ResolvedPathCache&) = delete;
-    ResolvedPathCache& operator=(const ResolvedPathCache&) = delete;
+    // Erases the stale entries and forgets the invalidations. Must be called with m_lock held for writing.
+    void DropStaleEntries()
+    {
+        DropStaleEntries(m_resolverCache);
+        DropStaleEntries(m_targetCache);
+        DropStaleEntries(m_paths[0]);
+        DropStaleEntries(m_paths[1]);
+        m_invalidations.clear();
+    }
 
-    static ResolvedPathCache& Instance()
+    template<typename V>
+    void DropStaleEntries(CacheMap<V>& map)
     {
-        static ResolvedPathCache instance;
-        return instance;
+        for (auto iter = map.Map.begin(); iter != map.Map.end();)
+        {
+            if (IsStale(iter->first, iter->second))
+            {
+                map.Budget.Release(iter->second.Size);
+                iter = map.Map.erase(iter);
+            }
+            else
+            {
+                ++iter;
+            }
+        }
     }
 
-private:
-    // Find should not return a pointer, as that memory can become invalid if a different thread adds/removes from the map.
-    // Instead, the value store in the map should be a pointer so that the memory isn't copied.
-    template<typename K, typename V, typename C>
-    const Possible<V> Find(std::map<K, V, C>& map, const K& path)
+    template<typename V>
+    static void Clear(CacheMap<V>& map)
     {
-        ResolvedPathCacheReadLock r_lock(m_lock);
-        auto iter = map.find(path);
-        Possible<V> p;
-        p.Found = iter != map.end();
-        if (p.Found)
+        for (const auto& entry : map.Map)
         {
-            p.Value = iter->second;
+            map.Budget.Release(entry.second.Size);
         }
 
-        return p;
+        map.Map.clear();
     }
 
     // CanonicalPath does not canonicalize trailing slashes for directories
     // But the cache structures need exact string matching, so we do it here
-    inline std::wstring Normalize(const std::wstring& path)
+    static inline std::wstring Normalize(const std::wstring& path)
     {
         if (path.size() > 0 && IsDirectorySeparator(path.back()))
         {
@@ -297,27 +518,45 @@ private:
         return path;
     }
 
+    // Like Normalize, but only copies the path (into the given buffer) when it has to be changed
+    static inline const std::wstring& NormalizeForLookup(const std::wstring& path, std::wstring& buffer)
+    {
+        if (path.size() > 0 && IsDirectorySeparator(path.back()))
+        {
+            buffer.assign(path, 0, path.size() - 1);
+            return buffer;
+        }
+
+        return path;
+    }
+
+    inline CacheMap<ResolvedPathCacheEntries>& Paths(bool preserveLastReparsePointInPath)
+    {
+        return m_paths[preserveLastReparsePointInPath ? 1 : 0];
+    }
+
     ResolvedPathCacheLock m_lock;
 
+    // Generation of the results of the cache (see ThreadCache and IsStale)
+    std::atomic<uint64_t> m_generation;
+
     // A mapping used to cache if base paths need to be resolved (no entry) or have previously been fully resolved
-    std::map<std::wstring, bool, CaseInsensitiveStringLessThan> m_resolverCache;
+    CacheMap<bool> m_resolverCache;
 
     // A mapping used to cache DeviceControl calls when querying targets of reparse points, used to avoid unnecessary I/O
-    std::map<std::wstring, std::pair<std::wstring, DWORD>, CaseInsensitiveStringLessThan> m_targetCache;
+    CacheMap<std::pair<std::wstring, DWORD>> m_targetCache;
 
     // A mapping used to cache all intermediate paths and the final fully resolved path (value) of an unresolved base 
-    // path where its last segment has to be resolved or not(key)
-    std::map<std::pair<std::wstring, bool>, ResolvedPathCacheEntries, CaseInsensitiveTargetCacheLessThan> m_paths;
-
-    // Reverse pointers of m_paths.  If m_paths has A -> B, then m_paths_reverse has B -> A
-    // Used to make removing values faster.
-    std::map<std::wstring, std::set<std::wstring, CaseInsensitiveStringLessThan>, CaseInsensitiveStringLessThan> m_paths_reverse;
+    // path where its last segment has to be resolved or not(key); one map per value of preserveLastReparsePointInPath
+    // (see Paths), so looking up a path does not require building a (path, bool) key
+    CacheMap<ResolvedPathCacheEntries> m_paths[2];
 
-    // All the paths the cache is aware of.
+    // The paths invalidated since the stale entries were last dropped.
     //
-    // This path tree is used for cache invalidation. Suppose that a process accesses D1 and D1\E1 where both D1 and E1 are
-    // symlinks. The cache will have entries for both D1 and D1\E1. If D1 is removed (e.g., by calling RemoveDirectory), then
-    // the entry for D1\E1 in the cache needs to be removed as well. Otherwise, if subsequently the process decides to create
-    // D1\E1 again but D1 points to a different target, then any access of D1\E1 will get the wrong entry from the cache.
-    PathTree m_pathTree;
+    // Suppose that a process accesses D1 and D1\E1 where both D1 and E1 are symlinks. The cache will have entries for both D1
+    // and D1\E1. If D1 is removed (e.g., by calling RemoveDirectory), then the entry for D1\E1 in the cache needs to be invalidated
+    // as well. Otherwise, if subsequently the process decides to create D1\E1 again but D1 points to a different target, then any
+    // access of D1\E1 will get the wrong entry from the cache. Checking the directories of a path against these (rather than
+    // keeping a tree of the paths in the cache to find the ones under a directory) is what lets Invalidate be done in constant time.
+    CaseInsensitivePathMap<Invalidation> m_invalidations;
 };
@@ -0,0 +1,93 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// The performance counters shared by the sandboxes: one schema every sandbox fills from its own counters, so that the
+// host can log comparable numbers for the pips of every platform (see SandboxStats.cs).
+//
+// CODESYNC: Public/Src/Engine/Processes/SandboxStats.cs
+//
+// Every sandbox sends its stats along with the other data it sends at the end of a process (or pip):
+//   - Windows: as the last field of the ReportType_ProcessData report of every process, the values separated by ',';
+//   - macOS: in the PipCompletionStats of the process tree completed report of every pip;
+//   - Linux: as a kAccessRecordKindSandboxStats record, which every process sends before it exits or execs.
+// The host adds them up over the processes of a pip, except for high-water marks (see IsSandboxStatHighWaterMark), of which
+// it keeps the maximum. New stats go at the end: 'count' lets readers take the stats they know of from writers that know
+// more, and the other way around. A sandbox that does not measure a stat leaves it at 0.
+
+#define kSandboxStatsVersion 1
+
+typedef enum
+{
+    // Accesses the sandbox found in (or did not find in, and added to) its caches of already checked or reported accesses
+    kSandboxStatCacheHits = 0,
+    kSandboxStatCacheMisses,
+
+    // Reports sent to the host
+    kSandboxStatReportsSent,
+
+    // Reports not sent on their own because another report (or a summary of several) already stands for them
+    kSandboxStatReportsCoalesced,
+
+    // Bytes of report data sent to the host
+    kSandboxStatBytesSent,
+
+    // Time the sandbox spent intercepting operations, on top of the operations themselves where it can tell them apart
+    kSandboxStatInterposerNs,
+
+    // Most bytes the sandbox had allocated for its own use at once
+    kSandboxStatAllocatedBytes,
+
+    // Most entries (reports, or batches of them) waiting in a report queue at once
+    kSandboxStatQueueHighWater,
+
+    kSandboxStatCount
+} SandboxStat;
+
+typedef struct
+{
+    // kSandboxStatsVersion
+    uint32_t version;
+
+    // Number of 'values' (kSandboxStatCount of the writer)
+    uint32_t count;
+
+    // Indexed by SandboxStat
+    uint64_t values[kSandboxStatCount];
+} SandboxStats;
+
+static_assert(sizeof(SandboxStats) == 8 + 8 * kSandboxStatCount, "CODESYNC: SandboxStats.cs");
+
+// Whether 'stat' is combined by taking the maximum rather than the sum
+inline bool IsSandboxStatHighWaterMark(int stat)
+{
+    return stat == kSandboxStatAllocatedBytes || stat == kSandboxStatQueueHighWater;
+}
+
+// Returns stats with every value at 0
+inline SandboxStats MakeSandboxStats()
+{
+    SandboxStats stats;
+    memset(&stats, 0, sizeof(stats));
+    stats.version = kSandboxStatsVersion;
+    stats.count   = kSandboxStatCount;
+    return stats;
+}
+
+// Adds 'value' to 'stat' (or, for a high-water mark, raises it to 'value')
+inline void AddSandboxStat(SandboxStats& stats, SandboxStat stat, uint64_t value)
+{
+    if (IsSandboxStatHighWaterMark(stat))
+    {
+        stats.values[stat] = stats.values[stat] > value ? stats.values[stat] : value;
+    }
+    else
+    {
+        stats.values[stat] += value;
+    }
+}
@@ -0,0 +1,91 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <memory>
+#include <stddef.h>
+#include <wchar.h>
+
+// Per-thread arena for the temporary strings of a detoured call (e.g., the null-terminated copy of the name of an OBJECT_ATTRIBUTES),
+// so that they don't go to the heap on the hot path of the file APIs. The arena is a bump allocator: strings are released in the
+// reverse order of their allocation, which ScratchString guarantees by being a scoped object that cannot be copied or moved.
+// Strings that don't fit in what remains of the arena go to the heap.
+
+// Number of characters of the arena of a thread
+#define SCRATCH_ARENA_LENGTH 32768
+
+class ScratchArena {
+public:
+    // Allocated on the first use by a thread, so threads that never use it don't pay for it
+    static ScratchArena& GetThreadArena()
+    {
+        thread_local std::unique_ptr<ScratchArena> t_arena;
+        if (!t_arena)
+        {
+            t_arena.reset(new ScratchArena());
+        }
+
+        return *t_arena;
+    }
+
+private:
+    ScratchArena() : m_top(0) { }
+
+    size_t m_top;
+    wchar_t m_chars[SCRATCH_ARENA_LENGTH];
+
+    friend class ScratchString;
+};
+
+// A null-terminated copy of a string, in the scratch arena of the thread when it fits.
+// Only meant to be a local variable of a detoured function.
+class ScratchString {
+public:
+    ScratchString(wchar_t const* chars, size_t length)
+        : m_arena(ScratchArena::GetThreadArena()), m_arenaTop(m_arena.m_top), m_length(length)
+    {
+        if (length < SCRATCH_ARENA_LENGTH - m_arenaTop)
+        {
+            m_chars = m_arena.m_chars + m_arenaTop;
+            m_arena.m_top += length + 1;
+            m_onHeap = false;
+        }
+        else
+        {
+            m_chars = new wchar_t[length + 1];
+            m_onHeap = true;
+        }
+
+        wmemcpy(m_chars, chars, length);
+        m_chars[length] = L'\0';
+    }
+
+    ~ScratchString()
+    {
+        if (m_onHeap)
+        {
+            delete[] m_chars;
+        }
+        else
+        {
+            m_arena.m_top = m_arenaTop;
+        }
+    }
+
+    ScratchString(const ScratchString&) = delete;
+    ScratchString& operator=(const ScratchString&) = delete;
+
+    wchar_t const* c_str() const { return m_chars; }
+    size_t length() const { return m_length; }
+    bool empty() const { return m_length == 0; }
+
+private:
+    ScratchArena& m_arena;
+
+    // Top of the arena before this string was allocated, restored when it's released
+    size_t m_arenaTop;
+    size_t m_length;
+    wchar_t* m_chars;
+    bool m_onHeap;
+};
@@ -7,11 +7,18 @@
 #include <memory>
 
 #include "DataTypes.h"
+#include "DebugMessageRing.h"
 #include "DebuggingHelpers.h"
 #include "DetoursHelpers.h"
+#include "DetourStatistics.h"
+#include "DetoursTracing.h"
 #include "FileAccessHelpers.h"
 #include "SendReport.h"
 #include "PolicyResult.h"
+#include "ReportRing.h"
+#include "ReportStringTable.h"
+#include "ResolvedPathCache.h"
+#include "SandboxStats.h"
 #include "buildXL_mem.h"
 
 using std::unique_ptr;
@@ -19,21 +26,51 @@ using std::unique_ptr;
 extern volatile LONG g_detoursAllocatedNoLockConcurentPoolEntries;
 extern volatile LONG64 g_detoursMaxHandleHeapEntries;
 extern volatile LONG64 g_detoursHandleHeapEntries;
+extern volatile LONG64 g_injectedProcessCount;
+extern volatile LONG64 g_injectionTimeInMicroseconds;
 
 // ----------------------------------------------------------------------------
 // HELPER FUNCTION DEFINITIONS
 // ----------------------------------------------------------------------------
 
-void SendReportString(_In_z_ wchar_t const* dataString)
+// When FileAccessManifestExtraFlag::BatchReports is set, report lines are not written to the report pipe one at a time:
+// they are appended to a per-process batch, which is written out when it is full, right before a child process is created,
+// when the process detaches and, at the latest, REPORT_BATCH_FLUSH_INTERVAL_MS after its first line was added.
+// The message count semaphore is released once per batch, by the number of lines in it, so the managed side (which takes
+// the semaphore once per line it receives) still accounts for every single line.
+// Lines that are still batched when the process is terminated (TerminateProcess) are lost; hence batching is opt-in.
+
+#define REPORT_BATCH_CAPACITY (64 * 1024 / sizeof(wchar_t)) // in characters
+#define REPORT_BATCH_FLUSH_INTERVAL_MS 50
+
+// An SRW lock (rather than a critical section) because it needs no initialization: reports may be sent at any time.
+static SRWLOCK g_reportBatchLock = SRWLOCK_INIT;
+static wchar_t g_reportBatch[REPORT_BATCH_CAPACITY];
+static size_t g_reportBatchLength; // in characters
+static LONG g_reportBatchLineCount;
+static PTP_TIMER g_reportBatchTimer;
+static bool g_reportBatchTimerUnavailable;
+
+// Report lines (and their bytes) sent by this process, for its SandboxStats (see ReportProcessData).
+static volatile LONG64 g_sentReportCount;
+static volatile LONG64 g_sentReportBytes;
+
+static void WriteReportData(_In_reads_(length) wchar_t const* data, size_t length, LONG lineCount)
 {
-    if (g_reportFileHandle == NULL || g_reportFileHandle == INVALID_HANDLE_VALUE) {
-        return;
-    }
+    TraceReportWrite(sizeof(wchar_t) * length, lineCount);
+    InterlockedAdd64(&g_sentReportCount, lineCount);
+    InterlockedAdd64(&g_sentReportBytes, (LONG64)(sizeof(wchar_t) * length));
 
     // Increment the message sent counter.
     if (g_messageCountSemaphore != INVALID_HANDLE_VALUE)
     {
-        ReleaseSemaphore(g_messageCountSemaphore, 1, nullptr);
+        ReleaseSemaphore(g_messageCountSemaphore, lineCount, nullptr);
+    }
+
+    // With a report ring (see ReportRing.h), the pipe is only written to for data larger than the whole ring.
+    ReportRing* ring = GetGlobalReportRing();
+    if (ring != nullptr && ring->Enqueue(data, sizeof(wchar_t) * length)) {
+        return;
     }
 
     OVERLAPPED overlapped;
@@ -42,10 +79,8 @@ void SendReportString(_In_z_ wchar_t const* dataString)
     overlapped.Offset = 0xFFFFFFFF;
     overlapped.OffsetHigh = 0xFFFFFFFF;
 
-    size_t reportLineLength = sizeof(wchar_t) * wcslen(dataString);
     DWORD bytesWritten;
-    DWORD lastError = GetLastError();
-    if (!WriteFile(g_reportFileHandle, dataString, (DWORD)reportLineLength, &bytesWritten, &overlapped))
+    if (!WriteFile(g_reportFileHandle, data, (DWORD)(sizeof(wchar_t) * length), &bytesWritten, &overlapped))
     {
         DWORD error = GetLastError();
         Dbg(L"Failed to write file access report line: %08X. Exiting with code %d.", (int)error, DETOURS_PIPE_WRITE_ERROR_4);
@@ -53,8 +88,231 @@ void SendReportString(_In_z_ wchar_t const* dataString)
         fwprintf(stderr, L"Failed to write file access report line: %08X. Exiting with code %d.", (int)error, DETOURS_PIPE_WRITE_ERROR_4);
         HandleDetoursInjectionAndCommunicationErrors(DETOURS_PIPE_WRITE_ERROR_4, L"Failure writing message to pipe: exit(-46).", DETOURS_WINDOWS_LOG_MESSAGE_4);
     }
+}
+
+// Must be called with g_reportBatchLock held.
+static void FlushReportBatchLocked()
+{
+    if (g_reportBatchLength == 0) {
+        return;
+    }
+
+    WriteReportData(g_reportBatch, g_reportBatchLength, g_reportBatchLineCount);
+    g_reportBatchLength = 0;
+    g_reportBatchLineCount = 0;
+}
+
+static VOID CALLBACK ReportBatchTimerCallback(PTP_CALLBACK_INSTANCE instance, PVOID context, PTP_TIMER timer)
+{
+    UNREFERENCED_PARAMETER(instance);
+    UNREFERENCED_PARAMETER(context);
+    UNREFERENCED_PARAMETER(timer);
+
+    FlushReportBatch();
+}
 
+// Schedules a flush of the batch REPORT_BATCH_FLUSH_INTERVAL_MS from now. Must be called with g_reportBatchLock held.
+// Returns false if no timer could be created, in which case lines must not be batched (nothing would bound their delay).
+static bool ArmReportBatchTimer()
+{
+    if (g_reportBatchTimer == nullptr) {
+        g_reportBatchTimer = CreateThreadpoolTimer(ReportBatchTimerCallback, nullptr, nullptr);
+        if (g_reportBatchTimer == nullptr) {
+            Dbg(L"Warning: Could not create the report batch timer (GLE=%d); reports will not be batched.", GetLastError());
+            g_reportBatchTimerUnavailable = true;
+            return false;
+        }
+    }
+
+    // Negative due times are relative, in 100 nanosecond units.
+    ULARGE_INTEGER dueTime;
+    dueTime.QuadPart = (ULONGLONG)(-((LONGLONG)REPORT_BATCH_FLUSH_INTERVAL_MS * 10000));
+    FILETIME fileDueTime;
+    fileDueTime.dwHighDateTime = dueTime.HighPart;
+    fileDueTime.dwLowDateTime = dueTime.LowPart;
+    SetThreadpoolTimer(g_reportBatchTimer, &fileDueTime, 0, 0);
+    return true;
+}
+
+static void AddToReportBatch(_In_reads_(length) wchar_t const* dataString, size_t length)
+{
+    AcquireSRWLockExclusive(&g_reportBatchLock);
+
+    if (g_reportBatchLength + length > REPORT_BATCH_CAPACITY) {
+        FlushReportBatchLocked();
+    }
+
+    if (length > REPORT_BATCH_CAPACITY || (g_reportBatchLength == 0 && !ArmReportBatchTimer())) {
+        // Does not fit in a batch (or cannot be batched): the batch is empty at this point, so lines stay in order.
+        WriteReportData(dataString, length, 1);
+    }
+    else {
+        wmemcpy(g_reportBatch + g_reportBatchLength, dataString, length);
+        g_reportBatchLength += length;
+        g_reportBatchLineCount++;
+    }
+
+    ReleaseSRWLockExclusive(&g_reportBatchLock);
+}
+
+void SendReportString(_In_z_ wchar_t const* dataString)
+{
+    if (g_reportFileHandle == NULL || g_reportFileHandle == INVALID_HANDLE_VALUE) {
+        return;
+    }
+
+    DWORD lastError = GetLastError();
+    size_t reportLineLength = wcslen(dataString); // in characters
+
+    if (BatchReports() && !g_reportBatchTimerUnavailable) {
+        AddToReportBatch(dataString, reportLineLength);
+    }
+    else {
+        WriteReportData(dataString, reportLineLength, 1);
+    }
+
+    SetLastError(lastError);
+}
+
+void FlushReportBatch(bool processDetaching)
+{
+    // Debug messages are not report lines (they are not counted by the message count semaphore), but are flushed along with them.
+    FlushDebugMessages(processDetaching);
+
+    if (!BatchReports() || g_reportFileHandle == NULL || g_reportFileHandle == INVALID_HANDLE_VALUE) {
+        return;
+    }
+
+    if (processDetaching) {
+        if (!TryAcquireSRWLockExclusive(&g_reportBatchLock)) {
+            Dbg(L"Warning: Report batch lock held by an exited thread; dropping %d batched report lines.", g_reportBatchLineCount);
+            return;
+        }
+    }
+    else {
+        AcquireSRWLockExclusive(&g_reportBatchLock);
+    }
+
+    DWORD lastError = GetLastError();
+    FlushReportBatchLocked();
     SetLastError(lastError);
+
+    ReleaseSRWLockExclusive(&g_reportBatchLock);
+}
+
+// When FileAccessManifestExtraFlag::BinaryReports is set, file accesses are reported as compact records rather than as
+// '|' separated hex fields (CODESYNC: Public/Src/Engine/Processes/FileAccessReportRecordParser.cs).
+//
+// A record is sent as the report line "<ReportType_FileAccessRecord>,<body>\r\n". The body is made of numbers, each
+// encoded as a sequence of digits: UTF-16 code units in [0x4000, 0xC000), which can neither be taken for line ends nor
+// be altered by the decoder on the managed side (they are not surrogates). A digit carries 14 bits of the number (least
+// significant first), plus 0x4000 if more digits follow. The body holds, in this order:
+//   - the version of the record format (REPORT_RECORD_VERSION)
+//   - the process id, id, correlation id, requested access, status, whether the access is explicitly reported, error,
+//     USN, desired access, share mode, creation disposition, flags and attributes, opened file or directory attributes
+//     and manifest path id
+//   - the operation, the path, the enumerate filter and the process arguments, each as a string reference: a number
+//     (id << 1, plus 1 if the string follows) and, if the string follows, its length and its UTF-16 code units.
+//     A string sent along with an id other than 0 is what that id stands for in all further reports of the process
+//     (see ReportStringTable), so repeated paths are sent as ids only.
+
+#define REPORT_RECORD_VERSION 1
+#define REPORT_RECORD_MAX_NUMBER_CHARS 5 // 64 bits, 14 bits per digit
+
+static wchar_t* AppendReportNumber(wchar_t* p, ULONGLONG value)
+{
+    do {
+        wchar_t digit = (wchar_t)(0x4000 + (value & 0x3FFF));
+        value >>= 14;
+        *p++ = value != 0 ? (wchar_t)(digit + 0x4000) : digit;
+    } while (value != 0);
+
+    return p;
+}
+
+static wchar_t* AppendReportString(wchar_t* p, DWORD id, bool send, _In_reads_(length) wchar_t const* str, size_t length)
+{
+    p = AppendReportNumber(p, ((ULONGLONG)id << 1) | (send ? 1 : 0));
+    if (send) {
+        p = AppendReportNumber(p, length);
+        wmemcpy(p, str, length);
+        p += length;
+    }
+
+    return p;
+}
+
+static void ReportFileAccessRecord(
+    FileOperationContext const& fileOperationContext,
+    FileAccessStatus status,
+    PolicyResult const& policyResult,
+    AccessCheckResult const& accessCheckResult,
+    DWORD error,
+    USN usn,
+    PCWSTR fileName,
+    size_t fileNameLength,
+    PCWSTR filterStr,
+    size_t filterLength)
+{
+    ReportStringTable* strings = GetGlobalReportStringTable();
+
+    size_t operationLength = wcslen(fileOperationContext.Operation);
+    bool sendOperation, sendPath;
+    DWORD operationId = strings->GetId(fileOperationContext.Operation, operationLength, sendOperation);
+    DWORD pathId = strings->GetId(fileName, fileNameLength, sendPath);
+
+    // See ReportFileAccess regarding when the command line is reported and why it must not contain line ends.
+    std::wstring commandLine;
+    if (ReportProcessArgs() && !_wcsicmp(fileOperationContext.Operation, L"Process")) {
+        commandLine.assign(g_currentProcessCommandLine);
+        std::replace(commandLine.begin(), commandLine.end(), L'\r', L' ');
+        std::replace(commandLine.begin(), commandLine.end(), L'\n', L' ');
+    }
+
+    // Report type and ',', 15 numbers, 4 string references (id and length) and "\r\n\0", plus the strings.
+    size_t reportBufferSize = 2 + (15 + 4 * 2) * REPORT_RECORD_MAX_NUMBER_CHARS + 3
+        + (sendOperation ? operationLength : 0) + (sendPath ? fileNameLength : 0) + filterLength + commandLine.length(); // in characters
+
+    unique_ptr<wchar_t[]> report(new wchar_t[reportBufferSize]);
+    assert(report.get());
+
+    wchar_t* p = report.get();
+    *p++ = L'0' + (wchar_t)ReportType::ReportType_FileAccessRecord;
+    *p++ = L',';
+    p = AppendReportNumber(p, REPORT_RECORD_VERSION);
+    p = AppendReportNumber(p, g_currentProcessId);
+    p = AppendReportNumber(p, fileOperationContext.Id);
+    p = AppendReportNumber(p, fileOperationContext.CorrelationId);
+    p = AppendReportNumber(p, (ULONGLONG)accessCheckResult.Access);
+    p = AppendReportNumber(p, (ULONGLONG)status);
+    p = AppendReportNumber(p, accessCheckResult.Level == ReportLevel::ReportExplicit ? 1 : 0);
+    p = AppendReportNumber(p, error);
+    p = AppendReportNumber(p, (ULONGLONG)usn);
+    p = AppendReportNumber(p, fileOperationContext.DesiredAccess);
+    p = AppendReportNumber(p, fileOperationContext.ShareMode);
+    p = AppendReportNumber(p, fileOperationContext.CreationDisposition);
+    p = AppendReportNumber(p, fileOperationContext.FlagsAndAttributes);
+    p = AppendReportNumber(p, fileOperationContext.OpenedFileOrDirectoryAttributes);
+    p = AppendReportNumber(p, policyResult.IsIndeterminate() ? 0 : policyResult.GetPathId());
+    p = AppendReportString(p, operationId, sendOperation, fileOperationContext.Operation, operationLength);
+    p = AppendReportString(p, pathId, sendPath, fileName, fileNameLength);
+    p = AppendReportString(p, 0, true, filterStr, filterLength);
+    p = AppendReportString(p, 0, true, commandLine.c_str(), commandLine.length());
+    *p++ = L'\r';
+    *p++ = L'\n';
+    *p = L'\0';
+    assert((size_t)(p - report.get()) < reportBufferSize);
+
+    SendReportString(report.get());
+
+    // Only now can other reports of these strings leave them out (see ReportStringTable::GetId).
+    if (sendOperation) {
+        strings->MarkSent(operationId);
+    }
+
+    if (sendPath) {
+        strings->MarkSent(pathId);
+    }
 }
 
 // ----------------------------------------------------------------------------
@@ -102,6 +360,12 @@ void ReportFileAccess(
     size_t filterLength = wcslen(filterStr); // in characters
     size_t fileProcessCommandLineLength = wcslen(g_currentProcessCommandLine); // in characters
     size_t operationLen = wcslen(fileOperationContext.Operation); // in characters
+
+    if (BinaryReports()) {
+        ReportFileAccessRecord(fileOperationContext, status, policyResult, accessCheckResult, error, usn, fileName, fileNameLength, filterStr, filterLength);
+        return;
+    }
+
     size_t reportBufferSize = fileNameLength + filterLength + fileProcessCommandLineLength + operationLen + 116; // in characters
 
     // Adding 116 should be enough for now since the max values for the members of the message are:
@@ -299,6 +563,137 @@ void ReportProcessDetouringStatus(
     }
 }
 
+void ReportDetourStatistics()
+{
+    if (g_reportFileHandle == NULL || g_reportFileHandle == INVALID_HANDLE_VALUE)
+    {
+        return;
+    }
+
+    ULONG64 lookups = 0;
+    ULONG64 shouldResolveReparsePointHits = 0;
+    ULONG64 reparsePointTargetHits = 0;
+    ULONG64 resolvedPathsHits = 0;
+    for (size_t i = 0; i < PATH_CACHE_STATISTICS_STRIPES; i++)
+    {
+        lookups += g_pathCacheStatistics[i].Lookups;
+        shouldResolveReparsePointHits += g_pathCacheStatistics[i].ShouldResolveReparsePointCacheHitCount;
+        reparsePointTargetHits += g_pathCacheStatistics[i].ReparsePointTargetCacheHitCount;
+        resolvedPathsHits += g_pathCacheStatistics[i].ResolvedPathsCacheHitCount;
+    }
+
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+
+    // The report is "<type>,<pid>|<path cache lookups>|<hits by cache>...|<function>:<calls>:<microseconds>|...",
+    // with only the functions that were called.
+    wchar_t buffer[128];
+    int length = swprintf_s(buffer, L"%u,%lu|%I64u|%I64u|%I64u|%I64u",
+        ReportType::ReportType_DetourStatistics,
+        GetCurrentProcessId(),
+        lookups,
+        shouldResolveReparsePointHits,
+        reparsePointTargetHits,
+        resolvedPathsHits);
+    assert(length > 0);
+
+    std::wstring report(buffer, length > 0 ? length : 0);
+    for (int id = 0; id < DetourStatisticsId_Count; id++)
+    {
+        ULONG64 calls;
+        ULONG64 ticks;
+        SumDetourStatistics((DetourStatisticsId)id, calls, ticks);
+        if (calls == 0)
+        {
+            continue;
+        }
+
+        ULONG64 microseconds = (ticks / frequency.QuadPart) * 1000000 + (ticks % frequency.QuadPart) * 1000000 / frequency.QuadPart;
+        length = swprintf_s(buffer, L"|%S:%I64u:%I64u", GetDetourStatisticsName((DetourStatisticsId)id), calls, microseconds);
+        if (length > 0)
+        {
+            report.append(buffer, length);
+        }
+    }
+
+    report.append(L"\r\n");
+    SendReportString(report.c_str());
+}
+
+void ReportDirectoryEnumerationSummary(
+    wchar_t const* directory,
+    wchar_t const* filter,
+    uint64_t entryCount,
+    uint64_t membershipHash)
+{
+    if (g_reportFileHandle == NULL || g_reportFileHandle == INVALID_HANDLE_VALUE)
+    {
+        return;
+    }
+
+    // The report is "<type>,<pid>|<entry count>|<membership hash>|<directory>|<filter>"; neither paths nor filters contain '|'
+    wchar_t buffer[64];
+    int length = swprintf_s(buffer, L"%u,%lu|%I64x|%I64x|",
+        ReportType::ReportType_DirectoryEnumerationSummary,
+        g_currentProcessId,
+        entryCount,
+        membershipHash);
+    assert(length > 0);
+
+    std::wstring report(buffer, length > 0 ? length : 0);
+    report.append(directory);
+    report.push_back(L'|');
+    if (filter != nullptr)
+    {
+        report.append(filter);
+    }
+
+    report.append(L"\r\n");
+    SendReportString(report.c_str());
+}
+
+// Renders the stats of this process, in the schema shared by the sandboxes (see SandboxStats.h), as the values separated by ','.
+// Detours has no cache of reported accesses and sends every report on its own: the resolved path cache stands for the cache,
+// and no report is ever coalesced.
+static void FormatSandboxStats(ULONG64 pathCacheLookups, ULONG64 pathCacheHits, LONG64 detoursMaxMemHeapSize, wchar_t* buffer, size_t bufferSize)
+{
+    SandboxStats stats = MakeSandboxStats();
+    stats.values[kSandboxStatCacheHits]      = pathCacheHits;
+    stats.values[kSandboxStatCacheMisses]    = pathCacheLookups > pathCacheHits ? pathCacheLookups - pathCacheHits : 0;
+    stats.values[kSandboxStatReportsSent]    = (uint64_t)g_sentReportCount;
+    stats.values[kSandboxStatBytesSent]      = (uint64_t)g_sentReportBytes;
+    stats.values[kSandboxStatAllocatedBytes] = (uint64_t)detoursMaxMemHeapSize;
+    stats.values[kSandboxStatQueueHighWater] = (uint64_t)GetReportRingHighWaterMark();
+
+    // Only measured with CollectDetourStatistics (see DetourStatistics.h), and including the time of the real calls of the
+    // innermost detours.
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    ULONG64 ticks = 0;
+    for (int id = 0; id < DetourStatisticsId_Count; id++)
+    {
+        ULONG64 calls;
+        ULONG64 detourTicks;
+        SumDetourStatistics((DetourStatisticsId)id, calls, detourTicks);
+        ticks += detourTicks;
+    }
+
+    stats.values[kSandboxStatInterposerNs] = (ticks / frequency.QuadPart) * 1000000000 + (ticks % frequency.QuadPart) * 1000000000 / frequency.QuadPart;
+
+    size_t length = 0;
+    buffer[0] = L'\0';
+    for (uint32_t i = 0; i < stats.count; i++)
+    {
+        int written = swprintf_s(buffer + length, bufferSize - length, i == 0 ? L"%I64u" : L",%I64u", stats.values[i]);
+        if (written < 0)
+        {
+            break;
+        }
+
+        length += written;
+    }
+}
+
 void ReportProcessData(
     IO_COUNTERS const& ioCounters,
     FILETIME const& creationTime,
@@ -326,9 +721,13 @@ void ReportProcessData(
     // exit time, and the kernel and user mode execution times. They have a high and low DWORD value.
     // There is 1 32 bit process exit code.
     // There is 1 32 bit parent process id.
-    // There are 29 separators for the "," and "|" characters. (30 values total gives us 29 separators)
+    // There are 36 separators for the "," and "|" characters. (34 values total gives us 33 separators)
     // There are 5 * 64 bit and 2 * 32 bit for detours max memory heap size * and payload size, final heap allocated, max and final HandleHeapEntries, allocated pool entries for the non-locking list.
+    // There are 2 * 64 bit for the lookups and hits of the resolved path cache.
+    // There are 2 * 64 bit for the number of injected child processes and the time it took to inject them.
+    // There are 3 * 64 bit for the entries, (estimated) bytes and evictions of the resolved path cache.
     // There are 6 * 64 bit for the max allocated/reallocated, virtual allocated data, max realloc chunck, final and max app used heap space
+    // There are kSandboxStatCount * 64 bit for the sandbox stats, separated by ','.
     // And the length of the module file name.
     // 3 characters for "\r\n" and null.
     size_t const reportBufferSize = 
@@ -336,11 +735,15 @@ void ReportProcessData(
         10 /*Process ID*/ +
         (20 * 6) /*IO Counters*/ +
         (10 * 7) /*Creation, exit, kernel, user times*/ +
-        29 /*Separators*/ +
+        36 /*Separators*/ +
         wcslen(fileName) + /*Module file name*/ +
         10 /*Process exit code*/ +
         10 /*Parent process id*/ +
         120 /*Detours max memory heap size * and payload size, final heap allocated, max and final HandleHeapEntries, allocated pool entries for the non-locking list. */ +
+        40 /*Resolved path cache lookups and hits*/ +
+        40 /*Injected processes and injection time*/ +
+        60 /*Resolved path cache entries, bytes and evictions*/ +
+        (21 * kSandboxStatCount) /*Sandbox stats and their separators*/ +
         3; /*\r\n null*/
 
     unique_ptr<wchar_t[]> report(new wchar_t[reportBufferSize]);
@@ -353,7 +756,19 @@ void ReportProcessData(
         return;
     }
 
-    int const constructReportResult = swprintf_s(report.get(), reportBufferSize, L"%u,%lu|%I64u|%I64u|%I64u|%I64u|%I64u|%I64u|%lu|%lu|%lu|%lu|%lu|%lu|%lu|%lu|%s|%lu|%lu|%I64u|%lu|%I64u|%lu|%I64u|%I64u\r\n",
+    ULONG64 pathCacheLookups;
+    ULONG64 pathCacheHits;
+    SumPathCacheStatistics(pathCacheLookups, pathCacheHits);
+
+    size_t pathCacheEntries;
+    size_t pathCacheBytes;
+    size_t pathCacheEvictions;
+    ResolvedPathCache::Instance().GetBudgetStatistics(pathCacheEntries, pathCacheBytes, pathCacheEvictions);
+
+    wchar_t sandboxStats[21 * kSandboxStatCount];
+    FormatSandboxStats(pathCacheLookups, pathCacheHits, detoursMaxMemHeapSize, sandboxStats, _countof(sandboxStats));
+
+    int const constructReportResult = swprintf_s(report.get(), reportBufferSize, L"%u,%lu|%I64u|%I64u|%I64u|%I64u|%I64u|%I64u|%lu|%lu|%lu|%lu|%lu|%lu|%lu|%lu|%s|%lu|%lu|%I64u|%lu|%I64u|%lu|%I64u|%I64u|%I64u|%I64u|%I64u|%I64u|%I64u|%I64u|%I64u|%s\r\n",
         ReportType::ReportType_ProcessData,
         GetCurrentProcessId(),
         ioCounters.ReadOperationCount,
@@ -378,7 +793,15 @@ void ReportProcessData(
         (ULONG64)g_detoursHeapAllocatedMemoryInBytes,
         (ULONG)g_detoursAllocatedNoLockConcurentPoolEntries,
         (ULONG64)g_detoursMaxHandleHeapEntries,
-        (ULONG64)g_detoursHandleHeapEntries);
+        (ULONG64)g_detoursHandleHeapEntries,
+        pathCacheLookups,
+        pathCacheHits,
+        (ULONG64)g_injectedProcessCount,
+        (ULONG64)g_injectionTimeInMicroseconds,
+        (ULONG64)pathCacheEntries,
+        (ULONG64)pathCacheBytes,
+        (ULONG64)pathCacheEvictions,
+        sandboxStats);
 
     assert(constructReportResult > 0);
 
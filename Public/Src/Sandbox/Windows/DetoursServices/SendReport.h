@@ -13,6 +13,12 @@
 // FUNCTION DECLARATIONS
 // ----------------------------------------------------------------------------
 
+// Writes out the report lines batched so far (see FileAccessManifestExtraFlag::BatchReports), and the buffered debug messages
+// (see FileAccessManifestExtraFlag::BufferDebugMessages).
+// Pass processDetaching when the process is exiting: the other threads are gone then, and the one holding the batch lock
+// (if any) will never release it.
+void FlushReportBatch(bool processDetaching = false);
+
 void ReportFileAccess(
     FileOperationContext const& fileOperationContext,
     FileAccessStatus status,
@@ -32,6 +38,31 @@ void ReportProcessData(
     DWORD const& parentProcessId,
     LONG64 const& detoursMaxMemHeapSize);
 
+// Sends the counters of the detoured functions and of the resolved path cache (see DetourStatistics.h).
+void ReportDetourStatistics();
+
+// Adds the name of an enumerated entry to the membership hash of an enumeration, which is the sum of the FNV-1a hashes of the names
+// (over their UTF-16 code units) so that it does not depend on the order in which the entries are found.
+// CODESYNC: Public/Src/Engine/Processes/DirectoryEnumerationSummary.cs
+inline uint64_t AddToEnumerationMembershipHash(uint64_t membershipHash, wchar_t const* name)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (; *name != L'\0'; name++)
+    {
+        hash = (hash ^ static_cast<uint16_t>(*name)) * 0x100000001b3ULL;
+    }
+
+    return membershipHash + hash;
+}
+
+// Sends the summary of a complete enumeration (see SummarizeDirectoryEnumerations): the directory, the filter, and the number and
+// membership hash of the entries found, from which BuildXL can tell the entries by enumerating the directory itself.
+void ReportDirectoryEnumerationSummary(
+    wchar_t const* directory,
+    wchar_t const* filter,
+    uint64_t entryCount,
+    uint64_t membershipHash);
+
 void ReportProcessDetouringStatus(
     ProcessDetouringStatus status,
     const LPCWSTR lpApplicationName,
@@ -0,0 +1,252 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "stdafx.h"
+
+#include <string>
+
+#include "DebuggingHelpers.h"
+#include "FileAccessHelpers.h"
+#include "globals.h"
+#include "SharedReparsePointCache.h"
+#include "StringOperations.h"
+
+// CODESYNC: DetoursSharedReparsePointCache.cs (section name)
+#define SHARED_REPARSE_POINT_CACHE_SECTION_SUFFIX L"_ReparsePointCache"
+
+// Max number of characters (path and target) a slot can hold
+#define SLOT_CAPACITY ((SharedReparsePointCacheSlotSize - SharedReparsePointCacheSlotHeaderSize) / sizeof(wchar_t))
+
+SharedReparsePointCache::SharedReparsePointCache(SharedReparsePointCacheHeader* header)
+    : m_header(header), m_mask(header->SlotCount - 1)
+{
+}
+
+SharedReparsePointCache* SharedReparsePointCache::Open(const wchar_t* errorNotificationFile)
+{
+    // Kernel object names don't allow '\\'
+    std::wstring sectionName(errorNotificationFile);
+    for (wchar_t& c : sectionName) {
+        if (c == L'\\') {
+            c = L'_';
+        }
+    }
+
+    sectionName += SHARED_REPARSE_POINT_CACHE_SECTION_SUFFIX;
+    HANDLE section = OpenFileMappingW(FILE_MAP_READ | FILE_MAP_WRITE, FALSE, sectionName.c_str());
+    if (section == NULL) {
+        Dbg(L"Warning: Could not open the shared reparse point cache '%s' (GLE=%d).", sectionName.c_str(), GetLastError());
+        return NULL;
+    }
+
+    // The view keeps the section alive.
+    void* view = MapViewOfFile(section, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, 0);
+    CloseHandle(section);
+    if (view == NULL) {
+        Dbg(L"Warning: Could not map the shared reparse point cache '%s' (GLE=%d).", sectionName.c_str(), GetLastError());
+        return NULL;
+    }
+
+    MEMORY_BASIC_INFORMATION info;
+    size_t mappedSize = VirtualQuery(view, &info, sizeof(info)) == sizeof(info) ? info.RegionSize : 0;
+    SharedReparsePointCacheHeader* header = (SharedReparsePointCacheHeader*)view;
+    if (mappedSize < SharedReparsePointCacheHeaderSize ||
+        header->Magic != SharedReparsePointCacheMagic ||
+        header->Version != SharedReparsePointCacheVersion ||
+        header->SlotCount == 0 ||
+        (header->SlotCount & (header->SlotCount - 1)) != 0 ||
+        header->SlotSize != SharedReparsePointCacheSlotSize ||
+        mappedSize < SharedReparsePointCacheHeaderSize + (size_t)header->SlotCount * SharedReparsePointCacheSlotSize) {
+        Dbg(L"Warning: The shared reparse point cache '%s' is not valid.", sectionName.c_str());
+        UnmapViewOfFile(view);
+        return NULL;
+    }
+
+    return new SharedReparsePointCache(header);
+}
+
+SharedReparsePointCache::~SharedReparsePointCache()
+{
+    UnmapViewOfFile(m_header);
+}
+
+size_t SharedReparsePointCache::KeyLength(const std::wstring& path)
+{
+    // Like ResolvedPathCache, C:\foo and C:\foo\ are the same path
+    return path.length() > 0 && IsDirectorySeparator(path.back()) ? path.length() - 1 : path.length();
+}
+
+uint64_t SharedReparsePointCache::Hash(const std::wstring& path)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0, length = KeyLength(path); i < length; i++) {
+        hash = (hash ^ (uint64_t)towlower(path[i])) * 1099511628211ULL;
+    }
+
+    return hash;
+}
+
+bool SharedReparsePointCache::Matches(const SharedReparsePointCacheSlot* slot, LONG64 generation, uint64_t hash, const std::wstring& path)
+{
+    size_t length = KeyLength(path);
+    if (slot->Generation != generation || slot->Hash != hash || slot->PathLength != length) {
+        return false;
+    }
+
+    const wchar_t* chars = CharsOf(slot);
+    for (size_t i = 0; i < length; i++) {
+        if (chars[i] != path[i] && towlower(chars[i]) != towlower(path[i])) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool SharedReparsePointCache::TryGet(const std::wstring& path, std::wstring& target, DWORD& reparsePointType)
+{
+    if (path.length() > SLOT_CAPACITY) {
+        return false;
+    }
+
+    // A copy of the slot being read, so what is compared and returned cannot change underneath.
+    LONG64 copyBuffer[SharedReparsePointCacheSlotSize / sizeof(LONG64)];
+    SharedReparsePointCacheSlot* copy = (SharedReparsePointCacheSlot*)copyBuffer;
+
+    uint64_t hash = Hash(path);
+    LONG64 generation = ReadAcquire64(&m_header->Generation);
+    for (uint64_t probe = 0; probe < SharedReparsePointCacheMaxProbes; probe++) {
+        SharedReparsePointCacheSlot* slot = SlotAt(hash + probe);
+        LONG sequence = slot->Sequence;
+        if ((sequence & 1) != 0) {
+            // Being written
+            continue;
+        }
+
+        MemoryBarrier();
+        memcpy(copy, slot, SharedReparsePointCacheSlotSize);
+        MemoryBarrier();
+        if (slot->Sequence != sequence) {
+            continue;
+        }
+
+        if (copy->Generation == 0) {
+            // Never written: the path would have been put here
+            return false;
+        }
+
+        if (Matches(copy, generation, hash, path)) {
+            if ((size_t)copy->PathLength + copy->TargetLength > SLOT_CAPACITY) {
+                return false;
+            }
+
+            target.assign(CharsOf(copy) + copy->PathLength, copy->TargetLength);
+            reparsePointType = copy->ReparsePointType;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void SharedReparsePointCache::Insert(const std::wstring& path, const std::wstring& target, DWORD reparsePointType)
+{
+    size_t pathLength = KeyLength(path);
+    if (pathLength + target.length() > SLOT_CAPACITY) {
+        return;
+    }
+
+    uint64_t hash = Hash(path);
+    LONG64 generation = ReadAcquire64(&m_header->Generation);
+
+    // Prefers a slot that is not valid anymore (or never was) over a valid slot of another path, which is only replaced when
+    // all the slots the path can go in are valid (the first one then, so the entries of a crowded region keep getting renewed).
+    SharedReparsePointCacheSlot* target_slot = NULL;
+    for (uint64_t probe = 0; probe < SharedReparsePointCacheMaxProbes; probe++) {
+        SharedReparsePointCacheSlot* slot = SlotAt(hash + probe);
+        if (slot->Generation != generation || Matches(slot, generation, hash, path)) {
+            target_slot = slot;
+            break;
+        }
+    }
+
+    if (target_slot == NULL) {
+        target_slot = SlotAt(hash);
+    }
+
+    LONG sequence = target_slot->Sequence;
+    if ((sequence & 1) != 0 || InterlockedCompareExchange(&target_slot->Sequence, sequence + 1, sequence) != sequence) {
+        // Someone else is writing this slot
+        return;
+    }
+
+    wchar_t* chars = (wchar_t*)((char*)target_slot + SharedReparsePointCacheSlotHeaderSize);
+    memcpy(chars, path.c_str(), pathLength * sizeof(wchar_t));
+    memcpy(chars + pathLength, target.c_str(), target.length() * sizeof(wchar_t));
+    target_slot->PathLength = (uint16_t)pathLength;
+    target_slot->TargetLength = (uint16_t)target.length();
+    target_slot->ReparsePointType = reparsePointType;
+    target_slot->Hash = hash;
+    target_slot->Generation = generation;
+
+    // Publishes the slot (the interlocked operation is a full barrier).
+    InterlockedExchange(&target_slot->Sequence, sequence + 2);
+}
+
+void SharedReparsePointCache::Invalidate(const std::wstring& path, bool isDirectory)
+{
+    if (isDirectory) {
+        InterlockedIncrement64(&m_header->Generation);
+        return;
+    }
+
+    // All the slots of the path are cleared: a path can be in several of them (e.g., when it was put in a slot that was not
+    // valid anymore, before the one with its previous entry).
+    uint64_t hash = Hash(path);
+    LONG64 generation = ReadAcquire64(&m_header->Generation);
+    for (uint64_t probe = 0; probe < SharedReparsePointCacheMaxProbes; probe++) {
+        SharedReparsePointCacheSlot* slot = SlotAt(hash + probe);
+        LONG sequence = slot->Sequence;
+        if ((sequence & 1) != 0) {
+            // The slot is being written, possibly for this path: only a new generation guarantees that it's not cached anymore.
+            InterlockedIncrement64(&m_header->Generation);
+            return;
+        }
+
+        if (slot->Generation == 0) {
+            return;
+        }
+
+        if (!Matches(slot, generation, hash, path)) {
+            continue;
+        }
+
+        if (InterlockedCompareExchange(&slot->Sequence, sequence + 1, sequence) != sequence) {
+            InterlockedIncrement64(&m_header->Generation);
+            return;
+        }
+
+        // Not valid in any generation anymore, but still occupied as far as lookups are concerned, so paths put in the
+        // following slots can still be found.
+        slot->Generation = -1;
+        InterlockedExchange(&slot->Sequence, sequence + 2);
+    }
+}
+
+SharedReparsePointCache* g_sharedReparsePointCache = NULL;
+
+void InitializeSharedReparsePointCache() {
+    assert(g_sharedReparsePointCache == NULL);
+    if (UseSharedReparsePointCache() && g_internalDetoursErrorNotificationFile != nullptr) {
+        g_sharedReparsePointCache = SharedReparsePointCache::Open(g_internalDetoursErrorNotificationFile);
+    }
+}
+
+SharedReparsePointCache* GetGlobalSharedReparsePointCache() {
+    return g_sharedReparsePointCache;
+}
+
+void ReleaseSharedReparsePointCache() {
+    delete g_sharedReparsePointCache;
+    g_sharedReparsePointCache = NULL;
+}
@@ -0,0 +1,122 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#include <windows.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+// A cache of reparse point targets (the results of FSCTL_GET_REPARSE_POINT cached by ResolvedPathCache, including the
+// absence of a reparse point) living in a section shared by all processes of a pip (see FileAccessManifestExtraFlag::SharedReparsePointCache),
+// so that a child process does not query again the reparse points its parent (or a sibling) already queried.
+// The section is created and initialized by BuildXL under a name derived from the internal error notification file
+// (like the name of the message count semaphore); its content is filled by the processes of the pip.
+//
+// CODESYNC: Public/Src/Engine/Processes/Internal/DetoursSharedReparsePointCache.cs
+//
+// The cache is a hash table of fixed-size slots, looked up by linear probing over at most SharedReparsePointCacheMaxProbes slots.
+// Every slot is protected by a sequence number that is odd while the slot is being written: readers copy the slot and only
+// use the copy if the sequence number was even and did not change meanwhile; writers make it odd with a CAS, so a slot is never
+// written by two processes at once. Processes of different bitness share the cache, so the layout only uses fixed-size types.
+//
+// Invalidation: every slot carries the generation of the cache when it was written, and only slots of the current generation are
+// valid. Invalidating a file only clears its slots, while invalidating a directory moves the cache to a new generation, since
+// the targets of all the paths underneath may have changed.
+
+#define SharedReparsePointCacheMagic   0x50525253 // "SRRP"
+#define SharedReparsePointCacheVersion 1
+
+#define SharedReparsePointCacheHeaderSize 128
+#define SharedReparsePointCacheSlotHeaderSize 32
+
+// Size of a slot, header included: paths and targets that don't fit are not cached
+#define SharedReparsePointCacheSlotSize 1024
+
+#define SharedReparsePointCacheMaxProbes 8
+
+typedef struct SharedReparsePointCacheHeader_t
+{
+    uint32_t Magic;
+    uint32_t Version;
+
+    // Number of slots (a power of 2)
+    uint32_t SlotCount;
+
+    // Size of a slot, header included (SharedReparsePointCacheSlotSize)
+    uint32_t SlotSize;
+
+    uint8_t Padding0[48];
+    volatile LONG64 Generation;
+} SharedReparsePointCacheHeader;
+
+typedef struct SharedReparsePointCacheSlot_t
+{
+    volatile LONG Sequence;
+    DWORD ReparsePointType;
+    uint64_t Hash;
+    LONG64 Generation;
+
+    // Number of characters of the path and of the target, which follow the slot header (without null terminators)
+    uint16_t PathLength;
+    uint16_t TargetLength;
+    uint32_t Reserved;
+} SharedReparsePointCacheSlot;
+
+static_assert(sizeof(SharedReparsePointCacheHeader) <= SharedReparsePointCacheHeaderSize, "CODESYNC: DetoursSharedReparsePointCache.cs");
+static_assert(sizeof(SharedReparsePointCacheSlot) == SharedReparsePointCacheSlotHeaderSize, "CODESYNC: DetoursSharedReparsePointCache.cs");
+static_assert(offsetof(SharedReparsePointCacheHeader, Generation) == 64, "CODESYNC: DetoursSharedReparsePointCache.cs");
+
+class SharedReparsePointCache {
+public:
+    // Maps the cache created by BuildXL for the given internal error notification file.
+    // Returns NULL if it cannot be opened or if the section does not contain a valid cache.
+    static SharedReparsePointCache* Open(const wchar_t* errorNotificationFile);
+
+    // Looks up the target and the type (0 if it is not a reparse point) of the given path.
+    bool TryGet(const std::wstring& path, std::wstring& target, DWORD& reparsePointType);
+
+    // Best effort: nothing is cached when the path and target don't fit in a slot or when the slots the path can go in are busy.
+    void Insert(const std::wstring& path, const std::wstring& target, DWORD reparsePointType);
+
+    void Invalidate(const std::wstring& path, bool isDirectory);
+
+    // Unmaps the cache
+    ~SharedReparsePointCache();
+
+private:
+    SharedReparsePointCache(SharedReparsePointCacheHeader* header);
+
+    inline SharedReparsePointCacheSlot* SlotAt(uint64_t index) const
+    {
+        return (SharedReparsePointCacheSlot*)((char*)m_header + SharedReparsePointCacheHeaderSize + (index & m_mask) * SharedReparsePointCacheSlotSize);
+    }
+
+    inline static const wchar_t* CharsOf(const SharedReparsePointCacheSlot* slot)
+    {
+        return (const wchar_t*)((const char*)slot + SharedReparsePointCacheSlotHeaderSize);
+    }
+
+    // Length of the path without its trailing separator, if any
+    static size_t KeyLength(const std::wstring& path);
+
+    // Hash of the path, which is the same for processes of any bitness
+    static uint64_t Hash(const std::wstring& path);
+
+    // Whether the (copied) slot is valid in the given generation and is for the given path
+    static bool Matches(const SharedReparsePointCacheSlot* slot, LONG64 generation, uint64_t hash, const std::wstring& path);
+
+    SharedReparsePointCacheHeader* m_header;
+    uint64_t m_mask;
+};
+
+// Opens the cache (if FileAccessManifestExtraFlag::SharedReparsePointCache is set). Must be called after the manifest has been parsed.
+void InitializeSharedReparsePointCache();
+
+// Returns the global cache, or NULL if reparse point targets are not shared by the processes of the pip.
+SharedReparsePointCache* GetGlobalSharedReparsePointCache();
+
+// Closes the global cache, if any (see ManifestRetarget.h); InitializeSharedReparsePointCache opens the one of the current manifest.
+// Only safe when no thread is in a detoured function.
+void ReleaseSharedReparsePointCache();
@@ -0,0 +1,79 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "ShimProcessMatchTable.h"
+
+// If we are building this for tests, we don't want to use the builxl private heap that only exists when running under detours
+#ifndef TEST
+    #include "stdafx.h"
+    #include "buildXL_mem.h"
+#endif
+
+#include <algorithm>
+#include <wchar.h>
+
+std::wstring ShimProcessMatchTable::FileNameOf(const std::wstring& path)
+{
+    size_t lastSeparator = path.rfind(L'\\');
+    return lastSeparator == std::wstring::npos ? path : path.substr(lastSeparator + 1);
+}
+
+void ShimProcessMatchTable::Add(const std::wstring& processName, const std::wstring& argumentMatch)
+{
+    FileNameMatches& matches = m_matchesByFileName[FileNameOf(processName)];
+    if (processName.find(L'\\') != std::wstring::npos)
+    {
+        matches.PathMatches.push_back({ processName, argumentMatch });
+    }
+    else if (argumentMatch.empty())
+    {
+        matches.MatchesAnyArguments = true;
+    }
+    else if (std::find(matches.ArgumentMatches.begin(), matches.ArgumentMatches.end(), argumentMatch) == matches.ArgumentMatches.end())
+    {
+        matches.ArgumentMatches.push_back(argumentMatch);
+    }
+}
+
+bool ShimProcessMatchTable::Matches(const std::wstring& command, const wchar_t* commandArgs) const
+{
+    auto found = m_matchesByFileName.find(FileNameOf(command));
+    if (found == m_matchesByFileName.end())
+    {
+        return false;
+    }
+
+    // The command ends with the file name (and a match for just the file name does not need more checks)
+    const FileNameMatches& matches = found->second;
+    if (matches.MatchesAnyArguments)
+    {
+        return true;
+    }
+
+    for (const std::wstring& argumentMatch : matches.ArgumentMatches)
+    {
+        if (wcsstr(commandArgs, argumentMatch.c_str()) != nullptr)
+        {
+            return true;
+        }
+    }
+
+    size_t commandLen = command.length();
+    for (const PathMatch& match : matches.PathMatches)
+    {
+        // The command must be the process name or end with e.g. "\bin\cl.exe"
+        size_t processLen = match.ProcessName.length();
+        bool commandMatch = processLen == commandLen
+            ? _wcsicmp(match.ProcessName.c_str(), command.c_str()) == 0
+            : processLen < commandLen
+                && command[commandLen - processLen - 1] == L'\\'
+                && _wcsicmp(command.c_str() + commandLen - processLen, match.ProcessName.c_str()) == 0;
+
+        if (commandMatch && (match.ArgumentMatch.empty() || wcsstr(commandArgs, match.ArgumentMatch.c_str()) != nullptr))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
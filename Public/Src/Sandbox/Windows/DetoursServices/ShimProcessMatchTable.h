@@ -0,0 +1,53 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#define EXPORT __declspec( dllexport )
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "UtilityHelpers.h"
+
+// CODESYNC: SubstituteProcessExecutionInfo.cs :: ShimProcessMatch class
+//
+// The process matches of the substitute process execution shim, compiled when the manifest is parsed
+// into a table keyed by the file name of the process, so that the command of a child process is only compared with (and its
+// arguments are only searched for) the matches of processes with the same file name, instead of with every match.
+// This class is not thread safe for writing; lookups can be done concurrently once all matches have been added.
+class ShimProcessMatchTable {
+public:
+    // Adds a match. The process name is either a file name (e.g., "cl.exe") or the end of a path (e.g., "bin\cl.exe").
+    // An empty argument match matches any arguments.
+    EXPORT void Add(const std::wstring& processName, const std::wstring& argumentMatch);
+
+    EXPORT bool IsEmpty() const { return m_matchesByFileName.empty(); }
+
+    // Whether the command (without quotes) and its arguments match one of the added matches, i.e., the command is the process
+    // name or ends with '\\' followed by it (ignoring case), and the arguments contain the argument match.
+    EXPORT bool Matches(const std::wstring& command, const wchar_t* commandArgs) const;
+
+private:
+    // A match whose process name is more than a file name
+    struct PathMatch {
+        std::wstring ProcessName;
+        std::wstring ArgumentMatch;
+    };
+
+    // All matches of processes with a given file name
+    struct FileNameMatches {
+        // Whether a match for the file name matches any arguments
+        bool MatchesAnyArguments = false;
+
+        // Distinct argument matches of the matches for the file name
+        std::vector<std::wstring> ArgumentMatches;
+
+        std::vector<PathMatch> PathMatches;
+    };
+
+    // The file name of a process name or of a command (what follows the last '\\')
+    static std::wstring FileNameOf(const std::wstring& path);
+
+    std::unordered_map<std::wstring, FileNameMatches, CaseInsensitiveStringHasher, CaseInsensitiveStringComparer> m_matchesByFileName;
+};
@@ -0,0 +1,381 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "stdafx.h"
+
+#include "buildXL_mem.h"
+#include "SlabAllocator.h"
+
+// Size of the header of a block (a multiple of MEMORY_ALLOCATION_ALIGNMENT, so that blocks stay as aligned as HeapAlloc's)
+#define SLAB_HEADER_SIZE 16
+
+// Number of bytes of a slab (a new slab is carved into as many blocks of its class as fit)
+#define SLAB_SIZE (16 * 1024)
+
+// Size class of the blocks that are allocated from the heap
+#define LARGE_BLOCK_CLASS 0xFFFFFFFF
+
+struct BlockHeader {
+    // Size of the block (excluding the header): the size of its class, or the requested size of a large block
+    size_t Size;
+    ULONG SizeClass;
+};
+
+static_assert(sizeof(BlockHeader) <= SLAB_HEADER_SIZE, "The header of a block must fit in SLAB_HEADER_SIZE bytes.");
+static_assert(SLAB_HEADER_SIZE % MEMORY_ALLOCATION_ALIGNMENT == 0, "Blocks must be as aligned as the heap allocations.");
+
+struct FreeBlock {
+    FreeBlock* Next;
+};
+
+static const size_t s_classSizes[] = { 16, 32, 48, 64, 96, 128, 192, 256, 384, SLAB_MAX_BLOCK_SIZE };
+
+#define SLAB_SIZE_CLASSES (sizeof(s_classSizes) / sizeof(s_classSizes[0]))
+
+// Number of blocks a thread takes from (or gives back to) a depot at once
+static inline ULONG BatchSize(ULONG sizeClass)
+{
+    return (ULONG)(SLAB_SIZE / (SLAB_HEADER_SIZE + s_classSizes[sizeClass]));
+}
+
+static inline ULONG GetSizeClass(size_t size)
+{
+    if (size > SLAB_MAX_BLOCK_SIZE) {
+        return LARGE_BLOCK_CLASS;
+    }
+
+    ULONG sizeClass = 0;
+    while (s_classSizes[sizeClass] < size) {
+        sizeClass++;
+    }
+
+    return sizeClass;
+}
+
+static inline BlockHeader* GetHeader(void* pMem)
+{
+    return (BlockHeader*)((char*)pMem - SLAB_HEADER_SIZE);
+}
+
+static inline void* GetBlock(BlockHeader* header)
+{
+    return (char*)header + SLAB_HEADER_SIZE;
+}
+
+// The free blocks of a class that no thread holds; protected by the lock of the private heap, which AttachColdDetours
+// takes before it suspends the threads (so it can still allocate with them suspended).
+struct Depot {
+    FreeBlock* Blocks;
+    ULONG Count;
+};
+
+static Depot s_depots[SLAB_SIZE_CLASSES];
+
+struct ThreadCache {
+    // Next cache in the list of all the caches (caches are never freed: the cache of an exited thread is reused by a new one)
+    ThreadCache* Next;
+    volatile LONG InUse;
+
+    // Bytes allocated (minus the bytes freed) by the thread and not yet published to the global counters
+    volatile LONG64 UnpublishedBytes;
+
+    FreeBlock* Blocks[SLAB_SIZE_CLASSES];
+    ULONG Counts[SLAB_SIZE_CLASSES];
+};
+
+static ThreadCache* volatile s_threadCaches = nullptr;
+static volatile LONG s_shutdown = 0;
+
+static __declspec(thread) ThreadCache* gt_cache = nullptr;
+
+// Set once the cache of the thread is released (i.e., when the thread exits): the blocks the thread frees afterwards
+// (e.g., from the destructors of other thread_local objects) go to the depots.
+static __declspec(thread) bool gt_exited = false;
+
+static void PublishBytes(LONG64 bytes)
+{
+    LONG64 allocatedSize = InterlockedAdd64(&g_detoursHeapAllocatedMemoryInBytes, bytes);
+    LONG64 localMax = InterlockedAdd64(&g_detoursMaxAllocatedMemoryInBytes, 0);
+
+    // Update the global MaxAllocated heap only if the current allocated heap is bigger than what is recorded.
+    while (allocatedSize > localMax)
+    {
+        InterlockedCompareExchange64(&g_detoursMaxAllocatedMemoryInBytes, allocatedSize, localMax);
+        localMax = InterlockedAdd64(&g_detoursMaxAllocatedMemoryInBytes, 0);
+    }
+}
+
+static inline void CountBytes(ThreadCache* cache, LONG64 bytes)
+{
+    if (!ShouldLogProcessData())
+    {
+        return;
+    }
+
+    if (cache == nullptr)
+    {
+        PublishBytes(bytes);
+        return;
+    }
+
+    // Only this thread writes the counter of its cache.
+    LONG64 unpublished = cache->UnpublishedBytes + bytes;
+    if (unpublished >= SLAB_PUBLISH_THRESHOLD || unpublished <= -SLAB_PUBLISH_THRESHOLD)
+    {
+        cache->UnpublishedBytes = 0;
+        PublishBytes(unpublished);
+    }
+    else
+    {
+        cache->UnpublishedBytes = unpublished;
+    }
+}
+
+// Moves 'count' blocks (starting at 'first') to the depot of their class.
+static void GiveToDepot(ULONG sizeClass, FreeBlock* first, ULONG count)
+{
+    FreeBlock* last = first;
+    for (ULONG i = 1; i < count; i++)
+    {
+        last = last->Next;
+    }
+
+    HeapLock(g_hPrivateHeap);
+    Depot& depot = s_depots[sizeClass];
+    last->Next = depot.Blocks;
+    depot.Blocks = first;
+    depot.Count += count;
+    HeapUnlock(g_hPrivateHeap);
+}
+
+static void ReleaseThreadCache()
+{
+    ThreadCache* cache = gt_cache;
+    gt_cache = nullptr;
+    gt_exited = true;
+    if (cache == nullptr || s_shutdown)
+    {
+        return;
+    }
+
+    for (ULONG sizeClass = 0; sizeClass < SLAB_SIZE_CLASSES; sizeClass++)
+    {
+        if (cache->Blocks[sizeClass] != nullptr)
+        {
+            GiveToDepot(sizeClass, cache->Blocks[sizeClass], cache->Counts[sizeClass]);
+            cache->Blocks[sizeClass] = nullptr;
+            cache->Counts[sizeClass] = 0;
+        }
+    }
+
+    if (cache->UnpublishedBytes != 0)
+    {
+        PublishBytes(cache->UnpublishedBytes);
+        cache->UnpublishedBytes = 0;
+    }
+
+    InterlockedExchange(&cache->InUse, 0);
+}
+
+struct ThreadCacheRelease {
+    ~ThreadCacheRelease() { ReleaseThreadCache(); }
+};
+
+// Returns the cache of the thread (acquiring one on the first call), or nullptr if the thread cannot have one.
+static ThreadCache* GetThreadCache()
+{
+    ThreadCache* cache = gt_cache;
+    if (cache != nullptr || gt_exited || s_shutdown)
+    {
+        return cache;
+    }
+
+    for (cache = (ThreadCache*)ReadPointerAcquire((PVOID const volatile*)&s_threadCaches); cache != nullptr; cache = cache->Next)
+    {
+        if (InterlockedCompareExchange(&cache->InUse, 1, 0) == 0)
+        {
+            break;
+        }
+    }
+
+    if (cache == nullptr)
+    {
+        cache = (ThreadCache*)HeapAlloc(g_hPrivateHeap, HEAP_ZERO_MEMORY, sizeof(ThreadCache));
+        if (cache == nullptr)
+        {
+            return nullptr;
+        }
+
+        cache->InUse = 1;
+        ThreadCache* head;
+        do
+        {
+            head = s_threadCaches;
+            cache->Next = head;
+        } while (InterlockedCompareExchangePointer((PVOID volatile*)&s_threadCaches, cache, head) != head);
+    }
+
+    gt_cache = cache;
+
+    // Released when the thread exits (the CRT runs the destructors of the thread_local objects of the DLL then).
+    thread_local ThreadCacheRelease t_release;
+    (void)t_release;
+
+    return cache;
+}
+
+// Refills the (empty) list of the thread for the class, from the depot or from a new slab; returns the first block (or nullptr).
+static FreeBlock* Refill(ThreadCache* cache, ULONG sizeClass)
+{
+    ULONG batchSize = BatchSize(sizeClass);
+    FreeBlock* blocks = nullptr;
+    ULONG count = 0;
+
+    HeapLock(g_hPrivateHeap);
+    Depot& depot = s_depots[sizeClass];
+    if (depot.Blocks != nullptr)
+    {
+        blocks = depot.Blocks;
+        FreeBlock* last = blocks;
+        count = 1;
+        while (count < batchSize && last->Next != nullptr)
+        {
+            last = last->Next;
+            count++;
+        }
+
+        depot.Blocks = last->Next;
+        depot.Count -= count;
+        last->Next = nullptr;
+    }
+    HeapUnlock(g_hPrivateHeap);
+
+    if (blocks == nullptr)
+    {
+        size_t stride = SLAB_HEADER_SIZE + s_classSizes[sizeClass];
+        char* slab = (char*)HeapAlloc(g_hPrivateHeap, 0, stride * batchSize);
+        if (slab == nullptr)
+        {
+            return nullptr;
+        }
+
+        for (ULONG i = batchSize; i-- > 0;)
+        {
+            BlockHeader* header = (BlockHeader*)(slab + i * stride);
+            header->Size = s_classSizes[sizeClass];
+            header->SizeClass = sizeClass;
+
+            FreeBlock* block = (FreeBlock*)GetBlock(header);
+            block->Next = blocks;
+            blocks = block;
+        }
+
+        count = batchSize;
+    }
+
+    cache->Blocks[sizeClass] = blocks;
+    cache->Counts[sizeClass] = count;
+    return blocks;
+}
+
+void* SlabAlloc(size_t size)
+{
+    ULONG sizeClass = GetSizeClass(size);
+    ThreadCache* cache = GetThreadCache();
+
+    if (sizeClass == LARGE_BLOCK_CLASS || cache == nullptr)
+    {
+        BlockHeader* header = (BlockHeader*)HeapAlloc(g_hPrivateHeap, BUILDXL_DETOURS_MEMORY_ALLOC_FLAGS, SLAB_HEADER_SIZE + size);
+        if (header == nullptr)
+        {
+            return nullptr;
+        }
+
+        header->Size = size;
+        header->SizeClass = LARGE_BLOCK_CLASS;
+        CountBytes(cache, (LONG64)(SLAB_HEADER_SIZE + size));
+        return GetBlock(header);
+    }
+
+    FreeBlock* block = cache->Blocks[sizeClass];
+    if (block == nullptr)
+    {
+        block = Refill(cache, sizeClass);
+        if (block == nullptr)
+        {
+            return nullptr;
+        }
+    }
+
+    cache->Blocks[sizeClass] = block->Next;
+    cache->Counts[sizeClass]--;
+
+    ZeroMemory(block, size);
+    CountBytes(cache, (LONG64)(SLAB_HEADER_SIZE + s_classSizes[sizeClass]));
+    return block;
+}
+
+void SlabFree(void* pMem)
+{
+    // The private heap is gone (or about to be).
+    if (s_shutdown)
+    {
+        return;
+    }
+
+    BlockHeader* header = GetHeader(pMem);
+    ULONG sizeClass = header->SizeClass;
+    ThreadCache* cache = GetThreadCache();
+    CountBytes(cache, -(LONG64)(SLAB_HEADER_SIZE + header->Size));
+
+    if (sizeClass == LARGE_BLOCK_CLASS)
+    {
+        HeapFree(g_hPrivateHeap, 0, header);
+        return;
+    }
+
+    FreeBlock* block = (FreeBlock*)pMem;
+    if (cache == nullptr)
+    {
+        block->Next = nullptr;
+        GiveToDepot(sizeClass, block, 1);
+        return;
+    }
+
+    block->Next = cache->Blocks[sizeClass];
+    cache->Blocks[sizeClass] = block;
+
+    // Keep at most two batches, so that the blocks a thread frees for another one go back to the depot.
+    ULONG batchSize = BatchSize(sizeClass);
+    if (++cache->Counts[sizeClass] >= 2 * batchSize)
+    {
+        FreeBlock* kept = block;
+        for (ULONG i = 1; i < batchSize; i++)
+        {
+            kept = kept->Next;
+        }
+
+        FreeBlock* given = kept->Next;
+        kept->Next = nullptr;
+        GiveToDepot(sizeClass, given, cache->Counts[sizeClass] - batchSize);
+        cache->Counts[sizeClass] = batchSize;
+    }
+}
+
+void PublishSlabAllocatorCounters()
+{
+    for (ThreadCache* cache = (ThreadCache*)ReadPointerAcquire((PVOID const volatile*)&s_threadCaches); cache != nullptr; cache = cache->Next)
+    {
+        LONG64 unpublished = cache->UnpublishedBytes;
+        if (unpublished != 0)
+        {
+            cache->UnpublishedBytes = 0;
+            PublishBytes(unpublished);
+        }
+    }
+}
+
+void ShutdownSlabAllocator()
+{
+    InterlockedExchange(&s_shutdown, 1);
+}
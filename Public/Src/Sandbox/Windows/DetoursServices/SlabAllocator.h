@@ -0,0 +1,39 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+// The allocator behind dd_malloc and dd_free (see buildXL_mem.h), on top of the private heap.
+//
+// The detoured functions allocate many small objects (e.g., the buffers of short wstrings and the control blocks of shared_ptrs)
+// that are freed shortly after, often by the same thread. Allocations of up to SLAB_MAX_BLOCK_SIZE bytes are rounded up to one
+// of a few size classes, and served from (and freed to) a per-thread list of free blocks of their class, without any lock.
+// Those lists are refilled from (and overflow into) per-class depots, under the lock of the private heap, one batch of blocks at
+// a time; a depot that runs out is refilled by carving a new slab (a single HeapAlloc) into blocks. Blocks of a class are never
+// returned to the heap: the memory of a class stays at the peak of what it needed. Larger allocations go to the heap, as before.
+//
+// Every block is preceded by a small header that tells its class, so that any thread can free any block. Blocks are zeroed when
+// they are allocated, like HeapAlloc with HEAP_ZERO_MEMORY did.
+//
+// When ShouldLogProcessData is set, the allocated bytes are counted on the thread (rather than with two interlocked operations
+// per allocation), and published to g_detoursHeapAllocatedMemoryInBytes (and g_detoursMaxAllocatedMemoryInBytes) by batches
+// of SLAB_PUBLISH_THRESHOLD bytes; PublishSlabAllocatorCounters adds what the threads did not publish yet.
+
+// Largest size (in bytes) served from slabs
+#define SLAB_MAX_BLOCK_SIZE 512
+
+// Number of bytes a thread allocates (or frees) before it publishes them to the global counters
+#define SLAB_PUBLISH_THRESHOLD (64 * 1024)
+
+// Allocates 'size' zeroed bytes; returns nullptr if the heap is out of memory.
+void* SlabAlloc(size_t size);
+
+// Frees a (non-null) block returned by SlabAlloc, from any thread.
+void SlabFree(void* pMem);
+
+// Adds the bytes the threads did not publish yet to the global counters. Only meant to be called when the process detaches
+// (i.e., once the other threads are gone), right before the counters are reported.
+void PublishSlabAllocatorCounters();
+
+// Stops using the slabs; called right before the private heap is destroyed (blocks freed afterwards are ignored).
+void ShutdownSlabAllocator();
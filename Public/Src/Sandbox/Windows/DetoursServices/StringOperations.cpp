@@ -3,6 +3,7 @@
 
 #include "stdafx.h"
 #include "StringOperations.h"
+#include "StringOperationsSimd.h"
 
 #if MAC_OS_LIBRARY
 #include <wchar.h>
@@ -13,9 +14,6 @@
 #include "pathcch.h"
 #endif
 
-#define _MAX_EXTENDED_DIR_LENGTH (_MAX_EXTENDED_PATH_LENGTH - _MAX_DRIVE - _MAX_FNAME - _MAX_EXT - 4)
-#define _MAX_EXTENDED_PATH_LENGTH 32768 // see https://docs.microsoft.com/en-us/cpp/c-runtime-library/path-field-limits?view=vs-2019
-
 // Magic numbers known to provide good hash distributions.
 // See here: http://www.isthe.com/chongo/tech/comp/fnv/
 
@@ -32,6 +30,28 @@ inline static DWORD Fold(DWORD hash, WORD value)
     return _Fold(_Fold(hash, (BYTE)value), (BYTE)(((WORD)value) >> 8));
 }
 
+#if SIMD_PATH_OPERATIONS
+// Normalizes (see NormalizePathChar) the block of characters at 'pPath' into 'pNormalized' and folds them into the hash.
+inline static DWORD NormalizeAndFoldBlock(DWORD hash, PCPathChar pPath, PPathChar pNormalized)
+{
+    __m128i upper;
+    if (TryToUpperAscii(LoadPathBlock(pPath), upper)) {
+        _mm_storeu_si128((__m128i*)pNormalized, upper);
+    }
+    else {
+        for (size_t i = 0; i < SIMD_PATH_BLOCK_LENGTH; i++) {
+            pNormalized[i] = NormalizePathChar(pPath[i]);
+        }
+    }
+
+    for (size_t i = 0; i < SIMD_PATH_BLOCK_LENGTH; i++) {
+        hash = Fold(hash, pNormalized[i]);
+    }
+
+    return hash;
+}
+#endif // SIMD_PATH_OPERATIONS
+
 #pragma warning( push )
 #pragma warning( disable : 4100) // 'nBufferLength' : unreferenced formal parameter // in Release builds
 DWORD WINAPI NormalizeAndHashPath(
@@ -43,8 +63,14 @@ DWORD WINAPI NormalizeAndHashPath(
 
     // not the fastest hashing implementation, but gives awesome distribution
     DWORD hash = Fnv1Basis32;
-    size_t i;
-    for (i = 0; pPath[i]; i++) {
+    size_t i = 0;
+#if SIMD_PATH_OPERATIONS
+    size_t length = pathlen(pPath);
+    for (; i + SIMD_PATH_BLOCK_LENGTH <= length; i += SIMD_PATH_BLOCK_LENGTH) {
+        hash = NormalizeAndFoldBlock(hash, pPath + i, (PPathChar)pBuffer + i);
+    }
+#endif // SIMD_PATH_OPERATIONS
+    for (; pPath[i]; i++) {
         PathChar c = NormalizePathChar(pPath[i]);
         ((PPathChar)pBuffer)[i] = c;
         hash = Fold(hash, c);
@@ -57,14 +83,40 @@ DWORD WINAPI NormalizeAndHashPath(
 }
 #pragma warning( pop )
 
+DWORD WINAPI NormalizeAndHashPaths(
+    __in_ecount(nLength)            PCPathChar pPaths,
+    __out_ecount(nLength)           PPathChar pBuffer,
+    __in                            DWORD nLength,
+    __out_ecount(nPathCount)        DWORD* pHashes,
+    __in                            DWORD nPathCount)
+{
+    size_t offset = 0;
+    DWORD i = 0;
+    for (; i < nPathCount && offset < nLength; i++) {
+        size_t pathLength = pathlen(pPaths + offset);
+        assert(offset + pathLength < nLength);
+
+        pHashes[i] = NormalizeAndHashPath(pPaths + offset, (PBYTE)(pBuffer + offset), (DWORD)((pathLength + 1) * sizeof(PathChar)));
+        offset += pathLength + 1;
+    }
+
+    return i;
+}
+
 DWORD WINAPI HashPath(
     __in_ecount(nLength)        PCPathChar pPath,
     __in                        size_t nLength)
 {
     // not the fastest hashing implementation, but gives awesome distribution
     DWORD hash = Fnv1Basis32;
-    size_t i;
-    for (i = 0; i < nLength; i++) {
+    size_t i = 0;
+#if SIMD_PATH_OPERATIONS
+    PathChar normalized[SIMD_PATH_BLOCK_LENGTH];
+    for (; i + SIMD_PATH_BLOCK_LENGTH <= nLength; i += SIMD_PATH_BLOCK_LENGTH) {
+        hash = NormalizeAndFoldBlock(hash, pPath + i, normalized);
+    }
+#endif // SIMD_PATH_OPERATIONS
+    for (; i < nLength; i++) {
         PathChar c = NormalizePathChar(pPath[i]);
         hash = Fold(hash, c);
     }
@@ -85,8 +137,12 @@ BOOL WINAPI ArePathsEqual(
     __in_ecount(nLength + 1)    PCPathChar pNormalizedPath,
     __in                        size_t nLength)
 {
-    size_t i;
-    for (i = 0; i < nLength; i++) {
+    size_t i = 0;
+#if SIMD_PATH_OPERATIONS
+    // The normalized path is its own upper case version
+    i = EqualPrefixLengthIgnoringAsciiCase(pPath, pNormalizedPath, nLength);
+#endif // SIMD_PATH_OPERATIONS
+    for (; i < nLength; i++) {
         PathChar c = NormalizePathChar(pPath[i]);
         if (c != pNormalizedPath[i]) {
             return false;
@@ -98,7 +154,11 @@ BOOL WINAPI ArePathsEqual(
 
 bool HasPrefix(PCPathChar str, PCPathChar prefix)
 {
-    for (size_t i = 0;; i++) {
+    size_t i = 0;
+#if SIMD_PATH_OPERATIONS
+    i = EqualNonNullPrefixLengthIgnoringAsciiCase(str, prefix);
+#endif // SIMD_PATH_OPERATIONS
+    for (;; i++) {
         if (str[i] == 0) {
             return prefix[i] == 0;
         }
@@ -229,7 +289,11 @@ bool IsPathWithinTree(PCPathChar tree, PCPathChar path)
             return false;
         }
 
-        for (size_t i = 0; i < treeElementLength; i++) {
+        size_t i = 0;
+#if SIMD_PATH_OPERATIONS
+        i = EqualPrefixLengthIgnoringAsciiCase(tree + treeElementStart, path + pathElementStart, treeElementLength);
+#endif // SIMD_PATH_OPERATIONS
+        for (; i < treeElementLength; i++) {
             PathChar ct = tree[treeElementStart + i];
             PathChar cp = path[pathElementStart + i];
             if (!IsPathCharEqual(ct, cp)) {
@@ -439,56 +503,6 @@ size_t GetRootLength(PCPathChar path)
     return i;
 }
 
-// Returns a collection of all path atoms of the given path
-int TryDecomposePath(const std::wstring& path, std::vector<std::wstring>& elements)
-{
-    auto drive = std::make_unique<wchar_t[]>(_MAX_DRIVE);
-    auto directory = std::make_unique<wchar_t[]>(_MAX_EXTENDED_DIR_LENGTH);
-    auto file_name = std::make_unique<wchar_t[]>(_MAX_FNAME);
-    auto extension = std::make_unique<wchar_t[]>(_MAX_EXT);
-
-    errno_t err = _wsplitpath_s(
-        path.c_str(),
-        drive.get(), _MAX_DRIVE,
-        directory.get(), _MAX_EXTENDED_DIR_LENGTH,
-        file_name.get(), _MAX_FNAME,
-        extension.get(), _MAX_EXT);
-
-    if (err != 0)
-    {
-        return err;
-    }
-
-    std::wstring wdrive = drive.get();
-    if (wdrive.size() > 0)
-    {
-        elements.push_back(std::move(wdrive));
-    }
-
-    wchar_t* context;
-    wchar_t* next = wcstok_s(directory.get(), L"\\/", &context);
-    while (next)
-    {
-        std::wstring dirAtom = next;
-        if (dirAtom.size() > 0)
-        {
-            elements.push_back(std::move(next));
-        }
-
-        next = wcstok_s(nullptr, L"\\/", &context);
-    }
-
-    std::wstring filenameAndExtension = file_name.get();
-    filenameAndExtension.append(extension.get());
-
-    if (filenameAndExtension.size() > 0)
-    {
-        elements.push_back(std::move(filenameAndExtension));
-    }
-
-    return 0;
-}
-
 std::wstring NormalizePath(const std::wstring& path)
 {
     if (GetRootLength(path.c_str()) == 0)
@@ -198,6 +198,16 @@ DWORD WINAPI NormalizeAndHashPath(
     __out_ecount(nBufferLength)     PBYTE pBuffer,
     __in                            DWORD nBufferLength);
 
+// NormalizeAndHashPaths applies NormalizeAndHashPath to nPathCount paths laid out one after the other (each null-terminated) in the nLength characters
+// of pPaths, storing the normalized paths in the same layout in a buffer and their hash codes in pHashes, so that managed code can normalize many paths
+// with a single call. Returns the number of paths normalized.
+DWORD WINAPI NormalizeAndHashPaths(
+    __in_ecount(nLength)            PCPathChar pPaths,
+    __out_ecount(nLength)           PPathChar pBuffer,
+    __in                            DWORD nLength,
+    __out_ecount(nPathCount)        DWORD* pHashes,
+    __in                            DWORD nPathCount);
+
 // Fast check if two buffers are equal (for use by managed code where memcmp isn't directly available)
 BOOL WINAPI AreBuffersEqual(
     __in_ecount(nBufferLength)    PBYTE pBuffer1,
@@ -246,10 +256,95 @@ bool IsPathToNamedStream(PCPathChar const path, size_t pathLength);
 // Gets root length of a path.
 size_t GetRootLength(PCPathChar path);
 
-#if _WIN32
-// Returns a collection of all path atoms of the given path
-int TryDecomposePath(const std::wstring& path, std::vector<std::wstring>& elements);
+// ----------------------------------------------------------------------------
+// PATH COMPONENTS
+// ----------------------------------------------------------------------------
+
+// A component of a path: its characters (in the path, hence not null-terminated) and their HashPath hash code.
+struct PathComponent {
+    PCPathChar Chars;
+    size_t Length;
+    DWORD Hash;
+};
+
+// Whether two path components are the same, comparing like HashPath hashes (i.e., ignoring case), so that equal
+// components always have equal hash codes.
+inline bool ArePathComponentsEqual(const PathComponent& lhs, const PathComponent& rhs)
+{
+    if (lhs.Length != rhs.Length || lhs.Hash != rhs.Hash)
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < lhs.Length; i++)
+    {
+        if (!IsPathCharEqual(lhs.Chars[i], rhs.Chars[i]))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
 
+// Splits a path into its components in place: nothing is copied or allocated, and the hash code of each component is
+// computed once, as the component is reached, for the consumers to look it up with (the manifest tree, PathTree).
+//
+// A component ends at a directory separator, which is skipped; separators a component starts with (e.g., the ones of
+// \\server in \\server\share) belong to it.  A trailing separator ends the path.  This is how the file access manifest
+// has always been searched, and the managed side lays out its tree of paths accordingly.
+class PathComponentIterator {
+public:
+    PathComponentIterator(PCPathChar path, size_t pathLength)
+        : m_path(path), m_end(path + pathLength), m_next(path), m_current { path, 0, 0 }
+    {
+    }
+
+    // Moves to the next component. Returns false (and leaves the current component as is) if there is none.
+    bool MoveNext()
+    {
+        if (m_next >= m_end)
+        {
+            return false;
+        }
+
+        PCPathChar end = m_next;
+        while (end < m_end && IsDirectorySeparator(*end))
+        {
+            end++;
+        }
+
+        while (end < m_end && !IsDirectorySeparator(*end))
+        {
+            end++;
+        }
+
+        m_current.Chars = m_next;
+        m_current.Length = end - m_next;
+        m_current.Hash = HashPath(m_current.Chars, m_current.Length);
+
+        // Skip the separator that ends the current component, but never the end of the path
+        m_next = end < m_end ? end + 1 : end;
+        return true;
+    }
+
+    const PathComponent& Current() const { return m_current; }
+
+    // The length of the path up to (and including) the current component
+    size_t PrefixLength() const { return (m_current.Chars - m_path) + m_current.Length; }
+
+    // The rest of the path after the current component (and the separator that ends it)
+    PCPathChar Remainder() const { return m_next; }
+    size_t RemainderLength() const { return m_end - m_next; }
+
+private:
+    PCPathChar m_path;
+    PCPathChar m_end;
+    PCPathChar m_next;
+    PathComponent m_current;
+};
+
+#if _WIN32
 // Combines two path fragments into a single path separated by a directory separator.
 std::wstring PathCombine(const std::wstring& fragment1, const std::wstring& fragment2);
 
@@ -0,0 +1,147 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+// SSE2 fast paths for the case-insensitive operations on paths done by every policy search and cache lookup
+// (see StringOperations.cpp and UtilityHelpers.h).
+//
+// Paths are almost always ASCII, and the case of an ASCII character can be changed without calling into the CRT
+// (towupper/towlower are locale-aware function calls): the kernels below handle blocks of 8 UTF-16 characters at once
+// and give up on any block that has a non-ASCII character, which the callers then handle with their original scalar code.
+// That keeps the results identical to the scalar ones (hash codes included, which the managed side relies on).
+//
+// SSE2 is part of the baseline of both x86 and x64; other platforms (and non-Windows builds, whose paths are not UTF-16)
+// only have the scalar code.
+
+#if !defined(SIMD_PATH_OPERATIONS)
+#if _WIN32 && (defined(_M_X64) || defined(_M_IX86))
+#define SIMD_PATH_OPERATIONS 1
+#else
+#define SIMD_PATH_OPERATIONS 0
+#endif
+#endif
+
+#if SIMD_PATH_OPERATIONS
+
+#include <emmintrin.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Number of characters handled at once
+#define SIMD_PATH_BLOCK_LENGTH 8
+
+inline __m128i LoadPathBlock(const WCHAR* chars)
+{
+    return _mm_loadu_si128((const __m128i*)chars);
+}
+
+inline bool AreBlocksEqual(__m128i a, __m128i b)
+{
+    return _mm_movemask_epi8(_mm_cmpeq_epi16(a, b)) == 0xFFFF;
+}
+
+inline bool IsAsciiBlock(__m128i chars)
+{
+    return _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(chars, _mm_set1_epi16((short)0xFF80)), _mm_setzero_si128())) == 0xFFFF;
+}
+
+inline bool HasNullChar(__m128i chars)
+{
+    return _mm_movemask_epi8(_mm_cmpeq_epi16(chars, _mm_setzero_si128())) != 0;
+}
+
+// Changes the case of the ASCII letters of the block (to upper case when 'from' is 'a', to lower case when it is 'A').
+// Returns false, leaving 'result' unset, if the block has a non-ASCII character.
+template<char from>
+inline bool TryChangeAsciiCase(__m128i chars, __m128i& result)
+{
+    if (!IsAsciiBlock(chars))
+    {
+        return false;
+    }
+
+    __m128i isLetter = _mm_and_si128(
+        _mm_cmpgt_epi16(chars, _mm_set1_epi16(from - 1)),
+        _mm_cmplt_epi16(chars, _mm_set1_epi16(from + 26)));
+    __m128i caseBit = _mm_and_si128(isLetter, _mm_set1_epi16(0x20));
+
+    // The case bit is set in lower case letters, clear in upper case ones
+    result = _mm_xor_si128(chars, caseBit);
+    return true;
+}
+
+inline bool TryToUpperAscii(__m128i chars, __m128i& result) { return TryChangeAsciiCase<'a'>(chars, result); }
+inline bool TryToLowerAscii(__m128i chars, __m128i& result) { return TryChangeAsciiCase<'A'>(chars, result); }
+
+// Whether both blocks are equal ignoring (ASCII) case; false if they differ or if either has a non-ASCII character that differs.
+inline bool AreBlocksEqualIgnoringAsciiCase(__m128i a, __m128i b)
+{
+    if (AreBlocksEqual(a, b))
+    {
+        return true;
+    }
+
+    __m128i upperA, upperB;
+    return TryToUpperAscii(a, upperA) && TryToUpperAscii(b, upperB) && AreBlocksEqual(upperA, upperB);
+}
+
+// Returns a number of leading characters of a and b (a multiple of the block length, at most 'length') that are known to be equal ignoring case.
+// The characters that follow are either different, non-ASCII or too few for a block: they are left to the caller.
+inline size_t EqualPrefixLengthIgnoringAsciiCase(const WCHAR* a, const WCHAR* b, size_t length)
+{
+    size_t i = 0;
+    for (; i + SIMD_PATH_BLOCK_LENGTH <= length; i += SIMD_PATH_BLOCK_LENGTH)
+    {
+        if (!AreBlocksEqualIgnoringAsciiCase(LoadPathBlock(a + i), LoadPathBlock(b + i)))
+        {
+            break;
+        }
+    }
+
+    return i;
+}
+
+// Like EqualPrefixLengthIgnoringAsciiCase but for trailing characters.
+inline size_t EqualSuffixLengthIgnoringAsciiCase(const WCHAR* a, const WCHAR* b, size_t length)
+{
+    size_t i = 0;
+    for (; i + SIMD_PATH_BLOCK_LENGTH <= length; i += SIMD_PATH_BLOCK_LENGTH)
+    {
+        size_t start = length - i - SIMD_PATH_BLOCK_LENGTH;
+        if (!AreBlocksEqualIgnoringAsciiCase(LoadPathBlock(a + start), LoadPathBlock(b + start)))
+        {
+            break;
+        }
+    }
+
+    return i;
+}
+
+// Whether reading a block at the given address stays within its page, i.e., cannot fault if the first character is readable.
+inline bool IsBlockWithinPage(const WCHAR* chars)
+{
+    return ((uintptr_t)chars & 4095) <= 4096 - SIMD_PATH_BLOCK_LENGTH * sizeof(WCHAR);
+}
+
+// Like EqualPrefixLengthIgnoringAsciiCase for null-terminated strings: the returned characters contain no null character.
+// Blocks that straddle a page boundary are left to the caller, since the string may end right before it.
+inline size_t EqualNonNullPrefixLengthIgnoringAsciiCase(const WCHAR* a, const WCHAR* b)
+{
+    size_t i = 0;
+    while (IsBlockWithinPage(a + i) && IsBlockWithinPage(b + i))
+    {
+        __m128i charsA = LoadPathBlock(a + i);
+        __m128i charsB = LoadPathBlock(b + i);
+        if (HasNullChar(charsA) || HasNullChar(charsB) || !AreBlocksEqualIgnoringAsciiCase(charsA, charsB))
+        {
+            break;
+        }
+
+        i += SIMD_PATH_BLOCK_LENGTH;
+    }
+
+    return i;
+}
+
+#endif // SIMD_PATH_OPERATIONS
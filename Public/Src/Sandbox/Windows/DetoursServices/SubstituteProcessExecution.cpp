@@ -12,6 +12,7 @@
 #include "FileAccessHelpers.h"
 #include "StringOperations.h"
 #include "UnicodeConverter.h"
+#include "ShimProcessMatchTable.h"
 #include "SubstituteProcessExecution.h"
 
 using std::wstring;
@@ -176,17 +177,6 @@ static const void FindApplicationNameFromCommandLine(const wchar_t *lpCommandLin
     }
 }
 
-static bool CommandArgsContainMatch(const wchar_t *commandArgs, const wchar_t *argMatch)
-{
-    if (argMatch == nullptr)
-    {
-        // No optional match, meaning always match.
-        return true;
-    }
-
-    return wcsstr(commandArgs, argMatch) != nullptr;
-}
-
 static bool CallPluginFunc(
     const wstring& command,
     const wstring& commandArgs,
@@ -227,7 +217,7 @@ static bool ShouldSubstituteShim(
     assert(g_SubstituteProcessExecutionShimPath != nullptr);
 
     // Easy cases.
-    if (g_pShimProcessMatches == nullptr || g_pShimProcessMatches->empty())
+    if (g_pShimProcessMatchTable == nullptr || g_pShimProcessMatchTable->IsEmpty())
     {
         if (g_SubstituteProcessExecutionPluginFunc != nullptr)
         {
@@ -245,45 +235,8 @@ static bool ShouldSubstituteShim(
         return g_ProcessExecutionShimAllProcesses;
     }
 
-    size_t commandLen = command.length();
-
-    bool foundMatch = false;
-
-    for (std::vector<ShimProcessMatch*>::iterator it = g_pShimProcessMatches->begin(); it != g_pShimProcessMatches->end(); ++it)
-    {
-        ShimProcessMatch* pMatch = *it;
-
-        const wchar_t* processName = pMatch->ProcessName.get();
-        size_t processLen = wcslen(processName);
-
-        // lpAppName is longer than e.g. "cmd.exe", see if lpAppName ends with e.g. "\cmd.exe"
-        if (processLen < commandLen)
-        {
-            if (command[commandLen - processLen - 1] == L'\\' &&
-                _wcsicmp(command.c_str() + commandLen - processLen, processName) == 0)
-            {
-                if (CommandArgsContainMatch(commandArgs.c_str(), pMatch->ArgumentMatch.get()))
-                {
-                    foundMatch = true;
-                    break;
-                }
-            }
-
-            continue;
-        }
-
-        if (processLen == commandLen)
-        {
-            if (_wcsicmp(processName, command.c_str()) == 0)
-            {
-                if (CommandArgsContainMatch(commandArgs.c_str(), pMatch->ArgumentMatch.get()))
-                {
-                    foundMatch = true;
-                    break;
-                }
-            }
-        }
-    }
+    // Only the matches for the file name of the command are looked at (see ShimProcessMatchTable).
+    bool foundMatch = g_pShimProcessMatchTable->Matches(command, commandArgs.c_str());
 
     // Filter meaning is exclusive if we're shimming all processes, inclusive otherwise.
     bool filterMatch = !g_ProcessExecutionShimAllProcesses;
@@ -0,0 +1,111 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include "TranslatePathTrie.h"
+
+// If we are building this for tests, we don't want to use the builxl private heap that only exists when running under detours
+#ifndef TEST
+    #include "stdafx.h"
+    #include "buildXL_mem.h"
+#endif
+
+#include <algorithm>
+#include <wctype.h>
+
+static bool IsUsed(const std::vector<size_t>& usedTranslations, size_t translationIndex)
+{
+    // Only the translations applied to a single path are used: a handful at most.
+    return std::find(usedTranslations.begin(), usedTranslations.end(), translationIndex) != usedTranslations.end();
+}
+
+TranslatePathTrie::TranslatePathTrie()
+{
+    m_nodes.push_back(Node { L'\0', NoNode, NoNode, std::vector<size_t>() });
+}
+
+uint32_t TranslatePathTrie::FindChild(uint32_t node, wchar_t c) const
+{
+    for (uint32_t child = m_nodes[node].FirstChild; child != NoNode; child = m_nodes[child].NextSibling)
+    {
+        if (m_nodes[child].Char == c)
+        {
+            return child;
+        }
+    }
+
+    return NoNode;
+}
+
+void TranslatePathTrie::Insert(const std::wstring& lowCaseFromPath, size_t translationIndex)
+{
+    uint32_t node = 0;
+    for (wchar_t c : lowCaseFromPath)
+    {
+        uint32_t child = FindChild(node, c);
+        if (child == NoNode)
+        {
+            child = (uint32_t)m_nodes.size();
+            m_nodes.push_back(Node { c, NoNode, m_nodes[node].FirstChild, std::vector<size_t>() });
+            m_nodes[node].FirstChild = child;
+        }
+
+        node = child;
+    }
+
+    m_nodes[node].Translations.push_back(translationIndex);
+}
+
+bool TranslatePathTrie::TryFind(
+    const std::wstring& path,
+    const std::vector<size_t>& usedTranslations,
+    size_t& translationIndex,
+    size_t& matchedLength) const
+{
+    bool found = false;
+    uint32_t node = 0;
+    size_t length = 0;
+
+    for (; length < path.length(); length++)
+    {
+        node = FindChild(node, towlower(path[length]));
+        if (node == NoNode)
+        {
+            break;
+        }
+
+        // Deeper nodes are longer prefixes; for a given prefix the first translation of the manifest wins.
+        for (size_t index : m_nodes[node].Translations)
+        {
+            if (!IsUsed(usedTranslations, index))
+            {
+                translationIndex = index;
+                matchedLength = length + 1;
+                found = true;
+                break;
+            }
+        }
+    }
+
+    if (node != NoNode && length == path.length() && length > 0 && path.back() != L'\\')
+    {
+        // The path may be a directory path that does not have a trailing '\\'. Such a match takes precedence over any
+        // prefix of the path; among translations of the same directory the last one of the manifest wins.
+        uint32_t child = FindChild(node, L'\\');
+        if (child != NoNode)
+        {
+            const std::vector<size_t>& translations = m_nodes[child].Translations;
+            for (auto it = translations.rbegin(); it != translations.rend(); ++it)
+            {
+                if (!IsUsed(usedTranslations, *it))
+                {
+                    translationIndex = *it;
+                    matchedLength = length;
+                    found = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    return found;
+}
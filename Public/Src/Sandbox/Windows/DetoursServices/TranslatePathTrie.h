@@ -0,0 +1,51 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+#define EXPORT __declspec( dllexport )
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// The 'from' paths of the path translations of the manifest (see TranslateFilePath), compiled into a case-insensitive
+// character trie when the manifest is parsed, so that finding the translation to apply to a path is a single walk over
+// the path instead of a comparison with every translation.
+// Translations are identified by their index in the manifest (i.e., in g_pManifestTranslatePathTuples).
+// This class is not thread safe for writing; lookups can be done concurrently once all translations have been inserted.
+class TranslatePathTrie {
+public:
+    EXPORT TranslatePathTrie();
+
+    // Adds the 'from' path (lower case, as stored in TranslatePathTuple) of the translation with the given index.
+    // Translations must be inserted in increasing index order.
+    EXPORT void Insert(const std::wstring& lowCaseFromPath, size_t translationIndex);
+
+    // Finds the translation to apply to the given path (of any case), ignoring the translations in usedTranslations:
+    // - the translation whose 'from' path is the longest prefix of the path (the first one in the manifest if several have the same 'from' path), or
+    // - if the path does not end with '\\', a translation whose 'from' path is the path followed by '\\', i.e., the path is a translated directory.
+    // Returns false if no translation applies; otherwise matchedLength is the number of characters of the path that are translated.
+    EXPORT bool TryFind(
+        const std::wstring& path,
+        const std::vector<size_t>& usedTranslations,
+        size_t& translationIndex,
+        size_t& matchedLength) const;
+
+private:
+    static const uint32_t NoNode = 0xFFFFFFFF;
+
+    struct Node {
+        wchar_t Char;
+        uint32_t FirstChild;
+        uint32_t NextSibling;
+
+        // Translations whose 'from' path ends at this node, in increasing index order
+        std::vector<size_t> Translations;
+    };
+
+    uint32_t FindChild(uint32_t node, wchar_t c) const;
+
+    // The root is the first node
+    std::vector<Node> m_nodes;
+};
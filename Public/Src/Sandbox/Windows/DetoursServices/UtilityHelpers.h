@@ -7,26 +7,36 @@
 #include <cwctype>
 #include <algorithm>
 #include "DataTypes.h"
+#include "StringOperationsSimd.h"
 
 // Case-insensitive equality for wstrings
 struct CaseInsensitiveStringComparer : public std::binary_function<std::wstring, std::wstring, bool> {
     bool operator()(const std::wstring& lhs, const std::wstring& rhs) const {
         if (lhs.length() == rhs.length()) {
-            return std::equal(rhs.begin(), rhs.end(), lhs.begin(),
-                [](const wchar_t a, const wchar_t b)
-                {
-                    if (a == b)
-                    {
-                        return true;
-                    }
-
-                    return towlower(a) == towlower(b);
-                });
+            return AreEqual(lhs.c_str(), rhs.c_str(), lhs.length());
         }
         else {
             return false;
         }
     }
+
+    // Compares strings that have the given length (for callers that don't have wstrings at hand)
+    static bool AreEqual(const wchar_t* lhs, const wchar_t* rhs, size_t length) {
+        size_t start = 0;
+#if SIMD_PATH_OPERATIONS
+        start = EqualPrefixLengthIgnoringAsciiCase(lhs, rhs, length);
+#endif // SIMD_PATH_OPERATIONS
+        return std::equal(rhs + start, rhs + length, lhs + start,
+            [](const wchar_t a, const wchar_t b)
+            {
+                if (a == b)
+                {
+                    return true;
+                }
+
+                return towlower(a) == towlower(b);
+            });
+    }
 };
 
 // Case-insensitive 'less than' for wstrings. Uses a lexicographical comparison on lowercased characters
@@ -38,7 +48,12 @@ struct CaseInsensitiveStringLessThan : public std::binary_function<std::wstring,
         {
             // Paths in the same process tend to share a significant prefix in common. Starting backwards
             // has a better chance to hit a difference first
-            auto result = std::lexicographical_compare(rhs.rbegin(), rhs.rend(), lhs.rbegin(), lhs.rend(),
+            size_t skip = 0;
+#if SIMD_PATH_OPERATIONS
+            // Equal trailing characters don't change the result
+            skip = EqualSuffixLengthIgnoringAsciiCase(lhs.c_str(), rhs.c_str(), lhs.length());
+#endif // SIMD_PATH_OPERATIONS
+            auto result = std::lexicographical_compare(rhs.rbegin() + skip, rhs.rend(), lhs.rbegin() + skip, lhs.rend(),
                 [](const wchar_t a, const wchar_t b)
                 {
                     if (a == b)
@@ -57,12 +72,39 @@ struct CaseInsensitiveStringLessThan : public std::binary_function<std::wstring,
     }
 };
 
-// Case-insensitive hasher for wstrings
+// Case-insensitive hasher for wstrings (consistent with CaseInsensitiveStringComparer)
+// FNV-1a over the lowercased characters, so hashing does not need to allocate a lowercased copy of the string
 struct CaseInsensitiveStringHasher {
     size_t operator()(const std::wstring& str) const {
-        std::wstring lowerstr(str);
-        std::transform(lowerstr.begin(), lowerstr.end(), lowerstr.begin(), towlower);
+        return (size_t)Hash(str.c_str(), str.length());
+    }
+
+    // The hash of the given characters (for callers that don't have a wstring at hand), which operator() truncates to a size_t
+    static uint64_t Hash(const wchar_t* str, size_t length) {
+        uint64_t hash = 14695981039346656037ULL;
+        size_t i = 0;
+#if SIMD_PATH_OPERATIONS
+        wchar_t lower[SIMD_PATH_BLOCK_LENGTH];
+        for (; i + SIMD_PATH_BLOCK_LENGTH <= length; i += SIMD_PATH_BLOCK_LENGTH) {
+            __m128i block;
+            if (TryToLowerAscii(LoadPathBlock(str + i), block)) {
+                _mm_storeu_si128((__m128i*)lower, block);
+            }
+            else {
+                for (size_t j = 0; j < SIMD_PATH_BLOCK_LENGTH; j++) {
+                    lower[j] = (wchar_t)towlower(str[i + j]);
+                }
+            }
+
+            for (size_t j = 0; j < SIMD_PATH_BLOCK_LENGTH; j++) {
+                hash = (hash ^ (uint64_t)lower[j]) * 1099511628211ULL;
+            }
+        }
+#endif // SIMD_PATH_OPERATIONS
+        for (; i < length; i++) {
+            hash = (hash ^ (uint64_t)towlower(str[i])) * 1099511628211ULL;
+        }
 
-        return std::hash<std::wstring>()(lowerstr);
+        return hash;
     }
 };
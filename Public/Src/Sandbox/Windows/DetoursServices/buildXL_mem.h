@@ -2,6 +2,7 @@
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
 
 #include "globals.h"
+#include "SlabAllocator.h"
 
 #pragma once
 
@@ -14,28 +15,11 @@ extern volatile LONG64 g_detoursHeapAllocatedMemoryInBytes;
 // The general allocation APIs are stubbed out and one should call only the dd_* methods.
 // The memory allocation done from the BuildXL Detours library happens on a private heap.
 
-// malloc and free versions for this DLL.
+// malloc and free versions for this DLL; small allocations are served from per-thread slabs (see SlabAllocator.h).
 inline void* dd_malloc(size_t size)
 {
     assert(g_hPrivateHeap != nullptr);
-    void* ret = HeapAlloc(g_hPrivateHeap, BUILDXL_DETOURS_MEMORY_ALLOC_FLAGS, size);
-
-    if (ShouldLogProcessData())
-    {
-        // Get the size since alignment matters and the actual allocated bytes can be a bit moe than size.
-        LONG64 allocatedSize = (LONG64)HeapSize(g_hPrivateHeap, BUILDXL_DETOURS_MEMORY_ALLOC_FLAGS, ret);
-        allocatedSize = InterlockedAdd64(&g_detoursHeapAllocatedMemoryInBytes, allocatedSize);
-        LONG64 localMax = InterlockedAdd64(&g_detoursMaxAllocatedMemoryInBytes, 0);
-
-        // Update the global MaxAllocated heap only if the current allocated heap is bigger than what is recorded.
-        while (allocatedSize > localMax)
-        {
-            InterlockedCompareExchange64(&g_detoursMaxAllocatedMemoryInBytes, allocatedSize, localMax);
-            localMax = InterlockedAdd64(&g_detoursMaxAllocatedMemoryInBytes, 0);
-        }
-    }
-
-    return ret;
+    return SlabAlloc(size);
 }
 
 inline void dd_free(void* pMem)
@@ -46,14 +30,7 @@ inline void dd_free(void* pMem)
         return;
     }
 
-    if (ShouldLogProcessData())
-    {
-        // Get the size since alignment matters and the actual allocated bytes can be a bit moe than size.
-        LONG64 deallocatedSize = (LONG64)HeapSize(g_hPrivateHeap, BUILDXL_DETOURS_MEMORY_ALLOC_FLAGS, pMem);
-        InterlockedAdd64(&g_detoursHeapAllocatedMemoryInBytes, -(deallocatedSize));
-    }
-
-    HeapFree(g_hPrivateHeap, HEAP_ZERO_MEMORY, pMem);
+    SlabFree(pMem);
 }
 
 // New news and deletes operators that call the private heap.
@@ -23,7 +23,8 @@ using std::vector;
 // FORWARD DECLARATIONS
 // ----------------------------------------------------------------------------
 class TranslatePathTuple;
-class ShimProcessMatch;
+class TranslatePathTrie;
+class ShimProcessMatchTable;
 
 // ----------------------------------------------------------------------------
 // GLOBALS
@@ -49,6 +50,7 @@ extern PManifestChildProcessesToBreakAwayFromJob g_manifestChildProcessesToBreak
 extern std::unordered_set<std::wstring, CaseInsensitiveStringHasher, CaseInsensitiveStringComparer>* g_processNamesToBreakAwayFromJob;
 extern PManifestTranslatePathsStrings g_manifestTranslatePathsStrings;
 extern vector<TranslatePathTuple*>* g_pManifestTranslatePathTuples;
+extern TranslatePathTrie* g_pManifestTranslatePathTrie;
 extern std::unordered_set<std::wstring>* g_pManifestTranslatePathLookupTable;
 
 extern PManifestInternalDetoursErrorNotificationFileString g_manifestInternalDetoursErrorNotificationFileString;
@@ -113,7 +115,7 @@ extern bool g_ProcessExecutionShimAllProcesses;
 extern wchar_t* g_SubstituteProcessExecutionPluginDllPath;
 extern HMODULE g_SubstituteProcessExecutionPluginDllHandle;
 extern SubstituteProcessExecutionPluginFunc g_SubstituteProcessExecutionPluginFunc;
-extern vector<ShimProcessMatch*>* g_pShimProcessMatches;
+extern ShimProcessMatchTable* g_pShimProcessMatchTable;
 
 // ----------------------------------------------------------------------------
 // Real Windows API function pointers
@@ -130,6 +132,7 @@ extern VirtualAlloc_t Real_VirtualAlloc;
 
 extern CreateFileA_t Real_CreateFileA;
 extern GetVolumePathNameW_t Real_GetVolumePathNameW;
+extern DefineDosDeviceW_t Real_DefineDosDeviceW;
 extern GetFileAttributesA_t Real_GetFileAttributesA;
 extern GetFileAttributesW_t Real_GetFileAttributesW;
 extern GetFileAttributesExW_t Real_GetFileAttributesExW;
@@ -204,8 +207,37 @@ extern volatile LONG g_msTimeInAddClosedList;
 extern volatile LONG g_msTimeInRemoveClosedList;
 #endif // MEASURE_DETOURED_NT_CLOSE_IMPACT
 
-#if MEASURE_REPARSEPOINT_RESOLVING_IMPACT
-extern volatile ULONGLONG g_shouldResolveReparsePointCacheHitCount;
-extern volatile ULONGLONG g_reparsePointTargetCacheHitCount;
-extern volatile ULONGLONG g_resolvedPathsCacheHitCout;
-#endif // MEASURE_REPARSEPOINT_RESOLVING_IMPACT
+// Lookups and hits of the resolved path cache (see ResolvedPathCache.h), sent with the process data.
+// The counters are spread over cache lines by thread (see GetPathCacheStatistics), so that counting a lookup does not
+// make all the threads doing lookups write the same cache line (which is what the cache itself avoids on a hit).
+#define PATH_CACHE_STATISTICS_STRIPES 16
+
+typedef struct __declspec(align(64)) PathCacheStatistics_t
+{
+    volatile LONG64 Lookups;
+    volatile LONG64 ShouldResolveReparsePointCacheHitCount;
+    volatile LONG64 ReparsePointTargetCacheHitCount;
+    volatile LONG64 ResolvedPathsCacheHitCount;
+} PathCacheStatistics;
+
+extern PathCacheStatistics g_pathCacheStatistics[PATH_CACHE_STATISTICS_STRIPES];
+
+// Counters of the current thread. Thread ids are multiples of 4.
+inline PathCacheStatistics& GetPathCacheStatistics()
+{
+    return g_pathCacheStatistics[(GetCurrentThreadId() >> 2) % PATH_CACHE_STATISTICS_STRIPES];
+}
+
+// Sums the counters of all threads.
+inline void SumPathCacheStatistics(ULONG64& lookups, ULONG64& hits)
+{
+    lookups = 0;
+    hits = 0;
+    for (size_t i = 0; i < PATH_CACHE_STATISTICS_STRIPES; i++)
+    {
+        lookups += g_pathCacheStatistics[i].Lookups;
+        hits += g_pathCacheStatistics[i].ShouldResolveReparsePointCacheHitCount
+            + g_pathCacheStatistics[i].ReparsePointTargetCacheHitCount
+            + g_pathCacheStatistics[i].ResolvedPathsCacheHitCount;
+    }
+}
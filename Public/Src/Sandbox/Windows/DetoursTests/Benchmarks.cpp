@@ -0,0 +1,212 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+// Benchmarks.cpp : Runs the operations Detours is the most sensitive to in tight loops, and prints the time they take per operation.
+//
+// The benchmarks are not run by the tests: they are meant to be run by hand, once undetoured (DetoursTests.exe BenchmarkCreateFile)
+// and once in the sandbox, to measure the overhead of the detours (and, with BuildXLWindowsSandboxCollectDetourStatistics=1, which
+// detours it is spent in, and the report bytes in the pip's log). The number of operations can be set with the
+// BUILDXL_DETOURS_BENCHMARK_ITERATIONS environment variable.
+//
+// The benchmarks work in the current directory, creating what they need the first time they run:
+//   BenchmarkCreateFile:         benchmarkFile
+//   BenchmarkEnumerateDirectory: benchmarkDirectory\file<n> (100000 files)
+//   BenchmarkSymlinkChain:       benchmarkTarget, benchmarkLink<n> (a chain of 8 symlinks to benchmarkTarget)
+//   BenchmarkCreateProcess:      (none; it starts DetoursTests.exe BenchmarkChildProcess)
+
+#include "stdafx.h"
+
+#include "Benchmarks.h"
+#include "Utils.h"
+
+#pragma warning( disable : 4711) // ... selected for inline expansion
+
+#define BENCHMARK_DIRECTORY_ENTRIES 100000
+#define BENCHMARK_SYMLINK_CHAIN_LENGTH 8
+
+static DWORD GetIterations(DWORD defaultIterations)
+{
+    wchar_t value[32];
+    DWORD length = GetEnvironmentVariableW(L"BUILDXL_DETOURS_BENCHMARK_ITERATIONS", value, _countof(value));
+    if (length == 0 || length >= _countof(value))
+    {
+        return defaultIterations;
+    }
+
+    DWORD iterations = wcstoul(value, nullptr, 10);
+    return iterations == 0 ? defaultIterations : iterations;
+}
+
+static LONGLONG Now()
+{
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return now.QuadPart;
+}
+
+static void PrintResult(const char* name, DWORD operations, LONGLONG start, LONGLONG end)
+{
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+
+    double nanoseconds = (double)(end - start) * 1e9 / (double)frequency.QuadPart;
+    printf("%s: %lu operations, %.0f ns/op\n", name, operations, operations == 0 ? 0.0 : nanoseconds / operations);
+}
+
+static bool EnsureFile(LPCWSTR path)
+{
+    HANDLE hFile = CreateFileW(path, GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+    {
+        printf("Could not create '%ls' (%lu)\n", path, GetLastError());
+        return false;
+    }
+
+    CloseHandle(hFile);
+    return true;
+}
+
+// Opens and closes the same file.
+int BenchmarkCreateFile()
+{
+    if (!EnsureFile(L"benchmarkFile"))
+    {
+        return (int)GetLastError();
+    }
+
+    DWORD iterations = GetIterations(100000);
+    LONGLONG start = Now();
+    for (DWORD i = 0; i < iterations; i++)
+    {
+        HANDLE hFile = CreateFileW(L"benchmarkFile", GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (hFile == INVALID_HANDLE_VALUE)
+        {
+            return (int)GetLastError();
+        }
+
+        CloseHandle(hFile);
+    }
+
+    PrintResult("CreateFile+CloseHandle", iterations, start, Now());
+    return ERROR_SUCCESS;
+}
+
+// Enumerates a directory of 100000 files with FindFirstFile/FindNextFile. An operation is one entry.
+int BenchmarkEnumerateDirectory()
+{
+    CreateDirectoryW(L"benchmarkDirectory", NULL);
+    wstring lastEntry = L"benchmarkDirectory\\file" + to_wstring(BENCHMARK_DIRECTORY_ENTRIES);
+    if (GetFileAttributesW(lastEntry.c_str()) == INVALID_FILE_ATTRIBUTES)
+    {
+        for (DWORD i = 1; i <= BENCHMARK_DIRECTORY_ENTRIES; i++)
+        {
+            wstring path = L"benchmarkDirectory\\file" + to_wstring(i);
+            if (!EnsureFile(path.c_str()))
+            {
+                return (int)GetLastError();
+            }
+        }
+    }
+
+    DWORD iterations = GetIterations(10);
+    DWORD entries = 0;
+    LONGLONG start = Now();
+    for (DWORD i = 0; i < iterations; i++)
+    {
+        WIN32_FIND_DATAW findData;
+        HANDLE hFind = FindFirstFileW(L"benchmarkDirectory\\*", &findData);
+        if (hFind == INVALID_HANDLE_VALUE)
+        {
+            return (int)GetLastError();
+        }
+
+        do
+        {
+            entries++;
+        } while (FindNextFileW(hFind, &findData));
+
+        FindClose(hFind);
+    }
+
+    PrintResult("FindFirstFile+FindNextFile", entries, start, Now());
+    return ERROR_SUCCESS;
+}
+
+// Opens a file through a chain of symlinks (benchmarkLink1 -> benchmarkLink2 -> ... -> benchmarkTarget).
+int BenchmarkSymlinkChain()
+{
+    if (!EnsureFile(L"benchmarkTarget"))
+    {
+        return (int)GetLastError();
+    }
+
+    wstring target = L"benchmarkTarget";
+    for (int i = BENCHMARK_SYMLINK_CHAIN_LENGTH; i >= 1; i--)
+    {
+        wstring link = L"benchmarkLink" + to_wstring(i);
+        if (GetFileAttributesW(link.c_str()) == INVALID_FILE_ATTRIBUTES && !TestCreateSymbolicLinkW(link.c_str(), target.c_str(), 0))
+        {
+            printf("Could not create the symlink '%ls' (%lu): creating symlinks may require developer mode or elevation\n", link.c_str(), GetLastError());
+            return (int)GetLastError();
+        }
+
+        target = link;
+    }
+
+    DWORD iterations = GetIterations(10000);
+    LONGLONG start = Now();
+    for (DWORD i = 0; i < iterations; i++)
+    {
+        HANDLE hFile = CreateFileW(L"benchmarkLink1", GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (hFile == INVALID_HANDLE_VALUE)
+        {
+            return (int)GetLastError();
+        }
+
+        CloseHandle(hFile);
+    }
+
+    PrintResult("CreateFile through a chain of " _CRT_STRINGIZE(BENCHMARK_SYMLINK_CHAIN_LENGTH) " symlinks", iterations, start, Now());
+    return ERROR_SUCCESS;
+}
+
+// Starts this executable (with the BenchmarkChildProcess verb) and waits for it to exit.
+int BenchmarkCreateProcess()
+{
+    wchar_t exePath[MAX_PATH];
+    if (GetModuleFileNameW(NULL, exePath, _countof(exePath)) == 0)
+    {
+        return (int)GetLastError();
+    }
+
+    wstring commandLine = L"\"" + wstring(exePath) + L"\" BenchmarkChildProcess";
+
+    DWORD iterations = GetIterations(200);
+    LONGLONG start = Now();
+    for (DWORD i = 0; i < iterations; i++)
+    {
+        STARTUPINFOW startupInfo;
+        ZeroMemory(&startupInfo, sizeof(startupInfo));
+        startupInfo.cb = sizeof(startupInfo);
+        PROCESS_INFORMATION processInfo;
+
+        vector<wchar_t> commandLineBuffer(commandLine.begin(), commandLine.end());
+        commandLineBuffer.push_back(L'\0');
+        if (!CreateProcessW(NULL, commandLineBuffer.data(), NULL, NULL, FALSE, 0, NULL, NULL, &startupInfo, &processInfo))
+        {
+            return (int)GetLastError();
+        }
+
+        WaitForSingleObject(processInfo.hProcess, INFINITE);
+        CloseHandle(processInfo.hThread);
+        CloseHandle(processInfo.hProcess);
+    }
+
+    PrintResult("CreateProcess+wait", iterations, start, Now());
+    return ERROR_SUCCESS;
+}
+
+int BenchmarkChildProcess()
+{
+    return ERROR_SUCCESS;
+}
@@ -0,0 +1,10 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#pragma once
+
+int BenchmarkCreateFile();
+int BenchmarkEnumerateDirectory();
+int BenchmarkSymlinkChain();
+int BenchmarkCreateProcess();
+int BenchmarkChildProcess();
@@ -9,6 +9,7 @@
 
 using namespace std;
 
+#include "Benchmarks.h"
 #include "Logging.h"
 #include "ReadExclusive.h"
 #include "ShortNames.h"
@@ -1290,6 +1291,19 @@ static void LoggingTests(const string& verb)
 #undef IF_COMMAND
 }
 
+static void BenchmarkTests(const string& verb)
+{
+#define IF_COMMAND(NAME)   { if (verb == #NAME) { exit(NAME()); } }
+
+    IF_COMMAND(BenchmarkCreateFile);
+    IF_COMMAND(BenchmarkEnumerateDirectory);
+    IF_COMMAND(BenchmarkSymlinkChain);
+    IF_COMMAND(BenchmarkCreateProcess);
+    IF_COMMAND(BenchmarkChildProcess);
+
+#undef IF_COMMAND
+}
+
 static void CorrelationCallTests(const string& verb)
 {
 #define IF_COMMAND1(NAME)   { if (verb == #NAME) { exit(NAME()); } }
@@ -1331,6 +1345,7 @@ int main(int argc, char **argv)
     SymlinkTests(verb);
     ResolvedPathCacheTests(verb);
     CorrelationCallTests(verb);
+    BenchmarkTests(verb);
     GenericTests(verb);
 
 #undef IF_COMMAND
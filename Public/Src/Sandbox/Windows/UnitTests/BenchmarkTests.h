@@ -0,0 +1,212 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <vector>
+#include <windows.h>
+#include <PathTree.h>
+#include <ResolvedPathCache.h>
+#include <StringOperations.h>
+
+// Microbenchmarks of the data structures the detours use on their hot paths. Not pass/fail tests: they report throughput
+// and allocations with BOOST_TEST_MESSAGE, and are disabled so that they don't slow down the regular runs.
+// Run them with: DetoursUnitTests.exe --run_test=Benchmarks --log_level=message
+BOOST_AUTO_TEST_SUITE(Benchmarks)
+
+// The busy blocks (and their bytes) in the process heap, which is the one the CRT allocates from.
+struct HeapUsage
+{
+    size_t Blocks = 0;
+    size_t Bytes = 0;
+
+    static HeapUsage Current()
+    {
+        HeapUsage usage;
+        HANDLE heap = GetProcessHeap();
+        if (!HeapLock(heap))
+        {
+            return usage;
+        }
+
+        PROCESS_HEAP_ENTRY entry;
+        entry.lpData = NULL;
+        while (HeapWalk(heap, &entry))
+        {
+            if ((entry.wFlags & PROCESS_HEAP_ENTRY_BUSY) != 0)
+            {
+                usage.Blocks++;
+                usage.Bytes += entry.cbData;
+            }
+        }
+
+        HeapUnlock(heap);
+        return usage;
+    }
+};
+
+// Paths shaped like the ones a build accesses: a few roots, deep output directories and many files per directory
+static std::vector<std::wstring> BenchmarkPaths(size_t count)
+{
+    static const wchar_t* roots[] = { L"C:\\src\\BuildXL\\Out\\Objects", L"C:\\src\\BuildXL\\Public\\Src", L"D:\\dbs\\sh\\nuget\\packages" };
+    std::vector<std::wstring> paths;
+    paths.reserve(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        std::wstring path(roots[i % (sizeof(roots) / sizeof(roots[0]))]);
+        path.append(L"\\").append(std::to_wstring(i % 17));
+        path.append(L"\\Microsoft.Build.").append(std::to_wstring(i % 251));
+        path.append(L"\\lib\\netstandard2.0\\file").append(std::to_wstring(i)).append(L".dll");
+        paths.push_back(std::move(path));
+    }
+
+    return paths;
+}
+
+// Runs the operation (which does the given number of iterations) and reports its time per iteration and the allocations it left behind
+static void Measure(const char* name, size_t iterations, const std::function<void()>& operation)
+{
+    HeapUsage before = HeapUsage::Current();
+    auto start = std::chrono::high_resolution_clock::now();
+
+    operation();
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+    HeapUsage after = HeapUsage::Current();
+
+    BOOST_TEST_MESSAGE(name << ": " << (elapsed / (long long)iterations) << " ns per op, "
+        << (long long)(iterations * 1000000000ull / (elapsed > 0 ? elapsed : 1)) << " ops/s, "
+        << ((long long)after.Blocks - (long long)before.Blocks) << " live blocks, "
+        << ((long long)after.Bytes - (long long)before.Bytes) << " live bytes");
+}
+
+BOOST_AUTO_TEST_CASE(PathTreeThroughput, * boost::unit_test::disabled())
+{
+    const std::vector<std::wstring> paths = BenchmarkPaths(100000);
+    PathTree tree;
+    size_t inserted = 0;
+
+    Measure("PathTree::TryInsert", paths.size(), [&]()
+    {
+        for (const std::wstring& path : paths)
+        {
+            inserted += tree.TryInsert(path) ? 1 : 0;
+        }
+    });
+
+    std::vector<std::wstring> descendants;
+    Measure("PathTree::RetrieveAndRemoveAllDescendants", paths.size(), [&]()
+    {
+        tree.RetrieveAndRemoveAllDescendants(L"C:\\src", descendants);
+        tree.RetrieveAndRemoveAllDescendants(L"D:\\dbs", descendants);
+    });
+
+    BOOST_CHECK_EQUAL(paths.size(), inserted);
+    BOOST_CHECK_EQUAL(paths.size(), descendants.size());
+}
+
+BOOST_AUTO_TEST_CASE(ResolvedPathCacheThroughput, * boost::unit_test::disabled())
+{
+    const std::vector<std::wstring> paths = BenchmarkPaths(20000);
+    const size_t lookupsPerThread = 200000;
+
+    for (size_t threadCount : { 1, 4, 16, 64 })
+    {
+        ResolvedPathCache cache;
+        std::atomic<size_t> inserted(0);
+        std::atomic<size_t> found(0);
+
+        auto runThreads = [&](const std::function<void(size_t)>& work)
+        {
+            std::vector<std::thread> threads;
+            for (size_t t = 0; t < threadCount; t++)
+            {
+                threads.emplace_back(work, t);
+            }
+
+            for (std::thread& thread : threads)
+            {
+                thread.join();
+            }
+        };
+
+        // Every thread inserts its share of the paths (an insert gives up when another thread holds the lock, as under detours)
+        std::string insertName = "ResolvedPathCache insert, " + std::to_string(threadCount) + " threads";
+        Measure(insertName.c_str(), paths.size(), [&]()
+        {
+            runThreads([&](size_t t)
+            {
+                for (size_t i = t; i < paths.size(); i += threadCount)
+                {
+                    inserted += cache.InsertResolvingCheckResult(paths[i], (i & 1) == 0) ? 1 : 0;
+                }
+            });
+        });
+
+        std::string lookupName = "ResolvedPathCache lookup, " + std::to_string(threadCount) + " threads";
+        Measure(lookupName.c_str(), lookupsPerThread * threadCount, [&]()
+        {
+            runThreads([&](size_t t)
+            {
+                size_t threadFound = 0;
+                for (size_t i = 0; i < lookupsPerThread; i++)
+                {
+                    // Lookups of a path repeat often when resolving the reparse points of the paths of a directory
+                    threadFound += cache.GetResolvingCheckResult(paths[(t * 7919 + i / 4) % paths.size()]).Found ? 1 : 0;
+                }
+
+                found += threadFound;
+            });
+        });
+
+        BOOST_CHECK(inserted > 0);
+        BOOST_CHECK(found > 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(StringOperationsPathThroughput, * boost::unit_test::disabled())
+{
+    const std::vector<std::wstring> paths = BenchmarkPaths(10000);
+    const size_t rounds = 50;
+    const size_t iterations = paths.size() * rounds;
+    size_t sink = 0;
+
+    Measure("HashPath", iterations, [&]()
+    {
+        for (size_t r = 0; r < rounds; r++)
+        {
+            for (const std::wstring& path : paths)
+            {
+                sink += HashPath(path.c_str(), path.length());
+            }
+        }
+    });
+
+    Measure("HasPrefix", iterations, [&]()
+    {
+        for (size_t r = 0; r < rounds; r++)
+        {
+            for (const std::wstring& path : paths)
+            {
+                sink += HasPrefix(path.c_str(), L"c:\\SRC\\buildxl\\out\\") ? 1 : 0;
+            }
+        }
+    });
+
+    Measure("IsPathWithinTree", iterations, [&]()
+    {
+        for (size_t r = 0; r < rounds; r++)
+        {
+            for (const std::wstring& path : paths)
+            {
+                sink += IsPathWithinTree(L"C:\\src\\BuildXL\\Public\\Src", path.c_str()) ? 1 : 0;
+            }
+        }
+    });
+
+    BOOST_CHECK(sink != 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,53 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <DosDeviceTable.h>
+
+BOOST_AUTO_TEST_SUITE(DosDeviceTableTests)
+
+static std::wstring Translate(const DosDeviceTable& t, const std::wstring& path)
+{
+    std::wstring dosPath = L"<none>";
+    t.TryTranslate(path.c_str(), path.length(), dosPath);
+    return dosPath;
+}
+
+BOOST_AUTO_TEST_CASE( TranslatesDeviceAndVolumeNames )
+{
+    DosDeviceTable t;
+    t.AddDrive(L'C', L"\\Device\\HarddiskVolume3", L"\\\\?\\Volume{00000000-0000-0000-0000-000000000003}");
+    t.AddDrive(L'D', L"\\Device\\HarddiskVolume30", L"\\\\?\\Volume{00000000-0000-0000-0000-000000000030}");
+
+    BOOST_CHECK(Translate(t, L"\\Device\\HarddiskVolume3\\foo\\bar.txt") == L"\\\\?\\C:\\foo\\bar.txt");
+    BOOST_CHECK(Translate(t, L"\\device\\harddiskvolume3\\") == L"\\\\?\\C:\\");
+    BOOST_CHECK(Translate(t, L"\\Device\\HarddiskVolume30\\foo") == L"\\\\?\\D:\\foo");
+    BOOST_CHECK(Translate(t, L"\\\\?\\Volume{00000000-0000-0000-0000-000000000030}\\foo") == L"\\\\?\\D:\\foo");
+
+    // The device name must be followed by a backslash
+    BOOST_CHECK(Translate(t, L"\\Device\\HarddiskVolume3") == L"<none>");
+    BOOST_CHECK(Translate(t, L"\\Device\\HarddiskVolume31\\foo") == L"<none>");
+    BOOST_CHECK(Translate(t, L"\\Device\\HarddiskVolume4\\foo") == L"<none>");
+    BOOST_CHECK(Translate(t, L"C:\\foo") == L"<none>");
+}
+
+BOOST_AUTO_TEST_CASE( TranslatesUncPaths )
+{
+    DosDeviceTable t;
+
+    BOOST_CHECK(Translate(t, L"\\Device\\Mup\\server\\share\\foo") == L"\\\\?\\UNC\\server\\share\\foo");
+
+    // Paths opened through a mapped drive are left to the OS
+    BOOST_CHECK(Translate(t, L"\\Device\\Mup\\;Z:0000000000001234\\server\\share\\foo") == L"<none>");
+}
+
+BOOST_AUTO_TEST_CASE( DoesNotTranslateVolumesWithSeveralDrives )
+{
+    DosDeviceTable t;
+    t.AddDrive(L'C', L"\\Device\\HarddiskVolume3", L"\\\\?\\Volume{00000000-0000-0000-0000-000000000003}");
+    t.AddDrive(L'X', L"\\Device\\HarddiskVolume3", L"\\\\?\\Volume{00000000-0000-0000-0000-000000000003}");
+
+    BOOST_CHECK(Translate(t, L"\\Device\\HarddiskVolume3\\foo") == L"<none>");
+    BOOST_CHECK(Translate(t, L"\\\\?\\Volume{00000000-0000-0000-0000-000000000003}\\foo") == L"<none>");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -14,4 +14,8 @@
 // The below includes basically make all the separated test suites into a single translation unit.
 #include "PathTreeTests.h"
 #include "StringOperationsTests.h"
-#include "ResolvedPathCacheTests.h"
\ No newline at end of file
+#include "ResolvedPathCacheTests.h"
+#include "TranslatePathTrieTests.h"
+#include "ShimProcessMatchTableTests.h"
+#include "DosDeviceTableTests.h"
+#include "BenchmarkTests.h"
\ No newline at end of file
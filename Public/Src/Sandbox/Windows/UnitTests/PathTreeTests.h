@@ -128,6 +128,20 @@ BOOST_AUTO_TEST_CASE( CasePreservingPaths )
     BOOST_CHECK(contains(desc, L"C:\\a\\path\\to\\ELSE"));
 }
 
+BOOST_AUTO_TEST_CASE( UncPaths )
+{
+    PathTree t;
+    bool success = t.TryInsert(L"\\\\server\\share\\path\\to\\something");
+    BOOST_CHECK(success);
+
+    std::vector<std::wstring> desc;
+    t.RetrieveAndRemoveAllDescendants(L"\\\\server\\share", desc);
+
+    // The server name keeps its leading separators
+    BOOST_CHECK_EQUAL(1, desc.size());
+    BOOST_CHECK(contains(desc, L"\\\\server\\share\\path\\to\\something"));
+}
+
 bool contains(std::vector<std::wstring>& collection, const std::wstring& element)
 {
     for (auto iter = collection.begin(); iter != collection.end(); iter++)
@@ -34,4 +34,86 @@ BOOST_AUTO_TEST_CASE( TryInsertPath )
     BOOST_CHECK(!findResult.Found);
 }
 
+BOOST_AUTO_TEST_CASE( LookupIgnoresCasingAndTrailingSeparator )
+{
+    ResolvedPathCache cache;
+
+    std::shared_ptr<std::vector<std::wstring>> order = std::make_shared<std::vector<std::wstring>>();
+    std::shared_ptr<std::map<std::wstring, ResolvedPathType, CaseInsensitiveStringLessThan>> resolvedPaths = std::make_shared<std::map<std::wstring, ResolvedPathType, CaseInsensitiveStringLessThan>>();
+
+    order->push_back(L"C:\\b\\path");
+    resolvedPaths->emplace(L"C:\\b\\path", ResolvedPathType::FullyResolved);
+
+    bool success = cache.InsertResolvedPaths(L"C:\\a\\path\\", false, order, resolvedPaths);
+    BOOST_CHECK(success);
+
+    BOOST_CHECK(cache.GetResolvedPaths(L"C:\\a\\path", false).Found);
+    BOOST_CHECK(cache.GetResolvedPaths(L"c:\\A\\PATH\\", false).Found);
+
+    // Entries are kept per value of preserveLastReparsePointInPath
+    BOOST_CHECK(!cache.GetResolvedPaths(L"C:\\a\\path", true).Found);
+
+    success = cache.InsertResolvingCheckResult(L"C:\\a\\Path", true);
+    BOOST_CHECK(success);
+
+    auto checkResult = cache.GetResolvingCheckResult(L"C:\\A\\path\\");
+    BOOST_CHECK(checkResult.Found);
+    BOOST_CHECK(checkResult.Value);
+
+    // Invalidating a parent directory invalidates everything underneath
+    cache.Invalidate(L"C:\\A", true);
+    BOOST_CHECK(!cache.GetResolvedPaths(L"C:\\a\\path", false).Found);
+    BOOST_CHECK(!cache.GetResolvingCheckResult(L"C:\\a\\path").Found);
+}
+
+BOOST_AUTO_TEST_CASE( LookupsDoNotSeeResultsOfOtherCaches )
+{
+    std::shared_ptr<std::vector<std::wstring>> order = std::make_shared<std::vector<std::wstring>>();
+    std::shared_ptr<std::map<std::wstring, ResolvedPathType, CaseInsensitiveStringLessThan>> resolvedPaths = std::make_shared<std::map<std::wstring, ResolvedPathType, CaseInsensitiveStringLessThan>>();
+
+    order->push_back(L"C:\\b\\path");
+    resolvedPaths->emplace(L"C:\\b\\path", ResolvedPathType::FullyResolved);
+
+    {
+        ResolvedPathCache cache;
+        BOOST_CHECK(cache.InsertResolvedPaths(L"C:\\a\\path", false, order, resolvedPaths));
+        BOOST_CHECK(cache.InsertResolvingCheckResult(L"C:\\a\\path", true));
+
+        // Looking up twice also exercises the copies of the results kept by this thread
+        BOOST_CHECK(cache.GetResolvedPaths(L"C:\\a\\path", false).Found);
+        BOOST_CHECK(cache.GetResolvedPaths(L"C:\\a\\path", false).Found);
+        BOOST_CHECK(cache.GetResolvingCheckResult(L"C:\\a\\path").Found);
+    }
+
+    // A cache created afterwards (possibly at the same address) starts empty
+    ResolvedPathCache cache;
+    BOOST_CHECK(!cache.GetResolvedPaths(L"C:\\a\\path", false).Found);
+    BOOST_CHECK(!cache.GetResolvingCheckResult(L"C:\\a\\path").Found);
+}
+
+BOOST_AUTO_TEST_CASE( InvalidatedEntriesCanBeInsertedAgain )
+{
+    ResolvedPathCache cache;
+
+    BOOST_CHECK(cache.InsertResolvingCheckResult(L"C:\\a\\b\\file", true));
+    BOOST_CHECK(cache.InsertResolvingCheckResult(L"C:\\a\\other", true));
+
+    // An existing entry is not replaced
+    BOOST_CHECK(!cache.InsertResolvingCheckResult(L"C:\\a\\b\\file", false));
+
+    // Invalidating a path that is not a directory leaves the paths under it (and its siblings) alone
+    cache.Invalidate(L"C:\\a\\b", false);
+    BOOST_CHECK(cache.GetResolvingCheckResult(L"C:\\a\\b\\file").Found);
+
+    cache.Invalidate(L"C:\\a\\b", true);
+    BOOST_CHECK(!cache.GetResolvingCheckResult(L"C:\\a\\b\\file").Found);
+    BOOST_CHECK(cache.GetResolvingCheckResult(L"C:\\a\\other").Found);
+
+    // The invalidated entry is replaced by the next insert
+    BOOST_CHECK(cache.InsertResolvingCheckResult(L"C:\\a\\b\\file", false));
+    auto checkResult = cache.GetResolvingCheckResult(L"C:\\a\\b\\file");
+    BOOST_CHECK(checkResult.Found);
+    BOOST_CHECK(!checkResult.Value);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,55 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <ShimProcessMatchTable.h>
+
+BOOST_AUTO_TEST_SUITE(ShimProcessMatchTableTests)
+
+BOOST_AUTO_TEST_CASE( MatchesFileNameIgnoringCase )
+{
+    ShimProcessMatchTable t;
+    BOOST_CHECK(t.IsEmpty());
+
+    t.Add(L"cl.exe", L"");
+    BOOST_CHECK(!t.IsEmpty());
+
+    BOOST_CHECK(t.Matches(L"cl.exe", L""));
+    BOOST_CHECK(t.Matches(L"C:\\vc\\bin\\CL.EXE", L"/c foo.cpp"));
+    BOOST_CHECK(!t.Matches(L"C:\\vc\\bin\\xcl.exe", L""));
+    BOOST_CHECK(!t.Matches(L"C:\\vc\\bin/cl.exe", L""));
+    BOOST_CHECK(!t.Matches(L"link.exe", L""));
+}
+
+BOOST_AUTO_TEST_CASE( MatchesArguments )
+{
+    ShimProcessMatchTable t;
+    t.Add(L"cl.exe", L"/c");
+    t.Add(L"cl.exe", L"/E");
+    t.Add(L"link.exe", L"/DLL");
+
+    BOOST_CHECK(t.Matches(L"c:\\bin\\cl.exe", L"/nologo /c foo.cpp"));
+    BOOST_CHECK(t.Matches(L"c:\\bin\\cl.exe", L"/E foo.cpp"));
+
+    // Arguments are matched case-sensitively
+    BOOST_CHECK(!t.Matches(L"c:\\bin\\cl.exe", L"/e foo.cpp"));
+    BOOST_CHECK(!t.Matches(L"c:\\bin\\cl.exe", L"/DLL"));
+    BOOST_CHECK(t.Matches(L"c:\\bin\\link.exe", L"/DLL"));
+}
+
+BOOST_AUTO_TEST_CASE( MatchesEndOfPath )
+{
+    ShimProcessMatchTable t;
+    t.Add(L"x64\\cl.exe", L"");
+    t.Add(L"arm\\cl.exe", L"/c");
+
+    BOOST_CHECK(t.Matches(L"c:\\bin\\X64\\cl.exe", L""));
+    BOOST_CHECK(t.Matches(L"x64\\cl.exe", L""));
+    BOOST_CHECK(!t.Matches(L"c:\\bin\\ax64\\cl.exe", L""));
+    BOOST_CHECK(!t.Matches(L"c:\\bin\\x86\\cl.exe", L""));
+    BOOST_CHECK(!t.Matches(L"cl.exe", L""));
+
+    BOOST_CHECK(t.Matches(L"c:\\bin\\arm\\cl.exe", L"/c foo.cpp"));
+    BOOST_CHECK(!t.Matches(L"c:\\bin\\arm\\cl.exe", L"foo.cpp"));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -1,7 +1,14 @@
 // Copyright (c) Microsoft. All rights reserved.
 // Licensed under the MIT license. See LICENSE file in the project root for full license information.
 
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <random>
+#include <vector>
 #include <StringOperations.h>
+#include <StringOperationsSimd.h>
+#include <UtilityHelpers.h>
 
 BOOST_AUTO_TEST_SUITE(StringOperationsTests)
 
@@ -161,4 +168,220 @@ BOOST_AUTO_TEST_CASE(NormalizeLongUncPathWithUncPrefixDottedSegment)
     BOOST_CHECK_EQUAL(expected.c_str(), result.c_str());
 }
 
+BOOST_AUTO_TEST_CASE(NormalizeAndHashPathsMatchesNormalizeAndHashPath)
+{
+    const std::vector<std::wstring> paths = { L"C:\\src\\BuildXL", L"", L"Microsoft.Build.Tasks.Core.dll", L"\\\\?\\D:\\out\\obj" };
+
+    std::vector<PathChar> input;
+    for (const std::wstring& path : paths)
+    {
+        input.insert(input.end(), path.begin(), path.end());
+        input.push_back(L'\0');
+    }
+
+    std::vector<PathChar> output(input.size());
+    std::vector<DWORD> hashes(paths.size());
+    BOOST_CHECK_EQUAL(paths.size(), NormalizeAndHashPaths(input.data(), output.data(), (DWORD)input.size(), hashes.data(), (DWORD)paths.size()));
+
+    size_t offset = 0;
+    for (size_t i = 0; i < paths.size(); i++)
+    {
+        std::vector<PathChar> normalized(paths[i].length() + 1);
+        DWORD hash = NormalizeAndHashPath(paths[i].c_str(), (PBYTE)normalized.data(), (DWORD)(normalized.size() * sizeof(PathChar)));
+
+        BOOST_CHECK_EQUAL(hash, hashes[i]);
+        BOOST_CHECK(std::equal(normalized.begin(), normalized.end(), output.begin() + offset));
+        offset += normalized.size();
+    }
+}
+
+// Scalar versions of the case-insensitive comparisons and hash of UtilityHelpers.h, which their fast paths must agree with
+static bool ScalarEqualsIgnoringCase(const std::wstring& lhs, const std::wstring& rhs)
+{
+    if (lhs.length() != rhs.length())
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < lhs.length(); i++)
+    {
+        if (lhs[i] != rhs[i] && towlower(lhs[i]) != towlower(rhs[i]))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool ScalarLessThanIgnoringCase(const std::wstring& lhs, const std::wstring& rhs)
+{
+    if (lhs.length() != rhs.length())
+    {
+        return lhs.length() < rhs.length();
+    }
+
+    for (size_t i = lhs.length(); i > 0; i--)
+    {
+        wchar_t l = (wchar_t)towlower(lhs[i - 1]);
+        wchar_t r = (wchar_t)towlower(rhs[i - 1]);
+        if (lhs[i - 1] != rhs[i - 1] && l != r)
+        {
+            return r < l;
+        }
+    }
+
+    return false;
+}
+
+static size_t ScalarHashIgnoringCase(const std::wstring& str)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (wchar_t c : str)
+    {
+        hash = (hash ^ (uint64_t)towlower(c)) * 1099511628211ULL;
+    }
+
+    return (size_t)hash;
+}
+
+// Pairs of paths of all lengths up to a few blocks, mostly equal ignoring case, some of them with non-ASCII characters
+static std::vector<std::pair<std::wstring, std::wstring>> GetCaseInsensitiveTestPairs()
+{
+    const std::wstring asciiChars(L"abcdxyzABCDXYZ019\\/._-~ ");
+    const std::wstring nonAsciiChars(L"\u00e9\u00c9\u0130\u0131\u03a3\u03c3\u2126\uff21");
+
+    std::mt19937 random(20210405);
+    std::vector<std::pair<std::wstring, std::wstring>> pairs;
+    for (size_t length = 0; length <= 40; length++)
+    {
+        for (int variant = 0; variant < 20; variant++)
+        {
+            std::wstring first;
+            for (size_t i = 0; i < length; i++)
+            {
+                bool nonAscii = variant % 4 == 3 && random() % 16 == 0;
+                first.push_back(nonAscii ? nonAsciiChars[random() % nonAsciiChars.length()] : asciiChars[random() % asciiChars.length()]);
+            }
+
+            std::wstring second(first);
+            for (size_t i = 0; i < length; i++)
+            {
+                if (random() % 2 == 0)
+                {
+                    second[i] = random() % 2 == 0 ? (wchar_t)towupper(second[i]) : (wchar_t)towlower(second[i]);
+                }
+            }
+
+            if (length > 0 && variant % 2 == 1)
+            {
+                // Different at a random position
+                second[random() % length] = variant % 8 == 7 ? nonAsciiChars[random() % nonAsciiChars.length()] : asciiChars[random() % asciiChars.length()];
+            }
+
+            pairs.emplace_back(first, second);
+        }
+    }
+
+    return pairs;
+}
+
+BOOST_AUTO_TEST_CASE(CaseInsensitiveComparisonsMatchScalarComparisons)
+{
+    CaseInsensitiveStringComparer equals;
+    CaseInsensitiveStringLessThan lessThan;
+    CaseInsensitiveStringHasher hasher;
+
+    for (const auto& pair : GetCaseInsensitiveTestPairs())
+    {
+        BOOST_CHECK_EQUAL(equals(pair.first, pair.second), ScalarEqualsIgnoringCase(pair.first, pair.second));
+        BOOST_CHECK_EQUAL(lessThan(pair.first, pair.second), ScalarLessThanIgnoringCase(pair.first, pair.second));
+        BOOST_CHECK_EQUAL(lessThan(pair.second, pair.first), ScalarLessThanIgnoringCase(pair.second, pair.first));
+        BOOST_CHECK_EQUAL(hasher(pair.first), ScalarHashIgnoringCase(pair.first));
+        BOOST_CHECK_EQUAL(hasher(pair.second), ScalarHashIgnoringCase(pair.second));
+    }
+}
+
+#if SIMD_PATH_OPERATIONS
+
+BOOST_AUTO_TEST_CASE(AsciiCaseChangeMatchesCrt)
+{
+    for (int start = 0; start < 128; start += SIMD_PATH_BLOCK_LENGTH)
+    {
+        WCHAR chars[SIMD_PATH_BLOCK_LENGTH];
+        for (int i = 0; i < SIMD_PATH_BLOCK_LENGTH; i++)
+        {
+            chars[i] = (WCHAR)(start + i);
+        }
+
+        WCHAR upper[SIMD_PATH_BLOCK_LENGTH];
+        WCHAR lower[SIMD_PATH_BLOCK_LENGTH];
+        __m128i block;
+        BOOST_CHECK(TryToUpperAscii(LoadPathBlock(chars), block));
+        _mm_storeu_si128((__m128i*)upper, block);
+        BOOST_CHECK(TryToLowerAscii(LoadPathBlock(chars), block));
+        _mm_storeu_si128((__m128i*)lower, block);
+
+        for (int i = 0; i < SIMD_PATH_BLOCK_LENGTH; i++)
+        {
+            BOOST_CHECK_EQUAL(upper[i], (WCHAR)towupper(chars[i]));
+            BOOST_CHECK_EQUAL(lower[i], (WCHAR)towlower(chars[i]));
+        }
+    }
+
+    // Blocks with any non-ASCII character are left to the scalar code
+    const WCHAR nonAscii[SIMD_PATH_BLOCK_LENGTH] = { L'a', L'b', L'c', L'd', L'e', L'f', L'g', L'\u00e9' };
+    __m128i block;
+    BOOST_CHECK(!TryToUpperAscii(LoadPathBlock(nonAscii), block));
+    BOOST_CHECK(!TryToLowerAscii(LoadPathBlock(nonAscii), block));
+}
+
+BOOST_AUTO_TEST_CASE(NonNullPrefixStopsAtNullChar)
+{
+    std::wstring text(L"C:\\Program Files\\Microsoft Visual Studio\\2019");
+    std::wstring prefix(L"c:\\program files\\microsoft");
+
+    size_t length = EqualNonNullPrefixLengthIgnoringAsciiCase(text.c_str(), prefix.c_str());
+    BOOST_CHECK(length <= prefix.length());
+    BOOST_CHECK(length % SIMD_PATH_BLOCK_LENGTH == 0);
+    BOOST_CHECK(ScalarEqualsIgnoringCase(text.substr(0, length), prefix.substr(0, length)));
+
+    BOOST_CHECK(EqualNonNullPrefixLengthIgnoringAsciiCase(text.c_str(), text.c_str()) <= text.length());
+}
+
+#endif // SIMD_PATH_OPERATIONS
+
+// Not a pass/fail test: reports how long the case-insensitive operations take compared with their scalar versions
+BOOST_AUTO_TEST_CASE(CaseInsensitiveOperationsThroughput)
+{
+    std::wstring path(L"C:\\src\\BuildXL\\Out\\Objects\\9\\c\\4bd3gl7ro0x2f2w4t9s6fs2p8\\Microsoft.Build.Framework.dll");
+    std::wstring other(path);
+    std::transform(other.begin(), other.end(), other.begin(), towlower);
+
+    const int iterations = 200000;
+    CaseInsensitiveStringComparer equals;
+    CaseInsensitiveStringHasher hasher;
+    size_t sink = 0;
+
+    auto measure = [&](const char* name, const std::function<size_t()>& operation)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < iterations; i++)
+        {
+            sink += operation();
+        }
+
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() - start).count();
+        BOOST_TEST_MESSAGE(name << ": " << (elapsed / iterations) << " ns per call");
+    };
+
+    measure("CaseInsensitiveStringComparer", [&]() { return (size_t)equals(path, other); });
+    measure("ScalarEqualsIgnoringCase", [&]() { return (size_t)ScalarEqualsIgnoringCase(path, other); });
+    measure("CaseInsensitiveStringHasher", [&]() { return hasher(path); });
+    measure("ScalarHashIgnoringCase", [&]() { return ScalarHashIgnoringCase(path); });
+
+    BOOST_CHECK(equals(path, other));
+    BOOST_CHECK(sink != 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,61 @@
+// Copyright (c) Microsoft. All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+
+#include <TranslatePathTrie.h>
+
+BOOST_AUTO_TEST_SUITE(TranslatePathTrieTests)
+
+BOOST_AUTO_TEST_CASE( LongestPrefixWins )
+{
+    TranslatePathTrie t;
+    t.Insert(L"c:\\a\\", 0);
+    t.Insert(L"c:\\a\\b\\", 1);
+    t.Insert(L"d:\\", 2);
+
+    size_t index, length;
+    BOOST_CHECK(t.TryFind(L"C:\\A\\B\\file.txt", {}, index, length));
+    BOOST_CHECK_EQUAL(1, index);
+    BOOST_CHECK_EQUAL(7, length);
+
+    BOOST_CHECK(t.TryFind(L"c:\\a\\c\\file.txt", {}, index, length));
+    BOOST_CHECK_EQUAL(0, index);
+    BOOST_CHECK_EQUAL(5, length);
+
+    BOOST_CHECK(!t.TryFind(L"e:\\a\\b", {}, index, length));
+    BOOST_CHECK(!t.TryFind(L"c:\\ab", {}, index, length));
+}
+
+BOOST_AUTO_TEST_CASE( DirectoryWithoutTrailingSeparator )
+{
+    TranslatePathTrie t;
+    t.Insert(L"c:\\a\\", 0);
+    t.Insert(L"c:\\a\\b\\", 1);
+
+    size_t index, length;
+    BOOST_CHECK(t.TryFind(L"C:\\a\\B", {}, index, length));
+    BOOST_CHECK_EQUAL(1, index);
+    BOOST_CHECK_EQUAL(6, length);
+}
+
+BOOST_AUTO_TEST_CASE( UsedTranslationsAreSkipped )
+{
+    TranslatePathTrie t;
+    t.Insert(L"c:\\a\\", 0);
+    t.Insert(L"c:\\a\\b\\", 1);
+    t.Insert(L"c:\\a\\b\\", 2);
+
+    size_t index, length;
+    BOOST_CHECK(t.TryFind(L"c:\\a\\b\\file.txt", {}, index, length));
+    BOOST_CHECK_EQUAL(1, index);
+
+    BOOST_CHECK(t.TryFind(L"c:\\a\\b\\file.txt", { 1 }, index, length));
+    BOOST_CHECK_EQUAL(2, index);
+
+    BOOST_CHECK(t.TryFind(L"c:\\a\\b\\file.txt", { 1, 2 }, index, length));
+    BOOST_CHECK_EQUAL(0, index);
+    BOOST_CHECK_EQUAL(5, length);
+
+    BOOST_CHECK(!t.TryFind(L"c:\\a\\b\\file.txt", { 0, 1, 2 }, index, length));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
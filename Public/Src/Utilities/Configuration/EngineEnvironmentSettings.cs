@@ -244,6 +244,245 @@ namespace BuildXL.Utilities.Configuration
         /// </summary>
         public static readonly Setting<bool> DisableDetoursRetries = CreateSetting("BuildXLDisableDetoursRetries", value => value == "1");
 
+        /// <summary>
+        /// Makes the Linux sandbox send batched access reports using a binary framing instead of one text line per report
+        /// </summary>
+        public static readonly Setting<bool> LinuxSandboxBinaryReports = CreateSetting("BuildXLLinuxSandboxBinaryReports", value => value == "1");
+
+        /// <summary>
+        /// When set, the Linux sandbox puts access reports into a shared-memory ring with this many slots (one per report packet) instead of writing them to the reports FIFO
+        /// </summary>
+        public static readonly Setting<int?> LinuxSandboxReportsRingSlots = CreateSetting("BuildXLLinuxSandboxReportsRingSlots", value => ParseInt32(value));
+
+        /// <summary>
+        /// Makes the Linux sandbox observe statically linked executables (which the interposing library cannot observe) using seccomp user notifications (requires Linux 5.8)
+        /// </summary>
+        public static readonly Setting<bool> LinuxSandboxSeccompStaticProcesses = CreateSetting("BuildXLLinuxSandboxSeccompStaticProcesses", value => value == "1");
+
+        /// <summary>
+        /// Makes the Linux sandbox count, for every interposed function, the calls, cache hits and reports sent, and the time spent in the interposer and in the real call
+        /// (implies <see cref="LinuxSandboxBinaryReports"/>; the per-pip summary is logged along with the other process stats)
+        /// </summary>
+        public static readonly Setting<bool> LinuxSandboxInterposeStats = CreateSetting("BuildXLLinuxSandboxInterposeStats", value => value == "1");
+
+        /// <summary>
+        /// Makes the Linux sandbox audit library (LD_AUDIT) observe processes that libDetours.so was not preloaded into (e.g., because they cleared LD_PRELOAD)
+        /// by redirecting their libc bindings to its interposers
+        /// </summary>
+        public static readonly Setting<bool> LinuxSandboxAuditSymbind = CreateSetting("BuildXLLinuxSandboxAuditSymbind", value => value == "1");
+
+        /// <summary>
+        /// Makes the processes of a pip sandboxed on Linux keep count (in shared memory) of how many of them are alive, so that the last one to exit
+        /// reports the process tree as completed (instead of the sandbox waiting for the reports FIFO to be closed by all processes)
+        /// </summary>
+        public static readonly Setting<bool> LinuxSandboxTrackProcessTree = CreateSetting("BuildXLLinuxSandboxTrackProcessTree", value => value == "1");
+
+        /// <summary>
+        /// Makes the processes of a pip sandboxed on Linux share (in shared memory) the accesses they already reported, so that an access made by
+        /// several processes is only reported once (per executable).
+        /// </summary>
+        /// <remarks>
+        /// Ignored when binary reports are used, i.e., with <see cref="LinuxSandboxBinaryReports"/> or any of the settings that imply them (such as
+        /// <see cref="LinuxSandboxReportsRingSlots"/>): buffered reports can be lost when a process is killed before flushing them, and with a shared
+        /// cache the accesses of the other processes that skipped reporting them would be lost along with them.
+        /// </remarks>
+        public static readonly Setting<bool> LinuxSandboxSharedReportCache = CreateSetting("BuildXLLinuxSandboxSharedReportCache", value => value == "1");
+
+        /// <summary>
+        /// Makes the processes of a pip sandboxed on Linux share (in shared memory) where the dynamic linker found the libraries it searched for, so that
+        /// once a process of the pip loaded a library, the others load it from that file instead of searching for it again (see la_objsearch in audit.cpp)
+        /// </summary>
+        public static readonly Setting<bool> LinuxSandboxLoaderSearchCache = CreateSetting("BuildXLLinuxSandboxLoaderSearchCache", value => value == "1");
+
+        /// <summary>
+        /// Number of threads the reports a pip sandboxed on Linux sends are parsed on (4 at most by default); the parsed reports are still processed
+        /// one at a time, in the order they were received in.  1 parses them on the thread that processes them.
+        /// </summary>
+        public static readonly Setting<int?> LinuxSandboxReportParsingParallelism = CreateSetting("BuildXLLinuxSandboxReportParsingParallelism", value => ParseInt32(value));
+
+        /// <summary>
+        /// Makes the Linux sandbox skip resolving and reporting paths that lie lexically inside an untracked scope (one nothing is reported or denied in).
+        /// Symlinks inside such scopes are then not followed, i.e., accesses reached through a symlink that points out of an untracked scope are not observed.
+        /// </summary>
+        public static readonly Setting<bool> LinuxSandboxLexicalUntrackedScopes = CreateSetting("BuildXLLinuxSandboxLexicalUntrackedScopes", value => value == "1");
+
+        /// <summary>
+        /// Makes the Linux sandbox share the part of the manifests of pips that is the same for all of them (untracked scopes, mounts and the like):
+        /// it is written once per build, and the manifest of every pip only carries a delta tree overlaid on it (see <c>FileAccessManifest.TreeBase</c>).
+        /// </summary>
+        public static readonly Setting<bool> LinuxSandboxSharedManifestBase = CreateSetting("BuildXLLinuxSandboxSharedManifestBase", value => value == "1");
+
+        /// <summary>
+        /// Makes the Linux sandbox report the accesses of pips that do not fail on unexpected file accesses without checking them against the manifest,
+        /// in which case the host checks them instead (see <c>FileAccessManifest.ObserveOnly</c>)
+        /// </summary>
+        public static readonly Setting<bool> LinuxSandboxObserveOnly = CreateSetting("BuildXLLinuxSandboxObserveOnly", value => value == "1");
+
+        /// <summary>
+        /// Makes the Linux sandbox hash the files pips write sequentially while they write them, so that storing those outputs to the cache
+        /// does not read them back (implies <see cref="LinuxSandboxBinaryReports"/>; only used when the cache hashes with VSO0)
+        /// </summary>
+        public static readonly Setting<bool> LinuxSandboxHashOutputs = CreateSetting("BuildXLLinuxSandboxHashOutputs", value => value == "1");
+
+        /// <summary>
+        /// Makes the Linux sandbox send the accesses of observe-only pips (see <see cref="LinuxSandboxObserveOnly"/>) as one deduplicated summary per process,
+        /// right before the process exits, execs or forks, instead of as they are made (implies <see cref="LinuxSandboxBinaryReports"/>).
+        /// The accesses of a process that is killed before it exits are lost.
+        /// </summary>
+        public static readonly Setting<bool> LinuxSandboxDeferReports = CreateSetting("BuildXLLinuxSandboxDeferReports", value => value == "1");
+
+        /// <summary>
+        /// Makes the Linux sandbox time its reports (a monotonic timestamp and a per-process sequence number on every record, see <c>AccessReportRecord</c>),
+        /// from which the time reports take to reach the host is logged for every pip (implies <see cref="LinuxSandboxBinaryReports"/>)
+        /// </summary>
+        public static readonly Setting<bool> LinuxSandboxTimedReports = CreateSetting("BuildXLLinuxSandboxTimedReports", value => value == "1");
+
+        /// <summary>
+        /// Makes the Linux sandbox remember, in every process, which of the directories it resolves paths through are symlinks (and to what),
+        /// instead of calling readlink for each of them every time.
+        /// Only the renames and removals a process makes itself are taken into account: a process then resolves (and reports) paths under a
+        /// directory or symlink another process replaced against what it used to be, which is why this is only meant for pips known not to do that.
+        /// </summary>
+        public static readonly Setting<bool> LinuxSandboxCacheResolvedPrefixes = CreateSetting("BuildXLLinuxSandboxCacheResolvedPrefixes", value => value == "1");
+
+        /// <summary>
+        /// A budget, in percent of the wall time of a process, for the time the Linux sandbox interposers take on top of the real calls they forward to: a process
+        /// that exceeds it switches to the cheapest way of observing it that its pip permits (deferred reports, see <see cref="LinuxSandboxDeferReports"/>, for
+        /// observe-only pips; nothing cheaper for the others), which is logged for the pip and counted (implies <see cref="LinuxSandboxBinaryReports"/>)
+        /// </summary>
+        public static readonly Setting<int?> LinuxSandboxOverheadBudgetPercent = CreateSetting("BuildXLLinuxSandboxOverheadBudgetPercent", value => ParseInt32(value));
+
+        /// <summary>
+        /// A cgroup v2 directory delegated to the build (e.g., /sys/fs/cgroup/user.slice/user-1000.slice/bxl): when set, every pip runs in a cgroup of its own
+        /// under it, from which the resource usage of the whole process tree of the pip is read, and which is killed as a whole when the pip is killed
+        /// (see <c>BuildXL.Interop.Unix.Cgroup</c>). The directory must not have processes of its own.
+        /// </summary>
+        public static readonly Setting<string> LinuxSandboxPipCgroupRoot = CreateSetting("BuildXLLinuxSandboxPipCgroupRoot", value => value);
+
+        /// <summary>
+        /// When set (along with <see cref="LinuxSandboxPipCgroupRoot"/>), the memory.high of the cgroup of every pip, in MB: past it, the processes of the pip are
+        /// throttled and reclaimed from rather than killed
+        /// </summary>
+        public static readonly Setting<int?> LinuxSandboxPipCgroupMemoryHighMb = CreateSetting("BuildXLLinuxSandboxPipCgroupMemoryHighMb", value => ParseInt32(value));
+
+        /// <summary>
+        /// A file in which the macOS Hybrid sandbox keeps, across builds, per executable statistics of the overhead of its two sources (events per second,
+        /// how many of the interposed accesses EndpointSecurity reported too, and how late): the processes of the executables for which interposing doesn't
+        /// pay off are then only observed by EndpointSecurity (the interposing library is not injected into them). Not set: every process is interposed.
+        /// </summary>
+        public static readonly Setting<string> MacOsHybridSandboxBackendCache = CreateSetting("BuildXLMacOsHybridSandboxBackendCache", value => value);
+
+        /// <summary>
+        /// Makes Detours batch the report lines of a pip's processes into larger pipe writes (see <c>FileAccessManifest.BatchReports</c>)
+        /// </summary>
+        public static readonly Setting<bool> WindowsSandboxBatchReports = CreateSetting("BuildXLWindowsSandboxBatchReports", value => value == "1");
+
+        /// <summary>
+        /// Makes Detours buffer the debug messages of a process and write them out together (see <c>FileAccessManifest.BufferDebugMessages</c>)
+        /// </summary>
+        public static readonly Setting<bool> WindowsSandboxBufferDebugMessages = CreateSetting("BuildXLWindowsSandboxBufferDebugMessages", value => value == "1");
+
+        /// <summary>
+        /// Makes Detours report file accesses as binary records rather than as text (see <c>FileAccessManifest.BinaryReports</c>)
+        /// </summary>
+        public static readonly Setting<bool> WindowsSandboxBinaryReports = CreateSetting("BuildXLWindowsSandboxBinaryReports", value => value == "1");
+
+        /// <summary>
+        /// When set, Detours puts the reports of a pip's processes into a shared-memory ring with this many slots instead of writing them to the report pipe
+        /// (see <c>FileAccessManifest.ReportRingSlots</c>)
+        /// </summary>
+        public static readonly Setting<int?> WindowsSandboxReportRingSlots = CreateSetting("BuildXLWindowsSandboxReportRingSlots", value => ParseInt32(value));
+
+        /// <summary>
+        /// When set, the processes of a pip share the reparse point targets they query through a shared-memory cache with this many slots
+        /// (see <c>FileAccessManifest.SharedReparsePointCacheSlots</c>)
+        /// </summary>
+        public static readonly Setting<int?> WindowsSandboxSharedReparsePointCacheSlots = CreateSetting("BuildXLWindowsSandboxSharedReparsePointCacheSlots", value => ParseInt32(value));
+
+        /// <summary>
+        /// Makes Detours report an access to a path only if the process did not already report it with the same or a stronger requested access
+        /// (see <c>FileAccessManifest.ReportOncePerPathAndAccess</c>)
+        /// </summary>
+        public static readonly Setting<bool> WindowsSandboxReportOncePerPathAndAccess = CreateSetting("BuildXLWindowsSandboxReportOncePerPathAndAccess", value => value == "1");
+
+        /// <summary>
+        /// When set, the processes of a pip share the accesses they reported through a shared-memory table with this many slots, so that an access is only reported once per pip
+        /// (see <c>FileAccessManifest.SharedReportedAccessSlots</c>)
+        /// </summary>
+        public static readonly Setting<int?> WindowsSandboxSharedReportedAccessSlots = CreateSetting("BuildXLWindowsSandboxSharedReportedAccessSlots", value => ParseInt32(value));
+
+        /// <summary>
+        /// Lays out the manifest tree passed to Detours so that the hashes of the children of a node can be compared at once
+        /// (see <c>FileAccessManifest.UseCompactManifestTree</c>)
+        /// </summary>
+        public static readonly Setting<bool> WindowsSandboxCompactManifestTree = CreateSetting("BuildXLWindowsSandboxCompactManifestTree", value => value == "1");
+
+        /// <summary>
+        /// Adds a filter of the paths of the manifest tree passed to the sandbox, with which a policy search stops as soon as the path has no more specific node
+        /// (see <c>FileAccessManifest.UseManifestPathFilter</c>)
+        /// </summary>
+        public static readonly Setting<bool> SandboxManifestPathFilter = CreateSetting("BuildXLSandboxManifestPathFilter", value => value == "1");
+
+        /// <summary>
+        /// Makes Detours cache the device names of the drives of a process to translate the final paths of handles itself
+        /// (see <c>FileAccessManifest.CacheDosDeviceNames</c>)
+        /// </summary>
+        public static readonly Setting<bool> WindowsSandboxCacheDosDeviceNames = CreateSetting("BuildXLWindowsSandboxCacheDosDeviceNames", value => value == "1");
+
+        /// <summary>
+        /// Makes Detours report the call counts and times of the detoured functions of every process
+        /// (see <c>FileAccessManifest.CollectDetourStatistics</c>)
+        /// </summary>
+        public static readonly Setting<bool> WindowsSandboxCollectDetourStatistics = CreateSetting("BuildXLWindowsSandboxCollectDetourStatistics", value => value == "1");
+
+        /// <summary>
+        /// Makes Detours check the accesses made through CreateFile only in the detour of NtCreateFile
+        /// (see <c>FileAccessManifest.NtCreateFileOnly</c>)
+        /// </summary>
+        public static readonly Setting<bool> WindowsSandboxNtCreateFileOnly = CreateSetting("BuildXLWindowsSandboxNtCreateFileOnly", value => value == "1");
+
+        /// <summary>
+        /// Makes Detours detour only the Nt functions and the few Win32 functions whose accesses they do not see
+        /// (see <c>FileAccessManifest.MinimalDetours</c>)
+        /// </summary>
+        public static readonly Setting<bool> WindowsSandboxMinimalDetours = CreateSetting("BuildXLWindowsSandboxMinimalDetours", value => value == "1");
+
+        /// <summary>
+        /// Makes Detours detour the rarely called file functions from a background thread once a process starts
+        /// (see <c>FileAccessManifest.DeferColdDetours</c>)
+        /// </summary>
+        public static readonly Setting<bool> WindowsSandboxDeferColdDetours = CreateSetting("BuildXLWindowsSandboxDeferColdDetours", value => value == "1");
+
+        /// <summary>
+        /// Makes Detours check and report the probes of a path only once per outcome
+        /// (see <c>FileAccessManifest.CacheProbeResults</c>)
+        /// </summary>
+        public static readonly Setting<bool> WindowsSandboxCacheProbeResults = CreateSetting("BuildXLWindowsSandboxCacheProbeResults", value => value == "1");
+
+        /// <summary>
+        /// Makes Detours remember the image paths it found for the application names of the processes it creates
+        /// (see <c>FileAccessManifest.CacheImagePathSearches</c>)
+        /// </summary>
+        public static readonly Setting<bool> WindowsSandboxCacheImagePathSearches = CreateSetting("BuildXLWindowsSandboxCacheImagePathSearches", value => value == "1");
+
+        /// <summary>
+        /// Makes Detours send one summary per directory enumeration instead of reporting every entry it finds
+        /// (see <c>FileAccessManifest.SummarizeDirectoryEnumerations</c>)
+        /// </summary>
+        public static readonly Setting<bool> WindowsSandboxSummarizeDirectoryEnumerations = CreateSetting("BuildXLWindowsSandboxSummarizeDirectoryEnumerations", value => value == "1");
+
+        /// <summary>
+        /// Makes Detours attach to hotpatchable functions through the padding before them
+        /// (see <c>FileAccessManifest.UseHotpatchDetours</c>)
+        /// </summary>
+        public static readonly Setting<bool> WindowsSandboxUseHotpatchDetours = CreateSetting("BuildXLWindowsSandboxUseHotpatchDetours", value => value == "1");
+
+        /// <summary>
+        /// Directory into which the raw report stream of every sandboxed pip is captured (one file per pip), so that it can be replayed
+        /// to benchmark the processing of reports (see <c>BuildXL.Processes.SandboxReportCapture</c>)
+        /// </summary>
+        public static readonly Setting<string> SandboxReportCaptureDirectory = CreateSetting("BuildXLSandboxReportCaptureDirectory", value => value);
+
         /// <summary>
         /// Threshold in bytes for large string buffer in string table.
         /// </summary>
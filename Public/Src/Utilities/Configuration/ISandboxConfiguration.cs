@@ -282,5 +282,11 @@ namespace BuildXL.Utilities.Configuration
         /// This list is only considered when <see cref="IUnsafeSandboxConfiguration.IgnoreFullReparsePointResolving"/> is set to true and<see cref="IUnsafeSandboxConfiguration.EnableFullReparsePointResolving"/> is set to false. 
         /// </summary>
         IReadOnlyList<AbsolutePath> DirectoriesToEnableFullReparsePointParsing { get; }
+
+        /// <summary>
+        /// List of directory paths that are guaranteed not to contain any reparse point (including the directories themselves), so that
+        /// the sandbox skips looking for reparse points under them. Windows only.
+        /// </summary>
+        IReadOnlyList<AbsolutePath> DirectoriesWithoutReparsePoints { get; }
     }
 }
@@ -54,6 +54,7 @@ namespace BuildXL.Utilities.Configuration.Mutable
             VmConcurrencyLimit = 0;
             RemoteAllProcesses = false;
             DirectoriesToEnableFullReparsePointParsing = new List<AbsolutePath>();
+            DirectoriesWithoutReparsePoints = new List<AbsolutePath>();
         }
 
         /// <nodoc />
@@ -105,6 +106,7 @@ namespace BuildXL.Utilities.Configuration.Mutable
             VmConcurrencyLimit = template.VmConcurrencyLimit;
             RemoteAllProcesses = template.RemoteAllProcesses;
             DirectoriesToEnableFullReparsePointParsing = pathRemapper.Remap(template.DirectoriesToEnableFullReparsePointParsing);
+            DirectoriesWithoutReparsePoints = pathRemapper.Remap(template.DirectoriesWithoutReparsePoints);
         }
 
         /// <inheritdoc />
@@ -275,5 +277,11 @@ namespace BuildXL.Utilities.Configuration.Mutable
 
         /// <inheritdoc />
         IReadOnlyList<AbsolutePath> ISandboxConfiguration.DirectoriesToEnableFullReparsePointParsing => DirectoriesToEnableFullReparsePointParsing;
+
+        /// <nodoc />
+        public List<AbsolutePath> DirectoriesWithoutReparsePoints { get; set; }
+
+        /// <inheritdoc />
+        IReadOnlyList<AbsolutePath> ISandboxConfiguration.DirectoriesWithoutReparsePoints => DirectoriesWithoutReparsePoints;
     }
 }
@@ -5,8 +5,193 @@
 
 #ifdef MICROSOFT_INTERNAL // Only needed for internal builds
 
+#include <algorithm>
+#include <malloc.h>
+#include <string.h>
+
  LOGMANAGER_INSTANCE
 
+// The events, their properties and all their strings live in the allocation of the batch (which starts with this header)
+struct AriaEventBatch
+{
+    SLIST_ENTRY entry;
+    int eventCount;
+    const char **eventNames;
+    const int *eventPropertiesLengths;
+    const AriaEventProperty *eventProperties;
+};
+
+static AriaEventBatch *CreateBatch(int eventCount, const char **eventNames, const int *eventPropertiesLengths, const AriaEventProperty *eventProperties)
+{
+    int propertyCount = 0;
+    size_t stringsSize = 0;
+    for (int i = 0; i < eventCount; i++)
+    {
+        propertyCount += eventPropertiesLengths[i];
+        stringsSize += strlen(eventNames[i]) + 1;
+    }
+
+    for (int i = 0; i < propertyCount; i++)
+    {
+        stringsSize += strlen(eventProperties[i].name) + 1;
+        if (eventProperties[i].value != nullptr)
+        {
+            stringsSize += strlen(eventProperties[i].value) + 1;
+        }
+    }
+
+    // Laid out by decreasing alignment: header, properties, names, lengths, strings
+    size_t size = sizeof(AriaEventBatch) + propertyCount * sizeof(AriaEventProperty) + eventCount * (sizeof(const char *) + sizeof(int)) + stringsSize;
+    char *block = (char *)_aligned_malloc(size, MEMORY_ALLOCATION_ALIGNMENT);
+    if (block == nullptr)
+    {
+        return nullptr;
+    }
+
+    AriaEventBatch *batch = (AriaEventBatch *)block;
+    AriaEventProperty *properties = (AriaEventProperty *)(block + sizeof(AriaEventBatch));
+    const char **names = (const char **)(properties + propertyCount);
+    int *lengths = (int *)(names + eventCount);
+    char *strings = (char *)(lengths + eventCount);
+
+    auto copyString = [&strings](const char *value)
+    {
+        size_t length = strlen(value) + 1;
+        memcpy(strings, value, length);
+        const char *copy = strings;
+        strings += length;
+        return copy;
+    };
+
+    for (int i = 0; i < eventCount; i++)
+    {
+        names[i] = copyString(eventNames[i]);
+        lengths[i] = eventPropertiesLengths[i];
+    }
+
+    for (int i = 0; i < propertyCount; i++)
+    {
+        properties[i].name = copyString(eventProperties[i].name);
+        properties[i].value = eventProperties[i].value != nullptr ? copyString(eventProperties[i].value) : nullptr;
+        properties[i].piiOrLongValue = eventProperties[i].piiOrLongValue;
+    }
+
+    batch->eventCount = eventCount;
+    batch->eventNames = names;
+    batch->eventPropertiesLengths = lengths;
+    batch->eventProperties = properties;
+    return batch;
+}
+
+// Values are added to one of several stripes (picked by thread) so that threads adding to the same metric rarely share a cache line
+#define ARIA_METRIC_STRIPES 16
+
+// Bucket i counts the values whose highest set bit is bit i - 1 (bucket 0 counts the values <= 0)
+#define ARIA_METRIC_BUCKETS 64
+
+struct DECLSPEC_ALIGN(64) AriaMetricStripe
+{
+    volatile LONG64 count;
+    volatile LONG64 sum;
+    volatile LONG64 min;
+    volatile LONG64 max;
+    volatile LONG64 buckets[ARIA_METRIC_BUCKETS];
+};
+
+struct AriaMetric
+{
+    std::string eventName;
+    std::string metricName;
+    AriaMetricStripe stripes[ARIA_METRIC_STRIPES];
+};
+
+static void ResetStripe(AriaMetricStripe &stripe)
+{
+    stripe.count = 0;
+    stripe.sum = 0;
+    stripe.min = INT64_MAX;
+    stripe.max = INT64_MIN;
+    memset((void *)stripe.buckets, 0, sizeof(stripe.buckets));
+}
+
+static int BucketOf(int64_t value)
+{
+    unsigned long index;
+    return value <= 0 || !_BitScanReverse64(&index, (unsigned __int64)value) ? 0 : (int)index + 1;
+}
+
+static int64_t BucketUpperBound(int bucket)
+{
+    return bucket == 0 ? 0 : (int64_t)((1ULL << bucket) - 1);
+}
+
+static void UpdateMin(volatile LONG64 *target, LONG64 value)
+{
+    LONG64 current = *target;
+    while (value < current)
+    {
+        LONG64 previous = InterlockedCompareExchange64(target, value, current);
+        if (previous == current)
+        {
+            break;
+        }
+
+        current = previous;
+    }
+}
+
+static void UpdateMax(volatile LONG64 *target, LONG64 value)
+{
+    LONG64 current = *target;
+    while (value > current)
+    {
+        LONG64 previous = InterlockedCompareExchange64(target, value, current);
+        if (previous == current)
+        {
+            break;
+        }
+
+        current = previous;
+    }
+}
+
+static void SubmitEvent(ILogger *log, const char *eventName, int eventPropertiesLength, const AriaEventProperty *eventProperties)
+{
+    EventProperties props;
+    props.SetName(eventName);
+    for (int i = 0; i < eventPropertiesLength; i++)
+    {
+        const char *propName = eventProperties[i].name;
+        const char *propValue = eventProperties[i].value;
+        int64_t piiOrValue = eventProperties[i].piiOrLongValue;
+
+        if (propValue == nullptr)
+        {
+            props.SetProperty(propName, piiOrValue);
+        }
+        else if (piiOrValue == (int)PiiKind::PiiKind_None)
+        {
+            props.SetProperty(propName, propValue);
+        }
+        else
+        {
+            props.SetProperty(propName, propValue, static_cast<PiiKind>(piiOrValue));
+        }
+    }
+
+    log->LogEvent(props);
+}
+
+static void SubmitBatch(ILogger *log, const AriaEventBatch *batch)
+{
+    const AriaEventProperty *properties = batch->eventProperties;
+    for (int i = 0; i < batch->eventCount; i++)
+    {
+        SubmitEvent(log, batch->eventNames[i], batch->eventPropertiesLengths[i], properties);
+        properties += batch->eventPropertiesLengths[i];
+    }
+}
+
 //// Aria logger class definition
 
 AriaLogger::AriaLogger(const char* token, const char *dbPath, int teardownTimeoutInSeconds)
@@ -20,10 +205,45 @@ AriaLogger::AriaLogger(const char* token, const char *dbPath, int teardownTimeou
 
     logger_ = LogManager::Initialize(token);
     LogManager::SetTransmitProfile(TransmitProfile_NearRealTime);
+
+    InitializeSRWLock(&metricsLock_);
+    metricCount_ = 0;
+
+    InitializeSListHead(&pendingBatches_);
+    stopping_ = false;
+    submitter_ = nullptr;
+    batchesAvailable_ = CreateEventW(nullptr, /*bManualReset*/ FALSE, /*bInitialState*/ FALSE, nullptr);
+    if (batchesAvailable_ != nullptr)
+    {
+        // Without a submitter thread, events are submitted by the threads that log them
+        submitter_ = CreateThread(nullptr, 0, AriaLogger::SubmitterThread, this, 0, nullptr);
+    }
 }
 
 AriaLogger::~AriaLogger()
 {
+    if (submitter_ != nullptr)
+    {
+        stopping_ = true;
+        SetEvent(batchesAvailable_);
+        WaitForSingleObject(submitter_, INFINITE);
+        CloseHandle(submitter_);
+    }
+    else
+    {
+        SubmitMetrics();
+    }
+
+    for (LONG i = 0; i < metricCount_; i++)
+    {
+        delete metrics_[i];
+    }
+
+    if (batchesAvailable_ != nullptr)
+    {
+        CloseHandle(batchesAvailable_);
+    }
+
     LogManager::FlushAndTeardown();
 }
 
@@ -32,6 +252,178 @@ ILogger *AriaLogger::GetLogger() const
     return logger_;
 };
 
+bool AriaLogger::Enqueue(AriaEventBatch *batch)
+{
+    if (submitter_ == nullptr)
+    {
+        return false;
+    }
+
+    // Only the push onto an empty list has to wake the submitter up: it takes every batch pushed until it gets to the list
+    if (InterlockedPushEntrySList(&pendingBatches_, &batch->entry) == nullptr)
+    {
+        SetEvent(batchesAvailable_);
+    }
+
+    return true;
+}
+
+DWORD WINAPI AriaLogger::SubmitterThread(LPVOID param)
+{
+    AriaLogger *logger = (AriaLogger *)param;
+    ULONGLONG nextMetricsFlush = GetTickCount64() + ARIA_METRICS_FLUSH_INTERVAL_MS;
+    while (true)
+    {
+        ULONGLONG now = GetTickCount64();
+        DWORD timeout = now >= nextMetricsFlush ? 0 : (DWORD)(nextMetricsFlush - now);
+        WaitForSingleObject(logger->batchesAvailable_, timeout);
+
+        // Read before the list is taken: whatever was logged before the logger got disposed is submitted
+        bool stopping = logger->stopping_;
+        logger->SubmitPendingBatches();
+
+        if (stopping || GetTickCount64() >= nextMetricsFlush)
+        {
+            logger->SubmitMetrics();
+            nextMetricsFlush = GetTickCount64() + ARIA_METRICS_FLUSH_INTERVAL_MS;
+        }
+
+        if (stopping)
+        {
+            return 0;
+        }
+    }
+}
+
+void AriaLogger::SubmitPendingBatches()
+{
+    // The list is LIFO: reverse it to submit the batches in the order they were logged
+    SLIST_ENTRY *entry = InterlockedFlushSList(&pendingBatches_);
+    SLIST_ENTRY *ordered = nullptr;
+    while (entry != nullptr)
+    {
+        SLIST_ENTRY *next = entry->Next;
+        entry->Next = ordered;
+        ordered = entry;
+        entry = next;
+    }
+
+    while (ordered != nullptr)
+    {
+        AriaEventBatch *batch = CONTAINING_RECORD(ordered, AriaEventBatch, entry);
+        ordered = ordered->Next;
+
+        SubmitBatch(logger_, batch);
+        _aligned_free(batch);
+    }
+}
+
+int AriaLogger::RegisterMetric(const char *eventName, const char *metricName)
+{
+    AcquireSRWLockExclusive(&metricsLock_);
+
+    int id = -1;
+    for (LONG i = 0; i < metricCount_ && id < 0; i++)
+    {
+        if (metrics_[i]->eventName == eventName && metrics_[i]->metricName == metricName)
+        {
+            id = i;
+        }
+    }
+
+    if (id < 0 && metricCount_ < ARIA_MAX_METRICS)
+    {
+        AriaMetric *metric = new AriaMetric();
+        metric->eventName = eventName;
+        metric->metricName = metricName;
+        for (int i = 0; i < ARIA_METRIC_STRIPES; i++)
+        {
+            ResetStripe(metric->stripes[i]);
+        }
+
+        id = metricCount_;
+        metrics_[id] = metric;
+
+        // Published once it is initialized: AddMetricValue doesn't take the lock
+        InterlockedIncrement(&metricCount_);
+    }
+
+    ReleaseSRWLockExclusive(&metricsLock_);
+    return id;
+}
+
+void AriaLogger::AddMetricValue(int metricId, int64_t value)
+{
+    if (metricId < 0 || metricId >= metricCount_)
+    {
+        return;
+    }
+
+    AriaMetricStripe &stripe = metrics_[metricId]->stripes[GetCurrentThreadId() % ARIA_METRIC_STRIPES];
+    InterlockedIncrement64(&stripe.count);
+    InterlockedAdd64(&stripe.sum, value);
+    UpdateMin(&stripe.min, value);
+    UpdateMax(&stripe.max, value);
+    InterlockedIncrement64(&stripe.buckets[BucketOf(value)]);
+}
+
+void AriaLogger::SubmitMetrics()
+{
+    for (LONG m = 0; m < metricCount_; m++)
+    {
+        AriaMetric *metric = metrics_[m];
+
+        // Each field is taken atomically, not the stripe as a whole: a value added concurrently may be split between two reports
+        int64_t count = 0, sum = 0, min = INT64_MAX, max = INT64_MIN;
+        int64_t buckets[ARIA_METRIC_BUCKETS] = { 0 };
+        for (int s = 0; s < ARIA_METRIC_STRIPES; s++)
+        {
+            AriaMetricStripe &stripe = metric->stripes[s];
+            count += InterlockedExchange64(&stripe.count, 0);
+            sum += InterlockedExchange64(&stripe.sum, 0);
+            min = (std::min)(min, (int64_t)InterlockedExchange64(&stripe.min, INT64_MAX));
+            max = (std::max)(max, (int64_t)InterlockedExchange64(&stripe.max, INT64_MIN));
+            for (int b = 0; b < ARIA_METRIC_BUCKETS; b++)
+            {
+                buckets[b] += InterlockedExchange64(&stripe.buckets[b], 0);
+            }
+        }
+
+        if (count <= 0)
+        {
+            continue;
+        }
+
+        int64_t percentiles[3];
+        const int64_t thresholds[3] = { (count * 50 + 99) / 100, (count * 90 + 99) / 100, (count * 99 + 99) / 100 };
+        int b = 0;
+        int64_t seen = 0;
+        for (int p = 0; p < 3; p++)
+        {
+            while (b < ARIA_METRIC_BUCKETS - 1 && seen + buckets[b] < thresholds[p])
+            {
+                seen += buckets[b++];
+            }
+
+            percentiles[p] = (std::max)(min, (std::min)(max, BucketUpperBound(b)));
+        }
+
+        AriaEventProperty properties[] =
+        {
+            { "MetricName", metric->metricName.c_str(), (int64_t)PiiKind::PiiKind_None },
+            { "Count", nullptr, count },
+            { "Sum", nullptr, sum },
+            { "Min", nullptr, min },
+            { "Max", nullptr, max },
+            { "P50", nullptr, percentiles[0] },
+            { "P90", nullptr, percentiles[1] },
+            { "P99", nullptr, percentiles[2] },
+        };
+
+        SubmitEvent(logger_, metric->eventName.c_str(), ARRAYSIZE(properties), properties);
+    }
+}
+
 //// External Interface
 
 AriaLogger* WINAPI CreateAriaLogger(const char *token, const char *dbPath, int teardownTimeoutInSeconds)
@@ -49,32 +441,44 @@ void WINAPI DisposeAriaLogger(const AriaLogger *logger)
 
 void WINAPI LogEvent(const AriaLogger *logger, const char *eventName, int eventPropertiesLength, const AriaEventProperty *eventProperties)
 {
-    if (logger != nullptr)
+    LogEvents(const_cast<AriaLogger *>(logger), 1, &eventName, &eventPropertiesLength, eventProperties);
+}
+
+void WINAPI LogEvents(AriaLogger *logger, int eventCount, const char **eventNames, const int *eventPropertiesLengths, const AriaEventProperty *eventProperties)
+{
+    if (logger == nullptr || eventCount <= 0)
     {
-        EventProperties props;
-        props.SetName(eventName);
-        for (int i = 0; i < eventPropertiesLength; i++)
-        {
-            const char *propName = eventProperties[i].name;
-            const char *propValue = eventProperties[i].value;
-            int64_t piiOrValue = eventProperties[i].piiOrLongValue;
+        return;
+    }
 
-            if (propValue == nullptr)
-            {
-                props.SetProperty(propName, piiOrValue);
-            }
-            else if (piiOrValue == (int)PiiKind::PiiKind_None)
-            {
-                props.SetProperty(propName, propValue);
-            }
-            else
-            {
-                props.SetProperty(propName, propValue, static_cast<PiiKind>(piiOrValue));
-            }
-        }
+    AriaEventBatch *batch = CreateBatch(eventCount, eventNames, eventPropertiesLengths, eventProperties);
+    if (batch == nullptr)
+    {
+        // Out of memory: submit the events right away rather than losing them
+        AriaEventBatch events = { };
+        events.eventCount = eventCount;
+        events.eventNames = eventNames;
+        events.eventPropertiesLengths = eventPropertiesLengths;
+        events.eventProperties = eventProperties;
+        SubmitBatch(logger->GetLogger(), &events);
+    }
+    else if (!logger->Enqueue(batch))
+    {
+        SubmitBatch(logger->GetLogger(), batch);
+        _aligned_free(batch);
+    }
+}
 
-        ILogger *log = logger->GetLogger();
-        log->LogEvent(props);
+int WINAPI RegisterAriaMetric(AriaLogger *logger, const char *eventName, const char *metricName)
+{
+    return logger != nullptr ? logger->RegisterMetric(eventName, metricName) : -1;
+}
+
+void WINAPI AddAriaMetricValue(AriaLogger *logger, int metricId, int64_t value)
+{
+    if (logger != nullptr)
+    {
+        logger->AddMetricValue(metricId, value);
     }
 }
 
@@ -12,6 +12,25 @@
 
 using namespace MAT;
 
+struct AriaEventProperty
+{
+    const char *name;
+    const char *value;
+    int64_t piiOrLongValue;
+};
+
+// A copy of events handed to the logger, see LogEvents
+struct AriaEventBatch;
+
+// The values added to a metric since it was last reported, see RegisterAriaMetric
+struct AriaMetric;
+
+// Maximum number of metrics a logger aggregates
+#define ARIA_MAX_METRICS 128
+
+// How often the aggregated metrics are reported (they are also reported when the logger is disposed)
+#define ARIA_METRICS_FLUSH_INTERVAL_MS (60 * 1000)
+
 class AriaLogger
 {
 
@@ -22,21 +41,37 @@ private:
 
     ILogger *logger_;
 
+    // Events are submitted to the SDK by a background thread, so that logging one only costs its callers a copy
+    SLIST_HEADER pendingBatches_;
+    HANDLE batchesAvailable_;
+    HANDLE submitter_;
+    volatile bool stopping_;
+
+    // Only ever grows: a registered metric is never freed before the logger
+    SRWLOCK metricsLock_;
+    volatile LONG metricCount_;
+    AriaMetric *metrics_[ARIA_MAX_METRICS];
+
+    static DWORD WINAPI SubmitterThread(LPVOID param);
+    void SubmitPendingBatches();
+    void SubmitMetrics();
+
 public:
 
     AriaLogger() = delete;
     AriaLogger(const char* token, const char *dbPath, int teardownTimeoutInSeconds);
 
+    // Submits the events that are still pending before tearing the SDK down
     ~AriaLogger();
 
     ILogger *GetLogger() const;
-};
 
-struct AriaEventProperty
-{
-    const char *name;
-    const char *value;
-    int64_t piiOrLongValue;
+    // Takes ownership of the batch; false if there is no submitter thread, in which case the caller keeps it
+    bool Enqueue(AriaEventBatch *batch);
+
+    // Returns the id of the metric (the same for the same names), or -1 if no more metrics can be registered
+    int RegisterMetric(const char *eventName, const char *metricName);
+    void AddMetricValue(int metricId, int64_t value);
 };
 
 AriaLogger* WINAPI CreateAriaLogger(const char *token, const char *dbPath, int teardownTimeoutInSeconds);
@@ -44,5 +79,16 @@ void WINAPI DisposeAriaLogger(const AriaLogger *);
 
 void WINAPI LogEvent(const AriaLogger *logger, const char *eventName, int eventPropertiesLength, const AriaEventProperty *eventProperties);
 
+// Logs 'eventCount' events: the properties of event i are the eventPropertiesLengths[i] entries of 'eventProperties' that follow the
+// properties of the events before it. The events (and their strings) are copied before this returns, and submitted in order.
+void WINAPI LogEvents(AriaLogger *logger, int eventCount, const char **eventNames, const int *eventPropertiesLengths, const AriaEventProperty *eventProperties);
+
+// Values that only matter in aggregate (e.g., per pip counters) are not logged one by one: the values added to a metric are
+// accumulated natively and reported every ARIA_METRICS_FLUSH_INTERVAL_MS (and when the logger is disposed) as a single 'eventName'
+// event with the properties MetricName, Count, Sum, Min, Max, P50, P90 and P99. A metric that got no value since it was last reported
+// is not reported. Percentiles are approximated by the upper bound of (power of two sized) histogram buckets.
+int WINAPI RegisterAriaMetric(AriaLogger *logger, const char *eventName, const char *metricName);
+void WINAPI AddAriaMetricValue(AriaLogger *logger, int metricId, int64_t value);
+
 #endif
 #endif
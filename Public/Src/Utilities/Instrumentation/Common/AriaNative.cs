@@ -2,6 +2,7 @@
 // Licensed under the MIT License.
 
 using System;
+using System.Collections.Generic;
 using System.Runtime.InteropServices;
 
 namespace BuildXL.Utilities.Instrumentation.Common
@@ -54,11 +55,56 @@ namespace BuildXL.Utilities.Instrumentation.Common
             ExternLogEvent(logger, eventName, eventProperties.Length, eventProperties);
         }
 
+        /// <summary>
+        /// Logs several events with a single call. The native logger copies them and submits them from a background thread.
+        /// </summary>
+        public static void LogEvents(IntPtr logger, IReadOnlyList<(string eventName, EventProperty[] eventProperties)> events)
+        {
+            if (events.Count == 0)
+            {
+                return;
+            }
+
+            var eventNames = new string[events.Count];
+            var eventPropertiesLengths = new int[events.Count];
+            var eventProperties = new List<EventProperty>();
+            for (int i = 0; i < events.Count; i++)
+            {
+                eventNames[i] = events[i].eventName;
+                eventPropertiesLengths[i] = events[i].eventProperties.Length;
+                eventProperties.AddRange(events[i].eventProperties);
+            }
+
+            ExternLogEvents(logger, events.Count, eventNames, eventPropertiesLengths, eventProperties.ToArray());
+        }
+
+        /// <summary>
+        /// Registers a metric whose values are aggregated natively and reported periodically as a single 'eventName' event.
+        /// Returns the id to pass to <see cref="AddMetricValue"/>, or -1 if the logger can't aggregate more metrics.
+        /// </summary>
+        [DllImport(AriaLibName, EntryPoint = "RegisterAriaMetric")]
+        public static extern int RegisterMetric(
+            IntPtr logger,
+            [MarshalAs(UnmanagedType.LPStr)] string eventName,
+            [MarshalAs(UnmanagedType.LPStr)] string metricName);
+
+        /// <nodoc />
+        [DllImport(AriaLibName, EntryPoint = "AddAriaMetricValue")]
+        public static extern void AddMetricValue(IntPtr logger, int metricId, long value);
+
         [DllImport(AriaLibName, EntryPoint = "LogEvent")]
         private static extern void ExternLogEvent(
             IntPtr logger,
             [MarshalAs(UnmanagedType.LPStr)] string eventName,
             int eventPropertiesLength,
             [MarshalAs(UnmanagedType.LPArray)] EventProperty[] eventProperties);
+
+        [DllImport(AriaLibName, EntryPoint = "LogEvents")]
+        private static extern void ExternLogEvents(
+            IntPtr logger,
+            int eventCount,
+            [MarshalAs(UnmanagedType.LPArray, ArraySubType = UnmanagedType.LPStr)] string[] eventNames,
+            [MarshalAs(UnmanagedType.LPArray)] int[] eventPropertiesLengths,
+            [MarshalAs(UnmanagedType.LPArray)] EventProperty[] eventProperties);
     }
 }
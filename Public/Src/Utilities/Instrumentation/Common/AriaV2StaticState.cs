@@ -2,10 +2,13 @@
 // Licensed under the MIT License.
 
 using System;
+using System.Collections.Concurrent;
+using System.Collections.Generic;
 using System.Diagnostics.ContractsLight;
 using System.IO;
 using System.Linq;
 using System.Text;
+using System.Threading;
 using System.Threading.Tasks;
 
 namespace BuildXL.Utilities.Instrumentation.Common
@@ -21,13 +24,24 @@ namespace BuildXL.Utilities.Instrumentation.Common
         /// <nodoc />
         public static readonly TimeSpan DefaultShutdownTimeout = TimeSpan.FromSeconds(20);
 
+        /// <summary>
+        /// How often the events logged since the last time are handed to the native logger (in a single call)
+        /// </summary>
+        public static readonly TimeSpan FlushInterval = TimeSpan.FromSeconds(1);
+
         private static readonly object s_syncRoot = new object();
+        private static readonly object s_flushLock = new object();
         private static readonly string s_ariaTelemetryDBName = "Aria.db";
 
         private static bool s_hasBeenInitialized;
         private static string? s_ariaTelemetryDBLocation;
         private static IntPtr s_ariaLogger;
 
+        // Logging an event only queues it here, so that the threads logging events don't pay for the interop call
+        private static readonly ConcurrentQueue<(string eventName, AriaNative.EventProperty[] eventProperties)> s_pendingEvents
+            = new ConcurrentQueue<(string eventName, AriaNative.EventProperty[] eventProperties)>();
+        private static Timer? s_flushTimer;
+
         /// <summary>
         /// Used to determine whether AriaV2 logging should be enabled
         /// </summary>
@@ -74,6 +88,7 @@ namespace BuildXL.Utilities.Instrumentation.Common
                         tenantToken,
                         Path.Combine(s_ariaTelemetryDBLocation, s_ariaTelemetryDBName),
                         (int)teardownTimeout.TotalSeconds);
+                    s_flushTimer = new Timer(_ => FlushPendingEvents(), null, FlushInterval, FlushInterval);
                     s_hasBeenInitialized = true;
                 }
             }
@@ -110,8 +125,16 @@ namespace BuildXL.Utilities.Instrumentation.Common
                     {
                         try
                         {
-                            AriaNative.DisposeAriaLogger(s_ariaLogger);
-                            s_ariaLogger = IntPtr.Zero;
+                            s_flushTimer?.Dispose();
+                            FlushPendingEvents();
+
+                            // A flush scheduled by the timer before it got disposed may still be about to run
+                            lock (s_flushLock)
+                            {
+                                AriaNative.DisposeAriaLogger(s_ariaLogger);
+                                s_ariaLogger = IntPtr.Zero;
+                            }
+
                             shutDownResult = ShutDownResult.Success;
                         }
                         catch (Exception ex)
@@ -144,7 +167,55 @@ namespace BuildXL.Utilities.Instrumentation.Common
                 return;
             }
 
-            AriaNative.LogEvent(s_ariaLogger, eventName, eventProperties);
+            s_pendingEvents.Enqueue((eventName, eventProperties));
+        }
+
+        /// <summary>
+        /// Registers a metric whose values only matter in aggregate: instead of an event per value, the count, sum, min, max and
+        /// percentiles of the values added since the last report are periodically reported as an 'eventName' event.
+        /// Returns the id to pass to <see cref="AddMetricValue"/>, or -1 if telemetry is disabled or no more metrics can be registered.
+        /// </summary>
+        public static int RegisterMetric(string eventName, string metricName)
+        {
+            if (!IsEnabled || s_ariaLogger == IntPtr.Zero)
+            {
+                return -1;
+            }
+
+            return AriaNative.RegisterMetric(s_ariaLogger, eventName, metricName);
+        }
+
+        /// <summary>
+        /// Adds a value to a metric returned by <see cref="RegisterMetric"/>
+        /// </summary>
+        public static void AddMetricValue(int metricId, long value)
+        {
+            if (!IsEnabled || metricId < 0 || s_ariaLogger == IntPtr.Zero)
+            {
+                return;
+            }
+
+            AriaNative.AddMetricValue(s_ariaLogger, metricId, value);
+        }
+
+        private static void FlushPendingEvents()
+        {
+            // Serialized so that the events reach the native logger in the order they were logged
+            lock (s_flushLock)
+            {
+                if (s_ariaLogger == IntPtr.Zero || s_pendingEvents.IsEmpty)
+                {
+                    return;
+                }
+
+                var events = new List<(string eventName, AriaNative.EventProperty[] eventProperties)>();
+                while (s_pendingEvents.TryDequeue(out var pendingEvent))
+                {
+                    events.Add(pendingEvent);
+                }
+
+                AriaNative.LogEvents(s_ariaLogger, events);
+            }
         }
 
         /// <summary>
@@ -13,6 +13,11 @@ namespace BuildXL.Interop
         /// </summary>
         public const string BuildXLInteropLibMacOS = "libBuildXLInterop";
 
+        /// <summary>
+        /// BuildXL interop library for Linux (shipped with the Linux sandbox)
+        /// </summary>
+        public const string BuildXLInteropLibLinux = "libBxlUtils";
+
         /// <summary>
         /// Standard C Library
         /// </summary>
@@ -0,0 +1,126 @@
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License.
+
+using System.Runtime.InteropServices;
+using static BuildXL.Interop.Libraries;
+
+namespace BuildXL.Interop.Unix
+{
+    /// <summary>
+    /// Per pip resource accounting and limits on top of cgroup v2 (Linux only): a pip runs in a cgroup of its own, created under a parent
+    /// cgroup the build was delegated, so that the kernel accounts for (and can act on) the whole process tree of the pip, including the
+    /// processes that escaped it (e.g., daemonized ones).
+    /// </summary>
+    /// <remarks>
+    /// All functions take the absolute path of the cgroup directory (e.g., /sys/fs/cgroup/bxl/pip1234) and return 0 on success, the error code (errno) otherwise.
+    /// See Public/Src/Sandbox/Linux/cgroup.h.
+    /// </remarks>
+    public static class Cgroup
+    {
+        /// <summary>
+        /// Usage of a cgroup, as read by <see cref="GetUsage"/>
+        /// </summary>
+        /// <remarks>
+        /// CODESYNC: Public/Src/Sandbox/Linux/cgroup.h
+        /// </remarks>
+        [StructLayout(LayoutKind.Sequential)]
+        public struct CgroupUsage
+        {
+            /// <summary>memory.current (bytes)</summary>
+            public ulong MemoryCurrentBytes;
+
+            /// <summary>memory.peak (bytes), 0 on kernels that don't have it</summary>
+            public ulong MemoryPeakBytes;
+
+            /// <summary>Number of times the cgroup was throttled by memory.high</summary>
+            public ulong MemoryHighEvents;
+
+            /// <summary>Number of processes of the cgroup the OOM killer killed</summary>
+            public ulong MemoryOomKills;
+
+            /// <summary>Total CPU time (microseconds)</summary>
+            public ulong CpuUsageUs;
+
+            /// <summary>User mode CPU time (microseconds)</summary>
+            public ulong CpuUserUs;
+
+            /// <summary>Kernel mode CPU time (microseconds)</summary>
+            public ulong CpuSystemUs;
+
+            /// <summary>Bytes read, summed over all devices</summary>
+            public ulong IoReadBytes;
+
+            /// <summary>Bytes written, summed over all devices</summary>
+            public ulong IoWriteBytes;
+
+            /// <summary>Read operations, summed over all devices</summary>
+            public ulong IoReadOps;
+
+            /// <summary>Write operations, summed over all devices</summary>
+            public ulong IoWriteOps;
+
+            /// <summary>Non-zero while some process is still in the cgroup</summary>
+            public uint Populated;
+
+            private readonly uint m_padding;
+        }
+
+        /// <summary>
+        /// Creates the cgroup <paramref name="path"/> (enabling the memory, cpu and io controllers in its parent first, best effort); an existing cgroup is reused
+        /// </summary>
+        public static int Create(string path) => pip_cgroup_create(path);
+
+        /// <summary>
+        /// Moves the process <paramref name="pid"/> into the cgroup <paramref name="path"/>; the children it creates from then on are created in there as well
+        /// </summary>
+        public static int AddProcess(string path, int pid) => pip_cgroup_add_process(path, pid);
+
+        /// <summary>
+        /// Sets memory.high of the cgroup <paramref name="path"/>: past <paramref name="bytes"/>, its processes are throttled and reclaimed from
+        /// (instead of killed, as with memory.max). 0 removes the limit.
+        /// </summary>
+        public static int SetMemoryHigh(string path, ulong bytes) => pip_cgroup_set_memory_high(path, bytes);
+
+        /// <summary>
+        /// Reads memory.current, memory.peak, memory.events, cpu.stat, io.stat and cgroup.events of the cgroup <paramref name="path"/> in one call.
+        /// The accounting of a controller that is not enabled is left at 0.
+        /// </summary>
+        public static int GetUsage(string path, ref CgroupUsage usage) => pip_cgroup_get_usage(path, ref usage, Marshal.SizeOf<CgroupUsage>());
+
+        /// <summary>
+        /// Kills every process of the cgroup <paramref name="path"/>
+        /// </summary>
+        public static int Kill(string path) => pip_cgroup_kill(path);
+
+        /// <summary>
+        /// Whether some (possibly not yet reaped) process is still in the cgroup <paramref name="path"/>
+        /// </summary>
+        public static int IsPopulated(string path, out bool populated) => pip_cgroup_is_populated(path, out populated);
+
+        /// <summary>
+        /// Removes the cgroup <paramref name="path"/>, which must not be populated; a cgroup that doesn't exist is not an error
+        /// </summary>
+        public static int Remove(string path) => pip_cgroup_remove(path);
+
+        [DllImport(BuildXLInteropLibLinux)]
+        private static extern int pip_cgroup_create(string path);
+
+        [DllImport(BuildXLInteropLibLinux)]
+        private static extern int pip_cgroup_add_process(string path, int pid);
+
+        [DllImport(BuildXLInteropLibLinux)]
+        private static extern int pip_cgroup_set_memory_high(string path, ulong bytes);
+
+        [DllImport(BuildXLInteropLibLinux)]
+        private static extern int pip_cgroup_get_usage(string path, ref CgroupUsage usage, long usageSize);
+
+        [DllImport(BuildXLInteropLibLinux)]
+        private static extern int pip_cgroup_kill(string path);
+
+        [DllImport(BuildXLInteropLibLinux)]
+        private static extern int pip_cgroup_is_populated(string path, [MarshalAs(UnmanagedType.U1)] out bool populated);
+
+        [DllImport(BuildXLInteropLibLinux)]
+        private static extern int pip_cgroup_remove(string path);
+    }
+}
@@ -130,6 +130,17 @@ namespace BuildXL.Interop.Unix
             public DateTime ToUtcDateTime(long sec, long nsec) => new Timespec { Tv_sec = sec, Tv_nsec = nsec }.ToUtcTime();
         }
 
+        /// <summary>
+        /// Header of the packed records written by the native directory enumeration, followed by the UTF-8 name of the entry
+        /// </summary>
+        [StructLayout(LayoutKind.Sequential)]
+        internal struct DirectoryEntryRecord
+        {
+            public uint RecordLength;
+            public uint NameLength;
+            public StatBuffer Stat;
+        }
+
         public enum FilePermissions : int
         {
             S_ISUID = 0x0800, // Set user ID on execution
@@ -176,6 +187,42 @@ namespace BuildXL.Interop.Unix
             ? Impl_Mac.StatFile(path, followSymlink, ref statBuf)
             : Impl_Linux.StatFile(path, followSymlink, ref statBuf);
 
+        /// <summary>
+        /// Same as <see cref="StatFile" /> except that many files are stat-ed at once, concurrently.
+        /// </summary>
+        /// <remarks>
+        /// Passing the paths in sorted order helps on macOS: consecutive paths of the same directory are resolved
+        /// relative to one descriptor of that directory.
+        /// </remarks>
+        /// <returns>
+        /// The number of files that were successfully stat-ed.  For every path <c>i</c>, <paramref name="errors"/>[i] is 0 if
+        /// the result is stored in <paramref name="statBufs"/>[i], and the error code (errno) of the failed call otherwise.
+        /// </returns>
+        public static int StatFiles(string[] paths, bool followSymlink, StatBuffer[] statBufs, int[] errors)
+        {
+            Contract.Requires(paths != null && statBufs != null && errors != null);
+            Contract.Requires(statBufs.Length >= paths.Length && errors.Length >= paths.Length);
+
+            return IsMacOS
+                ? Impl_Mac.StatFiles(paths, followSymlink, statBufs, errors)
+                : Impl_Linux.StatFiles(paths, followSymlink, statBufs, errors);
+        }
+
+        /// <summary>
+        /// Calls <paramref name="handleEntry"/> with the name and the attributes of every entry of <paramref name="directoryPath"/>
+        /// (except "." and ".."), without a separate <see cref="StatFile"/> call per entry.
+        /// </summary>
+        /// <remarks>
+        /// The attributes are those of the entries themselves, i.e., symlinks are not followed.  On macOS, the size of a directory
+        /// entry is always reported as 0.
+        /// </remarks>
+        /// <returns>
+        /// 0 on success, the error code (errno) otherwise.  Entries reported before an error occurred are not retracted.
+        /// </returns>
+        public static int EnumerateDirectoryWithAttributes(string directoryPath, Action<string, StatBuffer> handleEntry) => IsMacOS
+            ? Impl_Mac.EnumerateDirectoryWithAttributes(directoryPath, handleEntry)
+            : Impl_Linux.EnumerateDirectoryWithAttributes(directoryPath, handleEntry);
+
         /// <summary>
         /// Same as <see cref="StatFile" /> except that the target file is given as a file descriptor (<paramref name="fd" />).
         /// </summary>
@@ -362,6 +409,91 @@ namespace BuildXL.Interop.Unix
         [DllImport(Libraries.LibC, SetLastError = true, EntryPoint = "clonefile")]
         public static extern int CloneFile(string source, string destination, CloneFileFlags flags);
 
+        /// <summary>
+        /// Materializes <paramref name="source"/> at <paramref name="destination"/>, which must not exist yet: creates a copy-on-write
+        /// clone where the file system supports it (clonefile on APFS, the FICLONE ioctl on Linux) and otherwise copies the file
+        /// in the kernel (copyfile on macOS, copy_file_range or sendfile on Linux).  The permissions of the source are preserved.
+        /// </summary>
+        /// <param name="source">File to copy</param>
+        /// <param name="destination">Path of the new file</param>
+        /// <param name="followSymlink">Whether to copy the target of a symlink; if false, a symlink is copied as a symlink</param>
+        /// <returns>0 on success, the error code (errno) otherwise</returns>
+        public static int CloneOrCopyFile(string source, string destination, bool followSymlink) => IsMacOS
+            ? Impl_Mac.CloneOrCopyFile(source, destination, followSymlink)
+            : Impl_Linux.CloneOrCopyFile(source, destination, followSymlink);
+
+        /// <summary>
+        /// Same as <see cref="CloneOrCopyFile"/> except that many files are materialized at once, concurrently.
+        /// </summary>
+        /// <returns>
+        /// The number of files successfully materialized.  For every file <c>i</c>, <paramref name="errors"/>[i] is 0 if it
+        /// was materialized and the error code (errno) otherwise.
+        /// </returns>
+        public static int CloneOrCopyFiles(string[] sources, string[] destinations, bool followSymlink, int[] errors)
+        {
+            Contract.Requires(sources != null && destinations != null && errors != null);
+            Contract.Requires(destinations.Length == sources.Length && errors.Length >= sources.Length);
+
+            return IsMacOS
+                ? Impl_Mac.CloneOrCopyFiles(sources, destinations, sources.Length, followSymlink, errors)
+                : Impl_Linux.CloneOrCopyFiles(sources, destinations, followSymlink, errors);
+        }
+
+        /// <summary>
+        /// Flags of the changes reported by <see cref="ReadJournalChanges"/>
+        /// </summary>
+        [Flags]
+        public enum JournalChangeFlags : uint
+        {
+            /// <summary>The direct entries of the directory may have changed</summary>
+            None        = 0x0,
+
+            /// <summary>Every entry under the directory may have changed</summary>
+            Recursive   = 0x1,
+
+            /// <summary>The history since the requested event id is not available; reported (with <see cref="Recursive"/>) once per root</summary>
+            HistoryLost = 0x2,
+        }
+
+        /// <summary>
+        /// Returns the id of the most recent event of the change journal (FSEvents), i.e., the id to pass to <see cref="ReadJournalChanges"/>
+        /// to learn about the changes made from now on.  The journal is only available on macOS, elsewhere 0 is returned.
+        /// </summary>
+        public static ulong GetCurrentJournalEventId() => IsMacOS
+            ? Impl_Mac.GetCurrentJournalEventId()
+            : 0;
+
+        /// <summary>
+        /// Gets the id of the change journal of the volume on which <paramref name="path"/> resides.  Event ids are only meaningful
+        /// for the journal they come from: when the id of a volume changes, the history of that volume is gone.
+        /// </summary>
+        /// <returns>0 on success, the error code (errno) otherwise (ENOSYS when there is no change journal)</returns>
+        public static int GetJournalVolumeId(string path, StringBuilder volumeId) => IsMacOS
+            ? Impl_Mac.GetJournalVolumeId(path, volumeId, volumeId.Capacity)
+            : (int)Errno.ENOSYS;
+
+        /// <summary>
+        /// Calls <paramref name="handleChange"/> for every directory under <paramref name="roots"/> that changed after the journal event
+        /// <paramref name="sinceEventId"/>, so that callers only need to enumerate those again instead of scanning the roots.
+        /// </summary>
+        /// <remarks>
+        /// The journal records directories, not files.  The changes are coalesced: a directory is reported once, and not at all when an
+        /// ancestor is reported with <see cref="JournalChangeFlags.Recursive"/>.
+        /// </remarks>
+        /// <returns>
+        /// 0 on success, the error code (errno) otherwise (ENOSYS when there is no change journal).  On success, <paramref name="lastEventId"/>
+        /// is the id to pass to the next call.
+        /// </returns>
+        public static int ReadJournalChanges(string[] roots, ulong sinceEventId, Action<string, JournalChangeFlags> handleChange, out ulong lastEventId)
+        {
+            Contract.Requires(roots != null && roots.Length > 0 && handleChange != null);
+
+            lastEventId = sinceEventId;
+            return IsMacOS
+                ? Impl_Mac.ReadJournalChanges(roots, sinceEventId, handleChange, out lastEventId)
+                : (int)Errno.ENOSYS;
+        }
+
         /// <summary>
         /// Copies a file using 'copy_file_range' using in-kernel file descriptors.
         /// </summary>
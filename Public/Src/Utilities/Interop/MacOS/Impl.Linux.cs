@@ -2,6 +2,7 @@
 // Licensed under the MIT License.
 
 using System;
+using System.Collections.Concurrent;
 using System.Collections.Generic;
 using System.Diagnostics;
 using System.Diagnostics.ContractsLight;
@@ -10,6 +11,7 @@ using System.IO;
 using System.Runtime.InteropServices;
 using System.Text;
 using System.Threading;
+using System.Threading.Tasks;
 using Microsoft.Win32.SafeHandles;
 using static BuildXL.Interop.Libraries;
 using static BuildXL.Interop.Unix.Constants;
@@ -95,6 +97,288 @@ namespace BuildXL.Interop.Unix
             return StatFile(AT_FDCWD, path, followSymlink, ref statBuf);
         }
 
+        /// <summary>
+        /// Number of paths stat-ed by one work item of <see cref="StatFiles"/>
+        /// </summary>
+        private const int StatFilesChunkSize = 256;
+
+        /// <summary>
+        /// Linux specific implementation of <see cref="IO.StatFiles"/>
+        /// </summary>
+        internal static int StatFiles(string[] paths, bool followSymlink, StatBuffer[] statBufs, int[] errors)
+        {
+            Action<int, int> statRange = (start, end) =>
+            {
+                for (int i = start; i < end; i++)
+                {
+                    errors[i] = StatFile(AT_FDCWD, paths[i], followSymlink, ref statBufs[i]) == 0
+                        ? 0
+                        : Marshal.GetLastWin32Error();
+                }
+            };
+
+            if (paths.Length <= StatFilesChunkSize)
+            {
+                statRange(0, paths.Length);
+            }
+            else
+            {
+                Parallel.ForEach(
+                    Partitioner.Create(0, paths.Length, StatFilesChunkSize),
+                    range => statRange(range.Item1, range.Item2));
+            }
+
+            return errors.Take(paths.Length).Count(error => error == 0);
+        }
+
+        /// <summary>
+        /// Number of files materialized by one work item of <see cref="CloneOrCopyFiles"/>
+        /// </summary>
+        private const int CloneFilesChunkSize = 32;
+
+        /// <summary>
+        /// Largest number of bytes copied by one copy_file_range/sendfile call (the kernel limit of sendfile)
+        /// </summary>
+        private const long MaxBytesPerCopy = 0x7ffff000;
+
+        private const uint FICLONE = 0x40049409;
+
+        // Linux values of error numbers that <see cref="Errno"/> does not define or defines with their macOS values
+        private const int LinuxELOOP = 40;
+        private const int LinuxEOPNOTSUPP = 95;
+
+        private static bool s_copyFileRangeSupported = true;
+
+        /// <summary>
+        /// Linux specific implementation of <see cref="IO.CloneOrCopyFiles"/>
+        /// </summary>
+        internal static int CloneOrCopyFiles(string[] sources, string[] destinations, bool followSymlink, int[] errors)
+        {
+            Parallel.ForEach(
+                Partitioner.Create(0, sources.Length, CloneFilesChunkSize),
+                range =>
+                {
+                    for (int i = range.Item1; i < range.Item2; i++)
+                    {
+                        errors[i] = CloneOrCopyFile(sources[i], destinations[i], followSymlink);
+                    }
+                });
+
+            return errors.Take(sources.Length).Count(error => error == 0);
+        }
+
+        /// <summary>
+        /// Linux specific implementation of <see cref="IO.CloneOrCopyFile"/>
+        /// </summary>
+        internal static int CloneOrCopyFile(string source, string destination, bool followSymlink)
+        {
+            var sourceFlags = O_Flags.O_RDONLY | O_Flags.O_CLOEXEC | (followSymlink ? O_Flags.O_NONE : O_Flags.O_NOFOLLOW);
+            int sourceFd = OpenRetryingOnInterrupt(source, sourceFlags, 0);
+            if (sourceFd < 0)
+            {
+                int error = Marshal.GetLastWin32Error();
+                return !followSymlink && error == LinuxELOOP
+                    ? CopySymlink(source, destination)
+                    : error;
+            }
+
+            using (new SafeFileHandle(new IntPtr(sourceFd), ownsHandle: true))
+            {
+                var statBuf = new StatBuffer();
+                if (StatFile(sourceFd, string.Empty, followSymlink: false, ref statBuf) != 0)
+                {
+                    return Marshal.GetLastWin32Error();
+                }
+
+                var permissions = (FilePermissions)(statBuf.Mode & (ushort)FilePermissions.ALLPERMS);
+                int destinationFd = OpenRetryingOnInterrupt(destination, O_Flags.O_WRONLY | O_Flags.O_CREAT | O_Flags.O_EXCL | O_Flags.O_CLOEXEC, permissions);
+                if (destinationFd < 0)
+                {
+                    return Marshal.GetLastWin32Error();
+                }
+
+                int result;
+                using (new SafeFileHandle(new IntPtr(destinationFd), ownsHandle: true))
+                {
+                    result = ioctl(destinationFd, FICLONE, sourceFd) == 0
+                        ? 0
+                        : CopyFileContent(sourceFd, destinationFd, statBuf.Size);
+                }
+
+                if (result != 0)
+                {
+                    // don't leave a partial copy behind
+                    unlink(destination);
+                }
+
+                return result;
+            }
+        }
+
+        private static int OpenRetryingOnInterrupt(string path, O_Flags flags, FilePermissions permissions)
+        {
+            int result;
+            while (
+                (result = open(path, flags, permissions)) < 0 &&
+                Marshal.GetLastWin32Error() == (int)Errno.EINTR);
+            return result;
+        }
+
+        private static int CopySymlink(string source, string destination)
+        {
+            var target = new StringBuilder(MaxPathLength);
+            if (SafeReadLink(source, target, target.Capacity) < 0)
+            {
+                return Marshal.GetLastWin32Error();
+            }
+
+            return symlink(target.ToString(), destination) == 0 ? 0 : Marshal.GetLastWin32Error();
+        }
+
+        /// <summary>
+        /// Copies 'length' bytes from the current offset of 'sourceFd' to 'destinationFd' with copy_file_range, falling back to
+        /// sendfile where copy_file_range is not available (older glibc or kernel) or not supported for the two files.
+        /// </summary>
+        private static int CopyFileContent(int sourceFd, int destinationFd, long length)
+        {
+            while (length > 0)
+            {
+                long count = Math.Min(length, MaxBytesPerCopy);
+                long copied = -1;
+                int error = 0;
+
+                if (s_copyFileRangeSupported)
+                {
+                    try
+                    {
+                        copied = copyfilerange(sourceFd, IntPtr.Zero, destinationFd, IntPtr.Zero, count, 0);
+                        error = copied < 0 ? Marshal.GetLastWin32Error() : 0;
+                    }
+                    catch (EntryPointNotFoundException)
+                    {
+                        s_copyFileRangeSupported = false;
+                    }
+                }
+
+                if (copied < 0 && (!s_copyFileRangeSupported || error == (int)Errno.ENOSYS || error == (int)Errno.EXDEV || error == (int)Errno.EINVAL || error == LinuxEOPNOTSUPP))
+                {
+                    if (error == (int)Errno.ENOSYS)
+                    {
+                        s_copyFileRangeSupported = false;
+                    }
+
+                    copied = sendfile(destinationFd, sourceFd, IntPtr.Zero, count);
+                    error = copied < 0 ? Marshal.GetLastWin32Error() : 0;
+                }
+
+                if (copied < 0)
+                {
+                    if (error == (int)Errno.EINTR)
+                    {
+                        continue;
+                    }
+
+                    return error;
+                }
+
+                if (copied == 0)
+                {
+                    // the source was truncated while copying
+                    break;
+                }
+
+                length -= copied;
+            }
+
+            return 0;
+        }
+
+        /// <summary>
+        /// Size of the buffer directory entries are read into by <see cref="EnumerateDirectoryWithAttributes"/>
+        /// </summary>
+        private const int DirectoryEnumerationBufferSize = 32 * 1024;
+
+        /// <summary>
+        /// Linux specific implementation of <see cref="IO.EnumerateDirectoryWithAttributes"/>
+        /// </summary>
+        /// <remarks>
+        /// The entries are read with 'getdents64', a buffer full at a time, and every entry is stat-ed relative to the
+        /// directory descriptor (using 'fstatat' instead of 'statx' for the same reason as <see cref="StatFile(int, string, bool, ref StatBuffer)"/>).
+        /// </remarks>
+        internal static unsafe int EnumerateDirectoryWithAttributes(string directoryPath, Action<string, StatBuffer> handleEntry)
+        {
+            int dirfd;
+            while (
+                (dirfd = open(directoryPath, O_Flags.O_RDONLY | O_Flags.O_DIRECTORY | O_Flags.O_CLOEXEC, 0)) < 0 &&
+                Marshal.GetLastWin32Error() == (int)Errno.EINTR);
+            if (dirfd < 0)
+            {
+                return Marshal.GetLastWin32Error();
+            }
+
+            using (new SafeFileHandle(new IntPtr(dirfd), ownsHandle: true))
+            {
+                var buffer = new byte[DirectoryEnumerationBufferSize];
+                fixed (byte* start = buffer)
+                {
+                    while (true)
+                    {
+                        long length = getdents64(dirfd, start, buffer.Length);
+                        if (length < 0)
+                        {
+                            int error = Marshal.GetLastWin32Error();
+                            if (error == (int)Errno.EINTR)
+                            {
+                                continue;
+                            }
+
+                            return error;
+                        }
+
+                        if (length == 0)
+                        {
+                            return 0;
+                        }
+
+                        // struct linux_dirent64 { ino64_t d_ino; off64_t d_off; unsigned short d_reclen; unsigned char d_type; char d_name[]; }
+                        for (byte* entry = start; entry < start + length; entry += *(ushort*)(entry + DirentRecordLengthOffset))
+                        {
+                            string name = Marshal.PtrToStringAnsi(new IntPtr(entry + DirentNameOffset));
+                            if (name == "." || name == "..")
+                            {
+                                continue;
+                            }
+
+                            var statBuf = new StatBuffer();
+                            if (StatFile(dirfd, name, followSymlink: false, ref statBuf) != 0)
+                            {
+                                int error = Marshal.GetLastWin32Error();
+                                if (error == (int)Errno.ENOENT)
+                                {
+                                    // removed since the directory was read
+                                    continue;
+                                }
+
+                                return error;
+                            }
+
+                            handleEntry(name, statBuf);
+                        }
+                    }
+                }
+            }
+        }
+
+        private const int DirentRecordLengthOffset = 16;
+        private const int DirentNameOffset = 19;
+
+        private static unsafe long getdents64(int fd, byte* buffer, long count)
+        {
+            // glibc only has a wrapper since 2.30, so go through 'syscall' with the architecture specific number
+            long number = RuntimeInformation.ProcessArchitecture == Architecture.Arm64 ? 61 : 217;
+            return syscall(number, fd, buffer, count);
+        }
+
         private static int StatFile(int fd, string path, bool followSymlink, ref StatBuffer statBuf)
         {
             // using 'fstatat' instead of the newer 'statx' because Ubuntu 18.04 doesn't have iit
@@ -316,12 +600,12 @@ namespace BuildXL.Interop.Unix
             {
                 var resourceUsage = GetResourceUsagesForProcessTree(pid, includeChildProcesses);
                 buffer.UserTimeNs = resourceUsage.Aggregate(0UL, (acc, usage) => acc + usage.UserTimeNs);
-                buffer.SystemTimeNs = resourceUsage.Aggregate(0UL, (acc, usage) => acc + usage.SystemTimeNs);
+                buffer.SystemTimeNs = resourceUsage.Aggregate(0UL, (acc, usage) => acc + usage.SystemTimeNs);
                 buffer.WorkingSetSize = resourceUsage.Aggregate(0UL, (acc, usage) => acc + usage.WorkingSetSize);
                 buffer.PeakWorkingSetSize = resourceUsage.Aggregate(0UL, (acc, usage) => acc + usage.PeakWorkingSetSize);
-                buffer.DiskReadOps = resourceUsage.Aggregate(0UL, (acc, usage) => acc + usage.DiskReadOps);
+                buffer.DiskReadOps = resourceUsage.Aggregate(0UL, (acc, usage) => acc + usage.DiskReadOps);
                 buffer.DiskBytesRead = resourceUsage.Aggregate(0UL, (acc, usage) => acc + usage.DiskBytesRead);
-                buffer.DiskWriteOps = resourceUsage.Aggregate(0UL, (acc, usage) => acc + usage.DiskWriteOps);
+                buffer.DiskWriteOps = resourceUsage.Aggregate(0UL, (acc, usage) => acc + usage.DiskWriteOps);
                 buffer.DiskBytesWritten = resourceUsage.Aggregate(0UL, (acc, usage) => acc + usage.DiskBytesWritten);
                 buffer.NumberOfChildProcesses = resourceUsage.Aggregate(0, (acc, usage) => acc + usage.NumberOfChildProcesses);
 
@@ -345,6 +629,143 @@ namespace BuildXL.Interop.Unix
             return 0;
         }
 
+        private const string ProcPressureMemoryPath = "/proc/pressure/memory";
+
+        // Unprivileged PSI triggers need a window that is a multiple of 2s. Thresholds and window are in microseconds.
+        private const int PsiWindowMs = 2000;
+        private const string PsiWarningTrigger = "some 200000 2000000";
+        private const string PsiCriticalTrigger = "full 100000 2000000";
+
+        private const short POLLPRI = 0x2;
+        private const short POLLERR = 0x8;
+
+        /// <summary>
+        /// Linux specific implementation of <see cref="Memory.SubscribeToMemoryPressureChanges"/>
+        /// </summary>
+        internal static IDisposable SubscribeToMemoryPressureChanges(Action<PressureLevel> onChange)
+        {
+            int warningFd = OpenPsiTrigger(PsiWarningTrigger);
+            if (warningFd < 0)
+            {
+                return null;
+            }
+
+            int criticalFd = OpenPsiTrigger(PsiCriticalTrigger);
+            if (criticalFd < 0)
+            {
+                new SafeFileHandle(new IntPtr(warningFd), ownsHandle: true).Dispose();
+                return null;
+            }
+
+            return new PsiMemoryPressureSubscription(warningFd, criticalFd, onChange);
+        }
+
+        private static int OpenPsiTrigger(string trigger)
+        {
+            int fd = OpenRetryingOnInterrupt(ProcPressureMemoryPath, O_Flags.O_RDWR | O_Flags.O_NONBLOCK | O_Flags.O_CLOEXEC, 0);
+            if (fd < 0)
+            {
+                return -1;
+            }
+
+            // the kernel expects the trigger to be NUL terminated
+            byte[] bytes = Encoding.ASCII.GetBytes(trigger + "\0");
+            if (write(fd, bytes, bytes.Length) < 0)
+            {
+                new SafeFileHandle(new IntPtr(fd), ownsHandle: true).Dispose();
+                return -1;
+            }
+
+            return fd;
+        }
+
+        /// <summary>
+        /// Polls two PSI triggers on a dedicated thread: the level is <see cref="PressureLevel.Critical"/> (resp. <see cref="PressureLevel.Warning"/>)
+        /// for a PSI window after its trigger fired, and goes back to <see cref="PressureLevel.Normal"/> once neither fired for a window.
+        /// </summary>
+        private sealed class PsiMemoryPressureSubscription : IDisposable
+        {
+            private readonly SafeFileHandle m_warningTrigger;
+            private readonly SafeFileHandle m_criticalTrigger;
+            private readonly Action<PressureLevel> m_onChange;
+            private readonly Thread m_thread;
+            private volatile bool m_disposed;
+
+            public PsiMemoryPressureSubscription(int warningFd, int criticalFd, Action<PressureLevel> onChange)
+            {
+                m_warningTrigger = new SafeFileHandle(new IntPtr(warningFd), ownsHandle: true);
+                m_criticalTrigger = new SafeFileHandle(new IntPtr(criticalFd), ownsHandle: true);
+                m_onChange = onChange;
+                m_thread = new Thread(Poll) { IsBackground = true, Name = "MemoryPressureNotifications" };
+                m_thread.Start();
+            }
+
+            private void Poll()
+            {
+                var fds = new[]
+                {
+                    new PollFd { Fd = (int)m_warningTrigger.DangerousGetHandle(), Events = POLLPRI },
+                    new PollFd { Fd = (int)m_criticalTrigger.DangerousGetHandle(), Events = POLLPRI },
+                };
+
+                var stopwatch = Stopwatch.StartNew();
+                long lastWarningMs = long.MinValue / 2;
+                long lastCriticalMs = long.MinValue / 2;
+                PressureLevel level = PressureLevel.Normal;
+
+                while (!m_disposed)
+                {
+                    // the timeout is what brings the level back to normal, and what notices the subscription was disposed
+                    fds[0].Revents = fds[1].Revents = 0;
+                    int ready = poll(fds, (ulong)fds.Length, PsiWindowMs / 2);
+                    if (ready < 0 && Marshal.GetLastWin32Error() != (int)Errno.EINTR)
+                    {
+                        return;
+                    }
+
+                    if (((fds[0].Revents | fds[1].Revents) & POLLERR) != 0)
+                    {
+                        // the monitor is gone (e.g., the cgroup was removed)
+                        return;
+                    }
+
+                    long nowMs = stopwatch.ElapsedMilliseconds;
+                    if ((fds[0].Revents & POLLPRI) != 0)
+                    {
+                        lastWarningMs = nowMs;
+                    }
+
+                    if ((fds[1].Revents & POLLPRI) != 0)
+                    {
+                        lastCriticalMs = nowMs;
+                    }
+
+                    PressureLevel current = nowMs - lastCriticalMs < PsiWindowMs ? PressureLevel.Critical
+                        : nowMs - lastWarningMs < PsiWindowMs ? PressureLevel.Warning
+                        : PressureLevel.Normal;
+
+                    if (current != level && !m_disposed)
+                    {
+                        level = current;
+                        m_onChange(level);
+                    }
+                }
+            }
+
+            public void Dispose()
+            {
+                if (m_disposed)
+                {
+                    return;
+                }
+
+                m_disposed = true;
+                m_thread.Join();
+                m_warningTrigger.Dispose();
+                m_criticalTrigger.Dispose();
+            }
+        }
+
         /// <summary>
         /// Linux specific implementation of <see cref="Processor.GetCpuLoadInfo"/>
         /// </summary>
@@ -370,6 +791,68 @@ namespace BuildXL.Interop.Unix
             #pragma warning restore
         }
 
+        /// <summary>
+        /// Linux specific implementation of <see cref="Processor.CpuUtilizationSampler.Sample"/>; 'busyTicks' and 'totalTicks' hold
+        /// the ticks of every logical core at the previous sample and are updated in place.
+        /// </summary>
+        internal static int SampleCpuUtilization(ref ulong[] busyTicks, ref ulong[] totalTicks, ref CpuUtilization utilization, double[] coreUtilization)
+        {
+            try
+            {
+                // per core lines: cpuN user nice system idle iowait irq softirq ...
+                var cores = File.ReadAllLines($"{ProcPath}{ProcStatPath}")
+                    .Where(line => line.Length > 3 && line.StartsWith("cpu", StringComparison.Ordinal) && char.IsDigit(line[3]))
+                    .Select(line => line.Split(new[] { ' ' }, StringSplitOptions.RemoveEmptyEntries).Skip(1).Take(7).Select(ulong.Parse).ToArray())
+                    .ToArray();
+
+                if (cores.Length != busyTicks.Length)
+                {
+                    // start over (i.e., measure since boot) whenever the number of cores changes
+                    busyTicks = new ulong[cores.Length];
+                    totalTicks = new ulong[cores.Length];
+                }
+
+                ulong busy = 0, total = 0;
+                for (int i = 0; i < cores.Length; i++)
+                {
+                    var ticks = cores[i];
+                    Func<int, ulong> field = index => index < ticks.Length ? ticks[index] : 0;
+
+                    // busy: user, nice, system, irq and softirq; idle: idle and iowait
+                    ulong coreBusy = field(0) + field(1) + field(2) + field(5) + field(6);
+                    ulong coreTotal = coreBusy + field(3) + field(4);
+
+                    ulong busyDelta = coreBusy - busyTicks[i];
+                    ulong totalDelta = coreTotal - totalTicks[i];
+                    busyTicks[i] = coreBusy;
+                    totalTicks[i] = coreTotal;
+
+                    busy += busyDelta;
+                    total += totalDelta;
+                    if (coreUtilization != null && i < coreUtilization.Length)
+                    {
+                        coreUtilization[i] = Percent(busyDelta, totalDelta);
+                    }
+                }
+
+                utilization.NumCores = cores.Length;
+                utilization.NumPerformanceCores = cores.Length;
+                utilization.NumEfficiencyCores = 0;
+                utilization.Utilization = Percent(busy, total);
+                utilization.PerformanceUtilization = utilization.Utilization;
+                utilization.EfficiencyUtilization = 0;
+                return 0;
+            }
+            #pragma warning disable
+            catch (Exception)
+            {
+                return ERROR;
+            }
+            #pragma warning restore
+        }
+
+        private static double Percent(ulong part, ulong total) => total == 0 ? 0 : 100.0 * part / total;
+
         // CODESYNC: NormalizeAndHashPath in StringOperations.cpp
         // TODO: there is no reason for this hash computation to be done in native StringOperations.cpp
         private const uint Fnv1Prime32 = 16777619;
@@ -623,6 +1106,29 @@ namespace BuildXL.Interop.Unix
         [DllImport(LibC, SetLastError = true, CharSet = CharSet.Ansi)]
         internal static extern long sysconf(int name);
 
+        [DllImport(LibC, SetLastError = true)]
+        private static extern int ioctl(int fd, uint request, int arg);
+
+        [DllImport(LibC, SetLastError = true, CharSet = CharSet.Ansi)]
+        private static extern int unlink(string pathname);
+
+        [DllImport(LibC, SetLastError = true)]
+        private static extern unsafe long syscall(long number, int fd, byte* buffer, long count);
+
+        [DllImport(LibC, SetLastError = true)]
+        private static extern long write(int fd, byte[] buffer, long count);
+
+        [StructLayout(LayoutKind.Sequential)]
+        private struct PollFd
+        {
+            public int Fd;
+            public short Events;
+            public short Revents;
+        }
+
+        [DllImport(LibC, SetLastError = true)]
+        private static extern int poll([In, Out] PollFd[] fds, ulong nfds, int timeout);
+
         #pragma warning restore CS1591 // Missing XML comment for publicly visible type or member
 
         #endregion
@@ -157,6 +157,105 @@ namespace BuildXL.Interop.Unix
         internal unsafe static int StatFile(string path, bool followSymlink, ref StatBuffer statBuf)
             => StatFile(path, followSymlink, ref statBuf, sizeof(StatBuffer));
 
+        [DllImport(Libraries.BuildXLInteropLibMacOS, SetLastError = true)]
+        private static extern int StatFiles(
+            [MarshalAs(UnmanagedType.LPArray, ArraySubType = UnmanagedType.LPStr)] string[] paths,
+            int count,
+            bool followSymlink,
+            [Out] StatBuffer[] statBufs,
+            [Out] int[] errors,
+            long statBufferSize);
+
+        /// <summary>OSX specific implementation of <see cref="IO.StatFiles"/> </summary>
+        internal unsafe static int StatFiles(string[] paths, bool followSymlink, StatBuffer[] statBufs, int[] errors)
+            => StatFiles(paths, paths.Length, followSymlink, statBufs, errors, sizeof(StatBuffer));
+
+        /// <summary>OSX specific implementation of <see cref="IO.CloneOrCopyFile"/> </summary>
+        [DllImport(Libraries.BuildXLInteropLibMacOS, SetLastError = true)]
+        internal static extern int CloneOrCopyFile(string source, string destination, bool followSymlink);
+
+        /// <summary>OSX specific implementation of <see cref="IO.CloneOrCopyFiles"/> </summary>
+        [DllImport(Libraries.BuildXLInteropLibMacOS, SetLastError = true)]
+        internal static extern int CloneOrCopyFiles(
+            [MarshalAs(UnmanagedType.LPArray, ArraySubType = UnmanagedType.LPStr)] string[] sources,
+            [MarshalAs(UnmanagedType.LPArray, ArraySubType = UnmanagedType.LPStr)] string[] destinations,
+            int count,
+            bool followSymlink,
+            [Out] int[] errors);
+
+        [DllImport(Libraries.BuildXLInteropLibMacOS, SetLastError = true)]
+        private static unsafe extern int EnumerateDirectoryWithAttributes(SafeFileHandle fd, byte* buffer, long bufferSize, long statBufferSize);
+
+        /// <summary>
+        /// Size of the buffer the native enumeration writes its records to; with typical names it holds a few hundred entries
+        /// </summary>
+        private const int DirectoryEnumerationBufferSize = 64 * 1024;
+
+        /// <summary>OSX specific implementation of <see cref="IO.EnumerateDirectoryWithAttributes"/> </summary>
+        internal unsafe static int EnumerateDirectoryWithAttributes(string directoryPath, Action<string, StatBuffer> handleEntry)
+        {
+            using (var fd = Open(directoryPath, OpenFlags.O_RDONLY | OpenFlags.O_CLOEXEC, 0))
+            {
+                if (fd.IsInvalid)
+                {
+                    return Marshal.GetLastWin32Error();
+                }
+
+                var buffer = new byte[DirectoryEnumerationBufferSize];
+                fixed (byte* start = buffer)
+                {
+                    while (true)
+                    {
+                        int length = EnumerateDirectoryWithAttributes(fd, start, buffer.Length, sizeof(StatBuffer));
+                        if (length < 0)
+                        {
+                            return Marshal.GetLastWin32Error();
+                        }
+
+                        if (length == 0)
+                        {
+                            return 0;
+                        }
+
+                        for (byte* record = start; record < start + length; record += ((DirectoryEntryRecord*)record)->RecordLength)
+                        {
+                            var header = (DirectoryEntryRecord*)record;
+                            handleEntry(Encoding.UTF8.GetString(record + sizeof(DirectoryEntryRecord), (int)header->NameLength), header->Stat);
+                        }
+                    }
+                }
+            }
+        }
+
+        /// <summary>OSX specific implementation of <see cref="IO.GetCurrentJournalEventId"/> </summary>
+        [DllImport(Libraries.BuildXLInteropLibMacOS)]
+        internal static extern ulong GetCurrentJournalEventId();
+
+        /// <summary>OSX specific implementation of <see cref="IO.GetJournalVolumeId"/> </summary>
+        [DllImport(Libraries.BuildXLInteropLibMacOS, CharSet = CharSet.Ansi)]
+        internal static extern int GetJournalVolumeId(string path, StringBuilder buffer, long bufferSize);
+
+        [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+        private delegate void JournalChangeCallback(IntPtr path, uint flags);
+
+        [DllImport(Libraries.BuildXLInteropLibMacOS)]
+        private static extern int ReadJournalChanges(
+            [MarshalAs(UnmanagedType.LPArray, ArraySubType = UnmanagedType.LPStr)] string[] roots,
+            int rootCount,
+            ulong sinceEventId,
+            JournalChangeCallback callback,
+            out ulong lastEventId);
+
+        /// <summary>OSX specific implementation of <see cref="IO.ReadJournalChanges"/> </summary>
+        internal static int ReadJournalChanges(string[] roots, ulong sinceEventId, Action<string, JournalChangeFlags> handleChange, out ulong lastEventId)
+        {
+            // The changes are reported synchronously, so the delegate only has to outlive the call
+            JournalChangeCallback callback = (path, flags) => handleChange(Marshal.PtrToStringAnsi(path), (JournalChangeFlags)flags);
+            int result = ReadJournalChanges(roots, roots.Length, sinceEventId, callback, out lastEventId);
+            GC.KeepAlive(callback);
+            return result;
+        }
+
         /// <summary>OSX specific implementation of <see cref="IO.SafeReadLink"/> </summary>
         [DllImport(Libraries.BuildXLInteropLibMacOS, SetLastError = true, CharSet = CharSet.Ansi)]
         internal static extern long SafeReadLink(string link, StringBuilder buffer, long length);
@@ -198,9 +297,59 @@ namespace BuildXL.Interop.Unix
         [DllImport(Libraries.BuildXLInteropLibMacOS)]
         internal static extern int GetMemoryPressureLevel(ref PressureLevel level);
 
+        [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+        private delegate void MemoryPressureCallback(int level);
+
+        [DllImport(Libraries.BuildXLInteropLibMacOS)]
+        private static extern IntPtr StartMemoryPressureNotifications(MemoryPressureCallback callback);
+
+        [DllImport(Libraries.BuildXLInteropLibMacOS)]
+        private static extern void StopMemoryPressureNotifications(IntPtr notifications);
+
+        /// <summary>OSX specific implementation of <see cref="Memory.SubscribeToMemoryPressureChanges"/> </summary>
+        internal static IDisposable SubscribeToMemoryPressureChanges(Action<PressureLevel> onChange)
+        {
+            MemoryPressureCallback callback = level => onChange((PressureLevel)level);
+            IntPtr notifications = StartMemoryPressureNotifications(callback);
+            return notifications != IntPtr.Zero ? new MemoryPressureSubscription(notifications, callback) : null;
+        }
+
+        private sealed class MemoryPressureSubscription : IDisposable
+        {
+            private IntPtr m_notifications;
+
+            // The native side calls it until the notifications are stopped
+            private readonly MemoryPressureCallback m_callback;
+
+            public MemoryPressureSubscription(IntPtr notifications, MemoryPressureCallback callback)
+            {
+                m_notifications = notifications;
+                m_callback = callback;
+            }
+
+            public void Dispose()
+            {
+                IntPtr notifications = System.Threading.Interlocked.Exchange(ref m_notifications, IntPtr.Zero);
+                if (notifications != IntPtr.Zero)
+                {
+                    StopMemoryPressureNotifications(notifications);
+                    GC.KeepAlive(m_callback);
+                }
+            }
+        }
+
         [DllImport(Libraries.BuildXLInteropLibMacOS)]
         internal static extern int GetCpuLoadInfo(ref CpuLoadInfo buffer, long bufferSize);
 
+        [DllImport(Libraries.BuildXLInteropLibMacOS)]
+        internal static extern IntPtr CreateCpuUtilizationSampler();
+
+        [DllImport(Libraries.BuildXLInteropLibMacOS)]
+        internal static extern void ReleaseCpuUtilizationSampler(IntPtr sampler);
+
+        [DllImport(Libraries.BuildXLInteropLibMacOS)]
+        internal static extern int SampleCpuUtilization(IntPtr sampler, ref CpuUtilization buffer, [Out] double[] coreUtilization, int coreCount, long bufferSize);
+
         [DllImport(Libraries.BuildXLInteropLibMacOS)]
         internal static extern int GetProcessResourceUsage(int pid, ref ProcessResourceUsage buffer, long bufferSize, bool includeChildProcesses);
 
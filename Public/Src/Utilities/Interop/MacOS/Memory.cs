@@ -1,6 +1,7 @@
 // Copyright (c) Microsoft Corporation.
 // Licensed under the MIT License.
 
+using System;
 using System.Runtime.InteropServices;
 using static BuildXL.Interop.Dispatch;
 
@@ -50,5 +51,20 @@ namespace BuildXL.Interop.Unix
         public static int GetMemoryPressureLevel(ref PressureLevel level) => IsMacOS
             ? Impl_Mac.GetMemoryPressureLevel(ref level)
             : Impl_Linux.GetMemoryPressureLevel(ref level);
+
+        /// <summary>
+        /// Calls <paramref name="onChange"/> whenever the memory pressure level changes, until the returned subscription is disposed,
+        /// so that the level doesn't have to be polled. On macOS the transitions come from a memory pressure dispatch source; on Linux
+        /// they come from PSI triggers on /proc/pressure/memory (the memory of some tasks stalled for a while is <see cref="PressureLevel.Warning"/>,
+        /// the memory of all of them is <see cref="PressureLevel.Critical"/>).
+        /// </summary>
+        /// <remarks>
+        /// <paramref name="onChange"/> is called on a dedicated thread, one transition at a time; it must not throw nor dispose the subscription.
+        /// Disposing the subscription waits for a running <paramref name="onChange"/> to return.
+        /// </remarks>
+        /// <returns>The subscription, or null if the notifications aren't available (e.g., a kernel without PSI)</returns>
+        public static IDisposable SubscribeToMemoryPressureChanges(Action<PressureLevel> onChange) => IsMacOS
+            ? Impl_Mac.SubscribeToMemoryPressureChanges(onChange)
+            : Impl_Linux.SubscribeToMemoryPressureChanges(onChange);
     }
 }
@@ -1,6 +1,7 @@
 // Copyright (c) Microsoft Corporation.
 // Licensed under the MIT License.
 
+using System;
 using System.Runtime.InteropServices;
 
 using static BuildXL.Interop.Dispatch;
@@ -21,6 +22,17 @@ namespace BuildXL.Interop.Unix
             public ulong UserTime;
             public ulong IdleTime;
         }
+
+        [StructLayout(LayoutKind.Sequential)]
+        public struct CpuUtilization
+        {
+            public double Utilization;
+            public double PerformanceUtilization;
+            public double EfficiencyUtilization;
+            public int NumCores;
+            public int NumPerformanceCores;
+            public int NumEfficiencyCores;
+        }
         #pragma warning restore CS1591 // Missing XML comment for publicly visible type or member
 
         /// <summary>
@@ -30,5 +42,70 @@ namespace BuildXL.Interop.Unix
         public static int GetCpuLoadInfo(ref CpuLoadInfo buffer) => IsMacOS
             ? Impl_Mac.GetCpuLoadInfo(ref buffer, Marshal.SizeOf(buffer))
             : Impl_Linux.GetCpuLoadInfo(ref buffer, Marshal.SizeOf(buffer));
+
+        /// <summary>
+        /// Keeps the CPU ticks of its previous sample, so that every <see cref="Sample"/> directly returns the CPU utilization
+        /// (in percent) over the interval since the previous sample, for the whole machine, per logical core and, on Apple silicon,
+        /// per cluster (performance and efficiency cores); elsewhere every core counts as a performance core.
+        /// </summary>
+        /// <remarks>
+        /// Every poller should own a sampler: the interval a sample covers is the one since the previous sample of the same sampler.
+        /// </remarks>
+        public sealed class CpuUtilizationSampler : IDisposable
+        {
+            private readonly object m_lock = new object();
+            private IntPtr m_nativeSampler;
+
+            // Linux only: busy and total ticks of every logical core at the previous sample
+            private ulong[] m_busyTicks = new ulong[0];
+            private ulong[] m_totalTicks = new ulong[0];
+
+            /// <nodoc />
+            public CpuUtilizationSampler()
+            {
+                m_nativeSampler = IsMacOS ? Impl_Mac.CreateCpuUtilizationSampler() : IntPtr.Zero;
+            }
+
+            /// <summary>
+            /// Samples the utilization since the previous sample (since boot for the first one).  If <paramref name="coreUtilization"/>
+            /// is not null, the utilization of each of its first <see cref="CpuUtilization.NumCores"/> logical cores is stored in it.
+            /// </summary>
+            /// <returns>0 on success, an error code otherwise</returns>
+            public int Sample(ref CpuUtilization utilization, double[] coreUtilization = null)
+            {
+                lock (m_lock)
+                {
+                    if (!IsMacOS)
+                    {
+                        return Impl_Linux.SampleCpuUtilization(ref m_busyTicks, ref m_totalTicks, ref utilization, coreUtilization);
+                    }
+
+                    if (m_nativeSampler == IntPtr.Zero)
+                    {
+                        return ERROR;
+                    }
+
+                    return Impl_Mac.SampleCpuUtilization(
+                        m_nativeSampler,
+                        ref utilization,
+                        coreUtilization,
+                        coreUtilization?.Length ?? 0,
+                        Marshal.SizeOf(utilization));
+                }
+            }
+
+            /// <inheritdoc />
+            public void Dispose()
+            {
+                lock (m_lock)
+                {
+                    if (m_nativeSampler != IntPtr.Zero)
+                    {
+                        Impl_Mac.ReleaseCpuUtilizationSampler(m_nativeSampler);
+                        m_nativeSampler = IntPtr.Zero;
+                    }
+                }
+            }
+        }
     }
 }
@@ -57,6 +57,13 @@ namespace BuildXL.Interop.Unix
         [DllImport(Libraries.BuildXLInteropLibMacOS, SetLastError = true)]
         public static extern void DeinitializeSandbox();
 
+        /// <summary>
+        /// Hybrid sandbox only: enables the per executable choice of the source its processes are observed with, whose statistics
+        /// (and decisions) persist in <paramref name="cachePath"/> across builds. Must be called before any pip starts.
+        /// </summary>
+        [DllImport(Libraries.BuildXLInteropLibMacOS, CallingConvention = CallingConvention.Cdecl, CharSet = CharSet.Ansi)]
+        public static extern void SetHybridBackendCache(string cachePath);
+
         [DllImport(Libraries.BuildXLInteropLibMacOS, CallingConvention=CallingConvention.Cdecl, CharSet = CharSet.Ansi)]
         public static extern void ObserverFileAccessReports(
             ref SandboxConnectionInfo info,
@@ -82,12 +89,27 @@ namespace BuildXL.Interop.Unix
         public static void InitializeKextConnection(ref KextConnectionInfo info)
             => InitializeKextConnection(ref info, Marshal.SizeOf(info));
 
+        /// <summary>
+        /// The maximum number of report queues the kernel extension creates for a client.
+        /// CODESYNC: Public/Src/Sandbox/MacOs/Sandbox/Src/BuildXLSandboxShared.hpp :: kMaxReportQueues
+        /// </summary>
+        public const int MaxReportQueues = 8;
+
+        /// <summary>
+        /// The report queues of a client (the first <see cref="QueueCount"/> elements of the arrays), each to be drained by its own thread.
+        /// CODESYNC: Public/Src/Sandbox/MacOs/Interop/Sandbox/KextSandbox.hpp
+        /// </summary>
         [StructLayout(LayoutKind.Sequential)]
         public struct KextSharedMemoryInfo
         {
             public int Error;
-            public ulong Address;
-            public uint Port;
+            public uint QueueCount;
+
+            [MarshalAs(UnmanagedType.ByValArray, SizeConst = MaxReportQueues)]
+            public ulong[] Addresses;
+
+            [MarshalAs(UnmanagedType.ByValArray, SizeConst = MaxReportQueues)]
+            public uint[] Ports;
         }
 
         [DllImport(Libraries.BuildXLInteropLibMacOS, CallingConvention = CallingConvention.Cdecl)]
@@ -226,6 +248,12 @@ namespace BuildXL.Interop.Unix
 
             [MarshalAs(UnmanagedType.U4)][FieldOffset(40)]
             public uint NumHardLinkRetries;
+
+            /// <summary>
+            /// Offset of the stats of the pip in the schema shared by the sandboxes (a <c>SandboxStats</c>, see SandboxStats.h),
+            /// which the engine reads from <see cref="AccessReport.PathOrPipStats"/> itself.
+            /// </summary>
+            public const int SandboxStatsOffset = 48;
         }
 
         /// <remarks>
@@ -307,6 +335,20 @@ namespace BuildXL.Interop.Unix
             ulong address,
             uint port);
 
+        /// <summary>
+        /// Receives up to <c>kAccessReportBatchSize</c> consecutive <see cref="AccessReport"/> structs at <paramref name="reports"/>;
+        /// the memory is only valid for the duration of the call.  On errors <paramref name="count"/> is 0.
+        /// </summary>
+        [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+        public delegate void AccessReportBatchCallback(IntPtr reports, int count, int error);
+
+        [DllImport(Libraries.BuildXLInteropLibMacOS, CallingConvention=CallingConvention.Cdecl, CharSet = CharSet.Ansi)]
+        public static extern void ListenForFileAccessReportBatches(
+            [MarshalAs(UnmanagedType.FunctionPtr)] AccessReportBatchCallback callbackPointer,
+            long accessReportSize,
+            ulong address,
+            uint port);
+
         /// <summary>
         /// Callback the kernel extension can use to report any unrecoverable failures.
         ///
@@ -16,5 +16,11 @@ namespace BuildXL.Native.Processes
 
         /// <nodoc />
         uint Inject(uint processId, bool inheritedHandles);
+
+        /// <summary>
+        /// Moves a running process, created with <c>FileAccessManifest.AllowManifestRetarget</c>, to the manifest of this injector. Waits for
+        /// the process to switch (which it gives up on after <paramref name="timeoutMs"/> without a quiescent point) and returns a Win32 error code.
+        /// </summary>
+        uint Retarget(uint processId, uint timeoutMs);
     }
 }
@@ -27,6 +27,9 @@ namespace BuildXL.Native.Processes
         /// <summary><see cref="ProcessUtilities.NormalizeAndHashPath"/></summary>
         int NormalizeAndHashPath(string path, out byte[] normalizedPathBytes);
 
+        /// <summary><see cref="ProcessUtilities.NormalizeAndHashPaths"/></summary>
+        void NormalizeAndHashPaths(IReadOnlyList<string> paths, byte[][] normalizedPathBytes, int[] hashes);
+
         /// <summary><see cref="ProcessUtilities.AreBuffersEqual"/></summary>
         bool AreBuffersEqual(byte[] buffer1, byte[] buffer2);
 
@@ -70,6 +70,17 @@ namespace BuildXL.Native.Processes
         public static int NormalizeAndHashPath(string path, out byte[] bytes)
             => s_nativeMethods.NormalizeAndHashPath(path, out bytes);
 
+        /// <summary>
+        /// Same as <see cref="NormalizeAndHashPath"/> for each of the paths, with a single call into native.
+        ///
+        /// The normalized path and the hash code of the i-th path are stored in the i-th elements of <paramref name="normalizedPathBytes"/>
+        /// and <paramref name="hashes"/>.
+        /// 
+        /// @requires paths != null, and normalizedPathBytes and hashes have (at least) as many elements as paths
+        /// </summary>
+        public static void NormalizeAndHashPaths(IReadOnlyList<string> paths, byte[][] normalizedPathBytes, int[] hashes)
+            => s_nativeMethods.NormalizeAndHashPaths(paths, normalizedPathBytes, hashes);
+
         /// <summary>
         /// Returns if two native buffers are equal up to a given number of elements.
         /// 
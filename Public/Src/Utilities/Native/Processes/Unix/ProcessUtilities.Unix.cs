@@ -46,6 +46,19 @@ namespace BuildXL.Native.Processes.Unix
             return Sandbox.NormalizePathAndReturnHash(pathBytes, normalizedPathBytes);
         }
 
+        /// <inheritdoc />
+        public void NormalizeAndHashPaths(IReadOnlyList<string> paths, byte[][] normalizedPathBytes, int[] hashes)
+        {
+            Contract.Requires(paths != null);
+            Contract.Requires(normalizedPathBytes != null && normalizedPathBytes.Length >= paths.Count);
+            Contract.Requires(hashes != null && hashes.Length >= paths.Count);
+
+            for (int i = 0; i < paths.Count; i++)
+            {
+                hashes[i] = NormalizeAndHashPath(paths[i], out normalizedPathBytes[i]);
+            }
+        }
+
         /// <inheritdoc />
         public bool AreBuffersEqual(byte[] buffer1, byte[] buffer2)
         {
@@ -52,6 +52,13 @@ namespace BuildXL.Native.Processes.Windows
             return DetouredProcessInjector_Inject64(m_injector, processId, inheritedHandles);
         }
 
+        /// <inheritdoc />
+        public uint Retarget(uint processId, uint timeoutMs)
+        {
+            Assert64Process();
+            return DetouredProcessInjector_Retarget64(m_injector, processId, timeoutMs);
+        }
+
         /// <nodoc />
         public void Dispose()
         {
@@ -104,6 +111,15 @@ namespace BuildXL.Native.Processes.Windows
             uint processId,
             [MarshalAs(UnmanagedType.Bool)]
             bool inheritedHandles);
+
+        [DllImport(ExternDll.BuildXLNatives64, EntryPoint = "DetouredProcessInjector_Retarget", SetLastError = true)]
+        [return: MarshalAs(UnmanagedType.U4)]
+        private static extern uint DetouredProcessInjector_Retarget64(
+            IntPtr injector,
+            [MarshalAs(UnmanagedType.U4)]
+            uint processId,
+            [MarshalAs(UnmanagedType.U4)]
+            uint timeoutMs);
     }
 }
 
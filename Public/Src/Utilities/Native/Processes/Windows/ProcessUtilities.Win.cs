@@ -42,6 +42,53 @@ namespace BuildXL.Native.Processes.Windows
             }
         }
 
+        /// <inheritdoc />
+        public void NormalizeAndHashPaths(IReadOnlyList<string> paths, byte[][] normalizedPathBytes, int[] hashes)
+        {
+            Contract.Requires(paths != null);
+            Contract.Requires(normalizedPathBytes != null && normalizedPathBytes.Length >= paths.Count);
+            Contract.Requires(hashes != null && hashes.Length >= paths.Count);
+            Assert64Process();
+
+            if (paths.Count == 0)
+            {
+                return;
+            }
+
+            // The paths are passed one after the other, each followed by its null terminator (the zeros the array is initialized with)
+            int length = 0;
+            for (int i = 0; i < paths.Count; i++)
+            {
+                length += paths[i].Length + 1;
+            }
+
+            char[] input = new char[length];
+            char[] output = new char[length];
+            int offset = 0;
+            for (int i = 0; i < paths.Count; i++)
+            {
+                paths[i].CopyTo(0, input, offset, paths[i].Length);
+                offset += paths[i].Length + 1;
+            }
+
+            fixed (char* pInput = input)
+            fixed (char* pOutput = output)
+            fixed (int* pHashes = hashes)
+            {
+                int normalized = ExternNormalizeAndHashPaths(pInput, pOutput, length, pHashes, paths.Count);
+                Contract.Assert(normalized == paths.Count);
+            }
+
+            offset = 0;
+            for (int i = 0; i < paths.Count; i++)
+            {
+                int byteLength = (paths[i].Length + 1) * sizeof(char);
+                normalizedPathBytes[i] = new byte[byteLength];
+                Buffer.BlockCopy(output, offset * sizeof(char), normalizedPathBytes[i], 0, byteLength);
+                offset += paths[i].Length + 1;
+            }
+        }
+
         /// <inheritdoc />
         /// <remarks>
         /// It is not clear why we call into native to compare the content of 2 byte arrays (using 'memcmp') instead of doing it right here.
@@ -279,6 +326,9 @@ namespace BuildXL.Native.Processes.Windows
             [MarshalAs(UnmanagedType.LPWStr)] string path,
             byte* buffer, int bufferLength);
 
+        [DllImport(ExternDll.BuildXLNatives64, EntryPoint = "NormalizeAndHashPaths")]
+        private static extern unsafe int ExternNormalizeAndHashPaths(char* paths, char* buffer, int length, int* hashes, int pathCount);
+
         [DllImport(ExternDll.BuildXLNatives64, EntryPoint = "AreBuffersEqual")]
         [return: MarshalAs(UnmanagedType.Bool)]
         private static extern bool ExternAreBuffersEqual(byte* buffer1, byte* buffer2, int bufferLength);
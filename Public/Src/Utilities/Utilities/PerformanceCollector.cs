@@ -54,7 +54,7 @@ namespace BuildXL.Utilities
         // Used for calculating the Machine CPU time
         private DateTime m_machineTimeLastCollectedAt = DateTime.MinValue;
         private long m_machineTimeLastVale;
-        private CpuLoadInfo m_lastCpuLoadInfo;
+        private readonly CpuUtilizationSampler m_cpuUtilizationSampler = OperatingSystemHelper.IsUnixOS ? new CpuUtilizationSampler() : null;
 
         // Used for collecting disk activity
         private readonly (DriveInfo driveInfo, SafeFileHandle safeFileHandle, DISK_PERFORMANCE diskPerformance)[] m_drives;
@@ -443,6 +443,8 @@ namespace BuildXL.Utilities
             {
                 m_modifiedPageSizeWMIQuery?.Dispose();
             }
+
+            m_cpuUtilizationSampler?.Dispose();
         }
 
         #region Perf data collection implementations
@@ -647,31 +649,11 @@ namespace BuildXL.Utilities
 
         private double? GetMachineCpuUnix()
         {
-            double? machineCpu = null;
-
-            var buffer = new CpuLoadInfo();
-
-            // Initialize the CPU load info
-            if (m_lastCpuLoadInfo.SystemTime == 0 && m_lastCpuLoadInfo.UserTime == 0 && m_lastCpuLoadInfo.IdleTime == 0)
-            {
-                GetCpuLoadInfo(ref buffer);
-                m_lastCpuLoadInfo = buffer;
-            }
-
-            buffer = new CpuLoadInfo();
-            if (GetCpuLoadInfo(ref buffer) == MACOS_INTEROP_SUCCESS)
-            {
-                double systemTicks = buffer.SystemTime - m_lastCpuLoadInfo.SystemTime;
-                double userTicks = buffer.UserTime - m_lastCpuLoadInfo.UserTime;
-                double idleTicks = buffer.IdleTime - m_lastCpuLoadInfo.IdleTime;
-                double totalTicks = systemTicks + userTicks + idleTicks;
-
-                machineCpu = 100.0 * ((systemTicks + userTicks) / totalTicks);
-            }
-
-            m_lastCpuLoadInfo = buffer;
-
-            return machineCpu;
+            // The sampler keeps the ticks of the previous sample, each sample covers the interval since the previous collection
+            var utilization = new CpuUtilization();
+            return m_cpuUtilizationSampler.Sample(ref utilization) == MACOS_INTEROP_SUCCESS
+                ? utilization.Utilization
+                : (double?)null;
         }
 
         #endregion